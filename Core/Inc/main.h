@@ -41,7 +41,30 @@ extern "C" {
 
 /* Exported constants --------------------------------------------------------*/
 /* USER CODE BEGIN EC */
-
+/* PLL source shared by PLL1 (system) and PLL2 (audio). USE_AUDIO_CLOCK_HSE
+   runs them from the crystal, HSE_VALUE must then be the board frequency */
+#ifdef USE_AUDIO_CLOCK_HSE
+#ifndef CLOCK_HSE_STATE
+#define CLOCK_HSE_STATE               RCC_HSE_ON   /* RCC_HSE_BYPASS for an oscillator or the ST-LINK MCO */
+#endif /* CLOCK_HSE_STATE */
+#define CLOCK_PLL_SOURCE              RCC_PLLSOURCE_HSE
+#define CLOCK_PLL_SOURCE_HZ           HSE_VALUE
+#else /* USE_AUDIO_CLOCK_HSE */
+#define CLOCK_PLL_SOURCE              RCC_PLLSOURCE_HSI
+#define CLOCK_PLL_SOURCE_HZ           HSI_VALUE
+#endif /* USE_AUDIO_CLOCK_HSE */
+#if (CLOCK_PLL_SOURCE_HZ < 8000000UL)
+#error "the PLL source must be 8 MHz at least for the 8 to 16 MHz PLL input range"
+#endif /* CLOCK_PLL_SOURCE_HZ */
+/* smallest divider bringing the source in the 8 to 16 MHz input range */
+#define CLOCK_PLL_M                   ((CLOCK_PLL_SOURCE_HZ + 15999999UL) / 16000000UL)
+#define CLOCK_PLL_REF_HZ              (CLOCK_PLL_SOURCE_HZ / CLOCK_PLL_M)
+/* VCO multiplier in 1/8192 steps, split in N and FRACN */
+#define CLOCK_PLL_MULT(vco_hz)        ((uint32_t)((((uint64_t)(vco_hz) << 13) + (CLOCK_PLL_REF_HZ / 2U)) / CLOCK_PLL_REF_HZ))
+#define CLOCK_PLL_N(vco_hz)           (CLOCK_PLL_MULT(vco_hz) >> 13)
+#define CLOCK_PLL_FRACN(vco_hz)       (CLOCK_PLL_MULT(vco_hz) & 0x1FFFU)
+/* PLL1 VCO, P divider 1 : 550 MHz system clock */
+#define CLOCK_SYSTEM_VCO_HZ           550000000UL
 /* USER CODE END EC */
 
 /* Exported macro ------------------------------------------------------------*/
@@ -53,6 +76,10 @@ extern "C" {
 void Error_Handler(void);
 
 /* USER CODE BEGIN EFP */
+#ifdef USE_AUDIO_IDLE_POWER
+/* also called by the idle power manager to restore the clocks after STOP */
+void SystemClock_Config(void);
+#endif /* USE_AUDIO_IDLE_POWER */
 
 /* USER CODE END EFP */
 
@@ -22,6 +22,94 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "audio_speaker_node.h"
+#include "audio_mic_node.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_PUMP_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+#ifdef USE_AUDIO_CDC_COMMAND
+#include "audio_cdc_command.h"
+#endif /* USE_AUDIO_CDC_COMMAND */
+#ifdef USE_AUDIO_TAP
+#include "audio_tap.h"
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#if (defined USE_AUDIO_MIC_PATTERN) || (defined USE_AUDIO_SPEAKER_PATTERN)
+#include "audio_pattern.h"
+#endif /* USE_AUDIO_MIC_PATTERN || USE_AUDIO_SPEAKER_PATTERN */
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "audio_sof_align.h"
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_TRACE
+#include "audio_trace.h"
+#endif /* USE_AUDIO_TRACE */
+#ifdef USE_AUDIO_LOG
+#include "audio_log.h"
+#endif /* USE_AUDIO_LOG */
+#if (defined USE_AUDIO_PROFILER) || (defined USE_AUDIO_BOOT_PROFILE)
+#include "audio_profiler.h"
+#endif /* USE_AUDIO_PROFILER || USE_AUDIO_BOOT_PROFILE */
+#ifdef USE_AUDIO_LOOPBACK
+#include "audio_loopback.h"
+#endif /* USE_AUDIO_LOOPBACK */
+#ifdef USE_AUDIO_CDC_STRESS
+#include "audio_cdc_stress.h"
+#endif /* USE_AUDIO_CDC_STRESS */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+#include "audio_cdc_bridge.h"
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+#ifdef USE_AUDIO_CODEC_I2C
+#include "audio_codec.h"
+#endif /* USE_AUDIO_CODEC_I2C */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#include "audio_clip.h"
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "audio_bulk_capture.h"
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+#include "audio_vendor_request.h"
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_PARAMS_STORE
+#include "audio_params.h"
+#endif /* USE_AUDIO_PARAMS_STORE */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+#include "audio_fault.h"
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+#include "audio_snapshot.h"
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_copy.h"
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_FAST_COPY
+#include "audio_fast_copy.h"
+#endif /* USE_AUDIO_FAST_COPY */
+#ifdef USE_AUDIO_ISR_LATENCY
+#include "audio_isr_latency.h"
+#endif /* USE_AUDIO_ISR_LATENCY */
+#ifdef USE_AUDIO_CPU_LOAD
+#include "audio_cpu_load.h"
+#endif /* USE_AUDIO_CPU_LOAD */
+#ifdef USE_AUDIO_SOF_JITTER
+#include "audio_sof_jitter.h"
+#endif /* USE_AUDIO_SOF_JITTER */
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_HW_CONTROLS
+#include "audio_controls.h"
+#endif /* USE_AUDIO_HW_CONTROLS */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+#include "audio_user_devices.h"
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
 
 /* USER CODE END Includes */
 
@@ -43,16 +131,27 @@
 /* Private variables ---------------------------------------------------------*/
 
 /* USER CODE BEGIN PV */
+#ifdef USE_AUDIO_DUMMY_MIC
 uint16_t bufferIn[192]={0};
 uint32_t bufferLen=0;
 uint16_t valueIn=0;
+#endif /* USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+AUDIO_BufferRegionTypeDef speakerData;
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
+static void MPU_Config(void);
 static void MX_GPIO_Init(void);
 /* USER CODE BEGIN PFP */
-
+#ifdef USE_AUDIO_DUMMY_MIC
+static void MicSpaceHandler(void);
+#endif /* USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+static void SpeakerDataHandler(void);
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
 /* USER CODE END PFP */
 
 /* Private user code ---------------------------------------------------------*/
@@ -67,6 +166,43 @@ void USBD_error_handler(void)
 {
 Error_Handler();
 }
+
+#ifdef USE_AUDIO_DUMMY_MIC
+/**
+  * @brief  Fills the mic buffer while it has room, run from the audio pump.
+  * @param  None
+  * @retval None
+  */
+static void MicSpaceHandler(void)
+{
+  while((bufferLen=AUDIO_GetPacketLength()) > 0)//check if we have space in buffer
+  {
+    /* with USE_AUDIO_MIC_PATTERN the mic node numbers every frame over these marks */
+    bufferIn[0]=valueIn;//marks in buffer to check them in usb analyzer
+    bufferIn[95]=valueIn+1;
+    bufferIn[96]=valueIn+2;
+    bufferIn[191]=valueIn+3;
+    AUDIO_SendINData((uint8_t*)bufferIn,bufferLen);//send new data if buffer have space
+    valueIn++;
+  }
+}
+#endif /* USE_AUDIO_DUMMY_MIC */
+
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+/**
+  * @brief  Consumes the received speaker packets, run from the audio pump.
+  * @param  None
+  * @retval None
+  */
+static void SpeakerDataHandler(void)
+{
+  while(AUDIO_AcquireSpeakerData(&speakerData)>0)
+  {
+    /* packet is consumed in place from speakerData, then given back to the USB side */
+    AUDIO_ReleaseSpeakerData();
+  }
+}
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
 /* USER CODE END 0 */
 
 /**
@@ -76,16 +212,32 @@ Error_Handler();
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+#ifdef USE_AUDIO_BOOT_PROFILE
+  AUDIO_BootProfileInit();
+#endif /* USE_AUDIO_BOOT_PROFILE */
   /* USER CODE END 1 */
 
+  /* MPU Configuration--------------------------------------------------------*/
+  MPU_Config();
+
+  /* Enable the CPU Cache */
+
+  /* Enable I-Cache---------------------------------------------------------*/
+  SCB_EnableICache();
+
+  /* Enable D-Cache---------------------------------------------------------*/
+  SCB_EnableDCache();
+
   /* MCU Configuration--------------------------------------------------------*/
 
   /* Reset of all peripherals, Initializes the Flash interface and the Systick. */
   HAL_Init();
 
   /* USER CODE BEGIN Init */
-
+  AUDIO_BOOT_MARK(AUDIO_BOOT_CORE);
+#ifdef USE_AUDIO_ISR_LATENCY
+  AUDIO_IsrLatencyInit();
+#endif /* USE_AUDIO_ISR_LATENCY */
 
   /* USER CODE END Init */
 
@@ -93,31 +245,140 @@ int main(void)
   SystemClock_Config();
 
   /* USER CODE BEGIN SysInit */
-
+  AUDIO_BOOT_MARK(AUDIO_BOOT_CLOCK);
+#ifdef USE_AUDIO_PROFILER
+  AUDIO_ProfilerInit();
+#elif (defined USE_AUDIO_PACKET_QUEUE) || (defined USE_AUDIO_TRACE) || (defined USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY) || \
+      (defined USE_AUDIO_SOF_ALIGN) || (defined USE_AUDIO_FAST_COPY) || (defined USE_AUDIO_ISO_SLACK) || \
+      (defined USE_AUDIO_BENCH) || (defined USE_AUDIO_BULK_CAPTURE) || (defined USE_AUDIO_FAULT_INJECTION)
+  /* packets, trace records, SOF and capture blocks are time stamped, copies and fault delays timed, with the DWT cycle counter, locked after reset */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->LAR = 0xC5ACCE55U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif /* USE_AUDIO_PROFILER */
+  AUDIO_PumpInit();
+#ifdef USE_AUDIO_TRACE
+  AUDIO_TraceInit();
+#endif /* USE_AUDIO_TRACE */
+#ifdef USE_AUDIO_LOG
+  AUDIO_LogInit();
+#endif /* USE_AUDIO_LOG */
+#ifdef USE_AUDIO_CPU_LOAD
+  AUDIO_CpuLoadInit();
+#endif /* USE_AUDIO_CPU_LOAD */
+#ifdef USE_AUDIO_DUMMY_MIC
+  AUDIO_PumpSetHandler(AUDIO_PUMP_MIC_SPACE, MicSpaceHandler);
+#endif /* USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SPEAKER_DATA, SpeakerDataHandler);
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifdef USE_AUDIO_CDC_COMMAND
+  AUDIO_CdcCommandInit();
+#endif /* USE_AUDIO_CDC_COMMAND */
+#ifdef USE_AUDIO_TAP
+  AUDIO_TapInit();
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SPECTRUM
+  AUDIO_SpectrumInit();
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_SOF_ALIGN
+  AUDIO_SofAlignInit();
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_SOF_JITTER
+  AUDIO_SofJitterInit();
+#endif /* USE_AUDIO_SOF_JITTER */
+#ifdef USE_AUDIO_MIC_PATTERN
+  AUDIO_PatternInit();
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+  AUDIO_PatternCheckInit();
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+#ifdef USE_AUDIO_LOOPBACK
+  AUDIO_LoopbackInit();
+#endif /* USE_AUDIO_LOOPBACK */
+#ifdef USE_AUDIO_CDC_STRESS
+  AUDIO_CdcStressInit();
+#endif /* USE_AUDIO_CDC_STRESS */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+  AUDIO_CdcBridgeInit();
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+#ifdef USE_AUDIO_CODEC_I2C
+  AUDIO_CodecInit();
+#endif /* USE_AUDIO_CODEC_I2C */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  AUDIO_ClipInit();
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_BULK_CAPTURE
+  AUDIO_BulkCaptureInit();
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+  AUDIO_VendorRequestInit();
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+  AUDIO_DummyClockInit();
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+  AUDIO_FaultInit();
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+  AUDIO_SnapshotInit();
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_MDMA_COPY
+  AUDIO_CopyInit();
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_FAST_COPY
+  /* measured with the MDMA, before the USB device may start a stream */
+  AUDIO_FastCopyInit();
+#endif /* USE_AUDIO_FAST_COPY */
+#ifdef USE_AUDIO_IDLE_POWER
+  AUDIO_PowerInit();
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_PARAMS_STORE
+  /* read before the sessions restore it */
+  AUDIO_ParamsInit();
+#endif /* USE_AUDIO_PARAMS_STORE */
+#ifdef USE_AUDIO_HW_CONTROLS
+  AUDIO_ControlsInit();
+#endif /* USE_AUDIO_HW_CONTROLS */
+  AUDIO_BOOT_MARK(AUDIO_BOOT_SYSINIT);
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
   MX_USB_DEVICE_Init();
   /* USER CODE BEGIN 2 */
-
+#ifdef USE_AUDIO_PUMP_FREERTOS
+  /* the pump levels run as tasks from here, the loop below is not reached */
+  if(AUDIO_PumpStartTasks() != 0)
+  {
+    Error_Handler();
+  }
+  vTaskStartScheduler();
+#endif /* USE_AUDIO_PUMP_FREERTOS */
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
   while (1)
   {
-    bufferLen=AUDIO_GetPacketLength();//check if we have space in buffer
-    if(bufferLen>0){
-      bufferIn[0]=valueIn;//marks in buffer to check them in usb analyzer
-      bufferIn[95]=valueIn+1;
-      bufferIn[96]=valueIn+2;
-      bufferIn[191]=valueIn+3;
-      AUDIO_SendINData(bufferIn,bufferLen*2);//send new data if buffer have space
-      valueIn++;
-    }
-
-    AUDIO_GetSpeakerData();
+#ifdef USE_AUDIO_PARAMS_STORE
+    /* flash is only written from here, the tick wakes the loop each ms */
+    AUDIO_ParamsPoll();
+#endif /* USE_AUDIO_PARAMS_STORE */
+#if (defined USE_AUDIO_ISR_LATENCY) && (defined USE_AUDIO_PROFILER)
+    AUDIO_IsrLatencyPoll();
+#endif /* USE_AUDIO_ISR_LATENCY && USE_AUDIO_PROFILER */
+    /* audio work is posted by USB interrupts and runs from PendSV, sleep until next interrupt */
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerIdle();
+#elif (defined USE_AUDIO_CPU_LOAD)
+    /* masked, so the idle time is counted before the waking handler runs */
+    __disable_irq();
+    AUDIO_CpuLoadWfi();
+    __enable_irq();
+#else /* USE_AUDIO_IDLE_POWER */
+    __WFI();
+#endif /* USE_AUDIO_IDLE_POWER */
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -152,16 +413,21 @@ void SystemClock_Config(void)
   RCC_OscInitStruct.HSIState = RCC_HSI_DIV1;
   RCC_OscInitStruct.HSICalibrationValue = 64;
   RCC_OscInitStruct.HSI48State = RCC_HSI48_ON;
+#ifdef USE_AUDIO_CLOCK_HSE
+  /* HSI is kept on : it clocks the system while idle and after STOP */
+  RCC_OscInitStruct.OscillatorType |= RCC_OSCILLATORTYPE_HSE;
+  RCC_OscInitStruct.HSEState = CLOCK_HSE_STATE;
+#endif /* USE_AUDIO_CLOCK_HSE */
   RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
-  RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
-  RCC_OscInitStruct.PLL.PLLM = 4;
-  RCC_OscInitStruct.PLL.PLLN = 34;
+  RCC_OscInitStruct.PLL.PLLSource = CLOCK_PLL_SOURCE;
+  RCC_OscInitStruct.PLL.PLLM = CLOCK_PLL_M;
+  RCC_OscInitStruct.PLL.PLLN = CLOCK_PLL_N(CLOCK_SYSTEM_VCO_HZ);
   RCC_OscInitStruct.PLL.PLLP = 1;
   RCC_OscInitStruct.PLL.PLLQ = 2;
   RCC_OscInitStruct.PLL.PLLR = 2;
   RCC_OscInitStruct.PLL.PLLRGE = RCC_PLL1VCIRANGE_3;
   RCC_OscInitStruct.PLL.PLLVCOSEL = RCC_PLL1VCOWIDE;
-  RCC_OscInitStruct.PLL.PLLFRACN = 3072;
+  RCC_OscInitStruct.PLL.PLLFRACN = CLOCK_PLL_FRACN(CLOCK_SYSTEM_VCO_HZ);
   if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
   {
     Error_Handler();
@@ -222,6 +488,69 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE END 4 */
 
+ /* MPU Configuration */
+
+void MPU_Config(void)
+{
+  MPU_Region_InitTypeDef MPU_InitStruct = {0};
+
+  /* Disables the MPU */
+  HAL_MPU_Disable();
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  /* background region : no access outside of memories and peripherals,
+     prevents speculative reads to external memory areas */
+  MPU_InitStruct.Enable = MPU_REGION_ENABLE;
+  MPU_InitStruct.Number = MPU_REGION_NUMBER0;
+  MPU_InitStruct.BaseAddress = 0x0;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_4GB;
+  MPU_InitStruct.SubRegionDisable = 0x87;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL0;
+  MPU_InitStruct.AccessPermission = MPU_REGION_NO_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+
+  /** Initializes and configures the Region and the memory to be protected
+  */
+  /* D2 SRAM1 holds the USB DMA buffers (USBD_D2_BSS) : normal memory, not
+     cacheable, so packets shared by the CPU and the DMA need no maintenance */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER1;
+  MPU_InitStruct.BaseAddress = 0x30000000;
+  MPU_InitStruct.Size = MPU_REGION_SIZE_32KB;
+  MPU_InitStruct.SubRegionDisable = 0x0;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+  /* long delay store : the OCTOSPI memory mapped PSRAM is in the no access part
+     of the background region, the copy engine reads and writes it with the CPU
+     for its short moves and on a MDMA error. Normal memory, not cacheable, as
+     the MDMA moves the other blocks. The store size is a power of two */
+  MPU_InitStruct.Number = MPU_REGION_NUMBER2;
+  MPU_InitStruct.BaseAddress = AUDIO_LONG_DELAY_STORE_BASE;
+  MPU_InitStruct.Size = (uint8_t)(30U - __CLZ(AUDIO_LONG_DELAY_STORE_SIZE));
+  MPU_InitStruct.SubRegionDisable = 0x0;
+  MPU_InitStruct.TypeExtField = MPU_TEX_LEVEL1;
+  MPU_InitStruct.AccessPermission = MPU_REGION_FULL_ACCESS;
+  MPU_InitStruct.DisableExec = MPU_INSTRUCTION_ACCESS_DISABLE;
+  MPU_InitStruct.IsShareable = MPU_ACCESS_NOT_SHAREABLE;
+  MPU_InitStruct.IsCacheable = MPU_ACCESS_NOT_CACHEABLE;
+  MPU_InitStruct.IsBufferable = MPU_ACCESS_NOT_BUFFERABLE;
+
+  HAL_MPU_ConfigRegion(&MPU_InitStruct);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+  /* Enables the MPU */
+  HAL_MPU_Enable(MPU_PRIVILEGED_DEFAULT);
+
+}
+
 /**
   * @brief  This function is executed in case of error occurrence.
   * @retval None
@@ -22,6 +22,42 @@
 #include "stm32h7xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "audio_pump.h"
+#ifdef USE_AUDIO_PUMP_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+/* port tick handler, port.c does not export it in a header */
+extern void xPortSysTickHandler(void);
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+#include "audio_profiler.h"
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+#include "audio_fault.h"
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+#include "audio_snapshot.h"
+#endif /* USE_AUDIO_SNAPSHOT */
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC)
+#include "audio_user_devices.h"
+#endif /* (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC) */
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_copy.h"
+#endif /* USE_AUDIO_MDMA_COPY */
+#if (defined USE_USBD_DEFERRED_CONTROL) || (defined USE_USB_DEDICATED_EP1) || (defined USE_AUDIO_USB_LOW_RATE)
+#include "usbd_conf.h"
+#endif /* USE_USBD_DEFERRED_CONTROL || USE_USB_DEDICATED_EP1 || USE_AUDIO_USB_LOW_RATE */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+#include "audio_cdc_bridge.h"
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+#ifdef USE_AUDIO_HW_CONTROLS
+#include "audio_controls.h"
+#endif /* USE_AUDIO_HW_CONTROLS */
+#ifdef USE_AUDIO_CODEC_I2C
+#include "audio_codec.h"
+#endif /* USE_AUDIO_CODEC_I2C */
+#include "audio_isr_latency.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -138,6 +174,7 @@ void UsageFault_Handler(void)
   }
 }
 
+#ifndef USE_AUDIO_PUMP_FREERTOS
 /**
   * @brief This function handles System service call via SWI instruction.
   */
@@ -150,6 +187,7 @@ void SVC_Handler(void)
 
   /* USER CODE END SVCall_IRQn 1 */
 }
+#endif /* USE_AUDIO_PUMP_FREERTOS */
 
 /**
   * @brief This function handles Debug monitor.
@@ -164,18 +202,20 @@ void DebugMon_Handler(void)
   /* USER CODE END DebugMonitor_IRQn 1 */
 }
 
+#ifndef USE_AUDIO_PUMP_FREERTOS
 /**
   * @brief This function handles Pendable request for system service.
   */
 void PendSV_Handler(void)
 {
   /* USER CODE BEGIN PendSV_IRQn 0 */
-
+  AUDIO_PumpRun();
   /* USER CODE END PendSV_IRQn 0 */
   /* USER CODE BEGIN PendSV_IRQn 1 */
 
   /* USER CODE END PendSV_IRQn 1 */
 }
+#endif /* USE_AUDIO_PUMP_FREERTOS */
 
 /**
   * @brief This function handles System tick timer.
@@ -187,6 +227,22 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+#ifdef USE_AUDIO_PUMP_FREERTOS
+  /* SVC and PendSV are the port handlers, the tick is shared with the HAL */
+  if(xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED)
+  {
+    xPortSysTickHandler();
+  }
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+  AUDIO_DummyClockTick();
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+  AUDIO_FaultTick();
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+  AUDIO_SnapshotTick();
+#endif /* USE_AUDIO_SNAPSHOT */
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -204,14 +260,170 @@ void SysTick_Handler(void)
 void OTG_HS_IRQHandler(void)
 {
   /* USER CODE BEGIN OTG_HS_IRQn 0 */
-
+  AUDIO_PROF_BEGIN(AUDIO_PROF_PCD_IRQ);
+  AUDIO_ISR_FPU_BEGIN();
+#ifdef USE_AUDIO_USB_LOW_RATE
+  /* sparse iso endpoints : the incompletes before their poll is due are dropped */
+  USBD_LL_IsoIncompleteIRQHandler();
+#endif /* USE_AUDIO_USB_LOW_RATE */
   /* USER CODE END OTG_HS_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_OTG_HS);
   /* USER CODE BEGIN OTG_HS_IRQn 1 */
-
+  AUDIO_ISR_FPU_END();
+  AUDIO_PROF_END(AUDIO_PROF_PCD_IRQ);
   /* USER CODE END OTG_HS_IRQn 1 */
 }
+#ifdef USE_USB_DEDICATED_EP1
+
+/**
+  * @brief This function handles USB On The Go HS End Point 1 Out global interrupt.
+  */
+void OTG_HS_EP1_OUT_IRQHandler(void)
+{
+  AUDIO_PROF_BEGIN(AUDIO_PROF_PCD_IRQ);
+  AUDIO_ISR_FPU_BEGIN();
+  USBD_LL_EP1OutIRQHandler();
+  AUDIO_ISR_FPU_END();
+  AUDIO_PROF_END(AUDIO_PROF_PCD_IRQ);
+}
+
+/**
+  * @brief This function handles USB On The Go HS End Point 1 In global interrupt.
+  */
+void OTG_HS_EP1_IN_IRQHandler(void)
+{
+  AUDIO_PROF_BEGIN(AUDIO_PROF_PCD_IRQ);
+  AUDIO_ISR_FPU_BEGIN();
+  USBD_LL_EP1InIRQHandler();
+  AUDIO_ISR_FPU_END();
+  AUDIO_PROF_END(AUDIO_PROF_PCD_IRQ);
+}
+#endif /* USE_USB_DEDICATED_EP1 */
 
 /* USER CODE BEGIN 1 */
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+/**
+  * @brief This function handles the DMA stream of the SAI speaker.
+  */
+void AUDIO_SPEAKER_DMA_IRQHandler(void)
+{
+  AUDIO_ISR_FPU_BEGIN();
+  HAL_DMA_IRQHandler(&hdma_sai1_a);
+  AUDIO_ISR_FPU_END();
+}
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+/**
+  * @brief This function handles the DMA stream of the SAI mic.
+  */
+void AUDIO_MIC_DMA_IRQHandler(void)
+{
+  AUDIO_ISR_FPU_BEGIN();
+  HAL_DMA_IRQHandler(&hdma_sai1_b);
+  AUDIO_ISR_FPU_END();
+}
+#endif /* USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_MDMA_COPY
+/**
+  * @brief This function handles the MDMA channels of the copy engines.
+  */
+void AUDIO_COPY_MDMA_IRQHandler(void)
+{
+  AUDIO_CopyIRQHandler();
+}
+#endif /* USE_AUDIO_MDMA_COPY */
+#if (defined USE_AUDIO_PUMP_AUDIO_LEVEL) && (defined AUDIO_PUMP_AUDIO_IRQn)
+/**
+  * @brief This function handles the audio level of the pump, pended by software.
+  */
+void AUDIO_PUMP_AUDIO_IRQHandler(void)
+{
+  AUDIO_PumpRunAudio();
+}
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL && AUDIO_PUMP_AUDIO_IRQn */
+#ifdef USE_USBD_DEFERRED_CONTROL
+/**
+  * @brief This function handles the USB control events deferred by the OTG interrupt.
+  */
+void USBD_CTRL_IRQHandler(void)
+{
+  USBD_LL_ControlIRQHandler();
+}
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#if (defined USE_AUDIO_ISR_LATENCY) && (defined USE_AUDIO_PROFILER)
+/**
+  * @brief This function handles the interrupt latency probe, pended by software.
+  */
+void AUDIO_ISR_LATENCY_IRQHandler(void)
+{
+  AUDIO_IsrLatencyIRQHandler();
+}
+#endif /* USE_AUDIO_ISR_LATENCY && USE_AUDIO_PROFILER */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+/**
+  * @brief This function handles the USART of the CDC bridge.
+  */
+void AUDIO_CDC_BRIDGE_UART_IRQHandler(void)
+{
+  AUDIO_CdcBridgeUartIRQHandler();
+}
+
+/**
+  * @brief This function handles the reception DMA stream of the CDC bridge.
+  */
+void AUDIO_CDC_BRIDGE_RX_DMA_IRQHandler(void)
+{
+  AUDIO_CdcBridgeRxDmaIRQHandler();
+}
+
+/**
+  * @brief This function handles the transmission DMA stream of the CDC bridge.
+  */
+void AUDIO_CDC_BRIDGE_TX_DMA_IRQHandler(void)
+{
+  AUDIO_CdcBridgeTxDmaIRQHandler();
+}
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+#ifdef USE_AUDIO_HW_CONTROLS
+/**
+  * @brief This function handles the EXTI lines of the mute button and the volume encoder.
+  */
+void AUDIO_CONTROLS_EXTI_IRQHandler(void)
+{
+  AUDIO_ControlsExtiIRQHandler();
+}
 
+/**
+  * @brief This function handles the sampling timer of the hardware controls.
+  */
+void AUDIO_CONTROLS_TIM_IRQHandler(void)
+{
+  AUDIO_ControlsTimIRQHandler();
+}
+#endif /* USE_AUDIO_HW_CONTROLS */
+#ifdef USE_AUDIO_CODEC_I2C
+/**
+  * @brief This function handles the I2C events of the codec control.
+  */
+void AUDIO_CODEC_I2C_EV_IRQHandler(void)
+{
+  AUDIO_CodecI2cEvIRQHandler();
+}
+
+/**
+  * @brief This function handles the I2C errors of the codec control.
+  */
+void AUDIO_CODEC_I2C_ER_IRQHandler(void)
+{
+  AUDIO_CodecI2cErIRQHandler();
+}
+
+/**
+  * @brief This function handles the transmission DMA stream of the codec control.
+  */
+void AUDIO_CODEC_TX_DMA_IRQHandler(void)
+{
+  AUDIO_CodecTxDmaIRQHandler();
+}
+#endif /* USE_AUDIO_CODEC_I2C */
 /* USER CODE END 1 */
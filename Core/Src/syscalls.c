@@ -29,6 +29,9 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#ifdef USE_AUDIO_LOG
+#include "audio_log.h"
+#endif /* USE_AUDIO_LOG */
 
 
 /* Variables */
@@ -77,6 +80,19 @@ __attribute__((weak)) int _read(int file, char *ptr, int len)
   return len;
 }
 
+#ifdef USE_AUDIO_LOG
+/* queued in the log ring and sent in the background , text which doesn't fit is dropped */
+int _write(int file, char *ptr, int len)
+{
+  (void)file;
+
+  if (len > 0)
+  {
+    AUDIO_LogWrite(ptr, (uint32_t)len);
+  }
+  return len;
+}
+#else /* USE_AUDIO_LOG */
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
   (void)file;
@@ -88,6 +104,7 @@ __attribute__((weak)) int _write(int file, char *ptr, int len)
   }
   return len;
 }
+#endif /* USE_AUDIO_LOG */
 
 int _close(int file)
 {
@@ -93,6 +93,48 @@ LoopFillZerobss:
   cmp r2, r4
   bcc FillZerobss
 
+/* Copy the ITCM code from flash to ITCM */
+  ldr r0, =_sitcm
+  ldr r1, =_eitcm
+  ldr r2, =_siitcm
+  movs r3, #0
+  b LoopCopyItcmInit
+
+CopyItcmInit:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyItcmInit:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyItcmInit
+/* Zero fill the DTCM and D2 SRAM bss segments. */
+  ldr r2, =_sdtcm_bss
+  ldr r4, =_edtcm_bss
+  movs r3, #0
+  b LoopFillZeroDtcm
+
+FillZeroDtcm:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroDtcm:
+  cmp r2, r4
+  bcc FillZeroDtcm
+
+  ldr r2, =_sd2_bss
+  ldr r4, =_ed2_bss
+  b LoopFillZeroD2
+
+FillZeroD2:
+  str  r3, [r2]
+  adds r2, r2, #4
+
+LoopFillZeroD2:
+  cmp r2, r4
+  bcc FillZeroD2
+
 /* Call static constructors */
     bl __libc_init_array
 /* Call the application's entry point.*/
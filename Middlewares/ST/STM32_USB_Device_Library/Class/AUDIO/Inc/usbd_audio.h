@@ -138,12 +138,15 @@
 #define USBD_EP_ATTR_ISOC_ADAPT                                      0x08 /* attribute synchro adaptative  */
 #define USBD_EP_ATTR_ISOC_SYNC                                       0x0C /* attribute synchro synchronous  */
 #define USBD_EP_ATTR_USAGE_FEEDBACK                                  0x10 /* attribute synchro by feedback  */
+#define USBD_EP_ATTR_USAGE_IMPLICIT_FEEDBACK                         0x20 /* data endpoint also giving the feedback */
    
     /* Clock Source Control Selectors */
 #define USBD_AUDIO_CS_CONTROL_UNDEFINED                              0x00
 #define USBD_AUDIO_CS_SAM_FREQ_CONTROL                               0x01
 #define USBD_AUDIO_CS_CLOCK_VALID_CONTROL                            0x02
     /* Clock Selector Control Selectors */
+#define USBD_AUDIO_CX_CLOCK_SELECTOR_CONTROL                         0x01
+    /* Clock Selector Control Selectors */
 #define USBD_AUDIO_CX_CONTROL_UNDEFINED                              0x00
 #define USBD_AUDIO_CX_CLOCK_SELECTOR_CONTROL                         0x01
     /* Clock Multiplier Control Selectors */
@@ -160,19 +163,92 @@
 #define USBD_AUDIO_AS_VAL_ALT_SETTINGS_CONTROL                        0x02 
 #define USBD_AUDIO_AS_AUDIO_DATA_FORMAT_CONTROL                       0x03  
 /* configuration of current implementation of audio class */
-#define USBD_AUDIO_AS_INTERFACE_COUNT                                 2
+#ifdef USE_AUDIO_RECORDING_VOICE
+/* the voice record stream adds one streaming interface and its clock source */
+#define USBD_AUDIO_VOICE_COUNT                                        1
+#else /* USE_AUDIO_RECORDING_VOICE */
+#define USBD_AUDIO_VOICE_COUNT                                        0
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+/* the mixed play stream adds one streaming interface and its feature unit */
+#define USBD_AUDIO_AS_INTERFACE_COUNT                                 (3 + USBD_AUDIO_VOICE_COUNT)
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#define USBD_AUDIO_AS_INTERFACE_COUNT                                 (2 + USBD_AUDIO_VOICE_COUNT)
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #define USBD_AUDIO_MAX_IN_EP                                          5
 #define USBD_AUDIO_MAX_OUT_EP                                         5
-#define USBD_AUDIO_MAX_AS_INTERFACE                                   2
+#define USBD_AUDIO_MAX_AS_INTERFACE                                   USBD_AUDIO_AS_INTERFACE_COUNT
 #define USBD_AUDIO_EP_MAX_CONTROL                                     3
-#define USBD_AUDIO_CONFIG_CONTROL_UNIT_COUNT                          4 /*2 feature unit and 2 clock*/
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* the external clock source and the selector are added */
+#define USBD_AUDIO_CLOCK_SELECTOR_CONTROL_COUNT                       2
+#else /* USE_AUDIO_CLOCK_SELECTOR */
+#define USBD_AUDIO_CLOCK_SELECTOR_CONTROL_COUNT                       0
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#define USBD_AUDIO_CONFIG_CONTROL_UNIT_COUNT                          (5 + USBD_AUDIO_CLOCK_SELECTOR_CONTROL_COUNT + USBD_AUDIO_VOICE_COUNT) /*3 feature unit and 2 clock*/
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#define USBD_AUDIO_CONFIG_CONTROL_UNIT_COUNT                          (4 + USBD_AUDIO_CLOCK_SELECTOR_CONTROL_COUNT + USBD_AUDIO_VOICE_COUNT) /*2 feature unit and 2 clock*/
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #define USBD_AUDIO_FEATURE_MAX_CONTROL                                2  
+/* audio functions registered with USBD_RegisterClassComposite, each has its own class data,
+   endpoints and interrupt table. The instance index is the order of registration.
+   usbd_conf.h sizes USBD_MEM_POOL_SIZE from it */
+#ifndef USBD_AUDIO_MAX_INSTANCES
+#define USBD_AUDIO_MAX_INSTANCES                                      1U
+#endif /* USBD_AUDIO_MAX_INSTANCES */
+/* highest Unit/Clock id, control requests find their unit through a table indexed by id */
+#ifndef USBD_AUDIO_MAX_ENTITY_ID
+#define USBD_AUDIO_MAX_ENTITY_ID                                      0x1F
+#endif /* USBD_AUDIO_MAX_ENTITY_ID */
+#ifdef USE_AUDIO_USB_LOW_RATE
+/* low interrupt rate : the data endpoints carry AUDIO_USB_PACKET_MS of audio per packet,
+   the data endpoint interrupts come AUDIO_USB_PACKET_MS apart. Their FIFOs hold one packet
+   each and a packet still carries 1023 bytes at most (1024 on high speed), usbd_conf.c checks
+   both. With the shipped 96 kHz stereo formats only 2 ms fits (768 bytes at 16 bits), 4 and
+   8 ms need lower max rates, resolutions or channel counts */
+#ifndef USE_USB_AUDIO_CLASS_20
+#error "USE_AUDIO_USB_LOW_RATE needs the audio class 2.0, class 1.0 iso endpoints have a bInterval of 1"
+#endif /* USE_USB_AUDIO_CLASS_20 */
+#ifndef AUDIO_USB_PACKET_MS
+#define AUDIO_USB_PACKET_MS                                           2U
+#endif /* AUDIO_USB_PACKET_MS */
+#if (AUDIO_USB_PACKET_MS == 2U)
+#define AUDIO_FS_BINTERVAL                                            2U
+#define AUDIO_HS_BINTERVAL                                            5U
+#elif (AUDIO_USB_PACKET_MS == 4U)
+#define AUDIO_FS_BINTERVAL                                            3U
+#define AUDIO_HS_BINTERVAL                                            6U
+#elif (AUDIO_USB_PACKET_MS == 8U)
+#define AUDIO_FS_BINTERVAL                                            4U
+#define AUDIO_HS_BINTERVAL                                            7U
+#else /* AUDIO_USB_PACKET_MS */
+#error "AUDIO_USB_PACKET_MS must be 2, 4 or 8"
+#endif /* AUDIO_USB_PACKET_MS */
+#else /* USE_AUDIO_USB_LOW_RATE */
+#define AUDIO_USB_PACKET_MS                                           1U
+#endif /* USE_AUDIO_USB_LOW_RATE */
+/* iso endpoints bInterval, the packet period is 2^(bInterval-1) (micro)frames */
+#ifndef AUDIO_FS_BINTERVAL
+#define AUDIO_FS_BINTERVAL                                            1U
+#endif /* AUDIO_FS_BINTERVAL */
+#ifndef AUDIO_HS_BINTERVAL
+#define AUDIO_HS_BINTERVAL                                            1U
+#endif /* AUDIO_HS_BINTERVAL */
+#ifdef USE_AUDIO_USB_ADMISSION
+/* periodic bytes of a (micro)frame left to the interrupt endpoints of the other classes */
+#ifndef USBD_AUDIO_PERIODIC_RESERVE
+#define USBD_AUDIO_PERIODIC_RESERVE                                   32U
+#endif /* USBD_AUDIO_PERIODIC_RESERVE */
+#endif /* USE_AUDIO_USB_ADMISSION */
 #if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
-#ifdef USE_USB_FS
-#define AUDIO_FEEDBACK_EP_PACKET_SIZE                                 0x03
-#else /* USE_USB_HS*/
-#define AUDIO_FEEDBACK_EP_PACKET_SIZE                                 0x04
-#endif
+#ifndef USE_USB_HS_ULPI_PHY
+#define AUDIO_FEEDBACK_EP_PACKET_SIZE                                 0x03 /* 10.14 format */
+#else /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_FEEDBACK_EP_PACKET_SIZE                                 0x04 /* 16.16 format */
+#endif /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_FEEDBACK_RATE_FRAC_BITS                                 8U /* GetFeedback returns Hz in 24.8 format */
+#define AUDIO_FEEDBACK_SLOT_SIZE                                      4U /* encoded feedback slot, keeps both slots 32-bit aligned */
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
 
 
@@ -276,6 +352,7 @@ typedef struct
    uint16_t MinVolume;
    uint16_t ResVolume;
    int8_t  (*GetStatus)     (uint32_t /*privatedata*/);
+   uint8_t* VolumeRange;    /* optional GET_RANGE payload built by the unit, sent as is */
 }USBD_AUDIO_FeatureControlCallbacksTypeDef;
 
 /* The Clock Source callbacks */
@@ -285,13 +362,23 @@ typedef struct
    int8_t  (*SetCurFrequency) (uint32_t /*freq*/,uint8_t* /*as_cnt_to_restart*/ ,uint8_t* /*as_list_to_restart*/, uint32_t /* privatedata*/);
    int8_t  (*GetCurFrequency) (uint32_t* /* freq*/, uint32_t /* privatedata*/);
    int8_t  (*GetFrequencyList) ( uint32_t** /*freq_list*/,uint8_t* /* max_supported_count*/, uint32_t /* privatedata*/);
+   uint8_t* FrequencyRange;          /* optional GET_RANGE payload built by the clock, sent as is */
+   uint16_t FrequencyRangeLength;
 }USBD_AUDIO_ClockSourceCallbacksTypeDef;
 
+/* The Clock Selector callbacks, pins are numbered from 1 */
+typedef struct
+{
+   int8_t  (*GetCurSelector) (uint8_t* /*pin*/, uint32_t /* privatedata*/);
+   int8_t  (*SetCurSelector) (uint8_t /*pin*/,uint8_t* /*as_cnt_to_restart*/ ,uint8_t* /*as_list_to_restart*/, uint32_t /* privatedata*/);
+}USBD_AUDIO_ClockSelectorCallbacksTypeDef;
+
 /* the Unit callbacks , used when a control is called (Get_Cur, Set Cur ....) */
 typedef union
 {
    USBD_AUDIO_FeatureControlCallbacksTypeDef* feature_control;
    USBD_AUDIO_ClockSourceCallbacksTypeDef* clk_src_control; 
+   USBD_AUDIO_ClockSelectorCallbacksTypeDef* clk_sel_control;
 }USBD_AUDIO_ControlCallbacksTypeDef;
 /** Audio Unit  supported cmd and related callbacks */
 
@@ -316,10 +403,24 @@ typedef struct
    uint8_t* buf;
    uint16_t length;
    int8_t  (*DataReceived)     ( uint16_t/* data_len*/,uint32_t/* privatedata*/); /* called for OUT EP when data is received */
-   uint8_t*  (*GetBuffer)    (uint32_t /* privatedata*/, uint16_t* packet_length); /* called for IN and OUt  EP to get working buffer */
+   int8_t  (*DataMissed)       ( uint32_t/* privatedata*/); /* called for OUT EP when a packet was not received in its frame, may be 0 */
+   uint8_t*  (*GetBuffer)    (uint32_t /* privatedata*/, uint16_t* packet_length); /* called for IN and OUt  EP to get working buffer, 
+                                                                                      with USE_USB_HS_DMA it must be USBD_DMA_BUFFER_ALIGN aligned and DMA reachable,
+                                                                                      with USE_AUDIO_USB_OUT_PINGPONG the OUT EP buffer is taken before DataReceived
+                                                                                      of the previous packet and must not be the one holding it */
    uint16_t  (*GetMaxPacketLength)    (uint32_t /*privatedata*/); /* Called beforre openeing the EP to get Max Size length */
    int8_t  (*GetState)     (uint32_t/*privatedata*/);
    uint32_t  private_data;/* used as the last arguement of each callback */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+   /* IN EP : with StageRequest set, the next packet is taken from GetBuffer by USBD_AUDIO_StageInPacket
+      out of the ISR, the IN complete interrupt only arms it and calls StageRequest for the following one */
+   void    (*StageRequest)     (uint32_t/*privatedata*/); /* called from the ISR, must only schedule the staging */
+   uint8_t* volatile staged_buf;
+   volatile uint16_t staged_length;
+   volatile uint8_t  staged;           /* staged_buf holds the next packet */
+   volatile uint8_t  staging;          /* GetBuffer is running out of the ISR */
+   uint32_t stage_miss_count;          /* packets armed while none was staged */
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
  }  USBD_AUDIO_EP_DataTypeDef;
  
  
@@ -327,9 +428,12 @@ typedef struct
  /* Structure Define a feedback endpoint and it's callbacks */
  typedef struct 
  {
+   uint8_t feedback_data[2][AUDIO_FEEDBACK_SLOT_SIZE]; /* encoded feedback, double buffered , first field to stay 32-bit aligned */
+   uint8_t  feedback_ready; /* slot holding the last encoded rate */
+   uint8_t  feedback_sent;  /* slot given to the last transmit, not written until an other one is sent */
+   uint32_t feedback_rate;  /* rate encoded in the ready slot */
    uint8_t  ep_num; /* endpoint number */
-   uint8_t feedback_data[AUDIO_FEEDBACK_EP_PACKET_SIZE]; /* buffer used to send feedback */
-   uint32_t      (*GetFeedback)     (  uint32_t/* privatedata*/); /* return  count of played sample  since last ResetRate */
+   uint32_t      (*GetFeedback)     (  uint32_t/* privatedata*/); /* return rate to ask host for, Hz with AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits */
    uint32_t private_data;
  }  USBD_AUDIO_EP_SynchTypeDef;
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
@@ -346,7 +450,6 @@ typedef struct USBD_AUDIO_AS_Interface
     uint8_t synch_enabled;
     USBD_AUDIO_EP_SynchTypeDef synch_ep; /* synchro ep description */
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
-    void  (*SofReceived)     ( uint32_t/*privatedata*/);
     int8_t  (*SetAS_Alternate)     ( uint8_t/*alternate*/,uint32_t/*privatedata*/);
     int8_t  (*GetState)     (uint32_t/*privatedata*/);
     uint32_t  private_data; /* used as the last arguement of each callback */      
@@ -374,6 +477,19 @@ typedef struct
     uint32_t private_data;  
 }USBD_AUDIO_InterfaceCallbacksfTypeDef;
  
+#ifdef USE_AUDIO_ISO_SLACK
+#define USBD_AUDIO_SLACK_BINS                8U  /* eighths of a (micro)frame */
+/* Structure define the deadline slack of an ISO endpoint : time left in the
+   frame when the next transfer is handed to the core, from the last SOF */
+typedef struct
+{
+  uint32_t count; /* transfers measured */
+  uint32_t late; /* handed to the core after the frame ended */
+  int16_t  worst_us; /* smallest slack, negative when late */
+  uint32_t hist[USBD_AUDIO_SLACK_BINS]; /* bin n : slack in [n, n+1) eighths of a frame, late ones in bin 0 */
+}USBD_AUDIO_IsoSlackTypeDef;
+#endif /* USE_AUDIO_ISO_SLACK */
+
 #if USBD_AUDIO_SUPPORT_INTERRUPT
 
   typedef enum 
@@ -438,6 +554,10 @@ typedef struct
                                                                 (bytes)[10]= (uint8_t)(((vres) >> 16));\
                                                                 (bytes)[11]= (uint8_t)(((vres) >> 24));\
                                                }while(0);
+#define AUDIO_2_L2_RNG_SIZE                       6U  /* wMIN, wMAX, wRES */
+#define AUDIO_2_L3_RNG_SIZE                       12U /* dMIN, dMAX, dRES */
+/* GET_RANGE payload : wNumSubRanges then the sub-ranges */
+#define AUDIO_2_RNG_PAYLOAD_SIZE(rng_size, count) (2U + ((rng_size) * (count)))
 
 
 #define AUDIO_2_L2_CUR_DATA_TO_VAL(bytes)       (((uint16_t)((bytes)[1]))<<8)|(((uint16_t)((bytes)[0])))
@@ -463,9 +583,40 @@ extern USBD_ClassTypeDef  USBD_AUDIO;
   */ 
 uint8_t  USBD_AUDIO_RegisterInterface  (USBD_HandleTypeDef   *pdev, 
                                         USBD_AUDIO_InterfaceCallbacksfTypeDef *aifc);
+uint32_t USBD_AUDIO_GetIsoINIncompleteCount(USBD_HandleTypeDef *pdev, uint8_t ep_addr);
+uint32_t USBD_AUDIO_GetIsoOUTIncompleteCount(USBD_HandleTypeDef *pdev, uint8_t ep_addr);
+#ifdef USE_AUDIO_USB_ADMISSION
+uint32_t USBD_AUDIO_GetAdmissionRefusedCount(void);
+#endif /* USE_AUDIO_USB_ADMISSION */
+#ifdef USE_AUDIO_ISO_SLACK
+uint8_t  USBD_AUDIO_GetIsoSlack(USBD_HandleTypeDef *pdev, uint8_t ep_addr, USBD_AUDIO_IsoSlackTypeDef* slack);
+#endif /* USE_AUDIO_ISO_SLACK */
 #if USBD_AUDIO_SUPPORT_INTERRUPT
 uint8_t  USBD_AUDIO_SendInterrupt  (USBD_AUDIO_InterruptTypeDef *interrupt);
+uint8_t  USBD_AUDIO_SendInstanceInterrupt(uint8_t instance, USBD_AUDIO_InterruptTypeDef *interrupt);
 #endif /* USBD_AUDIO_SUPPORT_INTERRUPT  */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+void     USBD_AUDIO_StageInPacket(USBD_AUDIO_EP_DataTypeDef* data_ep);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+
+/* Data endpoint callbacks called on each packet. With USE_AUDIO_USB_DIRECT_DISPATCH the build has a single
+   implementation per direction, the USB streaming nodes, then they are called directly instead of through
+   USBD_AUDIO_EP_DataTypeDef pointers. The pointers are still set, the other callbacks still use them */
+#if defined(USE_AUDIO_USB_DIRECT_DISPATCH) && defined(USE_USB_AUDIO_PLAYPBACK)
+int8_t    USB_AUDIO_Streaming_Input_DataReceived(uint16_t data_len, uint32_t node_handle);
+uint8_t*  USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length);
+#define USBD_AUDIO_OUT_DATA_RECEIVED(data_ep, len)  USB_AUDIO_Streaming_Input_DataReceived((len), (data_ep)->private_data)
+#define USBD_AUDIO_OUT_GET_BUFFER(data_ep, plen)    USB_AUDIO_Streaming_Input_GetBuffer((data_ep)->private_data, (plen))
+#else /* USE_AUDIO_USB_DIRECT_DISPATCH && USE_USB_AUDIO_PLAYPBACK */
+#define USBD_AUDIO_OUT_DATA_RECEIVED(data_ep, len)  (data_ep)->DataReceived((len), (data_ep)->private_data)
+#define USBD_AUDIO_OUT_GET_BUFFER(data_ep, plen)    (data_ep)->GetBuffer((data_ep)->private_data, (plen))
+#endif /* USE_AUDIO_USB_DIRECT_DISPATCH && USE_USB_AUDIO_PLAYPBACK */
+#if defined(USE_AUDIO_USB_DIRECT_DISPATCH) && defined(USE_USB_AUDIO_RECORDING)
+uint8_t*  USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length);
+#define USBD_AUDIO_IN_GET_BUFFER(data_ep, plen)     USB_AUDIO_Streaming_Output_GetBuffer((data_ep)->private_data, (plen))
+#else /* USE_AUDIO_USB_DIRECT_DISPATCH && USE_USB_AUDIO_RECORDING */
+#define USBD_AUDIO_IN_GET_BUFFER(data_ep, plen)     (data_ep)->GetBuffer((data_ep)->private_data, (plen))
+#endif /* USE_AUDIO_USB_DIRECT_DISPATCH && USE_USB_AUDIO_RECORDING */
 
 /**
   * @}
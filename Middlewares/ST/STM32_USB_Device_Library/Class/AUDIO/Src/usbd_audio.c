@@ -62,6 +62,12 @@
 /* Includes ------------------------------------------------------------------*/
 #include "usbd_audio.h"
 #include "usbd_ctlreq.h"
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+#include "audio_vendor_request.h"
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_FAULT_INJECTION
+#include "audio_fault.h"
+#endif /* USE_AUDIO_FAULT_INJECTION */
 
 /** @addtogroup STM32_USB_DEVICE_LIBRARY
   * @{
@@ -74,6 +80,9 @@
   */ 
 #if USBD_AUDIO_SUPPORT_INTERRUPT
 #define USBD_AUDIO_INTERRUPT_TABLE_SIZE               10
+#define USBD_AUDIO_INTERRUPT_LEVEL_COUNT              3    /* high, normal and low priorities */
+#define USBD_AUDIO_INTERRUPT_HASH_SIZE                8    /* power of 2 */
+#define USBD_AUDIO_INTERRUPT_NONE                     0xFF /* end of list */
 #endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
 /** @defgroup USBD_AUDIO_Private_TypesDefinitions
   * @{
@@ -99,6 +108,18 @@
   uint8_t open; /* 0 closed , 1 open */
   uint16_t max_packet_length; /* the max packet length */
   uint16_t tx_rx_soffn;
+  uint32_t incomplete_count; /* ISO transfers not done in their frame */
+  uint32_t dropped_count; /* completions dropped : endpoint closed meanwhile or of unknown usage */
+#ifdef USE_AUDIO_ISO_SLACK
+  USBD_AUDIO_IsoSlackTypeDef slack; /* of the transfers handed to the core from the completion */
+#endif /* USE_AUDIO_ISO_SLACK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+  uint8_t fault_held; /* IN data packet not armed on purpose, the next SOF handles it as incomplete */
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+  uint8_t deferred; /* feedback or interrupt completion, re-armed once the data IN endpoints are */
+  uint32_t deferred_count;
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
 #if USBD_SUPPORT_AUDIO_OUT_FEEDBACK 
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
 }USBD_AUDIO_EPTypeDef;
@@ -109,6 +130,7 @@ typedef struct
   USBD_AUDIO_FunctionDescriptionfTypeDef aud_function; /* description of audio function */
   USBD_AUDIO_EPTypeDef ep_in[USBD_AUDIO_MAX_IN_EP]; /*  list of IN EP */
   USBD_AUDIO_EPTypeDef ep_out[USBD_AUDIO_MAX_OUT_EP]; /*  list of OUT EP */ 
+  uint8_t control_index[USBD_AUDIO_MAX_ENTITY_ID + 1]; /* index + 1 in aud_function.controls of each Unit/Clock id, 0 when none */
 
   /* Strcture used for control handeling */
   struct
@@ -117,16 +139,23 @@ typedef struct
     {
       USBD_AUDIO_ControlTypeDef *controller; /* related Control Unit */
     } entity;
+    uint8_t data[USB_MAX_EP0_SIZE];  /* buffer to receive request value or send response, kept 32-bit aligned for EP0 DMA */
     uint8_t request_target;
-    uint8_t data[USB_MAX_EP0_SIZE];  /* buffer to receive request value or send response */
     uint32_t len; /* used length of data buffer */
     uint16_t  wValue;/* wValue of request which is specific for each control*/
     uint8_t  req;/* the request type specific for each unit*/
   }last_control;
 #if USBD_AUDIO_SUPPORT_INTERRUPT
-  USBD_AUDIO_InterruptTypeDef interrupts[USBD_AUDIO_INTERRUPT_TABLE_SIZE];
-  uint8_t is_ep_busy;
   uint8_t interrupt_message[USBD_AUDIO_INTERRUPT_DATA_MESSAGE_SIZE+4];
+  USBD_AUDIO_InterruptTypeDef interrupts[USBD_AUDIO_INTERRUPT_TABLE_SIZE]; /* pool of pending interrupts */
+  uint8_t interrupt_next[USBD_AUDIO_INTERRUPT_TABLE_SIZE]; /* next in the same priority fifo or in the free list */
+  uint8_t interrupt_hash_next[USBD_AUDIO_INTERRUPT_TABLE_SIZE]; /* next in the same hash bucket */
+  uint8_t interrupt_head[USBD_AUDIO_INTERRUPT_LEVEL_COUNT]; /* oldest pending interrupt of each priority */
+  uint8_t interrupt_tail[USBD_AUDIO_INTERRUPT_LEVEL_COUNT]; /* newest pending interrupt of each priority */
+  uint8_t interrupt_hash[USBD_AUDIO_INTERRUPT_HASH_SIZE]; /* pending interrupts by entity and control, for coalescing */
+  uint8_t interrupt_free; /* first free entry of the pool */
+  uint8_t priority_map; /* OR of the priorities which have pending interrupts */
+  uint8_t is_ep_busy;
 #endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
 }USBD_AUDIO_HandleTypeDef;
 
@@ -146,6 +175,19 @@ typedef struct
 #endif /*USBD_AUDIO_SUPPORT_INTERRUPT*/
 #define AUDIO_UNIT_CONTROL_REQUEST 0x01
 #define AUDIO_EP_REQUEST 0x02
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+#define AUDIO_VENDOR_REQUEST 0x03
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_USB_ADMISSION
+/* periodic transfers may take 90% of a full speed frame and 80% of a high speed
+   microframe, each iso transaction adds its tokens and handshake (USB 2.0 5.6.4) */
+#define USBD_AUDIO_FS_PERIODIC_BYTES 1350U
+#define USBD_AUDIO_HS_PERIODIC_BYTES 6000U
+#define USBD_AUDIO_FS_ISO_OVERHEAD 9U
+#define USBD_AUDIO_HS_ISO_OVERHEAD 38U
+#define USBD_AUDIO_FS_ISO_MAX_PACKET 1023U
+#define USBD_AUDIO_HS_ISO_MAX_PACKET 1024U
+#endif /* USE_AUDIO_USB_ADMISSION */
 #if USBD_SUPPORT_AUDIO_OUT_FEEDBACK 
 #define USBD_AUDIO_SOF_COUNT_FEEDBACK_BITS 7
 #define USBD_AUDIO_SOF_COUNT_FEEDBACK (1 << USBD_AUDIO_SOF_COUNT_FEEDBACK_BITS)
@@ -184,9 +226,9 @@ static uint8_t  *USBD_AUDIO_GetCfgDesc (uint16_t *length);
 
 static uint8_t  *USBD_AUDIO_GetDeviceQualifierDesc (uint16_t *length);
 
-static uint8_t  USBD_AUDIO_DataIn (USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t  USBD_AUDIO_DataIn (USBD_HandleTypeDef *pdev, uint8_t epnum) USBD_ITCM_FUNC;
 
-static uint8_t  USBD_AUDIO_DataOut (USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t  USBD_AUDIO_DataOut (USBD_HandleTypeDef *pdev, uint8_t epnum) USBD_ITCM_FUNC;
 
 static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev);
 
@@ -199,20 +241,46 @@ static uint8_t  USBD_AUDIO_IsoINIncomplete (USBD_HandleTypeDef *pdev, uint8_t ep
 static uint8_t  USBD_AUDIO_IsoOutIncomplete (USBD_HandleTypeDef *pdev, uint8_t epnum);
 
 static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+static uint8_t USBD_AUDIO_VendorRequest(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
 
 #if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
-#ifdef USE_USB_FS
+#ifndef USE_USB_HS_ULPI_PHY
 #define get_usb_speed_rate  get_usb_full_speed_rate
 static  uint32_t get_usb_full_speed_rate(unsigned int rate, unsigned char * buf);
-#else /* USE_USB_HS*/
+#else /* USE_USB_HS_ULPI_PHY */
 #define get_usb_speed_rate  get_usb_high_speed_rate
 static  uint32_t get_usb_high_speed_rate(unsigned int rate, unsigned char * buf);
-#endif
+#endif /* USE_USB_HS_ULPI_PHY */
+static void     USBD_AUDIO_FeedbackPublish(USBD_AUDIO_EP_SynchTypeDef* sync_ep, uint8_t force);
+static uint8_t* USBD_AUDIO_FeedbackNextBuffer(USBD_AUDIO_EP_SynchTypeDef* sync_ep);
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
 #if USBD_AUDIO_SUPPORT_INTERRUPT
-static uint8_t  USBD_AUDIO_TransmitInterrupt(void);
+static uint8_t  USBD_AUDIO_TransmitInterrupt(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio);
+static void     USBD_AUDIO_InitInterrupts(USBD_AUDIO_HandleTypeDef *haudio);
+static uint8_t  USBD_AUDIO_InterruptLevel(uint8_t priority);
+static uint8_t  USBD_AUDIO_InterruptHash(USBD_AUDIO_InterruptTypeDef *interrupt);
 #endif /*USBD_AUDIO_SUPPORT_INTERRUPT*/
+static uint8_t  USBD_AUDIO_InstanceIndex(USBD_HandleTypeDef *pdev);
 static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_t as_interface_num,uint8_t new_alt);
+static void     USBD_AUDIO_RestartInterfaces(USBD_HandleTypeDef *pdev, uint8_t as_cnt_to_restart,
+                                             uint8_t *as_list_to_restart);
+#ifdef USE_AUDIO_USB_ADMISSION
+static uint8_t  USBD_AUDIO_AdmitAlternate(USBD_HandleTypeDef *pdev, uint8_t ep_addr,
+                                          uint16_t packet_length, uint16_t sync_length);
+#endif /* USE_AUDIO_USB_ADMISSION */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+static uint8_t* USBD_AUDIO_NextInPacket(USBD_AUDIO_EP_DataTypeDef* data_ep, uint16_t* length) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+#ifdef USE_AUDIO_ISO_SLACK
+static void     USBD_AUDIO_RecordSlack(USBD_AUDIO_EPTypeDef* ep) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_ISO_SLACK */
+static void     USBD_AUDIO_RearmSideIn(USBD_HandleTypeDef *pdev, USBD_AUDIO_EPTypeDef* ep, uint8_t epnum) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+static uint8_t  USBD_AUDIO_DataInPending(USBD_AUDIO_HandleTypeDef *haudio) USBD_ITCM_FUNC;
+static void     USBD_AUDIO_ServeDeferredIn(USBD_HandleTypeDef *pdev, uint8_t force) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
 
 /**
   * @}
@@ -263,8 +331,24 @@ __ALIGN_BEGIN static uint8_t USBD_AUDIO_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIE
 static uint8_t *USBD_AUDIO_CfgDesc=0;
 static uint16_t USBD_AUDIO_CfgDescSize=0;
 #if USBD_AUDIO_SUPPORT_INTERRUPT
-  USBD_HandleTypeDef   *pdev_audio = 0;
+/* device and class id of each audio function, the application queues its
+   interrupts by instance index */
+static USBD_HandleTypeDef *audio_instance_pdev[USBD_AUDIO_MAX_INSTANCES];
+static uint8_t audio_instance_class[USBD_AUDIO_MAX_INSTANCES];
 #endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
+#ifdef USE_USBD_FAST_RESET
+/* handle of each audio function kept over a bus reset, the next Init takes it
+   back with its sessions and rings */
+static USBD_AUDIO_HandleTypeDef *audio_parked[USBD_AUDIO_MAX_INSTANCES];
+#endif /* USE_USBD_FAST_RESET */
+#ifdef USE_AUDIO_USB_ADMISSION
+static uint32_t audio_admission_refused; /* alternates refused by USBD_AUDIO_AdmitAlternate */
+#endif /* USE_AUDIO_USB_ADMISSION */
+#ifdef USE_AUDIO_ISO_SLACK
+/* last SOF : cycle counter and (micro)frame number */
+static volatile uint32_t audio_sof_cycles;
+static volatile uint16_t audio_sof_fn;
+#endif /* USE_AUDIO_ISO_SLACK */
 
 /**
   * @}
@@ -287,7 +371,34 @@ static uint8_t  USBD_AUDIO_Init (USBD_HandleTypeDef *pdev,
   /* Allocate Audio structure */
   USBD_AUDIO_HandleTypeDef   *haudio;
   USBD_AUDIO_InterfaceCallbacksfTypeDef * aud_if_cbks;
+  uint8_t instance = USBD_AUDIO_InstanceIndex(pdev);
   
+  AUDIO_BOOT_MARK(AUDIO_BOOT_USB_CONFIGURED);
+  if(instance >= USBD_AUDIO_MAX_INSTANCES)
+  {
+    return USBD_FAIL;
+  }
+#ifdef USE_USBD_FAST_RESET
+  if(audio_parked[instance] != NULL)
+  {
+    /* configured again after a bus reset : sessions, controls and id table
+       are kept, only the endpoint and request state restart */
+    haudio = audio_parked[instance];
+    audio_parked[instance] = NULL;
+    memset(haudio->ep_in, 0, sizeof(haudio->ep_in));
+    memset(haudio->ep_out, 0, sizeof(haudio->ep_out));
+    memset(&haudio->last_control, 0, sizeof(haudio->last_control));
+    pdev->pClassDataCmsit[pdev->classId] = (void *)haudio;
+    pdev->pClassData = pdev->pClassDataCmsit[pdev->classId];
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+    USBD_AUDIO_InitInterrupts(haudio);
+    haudio->is_ep_busy = 0;
+    audio_instance_class[instance] = pdev->classId;
+    audio_instance_pdev[instance] = pdev;
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
+    return USBD_OK;
+  }
+#endif /* USE_USBD_FAST_RESET */
   haudio = USBD_malloc(sizeof (USBD_AUDIO_HandleTypeDef));
   if(haudio == NULL)
   {
@@ -306,12 +417,29 @@ static uint8_t  USBD_AUDIO_Init (USBD_HandleTypeDef *pdev,
       pdev->pClassData = 0;
       return USBD_FAIL;
     }
+    /* build the id table used by control requests */
+    for (int i = 0;i < haudio->aud_function.control_count; i++)
+    {
+      if(haudio->aud_function.controls[i].id > USBD_AUDIO_MAX_ENTITY_ID)
+      {
+        aud_if_cbks->DeInit(&haudio->aud_function,aud_if_cbks->private_data);
+        USBD_free(pdev->pClassData);
+        pdev->pClassDataCmsit[pdev->classId] = NULL;
+        pdev->pClassData = 0;
+        return USBD_FAIL;
+      }
+      haudio->control_index[haudio->aud_function.controls[i].id] = (uint8_t)(i + 1);
+    }
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+    USBD_AUDIO_InitInterrupts(haudio);
+    audio_instance_class[instance] = pdev->classId;
+    audio_instance_pdev[instance] = pdev;
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
   }
 
   return USBD_OK;
 }
 
-static uint8_t AUDIOOutEpAdd = AUDIO_OUT_EP;
 /**
   * @brief  USBD_AUDIO_Init
   *         DeInitialize the AUDIO layer
@@ -324,14 +452,47 @@ static uint8_t  USBD_AUDIO_DeInit (USBD_HandleTypeDef *pdev,
 {
     USBD_AUDIO_HandleTypeDef   *haudio;
     USBD_AUDIO_InterfaceCallbacksfTypeDef * aud_if_cbks;
-    
-#ifdef USE_USBD_COMPOSITE
-  /* Get the Endpoints addresses allocated for this class instance */
-  AUDIOOutEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_ISOC, (uint8_t)pdev->classId);
-#endif /* USE_USBD_COMPOSITE */
+#if (USBD_AUDIO_SUPPORT_INTERRUPT) || (defined USE_USBD_FAST_RESET)
+    uint8_t instance = USBD_AUDIO_InstanceIndex(pdev);
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT || USE_USBD_FAST_RESET */
 
     haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
-    aud_if_cbks =  (USBD_AUDIO_InterfaceCallbacksfTypeDef *)pdev->pUserData;
+    aud_if_cbks =  (USBD_AUDIO_InterfaceCallbacksfTypeDef *)pdev->pUserData[pdev->classId];
+#ifdef USE_USBD_FAST_RESET
+    if(instance < USBD_AUDIO_MAX_INSTANCES)
+    {
+      if((pdev->bus_reset != 0U) && (haudio != NULL))
+      {
+        /* bus reset : the streaming interfaces stop as on a SET_INTERFACE 0,
+           which closes their endpoints, the handle is parked for the next Init */
+        for(int i = 0; i < haudio->aud_function.as_interfaces_count; i++)
+        {
+          if(haudio->aud_function.as_interfaces[i].alternate != 0)
+          {
+            USBD_AUDIO_SetInterfaceAlternate(pdev, (uint8_t)i, 0);
+          }
+        }
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+        audio_instance_pdev[instance] = 0;
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
+        audio_parked[instance] = haudio;
+        pdev->pClassDataCmsit[pdev->classId] = NULL;
+        pdev->pClassData = NULL;
+        return USBD_OK;
+      }
+      if((haudio == NULL) && (audio_parked[instance] != NULL))
+      {
+        /* detach or a second reset before any configuration : full teardown
+           of the parked handle, its endpoints are already closed */
+        haudio = audio_parked[instance];
+        audio_parked[instance] = NULL;
+      }
+    }
+    if(haudio == NULL)
+    {
+      return USBD_OK;
+    }
+#endif /* USE_USBD_FAST_RESET */
     
     /* Close open EP */
     for(int i=1;i < USBD_AUDIO_MAX_IN_EP; i++)
@@ -353,6 +514,12 @@ static uint8_t  USBD_AUDIO_DeInit (USBD_HandleTypeDef *pdev,
   if(haudio != NULL)
   {
    aud_if_cbks->DeInit(&haudio->aud_function,aud_if_cbks->private_data);
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+    if(instance < USBD_AUDIO_MAX_INSTANCES)
+    {
+      audio_instance_pdev[instance] = 0;
+    }
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
     USBD_free(haudio);
     pdev->pClassDataCmsit[pdev->classId]  = NULL;
     
@@ -382,8 +549,13 @@ static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_
                                             &haudio->ep_out[pas_interface->data_ep.ep_num];
   
   
-  /* close old alternate interface */
-  if(new_alt==0)
+  if(new_alt > pas_interface->max_alternate)
+  {
+    return USBD_FAIL;
+  }
+  AUDIO_TRACE(AUDIO_TRACE_ALTERNATE, as_interface_num, new_alt);
+  /* close old alternate interface, also when moving between two streaming alternates */
+  if((new_alt==0)||(pas_interface->alternate!=0))
   {
     /* close all opned ep */
     if (pas_interface->alternate!=0)
@@ -404,27 +576,53 @@ static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_
             USBD_LL_CloseEP(pdev, ep->ep_description.sync_ep->ep_num);
             ep->open = 0;
           }
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+          /* the completion of the closed transfer is not served again */
+          ep->deferred = 0;
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
       }
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
     }
-    pas_interface->SetAS_Alternate(new_alt,pas_interface->private_data);
+    pas_interface->SetAS_Alternate(0,pas_interface->private_data);
     pas_interface->alternate=0;
   }
   /* start new  alternate interface */
-  else
+  if(new_alt!=0)
   {
     /* prepare EP */
+    ep = (pas_interface->data_ep.ep_num&0x80)?&haudio->ep_in[pas_interface->data_ep.ep_num&0x0F]:
+                                              &haudio->ep_out[pas_interface->data_ep.ep_num];
     ep->ep_description.data_ep=&pas_interface->data_ep;
     
-    /* open the data ep */
-    pas_interface->SetAS_Alternate(new_alt,pas_interface->private_data);
-    pas_interface->alternate=new_alt;
+    /* open the data ep, the session refuses an alternate which can't carry the current format */
+    if(pas_interface->SetAS_Alternate(new_alt,pas_interface->private_data) != 0)
+    {
+      return USBD_FAIL;
+    }
     ep->max_packet_length=ep->ep_description.data_ep->GetMaxPacketLength(ep->ep_description.data_ep->private_data);
+#ifdef USE_AUDIO_USB_ADMISSION
+    /* the other streams keep their bandwidth, this one is not started */
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
+    if(USBD_AUDIO_AdmitAlternate(pdev, pas_interface->data_ep.ep_num, ep->max_packet_length,
+                                 pas_interface->synch_enabled ? AUDIO_FEEDBACK_EP_PACKET_SIZE : 0U) != USBD_OK)
+#else /* USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+    if(USBD_AUDIO_AdmitAlternate(pdev, pas_interface->data_ep.ep_num, ep->max_packet_length, 0U) != USBD_OK)
+#endif /* USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+    {
+      pas_interface->SetAS_Alternate(0,pas_interface->private_data);
+      return USBD_FAIL;
+    }
+#endif /* USE_AUDIO_USB_ADMISSION */
+    pas_interface->alternate=new_alt;
     /* open data end point */
     USBD_LL_OpenEP(pdev,
                  ep->ep_description.data_ep->ep_num,
                  USBD_EP_TYPE_ISOC,
                  ep->max_packet_length);             
+#ifdef USE_AUDIO_USB_LOW_RATE
+    USBD_LL_SetIsoInterval(pdev, ep->ep_description.data_ep->ep_num,
+                           (pdev->dev_speed == USBD_SPEED_HIGH) ? AUDIO_HS_BINTERVAL : AUDIO_FS_BINTERVAL);
+#endif /* USE_AUDIO_USB_LOW_RATE */
      ep->open = 1;
      ep->ep_usage = USBD_AUDIO_DATA_EP;
      /* get usb working buffer */
@@ -439,12 +637,17 @@ static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_
                         ep->ep_description.data_ep->ep_num,
                         ep->ep_description.data_ep->buf,
                         ep->ep_description.data_ep->length);
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+      /* a packet staged before the last stop is stale */
+      ep->ep_description.data_ep->staged = 0;
+      if(ep->ep_description.data_ep->StageRequest)
+      {
+        ep->ep_description.data_ep->StageRequest(ep->ep_description.data_ep->private_data);
+      }
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
     }
     else/* OUT EP */
     {
-#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK 
-        uint32_t rate;
-#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */  
     /* Prepare Out endpoint to receive 1st packet */ 
     USBD_LL_PrepareReceive(pdev,
                            ep->ep_description.data_ep->ep_num,
@@ -463,11 +666,10 @@ static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_
            USBD_LL_OpenEP(pdev, sync_ep->ep_num,
                  USBD_EP_TYPE_ISOC, ep->max_packet_length);             
             ep->open = 1;
-            rate = sync_ep->GetFeedback(sync_ep->private_data);
-            get_usb_speed_rate(rate,sync_ep->feedback_data);
+            USBD_AUDIO_FeedbackPublish(sync_ep, 1);
             ep->tx_rx_soffn = USB_SOF_NUMBER();
             USBD_LL_Transmit(pdev, sync_ep->ep_num,
-                             sync_ep->feedback_data, ep->max_packet_length);
+                             USBD_AUDIO_FeedbackNextBuffer(sync_ep), ep->max_packet_length);
       }
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */   
 
@@ -476,37 +678,75 @@ static uint8_t  USBD_AUDIO_SetInterfaceAlternate(USBD_HandleTypeDef *pdev,uint8_
   return USBD_OK;
 }
 #if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
-#ifdef USE_USB_FS
+#ifndef USE_USB_HS_ULPI_PHY
 /**
   * @brief   get_usb_full_speed_rate
   *         Set feedback value from rate 
-  * @param  rate: 
+  * @param  rate: Hz with AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits (overflows above 512 kHz)
   * @param  buf: 
   * @retval 
   */
 static  uint32_t get_usb_full_speed_rate(unsigned int rate, unsigned char * buf)
 {
-        uint32_t freq =  ((rate << 13) + 62) / 125;
+        uint32_t freq =  ((rate << (13 - AUDIO_FEEDBACK_RATE_FRAC_BITS)) + 62) / 125;
         buf[0] =    freq>> 2;
         buf[1] =    freq>> 10;
         buf[2] =    freq>> 18;
 return freq;
  }
-#else /* USE_USB_FS */
+#else /* USE_USB_HS_ULPI_PHY */
 /*
- * convert a sampling rate into USB high speed format (fs/8000 in Q16.16)
+ * convert a sampling rate (Hz in 24.8) into USB high speed format (fs/8000 in Q16.16)
  * this will overflow at approx 4 MHz
  */
 static  uint32_t get_usb_high_speed_rate(unsigned int rate, unsigned char * buf)
 {
-        uint32_t freq =  ((rate << 10) + 62) / 125;
+        uint32_t freq =  ((rate << (10 - AUDIO_FEEDBACK_RATE_FRAC_BITS)) + 62) / 125;
         buf[0] =    freq;
         buf[1] =    freq>> 8;
         buf[2] =    freq>> 16;
         buf[3] =    freq>> 24;
 return freq;
 }
-#endif /* USE_USB_FS */
+#endif /* USE_USB_HS_ULPI_PHY */
+
+/**
+  * @brief  USBD_AUDIO_FeedbackPublish
+  *         encodes the rate returned by GetFeedback in the slot which is not
+  *         being sent, so the feedback IN completion only hands a ready buffer
+  *         to the core. Called from SOF once the feedback engine ran
+  * @param  sync_ep: synchro ep description
+  * @param  force: 1 to encode even when the rate didn't change
+  * @retval None
+  */
+static void USBD_AUDIO_FeedbackPublish(USBD_AUDIO_EP_SynchTypeDef* sync_ep, uint8_t force)
+{
+  uint32_t rate = sync_ep->GetFeedback(sync_ep->private_data);
+  uint8_t slot;
+
+  if((!force) && (rate == sync_ep->feedback_rate))
+  {
+    return;
+  }
+  /* the sent slot may still be read by the core */
+  slot = (sync_ep->feedback_sent & 1U) ^ 1U;
+  get_usb_speed_rate(rate, sync_ep->feedback_data[slot]);
+  sync_ep->feedback_rate = rate;
+  sync_ep->feedback_ready = slot;
+  AUDIO_TRACE(AUDIO_TRACE_FEEDBACK, sync_ep->ep_num & 0x0FU, rate);
+}
+
+/**
+  * @brief  USBD_AUDIO_FeedbackNextBuffer
+  *         returns the slot to send, it is kept unchanged until an other one is sent
+  * @param  sync_ep: synchro ep description
+  * @retval encoded feedback
+  */
+static uint8_t* USBD_AUDIO_FeedbackNextBuffer(USBD_AUDIO_EP_SynchTypeDef* sync_ep)
+{
+  sync_ep->feedback_sent = sync_ep->feedback_ready & 1U;
+  return sync_ep->feedback_data[sync_ep->feedback_sent];
+}
 #endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */ 
 
 /**
@@ -554,6 +794,12 @@ static uint8_t  USBD_AUDIO_Setup (USBD_HandleTypeDef *pdev,
         ret = USBD_FAIL;
     }
     break;
+
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+  case USB_REQ_TYPE_VENDOR :
+    ret = USBD_AUDIO_VendorRequest(pdev, req);
+    break;
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
     
   case USB_REQ_TYPE_STANDARD:
     switch (req->bRequest)
@@ -563,7 +809,11 @@ static uint8_t  USBD_AUDIO_Setup (USBD_HandleTypeDef *pdev,
       {
         pbuf = USBD_AUDIO_CfgDesc + 18;
         len = MIN(USB_AUDIO_DESC_SIZ , req->wLength);
-        
+#ifdef USE_USB_HS_DMA
+        /* descriptor offset is not 32-bit aligned, send an aligned copy */
+        USBD_memcpy(haudio->last_control.data, pbuf, len);
+        pbuf = haudio->last_control.data;
+#endif /* USE_USB_HS_DMA */
         
         USBD_CtlSendData (pdev, 
                           pbuf,
@@ -577,9 +827,14 @@ static uint8_t  USBD_AUDIO_Setup (USBD_HandleTypeDef *pdev,
         {
             if((uint8_t)(req->wIndex)==haudio->aud_function.as_interfaces[i].interface_num)
             {
+#ifdef USE_USB_HS_DMA
+              haudio->last_control.data[0] = haudio->aud_function.as_interfaces[i].alternate;
+              USBD_CtlSendData (pdev, haudio->last_control.data, 1);
+#else /* USE_USB_HS_DMA */
               USBD_CtlSendData (pdev,
                         (uint8_t *)&(haudio->aud_function.as_interfaces[i].alternate),
                         1);
+#endif /* USE_USB_HS_DMA */
               return USBD_OK;
             }
         }
@@ -603,7 +858,12 @@ static uint8_t  USBD_AUDIO_Setup (USBD_HandleTypeDef *pdev,
               else
               {               
                 /*Alternate is changed*/
-                return USBD_AUDIO_SetInterfaceAlternate(pdev,i,(uint8_t)(req->wValue));
+                ret = USBD_AUDIO_SetInterfaceAlternate(pdev,i,(uint8_t)(req->wValue));
+                if(ret != USBD_OK)
+                {
+                  USBD_CtlError (pdev, req);
+                }
+                return ret;
               }
             }
         } 
@@ -652,58 +912,183 @@ static uint8_t  USBD_AUDIO_DataIn (USBD_HandleTypeDef *pdev,
                               uint8_t epnum)
 {
   USBD_AUDIO_EPTypeDef * ep;
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+  USBD_AUDIO_HandleTypeDef * haudio;
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
+  AUDIO_PROF_BEGIN(AUDIO_PROF_AUDIO_DATA_IN);
 
    ep = &((USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId])->ep_in[epnum&0x7F];
    if(ep->open)
    {
-     switch(ep->ep_usage)
+     if(ep->ep_usage == USBD_AUDIO_DATA_EP)
      {
-     case USBD_AUDIO_DATA_EP : 
-       {
-        ep->ep_description.data_ep->buf = ep->ep_description.data_ep->GetBuffer(ep->ep_description.data_ep->private_data,
-                                                                                  &ep->ep_description.data_ep->length);
+        AUDIO_PROF_BEGIN(AUDIO_PROF_NODE_GET_BUFFER);
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+        ep->ep_description.data_ep->buf = USBD_AUDIO_NextInPacket(ep->ep_description.data_ep,
+                                                                  &ep->ep_description.data_ep->length);
+#else /* USE_AUDIO_USB_IN_PIPELINE */
+        ep->ep_description.data_ep->buf = USBD_AUDIO_IN_GET_BUFFER(ep->ep_description.data_ep,
+                                                                   &ep->ep_description.data_ep->length);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+        AUDIO_PROF_END(AUDIO_PROF_NODE_GET_BUFFER);
+#ifdef USE_AUDIO_FAULT_INJECTION
+        if(AUDIO_FaultHoldIn())
+        {
+          ep->fault_held = 1;
+        }
+        else
+#endif /* USE_AUDIO_FAULT_INJECTION */
+        {
+#ifdef USE_AUDIO_FAULT_INJECTION
+          AUDIO_FaultDelayIn();
+#endif /* USE_AUDIO_FAULT_INJECTION */
           ep->tx_rx_soffn = USB_SOF_NUMBER();
+#ifdef USE_AUDIO_ISO_SLACK
+          USBD_AUDIO_RecordSlack(ep);
+#endif /* USE_AUDIO_ISO_SLACK */
           USBD_LL_Transmit(pdev, 
                       epnum|0x80,
                       ep->ep_description.data_ep->buf,
                       ep->ep_description.data_ep->length);
-          break;
         }
-#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK 
-     case USBD_AUDIO_FEEDBACK_EP : 
+     }
+     else
+     {
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+       /* a data IN completion of the same interrupt is serviced first */
+       haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+       if(USBD_AUDIO_DataInPending(haudio))
        {
-         uint32_t rate; 
-         USBD_AUDIO_EP_SynchTypeDef* sync_ep=ep->ep_description.sync_ep;
-         rate = sync_ep->GetFeedback(sync_ep->private_data);
-         get_usb_speed_rate(rate,sync_ep->feedback_data);
-         ep->tx_rx_soffn = USB_SOF_NUMBER();
-         USBD_LL_Transmit(pdev, 
-              epnum|0x80,
-              sync_ep->feedback_data,
-              AUDIO_FEEDBACK_EP_PACKET_SIZE);
-            break;
-        }
-#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
-     
-#if USBD_AUDIO_SUPPORT_INTERRUPT
-     case USBD_AUDIO_INTERRUPT_EP : 
-        {
-          ((USBD_AUDIO_HandleTypeDef*) pdev->pClassData)->is_ep_busy = 0;
-          USBD_AUDIO_TransmitInterrupt();
-          break;
-        }
-#endif /*USBD_AUDIO_SUPPORT_INTERRUPT */ 
-     default :
-        USBD_error_handler();
+         ep->deferred = 1;
+         ep->deferred_count++;
+       }
+       else
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
+       {
+         USBD_AUDIO_RearmSideIn(pdev, ep, epnum&0x7F);
+       }
      }
    }
    else
    {
-    USBD_error_handler();
+    /* closed by a SET_INTERFACE while the transfer completed */
+    ep->dropped_count++;
    }
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+  USBD_AUDIO_ServeDeferredIn(pdev, 0);
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
+  AUDIO_PROF_END(AUDIO_PROF_AUDIO_DATA_IN);
   return USBD_OK;
 }
 
+/**
+  * @brief  USBD_AUDIO_RearmSideIn
+  *         re-arms an IN endpoint which is not a data one : the feedback one
+  *         with its value encoded at SOF , the interrupt one with the next
+  *         pending interrupt
+  * @param  pdev: device instance
+  * @param  ep: endpoint
+  * @param  epnum: endpoint index
+  * @retval None
+  */
+static void USBD_AUDIO_RearmSideIn(USBD_HandleTypeDef *pdev, USBD_AUDIO_EPTypeDef* ep, uint8_t epnum)
+{
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+  USBD_AUDIO_HandleTypeDef * haudio;
+#endif /* USBD_AUDIO_SUPPORT_INTERRUPT */
+
+  UNUSED(pdev);
+  UNUSED(epnum);
+  switch(ep->ep_usage)
+  {
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK 
+  case USBD_AUDIO_FEEDBACK_EP : 
+    {
+      /* encoded at SOF , only the ready slot is handed to the core */
+      USBD_AUDIO_EP_SynchTypeDef* sync_ep=ep->ep_description.sync_ep;
+      ep->tx_rx_soffn = USB_SOF_NUMBER();
+#ifdef USE_AUDIO_ISO_SLACK
+      USBD_AUDIO_RecordSlack(ep);
+#endif /* USE_AUDIO_ISO_SLACK */
+      USBD_LL_Transmit(pdev, 
+                       epnum|0x80,
+                       USBD_AUDIO_FeedbackNextBuffer(sync_ep),
+                       AUDIO_FEEDBACK_EP_PACKET_SIZE);
+      break;
+    }
+#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+#if USBD_AUDIO_SUPPORT_INTERRUPT
+  case USBD_AUDIO_INTERRUPT_EP : 
+    {
+      haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+      haudio->is_ep_busy = 0;
+      USBD_AUDIO_TransmitInterrupt(pdev, haudio);
+      break;
+    }
+#endif /*USBD_AUDIO_SUPPORT_INTERRUPT */ 
+  default :
+    /* nothing to send again, the endpoint stays idle */
+    ep->dropped_count++;
+    break;
+  }
+}
+
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+/**
+  * @brief  USBD_AUDIO_DataInPending
+  *         checks for an open data IN endpoint whose transfer completed and
+  *         whose completion the PCD driver did not service yet
+  * @param  haudio: audio class handle
+  * @retval 1 if one is pending, else 0
+  */
+static uint8_t USBD_AUDIO_DataInPending(USBD_AUDIO_HandleTypeDef *haudio)
+{
+  uint8_t n;
+
+  for(n = 1; n < USBD_AUDIO_MAX_IN_EP; n++)
+  {
+    if((haudio->ep_in[n].open) && (haudio->ep_in[n].ep_usage == USBD_AUDIO_DATA_EP) &&
+       IS_IN_EP_XFER_PENDING(n))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  USBD_AUDIO_ServeDeferredIn
+  *         re-arms the deferred feedback and interrupt endpoints once no data
+  *         IN completion is pending. From SOF they are re-armed in any case ,
+  *         a completion still pending then is serviced in the next interrupt
+  * @param  pdev: device instance
+  * @param  force: 1 to re-arm even when a data IN completion is pending
+  * @retval None
+  */
+static void USBD_AUDIO_ServeDeferredIn(USBD_HandleTypeDef *pdev, uint8_t force)
+{
+  USBD_AUDIO_HandleTypeDef * haudio;
+  uint8_t n;
+
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+  if((haudio == NULL) || ((!force) && USBD_AUDIO_DataInPending(haudio)))
+  {
+    return;
+  }
+  for(n = 1; n < USBD_AUDIO_MAX_IN_EP; n++)
+  {
+    if(haudio->ep_in[n].deferred)
+    {
+      haudio->ep_in[n].deferred = 0;
+      if(haudio->ep_in[n].open)
+      {
+        USBD_AUDIO_RearmSideIn(pdev, &haudio->ep_in[n], n);
+      }
+    }
+  }
+}
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
+
 /**
   * @brief  USBD_AUDIO_EP0_RxReady
   *         handle EP0 Rx Ready event
@@ -721,6 +1106,14 @@ static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev)
     /* @TODO Manage this error */
     return USBD_OK;
   }
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+  if(haudio->last_control.request_target == AUDIO_VENDOR_REQUEST)
+  {
+    AUDIO_VendorRequestReceived(haudio->last_control.req, (uint16_t)haudio->last_control.len);
+    haudio->last_control.req = 0x00;
+    return USBD_OK;
+  }
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
   if(haudio->last_control.request_target == AUDIO_UNIT_CONTROL_REQUEST)
   {
     USBD_AUDIO_ControlTypeDef *ctl;
@@ -736,7 +1129,7 @@ static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev)
           {
                   case USBD_AUDIO_FU_MUTE_CONTROL:
                     {
-                      /* @TODO treat multi channel case and error when req! of GetCur*/  
+                      /* channel number is in wValue low byte, 0 for master */
                       if(feature_control->SetMute)
                       {
                         feature_control->SetMute(LOBYTE(haudio->last_control.wValue),
@@ -782,27 +1175,9 @@ static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev)
             if((selector == USBD_AUDIO_CS_SAM_FREQ_CONTROL)&&(haudio->last_control.req == USBD_AUDIO_CS_REQ_CUR)&&clk_control->SetCurFrequency)
             {
               freq = AUDIO_2_L3_CUR_DATA_TO_VAL(haudio->last_control.data);
+              AUDIO_TRACE(AUDIO_TRACE_RATE, 0, freq);
                clk_control->SetCurFrequency(freq ,&as_cnt_to_restart ,as_list_to_restart, ctl->private_data);
-               for(int i=0, j=0; j<as_cnt_to_restart; j++)
-               {
-                 i = as_list_to_restart[j];
-/* update sampling rate for syenchronization EP */
-#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
-                 if(haudio->aud_function.as_interfaces[i].synch_enabled)
-                 {
-                    uint32_t rate; 
-                    rate = haudio->aud_function.as_interfaces[i].synch_ep.GetFeedback(
-                           haudio->aud_function.as_interfaces[i].synch_ep.private_data);
-                    get_usb_speed_rate(rate,haudio->aud_function.as_interfaces[i].synch_ep.feedback_data);
-                 }
-#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
-                 if(haudio->aud_function.as_interfaces[i].alternate != 0)
-                 {
-                  int alt = haudio->aud_function.as_interfaces[i].alternate;
-                  USBD_AUDIO_SetInterfaceAlternate(pdev, i, 0);
-                  USBD_AUDIO_SetInterfaceAlternate(pdev, i, alt);
-                 }
-               }
+               USBD_AUDIO_RestartInterfaces(pdev, as_cnt_to_restart, as_list_to_restart);
           }
             else
             {
@@ -810,6 +1185,26 @@ static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev)
             }
              break;
          }     
+    case USBD_AUDIO_CS_AC_SUBTYPE_CLOCK_SELECTOR:
+         {
+            uint8_t as_cnt_to_restart = 0;
+            uint8_t as_list_to_restart[USBD_AUDIO_AS_INTERFACE_COUNT];
+            USBD_AUDIO_ClockSelectorCallbacksTypeDef* sel_control = ctl->Callbacks.clk_sel_control;
+            if((selector == USBD_AUDIO_CX_CLOCK_SELECTOR_CONTROL)&&(haudio->last_control.req == USBD_AUDIO_CS_REQ_CUR)&&sel_control->SetCurSelector)
+            {
+              /* the streams of the new clock are restarted at its rate */
+              if(sel_control->SetCurSelector(haudio->last_control.data[0], &as_cnt_to_restart, as_list_to_restart,
+                                             ctl->private_data) == 0)
+              {
+                USBD_AUDIO_RestartInterfaces(pdev, as_cnt_to_restart, as_list_to_restart);
+              }
+            }
+            else
+            {
+               USBD_error_handler();
+            }
+            break;
+         }
   default : /* switch(ctl->type)*/
             USBD_error_handler();
                              
@@ -817,6 +1212,40 @@ static uint8_t  USBD_AUDIO_EP0_RxReady (USBD_HandleTypeDef *pdev)
   }
   return USBD_OK;
 }
+/**
+  * @brief  USBD_AUDIO_RestartInterfaces
+  *         restart the streaming interfaces whose clock changed, rate or
+  *         source, so their endpoints are opened again at the new rate
+  * @param  pdev: device instance
+  * @param  as_cnt_to_restart: count of interfaces in as_list_to_restart
+  * @param  as_list_to_restart: AS interfaces index
+  * @retval None
+  */
+static void USBD_AUDIO_RestartInterfaces(USBD_HandleTypeDef *pdev, uint8_t as_cnt_to_restart,
+                                         uint8_t *as_list_to_restart)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+  for(int i=0, j=0; j<as_cnt_to_restart; j++)
+  {
+    i = as_list_to_restart[j];
+/* update sampling rate for syenchronization EP */
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
+    if(haudio->aud_function.as_interfaces[i].synch_enabled)
+    {
+       USBD_AUDIO_FeedbackPublish(&haudio->aud_function.as_interfaces[i].synch_ep, 1);
+    }
+#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+    if(haudio->aud_function.as_interfaces[i].alternate != 0)
+    {
+     int alt = haudio->aud_function.as_interfaces[i].alternate;
+     USBD_AUDIO_SetInterfaceAlternate(pdev, i, 0);
+     USBD_AUDIO_SetInterfaceAlternate(pdev, i, alt);
+    }
+  }
+}
+
 /**
   * @brief  USBD_AUDIO_EP0_TxReady
   *         handle EP0 TRx Ready event
@@ -837,89 +1266,447 @@ static uint8_t  USBD_AUDIO_EP0_TxReady (USBD_HandleTypeDef *pdev)
   */
 static uint8_t  USBD_AUDIO_SOF (USBD_HandleTypeDef *pdev)
 {
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
     USBD_AUDIO_HandleTypeDef   *haudio;
-  
+#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+#ifdef USE_AUDIO_FAULT_INJECTION
+  USBD_AUDIO_HandleTypeDef   *fault_audio;
+  uint8_t fault_ep;
+#endif /* USE_AUDIO_FAULT_INJECTION */
+  AUDIO_PROF_BEGIN(AUDIO_PROF_AUDIO_SOF);
+#ifdef USE_AUDIO_ISO_SLACK
+  audio_sof_cycles = DWT->CYCCNT;
+  audio_sof_fn = (uint16_t)USB_SOF_NUMBER();
+#endif /* USE_AUDIO_ISO_SLACK */
  
+  /* one dispatch for all the sessions , they run on their own period */
+  AUDIO_SofTickDispatch();
+#ifdef USE_AUDIO_FAULT_INJECTION
+  /* a held packet missed the last frame as if the core had flushed it */
+  fault_audio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+  for(fault_ep = 1; (fault_audio != NULL) && (fault_ep < USBD_AUDIO_MAX_IN_EP); fault_ep++)
+  {
+    if(fault_audio->ep_in[fault_ep].fault_held)
+    {
+      fault_audio->ep_in[fault_ep].fault_held = 0;
+      USBD_AUDIO_IsoINIncomplete(pdev, fault_ep);
+    }
+  }
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK
   haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId]; 
-  
   for(int i=0;i<haudio->aud_function.as_interfaces_count;i++)
   {
       if(haudio->aud_function.as_interfaces[i].alternate!=0)
       {
-        if(haudio->aud_function.as_interfaces[i].SofReceived)
-          
+        if(haudio->aud_function.as_interfaces[i].synch_enabled)
         {
-          haudio->aud_function.as_interfaces[i].SofReceived(haudio->aud_function.as_interfaces[i].private_data);
+          USBD_AUDIO_FeedbackPublish(&haudio->aud_function.as_interfaces[i].synch_ep, 0);
         }
       }
   }
+#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+#ifdef USE_AUDIO_IN_EP_PRIORITY
+  /* a deferred endpoint, with the value just encoded, doesn't wait more than a frame */
+  USBD_AUDIO_ServeDeferredIn(pdev, 1);
+#endif /* USE_AUDIO_IN_EP_PRIORITY */
+  AUDIO_PROF_END(AUDIO_PROF_AUDIO_SOF);
   return USBD_OK;
 }
 
 /**
   * @brief  USBD_AUDIO_IsoINIncomplete
-  *         handle data ISO IN Incomplete event
+  *         handle data ISO IN Incomplete event. The PCD driver has already
+  *         disabled the endpoint it found pending in the elapsed frame and
+  *         flushed its TX FIFO , only that endpoint is armed again. The
+  *         transfer start selects the parity of the next frame
   * @param  pdev: device instance
   * @param  epnum: endpoint index
   * @retval status
   */
 static uint8_t  USBD_AUDIO_IsoINIncomplete (USBD_HandleTypeDef *pdev, uint8_t epnum)
 {
- USBD_AUDIO_EPTypeDef   *ep;
- USBD_AUDIO_HandleTypeDef   *haudio;
- uint16_t current_sof;
+  USBD_AUDIO_EPTypeDef   *ep;
+  USBD_AUDIO_HandleTypeDef   *haudio;
+
   haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
- /* @TODO check if the feedback is responsible of event */
-  for(int i = 1; i<USBD_AUDIO_MAX_IN_EP; i++)
-  {
-    ep = &haudio->ep_in[i];
-    current_sof = USB_SOF_NUMBER();
-    if((ep->open)&&
-       ((ep->ep_usage == USBD_AUDIO_FEEDBACK_EP)||(ep->ep_usage == USBD_AUDIO_DATA_EP))
-         /*&& IS_ISO_IN_INCOMPLETE_EP(i,current_sof, ep->tx_rx_soffn)*/)
+  epnum &= 0x7FU;
+  if((haudio == NULL) || (epnum == 0U) || (epnum >= USBD_AUDIO_MAX_IN_EP))
+  {
+    return USBD_FAIL;
+  }
+  ep = &haudio->ep_in[epnum];
+  if(ep->open == 0U)
+  {
+    return USBD_OK;
+  }
+  ep->incomplete_count++;
+  AUDIO_TRACE(AUDIO_TRACE_ISO_IN_INCOMPLETE, epnum, ep->incomplete_count);
+  ep->tx_rx_soffn = USB_SOF_NUMBER();
+#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK  
+  if(ep->ep_usage == USBD_AUDIO_FEEDBACK_EP)
+  {
+    USBD_LL_Transmit(pdev, 
+                     epnum|0x80,
+                     USBD_AUDIO_FeedbackNextBuffer(ep->ep_description.sync_ep),
+                     ep->max_packet_length);
+  }
+  else
+#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
+  if(ep->ep_usage == USBD_AUDIO_DATA_EP)
+  {
+    USBD_LL_Transmit(pdev, 
+                     epnum|0x80,
+                     ep->ep_description.data_ep->buf,
+                     ep->ep_description.data_ep->length);
+  }
+  return USBD_OK;
+}
+
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+/**
+  * @brief  USBD_AUDIO_NextInPacket
+  *         packet to arm from the IN complete interrupt : the staged one, else
+  *         it is taken from GetBuffer as without pipeline, or is a zero length
+  *         packet when the staging was preempted while running GetBuffer
+  * @param  data_ep: IN data endpoint
+  * @param  length: returned packet length
+  * @retval packet buffer
+  */
+static uint8_t* USBD_AUDIO_NextInPacket(USBD_AUDIO_EP_DataTypeDef* data_ep, uint16_t* length)
+{
+  uint8_t* buf;
+
+  if(data_ep->StageRequest == 0)
+  {
+    return USBD_AUDIO_IN_GET_BUFFER(data_ep, length);
+  }
+  if(data_ep->staged)
+  {
+    buf = data_ep->staged_buf;
+    *length = data_ep->staged_length;
+    data_ep->staged = 0;
+  }
+  else
+  {
+    data_ep->stage_miss_count++;
+    if(data_ep->staging)
     {
-    if(i==3){
+      /* GetBuffer can't run twice at a time, the last packet buffer stays armed */
+      buf = data_ep->buf;
+      *length = 0;
+    }
+    else
+    {
+      buf = USBD_AUDIO_IN_GET_BUFFER(data_ep, length);
+    }
+  }
+  data_ep->StageRequest(data_ep->private_data);
+  return buf;
+}
+
+/**
+  * @brief  USBD_AUDIO_StageInPacket
+  *         takes the next packet of an IN data endpoint from its GetBuffer, to
+  *         call out of the ISR when StageRequest asks for it. A packet already
+  *         staged is kept
+  * @param  data_ep: IN data endpoint
+  * @retval None
+  */
+void  USBD_AUDIO_StageInPacket(USBD_AUDIO_EP_DataTypeDef* data_ep)
+{
+  uint16_t length;
+  uint8_t* buf;
+
+  if(data_ep->staged)
+  {
+    return;
+  }
+  /* the IN complete interrupt skips GetBuffer while staging is set */
+  data_ep->staging = 1;
+  buf = USBD_AUDIO_IN_GET_BUFFER(data_ep, &length);
+  data_ep->staged_buf = buf;
+  data_ep->staged_length = length;
+  data_ep->staged = 1;
+  data_ep->staging = 0;
+}
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
 
-    	__NOP();
+/**
+  * @brief  USBD_AUDIO_GetIsoINIncompleteCount
+  *         count of ISO IN transfers which missed their frame on an endpoint
+  * @param  pdev: device instance
+  * @param  ep_addr: IN endpoint address
+  * @retval count since the audio class init
+  */
+uint32_t  USBD_AUDIO_GetIsoINIncompleteCount(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  uint8_t idx = pdev->classId;
+
+#ifdef USE_USBD_COMPOSITE
+  idx = USBD_CoreFindEP(pdev, ep_addr | 0x80U);
+  if(idx >= USBD_MAX_SUPPORTED_CLASS)
+  {
+    return 0;
+  }
+#endif /* USE_USBD_COMPOSITE */
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[idx];
+  if((haudio == NULL) || ((ep_addr & 0x7FU) >= USBD_AUDIO_MAX_IN_EP))
+  {
+    return 0;
+  }
+  return haudio->ep_in[ep_addr & 0x7FU].incomplete_count;
+}
+
+#ifdef USE_AUDIO_USB_ADMISSION
+/**
+  * @brief  USBD_AUDIO_AdmitAlternate
+  *         checks a streaming alternate before its endpoints are opened : its
+  *         packet must fit the endpoint FIFO and, with the endpoints already
+  *         open in every audio function, the periodic part of a (micro)frame.
+  *         All the streams are counted in the same (micro)frame whatever their
+  *         bInterval, the host may schedule them so
+  * @param  pdev: device instance
+  * @param  ep_addr: data endpoint address
+  * @param  packet_length: data endpoint max packet length
+  * @param  sync_length: feedback endpoint packet length, 0 without feedback
+  * @retval USBD_OK if the alternate can be serviced
+  */
+static uint8_t  USBD_AUDIO_AdmitAlternate(USBD_HandleTypeDef *pdev, uint8_t ep_addr,
+                                          uint16_t packet_length, uint16_t sync_length)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  uint32_t budget = USBD_AUDIO_FS_PERIODIC_BYTES;
+  uint32_t overhead = USBD_AUDIO_FS_ISO_OVERHEAD;
+  uint32_t max_packet = USBD_AUDIO_FS_ISO_MAX_PACKET;
+  uint32_t used;
+  uint32_t i;
+  uint8_t n;
+
+  if(pdev->dev_speed == USBD_SPEED_HIGH)
+  {
+    budget = USBD_AUDIO_HS_PERIODIC_BYTES;
+    overhead = USBD_AUDIO_HS_ISO_OVERHEAD;
+    max_packet = USBD_AUDIO_HS_ISO_MAX_PACKET;
+  }
+  used = USBD_AUDIO_PERIODIC_RESERVE + packet_length + overhead;
+  if(sync_length != 0U)
+  {
+    used += sync_length + overhead;
+  }
+  for(i = 0; i < pdev->NumClasses; i++)
+  {
+    if((pdev->pClass[i] != &USBD_AUDIO) || (pdev->pClassDataCmsit[i] == NULL))
+    {
+      continue;
     }
-      epnum = i|0x80;
-      USB_CLEAR_INCOMPLETE_IN_EP(epnum);
-      USBD_LL_FlushEP(pdev, epnum);
-      ep->tx_rx_soffn = USB_SOF_NUMBER();
-#if USBD_SUPPORT_AUDIO_OUT_FEEDBACK  
-      if(ep->ep_usage == USBD_AUDIO_FEEDBACK_EP)
+    haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[i];
+    for(n = 1; n < USBD_AUDIO_MAX_IN_EP; n++)
+    {
+      if(haudio->ep_in[n].open)
       {
-        USBD_LL_Transmit(pdev, 
-                         epnum,
-                         ep->ep_description.sync_ep->feedback_data,
-                         ep->max_packet_length);
-        continue;
+        used += haudio->ep_in[n].max_packet_length + overhead;
       }
-      else
-#endif /*USBD_SUPPORT_AUDIO_OUT_FEEDBACK */
-      if(ep->ep_usage == USBD_AUDIO_DATA_EP)
+    }
+    for(n = 1; n < USBD_AUDIO_MAX_OUT_EP; n++)
+    {
+      if(haudio->ep_out[n].open)
       {
-          USBD_LL_Transmit(pdev, 
-                      epnum,
-                      ep->ep_description.data_ep->buf,
-                      ep->ep_description.data_ep->length);
+        used += haudio->ep_out[n].max_packet_length + overhead;
       }
     }
   }
-  return 0;
+  if((packet_length > max_packet) || (packet_length > USBD_LL_GetIsoFifoSize(pdev, ep_addr)) || (used > budget))
+  {
+    audio_admission_refused++;
+    AUDIO_TRACE(AUDIO_TRACE_ADMISSION, ep_addr, used);
+    return USBD_FAIL;
+  }
+  return USBD_OK;
+}
+
+/**
+  * @brief  USBD_AUDIO_GetAdmissionRefusedCount
+  *         count of streaming alternates refused for bandwidth or FIFO space
+  * @param  None
+  * @retval count since power on
+  */
+uint32_t USBD_AUDIO_GetAdmissionRefusedCount(void)
+{
+  return audio_admission_refused;
+}
+#endif /* USE_AUDIO_USB_ADMISSION */
+
+#ifdef USE_AUDIO_ISO_SLACK
+/**
+  * @brief  USBD_AUDIO_RecordSlack
+  *         records the time left in the (micro)frame when the next transfer of
+  *         an endpoint is handed to the core. When the completion is serviced
+  *         before the SOF raised in the same interrupt, the stamp is from the
+  *         previous frame , the frame numbers elapsed since are taken off
+  * @param  ep: endpoint
+  * @retval None
+  */
+static void USBD_AUDIO_RecordSlack(USBD_AUDIO_EPTypeDef* ep)
+{
+  USBD_AUDIO_IsoSlackTypeDef* slack = &ep->slack;
+#ifdef USE_AUDIO_USB_LOW_RATE
+  /* the re-arm has until the next poll */
+  const int32_t period_us = 1000 * (int32_t)AUDIO_USB_PACKET_MS;
+#else /* USE_AUDIO_USB_LOW_RATE */
+  const int32_t period_us = 1000 / (int32_t)AUDIO_SOF_TICK_PER_MS;
+#endif /* USE_AUDIO_USB_LOW_RATE */
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  uint32_t frames;
+  int32_t elapsed_us;
+  int32_t slack_us;
+  uint32_t bin;
+
+  frames = ((uint32_t)ep->tx_rx_soffn - audio_sof_fn) & USB_SOF_NUMBER_MASK;
+  elapsed_us = (int32_t)((DWT->CYCCNT - audio_sof_cycles) / cycles_per_us);
+  elapsed_us -= (int32_t)frames * period_us;
+  slack_us = period_us - elapsed_us;
+  if(slack_us < 0)
+  {
+    slack->late++;
+    bin = 0;
+  }
+  else
+  {
+    bin = ((uint32_t)slack_us * USBD_AUDIO_SLACK_BINS) / (uint32_t)period_us;
+    bin = (bin >= USBD_AUDIO_SLACK_BINS) ? (USBD_AUDIO_SLACK_BINS - 1U) : bin;
+  }
+  slack_us = (slack_us < INT16_MIN) ? INT16_MIN : ((slack_us > INT16_MAX) ? INT16_MAX : slack_us);
+  if((slack->count == 0U) || (slack_us < slack->worst_us))
+  {
+    slack->worst_us = (int16_t)slack_us;
+  }
+  slack->hist[bin]++;
+  slack->count++;
+}
+
+/**
+  * @brief  USBD_AUDIO_GetIsoSlack
+  *         deadline slack of the transfers of an endpoint
+  * @param  pdev: device instance
+  * @param  ep_addr: endpoint address, bit 7 set for IN
+  * @param  slack: returned slack since the audio class init
+  * @retval status
+  */
+uint8_t  USBD_AUDIO_GetIsoSlack(USBD_HandleTypeDef *pdev, uint8_t ep_addr, USBD_AUDIO_IsoSlackTypeDef* slack)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  USBD_AUDIO_EPTypeDef   *ep;
+  uint32_t primask;
+  uint8_t idx = pdev->classId;
+  uint8_t epnum = ep_addr & 0x7FU;
+
+#ifdef USE_USBD_COMPOSITE
+  idx = USBD_CoreFindEP(pdev, ep_addr);
+  if(idx >= USBD_MAX_SUPPORTED_CLASS)
+  {
+    return USBD_FAIL;
+  }
+#endif /* USE_USBD_COMPOSITE */
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[idx];
+  if(haudio == NULL)
+  {
+    return USBD_FAIL;
+  }
+  if((ep_addr & 0x80U) != 0U)
+  {
+    if(epnum >= USBD_AUDIO_MAX_IN_EP)
+    {
+      return USBD_FAIL;
+    }
+    ep = &haudio->ep_in[epnum];
+  }
+  else
+  {
+    if(epnum >= USBD_AUDIO_MAX_OUT_EP)
+    {
+      return USBD_FAIL;
+    }
+    ep = &haudio->ep_out[epnum];
+  }
+  /* the completions run in the USB interrupt */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *slack = ep->slack;
+  __set_PRIMASK(primask);
+  return USBD_OK;
 }
+#endif /* USE_AUDIO_ISO_SLACK */
+
 /**
   * @brief  USBD_AUDIO_IsoOutIncomplete
-  *         handle data ISO OUT Incomplete event
+  *         handle data ISO OUT Incomplete event. The PCD driver has disabled
+  *         the endpoint which received nothing in the elapsed frame, the user
+  *         conceals the missing packet then the endpoint is armed again. The
+  *         transfer start selects the parity of the next frame
   * @param  pdev: device instance
   * @param  epnum: endpoint index
   * @retval status
   */
 static uint8_t  USBD_AUDIO_IsoOutIncomplete (USBD_HandleTypeDef *pdev, uint8_t epnum)
 {
+  USBD_AUDIO_EPTypeDef   *ep;
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  uint8_t *pbuf;
+  uint16_t packet_length;
 
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+  epnum &= 0x7FU;
+  if((haudio == NULL) || (epnum == 0U) || (epnum >= USBD_AUDIO_MAX_OUT_EP))
+  {
+    return USBD_FAIL;
+  }
+  ep = &haudio->ep_out[epnum];
+  if((ep->open == 0U) || (ep->ep_usage != USBD_AUDIO_DATA_EP))
+  {
+    return USBD_OK;
+  }
+  ep->incomplete_count++;
+  AUDIO_TRACE(AUDIO_TRACE_ISO_OUT_INCOMPLETE, epnum, ep->incomplete_count);
+  if(ep->ep_description.data_ep->DataMissed)
+  {
+    ep->ep_description.data_ep->DataMissed(ep->ep_description.data_ep->private_data);
+  }
+  pbuf = USBD_AUDIO_OUT_GET_BUFFER(ep->ep_description.data_ep, &packet_length);
+  USBD_LL_PrepareReceive(pdev,
+                         epnum,
+                         pbuf,
+                         packet_length);
   return USBD_OK;
 }
+
+/**
+  * @brief  USBD_AUDIO_GetIsoOUTIncompleteCount
+  *         count of ISO OUT packets which were not received in their frame
+  * @param  pdev: device instance
+  * @param  ep_addr: OUT endpoint address
+  * @retval count since the audio class init
+  */
+uint32_t  USBD_AUDIO_GetIsoOUTIncompleteCount(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  uint8_t idx = pdev->classId;
+
+#ifdef USE_USBD_COMPOSITE
+  idx = USBD_CoreFindEP(pdev, ep_addr & 0x7FU);
+  if(idx >= USBD_MAX_SUPPORTED_CLASS)
+  {
+    return 0;
+  }
+#endif /* USE_USBD_COMPOSITE */
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[idx];
+  if((haudio == NULL) || ((ep_addr & 0x7FU) >= USBD_AUDIO_MAX_OUT_EP))
+  {
+    return 0;
+  }
+  return haudio->ep_out[ep_addr & 0x7FU].incomplete_count;
+}
 /**
   * @brief  USBD_AUDIO_DataOut
   *         handle data OUT Stage
@@ -935,30 +1722,69 @@ static uint8_t  USBD_AUDIO_DataOut (USBD_HandleTypeDef *pdev,
   USBD_AUDIO_EPTypeDef * ep;
   uint8_t *pbuf ;
   uint16_t packet_length;
-
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+  uint16_t rx_length;
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
+  AUDIO_PROF_BEGIN(AUDIO_PROF_AUDIO_DATA_OUT);
 
   ep=&((USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId])->ep_out[epnum];
   if(ep->open)
   {
     /* get received length */
     packet_length = USBD_LL_GetRxDataSize(pdev, epnum);
-    /* inform user about data reception  */
-    ep->ep_description.data_ep->DataReceived(packet_length,ep->ep_description.data_ep->private_data);
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+    /* the node receives in two buffers : the endpoint is armed with the other one
+       before the received packet is processed */
+    AUDIO_PROF_BEGIN(AUDIO_PROF_NODE_GET_BUFFER);
+    pbuf=  USBD_AUDIO_OUT_GET_BUFFER(ep->ep_description.data_ep, &rx_length);
+    AUDIO_PROF_END(AUDIO_PROF_NODE_GET_BUFFER);
+#ifdef USE_AUDIO_ISO_SLACK
+    USBD_AUDIO_RecordSlack(ep);
+#endif /* USE_AUDIO_ISO_SLACK */
+    USBD_LL_PrepareReceive(pdev,
+                           epnum,
+                           pbuf,
+                           rx_length);
+#ifdef USE_AUDIO_FAULT_INJECTION
+    if(AUDIO_FaultDropOut() == 0U)
+#endif /* USE_AUDIO_FAULT_INJECTION */
+    {
+      AUDIO_PROF_BEGIN(AUDIO_PROF_NODE_DATA_RECEIVED);
+      USBD_AUDIO_OUT_DATA_RECEIVED(ep->ep_description.data_ep, packet_length);
+      AUDIO_PROF_END(AUDIO_PROF_NODE_DATA_RECEIVED);
+    }
+#else /* USE_AUDIO_USB_OUT_PINGPONG */
+    /* inform user about data reception , a dropped packet is overwritten by the next one */
+#ifdef USE_AUDIO_FAULT_INJECTION
+    if(AUDIO_FaultDropOut() == 0U)
+#endif /* USE_AUDIO_FAULT_INJECTION */
+    {
+      AUDIO_PROF_BEGIN(AUDIO_PROF_NODE_DATA_RECEIVED);
+      USBD_AUDIO_OUT_DATA_RECEIVED(ep->ep_description.data_ep, packet_length);
+      AUDIO_PROF_END(AUDIO_PROF_NODE_DATA_RECEIVED);
+    }
      
     /* get buffer to receive new packet */  
-    pbuf=  ep->ep_description.data_ep->GetBuffer(ep->ep_description.data_ep->private_data,&packet_length);                               
+    AUDIO_PROF_BEGIN(AUDIO_PROF_NODE_GET_BUFFER);
+    pbuf=  USBD_AUDIO_OUT_GET_BUFFER(ep->ep_description.data_ep, &packet_length);
+    AUDIO_PROF_END(AUDIO_PROF_NODE_GET_BUFFER);
     /* Prepare Out endpoint to receive next audio packet */
+#ifdef USE_AUDIO_ISO_SLACK
+    USBD_AUDIO_RecordSlack(ep);
+#endif /* USE_AUDIO_ISO_SLACK */
      USBD_LL_PrepareReceive(pdev,
                             epnum,
                             pbuf,
                             packet_length);
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
     }
     else
     {
-      USBD_error_handler();
+      /* closed by a SET_INTERFACE while the packet was received */
+      ep->dropped_count++;
     }
     
-  
+    AUDIO_PROF_END(AUDIO_PROF_AUDIO_DATA_OUT);
     return USBD_OK;
 }
 
@@ -974,6 +1800,7 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
   USBD_AUDIO_HandleTypeDef   *haudio;
   USBD_AUDIO_ControlTypeDef * ctl = 0;
   uint8_t unit_id,control_selector;
+  uint8_t *response = 0; /* a payload prebuilt by the unit, else last_control.data */
  
   haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
   
@@ -983,13 +1810,9 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
   /* get the Unit Id */
   unit_id = HIBYTE(req->wIndex);
   
-  for (int i = 0;i < haudio->aud_function.control_count; i++)
+  if((unit_id <= USBD_AUDIO_MAX_ENTITY_ID) && (haudio->control_index[unit_id] != 0U))
   {
-    if(unit_id == haudio->aud_function.controls[i].id)
-    {
-      ctl = &haudio->aud_function.controls[i];
-      break;
-    }     
+    ctl = &haudio->aud_function.controls[haudio->control_index[unit_id] - 1U];
   }
    control_selector = HIBYTE(req->wValue);
   if(!ctl)
@@ -1030,14 +1853,19 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
           {
                   case USBD_AUDIO_FU_MUTE_CONTROL:
                     {
-                      /* @TODO treat multi channel case and error when req! of GetCur*/
+                      /* channel number is in wValue low byte, 0 for master */
                       
                       haudio->last_control.data[0] = 0;
                       haudio->last_control.len = 1;
                       if(feature_control->GetMute)
                       {
-                        feature_control->GetMute(LOBYTE(req->wValue),
-                                                                &haudio->last_control.data[0], ctl->private_data);
+                        if(feature_control->GetMute(LOBYTE(req->wValue),
+                                                                &haudio->last_control.data[0], ctl->private_data) != 0)
+                        {
+                          /* channel not supported */
+                          USBD_CtlError (pdev, req);
+                          return  USBD_FAIL;
+                        }
                       }
 
                       break;
@@ -1053,8 +1881,13 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
                               if(feature_control->GetCurVolume)
                               {
                                   uint16_t cur_vol;
-                                  feature_control->GetCurVolume(LOBYTE(req->wValue),
-                                                                (uint16_t*)&cur_vol, ctl->private_data);
+                                  if(feature_control->GetCurVolume(LOBYTE(req->wValue),
+                                                                (uint16_t*)&cur_vol, ctl->private_data) != 0)
+                                  {
+                                    /* channel not supported */
+                                    USBD_CtlError (pdev, req);
+                                    return  USBD_FAIL;
+                                  }
                                   AUDIO_2_L2_CUR_VAL_TO_DATA(cur_vol, haudio->last_control.data);
                                   haudio->last_control.len = 2;
                               }
@@ -1067,11 +1900,17 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
                               break;
                           
                         case USBD_AUDIO_CS_REQ_RANGE:
+                          if(feature_control->VolumeRange)
+                          {
+                            response = feature_control->VolumeRange;
+                            haudio->last_control.len = AUDIO_2_RNG_PAYLOAD_SIZE(AUDIO_2_L2_RNG_SIZE, 1U);
+                            break;
+                          }
                           haudio->last_control.data[0] = 1 ; /* one subrange */
                           haudio->last_control.data[1] = 0 ;
-                          AUDIO_2_L2_RNG_VAL_TO_DATA( feature_control->MinVolume,feature_control->ResVolume,
-                                                     feature_control->MaxVolume, haudio->last_control.data + 2);
-                          haudio->last_control.len = 8;
+                          AUDIO_2_L2_RNG_VAL_TO_DATA( feature_control->MinVolume,feature_control->MaxVolume,
+                                                     feature_control->ResVolume, haudio->last_control.data + 2);
+                          haudio->last_control.len = AUDIO_2_RNG_PAYLOAD_SIZE(AUDIO_2_L2_RNG_SIZE, 1U);
                           break;
                         default :
                                 USBD_error_handler();
@@ -1112,7 +1951,12 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
                   {
                     /* Get Range frequency */
 
-                    if(clk_control->GetFrequencyList)
+                    if(clk_control->FrequencyRange)
+                    {
+                      response = clk_control->FrequencyRange;
+                      haudio->last_control.len = clk_control->FrequencyRangeLength;
+                    }
+                    else if(clk_control->GetFrequencyList)
                     {
                        uint32_t* freq_list;
                        uint8_t  freq_count;
@@ -1127,7 +1971,7 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
                         for(int i= 0; i < freq_count; i++)
                         {
                            AUDIO_2_L3_RNG_VAL_TO_DATA(freq_list[i] ,freq_list[i], 0, control_data );
-                           control_data+=12;
+                           control_data+=AUDIO_2_L3_RNG_SIZE;
                         }
                          haudio->last_control.len = control_data -  haudio->last_control.data;
                       }
@@ -1177,6 +2021,23 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
 
                   break;
                  }
+  case USBD_AUDIO_CS_AC_SUBTYPE_CLOCK_SELECTOR:
+    {
+      USBD_AUDIO_ClockSelectorCallbacksTypeDef* sel_control = ctl->Callbacks.clk_sel_control;
+      /* the selector control has only the CUR attribute */
+      if((control_selector == USBD_AUDIO_CX_CLOCK_SELECTOR_CONTROL) && (req->bRequest == USBD_AUDIO_CS_REQ_CUR) &&
+         sel_control->GetCurSelector)
+      {
+        sel_control->GetCurSelector(&haudio->last_control.data[0], ctl->private_data);
+        haudio->last_control.len = 1;
+      }
+      else
+      {
+        USBD_CtlError (pdev, req);
+        return  USBD_FAIL;
+      }
+      break;
+    }
             default :
                       USBD_error_handler();
     }
@@ -1186,9 +2047,55 @@ static uint8_t AUDIO_REQ(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
       haudio->last_control.len = req->wLength;
     }
   
-    USBD_CtlSendData (pdev, haudio->last_control.data,haudio->last_control.len);
+    if(!response)
+    {
+      response = haudio->last_control.data;
+    }
+    USBD_CtlSendData (pdev, response,haudio->last_control.len);
+  return USBD_OK;
+}
+
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+/**
+  * @brief  USBD_AUDIO_VendorRequest
+  *         Handles the vendor requests to an audio interface : stats, trace
+  *         and parameter sets, see audio_vendor_request.h. Answered at once
+  *         from a static block, the data stage is bounded so the next class
+  *         request is not delayed
+  * @param  pdev: instance
+  * @param  req: setup vendor request
+  * @retval status
+  */
+static uint8_t USBD_AUDIO_VendorRequest(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  USBD_AUDIO_HandleTypeDef   *haudio;
+  uint8_t *pbuf;
+  uint16_t len;
+
+  haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+  haudio->last_control.req = 0x00;
+  if(((req->bmRequest & USB_REQ_RECIPIENT_MASK) != USB_REQ_RECIPIENT_INTERFACE)||
+     (AUDIO_VendorRequestSetup(req->bRequest, req->wValue, req->wLength, (req->bmRequest & 0x80U) ? 1U : 0U,
+                               &pbuf, &len) != 0))
+  {
+    USBD_CtlError (pdev, req);
+    return USBD_FAIL;
+  }
+  if(req->bmRequest & 0x80U)
+  {
+    USBD_CtlSendData (pdev, pbuf, MIN(len, req->wLength));
+  }
+  else if(req->wLength != 0U)
+  {
+    /* the core sends the status stage of a request without data */
+    haudio->last_control.request_target = AUDIO_VENDOR_REQUEST;
+    haudio->last_control.len = req->wLength;
+    haudio->last_control.req = req->bRequest;
+    USBD_CtlPrepareRx (pdev, pbuf, req->wLength);
+  }
   return USBD_OK;
 }
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
 
 /**
 * @brief  DeviceQualifierDescriptor 
@@ -1202,6 +2109,32 @@ static uint8_t  *USBD_AUDIO_GetDeviceQualifierDesc (uint16_t *length)
   return USBD_AUDIO_DeviceQualifierDesc;
 }
 
+/**
+* @brief  USBD_AUDIO_InstanceIndex
+*         index of the audio function being called among the audio classes
+*         of the device, in the order of their registration
+* @param  pdev: device instance, classId set by the core
+* @retval instance index
+*/
+static uint8_t  USBD_AUDIO_InstanceIndex(USBD_HandleTypeDef *pdev)
+{
+  uint8_t instance = 0;
+#ifdef USE_USBD_COMPOSITE
+  uint8_t i;
+
+  for(i = 0; i < pdev->classId; i++)
+  {
+    if(pdev->tclasslist[i].ClassType == CLASS_TYPE_AUDIO)
+    {
+      instance++;
+    }
+  }
+#else /* USE_USBD_COMPOSITE */
+  UNUSED(pdev);
+#endif /* USE_USBD_COMPOSITE */
+  return instance;
+}
+
 /**
 * @brief  USBD_AUDIO_RegisterInterface
 * @param  fops: Audio interface callback
@@ -1222,102 +2155,126 @@ uint8_t  USBD_AUDIO_RegisterInterface  (USBD_HandleTypeDef   *pdev,
 #if USBD_AUDIO_SUPPORT_INTERRUPT
 /**
 * @brief  USBD_AUDIO_TransmitInterrupt
-* @param  void
+*         sends the oldest pending interrupt of the highest pending priority
+* @param  pdev: device instance
+* @param  haudio: class data of the audio function
 * @retval status
 */
-static uint8_t  USBD_AUDIO_TransmitInterrupt()
+static uint8_t  USBD_AUDIO_TransmitInterrupt(USBD_HandleTypeDef *pdev, USBD_AUDIO_HandleTypeDef *haudio)
 {
-    USBD_AUDIO_HandleTypeDef   *haudio;
-  int pos = USBD_AUDIO_INTERRUPT_TABLE_SIZE;
+  uint8_t level, pos, bucket;
+  uint8_t* link;
   
-  if(pdev_audio&&pdev_audio->pClassData)
+  if((haudio->is_ep_busy == 0)&&(haudio->priority_map != 0))
   {
-    haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
-
-    if(haudio->is_ep_busy == 0)
+    /* lowest set bit is the highest priority */
+    level = USBD_AUDIO_InterruptLevel(haudio->priority_map & (uint8_t)(~haudio->priority_map + 1U));
+    pos = haudio->interrupt_head[level];
+    haudio->interrupt_head[level] = haudio->interrupt_next[pos];
+    if(haudio->interrupt_head[level] == USBD_AUDIO_INTERRUPT_NONE)
     {
-  
-      for( int i = 0; i < USBD_AUDIO_INTERRUPT_TABLE_SIZE; i++)
-      {
-        if((haudio->interrupts[i].priority != USBD_AUDIO_NOT_USED_PRIORITY)
-            &&((pos == USBD_AUDIO_INTERRUPT_TABLE_SIZE)||
-                (haudio->interrupts[i].priority<haudio->interrupts[pos].priority))) 
-        {
-          pos = i;
-        }
-      }
-      if(pos<USBD_AUDIO_INTERRUPT_TABLE_SIZE)
-      {
-        haudio->is_ep_busy = 1;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_BINFO_OFFSET]= haudio->interrupts[pos].type;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_BATTRIBUTE_OFFSET]= haudio->interrupts[pos].attr;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WVALUE_OFFSET]= haudio->interrupts[pos].cn_mcn;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WVALUE_OFFSET+1]= haudio->interrupts[pos].cs;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WINDEX_OFFSET+1]=  haudio->interrupts[pos].entity_id;
-        haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WINDEX_OFFSET]=haudio->interrupts[pos].ep_if_id;
-        haudio->interrupts[pos].priority = USBD_AUDIO_NOT_USED_PRIORITY;
-            USBD_LL_Transmit(pdev_audio, haudio->aud_function.interrupt_ep_num,
-                            haudio->interrupt_message, USBD_AUDIO_INTERRUPT_DATA_MESSAGE_SIZE);
-        return 0;
-      }
+      haudio->interrupt_tail[level] = USBD_AUDIO_INTERRUPT_NONE;
+      haudio->priority_map &= (uint8_t)~haudio->interrupts[pos].priority;
     }
+    /* unlink from its bucket, buckets hold a few entries at most */
+    bucket = USBD_AUDIO_InterruptHash(&haudio->interrupts[pos]);
+    link = &haudio->interrupt_hash[bucket];
+    while(*link != pos)
+    {
+      link = &haudio->interrupt_hash_next[*link];
+    }
+    *link = haudio->interrupt_hash_next[pos];
+
+    haudio->is_ep_busy = 1;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_BINFO_OFFSET]= haudio->interrupts[pos].type;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_BATTRIBUTE_OFFSET]= haudio->interrupts[pos].attr;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WVALUE_OFFSET]= haudio->interrupts[pos].cn_mcn;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WVALUE_OFFSET+1]= haudio->interrupts[pos].cs;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WINDEX_OFFSET+1]=  haudio->interrupts[pos].entity_id;
+    haudio->interrupt_message[USBD_AUDIO_INTERRUPT_MESSAGE_WINDEX_OFFSET]=haudio->interrupts[pos].ep_if_id;
+    haudio->interrupts[pos].priority = USBD_AUDIO_NOT_USED_PRIORITY;
+    haudio->interrupt_next[pos] = haudio->interrupt_free;
+    haudio->interrupt_free = pos;
+    USBD_LL_Transmit(pdev, haudio->aud_function.interrupt_ep_num,
+                     haudio->interrupt_message, USBD_AUDIO_INTERRUPT_DATA_MESSAGE_SIZE);
+    return 0;
   }
   return 1;
 }
 
 /*
 * @brief  USBD_AUDIO_SendInterrupt
+*         queues an interrupt of the first audio function
 * @param  interrupt
 * @retval status
 */
 uint8_t  USBD_AUDIO_SendInterrupt  (USBD_AUDIO_InterruptTypeDef *interrupt)
 {
-  int pos = USBD_AUDIO_INTERRUPT_TABLE_SIZE;
+  return USBD_AUDIO_SendInstanceInterrupt(0, interrupt);
+}
+
+/*
+* @brief  USBD_AUDIO_SendInstanceInterrupt
+*         queues an interrupt in the fifo of its priority, an interrupt equal
+*         to a pending one is coalesced with it
+* @param  instance: audio function, in the order of registration
+* @param  interrupt
+* @retval status
+*/
+uint8_t  USBD_AUDIO_SendInstanceInterrupt(uint8_t instance, USBD_AUDIO_InterruptTypeDef *interrupt)
+{
   USBD_AUDIO_HandleTypeDef   *haudio;
+  USBD_HandleTypeDef         *pdev;
+  uint8_t level, pos, bucket;
   
-  if(pdev_audio&&pdev->pClassDataCmsit[pdev->classId])
+  pdev = (instance < USBD_AUDIO_MAX_INSTANCES) ? audio_instance_pdev[instance] : 0;
+  if(pdev && pdev->pClassDataCmsit[audio_instance_class[instance]])
   {
-    haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[pdev->classId];
+    haudio = (USBD_AUDIO_HandleTypeDef*) pdev->pClassDataCmsit[audio_instance_class[instance]];
+    level = USBD_AUDIO_InterruptLevel(interrupt->priority);
+    if(level == USBD_AUDIO_INTERRUPT_NONE)
+    {
+      return 2;
+    }
 
-    for( int i = 0; i < USBD_AUDIO_INTERRUPT_TABLE_SIZE; i++)
+    bucket = USBD_AUDIO_InterruptHash(interrupt);
+    for(pos = haudio->interrupt_hash[bucket]; pos != USBD_AUDIO_INTERRUPT_NONE; pos = haudio->interrupt_hash_next[pos])
     {
-      if((haudio->interrupts[i].priority == USBD_AUDIO_NOT_USED_PRIORITY)&&(pos == USBD_AUDIO_INTERRUPT_TABLE_SIZE))
+      if(interrupt->type == haudio->interrupts[pos].type &&
+         interrupt->attr == haudio->interrupts[pos].attr &&
+         interrupt->ep_if_id == haudio->interrupts[pos].ep_if_id &&
+         interrupt->entity_id == haudio->interrupts[pos].entity_id &&
+         interrupt->cs == haudio->interrupts[pos].cs &&
+         interrupt->cn_mcn == haudio->interrupts[pos].cn_mcn)
       {
-        pos = i;
+        return 0;
       }
-      else
-       if(haudio->interrupts[i].priority != USBD_AUDIO_NOT_USED_PRIORITY)
-       {
-         if(interrupt->type == haudio->interrupts[i].type &&
-            interrupt->attr == haudio->interrupts[i].attr &&
-            interrupt->ep_if_id == haudio->interrupts[i].ep_if_id &&
-            interrupt->entity_id == haudio->interrupts[i].entity_id &&
-            interrupt->cs == haudio->interrupts[i].cs &&
-            interrupt->cn_mcn == haudio->interrupts[i].cn_mcn)
-         {
-           return 0;
-         }
-       }
-      
     }
-    if(pos < USBD_AUDIO_INTERRUPT_TABLE_SIZE)
+
+    pos = haudio->interrupt_free;
+    if(pos == USBD_AUDIO_INTERRUPT_NONE)
+    {
+      return 2;
+    }
+    haudio->interrupt_free = haudio->interrupt_next[pos];
+    haudio->interrupts[pos] = *interrupt;
+    haudio->interrupt_next[pos] = USBD_AUDIO_INTERRUPT_NONE;
+    if(haudio->interrupt_tail[level] == USBD_AUDIO_INTERRUPT_NONE)
     {
-      haudio->interrupts[pos].type = interrupt->type;
-      haudio->interrupts[pos].attr = interrupt->attr;
-      haudio->interrupts[pos].ep_if_id = interrupt->ep_if_id;
-      haudio->interrupts[pos].entity_id = interrupt->entity_id;
-      haudio->interrupts[pos].cs = interrupt->cs;
-      haudio->interrupts[pos].cn_mcn = interrupt->cn_mcn;
-      haudio->interrupts[pos].priority = interrupt->priority;
+      haudio->interrupt_head[level] = pos;
     }
     else
     {
-      return 2;
+      haudio->interrupt_next[haudio->interrupt_tail[level]] = pos;
     }
+    haudio->interrupt_tail[level] = pos;
+    haudio->interrupt_hash_next[pos] = haudio->interrupt_hash[bucket];
+    haudio->interrupt_hash[bucket] = pos;
+    haudio->priority_map |= (uint8_t)interrupt->priority;
     
     if(haudio->is_ep_busy == 0)
     {
-      USBD_AUDIO_TransmitInterrupt();
+      USBD_AUDIO_TransmitInterrupt(pdev, haudio);
     }
     return 0;
   }
@@ -1326,6 +2283,58 @@ uint8_t  USBD_AUDIO_SendInterrupt  (USBD_AUDIO_InterruptTypeDef *interrupt)
     return 1;
   }
 }
+
+/**
+* @brief  USBD_AUDIO_InitInterrupts
+*         empties the priority fifos and the hash, all entries are free
+* @param  haudio: audio class data
+* @retval None
+*/
+static void  USBD_AUDIO_InitInterrupts(USBD_AUDIO_HandleTypeDef *haudio)
+{
+  for(int i = 0; i < USBD_AUDIO_INTERRUPT_TABLE_SIZE; i++)
+  {
+    haudio->interrupt_next[i] = (i + 1 < USBD_AUDIO_INTERRUPT_TABLE_SIZE) ? (uint8_t)(i + 1) : USBD_AUDIO_INTERRUPT_NONE;
+  }
+  haudio->interrupt_free = 0;
+  memset(haudio->interrupt_head, USBD_AUDIO_INTERRUPT_NONE, sizeof(haudio->interrupt_head));
+  memset(haudio->interrupt_tail, USBD_AUDIO_INTERRUPT_NONE, sizeof(haudio->interrupt_tail));
+  memset(haudio->interrupt_hash, USBD_AUDIO_INTERRUPT_NONE, sizeof(haudio->interrupt_hash));
+  haudio->priority_map = 0;
+}
+
+/**
+* @brief  USBD_AUDIO_InterruptLevel
+*         fifo index of a priority
+* @param  priority: one of USBD_AUDIO_InterruptPriorityTypeDef
+* @retval fifo index, USBD_AUDIO_INTERRUPT_NONE when priority is not valid
+*/
+static uint8_t  USBD_AUDIO_InterruptLevel(uint8_t priority)
+{
+  switch(priority)
+  {
+    case USBD_AUDIO_HIGH_PRIORITY:
+      return 0;
+    case USBD_AUDIO_NORMAL_PRIORITY:
+      return 1;
+    case USBD_AUDIO_LOW_PRIORITY:
+      return 2;
+    default :
+      return USBD_AUDIO_INTERRUPT_NONE;
+  }
+}
+
+/**
+* @brief  USBD_AUDIO_InterruptHash
+*         hash bucket of an interrupt, from what differs between two sources
+* @param  interrupt
+* @retval bucket index
+*/
+static uint8_t  USBD_AUDIO_InterruptHash(USBD_AUDIO_InterruptTypeDef *interrupt)
+{
+  return (uint8_t)((interrupt->entity_id ^ (interrupt->cs << 1) ^ (interrupt->cn_mcn << 2) ^ interrupt->ep_if_id)
+                   & (USBD_AUDIO_INTERRUPT_HASH_SIZE - 1U));
+}
 #endif /* USBD_AUDIO_SUPPORT_INTERRUPT  */
 /**
   * @}
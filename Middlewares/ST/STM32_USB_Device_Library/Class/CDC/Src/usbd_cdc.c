@@ -560,7 +560,9 @@ static uint8_t USBD_CDC_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
 
     if (((USBD_CDC_ItfTypeDef *)pdev->pUserData[pdev->classId])->TransmitCplt != NULL)
     {
+      AUDIO_PROF_BEGIN(AUDIO_PROF_CDC_XFER);
       ((USBD_CDC_ItfTypeDef *)pdev->pUserData[pdev->classId])->TransmitCplt(hcdc->TxBuffer, &hcdc->TxLength, epnum);
+      AUDIO_PROF_END(AUDIO_PROF_CDC_XFER);
     }
   }
 
@@ -589,7 +591,9 @@ static uint8_t USBD_CDC_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
   /* USB data will be immediately processed, this allow next USB traffic being
   NAKed till the end of the application Xfer */
 
+  AUDIO_PROF_BEGIN(AUDIO_PROF_CDC_XFER);
   ((USBD_CDC_ItfTypeDef *)pdev->pUserData[pdev->classId])->Receive(hcdc->RxBuffer, &hcdc->RxLength);
+  AUDIO_PROF_END(AUDIO_PROF_CDC_XFER);
 
   return (uint8_t)USBD_OK;
 }
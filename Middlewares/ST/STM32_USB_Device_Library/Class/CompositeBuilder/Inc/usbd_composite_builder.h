@@ -79,6 +79,10 @@ extern "C" {
 #include "usbd_mtp.h"
 #endif /* USBD_CMPSIT_ACTIVATE_MTP */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1U
+#include "usbd_vendor.h"
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
+
 /* Private defines -----------------------------------------------------------*/
 /* By default all classes are deactivated, in order to activate a class
    define its value to zero  */
@@ -130,13 +134,26 @@ extern "C" {
 #define USBD_CMPSIT_ACTIVATE_MTP                           0U
 #endif /* USBD_CMPSIT_ACTIVATE_MTP */
 
+#ifndef USBD_CMPSIT_ACTIVATE_VENDOR
+#define USBD_CMPSIT_ACTIVATE_VENDOR                        0U
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
+
 
 /* This is the maximum supported configuration descriptor size
-   User may define this value in usbd_conf.h in order to optimize footprint */
+   User may define this value in usbd_conf.h in order to optimize footprint,
+   8 channels feature units need about 50 more bytes than stereo ones */
 #ifndef USBD_CMPST_MAX_CONFDESC_SZ
-#define USBD_CMPST_MAX_CONFDESC_SZ                         400U
+#define USBD_CMPST_MAX_CONFDESC_SZ                         512U
 #endif /* USBD_CMPST_MAX_CONFDESC_SZ */
 
+/* When set to 1 the configuration descriptor of the CDC + AUDIO composite is a
+   constant in flash, generated at compile time. Classes registration only
+   assigns interfaces and endpoints, and checks they match the constant.
+   When set to 0 the descriptor is built in RAM, for any classes selection */
+#ifndef USBD_CMPSIT_STATIC_CONFDESC
+#define USBD_CMPSIT_STATIC_CONFDESC                        0U
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
+
 #ifndef USBD_CONFIG_STR_DESC_IDX
 #define USBD_CONFIG_STR_DESC_IDX                           4U
 #endif /* USBD_CONFIG_STR_DESC_IDX */
@@ -194,6 +211,32 @@ typedef struct
   uint8_t iClockSource;
 } __PACKED USBD_AUDIOClockSourceDescTypedef;
 
+typedef struct
+{
+  /* Audio clock selector Descriptor, internal and external clock inputs */
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubtype;
+  uint8_t bClockID;
+  uint8_t bNrInPins;
+  uint8_t baCSourceID[2];
+  uint8_t bmControls;
+  uint8_t iClockSelector;
+} __PACKED USBD_AUDIOClockSelectorDescTypedef;
+
+typedef struct
+{
+  /* Audio sampling rate converter unit Descriptor, between two clock domains */
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bDescriptorSubtype;
+  uint8_t bUnitID;
+  uint8_t bSourceID;
+  uint8_t bCSourceInID;
+  uint8_t bCSourceOutID;
+  uint8_t iSRC;
+} __PACKED USBD_AUDIOSampleRateConverterDescTypedef;
+
 typedef struct
 {
   /* Audio input terminal Descriptor*/
@@ -213,16 +256,14 @@ typedef struct
 
 typedef struct
 {
-  /* Audio feature unit Descriptor*/
+  /* Audio feature unit Descriptor, bmaControls of master and of each
+     channel then iFeature : bLength is USBD_AUDIO_FEATURE_UNIT_DESC_SIZE */
   uint8_t bLength;
   uint8_t bDescriptorType;
   uint8_t bDescriptorSubtype;
   uint8_t bUnitID;
   uint8_t bSourceID; 
-  uint32_t bmaControls0;
-  uint32_t bmaControls1;
-  uint32_t bmaControls2;
-  uint8_t  iFeature; 
+  uint32_t bmaControls[];
 } __PACKED USBD_AUDIOFeatureUnitDescTypedef;
 
 typedef struct
@@ -40,6 +40,12 @@ EndBSPDependencies */
 #include "usbd_composite_builder.h"
 
 #ifdef USE_USBD_COMPOSITE
+#if USBD_CMPSIT_ACTIVATE_AUDIO == 1
+#include "usb_audio_user.h"
+#endif /* USBD_CMPSIT_ACTIVATE_AUDIO */
+#if USBD_CMPSIT_STATIC_CONFDESC == 1
+#include <stddef.h>
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
 /** @addtogroup STM32_USB_DEVICE_LIBRARY
   * @{
@@ -54,6 +60,15 @@ EndBSPDependencies */
 /** @defgroup CMPSIT_CORE_Private_TypesDefinitions
   * @{
   */
+#if USBD_CMPSIT_ACTIVATE_AUDIO == 1
+/* format and bandwidth of one audio streaming alternate */
+typedef struct
+{
+  uint8_t  bSubslotSize;
+  uint8_t  bBitResolution;
+  uint16_t wMaxPacketSize;
+} USBD_CMPSIT_AudioAltTypeDef;
+#endif /* USBD_CMPSIT_ACTIVATE_AUDIO */
 /**
   * @}
   */
@@ -62,6 +77,113 @@ EndBSPDependencies */
 /** @defgroup CMPSIT_CORE_Private_Defines
   * @{
   */
+#if USBD_CMPSIT_ACTIVATE_AUDIO == 1
+/* audio function channels, taken from the audio sessions configuration */
+#ifdef USE_USB_AUDIO_PLAYPBACK
+#define CMPSIT_AUDIO_PLAY_CHANNEL_COUNT         USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT
+#define CMPSIT_AUDIO_PLAY_CHANNEL_MAP           USBD_AUDIO_CONFIG_PLAY_CHANNEL_MAP
+#else /* USE_USB_AUDIO_PLAYPBACK */
+#define CMPSIT_AUDIO_PLAY_CHANNEL_COUNT         2U
+#define CMPSIT_AUDIO_PLAY_CHANNEL_MAP           0x03U
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+#define CMPSIT_AUDIO_RECORD_CHANNEL_COUNT       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT
+#define CMPSIT_AUDIO_RECORD_CHANNEL_MAP         USBD_AUDIO_CONFIG_RECORD_CHANNEL_MAP
+#else /* USE_USB_AUDIO_RECORDING */
+#define CMPSIT_AUDIO_RECORD_CHANNEL_COUNT       2U
+#define CMPSIT_AUDIO_RECORD_CHANNEL_MAP         0x03U
+#endif /* USE_USB_AUDIO_RECORDING */
+/* master and each channel have their own mute and volume */
+#define CMPSIT_AUDIO_FU_CONTROLS                ((uint32_t)USBD_AUDIO_FU_CONTROL_MUTE | USBD_AUDIO_FU_CONTROL_VOLUME)
+/* max packet size of both isochronous endpoints */
+#define CMPSIT_AUDIO_EP_SIZE                    384U
+/* streaming endpoints bmAttributes : with implicit feedback the play endpoint is
+   asynchronous and the host takes its rate from the record endpoint packets */
+#ifdef USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK
+#define CMPSIT_AUDIO_PLAY_EP_ATTR               (USBD_EP_TYPE_ISOC | USBD_EP_ATTR_ISOC_ASYNC)
+#define CMPSIT_AUDIO_RECORD_EP_ATTR             (USBD_EP_TYPE_ISOC | USBD_EP_ATTR_ISOC_ASYNC | \
+                                                 USBD_EP_ATTR_USAGE_IMPLICIT_FEEDBACK)
+#else /* USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#define CMPSIT_AUDIO_PLAY_EP_ATTR               USBD_EP_TYPE_ISOC
+#define CMPSIT_AUDIO_RECORD_EP_ATTR             USBD_EP_TYPE_ISOC
+#endif /* USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+/* clock entity of the terminals : the selector between the internal and the
+   external clock sources, or the internal clock source */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+#define CMPSIT_AUDIO_CLOCK_ID                   USB_AUDIO_CONFIG_CLOCK_SELECTOR_ID
+#else /* USE_AUDIO_CLOCK_SELECTOR */
+#define CMPSIT_AUDIO_CLOCK_ID                   USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+/* entities of the AUDIO_TOPOLOGY_xxx tables : class specific size, appended
+   to the header size, and descriptor of each path */
+#define CMPSIT_AUDIO_ENTITY_SIZE(subtype, channels) \
+  (((subtype) == AUDIO_TOPOLOGY_INPUT_TERMINAL) ? (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef) : \
+   (((subtype) == AUDIO_TOPOLOGY_FEATURE_UNIT) ? (uint32_t)USBD_AUDIO_FEATURE_UNIT_DESC_SIZE(channels) : \
+    (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef)))
+#define CMPSIT_AUDIO_PLAY_ENTITY_SIZE(subtype, id, source, type, node) \
+  + CMPSIT_AUDIO_ENTITY_SIZE((subtype), CMPSIT_AUDIO_PLAY_CHANNEL_COUNT)
+#define CMPSIT_AUDIO_RECORD_ENTITY_SIZE(subtype, id, source, type, node) \
+  + CMPSIT_AUDIO_ENTITY_SIZE((subtype), CMPSIT_AUDIO_RECORD_CHANNEL_COUNT)
+#define CMPSIT_AUDIO_PLAY_ENTITY(subtype, id, source, type, node) \
+  USBD_CMPSIT_AUDIOEntityDesc(pConf, Sze, (subtype), (id), (source), (type), \
+                              CMPSIT_AUDIO_PLAY_CHANNEL_COUNT, CMPSIT_AUDIO_PLAY_CHANNEL_MAP);
+#define CMPSIT_AUDIO_RECORD_ENTITY(subtype, id, source, type, node) \
+  USBD_CMPSIT_AUDIOEntityDesc(pConf, Sze, (subtype), (id), (source), (type), \
+                              CMPSIT_AUDIO_RECORD_CHANNEL_COUNT, CMPSIT_AUDIO_RECORD_CHANNEL_MAP);
+/* play streaming alternates : bSubslotSize, bBitResolution and max packet of each */
+#if (defined USE_USB_AUDIO_PLAYPBACK) && (defined USE_AUDIO_USB_PLAY_MULTI_ALTERNATES)
+#define CMPSIT_AUDIO_PLAY_ALT_COUNT             USB_AUDIO_CONFIG_PLAY_ALT_COUNT
+#define CMPSIT_AUDIO_PLAY_ALT(n) \
+  { USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BYTE, USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BIT, \
+    USBD_AUDIO_CONFIG_PLAY_ALT_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_PLAY_ALT##n##_FREQ_MAX, \
+                                               USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BYTE) }
+#else /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+#define CMPSIT_AUDIO_PLAY_ALT_COUNT             1U
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+#endif /* USBD_CMPSIT_ACTIVATE_AUDIO */
+
+#if USBD_CMPSIT_STATIC_CONFDESC == 1
+#if (USBD_CMPSIT_ACTIVATE_CDC != 1) || (USBD_CMPSIT_ACTIVATE_AUDIO != 1) || \
+    (USBD_CMPSIT_ACTIVATE_HID == 1) || (USBD_CMPSIT_ACTIVATE_MSC == 1) || \
+    (USBD_CMPSIT_ACTIVATE_DFU == 1) || (USBD_CMPSIT_ACTIVATE_RNDIS == 1) || \
+    (USBD_CMPSIT_ACTIVATE_CDC_ECM == 1) || (USBD_CMPSIT_ACTIVATE_CUSTOMHID == 1) || \
+    (USBD_CMPSIT_ACTIVATE_VIDEO == 1) || (USBD_CMPSIT_ACTIVATE_PRINTER == 1) || \
+    (USBD_CMPSIT_ACTIVATE_CCID == 1) || (USBD_CMPSIT_ACTIVATE_MTP == 1) || \
+    (USBD_CMPSIT_ACTIVATE_VENDOR == 1)
+#error "USBD_CMPSIT_STATIC_CONFDESC supports only the CDC + AUDIO composite"
+#endif /* USBD_CMPSIT_ACTIVATE_xxx */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#error "USBD_CMPSIT_STATIC_CONFDESC doesn't describe the mixed play stream of USE_AUDIO_PLAYBACK_MIX"
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+#error "USBD_CMPSIT_STATIC_CONFDESC doesn't describe the clock selector of USE_AUDIO_CLOCK_SELECTOR"
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_RECORDING_VOICE
+#error "USBD_CMPSIT_STATIC_CONFDESC doesn't describe the voice record stream of USE_AUDIO_RECORDING_VOICE"
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#error "USBD_CMPSIT_STATIC_CONFDESC doesn't describe the second CDC of USE_AUDIO_CDC_TELEMETRY"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+/* interfaces and endpoints of the constant descriptor, CDC is registered first,
+   endpoints must match the addresses given at classes registration */
+#define CMPSIT_STATIC_CDC_IF                    0U
+#define CMPSIT_STATIC_AUDIO_IF                  2U
+#ifndef CMPSIT_STATIC_CDC_IN_EP
+#define CMPSIT_STATIC_CDC_IN_EP                 0x81U
+#endif /* CMPSIT_STATIC_CDC_IN_EP */
+#ifndef CMPSIT_STATIC_CDC_OUT_EP
+#define CMPSIT_STATIC_CDC_OUT_EP                0x01U
+#endif /* CMPSIT_STATIC_CDC_OUT_EP */
+#ifndef CMPSIT_STATIC_CDC_CMD_EP
+#define CMPSIT_STATIC_CDC_CMD_EP                0x82U
+#endif /* CMPSIT_STATIC_CDC_CMD_EP */
+#ifndef CMPSIT_STATIC_AUDIO_OUT_EP
+#define CMPSIT_STATIC_AUDIO_OUT_EP              0x03U
+#endif /* CMPSIT_STATIC_AUDIO_OUT_EP */
+#ifndef CMPSIT_STATIC_AUDIO_IN_EP
+#define CMPSIT_STATIC_AUDIO_IN_EP               0x83U
+#endif /* CMPSIT_STATIC_AUDIO_IN_EP */
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
 /**
   * @}
@@ -95,6 +217,9 @@ uint8_t  *USBD_CMPSIT_GetOtherSpeedCfgDesc(uint16_t *length);
 uint8_t  *USBD_CMPSIT_GetDeviceQualifierDescriptor(uint16_t *length);
 
 static uint8_t USBD_CMPSIT_FindFreeIFNbr(USBD_HandleTypeDef *pdev);
+#if USBD_CMPSIT_STATIC_CONFDESC == 1
+static uint8_t USBD_CMPSIT_CheckStaticConfDesc(USBD_HandleTypeDef *pdev);
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
 static void  USBD_CMPSIT_AddConfDesc(uint32_t Conf, __IO uint32_t *pSze);
 
@@ -127,6 +252,16 @@ static void  USBD_CMPSIT_CDC_ECMDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, _
 
 #if USBD_CMPSIT_ACTIVATE_AUDIO == 1U
 static void  USBD_CMPSIT_AUDIODesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
+static void  USBD_CMPSIT_AUDIOEntityDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t Subtype,
+                                         uint8_t EntityID, uint8_t SourceID, uint16_t TerminalType,
+                                         uint8_t NrChannels, uint32_t ChannelMap);
+static void  USBD_CMPSIT_AUDIOFeatureUnitDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t UnitID,
+                                              uint8_t SourceID, uint8_t NrChannels);
+static void  USBD_CMPSIT_AUDIOStreamingAltDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t speed,
+                                               uint8_t IfNum, uint8_t Alt, uint8_t TerminalLink,
+                                               uint8_t NrChannels, uint32_t ChannelMap,
+                                               const USBD_CMPSIT_AudioAltTypeDef *pAlt, uint8_t EpAdd,
+                                               uint8_t EpAttr);
 #endif /* USBD_CMPSIT_ACTIVATE_AUDIO == 1U */
 
 #if USBD_CMPSIT_ACTIVATE_CUSTOMHID == 1
@@ -149,6 +284,10 @@ static void  USBD_CMPSIT_CCIDDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO
 static void  USBD_CMPSIT_MTPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
 #endif /* USBD_CMPSIT_ACTIVATE_MTP == 1U */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1U
+static void  USBD_CMPSIT_VENDORDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed);
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR == 1U */
+
 /**
   * @}
   */
@@ -183,6 +322,7 @@ USBD_ClassTypeDef  USBD_CMPSIT =
 #endif /* USBD_SUPPORT_USER_STRING_DESC */
 };
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
 /* The generic configuration descriptor buffer that will be filled by builder
    Size of the buffer is the maximum possible configuration descriptor size. */
 __ALIGN_BEGIN static uint8_t USBD_CMPSIT_FSCfgDesc[USBD_CMPST_MAX_CONFDESC_SZ]  __ALIGN_END = {0};
@@ -196,6 +336,179 @@ static uint8_t *pCmpstHSConfDesc = USBD_CMPSIT_HSCfgDesc;
 /* Variable that dynamically holds the current size of the configuration descriptor */
 static __IO uint32_t CurrHSConfDescSz = 0U;
 #endif /* USE_USB_HS */
+#else /* USBD_CMPSIT_STATIC_CONFDESC */
+/* feature unit descriptor of a given channels count */
+#define CMPSIT_AUDIO_FU_DESC(NrChannels) \
+  struct { \
+    uint8_t bLength; \
+    uint8_t bDescriptorType; \
+    uint8_t bDescriptorSubtype; \
+    uint8_t bUnitID; \
+    uint8_t bSourceID; \
+    uint32_t bmaControls[(NrChannels) + 1U]; \
+    uint8_t iFeature; \
+  } __PACKED
+
+/* one streaming alternate of an audio streaming interface */
+typedef struct
+{
+  USBD_IfDescTypeDef                   If;
+  USBD_AUDIO20ASInterfaceDescTypedef   AsIf;
+  USBD_AUDIO20ASFormatTypeDescTypedef  Format;
+  USBD_EpDescTypeDef                   Ep;
+  USBD_AUDIO20ASEndpointDescTypedef    AsEp;
+} __PACKED USBD_CMPSIT_StaticAsAltDescTypeDef;
+
+/* The CDC + AUDIO configuration descriptor, same layout and content as built
+   by USBD_CMPSIT_CDCDesc and USBD_CMPSIT_AUDIODesc */
+typedef struct
+{
+  USBD_ConfigDescTypeDef               Config;
+#if USBD_COMPOSITE_USE_IAD == 1
+  USBD_IadDescTypeDef                  CdcIad;
+#endif /* USBD_COMPOSITE_USE_IAD == 1 */
+  USBD_IfDescTypeDef                   CdcCtrlIf;
+  USBD_CDCHeaderFuncDescTypeDef        CdcHeader;
+  USBD_CDCCallMgmFuncDescTypeDef       CdcCallMgm;
+  USBD_CDCACMFuncDescTypeDef           CdcAcm;
+  USBD_CDCUnionFuncDescTypeDef         CdcUnion;
+  USBD_EpDescTypeDef                   CdcCmdEp;
+  USBD_IfDescTypeDef                   CdcDataIf;
+  USBD_EpDescTypeDef                   CdcInEp;
+  USBD_EpDescTypeDef                   CdcOutEp;
+#if USBD_COMPOSITE_USE_IAD == 1
+  USBD_IadDescTypeDef                  AudioIad;
+#endif /* USBD_COMPOSITE_USE_IAD == 1 */
+  USBD_IfDescTypeDef                   AudioCtrlIf;
+  USBD_AUDIOHeaderFuncDescTypedef      AudioHeader;
+  USBD_AUDIOClockSourceDescTypedef     AudioClock;
+  USBD_AUDIOInputTerminalDescTypedef   PlayInputTerminal;
+  CMPSIT_AUDIO_FU_DESC(CMPSIT_AUDIO_PLAY_CHANNEL_COUNT) PlayFeatureUnit;
+  USBD_AUDIOOutputTerminalDescTypedef  PlayOutputTerminal;
+  USBD_AUDIOInputTerminalDescTypedef   RecordInputTerminal;
+  CMPSIT_AUDIO_FU_DESC(CMPSIT_AUDIO_RECORD_CHANNEL_COUNT) RecordFeatureUnit;
+  USBD_AUDIOOutputTerminalDescTypedef  RecordOutputTerminal;
+  USBD_IfDescTypeDef                   PlayIfAlt0;
+  USBD_CMPSIT_StaticAsAltDescTypeDef   PlayAlt[CMPSIT_AUDIO_PLAY_ALT_COUNT];
+  USBD_IfDescTypeDef                   RecordIfAlt0;
+  USBD_CMPSIT_StaticAsAltDescTypeDef   RecordAlt;
+} __PACKED USBD_CMPSIT_StaticConfDescTypeDef;
+
+#if (USBD_SELF_POWERED == 1U)
+#define CMPSIT_STATIC_BMATTRIBUTES              0xC0U
+#else
+#define CMPSIT_STATIC_BMATTRIBUTES              0x80U
+#endif /* USBD_SELF_POWERED */
+
+#define CMPSIT_STATIC_IF_DESC(ifnum, alt, eps, class, subclass, protocol) \
+  { (uint8_t)sizeof(USBD_IfDescTypeDef), USB_DESC_TYPE_INTERFACE, (ifnum), (alt), (eps), \
+    (class), (subclass), (protocol), 0U }
+
+#define CMPSIT_STATIC_EP_DESC(epadd, eptype, epsize, interval) \
+  { (uint8_t)sizeof(USBD_EpDescTypeDef), USB_DESC_TYPE_ENDPOINT, (epadd), (eptype), \
+    (uint16_t)(epsize), (interval) }
+
+#define CMPSIT_STATIC_FU_DESC(UnitID, SourceID, NrChannels) \
+  { (uint8_t)USBD_AUDIO_FEATURE_UNIT_DESC_SIZE(NrChannels), 0x24U, 0x06U, (UnitID), (SourceID), \
+    { [0 ... (NrChannels)] = CMPSIT_AUDIO_FU_CONTROLS }, 0U }
+
+#define CMPSIT_STATIC_AS_ALT_DESC(ifnum, alt, TerminalLink, NrChannels, ChannelMap, \
+                                  SubslotSize, BitResolution, epadd, epattr, epsize, interval) \
+  { CMPSIT_STATIC_IF_DESC((ifnum), (alt), 1U, 0x01U, 0x02U, 0x20U), \
+    { (uint8_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef), 0x24U, 0x01U, (TerminalLink), 0x00U, 0x01U, \
+      0x01U, (NrChannels), (ChannelMap), 0U }, \
+    { (uint8_t)sizeof(USBD_AUDIO20ASFormatTypeDescTypedef), 0x24U, 0x02U, 0x01U, (SubslotSize), (BitResolution) }, \
+    CMPSIT_STATIC_EP_DESC((epadd), (epattr), (epsize), (interval)), \
+    { (uint8_t)sizeof(USBD_AUDIO20ASEndpointDescTypedef), 0x25U, 0x01U, 0U, 0U, 0U, 0U } }
+
+/* play streaming alternates, each with its own format and max packet */
+#ifdef CMPSIT_AUDIO_PLAY_ALT
+#define CMPSIT_STATIC_PLAY_ALT_DESC(n, interval) \
+  CMPSIT_STATIC_AS_ALT_DESC(CMPSIT_STATIC_AUDIO_IF + 1U, (n), 0x12U, CMPSIT_AUDIO_PLAY_CHANNEL_COUNT, \
+                            CMPSIT_AUDIO_PLAY_CHANNEL_MAP, USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BYTE, \
+                            USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BIT, CMPSIT_STATIC_AUDIO_OUT_EP, \
+                            CMPSIT_AUDIO_PLAY_EP_ATTR, \
+                            USBD_AUDIO_CONFIG_PLAY_ALT_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_PLAY_ALT##n##_FREQ_MAX, \
+                                                                       USB_AUDIO_CONFIG_PLAY_ALT##n##_RES_BYTE), \
+                            (interval))
+#if CMPSIT_AUDIO_PLAY_ALT_COUNT == 3
+#define CMPSIT_STATIC_PLAY_ALTS_DESC(interval) \
+  CMPSIT_STATIC_PLAY_ALT_DESC(1, interval), CMPSIT_STATIC_PLAY_ALT_DESC(2, interval), \
+  CMPSIT_STATIC_PLAY_ALT_DESC(3, interval)
+#elif CMPSIT_AUDIO_PLAY_ALT_COUNT == 2
+#define CMPSIT_STATIC_PLAY_ALTS_DESC(interval) \
+  CMPSIT_STATIC_PLAY_ALT_DESC(1, interval), CMPSIT_STATIC_PLAY_ALT_DESC(2, interval)
+#else
+#define CMPSIT_STATIC_PLAY_ALTS_DESC(interval) \
+  CMPSIT_STATIC_PLAY_ALT_DESC(1, interval)
+#endif /* CMPSIT_AUDIO_PLAY_ALT_COUNT */
+#else /* CMPSIT_AUDIO_PLAY_ALT */
+#define CMPSIT_STATIC_PLAY_ALTS_DESC(interval) \
+  CMPSIT_STATIC_AS_ALT_DESC(CMPSIT_STATIC_AUDIO_IF + 1U, 1U, 0x12U, CMPSIT_AUDIO_PLAY_CHANNEL_COUNT, \
+                            CMPSIT_AUDIO_PLAY_CHANNEL_MAP, 2U, 16U, CMPSIT_STATIC_AUDIO_OUT_EP, \
+                            CMPSIT_AUDIO_PLAY_EP_ATTR, CMPSIT_AUDIO_EP_SIZE, (interval))
+#endif /* CMPSIT_AUDIO_PLAY_ALT */
+
+#if USBD_COMPOSITE_USE_IAD == 1
+#define CMPSIT_STATIC_IAD_DESC(first, count, class, subclass, protocol) \
+  { (uint8_t)sizeof(USBD_IadDescTypeDef), USB_DESC_TYPE_IAD, (first), (count), \
+    (class), (subclass), (protocol), 0U },
+#else
+#define CMPSIT_STATIC_IAD_DESC(first, count, class, subclass, protocol)
+#endif /* USBD_COMPOSITE_USE_IAD == 1 */
+
+/* audio control descriptors following the interface, wTotalLength of the header */
+#define CMPSIT_STATIC_AUDIO_CS_SIZE \
+  (offsetof(USBD_CMPSIT_StaticConfDescTypeDef, PlayIfAlt0) - \
+   offsetof(USBD_CMPSIT_StaticConfDescTypeDef, AudioHeader))
+
+/* descriptor content for one speed , only packet sizes and intervals change */
+#define CMPSIT_STATIC_CONFDESC(CdcDataSize, CdcInterval, AudioInterval) \
+{ \
+  { (uint8_t)sizeof(USBD_ConfigDescTypeDef), USB_DESC_TYPE_CONFIGURATION, \
+    (uint16_t)sizeof(USBD_CMPSIT_StaticConfDescTypeDef), 5U, 1U, USBD_CONFIG_STR_DESC_IDX, \
+    CMPSIT_STATIC_BMATTRIBUTES, USBD_MAX_POWER }, \
+  CMPSIT_STATIC_IAD_DESC(CMPSIT_STATIC_CDC_IF, 2U, 0x02U, 0x02U, 0x01U) \
+  CMPSIT_STATIC_IF_DESC(CMPSIT_STATIC_CDC_IF, 0U, 1U, 0x02U, 0x02U, 0x01U), \
+  { 0x05U, 0x24U, 0x00U, 0x0110U }, \
+  { 0x05U, 0x24U, 0x01U, 0x00U, CMPSIT_STATIC_CDC_IF + 1U }, \
+  { 0x04U, 0x24U, 0x02U, 0x02U }, \
+  { 0x05U, 0x24U, 0x06U, CMPSIT_STATIC_CDC_IF, CMPSIT_STATIC_CDC_IF + 1U }, \
+  CMPSIT_STATIC_EP_DESC(CMPSIT_STATIC_CDC_CMD_EP, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE, (CdcInterval)), \
+  CMPSIT_STATIC_IF_DESC(CMPSIT_STATIC_CDC_IF + 1U, 0U, 2U, 0x0AU, 0U, 0U), \
+  CMPSIT_STATIC_EP_DESC(CMPSIT_STATIC_CDC_IN_EP, USBD_EP_TYPE_BULK, (CdcDataSize), 0U), \
+  CMPSIT_STATIC_EP_DESC(CMPSIT_STATIC_CDC_OUT_EP, USBD_EP_TYPE_BULK, (CdcDataSize), 0U), \
+  CMPSIT_STATIC_IAD_DESC(CMPSIT_STATIC_AUDIO_IF, 3U, USB_DEVICE_CLASS_AUDIO, AUDIO_SUBCLASS_AUDIOCONTROL, 0x20U) \
+  CMPSIT_STATIC_IF_DESC(CMPSIT_STATIC_AUDIO_IF, 0U, 0U, USB_DEVICE_CLASS_AUDIO, AUDIO_SUBCLASS_AUDIOCONTROL, 0x20U), \
+  { (uint8_t)sizeof(USBD_AUDIOHeaderFuncDescTypedef), 0x24U, 0x01U, 0x0200U, 0x04U, \
+    (uint16_t)CMPSIT_STATIC_AUDIO_CS_SIZE, 0U }, \
+  { (uint8_t)sizeof(USBD_AUDIOClockSourceDescTypedef), 0x24U, 0x0AU, 0x18U, 0x01U, 0x01U, 0U, 0U }, \
+  { (uint8_t)sizeof(USBD_AUDIOInputTerminalDescTypedef), 0x24U, 0x02U, 0x12U, 0x0101U, 0U, 0x18U, \
+    CMPSIT_AUDIO_PLAY_CHANNEL_COUNT, CMPSIT_AUDIO_PLAY_CHANNEL_MAP, 0U, 0U, 0U }, \
+  CMPSIT_STATIC_FU_DESC(0x16U, 0x12U, CMPSIT_AUDIO_PLAY_CHANNEL_COUNT), \
+  { (uint8_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef), 0x24U, 0x03U, 0x14U, 0x0301U, 0U, 0x16U, \
+    0x18U, 0U, 0U }, \
+  { (uint8_t)sizeof(USBD_AUDIOInputTerminalDescTypedef), 0x24U, 0x02U, 0x11U, 0x0201U, 0U, 0x18U, \
+    CMPSIT_AUDIO_RECORD_CHANNEL_COUNT, CMPSIT_AUDIO_RECORD_CHANNEL_MAP, 0U, 0U, 0U }, \
+  CMPSIT_STATIC_FU_DESC(0x15U, 0x11U, CMPSIT_AUDIO_RECORD_CHANNEL_COUNT), \
+  { (uint8_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef), 0x24U, 0x03U, 0x13U, 0x0101U, 0U, 0x15U, \
+    0x18U, 0U, 0U }, \
+  CMPSIT_STATIC_IF_DESC(CMPSIT_STATIC_AUDIO_IF + 1U, 0U, 0U, 0x01U, 0x02U, 0x20U), \
+  { CMPSIT_STATIC_PLAY_ALTS_DESC(AudioInterval) }, \
+  CMPSIT_STATIC_IF_DESC(CMPSIT_STATIC_AUDIO_IF + 2U, 0U, 0U, 0x01U, 0x02U, 0x20U), \
+  CMPSIT_STATIC_AS_ALT_DESC(CMPSIT_STATIC_AUDIO_IF + 2U, 1U, 0x13U, CMPSIT_AUDIO_RECORD_CHANNEL_COUNT, \
+                            CMPSIT_AUDIO_RECORD_CHANNEL_MAP, 2U, 16U, CMPSIT_STATIC_AUDIO_IN_EP, \
+                            CMPSIT_AUDIO_RECORD_EP_ATTR, CMPSIT_AUDIO_EP_SIZE, (AudioInterval)) \
+}
+
+__ALIGN_BEGIN static const USBD_CMPSIT_StaticConfDescTypeDef USBD_CMPSIT_FSCfgDesc __ALIGN_END =
+  CMPSIT_STATIC_CONFDESC(CDC_DATA_FS_MAX_PACKET_SIZE, CDC_FS_BINTERVAL, AUDIO_FS_BINTERVAL);
+
+#ifdef USE_USB_HS
+__ALIGN_BEGIN static const USBD_CMPSIT_StaticConfDescTypeDef USBD_CMPSIT_HSCfgDesc __ALIGN_END =
+  CMPSIT_STATIC_CONFDESC(CDC_DATA_HS_MAX_PACKET_SIZE, CDC_HS_BINTERVAL, AUDIO_HS_BINTERVAL);
+#endif /* USE_USB_HS */
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
 /* USB Standard Device Descriptor */
 __ALIGN_BEGIN static uint8_t USBD_CMPSIT_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC]  __ALIGN_END =
@@ -267,6 +580,7 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
   uint8_t idxIf = 0U;
   uint8_t iEp = 0U;
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
   /* For the first class instance, start building the config descriptor common part */
   if (pdev->classId == 0U)
   {
@@ -276,6 +590,7 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
     USBD_CMPSIT_AddConfDesc((uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz);
 #endif /* USE_USB_HS */
   }
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
   switch (pdev->tclasslist[pdev->classId].ClassType)
   {
@@ -365,12 +680,19 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
       iEp = pdev->tclasslist[pdev->classId].EpAdd[2];
       USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
       /* Configure and Append the Descriptor */
       USBD_CMPSIT_CDCDesc(pdev, (uint32_t)pCmpstFSConfDesc, &CurrFSConfDescSz, (uint8_t)USBD_SPEED_FULL);
 
 #ifdef USE_USB_HS
       USBD_CMPSIT_CDCDesc(pdev, (uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz, (uint8_t)USBD_SPEED_HIGH);
 #endif /* USE_USB_HS */
+#else
+#ifdef USE_USB_HS
+      /* as left by the HS descriptor builder */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = CDC_DATA_HS_MAX_PACKET_SIZE;
+#endif /* USE_USB_HS */
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
       break;
 #endif /* USBD_CMPSIT_ACTIVATE_CDC */
@@ -473,7 +795,7 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
 #if USBD_CMPSIT_ACTIVATE_AUDIO == 1
     case CLASS_TYPE_AUDIO:
       /* Setup Max packet sizes*/
-      pdev->tclasslist[pdev->classId].CurrPcktSze = 384; //USBD_AUDIO_GetEpPcktSze(pdev, 0U, 0U);
+      pdev->tclasslist[pdev->classId].CurrPcktSze = CMPSIT_AUDIO_EP_SIZE;
 
       /* Find the first available interface slot and Assign number of interfaces */
       idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
@@ -484,6 +806,19 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
 
       /* Assign endpoint numbers */
       pdev->tclasslist[pdev->classId].NumEps = 2U; /* EP1_OUT*/
+#ifdef USE_AUDIO_PLAYBACK_MIX
+      /* mixed play stream, its interface and OUT endpoint come last */
+      pdev->tclasslist[pdev->classId].NumIf = 4U;
+      pdev->tclasslist[pdev->classId].Ifs[3] = (uint8_t)(idxIf + 3U);
+      pdev->tclasslist[pdev->classId].NumEps = 3U;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+      /* voice record stream, after the mix one */
+      pdev->tclasslist[pdev->classId].Ifs[pdev->tclasslist[pdev->classId].NumIf] =
+        (uint8_t)(idxIf + pdev->tclasslist[pdev->classId].NumIf);
+      pdev->tclasslist[pdev->classId].NumIf++;
+      pdev->tclasslist[pdev->classId].NumEps++;
+#endif /* USE_AUDIO_RECORDING_VOICE */
 
       /* Set OUT endpoint slot */
       iEp = pdev->tclasslist[pdev->classId].EpAdd[0];
@@ -495,10 +830,28 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
       iEp = pdev->tclasslist[pdev->classId].EpAdd[1];
       /* Assign OUT Endpoint */
       USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_ISOC, pdev->tclasslist[pdev->classId].CurrPcktSze);
+#ifdef USE_AUDIO_PLAYBACK_MIX
+
+      /* Assign the mix OUT Endpoint */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[2];
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_ISOC, pdev->tclasslist[pdev->classId].CurrPcktSze);
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+
+      /* Assign the voice IN Endpoint */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[pdev->tclasslist[pdev->classId].NumEps - 1U];
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_ISOC, USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE);
+#endif /* USE_AUDIO_RECORDING_VOICE */
 
-      /* Configure and Append the Descriptor (only FS mode supported) */
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
+      /* Configure and Append the Descriptor */
       USBD_CMPSIT_AUDIODesc(pdev, (uint32_t)pCmpstFSConfDesc, &CurrFSConfDescSz, (uint8_t)USBD_SPEED_FULL);
 
+#ifdef USE_USB_HS
+      USBD_CMPSIT_AUDIODesc(pdev, (uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz, (uint8_t)USBD_SPEED_HIGH);
+#endif /* USE_USB_HS */
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
+
       break;
 #endif /* USBD_CMPSIT_ACTIVATE_AUDIO */
 
@@ -667,6 +1020,38 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
       break;
 #endif /* USBD_CMPSIT_ACTIVATE_MTP */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1
+
+    case CLASS_TYPE_VENDOR:
+      /* Setup default Max packet size */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = USBD_VENDOR_FS_MAX_PACKET_SIZE;
+
+      /* Find the first available interface slot and Assign number of interfaces */
+      idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
+      pdev->tclasslist[pdev->classId].NumIf = 1U;
+      pdev->tclasslist[pdev->classId].Ifs[0] = idxIf;
+
+      /* Assign endpoint numbers */
+      pdev->tclasslist[pdev->classId].NumEps = 2U;
+
+      /* Set IN endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[0];
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+
+      /* Set OUT endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[1];
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+
+      /* Configure and Append the Descriptor */
+      USBD_CMPSIT_VENDORDesc(pdev, (uint32_t)pCmpstFSConfDesc, &CurrFSConfDescSz, (uint8_t)USBD_SPEED_FULL);
+
+#ifdef USE_USB_HS
+      USBD_CMPSIT_VENDORDesc(pdev, (uint32_t)pCmpstHSConfDesc, &CurrHSConfDescSz, (uint8_t)USBD_SPEED_HIGH);
+#endif /* USE_USB_HS */
+
+      break;
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
+
     default:
       UNUSED(idxIf);
       UNUSED(iEp);
@@ -675,7 +1060,23 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
       break;
   }
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
+  /* The buffer is already overrun, stop before the device enumerates with it */
+  if (CurrFSConfDescSz > USBD_CMPST_MAX_CONFDESC_SZ)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+#ifdef USE_USB_HS
+  if (CurrHSConfDescSz > USBD_CMPST_MAX_CONFDESC_SZ)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+#endif /* USE_USB_HS */
+
   return (uint8_t)USBD_OK;
+#else
+  return USBD_CMPSIT_CheckStaticConfDesc(pdev);
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 }
 
 /**
@@ -686,9 +1087,15 @@ uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
   */
 uint8_t  *USBD_CMPSIT_GetFSCfgDesc(uint16_t *length)
 {
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
   *length = (uint16_t)CurrFSConfDescSz;
 
   return USBD_CMPSIT_FSCfgDesc;
+#else
+  *length = (uint16_t)sizeof(USBD_CMPSIT_FSCfgDesc);
+
+  return (uint8_t *)&USBD_CMPSIT_FSCfgDesc;
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 }
 
 #ifdef USE_USB_HS
@@ -700,9 +1107,15 @@ uint8_t  *USBD_CMPSIT_GetFSCfgDesc(uint16_t *length)
   */
 uint8_t  *USBD_CMPSIT_GetHSCfgDesc(uint16_t *length)
 {
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
   *length = (uint16_t)CurrHSConfDescSz;
 
   return USBD_CMPSIT_HSCfgDesc;
+#else
+  *length = (uint16_t)sizeof(USBD_CMPSIT_HSCfgDesc);
+
+  return (uint8_t *)&USBD_CMPSIT_HSCfgDesc;
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 }
 #endif /* USE_USB_HS */
 
@@ -714,9 +1127,7 @@ uint8_t  *USBD_CMPSIT_GetHSCfgDesc(uint16_t *length)
   */
 uint8_t  *USBD_CMPSIT_GetOtherSpeedCfgDesc(uint16_t *length)
 {
-  *length = (uint16_t)CurrFSConfDescSz;
-
-  return USBD_CMPSIT_FSCfgDesc;
+  return USBD_CMPSIT_GetFSCfgDesc(length);
 }
 
 /**
@@ -756,6 +1167,48 @@ static uint8_t USBD_CMPSIT_FindFreeIFNbr(USBD_HandleTypeDef *pdev)
   return (uint8_t)idx;
 }
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 1
+/**
+  * @brief  USBD_CMPSIT_CheckStaticConfDesc
+  *         Checks the interfaces and endpoints assigned to the registered class
+  *         are the ones of the constant configuration descriptor
+  * @param  pdev: device instance
+  * @retval status
+  */
+static uint8_t USBD_CMPSIT_CheckStaticConfDesc(USBD_HandleTypeDef *pdev)
+{
+  USBD_CompositeElementTypeDef *pClass = &pdev->tclasslist[pdev->classId];
+  const USBD_CMPSIT_StaticConfDescTypeDef *pDesc = &USBD_CMPSIT_FSCfgDesc;
+
+  switch (pClass->ClassType)
+  {
+    case CLASS_TYPE_CDC:
+      if ((pClass->Ifs[0] != pDesc->CdcCtrlIf.bInterfaceNumber) ||
+          (pClass->Eps[0].add != pDesc->CdcInEp.bEndpointAddress) ||
+          (pClass->Eps[1].add != pDesc->CdcOutEp.bEndpointAddress) ||
+          (pClass->Eps[2].add != pDesc->CdcCmdEp.bEndpointAddress))
+      {
+        return (uint8_t)USBD_FAIL;
+      }
+      break;
+
+    case CLASS_TYPE_AUDIO:
+      if ((pClass->Ifs[0] != pDesc->AudioCtrlIf.bInterfaceNumber) ||
+          (pClass->Eps[0].add != pDesc->PlayAlt[0].Ep.bEndpointAddress) ||
+          (pClass->Eps[1].add != pDesc->RecordAlt.Ep.bEndpointAddress))
+      {
+        return (uint8_t)USBD_FAIL;
+      }
+      break;
+
+    default:
+      return (uint8_t)USBD_FAIL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
+
 /**
   * @brief  USBD_CMPSIT_AddToConfDesc
   *         Add a new class to the configuration descriptor
@@ -1136,24 +1589,50 @@ static void  USBD_CMPSIT_AUDIODesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __I
 {
   static USBD_IfDescTypeDef *pIfDesc;
   static USBD_IadDescTypeDef *pIadDesc;
-  static USBD_EpDescTypeDef             *pEpDesc;
-  UNUSED(speed);
 
   static USBD_AUDIOHeaderFuncDescTypedef    *pHeadDesc;
   static USBD_AUDIOClockSourceDescTypedef  *pClockDesc;
-  static USBD_AUDIOInputTerminalDescTypedef *pInputTerminalDesc;
-  static USBD_AUDIOFeatureUnitDescTypedef *pFeatureUnitDesc;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  static USBD_AUDIOClockSelectorDescTypedef *pClockSelDesc;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_RECORDING_VOICE
+  static USBD_AUDIOSampleRateConverterDescTypedef *pSrcDesc;
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_RECORDING_VOICE
   static USBD_AUDIOOutputTerminalDescTypedef *pOutputTerminalDesc;
-  static USBD_AUDIO20ASInterfaceDescTypedef *pAsInterfaceDesc;
-  static USBD_AUDIO20ASFormatTypeDescTypedef *pAsFormatTypeDesc;
-  static USBD_AUDIO20ASEndpointDescTypedef *pAsEndpointDesc;
+#endif /* USE_AUDIO_RECORDING_VOICE */
+  const USBD_CMPSIT_AudioAltTypeDef PlayAlts[CMPSIT_AUDIO_PLAY_ALT_COUNT] =
+  {
+#ifdef CMPSIT_AUDIO_PLAY_ALT
+    CMPSIT_AUDIO_PLAY_ALT(1),
+#if CMPSIT_AUDIO_PLAY_ALT_COUNT > 1
+    CMPSIT_AUDIO_PLAY_ALT(2),
+#endif /* CMPSIT_AUDIO_PLAY_ALT_COUNT > 1 */
+#if CMPSIT_AUDIO_PLAY_ALT_COUNT > 2
+    CMPSIT_AUDIO_PLAY_ALT(3),
+#endif /* CMPSIT_AUDIO_PLAY_ALT_COUNT > 2 */
+#else /* CMPSIT_AUDIO_PLAY_ALT */
+    { 2U, 16U, (uint16_t)pdev->tclasslist[pdev->classId].CurrPcktSze },
+#endif /* CMPSIT_AUDIO_PLAY_ALT */
+  };
+  const USBD_CMPSIT_AudioAltTypeDef RecordAlt = { 2U, 16U, (uint16_t)pdev->tclasslist[pdev->classId].CurrPcktSze };
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  const USBD_CMPSIT_AudioAltTypeDef MixAlt = { USBD_AUDIO_CONFIG_MIX_RES_BYTE, USBD_AUDIO_CONFIG_MIX_RES_BIT,
+                                               (uint16_t)pdev->tclasslist[pdev->classId].CurrPcktSze };
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+  const USBD_CMPSIT_AudioAltTypeDef VoiceAlt = { USBD_AUDIO_CONFIG_VOICE_RES_BYTE, USBD_AUDIO_CONFIG_VOICE_RES_BIT,
+                                                 USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE };
+  uint8_t voiceIf = pdev->tclasslist[pdev->classId].Ifs[pdev->tclasslist[pdev->classId].NumIf - 1U];
+#endif /* USE_AUDIO_RECORDING_VOICE */
+  uint32_t alt;
 
 #if USBD_COMPOSITE_USE_IAD == 1
   pIadDesc                          = ((USBD_IadDescTypeDef *)(pConf + *Sze));
   pIadDesc->bLength                 = (uint8_t)sizeof(USBD_IadDescTypeDef);
   pIadDesc->bDescriptorType         = USB_DESC_TYPE_IAD; /* IAD descriptor */
   pIadDesc->bFirstInterface         = pdev->tclasslist[pdev->classId].Ifs[0];
-  pIadDesc->bInterfaceCount         = 3U;    /* 2 interfaces */
+  pIadDesc->bInterfaceCount         = (uint8_t)pdev->tclasslist[pdev->classId].NumIf; /* control and streaming interfaces */
   pIadDesc->bFunctionClass          = USB_DEVICE_CLASS_AUDIO;
   pIadDesc->bFunctionSubClass       = AUDIO_SUBCLASS_AUDIOCONTROL;
   pIadDesc->bFunctionProtocol       = 0x20;
@@ -1166,14 +1645,22 @@ static void  USBD_CMPSIT_AUDIODesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __I
                        AUDIO_SUBCLASS_AUDIOCONTROL, 0x020, 0U);
 
 
-  uint32_t headerSize=		  (uint32_t)sizeof(USBD_AUDIOHeaderFuncDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef)+\
-		  (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+  uint32_t headerSize = (uint32_t)sizeof(USBD_AUDIOHeaderFuncDescTypedef) +
+                        (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef)
+                        AUDIO_TOPOLOGY_PLAY(CMPSIT_AUDIO_PLAY_ENTITY_SIZE)
+                        AUDIO_TOPOLOGY_RECORD(CMPSIT_AUDIO_RECORD_ENTITY_SIZE);
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  headerSize += 0U AUDIO_TOPOLOGY_MIX(CMPSIT_AUDIO_PLAY_ENTITY_SIZE);
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  headerSize += (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef) +
+                (uint32_t)sizeof(USBD_AUDIOClockSelectorDescTypedef);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_RECORDING_VOICE
+  headerSize += (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef) +
+                (uint32_t)sizeof(USBD_AUDIOSampleRateConverterDescTypedef) +
+                (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+#endif /* USE_AUDIO_RECORDING_VOICE */
 
 
 /* Header Functional Descriptor*/
@@ -1192,165 +1679,269 @@ static void  USBD_CMPSIT_AUDIODesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __I
   pClockDesc->bLength=(uint8_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
   pClockDesc->bDescriptorType=0x24;
   pClockDesc->bDescriptorSubtype=0xA;
-  pClockDesc->bClockID=0x18;
+  pClockDesc->bClockID=USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID;
   pClockDesc->bmAttributes=0x01;
   pClockDesc->bmControls=0x01;
   pClockDesc->bAssocTerminal=0x0;
   pClockDesc->iClockSource=0;
 
   *Sze += (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  /* external clock source : fixed rate, read only frequency and validity */
+  pClockDesc = ((USBD_AUDIOClockSourceDescTypedef *)((uint32_t)pConf + *Sze));
+  pClockDesc->bLength=(uint8_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
+  pClockDesc->bDescriptorType=0x24;
+  pClockDesc->bDescriptorSubtype=0xA;
+  pClockDesc->bClockID=USB_AUDIO_CONFIG_EXT_CLOCK_SOURCE_ID;
+  pClockDesc->bmAttributes=0x00;
+  pClockDesc->bmControls=0x05;
+  pClockDesc->bAssocTerminal=0x0;
+  pClockDesc->iClockSource=0;
+  *Sze += (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
 
-  /* Audio input terminal Descriptor*/
-  pInputTerminalDesc= ((USBD_AUDIOInputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
-  pInputTerminalDesc->bLength=(uint8_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
-  pInputTerminalDesc->bDescriptorType=0x24;
-  pInputTerminalDesc->bDescriptorSubtype=0x2;
-  pInputTerminalDesc->bTerminalID=0x12;
-  pInputTerminalDesc->wTerminalType =0x0101;
-  pInputTerminalDesc->bAssocTerminal=0x0;
-  pInputTerminalDesc->bCSourceID =0x18;
-  pInputTerminalDesc->bNrChannels =2;
-  pInputTerminalDesc->bmChannelConfig=0x03;
-  pInputTerminalDesc->iChannelNames=0;
-  pInputTerminalDesc->bmControls=0x0;
-  pInputTerminalDesc->iTerminal=0; 
-
-  *Sze += (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
-
-  /* Audio feature unit Descriptor*/
-  pFeatureUnitDesc= ((USBD_AUDIOFeatureUnitDescTypedef *)((uint32_t)pConf + *Sze));
-  pFeatureUnitDesc->bLength=(uint8_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef);
-  pFeatureUnitDesc->bDescriptorType=0x24;
-  pFeatureUnitDesc->bDescriptorSubtype=0x6;
-  pFeatureUnitDesc->bUnitID=0x16;
-  pFeatureUnitDesc->bSourceID=0x12;
-  pFeatureUnitDesc->bmaControls0=0xF;//check
-  pFeatureUnitDesc->bmaControls1=0x0;
-  pFeatureUnitDesc->bmaControls2=0x0;
-  pFeatureUnitDesc->iFeature=0; 
-
-*Sze += (uint32_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef);
-
-  /* Audio output terminal Descriptor*/
-pOutputTerminalDesc= ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
+  /* clock selector, pin 1 internal clock , pin 2 external clock */
+  pClockSelDesc = ((USBD_AUDIOClockSelectorDescTypedef *)((uint32_t)pConf + *Sze));
+  pClockSelDesc->bLength=(uint8_t)sizeof(USBD_AUDIOClockSelectorDescTypedef);
+  pClockSelDesc->bDescriptorType=0x24;
+  pClockSelDesc->bDescriptorSubtype=0xB;
+  pClockSelDesc->bClockID=USB_AUDIO_CONFIG_CLOCK_SELECTOR_ID;
+  pClockSelDesc->bNrInPins=2;
+  pClockSelDesc->baCSourceID[USB_AUDIO_CONFIG_CLOCK_SELECTOR_INTERNAL - 1U]=USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID;
+  pClockSelDesc->baCSourceID[USB_AUDIO_CONFIG_CLOCK_SELECTOR_EXTERNAL - 1U]=USB_AUDIO_CONFIG_EXT_CLOCK_SOURCE_ID;
+  pClockSelDesc->bmControls=0x03;
+  pClockSelDesc->iClockSelector=0;
+  *Sze += (uint32_t)sizeof(USBD_AUDIOClockSelectorDescTypedef);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+
+  /* play, record then mix terminals and units, from the topology tables */
+  AUDIO_TOPOLOGY_PLAY(CMPSIT_AUDIO_PLAY_ENTITY)
+  AUDIO_TOPOLOGY_RECORD(CMPSIT_AUDIO_RECORD_ENTITY)
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  AUDIO_TOPOLOGY_MIX(CMPSIT_AUDIO_PLAY_ENTITY)
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+
+  /* Voice clock source : fixed rate, read only frequency */
+  pClockDesc = ((USBD_AUDIOClockSourceDescTypedef *)((uint32_t)pConf + *Sze));
+  pClockDesc->bLength=(uint8_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
+  pClockDesc->bDescriptorType=0x24;
+  pClockDesc->bDescriptorSubtype=0xA;
+  pClockDesc->bClockID=USB_AUDIO_CONFIG_VOICE_CLOCK_SOURCE_ID;
+  pClockDesc->bmAttributes=0x01;
+  pClockDesc->bmControls=0x01;
+  pClockDesc->bAssocTerminal=0x0;
+  pClockDesc->iClockSource=0;
+  *Sze += (uint32_t)sizeof(USBD_AUDIOClockSourceDescTypedef);
 
+  /* Sampling rate converter from the record feature unit to the voice clock */
+  pSrcDesc = ((USBD_AUDIOSampleRateConverterDescTypedef *)((uint32_t)pConf + *Sze));
+  pSrcDesc->bLength=(uint8_t)sizeof(USBD_AUDIOSampleRateConverterDescTypedef);
+  pSrcDesc->bDescriptorType=0x24;
+  pSrcDesc->bDescriptorSubtype=0xD;
+  pSrcDesc->bUnitID=USB_AUDIO_CONFIG_VOICE_UNIT_SRC_ID;
+  pSrcDesc->bSourceID=USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID;
+  pSrcDesc->bCSourceInID=CMPSIT_AUDIO_CLOCK_ID;
+  pSrcDesc->bCSourceOutID=USB_AUDIO_CONFIG_VOICE_CLOCK_SOURCE_ID;
+  pSrcDesc->iSRC=0;
+  *Sze += (uint32_t)sizeof(USBD_AUDIOSampleRateConverterDescTypedef);
+
+  /* Voice USB streaming output terminal */
+  pOutputTerminalDesc= ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
   pOutputTerminalDesc->bLength=(uint8_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
   pOutputTerminalDesc->bDescriptorType=0x24;
   pOutputTerminalDesc->bDescriptorSubtype=0x03;
-  pOutputTerminalDesc->bTerminalID=0x14;
-  pOutputTerminalDesc->wTerminalType=0x0301;
+  pOutputTerminalDesc->bTerminalID=USB_AUDIO_CONFIG_VOICE_TERMINAL_OUTPUT_ID;
+  pOutputTerminalDesc->wTerminalType=0x0101;
   pOutputTerminalDesc->bAssocTerminal=0x0;
-  pOutputTerminalDesc->bSourceID=0x16;
-  pOutputTerminalDesc->bCSourceID=0x18;
+  pOutputTerminalDesc->bSourceID=USB_AUDIO_CONFIG_VOICE_UNIT_SRC_ID;
+  pOutputTerminalDesc->bCSourceID=USB_AUDIO_CONFIG_VOICE_CLOCK_SOURCE_ID;
   pOutputTerminalDesc->bmControls=0x0;
-  pOutputTerminalDesc->iTerminal=0; 
+  pOutputTerminalDesc->iTerminal=0;
+  *Sze += (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+#endif /* USE_AUDIO_RECORDING_VOICE */
 
-*Sze += (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+  /* Play streaming interface, zero bandwidth alternate then one alternate per format */
+  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[1], 0U, 0U, 0x01, 0x02, 0x020, 0U);
+  for(alt = 0U; alt < CMPSIT_AUDIO_PLAY_ALT_COUNT; alt++)
+  {
+    USBD_CMPSIT_AUDIOStreamingAltDesc(pConf, Sze, speed, pdev->tclasslist[pdev->classId].Ifs[1], (uint8_t)(alt + 1U),
+                                      USB_AUDIO_CONFIG_PLAY_TERMINAL_INPUT_ID, CMPSIT_AUDIO_PLAY_CHANNEL_COUNT,
+                                      CMPSIT_AUDIO_PLAY_CHANNEL_MAP,
+                                      &PlayAlts[alt], pdev->tclasslist[pdev->classId].Eps[0].add,
+                                      CMPSIT_AUDIO_PLAY_EP_ATTR);
+  }
 
-  /* Audio input terminal Descriptor*/
-  pInputTerminalDesc= ((USBD_AUDIOInputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
-  pInputTerminalDesc->bLength=(uint8_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
-  pInputTerminalDesc->bDescriptorType=0x24;
-  pInputTerminalDesc->bDescriptorSubtype=0x2;
-  pInputTerminalDesc->bTerminalID=0x11;
-  pInputTerminalDesc->wTerminalType =0x0201;
-  pInputTerminalDesc->bAssocTerminal=0x0;
-  pInputTerminalDesc->bCSourceID =0x18;
-  pInputTerminalDesc->bNrChannels =2;
-  pInputTerminalDesc->bmChannelConfig=0x03;
-  pInputTerminalDesc->iChannelNames=0;
-  pInputTerminalDesc->bmControls=0x0;
-  pInputTerminalDesc->iTerminal=0; 
+  /* Record streaming interface */
+  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[2], 0U, 0U, 0x01, 0x02, 0x020, 0U);
+  USBD_CMPSIT_AUDIOStreamingAltDesc(pConf, Sze, speed, pdev->tclasslist[pdev->classId].Ifs[2], 1U,
+                                    USB_AUDIO_CONFIG_RECORD_TERMINAL_OUTPUT_ID, CMPSIT_AUDIO_RECORD_CHANNEL_COUNT,
+                                    CMPSIT_AUDIO_RECORD_CHANNEL_MAP,
+                                    &RecordAlt, pdev->tclasslist[pdev->classId].Eps[1].add,
+                                    CMPSIT_AUDIO_RECORD_EP_ATTR);
+#ifdef USE_AUDIO_PLAYBACK_MIX
+
+  /* Mix streaming interface, one 16 bits alternate */
+  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[3], 0U, 0U, 0x01, 0x02, 0x020, 0U);
+  USBD_CMPSIT_AUDIOStreamingAltDesc(pConf, Sze, speed, pdev->tclasslist[pdev->classId].Ifs[3], 1U,
+                                    USB_AUDIO_CONFIG_MIX_TERMINAL_INPUT_ID, CMPSIT_AUDIO_PLAY_CHANNEL_COUNT,
+                                    CMPSIT_AUDIO_PLAY_CHANNEL_MAP, &MixAlt, pdev->tclasslist[pdev->classId].Eps[2].add,
+                                    USBD_EP_TYPE_ISOC);
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+
+  /* Voice streaming interface, one 16 bits alternate at the voice rate */
+  __USBD_CMPSIT_SET_IF(voiceIf, 0U, 0U, 0x01, 0x02, 0x020, 0U);
+  USBD_CMPSIT_AUDIOStreamingAltDesc(pConf, Sze, speed, voiceIf, 1U,
+                                    USB_AUDIO_CONFIG_VOICE_TERMINAL_OUTPUT_ID, CMPSIT_AUDIO_RECORD_CHANNEL_COUNT,
+                                    CMPSIT_AUDIO_RECORD_CHANNEL_MAP, &VoiceAlt,
+                                    pdev->tclasslist[pdev->classId].Eps[pdev->tclasslist[pdev->classId].NumEps - 1U].add,
+                                    CMPSIT_AUDIO_RECORD_EP_ATTR);
+#endif /* USE_AUDIO_RECORDING_VOICE */
 
-  *Sze += (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
+  /* Update Config Descriptor and IAD descriptor */
+  ((USBD_ConfigDescTypeDef *)pConf)->bNumInterfaces += (uint8_t)pdev->tclasslist[pdev->classId].NumIf;
+  ((USBD_ConfigDescTypeDef *)pConf)->wTotalLength = (uint16_t)(*Sze);
+}
 
+/**
+  * @brief  USBD_CMPSIT_AUDIOEntityDesc
+  *         Append the descriptor of a topology table entity : input terminal,
+  *         feature unit or output terminal, clocked by CMPSIT_AUDIO_CLOCK_ID
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @param  Subtype: AUDIO_TOPOLOGY_xxx entity subtype
+  * @param  EntityID: terminal or unit id
+  * @param  SourceID: id of the entity feeding it, unused for an input terminal
+  * @param  TerminalType: terminal type, unused for a unit
+  * @param  NrChannels: logical channels count of the path
+  * @param  ChannelMap: spatial location of the channels
+  * @retval None
+  */
+static void  USBD_CMPSIT_AUDIOEntityDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t Subtype,
+                                         uint8_t EntityID, uint8_t SourceID, uint16_t TerminalType,
+                                         uint8_t NrChannels, uint32_t ChannelMap)
+{
+  USBD_AUDIOInputTerminalDescTypedef *pInputTerminalDesc;
+  USBD_AUDIOOutputTerminalDescTypedef *pOutputTerminalDesc;
+
+  if (Subtype == AUDIO_TOPOLOGY_FEATURE_UNIT)
+  {
+    USBD_CMPSIT_AUDIOFeatureUnitDesc(pConf, Sze, EntityID, SourceID, NrChannels);
+  }
+  else if (Subtype == AUDIO_TOPOLOGY_INPUT_TERMINAL)
+  {
+    pInputTerminalDesc = ((USBD_AUDIOInputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
+    pInputTerminalDesc->bLength = (uint8_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
+    pInputTerminalDesc->bDescriptorType = 0x24;
+    pInputTerminalDesc->bDescriptorSubtype = AUDIO_TOPOLOGY_INPUT_TERMINAL;
+    pInputTerminalDesc->bTerminalID = EntityID;
+    pInputTerminalDesc->wTerminalType = TerminalType;
+    pInputTerminalDesc->bAssocTerminal = 0x0;
+    pInputTerminalDesc->bCSourceID = CMPSIT_AUDIO_CLOCK_ID;
+    pInputTerminalDesc->bNrChannels = NrChannels;
+    pInputTerminalDesc->bmChannelConfig = ChannelMap;
+    pInputTerminalDesc->iChannelNames = 0;
+    pInputTerminalDesc->bmControls = 0x0;
+    pInputTerminalDesc->iTerminal = 0;
+    *Sze += (uint32_t)sizeof(USBD_AUDIOInputTerminalDescTypedef);
+  }
+  else
+  {
+    pOutputTerminalDesc = ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
+    pOutputTerminalDesc->bLength = (uint8_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+    pOutputTerminalDesc->bDescriptorType = 0x24;
+    pOutputTerminalDesc->bDescriptorSubtype = AUDIO_TOPOLOGY_OUTPUT_TERMINAL;
+    pOutputTerminalDesc->bTerminalID = EntityID;
+    pOutputTerminalDesc->wTerminalType = TerminalType;
+    pOutputTerminalDesc->bAssocTerminal = 0x0;
+    pOutputTerminalDesc->bSourceID = SourceID;
+    pOutputTerminalDesc->bCSourceID = CMPSIT_AUDIO_CLOCK_ID;
+    pOutputTerminalDesc->bmControls = 0x0;
+    pOutputTerminalDesc->iTerminal = 0;
+    *Sze += (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
+  }
+}
+
+/**
+  * @brief  USBD_CMPSIT_AUDIOFeatureUnitDesc
+  *         Append an AUDIO feature unit Descriptor, its length depends on the
+  *         channels count : bmaControls are given for master then each channel
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @param  UnitID: feature unit id
+  * @param  SourceID: id of the terminal feeding the unit
+  * @param  NrChannels: logical channels count of the source
+  * @retval None
+  */
+static void  USBD_CMPSIT_AUDIOFeatureUnitDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t UnitID,
+                                              uint8_t SourceID, uint8_t NrChannels)
+{
+  USBD_AUDIOFeatureUnitDescTypedef *pFeatureUnitDesc;
+  uint8_t *piFeature;
+  uint32_t channel;
 
-  /* Audio feature unit Descriptor*/
   pFeatureUnitDesc= ((USBD_AUDIOFeatureUnitDescTypedef *)((uint32_t)pConf + *Sze));
-  pFeatureUnitDesc->bLength=(uint8_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef);
+  pFeatureUnitDesc->bLength=(uint8_t)USBD_AUDIO_FEATURE_UNIT_DESC_SIZE(NrChannels);
   pFeatureUnitDesc->bDescriptorType=0x24;
   pFeatureUnitDesc->bDescriptorSubtype=0x6;
-  pFeatureUnitDesc->bUnitID=0x15;
-  pFeatureUnitDesc->bSourceID=0x11;
-  pFeatureUnitDesc->bmaControls0=0xF;//check
-  pFeatureUnitDesc->bmaControls1=0x0;
-  pFeatureUnitDesc->bmaControls2=0x0;
-  pFeatureUnitDesc->iFeature=0; 
-
-*Sze += (uint32_t)sizeof(USBD_AUDIOFeatureUnitDescTypedef);
-
-  /* Audio output terminal Descriptor*/
-pOutputTerminalDesc= ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf + *Sze));
-
-  pOutputTerminalDesc->bLength=(uint8_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
-  pOutputTerminalDesc->bDescriptorType=0x24;
-  pOutputTerminalDesc->bDescriptorSubtype=0x03;
-  pOutputTerminalDesc->bTerminalID=0x13;
-  pOutputTerminalDesc->wTerminalType=0x0101;
-  pOutputTerminalDesc->bAssocTerminal=0x0;
-  pOutputTerminalDesc->bSourceID=0x15;
-  pOutputTerminalDesc->bCSourceID=0x18;
-  pOutputTerminalDesc->bmControls=0x0;
-  pOutputTerminalDesc->iTerminal=0; 
-*Sze += (uint32_t)sizeof(USBD_AUDIOOutputTerminalDescTypedef);
-
-  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[1], 0U, 0U, 0x01, 0x02, 0x020, 0U);
-  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[1], 1U, 1U, 0x01, 0x02, 0x020, 0U);
-
-  /* Audio 20 AS Interface Descriptor*/
-  pAsInterfaceDesc= ((USBD_AUDIO20ASInterfaceDescTypedef *)((uint32_t)pConf + *Sze));
-  pAsInterfaceDesc->bLength=(uint8_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef);
-  pAsInterfaceDesc->bDescriptorType=0x24;
-  pAsInterfaceDesc->bDescriptorSubtype=0x1;
-  pAsInterfaceDesc->bTerminalLink=0x12;
-  pAsInterfaceDesc->bmControls=0x0;
-  pAsInterfaceDesc->bFormatType=0x1;
-  pAsInterfaceDesc->bmFormats=0x1;
-  pAsInterfaceDesc->bNrChannels=2;
-  pAsInterfaceDesc->bmChannelConfig=0x03;
-  pAsInterfaceDesc->iChannelNames=0;
-*Sze += (uint32_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef);
-
-  /* Audio 20 as format type Descriptor*/
-  pAsFormatTypeDesc= ((USBD_AUDIO20ASFormatTypeDescTypedef *)((uint32_t)pConf + *Sze));
-  pAsFormatTypeDesc->bLength=(uint8_t)sizeof(USBD_AUDIO20ASFormatTypeDescTypedef);
-  pAsFormatTypeDesc->bDescriptorType=0x24;
-  pAsFormatTypeDesc->bDescriptorSubtype=0x2;
-  pAsFormatTypeDesc->bFormatType=0x1;
-  pAsFormatTypeDesc->bSubslotSize=2;
-  pAsFormatTypeDesc->bBitResolution=16;
-
-*Sze += (uint32_t)sizeof(USBD_AUDIO20ASFormatTypeDescTypedef);
+  pFeatureUnitDesc->bUnitID=UnitID;
+  pFeatureUnitDesc->bSourceID=SourceID;
+  for(channel = 0U; channel <= NrChannels; channel++)
+  {
+    pFeatureUnitDesc->bmaControls[channel]=CMPSIT_AUDIO_FU_CONTROLS;
+  }
+  /* iFeature closes the descriptor, after the last bmaControls */
+  piFeature = (uint8_t *)pFeatureUnitDesc + pFeatureUnitDesc->bLength - 1U;
+  *piFeature = 0U;
 
-  /* Append Endpoint descriptor to Configuration descriptor *///out
-  __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[0].add), (USBD_EP_TYPE_ISOC), (pdev->tclasslist[pdev->classId].CurrPcktSze), (1U), (1U));
+  *Sze += (uint32_t)pFeatureUnitDesc->bLength;
+}
 
-  pAsEndpointDesc= ((USBD_AUDIO20ASEndpointDescTypedef *)((uint32_t)pConf + *Sze));
-  pAsEndpointDesc->bLength=(uint8_t)sizeof(USBD_AUDIO20ASEndpointDescTypedef);
-  pAsEndpointDesc->bDescriptorType=0x25;
-  pAsEndpointDesc->bDescriptorSubtype=0x1;
-  pAsEndpointDesc->bmAttributes=0;
-  pAsEndpointDesc->bmControl=0;
-  pAsEndpointDesc->bLockDelayUnits=0;
-  pAsEndpointDesc->wLockDelay=0;
-  *Sze += (uint32_t)sizeof(USBD_AUDIO20ASEndpointDescTypedef);
+/**
+  * @brief  USBD_CMPSIT_AUDIOStreamingAltDesc
+  *         Append one alternate of an AUDIO streaming interface : interface,
+  *         class specific interface, format, data endpoint and class specific
+  *         endpoint descriptors
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @param  speed: current device speed
+  * @param  IfNum: streaming interface number
+  * @param  Alt: alternate setting number, 1 or above
+  * @param  TerminalLink: id of the terminal the interface is connected to
+  * @param  NrChannels: logical channels count
+  * @param  ChannelMap: spatial location of the channels
+  * @param  pAlt: format and max packet of the alternate
+  * @param  EpAdd: data endpoint address
+  * @param  EpAttr: data endpoint bmAttributes, isochronous with its synchronization and usage
+  * @retval None
+  */
+static void  USBD_CMPSIT_AUDIOStreamingAltDesc(uint32_t pConf, __IO uint32_t *Sze, uint8_t speed,
+                                               uint8_t IfNum, uint8_t Alt, uint8_t TerminalLink,
+                                               uint8_t NrChannels, uint32_t ChannelMap,
+                                               const USBD_CMPSIT_AudioAltTypeDef *pAlt, uint8_t EpAdd,
+                                               uint8_t EpAttr)
+{
+  static USBD_IfDescTypeDef *pIfDesc;
+  static USBD_EpDescTypeDef *pEpDesc;
+  USBD_AUDIO20ASInterfaceDescTypedef *pAsInterfaceDesc;
+  USBD_AUDIO20ASFormatTypeDescTypedef *pAsFormatTypeDesc;
+  USBD_AUDIO20ASEndpointDescTypedef *pAsEndpointDesc;
 
-  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[2], 0U, 0U, 0x01, 0x02, 0x020, 0U);
-  __USBD_CMPSIT_SET_IF(pdev->tclasslist[pdev->classId].Ifs[2], 1U, 1U, 0x01, 0x02, 0x020, 0U);
+  __USBD_CMPSIT_SET_IF(IfNum, Alt, 1U, 0x01, 0x02, 0x020, 0U);
 
   /* Audio 20 AS Interface Descriptor*/
   pAsInterfaceDesc= ((USBD_AUDIO20ASInterfaceDescTypedef *)((uint32_t)pConf + *Sze));
   pAsInterfaceDesc->bLength=(uint8_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef);
   pAsInterfaceDesc->bDescriptorType=0x24;
   pAsInterfaceDesc->bDescriptorSubtype=0x1;
-  pAsInterfaceDesc->bTerminalLink=0x13;
+  pAsInterfaceDesc->bTerminalLink=TerminalLink;
   pAsInterfaceDesc->bmControls=0x0;
   pAsInterfaceDesc->bFormatType=0x1;
   pAsInterfaceDesc->bmFormats=0x1;
-  pAsInterfaceDesc->bNrChannels=2;
-  pAsInterfaceDesc->bmChannelConfig=0x03;
+  pAsInterfaceDesc->bNrChannels=NrChannels;
+  pAsInterfaceDesc->bmChannelConfig=ChannelMap;
   pAsInterfaceDesc->iChannelNames=0;
-*Sze += (uint32_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef);
+  *Sze += (uint32_t)sizeof(USBD_AUDIO20ASInterfaceDescTypedef);
 
   /* Audio 20 as format type Descriptor*/
   pAsFormatTypeDesc= ((USBD_AUDIO20ASFormatTypeDescTypedef *)((uint32_t)pConf + *Sze));
@@ -1358,12 +1949,12 @@ pOutputTerminalDesc= ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf +
   pAsFormatTypeDesc->bDescriptorType=0x24;
   pAsFormatTypeDesc->bDescriptorSubtype=0x2;
   pAsFormatTypeDesc->bFormatType=0x1;
-  pAsFormatTypeDesc->bSubslotSize=2;
-  pAsFormatTypeDesc->bBitResolution=16;
-*Sze += (uint32_t)sizeof(USBD_AUDIO20ASFormatTypeDescTypedef);
+  pAsFormatTypeDesc->bSubslotSize=pAlt->bSubslotSize;
+  pAsFormatTypeDesc->bBitResolution=pAlt->bBitResolution;
+  *Sze += (uint32_t)sizeof(USBD_AUDIO20ASFormatTypeDescTypedef);
 
-  /* Append Endpoint descriptor to Configuration descriptor *///out
-  __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[1].add), (USBD_EP_TYPE_ISOC), (pdev->tclasslist[pdev->classId].CurrPcktSze), (1U), (1U));
+  /* Append Endpoint descriptor to Configuration descriptor, sized for this alternate only */
+  __USBD_CMPSIT_SET_EP(EpAdd, EpAttr, pAlt->wMaxPacketSize, (AUDIO_HS_BINTERVAL), (AUDIO_FS_BINTERVAL));
 
   pAsEndpointDesc= ((USBD_AUDIO20ASEndpointDescTypedef *)((uint32_t)pConf + *Sze));
   pAsEndpointDesc->bLength=(uint8_t)sizeof(USBD_AUDIO20ASEndpointDescTypedef);
@@ -1374,10 +1965,6 @@ pOutputTerminalDesc= ((USBD_AUDIOOutputTerminalDescTypedef *)((uint32_t)pConf +
   pAsEndpointDesc->bLockDelayUnits=0;
   pAsEndpointDesc->wLockDelay=0;
   *Sze += (uint32_t)sizeof(USBD_AUDIO20ASEndpointDescTypedef);
-
-  /* Update Config Descriptor and IAD descriptor */
-  ((USBD_ConfigDescTypeDef *)pConf)->bNumInterfaces += 3U;
-  ((USBD_ConfigDescTypeDef *)pConf)->wTotalLength = (uint16_t)(*Sze);
 }
 #endif /* USBD_CMPSIT_ACTIVATE_AUDIO */
 
@@ -1870,6 +2457,44 @@ static void  USBD_CMPSIT_MTPDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO
 }
 #endif /* USBD_CMPSIT_ACTIVATE_MTP == 1 */
 
+#if USBD_CMPSIT_ACTIVATE_VENDOR == 1
+/**
+  * @brief  USBD_CMPSIT_VENDORDesc
+  *         Configure and Append the vendor specific Descriptor
+  * @param  pdev: device instance
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @retval None
+  */
+static void  USBD_CMPSIT_VENDORDesc(USBD_HandleTypeDef *pdev, uint32_t pConf, __IO uint32_t *Sze, uint8_t speed)
+{
+  USBD_IfDescTypeDef *pIfDesc;
+  USBD_EpDescTypeDef *pEpDesc;
+
+  /* Append vendor Interface descriptor */
+  __USBD_CMPSIT_SET_IF((pdev->tclasslist[pdev->classId].Ifs[0]), (0U), \
+                       (uint8_t)(pdev->tclasslist[pdev->classId].NumEps), (USBD_VENDOR_INTERFACE_CLASS), \
+                       (USBD_VENDOR_INTERFACE_SUBCLASS), (USBD_VENDOR_INTERFACE_PROTOCOL), (0U));
+
+  if (speed == (uint8_t)USBD_SPEED_HIGH)
+  {
+    pdev->tclasslist[pdev->classId].CurrPcktSze = USBD_VENDOR_HS_MAX_PACKET_SIZE;
+  }
+
+  /* Append Endpoint descriptor to Configuration descriptor */
+  __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[0].add), (USBD_EP_TYPE_BULK), \
+                       (pdev->tclasslist[pdev->classId].CurrPcktSze), (0U), (0U));
+
+  /* Append Endpoint descriptor to Configuration descriptor */
+  __USBD_CMPSIT_SET_EP((pdev->tclasslist[pdev->classId].Eps[1].add), (USBD_EP_TYPE_BULK), \
+                       (pdev->tclasslist[pdev->classId].CurrPcktSze), (0U), (0U));
+
+  /* Update Config Descriptor */
+  ((USBD_ConfigDescTypeDef *)pConf)->bNumInterfaces += 1U;
+  ((USBD_ConfigDescTypeDef *)pConf)->wTotalLength = (uint16_t)(*Sze);
+}
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR == 1 */
+
 /**
   * @brief  USBD_CMPSIT_SetClassID
   *         Find and set the class ID relative to selected class type and instance
@@ -1957,6 +2582,7 @@ uint8_t USBD_CMPST_ClearConfDesc(USBD_HandleTypeDef *pdev)
 {
   UNUSED(pdev);
 
+#if USBD_CMPSIT_STATIC_CONFDESC == 0
   /* Reset the configuration descriptor pointer to default value and its size to zero */
   pCmpstFSConfDesc = USBD_CMPSIT_FSCfgDesc;
   CurrFSConfDescSz = 0U;
@@ -1965,6 +2591,7 @@ uint8_t USBD_CMPST_ClearConfDesc(USBD_HandleTypeDef *pdev)
   pCmpstHSConfDesc = USBD_CMPSIT_HSCfgDesc;
   CurrHSConfDescSz = 0U;
 #endif /* USE_USB_HS */
+#endif /* USBD_CMPSIT_STATIC_CONFDESC */
 
   /* All done, can't fail */
   return (uint8_t)USBD_OK;
@@ -145,6 +145,12 @@ USBD_StatusTypeDef USBD_LL_SetTestMode(USBD_HandleTypeDef *pdev, uint8_t testmod
 
 uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr);
 uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t  ep_addr);
+#ifdef USE_AUDIO_USB_ADMISSION
+uint32_t USBD_LL_GetIsoFifoSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr);
+#endif /* USE_AUDIO_USB_ADMISSION */
+#ifdef USE_AUDIO_USB_LOW_RATE
+USBD_StatusTypeDef USBD_LL_SetIsoInterval(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t interval);
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
 void  USBD_LL_Delay(uint32_t Delay);
 
@@ -70,6 +70,9 @@ extern "C" {
 #define USBD_MAX_CLASS_INTERFACES                      5U
 #endif /* USBD_MAX_CLASS_INTERFACES */
 
+/* endpoint numbers 0..15 of each direction in the endpoint to class table */
+#define USBD_EP_CLASS_MAP_SIZE                         16U
+
 #ifndef USBD_LPM_ENABLED
 #define USBD_LPM_ENABLED                                0U
 #endif /* USBD_LPM_ENABLED */
@@ -329,6 +332,7 @@ typedef enum
   CLASS_TYPE_VIDEO   = 10,
   CLASS_TYPE_PRINTER = 11,
   CLASS_TYPE_CCID    = 12,
+  CLASS_TYPE_VENDOR  = 13,
 } USBD_CompositeClassTypeDef;
 
 
@@ -374,6 +378,9 @@ typedef struct _USBD_HandleTypeDef
   uint8_t                 dev_connection_status;
   uint8_t                 dev_test_mode;
   uint32_t                dev_remote_wakeup;
+#ifdef USE_USBD_FAST_RESET
+  __IO uint8_t            bus_reset;  /* classes are de-initialized by USBD_LL_Reset */
+#endif /* USE_USBD_FAST_RESET */
   uint8_t                 ConfIdx;
 
   USBD_SetupReqTypedef    request;
@@ -389,6 +396,10 @@ typedef struct _USBD_HandleTypeDef
   uint32_t                NumClasses;
 #ifdef USE_USBD_COMPOSITE
   USBD_CompositeElementTypeDef tclasslist[USBD_MAX_SUPPORTED_CLASS];
+  /* class index + 1 of each endpoint number, 0 when no class uses it. Built
+     when classes are registered, read by USBD_CoreFindEP on each transfer */
+  uint8_t                 ep_in_class[USBD_EP_CLASS_MAP_SIZE];
+  uint8_t                 ep_out_class[USBD_EP_CLASS_MAP_SIZE];
 #endif /* USE_USBD_COMPOSITE */
 } USBD_HandleTypeDef;
 
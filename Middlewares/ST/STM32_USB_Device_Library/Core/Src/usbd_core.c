@@ -63,6 +63,9 @@
 /** @defgroup USBD_CORE_Private_FunctionPrototypes
   * @{
   */
+#ifdef USE_USBD_COMPOSITE
+static void USBD_CoreBuildEPMap(USBD_HandleTypeDef *pdev);
+#endif /* USE_USBD_COMPOSITE */
 
 /**
   * @}
@@ -259,12 +262,18 @@ USBD_StatusTypeDef  USBD_RegisterClassComposite(USBD_HandleTypeDef *pdev, USBD_C
 
       pdev->tclasslist[pdev->classId].EpAdd = EpAddr;
 
-      /* Call the composite class builder */
-      (void)USBD_CMPSIT_AddClass(pdev, pclass, classtype, 0);
+      /* Call the composite class builder, fails when the descriptor can't hold the class */
+      if (USBD_CMPSIT_AddClass(pdev, pclass, classtype, 0) != (uint8_t)USBD_OK)
+      {
+        ret = USBD_FAIL;
+      }
 
       /* Increment the ClassId for the next occurrence */
       pdev->classId ++;
       pdev->NumClasses ++;
+
+      /* endpoints of the new class are routed without scanning the classes */
+      USBD_CoreBuildEPMap(pdev);
     }
     else
     {
@@ -355,6 +364,7 @@ USBD_StatusTypeDef  USBD_UnRegisterClassComposite(USBD_HandleTypeDef *pdev)
   /* Reset the class ID and number of classes */
   pdev->classId = 0U;
   pdev->NumClasses = 0U;
+  USBD_CoreBuildEPMap(pdev);
 
   return ret;
 }
@@ -764,6 +774,10 @@ USBD_StatusTypeDef USBD_LL_Reset(USBD_HandleTypeDef *pdev)
   pdev->dev_config = 0U;
   pdev->dev_remote_wakeup = 0U;
   pdev->dev_test_mode = 0U;
+#ifdef USE_USBD_FAST_RESET
+  /* classes may keep their state for the next configuration */
+  pdev->bus_reset = 1U;
+#endif /* USE_USBD_FAST_RESET */
 
 #ifdef USE_USBD_COMPOSITE
   /* Parse the table of classes in use */
@@ -800,6 +814,9 @@ USBD_StatusTypeDef USBD_LL_Reset(USBD_HandleTypeDef *pdev)
     }
   }
 #endif /* USE_USBD_COMPOSITE */
+#ifdef USE_USBD_FAST_RESET
+  pdev->bus_reset = 0U;
+#endif /* USE_USBD_FAST_RESET */
 
   /* Open EP0 OUT */
   (void)USBD_LL_OpenEP(pdev, 0x00U, USBD_EP_TYPE_CTRL, USB_MAX_EP0_SIZE);
@@ -918,6 +935,17 @@ USBD_StatusTypeDef USBD_LL_SOF(USBD_HandleTypeDef *pdev)
 USBD_StatusTypeDef USBD_LL_IsoINIncomplete(USBD_HandleTypeDef *pdev,
                                            uint8_t epnum)
 {
+  uint8_t idx;
+
+  /* Get the class index relative to this endpoint, the current class
+     is kept for endpoints not registered by any class */
+  idx = USBD_CoreFindEP(pdev, ((uint8_t)epnum | 0x80U));
+
+  if (((uint16_t)idx != 0xFFU) && (idx < USBD_MAX_SUPPORTED_CLASS))
+  {
+    pdev->classId = idx;
+  }
+
   if (pdev->pClass[pdev->classId] == NULL)
   {
     return USBD_FAIL;
@@ -943,6 +971,17 @@ USBD_StatusTypeDef USBD_LL_IsoINIncomplete(USBD_HandleTypeDef *pdev,
 USBD_StatusTypeDef USBD_LL_IsoOUTIncomplete(USBD_HandleTypeDef *pdev,
                                             uint8_t epnum)
 {
+  uint8_t idx;
+
+  /* Get the class index relative to this endpoint, the current class
+     is kept for endpoints not registered by any class */
+  idx = USBD_CoreFindEP(pdev, (epnum & 0x7FU));
+
+  if (((uint16_t)idx != 0xFFU) && (idx < USBD_MAX_SUPPORTED_CLASS))
+  {
+    pdev->classId = idx;
+  }
+
   if (pdev->pClass[pdev->classId] == NULL)
   {
     return USBD_FAIL;
@@ -1067,28 +1106,24 @@ uint8_t USBD_CoreFindIF(USBD_HandleTypeDef *pdev, uint8_t index)
 uint8_t USBD_CoreFindEP(USBD_HandleTypeDef *pdev, uint8_t index)
 {
 #ifdef USE_USBD_COMPOSITE
-  /* Parse the table of classes in use */
-  for (uint32_t i = 0U; i < USBD_MAX_SUPPORTED_CLASS; i++)
+  uint8_t entry;
+
+  /* Read the endpoint to class table built by USBD_CoreBuildEPMap */
+  if ((index & 0x7FU) >= USBD_EP_CLASS_MAP_SIZE)
   {
-    /* Check if current class is in use */
-    if ((pdev->tclasslist[i].Active) == 1U)
-    {
-      /* Parse all endpoints listed in the current class */
-      for (uint32_t j = 0U; j < pdev->tclasslist[i].NumEps; j++)
-      {
-        /* Check if requested endpoint matches the current class endpoint */
-        if (pdev->tclasslist[i].Eps[j].add == index)
-        {
-          if (pdev->pClass[i]->Setup != NULL)
-          {
-            return (uint8_t)i;
-          }
-        }
-      }
-    }
+    return 0xFFU;
   }
 
-  return 0xFFU;
+  if ((index & 0x80U) == 0x80U)
+  {
+    entry = pdev->ep_in_class[index & 0x7FU];
+  }
+  else
+  {
+    entry = pdev->ep_out_class[index];
+  }
+
+  return (entry != 0U) ? (uint8_t)(entry - 1U) : 0xFFU;
 #else
   UNUSED(pdev);
   UNUSED(index);
@@ -1098,6 +1133,52 @@ uint8_t USBD_CoreFindEP(USBD_HandleTypeDef *pdev, uint8_t index)
 }
 
 #ifdef USE_USBD_COMPOSITE
+/**
+  * @brief  USBD_CoreBuildEPMap
+  *         build the endpoint number to class table of USBD_CoreFindEP from
+  *         the endpoints of the active classes, the first class listing an
+  *         endpoint keeps it, as with the former scan of the classes
+  * @param  pdev: device instance
+  * @retval None
+  */
+static void USBD_CoreBuildEPMap(USBD_HandleTypeDef *pdev)
+{
+  uint8_t add;
+
+  (void)USBD_memset(pdev->ep_in_class, 0, sizeof(pdev->ep_in_class));
+  (void)USBD_memset(pdev->ep_out_class, 0, sizeof(pdev->ep_out_class));
+
+  for (uint32_t i = 0U; i < USBD_MAX_SUPPORTED_CLASS; i++)
+  {
+    if ((pdev->tclasslist[i].Active != 1U) || (pdev->pClass[i] == NULL) || (pdev->pClass[i]->Setup == NULL))
+    {
+      continue;
+    }
+
+    for (uint32_t j = 0U; j < pdev->tclasslist[i].NumEps; j++)
+    {
+      add = pdev->tclasslist[i].Eps[j].add;
+
+      if ((add & 0x7FU) >= USBD_EP_CLASS_MAP_SIZE)
+      {
+        continue;
+      }
+
+      if ((add & 0x80U) == 0x80U)
+      {
+        if (pdev->ep_in_class[add & 0x7FU] == 0U)
+        {
+          pdev->ep_in_class[add & 0x7FU] = (uint8_t)(i + 1U);
+        }
+      }
+      else if (pdev->ep_out_class[add] == 0U)
+      {
+        pdev->ep_out_class[add] = (uint8_t)(i + 1U);
+      }
+    }
+  }
+}
+
 /**
   * @brief  USBD_CoreGetEPAdd
   *         Get the endpoint address relative to a selected class
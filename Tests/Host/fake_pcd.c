@@ -0,0 +1,120 @@
+/**
+  ******************************************************************************
+  * @file    fake_pcd.c
+  * @brief   Host stand-in of the USB peripheral : a full speed bus which
+  *          starts a frame each ms, reads the feedback endpoint and sends the
+  *          OUT stream at the rate it read, and device clocks drifting from it
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "fake_pcd.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FAKE_PCD_RATE_FRAC_BITS   8U /* device rates are Hz 24.8, as AUDIO_FEEDBACK_RATE_FRAC_BITS */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  FAKE_PCD_HostInit
+  *         bus reset , the host sends the nominal rate until it reads a feedback
+  * @param  host: host side
+  * @param  freq: nominal Hz of the OUT stream
+  * @param  feedback_period: frames between two reads of the feedback endpoint
+  * @retval None
+  */
+void FAKE_PCD_HostInit(FAKE_PCD_HostTypeDef* host, uint32_t freq, uint32_t feedback_period)
+{
+  host->sof = 0;
+  host->feedback_period = feedback_period;
+  host->feedback = (freq << FAKE_PCD_FEEDBACK_FRAC_BITS) / 1000U;
+  host->pending_rate = 0;
+  host->out_accumulator = 0;
+}
+
+/**
+  * @brief  FAKE_PCD_PublishFeedback
+  *         device side, the rate its feedback endpoint returns on next read
+  * @param  host: host side
+  * @param  rate: Hz 24.8 , as the GetFeedback callback returns it
+  * @retval None
+  */
+void FAKE_PCD_PublishFeedback(FAKE_PCD_HostTypeDef* host, uint32_t rate)
+{
+  host->pending_rate = rate;
+}
+
+/**
+  * @brief  FAKE_PCD_Sof
+  *         starts a frame, the feedback endpoint is read on its period with the
+  *         encoding of the full speed feedback of usbd_audio.c
+  * @param  host: host side
+  * @retval frame number
+  */
+uint32_t FAKE_PCD_Sof(FAKE_PCD_HostTypeDef* host)
+{
+  host->sof++;
+  if(((host->sof % host->feedback_period) == 0U) && (host->pending_rate != 0U))
+  {
+    host->feedback = (((host->pending_rate << (13U - FAKE_PCD_RATE_FRAC_BITS)) + 62U) / 125U) >> 2;
+  }
+  return host->sof;
+}
+
+/**
+  * @brief  FAKE_PCD_OutFrames
+  *         frames of the OUT packet of this frame
+  * @param  host: host side
+  * @retval frames count
+  */
+uint32_t FAKE_PCD_OutFrames(FAKE_PCD_HostTypeDef* host)
+{
+  uint32_t frames;
+
+  host->out_accumulator += host->feedback;
+  frames = host->out_accumulator >> FAKE_PCD_FEEDBACK_FRAC_BITS;
+  host->out_accumulator -= frames << FAKE_PCD_FEEDBACK_FRAC_BITS;
+  return frames;
+}
+
+/**
+  * @brief  FAKE_PCD_ClockInit
+  *         device clock of a speaker or a microphone
+  * @param  clock: device clock
+  * @param  freq: nominal Hz
+  * @param  ppm: drift against the bus clock, positive runs faster
+  * @retval None
+  */
+void FAKE_PCD_ClockInit(FAKE_PCD_ClockTypeDef* clock, uint32_t freq, int32_t ppm)
+{
+  clock->freq = freq;
+  clock->ppm = ppm;
+  clock->accumulator = 0;
+}
+
+/**
+  * @brief  FAKE_PCD_ClockFrames
+  *         frames the device clock ran during one bus frame
+  * @param  clock: device clock
+  * @retval frames count
+  */
+uint32_t FAKE_PCD_ClockFrames(FAKE_PCD_ClockTypeDef* clock)
+{
+  uint64_t one = 1000ULL * FAKE_PCD_PPM_ONE;
+  uint32_t frames;
+
+  clock->accumulator += (uint64_t)clock->freq * (uint64_t)((int64_t)FAKE_PCD_PPM_ONE + clock->ppm);
+  frames = (uint32_t)(clock->accumulator / one);
+  clock->accumulator -= frames * one;
+  return frames;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    fake_pcd.h
+  * @brief   header file for the fake_pcd.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __FAKE_PCD_H
+#define __FAKE_PCD_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define FAKE_PCD_PPM_ONE                1000000U
+#define FAKE_PCD_FEEDBACK_FRAC_BITS     14U /* full speed feedback is 10.14 frames per frame */
+
+/* Exported types ------------------------------------------------------------*/
+/* host side of a full speed bus : it counts the frames, reads the feedback
+   endpoint each feedback_period frames and sizes the OUT packets from the last
+   value read, the way a host controller driver does */
+typedef struct
+{
+  uint32_t  sof;                  /* frames since the bus reset */
+  uint32_t  feedback_period;      /* frames between two reads of the feedback endpoint */
+  uint32_t  feedback;             /* last value read, 10.14 frames per frame */
+  uint32_t  pending_rate;         /* rate published by the device, Hz 24.8 , 0 when none */
+  uint32_t  out_accumulator;      /* fractional frames of the OUT stream, 14 fractional bits */
+}
+FAKE_PCD_HostTypeDef;
+
+/* a device clock, running ppm away from the bus clock */
+typedef struct
+{
+  uint32_t  freq;                 /* nominal Hz */
+  int32_t   ppm;                  /* drift against the bus clock */
+  uint64_t  accumulator;          /* fractional frames, in 1 / (1000 * FAKE_PCD_PPM_ONE) */
+}
+FAKE_PCD_ClockTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void     FAKE_PCD_HostInit(FAKE_PCD_HostTypeDef* host, uint32_t freq, uint32_t feedback_period);
+void     FAKE_PCD_PublishFeedback(FAKE_PCD_HostTypeDef* host, uint32_t rate);
+uint32_t FAKE_PCD_Sof(FAKE_PCD_HostTypeDef* host);
+uint32_t FAKE_PCD_OutFrames(FAKE_PCD_HostTypeDef* host);
+void     FAKE_PCD_ClockInit(FAKE_PCD_ClockTypeDef* clock, uint32_t freq, int32_t ppm);
+uint32_t FAKE_PCD_ClockFrames(FAKE_PCD_ClockTypeDef* clock);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __FAKE_PCD_H */
@@ -0,0 +1,235 @@
+/**
+  ******************************************************************************
+  * @file    host_cdc.c
+  * @brief   Host side of the CDC command channel : frames the requests of
+  *          audio_cdc_command.c, checks its responses and runs a command on
+  *          the tty of the virtual COM port, for the host tools of this
+  *          directory
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "host_cdc.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t HOST_CdcReadByte(int fd, uint8_t* byte);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  HOST_CdcOpen
+  *         opens the tty of the virtual COM port in raw mode, the baud rate
+  *         of a CDC port has no effect
+  * @param  path: tty path, e.g. /dev/ttyACM0
+  * @retval file descriptor, -1 on error
+  */
+int HOST_CdcOpen(const char* path)
+{
+  struct termios tio;
+  int fd;
+
+  fd = open(path, O_RDWR | O_NOCTTY);
+  if(fd < 0)
+  {
+    return -1;
+  }
+  if(tcgetattr(fd, &tio) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  cfmakeraw(&tio);
+  if(tcsetattr(fd, TCSANOW, &tio) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  tcflush(fd, TCIOFLUSH);
+  return fd;
+}
+
+/**
+  * @brief  HOST_CdcClose
+  *         closes the tty
+  * @param  fd: file descriptor from HOST_CdcOpen
+  * @retval None
+  */
+void HOST_CdcClose(int fd)
+{
+  close(fd);
+}
+
+/**
+  * @brief  HOST_CdcRequest
+  *         frames a request : sync, cmd, len, payload, checksum
+  * @param  frame: destination, HOST_CDC_FRAME_SIZE bytes
+  * @param  cmd: AUDIO_CDC_CMD_xxx
+  * @param  payload: request payload
+  * @param  length: payload length, up to AUDIO_CDC_CMD_MAX_PAYLOAD
+  * @retval frame length
+  */
+uint32_t HOST_CdcRequest(uint8_t* frame, uint8_t cmd, const uint8_t* payload, uint8_t length)
+{
+  uint8_t  sum = 0;
+  uint32_t i;
+
+  frame[0] = AUDIO_CDC_CMD_REQUEST_SYNC;
+  frame[1] = cmd;
+  frame[2] = length;
+  for(i = 0; i < length; i++)
+  {
+    frame[HOST_CDC_REQUEST_HEADER + i] = payload[i];
+  }
+  for(i = 0; i < (HOST_CDC_REQUEST_HEADER + length); i++)
+  {
+    sum += frame[i];
+  }
+  /* the sum of all frame bytes is zero */
+  frame[HOST_CDC_REQUEST_HEADER + length] = (uint8_t)(0U - sum);
+  return HOST_CDC_REQUEST_HEADER + length + 1U;
+}
+
+/**
+  * @brief  HOST_CdcParse
+  *         checks a complete response frame and copies its payload
+  * @param  frame: response frame, from its sync byte
+  * @param  length: frame length
+  * @param  cmd: command the response must answer
+  * @param  status: returned AUDIO_CDC_CMD_STATUS_xxx
+  * @param  payload: payload copy, AUDIO_CDC_CMD_MAX_PAYLOAD bytes
+  * @param  payload_length: returned payload length
+  * @retval 0 if the frame is a valid response to cmd
+  */
+int8_t HOST_CdcParse(const uint8_t* frame, uint32_t length, uint8_t cmd, uint8_t* status,
+                     uint8_t* payload, uint8_t* payload_length)
+{
+  uint8_t  sum = 0;
+  uint32_t i;
+
+  if((length < (HOST_CDC_RESPONSE_HEADER + 1U)) || (frame[0] != AUDIO_CDC_CMD_RESPONSE_SYNC) ||
+     (frame[1] != cmd) || (frame[3] > AUDIO_CDC_CMD_MAX_PAYLOAD) ||
+     (length != (HOST_CDC_RESPONSE_HEADER + frame[3] + 1U)))
+  {
+    return -1;
+  }
+  for(i = 0; i < length; i++)
+  {
+    sum += frame[i];
+  }
+  if(sum != 0U)
+  {
+    return -1;
+  }
+  *status = frame[2];
+  *payload_length = frame[3];
+  for(i = 0; i < frame[3]; i++)
+  {
+    payload[i] = frame[HOST_CDC_RESPONSE_HEADER + i];
+  }
+  return 0;
+}
+
+/**
+  * @brief  HOST_CdcCommand
+  *         sends a request and waits its response, bytes before the response
+  *         sync are dropped as the device drops them
+  * @param  fd: file descriptor from HOST_CdcOpen
+  * @param  cmd: AUDIO_CDC_CMD_xxx
+  * @param  payload: request payload
+  * @param  length: payload length
+  * @param  response: response payload, AUDIO_CDC_CMD_MAX_PAYLOAD bytes
+  * @param  response_length: returned response payload length
+  * @retval 0 if the device answered AUDIO_CDC_CMD_STATUS_OK
+  */
+int8_t HOST_CdcCommand(int fd, uint8_t cmd, const uint8_t* payload, uint8_t length,
+                       uint8_t* response, uint8_t* response_length)
+{
+  uint8_t  frame[HOST_CDC_FRAME_SIZE];
+  uint8_t  status;
+  uint32_t frame_length;
+  uint32_t i;
+
+  frame_length = HOST_CdcRequest(frame, cmd, payload, length);
+  if(write(fd, frame, frame_length) != (ssize_t)frame_length)
+  {
+    return -1;
+  }
+  do
+  {
+    if(HOST_CdcReadByte(fd, &frame[0]) != 0)
+    {
+      return -1;
+    }
+  }
+  while(frame[0] != AUDIO_CDC_CMD_RESPONSE_SYNC);
+  for(i = 1; i < HOST_CDC_RESPONSE_HEADER; i++)
+  {
+    if(HOST_CdcReadByte(fd, &frame[i]) != 0)
+    {
+      return -1;
+    }
+  }
+  if(frame[3] > AUDIO_CDC_CMD_MAX_PAYLOAD)
+  {
+    return -1;
+  }
+  frame_length = HOST_CDC_RESPONSE_HEADER + frame[3] + 1U;
+  for(; i < frame_length; i++)
+  {
+    if(HOST_CdcReadByte(fd, &frame[i]) != 0)
+    {
+      return -1;
+    }
+  }
+  if(HOST_CdcParse(frame, frame_length, cmd, &status, response, response_length) != 0)
+  {
+    return -1;
+  }
+  return (status == AUDIO_CDC_CMD_STATUS_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  HOST_CdcGet32
+  *         reads a little endian 32 bits field of a payload
+  * @param  src: field
+  * @retval value
+  */
+uint32_t HOST_CdcGet32(const uint8_t* src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  HOST_CdcReadByte
+  *         reads a byte of the tty within HOST_CDC_TIMEOUT_MS
+  * @param  fd: file descriptor
+  * @param  byte: returned byte
+  * @retval 0 if a byte was read
+  */
+static int8_t HOST_CdcReadByte(int fd, uint8_t* byte)
+{
+  struct pollfd pfd;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+  if((poll(&pfd, 1, (int)HOST_CDC_TIMEOUT_MS) != 1) || (read(fd, byte, 1) != 1))
+  {
+    return -1;
+  }
+  return 0;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
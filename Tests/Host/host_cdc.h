@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file    host_cdc.h
+  * @brief   header file for the host_cdc.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HOST_CDC_H
+#define __HOST_CDC_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_cdc_command.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define HOST_CDC_REQUEST_HEADER         3U    /* sync, cmd, len */
+#define HOST_CDC_RESPONSE_HEADER        4U    /* sync, cmd, status, len */
+#define HOST_CDC_FRAME_SIZE             (HOST_CDC_RESPONSE_HEADER + AUDIO_CDC_CMD_MAX_PAYLOAD + 1U)
+#define HOST_CDC_TIMEOUT_MS             1000U /* response wait of a command */
+
+/* Exported functions ------------------------------------------------------- */
+int      HOST_CdcOpen(const char* path);
+void     HOST_CdcClose(int fd);
+uint32_t HOST_CdcRequest(uint8_t* frame, uint8_t cmd, const uint8_t* payload, uint8_t length);
+int8_t   HOST_CdcParse(const uint8_t* frame, uint32_t length, uint8_t cmd, uint8_t* status,
+                       uint8_t* payload, uint8_t* payload_length);
+int8_t   HOST_CdcCommand(int fd, uint8_t cmd, const uint8_t* payload, uint8_t length,
+                         uint8_t* response, uint8_t* response_length);
+uint32_t HOST_CdcGet32(const uint8_t* src);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __HOST_CDC_H */
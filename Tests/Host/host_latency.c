@@ -0,0 +1,220 @@
+/**
+  ******************************************************************************
+  * @file    host_latency.c
+  * @brief   Host analysis of the USE_AUDIO_LOOPBACK latency benchmark : the
+  *          host plays an impulse train and records it back, the round trip
+  *          of each impulse is the distance of its onset in the recording to
+  *          its place in the played stream. The min, average, max and the
+  *          jitter distribution are reported against the device part, read
+  *          with the LOOPBACK command
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "host_latency.h"
+#include "host_cdc.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t HOST_LatencyOnset(const uint8_t* recorded, uint32_t frames, uint32_t from,
+                                  const AUDIO_DescriptionTypeDef* audio_description);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  HOST_LatencyFrames
+  *         length of an impulse train, a period of silence before the first
+  *         impulse and after the last one
+  * @param  impulses: impulses count
+  * @param  period: frames between two impulses
+  * @retval frames count
+  */
+uint32_t HOST_LatencyFrames(uint32_t impulses, uint32_t period)
+{
+  return (impulses + 1U) * period;
+}
+
+/**
+  * @brief  HOST_LatencyImpulses
+  *         writes an impulse train : impulse k is the frame (k + 1) * period,
+  *         at HOST_LATENCY_LEVEL on every channel, the other frames are silent
+  * @param  data: HOST_LatencyFrames frames
+  * @param  impulses: impulses count
+  * @param  period: frames between two impulses
+  * @param  audio_description: format of the stream, 16 to 32 bits little endian
+  * @retval None
+  */
+void HOST_LatencyImpulses(uint8_t* data, uint32_t impulses, uint32_t period,
+                          const AUDIO_DescriptionTypeDef* audio_description)
+{
+  uint32_t frame_length = AUDIO_SAMPLE_LENGTH(audio_description);
+  uint32_t value = (uint32_t)HOST_LATENCY_LEVEL << (8U * (audio_description->audio_res - 2U));
+  uint8_t* sample;
+  uint32_t k;
+  uint8_t  channel;
+  uint8_t  b;
+
+  memset(data, 0, HOST_LatencyFrames(impulses, period) * frame_length);
+  for(k = 0; k < impulses; k++)
+  {
+    sample = &data[(k + 1U) * period * frame_length];
+    for(channel = 0; channel < audio_description->channels_count; channel++)
+    {
+      for(b = 0; b < audio_description->audio_res; b++)
+      {
+        *sample++ = (uint8_t)(value >> (8U * b));
+      }
+    }
+  }
+}
+
+/**
+  * @brief  HOST_LatencyAnalyze
+  *         finds the impulses in a recording. The first onset is the first
+  *         impulse, the others are placed from their distance to it, so the
+  *         round trip must stay below the period. An impulse lost in the
+  *         device or the host is not found and doesn't shift the others
+  * @param  recorded: recorded frames
+  * @param  frames: recorded frames count
+  * @param  impulses: impulses count of the played train
+  * @param  period: frames between two impulses
+  * @param  offset_us: start of the recording after the start of the playback
+  * @param  audio_description: format of the stream
+  * @param  result: returned round trip
+  * @retval 0 if an impulse was found
+  */
+int8_t HOST_LatencyAnalyze(const uint8_t* recorded, uint32_t frames, uint32_t impulses, uint32_t period,
+                           int32_t offset_us, const AUDIO_DescriptionTypeDef* audio_description,
+                           HOST_LatencyResultTypeDef* result)
+{
+  uint32_t first;
+  uint32_t onset;
+  uint32_t k;
+  uint32_t last_k;
+  uint32_t bin;
+  int64_t  latency;
+  int64_t  sum = 0;
+  uint8_t  pass;
+
+  memset(result, 0, sizeof(HOST_LatencyResultTypeDef));
+  result->impulses = impulses;
+  result->min_us = INT32_MAX;
+  result->max_us = INT32_MIN;
+  if((period == 0U) || (audio_description->frequence == 0U) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  first = HOST_LatencyOnset(recorded, frames, 0, audio_description);
+  if(first == UINT32_MAX)
+  {
+    return -1;
+  }
+
+  /* the jitter bins start at the min, known after the first pass */
+  for(pass = 0; pass < 2U; pass++)
+  {
+    last_k = UINT32_MAX;
+    for(onset = first; onset != UINT32_MAX;
+        onset = HOST_LatencyOnset(recorded, frames, onset + (period / 2U), audio_description))
+    {
+      k = (onset - first + (period / 2U)) / period;
+      if(k >= impulses)
+      {
+        break;
+      }
+      if(k == last_k)
+      {
+        /* a second onset in the same period, not an impulse */
+        continue;
+      }
+      last_k = k;
+      latency = (((int64_t)onset - ((int64_t)(k + 1U) * period)) * 1000000) / audio_description->frequence + offset_us;
+      if(pass == 0U)
+      {
+        result->found++;
+        sum += latency;
+        result->min_us = (latency < result->min_us) ? (int32_t)latency : result->min_us;
+        result->max_us = (latency > result->max_us) ? (int32_t)latency : result->max_us;
+      }
+      else
+      {
+        bin = (uint32_t)(latency - result->min_us) / HOST_LATENCY_HIST_BIN_US;
+        result->hist[(bin < HOST_LATENCY_HIST_BINS) ? bin : (HOST_LATENCY_HIST_BINS - 1U)]++;
+      }
+    }
+  }
+  result->avg_us = (int32_t)(sum / result->found);
+  return 0;
+}
+
+/**
+  * @brief  HOST_LatencyParseDevice
+  *         reads the device part from the LOOPBACK command response
+  * @param  payload: response payload
+  * @param  length: payload length
+  * @param  stats: returned measures, min_ms is UINT32_MAX before the first packet
+  * @retval 0 if the payload is a LOOPBACK response
+  */
+int8_t HOST_LatencyParseDevice(const uint8_t* payload, uint8_t length, AUDIO_LoopbackStatsTypeDef* stats)
+{
+  uint32_t i;
+
+  if(length != HOST_LATENCY_DEVICE_LENGTH)
+  {
+    return -1;
+  }
+  /* delay, count, min, max, dropped bytes then latency histogram */
+  stats->delay_ms = HOST_CdcGet32(&payload[0]);
+  stats->count    = HOST_CdcGet32(&payload[4]);
+  stats->min_ms   = (stats->count != 0U) ? HOST_CdcGet32(&payload[8]) : UINT32_MAX;
+  stats->max_ms   = HOST_CdcGet32(&payload[12]);
+  stats->dropped  = HOST_CdcGet32(&payload[16]);
+  for(i = 0; i < AUDIO_LOOPBACK_HIST_BINS; i++)
+  {
+    stats->hist[i] = HOST_CdcGet32(&payload[20U + (4U * i)]);
+  }
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  HOST_LatencyOnset
+  *         first frame from a position whose first channel crosses
+  *         HOST_LATENCY_THRESHOLD, on the 16 most significant bits
+  * @param  recorded: recorded frames
+  * @param  frames: recorded frames count
+  * @param  from: first frame to look at
+  * @param  audio_description: format of the stream
+  * @retval frame of the onset, UINT32_MAX if none
+  */
+static uint32_t HOST_LatencyOnset(const uint8_t* recorded, uint32_t frames, uint32_t from,
+                                  const AUDIO_DescriptionTypeDef* audio_description)
+{
+  const uint8_t* sample;
+  uint8_t  res = audio_description->audio_res;
+  uint32_t i;
+  int32_t  value;
+
+  for(i = from; i < frames; i++)
+  {
+    /* the 16 most significant bits of the little endian sample */
+    sample = &recorded[(i * AUDIO_SAMPLE_LENGTH(audio_description)) + res - 2U];
+    value = (int16_t)((uint16_t)sample[0] | ((uint16_t)sample[1] << 8));
+    if((value >= HOST_LATENCY_THRESHOLD) || (value <= -HOST_LATENCY_THRESHOLD))
+    {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    host_latency.h
+  * @brief   header file for the host_latency.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HOST_LATENCY_H
+#define __HOST_LATENCY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "audio_loopback.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define HOST_LATENCY_LEVEL              0x4000  /* impulse, half the 16 most significant bits full scale */
+#define HOST_LATENCY_THRESHOLD          0x2000  /* onset, a quarter of the full scale */
+#define HOST_LATENCY_HIST_BINS          16U     /* last bin has no upper bound */
+#define HOST_LATENCY_HIST_BIN_US        125U    /* a high speed microframe per bin */
+#define HOST_LATENCY_DEVICE_LENGTH      (20U + (4U * AUDIO_LOOPBACK_HIST_BINS)) /* LOOPBACK response */
+
+/* Exported types ------------------------------------------------------------*/
+/* round trip of an impulse train through the device, played by the host and
+   recorded back */
+typedef struct
+{
+  uint32_t impulses;                        /* played */
+  uint32_t found;                           /* found in the recording */
+  int32_t  min_us;
+  int32_t  max_us;
+  int32_t  avg_us;
+  uint32_t hist[HOST_LATENCY_HIST_BINS];    /* jitter, from min_us */
+}
+HOST_LatencyResultTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t HOST_LatencyFrames(uint32_t impulses, uint32_t period);
+void     HOST_LatencyImpulses(uint8_t* data, uint32_t impulses, uint32_t period,
+                              const AUDIO_DescriptionTypeDef* audio_description);
+int8_t   HOST_LatencyAnalyze(const uint8_t* recorded, uint32_t frames, uint32_t impulses, uint32_t period,
+                             int32_t offset_us, const AUDIO_DescriptionTypeDef* audio_description,
+                             HOST_LatencyResultTypeDef* result);
+int8_t   HOST_LatencyParseDevice(const uint8_t* payload, uint8_t length, AUDIO_LoopbackStatsTypeDef* stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __HOST_LATENCY_H */
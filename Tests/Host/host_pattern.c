@@ -0,0 +1,143 @@
+/**
+  ******************************************************************************
+  * @file    host_pattern.c
+  * @brief   Host verifier of the USE_AUDIO_MIC_PATTERN recording stream : the
+  *          recorded frames go one by one through the check of the played
+  *          pattern of audio_pattern.c, so the host and the device agree on
+  *          the sequence. Each change of its counts is an event, placed at
+  *          its recorded frame : lost frames, repeated frames and corrupted
+  *          ones. The device counts of the PATTERN command tell the frames
+  *          the implicit synchro skipped from the others
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "host_pattern.h"
+#include "host_cdc.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static void HOST_PatternEvent(HOST_PatternResultTypeDef* result, uint8_t kind, uint32_t frame, uint32_t count);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  HOST_PatternVerify
+  *         checks a recording against a pattern, from its first word. The
+  *         silence before it is skipped, as the first frame of the counter
+  * @param  recorded: recorded frames, little endian
+  * @param  frames: recorded frames count
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @param  audio_description: format of the recording
+  * @param  result: returned totals and events
+  * @retval 0 if the pattern was found
+  */
+int8_t HOST_PatternVerify(const uint8_t* recorded, uint32_t frames, uint8_t mode,
+                          const AUDIO_DescriptionTypeDef* audio_description, HOST_PatternResultTypeDef* result)
+{
+  AUDIO_BufferRegionTypeDef region;
+  AUDIO_PatternCheckTypeDef check;
+  uint32_t frame_length = AUDIO_SAMPLE_LENGTH(audio_description);
+  uint32_t i;
+
+  memset(result, 0, sizeof(HOST_PatternResultTypeDef));
+  result->frames = frames;
+  if((mode == AUDIO_PATTERN_OFF) || (AUDIO_PatternCheckSetMode(mode) != 0))
+  {
+    return -1;
+  }
+  AUDIO_PatternCheckGetStats(&result->check);
+  region.length[0] = frame_length;
+  region.length[1] = 0;
+  for(i = 0; i < frames; i++)
+  {
+    region.data[0] = (uint8_t*)&recorded[i * frame_length];
+    region.data[1] = region.data[0];
+    AUDIO_PatternCheckRegion(&region, frame_length, audio_description, (uint16_t)i);
+    AUDIO_PatternCheckGetStats(&check);
+    if(check.locked && !result->check.locked)
+    {
+      result->first_frame = i;
+    }
+    if(check.lost != result->check.lost)
+    {
+      HOST_PatternEvent(result, HOST_PATTERN_LOST, i, check.lost - result->check.lost);
+    }
+    if(check.repeated != result->check.repeated)
+    {
+      HOST_PatternEvent(result, HOST_PATTERN_REPEATED, i, check.repeated - result->check.repeated);
+    }
+    if(check.corrupted != result->check.corrupted)
+    {
+      HOST_PatternEvent(result, HOST_PATTERN_CORRUPTED, i, check.corrupted - result->check.corrupted);
+    }
+    result->check = check;
+  }
+  return result->check.locked ? 0 : -1;
+}
+
+/**
+  * @brief  HOST_PatternParseDevice
+  *         reads the device counts from the PATTERN command response
+  * @param  payload: response payload
+  * @param  length: payload length
+  * @param  stats: returned counts
+  * @retval 0 if the payload is a PATTERN response
+  */
+int8_t HOST_PatternParseDevice(const uint8_t* payload, uint8_t length, AUDIO_PatternStatsTypeDef* stats)
+{
+  if(length != HOST_PATTERN_DEVICE_LENGTH)
+  {
+    return -1;
+  }
+  /* mode, frames, sync packets, skipped frames, frames at last skip */
+  stats->mode            = payload[0];
+  stats->frames          = HOST_CdcGet32(&payload[1]);
+  stats->sync_packets    = HOST_CdcGet32(&payload[5]);
+  stats->sync_skipped    = HOST_CdcGet32(&payload[9]);
+  stats->sync_last_frame = HOST_CdcGet32(&payload[13]);
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  HOST_PatternEvent
+  *         adds an event, consecutive corrupted frames are one event
+  * @param  result: verifier result
+  * @param  kind: HOST_PATTERN_xxx
+  * @param  frame: recorded frame
+  * @param  count: frames of the event
+  * @retval None
+  */
+static void HOST_PatternEvent(HOST_PatternResultTypeDef* result, uint8_t kind, uint32_t frame, uint32_t count)
+{
+  HOST_PatternEventTypeDef* last;
+
+  if((kind == HOST_PATTERN_CORRUPTED) && (result->event_count != 0U) &&
+     (result->event_count <= HOST_PATTERN_MAX_EVENTS))
+  {
+    last = &result->events[result->event_count - 1U];
+    if((last->kind == kind) && ((last->frame + last->count) == frame))
+    {
+      last->count += count;
+      return;
+    }
+  }
+  if(result->event_count < HOST_PATTERN_MAX_EVENTS)
+  {
+    result->events[result->event_count].kind  = kind;
+    result->events[result->event_count].frame = frame;
+    result->events[result->event_count].count = count;
+  }
+  result->event_count++;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
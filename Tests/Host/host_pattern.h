@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    host_pattern.h
+  * @brief   header file for the host_pattern.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HOST_PATTERN_H
+#define __HOST_PATTERN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "audio_pattern.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define HOST_PATTERN_LOST               0U  /* frames missing from the stream */
+#define HOST_PATTERN_REPEATED           1U  /* frames sent again */
+#define HOST_PATTERN_CORRUPTED          2U  /* frames out of the sequence, inserted or damaged */
+#define HOST_PATTERN_MAX_EVENTS         64U /* events kept, the others are counted only */
+#define HOST_PATTERN_DEVICE_LENGTH      17U /* PATTERN response */
+
+/* Exported types ------------------------------------------------------------*/
+/* a discontinuity of the recorded frames */
+typedef struct
+{
+  uint8_t  kind;               /* HOST_PATTERN_xxx */
+  uint32_t frame;              /* recorded frame where it was found */
+  uint32_t count;              /* frames lost, repeated or corrupted */
+}
+HOST_PatternEventTypeDef;
+
+/* check of a recording of the dummy mic pattern */
+typedef struct
+{
+  AUDIO_PatternCheckTypeDef check;        /* totals, checked frame by frame : packets are frames */
+  uint32_t frames;                        /* recorded frames */
+  uint32_t first_frame;                   /* first pattern frame, after the silence */
+  uint32_t event_count;                   /* events found */
+  HOST_PatternEventTypeDef events[HOST_PATTERN_MAX_EVENTS];
+}
+HOST_PatternResultTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t HOST_PatternVerify(const uint8_t* recorded, uint32_t frames, uint8_t mode,
+                          const AUDIO_DescriptionTypeDef* audio_description, HOST_PatternResultTypeDef* result);
+int8_t HOST_PatternParseDevice(const uint8_t* payload, uint8_t length, AUDIO_PatternStatsTypeDef* stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __HOST_PATTERN_H */
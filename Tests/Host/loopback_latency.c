@@ -0,0 +1,273 @@
+/**
+  ******************************************************************************
+  * @file    loopback_latency.c
+  * @brief   Host tool of the USE_AUDIO_LOOPBACK latency benchmark, run by
+  *          loopback_latency.sh for each rate and host buffer size :
+  *            impulse  writes the impulse train the host plays
+  *            analyze  reports the round trip found in the recording, and
+  *                     the device part read with the LOOPBACK command
+  *            delay    sets the loopback delay and clears the measures
+  *          The streams are raw little endian PCM files
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_cdc.h"
+#include "host_latency.h"
+
+/* Private define ------------------------------------------------------------*/
+#define LOOPBACK_DEFAULT_FREQ       48000U
+#define LOOPBACK_DEFAULT_CHANNELS   2U
+#define LOOPBACK_DEFAULT_RES        2U
+#define LOOPBACK_DEFAULT_IMPULSES   40U
+#define LOOPBACK_DEFAULT_PERIOD_MS  250U    /* above the round trip with the host buffers */
+
+/* Private variables ---------------------------------------------------------*/
+static const char loopback_usage[] =
+  "usage: loopback_latency [-r rate] [-c channels] [-b bytes per sample] [-n impulses]\n"
+  "                        [-p period ms] [-o recording start offset us] [-t tty]\n"
+  "                        impulse <played.raw> | analyze <recorded.raw> | delay <ms>\n";
+
+/* Private function prototypes -----------------------------------------------*/
+static int LOOPBACK_Impulse(const char* path, uint32_t impulses, uint32_t period,
+                            const AUDIO_DescriptionTypeDef* audio_description);
+static int LOOPBACK_Analyze(const char* path, uint32_t impulses, uint32_t period, int32_t offset_us,
+                            const char* tty, const AUDIO_DescriptionTypeDef* audio_description);
+static int LOOPBACK_Device(const char* tty, const uint8_t* payload, uint8_t length,
+                           AUDIO_LoopbackStatsTypeDef* stats);
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  AUDIO_DescriptionTypeDef   desc;
+  AUDIO_LoopbackStatsTypeDef stats;
+  uint32_t impulses  = LOOPBACK_DEFAULT_IMPULSES;
+  uint32_t period_ms = LOOPBACK_DEFAULT_PERIOD_MS;
+  int32_t  offset_us = 0;
+  const char* tty = 0;
+  uint8_t  delay;
+  int opt;
+
+  memset(&desc, 0, sizeof(desc));
+  desc.frequence = LOOPBACK_DEFAULT_FREQ;
+  desc.channels_count = LOOPBACK_DEFAULT_CHANNELS;
+  desc.audio_res = LOOPBACK_DEFAULT_RES;
+  while((opt = getopt(argc, argv, "r:c:b:n:p:o:t:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'r': desc.frequence = (uint32_t)strtoul(optarg, 0, 0); break;
+      case 'c': desc.channels_count = (uint8_t)strtoul(optarg, 0, 0); break;
+      case 'b': desc.audio_res = (uint8_t)strtoul(optarg, 0, 0); break;
+      case 'n': impulses = (uint32_t)strtoul(optarg, 0, 0); break;
+      case 'p': period_ms = (uint32_t)strtoul(optarg, 0, 0); break;
+      case 'o': offset_us = (int32_t)strtol(optarg, 0, 0); break;
+      case 't': tty = optarg; break;
+      default:
+        fputs(loopback_usage, stderr);
+        return 2;
+    }
+  }
+  if(((argc - optind) != 2) || (desc.frequence < 1000U) || (desc.channels_count == 0U) ||
+     (desc.audio_res < 2U) || (desc.audio_res > 4U) || (impulses == 0U) || (period_ms == 0U))
+  {
+    fputs(loopback_usage, stderr);
+    return 2;
+  }
+
+  if(strcmp(argv[optind], "impulse") == 0)
+  {
+    return LOOPBACK_Impulse(argv[optind + 1], impulses, (desc.frequence * period_ms) / 1000U, &desc);
+  }
+  if(strcmp(argv[optind], "analyze") == 0)
+  {
+    return LOOPBACK_Analyze(argv[optind + 1], impulses, (desc.frequence * period_ms) / 1000U, offset_us, tty, &desc);
+  }
+  if((strcmp(argv[optind], "delay") == 0) && (tty != 0))
+  {
+    delay = (uint8_t)strtoul(argv[optind + 1], 0, 0);
+    if(LOOPBACK_Device(tty, &delay, 1U, &stats) != 0)
+    {
+      return 1;
+    }
+    printf("delay %u ms\n", stats.delay_ms);
+    return 0;
+  }
+  fputs(loopback_usage, stderr);
+  return 2;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  LOOPBACK_Impulse
+  *         writes the impulse train to a file
+  * @param  path: file path
+  * @param  impulses: impulses count
+  * @param  period: frames between two impulses
+  * @param  audio_description: format of the stream
+  * @retval exit status
+  */
+static int LOOPBACK_Impulse(const char* path, uint32_t impulses, uint32_t period,
+                            const AUDIO_DescriptionTypeDef* audio_description)
+{
+  size_t   length = (size_t)HOST_LatencyFrames(impulses, period) * AUDIO_SAMPLE_LENGTH(audio_description);
+  uint8_t* data = malloc(length);
+  FILE*    file;
+  int      ret = 1;
+
+  if(data == 0)
+  {
+    return 1;
+  }
+  HOST_LatencyImpulses(data, impulses, period, audio_description);
+  file = fopen(path, "wb");
+  if(file != 0)
+  {
+    ret = (fwrite(data, 1, length, file) == length) ? 0 : 1;
+    ret |= (fclose(file) == 0) ? 0 : 1;
+  }
+  if(ret != 0)
+  {
+    perror(path);
+  }
+  free(data);
+  return ret;
+}
+
+/**
+  * @brief  LOOPBACK_Analyze
+  *         prints the round trip of the impulses of a recording, and with a
+  *         tty the device part and the host part, the host buffers and the
+  *         USB scheduling
+  * @param  path: recording path
+  * @param  impulses: impulses count of the played train
+  * @param  period: frames between two impulses
+  * @param  offset_us: start of the recording after the start of the playback
+  * @param  tty: virtual COM port, 0 if none
+  * @param  audio_description: format of the stream
+  * @retval exit status
+  */
+static int LOOPBACK_Analyze(const char* path, uint32_t impulses, uint32_t period, int32_t offset_us,
+                            const char* tty, const AUDIO_DescriptionTypeDef* audio_description)
+{
+  AUDIO_LoopbackStatsTypeDef stats;
+  HOST_LatencyResultTypeDef  result;
+  uint8_t* data;
+  FILE*    file;
+  long     length;
+  uint64_t device_sum = 0;
+  uint32_t device_avg_us;
+  uint32_t i;
+  int      ret = 1;
+
+  file = fopen(path, "rb");
+  if((file == 0) || (fseek(file, 0, SEEK_END) != 0) || ((length = ftell(file)) <= 0) || (fseek(file, 0, SEEK_SET) != 0))
+  {
+    perror(path);
+    if(file != 0)
+    {
+      fclose(file);
+    }
+    return 1;
+  }
+  data = malloc((size_t)length);
+  if((data != 0) && (fread(data, 1, (size_t)length, file) == (size_t)length))
+  {
+    ret = 0;
+  }
+  fclose(file);
+  if(ret != 0)
+  {
+    perror(path);
+    free(data);
+    return 1;
+  }
+
+  if(HOST_LatencyAnalyze(data, (uint32_t)((size_t)length / AUDIO_SAMPLE_LENGTH(audio_description)), impulses, period,
+                         offset_us, audio_description, &result) != 0)
+  {
+    fprintf(stderr, "%s: no impulse\n", path);
+    free(data);
+    return 1;
+  }
+  free(data);
+  printf("%u Hz : %u of %u impulses, round trip min %d avg %d max %d us\n", audio_description->frequence,
+         result.found, result.impulses, result.min_us, result.avg_us, result.max_us);
+  printf("jitter from min, %u us bins :", HOST_LATENCY_HIST_BIN_US);
+  for(i = 0; i < HOST_LATENCY_HIST_BINS; i++)
+  {
+    printf(" %u", result.hist[i]);
+  }
+  printf("\n");
+
+  if(tty != 0)
+  {
+    if(LOOPBACK_Device(tty, 0, 0, &stats) != 0)
+    {
+      return 1;
+    }
+    if(stats.count == 0U)
+    {
+      printf("device : no packet measured\n");
+      return 0;
+    }
+    /* the device bins are ms from the configured delay, the last one counted at its lower bound */
+    for(i = 0; i < AUDIO_LOOPBACK_HIST_BINS; i++)
+    {
+      device_sum += (uint64_t)stats.hist[i] * (stats.delay_ms + i) * 1000U;
+    }
+    device_avg_us = (uint32_t)(device_sum / stats.count);
+    printf("device : delay %u ms, %u packets, min %u avg %u max %u ms, %u bytes dropped\n", stats.delay_ms,
+           stats.count, stats.min_ms, device_avg_us / 1000U, stats.max_ms, stats.dropped);
+    printf("host and bus : avg %d us\n", result.avg_us - (int32_t)device_avg_us);
+  }
+  return 0;
+}
+
+/**
+  * @brief  LOOPBACK_Device
+  *         runs the LOOPBACK command
+  * @param  tty: virtual COM port
+  * @param  payload: delay to set, 0 to read the measures only
+  * @param  length: payload length
+  * @param  stats: returned device measures
+  * @retval 0 if no error
+  */
+static int LOOPBACK_Device(const char* tty, const uint8_t* payload, uint8_t length,
+                           AUDIO_LoopbackStatsTypeDef* stats)
+{
+  uint8_t response[AUDIO_CDC_CMD_MAX_PAYLOAD];
+  uint8_t response_length;
+  int8_t  ret;
+  int     fd;
+
+  fd = HOST_CdcOpen(tty);
+  if(fd < 0)
+  {
+    perror(tty);
+    return -1;
+  }
+  ret = HOST_CdcCommand(fd, AUDIO_CDC_CMD_LOOPBACK, payload, length, response, &response_length);
+  HOST_CdcClose(fd);
+  if((ret != 0) || (HOST_LatencyParseDevice(response, response_length, stats) != 0))
+  {
+    fprintf(stderr, "%s: no LOOPBACK response, is the firmware built with USE_AUDIO_LOOPBACK ?\n", tty);
+    return -1;
+  }
+  return 0;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Round trip latency of a USE_AUDIO_LOOPBACK firmware, for each rate and host
+# buffer size : the loopback delay is set with the LOOPBACK command, an impulse
+# train is played with aplay while arecord records the device back, and
+# loopback_latency reports the round trip, its jitter and the device part.
+#
+#   loopback_latency.sh <alsa device> <tty> [delay ms]
+#
+# RATES, BUFFERS (frames), CHANNELS, RES (bytes), IMPULSES and PERIOD_MS set
+# the runs. The offset of the recording start is taken from the start of the
+# two processes : the jitter is exact, the round trip carries the difference
+# of their start up times.
+
+set -e
+
+DEV=${1:?alsa device of the board, e.g. hw:CARD=Audio}
+TTY=${2:?virtual COM port of the board, e.g. /dev/ttyACM0}
+DELAY=${3:-0}
+RATES=${RATES:-"48000 96000"}
+BUFFERS=${BUFFERS:-"256 1024 4096"}
+CHANNELS=${CHANNELS:-2}
+RES=${RES:-2}
+IMPULSES=${IMPULSES:-40}
+PERIOD_MS=${PERIOD_MS:-250}
+
+TOOL=$(dirname "$0")/build/loopback_latency
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+case $RES in
+  2) FORMAT=S16_LE ;;
+  3) FORMAT=S24_3LE ;;
+  4) FORMAT=S32_LE ;;
+  *) echo "RES is 2, 3 or 4 bytes" >&2; exit 2 ;;
+esac
+# one period more than the train, the last impulse comes back
+SECONDS_REC=$(( (IMPULSES + 2) * PERIOD_MS / 1000 + 1 ))
+
+for RATE in $RATES; do
+  OPTS="-r $RATE -c $CHANNELS -b $RES -n $IMPULSES -p $PERIOD_MS"
+  "$TOOL" $OPTS impulse "$WORK/played.raw"
+  for BUFFER in $BUFFERS; do
+    echo "== $RATE Hz, $BUFFER frames host buffer, $DELAY ms loopback delay"
+    "$TOOL" -t "$TTY" delay "$DELAY"
+    REC_START=$(date +%s%N)
+    arecord -q -D "$DEV" -t raw -f $FORMAT -c "$CHANNELS" -r "$RATE" --buffer-size="$BUFFER" \
+            -d "$SECONDS_REC" "$WORK/recorded.raw" &
+    PLAY_START=$(date +%s%N)
+    aplay -q -D "$DEV" -t raw -f $FORMAT -c "$CHANNELS" -r "$RATE" --buffer-size="$BUFFER" "$WORK/played.raw"
+    wait
+    "$TOOL" $OPTS -o $(( (REC_START - PLAY_START) / 1000 )) -t "$TTY" analyze "$WORK/recorded.raw"
+  done
+done
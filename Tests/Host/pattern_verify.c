@@ -0,0 +1,214 @@
+/**
+  ******************************************************************************
+  * @file    pattern_verify.c
+  * @brief   Host tool of the USE_AUDIO_MIC_PATTERN recording check, without a
+  *          USB analyzer :
+  *            restart  restarts the dummy mic pattern with the PATTERN command
+  *            check    verifies a recording of the board, e.g. made with
+  *                     arecord -t raw, and lists the lost, repeated and
+  *                     corrupted frames with their time. With the tty, the
+  *                     frames the implicit synchro skipped are read from the
+  *                     board and told from the glitches
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "host_cdc.h"
+#include "host_pattern.h"
+
+/* Private define ------------------------------------------------------------*/
+#define PATTERN_DEFAULT_FREQ        48000U
+#define PATTERN_DEFAULT_CHANNELS    2U
+#define PATTERN_DEFAULT_RES         2U
+
+/* Private variables ---------------------------------------------------------*/
+static const char pattern_usage[] =
+  "usage: pattern_verify [-r rate] [-c channels] [-b bytes per sample] [-m mode] [-t tty]\n"
+  "                      restart | check <recorded.raw>\n"
+  "       mode 1 counter, 2 PRBS\n";
+static const char* const pattern_events[] = { "lost", "repeated", "corrupted" };
+
+/* Private function prototypes -----------------------------------------------*/
+static int PATTERN_Check(const char* path, uint8_t mode, const char* tty,
+                         const AUDIO_DescriptionTypeDef* audio_description);
+static int PATTERN_Device(const char* tty, const uint8_t* payload, uint8_t length, AUDIO_PatternStatsTypeDef* stats);
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  AUDIO_DescriptionTypeDef  desc;
+  AUDIO_PatternStatsTypeDef stats;
+  uint8_t mode = AUDIO_PATTERN_DEFAULT_MODE;
+  const char* tty = 0;
+  int opt;
+
+  memset(&desc, 0, sizeof(desc));
+  desc.frequence = PATTERN_DEFAULT_FREQ;
+  desc.channels_count = PATTERN_DEFAULT_CHANNELS;
+  desc.audio_res = PATTERN_DEFAULT_RES;
+  while((opt = getopt(argc, argv, "r:c:b:m:t:")) != -1)
+  {
+    switch(opt)
+    {
+      case 'r': desc.frequence = (uint32_t)strtoul(optarg, 0, 0); break;
+      case 'c': desc.channels_count = (uint8_t)strtoul(optarg, 0, 0); break;
+      case 'b': desc.audio_res = (uint8_t)strtoul(optarg, 0, 0); break;
+      case 'm': mode = (uint8_t)strtoul(optarg, 0, 0); break;
+      case 't': tty = optarg; break;
+      default:
+        fputs(pattern_usage, stderr);
+        return 2;
+    }
+  }
+  if((optind >= argc) || (desc.frequence == 0U) || (desc.channels_count == 0U) ||
+     (desc.audio_res < 2U) || (desc.audio_res > 4U) || (mode == AUDIO_PATTERN_OFF) || (mode >= AUDIO_PATTERN_MODE_COUNT))
+  {
+    fputs(pattern_usage, stderr);
+    return 2;
+  }
+
+  if((strcmp(argv[optind], "restart") == 0) && ((argc - optind) == 1) && (tty != 0))
+  {
+    if(PATTERN_Device(tty, &mode, 1U, &stats) != 0)
+    {
+      return 1;
+    }
+    printf("pattern %u restarted\n", stats.mode);
+    return 0;
+  }
+  if((strcmp(argv[optind], "check") == 0) && ((argc - optind) == 2))
+  {
+    return PATTERN_Check(argv[optind + 1], mode, tty, &desc);
+  }
+  fputs(pattern_usage, stderr);
+  return 2;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  PATTERN_Check
+  *         prints the check of a recording, and with a tty the device counts
+  * @param  path: recording path
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @param  tty: virtual COM port, 0 if none
+  * @param  audio_description: format of the recording
+  * @retval exit status, 1 when the recording has errors
+  */
+static int PATTERN_Check(const char* path, uint8_t mode, const char* tty,
+                         const AUDIO_DescriptionTypeDef* audio_description)
+{
+  static HOST_PatternResultTypeDef result;
+  AUDIO_PatternStatsTypeDef stats;
+  uint8_t* data;
+  FILE*    file;
+  long     length;
+  uint32_t glitches;
+  uint32_t i;
+  int      ret = 1;
+
+  file = fopen(path, "rb");
+  if((file == 0) || (fseek(file, 0, SEEK_END) != 0) || ((length = ftell(file)) <= 0) || (fseek(file, 0, SEEK_SET) != 0))
+  {
+    perror(path);
+    if(file != 0)
+    {
+      fclose(file);
+    }
+    return 1;
+  }
+  data = malloc((size_t)length);
+  if((data != 0) && (fread(data, 1, (size_t)length, file) == (size_t)length))
+  {
+    ret = 0;
+  }
+  fclose(file);
+  if(ret != 0)
+  {
+    perror(path);
+    free(data);
+    return 1;
+  }
+
+  ret = HOST_PatternVerify(data, (uint32_t)((size_t)length / AUDIO_SAMPLE_LENGTH(audio_description)), mode,
+                           audio_description, &result);
+  free(data);
+  if(ret != 0)
+  {
+    fprintf(stderr, "%s: no pattern\n", path);
+    return 1;
+  }
+  printf("%u frames, pattern from frame %u : %u lost, %u repeated, %u corrupted, %u bit errors, %u resyncs\n",
+         result.frames, result.first_frame, result.check.lost, result.check.repeated, result.check.corrupted,
+         result.check.bit_errors, result.check.resyncs);
+  for(i = 0; (i < result.event_count) && (i < HOST_PATTERN_MAX_EVENTS); i++)
+  {
+    printf("  %10.3f ms frame %9u : %u %s\n", (double)result.events[i].frame * 1000.0 / audio_description->frequence,
+           result.events[i].frame, result.events[i].count, pattern_events[result.events[i].kind]);
+  }
+  if(result.event_count > HOST_PATTERN_MAX_EVENTS)
+  {
+    printf("  %u more events\n", result.event_count - HOST_PATTERN_MAX_EVENTS);
+  }
+  glitches = result.check.lost + result.check.repeated + result.check.corrupted;
+
+  if(tty != 0)
+  {
+    if(PATTERN_Device(tty, 0, 0, &stats) != 0)
+    {
+      return 1;
+    }
+    printf("device : %u frames since the restart, %u packets resized by the implicit synchro, %u frames skipped\n",
+           stats.frames, stats.sync_packets, stats.sync_skipped);
+    /* the skips are counted since the restart, the recording may have missed some */
+    glitches -= (result.check.lost > stats.sync_skipped) ? stats.sync_skipped : result.check.lost;
+    printf("not from the implicit synchro : %u frames\n", glitches);
+  }
+  return (glitches != 0U) ? 1 : 0;
+}
+
+/**
+  * @brief  PATTERN_Device
+  *         runs the PATTERN command
+  * @param  tty: virtual COM port
+  * @param  payload: mode to restart, 0 to read the counts only
+  * @param  length: payload length
+  * @param  stats: returned device counts
+  * @retval 0 if no error
+  */
+static int PATTERN_Device(const char* tty, const uint8_t* payload, uint8_t length, AUDIO_PatternStatsTypeDef* stats)
+{
+  uint8_t response[AUDIO_CDC_CMD_MAX_PAYLOAD];
+  uint8_t response_length;
+  int8_t  ret;
+  int     fd;
+
+  fd = HOST_CdcOpen(tty);
+  if(fd < 0)
+  {
+    perror(tty);
+    return -1;
+  }
+  ret = HOST_CdcCommand(fd, AUDIO_CDC_CMD_PATTERN, payload, length, response, &response_length);
+  HOST_CdcClose(fd);
+  if((ret != 0) || (HOST_PatternParseDevice(response, response_length, stats) != 0))
+  {
+    fprintf(stderr, "%s: no PATTERN response, is the firmware built with USE_AUDIO_MIC_PATTERN ?\n", tty);
+    return -1;
+  }
+  return 0;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    cmsis_compiler.h
+  * @brief   Host stand-in of the CMSIS compiler header, for the ring code
+  *          and the node kernels : the Cortex-M saturating intrinsics are
+  *          written in C with the results of the instructions, the unaligned
+  *          accesses are little endian byte copies
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CMSIS_COMPILER_H
+#define __CMSIS_COMPILER_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+
+/* Exported macros -----------------------------------------------------------*/
+#define __STATIC_INLINE      static inline
+#define __STATIC_FORCEINLINE __attribute__((always_inline)) static inline
+#define __PACKED             __attribute__((packed))
+#define __DMB()              __sync_synchronize()
+#define __disable_irq()
+#define __enable_irq()
+
+/* Exported functions ------------------------------------------------------- */
+__STATIC_INLINE uint32_t __get_PRIMASK(void)
+{
+  return 0;
+}
+
+__STATIC_INLINE void __set_PRIMASK(uint32_t primask)
+{
+  (void)primask;
+}
+
+/* SSAT : value saturated to a signed sat bits range */
+__STATIC_INLINE int32_t __SSAT(int32_t value, uint32_t sat)
+{
+  const int32_t max = (int32_t)((1UL << (sat - 1U)) - 1U);
+
+  return (value > max) ? max : ((value < (-max - 1)) ? (-max - 1) : value);
+}
+
+/* QADD : saturated 32 bits add */
+__STATIC_INLINE int32_t __QADD(int32_t op1, int32_t op2)
+{
+  int64_t sum = (int64_t)op1 + op2;
+
+  return (sum > INT32_MAX) ? INT32_MAX : ((sum < INT32_MIN) ? INT32_MIN : (int32_t)sum);
+}
+
+/* QADD16 : two saturated 16 bits adds, one per halfword */
+__STATIC_INLINE uint32_t __QADD16(uint32_t op1, uint32_t op2)
+{
+  int32_t lo = __SSAT((int32_t)(int16_t)op1 + (int16_t)op2, 16);
+  int32_t hi = __SSAT((int32_t)(int16_t)(op1 >> 16) + (int16_t)(op2 >> 16), 16);
+
+  return ((uint32_t)hi << 16) | ((uint32_t)lo & 0xFFFFU);
+}
+
+/* unaligned 32 bits accesses, the host is little endian as the Cortex-M7 */
+__STATIC_INLINE uint32_t __UNALIGNED_UINT32_READ(const void* addr)
+{
+  uint32_t value;
+
+  memcpy(&value, addr, sizeof(value));
+  return value;
+}
+
+__STATIC_INLINE void __UNALIGNED_UINT32_WRITE(void* addr, uint32_t value)
+{
+  memcpy(addr, &value, sizeof(value));
+}
+
+#endif /* __CMSIS_COMPILER_H */
@@ -0,0 +1,38 @@
+/**
+  ******************************************************************************
+  * @file    stm32h7xx_hal.h
+  * @brief   Host stand-in of the HAL header, for the App code which only
+  *          reads the ms tick. The test gives HAL_GetTick, the time it
+  *          simulates
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32H7xx_HAL_H
+#define __STM32H7xx_HAL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "cmsis_compiler.h"
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t HAL_GetTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __STM32H7xx_HAL_H */
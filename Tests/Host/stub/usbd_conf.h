@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    usbd_conf.h
+  * @brief   Host stand-in of the USB device library configuration, the ring,
+  *          scheduler, synchro and resampler code only needs the copy
+  *          routines which default to the C library without USE_AUDIO_FAST_COPY.
+  *          The node kernels include the class headers, which need the sizes
+  *          and the placement attributes below, the memories are not placed.
+  *          The HAL is the ms tick only, as the benchmark modes read it
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_CONF__H__
+#define __USBD_CONF__H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "cmsis_compiler.h"
+#include "stm32h7xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define __IO                        volatile
+#define USBD_MAX_NUM_INTERFACES     4U
+#define USBD_MAX_NUM_CONFIGURATION  1U
+#define USBD_MAX_STR_DESC_SIZ       512U
+#define USBD_DEBUG_LEVEL            0U
+#define USBD_SELF_POWERED           1U
+
+/* Exported macros -----------------------------------------------------------*/
+#define USBD_ITCM_FUNC
+#define USBD_DTCM_BSS
+#define USBD_D2_BSS
+#define USBD_DEBUG_BSS
+#define USBD_malloc                 malloc
+#define USBD_free                   free
+#define USBD_memset                 memset
+#define USBD_memcpy                 memcpy
+#define USBD_UsrLog(...)
+#define USBD_ErrLog(...)
+#define USBD_DbgLog(...)
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __USBD_CONF__H__ */
@@ -0,0 +1,549 @@
+/**
+  ******************************************************************************
+  * @file    test_audio_kernels.c
+  * @brief   Host test of the node kernels : the PCM gain kernels, the mixer
+  *          node and the recording resampler are built from USB_DEVICE/App
+  *          and run on the pseudo random stream of audio_bench.c. Each output
+  *          is checked against a reference computed here in double or plain
+  *          integer arithmetic, then its CRC-32 against a golden vector, so
+  *          a change of any output bit is reported. Run with --golden to
+  *          print the CRCs, the resampler ones are the golden CRCs of the
+  *          on-target BENCH command
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "audio_node.h"
+#include "audio_gain.h"
+#include "audio_pcm.h"
+#include "audio_pcm_kernels.h"
+#include "audio_mixer_node.h"
+#include "audio_resampler.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_MAX_CHANNELS           6U
+#define TEST_FRAMES                 48U     /* one ms at 48 kHz */
+#define TEST_RING_SIZE              4096U   /* bytes, a power of two above two bench packets */
+#define TEST_RING_MARGIN            256U
+#define TEST_RES_COUNT              3U      /* 2, 3 and 4 bytes samples */
+#define TEST_CHANNEL_COUNTS         { 1U, 2U, TEST_MAX_CHANNELS } /* mono, stereo and the generic kernels */
+#define TEST_CHANNEL_COUNT_COUNT    3U
+#define TEST_MIX_VOLUME_DB_256      (-6 * 256)
+#define TEST_RESAMPLER_FREQS        { 44100U, 48000U }
+#define TEST_RESAMPLER_FREQ_COUNT   2U
+#define TEST_RESAMPLER_DELAY        3U      /* frames, the history is filled before the first input frame */
+
+#define TEST_CHECK(cond, ...)  do { if(!(cond)) { printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+                                                  printf(__VA_ARGS__); printf("\n"); test_failures++; } } while(0)
+
+/* Private variables ---------------------------------------------------------*/
+/* golden CRC-32 of the outputs, refreshed with --golden once a change of the
+   kernels is checked against the references */
+static const uint32_t test_gain_golden[TEST_RES_COUNT][TEST_CHANNEL_COUNT_COUNT] =
+{
+  { 0x30DCEA7DU, 0xA778F1C6U, 0x154CF653U },   /* 16 bits : mono, stereo, 6 channels */
+  { 0xBBA7B40AU, 0x521C392AU, 0x18F63236U },   /* 24 bits */
+  { 0x41C2543DU, 0x57444F07U, 0xD1F239F0U },   /* 32 bits */
+};
+static const uint32_t test_mix_golden[TEST_RES_COUNT] =
+{
+  0xDA5545AEU, 0xC6909F28U, 0xFBC010A1U        /* speaker slots of 16, 24 and 32 bits */
+};
+/* the BENCH RESAMPLER output : 100 ppm fast on one ms of stereo */
+static const uint32_t test_resampler_golden[2][TEST_RESAMPLER_FREQ_COUNT] =
+{
+  { 0xB9D4AD93U, 0x75295FBDU },                /* 16 bits : 44.1 kHz, 48 kHz */
+  { 0xE1FD5289U, 0x61671491U },                /* 24 bits */
+};
+
+static int      test_failures;
+static uint8_t  test_golden;                   /* --golden : print the CRCs, don't compare them */
+static uint8_t  test_ring[TEST_RING_SIZE + TEST_RING_MARGIN];
+static uint8_t  test_in[TEST_FRAMES * 2U * TEST_MAX_CHANNELS * 4U];
+static uint8_t  test_out[TEST_FRAMES * 2U * TEST_MAX_CHANNELS * 4U];
+static uint8_t  test_half[TEST_FRAMES * 2U * 4U];
+/* node handles are 32 bits, the target is linked non PIE so its statics are below 4 GB */
+static AUDIO_Mixer_NodeTypeDef   test_mixer;
+static AUDIO_DescriptionTypeDef  test_mix_desc;
+static AUDIO_DescriptionTypeDef  test_speaker_desc;
+static AUDIO_ResamplerTypeDef    test_resampler;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     TEST_RingInit(AUDIO_BufferTypeDef* buf);
+static void     TEST_Fill(uint8_t* data, uint32_t samples, uint8_t res);
+static int32_t  TEST_Load(const uint8_t* data, uint8_t res);
+static int32_t  TEST_Saturate(int64_t value, uint8_t bits);
+static uint32_t TEST_Crc(const uint8_t* data, uint32_t length);
+static void     TEST_Golden(const char* name, uint32_t crc, uint32_t golden);
+static void     TEST_Gain(void);
+static void     TEST_Mix(void);
+static void     TEST_Resampler(void);
+static uint32_t TEST_ResamplerCheck(AUDIO_BufferTypeDef* buf, uint32_t step, uint32_t frames, uint8_t res);
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  test_golden = ((argc > 1) && (strcmp(argv[1], "--golden") == 0)) ? 1U : 0U;
+  TEST_Gain();
+  TEST_Mix();
+  TEST_Resampler();
+  if(test_golden)
+  {
+    return 0;
+  }
+  printf("%s : %d failure(s)\n", (test_failures == 0) ? "PASS" : "FAIL", test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
+
+/**
+  * @brief  AUDIO_GainFromDb256
+  *         host stand-in of audio_gain.c, whose table comes with the SAI
+  *         speaker headers. The mixer keeps the gain it is given and the
+  *         reference reads it back, so the table itself is not under test
+  * @param  volume_db_256: volume in dB 8.8
+  * @retval Q1.30 gain
+  */
+int32_t AUDIO_GainFromDb256(int volume_db_256)
+{
+  return (int32_t)lround(pow(10.0, (double)volume_db_256 / (256.0 * 20.0)) * (double)AUDIO_GAIN_UNITY);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  TEST_RingInit
+  *         empty ring of TEST_RING_SIZE bytes
+  * @param  buf: audio buffer
+  * @retval None
+  */
+static void TEST_RingInit(AUDIO_BufferTypeDef* buf)
+{
+  memset(buf, 0, sizeof(AUDIO_BufferTypeDef));
+  memset(test_ring, 0, sizeof(test_ring));
+  buf->data = test_ring;
+  buf->size = TEST_RING_SIZE;
+  buf->mask = TEST_RING_SIZE - 1U;
+  buf->margin = TEST_RING_MARGIN;
+  AUDIO_BufferReset(buf);
+}
+
+/**
+  * @brief  TEST_Fill
+  *         pseudo random samples up to full scale, the AUDIO_BenchFill
+  *         sequence so the CRCs are those of the target bench
+  * @param  data: samples
+  * @param  samples: samples count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+static void TEST_Fill(uint8_t* data, uint32_t samples, uint8_t res)
+{
+  uint32_t seed = 0x12345678U;
+  uint32_t i;
+  uint8_t  b;
+
+  for(i = 0; i < samples; i++)
+  {
+    seed = seed * 1664525U + 1013904223U;
+    for(b = 0; b < res; b++)
+    {
+      *data++ = (uint8_t)(seed >> (8U * (4U - res + b)));
+    }
+  }
+}
+
+/**
+  * @brief  TEST_Load
+  *         little endian signed sample
+  * @param  data: sample
+  * @param  res: bytes per sample
+  * @retval value
+  */
+static int32_t TEST_Load(const uint8_t* data, uint8_t res)
+{
+  uint32_t value = 0;
+  uint8_t  b;
+
+  for(b = 0; b < res; b++)
+  {
+    value |= (uint32_t)data[b] << (8U * (4U - res + b));
+  }
+  return (int32_t)value >> (8U * (4U - res));
+}
+
+/**
+  * @brief  TEST_Saturate
+  *         value limited to a signed range
+  * @param  value: value
+  * @param  bits: bits of the range
+  * @retval saturated value
+  */
+static int32_t TEST_Saturate(int64_t value, uint8_t bits)
+{
+  const int64_t max = ((int64_t)1 << (bits - 1U)) - 1;
+
+  return (int32_t)((value > max) ? max : ((value < (-max - 1)) ? (-max - 1) : value));
+}
+
+/**
+  * @brief  TEST_Crc
+  *         CRC-32 of zlib / Ethernet, the AUDIO_BenchCrc one
+  * @param  data: bytes
+  * @param  length: bytes count
+  * @retval CRC
+  */
+static uint32_t TEST_Crc(const uint8_t* data, uint32_t length)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+  uint32_t i;
+  uint8_t  bit;
+
+  for(i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for(bit = 0; bit < 8U; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
+  }
+  return ~crc;
+}
+
+/**
+  * @brief  TEST_Golden
+  *         compares a CRC with its golden vector, or prints it with --golden
+  * @param  name: output name
+  * @param  crc: CRC of the output
+  * @param  golden: golden CRC
+  * @retval None
+  */
+static void TEST_Golden(const char* name, uint32_t crc, uint32_t golden)
+{
+  if(test_golden)
+  {
+    printf("%-24s 0x%08XU\n", name, crc);
+    return;
+  }
+  TEST_CHECK(crc == golden, "%s CRC 0x%08X, golden 0x%08X", name, crc, golden);
+}
+
+/**
+  * @brief  TEST_Gain
+  *         each gain kernel ramps one channel down, holds one above unity
+  *         so full scale samples saturate, and the others at fixed gains.
+  *         The 16 bits kernels take the gain on 14 fractional bits, the
+  *         others on 30 , out of place and in place give the same output
+  * @param  None
+  * @retval None
+  */
+static void TEST_Gain(void)
+{
+  static const uint8_t counts[TEST_CHANNEL_COUNT_COUNT] = TEST_CHANNEL_COUNTS;
+  const AUDIO_PcmKernelsTypeDef* kernels;
+  int32_t  gain[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  int32_t  step[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  uint32_t samples;
+  uint32_t errors;
+  uint32_t i;
+  double   g;
+  double   tolerance;
+  int32_t  expected;
+  int32_t  value;
+  char     name[32];
+  uint8_t  res;
+  uint8_t  channels;
+  uint8_t  ch;
+  uint8_t  c;
+
+  printf("gain kernels\n");
+  for(res = 2U; res <= 4U; res++)
+  {
+    /* one LSB of truncation, two with the 14 bits gain */
+    tolerance = (res == 2U) ? 2.0 : 1.0;
+    for(c = 0; c < TEST_CHANNEL_COUNT_COUNT; c++)
+    {
+      channels = counts[c];
+      samples = TEST_FRAMES * channels;
+      kernels = AUDIO_PcmKernelsSelect(res, channels);
+      TEST_CHECK(kernels != 0, "no kernels for %u bytes, %u channels", res, channels);
+      if(kernels == 0)
+      {
+        continue;
+      }
+      for(ch = 0; ch < channels; ch++)
+      {
+        gain[ch] = (int32_t)(AUDIO_GAIN_UNITY / 4) * (ch + 1);
+        step[ch] = 0;
+      }
+      /* unity down to a half, and +5 dB */
+      gain[0] = AUDIO_GAIN_UNITY;
+      step[0] = -(int32_t)(AUDIO_GAIN_UNITY / 2 / TEST_FRAMES);
+      if(channels > 1U)
+      {
+        gain[1] = (int32_t)(1.778 * AUDIO_GAIN_UNITY);
+      }
+      TEST_Fill(test_in, samples, res);
+      kernels->Gain(test_in, test_out, TEST_FRAMES, channels, gain, step);
+
+      errors = 0;
+      for(i = 0; i < samples; i++)
+      {
+        ch = (uint8_t)(i % channels);
+        /* the step is added before each frame */
+        g = (double)(gain[ch] + step[ch] * (int32_t)(i / channels + 1U)) / (double)AUDIO_GAIN_UNITY;
+        expected = TEST_Saturate((int64_t)floor((double)TEST_Load(&test_in[i * res], res) * g), (uint8_t)(8U * res));
+        value = TEST_Load(&test_out[i * res], res);
+        if(fabs((double)value - (double)expected) > tolerance)
+        {
+          errors++;
+        }
+      }
+      TEST_CHECK(errors == 0, "%u bytes, %u channels: %u samples off the reference", res, channels, errors);
+
+      kernels->Gain(test_in, test_in, TEST_FRAMES, channels, gain, step);
+      TEST_CHECK(memcmp(test_in, test_out, samples * res) == 0,
+                 "%u bytes, %u channels: in place output differs", res, channels);
+      snprintf(name, sizeof(name), "gain %u bytes %u ch", res, channels);
+      TEST_Golden(name, TEST_Crc(test_out, samples * res), test_gain_golden[res - 2U][c]);
+    }
+  }
+}
+
+/**
+  * @brief  TEST_Mix
+  *         the mixer node adds a 16 bits stereo stream to speaker slots of
+  *         16 bits, right aligned 24 bits and 32 bits : at unity, then at
+  *         TEST_MIX_VOLUME_DB_256 with the right channel muted. Speaker and
+  *         mixed samples are full scale so the adds saturate. A ring below
+  *         one half leaves the slots untouched and counts an underrun
+  * @param  None
+  * @retval None
+  */
+static void TEST_Mix(void)
+{
+  AUDIO_BufferTypeDef buf;
+  uint8_t  mix[TEST_FRAMES * 2U * 2U];
+  uint8_t  speaker[sizeof(test_half)];
+  uint32_t crc;
+  uint32_t samples = TEST_FRAMES * 2U;
+  uint32_t errors;
+  uint32_t slot;
+  uint32_t i;
+  int32_t  x;
+  int32_t  m;
+  int32_t  expected;
+  char     name[32];
+  uint8_t  res;
+  uint8_t  pass;
+
+  printf("mixer\n");
+  memset(&test_mix_desc, 0, sizeof(test_mix_desc));
+  test_mix_desc.frequence = 48000U;
+  test_mix_desc.channels_count = 2U;
+  test_mix_desc.channels_map = 0x03;
+  test_mix_desc.audio_res = 2U;
+  TEST_Fill(mix, samples, 2U);
+  for(res = 2U; res <= 4U; res++)
+  {
+    slot = (res == 2U) ? 2U : 4U;
+    memcpy(&test_speaker_desc, &test_mix_desc, sizeof(test_speaker_desc));
+    test_speaker_desc.audio_res = res;
+    TEST_CHECK(AUDIO_MixerInit(&test_mix_desc, 0, (uint32_t)&test_mixer) == 0, "mixer init");
+    AUDIO_MixerSetOutput(&test_speaker_desc);
+    TEST_RingInit(&buf);
+    test_mixer.MixerStart(&buf, sizeof(mix), (uint32_t)&test_mixer);
+    crc = 0;
+
+    /* below the threshold, nothing is added */
+    TEST_Fill(speaker, samples, (uint8_t)slot);
+    memcpy(test_half, speaker, samples * slot);
+    AUDIO_BufferWrite(&buf, mix, sizeof(mix) / 2U);
+    AUDIO_MixerMix(test_half, TEST_FRAMES);
+    TEST_CHECK(memcmp(test_half, speaker, samples * slot) == 0, "%u bytes: slots changed below the threshold", res);
+    AUDIO_BufferReset(&buf);
+
+    for(pass = 0; pass < 2U; pass++)
+    {
+      if(pass == 1U)
+      {
+        test_mixer.MixerSetVolume(0, TEST_MIX_VOLUME_DB_256, (uint32_t)&test_mixer);
+        test_mixer.MixerMute(2, 1, (uint32_t)&test_mixer);
+      }
+      TEST_Fill(speaker, samples, (uint8_t)slot);
+      for(i = 0; (res == 3U) && (i < samples); i++)
+      {
+        /* right aligned slots, the upper byte clear */
+        speaker[4U * i + 3U] = 0;
+      }
+      memcpy(test_half, speaker, samples * slot);
+      AUDIO_BufferWrite(&buf, mix, sizeof(mix));
+      AUDIO_MixerMix(test_half, TEST_FRAMES);
+
+      errors = 0;
+      for(i = 0; i < samples; i++)
+      {
+        m = TEST_Load(&mix[2U * i], 2U);
+        if(pass == 1U)
+        {
+          m = ((i & 1U) != 0U) ? 0 : TEST_Saturate(((int64_t)m * test_mixer.gain) >> 15, 16);
+        }
+        if(res == 2U)
+        {
+          expected = TEST_Saturate((int64_t)TEST_Load(&speaker[2U * i], 2U) + m, 16);
+          x = TEST_Load(&test_half[2U * i], 2U);
+        }
+        else if(res == 3U)
+        {
+          expected = TEST_Saturate((int64_t)TEST_Load(&speaker[4U * i], 3U) + ((int64_t)m << 8), 24) & AUDIO_PCM_24_MASK;
+          x = TEST_Load(&test_half[4U * i], 4U);
+        }
+        else
+        {
+          expected = TEST_Saturate((int64_t)TEST_Load(&speaker[4U * i], 4U) + ((int64_t)m << 16), 32);
+          x = TEST_Load(&test_half[4U * i], 4U);
+        }
+        if(x != expected)
+        {
+          errors++;
+        }
+      }
+      TEST_CHECK(errors == 0, "%u bytes, pass %u: %u samples off the reference", res, pass, errors);
+      TEST_CHECK(AUDIO_BUFFER_FILLED_SIZE(&buf) == 0U, "%u bytes: the mixed packet is not consumed", res);
+      /* both passes are in the golden vector */
+      crc ^= TEST_Crc(test_half, samples * slot);
+    }
+
+    /* half a packet left : one underrun, slots untouched */
+    AUDIO_BufferWrite(&buf, mix, sizeof(mix) / 2U);
+    memcpy(test_half, speaker, samples * slot);
+    AUDIO_MixerMix(test_half, TEST_FRAMES);
+    TEST_CHECK((test_mixer.underruns == 1U) && (memcmp(test_half, speaker, samples * slot) == 0),
+               "%u bytes: underrun not detected", res);
+    test_mixer.MixerStop((uint32_t)&test_mixer);
+    snprintf(name, sizeof(name), "mix %u bytes slots", res);
+    TEST_Golden(name, crc, test_mix_golden[res - 2U]);
+  }
+}
+
+/**
+  * @brief  TEST_Resampler
+  *         at a unity step the resampler gives back its input, delayed by
+  *         its history. At the bench step, 100 ppm fast on two packets, and
+  *         at the 44.1 to 48 kHz step, which puts the output frames all
+  *         along the input ones, each output frame is the Catmull-Rom cubic
+  *         at its position within the error of the 15 bits position
+  * @param  None
+  * @retval None
+  */
+static void TEST_Resampler(void)
+{
+  static const uint32_t freqs[TEST_RESAMPLER_FREQ_COUNT] = TEST_RESAMPLER_FREQS;
+  AUDIO_BufferTypeDef buf;
+  const uint32_t bench_step = AUDIO_RESAMPLER_STEP_ONE + (AUDIO_RESAMPLER_STEP_ONE / 10000U);
+  const uint32_t ratio_step = (uint32_t)(((uint64_t)AUDIO_RESAMPLER_STEP_ONE * 44100U) / 48000U);
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t errors;
+  uint32_t i;
+  int64_t  n;
+  char     name[32];
+  uint8_t  res;
+  uint8_t  f;
+
+  printf("resampler\n");
+  for(res = 2U; res <= 3U; res++)
+  {
+    for(f = 0; f < TEST_RESAMPLER_FREQ_COUNT; f++)
+    {
+      frames = (freqs[f] + 999U) / 1000U;
+      bytes = frames * 2U * res;
+      TEST_Fill(test_in, frames * 2U, res);
+      TEST_RingInit(&buf);
+      AUDIO_BufferWrite(&buf, test_in, bytes);
+      AUDIO_BufferWrite(&buf, test_in, bytes);
+      memcpy(test_in + bytes, test_in, bytes);
+
+      AUDIO_ResamplerInit(&test_resampler, 2U, res);
+      AUDIO_ResamplerProcess(&test_resampler, &buf, test_out, frames);
+      errors = 0;
+      for(i = 0; i < frames * 2U; i++)
+      {
+        n = (int64_t)(i / 2U) - TEST_RESAMPLER_DELAY;
+        if(TEST_Load(&test_out[i * res], res) != ((n < 0) ? 0 : TEST_Load(&test_in[((uint32_t)n * 2U + (i & 1U)) * res], res)))
+        {
+          errors++;
+        }
+      }
+      TEST_CHECK(errors == 0, "%u bytes, %u Hz, unity step: %u samples differ from the input", res, freqs[f], errors);
+
+      errors = TEST_ResamplerCheck(&buf, ratio_step, frames, res);
+      TEST_CHECK(errors == 0, "%u bytes, %u Hz, 44.1 to 48 kHz: %u samples off the reference", res, freqs[f], errors);
+      errors = TEST_ResamplerCheck(&buf, bench_step, frames, res);
+      TEST_CHECK(errors == 0, "%u bytes, %u Hz, 100 ppm: %u samples off the reference", res, freqs[f], errors);
+      snprintf(name, sizeof(name), "resampler %u bytes %u Hz", res, freqs[f]);
+      TEST_Golden(name, TEST_Crc(test_out, bytes), test_resampler_golden[res - 2U][f]);
+    }
+  }
+}
+
+/**
+  * @brief  TEST_ResamplerCheck
+  *         resamples the stereo frames of test_in held by the ring from a
+  *         fresh history to test_out, and compares them with the cubic
+  * @param  buf: ring holding test_in, not consumed
+  * @param  step: input frames per output frame, 2.30 format
+  * @param  frames: output frames count
+  * @param  res: bytes per sample
+  * @retval samples off the reference
+  */
+static uint32_t TEST_ResamplerCheck(AUDIO_BufferTypeDef* buf, uint32_t step, uint32_t frames, uint8_t res)
+{
+  /* the position error by the largest slope of full scale noise */
+  const double tolerance = (double)(1UL << (8U * res - 12U));
+  uint32_t errors = 0;
+  uint32_t i;
+  int64_t  n;
+  double   t;
+  double   mu;
+  double   x[4];
+  double   y;
+  uint8_t  ch;
+  uint8_t  k;
+
+  AUDIO_ResamplerInit(&test_resampler, 2U, res);
+  AUDIO_ResamplerSetStep(&test_resampler, step);
+  AUDIO_ResamplerProcess(&test_resampler, buf, test_out, frames);
+  for(i = 0; i < frames * 2U; i++)
+  {
+    ch = (uint8_t)(i & 1U);
+    t = (double)(i / 2U) * ((double)step / (double)AUDIO_RESAMPLER_STEP_ONE) - TEST_RESAMPLER_DELAY;
+    n = (int64_t)floor(t);
+    mu = t - (double)n;
+    for(k = 0; k < 4U; k++)
+    {
+      /* silence before the first input frame */
+      x[k] = ((n - 1 + k) < 0) ? 0.0 : (double)TEST_Load(&test_in[((uint32_t)(n - 1 + k) * 2U + ch) * res], res);
+    }
+    y = x[1] + 0.5 * mu * (x[2] - x[0] + mu * (2.0 * x[0] - 5.0 * x[1] + 4.0 * x[2] - x[3] +
+                                                mu * (3.0 * (x[1] - x[2]) + x[3] - x[0])));
+    if(fabs((double)TEST_Load(&test_out[i * res], res) - (double)TEST_Saturate((int64_t)floor(y), (uint8_t)(8U * res))) > tolerance)
+    {
+      errors++;
+    }
+  }
+  return errors;
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
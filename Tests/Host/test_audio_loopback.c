@@ -0,0 +1,381 @@
+/**
+  ******************************************************************************
+  * @file    test_audio_loopback.c
+  * @brief   Host test of the loopback latency benchmark : audio_loopback.c is
+  *          run on fake speaker and mic nodes, one packet each ms, with the
+  *          impulse train of the loopback_latency tool. The round trip found
+  *          by host_latency.c must be the configured delay, and follow the
+  *          device measure when a played packet comes a ms late. The LOOPBACK
+  *          response is framed as audio_cdc_command.c frames it and parsed
+  *          back by the tool code
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "audio_node.h"
+#include "audio_pump.h"
+#include "audio_speaker_node.h"
+#include "audio_mic_node.h"
+#include "audio_loopback.h"
+#include "host_cdc.h"
+#include "host_latency.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_CHANNELS               2U
+#define TEST_IMPULSES               20U
+#define TEST_PERIOD_MS              100U    /* above the round trip of the largest delay */
+#define TEST_TRAIN_MS               ((TEST_IMPULSES + 1U) * TEST_PERIOD_MS)
+#define TEST_RUN_MS                 (TEST_TRAIN_MS + AUDIO_LOOPBACK_MAX_DELAY_MS + 2U) /* the last impulse comes back */
+#define TEST_LATE_MS                (TEST_TRAIN_MS / 2U) /* between the impulses 9 and 10 */
+#define TEST_NO_LATE                UINT32_MAX
+#define TEST_MAX_PACKET             (96U * TEST_CHANNELS * 4U) /* one ms at 96 kHz */
+#define TEST_QUEUE_SIZE             4U      /* played packets not yet taken by the handler */
+#define TEST_FREQ_COUNT             3U
+#define TEST_FREQS                  { 16000U, 48000U, 96000U }
+#define TEST_DELAY_COUNT            3U
+#define TEST_DELAYS                 { 0U, 5U, AUDIO_LOOPBACK_MAX_DELAY_MS }
+#define TEST_LOST_IMPULSE           4U      /* erased from the recording */
+
+#define TEST_CHECK(cond, ...)  do { if(!(cond)) { printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+                                                  printf(__VA_ARGS__); printf("\n"); test_failures++; } } while(0)
+
+/* Private variables ---------------------------------------------------------*/
+static int      test_failures;
+static uint32_t test_tick;
+static AUDIO_PumpHandlerTypeDef test_speaker_handler;
+static AUDIO_PumpHandlerTypeDef test_mic_handler;
+/* played packets, pointers in the impulse train */
+static const uint8_t* test_queue[TEST_QUEUE_SIZE];
+static uint32_t test_queue_in;
+static uint32_t test_queue_out;
+static uint32_t test_packet_length;
+static uint8_t  test_mic_due;
+static uint32_t test_recorded_length;
+static uint8_t  test_played[TEST_TRAIN_MS * TEST_MAX_PACKET];
+static uint8_t  test_recorded[TEST_RUN_MS * TEST_MAX_PACKET];
+
+/* Private function prototypes -----------------------------------------------*/
+static void TEST_Run(const AUDIO_DescriptionTypeDef* audio_description, uint32_t delay_ms, uint32_t late_ms,
+                     AUDIO_LoopbackStatsTypeDef* stats);
+static void TEST_Latency(void);
+static void TEST_Cdc(void);
+static uint8_t* TEST_Put32(uint8_t* dst, uint32_t value);
+
+/* Exported functions --------------------------------------------------------*/
+int main(void)
+{
+  TEST_Latency();
+  TEST_Cdc();
+  printf("%s : %d failure(s)\n", (test_failures == 0) ? "PASS" : "FAIL", test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
+
+/**
+  * @brief  HAL_GetTick
+  *         simulated ms tick
+  * @param  None
+  * @retval tick
+  */
+uint32_t HAL_GetTick(void)
+{
+  return test_tick;
+}
+
+/**
+  * @brief  AUDIO_PumpSetHandler
+  *         keeps the handlers the loopback registers, the test runs them
+  * @param  work: AUDIO_PUMP_xxx
+  * @param  handler: handler
+  * @retval None
+  */
+void AUDIO_PumpSetHandler(uint32_t work, AUDIO_PumpHandlerTypeDef handler)
+{
+  if(work == AUDIO_PUMP_SPEAKER_DATA)
+  {
+    test_speaker_handler = handler;
+  }
+  else if(work == AUDIO_PUMP_MIC_SPACE)
+  {
+    test_mic_handler = handler;
+  }
+}
+
+/**
+  * @brief  AUDIO_AcquireSpeakerData
+  *         oldest played packet, in two regions as across the ring end
+  * @param  region: returned packet regions
+  * @retval packet length, 0 if none
+  */
+uint32_t AUDIO_AcquireSpeakerData(AUDIO_BufferRegionTypeDef* region)
+{
+  const uint8_t* packet;
+
+  if(test_queue_in == test_queue_out)
+  {
+    return 0;
+  }
+  packet = test_queue[test_queue_out % TEST_QUEUE_SIZE];
+  region->data[0]   = (uint8_t*)packet;
+  region->length[0] = test_packet_length / 2U;
+  region->data[1]   = (uint8_t*)packet + region->length[0];
+  region->length[1] = test_packet_length - region->length[0];
+  return test_packet_length;
+}
+
+/**
+  * @brief  AUDIO_ReleaseSpeakerData
+  *         consumes the oldest played packet
+  * @param  None
+  * @retval 0
+  */
+uint16_t AUDIO_ReleaseSpeakerData(void)
+{
+  test_queue_out++;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_GetPacketLength
+  *         a mic packet is due each ms
+  * @param  None
+  * @retval packet length, 0 if the packet of the ms is committed
+  */
+uint32_t AUDIO_GetPacketLength(void)
+{
+  return test_mic_due ? test_packet_length : 0U;
+}
+
+/**
+  * @brief  AUDIO_ReserveINData
+  *         room of the next mic packet in the recording, in two regions
+  * @param  region: returned room regions
+  * @retval room length
+  */
+uint32_t AUDIO_ReserveINData(AUDIO_BufferRegionTypeDef* region)
+{
+  region->data[0]   = &test_recorded[test_recorded_length];
+  region->length[0] = test_packet_length / 2U;
+  region->data[1]   = region->data[0] + region->length[0];
+  region->length[1] = test_packet_length - region->length[0];
+  return test_packet_length;
+}
+
+/**
+  * @brief  AUDIO_CommitINData
+  *         appends the mic packet to the recording
+  * @param  length: packet length
+  * @retval length
+  */
+uint32_t AUDIO_CommitINData(uint32_t length)
+{
+  test_recorded_length += length;
+  test_mic_due = 0;
+  return length;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  TEST_Run
+  *         plays the impulse train through the loopback, a packet each ms,
+  *         and records the mic packets of each ms
+  * @param  audio_description: format of both streams
+  * @param  delay_ms: loopback delay
+  * @param  late_ms: ms whose played packet comes with the next one, TEST_NO_LATE
+  * @param  stats: returned device measures
+  * @retval None
+  */
+static void TEST_Run(const AUDIO_DescriptionTypeDef* audio_description, uint32_t delay_ms, uint32_t late_ms,
+                     AUDIO_LoopbackStatsTypeDef* stats)
+{
+  uint32_t t;
+
+  test_packet_length = (audio_description->frequence / 1000U) * AUDIO_SAMPLE_LENGTH(audio_description);
+  HOST_LatencyImpulses(test_played, TEST_IMPULSES, TEST_PERIOD_MS * (audio_description->frequence / 1000U),
+                       audio_description);
+  test_queue_in = 0;
+  test_queue_out = 0;
+  test_recorded_length = 0;
+  AUDIO_LoopbackInit();
+  AUDIO_LoopbackSetDelay(delay_ms);
+  for(t = 0; t < TEST_RUN_MS; t++)
+  {
+    test_tick = t;
+    if((late_ms != TEST_NO_LATE) && (t == (late_ms + 1U)))
+    {
+      test_queue[test_queue_in++ % TEST_QUEUE_SIZE] = &test_played[late_ms * test_packet_length];
+    }
+    if((t < TEST_TRAIN_MS) && (t != late_ms))
+    {
+      test_queue[test_queue_in++ % TEST_QUEUE_SIZE] = &test_played[t * test_packet_length];
+    }
+    test_speaker_handler();
+    test_mic_due = 1;
+    test_mic_handler();
+  }
+  AUDIO_LoopbackGetStats(stats);
+}
+
+/**
+  * @brief  TEST_Latency
+  *         at each rate, sample size and delay, the round trip of every
+  *         impulse is the delay, as the device measures it. A packet a ms
+  *         late adds a ms to the device latency of the next packets and
+  *         to the round trip of the next impulses, without losing any
+  * @param  None
+  * @retval None
+  */
+static void TEST_Latency(void)
+{
+  static const uint32_t freqs[TEST_FREQ_COUNT] = TEST_FREQS;
+  static const uint32_t delays[TEST_DELAY_COUNT] = TEST_DELAYS;
+  AUDIO_DescriptionTypeDef   desc;
+  AUDIO_LoopbackStatsTypeDef stats;
+  HOST_LatencyResultTypeDef  result;
+  uint32_t fpm;
+  uint32_t count;
+  uint8_t  f;
+  uint8_t  d;
+  uint8_t  res;
+
+  printf("loopback latency\n");
+  for(res = 2U; res <= 3U; res++)
+  {
+    for(f = 0; f < TEST_FREQ_COUNT; f++)
+    {
+      memset(&desc, 0, sizeof(desc));
+      desc.frequence = freqs[f];
+      desc.channels_count = TEST_CHANNELS;
+      desc.channels_map = 0x03;
+      desc.audio_res = res;
+      fpm = freqs[f] / 1000U;
+      for(d = 0; d < TEST_DELAY_COUNT; d++)
+      {
+        TEST_Run(&desc, delays[d], TEST_NO_LATE, &stats);
+        count = TEST_TRAIN_MS - delays[d];
+        TEST_CHECK((stats.count == count) && (stats.min_ms == delays[d]) && (stats.max_ms == delays[d]) &&
+                   (stats.hist[0] == count) && (stats.dropped == 0U),
+                   "%u bytes, %u Hz, %u ms: device count %u, min %u, max %u ms, dropped %u",
+                   res, freqs[f], delays[d], stats.count, stats.min_ms, stats.max_ms, stats.dropped);
+        TEST_CHECK(HOST_LatencyAnalyze(test_recorded, test_recorded_length / AUDIO_SAMPLE_LENGTH(&desc),
+                                       TEST_IMPULSES, TEST_PERIOD_MS * fpm, 0, &desc, &result) == 0,
+                   "%u bytes, %u Hz, %u ms: no impulse", res, freqs[f], delays[d]);
+        TEST_CHECK((result.found == TEST_IMPULSES) && (result.min_us == (int32_t)(delays[d] * 1000U)) &&
+                   (result.max_us == result.min_us) && (result.avg_us == result.min_us) &&
+                   (result.hist[0] == TEST_IMPULSES),
+                   "%u bytes, %u Hz, %u ms: %u impulses, round trip %d to %d us",
+                   res, freqs[f], delays[d], result.found, result.min_us, result.max_us);
+
+        /* an impulse lost on the way doesn't move the others */
+        memset(&test_recorded[((TEST_LOST_IMPULSE + 1U) * TEST_PERIOD_MS + delays[d]) * test_packet_length], 0,
+               test_packet_length);
+        HOST_LatencyAnalyze(test_recorded, test_recorded_length / AUDIO_SAMPLE_LENGTH(&desc),
+                            TEST_IMPULSES, TEST_PERIOD_MS * fpm, 0, &desc, &result);
+        TEST_CHECK((result.found == (TEST_IMPULSES - 1U)) && (result.min_us == (int32_t)(delays[d] * 1000U)) &&
+                   (result.max_us == result.min_us),
+                   "%u bytes, %u Hz, %u ms, lost impulse: %u impulses, round trip %d to %d us",
+                   res, freqs[f], delays[d], result.found, result.min_us, result.max_us);
+
+        TEST_Run(&desc, delays[d], TEST_LATE_MS, &stats);
+        /* the packets in the line when the late one is missed, and the late one, keep the delay */
+        TEST_CHECK((stats.count == count) && (stats.min_ms == delays[d]) &&
+                   (stats.max_ms == (delays[d] + 1U)) && (stats.hist[0] == (TEST_LATE_MS - delays[d] + 1U)) &&
+                   (stats.hist[1] == (TEST_TRAIN_MS - 1U - TEST_LATE_MS)),
+                   "%u bytes, %u Hz, %u ms, late packet: device count %u, min %u, max %u ms, %u and %u in the first bins",
+                   res, freqs[f], delays[d], stats.count, stats.min_ms, stats.max_ms, stats.hist[0], stats.hist[1]);
+        HOST_LatencyAnalyze(test_recorded, test_recorded_length / AUDIO_SAMPLE_LENGTH(&desc),
+                            TEST_IMPULSES, TEST_PERIOD_MS * fpm, 0, &desc, &result);
+        TEST_CHECK((result.found == TEST_IMPULSES) && (result.min_us == (int32_t)(stats.min_ms * 1000U)) &&
+                   (result.max_us == (int32_t)(stats.max_ms * 1000U)) && (result.hist[0] == (TEST_IMPULSES / 2U)) &&
+                   (result.hist[1000U / HOST_LATENCY_HIST_BIN_US] == (TEST_IMPULSES / 2U)),
+                   "%u bytes, %u Hz, %u ms, late packet: %u impulses, round trip %d to %d us",
+                   res, freqs[f], delays[d], result.found, result.min_us, result.max_us);
+      }
+    }
+  }
+}
+
+/**
+  * @brief  TEST_Cdc
+  *         the tool frames a request as the device expects it, and reads the
+  *         LOOPBACK response the device frames back. A corrupted response is
+  *         refused
+  * @param  None
+  * @retval None
+  */
+static void TEST_Cdc(void)
+{
+  static const uint8_t ping[] = { AUDIO_CDC_CMD_REQUEST_SYNC, AUDIO_CDC_CMD_PING, 0x00U, 0x5AU };
+  AUDIO_LoopbackStatsTypeDef stats;
+  AUDIO_LoopbackStatsTypeDef parsed;
+  uint8_t  frame[HOST_CDC_FRAME_SIZE];
+  uint8_t  payload[AUDIO_CDC_CMD_MAX_PAYLOAD];
+  uint8_t* ptr;
+  uint8_t  status;
+  uint8_t  length;
+  uint8_t  sum = 0;
+  uint32_t frame_length;
+  uint32_t i;
+
+  printf("commands\n");
+  TEST_CHECK((HOST_CdcRequest(frame, AUDIO_CDC_CMD_PING, 0, 0) == sizeof(ping)) && (memcmp(frame, ping, sizeof(ping)) == 0),
+             "PING request %02X %02X %02X %02X", frame[0], frame[1], frame[2], frame[3]);
+
+  /* the LOOPBACK response of the last run, as AUDIO_CdcCommandRespond frames it */
+  AUDIO_LoopbackGetStats(&stats);
+  frame[0] = AUDIO_CDC_CMD_RESPONSE_SYNC;
+  frame[1] = AUDIO_CDC_CMD_LOOPBACK;
+  frame[2] = AUDIO_CDC_CMD_STATUS_OK;
+  ptr = &frame[HOST_CDC_RESPONSE_HEADER];
+  ptr = TEST_Put32(ptr, stats.delay_ms);
+  ptr = TEST_Put32(ptr, stats.count);
+  ptr = TEST_Put32(ptr, (stats.count != 0U) ? stats.min_ms : 0U);
+  ptr = TEST_Put32(ptr, stats.max_ms);
+  ptr = TEST_Put32(ptr, stats.dropped);
+  for(i = 0; i < AUDIO_LOOPBACK_HIST_BINS; i++)
+  {
+    ptr = TEST_Put32(ptr, stats.hist[i]);
+  }
+  frame[3] = (uint8_t)(ptr - &frame[HOST_CDC_RESPONSE_HEADER]);
+  for(i = 0; i < (uint32_t)(ptr - frame); i++)
+  {
+    sum += frame[i];
+  }
+  *ptr++ = (uint8_t)(0U - sum);
+  frame_length = (uint32_t)(ptr - frame);
+
+  TEST_CHECK((HOST_CdcParse(frame, frame_length, AUDIO_CDC_CMD_LOOPBACK, &status, payload, &length) == 0) &&
+             (status == AUDIO_CDC_CMD_STATUS_OK) && (HOST_LatencyParseDevice(payload, length, &parsed) == 0) &&
+             (memcmp(&parsed, &stats, sizeof(stats)) == 0), "LOOPBACK response not read back");
+  frame[HOST_CDC_RESPONSE_HEADER + 4U] ^= 0x01U;
+  TEST_CHECK(HOST_CdcParse(frame, frame_length, AUDIO_CDC_CMD_LOOPBACK, &status, payload, &length) != 0,
+             "corrupted response accepted");
+}
+
+/**
+  * @brief  TEST_Put32
+  *         writes a little endian 32 bits field, as the device does
+  * @param  dst: destination
+  * @param  value: value
+  * @retval next byte
+  */
+static uint8_t* TEST_Put32(uint8_t* dst, uint32_t value)
+{
+  *dst++ = (uint8_t)value;
+  *dst++ = (uint8_t)(value >> 8);
+  *dst++ = (uint8_t)(value >> 16);
+  *dst++ = (uint8_t)(value >> 24);
+  return dst;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
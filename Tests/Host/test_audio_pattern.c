@@ -0,0 +1,276 @@
+/**
+  ******************************************************************************
+  * @file    test_audio_pattern.c
+  * @brief   Host test of the dummy mic pattern verifier : the frames of
+  *          audio_pattern.c are written one packet each ms, in two regions as
+  *          across the ring end, then recorded after a silence with skipped,
+  *          repeated, silent, damaged and dropped frames. host_pattern.c must
+  *          find each of them at its recorded frame, and the PATTERN response
+  *          is parsed back by the tool code
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "audio_node.h"
+#include "audio_pattern.h"
+#include "host_cdc.h"
+#include "host_pattern.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_FREQ                   48000U
+#define TEST_CHANNELS               2U
+#define TEST_PACKET_FRAMES          (TEST_FREQ / 1000U)
+#define TEST_RUN_MS                 2000U   /* the counter wraps */
+#define TEST_FRAMES                 (TEST_RUN_MS * TEST_PACKET_FRAMES)
+#define TEST_SPLIT_BYTES            21U     /* first region of a packet, inside a sample */
+#define TEST_SILENCE_FRAMES         10U     /* recorded before the pattern starts */
+#define TEST_MAX_FRAME              (TEST_CHANNELS * 4U)
+#define TEST_MAX_RECORDED           (TEST_FRAMES + TEST_SILENCE_FRAMES + 16U)
+#define TEST_RES_COUNT              3U
+#define TEST_RESES                  { 2U, 3U, 4U }
+
+/* faults of the recording */
+#define TEST_SKIP                   0U      /* frames removed from the ring by the implicit synchro */
+#define TEST_REPEAT                 1U      /* frames recorded again */
+#define TEST_SILENT                 2U      /* frame recorded as silence */
+#define TEST_FLIP                   3U      /* most significant bit of a word flipped */
+#define TEST_DROP                   4U      /* frames lost on the way */
+
+#define TEST_CHECK(cond, ...)  do { if(!(cond)) { printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+                                                  printf(__VA_ARGS__); printf("\n"); test_failures++; } } while(0)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t frame;              /* generated frame where the fault starts */
+  uint8_t  kind;               /* TEST_xxx */
+  uint32_t count;              /* frames of the fault */
+}
+TEST_FaultTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static int     test_failures;
+/* a corrupted frame stays at its place in the sequence, the faults are given
+   beyond AUDIO_PATTERN_MAX_JUMP : a silent frame closer to the counter start
+   would be a jump back to its first frame */
+static const TEST_FaultTypeDef test_faults[] =
+{
+  { 1000U,  TEST_SKIP,   1U },
+  { 5000U,  TEST_REPEAT, 2U },
+  { 9000U,  TEST_SILENT, 1U },
+  { 13000U, TEST_FLIP,   1U },
+  { 17000U, TEST_DROP,   TEST_PACKET_FRAMES },
+  { 65535U, TEST_SKIP,   2U },       /* across the counter wrap */
+};
+#define TEST_FAULT_COUNT            (sizeof(test_faults) / sizeof(test_faults[0]))
+static uint8_t test_generated[TEST_FRAMES * TEST_MAX_FRAME];
+static uint8_t test_recorded[TEST_MAX_RECORDED * TEST_MAX_FRAME];
+
+/* Private function prototypes -----------------------------------------------*/
+static void TEST_Verify(uint8_t res, uint8_t mode);
+static void TEST_Device(void);
+static uint8_t* TEST_Put32(uint8_t* dst, uint32_t value);
+
+/* Exported functions --------------------------------------------------------*/
+int main(void)
+{
+  static const uint8_t reses[TEST_RES_COUNT] = TEST_RESES;
+  uint32_t r;
+
+  for(r = 0; r < TEST_RES_COUNT; r++)
+  {
+    TEST_Verify(reses[r], AUDIO_PATTERN_COUNTER);
+    TEST_Verify(reses[r], AUDIO_PATTERN_PRBS);
+  }
+  printf("%s : %d failure(s)\n", (test_failures == 0) ? "PASS" : "FAIL", test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  TEST_Verify
+  *         generates the pattern, records it with the faults and checks the
+  *         verifier events against them
+  * @param  res: bytes per sample
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @retval None
+  */
+static void TEST_Verify(uint8_t res, uint8_t mode)
+{
+  static HOST_PatternResultTypeDef result;
+  HOST_PatternEventTypeDef  expected[TEST_FAULT_COUNT];
+  AUDIO_DescriptionTypeDef  desc;
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t frame_length;
+  uint32_t packet_length;
+  uint32_t generated;
+  uint32_t recorded = TEST_SILENCE_FRAMES;
+  uint32_t lost     = 0;
+  uint32_t repeated = 0;
+  uint32_t corrupted = 0;
+  uint32_t fault = 0;
+  uint32_t ms;
+  uint32_t i;
+
+  memset(&desc, 0, sizeof(desc));
+  desc.frequence      = TEST_FREQ;
+  desc.channels_count = TEST_CHANNELS;
+  desc.audio_res      = res;
+  frame_length  = AUDIO_SAMPLE_LENGTH(&desc);
+  packet_length = TEST_PACKET_FRAMES * frame_length;
+  printf("pattern %u, %u bytes\n", mode, res);
+
+  TEST_CHECK(AUDIO_PatternSetMode(mode) == 0, "mode %u refused", mode);
+  for(ms = 0; ms < TEST_RUN_MS; ms++)
+  {
+    region.data[0]   = &test_generated[ms * packet_length];
+    region.length[0] = TEST_SPLIT_BYTES;
+    region.data[1]   = region.data[0] + TEST_SPLIT_BYTES;
+    AUDIO_PatternWriteRegion(&region, packet_length, &desc);
+  }
+
+  /* recording : silence, then the frames with the faults */
+  memset(test_recorded, 0, TEST_SILENCE_FRAMES * frame_length);
+  for(generated = 0; generated < TEST_FRAMES;)
+  {
+    if((fault < TEST_FAULT_COUNT) && (test_faults[fault].frame == generated))
+    {
+      expected[fault].frame = recorded;
+      expected[fault].count = test_faults[fault].count;
+      switch(test_faults[fault].kind)
+      {
+        case TEST_SKIP:
+          AUDIO_PatternSyncAdjust((int32_t)(test_faults[fault].count * frame_length), 1U, &desc);
+          /* fall through */
+        case TEST_DROP:
+          expected[fault].kind = HOST_PATTERN_LOST;
+          lost += test_faults[fault].count;
+          generated += test_faults[fault].count;
+          break;
+        case TEST_REPEAT:
+          expected[fault].kind = HOST_PATTERN_REPEATED;
+          repeated += test_faults[fault].count;
+          memcpy(&test_recorded[recorded * frame_length],
+                 &test_generated[(generated - test_faults[fault].count) * frame_length],
+                 test_faults[fault].count * frame_length);
+          recorded += test_faults[fault].count;
+          break;
+        case TEST_SILENT:
+          expected[fault].kind = HOST_PATTERN_CORRUPTED;
+          corrupted++;
+          memset(&test_recorded[recorded * frame_length], 0, frame_length);
+          recorded++;
+          generated++;
+          break;
+        default:
+          expected[fault].kind = HOST_PATTERN_CORRUPTED;
+          corrupted++;
+          memcpy(&test_recorded[recorded * frame_length], &test_generated[generated * frame_length], frame_length);
+          test_recorded[(recorded * frame_length) + res - 1U] ^= 0x80U;
+          recorded++;
+          generated++;
+          break;
+      }
+      fault++;
+      continue;
+    }
+    memcpy(&test_recorded[recorded * frame_length], &test_generated[generated * frame_length], frame_length);
+    recorded++;
+    generated++;
+  }
+
+  TEST_CHECK(HOST_PatternVerify(test_recorded, recorded, mode, &desc, &result) == 0, "pattern not found");
+  /* the first counter frame is silent */
+  TEST_CHECK(result.first_frame == (TEST_SILENCE_FRAMES + ((mode == AUDIO_PATTERN_COUNTER) ? 1U : 0U)),
+             "pattern from frame %u", result.first_frame);
+  TEST_CHECK((result.frames == recorded) && (result.check.lost == lost) && (result.check.repeated == repeated) &&
+             (result.check.corrupted == corrupted) && (result.check.resyncs == 0U),
+             "%u frames : %u lost, %u repeated, %u corrupted, %u resyncs", result.frames, result.check.lost,
+             result.check.repeated, result.check.corrupted, result.check.resyncs);
+  TEST_CHECK(result.event_count == TEST_FAULT_COUNT, "%u events", result.event_count);
+  for(i = 0; (i < TEST_FAULT_COUNT) && (i < result.event_count); i++)
+  {
+    TEST_CHECK((result.events[i].kind == expected[i].kind) && (result.events[i].frame == expected[i].frame) &&
+               (result.events[i].count == expected[i].count),
+               "event %u : kind %u frame %u count %u, expected kind %u frame %u count %u", i,
+               result.events[i].kind, result.events[i].frame, result.events[i].count,
+               expected[i].kind, expected[i].frame, expected[i].count);
+  }
+
+  /* no pattern in a silent recording */
+  memset(test_recorded, 0, TEST_SILENCE_FRAMES * frame_length);
+  TEST_CHECK(HOST_PatternVerify(test_recorded, TEST_SILENCE_FRAMES, mode, &desc, &result) != 0,
+             "pattern found in the silence");
+
+  TEST_Device();
+}
+
+/**
+  * @brief  TEST_Device
+  *         reads the device counts back from a PATTERN response payload, as
+  *         audio_cdc_command.c writes it
+  * @param  None
+  * @retval None
+  */
+static void TEST_Device(void)
+{
+  AUDIO_PatternStatsTypeDef stats;
+  AUDIO_PatternStatsTypeDef parsed;
+  uint8_t  payload[AUDIO_CDC_CMD_MAX_PAYLOAD];
+  uint8_t* ptr = payload;
+  uint32_t skipped = 0;
+  uint32_t i;
+
+  for(i = 0; i < TEST_FAULT_COUNT; i++)
+  {
+    if(test_faults[i].kind == TEST_SKIP)
+    {
+      skipped += test_faults[i].count;
+    }
+  }
+  AUDIO_PatternGetStats(&stats);
+  TEST_CHECK((stats.frames == TEST_FRAMES) && (stats.sync_skipped == skipped),
+             "device : %u frames, %u skipped", stats.frames, stats.sync_skipped);
+
+  *ptr++ = stats.mode;
+  ptr = TEST_Put32(ptr, stats.frames);
+  ptr = TEST_Put32(ptr, stats.sync_packets);
+  ptr = TEST_Put32(ptr, stats.sync_skipped);
+  ptr = TEST_Put32(ptr, stats.sync_last_frame);
+  memset(&parsed, 0xFF, sizeof(parsed));
+  TEST_CHECK((HOST_PatternParseDevice(payload, (uint8_t)(ptr - payload), &parsed) == 0) &&
+             (parsed.mode == stats.mode) && (parsed.frames == stats.frames) &&
+             (parsed.sync_packets == stats.sync_packets) && (parsed.sync_skipped == stats.sync_skipped) &&
+             (parsed.sync_last_frame == stats.sync_last_frame), "PATTERN response not read back");
+  TEST_CHECK(HOST_PatternParseDevice(payload, (uint8_t)(ptr - payload - 1), &parsed) != 0,
+             "short PATTERN response accepted");
+}
+
+/**
+  * @brief  TEST_Put32
+  *         little endian 32 bits, as AUDIO_CdcCommandPut32
+  * @param  dst: destination
+  * @param  value: value
+  * @retval next byte
+  */
+static uint8_t* TEST_Put32(uint8_t* dst, uint32_t value)
+{
+  *dst++ = (uint8_t)value;
+  *dst++ = (uint8_t)(value >> 8);
+  *dst++ = (uint8_t)(value >> 16);
+  *dst++ = (uint8_t)(value >> 24);
+  return dst;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,612 @@
+/**
+  ******************************************************************************
+  * @file    test_audio_sync.c
+  * @brief   Host test of the stream synchronisation : the playback feedback
+  *          and the recording resampler hold their ring against a simulated
+  *          bus and device clocks drifting by up to 500 ppm, and recover from
+  *          lost packets. The ring keeps the data in order across its end and
+  *          the packet scheduler carries the exact rate. Run with --bench to
+  *          time the steps instead
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "audio_node.h"
+#include "audio_resampler.h"
+#include "audio_sync_control.h"
+#include "fake_pcd.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_RATE_FRAC_BITS         8U      /* AUDIO_FEEDBACK_RATE_FRAC_BITS of usbd_audio.h */
+#define TEST_CHANNELS               2U
+#define TEST_RES                    2U
+#define TEST_FRAME_SIZE             (TEST_CHANNELS * TEST_RES)
+#define TEST_RING_SIZE              8192U   /* bytes, both rings */
+#define TEST_RING_MARGIN            256U    /* at least the largest packet */
+#define TEST_LATENCY_MS             8U      /* playback start threshold, the medium latency profile */
+#define TEST_FEEDBACK_PERIOD        32U     /* frames between two reads of the feedback endpoint */
+#define TEST_DURATION_MS            600000U /* simulated time of each run */
+#define TEST_DRIFT_COUNT            3U
+#define TEST_DRIFTS                 { -500, 0, 500 }
+#define TEST_GAP_MS                 10000U  /* the stream loses packets at this time */
+#define TEST_GAP_PACKETS            4U      /* packets lost */
+
+/* playback bounds */
+#define TEST_PLAY_RECOVER_MS        500U    /* fill level is back in its band this time after the gap */
+#define TEST_PLAY_BAND_FRAMES       64      /* fill level band around the target, a speaker packet and a bit */
+#define TEST_PLAY_OFFSET_FRAMES     1       /* average distance to the target after the recovery */
+#define TEST_PLAY_RATE_PPM          3       /* frames the host sent against the frames the speaker took */
+
+/* recording bounds */
+#define TEST_REC_RECOVER_MS         2000U   /* fill level is back in its band this time after the gap */
+#define TEST_REC_BAND_FRAMES        64      /* fill level band around the center, a mic packet and a bit */
+#define TEST_REC_OFFSET_FRAMES      24      /* average distance to the center, the correction is proportional only */
+#define TEST_REC_RATE_PPM           3       /* mic frames consumed against the mic frames written */
+
+#define TEST_BENCH_LOOPS            10000000U
+
+#define TEST_CHECK(cond, ...)  do { if(!(cond)) { printf("  FAIL %s:%d: ", __FILE__, __LINE__); \
+                                                  printf(__VA_ARGS__); printf("\n"); test_failures++; } } while(0)
+
+/* Private types -------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t  underruns;
+  uint32_t  overruns;
+  uint32_t  order_errors;      /* frames read out of order */
+  uint32_t  recover_ms;        /* last time out of band , from the gap */
+  int32_t   excursion;         /* largest distance to the target after the recovery, frames */
+  double    offset;            /* average distance to the target after the recovery, frames */
+  double    rate_ppm;          /* rate error after the recovery */
+}
+TEST_RunTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static int      test_failures;
+static uint8_t  test_ring[TEST_RING_SIZE + TEST_RING_MARGIN];
+static uint8_t  test_packet[TEST_RING_MARGIN];
+
+/* Private function prototypes -----------------------------------------------*/
+static void     TEST_RingInit(AUDIO_BufferTypeDef* buf, uint8_t flags);
+static void     TEST_Playback(uint32_t freq, int32_t ppm, TEST_RunTypeDef* run);
+static void     TEST_Recording(uint32_t freq, int32_t ppm, TEST_RunTypeDef* run);
+static void     TEST_Track(TEST_RunTypeDef* run, uint32_t ms, int32_t distance, int32_t band, uint32_t settle_ms);
+static void     TEST_PlaybackDrift(void);
+static void     TEST_RecordingDrift(void);
+static void     TEST_RingRegions(void);
+static void     TEST_Scheduler(void);
+static void     TEST_Bench(void);
+static double   TEST_Now(void);
+
+/* Exported functions --------------------------------------------------------*/
+int main(int argc, char** argv)
+{
+  if((argc > 1) && (strcmp(argv[1], "--bench") == 0))
+  {
+    TEST_Bench();
+    return 0;
+  }
+  TEST_RingRegions();
+  TEST_Scheduler();
+  TEST_PlaybackDrift();
+  TEST_RecordingDrift();
+  printf("%s : %d failure(s)\n", (test_failures == 0) ? "PASS" : "FAIL", test_failures);
+  return (test_failures == 0) ? 0 : 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  TEST_RingInit
+  *         ring of TEST_RING_SIZE bytes, as AUDIO_USB_InitializesDataBuffer sets it
+  * @param  buf: audio buffer
+  * @param  flags: buffer flags
+  * @retval None
+  */
+static void TEST_RingInit(AUDIO_BufferTypeDef* buf, uint8_t flags)
+{
+  memset(buf, 0, sizeof(AUDIO_BufferTypeDef));
+  memset(test_ring, 0, sizeof(test_ring));
+  buf->buffer_flags = flags;
+  buf->data = test_ring;
+  buf->size = TEST_RING_SIZE;
+  buf->mask = TEST_RING_SIZE - 1U;
+  buf->margin = TEST_RING_MARGIN;
+  AUDIO_BufferReset(buf);
+}
+
+/**
+  * @brief  TEST_Playback
+  *         USB OUT stream paced by the feedback into the ring, read by a
+  *         speaker one ms packet at a time from its own clock. Each frame
+  *         carries its index so the ring order is checked too
+  * @param  freq: sampling frequency
+  * @param  ppm: speaker clock drift against the bus
+  * @param  run: results
+  * @retval None
+  */
+static void TEST_Playback(uint32_t freq, int32_t ppm, TEST_RunTypeDef* run)
+{
+  AUDIO_BufferTypeDef buf;
+  AUDIO_SyncFeedbackTypeDef feedback;
+  FAKE_PCD_HostTypeDef host;
+  FAKE_PCD_ClockTypeDef speaker;
+  int32_t sample_size = (int32_t)TEST_FRAME_SIZE;
+  int32_t nominal = (int32_t)(freq << TEST_RATE_FRAC_BITS);
+  int32_t max_deviation = nominal >> AUDIO_FEEDBACK_MAX_DEVIATION_SHIFT;
+  uint32_t packet_length = AUDIO_MS_PACKET_SIZE(freq, TEST_CHANNELS, TEST_RES);
+  uint32_t packet_frames = packet_length / TEST_FRAME_SIZE;
+  uint32_t threshold = packet_length * TEST_LATENCY_MS;
+  uint32_t guard_band = (threshold + packet_length) >> 1;
+  uint64_t offset_sum = 0;
+  uint32_t written = 0;
+  uint32_t read = 0;
+  uint32_t written_start = 0;
+  uint32_t read_start = 0;
+  uint32_t pending = 0;
+  uint32_t started = 0;
+  uint32_t ms, i, frames, length;
+  int32_t correction, distance;
+  uint32_t settle_ms = TEST_GAP_MS + TEST_PLAY_RECOVER_MS;
+
+  memset(run, 0, sizeof(TEST_RunTypeDef));
+  TEST_RingInit(&buf, 0);
+  FAKE_PCD_HostInit(&host, freq, TEST_FEEDBACK_PERIOD);
+  FAKE_PCD_ClockInit(&speaker, freq, ppm);
+  memset(&feedback, 0, sizeof(feedback));
+
+  for(ms = 0; ms < TEST_DURATION_MS; ms++)
+  {
+    FAKE_PCD_Sof(&host);
+    if(ms == settle_ms)
+    {
+      written_start = written;
+      read_start = read;
+    }
+    /* OUT packet of this frame, sized from the feedback the host read */
+    frames = FAKE_PCD_OutFrames(&host);
+    if((ms >= TEST_GAP_MS) && (ms < TEST_GAP_MS + TEST_GAP_PACKETS))
+    {
+      /* lost on the bus */
+      frames = 0;
+    }
+    length = frames * TEST_FRAME_SIZE;
+    if(length > AUDIO_BufferFreeSize(&buf))
+    {
+      run->overruns++;
+    }
+    else
+    {
+      for(i = 0; i < frames; i++)
+      {
+        memcpy(test_packet + i * TEST_FRAME_SIZE, &written, TEST_FRAME_SIZE);
+        written++;
+      }
+      AUDIO_BufferWrite(&buf, test_packet, length);
+    }
+    if(!started)
+    {
+      if(AUDIO_BufferFilledSize(&buf) < threshold)
+      {
+        continue;
+      }
+      /* speaker starts from the start threshold , as the first SOF of the session */
+      started = 1;
+      feedback.fill_avg = (int32_t)threshold << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+      feedback.integral = 0;
+    }
+    /* speaker reads one ms packet each packet_frames of its own clock */
+    pending += FAKE_PCD_ClockFrames(&speaker);
+    while(pending >= packet_frames)
+    {
+      pending -= packet_frames;
+      if(AUDIO_BufferFilledSize(&buf) < packet_length)
+      {
+        run->underruns++;
+        continue;
+      }
+      AUDIO_BufferRead(&buf, test_packet, packet_length);
+      for(i = 0; i < packet_frames; i++)
+      {
+        uint32_t index;
+
+        memcpy(&index, test_packet + i * TEST_FRAME_SIZE, TEST_FRAME_SIZE);
+        if(index != read)
+        {
+          run->order_errors++;
+          read = index;
+        }
+        read++;
+      }
+    }
+    /* SOF of the session : one step of the feedback controller */
+    correction = AUDIO_SyncFeedbackStep(&feedback, (int32_t)AUDIO_BufferFilledSize(&buf) << AUDIO_FEEDBACK_FILL_FRAC_BITS,
+                                        (int32_t)threshold << AUDIO_FEEDBACK_FILL_FRAC_BITS, sample_size, max_deviation,
+                                        AUDIO_FEEDBACK_FILL_AVG_SHIFT);
+    if(AUDIO_BufferFilledSize(&buf) < guard_band)
+    {
+      correction = max_deviation;
+    }
+    FAKE_PCD_PublishFeedback(&host, (uint32_t)(nominal + correction));
+
+    distance = ((int32_t)AUDIO_BufferFilledSize(&buf) - (int32_t)threshold) / sample_size;
+    TEST_Track(run, ms, distance, TEST_PLAY_BAND_FRAMES, settle_ms);
+    if(ms >= settle_ms)
+    {
+      offset_sum += (uint64_t)(int64_t)distance;
+    }
+  }
+  run->offset = (double)(int64_t)offset_sum / (double)(TEST_DURATION_MS - settle_ms);
+  run->rate_ppm = ((double)(written - written_start) / (double)(read - read_start) - 1.0) * 1e6;
+}
+
+/**
+  * @brief  TEST_Recording
+  *         mic writes one ms packet at a time from its own clock in the
+  *         mirrored ring, the resampler produces the USB IN packets of each
+  *         frame with the step corrected from the fill level
+  * @param  freq: sampling frequency
+  * @param  ppm: mic clock drift against the bus
+  * @param  run: results
+  * @retval None
+  */
+static void TEST_Recording(uint32_t freq, int32_t ppm, TEST_RunTypeDef* run)
+{
+  AUDIO_BufferTypeDef buf;
+  AUDIO_ResamplerTypeDef resampler;
+  AUDIO_PacketSchedulerTypeDef scheduler;
+  AUDIO_DescriptionTypeDef desc;
+  FAKE_PCD_HostTypeDef host;
+  FAKE_PCD_ClockTypeDef mic;
+  int32_t sample_size = (int32_t)TEST_FRAME_SIZE;
+  uint32_t packet_length = AUDIO_MS_PACKET_SIZE(freq, TEST_CHANNELS, TEST_RES);
+  uint32_t packet_frames = packet_length / TEST_FRAME_SIZE;
+  int32_t center = (int32_t)(TEST_RING_SIZE >> 1);
+  uint64_t offset_sum = 0;
+  uint64_t mic_frames = 0;
+  uint64_t consumed_frames = 0;
+  uint32_t pending = 0;
+  uint32_t started = 0;
+  uint32_t settle_ms = TEST_GAP_MS + TEST_REC_RECOVER_MS;
+  uint32_t ms, frames, consumed;
+  int32_t correction, distance;
+
+  memset(run, 0, sizeof(TEST_RunTypeDef));
+  TEST_RingInit(&buf, AUDIO_BUFFER_MIRRORED);
+  FAKE_PCD_HostInit(&host, freq, TEST_FEEDBACK_PERIOD);
+  FAKE_PCD_ClockInit(&mic, freq, ppm);
+  AUDIO_ResamplerInit(&resampler, TEST_CHANNELS, TEST_RES);
+  memset(&desc, 0, sizeof(desc));
+  desc.frequence = freq;
+  desc.channels_count = TEST_CHANNELS;
+  desc.audio_res = TEST_RES;
+  AUDIO_PacketSchedulerInit(&scheduler, &desc, 1000U);
+  memset(test_packet, 0, sizeof(test_packet));
+
+  for(ms = 0; ms < TEST_DURATION_MS; ms++)
+  {
+    FAKE_PCD_Sof(&host);
+    /* mic DMA puts one ms packet each packet_frames of its own clock */
+    pending += FAKE_PCD_ClockFrames(&mic);
+    while(pending >= packet_frames)
+    {
+      pending -= packet_frames;
+      if((ms >= TEST_GAP_MS) && (ms < TEST_GAP_MS + TEST_GAP_PACKETS))
+      {
+        /* lost by the mic DMA */
+        continue;
+      }
+      if(packet_length > AUDIO_BufferFreeSize(&buf))
+      {
+        run->overruns++;
+        continue;
+      }
+      AUDIO_BufferWrite(&buf, test_packet, packet_length);
+      mic_frames += (ms >= settle_ms) ? packet_frames : 0U;
+    }
+    if(!started)
+    {
+      started = (AUDIO_BufferFilledSize(&buf) >= (uint32_t)center) ? 1U : 0U;
+      continue;
+    }
+    /* IN packet of this frame */
+    correction = AUDIO_SyncResamplerCorrection((int32_t)AUDIO_BufferFilledSize(&buf), center, sample_size,
+                                               (int32_t)AUDIO_RESAMPLER_STEP_ONE);
+    AUDIO_ResamplerSetStep(&resampler, (uint32_t)((int32_t)AUDIO_RESAMPLER_STEP_ONE + correction));
+    frames = AUDIO_PacketSchedulerNext(&scheduler) / TEST_FRAME_SIZE;
+    if(AUDIO_BufferFilledSize(&buf) < (frames + AUDIO_RESAMPLER_TAPS) * TEST_FRAME_SIZE)
+    {
+      run->underruns++;
+    }
+    /* the fill level the correction is computed from */
+    distance = ((int32_t)AUDIO_BufferFilledSize(&buf) - center) / sample_size;
+    consumed = AUDIO_ResamplerProcess(&resampler, &buf, test_packet, frames);
+    AUDIO_BufferCommitRead(&buf, consumed);
+    TEST_Track(run, ms, distance, TEST_REC_BAND_FRAMES, settle_ms);
+    if(ms >= settle_ms)
+    {
+      consumed_frames += consumed / TEST_FRAME_SIZE;
+      offset_sum += (uint64_t)(int64_t)distance;
+    }
+  }
+  run->offset = (double)(int64_t)offset_sum / (double)(TEST_DURATION_MS - settle_ms);
+  run->rate_ppm = ((double)consumed_frames / (double)mic_frames - 1.0) * 1e6;
+}
+
+/**
+  * @brief  TEST_Track
+  *         fill level statistics of a run : time to come back in band after
+  *         the gap, and largest distance to the target after the recovery
+  * @param  run: results
+  * @param  ms: bus time
+  * @param  distance: fill level less the target, frames
+  * @param  band: largest distance expected after the recovery, frames
+  * @param  settle_ms: end of the recovery
+  * @retval None
+  */
+static void TEST_Track(TEST_RunTypeDef* run, uint32_t ms, int32_t distance, int32_t band, uint32_t settle_ms)
+{
+  distance = (distance < 0) ? -distance : distance;
+  if((ms >= TEST_GAP_MS) && (distance > band))
+  {
+    run->recover_ms = ms + 1U - TEST_GAP_MS;
+  }
+  if(ms >= settle_ms)
+  {
+    run->excursion = (distance > run->excursion) ? distance : run->excursion;
+  }
+}
+
+/**
+  * @brief  TEST_PlaybackDrift
+  *         feedback against speaker clocks -500, 0 and +500 ppm away from the bus
+  * @param  None
+  * @retval None
+  */
+static void TEST_PlaybackDrift(void)
+{
+  static const int32_t drifts[TEST_DRIFT_COUNT] = TEST_DRIFTS;
+  static const uint32_t freqs[] = { 48000U, 44100U };
+  TEST_RunTypeDef run;
+  uint32_t f, d;
+
+  for(f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++)
+  {
+    for(d = 0; d < TEST_DRIFT_COUNT; d++)
+    {
+      TEST_Playback(freqs[f], drifts[d], &run);
+      printf("playback  %6u Hz %+4d ppm : recovered in %4u ms, excursion %3d frames, offset %+6.2f frames, rate %+.2f ppm\n",
+             (unsigned)freqs[f], (int)drifts[d], (unsigned)run.recover_ms, (int)run.excursion, run.offset, run.rate_ppm);
+      TEST_CHECK(run.underruns == 0U, "%u underruns", (unsigned)run.underruns);
+      TEST_CHECK(run.overruns == 0U, "%u overruns", (unsigned)run.overruns);
+      TEST_CHECK(run.order_errors == 0U, "%u frames out of order", (unsigned)run.order_errors);
+      TEST_CHECK(run.recover_ms < TEST_PLAY_RECOVER_MS, "not recovered in %u ms", (unsigned)TEST_PLAY_RECOVER_MS);
+      TEST_CHECK(run.excursion <= TEST_PLAY_BAND_FRAMES, "excursion %d frames", (int)run.excursion);
+      TEST_CHECK((run.offset < TEST_PLAY_OFFSET_FRAMES) && (run.offset > -TEST_PLAY_OFFSET_FRAMES),
+                 "offset %+.2f frames", run.offset);
+      TEST_CHECK((run.rate_ppm < TEST_PLAY_RATE_PPM) && (run.rate_ppm > -TEST_PLAY_RATE_PPM),
+                 "rate error %+.2f ppm", run.rate_ppm);
+    }
+  }
+}
+
+/**
+  * @brief  TEST_RecordingDrift
+  *         resampler against mic clocks -500, 0 and +500 ppm away from the bus
+  * @param  None
+  * @retval None
+  */
+static void TEST_RecordingDrift(void)
+{
+  static const int32_t drifts[TEST_DRIFT_COUNT] = TEST_DRIFTS;
+  static const uint32_t freqs[] = { 48000U, 44100U };
+  TEST_RunTypeDef run;
+  uint32_t f, d;
+
+  for(f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++)
+  {
+    for(d = 0; d < TEST_DRIFT_COUNT; d++)
+    {
+      TEST_Recording(freqs[f], drifts[d], &run);
+      printf("recording %6u Hz %+4d ppm : recovered in %4u ms, excursion %3d frames, offset %+6.2f frames, rate %+.2f ppm\n",
+             (unsigned)freqs[f], (int)drifts[d], (unsigned)run.recover_ms, (int)run.excursion, run.offset, run.rate_ppm);
+      TEST_CHECK(run.underruns == 0U, "%u underruns", (unsigned)run.underruns);
+      TEST_CHECK(run.overruns == 0U, "%u overruns", (unsigned)run.overruns);
+      TEST_CHECK(run.recover_ms < TEST_REC_RECOVER_MS, "not recovered in %u ms", (unsigned)TEST_REC_RECOVER_MS);
+      TEST_CHECK(run.excursion <= TEST_REC_BAND_FRAMES, "excursion %d frames", (int)run.excursion);
+      TEST_CHECK((run.offset < TEST_REC_OFFSET_FRAMES) && (run.offset > -TEST_REC_OFFSET_FRAMES),
+                 "offset %+.2f frames", run.offset);
+      TEST_CHECK((run.rate_ppm < TEST_REC_RATE_PPM) && (run.rate_ppm > -TEST_REC_RATE_PPM),
+                 "rate error %+.2f ppm", run.rate_ppm);
+    }
+  }
+}
+
+/**
+  * @brief  TEST_RingRegions
+  *         a write crossing the ring end is read back whole, from the margin
+  *         by default and from the ring start when mirrored
+  * @param  None
+  * @retval None
+  */
+static void TEST_RingRegions(void)
+{
+  AUDIO_BufferTypeDef buf;
+  AUDIO_BufferRegionTypeDef region;
+  uint8_t out[TEST_RING_MARGIN];
+  uint8_t flags[2] = { 0U, AUDIO_BUFFER_MIRRORED };
+  uint32_t f, i, length;
+
+  printf("ring regions\n");
+  for(f = 0; f < 2U; f++)
+  {
+    TEST_RingInit(&buf, flags[f]);
+    /* move the pointers 100 bytes before the ring end */
+    buf.rd_ptr = TEST_RING_SIZE - 100U;
+    buf.wr_ptr = TEST_RING_SIZE - 100U;
+    for(i = 0; i < sizeof(test_packet); i++)
+    {
+      test_packet[i] = (uint8_t)(i + 1U);
+    }
+    AUDIO_BufferWrite(&buf, test_packet, 200U);
+    TEST_CHECK(AUDIO_BufferFilledSize(&buf) == 200U, "filled %u", (unsigned)AUDIO_BufferFilledSize(&buf));
+    length = AUDIO_BufferAcquireRead(&buf, 200U, &region);
+    TEST_CHECK(length == 200U, "acquired %u", (unsigned)length);
+    if(flags[f] & AUDIO_BUFFER_MIRRORED)
+    {
+      TEST_CHECK(region.length[1] == 0U, "mirrored read split at %u", (unsigned)region.length[0]);
+    }
+    AUDIO_BufferRead(&buf, out, 200U);
+    TEST_CHECK(memcmp(out, test_packet, 200U) == 0, "data across the ring end, flags %u", (unsigned)flags[f]);
+    TEST_CHECK(AUDIO_BufferFilledSize(&buf) == 0U, "left %u", (unsigned)AUDIO_BufferFilledSize(&buf));
+    /* an empty read touches nothing */
+    length = AUDIO_BufferAcquireRead(&buf, 64U, &region);
+    TEST_CHECK((length == 0U) && (region.length[0] == 0U) && (region.length[1] == 0U), "empty read of %u", (unsigned)length);
+  }
+}
+
+/**
+  * @brief  TEST_Scheduler
+  *         a second of packets carries exactly the frequency, with packets of
+  *         two lengths one frame apart
+  * @param  None
+  * @retval None
+  */
+static void TEST_Scheduler(void)
+{
+  static const uint32_t freqs[] = { 8000U, 11025U, 22050U, 44100U, 48000U, 88200U, 96000U, 176400U, 192000U };
+  static const uint32_t rates[] = { 1000U, 8000U };
+  AUDIO_PacketSchedulerTypeDef scheduler;
+  AUDIO_DescriptionTypeDef desc;
+  uint32_t f, r, i, total, length;
+
+  printf("packet scheduler\n");
+  memset(&desc, 0, sizeof(desc));
+  desc.channels_count = TEST_CHANNELS;
+  desc.audio_res = TEST_RES;
+  for(r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+  {
+    for(f = 0; f < sizeof(freqs) / sizeof(freqs[0]); f++)
+    {
+      desc.frequence = freqs[f];
+      AUDIO_PacketSchedulerInit(&scheduler, &desc, rates[r]);
+      total = 0;
+      for(i = 0; i < 2U * rates[r]; i++)
+      {
+        length = AUDIO_PacketSchedulerPeek(&scheduler);
+        TEST_CHECK(length == AUDIO_PacketSchedulerNext(&scheduler), "peek differs at packet %u", (unsigned)i);
+        TEST_CHECK((length == scheduler.short_length) || (length == scheduler.long_length), "length %u", (unsigned)length);
+        total += length;
+        if(i == rates[r] - 1U)
+        {
+          TEST_CHECK(total == freqs[f] * TEST_FRAME_SIZE, "%u Hz at %u packets/s : %u bytes in a second",
+                     (unsigned)freqs[f], (unsigned)rates[r], (unsigned)total);
+        }
+      }
+      TEST_CHECK(total == 2U * freqs[f] * TEST_FRAME_SIZE, "%u Hz at %u packets/s : %u bytes in two seconds",
+                 (unsigned)freqs[f], (unsigned)rates[r], (unsigned)total);
+    }
+  }
+}
+
+/**
+  * @brief  TEST_Bench
+  *         host time of the per frame steps, a relative measure only : the
+  *         target figures come from the USE_AUDIO_BENCH build
+  * @param  None
+  * @retval None
+  */
+static void TEST_Bench(void)
+{
+  AUDIO_BufferTypeDef buf;
+  AUDIO_SyncFeedbackTypeDef feedback;
+  AUDIO_ResamplerTypeDef resampler;
+  AUDIO_PacketSchedulerTypeDef scheduler;
+  AUDIO_DescriptionTypeDef desc;
+  uint32_t packet_length = AUDIO_MS_PACKET_SIZE(48000U, TEST_CHANNELS, TEST_RES);
+  int32_t target = (int32_t)(packet_length * TEST_LATENCY_MS) << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+  int32_t max_deviation = (int32_t)(48000U << TEST_RATE_FRAC_BITS) >> AUDIO_FEEDBACK_MAX_DEVIATION_SHIFT;
+  volatile int32_t sink = 0;
+  uint32_t i;
+  double start;
+
+  memset(&feedback, 0, sizeof(feedback));
+  feedback.fill_avg = target;
+  start = TEST_Now();
+  for(i = 0; i < TEST_BENCH_LOOPS; i++)
+  {
+    sink += AUDIO_SyncFeedbackStep(&feedback, target + (int32_t)((i & 15U) << 6) - 512, target,
+                                   (int32_t)TEST_FRAME_SIZE, max_deviation, AUDIO_FEEDBACK_FILL_AVG_SHIFT);
+  }
+  printf("feedback step          %7.2f ns\n", (TEST_Now() - start) * 1e9 / TEST_BENCH_LOOPS);
+
+  start = TEST_Now();
+  for(i = 0; i < TEST_BENCH_LOOPS; i++)
+  {
+    sink += AUDIO_SyncResamplerCorrection(4096 + (int32_t)(i & 255U) - 128, 4096, (int32_t)TEST_FRAME_SIZE,
+                                          (int32_t)AUDIO_RESAMPLER_STEP_ONE);
+  }
+  printf("resampler correction   %7.2f ns\n", (TEST_Now() - start) * 1e9 / TEST_BENCH_LOOPS);
+
+  memset(&desc, 0, sizeof(desc));
+  desc.frequence = 44100U;
+  desc.channels_count = TEST_CHANNELS;
+  desc.audio_res = TEST_RES;
+  AUDIO_PacketSchedulerInit(&scheduler, &desc, 1000U);
+  start = TEST_Now();
+  for(i = 0; i < TEST_BENCH_LOOPS; i++)
+  {
+    sink += AUDIO_PacketSchedulerNext(&scheduler);
+  }
+  printf("scheduler next         %7.2f ns\n", (TEST_Now() - start) * 1e9 / TEST_BENCH_LOOPS);
+
+  TEST_RingInit(&buf, 0);
+  start = TEST_Now();
+  for(i = 0; i < TEST_BENCH_LOOPS / 10U; i++)
+  {
+    AUDIO_BufferWrite(&buf, test_packet, packet_length);
+    AUDIO_BufferRead(&buf, test_packet, packet_length);
+  }
+  printf("ring write+read %4u B %7.2f ns\n", (unsigned)packet_length,
+         (TEST_Now() - start) * 1e9 / (TEST_BENCH_LOOPS / 10U));
+
+  TEST_RingInit(&buf, AUDIO_BUFFER_MIRRORED);
+  AUDIO_ResamplerInit(&resampler, TEST_CHANNELS, TEST_RES);
+  AUDIO_ResamplerSetStep(&resampler, AUDIO_RESAMPLER_STEP_ONE + (AUDIO_RESAMPLER_STEP_ONE >> 10));
+  start = TEST_Now();
+  for(i = 0; i < TEST_BENCH_LOOPS / 100U; i++)
+  {
+    AUDIO_BufferWrite(&buf, test_packet, packet_length);
+    AUDIO_BufferCommitRead(&buf, AUDIO_ResamplerProcess(&resampler, &buf, test_packet, packet_length / TEST_FRAME_SIZE));
+  }
+  printf("resampler %4u frames   %7.2f ns\n", (unsigned)(packet_length / TEST_FRAME_SIZE),
+         (TEST_Now() - start) * 1e9 / (TEST_BENCH_LOOPS / 100U));
+  (void)sink;
+}
+
+/**
+  * @brief  TEST_Now
+  *         monotonic time
+  * @param  None
+  * @retval seconds
+  */
+static double TEST_Now(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,410 @@
+/**
+  ******************************************************************************
+  * @file    audio_aec_node.c
+  * @brief   Acoustic echo canceller : each speaker DMA half, as it is given to
+  *          the DMA, is kept as a mono 16 bits reference. An NLMS filter per
+  *          mic channel estimates the echo of this reference and removes it
+  *          from every captured mic half before it is published in the record
+  *          ring. Both sessions run from one clock, so once a mic half has set
+  *          the reference position it keeps pace with the microphone sample
+  *          by sample; the filter covers the acoustic path plus the half of
+  *          uncertainty between the two DMA interrupts. The echo is filtered
+  *          with SMLALD, two taps per cycle, and adaptation stops while the
+  *          near end talks (Geigel detector).
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_aec_node.h"
+#include "audio_pcm.h"
+
+#ifdef USE_AUDIO_AEC
+#ifndef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
+#error "USE_AUDIO_AEC aligns the mic on the speaker samples, it needs USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC"
+#endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+#if defined(USE_AUDIO_SPEAKER_DUMMY) || defined(USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_AEC needs the SAI speaker and a SAI or MEMS mic"
+#endif /* USE_AUDIO_SPEAKER_DUMMY || USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_MDMA_COPY
+#error "USE_AUDIO_AEC reads the speaker halves when the DMA gets them, the MDMA may not have completed them"
+#endif /* USE_AUDIO_MDMA_COPY */
+#if (USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT > AUDIO_AEC_MAX_CHANNELS)
+#error "USE_AUDIO_AEC cancels the echo on up to AUDIO_AEC_MAX_CHANNELS mic channels"
+#endif /* USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT */
+#if ((AUDIO_AEC_TAPS % 2U) != 0U) || (AUDIO_AEC_TAPS > AUDIO_AEC_REF_FRAMES / 4U)
+#error "AUDIO_AEC_TAPS must be even and leave room for the speaker halves in the reference"
+#endif /* AUDIO_AEC_TAPS */
+#if ((AUDIO_AEC_TAPS * USB_AUDIO_CONFIG_RECORD_FREQ_MAX / 1000U) * USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT > \
+     AUDIO_AEC_MAX_TAP_RATE / 1000U)
+#error "the echo canceller doesn't fit its share of the core, lower AUDIO_AEC_TAPS"
+#endif /* AUDIO_AEC_MAX_TAP_RATE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_AEC_REF_INDEX(frame)        ((frame) & (AUDIO_AEC_REF_FRAMES - 1U))
+#define AUDIO_AEC_STEP_LIMIT              0xFFFF   /* |step| * |sample| stays in 32 bits */
+#define AUDIO_AEC_POWER_SMOOTHING         0.1f     /* per mic half */
+
+/* Private variables ---------------------------------------------------------*/
+/* written twice, the filter window is contiguous. Written by the speaker DMA
+   interrupt, read by the mic one */
+static int16_t aec_reference[2U * AUDIO_AEC_REF_FRAMES] USBD_DTCM_BSS;
+static volatile uint32_t aec_ref_written = 0;    /* free running reference frames */
+static volatile uint32_t aec_ref_frequency = 0;  /* 0 until the speaker plays */
+static volatile uint32_t aec_ref_half = 0;       /* reference frames of a speaker half */
+static AUDIO_Aec_NodeTypeDef *current_aec = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_AecDeInit(uint32_t node_handle);
+static int8_t  AUDIO_AecStart(uint32_t node_handle);
+static int8_t  AUDIO_AecStop(uint32_t node_handle);
+static void    AUDIO_AecSync(AUDIO_Aec_NodeTypeDef* aec, uint32_t written, uint32_t frames);
+static int32_t AUDIO_AecFilter(const AUDIO_AecChannelTypeDef* channel, const int16_t* window) USBD_ITCM_FUNC;
+static void    AUDIO_AecAdapt(AUDIO_AecChannelTypeDef* channel, const int16_t* window, int32_t step) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_AecInit
+  *         Initializes the echo canceller of the record session, the filters
+  *         start from no echo
+  * @param  audio_description: record audio parameters
+  * @param  session_handle:   record session handle
+  * @param  node_handle:      echo canceller node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_AecInit(AUDIO_DescriptionTypeDef* audio_description,
+                      AUDIO_SessionTypeDef* session_handle,
+                      uint32_t node_handle)
+{
+  AUDIO_Aec_NodeTypeDef* aec = (AUDIO_Aec_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_AEC_MAX_CHANNELS) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(aec, 0, sizeof(AUDIO_Aec_NodeTypeDef));
+  aec->node.state = AUDIO_NODE_INITIALIZED;
+  aec->node.type = AUDIO_PROCESSING;
+  aec->node.session_handle = session_handle;
+  aec->node.audio_description = audio_description;
+
+  aec->AecDeInit = AUDIO_AecDeInit;
+  aec->AecStart = AUDIO_AecStart;
+  aec->AecStop = AUDIO_AecStop;
+  current_aec = aec;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AecReference
+  *         keeps the frames of a speaker half as reference, the first two
+  *         channels mixed to mono. Called by the SAI speaker node with each
+  *         half it gives to the DMA, in the slot layout : int16 for 16 bits,
+  *         right aligned 24 bits or int32 in 32 bits slots
+  * @param  half: speaker DMA half
+  * @param  frames: frames count of the half
+  * @param  audio_description: speaker audio parameters
+  * @param  frequency: rate the half is played at
+  * @retval None
+  */
+void  AUDIO_AecReference(const uint8_t* half, uint32_t frames, const AUDIO_DescriptionTypeDef* audio_description,
+                         uint32_t frequency)
+{
+  uint8_t  channels = audio_description->channels_count;
+  uint8_t  mixed = (channels > 1U) ? 2U : 1U;
+  uint32_t written = aec_ref_written;
+  uint32_t index;
+  int32_t  x;
+  uint32_t i;
+  uint8_t  ch;
+
+  for(i = 0; i < frames; i++)
+  {
+    x = 0;
+    for(ch = 0; ch < mixed; ch++)
+    {
+      if(audio_description->audio_res == 2U)
+      {
+        x += ((const int16_t*)half)[ch];
+      }
+      else if(audio_description->audio_res == AUDIO_PCM_PACKED_24_BYTES)
+      {
+        x += (int32_t)(((const uint32_t*)half)[ch] << 8) >> 16;
+      }
+      else
+      {
+        x += ((const int32_t*)half)[ch] >> 16;
+      }
+    }
+    half += channels * ((audio_description->audio_res == 2U) ? 2U : 4U);
+    index = AUDIO_AEC_REF_INDEX(written + i);
+    aec_reference[index] = (int16_t)(x / mixed);
+    aec_reference[index + AUDIO_AEC_REF_FRAMES] = aec_reference[index];
+  }
+  aec_ref_frequency = frequency;
+  aec_ref_half = frames;
+  /* the frames are in the reference before they are counted */
+  __DMB();
+  aec_ref_written = written + frames;
+}
+
+/**
+  * @brief  AUDIO_AecCancel
+  *         removes the echo from a captured mic half, in place in the record
+  *         ring before it is published. Called by the mic nodes from their
+  *         DMA interrupt. The half is left untouched while the speaker doesn't
+  *         play at the record rate
+  * @param  region: region of the record ring holding the half
+  * @retval None
+  */
+void  AUDIO_AecCancel(AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_Aec_NodeTypeDef* aec = current_aec;
+  AUDIO_DescriptionTypeDef* desc;
+  const int16_t* window;
+  uint32_t written, half;
+  uint32_t frame_length, frames;
+  uint32_t offset = 0;
+  int32_t  distance;
+  int32_t  x_new, x_old;
+  int32_t  d, d16, y, e16;
+  int32_t  step;
+  float    mic_power = 0.0f;
+  float    out_power = 0.0f;
+  uint32_t i;
+  uint8_t  shift;
+  uint8_t  res;
+  uint8_t  ch;
+
+  if((aec == 0) || (aec->node.state != AUDIO_NODE_STARTED))
+  {
+    return;
+  }
+  desc = aec->node.audio_description;
+  if(aec_ref_frequency != desc->frequence)
+  {
+    aec->synced = 0;
+    return;
+  }
+  written = aec_ref_written;
+  half = aec_ref_half;
+  res = desc->audio_res;
+  shift = 8U * (res - 2U);
+  frame_length = AUDIO_SAMPLE_LENGTH(desc);
+  frames = (region->length[0] + region->length[1]) / frame_length;
+
+  /* one to three speaker halves of reference after the half, else back to two */
+  distance = (int32_t)(written - (aec->rd + frames));
+  if((aec->synced == 0U) || (distance < (int32_t)half) || (distance > (int32_t)(3U * half)))
+  {
+    if(written == aec->sync_written)
+    {
+      /* the speaker stopped, nothing to cancel */
+      aec->synced = 0;
+      return;
+    }
+    aec->slips += aec->synced;
+    AUDIO_AecSync(aec, written, frames);
+  }
+
+  for(i = 0; i < frames; i++)
+  {
+    /* window of the reference ending at the frame */
+    x_new = aec_reference[AUDIO_AEC_REF_INDEX(aec->rd)];
+    x_old = aec_reference[AUDIO_AEC_REF_INDEX(aec->rd - AUDIO_AEC_TAPS)];
+    aec->energy += (uint32_t)((x_new * x_new) >> 8) - (uint32_t)((x_old * x_old) >> 8);
+    x_new = (x_new < 0) ? -x_new : x_new;
+    aec->peak = (x_new > aec->peak) ? x_new : aec->peak - (aec->peak >> AUDIO_AEC_PEAK_RELEASE_SHIFT);
+    window = &aec_reference[AUDIO_AEC_REF_INDEX(aec->rd) + AUDIO_AEC_REF_FRAMES - (AUDIO_AEC_TAPS - 1U)];
+    aec->rd++;
+
+    for(ch = 0; ch < desc->channels_count; ch++)
+    {
+      d = AUDIO_PcmRegionRead(region, offset, res);
+      d16 = __SSAT(d >> shift, 16);
+      y = AUDIO_AecFilter(&aec->channel[ch], window);
+      e16 = __SSAT(d16 - y, 16);
+      if(res == 4U)
+      {
+        d = ((int64_t)d - ((int64_t)y << shift) > INT32_MAX) ? INT32_MAX :
+            (((int64_t)d - ((int64_t)y << shift) < INT32_MIN) ? INT32_MIN : d - (y << shift));
+      }
+      else
+      {
+        d = __SSAT(d - (y << shift), 8U * res);
+      }
+      AUDIO_PcmRegionWrite(region, offset, d, res);
+      offset += res;
+      mic_power += (float)(d16 * d16);
+      out_power += (float)(e16 * e16);
+
+      /* the echo is assumed 6 dB below the speaker, anything louder is the near end */
+      if(((d16 < 0) ? -d16 : d16) > (aec->peak >> 1))
+      {
+        aec->channel[ch].hold = AUDIO_AEC_TAPS;
+      }
+      if(aec->channel[ch].hold != 0U)
+      {
+        aec->channel[ch].hold--;
+        continue;
+      }
+      /* normalized step, the weights are Q31 : mu . e . 2^31 / (256 . energy) */
+      step = (int32_t)(AUDIO_AEC_STEP * (float)e16 * 8388608.0f / (float)(aec->energy + AUDIO_AEC_ENERGY_FLOOR));
+      step = (step > AUDIO_AEC_STEP_LIMIT) ? AUDIO_AEC_STEP_LIMIT :
+             ((step < -AUDIO_AEC_STEP_LIMIT) ? -AUDIO_AEC_STEP_LIMIT : step);
+      AUDIO_AecAdapt(&aec->channel[ch], window, step);
+    }
+  }
+  aec->mic_power += AUDIO_AEC_POWER_SMOOTHING * (mic_power - aec->mic_power);
+  aec->out_power += AUDIO_AEC_POWER_SMOOTHING * (out_power - aec->out_power);
+}
+
+/**
+  * @brief  AUDIO_AecGetStatus
+  *         returns the alignment state and the echo return loss enhancement
+  * @param  synced: returned 1 while the mic is aligned on the reference
+  * @param  slips: returned count of reference position moves since start
+  * @param  erle_db_256: returned echo attenuation in dB 8.8
+  * @retval 0 if no error, -1 when not initialized
+  */
+int8_t  AUDIO_AecGetStatus(uint8_t* synced, uint32_t* slips, int* erle_db_256)
+{
+  AUDIO_Aec_NodeTypeDef* aec = current_aec;
+
+  if(aec == 0)
+  {
+    return -1;
+  }
+  *synced = aec->synced;
+  *slips = aec->slips;
+  *erle_db_256 = ((aec->mic_power > 0.0f) && (aec->out_power > 0.0f)) ?
+                 (int)(2560.0f * log10f(aec->mic_power / aec->out_power)) : 0;
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_AecDeInit
+  *         De-Initializes the echo canceller node
+  * @param  node_handle: echo canceller node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AecDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Aec_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AecStart
+  *         Starts cancelling, the first mic half aligns on the reference. The
+  *         filters keep what they learnt, the echo path hasn't changed
+  * @param  node_handle: echo canceller node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AecStart(uint32_t node_handle)
+{
+  AUDIO_Aec_NodeTypeDef* aec = (AUDIO_Aec_NodeTypeDef*)node_handle;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  aec->synced = 0;
+  aec->slips = 0;
+  aec->sync_written = aec_ref_written - 1U;
+  aec->node.state = AUDIO_NODE_STARTED;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AecStop
+  *         Stops cancelling, the mic halves are left untouched
+  * @param  node_handle: echo canceller node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AecStop(uint32_t node_handle)
+{
+  ((AUDIO_Aec_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AecSync
+  *         aligns the mic half on the reference : the last reference half is
+  *         played after the current one, the reference of the newest mic
+  *         frame is two halves back, at most one half before it was heard.
+  *         The window energy is computed again
+  * @param  aec: echo canceller node
+  * @param  written: reference frames written
+  * @param  frames: frames of the mic half
+  * @retval None
+  */
+static void  AUDIO_AecSync(AUDIO_Aec_NodeTypeDef* aec, uint32_t written, uint32_t frames)
+{
+  int32_t  x;
+  uint32_t j;
+
+  aec->rd = written - 2U * aec_ref_half - frames;
+  aec->energy = 0;
+  aec->peak = 0;
+  for(j = 1U; j <= AUDIO_AEC_TAPS; j++)
+  {
+    x = aec_reference[AUDIO_AEC_REF_INDEX(aec->rd - j)];
+    aec->energy += (uint32_t)((x * x) >> 8);
+  }
+  aec->sync_written = written;
+  aec->synced = 1;
+}
+
+/**
+  * @brief  AUDIO_AecFilter
+  *         echo estimate of a mic channel, two taps per SMLALD
+  * @param  channel: mic channel filter
+  * @param  window: reference window, oldest frame first
+  * @retval echo in 16 bits samples
+  */
+static int32_t  AUDIO_AecFilter(const AUDIO_AecChannelTypeDef* channel, const int16_t* window)
+{
+  const int16_t* weight = channel->weight16;
+  uint64_t acc = 0;
+  uint32_t j;
+
+  for(j = 0; j < AUDIO_AEC_TAPS; j += 2U)
+  {
+    acc = __SMLALD(__UNALIGNED_UINT32_READ(&window[j]), __UNALIGNED_UINT32_READ(&weight[j]), acc);
+  }
+  return (int32_t)((int64_t)acc >> 15);
+}
+
+/**
+  * @brief  AUDIO_AecAdapt
+  *         NLMS update of the weights of a mic channel
+  * @param  channel: mic channel filter
+  * @param  window: reference window, oldest frame first
+  * @param  step: normalized error, |step| * 32768 fits 32 bits
+  * @retval None
+  */
+static void  AUDIO_AecAdapt(AUDIO_AecChannelTypeDef* channel, const int16_t* window, int32_t step)
+{
+  uint32_t j;
+
+  for(j = 0; j < AUDIO_AEC_TAPS; j++)
+  {
+    channel->weight[j] = __QADD(channel->weight[j], step * window[j]);
+    channel->weight16[j] = (int16_t)(channel->weight[j] >> 16);
+  }
+}
+#endif /* USE_AUDIO_AEC */
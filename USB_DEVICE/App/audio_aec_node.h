@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    audio_aec_node.h
+  * @brief   header file for the audio_aec_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_AEC_NODE_H
+#define __AUDIO_AEC_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_AEC
+/* Exported constants --------------------------------------------------------*/
+/* echo path length, the reference lags the speaker output by up to one half */
+#ifndef AUDIO_AEC_TAPS
+#define AUDIO_AEC_TAPS                  256U
+#endif /* AUDIO_AEC_TAPS */
+#define AUDIO_AEC_MAX_CHANNELS          2U
+#define AUDIO_AEC_REF_FRAMES            2048U /* power of 2, reference frames kept */
+#define AUDIO_AEC_STEP                  0.25f /* NLMS step size */
+#define AUDIO_AEC_ENERGY_FLOOR          (AUDIO_AEC_TAPS * 4U) /* window energy / 256 below which the step shrinks, about -54 dBFS */
+#define AUDIO_AEC_PEAK_RELEASE_SHIFT    8U    /* reference peak follower decay per frame */
+/* taps filtered and adapted per second, over all channels : about 3.5 cycles
+   per tap, 15 % of the core at 550 MHz */
+#define AUDIO_AEC_MAX_TAP_RATE          25000000U
+
+/* Exported types ------------------------------------------------------------*/
+/* adaptive filter of one mic channel */
+typedef struct
+{
+  int32_t                  weight[AUDIO_AEC_TAPS];     /* Q31 , oldest reference frame first */
+  int16_t                  weight16[AUDIO_AEC_TAPS];   /* Q15 high half words, filtered with SMLAD */
+  uint32_t                 hold;                       /* frames left without adaptation after double talk */
+}
+AUDIO_AecChannelTypeDef;
+
+/* echo canceller : the reference is what the speaker plays, the echo estimate
+   is removed from the mic frames before they reach the record ring */
+typedef struct
+{
+  AUDIO_NodeTypeDef        node;               /* node structure , must be first field */
+  AUDIO_AecChannelTypeDef  channel[AUDIO_AEC_MAX_CHANNELS];
+  uint32_t                 rd;                 /* free running reference frame of the next mic frame */
+  uint32_t                 energy;             /* squares / 256 of the reference window */
+  int32_t                  peak;               /* reference peak follower , double talk detection */
+  float                    mic_power;          /* smoothed power in and out , echo return loss enhancement */
+  float                    out_power;
+  uint32_t                 slips;              /* reference position moved back in place */
+  uint32_t                 sync_written;       /* reference frames written at the last alignment */
+  uint8_t                  synced;             /* 0 until a mic half sets rd */
+  int8_t                  (*AecDeInit) (uint32_t /*node_handle*/);
+  int8_t                  (*AecStart)  (uint32_t /*node_handle*/);
+  int8_t                  (*AecStop)   (uint32_t /*node_handle*/);
+}
+AUDIO_Aec_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_AecInit(AUDIO_DescriptionTypeDef* audio_description,
+                      AUDIO_SessionTypeDef* session_handle,
+                      uint32_t node_handle);
+void    AUDIO_AecReference(const uint8_t* half, uint32_t frames, const AUDIO_DescriptionTypeDef* audio_description,
+                           uint32_t frequency) USBD_ITCM_FUNC;
+void    AUDIO_AecCancel(AUDIO_BufferRegionTypeDef* region) USBD_ITCM_FUNC;
+int8_t  AUDIO_AecGetStatus(uint8_t* synced, uint32_t* slips, int* erle_db_256);
+#endif /* USE_AUDIO_AEC */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_AEC_NODE_H */
@@ -0,0 +1,297 @@
+/**
+  ******************************************************************************
+  * @file    audio_agc_node.c
+  * @brief   Mic automatic gain control and noise gate : a peak envelope of
+  *          the frames sets one gain for all channels, which brings the
+  *          envelope to the target level. The gain goes down with the attack
+  *          constant, is held, then goes up with the decay constant; it is
+  *          kept while the gate is closed so the noise isn't raised. The gate
+  *          closes once the envelope stayed below its threshold for the gate
+  *          hold. Fixed point, in place in the record ring before the half is
+  *          published, so the host gets levelled samples.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_agc_node.h"
+#include "audio_pcm.h"
+
+#ifdef USE_AUDIO_MIC_AGC
+#if (AUDIO_AGC_ENV_ATTACK_FRAMES == 0U) || (AUDIO_AGC_ENV_RELEASE_FRAMES == 0U) || \
+    (AUDIO_AGC_ATTACK_FRAMES == 0U) || (AUDIO_AGC_DECAY_FRAMES == 0U)
+#error "the AGC time constants must not be zero"
+#endif /* AUDIO_AGC_ENV_ATTACK_FRAMES */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_AGC_MUL(x, coef)          ((int32_t)(((int64_t)(x) * (coef)) >> 31))
+#define AUDIO_AGC_TARGET_MIN_DB_256     (-40 * 256)
+#define AUDIO_AGC_MAX_GAIN_LIMIT_DB_256 (40 * 256)
+#define AUDIO_AGC_GATE_MIN_DB_256       (-90 * 256)
+#define AUDIO_AGC_GATE_MAX_DB_256       (-20 * 256)
+#define AUDIO_AGC_SILENCE_DB_256        (-200 * 256) /* reported for a null envelope */
+
+/* Private variables ---------------------------------------------------------*/
+/* set from the pump by the CDC commands */
+static AUDIO_Agc_NodeTypeDef *current_agc = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_AgcDeInit(uint32_t node_handle);
+static int8_t   AUDIO_AgcStart(uint32_t node_handle);
+static int8_t   AUDIO_AgcStop(uint32_t node_handle);
+static uint32_t AUDIO_AgcLevel(int db_256);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_AgcInit
+  *         Initializes the AGC of the record session with the build time
+  *         levels and time constants
+  * @param  audio_description: record audio parameters
+  * @param  session_handle:   record session handle
+  * @param  node_handle:      AGC node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_AgcInit(AUDIO_DescriptionTypeDef* audio_description,
+                      AUDIO_SessionTypeDef* session_handle,
+                      uint32_t node_handle)
+{
+  AUDIO_Agc_NodeTypeDef* agc = (AUDIO_Agc_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(agc, 0, sizeof(AUDIO_Agc_NodeTypeDef));
+  agc->node.state = AUDIO_NODE_INITIALIZED;
+  agc->node.type = AUDIO_PROCESSING;
+  agc->node.session_handle = session_handle;
+  agc->node.audio_description = audio_description;
+  agc->gate_floor = (int32_t)AUDIO_AgcLevel(AUDIO_AGC_GATE_FLOOR_DB_256);
+  agc->env_attack = AUDIO_AGC_GATE_UNITY / (int32_t)AUDIO_AGC_ENV_ATTACK_FRAMES;
+  agc->env_release = AUDIO_AGC_GATE_UNITY / (int32_t)AUDIO_AGC_ENV_RELEASE_FRAMES;
+  agc->attack = AUDIO_AGC_GATE_UNITY / (int32_t)AUDIO_AGC_ATTACK_FRAMES;
+  agc->decay = AUDIO_AGC_GATE_UNITY / (int32_t)AUDIO_AGC_DECAY_FRAMES;
+  /* the gate opens as fast as the envelope rises and fades as it releases */
+  agc->gate_attack = agc->env_attack;
+  agc->gate_release = agc->env_release;
+
+  agc->AgcDeInit = AUDIO_AgcDeInit;
+  agc->AgcStart = AUDIO_AgcStart;
+  agc->AgcStop = AUDIO_AgcStop;
+  current_agc = agc;
+  return AUDIO_AgcSetLevels(AUDIO_AGC_TARGET_DB_256, AUDIO_AGC_MAX_GAIN_DB_256, AUDIO_AGC_GATE_THRESHOLD_DB_256);
+}
+
+/**
+  * @brief  AUDIO_AgcProcess
+  *         levels a captured mic half, in place in the record ring before it
+  *         is published. Called by the mic nodes from their DMA interrupt
+  * @param  region: region of the record ring holding the half
+  * @retval None
+  */
+void  AUDIO_AgcProcess(AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_Agc_NodeTypeDef* agc = current_agc;
+  int32_t  x[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  uint32_t offset = 0;
+  uint32_t frames;
+  uint32_t peak, magnitude;
+  uint32_t ratio;
+  int32_t  desired, coef, total;
+  int64_t  y;
+  uint32_t i;
+  uint8_t  channels, res, shift;
+  uint8_t  ch;
+
+  if((agc == 0) || (agc->node.state != AUDIO_NODE_STARTED))
+  {
+    return;
+  }
+  channels = agc->node.audio_description->channels_count;
+  res = agc->node.audio_description->audio_res;
+  /* Q31 samples */
+  shift = 32U - 8U * res;
+  frames = (region->length[0] + region->length[1]) / AUDIO_SAMPLE_LENGTH(agc->node.audio_description);
+
+  for(i = 0; i < frames; i++)
+  {
+    peak = 0;
+    for(ch = 0; ch < channels; ch++)
+    {
+      x[ch] = (int32_t)((uint32_t)AUDIO_PcmRegionRead(region, offset + ch * res, res) << shift);
+      magnitude = (x[ch] < 0) ? (uint32_t)(-(int64_t)x[ch]) : (uint32_t)x[ch];
+      peak = (magnitude > peak) ? magnitude : peak;
+    }
+    peak = (peak > (uint32_t)AUDIO_AGC_GATE_UNITY) ? (uint32_t)AUDIO_AGC_GATE_UNITY : peak;
+    agc->envelope += AUDIO_AGC_MUL((int32_t)peak - (int32_t)agc->envelope,
+                                   (peak > agc->envelope) ? agc->env_attack : agc->env_release);
+
+    /* noise gate */
+    if(agc->envelope >= agc->gate_threshold)
+    {
+      agc->gate_open = 1;
+      agc->gate_hold = AUDIO_AGC_GATE_HOLD_FRAMES;
+    }
+    else if(agc->gate_hold != 0U)
+    {
+      agc->gate_hold--;
+    }
+    else
+    {
+      agc->gate_open = 0;
+    }
+    agc->gate += AUDIO_AGC_MUL((agc->gate_open ? AUDIO_AGC_GATE_UNITY : agc->gate_floor) - agc->gate,
+                               agc->gate_open ? agc->gate_attack : agc->gate_release);
+
+    /* gain bringing the envelope to the target, the noise doesn't move it */
+    if(agc->gate_open)
+    {
+      /* Q16 division on the 16 high bits, UDIV is a few cycles */
+      ratio = ((agc->target >> 15) << 16) / ((agc->envelope >> 15) | 1U);
+      desired = (ratio > ((uint32_t)agc->max_gain >> 8)) ? agc->max_gain : (int32_t)(ratio << 8);
+      if(desired < agc->gain)
+      {
+        agc->hold = AUDIO_AGC_HOLD_FRAMES;
+        coef = agc->attack;
+      }
+      else
+      {
+        coef = (agc->hold != 0U) ? 0 : agc->decay;
+        agc->hold -= (agc->hold != 0U);
+      }
+      agc->gain += AUDIO_AGC_MUL(desired - agc->gain, coef);
+    }
+
+    total = AUDIO_AGC_MUL(agc->gain, agc->gate);
+    for(ch = 0; ch < channels; ch++)
+    {
+      y = ((int64_t)x[ch] * total) >> 24;
+      y = (y > INT32_MAX) ? INT32_MAX : ((y < INT32_MIN) ? INT32_MIN : y);
+      AUDIO_PcmRegionWrite(region, offset, (int32_t)y >> shift, res);
+      offset += res;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_AgcSetLevels
+  *         changes the levels, applied from the next frame. Called from the
+  *         pump
+  * @param  target_db_256: envelope target, -40 to 0 dBFS
+  * @param  max_gain_db_256: highest gain, 0 to 40 dB
+  * @param  gate_db_256: gate threshold, -90 to -20 dBFS
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_AgcSetLevels(int target_db_256, int max_gain_db_256, int gate_db_256)
+{
+  if((current_agc == 0) ||
+     (target_db_256 < AUDIO_AGC_TARGET_MIN_DB_256) || (target_db_256 > 0) ||
+     (max_gain_db_256 < 0) || (max_gain_db_256 > AUDIO_AGC_MAX_GAIN_LIMIT_DB_256) ||
+     (gate_db_256 < AUDIO_AGC_GATE_MIN_DB_256) || (gate_db_256 > AUDIO_AGC_GATE_MAX_DB_256))
+  {
+    return -1;
+  }
+  current_agc->target = AUDIO_AgcLevel(target_db_256);
+  current_agc->max_gain = (int32_t)(powf(10.0f, (float)max_gain_db_256 / (256.0f * 20.0f)) *
+                                    (float)AUDIO_AGC_GAIN_UNITY);
+  current_agc->gate_threshold = AUDIO_AgcLevel(gate_db_256);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AgcGetStatus
+  *         returns the gain applied, the gate included, and the envelope
+  * @param  gain_db_256: returned gain in dB 8.8
+  * @param  envelope_db_256: returned envelope in dBFS 8.8
+  * @param  gate_open: returned 1 while the gate is open
+  * @retval 0 if no error, -1 when not initialized
+  */
+int8_t  AUDIO_AgcGetStatus(int* gain_db_256, int* envelope_db_256, uint8_t* gate_open)
+{
+  AUDIO_Agc_NodeTypeDef* agc = current_agc;
+  int32_t total;
+
+  if(agc == 0)
+  {
+    return -1;
+  }
+  total = AUDIO_AGC_MUL(agc->gain, agc->gate);
+  *gain_db_256 = (total > 0) ? (int)(256.0f * 20.0f * log10f((float)total / (float)AUDIO_AGC_GAIN_UNITY)) :
+                 AUDIO_AGC_SILENCE_DB_256;
+  *envelope_db_256 = (agc->envelope > 0U) ?
+                     (int)(256.0f * 20.0f * log10f((float)agc->envelope / (float)AUDIO_AGC_GATE_UNITY)) :
+                     AUDIO_AGC_SILENCE_DB_256;
+  *gate_open = agc->gate_open;
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_AgcDeInit
+  *         De-Initializes the AGC node
+  * @param  node_handle: AGC node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AgcDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Agc_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AgcStart
+  *         Starts levelling at unity gain, the gate closed
+  * @param  node_handle: AGC node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AgcStart(uint32_t node_handle)
+{
+  AUDIO_Agc_NodeTypeDef* agc = (AUDIO_Agc_NodeTypeDef*)node_handle;
+
+  agc->envelope = 0;
+  agc->gain = AUDIO_AGC_GAIN_UNITY;
+  agc->hold = 0;
+  agc->gate = agc->gate_floor;
+  agc->gate_hold = 0;
+  agc->gate_open = 0;
+  agc->node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AgcStop
+  *         Stops levelling, the mic halves are left untouched
+  * @param  node_handle: AGC node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_AgcStop(uint32_t node_handle)
+{
+  ((AUDIO_Agc_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_AgcLevel
+  *         Q31 magnitude of a level, only conversion from dB
+  * @param  db_256: level in dBFS 8.8 , at most 0
+  * @retval magnitude
+  */
+static uint32_t  AUDIO_AgcLevel(int db_256)
+{
+  float level = powf(10.0f, (float)db_256 / (256.0f * 20.0f)) * 2147483647.0f;
+
+  return (level >= 2147483647.0f) ? (uint32_t)AUDIO_AGC_GATE_UNITY : (uint32_t)level;
+}
+#endif /* USE_AUDIO_MIC_AGC */
@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file    audio_agc_node.h
+  * @brief   header file for the audio_agc_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_AGC_NODE_H
+#define __AUDIO_AGC_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_MIC_AGC
+/* Exported constants --------------------------------------------------------*/
+/* default levels, changed with AUDIO_AgcSetLevels */
+#ifndef AUDIO_AGC_TARGET_DB_256
+#define AUDIO_AGC_TARGET_DB_256         (-18 * 256) /* envelope level the gain brings the mic to */
+#endif /* AUDIO_AGC_TARGET_DB_256 */
+#ifndef AUDIO_AGC_MAX_GAIN_DB_256
+#define AUDIO_AGC_MAX_GAIN_DB_256       (30 * 256)
+#endif /* AUDIO_AGC_MAX_GAIN_DB_256 */
+#ifndef AUDIO_AGC_GATE_THRESHOLD_DB_256
+#define AUDIO_AGC_GATE_THRESHOLD_DB_256 (-60 * 256) /* envelope level below which the gate closes */
+#endif /* AUDIO_AGC_GATE_THRESHOLD_DB_256 */
+#ifndef AUDIO_AGC_GATE_FLOOR_DB_256
+#define AUDIO_AGC_GATE_FLOOR_DB_256     (-40 * 256) /* attenuation of the closed gate */
+#endif /* AUDIO_AGC_GATE_FLOOR_DB_256 */
+/* time constants in frames, 48 kHz values */
+#ifndef AUDIO_AGC_ENV_ATTACK_FRAMES
+#define AUDIO_AGC_ENV_ATTACK_FRAMES     48U     /* envelope follower */
+#endif /* AUDIO_AGC_ENV_ATTACK_FRAMES */
+#ifndef AUDIO_AGC_ENV_RELEASE_FRAMES
+#define AUDIO_AGC_ENV_RELEASE_FRAMES    4800U
+#endif /* AUDIO_AGC_ENV_RELEASE_FRAMES */
+#ifndef AUDIO_AGC_ATTACK_FRAMES
+#define AUDIO_AGC_ATTACK_FRAMES         480U    /* gain down */
+#endif /* AUDIO_AGC_ATTACK_FRAMES */
+#ifndef AUDIO_AGC_DECAY_FRAMES
+#define AUDIO_AGC_DECAY_FRAMES          24000U  /* gain up, after the hold */
+#endif /* AUDIO_AGC_DECAY_FRAMES */
+#ifndef AUDIO_AGC_HOLD_FRAMES
+#define AUDIO_AGC_HOLD_FRAMES           14400U  /* gain kept after it went down, pauses don't pump */
+#endif /* AUDIO_AGC_HOLD_FRAMES */
+#ifndef AUDIO_AGC_GATE_HOLD_FRAMES
+#define AUDIO_AGC_GATE_HOLD_FRAMES      9600U   /* gate kept open below the threshold */
+#endif /* AUDIO_AGC_GATE_HOLD_FRAMES */
+#define AUDIO_AGC_GAIN_UNITY            0x1000000 /* Q24 , up to 40 dB */
+#define AUDIO_AGC_GATE_UNITY            0x7FFFFFFF /* Q31 */
+
+/* Exported types ------------------------------------------------------------*/
+/* automatic gain control and noise gate : one gain for all channels follows
+   the frame peak envelope */
+typedef struct
+{
+  AUDIO_NodeTypeDef  node;           /* node structure , must be first field */
+  uint32_t           envelope;       /* Q31 magnitude */
+  int32_t            gain;           /* Q24 , automatic gain */
+  uint32_t           hold;           /* frames the gain is kept */
+  int32_t            gate;           /* Q31 , gate gain */
+  uint32_t           gate_hold;      /* frames the gate stays open */
+  uint8_t            gate_open;
+  volatile uint32_t  target;         /* Q31 magnitude, changed from the pump */
+  volatile int32_t   max_gain;       /* Q24 */
+  volatile uint32_t  gate_threshold; /* Q31 magnitude */
+  int32_t            gate_floor;     /* Q31 */
+  int32_t            env_attack;     /* Q31 one pole coefficients */
+  int32_t            env_release;
+  int32_t            attack;
+  int32_t            decay;
+  int32_t            gate_attack;
+  int32_t            gate_release;
+  int8_t            (*AgcDeInit) (uint32_t /*node_handle*/);
+  int8_t            (*AgcStart)  (uint32_t /*node_handle*/);
+  int8_t            (*AgcStop)   (uint32_t /*node_handle*/);
+}
+AUDIO_Agc_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_AgcInit(AUDIO_DescriptionTypeDef* audio_description,
+                      AUDIO_SessionTypeDef* session_handle,
+                      uint32_t node_handle);
+void    AUDIO_AgcProcess(AUDIO_BufferRegionTypeDef* region) USBD_ITCM_FUNC;
+int8_t  AUDIO_AgcSetLevels(int target_db_256, int max_gain_db_256, int gate_db_256);
+int8_t  AUDIO_AgcGetStatus(int* gain_db_256, int* envelope_db_256, uint8_t* gate_open);
+#endif /* USE_AUDIO_MIC_AGC */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_AGC_NODE_H */
@@ -0,0 +1,241 @@
+/**
+  ******************************************************************************
+  * @file    audio_beamformer.c
+  * @brief   Delay and sum beamformer : the decimated mics of a linear array
+  *          are steered to one or two beams before the recording ring, the
+  *          host gets the beams instead of the raw mics. Each mic is delayed
+  *          by whole samples and a 4 taps Lagrange fractional delay, the taps
+  *          of every preset are computed on start at the stream rate. Samples
+  *          are kept on 16 bits, which is well below the noise floor of the
+  *          MEMS mics, so two taps are accumulated per SMLAD.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_beamformer.h"
+
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_BEAM_TAP_FRAC_BITS          15U
+#define AUDIO_BEAM_SAMPLE_SHIFT           8U   /* 24 bits PCM to 16 bits history */
+
+#if (AUDIO_BEAM_TAPS != 4U)
+#error "the beamformer kernel is unrolled for 4 taps"
+#endif /* AUDIO_BEAM_TAPS */
+
+/* Private variables ---------------------------------------------------------*/
+static const int8_t beam_preset_angles[AUDIO_BEAM_PRESET_COUNT] = AUDIO_BEAM_PRESET_ANGLES;
+/* read by the CDC commands from the pump */
+static AUDIO_BeamformerTypeDef *current_beamformer = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_BeamformerBuildPreset(AUDIO_BeamPresetTypeDef* preset, uint8_t mics, int32_t angle,
+                                           uint32_t frequency);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BeamformerInit
+  *         Initializes the beamformer, one beam is steered to broadside, two
+  *         beams to the first two side presets
+  * @param  beamformer: beamformer to initialize
+  * @param  mics: mics count , 2 to AUDIO_BEAM_MAX_MICS
+  * @param  beams: beams count , 1 to AUDIO_BEAM_MAX_BEAMS
+  * @retval None
+  */
+void  AUDIO_BeamformerInit(AUDIO_BeamformerTypeDef* beamformer, uint8_t mics, uint8_t beams)
+{
+  uint8_t b;
+
+  memset(beamformer, 0, sizeof(AUDIO_BeamformerTypeDef));
+  beamformer->mics = (mics > AUDIO_BEAM_MAX_MICS) ? AUDIO_BEAM_MAX_MICS : mics;
+  beamformer->beams = (beams > AUDIO_BEAM_MAX_BEAMS) ? AUDIO_BEAM_MAX_BEAMS : beams;
+  for(b = 0; b < beamformer->beams; b++)
+  {
+    beamformer->beam_preset[b] = (beamformer->beams == 1U) ? 0U : (1U + b);
+  }
+  current_beamformer = beamformer;
+}
+
+/**
+  * @brief  AUDIO_BeamformerReset
+  *         computes the presets at the stream rate and clears the history.
+  *         Must be called while not running
+  * @param  beamformer: beamformer
+  * @param  frequency: stream rate
+  * @retval None
+  */
+void  AUDIO_BeamformerReset(AUDIO_BeamformerTypeDef* beamformer, uint32_t frequency)
+{
+  uint8_t p;
+
+  for(p = 0; p < AUDIO_BEAM_PRESET_COUNT; p++)
+  {
+    AUDIO_BeamformerBuildPreset(&beamformer->preset[p], beamformer->mics, beam_preset_angles[p], frequency);
+  }
+  memset(beamformer->history, 0, sizeof(beamformer->history));
+  beamformer->pos = 0;
+}
+
+/**
+  * @brief  AUDIO_BeamformerRun
+  *         pushes the mic samples of each frame and sums the delayed mics of
+  *         each beam. The output frame is never after its input frame, so it
+  *         is written in place
+  * @param  beamformer: beamformer
+  * @param  pcm: 24 bits frames of the mics in, of the beams out
+  * @param  frames: frames count
+  * @retval None
+  */
+void  AUDIO_BeamformerRun(AUDIO_BeamformerTypeDef* beamformer, int32_t* pcm, uint32_t frames)
+{
+  const AUDIO_BeamPresetTypeDef* steering[AUDIO_BEAM_MAX_BEAMS];
+  const AUDIO_BeamPresetTypeDef* preset;
+  const int16_t* window;
+  const int32_t* in = pcm;
+  int32_t* out = pcm;
+  uint8_t  mics = beamformer->mics;
+  uint8_t  beams = beamformer->beams;
+  uint32_t newest;
+  int32_t  acc;
+  uint32_t i;
+  uint8_t  m, b;
+
+  /* a preset change applies from a whole half */
+  for(b = 0; b < beams; b++)
+  {
+    steering[b] = &beamformer->preset[beamformer->beam_preset[b]];
+  }
+  for(i = 0; i < frames; i++)
+  {
+    newest = beamformer->pos + AUDIO_BEAM_HISTORY;
+    for(m = 0; m < mics; m++)
+    {
+      beamformer->history[m][beamformer->pos] = (int16_t)(in[m] >> AUDIO_BEAM_SAMPLE_SHIFT);
+      beamformer->history[m][newest] = beamformer->history[m][beamformer->pos];
+    }
+    in += mics;
+    beamformer->pos = (beamformer->pos + 1U == AUDIO_BEAM_HISTORY) ? 0U : beamformer->pos + 1U;
+
+    for(b = 0; b < beams; b++)
+    {
+      preset = steering[b];
+      acc = 0;
+      for(m = 0; m < mics; m++)
+      {
+        window = &beamformer->history[m][newest - preset->delay[m] - (AUDIO_BEAM_TAPS - 1U)];
+        acc = __SMLAD(__UNALIGNED_UINT32_READ(window), preset->taps[m][0], acc);
+        acc = __SMLAD(__UNALIGNED_UINT32_READ(window + 2), preset->taps[m][1], acc);
+      }
+      /* Q15 taps on 16 bits samples back to 24 bits */
+      *out++ = __SSAT(acc >> (AUDIO_BEAM_TAP_FRAC_BITS - AUDIO_BEAM_SAMPLE_SHIFT), 24);
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_BeamformerSetPreset
+  *         steers a beam, from the next half. Called from the pump
+  * @param  beam: 0 to beams count - 1
+  * @param  preset: 0 to AUDIO_BEAM_PRESET_COUNT - 1
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_BeamformerSetPreset(uint8_t beam, uint8_t preset)
+{
+  if((current_beamformer == 0) || (beam >= current_beamformer->beams) || (preset >= AUDIO_BEAM_PRESET_COUNT))
+  {
+    return -1;
+  }
+  current_beamformer->beam_preset[beam] = preset;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_BeamformerGetPresets
+  *         reads the steering of the beams
+  * @param  presets: receives the preset of each beam
+  * @retval beams count, -1 when the beamformer is not initialized
+  */
+int8_t  AUDIO_BeamformerGetPresets(uint8_t* presets)
+{
+  uint8_t b;
+
+  if(current_beamformer == 0)
+  {
+    return -1;
+  }
+  for(b = 0; b < current_beamformer->beams; b++)
+  {
+    presets[b] = current_beamformer->beam_preset[b];
+  }
+  return (int8_t)current_beamformer->beams;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BeamformerBuildPreset
+  *         delays of a steering angle, relative to the mic heard last. The
+  *         Lagrange taps interpolate between the 4 newest samples of the
+  *         window at 1 + fraction samples, the same latency for all mics.
+  *         Delays beyond the history are clamped
+  * @param  preset: preset to compute
+  * @param  mics: mics count
+  * @param  angle: degrees from broadside
+  * @param  frequency: stream rate
+  * @retval None
+  */
+static void  AUDIO_BeamformerBuildPreset(AUDIO_BeamPresetTypeDef* preset, uint8_t mics, int32_t angle,
+                                         uint32_t frequency)
+{
+  float delay[AUDIO_BEAM_MAX_MICS];
+  float tap[AUDIO_BEAM_TAPS];
+  float step, latest, t;
+  int32_t q[AUDIO_BEAM_TAPS];
+  uint8_t m, j, k;
+
+  /* arrival of mic m after mic 0, in samples */
+  step = (float)AUDIO_BEAM_MIC_SPACING_UM * 1e-3f * sinf((float)angle * (float)M_PI / 180.0f) *
+         (float)frequency / (float)AUDIO_BEAM_SOUND_SPEED_MM_S;
+  latest = (step > 0.0f) ? step * (float)(mics - 1U) : 0.0f;
+  memset(preset, 0, sizeof(AUDIO_BeamPresetTypeDef));
+  for(m = 0; m < mics; m++)
+  {
+    /* early mics wait for the late ones */
+    delay[m] = latest - step * (float)m;
+    if(delay[m] > (float)(AUDIO_BEAM_HISTORY - AUDIO_BEAM_TAPS))
+    {
+      delay[m] = (float)(AUDIO_BEAM_HISTORY - AUDIO_BEAM_TAPS);
+    }
+    preset->delay[m] = (uint8_t)delay[m];
+    t = 1.0f + (delay[m] - (float)preset->delay[m]);
+    for(j = 0; j < AUDIO_BEAM_TAPS; j++)
+    {
+      /* tap j weights the sample j samples before the window newest */
+      tap[j] = 1.0f;
+      for(k = 0; k < AUDIO_BEAM_TAPS; k++)
+      {
+        if(k != j)
+        {
+          tap[j] *= (t - (float)k) / (float)((int32_t)j - (int32_t)k);
+        }
+      }
+      q[AUDIO_BEAM_TAPS - 1U - j] = (int32_t)lroundf(tap[j] * (float)(1U << AUDIO_BEAM_TAP_FRAC_BITS) / (float)mics);
+      q[AUDIO_BEAM_TAPS - 1U - j] = __SSAT(q[AUDIO_BEAM_TAPS - 1U - j], 16);
+    }
+    preset->taps[m][0] = __PKHBT((uint32_t)(uint16_t)q[0], (uint32_t)(uint16_t)q[1], 16);
+    preset->taps[m][1] = __PKHBT((uint32_t)(uint16_t)q[2], (uint32_t)(uint16_t)q[3], 16);
+  }
+}
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
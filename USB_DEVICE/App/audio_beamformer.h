@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file    audio_beamformer.h
+  * @brief   header file for the audio_beamformer.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_BEAMFORMER_H
+#define __AUDIO_BEAMFORMER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_BEAM_MAX_MICS               4U
+#define AUDIO_BEAM_MAX_BEAMS              2U
+#define AUDIO_BEAM_TAPS                   4U   /* cubic Lagrange fractional delay, two SMLAD per mic */
+#define AUDIO_BEAM_HISTORY                16U  /* mic samples kept, longest delay is AUDIO_BEAM_HISTORY - AUDIO_BEAM_TAPS */
+#define AUDIO_BEAM_PRESET_COUNT           5U   /* steering angles of AUDIO_BEAM_PRESET_ANGLES */
+#define AUDIO_BEAM_PRESET_ANGLES          { 0, -30, 30, -60, 60 } /* degrees from broadside, positive towards the last mic */
+#define AUDIO_BEAM_SOUND_SPEED_MM_S       343000U
+
+/* linear array, mics evenly spaced in decimation order */
+#ifndef AUDIO_BEAM_MIC_SPACING_UM
+#define AUDIO_BEAM_MIC_SPACING_UM         21000U
+#endif /* AUDIO_BEAM_MIC_SPACING_UM */
+
+/* Exported types ------------------------------------------------------------*/
+/* delays and taps of a steering angle, the 1 / mics gain is in the taps */
+typedef struct
+{
+  uint32_t  taps[AUDIO_BEAM_MAX_MICS][AUDIO_BEAM_TAPS / 2U]; /* Q15 pairs, the oldest sample tap in the low half word */
+  uint8_t   delay[AUDIO_BEAM_MAX_MICS];                      /* whole samples */
+}
+AUDIO_BeamPresetTypeDef;
+
+typedef struct
+{
+  AUDIO_BeamPresetTypeDef preset[AUDIO_BEAM_PRESET_COUNT];
+  int16_t   history[AUDIO_BEAM_MAX_MICS][2U * AUDIO_BEAM_HISTORY]; /* written twice, the window is contiguous */
+  volatile uint8_t beam_preset[AUDIO_BEAM_MAX_BEAMS];       /* steering of each beam, changed from the pump */
+  uint8_t   mics;
+  uint8_t   beams;
+  uint8_t   pos;                                            /* next write index in history */
+}
+AUDIO_BeamformerTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void      AUDIO_BeamformerInit(AUDIO_BeamformerTypeDef* beamformer, uint8_t mics, uint8_t beams);
+void      AUDIO_BeamformerReset(AUDIO_BeamformerTypeDef* beamformer, uint32_t frequency);
+/* pcm holds frames of mics samples, it receives frames of beams samples, 24 bits right aligned */
+void      AUDIO_BeamformerRun(AUDIO_BeamformerTypeDef* beamformer, int32_t* pcm, uint32_t frames) USBD_ITCM_FUNC;
+int8_t    AUDIO_BeamformerSetPreset(uint8_t beam, uint8_t preset);
+int8_t    AUDIO_BeamformerGetPresets(uint8_t* presets);
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_BEAMFORMER_H */
@@ -0,0 +1,783 @@
+/**
+  ******************************************************************************
+  * @file    audio_bench.c
+  * @brief   on-target micro-benchmarks : the audio kernels are run on one ms
+  *          of a synthetic stereo stream with private buffers and node
+  *          instances, timed with the DWT cycle counter. The min of the runs
+  *          is the cost of the kernel, the max shows the interrupts and cache
+  *          misses which hit it. Run from the pump on a CDC command, none of
+  *          the sessions nodes or rings is touched. Each kernel has a declared
+  *          cycle budget per ms and its output is checked, against a built-in
+  *          reference for the lossless ones and against a golden CRC recorded
+  *          by the host for the others, so a regression of either is reported.
+  *          The node kernels are also built on the host by Tests/Host,
+  *          test_audio_kernels.c checks them against double references and
+  *          its make golden prints the resampler CRCs of the BENCH command
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_bench.h"
+
+#ifdef USE_AUDIO_BENCH
+#include "stm32h7xx.h"
+#include "audio_node.h"
+#include "audio_usb_nodes.h"
+#include "audio_pcm.h"
+#include "audio_fast_copy.h"
+#include "audio_copy.h"
+#include "audio_eq_node.h"
+#include "audio_router_node.h"
+#include "audio_volume_node.h"
+#include "audio_limiter_node.h"
+#include "audio_float_pipeline.h"
+#include "audio_upsampler.h"
+#include "audio_resampler.h"
+#include "audio_sessions_usb.h"
+#include "audio_user_devices.h"
+
+#if (defined USE_AUDIO_PLAYBACK_FIXED_RATE) && !(defined USE_AUDIO_SPEAKER_DUMMY)
+#define AUDIO_BENCH_HAS_FIR
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE && !USE_AUDIO_SPEAKER_DUMMY */
+#if (defined USE_USB_AUDIO_PLAYPBACK) && (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) && \
+    !(defined USE_AUDIO_CLOCK_SOF_OUTPUT)
+#define AUDIO_BENCH_HAS_FEEDBACK
+#endif /* USE_USB_AUDIO_PLAYPBACK && USE_AUDIO_PLAYBACK_USB_FEEDBACK && !USE_AUDIO_CLOCK_SOF_OUTPUT */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_BENCH_BIT(test)             (1UL << (test))
+#define AUDIO_BENCH_MAX_FRAMES            ((AUDIO_BENCH_FREQ_MAX + 999U) / 1000U)
+#define AUDIO_BENCH_PACKET_SIZE           (AUDIO_BENCH_MAX_FRAMES * AUDIO_BENCH_CHANNELS * 4U)
+/* four packets and the max packet margin */
+#define AUDIO_BENCH_RING_SIZE             (5U * AUDIO_BENCH_PACKET_SIZE)
+
+/* Private typedef -----------------------------------------------------------*/
+/* budget of one ms : fixed cycles plus cycles per stereo frame */
+typedef struct
+{
+  uint16_t fixed;
+  uint16_t per_frame;
+}
+AUDIO_BenchBudgetTypeDef;
+
+/* one instance at a time, set up before the runs */
+typedef union
+{
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  AUDIO_Eq_NodeTypeDef      eq;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+  AUDIO_Router_NodeTypeDef  router;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  AUDIO_Volume_NodeTypeDef  volume;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  AUDIO_Limiter_NodeTypeDef limiter;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef AUDIO_BENCH_HAS_FIR
+  AUDIO_UpsamplerTypeDef    upsampler;
+#endif /* AUDIO_BENCH_HAS_FIR */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  AUDIO_ResamplerTypeDef    resampler;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  uint8_t                   none;
+}
+AUDIO_BenchInstanceTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+/* declared budgets, a kernel which goes over it is flagged. Index AUDIO_BENCH_xxx */
+static const AUDIO_BenchBudgetTypeDef bench_budgets[AUDIO_BENCH_TEST_COUNT] =
+{
+  {  200U,                            4U },  /* RING */
+  {  100U,                           12U },  /* PCM_IN */
+  {  100U,                           12U },  /* PCM_OUT */
+  {  100U,                            4U },  /* COPY_NEWLIB */
+  {  100U,                            3U },  /* COPY_FAST */
+  {  600U,                            8U },  /* COPY_MDMA, up to the callback */
+  {  200U,                           96U },  /* EQ, 4 biquad stages */
+  {  500U,                          256U },  /* FIR, 32 taps per output frame */
+  {  200U,                           24U },  /* ROUTER */
+  {  200U,                           16U },  /* VOLUME */
+  {  300U,                           48U },  /* LIMITER */
+  { 2000U,                            0U },  /* FEEDBACK */
+  {  300U,                           48U },  /* RESAMPLER */
+  {  100U,                           16U },  /* FLOAT_IN */
+  {  100U,                           24U },  /* FLOAT_OUT */
+  {  200U,                           48U },  /* EQ_FLOAT, 4 biquad stages */
+  {  200U,                            8U },  /* VOLUME_FLOAT */
+  {  300U,                           32U },  /* LIMITER_FLOAT */
+};
+/* the session rings are in DTCM and the DMA halves in D2 SRAM */
+static uint8_t  bench_src[AUDIO_BENCH_PACKET_SIZE] __ALIGNED(8) USBD_DTCM_BSS;
+static uint8_t  bench_work[AUDIO_BENCH_PACKET_SIZE] __ALIGNED(8) USBD_DTCM_BSS;
+static uint32_t bench_words[AUDIO_BENCH_MAX_FRAMES * AUDIO_BENCH_CHANNELS] USBD_DTCM_BSS;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static float    bench_planes[AUDIO_BENCH_MAX_FRAMES * AUDIO_BENCH_CHANNELS] USBD_DTCM_BSS;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+static uint8_t  bench_ring_data[AUDIO_BENCH_RING_SIZE] __ALIGNED(8) USBD_DTCM_BSS;
+static uint8_t  bench_dst[AUDIO_BENCH_PACKET_SIZE] __ALIGNED(8) USBD_D2_BSS;
+static AUDIO_BufferTypeDef        bench_ring;
+static AUDIO_BenchInstanceTypeDef bench_instance USBD_DTCM_BSS;
+static AUDIO_DescriptionTypeDef   bench_desc;
+static uint32_t bench_frames;
+static uint32_t bench_bytes;
+#ifdef USE_AUDIO_MDMA_COPY
+static volatile uint8_t bench_mdma_done;
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_BenchSetup(uint8_t test);
+static uint32_t AUDIO_BenchOnce(uint8_t test);
+static void     AUDIO_BenchFill(uint8_t* data, uint32_t samples, uint8_t res);
+static uint8_t* AUDIO_BenchOutput(uint8_t test, uint32_t* length);
+static int8_t   AUDIO_BenchCheck(uint8_t test);
+static uint32_t AUDIO_BenchCrc(const uint8_t* data, uint32_t length);
+#if (defined USE_AUDIO_PLAYBACK_EQ) || (defined USE_AUDIO_PLAYBACK_ROUTER) || \
+    (defined USE_AUDIO_PLAYBACK_SOFT_VOLUME) || (defined USE_AUDIO_PLAYBACK_LIMITER)
+static uint32_t AUDIO_BenchNode(AUDIO_ProcessingNodeTypeDef* node);
+#endif /* USE_AUDIO_PLAYBACK_EQ || USE_AUDIO_PLAYBACK_ROUTER || USE_AUDIO_PLAYBACK_SOFT_VOLUME || USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static uint32_t AUDIO_BenchFloatNode(AUDIO_ProcessingNodeTypeDef* node);
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+#ifdef USE_AUDIO_MDMA_COPY
+static void     AUDIO_BenchMdmaDone(uint32_t private_data);
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BenchGetTests
+  *         kernels built in this firmware
+  * @param  None
+  * @retval mask, bit n for the test n
+  */
+uint32_t AUDIO_BenchGetTests(void)
+{
+  uint32_t tests = AUDIO_BENCH_BIT(AUDIO_BENCH_RING) | AUDIO_BENCH_BIT(AUDIO_BENCH_PCM_IN) |
+                   AUDIO_BENCH_BIT(AUDIO_BENCH_PCM_OUT) | AUDIO_BENCH_BIT(AUDIO_BENCH_COPY_NEWLIB);
+
+#ifdef USE_AUDIO_FAST_COPY
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_COPY_FAST);
+#endif /* USE_AUDIO_FAST_COPY */
+#ifdef USE_AUDIO_MDMA_COPY
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_COPY_MDMA);
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_EQ);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef AUDIO_BENCH_HAS_FIR
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_FIR);
+#endif /* AUDIO_BENCH_HAS_FIR */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_ROUTER);
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_VOLUME);
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_LIMITER);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef AUDIO_BENCH_HAS_FEEDBACK
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_FEEDBACK);
+#endif /* AUDIO_BENCH_HAS_FEEDBACK */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_RESAMPLER);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_FLOAT_IN) | AUDIO_BENCH_BIT(AUDIO_BENCH_FLOAT_OUT);
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_EQ_FLOAT);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_VOLUME_FLOAT);
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  tests |= AUDIO_BENCH_BIT(AUDIO_BENCH_LIMITER_FLOAT);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  return tests;
+}
+
+/**
+  * @brief  AUDIO_BenchRun
+  *         runs a kernel AUDIO_BENCH_RUNS times on one ms of stereo audio.
+  *         Must be called from the pump while no stream uses the MDMA
+  * @param  test: AUDIO_BENCH_xxx, built in AUDIO_BenchGetTests
+  * @param  res: bytes per sample, 2 to 4
+  * @param  freq: sampling frequency, AUDIO_BENCH_FREQ_MIN to AUDIO_BENCH_FREQ_MAX
+  * @param  golden_crc: expected CRC of the output, 0 if none
+  * @param  result: returned measure
+  * @retval 0 if no error, -1 on arguments the kernel doesn't take
+  */
+int8_t AUDIO_BenchRun(uint8_t test, uint8_t res, uint32_t freq, const uint32_t* golden_crc,
+                      AUDIO_BenchResultTypeDef* result)
+{
+  uint64_t sum = 0;
+  uint32_t cycles;
+  uint32_t run;
+  uint32_t length;
+  uint8_t* output;
+
+  if((test >= AUDIO_BENCH_TEST_COUNT) || ((AUDIO_BenchGetTests() & AUDIO_BENCH_BIT(test)) == 0U) ||
+     (res < 2U) || (res > 4U) || (freq < AUDIO_BENCH_FREQ_MIN) || (freq > AUDIO_BENCH_FREQ_MAX))
+  {
+    return -1;
+  }
+  memset(&bench_desc, 0, sizeof(bench_desc));
+  bench_desc.frequence = freq;
+  bench_desc.channels_count = AUDIO_BENCH_CHANNELS;
+  bench_desc.channels_map = 0x03;
+  bench_desc.audio_res = res;
+  bench_frames = (freq + 999U) / 1000U;
+  bench_bytes = bench_frames * AUDIO_BENCH_CHANNELS * res;
+  AUDIO_BenchFill(bench_src, bench_frames * AUDIO_BENCH_CHANNELS, res);
+  if(AUDIO_BenchSetup(test) != 0)
+  {
+    return -1;
+  }
+
+  result->test = test;
+  result->res = res;
+  result->freq = freq;
+  result->frames = (uint16_t)bench_frames;
+  result->runs = AUDIO_BENCH_RUNS;
+  result->min = UINT32_MAX;
+  result->max = 0;
+  for(run = 0; run < AUDIO_BENCH_RUNS; run++)
+  {
+    cycles = AUDIO_BenchOnce(test);
+    if(cycles == UINT32_MAX)
+    {
+      return -1;
+    }
+    result->min = (cycles < result->min) ? cycles : result->min;
+    result->max = (cycles > result->max) ? cycles : result->max;
+    sum += cycles;
+  }
+  result->avg = (uint32_t)(sum / AUDIO_BENCH_RUNS);
+#ifdef AUDIO_BENCH_HAS_FIR
+  if(test == AUDIO_BENCH_FIR)
+  {
+    result->frames = (uint16_t)((AUDIO_SPEAKER_FIXED_RATE + 999U) / 1000U);
+  }
+#endif /* AUDIO_BENCH_HAS_FIR */
+
+  /* the min is the kernel alone, the max depends on the interrupts */
+  result->budget = bench_budgets[test].fixed + (uint32_t)bench_budgets[test].per_frame * result->frames;
+  result->status = (result->min > result->budget) ? AUDIO_BENCH_STATUS_OVER_BUDGET : 0U;
+  output = AUDIO_BenchOutput(test, &length);
+  result->crc = (output != 0) ? AUDIO_BenchCrc(output, length) : 0U;
+  if((AUDIO_BenchCheck(test) != 0) || ((golden_crc != 0) && (*golden_crc != result->crc)))
+  {
+    result->status |= AUDIO_BENCH_STATUS_MISMATCH;
+  }
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BenchSetup
+  *         initializes the ring or the node instance of a kernel
+  * @param  test: AUDIO_BENCH_xxx
+  * @retval 0 if no error
+  */
+static int8_t AUDIO_BenchSetup(uint8_t test)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t i;
+  int8_t ret = 0;
+
+  memset(&bench_instance, 0, sizeof(bench_instance));
+  switch(test)
+  {
+    case AUDIO_BENCH_RING:
+      bench_ring.data = bench_ring_data;
+      bench_ring.buffer_flags = 0;
+      AUDIO_USB_InitializesDataBuffer(&bench_ring, AUDIO_BENCH_RING_SIZE, (uint16_t)bench_bytes, (uint16_t)bench_bytes);
+      break;
+
+    case AUDIO_BENCH_PCM_OUT:
+      /* words of the source packet */
+      region.data[0] = bench_src;
+      region.length[0] = bench_bytes;
+      region.data[1] = bench_src;
+      region.length[1] = 0;
+      for(i = 0; i < bench_frames * AUDIO_BENCH_CHANNELS; i++)
+      {
+        bench_words[i] = (uint32_t)AUDIO_PcmRegionRead(&region, i * bench_desc.audio_res, bench_desc.audio_res);
+      }
+      break;
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_FLOAT_OUT:
+      AUDIO_PcmDeinterleave(bench_src, bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_frames,
+                            AUDIO_BENCH_CHANNELS, bench_desc.audio_res);
+      break;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    case AUDIO_BENCH_EQ:
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_EQ_FLOAT:
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+      ret = AUDIO_EqBenchInit(&bench_desc, (uint32_t)&bench_instance.eq);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+#ifdef AUDIO_BENCH_HAS_FIR
+    case AUDIO_BENCH_FIR:
+      /* the upsampler doesn't decimate */
+      if(bench_desc.frequence > AUDIO_SPEAKER_FIXED_RATE)
+      {
+        ret = -1;
+      }
+      break;
+#endif /* AUDIO_BENCH_HAS_FIR */
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    case AUDIO_BENCH_ROUTER:
+      ret = AUDIO_RouterBenchInit(&bench_desc, (uint32_t)&bench_instance.router);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    case AUDIO_BENCH_VOLUME:
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_VOLUME_FLOAT:
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+      ret = AUDIO_VolumeInit(&bench_desc, 0, (uint32_t)&bench_instance.volume);
+      if(ret == 0)
+      {
+        /* unity gain is a bypass, the first run ramps to -6 dB and the others hold it */
+        bench_instance.volume.VolumeStart((uint32_t)&bench_instance.volume);
+        ret = bench_instance.volume.VolumeSetVolume(0, -6 * 256, (uint32_t)&bench_instance.volume);
+      }
+      break;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    case AUDIO_BENCH_LIMITER:
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_LIMITER_FLOAT:
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+      ret = AUDIO_LimiterInit(&bench_desc, 0, (uint32_t)&bench_instance.limiter);
+      if(ret == 0)
+      {
+        ret = bench_instance.limiter.LimiterStart((uint32_t)&bench_instance.limiter);
+      }
+      break;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+    case AUDIO_BENCH_RESAMPLER:
+      if(bench_desc.audio_res == 4U)
+      {
+        ret = -1;
+        break;
+      }
+      /* two packets to read, the resampler doesn't commit them */
+      bench_ring.data = bench_ring_data;
+      bench_ring.buffer_flags = 0;
+      AUDIO_USB_InitializesDataBuffer(&bench_ring, AUDIO_BENCH_RING_SIZE, (uint16_t)bench_bytes, (uint16_t)bench_bytes);
+      AUDIO_BufferWrite(&bench_ring, bench_src, bench_bytes);
+      AUDIO_BufferWrite(&bench_ring, bench_src, bench_bytes);
+      break;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+
+    default:
+      break;
+  }
+  return ret;
+}
+
+/**
+  * @brief  AUDIO_BenchOnce
+  *         one run of a kernel, its per run preparation is not timed
+  * @param  test: AUDIO_BENCH_xxx, set up
+  * @retval cycles, UINT32_MAX if the kernel couldn't run
+  */
+static uint32_t AUDIO_BenchOnce(uint8_t test)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t samples = bench_frames * AUDIO_BENCH_CHANNELS;
+  uint8_t  res = bench_desc.audio_res;
+  uint32_t start = 0;
+  uint32_t i;
+
+  region.data[0] = bench_src;
+  region.length[0] = bench_bytes;
+  region.data[1] = bench_src;
+  region.length[1] = 0;
+  switch(test)
+  {
+    case AUDIO_BENCH_RING:
+      start = DWT->CYCCNT;
+      AUDIO_BufferWrite(&bench_ring, bench_src, bench_bytes);
+      AUDIO_BufferRead(&bench_ring, bench_work, bench_bytes);
+      start = DWT->CYCCNT - start;
+      break;
+
+    case AUDIO_BENCH_PCM_IN:
+      start = DWT->CYCCNT;
+      if(res == AUDIO_PCM_PACKED_24_BYTES)
+      {
+        AUDIO_PcmUnpack24(bench_src, bench_words, samples);
+      }
+      else
+      {
+        for(i = 0; i < samples; i++)
+        {
+          bench_words[i] = (uint32_t)AUDIO_PcmRegionRead(&region, i * res, res);
+        }
+      }
+      start = DWT->CYCCNT - start;
+      break;
+
+    case AUDIO_BENCH_PCM_OUT:
+      region.data[0] = bench_work;
+      region.data[1] = bench_work;
+      start = DWT->CYCCNT;
+      if(res == AUDIO_PCM_PACKED_24_BYTES)
+      {
+        AUDIO_PcmPack24(bench_words, bench_work, samples);
+      }
+      else
+      {
+        for(i = 0; i < samples; i++)
+        {
+          AUDIO_PcmRegionWrite(&region, i * res, (int32_t)bench_words[i], res);
+        }
+      }
+      start = DWT->CYCCNT - start;
+      break;
+
+    case AUDIO_BENCH_COPY_NEWLIB:
+      start = DWT->CYCCNT;
+      memcpy(bench_dst, bench_src, bench_bytes);
+      start = DWT->CYCCNT - start;
+      break;
+
+#ifdef USE_AUDIO_FAST_COPY
+    case AUDIO_BENCH_COPY_FAST:
+      start = DWT->CYCCNT;
+      AUDIO_FastCopy(bench_dst, bench_src, bench_bytes);
+      start = DWT->CYCCNT - start;
+      break;
+#endif /* USE_AUDIO_FAST_COPY */
+
+#ifdef USE_AUDIO_MDMA_COPY
+    case AUDIO_BENCH_COPY_MDMA:
+      bench_mdma_done = 0;
+      start = DWT->CYCCNT;
+      if(AUDIO_CopyFromRegion(AUDIO_COPY_SPEAKER, bench_dst, &region, AUDIO_BenchMdmaDone, 0) != 0)
+      {
+        return UINT32_MAX;
+      }
+      while(!bench_mdma_done)
+      {
+      }
+      start = DWT->CYCCNT - start;
+      break;
+#endif /* USE_AUDIO_MDMA_COPY */
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    case AUDIO_BENCH_EQ:
+      start = AUDIO_BenchNode(&bench_instance.eq.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+#ifdef AUDIO_BENCH_HAS_FIR
+    case AUDIO_BENCH_FIR:
+      AUDIO_UpsamplerInit(&bench_instance.upsampler, bench_desc.frequence, AUDIO_SPEAKER_FIXED_RATE,
+                          AUDIO_BENCH_CHANNELS, res);
+      start = DWT->CYCCNT;
+      AUDIO_UpsamplerProcess(&bench_instance.upsampler, &region, bench_dst,
+                             (AUDIO_SPEAKER_FIXED_RATE + 999U) / 1000U);
+      start = DWT->CYCCNT - start;
+      break;
+#endif /* AUDIO_BENCH_HAS_FIR */
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    case AUDIO_BENCH_ROUTER:
+      start = AUDIO_BenchNode(&bench_instance.router.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    case AUDIO_BENCH_VOLUME:
+      start = AUDIO_BenchNode(&bench_instance.volume.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    case AUDIO_BENCH_LIMITER:
+      start = AUDIO_BenchNode(&bench_instance.limiter.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+
+#ifdef AUDIO_BENCH_HAS_FEEDBACK
+    case AUDIO_BENCH_FEEDBACK:
+      start = AUDIO_Playback_FeedbackBench(bench_desc.frequence, AUDIO_BENCH_CHANNELS, res);
+      break;
+#endif /* AUDIO_BENCH_HAS_FEEDBACK */
+
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+    case AUDIO_BENCH_RESAMPLER:
+      /* 100 ppm fast, as a drifting mic clock */
+      AUDIO_ResamplerInit(&bench_instance.resampler, AUDIO_BENCH_CHANNELS, res);
+      AUDIO_ResamplerSetStep(&bench_instance.resampler, AUDIO_RESAMPLER_STEP_ONE + (AUDIO_RESAMPLER_STEP_ONE / 10000U));
+      start = DWT->CYCCNT;
+      AUDIO_ResamplerProcess(&bench_instance.resampler, &bench_ring, bench_work, bench_frames);
+      start = DWT->CYCCNT - start;
+      break;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_FLOAT_IN:
+      start = DWT->CYCCNT;
+      AUDIO_PcmDeinterleave(bench_src, bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_frames, AUDIO_BENCH_CHANNELS, res);
+      start = DWT->CYCCNT - start;
+      /* back to a packet for the check, not timed */
+      AUDIO_PcmInterleave(bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_work, bench_frames, AUDIO_BENCH_CHANNELS, res);
+      break;
+
+    case AUDIO_BENCH_FLOAT_OUT:
+      start = DWT->CYCCNT;
+      AUDIO_FloatPipelineOutput(bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_work, bench_frames,
+                                AUDIO_BENCH_CHANNELS, res);
+      start = DWT->CYCCNT - start;
+      break;
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    case AUDIO_BENCH_EQ_FLOAT:
+      start = AUDIO_BenchFloatNode(&bench_instance.eq.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    case AUDIO_BENCH_VOLUME_FLOAT:
+      start = AUDIO_BenchFloatNode(&bench_instance.volume.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    case AUDIO_BENCH_LIMITER_FLOAT:
+      start = AUDIO_BenchFloatNode(&bench_instance.limiter.processing);
+      break;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+    default:
+      break;
+  }
+  return start;
+}
+
+/**
+  * @brief  AUDIO_BenchFill
+  *         pseudo random samples up to full scale, so the limiter and the
+  *         saturations work as on music
+  * @param  data: packet
+  * @param  samples: samples count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+static void AUDIO_BenchFill(uint8_t* data, uint32_t samples, uint8_t res)
+{
+  uint32_t seed = 0x12345678U;
+  uint32_t i;
+  uint8_t  b;
+
+  for(i = 0; i < samples; i++)
+  {
+    seed = seed * 1664525U + 1013904223U;
+    for(b = 0; b < res; b++)
+    {
+      /* the most significant bytes of the seed, little endian */
+      *data++ = (uint8_t)(seed >> (8U * (4U - res + b)));
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_BenchOutput
+  *         output of the last run of a kernel
+  * @param  test: AUDIO_BENCH_xxx, run
+  * @param  length: returned output length in bytes
+  * @retval output, 0 for the kernels without samples out
+  */
+static uint8_t* AUDIO_BenchOutput(uint8_t test, uint32_t* length)
+{
+  *length = bench_bytes;
+  switch(test)
+  {
+    case AUDIO_BENCH_PCM_IN:
+      *length = bench_frames * AUDIO_BENCH_CHANNELS * 4U;
+      return (uint8_t*)bench_words;
+
+    case AUDIO_BENCH_COPY_NEWLIB:
+    case AUDIO_BENCH_COPY_FAST:
+    case AUDIO_BENCH_COPY_MDMA:
+      return bench_dst;
+
+#ifdef AUDIO_BENCH_HAS_FIR
+    case AUDIO_BENCH_FIR:
+      *length = ((AUDIO_SPEAKER_FIXED_RATE + 999U) / 1000U) * AUDIO_BENCH_CHANNELS *
+                ((bench_desc.audio_res == 2U) ? 2U : 4U);
+      return bench_dst;
+#endif /* AUDIO_BENCH_HAS_FIR */
+
+    case AUDIO_BENCH_FEEDBACK:
+      *length = 0;
+      return 0;
+
+    default:
+      /* ring, packed words, nodes in place and resampler */
+      return bench_work;
+  }
+}
+
+/**
+  * @brief  AUDIO_BenchCheck
+  *         compares the output of a lossless kernel with the source packet ,
+  *         the others are checked by the golden CRC only
+  * @param  test: AUDIO_BENCH_xxx, run
+  * @retval 0 if the output is right or the kernel has no reference
+  */
+static int8_t AUDIO_BenchCheck(uint8_t test)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t i;
+
+  switch(test)
+  {
+    case AUDIO_BENCH_RING:
+    case AUDIO_BENCH_PCM_OUT:
+      return (memcmp(bench_work, bench_src, bench_bytes) == 0) ? 0 : -1;
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+    case AUDIO_BENCH_FLOAT_IN:
+      /* a float holds 16 and 24 bits samples, 32 bits ones lose their low bits */
+      if(bench_desc.audio_res == 4U)
+      {
+        return 0;
+      }
+      return (memcmp(bench_work, bench_src, bench_bytes) == 0) ? 0 : -1;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+    case AUDIO_BENCH_COPY_NEWLIB:
+    case AUDIO_BENCH_COPY_FAST:
+    case AUDIO_BENCH_COPY_MDMA:
+      return (memcmp(bench_dst, bench_src, bench_bytes) == 0) ? 0 : -1;
+
+    case AUDIO_BENCH_PCM_IN:
+      /* the generic reader is the reference of the packed 24 bits one */
+      region.data[0] = bench_src;
+      region.length[0] = bench_bytes;
+      region.data[1] = bench_src;
+      region.length[1] = 0;
+      for(i = 0; i < bench_frames * AUDIO_BENCH_CHANNELS; i++)
+      {
+        if(bench_words[i] != (uint32_t)AUDIO_PcmRegionRead(&region, i * bench_desc.audio_res, bench_desc.audio_res))
+        {
+          return -1;
+        }
+      }
+      return 0;
+
+    default:
+      return 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_BenchCrc
+  *         CRC-32 of zlib / Ethernet, computed bitwise as the host computes
+  *         its golden values
+  * @param  data: data to check
+  * @param  length: data length
+  * @retval CRC
+  */
+static uint32_t AUDIO_BenchCrc(const uint8_t* data, uint32_t length)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+  uint32_t i;
+  uint8_t  bit;
+
+  for(i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for(bit = 0; bit < 8U; bit++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
+  }
+  return ~crc;
+}
+
+#if (defined USE_AUDIO_PLAYBACK_EQ) || (defined USE_AUDIO_PLAYBACK_ROUTER) || \
+    (defined USE_AUDIO_PLAYBACK_SOFT_VOLUME) || (defined USE_AUDIO_PLAYBACK_LIMITER)
+/**
+  * @brief  AUDIO_BenchNode
+  *         processes a packet in place, as a node of the play chain
+  * @param  node: processing node, initialized
+  * @retval cycles of the Process call
+  */
+static uint32_t AUDIO_BenchNode(AUDIO_ProcessingNodeTypeDef* node)
+{
+  uint32_t start;
+
+  memcpy(bench_work, bench_src, bench_bytes);
+  start = DWT->CYCCNT;
+  node->Process(bench_work, bench_work, bench_frames, (uint32_t)node);
+  return DWT->CYCCNT - start;
+}
+#endif /* USE_AUDIO_PLAYBACK_EQ || USE_AUDIO_PLAYBACK_ROUTER || USE_AUDIO_PLAYBACK_SOFT_VOLUME || USE_AUDIO_PLAYBACK_LIMITER */
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/**
+  * @brief  AUDIO_BenchFloatNode
+  *         processes the planes of a packet, as a node of a float chain.
+  *         The conversions are timed by FLOAT_IN and FLOAT_OUT
+  * @param  node: processing node with a float variant, initialized
+  * @retval cycles of the ProcessFloat call
+  */
+static uint32_t AUDIO_BenchFloatNode(AUDIO_ProcessingNodeTypeDef* node)
+{
+  uint32_t start;
+
+  AUDIO_PcmDeinterleave(bench_src, bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_frames,
+                        AUDIO_BENCH_CHANNELS, bench_desc.audio_res);
+  start = DWT->CYCCNT;
+  node->ProcessFloat(bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_frames, (uint32_t)node);
+  start = DWT->CYCCNT - start;
+  AUDIO_PcmInterleave(bench_planes, AUDIO_BENCH_MAX_FRAMES, bench_work, bench_frames,
+                      AUDIO_BENCH_CHANNELS, bench_desc.audio_res);
+  return start;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+#ifdef USE_AUDIO_MDMA_COPY
+/**
+  * @brief  AUDIO_BenchMdmaDone
+  *         end of a benchmark MDMA copy
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_BenchMdmaDone(uint32_t private_data)
+{
+  bench_mdma_done = 1;
+}
+#endif /* USE_AUDIO_MDMA_COPY */
+#endif /* USE_AUDIO_BENCH */
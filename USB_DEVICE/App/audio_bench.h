@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    audio_bench.h
+  * @brief   header file for the audio_bench.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_BENCH_H
+#define __AUDIO_BENCH_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usb_audio_user.h"
+
+#ifdef USE_AUDIO_BENCH
+/* Exported constants --------------------------------------------------------*/
+/* kernels, each run on one ms of stereo audio at the asked rate and sample size */
+#define AUDIO_BENCH_RING                  0U  /* write then read of a packet through a ring */
+#define AUDIO_BENCH_PCM_IN                1U  /* packet to 32 bits words, AUDIO_PcmUnpack24 for 3 bytes samples */
+#define AUDIO_BENCH_PCM_OUT               2U  /* 32 bits words to packet, AUDIO_PcmPack24 for 3 bytes samples */
+#define AUDIO_BENCH_COPY_NEWLIB           3U  /* memcpy of a packet from DTCM to D2 SRAM */
+#define AUDIO_BENCH_COPY_FAST             4U  /* AUDIO_FastCopy from ITCM, USE_AUDIO_FAST_COPY */
+#define AUDIO_BENCH_COPY_MDMA             5U  /* MDMA copy up to its callback, USE_AUDIO_MDMA_COPY */
+#define AUDIO_BENCH_EQ                    6U  /* all biquad stages, USE_AUDIO_PLAYBACK_EQ */
+#define AUDIO_BENCH_FIR                   7U  /* polyphase FIR to the fixed rate, USE_AUDIO_PLAYBACK_FIXED_RATE */
+#define AUDIO_BENCH_ROUTER                8U  /* channel mixing matrix, USE_AUDIO_PLAYBACK_ROUTER */
+#define AUDIO_BENCH_VOLUME                9U  /* volume ramp, USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#define AUDIO_BENCH_LIMITER               10U /* USE_AUDIO_PLAYBACK_LIMITER */
+#define AUDIO_BENCH_FEEDBACK              11U /* one feedback PI step, USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#define AUDIO_BENCH_RESAMPLER             12U /* recording synchro, USE_AUDIO_RECORDING_USB_RESAMPLER */
+/* float pipeline, USE_AUDIO_FLOAT_PIPELINE : a float chain costs FLOAT_IN + FLOAT_OUT + its float nodes */
+#define AUDIO_BENCH_FLOAT_IN              13U /* packet to float planes */
+#define AUDIO_BENCH_FLOAT_OUT             14U /* float planes to packet, saturated, 16 bits dithered */
+#define AUDIO_BENCH_EQ_FLOAT              15U /* all biquad stages on the planes, USE_AUDIO_PLAYBACK_EQ */
+#define AUDIO_BENCH_VOLUME_FLOAT          16U /* volume ramp on the planes, USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#define AUDIO_BENCH_LIMITER_FLOAT         17U /* USE_AUDIO_PLAYBACK_LIMITER */
+#define AUDIO_BENCH_TEST_COUNT            18U
+
+#define AUDIO_BENCH_RUNS                  16U /* min, avg and max over the runs */
+#define AUDIO_BENCH_CHANNELS              2U
+/* result status bits */
+#define AUDIO_BENCH_STATUS_OVER_BUDGET    0x01U /* min cycles above the declared budget */
+#define AUDIO_BENCH_STATUS_MISMATCH       0x02U /* output differs from the reference or the golden CRC */
+
+#define AUDIO_BENCH_FREQ_MIN              USB_AUDIO_CONFIG_FREQ_8_K
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+#define AUDIO_BENCH_FREQ_MAX              USB_AUDIO_CONFIG_FREQ_768_K
+#else /* USE_AUDIO_PLAYBACK_HIRES */
+#define AUDIO_BENCH_FREQ_MAX              USB_AUDIO_CONFIG_FREQ_192_K
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  test;
+  uint8_t  res;                           /* bytes per sample */
+  uint32_t freq;
+  uint16_t frames;                        /* frames of the run, output frames for the FIR */
+  uint16_t runs;
+  uint32_t min;                           /* cycles */
+  uint32_t avg;
+  uint32_t max;
+  uint32_t budget;                        /* declared cycles of the kernel at this rate */
+  uint32_t crc;                           /* CRC-32 of the output of the last run */
+  uint8_t  status;                        /* AUDIO_BENCH_STATUS_xxx */
+}
+AUDIO_BenchResultTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+uint32_t AUDIO_BenchGetTests(void);
+int8_t   AUDIO_BenchRun(uint8_t test, uint8_t res, uint32_t freq, const uint32_t* golden_crc,
+                        AUDIO_BenchResultTypeDef* result);
+#endif /* USE_AUDIO_BENCH */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_BENCH_H */
@@ -0,0 +1,349 @@
+/**
+  ******************************************************************************
+  * @file    audio_bulk_capture.c
+  * @brief   Bulk capture : each half captured by the mic is queued as one
+  *          block, a header and the half in the record format, and sent on a
+  *          vendor bulk IN endpoint. Bulk transfers use the bandwidth the
+  *          isochronous streams leave, the host reassembles the stream from
+  *          the block numbers and drops the blocks of an older run. The mic
+  *          runs while the host captures, with or without the record
+  *          streaming interface.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_bulk_capture.h"
+
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "usb_audio_user.h"
+#include "audio_user_devices.h"
+#include "audio_sessions_usb.h"
+#include "audio_pump.h"
+#include "hal_usb_ex.h"
+
+#if (AUDIO_BULK_CAPTURE_SLOTS & (AUDIO_BULK_CAPTURE_SLOTS - 1U)) != 0U
+#error "AUDIO_BULK_CAPTURE_SLOTS must be a power of two"
+#endif /* AUDIO_BULK_CAPTURE_SLOTS */
+
+/* Private defines -----------------------------------------------------------*/
+/* largest captured half, rounded to the word */
+#define AUDIO_BULK_CAPTURE_PAYLOAD_MAX    ((AUDIO_MS_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_RECORD_FREQ_MAX,       \
+                                                                     USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT, \
+                                                                     USBD_AUDIO_CONFIG_RECORD_RES_BYTE) *    \
+                                            AUDIO_MIC_DMA_HALF_MS + 3U) & ~3U)
+/* transmit state, set by the pump and by the USB interrupt */
+#define AUDIO_BULK_CAPTURE_TX_IDLE        0x00U
+#define AUDIO_BULK_CAPTURE_TX_SENDING     0x01U /* the block rd is sent */
+#define AUDIO_BULK_CAPTURE_TX_SENT        0x02U /* its place can be reused */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_BulkCaptureHeaderTypeDef header;
+  uint8_t  payload[AUDIO_BULK_CAPTURE_PAYLOAD_MAX];
+}
+AUDIO_BulkCaptureSlotTypeDef;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_BULK_CAPTURE_Init(void);
+static int8_t   AUDIO_BULK_CAPTURE_DeInit(void);
+static int8_t   AUDIO_BULK_CAPTURE_Receive(uint8_t* Buf, uint32_t Len);
+static int8_t   AUDIO_BULK_CAPTURE_TransmitCplt(uint8_t* Buf, uint32_t Len);
+static void     AUDIO_BulkCaptureSend(void);
+static void     AUDIO_BulkCaptureSetActive(uint8_t active);
+static void     AUDIO_BulkCapturePlanar(uint8_t* dst, const AUDIO_BufferRegionTypeDef* region, uint32_t frames,
+                                        uint8_t channels, uint8_t res) USBD_ITCM_FUNC;
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceHS;
+extern AUDIO_USB_SessionTypedef usb_record_session;
+
+USBD_VENDOR_ItfTypeDef AUDIO_BULK_CAPTURE_Interface_fops =
+{
+  AUDIO_BULK_CAPTURE_Init,
+  AUDIO_BULK_CAPTURE_DeInit,
+  AUDIO_BULK_CAPTURE_Receive,
+  AUDIO_BULK_CAPTURE_TransmitCplt
+};
+
+/* blocks and request, moved by the USB DMA */
+__ALIGN_BEGIN static AUDIO_BulkCaptureSlotTypeDef bulk_slots[AUDIO_BULK_CAPTURE_SLOTS] __ALIGN_END USBD_BUFFER_BSS;
+__ALIGN_BEGIN static uint8_t bulk_rx_request[USBD_VENDOR_HS_MAX_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+static volatile uint32_t bulk_wr = 0;        /* free running , blocks written by the mic */
+static volatile uint32_t bulk_rd = 0;        /* free running , blocks released by the pump */
+static volatile uint8_t  bulk_tx_state = AUDIO_BULK_CAPTURE_TX_IDLE;
+/* written by the USB interrupt , applied by the mic at its next half */
+static volatile uint8_t  bulk_active = 0;
+static volatile uint8_t  bulk_start = 0;     /* a START was received since the last half */
+static volatile uint8_t  bulk_request_run = 0;
+static volatile uint8_t  bulk_request_layout = AUDIO_BULK_CAPTURE_INTERLEAVED;
+/* owned by the mic */
+static uint8_t  bulk_run;
+static uint8_t  bulk_layout;
+static uint32_t bulk_sequence;
+static uint32_t bulk_frame;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BulkCaptureInit
+  *         registers the pump handler, called before the USB device starts
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_BulkCaptureInit(void)
+{
+  bulk_wr = 0;
+  bulk_rd = 0;
+  bulk_tx_state = AUDIO_BULK_CAPTURE_TX_IDLE;
+  bulk_active = 0;
+  bulk_start = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_BULK_CAPTURE, AUDIO_BulkCaptureSend);
+}
+
+/**
+  * @brief  AUDIO_BulkCaptureWriteRegion
+  *         called by the mic for each captured half, before the echo
+  *         canceller and the AGC. The half is queued as one block, or counted
+  *         as dropped when the host doesn't read fast enough
+  * @param  region: captured half, in the record format
+  * @param  desc: record format
+  * @retval None
+  */
+void  AUDIO_BulkCaptureWriteRegion(const AUDIO_BufferRegionTypeDef* region, const AUDIO_DescriptionTypeDef* desc)
+{
+  AUDIO_BulkCaptureSlotTypeDef* slot;
+  uint32_t length = region->length[0] + region->length[1];
+  uint32_t frames = length / AUDIO_SAMPLE_LENGTH(desc);
+  uint32_t wr = bulk_wr;
+
+  if(!bulk_active)
+  {
+    return;
+  }
+  if(bulk_start)
+  {
+    bulk_start = 0;
+    bulk_run = bulk_request_run;
+    bulk_layout = bulk_request_layout;
+    bulk_sequence = 0;
+    bulk_frame = 0;
+  }
+  if(((wr - bulk_rd) >= AUDIO_BULK_CAPTURE_SLOTS) || (length > AUDIO_BULK_CAPTURE_PAYLOAD_MAX))
+  {
+    /* the block number and the frame index tell the host what is missing */
+    bulk_sequence++;
+    bulk_frame += frames;
+    return;
+  }
+  slot = &bulk_slots[wr & (AUDIO_BULK_CAPTURE_SLOTS - 1U)];
+  slot->header.sync = AUDIO_BULK_CAPTURE_SYNC;
+  slot->header.run = bulk_run;
+  slot->header.layout = bulk_layout;
+  slot->header.channels = desc->channels_count;
+  slot->header.res_byte = desc->audio_res;
+  slot->header.reserved = 0;
+  slot->header.sof = (uint16_t)USB_SOF_NUMBER();
+  slot->header.sequence = bulk_sequence++;
+  slot->header.frame = bulk_frame;
+  slot->header.time = DWT->CYCCNT;
+  slot->header.frequency = desc->frequence;
+  slot->header.frames = frames;
+  bulk_frame += frames;
+  if(bulk_layout == AUDIO_BULK_CAPTURE_PLANAR)
+  {
+    AUDIO_BulkCapturePlanar(slot->payload, region, frames, desc->channels_count, desc->audio_res);
+  }
+  else
+  {
+    memcpy(slot->payload, region->data[0], region->length[0]);
+    memcpy(&slot->payload[region->length[0]], region->data[1], region->length[1]);
+  }
+  /* the block is written before the pump may send it */
+  __DMB();
+  bulk_wr = wr + 1U;
+  AUDIO_PumpPost(AUDIO_PUMP_BULK_CAPTURE);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BULK_CAPTURE_Init
+  *         the vendor interface is configured, the first request is awaited
+  * @param  None
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_BULK_CAPTURE_Init(void)
+{
+  (void)USBD_VENDOR_Receive(&hUsbDeviceHS, bulk_rx_request, sizeof(bulk_rx_request),
+                            AUDIO_BULK_CAPTURE_CLASS_ID);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_BULK_CAPTURE_DeInit
+  *         the vendor interface is released : the capture stops and the block
+  *         being sent is released
+  * @param  None
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_BULK_CAPTURE_DeInit(void)
+{
+  AUDIO_BulkCaptureSetActive(0);
+  if(bulk_tx_state == AUDIO_BULK_CAPTURE_TX_SENDING)
+  {
+    bulk_tx_state = AUDIO_BULK_CAPTURE_TX_SENT;
+  }
+  AUDIO_PumpPost(AUDIO_PUMP_BULK_CAPTURE);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_BULK_CAPTURE_Receive
+  *         a request was received, it is applied at once from the USB
+  *         interrupt and the endpoint is armed for the next one. Other
+  *         lengths and unknown ops are ignored
+  * @param  Buf: received transfer
+  * @param  Len: transfer length
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_BULK_CAPTURE_Receive(uint8_t* Buf, uint32_t Len)
+{
+  AUDIO_BulkCaptureRequestTypeDef request;
+
+  if(Len == sizeof(AUDIO_BulkCaptureRequestTypeDef))
+  {
+    memcpy(&request, Buf, sizeof(request));
+    if(request.op == AUDIO_BULK_CAPTURE_OP_START)
+    {
+      bulk_request_run = request.run;
+      bulk_request_layout = (request.layout == AUDIO_BULK_CAPTURE_PLANAR) ? AUDIO_BULK_CAPTURE_PLANAR :
+                                                                           AUDIO_BULK_CAPTURE_INTERLEAVED;
+      bulk_start = 1;
+      AUDIO_BulkCaptureSetActive(1);
+    }
+    else if(request.op == AUDIO_BULK_CAPTURE_OP_STOP)
+    {
+      AUDIO_BulkCaptureSetActive(0);
+    }
+  }
+  (void)USBD_VENDOR_Receive(&hUsbDeviceHS, bulk_rx_request, sizeof(bulk_rx_request),
+                            AUDIO_BULK_CAPTURE_CLASS_ID);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_BULK_CAPTURE_TransmitCplt
+  *         a block was sent, the pump releases it and sends the next one
+  * @param  Buf: sent data
+  * @param  Len: sent length
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_BULK_CAPTURE_TransmitCplt(uint8_t* Buf, uint32_t Len)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+  bulk_tx_state = AUDIO_BULK_CAPTURE_TX_SENT;
+  AUDIO_PumpPost(AUDIO_PUMP_BULK_CAPTURE);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_BulkCaptureSend
+  *         pump handler, run when a block is queued and when one was sent.
+  *         Only the pump releases blocks, so the mic never writes the one
+  *         being sent
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_BulkCaptureSend(void)
+{
+  AUDIO_BulkCaptureSlotTypeDef* slot;
+  uint32_t rd = bulk_rd;
+
+  if(bulk_tx_state == AUDIO_BULK_CAPTURE_TX_SENDING)
+  {
+    return;
+  }
+  if(bulk_tx_state == AUDIO_BULK_CAPTURE_TX_SENT)
+  {
+    rd++;
+    bulk_rd = rd;
+    bulk_tx_state = AUDIO_BULK_CAPTURE_TX_IDLE;
+  }
+  if(rd == bulk_wr)
+  {
+    return;
+  }
+  /* the block is read after the write position */
+  __DMB();
+  slot = &bulk_slots[rd & (AUDIO_BULK_CAPTURE_SLOTS - 1U)];
+  bulk_tx_state = AUDIO_BULK_CAPTURE_TX_SENDING;
+  if(USBD_VENDOR_Transmit(&hUsbDeviceHS, (uint8_t*)slot, sizeof(AUDIO_BulkCaptureHeaderTypeDef) +
+                          slot->header.frames * slot->header.channels * slot->header.res_byte,
+                          AUDIO_BULK_CAPTURE_CLASS_ID) != (uint8_t)USBD_OK)
+  {
+    /* not configured : the block is dropped */
+    bulk_rd = rd + 1U;
+    bulk_tx_state = AUDIO_BULK_CAPTURE_TX_IDLE;
+    AUDIO_PumpPost(AUDIO_PUMP_BULK_CAPTURE);
+  }
+}
+
+/**
+  * @brief  AUDIO_BulkCaptureSetActive
+  *         starts or stops the capture, the recording session keeps the mic
+  *         running while the host captures. Called from the USB interrupt
+  * @param  active: 1 to capture
+  * @retval None
+  */
+static void  AUDIO_BulkCaptureSetActive(uint8_t active)
+{
+  if(active == bulk_active)
+  {
+    return;
+  }
+  bulk_active = active;
+  AUDIO_Recording_SetUser(AUDIO_RECORDING_USER_BULK, active, (uint32_t)&usb_record_session);
+}
+
+/**
+  * @brief  AUDIO_BulkCapturePlanar
+  *         writes the channels of a half one after the other, a sample may
+  *         be split by the ring end
+  * @param  dst: payload
+  * @param  region: interleaved half
+  * @param  frames: frames of the half
+  * @param  channels: channels count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+static void  AUDIO_BulkCapturePlanar(uint8_t* dst, const AUDIO_BufferRegionTypeDef* region, uint32_t frames,
+                                     uint8_t channels, uint8_t res)
+{
+  uint32_t ch, frame, i;
+  uint32_t offset;
+
+  for(ch = 0; ch < channels; ch++)
+  {
+    for(frame = 0; frame < frames; frame++)
+    {
+      offset = (frame * channels + ch) * res;
+      for(i = 0; i < res; i++, offset++)
+      {
+        *dst++ = (offset < region->length[0]) ? region->data[0][offset] :
+                                               region->data[1][offset - region->length[0]];
+      }
+    }
+  }
+}
+#endif /* USE_AUDIO_BULK_CAPTURE */
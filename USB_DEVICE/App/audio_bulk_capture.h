@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file    audio_bulk_capture.h
+  * @brief   header file for the audio_bulk_capture.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_BULK_CAPTURE_H
+#define __AUDIO_BULK_CAPTURE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "usbd_vendor.h"
+#include "audio_node.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* the vendor interface is registered after the other functions */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define AUDIO_BULK_CAPTURE_CLASS_ID       3U
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define AUDIO_BULK_CAPTURE_CLASS_ID       2U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+/* bulk IN and OUT , EP8 is free with and without the telemetry CDC */
+#define AUDIO_BULK_CAPTURE_IN_EP          0x88U
+#define AUDIO_BULK_CAPTURE_OUT_EP         0x08U
+
+/* blocks waiting for the host, one per captured half, must be a power of two */
+#ifndef AUDIO_BULK_CAPTURE_SLOTS
+#define AUDIO_BULK_CAPTURE_SLOTS          8U
+#endif /* AUDIO_BULK_CAPTURE_SLOTS */
+
+/* request ops */
+#define AUDIO_BULK_CAPTURE_OP_START       0x01U /* blocks are sent from the next captured half */
+#define AUDIO_BULK_CAPTURE_OP_STOP        0x02U /* no more block is captured */
+
+/* payload layouts */
+#define AUDIO_BULK_CAPTURE_INTERLEAVED    0x00U /* frames one after the other, as in the mic ring */
+#define AUDIO_BULK_CAPTURE_PLANAR         0x01U /* all the samples of channel 1, then of channel 2 ... */
+
+#define AUDIO_BULK_CAPTURE_SYNC           0xB5U
+
+/* Exported types ------------------------------------------------------------*/
+/* 4 bytes, sent alone in one OUT transfer. A START while capturing restarts
+   the numbering with the new run and layout */
+typedef struct
+{
+  uint8_t  op;         /* AUDIO_BULK_CAPTURE_OP_xxx */
+  uint8_t  run;        /* START : copied in the blocks, older blocks still queued have another one */
+  uint8_t  layout;     /* START : AUDIO_BULK_CAPTURE_INTERLEAVED or AUDIO_BULK_CAPTURE_PLANAR */
+  uint8_t  reserved;
+}
+AUDIO_BulkCaptureRequestTypeDef;
+
+/* 28 bytes, little endian, heads each IN transfer. The payload follows,
+   frames * channels * res_byte bytes of the record format */
+typedef struct
+{
+  uint8_t  sync;       /* AUDIO_BULK_CAPTURE_SYNC */
+  uint8_t  run;        /* run of the START request */
+  uint8_t  layout;
+  uint8_t  channels;
+  uint8_t  res_byte;   /* 2 , 3 or 4 as on the record stream */
+  uint8_t  reserved;
+  uint16_t sof;        /* USB frame number when the half was captured */
+  uint32_t sequence;   /* block number since START, a gap counts the blocks dropped on a full queue */
+  uint32_t frame;      /* index since START of the first frame, dropped blocks included */
+  uint32_t time;       /* DWT cycle counter when the half was captured */
+  uint32_t frequency;  /* sampling frequency */
+  uint32_t frames;     /* frames of the payload */
+}
+AUDIO_BulkCaptureHeaderTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern USBD_VENDOR_ItfTypeDef  AUDIO_BULK_CAPTURE_Interface_fops;
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_BulkCaptureInit(void);
+void  AUDIO_BulkCaptureWriteRegion(const AUDIO_BufferRegionTypeDef* region,
+                                   const AUDIO_DescriptionTypeDef* desc) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_BULK_CAPTURE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_BULK_CAPTURE_H */
@@ -0,0 +1,491 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_bridge.c
+  * @brief   CDC to UART bridge : the line coding set by the host is applied to
+  *          a USART, UART reception runs on a circular DMA ring with idle line
+  *          detection and is written to CDC IN in blocks, CDC OUT data is read
+  *          in chunks and sent by DMA. The CPU only copies blocks between the
+  *          CDC rings and the DMA buffers, from the pump.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_cdc_bridge.h"
+
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+#include "audio_pump.h"
+#include "usbd_cdc_if.h"
+#include "usbd_conf.h"
+
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_CDC_STRESS)
+#error "USE_AUDIO_CDC_UART_BRIDGE owns the CDC data, it can't be used with USE_AUDIO_CDC_COMMAND or USE_AUDIO_CDC_STRESS"
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_CDC_STRESS */
+#if ((defined USE_AUDIO_TAP) || (defined USE_AUDIO_SPECTRUM) || \
+     ((defined USE_AUDIO_TRACE) && (!defined USE_AUDIO_TRACE_ITM))) && (!defined USE_AUDIO_CDC_TELEMETRY)
+#error "with USE_AUDIO_CDC_UART_BRIDGE the tap, spectrum and trace frames need USE_AUDIO_CDC_TELEMETRY"
+#endif /* (USE_AUDIO_TAP || USE_AUDIO_SPECTRUM || (USE_AUDIO_TRACE && !USE_AUDIO_TRACE_ITM)) && !USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_IDLE_POWER
+#error "USE_AUDIO_IDLE_POWER changes the USART kernel clock, it can't be used with USE_AUDIO_CDC_UART_BRIDGE"
+#endif /* USE_AUDIO_IDLE_POWER */
+#if (AUDIO_CDC_BRIDGE_RX_SIZE & (AUDIO_CDC_BRIDGE_RX_SIZE - 1U)) != 0U
+#error "AUDIO_CDC_BRIDGE_RX_SIZE must be a power of two"
+#endif /* AUDIO_CDC_BRIDGE_RX_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CDC_BRIDGE_RX_KEEP          (AUDIO_CDC_BRIDGE_RX_SIZE / 2U)
+
+/* Private variables ---------------------------------------------------------*/
+static UART_HandleTypeDef huart_bridge;
+static DMA_HandleTypeDef  hdma_bridge_rx;
+static DMA_HandleTypeDef  hdma_bridge_tx;
+/* DMA1 can't reach the DTCM , D2 SRAM1 is not cacheable */
+static uint8_t bridge_rx_buffer[AUDIO_CDC_BRIDGE_RX_SIZE] USBD_D2_BSS;
+static uint8_t bridge_tx_buffer[AUDIO_CDC_BRIDGE_TX_SIZE] USBD_D2_BSS;
+
+/* written by the UART interrupts */
+static volatile uint32_t bridge_rx_head = 0;     /* free running count of received bytes */
+static volatile uint16_t bridge_rx_pos = 0;      /* DMA position of the last reception event */
+static volatile uint8_t  bridge_rx_restart = 0;  /* reception was aborted by an error */
+static volatile uint8_t  bridge_tx_busy = 0;
+/* written by the CDC control request */
+static volatile uint8_t  bridge_coding_pending = 0;
+static uint32_t bridge_coding_baud;
+static uint8_t  bridge_coding_stop_bits;
+static uint8_t  bridge_coding_parity;
+static uint8_t  bridge_coding_data_bits;
+/* only used from the pump */
+static uint32_t bridge_rx_tail = 0;
+static AUDIO_CdcBridgeStatsTypeDef bridge_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_CdcBridgeHandler(void);
+static void    AUDIO_CdcBridgeUartToUsb(void);
+static void    AUDIO_CdcBridgeUsbToUart(void);
+static int8_t  AUDIO_CdcBridgeConfigure(uint32_t baud, uint8_t stop_bits, uint8_t parity, uint8_t data_bits);
+static void    AUDIO_CdcBridgeStartRx(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcBridgeInit
+  *         registers the bridge in the pump and starts the UART with the
+  *         default CDC line coding, must be called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcBridgeInit(void)
+{
+  memset(&bridge_stats, 0, sizeof(bridge_stats));
+  bridge_tx_busy = 0;
+  bridge_coding_pending = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CDC_BRIDGE, AUDIO_CdcBridgeHandler);
+
+  huart_bridge.Instance = AUDIO_CDC_BRIDGE_UART;
+  huart_bridge.Init.Mode = UART_MODE_TX_RX;
+  huart_bridge.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart_bridge.Init.OneBitSampling = UART_ONE_BIT_SAMPLE_DISABLE;
+  huart_bridge.Init.ClockPrescaler = UART_PRESCALER_DIV1;
+  huart_bridge.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
+  if(AUDIO_CdcBridgeConfigure(AUDIO_CDC_BRIDGE_DEFAULT_BAUD, 0U, 0U, 8U) != 0)
+  {
+    Error_Handler();
+  }
+  AUDIO_CdcBridgeStartRx();
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeSetLineCoding
+  *         called on CDC_SET_LINE_CODING from the USB interrupt, the USART is
+  *         configured again from the pump
+  * @param  baud: dwDTERate
+  * @param  stop_bits: bCharFormat , 0 for 1 , 1 for 1.5 , 2 for 2 stop bits
+  * @param  parity: bParityType , 0 none , 1 odd , 2 even
+  * @param  data_bits: bDataBits , 7 or 8
+  * @retval None
+  */
+void AUDIO_CdcBridgeSetLineCoding(uint32_t baud, uint8_t stop_bits, uint8_t parity, uint8_t data_bits)
+{
+  bridge_coding_baud = baud;
+  bridge_coding_stop_bits = stop_bits;
+  bridge_coding_parity = parity;
+  bridge_coding_data_bits = data_bits;
+  /* fields are written before the pump sees the request */
+  __DMB();
+  bridge_coding_pending = 1;
+  AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeGetStats
+  *         returns the bridge counters, must be called from the pump
+  * @param  stats: counters copy
+  * @retval None
+  */
+void AUDIO_CdcBridgeGetStats(AUDIO_CdcBridgeStatsTypeDef* stats)
+{
+  *stats = bridge_stats;
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeUartIRQHandler
+  *         USART interrupt , idle line and errors
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcBridgeUartIRQHandler(void)
+{
+  HAL_UART_IRQHandler(&huart_bridge);
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeRxDmaIRQHandler
+  *         reception DMA interrupt , half and full ring
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcBridgeRxDmaIRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_bridge_rx);
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeTxDmaIRQHandler
+  *         transmission DMA interrupt
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcBridgeTxDmaIRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_bridge_tx);
+}
+
+/**
+  * @brief  HAL_UARTEx_RxEventCallback
+  *         idle line, half or full ring : Size is the DMA position in the ring.
+  *         Events come at least every half ring so the distance from the last
+  *         one is never ambiguous
+  * @param  huart: UART handle
+  * @param  Size: number of bytes in the ring from its start
+  * @retval None
+  */
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+  uint32_t pos = Size & (AUDIO_CDC_BRIDGE_RX_SIZE - 1U);
+
+  if(huart == &huart_bridge)
+  {
+    bridge_rx_head += (pos - bridge_rx_pos) & (AUDIO_CDC_BRIDGE_RX_SIZE - 1U);
+    bridge_rx_pos = (uint16_t)pos;
+    AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+  }
+}
+
+/**
+  * @brief  HAL_UART_TxCpltCallback
+  *         the chunk is sent, the next one is read from the CDC ring
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+  if(huart == &huart_bridge)
+  {
+    bridge_tx_busy = 0;
+    AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+  }
+}
+
+/**
+  * @brief  HAL_UART_ErrorCallback
+  *         an overrun aborts the DMA reception, it is started again from the
+  *         pump. Framing, noise and parity errors are only counted
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
+{
+  if(huart == &huart_bridge)
+  {
+    bridge_stats.uart_error_count++;
+    if(huart->RxState == HAL_UART_STATE_READY)
+    {
+      bridge_rx_restart = 1;
+    }
+    if(huart->gState == HAL_UART_STATE_READY)
+    {
+      bridge_tx_busy = 0;
+    }
+    AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+  }
+}
+
+/**
+  * @brief  HAL_UART_MspInit
+  *         USART clock, pins, DMA streams and interrupts of the bridge
+  * @param  huart: UART handle
+  * @retval None
+  */
+void HAL_UART_MspInit(UART_HandleTypeDef *huart)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if(huart->Instance == AUDIO_CDC_BRIDGE_UART)
+  {
+    AUDIO_CDC_BRIDGE_UART_CLK_ENABLE();
+    AUDIO_CDC_BRIDGE_GPIO_CLK_ENABLE();
+    AUDIO_CDC_BRIDGE_DMA_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = AUDIO_CDC_BRIDGE_GPIO_PINS;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = AUDIO_CDC_BRIDGE_GPIO_AF;
+    HAL_GPIO_Init(AUDIO_CDC_BRIDGE_GPIO_PORT, &GPIO_InitStruct);
+
+    hdma_bridge_rx.Instance = AUDIO_CDC_BRIDGE_RX_DMA_STREAM;
+    hdma_bridge_rx.Init.Request = AUDIO_CDC_BRIDGE_RX_DMA_REQUEST;
+    hdma_bridge_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_bridge_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_bridge_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_bridge_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_bridge_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_bridge_rx.Init.Mode = DMA_CIRCULAR;
+    hdma_bridge_rx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_bridge_rx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(&hdma_bridge_rx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(huart, hdmarx, hdma_bridge_rx);
+
+    hdma_bridge_tx.Instance = AUDIO_CDC_BRIDGE_TX_DMA_STREAM;
+    hdma_bridge_tx.Init.Request = AUDIO_CDC_BRIDGE_TX_DMA_REQUEST;
+    hdma_bridge_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_bridge_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_bridge_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_bridge_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_bridge_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_bridge_tx.Init.Mode = DMA_NORMAL;
+    hdma_bridge_tx.Init.Priority = DMA_PRIORITY_MEDIUM;
+    hdma_bridge_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(&hdma_bridge_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(huart, hdmatx, hdma_bridge_tx);
+
+    HAL_NVIC_SetPriority(AUDIO_CDC_BRIDGE_RX_DMA_IRQn, AUDIO_CDC_BRIDGE_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CDC_BRIDGE_RX_DMA_IRQn);
+    HAL_NVIC_SetPriority(AUDIO_CDC_BRIDGE_TX_DMA_IRQn, AUDIO_CDC_BRIDGE_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CDC_BRIDGE_TX_DMA_IRQn);
+    HAL_NVIC_SetPriority(AUDIO_CDC_BRIDGE_UART_IRQn, AUDIO_CDC_BRIDGE_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CDC_BRIDGE_UART_IRQn);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcBridgeHandler
+  *         pump work : new line coding, UART data to CDC IN, CDC OUT data to
+  *         the UART
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcBridgeHandler(void)
+{
+  AUDIO_CdcBridgeUartToUsb();
+  if(bridge_coding_pending)
+  {
+    bridge_coding_pending = 0;
+    __DMB();
+    HAL_UART_Abort(&huart_bridge);
+    bridge_tx_busy = 0;
+    if(AUDIO_CdcBridgeConfigure(bridge_coding_baud, bridge_coding_stop_bits,
+                                bridge_coding_parity, bridge_coding_data_bits) != 0)
+    {
+      /* the USART keeps its previous line coding */
+      bridge_stats.coding_rejected_count++;
+    }
+    bridge_rx_restart = 1;
+  }
+  if(bridge_rx_restart)
+  {
+    AUDIO_CdcBridgeStartRx();
+  }
+  AUDIO_CdcBridgeUsbToUart();
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeUartToUsb
+  *         writes the received data to the CDC transmit ring in at most two
+  *         blocks. Data not accepted stays in the DMA ring and is written on
+  *         the next CDC transfer complete, until the UART laps it
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcBridgeUartToUsb(void)
+{
+  uint32_t head = bridge_rx_head;
+  uint32_t length = head - bridge_rx_tail;
+  uint32_t offset;
+  uint32_t chunk;
+  uint32_t written;
+
+  /* the DMA is at most half a ring after the last event, older data may be overwritten */
+  if(length > AUDIO_CDC_BRIDGE_RX_KEEP)
+  {
+    bridge_stats.rx_lost_bytes += length - AUDIO_CDC_BRIDGE_RX_KEEP;
+    bridge_rx_tail = head - AUDIO_CDC_BRIDGE_RX_KEEP;
+    length = AUDIO_CDC_BRIDGE_RX_KEEP;
+  }
+  while(length != 0U)
+  {
+    offset = bridge_rx_tail & (AUDIO_CDC_BRIDGE_RX_SIZE - 1U);
+    chunk = AUDIO_CDC_BRIDGE_RX_SIZE - offset;
+    if(chunk > length)
+    {
+      chunk = length;
+    }
+    written = CDC_Write_FS(&bridge_rx_buffer[offset], (uint16_t)chunk, 0);
+    bridge_rx_tail += written;
+    bridge_stats.uart_to_usb_bytes += written;
+    length -= written;
+    if(written != chunk)
+    {
+      break;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeUsbToUart
+  *         when the UART is idle reads a chunk of CDC OUT data and sends it by
+  *         DMA. Reading makes room in the CDC ring, the host is NAKed while
+  *         the UART is slower than USB
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcBridgeUsbToUart(void)
+{
+  uint16_t length;
+
+  if(bridge_tx_busy || (CDC_GetRxCount_FS() == 0U))
+  {
+    return;
+  }
+  length = CDC_Read_FS(bridge_tx_buffer, AUDIO_CDC_BRIDGE_TX_SIZE);
+  bridge_tx_busy = 1;
+  if(HAL_UART_Transmit_DMA(&huart_bridge, bridge_tx_buffer, length) != HAL_OK)
+  {
+    bridge_tx_busy = 0;
+    return;
+  }
+  bridge_stats.usb_to_uart_bytes += length;
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeConfigure
+  *         applies a CDC line coding to the USART. Above a sixteenth of the
+  *         kernel clock the USART oversamples by 8, up to an eighth of it
+  * @param  baud: baud rate
+  * @param  stop_bits: 0 for 1 , 1 for 1.5 , 2 for 2 stop bits
+  * @param  parity: 0 none , 1 odd , 2 even , mark and space are not supported
+  * @param  data_bits: 7 or 8 , the parity bit is added to the word length
+  * @retval 0 if no error, -1 if the line coding can't be applied
+  */
+static int8_t AUDIO_CdcBridgeConfigure(uint32_t baud, uint8_t stop_bits, uint8_t parity, uint8_t data_bits)
+{
+  uint32_t kernel_clock = HAL_RCC_GetPCLK1Freq();
+  UART_InitTypeDef init = huart_bridge.Init;
+
+  if((baud == 0U) || (baud > (kernel_clock / 8U)))
+  {
+    return -1;
+  }
+  switch(stop_bits)
+  {
+    case 0:
+      init.StopBits = UART_STOPBITS_1;
+      break;
+    case 1:
+      init.StopBits = UART_STOPBITS_1_5;
+      break;
+    case 2:
+      init.StopBits = UART_STOPBITS_2;
+      break;
+    default:
+      return -1;
+  }
+  switch(parity)
+  {
+    case 0:
+      init.Parity = UART_PARITY_NONE;
+      break;
+    case 1:
+      init.Parity = UART_PARITY_ODD;
+      break;
+    case 2:
+      init.Parity = UART_PARITY_EVEN;
+      break;
+    default:
+      return -1;
+  }
+  if((data_bits != 7U) && (data_bits != 8U))
+  {
+    return -1;
+  }
+  if(parity == 0U)
+  {
+    init.WordLength = (data_bits == 8U) ? UART_WORDLENGTH_8B : UART_WORDLENGTH_7B;
+  }
+  else
+  {
+    init.WordLength = (data_bits == 8U) ? UART_WORDLENGTH_9B : UART_WORDLENGTH_8B;
+  }
+  init.BaudRate = baud;
+  init.OverSampling = (baud > (kernel_clock / 16U)) ? UART_OVERSAMPLING_8 : UART_OVERSAMPLING_16;
+
+  huart_bridge.Init = init;
+  if(HAL_UART_Init(&huart_bridge) != HAL_OK)
+  {
+    return -1;
+  }
+  bridge_stats.baud = baud;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CdcBridgeStartRx
+  *         starts the circular DMA reception from the start of the ring , the
+  *         data not yet forwarded is dropped. The reception must be stopped
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcBridgeStartRx(void)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  bridge_stats.rx_lost_bytes += bridge_rx_head - bridge_rx_tail;
+  bridge_rx_head = 0;
+  bridge_rx_tail = 0;
+  bridge_rx_pos = 0;
+  bridge_rx_restart = 0;
+  __set_PRIMASK(primask);
+  if(HAL_UARTEx_ReceiveToIdle_DMA(&huart_bridge, bridge_rx_buffer, AUDIO_CDC_BRIDGE_RX_SIZE) != HAL_OK)
+  {
+    bridge_rx_restart = 1;
+  }
+}
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_bridge.h
+  * @brief   header file for the audio_cdc_bridge.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CDC_BRIDGE_H
+#define __AUDIO_CDC_BRIDGE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+#include "main.h"
+
+#ifndef HAL_UART_MODULE_ENABLED
+#error "the CDC to UART bridge needs HAL_UART_MODULE_ENABLED and the HAL UART driver"
+#endif /* HAL_UART_MODULE_ENABLED */
+
+/* Exported constants --------------------------------------------------------*/
+/* USART2 on the Zio connector : TX PD5 , RX PD6 */
+#define AUDIO_CDC_BRIDGE_UART                 USART2
+#define AUDIO_CDC_BRIDGE_UART_CLK_ENABLE()    __HAL_RCC_USART2_CLK_ENABLE()
+#define AUDIO_CDC_BRIDGE_UART_IRQn            USART2_IRQn
+#define AUDIO_CDC_BRIDGE_UART_IRQHandler      USART2_IRQHandler
+#define AUDIO_CDC_BRIDGE_GPIO_PORT            GPIOD
+#define AUDIO_CDC_BRIDGE_GPIO_PINS            (GPIO_PIN_5 | GPIO_PIN_6)
+#define AUDIO_CDC_BRIDGE_GPIO_AF              GPIO_AF7_USART2
+#define AUDIO_CDC_BRIDGE_GPIO_CLK_ENABLE()    __HAL_RCC_GPIOD_CLK_ENABLE()
+/* DMA1 streams 0 and 1 are used by the SAI speaker and mic */
+#define AUDIO_CDC_BRIDGE_DMA_CLK_ENABLE()     __HAL_RCC_DMA1_CLK_ENABLE()
+#define AUDIO_CDC_BRIDGE_RX_DMA_STREAM        DMA1_Stream2
+#define AUDIO_CDC_BRIDGE_RX_DMA_REQUEST       DMA_REQUEST_USART2_RX
+#define AUDIO_CDC_BRIDGE_RX_DMA_IRQn          DMA1_Stream2_IRQn
+#define AUDIO_CDC_BRIDGE_RX_DMA_IRQHandler    DMA1_Stream2_IRQHandler
+#define AUDIO_CDC_BRIDGE_TX_DMA_STREAM        DMA1_Stream3
+#define AUDIO_CDC_BRIDGE_TX_DMA_REQUEST       DMA_REQUEST_USART2_TX
+#define AUDIO_CDC_BRIDGE_TX_DMA_IRQn          DMA1_Stream3_IRQn
+#define AUDIO_CDC_BRIDGE_TX_DMA_IRQHandler    DMA1_Stream3_IRQHandler
+/* below OTG_HS (0), the SAI / MDMA interrupts (1) and the audio level of the pump (2) ,
+   the UART data is moved by DMA so the interrupt latency does not limit the baud rate */
+#define AUDIO_CDC_BRIDGE_IRQ_PRIORITY         3U
+
+/* UART to USB circular DMA ring, must be a power of two. Data is forwarded on each idle line,
+   half and full transfer event, up to half of the ring is kept while the CDC IN pipe is busy */
+#define AUDIO_CDC_BRIDGE_RX_SIZE              4096U
+/* USB to UART transfer, one DMA transfer per chunk read from the CDC reception ring */
+#define AUDIO_CDC_BRIDGE_TX_SIZE              1024U
+/* line coding applied at start up, the default one of the CDC interface */
+#define AUDIO_CDC_BRIDGE_DEFAULT_BAUD         9600U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t uart_to_usb_bytes;       /* received on the UART and written to CDC IN */
+  uint32_t usb_to_uart_bytes;       /* received on CDC OUT and sent on the UART */
+  uint32_t rx_lost_bytes;           /* overwritten in the DMA ring while CDC IN was busy */
+  uint32_t uart_error_count;        /* overrun, framing, noise or parity errors */
+  uint32_t coding_rejected_count;   /* line codings the USART can't apply */
+  uint32_t baud;                    /* baud rate in use */
+}
+AUDIO_CdcBridgeStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void AUDIO_CdcBridgeInit(void);
+void AUDIO_CdcBridgeSetLineCoding(uint32_t baud, uint8_t stop_bits, uint8_t parity, uint8_t data_bits);
+void AUDIO_CdcBridgeGetStats(AUDIO_CdcBridgeStatsTypeDef* stats);
+void AUDIO_CdcBridgeUartIRQHandler(void);
+void AUDIO_CdcBridgeRxDmaIRQHandler(void);
+void AUDIO_CdcBridgeTxDmaIRQHandler(void);
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CDC_BRIDGE_H */
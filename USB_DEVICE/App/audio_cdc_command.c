@@ -0,0 +1,1284 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_command.c
+  * @brief   Command channel on the CDC interface : reads audio sessions state
+  *          and sets their controls from the host while streaming. Frames are
+  *          parsed in the pump, out of USB interrupt context.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_cdc_command.h"
+
+#ifdef USE_AUDIO_CDC_COMMAND
+#include "audio_pump.h"
+#include "usbd_audio_if.h"
+#include "usbd_cdc_if.h"
+#ifdef USE_AUDIO_TAP
+#include "audio_tap.h"
+#endif /* USE_AUDIO_TAP */
+#if (defined USE_AUDIO_PROFILER) || (defined USE_AUDIO_BOOT_PROFILE)
+#include "audio_profiler.h"
+#endif /* USE_AUDIO_PROFILER || USE_AUDIO_BOOT_PROFILE */
+#ifdef USE_AUDIO_LOOPBACK
+#include "audio_loopback.h"
+#endif /* USE_AUDIO_LOOPBACK */
+#ifdef USE_AUDIO_CDC_STRESS
+#include "audio_cdc_stress.h"
+#endif /* USE_AUDIO_CDC_STRESS */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+#include <string.h>
+#include "audio_eq_node.h"
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_LEVEL_METER
+#include "audio_meter_node.h"
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+#include "audio_sidetone_node.h"
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_TRACE
+#include "audio_trace.h"
+#endif /* USE_AUDIO_TRACE */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+#include "audio_router_node.h"
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+#include "audio_beamformer.h"
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+#ifdef USE_AUDIO_AEC
+#include "audio_aec_node.h"
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+#include "audio_agc_node.h"
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#if (defined USE_AUDIO_MIC_PATTERN) || (defined USE_AUDIO_SPEAKER_PATTERN)
+#include "audio_pattern.h"
+#endif /* USE_AUDIO_MIC_PATTERN || USE_AUDIO_SPEAKER_PATTERN */
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "audio_sof_align.h"
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_FAST_COPY
+#include "audio_fast_copy.h"
+#endif /* USE_AUDIO_FAST_COPY */
+#ifdef USE_AUDIO_CPU_LOAD
+#include "audio_cpu_load.h"
+#endif /* USE_AUDIO_CPU_LOAD */
+#ifdef USE_AUDIO_SOF_JITTER
+#include "audio_sof_jitter.h"
+#endif /* USE_AUDIO_SOF_JITTER */
+#ifdef USE_AUDIO_BENCH
+#include "audio_bench.h"
+#endif /* USE_AUDIO_BENCH */
+#ifdef USE_AUDIO_FAULT_INJECTION
+#include "audio_fault.h"
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+#include "audio_snapshot.h"
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SYNC_START
+#include "audio_sync_start.h"
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+#include "audio_long_delay_node.h"
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CDC_CMD_REQUEST_HEADER      3U /* sync, cmd, len */
+#define AUDIO_CDC_CMD_RESPONSE_HEADER     4U /* sync, cmd, status, len */
+#define AUDIO_CDC_CMD_READ_CHUNK          64U
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t  cmd_frame[AUDIO_CDC_CMD_REQUEST_HEADER + AUDIO_CDC_CMD_MAX_PAYLOAD + 1U];
+static uint32_t cmd_frame_length;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_CdcCommandHandler(void);
+static void     AUDIO_CdcCommandExecute(uint8_t cmd, uint8_t* payload, uint8_t length);
+static void     AUDIO_CdcCommandRespond(uint8_t cmd, uint8_t status, uint8_t* payload, uint8_t length);
+static uint8_t  AUDIO_CdcCommandSessionToFunction(uint8_t session);
+static uint8_t* AUDIO_CdcCommandPut32(uint8_t* dst, uint32_t value);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcCommandInit
+  *         registers the command parser in the pump, must be called after
+  *         AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcCommandInit(void)
+{
+  cmd_frame_length = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CDC_COMMAND, AUDIO_CdcCommandHandler);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcCommandHandler
+  *         pump handler, consumes received bytes and executes complete frames.
+  *         Bytes before a sync byte are dropped
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcCommandHandler(void)
+{
+  uint8_t  chunk[AUDIO_CDC_CMD_READ_CHUNK];
+  uint16_t count;
+  uint16_t i;
+  uint8_t  sum;
+  uint32_t j;
+
+  while((count = CDC_Read_FS(chunk, (uint16_t)sizeof(chunk))) != 0U)
+  {
+    for(i = 0; i < count; i++)
+    {
+      if((cmd_frame_length == 0U) && (chunk[i] != AUDIO_CDC_CMD_REQUEST_SYNC))
+      {
+        continue;
+      }
+      cmd_frame[cmd_frame_length++] = chunk[i];
+      if(cmd_frame_length < AUDIO_CDC_CMD_REQUEST_HEADER)
+      {
+        continue;
+      }
+      if(cmd_frame[2] > AUDIO_CDC_CMD_MAX_PAYLOAD)
+      {
+        AUDIO_CdcCommandRespond(cmd_frame[1], AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        cmd_frame_length = 0;
+        continue;
+      }
+      if(cmd_frame_length < (AUDIO_CDC_CMD_REQUEST_HEADER + cmd_frame[2] + 1U))
+      {
+        continue;
+      }
+      for(sum = 0, j = 0; j < cmd_frame_length; j++)
+      {
+        sum += cmd_frame[j];
+      }
+      if(sum != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd_frame[1], AUDIO_CDC_CMD_STATUS_CHECKSUM, 0, 0);
+      }
+      else
+      {
+        /* commands change session state also used by audio work */
+        uint32_t lock = AUDIO_PumpLockAudio();
+
+        AUDIO_CdcCommandExecute(cmd_frame[1], &cmd_frame[AUDIO_CDC_CMD_REQUEST_HEADER], cmd_frame[2]);
+        AUDIO_PumpUnlockAudio(lock);
+      }
+      cmd_frame_length = 0;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_CdcCommandExecute
+  *         executes one command and sends its response
+  * @param  cmd: command
+  * @param  payload: command arguments
+  * @param  length: arguments length
+  * @retval None
+  */
+static void AUDIO_CdcCommandExecute(uint8_t cmd, uint8_t* payload, uint8_t length)
+{
+  uint8_t response[AUDIO_CDC_CMD_MAX_PAYLOAD];
+  uint8_t* ptr = response;
+  AUDIO_USB_SessionStatsTypeDef stats;
+  uint8_t func;
+  int32_t value;
+  uint8_t i;
+#ifdef USE_AUDIO_TAP
+  uint8_t point;
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_PROFILER
+  AUDIO_ProfilerProbeTypeDef probe;
+  uint8_t bin;
+#endif /* USE_AUDIO_PROFILER */
+#ifdef USE_AUDIO_LOOPBACK
+  AUDIO_LoopbackStatsTypeDef loopback;
+#endif /* USE_AUDIO_LOOPBACK */
+#ifdef USE_AUDIO_CDC_STRESS
+  AUDIO_CdcStressReportTypeDef report;
+#endif /* USE_AUDIO_CDC_STRESS */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+  AUDIO_DummyClockStatsTypeDef drift;
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  float coef[AUDIO_EQ_COEF_COUNT];
+  uint32_t word;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_LEVEL_METER
+  AUDIO_MeterLevelTypeDef levels[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  uint8_t channels;
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+  int gain_db_256;
+  uint32_t slips;
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+  uint8_t presets[AUDIO_BEAM_MAX_BEAMS];
+  int8_t beams;
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+#ifdef USE_AUDIO_AEC
+  uint8_t aec_synced;
+  uint32_t aec_slips;
+  int erle_db_256;
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+  int agc_gain_db_256;
+  int envelope_db_256;
+  uint8_t gate_open;
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_SPECTRUM
+  uint32_t period_ms;
+  uint8_t source;
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_MIC_PATTERN
+  AUDIO_PatternStatsTypeDef pattern;
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+  AUDIO_PatternCheckTypeDef pattern_check;
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+#ifdef USE_AUDIO_SOF_ALIGN
+  AUDIO_SofAlignStatsTypeDef align;
+  uint8_t stream;
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_FAST_COPY
+  AUDIO_FastCopyBenchTypeDef bench;
+  uint8_t bench_index;
+#endif /* USE_AUDIO_FAST_COPY */
+#ifdef USE_AUDIO_CPU_LOAD
+  AUDIO_CpuLoadReportTypeDef load;
+  uint8_t load_index;
+#endif /* USE_AUDIO_CPU_LOAD */
+#ifdef USE_AUDIO_ISO_SLACK
+  USBD_AUDIO_IsoSlackTypeDef slack[2];
+  uint8_t slack_ep;
+#endif /* USE_AUDIO_ISO_SLACK */
+#ifdef USE_AUDIO_SOF_JITTER
+  AUDIO_SofJitterStatsTypeDef sof_jitter;
+#endif /* USE_AUDIO_SOF_JITTER */
+#ifdef USE_AUDIO_BENCH
+  AUDIO_BenchResultTypeDef bench_result;
+  uint32_t bench_freq;
+  uint32_t bench_crc;
+#endif /* USE_AUDIO_BENCH */
+#ifdef USE_AUDIO_FAULT_INJECTION
+  AUDIO_FaultConfigTypeDef fault;
+  AUDIO_FaultReportTypeDef fault_report;
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#ifdef USE_AUDIO_SNAPSHOT
+  AUDIO_SnapshotStatusTypeDef snapshot;
+  uint8_t snapshot_status;
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SYNC_START
+  AUDIO_SyncStartStatusTypeDef sync_start;
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+  AUDIO_LongDelayStatusTypeDef long_delay;
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+  switch(cmd)
+  {
+    case AUDIO_CDC_CMD_PING:
+      *ptr++ = AUDIO_CDC_CMD_VERSION;
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+
+    case AUDIO_CDC_CMD_GET_STATS:
+      if((length != 1U) || ((func = AUDIO_CdcCommandSessionToFunction(payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(USBD_AUDIO_GetSessionStats(func, &stats) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* state, res, channels, mute, frequence, volume then counters : 40 bytes */
+      *ptr++ = stats.state;
+      *ptr++ = stats.audio_description.audio_res;
+      *ptr++ = stats.audio_description.channels_count;
+      *ptr++ = stats.audio_description.audio_mute;
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.audio_description.frequence);
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)stats.audio_description.audio_volume_db_256);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.buffer_size);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.buffer_filled);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.feedback);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.underrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.overrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.iso_in_incomplete_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.iso_out_incomplete_count);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+
+    case AUDIO_CDC_CMD_GET_FILL:
+      if((length != 1U) || ((func = AUDIO_CdcCommandSessionToFunction(payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(USBD_AUDIO_GetSessionStats(func, &stats) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* size, min, max, underruns, overruns, ms since last glitch, histogram, resyncs : 92 bytes */
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.buffer_size);
+      ptr = AUDIO_CdcCommandPut32(ptr, (stats.fill.fill_min == UINT32_MAX) ? 0U : stats.fill.fill_min);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.fill.fill_max);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.fill.underrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.fill.overrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, HAL_GetTick() - stats.fill.glitch_tick);
+      for(i = 0; i < AUDIO_BUFFER_FILL_HIST_BINS; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, stats.fill.fill_hist[i]);
+      }
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.fill.resync_count);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+
+    case AUDIO_CDC_CMD_SET_PARAM:
+      if((length != 8U) || ((func = AUDIO_CdcCommandSessionToFunction(payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      value = (int32_t)((uint32_t)payload[4] | ((uint32_t)payload[5] << 8) |
+                        ((uint32_t)payload[6] << 16) | ((uint32_t)payload[7] << 24));
+      if((payload[1] > (uint8_t)AUDIO_USB_PARAM_CHAIN)||
+         (USBD_AUDIO_SetSessionParameter(func, (AUDIO_USB_SessionParamTypedef)payload[1],
+                                         (uint16_t)(payload[2] | (payload[3] << 8)), value) != 0))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, 0, 0);
+      break;
+
+#ifdef USE_AUDIO_TAP
+    case AUDIO_CDC_CMD_SET_TAP:
+      if(length != 1U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_TapSelect(payload[0]);
+      *ptr++ = (uint8_t)AUDIO_TapGetSelected();
+      for(point = 0; point < AUDIO_TAP_POINT_COUNT; point++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_TapGetDropped(point));
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_TAP */
+
+#ifdef USE_AUDIO_PROFILER
+    case AUDIO_CDC_CMD_GET_PROFILE:
+      if((length != 2U) || (AUDIO_ProfilerGet(payload[0], &probe) != 0))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(payload[1] != 0U)
+      {
+        AUDIO_ProfilerReset();
+      }
+      /* probe then count, min, avg, max, histogram : 49 bytes */
+      *ptr++ = payload[0];
+      ptr = AUDIO_CdcCommandPut32(ptr, probe.count);
+      ptr = AUDIO_CdcCommandPut32(ptr, (probe.count != 0U) ? probe.min : 0U);
+      ptr = AUDIO_CdcCommandPut32(ptr, (probe.count != 0U) ? (uint32_t)(probe.total / probe.count) : 0U);
+      ptr = AUDIO_CdcCommandPut32(ptr, probe.max);
+      for(bin = 0; bin < AUDIO_PROF_HIST_BINS; bin++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, probe.hist[bin]);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_PROFILER */
+
+#ifdef USE_AUDIO_LOOPBACK
+    case AUDIO_CDC_CMD_LOOPBACK:
+      if((length > 1U) || ((length == 1U) && (AUDIO_LoopbackSetDelay(payload[0]) != 0)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_LoopbackGetStats(&loopback);
+      /* delay, count, min, max, dropped bytes then latency histogram : 84 bytes */
+      ptr = AUDIO_CdcCommandPut32(ptr, loopback.delay_ms);
+      ptr = AUDIO_CdcCommandPut32(ptr, loopback.count);
+      ptr = AUDIO_CdcCommandPut32(ptr, (loopback.count != 0U) ? loopback.min_ms : 0U);
+      ptr = AUDIO_CdcCommandPut32(ptr, loopback.max_ms);
+      ptr = AUDIO_CdcCommandPut32(ptr, loopback.dropped);
+      for(i = 0; i < AUDIO_LOOPBACK_HIST_BINS; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, loopback.hist[i]);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_LOOPBACK */
+
+#ifdef USE_AUDIO_CDC_STRESS
+    case AUDIO_CDC_CMD_STRESS:
+      if(length == 4U)
+      {
+        /* response is sent before the filler , CDC OUT is dropped until the end */
+        if(AUDIO_CdcStressStart((uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+                                ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24)) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, 0, 0);
+        break;
+      }
+      if(length != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(AUDIO_CdcStressGetReport(&report) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* report fields in AUDIO_CdcStressReportTypeDef order : 48 bytes */
+      ptr = AUDIO_CdcCommandPut32(ptr, report.duration_ms);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.cdc_tx_bytes);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.cdc_rx_bytes);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.play_frequency);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.record_frequency);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.play_underrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.play_overrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.play_iso_out_incomplete_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.record_underrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.record_overrun_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.record_iso_in_incomplete_count);
+      ptr = AUDIO_CdcCommandPut32(ptr, report.isr_load_permille);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_CDC_STRESS */
+
+#ifdef USE_AUDIO_DUMMY_CLOCK
+    case AUDIO_CDC_CMD_DUMMY_CLOCK:
+      if((length != 0U) && (length != 4U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 4U)
+      {
+        /* the run starts now , set it once the streams are started */
+        value = (int32_t)((uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+                          ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24));
+        if(AUDIO_DummyClockSetPpm(value) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      AUDIO_DummyClockGetStats(&drift);
+      /* ppm, elapsed, frames, rate errors, feedback error, fill min and max : 44 bytes.
+         speaker before mic , errors in ppm */
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)drift.ppm);
+      ptr = AUDIO_CdcCommandPut32(ptr, drift.elapsed_ms);
+      for(i = 0; i < AUDIO_DUMMY_CLOCK_DIR_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, drift.frames[i]);
+      }
+      for(i = 0; i < AUDIO_DUMMY_CLOCK_DIR_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)drift.rate_error[i]);
+      }
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)drift.feedback_error);
+      for(i = 0; i < AUDIO_DUMMY_CLOCK_DIR_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, drift.fill_min[i]);
+        ptr = AUDIO_CdcCommandPut32(ptr, drift.fill_max[i]);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+
+#ifdef USE_AUDIO_PACKET_QUEUE
+    case AUDIO_CDC_CMD_GET_DELAY:
+      if((length != 1U) || ((func = AUDIO_CdcCommandSessionToFunction(payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(USBD_AUDIO_GetSessionStats(func, &stats) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* count, lost, last, min, avg, max : 24 bytes. play : USB reception to speaker output,
+         record : mic input to USB send */
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.delay.count);
+      ptr = AUDIO_CdcCommandPut32(ptr, stats.delay.lost);
+      ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_PACKET_TIME_TO_US(stats.delay.last));
+      ptr = AUDIO_CdcCommandPut32(ptr, (stats.delay.count == 0U) ? 0U : AUDIO_PACKET_TIME_TO_US(stats.delay.min));
+      ptr = AUDIO_CdcCommandPut32(ptr, (stats.delay.count == 0U) ? 0U :
+                                       AUDIO_PACKET_TIME_TO_US(stats.delay.total / stats.delay.count));
+      ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_PACKET_TIME_TO_US(stats.delay.max));
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    case AUDIO_CDC_CMD_SET_EQ:
+      if((length != 0U) && (length != (2U + (AUDIO_EQ_COEF_COUNT * 4U))))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 0U)
+      {
+        if(AUDIO_EqCommit() != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+          break;
+        }
+      }
+      else
+      {
+        for(i = 0; i < AUDIO_EQ_COEF_COUNT; i++)
+        {
+          word = (uint32_t)payload[2U + 4U * i] | ((uint32_t)payload[3U + 4U * i] << 8) |
+                 ((uint32_t)payload[4U + 4U * i] << 16) | ((uint32_t)payload[5U + 4U * i] << 24);
+          memcpy(&coef[i], &word, sizeof(float));
+        }
+        /* refused while the previous commit waits for a packet */
+        if(AUDIO_EqSetStage(payload[0], payload[1], coef) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      *ptr++ = AUDIO_EqGetStageCount();
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+#ifdef USE_AUDIO_LEVEL_METER
+    case AUDIO_CDC_CMD_METER:
+      if((length != 1U) && (length != 9U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 9U)
+      {
+        if(AUDIO_MeterConfigure(payload[0],
+                                (uint32_t)payload[1] | ((uint32_t)payload[2] << 8) |
+                                ((uint32_t)payload[3] << 16) | ((uint32_t)payload[4] << 24),
+                                (uint32_t)payload[5] | ((uint32_t)payload[6] << 8) |
+                                ((uint32_t)payload[7] << 16) | ((uint32_t)payload[8] << 24)) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      /* the meters are numbered as the sessions */
+      if(AUDIO_MeterGetLevels(payload[0], levels, &channels) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* channels, then peak and rms on 24 bits per channel : 65 bytes for 8 channels */
+      *ptr++ = channels;
+      for(i = 0; i < channels; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, levels[i].peak);
+        ptr = AUDIO_CdcCommandPut32(ptr, levels[i].rms);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_LEVEL_METER */
+
+#ifdef USE_AUDIO_SIDETONE
+    case AUDIO_CDC_CMD_SIDETONE:
+      if((length != 0U) && (length != 4U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 4U)
+      {
+        value = (int32_t)((uint32_t)payload[0] | ((uint32_t)payload[1] << 8) |
+                          ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24));
+        if(AUDIO_SidetoneSetGain(value) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      if(AUDIO_SidetoneGetStatus(&gain_db_256, &slips) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)gain_db_256);
+      ptr = AUDIO_CdcCommandPut32(ptr, slips);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SIDETONE */
+
+#ifdef USE_AUDIO_BOOT_PROFILE
+    case AUDIO_CDC_CMD_GET_BOOT:
+      /* budget, reached, count then stages : 45 bytes */
+      ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_BOOT_BUDGET_US);
+      ptr = AUDIO_CdcCommandPut32(ptr, audio_boot_profile.reached);
+      *ptr++ = AUDIO_BOOT_STAGE_COUNT;
+      for(i = 0; i < AUDIO_BOOT_STAGE_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, audio_boot_profile.time_us[i]);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_BOOT_PROFILE */
+
+#ifdef USE_AUDIO_TRACE
+    case AUDIO_CDC_CMD_TRACE:
+      if((length > 1U) || ((length == 1U) && (payload[0] > AUDIO_TRACE_MODE_FREEZE)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 1U)
+      {
+        AUDIO_TraceSetMode(payload[0]);
+      }
+      /* mode, frozen, lost : 6 bytes */
+      *ptr++ = AUDIO_TraceGetMode();
+      *ptr++ = AUDIO_TraceIsFrozen();
+      ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_TraceGetLost());
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_TRACE */
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    case AUDIO_CDC_CMD_ROUTE:
+      if((length != 0U) && (length != 4U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(AUDIO_RouterIsIdentity() < 0)
+      {
+        /* playback not initialized */
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      if(length == 0U)
+      {
+        if(AUDIO_RouterCommit() != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+          break;
+        }
+      }
+      /* refused while the previous commit waits for a packet */
+      else if(AUDIO_RouterSetGain(payload[0], payload[1],
+                                  (int16_t)((uint16_t)payload[2] | ((uint16_t)payload[3] << 8))) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      *ptr++ = (uint8_t)AUDIO_RouterIsIdentity();
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+    case AUDIO_CDC_CMD_BEAM:
+      if((length != 0U) && (length != 2U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(AUDIO_BeamformerGetPresets(presets) < 0)
+      {
+        /* recording not initialized */
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      if((length == 2U) && (AUDIO_BeamformerSetPreset(payload[0], payload[1]) != 0))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      beams = AUDIO_BeamformerGetPresets(presets);
+      *ptr++ = (uint8_t)beams;
+      for(i = 0; i < (uint8_t)beams; i++)
+      {
+        *ptr++ = presets[i];
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+
+#ifdef USE_AUDIO_AEC
+    case AUDIO_CDC_CMD_AEC:
+      if(AUDIO_AecGetStatus(&aec_synced, &aec_slips, &erle_db_256) != 0)
+      {
+        /* recording not initialized */
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      *ptr++ = aec_synced;
+      ptr = AUDIO_CdcCommandPut32(ptr, aec_slips);
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)erle_db_256);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_AEC */
+
+#ifdef USE_AUDIO_MIC_AGC
+    case AUDIO_CDC_CMD_AGC:
+      if((length != 0U) && (length != 6U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(AUDIO_AgcGetStatus(&agc_gain_db_256, &envelope_db_256, &gate_open) != 0)
+      {
+        /* recording not initialized */
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      if((length == 6U) &&
+         (AUDIO_AgcSetLevels((int16_t)((uint16_t)payload[0] | ((uint16_t)payload[1] << 8)),
+                             (int16_t)((uint16_t)payload[2] | ((uint16_t)payload[3] << 8)),
+                             (int16_t)((uint16_t)payload[4] | ((uint16_t)payload[5] << 8))) != 0))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)agc_gain_db_256);
+      ptr = AUDIO_CdcCommandPut32(ptr, (uint32_t)envelope_db_256);
+      *ptr++ = gate_open;
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_MIC_AGC */
+
+#ifdef USE_AUDIO_SPECTRUM
+    case AUDIO_CDC_CMD_SPECTRUM:
+      if((length != 0U) && (length != 3U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 3U)
+      {
+        if(AUDIO_SpectrumSelect(payload[0], (uint32_t)payload[1] | ((uint32_t)payload[2] << 8)) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      *ptr++ = (uint8_t)AUDIO_SpectrumGetSelected(&period_ms);
+      *ptr++ = (uint8_t)period_ms;
+      *ptr++ = (uint8_t)(period_ms >> 8);
+      for(source = 0; source < AUDIO_SPECTRUM_SOURCE_COUNT; source++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_SpectrumGetSent(source));
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SPECTRUM */
+
+#ifdef USE_AUDIO_MIC_PATTERN
+    case AUDIO_CDC_CMD_PATTERN:
+      if((length > 1U) || ((length == 1U) && (AUDIO_PatternSetMode(payload[0]) != 0)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_PatternGetStats(&pattern);
+      *ptr++ = pattern.mode;
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern.frames);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern.sync_packets);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern.sync_skipped);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern.sync_last_frame);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_MIC_PATTERN */
+
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+    case AUDIO_CDC_CMD_PATTERN_CHECK:
+      if((length > 1U) || ((length == 1U) && (AUDIO_PatternCheckSetMode(payload[0]) != 0)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      /* compared by the host with the ISO OUT incomplete count of GET_STATS */
+      AUDIO_PatternCheckGetStats(&pattern_check);
+      *ptr++ = pattern_check.mode;
+      *ptr++ = pattern_check.locked;
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.packets);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.error_packets);
+      *ptr++ = (uint8_t)pattern_check.error_sof;
+      *ptr++ = (uint8_t)(pattern_check.error_sof >> 8);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.frames);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.lost);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.repeated);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.corrupted);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.bit_errors);
+      ptr = AUDIO_CdcCommandPut32(ptr, pattern_check.resyncs);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+#ifdef USE_AUDIO_SOF_ALIGN
+    case AUDIO_CDC_CMD_SOF_ALIGN:
+      if(length != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      for(stream = 0; stream < AUDIO_SOF_ALIGN_STREAM_COUNT; stream++)
+      {
+        AUDIO_SofAlignGetStats(stream, &align);
+        *ptr++ = align.aligned;
+        *ptr++ = (uint8_t)align.offset_us;
+        *ptr++ = (uint8_t)(align.offset_us >> 8);
+        *ptr++ = (uint8_t)align.error_us;
+        *ptr++ = (uint8_t)((uint16_t)align.error_us >> 8);
+        *ptr++ = (uint8_t)align.error_min_us;
+        *ptr++ = (uint8_t)((uint16_t)align.error_min_us >> 8);
+        *ptr++ = (uint8_t)align.error_max_us;
+        *ptr++ = (uint8_t)((uint16_t)align.error_max_us >> 8);
+        ptr = AUDIO_CdcCommandPut32(ptr, align.halves);
+        ptr = AUDIO_CdcCommandPut32(ptr, align.drifts);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+#ifdef USE_AUDIO_FAST_COPY
+    case AUDIO_CDC_CMD_COPY_BENCH:
+      if(length != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      *ptr++ = AUDIO_FAST_COPY_BENCH_COUNT;
+      for(bench_index = 0; AUDIO_FastCopyGetBench(bench_index, &bench) == 0; bench_index++)
+      {
+        *ptr++ = (uint8_t)bench.length;
+        *ptr++ = (uint8_t)(bench.length >> 8);
+        ptr = AUDIO_CdcCommandPut32(ptr, bench.copy_newlib);
+        ptr = AUDIO_CdcCommandPut32(ptr, bench.copy_fast);
+        ptr = AUDIO_CdcCommandPut32(ptr, bench.copy_mdma);
+        ptr = AUDIO_CdcCommandPut32(ptr, bench.set_newlib);
+        ptr = AUDIO_CdcCommandPut32(ptr, bench.set_fast);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_FAST_COPY */
+
+#ifdef USE_AUDIO_CPU_LOAD
+    case AUDIO_CDC_CMD_CPU_LOAD:
+      if(length != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_CpuLoadGetReport(&load);
+      ptr = AUDIO_CdcCommandPut32(ptr, load.frames);
+      for(load_index = 0; load_index < AUDIO_CPU_LOAD_STAGE_COUNT; load_index++)
+      {
+        *ptr++ = (uint8_t)load.stage[load_index].avg;
+        *ptr++ = (uint8_t)(load.stage[load_index].avg >> 8);
+        *ptr++ = (uint8_t)load.stage[load_index].peak;
+        *ptr++ = (uint8_t)(load.stage[load_index].peak >> 8);
+      }
+      *ptr++ = load.nodes;
+      for(load_index = 0; load_index < load.nodes; load_index++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, load.node_id[load_index]);
+        *ptr++ = (uint8_t)load.node[load_index].avg;
+        *ptr++ = (uint8_t)(load.node[load_index].avg >> 8);
+        *ptr++ = (uint8_t)load.node[load_index].peak;
+        *ptr++ = (uint8_t)(load.node[load_index].peak >> 8);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_CPU_LOAD */
+
+#ifdef USE_AUDIO_ISO_SLACK
+    case AUDIO_CDC_CMD_ISO_SLACK:
+      if((length != 1U) || ((func = AUDIO_CdcCommandSessionToFunction(payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(USBD_AUDIO_GetSessionSlack(func, &slack[0], &slack[1]) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      /* 42 bytes per endpoint, the feedback one is cleared when not built */
+      for(slack_ep = 0; slack_ep < 2U; slack_ep++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, slack[slack_ep].count);
+        ptr = AUDIO_CdcCommandPut32(ptr, slack[slack_ep].late);
+        *ptr++ = (uint8_t)slack[slack_ep].worst_us;
+        *ptr++ = (uint8_t)((uint16_t)slack[slack_ep].worst_us >> 8);
+        for(i = 0; i < USBD_AUDIO_SLACK_BINS; i++)
+        {
+          ptr = AUDIO_CdcCommandPut32(ptr, slack[slack_ep].hist[i]);
+        }
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_ISO_SLACK */
+
+#ifdef USE_AUDIO_SOF_JITTER
+    case AUDIO_CDC_CMD_SOF_JITTER:
+      if(length != 0U)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_SofJitterGetStats(&sof_jitter);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.windows);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.period_ps);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.jitter_avg_ns);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.jitter_peak_ns);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.window_missed);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.missed);
+      ptr = AUDIO_CdcCommandPut32(ptr, sof_jitter.overruns);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SOF_JITTER */
+
+#ifdef USE_AUDIO_BENCH
+    case AUDIO_CDC_CMD_BENCH:
+      if(length == 0U)
+      {
+        *ptr++ = AUDIO_BENCH_TEST_COUNT;
+        ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_BenchGetTests());
+        *ptr++ = AUDIO_BENCH_RUNS;
+        ptr = AUDIO_CdcCommandPut32(ptr, AUDIO_BENCH_FREQ_MAX);
+        ptr = AUDIO_CdcCommandPut32(ptr, SystemCoreClock);
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+        break;
+      }
+      if((length != 6U) && (length != 10U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      /* the kernels share the nodes and buffers of the streams */
+      for(i = AUDIO_CDC_CMD_SESSION_PLAYBACK; i <= AUDIO_CDC_CMD_SESSION_RECORD; i++)
+      {
+        func = AUDIO_CdcCommandSessionToFunction(i);
+        if((USBD_AUDIO_GetSessionStats(func, &stats) == 0) && (stats.state == AUDIO_SESSION_STARTED))
+        {
+          break;
+        }
+      }
+      if((i <= AUDIO_CDC_CMD_SESSION_RECORD) || (payload[0] >= AUDIO_BENCH_TEST_COUNT) ||
+         ((AUDIO_BenchGetTests() & (1U << payload[0])) == 0U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNAVAILABLE, 0, 0);
+        break;
+      }
+      bench_freq = (uint32_t)payload[2] | ((uint32_t)payload[3] << 8) |
+                   ((uint32_t)payload[4] << 16) | ((uint32_t)payload[5] << 24);
+      bench_crc = (length == 10U) ? ((uint32_t)payload[6] | ((uint32_t)payload[7] << 8) |
+                                     ((uint32_t)payload[8] << 16) | ((uint32_t)payload[9] << 24)) : 0U;
+      if(AUDIO_BenchRun(payload[0], payload[1], bench_freq, (length == 10U) ? &bench_crc : 0, &bench_result) != 0)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      *ptr++ = bench_result.test;
+      *ptr++ = bench_result.res;
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.freq);
+      *ptr++ = (uint8_t)bench_result.frames;
+      *ptr++ = (uint8_t)(bench_result.frames >> 8);
+      *ptr++ = (uint8_t)bench_result.runs;
+      *ptr++ = (uint8_t)(bench_result.runs >> 8);
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.min);
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.avg);
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.max);
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.budget);
+      ptr = AUDIO_CdcCommandPut32(ptr, bench_result.crc);
+      *ptr++ = bench_result.status;
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_BENCH */
+
+#ifdef USE_AUDIO_FAULT_INJECTION
+    case AUDIO_CDC_CMD_FAULT:
+      if((length != 0U) && (length != 12U))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(length == 12U)
+      {
+        fault.drop_out_every = (uint16_t)(payload[0] | (payload[1] << 8));
+        fault.delay_in_every = (uint16_t)(payload[2] | (payload[3] << 8));
+        fault.delay_in_us = (uint16_t)(payload[4] | (payload[5] << 8));
+        fault.incomplete_in_every = (uint16_t)(payload[6] | (payload[7] << 8));
+        fault.skew_ppm[AUDIO_FAULT_PLAYBACK] = (int16_t)(payload[8] | (payload[9] << 8));
+        fault.skew_ppm[AUDIO_FAULT_RECORD] = (int16_t)(payload[10] | (payload[11] << 8));
+        if(AUDIO_FaultSet(&fault) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      AUDIO_FaultGetReport(&fault_report);
+      /* faults 12 bytes, elapsed, then 37 bytes per session : 90 bytes */
+      *ptr++ = (uint8_t)fault_report.config.drop_out_every;
+      *ptr++ = (uint8_t)(fault_report.config.drop_out_every >> 8);
+      *ptr++ = (uint8_t)fault_report.config.delay_in_every;
+      *ptr++ = (uint8_t)(fault_report.config.delay_in_every >> 8);
+      *ptr++ = (uint8_t)fault_report.config.delay_in_us;
+      *ptr++ = (uint8_t)(fault_report.config.delay_in_us >> 8);
+      *ptr++ = (uint8_t)fault_report.config.incomplete_in_every;
+      *ptr++ = (uint8_t)(fault_report.config.incomplete_in_every >> 8);
+      for(i = 0; i < AUDIO_FAULT_DIR_COUNT; i++)
+      {
+        *ptr++ = (uint8_t)fault_report.config.skew_ppm[i];
+        *ptr++ = (uint8_t)((uint16_t)fault_report.config.skew_ppm[i] >> 8);
+      }
+      ptr = AUDIO_CdcCommandPut32(ptr, fault_report.elapsed_ms);
+      for(i = 0; i < AUDIO_FAULT_DIR_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].injected);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].underrun_count);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].overrun_count);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].resync_count);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].incomplete_count);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].recoveries);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].recovery_last_ms);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].recovery_max_ms);
+        ptr = AUDIO_CdcCommandPut32(ptr, fault_report.dir[i].recovery_total_ms);
+        *ptr++ = fault_report.dir[i].recovering;
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_FAULT_INJECTION */
+
+#ifdef USE_AUDIO_SNAPSHOT
+    case AUDIO_CDC_CMD_SNAPSHOT:
+      if((length == 0U) || ((payload[0] == AUDIO_SNAPSHOT_OP_ARM) ? (length != 5U) : (length != 1U)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      snapshot_status = AUDIO_CDC_CMD_STATUS_OK;
+      switch(payload[0])
+      {
+        case AUDIO_SNAPSHOT_OP_STATUS:
+          break;
+        case AUDIO_SNAPSHOT_OP_ARM:
+          if(AUDIO_SnapshotArm(payload[1], payload[2], (uint16_t)(payload[3] | (payload[4] << 8))) != 0)
+          {
+            snapshot_status = AUDIO_CDC_CMD_STATUS_BAD_ARGS;
+          }
+          break;
+        case AUDIO_SNAPSHOT_OP_TRIGGER:
+          AUDIO_SnapshotTrigger(AUDIO_SNAPSHOT_TRIGGER_COMMAND);
+          break;
+        case AUDIO_SNAPSHOT_OP_READ:
+          /* the frames follow the response, they are sent from the pump */
+          if(AUDIO_SnapshotRead() != 0)
+          {
+            snapshot_status = AUDIO_CDC_CMD_STATUS_UNAVAILABLE;
+          }
+          break;
+        case AUDIO_SNAPSHOT_OP_STOP:
+          AUDIO_SnapshotStop();
+          break;
+        default:
+          snapshot_status = AUDIO_CDC_CMD_STATUS_BAD_ARGS;
+          break;
+      }
+      if(snapshot_status != AUDIO_CDC_CMD_STATUS_OK)
+      {
+        AUDIO_CdcCommandRespond(cmd, snapshot_status, 0, 0);
+        break;
+      }
+      AUDIO_SnapshotGetStatus(&snapshot);
+      /* 10 bytes then 8 per point : 34 bytes */
+      *ptr++ = snapshot.state;
+      *ptr++ = snapshot.points;
+      *ptr++ = snapshot.triggers;
+      *ptr++ = snapshot.cause;
+      *ptr++ = (uint8_t)snapshot.post_ms;
+      *ptr++ = (uint8_t)(snapshot.post_ms >> 8);
+      ptr = AUDIO_CdcCommandPut32(ptr, snapshot.trigger_ms);
+      for(i = 0; i < AUDIO_TAP_POINT_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, snapshot.length[i]);
+        ptr = AUDIO_CdcCommandPut32(ptr, snapshot.pre[i]);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SNAPSHOT */
+
+#ifdef USE_AUDIO_SYNC_START
+    case AUDIO_CDC_CMD_SYNC_START:
+      if((length == 0U) || ((payload[0] == AUDIO_SYNC_START_OP_ARM) ? (length != 2U) : (length != 1U)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      if(payload[0] == AUDIO_SYNC_START_OP_ARM)
+      {
+        if(AUDIO_SyncStartArm(payload[1]) != 0)
+        {
+          AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+          break;
+        }
+      }
+      else if(payload[0] == AUDIO_SYNC_START_OP_DISARM)
+      {
+        AUDIO_SyncStartDisarm();
+      }
+      else if(payload[0] != AUDIO_SYNC_START_OP_STATUS)
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_SyncStartGetStatus(&sync_start);
+      /* 6 bytes then 6 per stream : 18 bytes */
+      *ptr++ = sync_start.state;
+      *ptr++ = sync_start.held;
+      *ptr++ = sync_start.valid;
+      *ptr++ = sync_start.lead_ms;
+      *ptr++ = (uint8_t)sync_start.start_frame;
+      *ptr++ = (uint8_t)(sync_start.start_frame >> 8);
+      for(i = 0; i < AUDIO_SYNC_START_STREAM_COUNT; i++)
+      {
+        ptr = AUDIO_CdcCommandPut32(ptr, sync_start.position[i]);
+        *ptr++ = (uint8_t)sync_start.delay[i];
+        *ptr++ = (uint8_t)(sync_start.delay[i] >> 8);
+      }
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_SYNC_START */
+
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+    case AUDIO_CDC_CMD_LONG_DELAY:
+      if(((length != 0U) && (length != 2U)) ||
+         ((length == 2U) && (AUDIO_LongDelaySetMs((uint16_t)(payload[0] | (payload[1] << 8))) != 0)))
+      {
+        AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_BAD_ARGS, 0, 0);
+        break;
+      }
+      AUDIO_LongDelayGetStatus(&long_delay);
+      /* 5 bytes then 5 words : 25 bytes */
+      *ptr++ = long_delay.state;
+      *ptr++ = (uint8_t)long_delay.delay_ms;
+      *ptr++ = (uint8_t)(long_delay.delay_ms >> 8);
+      *ptr++ = (uint8_t)long_delay.max_ms;
+      *ptr++ = (uint8_t)(long_delay.max_ms >> 8);
+      ptr = AUDIO_CdcCommandPut32(ptr, long_delay.delay_frames);
+      ptr = AUDIO_CdcCommandPut32(ptr, long_delay.underruns);
+      ptr = AUDIO_CdcCommandPut32(ptr, long_delay.overflows);
+      ptr = AUDIO_CdcCommandPut32(ptr, long_delay.flushes);
+      ptr = AUDIO_CdcCommandPut32(ptr, long_delay.fetches);
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_OK, response, (uint8_t)(ptr - response));
+      break;
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+    default :
+      AUDIO_CdcCommandRespond(cmd, AUDIO_CDC_CMD_STATUS_UNKNOWN, 0, 0);
+      break;
+  }
+}
+
+/**
+  * @brief  AUDIO_CdcCommandRespond
+  *         sends a response frame, dropped when the CDC transmit ring is full
+  * @param  cmd: command answered
+  * @param  status: response status
+  * @param  payload: response data
+  * @param  length: response data length
+  * @retval None
+  */
+static void AUDIO_CdcCommandRespond(uint8_t cmd, uint8_t status, uint8_t* payload, uint8_t length)
+{
+  uint8_t frame[AUDIO_CDC_CMD_RESPONSE_HEADER + AUDIO_CDC_CMD_MAX_PAYLOAD + 1U];
+  uint8_t sum = 0;
+  uint32_t i;
+
+  frame[0] = AUDIO_CDC_CMD_RESPONSE_SYNC;
+  frame[1] = cmd;
+  frame[2] = status;
+  frame[3] = length;
+  for(i = 0; i < length; i++)
+  {
+    frame[AUDIO_CDC_CMD_RESPONSE_HEADER + i] = payload[i];
+  }
+  for(i = 0; i < (AUDIO_CDC_CMD_RESPONSE_HEADER + length); i++)
+  {
+    sum += frame[i];
+  }
+  frame[i] = (uint8_t)(0U - sum);
+  /* never wait for the host in the pump */
+  (void)CDC_Transmit_FS(frame, (uint16_t)(i + 1U));
+}
+
+/**
+  * @brief  AUDIO_CdcCommandSessionToFunction
+  *         converts a session number of the protocol to an audio function
+  * @param  session: AUDIO_CDC_CMD_SESSION_PLAYBACK or AUDIO_CDC_CMD_SESSION_RECORD
+  * @retval USBD_AUDIO_PLAYBACK, USBD_AUDIO_RECORD or 0 if unknown
+  */
+static uint8_t AUDIO_CdcCommandSessionToFunction(uint8_t session)
+{
+  switch(session)
+  {
+    case AUDIO_CDC_CMD_SESSION_PLAYBACK:
+      return USBD_AUDIO_PLAYBACK;
+    case AUDIO_CDC_CMD_SESSION_RECORD:
+      return USBD_AUDIO_RECORD;
+    default :
+      return 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_CdcCommandPut32
+  *         writes a little endian 32 bits field
+  * @param  dst: where to write
+  * @param  value: value to write
+  * @retval next write position
+  */
+static uint8_t* AUDIO_CdcCommandPut32(uint8_t* dst, uint32_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+  dst[2] = (uint8_t)(value >> 16);
+  dst[3] = (uint8_t)(value >> 24);
+  return dst + 4;
+}
+#endif /* USE_AUDIO_CDC_COMMAND */
@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_command.h
+  * @brief   header file for the audio_cdc_command.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CDC_COMMAND_H
+#define __AUDIO_CDC_COMMAND_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usb_audio_user.h"
+
+#ifdef USE_AUDIO_CDC_COMMAND
+/* Exported constants --------------------------------------------------------*/
+/* request  : AUDIO_CDC_CMD_REQUEST_SYNC, cmd, len, payload[len], checksum
+   response : AUDIO_CDC_CMD_RESPONSE_SYNC, cmd, status, len, payload[len], checksum
+   checksum makes the sum of all frame bytes zero, multi bytes fields are little endian */
+#define AUDIO_CDC_CMD_REQUEST_SYNC        0xA5U
+#define AUDIO_CDC_CMD_RESPONSE_SYNC       0x5AU
+#define AUDIO_CDC_CMD_MAX_PAYLOAD         96U
+#define AUDIO_CDC_CMD_VERSION             0x1FU
+
+/* commands */
+#define AUDIO_CDC_CMD_PING                0x01U /* no payload, response : version */
+#define AUDIO_CDC_CMD_GET_STATS           0x02U /* session , response : session state */
+#define AUDIO_CDC_CMD_SET_PARAM           0x03U /* session, param, channel, int32 value */
+#define AUDIO_CDC_CMD_SET_TAP             0x04U /* points mask , response : mask, then dropped bytes per point */
+#define AUDIO_CDC_CMD_GET_PROFILE         0x05U /* probe, clear , response : probe, count, min, avg, max cycles, histogram */
+#define AUDIO_CDC_CMD_GET_FILL            0x06U /* session , response : ring size, fill min, max, glitches, histogram, resyncs */
+#define AUDIO_CDC_CMD_LOOPBACK            0x07U /* [delay ms] sets the delay and clears , response : delay, count, min, max, dropped, histogram */
+#define AUDIO_CDC_CMD_STRESS              0x08U /* [duration ms , 32 bits] starts a run , without payload response : report of last run */
+#define AUDIO_CDC_CMD_DUMMY_CLOCK         0x09U /* [ppm , int32] sets the offset and clears , response : drift run report */
+#define AUDIO_CDC_CMD_GET_DELAY           0x0AU /* session , response : packets measured, lost, last, min, avg, max delay in us */
+#define AUDIO_CDC_CMD_SET_EQ              0x0BU /* [channel, stage, b0, b1, b2, a1, a2 float32] loads a stage, without payload commits , response : active stages count */
+#define AUDIO_CDC_CMD_METER               0x0CU /* session [, period ms, peak threshold 24 bits] , response : channels, then peak and rms per channel */
+#define AUDIO_CDC_CMD_SIDETONE            0x0DU /* [gain dB 8.8 , int32] sets the gain , response : gain, slips */
+#define AUDIO_CDC_CMD_GET_BOOT            0x0EU /* no payload, response : budget us, reached stages mask, stage count, time of each stage in us */
+#define AUDIO_CDC_CMD_TRACE               0x0FU /* [mode] sets the mode and re-arms , response : mode, frozen, lost records */
+#define AUDIO_CDC_CMD_ROUTE               0x10U /* [output, input, gain Q1.14 int16] loads a gain, without payload commits , response : identity */
+#define AUDIO_CDC_CMD_BEAM                0x11U /* [beam, preset] steers a beam , response : beams count, preset of each beam */
+#define AUDIO_CDC_CMD_AEC                 0x12U /* no payload, response : synced, slips, echo return loss enhancement dB 8.8 int32 */
+#define AUDIO_CDC_CMD_AGC                 0x13U /* [target dBFS, max gain dB, gate dBFS , int16 8.8] sets the levels , response : gain dB, envelope dBFS int32 8.8, gate open */
+#define AUDIO_CDC_CMD_SPECTRUM            0x14U /* [sources mask, period ms 16 bits] selects the streams , response : mask, period, then frames sent per source */
+#define AUDIO_CDC_CMD_PATTERN             0x15U /* [mode] restarts the dummy mic pattern , response : mode, frames, sync packets, skipped frames, frames at last skip */
+#define AUDIO_CDC_CMD_PATTERN_CHECK       0x16U /* [mode] restarts the dummy speaker check , response : mode, locked, packets, error packets, error SOF 16 bits, frames, lost, repeated, corrupted, bit errors, resyncs */
+#define AUDIO_CDC_CMD_SOF_ALIGN           0x17U /* no payload, response per stream speaker then mic : aligned, offset us, error us, min us, max us int16, halves, drifts */
+#define AUDIO_CDC_CMD_COPY_BENCH          0x18U /* no payload, response : count, then per length : length 16 bits, cycles of newlib copy, fast copy, MDMA copy, newlib set, fast set */
+#define AUDIO_CDC_CMD_CPU_LOAD            0x19U /* no payload, response : frames, USB ISR, CDC, nodes, idle avg and peak permille 16 bits, node count, then per node : id, avg, peak */
+#define AUDIO_CDC_CMD_ISO_SLACK           0x1AU /* [session], response : data then feedback endpoint : count, late, worst us 16 bits, histogram in eighths of a frame */
+#define AUDIO_CDC_CMD_SOF_JITTER          0x1BU /* no payload, response : windows, mean period ps, jitter avg and peak ns, missed in the window, missed, overruns */
+#define AUDIO_CDC_CMD_BENCH               0x1CU /* [test, res, freq 32 bits, optional golden CRC] runs a kernel, response : test, res, freq, frames, runs 16 bits, min, avg, max, budget cycles, CRC, status. No payload, response : test count, built tests mask, runs, max frequency, core clock */
+#define AUDIO_CDC_CMD_FAULT               0x1DU /* [drop OUT every, delay IN every, delay us, incomplete IN every 16 bits, speaker and mic skew ppm int16] sets the faults and clears the report, response : the faults, elapsed ms, then playback and record : injected, underruns, overruns, resyncs, incompletes, recoveries, last, max and total recovery ms, recovering */
+#define AUDIO_CDC_CMD_SNAPSHOT            0x1EU /* [op, status : none, arm : points, triggers, post ms 16 bits, trigger, read, stop] response : state, points, triggers, cause, post ms 16 bits, trigger ms since arming, then bytes held and bytes before the trigger per tap point. Read sends the frozen capture in AUDIO_SNAPSHOT_SYNC frames after the response */
+#define AUDIO_CDC_CMD_SYNC_START          0x1FU /* [op, status : none, arm : lead ms, disarm] response : state, held, valid, lead ms, start USB frame 16 bits, then playback and record : position in frames since the alternate, device delay frames 16 bits */
+#define AUDIO_CDC_CMD_LONG_DELAY          0x20U /* [delay ms 16 bits] sets the delay, 0 lets the frames through , response : state, delay ms, max ms 16 bits, applied delay frames, underruns, overflows, blocks stored, blocks fetched */
+
+/* sessions */
+#define AUDIO_CDC_CMD_SESSION_PLAYBACK    0x00U
+#define AUDIO_CDC_CMD_SESSION_RECORD      0x01U
+
+/* response status */
+#define AUDIO_CDC_CMD_STATUS_OK           0x00U
+#define AUDIO_CDC_CMD_STATUS_CHECKSUM     0x01U
+#define AUDIO_CDC_CMD_STATUS_UNKNOWN      0x02U
+#define AUDIO_CDC_CMD_STATUS_BAD_ARGS     0x03U
+#define AUDIO_CDC_CMD_STATUS_UNAVAILABLE  0x04U
+
+/* Exported functions ------------------------------------------------------- */
+void AUDIO_CdcCommandInit(void);
+#endif /* USE_AUDIO_CDC_COMMAND */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CDC_COMMAND_H */
@@ -0,0 +1,242 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_stress.c
+  * @brief   CDC + audio stress run : while the host streams both audio
+  *          sessions, CDC IN is kept full with filler and CDC OUT data is
+  *          drained as fast as it comes. At the end the audio glitches, the
+  *          CDC throughput and the USB interrupt load of the run are reported
+  *          over the CDC command channel. The command parser is suspended
+  *          during the run.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_cdc_stress.h"
+
+#ifdef USE_AUDIO_CDC_STRESS
+#include "audio_cdc_command.h"
+#include "audio_pump.h"
+#include "usbd_cdc_if.h"
+#include "usbd_audio_if.h"
+#include "audio_profiler.h"
+
+#ifndef USE_AUDIO_CDC_COMMAND
+#error "USE_AUDIO_CDC_STRESS is driven by the CDC command channel, USE_AUDIO_CDC_COMMAND is required"
+#endif /* USE_AUDIO_CDC_COMMAND */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CDC_STRESS_CHUNK            512U
+
+/* Private variables ---------------------------------------------------------*/
+/* only used from the pump */
+static uint8_t  stress_running = 0;
+static uint8_t  stress_done = 0;
+static uint32_t stress_start_tick;
+static uint32_t stress_duration_ms;
+static AUDIO_USB_SessionStatsTypeDef stress_play_start;
+static AUDIO_USB_SessionStatsTypeDef stress_record_start;
+#ifdef USE_AUDIO_PROFILER
+static uint64_t stress_isr_start;
+#endif /* USE_AUDIO_PROFILER */
+static AUDIO_CdcStressReportTypeDef stress_report;
+static const uint8_t stress_fill[AUDIO_CDC_STRESS_CHUNK] = {AUDIO_CDC_STRESS_FILL_BYTE};
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_CdcStressTxHandler(void);
+static void    AUDIO_CdcStressRxHandler(void);
+static uint8_t AUDIO_CdcStressCheckEnd(void);
+static void    AUDIO_CdcStressGetSession(uint8_t func, AUDIO_USB_SessionStatsTypeDef* stats);
+#ifdef USE_AUDIO_PROFILER
+static uint64_t AUDIO_CdcStressGetIsrCycles(void);
+#endif /* USE_AUDIO_PROFILER */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcStressInit
+  *         registers the filler in the pump, must be called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CdcStressInit(void)
+{
+  stress_running = 0;
+  stress_done = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_STRESS, AUDIO_CdcStressTxHandler);
+}
+
+/**
+  * @brief  AUDIO_CdcStressStart
+  *         starts a run, CDC OUT data goes to the stress until its end. Must be
+  *         called from the pump
+  * @param  duration_ms: run length, up to AUDIO_CDC_STRESS_MAX_DURATION_MS
+  * @retval 0 if no error
+  */
+int8_t AUDIO_CdcStressStart(uint32_t duration_ms)
+{
+  if(stress_running || (duration_ms == 0U) || (duration_ms > AUDIO_CDC_STRESS_MAX_DURATION_MS))
+  {
+    return -1;
+  }
+  memset(&stress_report, 0, sizeof(stress_report));
+  AUDIO_CdcStressGetSession(USBD_AUDIO_PLAYBACK, &stress_play_start);
+  AUDIO_CdcStressGetSession(USBD_AUDIO_RECORD, &stress_record_start);
+#ifdef USE_AUDIO_PROFILER
+  stress_isr_start = AUDIO_CdcStressGetIsrCycles();
+#endif /* USE_AUDIO_PROFILER */
+  stress_duration_ms = duration_ms;
+  stress_start_tick = HAL_GetTick();
+  stress_running = 1;
+  stress_done = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CDC_COMMAND, AUDIO_CdcStressRxHandler);
+  AUDIO_PumpPost(AUDIO_PUMP_STRESS | AUDIO_PUMP_CDC_COMMAND);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CdcStressGetReport
+  *         returns the report of the last run
+  * @param  report: report copy
+  * @retval 0 if no error, -1 if no run ended
+  */
+int8_t AUDIO_CdcStressGetReport(AUDIO_CdcStressReportTypeDef* report)
+{
+  AUDIO_CdcStressCheckEnd();
+  if(!stress_done)
+  {
+    return -1;
+  }
+  *report = stress_report;
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CdcStressTxHandler
+  *         pump handler posted when CDC IN sent a transfer, fills the transmit
+  *         ring with filler for as long as it has room
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcStressTxHandler(void)
+{
+  uint16_t accepted;
+
+  if(AUDIO_CdcStressCheckEnd())
+  {
+    return;
+  }
+  while((accepted = CDC_Write_FS(stress_fill, (uint16_t)sizeof(stress_fill), 0)) != 0U)
+  {
+    stress_report.cdc_tx_bytes += accepted;
+  }
+}
+
+/**
+  * @brief  AUDIO_CdcStressRxHandler
+  *         pump handler in place of the command parser during a run, drops
+  *         the received data
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CdcStressRxHandler(void)
+{
+  uint8_t  chunk[64];
+  uint16_t count;
+
+  while((count = CDC_Read_FS(chunk, (uint16_t)sizeof(chunk))) != 0U)
+  {
+    stress_report.cdc_rx_bytes += count;
+  }
+  AUDIO_CdcStressCheckEnd();
+}
+
+/**
+  * @brief  AUDIO_CdcStressCheckEnd
+  *         ends the run once its duration elapsed : fills the report and
+  *         gives CDC OUT back to the command parser
+  * @param  None
+  * @retval 1 if no run is going on
+  */
+static uint8_t AUDIO_CdcStressCheckEnd(void)
+{
+  AUDIO_USB_SessionStatsTypeDef stats;
+#ifdef USE_AUDIO_PROFILER
+  uint64_t run_cycles;
+#endif /* USE_AUDIO_PROFILER */
+
+  if(!stress_running)
+  {
+    return 1;
+  }
+  if((HAL_GetTick() - stress_start_tick) < stress_duration_ms)
+  {
+    return 0;
+  }
+  stress_report.duration_ms = HAL_GetTick() - stress_start_tick;
+  AUDIO_CdcStressGetSession(USBD_AUDIO_PLAYBACK, &stats);
+  stress_report.play_frequency = stats.audio_description.frequence;
+  stress_report.play_underrun_count = stats.underrun_count - stress_play_start.underrun_count;
+  stress_report.play_overrun_count = stats.overrun_count - stress_play_start.overrun_count;
+  stress_report.play_iso_out_incomplete_count = stats.iso_out_incomplete_count -
+                                                stress_play_start.iso_out_incomplete_count;
+  AUDIO_CdcStressGetSession(USBD_AUDIO_RECORD, &stats);
+  stress_report.record_frequency = stats.audio_description.frequence;
+  stress_report.record_underrun_count = stats.underrun_count - stress_record_start.underrun_count;
+  stress_report.record_overrun_count = stats.overrun_count - stress_record_start.overrun_count;
+  stress_report.record_iso_in_incomplete_count = stats.iso_in_incomplete_count -
+                                                 stress_record_start.iso_in_incomplete_count;
+#ifdef USE_AUDIO_PROFILER
+  run_cycles = (uint64_t)stress_report.duration_ms * (SystemCoreClock / 1000U);
+  stress_report.isr_load_permille = (uint32_t)(((AUDIO_CdcStressGetIsrCycles() - stress_isr_start) * 1000U) /
+                                               run_cycles);
+#else /* USE_AUDIO_PROFILER */
+  stress_report.isr_load_permille = AUDIO_CDC_STRESS_ISR_LOAD_NONE;
+#endif /* USE_AUDIO_PROFILER */
+  stress_running = 0;
+  stress_done = 1;
+  AUDIO_CdcCommandInit();
+  return 1;
+}
+
+/**
+  * @brief  AUDIO_CdcStressGetSession
+  *         reads the counters of a session, zeros when it is not built
+  * @param  func: USBD_AUDIO_PLAYBACK or USBD_AUDIO_RECORD
+  * @param  stats: session counters
+  * @retval None
+  */
+static void AUDIO_CdcStressGetSession(uint8_t func, AUDIO_USB_SessionStatsTypeDef* stats)
+{
+  if(USBD_AUDIO_GetSessionStats(func, stats) != 0)
+  {
+    memset(stats, 0, sizeof(AUDIO_USB_SessionStatsTypeDef));
+  }
+}
+
+#ifdef USE_AUDIO_PROFILER
+/**
+  * @brief  AUDIO_CdcStressGetIsrCycles
+  *         cycles spent in the OTG_HS interrupt since the profiler reset
+  * @param  None
+  * @retval cycles
+  */
+static uint64_t AUDIO_CdcStressGetIsrCycles(void)
+{
+  AUDIO_ProfilerProbeTypeDef probe;
+
+  AUDIO_ProfilerGet(AUDIO_PROF_PCD_IRQ, &probe);
+  return probe.total;
+}
+#endif /* USE_AUDIO_PROFILER */
+#endif /* USE_AUDIO_CDC_STRESS */
@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file    audio_cdc_stress.h
+  * @brief   header file for the audio_cdc_stress.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CDC_STRESS_H
+#define __AUDIO_CDC_STRESS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_CDC_STRESS
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_CDC_STRESS_MAX_DURATION_MS  60000U
+#define AUDIO_CDC_STRESS_FILL_BYTE        0x00U /* CDC IN filler, never a response sync byte */
+#define AUDIO_CDC_STRESS_ISR_LOAD_NONE    0xFFFFFFFFU /* ISR load is measured with USE_AUDIO_PROFILER only */
+
+/* Exported types ------------------------------------------------------------*/
+/* counters over the stress run, glitches are the increase of the session counters */
+typedef struct
+{
+  uint32_t duration_ms;
+  uint32_t cdc_tx_bytes;             /* filler sent on CDC IN */
+  uint32_t cdc_rx_bytes;             /* bytes received on CDC OUT and dropped */
+  uint32_t play_frequency;           /* stream formats at the end of the run */
+  uint32_t record_frequency;
+  uint32_t play_underrun_count;
+  uint32_t play_overrun_count;
+  uint32_t play_iso_out_incomplete_count;
+  uint32_t record_underrun_count;
+  uint32_t record_overrun_count;
+  uint32_t record_iso_in_incomplete_count;
+  uint32_t isr_load_permille;        /* OTG_HS interrupt , AUDIO_CDC_STRESS_ISR_LOAD_NONE if not measured */
+}
+AUDIO_CdcStressReportTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void   AUDIO_CdcStressInit(void);
+int8_t AUDIO_CdcStressStart(uint32_t duration_ms);
+int8_t AUDIO_CdcStressGetReport(AUDIO_CdcStressReportTypeDef* report);
+#endif /* USE_AUDIO_CDC_STRESS */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CDC_STRESS_H */
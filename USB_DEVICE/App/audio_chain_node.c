@@ -0,0 +1,266 @@
+/**
+  ******************************************************************************
+  * @file    audio_chain_node.c
+  * @brief   Processing chain of the playback : a processing node which runs a
+  *          list of processing nodes, so the list can be rebuilt from the
+  *          CDC command channel while the stream goes on. The new list is
+  *          built in a second bank and swapped with the active one at a
+  *          packet boundary : the packet before the swap fades out through
+  *          the old list, the next one fades in through the new list. A node
+  *          joining the list is restarted by its owner before, so it starts
+  *          from a cleared state.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_chain_node.h"
+
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+#include "audio_pcm.h"
+
+/* Private variables ---------------------------------------------------------*/
+/* built from the pump, run by the process in the USB interrupt */
+static AUDIO_Chain_NodeTypeDef *current_chain = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_ChainDeInit(uint32_t node_handle);
+static int8_t  AUDIO_ChainStart(uint32_t node_handle);
+static int8_t  AUDIO_ChainStop(uint32_t node_handle);
+static int8_t  AUDIO_ChainProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ChainInit
+  *         Initializes the chain node, both banks are empty
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      chain node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_ChainInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint32_t node_handle)
+{
+  AUDIO_Chain_NodeTypeDef* chain = (AUDIO_Chain_NodeTypeDef*)node_handle;
+
+  memset(chain, 0, sizeof(AUDIO_Chain_NodeTypeDef));
+  chain->processing.node.state = AUDIO_NODE_INITIALIZED;
+  chain->processing.node.type = AUDIO_PROCESSING;
+  chain->processing.node.session_handle = session_handle;
+  chain->processing.node.audio_description = audio_description;
+
+  chain->ChainDeInit = AUDIO_ChainDeInit;
+  chain->ChainStart = AUDIO_ChainStart;
+  chain->ChainStop = AUDIO_ChainStop;
+  chain->processing.Process = AUDIO_ChainProcess;
+  current_chain = chain;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainClear
+  *         starts building an empty bank, the active one runs meanwhile. Must
+  *         be called from the pump
+  * @param  None
+  * @retval 0 if no error, -1 while the previous swap is pending
+  */
+int8_t  AUDIO_ChainClear(void)
+{
+  AUDIO_Chain_NodeTypeDef* chain = current_chain;
+
+  if((chain == 0) || (chain->swap != AUDIO_CHAIN_SWAP_NONE))
+  {
+    return -1;
+  }
+  chain->bank[chain->active ^ 1U].stage_count = 0;
+  chain->loading = 1;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainAdd
+  *         appends a processing node to the bank being built. The node must
+  *         be out of any node list, it is run by the chain only while started
+  * @param  node: processing node
+  * @retval 0 if no error, -1 when the bank is full or not cleared first
+  */
+int8_t  AUDIO_ChainAdd(AUDIO_NodeTypeDef* node)
+{
+  AUDIO_Chain_NodeTypeDef* chain = current_chain;
+  AUDIO_ChainBankTypeDef* bank;
+
+  if((chain == 0) || (!chain->loading) || (node == 0) || (node->type != AUDIO_PROCESSING))
+  {
+    return -1;
+  }
+  bank = &chain->bank[chain->active ^ 1U];
+  if(bank->stage_count >= AUDIO_CHAIN_MAX_STAGES)
+  {
+    return -1;
+  }
+  node->next = 0;
+  bank->stage[bank->stage_count++] = node;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainCommit
+  *         runs the built bank after the fade out of the next packet, at once
+  *         when the node is not started. Must be called from the pump
+  * @param  None
+  * @retval 0 if no error, -1 while the previous swap is pending
+  */
+int8_t  AUDIO_ChainCommit(void)
+{
+  AUDIO_Chain_NodeTypeDef* chain = current_chain;
+
+  if((chain == 0) || (chain->swap != AUDIO_CHAIN_SWAP_NONE))
+  {
+    return -1;
+  }
+  if(!chain->loading)
+  {
+    return 0;
+  }
+  chain->loading = 0;
+  if(chain->processing.node.state != AUDIO_NODE_STARTED)
+  {
+    chain->active ^= 1U;
+    return 0;
+  }
+  __DMB();
+  chain->swap = AUDIO_CHAIN_SWAP_FADE_OUT;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainIsActive
+  *         tells if a node is run by the active bank
+  * @param  node: processing node
+  * @retval 1 if it is
+  */
+uint8_t AUDIO_ChainIsActive(AUDIO_NodeTypeDef* node)
+{
+  AUDIO_Chain_NodeTypeDef* chain = current_chain;
+  AUDIO_ChainBankTypeDef* bank;
+  uint8_t i;
+
+  if(chain == 0)
+  {
+    return 0;
+  }
+  bank = &chain->bank[chain->active];
+  for(i = 0; i < bank->stage_count; i++)
+  {
+    if(bank->stage[i] == node)
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ChainDeInit
+  *         De-Initializes the chain node
+  * @param  node_handle: chain node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ChainDeInit(uint32_t node_handle)
+{
+  AUDIO_Chain_NodeTypeDef* chain = (AUDIO_Chain_NodeTypeDef*)node_handle;
+
+  chain->processing.node.state = AUDIO_NODE_OFF;
+  if(current_chain == chain)
+  {
+    current_chain = 0;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainStart
+  *         Starts running the active bank, its nodes are started by their owner
+  * @param  node_handle: chain node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ChainStart(uint32_t node_handle)
+{
+  ((AUDIO_Chain_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainStop
+  *         Stops processing, packets are left untouched. A pending swap is
+  *         done so the next build isn't refused
+  * @param  node_handle: chain node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ChainStop(uint32_t node_handle)
+{
+  AUDIO_Chain_NodeTypeDef* chain = (AUDIO_Chain_NodeTypeDef*)node_handle;
+
+  chain->processing.node.state = AUDIO_NODE_STOPPED;
+  if(chain->swap == AUDIO_CHAIN_SWAP_FADE_OUT)
+  {
+    chain->active ^= 1U;
+  }
+  chain->swap = AUDIO_CHAIN_SWAP_NONE;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ChainProcess
+  *         Runs the stages of the active bank. A swap takes two packets : the
+  *         first one fades out, the bank is swapped, the second one fades in,
+  *         so no node sees a packet twice
+  * @param  in: input frames
+  * @param  out: output frames , must be in
+  * @param  frames: frames count
+  * @param  node_handle: chain node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ChainProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Chain_NodeTypeDef* chain = (AUDIO_Chain_NodeTypeDef*)node_handle;
+  AUDIO_DescriptionTypeDef* desc = chain->processing.node.audio_description;
+  AUDIO_ChainBankTypeDef* bank = &chain->bank[chain->active];
+  AUDIO_NodeTypeDef* stage;
+  uint8_t i;
+
+  /* called directly, the CPU load of the stages is accounted to the chain */
+  for(i = 0; i < bank->stage_count; i++)
+  {
+    stage = bank->stage[i];
+    if(stage->state == AUDIO_NODE_STARTED)
+    {
+      ((AUDIO_ProcessingNodeTypeDef*)stage)->Process(out, out, frames, (uint32_t)stage);
+    }
+  }
+  if(chain->swap == AUDIO_CHAIN_SWAP_FADE_OUT)
+  {
+    AUDIO_PcmFade(out, frames, desc->channels_count, desc->audio_res, 0);
+    chain->active ^= 1U;
+    chain->swap = AUDIO_CHAIN_SWAP_FADE_IN;
+  }
+  else if(chain->swap == AUDIO_CHAIN_SWAP_FADE_IN)
+  {
+    AUDIO_PcmFade(out, frames, desc->channels_count, desc->audio_res, 1);
+    chain->swap = AUDIO_CHAIN_SWAP_NONE;
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
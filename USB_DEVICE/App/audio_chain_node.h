@@ -0,0 +1,73 @@
+/**
+  ******************************************************************************
+  * @file    audio_chain_node.h
+  * @brief   header file for the audio_chain_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CHAIN_NODE_H
+#define __AUDIO_CHAIN_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_CHAIN_MAX_STAGES          4U
+/* swap states */
+#define AUDIO_CHAIN_SWAP_NONE           0U
+#define AUDIO_CHAIN_SWAP_FADE_OUT       1U /* next packet runs the active stages then fades out */
+#define AUDIO_CHAIN_SWAP_FADE_IN        2U /* next packet runs the new stages then fades in */
+
+/* Exported types ------------------------------------------------------------*/
+/* stages run in order, the active one is never written */
+typedef struct
+{
+  AUDIO_NodeTypeDef* stage[AUDIO_CHAIN_MAX_STAGES];
+  uint8_t            stage_count;
+}
+AUDIO_ChainBankTypeDef;
+
+/* chain node : runs the processing nodes of its active bank in place on each packet */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  AUDIO_ChainBankTypeDef bank[2];                                  /* active one and the one being built */
+  volatile uint8_t   active;         /* bank run by the process */
+  volatile uint8_t   swap;           /* AUDIO_CHAIN_SWAP_xxx */
+  uint8_t            loading;        /* the built bank was cleared */
+  int8_t            (*ChainDeInit)  (uint32_t /*node_handle*/);
+  int8_t            (*ChainStart)   (uint32_t /*node_handle*/);
+  int8_t            (*ChainStop)    (uint32_t /*node_handle*/);
+}
+AUDIO_Chain_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_ChainInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint32_t node_handle);
+int8_t  AUDIO_ChainClear(void);
+int8_t  AUDIO_ChainAdd(AUDIO_NodeTypeDef* node);
+int8_t  AUDIO_ChainCommit(void);
+uint8_t AUDIO_ChainIsActive(AUDIO_NodeTypeDef* node);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CHAIN_NODE_H */
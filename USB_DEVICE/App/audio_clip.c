@@ -0,0 +1,732 @@
+/**
+  ******************************************************************************
+  * @file    audio_clip.c
+  * @brief   clips uploaded on the vendor bulk interface and played by the
+  *          speaker node. Each DATA payload is received by the vendor class
+  *          straight at its place in the store, then checked by the CRC unit
+  *          from the pump. Clips attached by the application are read in
+  *          place from flash. Up to AUDIO_CLIP_VOICES clips are mixed in the
+  *          host stream while the host plays, else the speaker output is
+  *          started locally for them
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_clip.h"
+#include "audio_pump.h"
+#include "audio_pcm.h"
+#include "audio_speaker_node.h"
+
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+#error "USE_AUDIO_CLIP_UPLOAD plays the clips on the SAI speaker, it can't be used with USE_AUDIO_SPEAKER_DUMMY"
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#if (AUDIO_CLIP_STORE_SIZE % 32U) != 0U
+#error "AUDIO_CLIP_STORE_SIZE must be a multiple of the cache line"
+#endif /* AUDIO_CLIP_STORE_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CLIP_FREE                   0x00U
+#define AUDIO_CLIP_LOADING                0x01U /* allocated, DATA payloads expected */
+#define AUDIO_CLIP_READY                  0x02U /* clip CRC checked */
+#define AUDIO_CLIP_ALIGN(length)          (((length) + 31U) & ~31U) /* clips start on a cache line */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  const uint8_t* data;
+  uint32_t  length;
+  uint32_t  received;
+  uint32_t  frequency;
+  uint8_t   channels;
+  uint8_t   res_byte;
+  uint8_t   state;
+  uint8_t   attached;     /* read in place from flash, kept by ERASE */
+}
+AUDIO_ClipTypeDef;
+
+/* clip being played and its next byte, read by the SAI interrupt */
+typedef struct
+{
+  AUDIO_ClipTypeDef* volatile clip;
+  volatile uint32_t  position;
+}
+AUDIO_ClipVoiceTypeDef;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_CLIP_Init(void);
+static int8_t   AUDIO_CLIP_DeInit(void);
+static int8_t   AUDIO_CLIP_Receive(uint8_t* Buf, uint32_t Len);
+static int8_t   AUDIO_CLIP_TransmitCplt(uint8_t* Buf, uint32_t Len);
+static void     AUDIO_ClipHandler(void);
+static void     AUDIO_ClipRequest(void);
+static void     AUDIO_ClipPayload(void);
+static uint8_t  AUDIO_ClipBegin(AUDIO_ClipTypeDef* clip, AUDIO_ClipRequestTypeDef* req, uint32_t* value);
+static uint8_t  AUDIO_ClipPlay(AUDIO_ClipTypeDef* clip);
+static void     AUDIO_ClipStop(AUDIO_ClipTypeDef* clip);
+static uint8_t  AUDIO_ClipMixVoice(AUDIO_ClipVoiceTypeDef* voice, uint8_t* half, uint32_t samples) USBD_ITCM_FUNC;
+static void     AUDIO_ClipOutput(void);
+static void     AUDIO_ClipRespond(AUDIO_ClipTypeDef* clip, uint8_t status, uint32_t value);
+static void     AUDIO_ClipArm(uint8_t* buffer, uint32_t length);
+static uint32_t AUDIO_ClipCrc(const uint8_t* data, uint32_t length);
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceHS;
+
+USBD_VENDOR_ItfTypeDef AUDIO_CLIP_Interface_fops =
+{
+  AUDIO_CLIP_Init,
+  AUDIO_CLIP_DeInit,
+  AUDIO_CLIP_Receive,
+  AUDIO_CLIP_TransmitCplt
+};
+
+/* AXI SRAM, written by the USB DMA when it is used : lines are invalidated before the CRC reads them */
+static uint8_t clip_store[AUDIO_CLIP_STORE_SIZE] __attribute__((aligned(32)));
+static uint32_t clip_store_used = 0;
+static AUDIO_ClipTypeDef clips[AUDIO_CLIP_COUNT];
+/* request header and response, moved by the USB DMA */
+__ALIGN_BEGIN static uint8_t clip_rx_header[USBD_VENDOR_HS_MAX_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+__ALIGN_BEGIN static AUDIO_ClipResponseTypeDef clip_response __ALIGN_END USBD_BUFFER_BSS;
+static AUDIO_ClipRequestTypeDef clip_request;
+static volatile uint8_t  clip_rx_pending = 0;  /* a transfer was received, the OUT endpoint NAKs */
+static volatile uint8_t  clip_rx_payload = 0;  /* the endpoint is armed for the payload of clip_request */
+static volatile uint32_t clip_rx_length = 0;
+static volatile uint8_t  clip_tx_busy = 0;
+static AUDIO_ClipVoiceTypeDef clip_voices[AUDIO_CLIP_VOICES];
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ClipInit
+  *         clocks the CRC unit and registers the pump handler, called before
+  *         the USB device starts
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ClipInit(void)
+{
+  __HAL_RCC_CRC_CLK_ENABLE();
+  memset(clips, 0, sizeof(clips));
+  memset(clip_voices, 0, sizeof(clip_voices));
+  clip_store_used = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CLIP, AUDIO_ClipHandler);
+}
+
+/**
+  * @brief  AUDIO_ClipAttach
+  *         makes a clip of the application playable, it is read in place so
+  *         it may be a constant in flash. Called from the pump or before the
+  *         USB device starts, the clip index must be free
+  * @param  index: clip index , below AUDIO_CLIP_COUNT
+  * @param  data: word aligned samples with the play stream layout
+  * @param  length: clip length in bytes , a whole count of frames
+  * @param  frequency: sampling frequency
+  * @param  channels: channels count
+  * @param  res_byte: sample size in bytes , 2 , 3 or 4
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_ClipAttach(uint8_t index, const uint8_t* data, uint32_t length, uint32_t frequency,
+                         uint8_t channels, uint8_t res_byte)
+{
+  AUDIO_ClipTypeDef* clip;
+
+  if((index >= AUDIO_CLIP_COUNT) || (clips[index].state != AUDIO_CLIP_FREE) ||
+     (((uint32_t)data & 3U) != 0U) || (channels == 0U) || (frequency == 0U) || (length == 0U) ||
+     (res_byte < 2U) || (res_byte > 4U) || ((length % ((uint32_t)channels * res_byte)) != 0U))
+  {
+    return -1;
+  }
+  clip = &clips[index];
+  clip->data = data;
+  clip->length = length;
+  clip->received = length;
+  clip->frequency = frequency;
+  clip->channels = channels;
+  clip->res_byte = res_byte;
+  clip->attached = 1;
+  clip->state = AUDIO_CLIP_READY;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ClipMix
+  *         adds the next frames of the clips being played to a speaker DMA
+  *         half. Called by the SAI speaker node once the half has the slot
+  *         layout : int16 for 16 bits, right aligned 24 bits or int32 in 32
+  *         bits slots. A clip stops at its end or when the speaker format
+  *         changes
+  * @param  half: speaker DMA half
+  * @param  frames: frames count of the half
+  * @param  desc: speaker format
+  * @retval None
+  */
+void  AUDIO_ClipMix(uint8_t* half, uint32_t frames, AUDIO_DescriptionTypeDef* desc)
+{
+  AUDIO_ClipVoiceTypeDef* voice;
+  AUDIO_ClipTypeDef* clip;
+  uint8_t ended = 0;
+  uint8_t v;
+
+  for(v = 0; v < AUDIO_CLIP_VOICES; v++)
+  {
+    voice = &clip_voices[v];
+    clip = voice->clip;
+    if(clip == 0)
+    {
+      continue;
+    }
+    if((clip->frequency != desc->frequence) || (clip->channels != desc->channels_count) ||
+       (clip->res_byte != desc->audio_res))
+    {
+      voice->clip = 0;
+      ended = 1;
+      continue;
+    }
+    ended |= AUDIO_ClipMixVoice(voice, half, frames * clip->channels);
+  }
+  if(ended)
+  {
+    /* the pump stops the local output after the last clip */
+    AUDIO_PumpPost(AUDIO_PUMP_CLIP);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ClipMixVoice
+  *         adds the next samples of one clip to the speaker slots, saturated.
+  *         16 bits slots are added two at a time, the half is word aligned
+  *         and the clip may not be
+  * @param  voice: voice playing the clip
+  * @param  half: speaker slots of the first frame
+  * @param  samples: samples count of the half
+  * @retval 1 if the clip ended
+  */
+static uint8_t  AUDIO_ClipMixVoice(AUDIO_ClipVoiceTypeDef* voice, uint8_t* half, uint32_t samples)
+{
+  AUDIO_ClipTypeDef* clip = voice->clip;
+  uint32_t position = voice->position;
+  const uint8_t* src;
+  uint32_t i;
+  int32_t x;
+
+  if(samples > (clip->length - position) / clip->res_byte)
+  {
+    samples = (clip->length - position) / clip->res_byte;
+  }
+  src = clip->data + position;
+  switch(clip->res_byte)
+  {
+    case 2:
+    {
+      uint32_t* dst = (uint32_t*)half;
+      int16_t* last;
+
+      for(i = 0; i < (samples >> 1); i++)
+      {
+        dst[i] = __QADD16(dst[i], __UNALIGNED_UINT32_READ(src + 4U * i));
+      }
+      if(samples & 1U)
+      {
+        last = (int16_t*)&dst[samples >> 1];
+        *last = (int16_t)__SSAT((int32_t)*last + (int16_t)__UNALIGNED_UINT16_READ(src + 2U * (samples - 1U)), 16);
+      }
+      break;
+    }
+    case AUDIO_PCM_PACKED_24_BYTES:
+    {
+      uint32_t* dst = (uint32_t*)half;
+
+      for(i = 0; i < samples; i++)
+      {
+        /* S24_3LE clip sample and right aligned slot, both sign extended before the add */
+        x = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+        x = __SSAT(((int32_t)(dst[i] << 8) >> 8) + x, 24);
+        dst[i] = (uint32_t)x & AUDIO_PCM_24_MASK;
+        src += AUDIO_PCM_PACKED_24_BYTES;
+      }
+      break;
+    }
+    default:
+    {
+      int32_t* dst = (int32_t*)half;
+      const int32_t* s = (const int32_t*)src;
+
+      for(i = 0; i < samples; i++)
+      {
+        dst[i] = __QADD(dst[i], s[i]);
+      }
+      break;
+    }
+  }
+  position += samples * clip->res_byte;
+  voice->position = position;
+  if(position >= clip->length)
+  {
+    voice->clip = 0;
+    return 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CLIP_Init
+  *         the vendor interface is configured, the first request is awaited
+  * @param  None
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_CLIP_Init(void)
+{
+  clip_rx_pending = 0;
+  clip_rx_payload = 0;
+  clip_tx_busy = 0;
+  AUDIO_ClipArm(clip_rx_header, sizeof(clip_rx_header));
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CLIP_DeInit
+  *         the vendor interface is released, a clip being loaded stays
+  *         allocated and a clip being played goes on
+  * @param  None
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_CLIP_DeInit(void)
+{
+  clip_rx_pending = 0;
+  clip_rx_payload = 0;
+  clip_tx_busy = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CLIP_Receive
+  *         a request or a payload was received, it is handled from the pump
+  * @param  Buf: received transfer
+  * @param  Len: transfer length
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_CLIP_Receive(uint8_t* Buf, uint32_t Len)
+{
+  clip_rx_length = Len;
+  if((clip_rx_payload == 0U) && (Len == sizeof(AUDIO_ClipRequestTypeDef)))
+  {
+    memcpy(&clip_request, Buf, sizeof(AUDIO_ClipRequestTypeDef));
+  }
+  clip_rx_pending = 1;
+  AUDIO_PumpPost(AUDIO_PUMP_CLIP);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CLIP_TransmitCplt
+  *         the response was sent, a request waiting for it can be handled
+  * @param  Buf: sent data
+  * @param  Len: sent length
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_CLIP_TransmitCplt(uint8_t* Buf, uint32_t Len)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+  clip_tx_busy = 0;
+  if(clip_rx_pending)
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_CLIP);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ClipHandler
+  *         pump work : handles the received transfer once the previous
+  *         response is sent, then starts or stops the local output
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ClipHandler(void)
+{
+  if((clip_rx_pending != 0U) && (clip_tx_busy == 0U))
+  {
+    clip_rx_pending = 0;
+    if(clip_rx_payload)
+    {
+      AUDIO_ClipPayload();
+    }
+    else
+    {
+      AUDIO_ClipRequest();
+    }
+  }
+  AUDIO_ClipOutput();
+}
+
+/**
+  * @brief  AUDIO_ClipRequest
+  *         handles a request header, a valid DATA arms the payload reception
+  *         at its place in the store, the other requests are answered
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ClipRequest(void)
+{
+  AUDIO_ClipRequestTypeDef* req = &clip_request;
+  AUDIO_ClipTypeDef* clip = 0;
+  uint8_t status = AUDIO_CLIP_OK;
+  uint32_t value = 0;
+  uint8_t i;
+
+  if((clip_rx_length != sizeof(AUDIO_ClipRequestTypeDef)) || (req->clip >= AUDIO_CLIP_COUNT))
+  {
+    /* a zero length packet after a payload is ignored */
+    if(clip_rx_length != 0U)
+    {
+      if(clip_rx_length != sizeof(AUDIO_ClipRequestTypeDef))
+      {
+        req->op = 0;
+        req->clip = 0;
+      }
+      AUDIO_ClipRespond(0, AUDIO_CLIP_ERR_REQUEST, 0);
+    }
+    AUDIO_ClipArm(clip_rx_header, sizeof(clip_rx_header));
+    return;
+  }
+  clip = &clips[req->clip];
+  switch(req->op)
+  {
+    case AUDIO_CLIP_OP_BEGIN:
+      status = AUDIO_ClipBegin(clip, req, &value);
+      break;
+
+    case AUDIO_CLIP_OP_DATA:
+      if(clip->state != AUDIO_CLIP_LOADING)
+      {
+        status = AUDIO_CLIP_ERR_STATE;
+      }
+      else if((req->offset != clip->received) || (req->length == 0U) || (req->length > AUDIO_CLIP_CHUNK_MAX) ||
+              (req->length > clip->length - clip->received))
+      {
+        status = AUDIO_CLIP_ERR_OFFSET;
+      }
+      else
+      {
+        /* no response, the payload is received next */
+        clip_rx_payload = 1;
+        AUDIO_ClipArm((uint8_t*)clip->data + clip->received, req->length);
+        return;
+      }
+      break;
+
+    case AUDIO_CLIP_OP_END:
+      if((clip->state != AUDIO_CLIP_LOADING) || (clip->received != clip->length))
+      {
+        status = AUDIO_CLIP_ERR_STATE;
+        break;
+      }
+      value = AUDIO_ClipCrc(clip->data, clip->length);
+      if(value == req->crc)
+      {
+        clip->state = AUDIO_CLIP_READY;
+      }
+      else
+      {
+        /* the whole clip is sent again */
+        clip->received = 0;
+        status = AUDIO_CLIP_ERR_CRC;
+      }
+      break;
+
+    case AUDIO_CLIP_OP_PLAY:
+      status = AUDIO_ClipPlay(clip);
+      break;
+
+    case AUDIO_CLIP_OP_STOP:
+      AUDIO_ClipStop(clip);
+      break;
+
+    case AUDIO_CLIP_OP_ERASE:
+      for(i = 0; i < AUDIO_CLIP_COUNT; i++)
+      {
+        if(clips[i].attached == 0U)
+        {
+          AUDIO_ClipStop(&clips[i]);
+          clips[i].state = AUDIO_CLIP_FREE;
+          clips[i].received = 0;
+        }
+      }
+      clip_store_used = 0;
+      value = AUDIO_CLIP_STORE_SIZE;
+      break;
+
+    default:
+      status = AUDIO_CLIP_ERR_REQUEST;
+      break;
+  }
+  AUDIO_ClipRespond(clip, status, value);
+  AUDIO_ClipArm(clip_rx_header, sizeof(clip_rx_header));
+}
+
+/**
+  * @brief  AUDIO_ClipPayload
+  *         checks a DATA payload received in the store, a payload shorter
+  *         than announced or with a bad CRC is sent again at the same offset
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ClipPayload(void)
+{
+  AUDIO_ClipTypeDef* clip = &clips[clip_request.clip];
+  const uint8_t* data = clip->data + clip_request.offset;
+  uint8_t status = AUDIO_CLIP_OK;
+
+  clip_rx_payload = 0;
+#ifdef USE_USB_HS_DMA
+  {
+    /* the CPU never writes the store, lines at both ends hold no dirty data */
+    uint32_t start = (uint32_t)data & ~31U;
+
+    SCB_InvalidateDCache_by_Addr((uint32_t*)start, (int32_t)AUDIO_CLIP_ALIGN((uint32_t)data + clip_rx_length - start));
+  }
+#endif /* USE_USB_HS_DMA */
+  if(clip_rx_length != clip_request.length)
+  {
+    status = AUDIO_CLIP_ERR_OFFSET;
+  }
+  else if(AUDIO_ClipCrc(data, clip_rx_length) != clip_request.crc)
+  {
+    status = AUDIO_CLIP_ERR_CRC;
+  }
+  else
+  {
+    clip->received += clip_rx_length;
+  }
+  AUDIO_ClipRespond(clip, status, 0);
+  AUDIO_ClipArm(clip_rx_header, sizeof(clip_rx_header));
+}
+
+/**
+  * @brief  AUDIO_ClipBegin
+  *         allocates a clip after the previous ones, its length must be a
+  *         whole count of frames
+  * @param  clip: clip to allocate
+  * @param  req: BEGIN request
+  * @param  value: returns the free bytes of the store
+  * @retval AUDIO_CLIP_OK or AUDIO_CLIP_ERR_xxx
+  */
+static uint8_t  AUDIO_ClipBegin(AUDIO_ClipTypeDef* clip, AUDIO_ClipRequestTypeDef* req, uint32_t* value)
+{
+  uint32_t size;
+
+  *value = AUDIO_CLIP_STORE_SIZE - clip_store_used;
+  if(clip->state != AUDIO_CLIP_FREE)
+  {
+    return AUDIO_CLIP_ERR_STATE;
+  }
+  if((req->channels == 0U) || (req->frequency == 0U) || (req->length == 0U) ||
+     (req->res_byte < 2U) || (req->res_byte > 4U) ||
+     ((req->length % ((uint32_t)req->channels * req->res_byte)) != 0U))
+  {
+    return AUDIO_CLIP_ERR_REQUEST;
+  }
+  size = AUDIO_CLIP_ALIGN(req->length);
+  if(size > *value)
+  {
+    return AUDIO_CLIP_ERR_SPACE;
+  }
+  clip->data = clip_store + clip_store_used;
+  clip->length = req->length;
+  clip->received = 0;
+  clip->frequency = req->frequency;
+  clip->channels = req->channels;
+  clip->res_byte = req->res_byte;
+  clip->state = AUDIO_CLIP_LOADING;
+  clip_store_used += size;
+  *value -= size;
+  return AUDIO_CLIP_OK;
+}
+
+/**
+  * @brief  AUDIO_ClipPlay
+  *         plays a loaded clip from its start on a free voice, or restarts
+  *         it when it is already played. It must have the format of the
+  *         speaker
+  * @param  clip: clip to play
+  * @retval AUDIO_CLIP_OK or AUDIO_CLIP_ERR_xxx
+  */
+static uint8_t  AUDIO_ClipPlay(AUDIO_ClipTypeDef* clip)
+{
+  AUDIO_DescriptionTypeDef* desc = AUDIO_SpeakerGetDescription();
+  AUDIO_ClipVoiceTypeDef* voice = 0;
+  uint32_t primask;
+  uint8_t v;
+
+  if((clip->state != AUDIO_CLIP_READY) || (desc == 0))
+  {
+    return AUDIO_CLIP_ERR_STATE;
+  }
+  if((clip->frequency != desc->frequence) || (clip->channels != desc->channels_count) ||
+     (clip->res_byte != desc->audio_res))
+  {
+    return AUDIO_CLIP_ERR_FORMAT;
+  }
+  for(v = 0; v < AUDIO_CLIP_VOICES; v++)
+  {
+    if(clip_voices[v].clip == clip)
+    {
+      voice = &clip_voices[v];
+      break;
+    }
+    if((voice == 0) && (clip_voices[v].clip == 0))
+    {
+      voice = &clip_voices[v];
+    }
+  }
+  if(voice == 0)
+  {
+    return AUDIO_CLIP_ERR_VOICE;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  voice->position = 0;
+  voice->clip = clip;
+  __set_PRIMASK(primask);
+  AUDIO_ClipOutput();
+  return (voice->clip == 0) ? AUDIO_CLIP_ERR_STATE : AUDIO_CLIP_OK;
+}
+
+/**
+  * @brief  AUDIO_ClipStop
+  *         stops a clip being played, the local output is stopped next
+  *         after the last one
+  * @param  clip: clip to stop
+  * @retval None
+  */
+static void  AUDIO_ClipStop(AUDIO_ClipTypeDef* clip)
+{
+  uint8_t v;
+
+  for(v = 0; v < AUDIO_CLIP_VOICES; v++)
+  {
+    if(clip_voices[v].clip == clip)
+    {
+      clip_voices[v].clip = 0;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_ClipOutput
+  *         the speaker output runs while clips are played : it is started
+  *         locally when the host doesn't stream, and stopped after the last
+  *         clip
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ClipOutput(void)
+{
+  uint32_t lock;
+  uint8_t playing = 0;
+  uint8_t v;
+
+  for(v = 0; v < AUDIO_CLIP_VOICES; v++)
+  {
+    playing |= (clip_voices[v].clip != 0) ? 1U : 0U;
+  }
+  /* the host may start or stop the stream from the audio level */
+  lock = AUDIO_PumpLockAudio();
+  if(playing)
+  {
+    if(AUDIO_SpeakerLocalStart() != 0)
+    {
+      memset(clip_voices, 0, sizeof(clip_voices));
+    }
+  }
+  else
+  {
+    AUDIO_SpeakerLocalStop();
+  }
+  AUDIO_PumpUnlockAudio(lock);
+}
+
+/**
+  * @brief  AUDIO_ClipRespond
+  *         sends the response of the handled request or payload
+  * @param  clip: clip of the request , 0 when the request is not valid
+  * @param  status: AUDIO_CLIP_OK or AUDIO_CLIP_ERR_xxx
+  * @param  value: response value
+  * @retval None
+  */
+static void  AUDIO_ClipRespond(AUDIO_ClipTypeDef* clip, uint8_t status, uint32_t value)
+{
+  clip_response.op = clip_request.op;
+  clip_response.clip = clip_request.clip;
+  clip_response.status = status;
+  clip_response.reserved = 0;
+  clip_response.next = (clip != 0) ? clip->received : 0U;
+  clip_response.value = value;
+  clip_tx_busy = 1;
+  if(USBD_VENDOR_Transmit(&hUsbDeviceHS, (uint8_t*)&clip_response, sizeof(clip_response),
+                          AUDIO_CLIP_CLASS_ID) != (uint8_t)USBD_OK)
+  {
+    clip_tx_busy = 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_ClipArm
+  *         arms the OUT endpoint for the next request or payload
+  * @param  buffer: reception buffer
+  * @param  length: transfer length
+  * @retval None
+  */
+static void  AUDIO_ClipArm(uint8_t* buffer, uint32_t length)
+{
+  (void)USBD_VENDOR_Receive(&hUsbDeviceHS, buffer, length, AUDIO_CLIP_CLASS_ID);
+}
+
+/**
+  * @brief  AUDIO_ClipCrc
+  *         CRC-32 (reflected 0x04C11DB7 , init and final xor 0xFFFFFFFF) by
+  *         the CRC unit, words are written with the bits reversed so they
+  *         are processed in the byte order of the stream
+  * @param  data: word aligned data
+  * @param  length: data length
+  * @retval CRC
+  */
+static uint32_t  AUDIO_ClipCrc(const uint8_t* data, uint32_t length)
+{
+  const uint32_t* word = (const uint32_t*)data;
+
+  CRC->POL = 0x04C11DB7U;
+  CRC->INIT = 0xFFFFFFFFU;
+  CRC->CR = CRC_CR_REV_IN | CRC_CR_REV_OUT | CRC_CR_RESET;
+  while(length >= 4U)
+  {
+    CRC->DR = *word++;
+    length -= 4U;
+  }
+  if(length != 0U)
+  {
+    /* the tail bytes, reversed each */
+    data = (const uint8_t*)word;
+    CRC->CR = (CRC->CR & ~CRC_CR_REV_IN) | CRC_CR_REV_IN_0;
+    while(length != 0U)
+    {
+      *(__IO uint8_t*)(__IO void*)&CRC->DR = *data++;
+      length--;
+    }
+  }
+  return ~CRC->DR;
+}
+#endif /* USE_AUDIO_CLIP_UPLOAD */
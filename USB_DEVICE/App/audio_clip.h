@@ -0,0 +1,113 @@
+/**
+  ******************************************************************************
+  * @file    audio_clip.h
+  * @brief   header file for the audio_clip.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CLIP_H
+#define __AUDIO_CLIP_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#include "usbd_vendor.h"
+#include "audio_node.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* the vendor interface is registered after the other functions */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define AUDIO_CLIP_CLASS_ID               3U
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define AUDIO_CLIP_CLASS_ID               2U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+/* bulk IN and OUT , EP8 is free with and without the telemetry CDC */
+#define AUDIO_CLIP_IN_EP                  0x88U
+#define AUDIO_CLIP_OUT_EP                 0x08U
+
+/* clips are kept in AXI SRAM, allocated one after the other, ERASE frees them all */
+#ifndef AUDIO_CLIP_STORE_SIZE
+#define AUDIO_CLIP_STORE_SIZE             (128U * 1024U)
+#endif /* AUDIO_CLIP_STORE_SIZE */
+#define AUDIO_CLIP_COUNT                  8U
+/* clips mixed at the same time, each one at unity gain and saturated */
+#define AUDIO_CLIP_VOICES                 4U
+/* largest DATA payload, received as one transfer : 512 full speed packets */
+#define AUDIO_CLIP_CHUNK_MAX              32768U
+
+/* request ops */
+#define AUDIO_CLIP_OP_BEGIN               0x01U /* format and length of the clip, allocates it */
+#define AUDIO_CLIP_OP_DATA                0x02U /* offset, length and CRC of the payload sent next */
+#define AUDIO_CLIP_OP_END                 0x03U /* CRC of the whole clip, the clip can then be played */
+#define AUDIO_CLIP_OP_PLAY                0x04U /* plays the clip once, mixed in the speaker output */
+#define AUDIO_CLIP_OP_STOP                0x05U /* stops the clip if it is played */
+#define AUDIO_CLIP_OP_ERASE               0x06U /* frees all uploaded clips, attached ones are kept */
+
+/* response status */
+#define AUDIO_CLIP_OK                     0x00U
+#define AUDIO_CLIP_ERR_REQUEST            0x01U /* unknown op, clip index or bad header length */
+#define AUDIO_CLIP_ERR_SPACE              0x02U /* the store is full */
+#define AUDIO_CLIP_ERR_OFFSET             0x03U /* not the next offset, or past the clip length */
+#define AUDIO_CLIP_ERR_CRC                0x04U /* payload or clip CRC mismatch */
+#define AUDIO_CLIP_ERR_STATE              0x05U /* clip not loaded, or already allocated */
+#define AUDIO_CLIP_ERR_FORMAT             0x06U /* format differs from the speaker one */
+#define AUDIO_CLIP_ERR_VOICE              0x07U /* AUDIO_CLIP_VOICES clips are already played */
+
+/* Exported types ------------------------------------------------------------*/
+/* 20 bytes, little endian, sent alone in one OUT transfer. CRCs are the
+   CRC-32 of zlib / Ethernet */
+typedef struct
+{
+  uint8_t  op;         /* AUDIO_CLIP_OP_xxx */
+  uint8_t  clip;       /* clip index , below AUDIO_CLIP_COUNT */
+  uint8_t  channels;   /* BEGIN : channels count */
+  uint8_t  res_byte;   /* BEGIN : sample size in bytes , 2 , 3 or 4 as on the play stream */
+  uint32_t frequency;  /* BEGIN : sampling frequency */
+  uint32_t offset;     /* DATA : offset of the payload, 4 bytes aligned */
+  uint32_t length;     /* BEGIN : clip length , DATA : payload length */
+  uint32_t crc;        /* DATA : payload CRC , END : clip CRC */
+}
+AUDIO_ClipRequestTypeDef;
+
+/* 12 bytes, one per request and one per DATA payload */
+typedef struct
+{
+  uint8_t  op;
+  uint8_t  clip;
+  uint8_t  status;     /* AUDIO_CLIP_OK or AUDIO_CLIP_ERR_xxx */
+  uint8_t  reserved;
+  uint32_t next;       /* offset of the next DATA payload expected */
+  uint32_t value;      /* BEGIN , ERASE : free bytes of the store , END : CRC computed */
+}
+AUDIO_ClipResponseTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern USBD_VENDOR_ItfTypeDef  AUDIO_CLIP_Interface_fops;
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_ClipInit(void);
+int8_t  AUDIO_ClipAttach(uint8_t index, const uint8_t* data, uint32_t length, uint32_t frequency,
+                         uint8_t channels, uint8_t res_byte);
+void  AUDIO_ClipMix(uint8_t* half, uint32_t frames, AUDIO_DescriptionTypeDef* desc) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CLIP_H */
@@ -0,0 +1,251 @@
+/**
+  ******************************************************************************
+  * @file    audio_clock_domain.c
+  * @brief   clock domain shared by playback and recording : one SOF handler
+  *          counts the frames of the common audio clock on a single node and
+  *          estimates its rate in USB time. The feedback and the recording
+  *          synchro read this estimate, so they always agree on the drift.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32h7xx.h"
+#include "audio_clock_domain.h"
+
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+#include "audio_sof_timestamp.h"
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CLOCK_DOMAIN_NO_SOURCE       0xFFU
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_ClockDomainSubscriberTypeDef subscriber;
+  uint32_t frames;  /* counted since the last Frame call */
+  uint32_t sof;     /* SOF since the last Frame call */
+  uint8_t  used;
+}
+AUDIO_ClockDomainSlotTypeDef;
+
+typedef struct
+{
+  AUDIO_ClockDomainSlotTypeDef slot[AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS];
+  uint32_t frequency;      /* nominal rate the window was started for */
+  uint32_t window_frames;  /* frames counted in the current second */
+  uint32_t window_sof;     /* SOF of the current second */
+  uint32_t residue;        /* samples of an incomplete frame, counted with the next SOF */
+  uint32_t rate;           /* AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS, 0 until a whole second is counted */
+  uint8_t  source;         /* slot the frames are counted on */
+}
+AUDIO_ClockDomainTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_ClockDomainTypeDef clock_domain = { .source = AUDIO_CLOCK_DOMAIN_NO_SOURCE };
+
+/* Private function prototypes -----------------------------------------------*/
+static void  AUDIO_ClockDomainSof(uint32_t private_data);
+static void  AUDIO_ClockDomainSelectSource(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ClockDomainSubscribe
+  *         adds a session of the shared clock, the SOF handler runs while a
+  *         session is subscribed
+  * @param  subscriber: copied, StartCount and GetCount must be set
+  * @retval 0 if no error, -1 when no slot is free
+  */
+int8_t  AUDIO_ClockDomainSubscribe(const AUDIO_ClockDomainSubscriberTypeDef* subscriber)
+{
+  AUDIO_ClockDomainSlotTypeDef* slot = 0;
+  uint32_t primask;
+  uint32_t i;
+
+  if((subscriber->StartCount == 0) || (subscriber->GetCount == 0) || (subscriber->period == 0U))
+  {
+    return -1;
+  }
+  for(i = 0; i < AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS; i++)
+  {
+    if(clock_domain.slot[i].used == 0U)
+    {
+      slot = &clock_domain.slot[i];
+      break;
+    }
+  }
+  if(slot == 0)
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  slot->subscriber = *subscriber;
+  slot->frames = 0;
+  slot->sof = 0;
+  slot->used = 1;
+  __set_PRIMASK(primask);
+  /* subscribing the handler again keeps its slot */
+  if(AUDIO_SofTickSubscribe(AUDIO_ClockDomainSof, 1, 0) != 0)
+  {
+    slot->used = 0;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ClockDomainUnsubscribe
+  *         removes a session. When its node was counted, the count moves to
+  *         another session from the next SOF and the estimate is kept
+  * @param  private_data: data the session was subscribed with
+  * @retval None
+  */
+void  AUDIO_ClockDomainUnsubscribe(uint32_t private_data)
+{
+  uint32_t primask;
+  uint8_t used = 0;
+  uint32_t i;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(i = 0; i < AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS; i++)
+  {
+    if(clock_domain.slot[i].used && (clock_domain.slot[i].subscriber.private_data == private_data))
+    {
+      clock_domain.slot[i].used = 0;
+      if(clock_domain.source == i)
+      {
+        clock_domain.source = AUDIO_CLOCK_DOMAIN_NO_SOURCE;
+      }
+    }
+    used |= clock_domain.slot[i].used;
+  }
+  __set_PRIMASK(primask);
+  if(used == 0U)
+  {
+    AUDIO_SofTickUnsubscribe(AUDIO_ClockDomainSof, 0);
+    clock_domain.rate = 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_ClockDomainGetRate
+  *         rate of the shared clock measured in USB time. With
+  *         USE_AUDIO_SOF_TIMESTAMP the latched rate is used once available
+  * @param  None
+  * @retval rate in Hz with AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS fractional bits, 0 if unknown
+  */
+uint32_t  AUDIO_ClockDomainGetRate(void)
+{
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  uint32_t measured = AUDIO_SofTimestampGetRate(clock_domain.frequency);
+
+  if(measured)
+  {
+    return measured;
+  }
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+  return clock_domain.rate;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ClockDomainSof
+  *         counts the frames of the SOF on the source node, updates the rate
+  *         each second and passes the frames to the subscribers
+  * @param  private_data: unused
+  * @retval None
+  */
+static void  AUDIO_ClockDomainSof(uint32_t private_data)
+{
+  AUDIO_ClockDomainSlotTypeDef* slot;
+  AUDIO_DescriptionTypeDef* desc;
+  uint32_t samples;
+  uint32_t frames;
+  uint32_t i;
+
+  if(clock_domain.source == AUDIO_CLOCK_DOMAIN_NO_SOURCE)
+  {
+    /* the count starts at this SOF, frames are taken from the next one */
+    AUDIO_ClockDomainSelectSource();
+    return;
+  }
+  slot = &clock_domain.slot[clock_domain.source];
+  desc = slot->subscriber.audio_description;
+  samples = slot->subscriber.GetCount(slot->subscriber.private_data);
+  if((samples == 0U) || (desc->frequence != clock_domain.frequency))
+  {
+    /* the node stopped or changed rate : the window is restarted on a running node */
+    clock_domain.source = AUDIO_CLOCK_DOMAIN_NO_SOURCE;
+    if(desc->frequence != clock_domain.frequency)
+    {
+      clock_domain.rate = 0;
+    }
+    return;
+  }
+  samples += clock_domain.residue;
+  frames = samples / desc->channels_count;
+  clock_domain.residue = samples - (frames * desc->channels_count);
+
+  clock_domain.window_frames += frames;
+  if(++clock_domain.window_sof == AUDIO_CLOCK_DOMAIN_SOF_PER_SECOND)
+  {
+    clock_domain.rate = clock_domain.window_frames << AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS;
+    clock_domain.window_frames = 0;
+    clock_domain.window_sof = 0;
+  }
+
+  for(i = 0; i < AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS; i++)
+  {
+    slot = &clock_domain.slot[i];
+    if(slot->used && slot->subscriber.Frame)
+    {
+      slot->frames += frames;
+      if(++slot->sof >= slot->subscriber.period)
+      {
+        slot->subscriber.Frame(slot->frames, slot->subscriber.private_data);
+        slot->frames = 0;
+        slot->sof = 0;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_ClockDomainSelectSource
+  *         starts the count on the first subscriber whose node runs
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ClockDomainSelectSource(void)
+{
+  AUDIO_ClockDomainSlotTypeDef* slot;
+  uint8_t i;
+
+  for(i = 0; i < AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS; i++)
+  {
+    slot = &clock_domain.slot[i];
+    if(slot->used && (slot->subscriber.StartCount(slot->subscriber.private_data) == 0))
+    {
+      clock_domain.source = i;
+      clock_domain.frequency = slot->subscriber.audio_description->frequence;
+      clock_domain.window_frames = 0;
+      clock_domain.window_sof = 0;
+      clock_domain.residue = 0;
+      return;
+    }
+  }
+}
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
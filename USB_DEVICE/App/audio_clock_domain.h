@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    audio_clock_domain.h
+  * @brief   header file for the audio_clock_domain.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CLOCK_DOMAIN_H
+#define __AUDIO_CLOCK_DOMAIN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+#include "audio_node.h"
+#include "audio_sof_tick.h"
+
+#ifndef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
+#error "the clock domain estimates the clock shared by playback and recording, it needs USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC"
+#endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_CLOCK_DOMAIN_MAX_SUBSCRIBERS 2U    /* playback and recording sessions */
+#define AUDIO_CLOCK_DOMAIN_SOF_PER_SECOND  (1000U * AUDIO_SOF_TICK_PER_MS)
+#define AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS  8U    /* rates in Hz, 24.8 format as the feedback rate */
+
+/* Exported types ------------------------------------------------------------*/
+/* a session of the shared clock. The frames are counted on one subscriber at a
+   time, the first whose count starts, all of them get the same frames and rate */
+typedef struct
+{
+  int8_t   (*StartCount) (uint32_t /*private_data*/); /* 0 when its node runs and the count is started */
+  uint32_t (*GetCount)   (uint32_t /*private_data*/); /* samples of all channels since the last call */
+  void     (*Frame)      (uint32_t /*frames*/, uint32_t /*private_data*/); /* frames counted in the period, may be 0 */
+  AUDIO_DescriptionTypeDef* audio_description;       /* rate and channels of the counted samples */
+  uint32_t period;                                   /* SOF between two Frame calls */
+  uint32_t private_data;
+}
+AUDIO_ClockDomainSubscriberTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t   AUDIO_ClockDomainSubscribe(const AUDIO_ClockDomainSubscriberTypeDef* subscriber);
+void     AUDIO_ClockDomainUnsubscribe(uint32_t private_data);
+uint32_t AUDIO_ClockDomainGetRate(void);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CLOCK_DOMAIN_H */
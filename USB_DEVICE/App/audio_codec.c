@@ -0,0 +1,386 @@
+/**
+  ******************************************************************************
+  * @file    audio_codec.c
+  * @brief   queued codec register writer. Sequences of register writes are
+  *          queued from any context, the EP0 control requests included, and
+  *          sent one register at a time by I2C DMA from the interrupts : the
+  *          caller never waits for the bus. The completion of a sequence is
+  *          reported from the pump.
+  *          A speaker or mic node driving a codec queues its volume, mute and
+  *          rate sequences from SetVolume, SetMute or ChangeFrequence and
+  *          returns at once, so the control request is acknowledged at once.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_codec.h"
+
+#ifdef USE_AUDIO_CODEC_I2C
+#include "audio_pump.h"
+#include "usbd_conf.h"
+
+#if (AUDIO_CODEC_REG_QUEUE_SIZE & (AUDIO_CODEC_REG_QUEUE_SIZE - 1U)) != 0U
+#error "AUDIO_CODEC_REG_QUEUE_SIZE must be a power of two"
+#endif /* AUDIO_CODEC_REG_QUEUE_SIZE */
+#if (AUDIO_CODEC_SEQ_QUEUE_SIZE & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)) != 0U
+#error "AUDIO_CODEC_SEQ_QUEUE_SIZE must be a power of two"
+#endif /* AUDIO_CODEC_SEQ_QUEUE_SIZE */
+#if (AUDIO_CODEC_REG_VALUE_SIZE != 1U) && (AUDIO_CODEC_REG_VALUE_SIZE != 2U)
+#error "AUDIO_CODEC_REG_VALUE_SIZE must be 1 or 2"
+#endif /* AUDIO_CODEC_REG_VALUE_SIZE */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_CodecDoneTypeDef done;
+  uint32_t private_data;
+  uint8_t  count;     /* registers of the sequence */
+  uint8_t  written;   /* registers already sent */
+  int8_t   status;
+}
+AUDIO_CodecSequenceTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static I2C_HandleTypeDef hi2c_codec;
+static DMA_HandleTypeDef hdma_codec_tx;
+/* DMA1 can't reach the DTCM , D2 SRAM1 is not cacheable */
+static uint8_t codec_tx_buffer[AUDIO_CODEC_REG_VALUE_SIZE] USBD_D2_BSS;
+
+static AUDIO_CodecRegTypeDef      codec_regs[AUDIO_CODEC_REG_QUEUE_SIZE];
+static AUDIO_CodecSequenceTypeDef codec_seqs[AUDIO_CODEC_SEQ_QUEUE_SIZE];
+/* free running counts : queued by AUDIO_CodecWrite, sent by the interrupts,
+   reported by the pump */
+static volatile uint32_t codec_reg_head = 0;
+static volatile uint32_t codec_reg_sent = 0;
+static volatile uint32_t codec_seq_head = 0;
+static volatile uint32_t codec_seq_sent = 0;
+static uint32_t codec_seq_tail = 0;
+static volatile uint8_t  codec_busy = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void  AUDIO_CodecHandler(void);
+static void  AUDIO_CodecStartNext(void);
+static void  AUDIO_CodecSequenceEnd(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CodecInit
+  *         registers the writer in the pump and configures the I2C, must be
+  *         called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_CodecInit(void)
+{
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+
+  codec_reg_head = 0;
+  codec_reg_sent = 0;
+  codec_seq_head = 0;
+  codec_seq_sent = 0;
+  codec_seq_tail = 0;
+  codec_busy = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CODEC, AUDIO_CodecHandler);
+
+  /* HSI kernel clock : the timing does not change with the APB clocks */
+  PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_I2C123;
+  PeriphClkInitStruct.I2c123ClockSelection = RCC_I2C123CLKSOURCE_HSI;
+  if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  hi2c_codec.Instance = AUDIO_CODEC_I2C;
+  hi2c_codec.Init.Timing = AUDIO_CODEC_I2C_TIMING;
+  hi2c_codec.Init.OwnAddress1 = 0;
+  hi2c_codec.Init.AddressingMode = I2C_ADDRESSINGMODE_7BIT;
+  hi2c_codec.Init.DualAddressMode = I2C_DUALADDRESS_DISABLE;
+  hi2c_codec.Init.OwnAddress2 = 0;
+  hi2c_codec.Init.OwnAddress2Masks = I2C_OA2_NOMASK;
+  hi2c_codec.Init.GeneralCallMode = I2C_GENERALCALL_DISABLE;
+  hi2c_codec.Init.NoStretchMode = I2C_NOSTRETCH_DISABLE;
+  if(HAL_I2C_Init(&hi2c_codec) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if(HAL_I2CEx_ConfigAnalogFilter(&hi2c_codec, I2C_ANALOGFILTER_ENABLE) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief  AUDIO_CodecWrite
+  *         queues a sequence of register writes, sent in order after the
+  *         sequences already queued. May be called from any context
+  * @param  regs: registers and values, copied
+  * @param  count: registers of the sequence
+  * @param  done: called from the pump when the sequence ends, may be 0
+  * @param  private_data: done argument
+  * @retval 0 if no error, -1 when the queue is full
+  */
+int8_t  AUDIO_CodecWrite(const AUDIO_CodecRegTypeDef* regs, uint8_t count,
+                         AUDIO_CodecDoneTypeDef done, uint32_t private_data)
+{
+  AUDIO_CodecSequenceTypeDef* seq;
+  uint32_t primask;
+  uint32_t i;
+
+  if((count == 0U) || (count > AUDIO_CODEC_REG_QUEUE_SIZE))
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(((AUDIO_CODEC_REG_QUEUE_SIZE - (codec_reg_head - codec_reg_sent)) < count) ||
+     ((codec_seq_head - codec_seq_tail) == AUDIO_CODEC_SEQ_QUEUE_SIZE))
+  {
+    __set_PRIMASK(primask);
+    return -1;
+  }
+  for(i = 0; i < count; i++)
+  {
+    codec_regs[(codec_reg_head + i) & (AUDIO_CODEC_REG_QUEUE_SIZE - 1U)] = regs[i];
+  }
+  seq = &codec_seqs[codec_seq_head & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)];
+  seq->done = done;
+  seq->private_data = private_data;
+  seq->count = count;
+  seq->written = 0;
+  seq->status = 0;
+  codec_reg_head += count;
+  codec_seq_head++;
+  __set_PRIMASK(primask);
+  /* the transfer is started from the pump, never from the caller */
+  AUDIO_PumpPost(AUDIO_PUMP_CODEC);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CodecIsIdle
+  *         the queue is empty and every completion was reported
+  * @param  None
+  * @retval 1 if idle
+  */
+uint8_t  AUDIO_CodecIsIdle(void)
+{
+  return (codec_seq_head == codec_seq_tail) ? 1U : 0U;
+}
+
+/**
+  * @brief  AUDIO_CodecI2cEvIRQHandler
+  *         I2C event interrupt
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_CodecI2cEvIRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&hi2c_codec);
+}
+
+/**
+  * @brief  AUDIO_CodecI2cErIRQHandler
+  *         I2C error interrupt
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_CodecI2cErIRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&hi2c_codec);
+}
+
+/**
+  * @brief  AUDIO_CodecTxDmaIRQHandler
+  *         transmission DMA interrupt
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_CodecTxDmaIRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_codec_tx);
+}
+
+/**
+  * @brief  HAL_I2C_MemTxCpltCallback
+  *         a register is written, the next one is started at once
+  * @param  hi2c: I2C handle
+  * @retval None
+  */
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  AUDIO_CodecSequenceTypeDef* seq;
+
+  if(hi2c == &hi2c_codec)
+  {
+    seq = &codec_seqs[codec_seq_sent & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)];
+    codec_reg_sent++;
+    if(++seq->written == seq->count)
+    {
+      AUDIO_CodecSequenceEnd();
+    }
+    AUDIO_CodecStartNext();
+  }
+}
+
+/**
+  * @brief  HAL_I2C_ErrorCallback
+  *         no acknowledge or bus error : the rest of the sequence is dropped,
+  *         the next sequence is started
+  * @param  hi2c: I2C handle
+  * @retval None
+  */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  AUDIO_CodecSequenceTypeDef* seq;
+
+  if(hi2c == &hi2c_codec)
+  {
+    seq = &codec_seqs[codec_seq_sent & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)];
+    seq->status = -1;
+    codec_reg_sent += (uint32_t)(seq->count - seq->written);
+    AUDIO_CodecSequenceEnd();
+    AUDIO_CodecStartNext();
+  }
+}
+
+/**
+  * @brief  HAL_I2C_MspInit
+  *         I2C clock, pins, DMA stream and interrupts of the codec control
+  * @param  hi2c: I2C handle
+  * @retval None
+  */
+void HAL_I2C_MspInit(I2C_HandleTypeDef *hi2c)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if(hi2c->Instance == AUDIO_CODEC_I2C)
+  {
+    AUDIO_CODEC_I2C_CLK_ENABLE();
+    AUDIO_CODEC_GPIO_CLK_ENABLE();
+    AUDIO_CODEC_DMA_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = AUDIO_CODEC_GPIO_PINS;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_OD;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    GPIO_InitStruct.Alternate = AUDIO_CODEC_GPIO_AF;
+    HAL_GPIO_Init(AUDIO_CODEC_GPIO_PORT, &GPIO_InitStruct);
+
+    hdma_codec_tx.Instance = AUDIO_CODEC_TX_DMA_STREAM;
+    hdma_codec_tx.Init.Request = AUDIO_CODEC_TX_DMA_REQUEST;
+    hdma_codec_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_codec_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_codec_tx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_codec_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_codec_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_codec_tx.Init.Mode = DMA_NORMAL;
+    hdma_codec_tx.Init.Priority = DMA_PRIORITY_LOW;
+    hdma_codec_tx.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(&hdma_codec_tx) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(hi2c, hdmatx, hdma_codec_tx);
+
+    HAL_NVIC_SetPriority(AUDIO_CODEC_TX_DMA_IRQn, AUDIO_CODEC_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CODEC_TX_DMA_IRQn);
+    HAL_NVIC_SetPriority(AUDIO_CODEC_I2C_EV_IRQn, AUDIO_CODEC_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CODEC_I2C_EV_IRQn);
+    HAL_NVIC_SetPriority(AUDIO_CODEC_I2C_ER_IRQn, AUDIO_CODEC_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_CODEC_I2C_ER_IRQn);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CodecHandler
+  *         pump work : reports the ended sequences and starts the writer when
+  *         sequences wait on an idle bus
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_CodecHandler(void)
+{
+  AUDIO_CodecSequenceTypeDef* seq;
+  uint32_t primask;
+  uint8_t start = 0;
+
+  while(codec_seq_tail != codec_seq_sent)
+  {
+    seq = &codec_seqs[codec_seq_tail & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)];
+    if(seq->done)
+    {
+      seq->done(seq->status, seq->private_data);
+    }
+    codec_seq_tail++;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if((codec_busy == 0U) && (codec_seq_sent != codec_seq_head))
+  {
+    codec_busy = 1;
+    start = 1;
+  }
+  __set_PRIMASK(primask);
+  if(start)
+  {
+    AUDIO_CodecStartNext();
+  }
+}
+
+/**
+  * @brief  AUDIO_CodecStartNext
+  *         starts the DMA write of the next queued register, the writer is
+  *         idle once the queue is empty
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_CodecStartNext(void)
+{
+  AUDIO_CodecSequenceTypeDef* seq;
+  AUDIO_CodecRegTypeDef reg;
+
+  while(codec_seq_sent != codec_seq_head)
+  {
+    seq = &codec_seqs[codec_seq_sent & (AUDIO_CODEC_SEQ_QUEUE_SIZE - 1U)];
+    reg = codec_regs[codec_reg_sent & (AUDIO_CODEC_REG_QUEUE_SIZE - 1U)];
+#if (AUDIO_CODEC_REG_VALUE_SIZE == 2U)
+    codec_tx_buffer[0] = (uint8_t)(reg.value >> 8);
+    codec_tx_buffer[1] = (uint8_t)reg.value;
+#else /* AUDIO_CODEC_REG_VALUE_SIZE */
+    codec_tx_buffer[0] = (uint8_t)reg.value;
+#endif /* AUDIO_CODEC_REG_VALUE_SIZE */
+    if(HAL_I2C_Mem_Write_DMA(&hi2c_codec, AUDIO_CODEC_I2C_ADDRESS, reg.reg, AUDIO_CODEC_REG_ADDR_SIZE,
+                             codec_tx_buffer, AUDIO_CODEC_REG_VALUE_SIZE) == HAL_OK)
+    {
+      return;
+    }
+    /* the bus is stuck : the sequence fails, the next one is tried */
+    seq->status = -1;
+    codec_reg_sent += (uint32_t)(seq->count - seq->written);
+    AUDIO_CodecSequenceEnd();
+  }
+  codec_busy = 0;
+}
+
+/**
+  * @brief  AUDIO_CodecSequenceEnd
+  *         the sent sequence ended, its completion is reported from the pump
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_CodecSequenceEnd(void)
+{
+  codec_seq_sent++;
+  AUDIO_PumpPost(AUDIO_PUMP_CODEC);
+}
+#endif /* USE_AUDIO_CODEC_I2C */
@@ -0,0 +1,93 @@
+/**
+  ******************************************************************************
+  * @file    audio_codec.h
+  * @brief   header file for the audio_codec.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CODEC_H
+#define __AUDIO_CODEC_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_CODEC_I2C
+#include "main.h"
+
+#ifndef HAL_I2C_MODULE_ENABLED
+#error "the codec control needs HAL_I2C_MODULE_ENABLED and the HAL I2C driver"
+#endif /* HAL_I2C_MODULE_ENABLED */
+
+/* Exported constants --------------------------------------------------------*/
+/* I2C1 on the Zio connector : SCL PB8 , SDA PB9 */
+#define AUDIO_CODEC_I2C                       I2C1
+#define AUDIO_CODEC_I2C_CLK_ENABLE()          __HAL_RCC_I2C1_CLK_ENABLE()
+#define AUDIO_CODEC_I2C_EV_IRQn               I2C1_EV_IRQn
+#define AUDIO_CODEC_I2C_EV_IRQHandler         I2C1_EV_IRQHandler
+#define AUDIO_CODEC_I2C_ER_IRQn               I2C1_ER_IRQn
+#define AUDIO_CODEC_I2C_ER_IRQHandler         I2C1_ER_IRQHandler
+#define AUDIO_CODEC_GPIO_PORT                 GPIOB
+#define AUDIO_CODEC_GPIO_PINS                 (GPIO_PIN_8 | GPIO_PIN_9)
+#define AUDIO_CODEC_GPIO_AF                   GPIO_AF4_I2C1
+#define AUDIO_CODEC_GPIO_CLK_ENABLE()         __HAL_RCC_GPIOB_CLK_ENABLE()
+/* DMA1 streams 0 to 3 are used by the SAI and the CDC bridge */
+#define AUDIO_CODEC_DMA_CLK_ENABLE()          __HAL_RCC_DMA1_CLK_ENABLE()
+#define AUDIO_CODEC_TX_DMA_STREAM             DMA1_Stream4
+#define AUDIO_CODEC_TX_DMA_REQUEST            DMA_REQUEST_I2C1_TX
+#define AUDIO_CODEC_TX_DMA_IRQn               DMA1_Stream4_IRQn
+#define AUDIO_CODEC_TX_DMA_IRQHandler         DMA1_Stream4_IRQHandler
+/* below OTG_HS (0), the SAI / MDMA interrupts (1) and the audio level of the pump (2) */
+#define AUDIO_CODEC_IRQ_PRIORITY              3U
+/* the kernel clock is the 64 MHz HSI, kept on by the idle power manager :
+   400 kHz fast mode, PRESC 0 SCLDEL 8 SDADEL 2 SCLH 55 SCLL 87 */
+#define AUDIO_CODEC_I2C_TIMING                0x00823757U
+
+/* codec 7 bits address shifted left, register address and value sizes in bytes */
+#define AUDIO_CODEC_I2C_ADDRESS               0x34U
+#define AUDIO_CODEC_REG_ADDR_SIZE             I2C_MEMADD_SIZE_16BIT
+#define AUDIO_CODEC_REG_VALUE_SIZE            2U
+/* queued register writes and sequences, must be powers of two */
+#define AUDIO_CODEC_REG_QUEUE_SIZE            32U
+#define AUDIO_CODEC_SEQ_QUEUE_SIZE            8U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint16_t reg;
+  uint16_t value;
+}
+AUDIO_CodecRegTypeDef;
+
+/* called from the pump once the last register of a sequence is written,
+   status is 0 if no error, -1 when the codec did not acknowledge */
+typedef void (*AUDIO_CodecDoneTypeDef)(int8_t status, uint32_t private_data);
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_CodecInit(void);
+int8_t  AUDIO_CodecWrite(const AUDIO_CodecRegTypeDef* regs, uint8_t count,
+                         AUDIO_CodecDoneTypeDef done, uint32_t private_data);
+uint8_t AUDIO_CodecIsIdle(void);
+void    AUDIO_CodecI2cEvIRQHandler(void);
+void    AUDIO_CodecI2cErIRQHandler(void);
+void    AUDIO_CodecTxDmaIRQHandler(void);
+#endif /* USE_AUDIO_CODEC_I2C */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CODEC_H */
@@ -0,0 +1,289 @@
+/**
+  ******************************************************************************
+  * @file    audio_controls.c
+  * @brief   hardware mute button and volume encoder. An edge on any input
+  *          masks the EXTI lines and starts a sampling timer, which debounces
+  *          the button, decodes the encoder and runs until the inputs are
+  *          idle. Changes are sent from the pump through the session
+  *          ExternalControl, at most once per ms frame : encoder detents of a
+  *          frame are summed in one volume change and one interrupt message
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_controls.h"
+#include "audio_pump.h"
+#include "usbd_audio_if.h"
+
+#ifdef USE_AUDIO_HW_CONTROLS
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_CONTROLS_EXTI_LINES   (AUDIO_CONTROLS_BUTTON_GPIO_PIN | AUDIO_CONTROLS_ENC_A_GPIO_PIN | \
+                                     AUDIO_CONTROLS_ENC_B_GPIO_PIN)
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_ControlsHandler(void);
+static void     AUDIO_ControlsSample(void);
+static void     AUDIO_ControlsStartTimer(void);
+static uint8_t  AUDIO_ControlsReadEncoder(void);
+
+/* Private variables ---------------------------------------------------------*/
+/* quadrature step from the previous and the current A B state , 0 for no move or a
+   skipped state */
+static const int8_t AUDIO_ControlsEncSteps[16] =
+{
+  0, -1,  1,  0,
+  1,  0,  0, -1,
+ -1,  0,  0,  1,
+  0,  1, -1,  0
+};
+/* written by the timer interrupt */
+static uint8_t  controls_button;       /* debounced level , 1 when pressed */
+static uint8_t  controls_button_count; /* samples the raw level differed from controls_button */
+static uint8_t  controls_enc;          /* last A B state */
+static int8_t   controls_enc_states;   /* quadrature steps since the last detent */
+static uint16_t controls_idle;         /* samples without input change */
+/* taken by the pump */
+static volatile int32_t controls_detents = 0;
+static volatile uint8_t controls_presses = 0;
+static uint32_t controls_sent_tick = 0;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ControlsInit
+  *         configures the inputs, the EXTI lines and the timer, must be called
+  *         after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ControlsInit(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CONTROLS, AUDIO_ControlsHandler);
+  AUDIO_CONTROLS_BUTTON_GPIO_CLK_ENABLE();
+  AUDIO_CONTROLS_ENC_GPIO_CLK_ENABLE();
+  AUDIO_CONTROLS_TIM_CLK_ENABLE();
+
+  /* the button has its pull down on the board, the encoder switches to ground */
+  GPIO_InitStruct.Pin = AUDIO_CONTROLS_BUTTON_GPIO_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  HAL_GPIO_Init(AUDIO_CONTROLS_BUTTON_GPIO_PORT, &GPIO_InitStruct);
+  GPIO_InitStruct.Pin = AUDIO_CONTROLS_ENC_A_GPIO_PIN | AUDIO_CONTROLS_ENC_B_GPIO_PIN;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(AUDIO_CONTROLS_ENC_GPIO_PORT, &GPIO_InitStruct);
+
+  controls_button = (HAL_GPIO_ReadPin(AUDIO_CONTROLS_BUTTON_GPIO_PORT, AUDIO_CONTROLS_BUTTON_GPIO_PIN) ==
+                     AUDIO_CONTROLS_BUTTON_ACTIVE) ? 1U : 0U;
+  controls_button_count = 0;
+  controls_enc = AUDIO_ControlsReadEncoder();
+  controls_enc_states = 0;
+  controls_detents = 0;
+  controls_presses = 0;
+
+  /* update interrupt every AUDIO_CONTROLS_SAMPLE_US , started by the first edge */
+  AUDIO_CONTROLS_TIM->CR1 = TIM_CR1_URS;
+  AUDIO_CONTROLS_TIM->DIER = TIM_DIER_UIE;
+  HAL_NVIC_SetPriority(AUDIO_CONTROLS_TIM_IRQn, AUDIO_CONTROLS_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(AUDIO_CONTROLS_TIM_IRQn);
+  __HAL_GPIO_EXTI_CLEAR_IT(AUDIO_CONTROLS_EXTI_LINES);
+  HAL_NVIC_SetPriority(AUDIO_CONTROLS_EXTI_IRQn, AUDIO_CONTROLS_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(AUDIO_CONTROLS_EXTI_IRQn);
+}
+
+/**
+  * @brief  AUDIO_ControlsExtiIRQHandler
+  *         first edge of a press or a turn, the lines stay masked while the
+  *         timer samples them
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ControlsExtiIRQHandler(void)
+{
+  if((EXTI->PR1 & AUDIO_CONTROLS_EXTI_LINES) == 0U)
+  {
+    return;
+  }
+  EXTI->IMR1 &= ~AUDIO_CONTROLS_EXTI_LINES;
+  __HAL_GPIO_EXTI_CLEAR_IT(AUDIO_CONTROLS_EXTI_LINES);
+  AUDIO_ControlsStartTimer();
+}
+
+/**
+  * @brief  AUDIO_ControlsTimIRQHandler
+  *         samples the inputs each AUDIO_CONTROLS_SAMPLE_US
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ControlsTimIRQHandler(void)
+{
+  if((AUDIO_CONTROLS_TIM->SR & TIM_SR_UIF) == 0U)
+  {
+    return;
+  }
+  AUDIO_CONTROLS_TIM->SR = ~TIM_SR_UIF;
+  AUDIO_ControlsSample();
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ControlsSample
+  *         debounces the button, decodes the encoder and stops the sampling
+  *         once the inputs are idle and the pump took every change
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ControlsSample(void)
+{
+  uint8_t button;
+  uint8_t enc;
+  uint8_t moved = 0;
+
+  button = (HAL_GPIO_ReadPin(AUDIO_CONTROLS_BUTTON_GPIO_PORT, AUDIO_CONTROLS_BUTTON_GPIO_PIN) ==
+            AUDIO_CONTROLS_BUTTON_ACTIVE) ? 1U : 0U;
+  if(button != controls_button)
+  {
+    moved = 1;
+    if(++controls_button_count >= AUDIO_CONTROLS_DEBOUNCE_SAMPLES)
+    {
+      controls_button = button;
+      controls_button_count = 0;
+      if(button)
+      {
+        controls_presses++;
+      }
+    }
+  }
+  else
+  {
+    controls_button_count = 0;
+  }
+
+  /* contact bounce moves the state back and forth, its steps cancel out */
+  enc = AUDIO_ControlsReadEncoder();
+  if(enc != controls_enc)
+  {
+    moved = 1;
+    controls_enc_states += AUDIO_ControlsEncSteps[(controls_enc << 2) | enc];
+    controls_enc = enc;
+    if(controls_enc_states >= AUDIO_CONTROLS_ENC_STATES_PER_DETENT)
+    {
+      controls_enc_states = 0;
+      controls_detents++;
+    }
+    else if(controls_enc_states <= -AUDIO_CONTROLS_ENC_STATES_PER_DETENT)
+    {
+      controls_enc_states = 0;
+      controls_detents--;
+    }
+  }
+
+  controls_idle = moved ? 0U : (uint16_t)(controls_idle + 1U);
+  if((controls_presses != 0U) || (controls_detents != 0))
+  {
+    /* posted again each sample until the pump sends it */
+    AUDIO_PumpPost(AUDIO_PUMP_CONTROLS);
+  }
+  else if(controls_idle >= AUDIO_CONTROLS_IDLE_SAMPLES)
+  {
+    AUDIO_CONTROLS_TIM->CR1 &= ~TIM_CR1_CEN;
+    controls_enc_states = 0;
+    __HAL_GPIO_EXTI_CLEAR_IT(AUDIO_CONTROLS_EXTI_LINES);
+    EXTI->IMR1 |= AUDIO_CONTROLS_EXTI_LINES;
+  }
+}
+
+/**
+  * @brief  AUDIO_ControlsStartTimer
+  *         starts the sampling, the prescaler follows the kernel clock which
+  *         may change with the idle power manager
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ControlsStartTimer(void)
+{
+  uint32_t clock = HAL_RCC_GetPCLK1Freq();
+
+  /* APB1 timers run at twice a divided APB clock */
+  if((RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) != RCC_APB1_DIV1)
+  {
+    clock *= 2U;
+  }
+  controls_idle = 0;
+  AUDIO_CONTROLS_TIM->PSC = (clock / 1000000U) - 1U;
+  AUDIO_CONTROLS_TIM->ARR = AUDIO_CONTROLS_SAMPLE_US - 1U;
+  /* loads the prescaler, URS keeps it from raising the update interrupt */
+  AUDIO_CONTROLS_TIM->EGR = TIM_EGR_UG;
+  AUDIO_CONTROLS_TIM->CR1 |= TIM_CR1_CEN;
+}
+
+/**
+  * @brief  AUDIO_ControlsReadEncoder
+  *         reads the encoder contacts
+  * @param  None
+  * @retval A B state , A in bit 1
+  */
+static uint8_t  AUDIO_ControlsReadEncoder(void)
+{
+  uint32_t idr = AUDIO_CONTROLS_ENC_GPIO_PORT->IDR;
+
+  return (uint8_t)((((idr & AUDIO_CONTROLS_ENC_A_GPIO_PIN) != 0U) ? 2U : 0U) |
+                   (((idr & AUDIO_CONTROLS_ENC_B_GPIO_PIN) != 0U) ? 1U : 0U));
+}
+
+/**
+  * @brief  AUDIO_ControlsHandler
+  *         sends the changes of the inputs, once per ms frame : the interrupt
+  *         endpoint gets at most one mute and one volume message per frame
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_ControlsHandler(void)
+{
+  uint32_t now = HAL_GetTick();
+  uint32_t primask;
+  uint32_t lock;
+  int32_t detents;
+  uint8_t presses;
+
+  if(now == controls_sent_tick)
+  {
+    /* the timer posts the changes again next sample */
+    return;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  detents = controls_detents;
+  presses = controls_presses;
+  controls_detents = 0;
+  controls_presses = 0;
+  __set_PRIMASK(primask);
+  if((detents == 0) && (presses == 0U))
+  {
+    return;
+  }
+  controls_sent_tick = now;
+  /* the session controls change state also used by audio work */
+  lock = AUDIO_PumpLockAudio();
+  if(presses & 1U)
+  {
+    USBD_AUDIO_ExecuteControl(USBD_AUDIO_PLAYBACK, USBD_AUDIO_MUTE_UNMUTE, 0, 0);
+  }
+  if(detents != 0)
+  {
+    USBD_AUDIO_ExecuteControl(USBD_AUDIO_PLAYBACK, USBD_AUDIO_VOLUME,
+                              (uint32_t)(detents * AUDIO_CONTROLS_VOLUME_STEP_DB_256), 0);
+  }
+  AUDIO_PumpUnlockAudio(lock);
+}
+#endif /* USE_AUDIO_HW_CONTROLS */
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    audio_controls.h
+  * @brief   header file for the audio_controls.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CONTROLS_H
+#define __AUDIO_CONTROLS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_HW_CONTROLS
+#include "main.h"
+
+#ifndef USE_AUDIO_USB_INTERRUPT
+#error "the hardware controls report their changes to the host, they need USE_AUDIO_USB_INTERRUPT"
+#endif /* USE_AUDIO_USB_INTERRUPT */
+
+/* Exported constants --------------------------------------------------------*/
+/* user button B1 (PC13, high when pressed) toggles the playback mute, the quadrature
+   encoder on PD12 / PD13 changes the playback volume. All lines are on EXTI15_10 */
+#define AUDIO_CONTROLS_BUTTON_GPIO_PORT       GPIOC
+#define AUDIO_CONTROLS_BUTTON_GPIO_PIN        GPIO_PIN_13
+#define AUDIO_CONTROLS_BUTTON_ACTIVE          GPIO_PIN_SET
+#define AUDIO_CONTROLS_BUTTON_GPIO_CLK_ENABLE() __HAL_RCC_GPIOC_CLK_ENABLE()
+#define AUDIO_CONTROLS_ENC_GPIO_PORT          GPIOD
+#define AUDIO_CONTROLS_ENC_A_GPIO_PIN         GPIO_PIN_12
+#define AUDIO_CONTROLS_ENC_B_GPIO_PIN         GPIO_PIN_13
+#define AUDIO_CONTROLS_ENC_GPIO_CLK_ENABLE()  __HAL_RCC_GPIOD_CLK_ENABLE()
+#define AUDIO_CONTROLS_EXTI_IRQn              EXTI15_10_IRQn
+#define AUDIO_CONTROLS_EXTI_IRQHandler        EXTI15_10_IRQHandler
+/* basic timer sampling the inputs while they move */
+#define AUDIO_CONTROLS_TIM                    TIM7
+#define AUDIO_CONTROLS_TIM_CLK_ENABLE()       __HAL_RCC_TIM7_CLK_ENABLE()
+#define AUDIO_CONTROLS_TIM_IRQn               TIM7_IRQn
+#define AUDIO_CONTROLS_TIM_IRQHandler         TIM7_IRQHandler
+/* below OTG_HS (0), the SAI / MDMA interrupts (1) and the audio level of the pump (2) */
+#define AUDIO_CONTROLS_IRQ_PRIORITY           3U
+
+/* the first edge masks the EXTI lines and starts the sampling, a button level is
+   taken once it is stable for AUDIO_CONTROLS_DEBOUNCE_SAMPLES. The EXTI lines are
+   unmasked once nothing moved for AUDIO_CONTROLS_IDLE_SAMPLES */
+#define AUDIO_CONTROLS_SAMPLE_US              500U
+#define AUDIO_CONTROLS_DEBOUNCE_SAMPLES       10U  /* 5 ms */
+#define AUDIO_CONTROLS_IDLE_SAMPLES           40U  /* 20 ms */
+/* quadrature states per detent, and volume change per detent */
+#define AUDIO_CONTROLS_ENC_STATES_PER_DETENT  4
+#define AUDIO_CONTROLS_VOLUME_STEP_DB_256     256  /* 1 dB */
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_ControlsInit(void);
+void  AUDIO_ControlsExtiIRQHandler(void);
+void  AUDIO_ControlsTimIRQHandler(void);
+#endif /* USE_AUDIO_HW_CONTROLS */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CONTROLS_H */
@@ -0,0 +1,340 @@
+/**
+  ******************************************************************************
+  * @file    audio_copy.c
+  * @brief   Copy engine of the SAI nodes : the block moves between a DMA half
+  *          and the session ring are done by the MDMA instead of the CPU. A
+  *          ring region which wraps is moved by a two nodes linked list, the
+  *          user callback runs at the end of the whole list. Copies shorter
+  *          than AUDIO_COPY_MIN_DMA_LENGTH, or which the MDMA failed, are done
+  *          by the CPU. No cache maintenance is done : rings are in DTCM or in
+  *          D2 SRAM, DMA halves and link nodes in D2 SRAM, none of them cached.
+  *          The long delay node has its own engine, between its D2 SRAM
+  *          windows and the OCTOSPI PSRAM.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_conf.h"
+#include "audio_copy.h"
+
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_user_devices.h"
+
+#if (defined USE_AUDIO_SPEAKER_DUMMY) && (defined USE_AUDIO_DUMMY_MIC) && !(defined USE_AUDIO_PLAYBACK_LONG_DELAY)
+#error "USE_AUDIO_MDMA_COPY offloads the copies of the SAI nodes or of the long delay, the SAI speaker, the SAI mic or USE_AUDIO_PLAYBACK_LONG_DELAY is required"
+#endif /* USE_AUDIO_SPEAKER_DUMMY && USE_AUDIO_DUMMY_MIC && !USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifndef HAL_MDMA_MODULE_ENABLED
+#error "USE_AUDIO_MDMA_COPY needs HAL_MDMA_MODULE_ENABLED and the HAL MDMA driver"
+#endif /* HAL_MDMA_MODULE_ENABLED */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  MDMA_HandleTypeDef        hmdma;        /* first, the HAL callbacks get back the engine from it */
+  MDMA_LinkNodeTypeDef*     node;         /* second piece of a wrapping region */
+  uint8_t*                  dst[2];
+  uint8_t*                  src[2];
+  uint32_t                  length[2];
+  AUDIO_CopyCallbackTypeDef callback;
+  uint32_t                  private_data;
+  volatile uint8_t          busy;         /* a MDMA transfer is running */
+  uint8_t                   linked;       /* node is in the list */
+}
+AUDIO_CopyTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_CopyTypeDef copy_engines[AUDIO_COPY_ENGINE_COUNT];
+/* fetched by the MDMA, so in D2 SRAM which is not cached */
+static MDMA_LinkNodeTypeDef copy_nodes[AUDIO_COPY_ENGINE_COUNT] __ALIGNED(8) USBD_D2_BSS;
+static MDMA_Channel_TypeDef* const copy_channels[AUDIO_COPY_ENGINE_COUNT] =
+{
+  AUDIO_COPY_SPEAKER_MDMA_CHANNEL,
+  AUDIO_COPY_MIC_MDMA_CHANNEL,
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+  AUDIO_COPY_DELAY_MDMA_CHANNEL
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t AUDIO_CopyStart(AUDIO_CopyTypeDef* copy);
+static void   AUDIO_CopyByCpu(AUDIO_CopyTypeDef* copy);
+static void   AUDIO_CopyEnd(AUDIO_CopyTypeDef* copy);
+static void   AUDIO_CopyXferCplt(MDMA_HandleTypeDef* hmdma);
+static void   AUDIO_CopyXferError(MDMA_HandleTypeDef* hmdma);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CopyInit
+  *         initializes the MDMA channels of the engines, must be called
+  *         before the SAI nodes are started
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CopyInit(void)
+{
+  AUDIO_CopyTypeDef* copy;
+  uint8_t engine;
+
+  AUDIO_COPY_MDMA_CLK_ENABLE();
+  memset(copy_engines, 0, sizeof(copy_engines));
+  for(engine = 0; engine < AUDIO_COPY_ENGINE_COUNT; engine++)
+  {
+    copy = &copy_engines[engine];
+    copy->node = &copy_nodes[engine];
+    copy->hmdma.Instance = copy_channels[engine];
+    copy->hmdma.Init.Request = MDMA_REQUEST_SW;
+    copy->hmdma.Init.TransferTriggerMode = MDMA_FULL_TRANSFER;
+    copy->hmdma.Init.Priority = MDMA_PRIORITY_HIGH;
+    copy->hmdma.Init.Endianness = MDMA_LITTLE_ENDIANNESS_PRESERVE;
+    /* ring regions are only byte aligned, bytes are packed in the bursts */
+    copy->hmdma.Init.SourceInc = MDMA_SRC_INC_BYTE;
+    copy->hmdma.Init.DestinationInc = MDMA_DEST_INC_BYTE;
+    copy->hmdma.Init.SourceDataSize = MDMA_SRC_DATASIZE_BYTE;
+    copy->hmdma.Init.DestDataSize = MDMA_DEST_DATASIZE_BYTE;
+    copy->hmdma.Init.DataAlignment = MDMA_DATAALIGN_PACKENABLE;
+    copy->hmdma.Init.BufferTransferLength = 128U;
+    copy->hmdma.Init.SourceBurst = MDMA_SOURCE_BURST_16BEATS;
+    copy->hmdma.Init.DestBurst = MDMA_DEST_BURST_16BEATS;
+    copy->hmdma.Init.SourceBlockAddressOffset = 0;
+    copy->hmdma.Init.DestBlockAddressOffset = 0;
+    if(HAL_MDMA_Init(&copy->hmdma) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    copy->hmdma.XferCpltCallback = AUDIO_CopyXferCplt;
+    copy->hmdma.XferErrorCallback = AUDIO_CopyXferError;
+  }
+  HAL_NVIC_SetPriority(AUDIO_COPY_MDMA_IRQn, AUDIO_COPY_MDMA_IRQ_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(AUDIO_COPY_MDMA_IRQn);
+}
+
+/**
+  * @brief  AUDIO_CopyFromRegion
+  *         copies a region of a ring to a linear buffer
+  * @param  engine: engine of the caller
+  * @param  dst: destination, of the region length
+  * @param  region: region to read, must stay valid until the callback
+  * @param  callback: called once the data is copied
+  * @param  private_data: callback parameter
+  * @retval 0 if the copy is started or done, -1 if the engine is busy
+  */
+int8_t AUDIO_CopyFromRegion(AUDIO_CopyEngineTypeDef engine, uint8_t* dst, AUDIO_BufferRegionTypeDef* region,
+                            AUDIO_CopyCallbackTypeDef callback, uint32_t private_data)
+{
+  AUDIO_CopyTypeDef* copy = &copy_engines[engine];
+
+  if(copy->busy)
+  {
+    return -1;
+  }
+  copy->dst[0] = dst;
+  copy->dst[1] = dst + region->length[0];
+  copy->src[0] = region->data[0];
+  copy->src[1] = region->data[1];
+  copy->length[0] = region->length[0];
+  copy->length[1] = region->length[1];
+  copy->callback = callback;
+  copy->private_data = private_data;
+  return AUDIO_CopyStart(copy);
+}
+
+/**
+  * @brief  AUDIO_CopyToRegion
+  *         copies a linear buffer to a region of a ring
+  * @param  engine: engine of the caller
+  * @param  region: region to write, must stay valid until the callback
+  * @param  src: source, of the region length
+  * @param  callback: called once the data is copied
+  * @param  private_data: callback parameter
+  * @retval 0 if the copy is started or done, -1 if the engine is busy
+  */
+int8_t AUDIO_CopyToRegion(AUDIO_CopyEngineTypeDef engine, AUDIO_BufferRegionTypeDef* region, uint8_t* src,
+                          AUDIO_CopyCallbackTypeDef callback, uint32_t private_data)
+{
+  AUDIO_CopyTypeDef* copy = &copy_engines[engine];
+
+  if(copy->busy)
+  {
+    return -1;
+  }
+  copy->dst[0] = region->data[0];
+  copy->dst[1] = region->data[1];
+  copy->src[0] = src;
+  copy->src[1] = src + region->length[0];
+  copy->length[0] = region->length[0];
+  copy->length[1] = region->length[1];
+  copy->callback = callback;
+  copy->private_data = private_data;
+  return AUDIO_CopyStart(copy);
+}
+
+/**
+  * @brief  AUDIO_CopyWait
+  *         waits for the end of the running copy, its callback included. Must
+  *         be called below the priority of the MDMA interrupt
+  * @param  engine: engine of the caller
+  * @retval None
+  */
+void AUDIO_CopyWait(AUDIO_CopyEngineTypeDef engine)
+{
+  while(copy_engines[engine].busy)
+  {
+  }
+}
+
+/**
+  * @brief  AUDIO_CopyAbort
+  *         stops the running copy, its callback is not called
+  * @param  engine: engine of the caller
+  * @retval None
+  */
+void AUDIO_CopyAbort(AUDIO_CopyEngineTypeDef engine)
+{
+  AUDIO_CopyTypeDef* copy = &copy_engines[engine];
+
+  /* the end of the copy can't run while it is removed */
+  HAL_NVIC_DisableIRQ(AUDIO_COPY_MDMA_IRQn);
+  if(copy->busy)
+  {
+    HAL_MDMA_Abort(&copy->hmdma);
+    if(copy->linked)
+    {
+      HAL_MDMA_LinkedList_RemoveNode(&copy->hmdma, copy->node);
+      copy->linked = 0;
+    }
+    copy->busy = 0;
+  }
+  HAL_NVIC_EnableIRQ(AUDIO_COPY_MDMA_IRQn);
+}
+
+/**
+  * @brief  AUDIO_CopyIRQHandler
+  *         MDMA interrupt, shared by the channels of the engines
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CopyIRQHandler(void)
+{
+  uint8_t engine;
+
+  for(engine = 0; engine < AUDIO_COPY_ENGINE_COUNT; engine++)
+  {
+    HAL_MDMA_IRQHandler(&copy_engines[engine].hmdma);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CopyStart
+  *         starts the MDMA on the pieces of the copy, the second piece is
+  *         moved by the link node. Short copies are done at once by the CPU
+  * @param  copy: engine
+  * @retval 0 if no error
+  */
+static int8_t AUDIO_CopyStart(AUDIO_CopyTypeDef* copy)
+{
+  MDMA_LinkNodeConfTypeDef node_config;
+  uint8_t first = (copy->length[0] == 0U) ? 1U : 0U;
+
+  if((copy->length[0] + copy->length[1]) < AUDIO_COPY_MIN_DMA_LENGTH)
+  {
+    AUDIO_CopyByCpu(copy);
+    copy->callback(copy->private_data);
+    return 0;
+  }
+  copy->busy = 1;
+  if((first == 0U) && (copy->length[1] != 0U))
+  {
+    memset(&node_config, 0, sizeof(node_config));
+    node_config.Init = copy->hmdma.Init;
+    node_config.SrcAddress = (uint32_t)copy->src[1];
+    node_config.DstAddress = (uint32_t)copy->dst[1];
+    node_config.BlockDataLength = copy->length[1];
+    node_config.BlockCount = 1;
+    if((HAL_MDMA_LinkedList_CreateNode(copy->node, &node_config) != HAL_OK) ||
+       (HAL_MDMA_LinkedList_AddNode(&copy->hmdma, copy->node, 0) != HAL_OK))
+    {
+      AUDIO_CopyEnd(copy);
+      return 0;
+    }
+    copy->linked = 1;
+  }
+  if(HAL_MDMA_Start_IT(&copy->hmdma, (uint32_t)copy->src[first], (uint32_t)copy->dst[first],
+                       copy->length[first], 1) != HAL_OK)
+  {
+    AUDIO_CopyEnd(copy);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_CopyByCpu
+  *         copies the pieces with the CPU
+  * @param  copy: engine
+  * @retval None
+  */
+static void AUDIO_CopyByCpu(AUDIO_CopyTypeDef* copy)
+{
+  AUDIO_MEMCPY(copy->dst[0], copy->src[0], copy->length[0]);
+  AUDIO_MEMCPY(copy->dst[1], copy->src[1], copy->length[1]);
+}
+
+/**
+  * @brief  AUDIO_CopyEnd
+  *         the MDMA failed, the copy is done by the CPU then completed
+  * @param  copy: engine
+  * @retval None
+  */
+static void AUDIO_CopyEnd(AUDIO_CopyTypeDef* copy)
+{
+  if(copy->linked)
+  {
+    HAL_MDMA_LinkedList_RemoveNode(&copy->hmdma, copy->node);
+    copy->linked = 0;
+  }
+  AUDIO_CopyByCpu(copy);
+  copy->busy = 0;
+  copy->callback(copy->private_data);
+}
+
+/**
+  * @brief  AUDIO_CopyXferCplt
+  *         the whole list is moved
+  * @param  hmdma: MDMA handle of the engine
+  * @retval None
+  */
+static void AUDIO_CopyXferCplt(MDMA_HandleTypeDef* hmdma)
+{
+  AUDIO_CopyTypeDef* copy = (AUDIO_CopyTypeDef*)hmdma;
+
+  if(copy->linked)
+  {
+    HAL_MDMA_LinkedList_RemoveNode(hmdma, copy->node);
+    copy->linked = 0;
+  }
+  copy->busy = 0;
+  copy->callback(copy->private_data);
+}
+
+/**
+  * @brief  AUDIO_CopyXferError
+  *         transfer error, the channel is disabled by the HAL
+  * @param  hmdma: MDMA handle of the engine
+  * @retval None
+  */
+static void AUDIO_CopyXferError(MDMA_HandleTypeDef* hmdma)
+{
+  AUDIO_CopyEnd((AUDIO_CopyTypeDef*)hmdma);
+}
+#endif /* USE_AUDIO_MDMA_COPY */
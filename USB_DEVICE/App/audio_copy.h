@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    audio_copy.h
+  * @brief   header file for the audio_copy.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_COPY_H
+#define __AUDIO_COPY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+#ifdef USE_AUDIO_MDMA_COPY
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_COPY_MIN_DMA_LENGTH         64U  /* shorter copies are done by the CPU */
+
+/* Exported types ------------------------------------------------------------*/
+/* one MDMA channel per user, so the speaker and mic copies run together */
+typedef enum
+{
+  AUDIO_COPY_SPEAKER = 0,
+  AUDIO_COPY_MIC,
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+  AUDIO_COPY_DELAY,               /* blocks between the long delay windows and the PSRAM */
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+  AUDIO_COPY_ENGINE_COUNT
+}
+AUDIO_CopyEngineTypeDef;
+
+/* called once the data is copied, from the MDMA interrupt or from the caller
+   when the CPU did the copy */
+typedef void (*AUDIO_CopyCallbackTypeDef)(uint32_t private_data);
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_CopyInit(void);
+int8_t  AUDIO_CopyFromRegion(AUDIO_CopyEngineTypeDef engine, uint8_t* dst, AUDIO_BufferRegionTypeDef* region,
+                             AUDIO_CopyCallbackTypeDef callback, uint32_t private_data);
+int8_t  AUDIO_CopyToRegion(AUDIO_CopyEngineTypeDef engine, AUDIO_BufferRegionTypeDef* region, uint8_t* src,
+                           AUDIO_CopyCallbackTypeDef callback, uint32_t private_data);
+void    AUDIO_CopyWait(AUDIO_CopyEngineTypeDef engine);
+void    AUDIO_CopyAbort(AUDIO_CopyEngineTypeDef engine);
+void    AUDIO_CopyIRQHandler(void);
+#endif /* USE_AUDIO_MDMA_COPY */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_COPY_H */
@@ -0,0 +1,292 @@
+/**
+  ******************************************************************************
+  * @file    audio_cpu_load.c
+  * @brief   CPU budget of the 1 ms frames : at each ms SOF the cycles spent
+  *          since the previous one in the USB interrupt, the CDC, the
+  *          processing nodes and asleep are turned into permille of the
+  *          frame, averaged and peaked over a window. The cycle counter stops
+  *          while the core sleeps, so the idle time is the part of the frame
+  *          it didn't count, plus the cycles it counted in WFI when a
+  *          debugger keeps the core clock on in sleep
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_cpu_load.h"
+
+#ifdef USE_AUDIO_CPU_LOAD
+#include "stm32h7xx.h"
+#include "audio_profiler.h"
+#include "audio_sof_tick.h"
+
+#ifndef USE_AUDIO_PROFILER
+#error "USE_AUDIO_CPU_LOAD reads the USB interrupt and CDC probes, USE_AUDIO_PROFILER is required"
+#endif /* USE_AUDIO_PROFILER */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t          id;                   /* Process function */
+  volatile uint32_t cycles;               /* running total */
+  uint32_t          last;                 /* total at the last frame */
+  uint64_t          sum;                  /* cycles in the window */
+  uint16_t          peak;
+}
+AUDIO_CpuLoadNodeTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_CpuLoadNodeTypeDef load_nodes[AUDIO_CPU_LOAD_MAX_NODES];
+static volatile uint8_t  load_node_count;
+static volatile uint32_t load_nodes_cycles; /* all nodes, those without a slot included */
+static volatile uint32_t load_wfi_cycles;   /* counted in WFI */
+/* frame and window, from the SOF interrupt only */
+static uint32_t load_last_time;
+static uint32_t load_last_tick;
+static uint32_t load_last[AUDIO_CPU_LOAD_STAGE_COUNT];
+static uint64_t load_sum[AUDIO_CPU_LOAD_STAGE_COUNT];
+static uint16_t load_peak[AUDIO_CPU_LOAD_STAGE_COUNT];
+static uint64_t load_window_cycles;
+static uint32_t load_window_frames;
+static uint8_t  load_started;
+static AUDIO_CpuLoadReportTypeDef load_report;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_CpuLoadTick(uint32_t private_data);
+static void     AUDIO_CpuLoadSample(uint32_t* totals);
+static uint16_t AUDIO_CpuLoadPermille(uint32_t cycles, uint32_t frame_cycles);
+static void     AUDIO_CpuLoadEndWindow(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CpuLoadInit
+  *         clears the accounting and follows the SOF, after AUDIO_ProfilerInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CpuLoadInit(void)
+{
+  memset(load_nodes, 0, sizeof(load_nodes));
+  memset(&load_report, 0, sizeof(load_report));
+  load_node_count = 0;
+  load_started = 0;
+  AUDIO_SofTickSubscribe(AUDIO_CpuLoadTick, AUDIO_SOF_TICK_PER_MS, 0);
+}
+
+/**
+  * @brief  AUDIO_CpuLoadWfi
+  *         WFI of the main loop, interrupts must be masked so the handler
+  *         which wakes the core runs after the idle time is counted
+  * @param  None
+  * @retval None
+  */
+void AUDIO_CpuLoadWfi(void)
+{
+  uint32_t start = DWT->CYCCNT;
+
+  __WFI();
+  load_wfi_cycles += DWT->CYCCNT - start;
+}
+
+/**
+  * @brief  AUDIO_CpuLoadNode
+  *         adds the cycles of one Process call, from AUDIO_NodeProcessChain.
+  *         Nodes are told apart by their Process function
+  * @param  node: processing node
+  * @param  cycles: duration of the call
+  * @retval None
+  */
+void AUDIO_CpuLoadNode(AUDIO_NodeTypeDef* node, uint32_t cycles)
+{
+  uint32_t id = (uint32_t)((AUDIO_ProcessingNodeTypeDef*)node)->Process;
+  uint32_t primask;
+  uint8_t  i;
+
+  load_nodes_cycles += cycles;
+  for(i = 0; i < load_node_count; i++)
+  {
+    if(load_nodes[i].id == id)
+    {
+      load_nodes[i].cycles += cycles;
+      return;
+    }
+  }
+  /* chains run from the USB interrupt and the pump , a slot is added once */
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(i = 0; i < load_node_count; i++)
+  {
+    if(load_nodes[i].id == id)
+    {
+      break;
+    }
+  }
+  if(i == load_node_count)
+  {
+    if(i == AUDIO_CPU_LOAD_MAX_NODES)
+    {
+      __set_PRIMASK(primask);
+      return;
+    }
+    load_nodes[i].id = id;
+    load_node_count++;
+  }
+  load_nodes[i].cycles += cycles;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_CpuLoadGetReport
+  *         copies the last complete window
+  * @param  report: returned window
+  * @retval None
+  */
+void AUDIO_CpuLoadGetReport(AUDIO_CpuLoadReportTypeDef* report)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  *report = load_report;
+  __set_PRIMASK(primask);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_CpuLoadTick
+  *         ms SOF : accounts the frame since the previous one. The frame length
+  *         is the core clock over the elapsed SOF ms, lost SOF included
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_CpuLoadTick(uint32_t private_data)
+{
+  uint32_t totals[AUDIO_CPU_LOAD_STAGE_COUNT];
+  uint32_t now = DWT->CYCCNT;
+  uint32_t tick = AUDIO_SofTickGetCount();
+  uint32_t frame_cycles;
+  uint32_t counted;
+  uint32_t cycles;
+  uint16_t permille;
+  uint8_t  stage;
+  uint8_t  i;
+
+  AUDIO_CpuLoadSample(totals);
+  if(load_started)
+  {
+    frame_cycles = ((tick - load_last_tick) / AUDIO_SOF_TICK_PER_MS) * (SystemCoreClock / 1000U);
+    counted = now - load_last_time;
+    for(stage = 0; stage < AUDIO_CPU_LOAD_STAGE_COUNT; stage++)
+    {
+      cycles = totals[stage] - load_last[stage];
+      if(stage == AUDIO_CPU_LOAD_IDLE)
+      {
+        /* asleep with the core clock stopped */
+        cycles += (frame_cycles > counted) ? (frame_cycles - counted) : 0U;
+      }
+      /* a probe cleared by GET_PROFILE goes backward */
+      cycles = (cycles > frame_cycles) ? frame_cycles : cycles;
+      load_sum[stage] += cycles;
+      permille = AUDIO_CpuLoadPermille(cycles, frame_cycles);
+      load_peak[stage] = (permille > load_peak[stage]) ? permille : load_peak[stage];
+    }
+    for(i = 0; i < load_node_count; i++)
+    {
+      cycles = load_nodes[i].cycles - load_nodes[i].last;
+      load_nodes[i].last += cycles;
+      load_nodes[i].sum += cycles;
+      permille = AUDIO_CpuLoadPermille(cycles, frame_cycles);
+      load_nodes[i].peak = (permille > load_nodes[i].peak) ? permille : load_nodes[i].peak;
+    }
+    load_window_cycles += frame_cycles;
+    load_window_frames++;
+    if(load_window_frames >= AUDIO_CPU_LOAD_WINDOW_MS)
+    {
+      AUDIO_CpuLoadEndWindow();
+    }
+  }
+  else
+  {
+    for(i = 0; i < load_node_count; i++)
+    {
+      load_nodes[i].last = load_nodes[i].cycles;
+    }
+    load_started = 1;
+  }
+  load_last_time = now;
+  load_last_tick = tick;
+  memcpy(load_last, totals, sizeof(load_last));
+}
+
+/**
+  * @brief  AUDIO_CpuLoadSample
+  *         reads the running totals of the stages
+  * @param  totals: returned totals, wrapping cycles
+  * @retval None
+  */
+static void AUDIO_CpuLoadSample(uint32_t* totals)
+{
+  totals[AUDIO_CPU_LOAD_USB_ISR] = (uint32_t)audio_profiler_probes[AUDIO_PROF_PCD_IRQ].total;
+  totals[AUDIO_CPU_LOAD_CDC]     = (uint32_t)audio_profiler_probes[AUDIO_PROF_CDC_XFER].total;
+  totals[AUDIO_CPU_LOAD_NODES]   = load_nodes_cycles;
+  totals[AUDIO_CPU_LOAD_IDLE]    = load_wfi_cycles;
+}
+
+/**
+  * @brief  AUDIO_CpuLoadPermille
+  *         share of a frame
+  * @param  cycles: cycles of the stage
+  * @param  frame_cycles: cycles of the frame
+  * @retval permille, up to 1000
+  */
+static uint16_t AUDIO_CpuLoadPermille(uint32_t cycles, uint32_t frame_cycles)
+{
+  if(frame_cycles == 0U)
+  {
+    return 0;
+  }
+  cycles = (cycles > frame_cycles) ? frame_cycles : cycles;
+  return (uint16_t)(((uint64_t)cycles * 1000U) / frame_cycles);
+}
+
+/**
+  * @brief  AUDIO_CpuLoadEndWindow
+  *         publishes the window and starts the next one
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_CpuLoadEndWindow(void)
+{
+  uint8_t stage;
+  uint8_t i;
+
+  load_report.frames = load_window_frames;
+  for(stage = 0; stage < AUDIO_CPU_LOAD_STAGE_COUNT; stage++)
+  {
+    load_report.stage[stage].avg  = (uint16_t)((load_sum[stage] * 1000U) / load_window_cycles);
+    load_report.stage[stage].peak = load_peak[stage];
+    load_sum[stage] = 0;
+    load_peak[stage] = 0;
+  }
+  load_report.nodes = load_node_count;
+  for(i = 0; i < load_node_count; i++)
+  {
+    load_report.node_id[i]   = load_nodes[i].id;
+    load_report.node[i].avg  = (uint16_t)((load_nodes[i].sum * 1000U) / load_window_cycles);
+    load_report.node[i].peak = load_nodes[i].peak;
+    load_nodes[i].sum = 0;
+    load_nodes[i].peak = 0;
+  }
+  load_window_cycles = 0;
+  load_window_frames = 0;
+}
+#endif /* USE_AUDIO_CPU_LOAD */
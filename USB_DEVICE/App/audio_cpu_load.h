@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    audio_cpu_load.h
+  * @brief   header file for the audio_cpu_load.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_CPU_LOAD_H
+#define __AUDIO_CPU_LOAD_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+#ifdef USE_AUDIO_CPU_LOAD
+/* Exported constants --------------------------------------------------------*/
+/* stages, in permille of the 1 ms frames. The CDC and the nodes run inside the
+   USB interrupt or the pump , the rest of the frame is the pump and the other
+   interrupts */
+#define AUDIO_CPU_LOAD_USB_ISR            0U /* OTG_HS interrupt, AUDIO_PROF_PCD_IRQ */
+#define AUDIO_CPU_LOAD_CDC                1U /* CDC transfer callbacks, AUDIO_PROF_CDC_XFER */
+#define AUDIO_CPU_LOAD_NODES              2U /* all processing nodes */
+#define AUDIO_CPU_LOAD_IDLE               3U /* main loop asleep in WFI */
+#define AUDIO_CPU_LOAD_STAGE_COUNT        4U
+
+#define AUDIO_CPU_LOAD_MAX_NODES          6U  /* processing node types accounted separately */
+#ifndef AUDIO_CPU_LOAD_WINDOW_MS
+#define AUDIO_CPU_LOAD_WINDOW_MS          1000U
+#endif /* AUDIO_CPU_LOAD_WINDOW_MS */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint16_t avg;                           /* permille of the window */
+  uint16_t peak;                          /* permille of the busiest frame */
+}
+AUDIO_CpuLoadValueTypeDef;
+
+/* last complete window */
+typedef struct
+{
+  uint32_t                  frames;
+  AUDIO_CpuLoadValueTypeDef stage[AUDIO_CPU_LOAD_STAGE_COUNT];
+  uint8_t                   nodes;
+  uint32_t                  node_id[AUDIO_CPU_LOAD_MAX_NODES]; /* Process function, found in the map file */
+  AUDIO_CpuLoadValueTypeDef node[AUDIO_CPU_LOAD_MAX_NODES];
+}
+AUDIO_CpuLoadReportTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_CpuLoadInit(void);
+void    AUDIO_CpuLoadWfi(void);
+void    AUDIO_CpuLoadGetReport(AUDIO_CpuLoadReportTypeDef* report);
+#endif /* USE_AUDIO_CPU_LOAD */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_CPU_LOAD_H */
@@ -0,0 +1,215 @@
+/**
+  ******************************************************************************
+  * @file    audio_decimator.c
+  * @brief   FIR decimator : the mic stream is brought down to the voice rate
+  *          by an integer factor, 48 kHz to 16 kHz by 3. A Blackman windowed
+  *          sinc of 96 taps at the input rate cuts at 0.85 of the output
+  *          Nyquist rate, only the kept frames are filtered. Samples are
+  *          filtered on 16 bits, the voice stream resolution.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_decimator.h"
+#include "audio_pcm.h"
+
+#ifdef USE_AUDIO_RECORDING_VOICE
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_DECIMATOR_CUTOFF            0.85f /* of the output Nyquist rate */
+#define AUDIO_DECIMATOR_COEF_FRAC_BITS    15U   /* Q15 taps */
+
+#if AUDIO_DECIMATOR_TAPS > 128U
+#error "AUDIO_DECIMATOR_TAPS must fit the uint8_t history index"
+#endif /* AUDIO_DECIMATOR_TAPS */
+
+/* Private variables ---------------------------------------------------------*/
+/* taps of the current factor, from the oldest input frame. Read for every
+   output frame so kept in DTCM */
+__ALIGN_BEGIN static int16_t decimator_coeffs[AUDIO_DECIMATOR_TAPS] __ALIGN_END USBD_DTCM_BSS;
+static uint8_t decimator_coeffs_factor = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_DecimatorBuildCoeffs(uint8_t factor);
+static int16_t AUDIO_DecimatorLoadSample(const AUDIO_BufferRegionTypeDef* input, uint32_t offset,
+                                         uint8_t res) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_DecimatorInit
+  *         Initializes the conversion of a stream, history is silence. The
+  *         taps are computed when the factor changes
+  * @param  decimator: decimator to initialize
+  * @param  in_rate: mic rate
+  * @param  out_rate: voice rate, the factor is 0 when it doesn't divide in_rate
+  * @param  channels: channels count , at most AUDIO_DECIMATOR_MAX_CHANNELS
+  * @retval None
+  */
+void  AUDIO_DecimatorInit(AUDIO_DecimatorTypeDef* decimator, uint32_t in_rate, uint32_t out_rate,
+                          uint8_t channels)
+{
+  memset(decimator, 0, sizeof(AUDIO_DecimatorTypeDef));
+  decimator->in_rate = in_rate;
+  decimator->channels = (channels > AUDIO_DECIMATOR_MAX_CHANNELS) ? AUDIO_DECIMATOR_MAX_CHANNELS : channels;
+  if((out_rate != 0U) && (in_rate >= out_rate) && ((in_rate % out_rate) == 0U) && ((in_rate / out_rate) <= 0xFFU))
+  {
+    decimator->factor = (uint8_t)(in_rate / out_rate);
+  }
+  if((decimator->factor > 1U) && (decimator->factor != decimator_coeffs_factor))
+  {
+    AUDIO_DecimatorBuildCoeffs(decimator->factor);
+    decimator_coeffs_factor = decimator->factor;
+  }
+}
+
+/**
+  * @brief  AUDIO_DecimatorOutputFrames
+  *         output frames the next AUDIO_DecimatorProcess call produces
+  * @param  decimator: decimator
+  * @param  input_frames: count of frames to filter
+  * @retval output frames count
+  */
+uint32_t  AUDIO_DecimatorOutputFrames(const AUDIO_DecimatorTypeDef* decimator, uint32_t input_frames)
+{
+  if(decimator->factor == 0U)
+  {
+    return 0;
+  }
+  return (decimator->phase + input_frames) / decimator->factor;
+}
+
+/**
+  * @brief  AUDIO_DecimatorProcess
+  *         Filters input_frames frames and writes the kept ones as 16 bits
+  *         samples
+  * @param  decimator: decimator
+  * @param  input: input frames
+  * @param  input_frames: count of frames to filter
+  * @param  res: bytes per input sample , 2, 3 or 4
+  * @param  output: output region, holds AUDIO_DecimatorOutputFrames frames
+  * @retval written output frames
+  */
+uint32_t  AUDIO_DecimatorProcess(AUDIO_DecimatorTypeDef* decimator, const AUDIO_BufferRegionTypeDef* input,
+                                 uint32_t input_frames, uint8_t res,
+                                 const AUDIO_BufferRegionTypeDef* output)
+{
+  uint32_t in_frame_size = decimator->channels * res;
+  uint32_t out_offset = 0;
+  uint32_t frames = 0;
+  const int16_t* window;
+  int16_t  sample;
+  int32_t  acc;
+  uint32_t frame, ch, j;
+
+  if(decimator->factor == 0U)
+  {
+    return 0;
+  }
+  for(frame = 0; frame < input_frames; frame++)
+  {
+    if(decimator->factor == 1U)
+    {
+      /* same rate, only the resolution changes */
+      for(ch = 0; ch < decimator->channels; ch++)
+      {
+        sample = AUDIO_DecimatorLoadSample(input, frame * in_frame_size + ch * res, res);
+        AUDIO_PcmRegionWrite(output, out_offset, sample, 2U);
+        out_offset += 2U;
+      }
+      frames++;
+      continue;
+    }
+    for(ch = 0; ch < decimator->channels; ch++)
+    {
+      sample = AUDIO_DecimatorLoadSample(input, frame * in_frame_size + ch * res, res);
+      decimator->history[ch][decimator->pos] = sample;
+      decimator->history[ch][decimator->pos + AUDIO_DECIMATOR_TAPS] = sample;
+    }
+    decimator->pos = (decimator->pos + 1U == AUDIO_DECIMATOR_TAPS) ? 0U : decimator->pos + 1U;
+    if(++decimator->phase < decimator->factor)
+    {
+      continue;
+    }
+    decimator->phase = 0;
+    for(ch = 0; ch < decimator->channels; ch++)
+    {
+      /* the sum of the taps magnitudes stays below 2 : no overflow on 32 bits */
+      window = &decimator->history[ch][decimator->pos];
+      acc = 0;
+      for(j = 0; j < AUDIO_DECIMATOR_TAPS; j++)
+      {
+        acc += (int32_t)window[j] * decimator_coeffs[j];
+      }
+      acc = (acc + (1 << (AUDIO_DECIMATOR_COEF_FRAC_BITS - 1U))) >> AUDIO_DECIMATOR_COEF_FRAC_BITS;
+      if(acc > INT16_MAX)
+      {
+        acc = INT16_MAX;
+      }
+      if(acc < INT16_MIN)
+      {
+        acc = INT16_MIN;
+      }
+      AUDIO_PcmRegionWrite(output, out_offset, acc, 2U);
+      out_offset += 2U;
+    }
+    frames++;
+  }
+  return frames;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_DecimatorBuildCoeffs
+  *         computes the taps of a factor, normalized to a unity DC gain
+  * @param  factor: decimation factor, at least 2
+  * @retval None
+  */
+static void  AUDIO_DecimatorBuildCoeffs(uint8_t factor)
+{
+  float taps[AUDIO_DECIMATOR_TAPS];
+  float sum = 0.0f;
+  float t, w, x;
+  uint32_t j;
+
+  for(j = 0; j < AUDIO_DECIMATOR_TAPS; j++)
+  {
+    /* distance to the filter center, in input frames */
+    t = (float)j - (float)(AUDIO_DECIMATOR_TAPS - 1U) / 2.0f;
+    w = 0.42f + 0.5f * cosf(2.0f * (float)M_PI * t / (float)AUDIO_DECIMATOR_TAPS) +
+        0.08f * cosf(4.0f * (float)M_PI * t / (float)AUDIO_DECIMATOR_TAPS);
+    x = (float)M_PI * AUDIO_DECIMATOR_CUTOFF * t / (float)factor;
+    taps[j] = (x == 0.0f) ? w : (w * sinf(x) / x);
+    sum += taps[j];
+  }
+  for(j = 0; j < AUDIO_DECIMATOR_TAPS; j++)
+  {
+    decimator_coeffs[j] = (int16_t)lroundf(taps[j] * (float)(1U << AUDIO_DECIMATOR_COEF_FRAC_BITS) / sum);
+  }
+}
+
+/**
+  * @brief  AUDIO_DecimatorLoadSample
+  *         reads a sample of the input, a sample may be split by the ring
+  *         end. Samples are scaled to 16 bits
+  * @param  input: input frames
+  * @param  offset: byte offset of the sample in the input
+  * @param  res: bytes per sample
+  * @retval sample value
+  */
+static int16_t  AUDIO_DecimatorLoadSample(const AUDIO_BufferRegionTypeDef* input, uint32_t offset, uint8_t res)
+{
+  return (int16_t)(AUDIO_PcmRegionRead(input, offset, res) >> (8U * (res - 2U)));
+}
+#endif /* USE_AUDIO_RECORDING_VOICE */
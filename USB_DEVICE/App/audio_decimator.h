@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    audio_decimator.h
+  * @brief   header file for the audio_decimator.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_DECIMATOR_H
+#define __AUDIO_DECIMATOR_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+#include "audio_node.h"
+
+#ifdef USE_AUDIO_RECORDING_VOICE
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_DECIMATOR_TAPS              96U  /* input frames per output frame, 2 ms at 48 kHz */
+#define AUDIO_DECIMATOR_MAX_CHANNELS      8U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t  in_rate;
+  uint8_t   factor;     /* input frames per output frame, 0 when the rates have no integer ratio */
+  uint8_t   channels;
+  uint8_t   phase;      /* input frames received since the last output frame */
+  uint8_t   pos;        /* next write index in history */
+  int16_t   history[AUDIO_DECIMATOR_MAX_CHANNELS][2U * AUDIO_DECIMATOR_TAPS]; /* written twice, the window is contiguous */
+}
+AUDIO_DecimatorTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void      AUDIO_DecimatorInit(AUDIO_DecimatorTypeDef* decimator, uint32_t in_rate, uint32_t out_rate,
+                              uint8_t channels);
+uint32_t  AUDIO_DecimatorOutputFrames(const AUDIO_DecimatorTypeDef* decimator, uint32_t input_frames);
+uint32_t  AUDIO_DecimatorProcess(AUDIO_DecimatorTypeDef* decimator, const AUDIO_BufferRegionTypeDef* input,
+                                 uint32_t input_frames, uint8_t res,
+                                 const AUDIO_BufferRegionTypeDef* output) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_RECORDING_VOICE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_DECIMATOR_H */
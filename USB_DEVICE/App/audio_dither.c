@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    audio_dither.c
+  * @brief   Word length reduction : 24 bits samples are brought to 16 bits
+  *          with TPDF dither and noise shaping instead of being truncated, so
+  *          the requantization error is a benign noise and not a distortion
+  *          of the quiet passages. One xorshift LFSR and one error per channel,
+  *          16 bits stereo frames are written one word at a time.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_dither.h"
+
+#ifdef USE_AUDIO_DITHER
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_DITHER_SEED_STEP            0x9E3779B9U /* channels draw from distinct sequences */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_DitherInit
+  *         Initializes the dither of a stream, errors are cleared
+  * @param  dither: dither to initialize
+  * @param  channels: channels count , at most AUDIO_DITHER_MAX_CHANNELS
+  * @retval None
+  */
+void  AUDIO_DitherInit(AUDIO_DitherTypeDef* dither, uint8_t channels)
+{
+  uint8_t ch;
+
+  memset(dither, 0, sizeof(AUDIO_DitherTypeDef));
+  dither->channels = (channels > AUDIO_DITHER_MAX_CHANNELS) ? AUDIO_DITHER_MAX_CHANNELS : channels;
+  for(ch = 0; ch < AUDIO_DITHER_MAX_CHANNELS; ch++)
+  {
+    dither->channel[ch].seed = AUDIO_DITHER_SEED_STEP * (ch + 1U);
+  }
+}
+
+/**
+  * @brief  AUDIO_DitherReduce16
+  *         reduces interleaved 24 bits right aligned samples to 16 bits.
+  *         Output may be the input, the samples don't grow
+  * @param  dither: dither of the stream
+  * @param  in: 24 bits samples
+  * @param  out: 16 bits samples
+  * @param  samples: samples of all channels, a multiple of the channels count
+  * @retval None
+  */
+void  AUDIO_DitherReduce16(AUDIO_DitherTypeDef* dither, const int32_t* in, int16_t* out, uint32_t samples)
+{
+  AUDIO_DitherChannelTypeDef* channel = dither->channel;
+  uint8_t  channels = dither->channels;
+  uint8_t  ch = 0;
+  int16_t  left, right;
+  uint32_t i;
+
+  if((channels % 2U) == 0U)
+  {
+    /* a channel pair per word */
+    for(i = 0; i < samples; i += 2U)
+    {
+      left = AUDIO_DitherSample16(&channel[ch], in[i]);
+      right = AUDIO_DitherSample16(&channel[ch + 1U], in[i + 1U]);
+      __UNALIGNED_UINT32_WRITE(&out[i], __PKHBT((uint32_t)(uint16_t)left, (uint32_t)right, 16));
+      ch = (ch + 2U == channels) ? 0U : ch + 2U;
+    }
+    return;
+  }
+  for(i = 0; i < samples; i++)
+  {
+    out[i] = AUDIO_DitherSample16(&channel[ch], in[i]);
+    ch = (ch + 1U == channels) ? 0U : ch + 1U;
+  }
+}
+#endif /* USE_AUDIO_DITHER */
@@ -0,0 +1,90 @@
+/**
+  ******************************************************************************
+  * @file    audio_dither.h
+  * @brief   header file for the audio_dither.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_DITHER_H
+#define __AUDIO_DITHER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_DITHER
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_DITHER_MAX_CHANNELS         8U
+#define AUDIO_DITHER_SHIFT                8U  /* 24 bits to 16 bits */
+#define AUDIO_DITHER_ERROR_BITS           10U /* fed back error is bounded to 2 LSB, a clipped sample can't run away */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t  seed;       /* xorshift LFSR state , never 0 */
+  int32_t   error;      /* last quantization error, in 24 bits LSB */
+}
+AUDIO_DitherChannelTypeDef;
+
+typedef struct
+{
+  AUDIO_DitherChannelTypeDef channel[AUDIO_DITHER_MAX_CHANNELS];
+  uint8_t   channels;
+}
+AUDIO_DitherTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_DitherInit(AUDIO_DitherTypeDef* dither, uint8_t channels);
+void  AUDIO_DitherReduce16(AUDIO_DitherTypeDef* dither, const int32_t* in, int16_t* out, uint32_t samples) USBD_ITCM_FUNC;
+
+/**
+  * @brief  AUDIO_DitherSample16
+  *         reduces a 24 bits sample to 16 bits : TPDF dither of 2 LSB peak
+  *         to peak, from the two low bytes of the LFSR, and first order error
+  *         feedback, which moves the requantization noise up to the top of the
+  *         band. Digital silence stays silent, muted channels aren't hissing
+  * @param  channel: dither state of the sample channel
+  * @param  sample: 24 bits sample
+  * @retval 16 bits sample
+  */
+__STATIC_INLINE int16_t AUDIO_DitherSample16(AUDIO_DitherChannelTypeDef* channel, int32_t sample)
+{
+  uint32_t seed = channel->seed;
+  int32_t  w, y;
+
+  if(sample == 0)
+  {
+    channel->error = 0;
+    return 0;
+  }
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  channel->seed = seed;
+  w = sample - channel->error;
+  y = __SSAT((w + (int32_t)(seed & 0xFFU) - (int32_t)((seed >> 8) & 0xFFU) +
+              (1 << (AUDIO_DITHER_SHIFT - 1U))) >> AUDIO_DITHER_SHIFT, 16);
+  channel->error = __SSAT((y << AUDIO_DITHER_SHIFT) - w, AUDIO_DITHER_ERROR_BITS);
+  return (int16_t)y;
+}
+#endif /* USE_AUDIO_DITHER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_DITHER_H */
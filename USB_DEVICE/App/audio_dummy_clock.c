@@ -0,0 +1,268 @@
+/**
+  ******************************************************************************
+  * @file    audio_dummy_clock.c
+  * @brief   Simulated device clock of the dummy speaker and mic : the nodes
+  *          consume and produce at a programmable ppm offset of SysTick, in
+  *          place of the pace of the USB packets. The host then sees the drift
+  *          of a real DAC or ADC, so the playback feedback and the recording
+  *          synchro can be exercised without an external codec. Rate errors
+  *          and ring excursions of the run are reported.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_dummy_clock.h"
+
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "usb_audio_user.h"
+#include "usbd_audio.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_CDC_COMMAND
+#include "usbd_audio_if.h"
+#endif /* USE_AUDIO_CDC_COMMAND */
+
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) && (!defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_DUMMY_CLOCK paces the dummy nodes, USE_AUDIO_SPEAKER_DUMMY or USE_AUDIO_DUMMY_MIC is required"
+#endif /* USE_AUDIO_SPEAKER_DUMMY || USE_AUDIO_DUMMY_MIC */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_DUMMY_CLOCK_ONE_MS          (1UL << AUDIO_DUMMY_CLOCK_FRAC_BITS)
+
+/* Private variables ---------------------------------------------------------*/
+/* written by SysTick only */
+static volatile uint32_t clock_now;       /* device ms, free running */
+static volatile uint32_t clock_ticks;     /* SysTick ms since the offset change */
+static uint32_t clock_step;              /* device ms per SysTick ms */
+/* written by the pump only */
+static uint32_t clock_used[AUDIO_DUMMY_CLOCK_DIR_COUNT];  /* device ms spent per direction, free running */
+static uint32_t clock_frames[AUDIO_DUMMY_CLOCK_DIR_COUNT];
+static uint32_t clock_freq[AUDIO_DUMMY_CLOCK_DIR_COUNT];  /* rate of the last packet */
+static int32_t  clock_ppm = 0;
+#ifdef USE_AUDIO_FAULT_INJECTION
+static int32_t  clock_skew[AUDIO_DUMMY_CLOCK_DIR_COUNT]; /* direction rate on top of the offset, ppm */
+#endif /* USE_AUDIO_FAULT_INJECTION */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t AUDIO_DummyClockCost(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc);
+static int32_t  AUDIO_DummyClockRateError(AUDIO_DummyClockDirTypeDef dir, uint32_t elapsed_ms);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_DummyClockInit
+  *         starts the clock without offset, must be called before SysTick
+  *         calls AUDIO_DummyClockTick
+  * @param  None
+  * @retval None
+  */
+void AUDIO_DummyClockInit(void)
+{
+  AUDIO_DummyClockSetPpm(0);
+}
+
+/**
+  * @brief  AUDIO_DummyClockSetPpm
+  *         sets the offset of the device clock and clears the measures. Must
+  *         be called from the pump
+  * @param  ppm: offset, positive when the device runs faster than SysTick
+  * @retval 0 if no error
+  */
+int8_t AUDIO_DummyClockSetPpm(int32_t ppm)
+{
+  uint32_t primask;
+  uint8_t  dir;
+
+  if((ppm > AUDIO_DUMMY_CLOCK_MAX_PPM) || (ppm < -AUDIO_DUMMY_CLOCK_MAX_PPM))
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  clock_step = (uint32_t)((int32_t)AUDIO_DUMMY_CLOCK_ONE_MS +
+                          (int32_t)(((int64_t)ppm << AUDIO_DUMMY_CLOCK_FRAC_BITS) / 1000000));
+  clock_ticks = 0;
+  for(dir = 0; dir < AUDIO_DUMMY_CLOCK_DIR_COUNT; dir++)
+  {
+    clock_used[dir] = clock_now;
+    clock_frames[dir] = 0;
+  }
+  clock_ppm = ppm;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_DummyClockTick
+  *         advances the device clock, called each SysTick ms
+  * @param  None
+  * @retval None
+  */
+void AUDIO_DummyClockTick(void)
+{
+  clock_now += clock_step;
+  clock_ticks++;
+  AUDIO_PumpPost(AUDIO_PUMP_SPEAKER_DATA | AUDIO_PUMP_MIC_SPACE);
+}
+
+/**
+  * @brief  AUDIO_DummyClockIsDue
+  *         tells if the device clock reached the time of a packet. A direction
+  *         which was stalled catches up AUDIO_DUMMY_CLOCK_MAX_BACKLOG_MS at most
+  * @param  dir: speaker or mic
+  * @param  length: packet length in bytes
+  * @param  audio_desc: stream format of the packet
+  * @retval 1 if the packet can be consumed or produced
+  */
+uint8_t AUDIO_DummyClockIsDue(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc)
+{
+  uint32_t now = clock_now;
+
+  if((now - clock_used[dir]) > (AUDIO_DUMMY_CLOCK_MAX_BACKLOG_MS * AUDIO_DUMMY_CLOCK_ONE_MS))
+  {
+    clock_used[dir] = now - (AUDIO_DUMMY_CLOCK_MAX_BACKLOG_MS * AUDIO_DUMMY_CLOCK_ONE_MS);
+  }
+  return ((now - clock_used[dir]) >= AUDIO_DummyClockCost(dir, length, audio_desc)) ? 1U : 0U;
+}
+
+/**
+  * @brief  AUDIO_DummyClockConsume
+  *         spends the device time of a packet consumed or produced
+  * @param  dir: speaker or mic
+  * @param  length: packet length in bytes
+  * @param  audio_desc: stream format of the packet
+  * @retval None
+  */
+void AUDIO_DummyClockConsume(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc)
+{
+  clock_used[dir] += AUDIO_DummyClockCost(dir, length, audio_desc);
+  clock_frames[dir] += length / AUDIO_SAMPLE_LENGTH(audio_desc);
+  clock_freq[dir] = audio_desc->frequence;
+}
+
+/**
+  * @brief  AUDIO_DummyClockGetStats
+  *         reports the run since the last offset change. Feedback and ring
+  *         excursions are read from the sessions with USE_AUDIO_CDC_COMMAND
+  *         only. Must be called from the pump
+  * @param  stats: run report
+  * @retval None
+  */
+void AUDIO_DummyClockGetStats(AUDIO_DummyClockStatsTypeDef* stats)
+{
+#ifdef USE_AUDIO_CDC_COMMAND
+  AUDIO_USB_SessionStatsTypeDef session;
+#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  uint32_t nominal;
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#endif /* USE_AUDIO_CDC_COMMAND */
+  uint8_t dir;
+
+  memset(stats, 0, sizeof(AUDIO_DummyClockStatsTypeDef));
+  stats->ppm = clock_ppm;
+  stats->elapsed_ms = clock_ticks;
+  for(dir = 0; dir < AUDIO_DUMMY_CLOCK_DIR_COUNT; dir++)
+  {
+    stats->frames[dir] = clock_frames[dir];
+    stats->rate_error[dir] = AUDIO_DummyClockRateError((AUDIO_DummyClockDirTypeDef)dir, stats->elapsed_ms);
+  }
+  stats->feedback_error = AUDIO_DUMMY_CLOCK_RATE_NONE;
+#ifdef USE_AUDIO_CDC_COMMAND
+  if(USBD_AUDIO_GetSessionStats(USBD_AUDIO_PLAYBACK, &session) == 0)
+  {
+#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
+    nominal = session.audio_description.frequence;
+    if((session.feedback != 0U) && (nominal != 0U))
+    {
+      /* feedback is Hz with AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits */
+      stats->feedback_error = (int32_t)(((int64_t)session.feedback * 1000000) /
+                                        ((int64_t)nominal << AUDIO_FEEDBACK_RATE_FRAC_BITS)) - 1000000 - clock_ppm;
+    }
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+    stats->fill_min[AUDIO_DUMMY_CLOCK_SPEAKER] = (session.fill.fill_min == UINT32_MAX) ? 0U : session.fill.fill_min;
+    stats->fill_max[AUDIO_DUMMY_CLOCK_SPEAKER] = session.fill.fill_max;
+  }
+  if(USBD_AUDIO_GetSessionStats(USBD_AUDIO_RECORD, &session) == 0)
+  {
+    stats->fill_min[AUDIO_DUMMY_CLOCK_MIC] = (session.fill.fill_min == UINT32_MAX) ? 0U : session.fill.fill_min;
+    stats->fill_max[AUDIO_DUMMY_CLOCK_MIC] = session.fill.fill_max;
+  }
+#endif /* USE_AUDIO_CDC_COMMAND */
+}
+
+#ifdef USE_AUDIO_FAULT_INJECTION
+/**
+  * @brief  AUDIO_DummyClockSetSkew
+  *         skews one direction against the other, the measures keep running.
+  *         Must be called from the pump
+  * @param  dir: speaker or mic
+  * @param  ppm: skew, positive when the direction runs faster
+  * @retval 0 if no error
+  */
+int8_t AUDIO_DummyClockSetSkew(AUDIO_DummyClockDirTypeDef dir, int32_t ppm)
+{
+  if((dir >= AUDIO_DUMMY_CLOCK_DIR_COUNT) || (ppm > AUDIO_DUMMY_CLOCK_MAX_PPM) || (ppm < -AUDIO_DUMMY_CLOCK_MAX_PPM))
+  {
+    return -1;
+  }
+  clock_skew[dir] = ppm;
+  return 0;
+}
+#endif /* USE_AUDIO_FAULT_INJECTION */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_DummyClockCost
+  *         device time of a packet
+  * @param  dir: speaker or mic
+  * @param  length: packet length in bytes
+  * @param  audio_desc: stream format of the packet
+  * @retval device ms with AUDIO_DUMMY_CLOCK_FRAC_BITS fractional bits
+  */
+static uint32_t AUDIO_DummyClockCost(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc)
+{
+  uint32_t frames = length / AUDIO_SAMPLE_LENGTH(audio_desc);
+  uint64_t cost = (((uint64_t)frames * 1000U) << AUDIO_DUMMY_CLOCK_FRAC_BITS) / audio_desc->frequence;
+
+#ifdef USE_AUDIO_FAULT_INJECTION
+  if(clock_skew[dir] != 0)
+  {
+    cost = (cost * 1000000U) / (uint32_t)(1000000 + clock_skew[dir]);
+  }
+#else /* USE_AUDIO_FAULT_INJECTION */
+  (void)dir;
+#endif /* USE_AUDIO_FAULT_INJECTION */
+  return (uint32_t)cost;
+}
+
+/**
+  * @brief  AUDIO_DummyClockRateError
+  *         rate measured on a direction against SysTick, minus the configured offset
+  * @param  dir: speaker or mic
+  * @param  elapsed_ms: SysTick ms of the run
+  * @retval error in ppm, AUDIO_DUMMY_CLOCK_RATE_NONE if the direction didn't run
+  */
+static int32_t AUDIO_DummyClockRateError(AUDIO_DummyClockDirTypeDef dir, uint32_t elapsed_ms)
+{
+  if((elapsed_ms == 0U) || (clock_frames[dir] == 0U) || (clock_freq[dir] == 0U))
+  {
+    return AUDIO_DUMMY_CLOCK_RATE_NONE;
+  }
+#ifdef USE_AUDIO_FAULT_INJECTION
+  return (int32_t)(((int64_t)clock_frames[dir] * 1000000000LL) / ((int64_t)elapsed_ms * clock_freq[dir]))
+         - 1000000 - clock_ppm - clock_skew[dir];
+#else /* USE_AUDIO_FAULT_INJECTION */
+  return (int32_t)(((int64_t)clock_frames[dir] * 1000000000LL) / ((int64_t)elapsed_ms * clock_freq[dir]))
+         - 1000000 - clock_ppm;
+#endif /* USE_AUDIO_FAULT_INJECTION */
+}
+#endif /* USE_AUDIO_DUMMY_CLOCK */
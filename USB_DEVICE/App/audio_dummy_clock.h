@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file    audio_dummy_clock.h
+  * @brief   header file for the audio_dummy_clock.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_DUMMY_CLOCK_H
+#define __AUDIO_DUMMY_CLOCK_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+#ifdef USE_AUDIO_DUMMY_CLOCK
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_DUMMY_CLOCK_MAX_PPM         2000   /* offset range, both ways */
+#define AUDIO_DUMMY_CLOCK_FRAC_BITS       24U    /* device ms are counted with 24 fractional bits */
+#define AUDIO_DUMMY_CLOCK_MAX_BACKLOG_MS  4U     /* time a stalled direction can catch up */
+#define AUDIO_DUMMY_CLOCK_RATE_NONE       INT32_MIN /* rate error not measured */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_DUMMY_CLOCK_SPEAKER = 0,
+  AUDIO_DUMMY_CLOCK_MIC,
+  AUDIO_DUMMY_CLOCK_DIR_COUNT
+}
+AUDIO_DummyClockDirTypeDef;
+
+/* run since the last offset change , rate errors in ppm of the nominal rate */
+typedef struct
+{
+  int32_t  ppm;                   /* configured offset */
+  uint32_t elapsed_ms;            /* SysTick ms */
+  uint32_t frames[AUDIO_DUMMY_CLOCK_DIR_COUNT];     /* frames consumed by the speaker, produced by the mic */
+  int32_t  rate_error[AUDIO_DUMMY_CLOCK_DIR_COUNT]; /* measured offset minus the configured one */
+  int32_t  feedback_error;        /* feedback sent to host minus the speaker rate */
+  uint32_t fill_min[AUDIO_DUMMY_CLOCK_DIR_COUNT];   /* ring excursions seen by the USB nodes since the session start */
+  uint32_t fill_max[AUDIO_DUMMY_CLOCK_DIR_COUNT];
+}
+AUDIO_DummyClockStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_DummyClockInit(void);
+int8_t  AUDIO_DummyClockSetPpm(int32_t ppm);
+void    AUDIO_DummyClockTick(void);
+uint8_t AUDIO_DummyClockIsDue(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc);
+void    AUDIO_DummyClockConsume(AUDIO_DummyClockDirTypeDef dir, uint32_t length, AUDIO_DescriptionTypeDef* audio_desc);
+void    AUDIO_DummyClockGetStats(AUDIO_DummyClockStatsTypeDef* stats);
+#ifdef USE_AUDIO_FAULT_INJECTION
+int8_t  AUDIO_DummyClockSetSkew(AUDIO_DummyClockDirTypeDef dir, int32_t ppm);
+#endif /* USE_AUDIO_FAULT_INJECTION */
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_DUMMY_CLOCK_H */
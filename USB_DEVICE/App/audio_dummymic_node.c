@@ -51,8 +51,19 @@
 #include "usbd_audio.h"
 #include "audio_mic_node.h"
 #include "usb_audio_user.h"
+#include "audio_tap.h"
+#include "audio_snapshot.h"
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_MIC_PATTERN
+#include "audio_pattern.h"
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
 
-
+#ifdef USE_AUDIO_DUMMY_MIC
 
 /* Private defines -----------------------------------------------------------*/
 #define DUMMY_MIC_VOLUME_RES_DB_256     256 /* 1 db 1 * 256 = 256*/ 
@@ -219,7 +230,10 @@ static int8_t  AUDIO_MicMute(uint16_t channel_number, uint8_t mute, uint32_t nod
   */
 static int8_t  AUDIO_MicSetVolume( uint16_t channel_number,  int volume_db_256 ,  uint32_t node_handle)
 {
-  ((AUDIO_Mic_NodeTypeDef*)node_handle)->volume = volume_db_256;
+  if(channel_number == 0)
+  {
+    ((AUDIO_Mic_NodeTypeDef*)node_handle)->volume = volume_db_256;
+  }
     
   /* @TO ADD set volume function here */
   
@@ -244,33 +258,126 @@ static int8_t  AUDIO_MicGetVolumeDefaultsValues( int* vol_max, int* vol_min, int
 }
 
 uint32_t AUDIO_GetPacketLength(){
-    if ((micStart==1)&&(current_mic->node.state == AUDIO_NODE_STARTED)){
+    if ((micStart==1)&&(current_mic)&&(current_mic->node.state == AUDIO_NODE_STARTED)){
         if ( AUDIO_BUFFER_FREE_SIZE(current_mic->buf)>current_mic->packet_length)
         {
+#ifdef USE_AUDIO_DUMMY_CLOCK
+          /* recorded at the pace of the simulated device clock */
+          if(!AUDIO_DummyClockIsDue(AUDIO_DUMMY_CLOCK_MIC, current_mic->packet_length,
+                                    current_mic->node.audio_description))
+          {
+            return 0;
+          }
+#endif /* USE_AUDIO_DUMMY_CLOCK */
           return current_mic->packet_length;
         }
     }
       return 0;
 }
 
-uint32_t AUDIO_SendINData(uint8_t* buffer,uint32_t length){
-  if (current_mic->node.state == AUDIO_NODE_STARTED)
+/**
+  * @brief  AUDIO_ReserveINData
+  *         reserve room for next packet in the mic buffer so samples are rendered in place,
+  *         the packet is published by AUDIO_CommitINData
+  * @param  region: returned packet area , split in two parts when it wraps in the buffer
+  * @retval reserved bytes , 0 if mic is not started
+  */
+uint32_t AUDIO_ReserveINData(AUDIO_BufferRegionTypeDef* region)
+{
+  if ((current_mic)&&(current_mic->node.state == AUDIO_NODE_STARTED))
   {
-	uint16_t wr_distance ;
+	uint32_t wr_distance ;
     wr_distance = AUDIO_BUFFER_FREE_SIZE(current_mic->buf);
-    if (wr_distance <= current_mic->packet_length)
+    if ((wr_distance <= current_mic->packet_length) &&
+        (AUDIO_SESSION_SUBSCRIBED(current_mic->node.session_handle, AUDIO_OVERRUN)))
     {
       current_mic->node.session_handle->SessionCallback(AUDIO_OVERRUN, (AUDIO_NodeTypeDef *)current_mic,
                                                         current_mic->node.session_handle);
     }
-    memcpy((uint16_t*)(current_mic->buf->data+current_mic->buf->wr_ptr),buffer, current_mic->packet_length);
-    /* check for overflow */
-    current_mic->buf->wr_ptr += current_mic->packet_length;
+    return AUDIO_BufferAcquireWrite(current_mic->buf, current_mic->packet_length, region);
+  }
+  return 0;
+}
 
-    if (current_mic->buf->wr_ptr == current_mic->buf->size)
-    {
-      current_mic->buf->wr_ptr = 0;
-    }
+/**
+  * @brief  AUDIO_CommitINData
+  *         publish bytes written in the area returned by AUDIO_ReserveINData
+  * @param  length: written bytes
+  * @retval published bytes
+  */
+uint32_t AUDIO_CommitINData(uint32_t length)
+{
+#ifdef USE_AUDIO_PACKET_QUEUE
+  uint32_t wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+  if ((current_mic)&&(current_mic->node.state == AUDIO_NODE_STARTED))
+  {
+#if (defined USE_AUDIO_TAP) || (defined USE_AUDIO_SNAPSHOT) || (defined USE_AUDIO_SPECTRUM) || \
+    (defined USE_AUDIO_MIC_PATTERN)
+    AUDIO_BufferRegionTypeDef region;
+
+    length = AUDIO_BufferAcquireWrite(current_mic->buf, length, &region);
+#ifdef USE_AUDIO_MIC_PATTERN
+    /* the taps see the frames the host receives */
+    AUDIO_PatternWriteRegion(&region, length, current_mic->node.audio_description);
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_TAP
+    AUDIO_TapWriteRegion(AUDIO_TAP_POINT_MIC_RAW, &region);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+    AUDIO_SnapshotWriteRegion(AUDIO_TAP_POINT_MIC_RAW, &region);
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SPECTRUM
+    AUDIO_SpectrumWriteRegion(AUDIO_SPECTRUM_SOURCE_MIC, &region, current_mic->node.audio_description);
+#endif /* USE_AUDIO_SPECTRUM */
+#endif /* USE_AUDIO_TAP || USE_AUDIO_SNAPSHOT || USE_AUDIO_SPECTRUM || USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_PACKET_QUEUE
+    wr_ptr = current_mic->buf->wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+    AUDIO_BufferCommitWrite(current_mic->buf, length);
+#ifdef USE_AUDIO_PACKET_QUEUE
+    AUDIO_BufferPushPacket(current_mic->buf, wr_ptr, (uint16_t)length, (uint16_t)USB_SOF_NUMBER(), AUDIO_PACKET_TIME());
+#endif /* USE_AUDIO_PACKET_QUEUE */
+#ifdef USE_AUDIO_DUMMY_CLOCK
+    AUDIO_DummyClockConsume(AUDIO_DUMMY_CLOCK_MIC, length, current_mic->node.audio_description);
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+    return length;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SendINData
+  *         copy a packet to the mic buffer
+  * @param  buffer: packet data
+  * @param  length: packet length in bytes
+  * @retval copied bytes , 0 if nothing was reserved
+  */
+uint32_t AUDIO_SendINData(uint8_t* buffer,uint32_t length){
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t reserved;
+  
+  reserved = AUDIO_ReserveINData(&region);
+  if (length > reserved)
+  {
+    length = reserved;
+  }
+  if (length == 0)
+  {
+    /* mic not started or ring full : region is not set */
+    return 0;
+  }
+  if (length > region.length[0])
+  {
+    AUDIO_MEMCPY(region.data[0], buffer, region.length[0]);
+    AUDIO_MEMCPY(region.data[1], buffer + region.length[0], length - region.length[0]);
+  }
+  else
+  {
+    AUDIO_MEMCPY(region.data[0], buffer, length);
   }
+  return AUDIO_CommitINData(length);
 }
+#endif /* USE_AUDIO_DUMMY_MIC */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -50,6 +50,15 @@
 #include "usbd_audio.h"
 #include "audio_speaker_node.h"
 #include "usb_audio_user.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+#include "audio_pattern.h"
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+#ifdef USE_AUDIO_SPEAKER_DUMMY
 /* Private defines -----------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 static int8_t  AUDIO_SpeakerDeInit(uint32_t node_handle);
@@ -60,8 +69,12 @@ static int8_t  AUDIO_SpeakerMute( uint16_t channel_number,  uint8_t mute , uint3
 static int8_t  AUDIO_SpeakerSetVolume( uint16_t channel_number,  int volume ,  uint32_t node_handle);
 static void    AUDIO_SpeakerInitInjectionsParams( AUDIO_Speaker_NodeTypeDef* speaker);
 static uint16_t  AUDIO_SpeakerUpdateBuffer(void);
+static uint16_t  AUDIO_SpeakerGetNextReadLength(void);
 static int8_t  AUDIO_SpeakerStartReadCount( uint32_t node_handle);
 static uint16_t AUDIO_SpeakerGetLastReadCount( uint32_t node_handle);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+static int8_t  AUDIO_SpeakerPower( uint8_t on, uint32_t node_handle);
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private macros ------------------------------------------------------------*/
@@ -100,28 +113,133 @@ static AUDIO_Speaker_NodeTypeDef *current_speaker = 0;
   speaker->SpeakerSetVolume = AUDIO_SpeakerSetVolume;
   speaker->SpeakerStartReadCount = AUDIO_SpeakerStartReadCount;
   speaker->SpeakerGetReadCount = AUDIO_SpeakerGetLastReadCount;
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  speaker->SpeakerPower = AUDIO_SpeakerPower;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
   current_speaker = speaker;
   return 0;
 }
 
-#define BUFFER_OUT_SIZE 280*1024
-volatile uint8_t storeBuffer[BUFFER_OUT_SIZE];
-uint32_t pointer;
-
+/**
+  * @brief  AUDIO_GetSpeakerData
+  *         read and drop a packet from the buffer, the played stream is
+  *         captured over CDC with USE_AUDIO_TAP
+  * @param  data: not used
+  * @retval read bytes
+  */
 uint32_t AUDIO_GetSpeakerData(uint16_t* data){
-    if(current_speaker->node.state == AUDIO_NODE_STARTED){
-      uint16_t wr_distance = AUDIO_BUFFER_FILLED_SIZE(current_speaker->buf);
-      if(wr_distance>current_speaker->packet_length){
-        if(pointer<(BUFFER_OUT_SIZE-current_speaker->packet_length)){
-          memcpy(&storeBuffer[pointer],(uint16_t*)(current_speaker->buf->data+current_speaker->buf->rd_ptr),current_speaker->packet_length);
-          pointer+=current_speaker->packet_length;
-        }
-        return AUDIO_SpeakerUpdateBuffer();
+    AUDIO_BufferRegionTypeDef region;
+
+    if(AUDIO_AcquireSpeakerData(&region) > 0){
+      return AUDIO_ReleaseSpeakerData();
+    }
+    return 0;
+}
+
+/**
+  * @brief  AUDIO_AcquireSpeakerData
+  *         borrow next packet in place, no copy is done. The packet must be released
+  *         by AUDIO_ReleaseSpeakerData once it is consumed
+  * @param  region: returned packet , split in two parts when it wraps in the buffer
+  * @retval packet length , 0 if no packet is ready
+  */
+uint32_t AUDIO_AcquireSpeakerData(AUDIO_BufferRegionTypeDef* region)
+{
+  if((current_speaker)&&(current_speaker->node.state == AUDIO_NODE_STARTED))
+  {
+    uint16_t read_length = AUDIO_SpeakerGetNextReadLength();
+
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+    if(current_speaker->drop_length != 0U)
+    {
+      AUDIO_BufferDrop(current_speaker->buf, current_speaker->drop_length,
+                       AUDIO_SAMPLE_LENGTH(current_speaker->node.audio_description));
+      current_speaker->drop_length = 0;
+    }
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+
+    if(AUDIO_BUFFER_FILLED_SIZE(current_speaker->buf) > read_length)
+    {
+#ifdef USE_AUDIO_DUMMY_CLOCK
+      /* played at the pace of the simulated device clock */
+      if(!AUDIO_DummyClockIsDue(AUDIO_DUMMY_CLOCK_SPEAKER, read_length, current_speaker->node.audio_description))
+      {
+        return 0;
       }
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+      read_length = (uint16_t)AUDIO_BufferAcquireRead(current_speaker->buf, read_length, region);
+      AUDIO_PatternCheckRegion(region, read_length, current_speaker->node.audio_description,
+                               (uint16_t)USB_SOF_NUMBER());
+      return read_length;
+#else /* USE_AUDIO_SPEAKER_PATTERN */
+      return AUDIO_BufferAcquireRead(current_speaker->buf, read_length, region);
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
     }
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ReleaseSpeakerData
+  *         release the packet borrowed by AUDIO_AcquireSpeakerData
+  * @param  None
+  * @retval released bytes
+  */
+uint16_t AUDIO_ReleaseSpeakerData(void)
+{
+#ifdef USE_AUDIO_DUMMY_CLOCK
+  uint16_t read_length = AUDIO_SpeakerUpdateBuffer();
+
+  if(read_length > 0U)
+  {
+    AUDIO_DummyClockConsume(AUDIO_DUMMY_CLOCK_SPEAKER, read_length, current_speaker->node.audio_description);
+  }
+  return read_length;
+#else /* USE_AUDIO_DUMMY_CLOCK */
+  return AUDIO_SpeakerUpdateBuffer();
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+}
+
+
+#ifdef USE_AUDIO_PACKET_QUEUE
+/**
+  * @brief  AUDIO_GetSpeakerPacketAge
+  *         time since the packet borrowed by AUDIO_AcquireSpeakerData was received
+  * @param  None
+  * @retval age in ms , 0 if the packet is not tracked
+  */
+uint32_t AUDIO_GetSpeakerPacketAge(void)
+{
+  AUDIO_PacketDescTypeDef packet;
+
+  if((current_speaker == 0) || (AUDIO_BufferNextPacket(current_speaker->buf, &packet) == 0U))
+  {
     return 0;
+  }
+  return (((uint32_t)USB_SOF_NUMBER() - packet.sof) & USB_SOF_NUMBER_MASK) / AUDIO_PACKET_SOF_PER_MS;
 }
+#endif /* USE_AUDIO_PACKET_QUEUE */
 
+/**
+  * @brief  AUDIO_SpeakerGetNextReadLength
+  *         return the size of the next packet to read from the buffer, the
+  *         packet as received when packets are tracked
+  * @param  None
+  * @retval packet length
+  */
+static uint16_t AUDIO_SpeakerGetNextReadLength(void)
+{
+#ifdef USE_AUDIO_PACKET_QUEUE
+  AUDIO_PacketDescTypeDef packet;
+
+  if(AUDIO_BufferNextPacket(current_speaker->buf, &packet))
+  {
+    return packet.length;
+  }
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  return AUDIO_PacketSchedulerPeek(&current_speaker->scheduler);
+}
 
 /**
   * @brief  AUDIO_SpeakerUpdateBuffer
@@ -131,7 +249,11 @@ uint32_t AUDIO_GetSpeakerData(uint16_t* data){
   */
 static uint16_t AUDIO_SpeakerUpdateBuffer(void)
 {
-  uint16_t wr_distance, read_length = 0;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  AUDIO_PacketDescTypeDef packet;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  uint32_t wr_distance;
+  uint16_t read_length = 0;
     
   if((current_speaker)&&(current_speaker->node.state != AUDIO_NODE_OFF))
   {
@@ -142,40 +264,35 @@ static uint16_t AUDIO_SpeakerUpdateBuffer(void)
     {
 
       /* inform session that a packet is played */
-      current_speaker->node.session_handle->SessionCallback(AUDIO_PACKET_PLAYED, (AUDIO_NodeTypeDef*)current_speaker, 
+      AUDIO_PumpPostEvent(AUDIO_PACKET_PLAYED, (AUDIO_NodeTypeDef*)current_speaker, 
                                                             current_speaker->node.session_handle);
       /* prepare next size to inject */
-      read_length = current_speaker->packet_length;
-#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K
-      if(current_speaker->node.audio_description->frequence == USB_AUDIO_CONFIG_FREQ_44_1_K)
+#ifdef USE_AUDIO_PACKET_QUEUE
+      if(AUDIO_BufferNextPacket(current_speaker->buf, &packet))
+      {
+        read_length = packet.length;
+      }
+      else
+#endif /* USE_AUDIO_PACKET_QUEUE */
       {
-        if(current_speaker->injection_44_count < 9)
-        {
-          current_speaker->injection_44_count++;  
-        }
-        else
-        {
-           current_speaker->injection_44_count = 0;
-           read_length = current_speaker->packet_length_max_44_1;
-        }
+        read_length = AUDIO_PacketSchedulerNext(&current_speaker->scheduler);
       }
-#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K*/
       wr_distance = AUDIO_BUFFER_FILLED_SIZE(current_speaker->buf);
       if(wr_distance < read_length)
       {
         /** inform session that an underrun is happened */
-        current_speaker->node.session_handle->SessionCallback(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)current_speaker, 
+        AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)current_speaker, 
                                                   current_speaker->node.session_handle);
         read_length = 0;
       }
       else
       {     
+#ifdef USE_AUDIO_PACKET_QUEUE
+        /* the dummy speaker outputs the packet when it is read */
+        AUDIO_BufferMeasureDelay(current_speaker->buf, AUDIO_PACKET_TIME());
+#endif /* USE_AUDIO_PACKET_QUEUE */
         /* update read pointer */
-        current_speaker->buf->rd_ptr += read_length;
-        if(current_speaker->buf->rd_ptr >= current_speaker->buf->size)
-        {
-          current_speaker->buf->rd_ptr = current_speaker->buf->rd_ptr - current_speaker->buf->size;
-        }
+        AUDIO_BufferCommitRead(current_speaker->buf, read_length);
       }
     } /* current_speaker->node.state == AUDIO_NODE_STARTED */
   }
@@ -219,6 +336,10 @@ static int8_t  AUDIO_SpeakerStart(AUDIO_BufferTypeDef* buffer,  uint32_t node_ha
 
   speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
   speaker->buf = buffer;
+  AUDIO_PacketSchedulerReset(&speaker->scheduler);
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+  speaker->drop_length = 0;
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
   AUDIO_SpeakerMute( 0,  speaker->node.audio_description->audio_mute , node_handle);
   AUDIO_SpeakerSetVolume( 0,  speaker->node.audio_description->audio_volume_db_256 , node_handle);
   speaker->node.state = AUDIO_NODE_STARTED;
@@ -266,17 +387,12 @@ static int8_t  AUDIO_SpeakerChangeFrequence( uint32_t node_handle)
 static void  AUDIO_SpeakerInitInjectionsParams( AUDIO_Speaker_NodeTypeDef* speaker)
 {
   speaker->packet_length = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(speaker->node.audio_description);
-#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K
-  if(speaker->node.audio_description->frequence == USB_AUDIO_CONFIG_FREQ_44_1_K)
-  {
-    speaker->packet_length_max_44_1 = speaker->packet_length + AUDIO_SAMPLE_LENGTH(speaker->node.audio_description);
-  }
-#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K*/
+  AUDIO_PacketSchedulerInit(&speaker->scheduler, speaker->node.audio_description, 1000U);
  }
  /**
   * @brief  AUDIO_SpeakerMute
   *         set Mute value to speaker
-  * @param  channel_number: channel number
+  * @param  channel_number: channel number, only master (0) is handled
 * @param  mute: mute value (0 : mute , 1 unmute)
   * @param  node_handle: speaker node handle must be Started
   * @retval  : 0 if no error
@@ -286,7 +402,10 @@ static int8_t  AUDIO_SpeakerMute( uint16_t channel_number,  uint8_t mute , uint3
   AUDIO_Speaker_NodeTypeDef* speaker;
 
   speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
-  speaker->node.audio_description->audio_mute = mute;
+  if(channel_number == 0)
+  {
+    speaker->node.audio_description->audio_mute = mute;
+  }
 
   return 0;
 }
@@ -294,7 +413,7 @@ static int8_t  AUDIO_SpeakerMute( uint16_t channel_number,  uint8_t mute , uint3
  /**
   * @brief  AUDIO_SpeakerSetVolume
   *         set Volume value to speaker
-  * @param  channel_number: channel number
+  * @param  channel_number: channel number, only master (0) is handled
   * @param  volume_db_256:  volume value in db
   * @param  node_handle:    speaker node handle must be Started
   * @retval 0 if no error
@@ -304,7 +423,10 @@ static int8_t  AUDIO_SpeakerSetVolume( uint16_t channel_number,  int volume_db_2
   AUDIO_Speaker_NodeTypeDef* speaker;
   
   speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
-  speaker->node.audio_description->audio_volume_db_256 = volume_db_256;
+  if(channel_number == 0)
+  {
+    speaker->node.audio_description->audio_volume_db_256 = volume_db_256;
+  }
   
   return 0;
 }
@@ -335,4 +457,18 @@ static uint16_t  AUDIO_SpeakerGetLastReadCount( uint32_t node_handle)
     
   return read_bytes;
 }
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+ /**
+  * @brief  AUDIO_SpeakerPower
+  *         no output stage on the dummy speaker
+  * @param  on: 1 to power the output stage, 0 to shut it down
+  * @param  node_handle: speaker node handle
+  * @retval 0
+  */
+static int8_t  AUDIO_SpeakerPower( uint8_t on, uint32_t node_handle)
+{
+  return 0;
+}
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
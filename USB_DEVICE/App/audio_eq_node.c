@@ -0,0 +1,584 @@
+/**
+  ******************************************************************************
+  * @file    audio_eq_node.c
+  * @brief   Equalizer : cascaded biquads per channel applied in place on the
+  *          packets received from USB, before they are published to the
+  *          speaker. Single precision float on the M7 FPU. Coefficients are
+  *          loaded from the CDC command channel in a second bank, which is
+  *          swapped with the active one between two packets, so a packet is
+  *          never processed with a partly loaded set. With
+  *          USE_AUDIO_PLANAR_DSP the packet is split in one float plane per
+  *          channel and each stage runs over a whole plane.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_eq_node.h"
+#ifdef USE_AUDIO_PLANAR_DSP
+#include "audio_pcm.h"
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_EQ_SCALE_16               32768.0f
+#define AUDIO_EQ_SCALE_24               8388608.0f
+#define AUDIO_EQ_SCALE_32               2147483648.0f
+#ifdef USE_AUDIO_PLANAR_DSP
+/* frames filtered per plane, longer packets are split : 1 ms at 48 kHz */
+#define AUDIO_EQ_PLANE_FRAMES           48U
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Private variables ---------------------------------------------------------*/
+/* written from the pump, read by the process in the USB interrupt */
+static AUDIO_Eq_NodeTypeDef *current_eq = 0;
+#ifdef USE_AUDIO_PLANAR_DSP
+/* one plane per channel, only used by the process */
+static float eq_planes[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT * AUDIO_EQ_PLANE_FRAMES] USBD_DTCM_BSS;
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_EqDeInit(uint32_t node_handle);
+static int8_t  AUDIO_EqStart(uint32_t node_handle);
+static int8_t  AUDIO_EqStop(uint32_t node_handle);
+static int8_t  AUDIO_EqProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static int8_t  AUDIO_EqProcessFloat(float* planes, uint32_t stride, uint32_t frames,
+                                    uint32_t node_handle) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+static void    AUDIO_EqSetFlat(AUDIO_EqBankTypeDef* bank);
+#ifdef USE_AUDIO_PLANAR_DSP
+static void    AUDIO_EqFilterPlane(float (*coef)[AUDIO_EQ_COEF_COUNT], float (*state)[2], uint8_t stages,
+                                   float* plane, uint32_t frames) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_EqInit
+  *         Initializes the equalizer node, all channels are flat
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      equalizer node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_EqInit(AUDIO_DescriptionTypeDef* audio_description,
+                     AUDIO_SessionTypeDef* session_handle,
+                     uint32_t node_handle)
+{
+  AUDIO_Eq_NodeTypeDef* eq = (AUDIO_Eq_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(eq, 0, sizeof(AUDIO_Eq_NodeTypeDef));
+  eq->processing.node.state = AUDIO_NODE_INITIALIZED;
+  eq->processing.node.type = AUDIO_PROCESSING;
+  eq->processing.node.session_handle = session_handle;
+  eq->processing.node.audio_description = audio_description;
+  AUDIO_EqSetFlat(&eq->bank[0]);
+  AUDIO_EqSetFlat(&eq->bank[1]);
+
+  eq->EqDeInit = AUDIO_EqDeInit;
+  eq->EqStart = AUDIO_EqStart;
+  eq->EqStop = AUDIO_EqStop;
+  eq->processing.Process = AUDIO_EqProcess;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  eq->processing.ProcessFloat = AUDIO_EqProcessFloat;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  current_eq = eq;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqSetStage
+  *         loads the coefficients of one stage in the loaded bank, they are
+  *         used once AUDIO_EqCommit is called. Must be called from the pump
+  * @param  channel_number: 0 for all channels, 1..n for a channel
+  * @param  stage: stage index, below AUDIO_EQ_MAX_STAGES
+  * @param  coef: b0, b1, b2, a1, a2 , normalized by a0
+  * @retval 0 if no error, -1 on bad arguments or while a swap is pending
+  */
+int8_t  AUDIO_EqSetStage(uint16_t channel_number, uint8_t stage, const float* coef)
+{
+  AUDIO_Eq_NodeTypeDef* eq = current_eq;
+  AUDIO_EqBankTypeDef* bank;
+  uint8_t channels;
+  uint8_t ch;
+
+  if((eq == 0) || eq->swap || (stage >= AUDIO_EQ_MAX_STAGES))
+  {
+    return -1;
+  }
+  channels = eq->processing.node.audio_description->channels_count;
+  if(channel_number > channels)
+  {
+    return -1;
+  }
+  bank = &eq->bank[eq->active ^ 1U];
+  if(!eq->loading)
+  {
+    /* stages not loaded keep their active coefficients */
+    memcpy(bank, &eq->bank[eq->active], sizeof(AUDIO_EqBankTypeDef));
+    eq->loading = 1;
+  }
+  for(ch = 0; ch < channels; ch++)
+  {
+    if((channel_number == 0U) || (channel_number == (uint16_t)(ch + 1U)))
+    {
+      memcpy(bank->coef[ch][stage], coef, sizeof(bank->coef[ch][stage]));
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqCommit
+  *         uses the loaded bank from the next packet, at once when the node
+  *         is not started. Must be called from the pump
+  * @param  None
+  * @retval 0 if no error, -1 while the previous swap is pending
+  */
+int8_t  AUDIO_EqCommit(void)
+{
+  AUDIO_Eq_NodeTypeDef* eq = current_eq;
+  AUDIO_EqBankTypeDef* bank;
+  uint8_t channels;
+  uint8_t ch;
+  uint8_t s;
+
+  if((eq == 0) || eq->swap)
+  {
+    return -1;
+  }
+  if(!eq->loading)
+  {
+    return 0;
+  }
+  bank = &eq->bank[eq->active ^ 1U];
+  channels = eq->processing.node.audio_description->channels_count;
+  /* flat stages at the end are skipped */
+  bank->stage_count = 0;
+  for(ch = 0; ch < channels; ch++)
+  {
+    for(s = bank->stage_count; s < AUDIO_EQ_MAX_STAGES; s++)
+    {
+      if((bank->coef[ch][s][0] != 1.0f) || (bank->coef[ch][s][1] != 0.0f) || (bank->coef[ch][s][2] != 0.0f) ||
+         (bank->coef[ch][s][3] != 0.0f) || (bank->coef[ch][s][4] != 0.0f))
+      {
+        bank->stage_count = s + 1U;
+      }
+    }
+  }
+  eq->loading = 0;
+  if(eq->processing.node.state != AUDIO_NODE_STARTED)
+  {
+    eq->active ^= 1U;
+    return 0;
+  }
+  __DMB();
+  eq->swap = 1;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqGetStage
+  *         reads the coefficients of one stage of a channel in the active bank
+  * @param  channel_number: 1..n
+  * @param  stage: stage index, below AUDIO_EQ_MAX_STAGES
+  * @param  coef: filled with b0, b1, b2, a1, a2
+  * @retval 0 if no error, -1 on bad arguments or when the equalizer is not built
+  */
+int8_t  AUDIO_EqGetStage(uint16_t channel_number, uint8_t stage, float* coef)
+{
+  AUDIO_Eq_NodeTypeDef* eq = current_eq;
+
+  if((eq == 0) || (stage >= AUDIO_EQ_MAX_STAGES) || (channel_number == 0U) ||
+     (channel_number > eq->processing.node.audio_description->channels_count))
+  {
+    return -1;
+  }
+  memcpy(coef, eq->bank[eq->active].coef[channel_number - 1U][stage], sizeof(float) * AUDIO_EQ_COEF_COUNT);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqGetStageCount
+  *         stages run on each packet with the active bank
+  * @param  None
+  * @retval stages count, 0 when the equalizer is flat or not built
+  */
+uint8_t AUDIO_EqGetStageCount(void)
+{
+  if(current_eq == 0)
+  {
+    return 0;
+  }
+  return current_eq->bank[current_eq->active].stage_count;
+}
+
+#ifdef USE_AUDIO_BENCH
+/**
+  * @brief  AUDIO_EqBenchInit
+  *         Initializes an equalizer out of the sessions for the benchmark,
+  *         all stages of all channels set to the same peaking filter. The
+  *         node loaded by the CDC commands is left unchanged. Must be called
+  *         from the pump
+  * @param  audio_description: audio parameters
+  * @param  node_handle:      equalizer node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_EqBenchInit(AUDIO_DescriptionTypeDef* audio_description, uint32_t node_handle)
+{
+  static const float coef[AUDIO_EQ_COEF_COUNT] = { 1.05f, -1.80f, 0.81f, -1.80f, 0.86f };
+  AUDIO_Eq_NodeTypeDef* saved = current_eq;
+  uint8_t stage;
+
+  if(AUDIO_EqInit(audio_description, 0, node_handle) != 0)
+  {
+    current_eq = saved;
+    return -1;
+  }
+  for(stage = 0; stage < AUDIO_EQ_MAX_STAGES; stage++)
+  {
+    AUDIO_EqSetStage(0, stage, coef);
+  }
+  AUDIO_EqCommit();
+  AUDIO_EqStart(node_handle);
+  current_eq = saved;
+  return 0;
+}
+#endif /* USE_AUDIO_BENCH */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_EqDeInit
+  *         De-Initializes the equalizer node
+  * @param  node_handle: equalizer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_EqDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Eq_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_OFF;
+  current_eq = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqStart
+  *         Starts processing from a cleared filter state
+  * @param  node_handle: equalizer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_EqStart(uint32_t node_handle)
+{
+  AUDIO_Eq_NodeTypeDef* eq = (AUDIO_Eq_NodeTypeDef*)node_handle;
+
+  memset(eq->state, 0, sizeof(eq->state));
+  eq->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqStop
+  *         Stops processing, packets are left untouched. A pending swap is
+  *         done so the next load isn't refused
+  * @param  node_handle: equalizer node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_EqStop(uint32_t node_handle)
+{
+  AUDIO_Eq_NodeTypeDef* eq = (AUDIO_Eq_NodeTypeDef*)node_handle;
+
+  eq->processing.node.state = AUDIO_NODE_STOPPED;
+  if(eq->swap)
+  {
+    eq->active ^= 1U;
+    eq->swap = 0;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_EqFilter
+  *         runs one sample of a channel through its stages
+  * @param  coef: stages coefficients of the channel
+  * @param  state: stages state of the channel
+  * @param  stages: stages count
+  * @param  x: input sample, full scale is 1
+  * @retval filtered sample
+  */
+__STATIC_FORCEINLINE float AUDIO_EqFilter(float (*coef)[AUDIO_EQ_COEF_COUNT], float (*state)[2],
+                                          uint8_t stages, float x)
+{
+  float y;
+  uint8_t s;
+
+  for(s = 0; s < stages; s++)
+  {
+    y = coef[s][0] * x + state[s][0];
+    state[s][0] = coef[s][1] * x - coef[s][3] * y + state[s][1];
+    state[s][1] = coef[s][2] * x - coef[s][4] * y;
+    x = y;
+  }
+  return x;
+}
+
+/**
+  * @brief  AUDIO_EqSaturate
+  *         converts a filtered sample back to a fixed point sample
+  * @param  y: filtered sample, full scale is 1
+  * @param  scale: fixed point full scale
+  * @param  max: largest fixed point sample
+  * @retval saturated sample
+  */
+__STATIC_FORCEINLINE int32_t AUDIO_EqSaturate(float y, float scale, int32_t max)
+{
+  if(y >= 1.0f)
+  {
+    return max;
+  }
+  if(y < -1.0f)
+  {
+    return -max - 1;
+  }
+  return (int32_t)(y * scale);
+}
+
+/**
+  * @brief  AUDIO_EqProcess
+  *         Filters frames with the active bank, the loaded one becomes active
+  *         first when a swap is pending. Samples are saturated, 2, 3 or 4
+  *         bytes little endian
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  node_handle: equalizer node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_EqProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Eq_NodeTypeDef* eq = (AUDIO_Eq_NodeTypeDef*)node_handle;
+  AUDIO_EqBankTypeDef* bank;
+  uint8_t channels = eq->processing.node.audio_description->channels_count;
+  uint8_t res = eq->processing.node.audio_description->audio_res;
+  uint8_t stages;
+  uint32_t i;
+  uint8_t ch;
+
+  if(eq->swap)
+  {
+    eq->active ^= 1U;
+    eq->swap = 0;
+  }
+  bank = &eq->bank[eq->active];
+  stages = bank->stage_count;
+  if(stages == 0U)
+  {
+    /* bit exact path */
+    if(out != in)
+    {
+      AUDIO_MEMCPY(out, in, frames * channels * res);
+    }
+    return 0;
+  }
+
+  AUDIO_PROF_BEGIN(AUDIO_PROF_EQ_PROCESS);
+#ifdef USE_AUDIO_PLANAR_DSP
+  {
+    uint32_t frame_size = channels * res;
+    uint32_t n;
+
+    for(i = 0; i < frames; i += n)
+    {
+      n = ((frames - i) > AUDIO_EQ_PLANE_FRAMES) ? AUDIO_EQ_PLANE_FRAMES : (frames - i);
+      AUDIO_PcmDeinterleave(in + i * frame_size, eq_planes, AUDIO_EQ_PLANE_FRAMES, n, channels, res);
+      for(ch = 0; ch < channels; ch++)
+      {
+        AUDIO_EqFilterPlane(bank->coef[ch], eq->state[ch], stages, &eq_planes[ch * AUDIO_EQ_PLANE_FRAMES], n);
+      }
+      AUDIO_PcmInterleave(eq_planes, AUDIO_EQ_PLANE_FRAMES, out + i * frame_size, n, channels, res);
+    }
+  }
+#else /* USE_AUDIO_PLANAR_DSP */
+  switch(res)
+  {
+    case 2:
+    {
+      int16_t* src = (int16_t*)in;
+      int16_t* dst = (int16_t*)out;
+      float y;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          y = AUDIO_EqFilter(bank->coef[ch], eq->state[ch], stages, (float)*src++ * (1.0f / AUDIO_EQ_SCALE_16));
+          *dst++ = (int16_t)AUDIO_EqSaturate(y, AUDIO_EQ_SCALE_16, INT16_MAX);
+        }
+      }
+      break;
+    }
+    case 3:
+    {
+      uint8_t* src = in;
+      uint8_t* dst = out;
+      int32_t value;
+      float y;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          value = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+          y = AUDIO_EqFilter(bank->coef[ch], eq->state[ch], stages, (float)value * (1.0f / AUDIO_EQ_SCALE_24));
+          value = AUDIO_EqSaturate(y, AUDIO_EQ_SCALE_24, 0x7FFFFF);
+          dst[0] = (uint8_t)value;
+          dst[1] = (uint8_t)(value >> 8);
+          dst[2] = (uint8_t)(value >> 16);
+          src += 3;
+          dst += 3;
+        }
+      }
+      break;
+    }
+    case 4:
+    {
+      int32_t* src = (int32_t*)in;
+      int32_t* dst = (int32_t*)out;
+      float y;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          /* 24 bits of precision, enough for the 24 bits DACs */
+          y = AUDIO_EqFilter(bank->coef[ch], eq->state[ch], stages, (float)*src++ * (1.0f / AUDIO_EQ_SCALE_32));
+          *dst++ = AUDIO_EqSaturate(y, AUDIO_EQ_SCALE_32, INT32_MAX);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+#endif /* USE_AUDIO_PLANAR_DSP */
+  AUDIO_PROF_END(AUDIO_PROF_EQ_PROCESS);
+  return 0;
+}
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/**
+  * @brief  AUDIO_EqProcessFloat
+  *         filters the channel planes with the active bank, the loaded one
+  *         becomes active first when a swap is pending. Samples are not
+  *         saturated
+  * @param  planes: float planes, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  frames: frames count
+  * @param  node_handle: equalizer node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_EqProcessFloat(float* planes, uint32_t stride, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Eq_NodeTypeDef* eq = (AUDIO_Eq_NodeTypeDef*)node_handle;
+  AUDIO_EqBankTypeDef* bank;
+  uint8_t channels = eq->processing.node.audio_description->channels_count;
+  uint8_t ch;
+
+  if(eq->swap)
+  {
+    eq->active ^= 1U;
+    eq->swap = 0;
+  }
+  bank = &eq->bank[eq->active];
+  if(bank->stage_count == 0U)
+  {
+    return 0;
+  }
+  AUDIO_PROF_BEGIN(AUDIO_PROF_EQ_PROCESS);
+  for(ch = 0; ch < channels; ch++)
+  {
+    AUDIO_EqFilterPlane(bank->coef[ch], eq->state[ch], bank->stage_count, planes + ch * stride, frames);
+  }
+  AUDIO_PROF_END(AUDIO_PROF_EQ_PROCESS);
+  return 0;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+/**
+  * @brief  AUDIO_EqSetFlat
+  *         sets all stages of all channels of a bank to pass through
+  * @param  bank: coefficient bank
+  * @retval None
+  */
+static void AUDIO_EqSetFlat(AUDIO_EqBankTypeDef* bank)
+{
+  uint8_t ch;
+  uint8_t s;
+
+  memset(bank, 0, sizeof(AUDIO_EqBankTypeDef));
+  for(ch = 0; ch < AUDIO_MAX_SUPPORTED_CHANNEL_COUNT; ch++)
+  {
+    for(s = 0; s < AUDIO_EQ_MAX_STAGES; s++)
+    {
+      bank->coef[ch][s][0] = 1.0f;
+    }
+  }
+}
+#ifdef USE_AUDIO_PLANAR_DSP
+
+/**
+  * @brief  AUDIO_EqFilterPlane
+  *         runs a plane through the stages of its channel in place, one stage
+  *         over all the frames before the next, coefficients and state stay
+  *         in registers
+  * @param  coef: stages coefficients of the channel
+  * @param  state: stages state of the channel
+  * @param  stages: stages count
+  * @param  plane: samples of the channel, full scale is 1
+  * @param  frames: samples count
+  * @retval None
+  */
+static void  AUDIO_EqFilterPlane(float (*coef)[AUDIO_EQ_COEF_COUNT], float (*state)[2], uint8_t stages,
+                                 float* plane, uint32_t frames)
+{
+  float b0, b1, b2, a1, a2, z0, z1, x, y;
+  uint32_t i;
+  uint8_t s;
+
+  for(s = 0; s < stages; s++)
+  {
+    b0 = coef[s][0];
+    b1 = coef[s][1];
+    b2 = coef[s][2];
+    a1 = coef[s][3];
+    a2 = coef[s][4];
+    z0 = state[s][0];
+    z1 = state[s][1];
+    for(i = 0; i < frames; i++)
+    {
+      x = plane[i];
+      y = b0 * x + z0;
+      z0 = b1 * x - a1 * y + z1;
+      z1 = b2 * x - a2 * y;
+      plane[i] = y;
+    }
+    state[s][0] = z0;
+    state[s][1] = z1;
+  }
+}
+#endif /* USE_AUDIO_PLANAR_DSP */
+#endif /* USE_AUDIO_PLAYBACK_EQ */
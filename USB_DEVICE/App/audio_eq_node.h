@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file    audio_eq_node.h
+  * @brief   header file for the audio_eq_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_EQ_NODE_H
+#define __AUDIO_EQ_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+/* Exported constants --------------------------------------------------------*/
+/* bounds the work of a packet : 4 stages on 1 ms of 192 kHz stereo are about
+   16k cycles, 3 % of the core at 550 MHz. Measured by AUDIO_PROF_EQ_PROCESS */
+#define AUDIO_EQ_MAX_STAGES             4U
+/* b0, b1, b2, a1, a2 : y = b0.x + b1.x1 + b2.x2 - a1.y1 - a2.y2 , a0 is 1 */
+#define AUDIO_EQ_COEF_COUNT             5U
+
+/* Exported types ------------------------------------------------------------*/
+/* coefficient set of all channels, the active one is never written */
+typedef struct
+{
+  float              coef[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT][AUDIO_EQ_MAX_STAGES][AUDIO_EQ_COEF_COUNT];
+  uint8_t            stage_count;    /* stages run, the following ones are flat on all channels */
+}
+AUDIO_EqBankTypeDef;
+
+/* equalizer node : cascaded biquads per channel applied in place on each packet */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  AUDIO_EqBankTypeDef bank[2];                                     /* active one and the one being loaded */
+  float              state[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT][AUDIO_EQ_MAX_STAGES][2]; /* transposed direct form II */
+  volatile uint8_t   active;         /* bank used by the process */
+  volatile uint8_t   swap;           /* the loaded bank is used from next packet */
+  uint8_t            loading;        /* the loaded bank was copied from the active one */
+  int8_t            (*EqDeInit)     (uint32_t /*node_handle*/);
+  int8_t            (*EqStart)      (uint32_t /*node_handle*/);
+  int8_t            (*EqStop)       (uint32_t /*node_handle*/);
+}
+AUDIO_Eq_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_EqInit(AUDIO_DescriptionTypeDef* audio_description,
+                     AUDIO_SessionTypeDef* session_handle,
+                     uint32_t node_handle);
+int8_t  AUDIO_EqSetStage(uint16_t channel_number, uint8_t stage, const float* coef);
+int8_t  AUDIO_EqCommit(void);
+int8_t  AUDIO_EqGetStage(uint16_t channel_number, uint8_t stage, float* coef);
+uint8_t AUDIO_EqGetStageCount(void);
+#ifdef USE_AUDIO_BENCH
+int8_t  AUDIO_EqBenchInit(AUDIO_DescriptionTypeDef* audio_description, uint32_t node_handle);
+#endif /* USE_AUDIO_BENCH */
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_EQ_NODE_H */
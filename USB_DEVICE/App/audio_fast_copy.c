@@ -0,0 +1,289 @@
+/**
+  ******************************************************************************
+  * @file    audio_fast_copy.c
+  * @brief   copy and set of the audio blocks, run from ITCM instead of the
+  *          generic newlib routines in flash. The body moves 32 bytes per
+  *          loop with 64 bits accesses (LDRD/STRD) once the destination is
+  *          word aligned, so the PCM blocks, word aligned with a length
+  *          multiple of 4, never run the byte prologue and epilogue. A
+  *          benchmark against newlib and the MDMA is run at boot
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_fast_copy.h"
+
+#ifdef USE_AUDIO_FAST_COPY
+#include "stm32h7xx.h"
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_copy.h"
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/* Private typedef -----------------------------------------------------------*/
+/* 64 bits access of a word aligned address : LDRD/STRD, which the Cortex-M7
+   issues as one AXI beat */
+typedef uint64_t __attribute__((aligned(4), __may_alias__)) AUDIO_FastDwordTypeDef;
+typedef uint32_t __attribute__((__may_alias__)) AUDIO_FastWordTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_FastCopyBenchTypeDef fast_copy_bench[AUDIO_FAST_COPY_BENCH_COUNT];
+/* a ring in DTCM is copied to a DMA half in D2 SRAM */
+static uint8_t fast_copy_src[AUDIO_FAST_COPY_BENCH_SIZE] __ALIGNED(8) USBD_DTCM_BSS;
+static uint8_t fast_copy_dst[AUDIO_FAST_COPY_BENCH_SIZE] __ALIGNED(8) USBD_D2_BSS;
+#ifdef USE_AUDIO_MDMA_COPY
+static volatile uint8_t fast_copy_mdma_done;
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_FastCopyBench(AUDIO_FastCopyBenchTypeDef* bench);
+#ifdef USE_AUDIO_MDMA_COPY
+static void     AUDIO_FastCopyMdmaDone(uint32_t private_data);
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FastCopyInit
+  *         measures the copies, to call after AUDIO_CopyInit and before the
+  *         USB device is started, so no stream uses the MDMA.
+  * @param  None
+  * @retval None
+  */
+void AUDIO_FastCopyInit(void)
+{
+  static const uint16_t lengths[AUDIO_FAST_COPY_BENCH_COUNT] = AUDIO_FAST_COPY_BENCH_LENGTHS;
+  uint32_t i;
+
+  for(i = 0; i < AUDIO_FAST_COPY_BENCH_SIZE; i++)
+  {
+    fast_copy_src[i] = (uint8_t)(i * 7U);
+  }
+  for(i = 0; i < AUDIO_FAST_COPY_BENCH_COUNT; i++)
+  {
+    memset(&fast_copy_bench[i], 0, sizeof(AUDIO_FastCopyBenchTypeDef));
+    fast_copy_bench[i].length = lengths[i];
+    AUDIO_FastCopyBench(&fast_copy_bench[i]);
+  }
+}
+
+/**
+  * @brief  AUDIO_FastCopy
+  *         memcpy of the audio path, the areas must not overlap
+  * @param  dst: destination
+  * @param  src: source
+  * @param  length: bytes to copy
+  * @retval None
+  */
+void AUDIO_FastCopy(void* dst, const void* src, uint32_t length)
+{
+  uint8_t* d = (uint8_t*)dst;
+  const uint8_t* s = (const uint8_t*)src;
+  AUDIO_FastDwordTypeDef* d64;
+  const AUDIO_FastDwordTypeDef* s64;
+  uint64_t a, b, c, e;
+
+  while((((uint32_t)d & 3U) != 0U) && (length != 0U))
+  {
+    *d++ = *s++;
+    length--;
+  }
+  if(((uint32_t)s & 3U) == 0U)
+  {
+    d64 = (AUDIO_FastDwordTypeDef*)d;
+    s64 = (const AUDIO_FastDwordTypeDef*)s;
+    while(length >= 32U)
+    {
+      /* loads grouped ahead of the stores , the pipeline overlaps them */
+      a = s64[0];
+      b = s64[1];
+      c = s64[2];
+      e = s64[3];
+      d64[0] = a;
+      d64[1] = b;
+      d64[2] = c;
+      d64[3] = e;
+      d64 += 4;
+      s64 += 4;
+      length -= 32U;
+    }
+    d = (uint8_t*)d64;
+    s = (const uint8_t*)s64;
+    while(length >= 4U)
+    {
+      *(AUDIO_FastWordTypeDef*)d = *(const AUDIO_FastWordTypeDef*)s;
+      d += 4;
+      s += 4;
+      length -= 4U;
+    }
+  }
+  else
+  {
+    /* source not word aligned with the destination : the Cortex-M7 reads
+       unaligned words from normal memory */
+    while(length >= 4U)
+    {
+      *(AUDIO_FastWordTypeDef*)d = __UNALIGNED_UINT32_READ(s);
+      d += 4;
+      s += 4;
+      length -= 4U;
+    }
+  }
+  while(length != 0U)
+  {
+    *d++ = *s++;
+    length--;
+  }
+}
+
+/**
+  * @brief  AUDIO_FastSet
+  *         memset of the audio path
+  * @param  dst: destination
+  * @param  value: byte written
+  * @param  length: bytes to set
+  * @retval None
+  */
+void AUDIO_FastSet(void* dst, uint8_t value, uint32_t length)
+{
+  uint8_t* d = (uint8_t*)dst;
+  AUDIO_FastDwordTypeDef* d64;
+  uint32_t word = 0x01010101U * value;
+  uint64_t dword = ((uint64_t)word << 32) | word;
+
+  while((((uint32_t)d & 3U) != 0U) && (length != 0U))
+  {
+    *d++ = value;
+    length--;
+  }
+  d64 = (AUDIO_FastDwordTypeDef*)d;
+  while(length >= 32U)
+  {
+    d64[0] = dword;
+    d64[1] = dword;
+    d64[2] = dword;
+    d64[3] = dword;
+    d64 += 4;
+    length -= 32U;
+  }
+  d = (uint8_t*)d64;
+  while(length >= 4U)
+  {
+    *(AUDIO_FastWordTypeDef*)d = word;
+    d += 4;
+    length -= 4U;
+  }
+  while(length != 0U)
+  {
+    *d++ = value;
+    length--;
+  }
+}
+
+/**
+  * @brief  AUDIO_FastCopyGetBench
+  *         reads a boot measure
+  * @param  index: measure index, below AUDIO_FAST_COPY_BENCH_COUNT
+  * @param  bench: returned measure
+  * @retval 0 if no error
+  */
+int8_t AUDIO_FastCopyGetBench(uint8_t index, AUDIO_FastCopyBenchTypeDef* bench)
+{
+  if(index >= AUDIO_FAST_COPY_BENCH_COUNT)
+  {
+    return -1;
+  }
+  *bench = fast_copy_bench[index];
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FastCopyBench
+  *         times each method over AUDIO_FAST_COPY_BENCH_RUNS runs with the
+  *         cycle counter, the shortest run is kept as the SysTick interrupt
+  *         may hit the others. The MDMA time runs up to its completion callback
+  * @param  bench: measure, length set
+  * @retval None
+  */
+static void AUDIO_FastCopyBench(AUDIO_FastCopyBenchTypeDef* bench)
+{
+#ifdef USE_AUDIO_MDMA_COPY
+  AUDIO_BufferRegionTypeDef region;
+#endif /* USE_AUDIO_MDMA_COPY */
+  uint32_t cycles[5];
+  uint32_t start;
+  uint32_t run;
+  uint8_t  i;
+
+  for(i = 0; i < 5U; i++)
+  {
+    cycles[i] = UINT32_MAX;
+  }
+  for(run = 0; run < AUDIO_FAST_COPY_BENCH_RUNS; run++)
+  {
+    start = DWT->CYCCNT;
+    memcpy(fast_copy_dst, fast_copy_src, bench->length);
+    start = DWT->CYCCNT - start;
+    cycles[0] = (start < cycles[0]) ? start : cycles[0];
+
+    start = DWT->CYCCNT;
+    AUDIO_FastCopy(fast_copy_dst, fast_copy_src, bench->length);
+    start = DWT->CYCCNT - start;
+    cycles[1] = (start < cycles[1]) ? start : cycles[1];
+
+#ifdef USE_AUDIO_MDMA_COPY
+    region.data[0] = fast_copy_src;
+    region.length[0] = bench->length;
+    region.data[1] = fast_copy_src;
+    region.length[1] = 0;
+    fast_copy_mdma_done = 0;
+    start = DWT->CYCCNT;
+    if(AUDIO_CopyFromRegion(AUDIO_COPY_SPEAKER, fast_copy_dst, &region, AUDIO_FastCopyMdmaDone, 0) == 0)
+    {
+      while(!fast_copy_mdma_done)
+      {
+      }
+      start = DWT->CYCCNT - start;
+      cycles[2] = (start < cycles[2]) ? start : cycles[2];
+    }
+#endif /* USE_AUDIO_MDMA_COPY */
+
+    start = DWT->CYCCNT;
+    memset(fast_copy_dst, 0, bench->length);
+    start = DWT->CYCCNT - start;
+    cycles[3] = (start < cycles[3]) ? start : cycles[3];
+
+    start = DWT->CYCCNT;
+    AUDIO_FastSet(fast_copy_dst, 0, bench->length);
+    start = DWT->CYCCNT - start;
+    cycles[4] = (start < cycles[4]) ? start : cycles[4];
+  }
+  bench->copy_newlib = cycles[0];
+  bench->copy_fast   = cycles[1];
+  bench->copy_mdma   = (cycles[2] == UINT32_MAX) ? 0U : cycles[2];
+  bench->set_newlib  = cycles[3];
+  bench->set_fast    = cycles[4];
+}
+
+#ifdef USE_AUDIO_MDMA_COPY
+/**
+  * @brief  AUDIO_FastCopyMdmaDone
+  *         end of a benchmark MDMA copy
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_FastCopyMdmaDone(uint32_t private_data)
+{
+  fast_copy_mdma_done = 1;
+}
+#endif /* USE_AUDIO_MDMA_COPY */
+#endif /* USE_AUDIO_FAST_COPY */
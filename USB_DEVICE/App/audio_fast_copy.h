@@ -0,0 +1,70 @@
+/**
+  ******************************************************************************
+  * @file    audio_fast_copy.h
+  * @brief   header file for the audio_fast_copy.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_FAST_COPY_H
+#define __AUDIO_FAST_COPY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include <string.h>
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_FAST_COPY
+/* Exported constants --------------------------------------------------------*/
+/* lengths measured at boot , the largest is the benchmark buffers size */
+#define AUDIO_FAST_COPY_BENCH_COUNT       3U
+#define AUDIO_FAST_COPY_BENCH_LENGTHS     { 192U, 576U, 1536U }
+#define AUDIO_FAST_COPY_BENCH_SIZE        1536U
+#define AUDIO_FAST_COPY_BENCH_RUNS        8U    /* the shortest run is kept */
+
+/* Exported types ------------------------------------------------------------*/
+/* cycles of one copy or set of length bytes , from DTCM to D2 SRAM like a
+   ring to a DMA half */
+typedef struct
+{
+  uint16_t length;
+  uint32_t copy_newlib;
+  uint32_t copy_fast;
+  uint32_t copy_mdma;                     /* 0 without USE_AUDIO_MDMA_COPY */
+  uint32_t set_newlib;
+  uint32_t set_fast;
+}
+AUDIO_FastCopyBenchTypeDef;
+
+/* Exported macros -----------------------------------------------------------*/
+#define AUDIO_MEMCPY(dst, src, length)    AUDIO_FastCopy((dst), (src), (length))
+#define AUDIO_MEMSET(dst, value, length)  AUDIO_FastSet((dst), (value), (length))
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_FastCopyInit(void);
+void    AUDIO_FastCopy(void* dst, const void* src, uint32_t length) USBD_ITCM_FUNC;
+void    AUDIO_FastSet(void* dst, uint8_t value, uint32_t length) USBD_ITCM_FUNC;
+int8_t  AUDIO_FastCopyGetBench(uint8_t index, AUDIO_FastCopyBenchTypeDef* bench);
+#else /* USE_AUDIO_FAST_COPY */
+#define AUDIO_MEMCPY(dst, src, length)    memcpy((dst), (src), (length))
+#define AUDIO_MEMSET(dst, value, length)  memset((dst), (value), (length))
+#endif /* USE_AUDIO_FAST_COPY */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_FAST_COPY_H */
@@ -0,0 +1,329 @@
+/**
+  ******************************************************************************
+  * @file    audio_fault.c
+  * @brief   Fault injection for the recovery paths : OUT data packets dropped
+  *          before the session sees them, IN data re-arms delayed or held
+  *          past their frame so the ISO IN incomplete handling runs, and the
+  *          dummy speaker and mic rates skewed. Set over the CDC command
+  *          channel. Each session is watched from the pump every ms : the
+  *          glitches of its counters and the time each disturbance took to
+  *          settle are reported.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_fault.h"
+
+#ifdef USE_AUDIO_FAULT_INJECTION
+#include "usbd_conf.h"
+#include "usbd_audio_if.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_DUMMY_CLOCK
+#include "audio_dummy_clock.h"
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+
+#ifndef USE_AUDIO_CDC_COMMAND
+#error "USE_AUDIO_FAULT_INJECTION is driven by the CDC command channel, USE_AUDIO_CDC_COMMAND is required"
+#endif /* USE_AUDIO_CDC_COMMAND */
+
+/* Private variables ---------------------------------------------------------*/
+/* written by AUDIO_FaultSet with the interrupts masked */
+static AUDIO_FaultConfigTypeDef fault_config;
+static volatile uint8_t  fault_active = 0;
+/* written by the USB interrupt only */
+static uint16_t fault_out_count;
+static uint16_t fault_delay_count;
+static uint16_t fault_hold_count;
+static volatile uint32_t fault_injected[AUDIO_FAULT_DIR_COUNT];
+/* written by the pump only */
+static uint32_t fault_start_tick;
+static AUDIO_USB_SessionStatsTypeDef fault_base[AUDIO_FAULT_DIR_COUNT];
+static uint32_t fault_events[AUDIO_FAULT_DIR_COUNT];     /* faults and glitches at the last check */
+static uint32_t fault_begin_tick[AUDIO_FAULT_DIR_COUNT]; /* first event of the disturbance */
+static uint32_t fault_last_tick[AUDIO_FAULT_DIR_COUNT];  /* last event of the disturbance */
+static AUDIO_FaultRecoveryTypeDef fault_recovery[AUDIO_FAULT_DIR_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_FaultHandler(void);
+static uint8_t  AUDIO_FaultDirToFunction(uint8_t dir);
+static void     AUDIO_FaultGetSession(uint8_t dir, AUDIO_USB_SessionStatsTypeDef* stats);
+static uint32_t AUDIO_FaultGlitches(const AUDIO_USB_SessionStatsTypeDef* stats);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FaultInit
+  *         registers the session watch in the pump, no fault is injected
+  *         until AUDIO_FaultSet. Must be called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_FaultInit(void)
+{
+  memset(&fault_config, 0, sizeof(fault_config));
+  fault_active = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_FAULT, AUDIO_FaultHandler);
+}
+
+/**
+  * @brief  AUDIO_FaultSet
+  *         sets the faults to inject and restarts the report from the current
+  *         session counters. Must be called from the pump
+  * @param  config: faults, all periods 0 to only watch the sessions
+  * @retval 0 if no error, -1 if a fault is out of range or not built
+  */
+int8_t AUDIO_FaultSet(const AUDIO_FaultConfigTypeDef* config)
+{
+  uint32_t primask;
+  uint8_t  dir;
+
+  if(config->delay_in_us > AUDIO_FAULT_MAX_DELAY_US)
+  {
+    return -1;
+  }
+  for(dir = 0; dir < AUDIO_FAULT_DIR_COUNT; dir++)
+  {
+    if((config->skew_ppm[dir] > AUDIO_FAULT_MAX_SKEW_PPM) || (config->skew_ppm[dir] < -AUDIO_FAULT_MAX_SKEW_PPM))
+    {
+      return -1;
+    }
+#ifdef USE_AUDIO_DUMMY_CLOCK
+    AUDIO_DummyClockSetSkew((AUDIO_DummyClockDirTypeDef)dir, config->skew_ppm[dir]);
+#else /* USE_AUDIO_DUMMY_CLOCK */
+    if(config->skew_ppm[dir] != 0)
+    {
+      return -1;
+    }
+#endif /* USE_AUDIO_DUMMY_CLOCK */
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  fault_config = *config;
+  fault_out_count = 0;
+  fault_delay_count = 0;
+  fault_hold_count = 0;
+  for(dir = 0; dir < AUDIO_FAULT_DIR_COUNT; dir++)
+  {
+    fault_injected[dir] = 0;
+  }
+  __set_PRIMASK(primask);
+
+  for(dir = 0; dir < AUDIO_FAULT_DIR_COUNT; dir++)
+  {
+    AUDIO_FaultGetSession(dir, &fault_base[dir]);
+    fault_events[dir] = AUDIO_FaultGlitches(&fault_base[dir]);
+    memset(&fault_recovery[dir], 0, sizeof(AUDIO_FaultRecoveryTypeDef));
+  }
+  fault_start_tick = HAL_GetTick();
+  fault_active = 1;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_FaultGetReport
+  *         reports the faults and the session recoveries since AUDIO_FaultSet.
+  *         Must be called from the pump
+  * @param  report: report copy
+  * @retval None
+  */
+void AUDIO_FaultGetReport(AUDIO_FaultReportTypeDef* report)
+{
+  AUDIO_USB_SessionStatsTypeDef stats;
+  uint8_t dir;
+
+  memset(report, 0, sizeof(AUDIO_FaultReportTypeDef));
+  if(!fault_active)
+  {
+    return;
+  }
+  report->config = fault_config;
+  report->elapsed_ms = HAL_GetTick() - fault_start_tick;
+  for(dir = 0; dir < AUDIO_FAULT_DIR_COUNT; dir++)
+  {
+    AUDIO_FaultGetSession(dir, &stats);
+    report->dir[dir] = fault_recovery[dir];
+    report->dir[dir].injected = fault_injected[dir];
+    report->dir[dir].underrun_count = stats.underrun_count - fault_base[dir].underrun_count;
+    report->dir[dir].overrun_count = stats.overrun_count - fault_base[dir].overrun_count;
+    report->dir[dir].resync_count = stats.fill.resync_count - fault_base[dir].fill.resync_count;
+    report->dir[dir].incomplete_count = (stats.iso_in_incomplete_count + stats.iso_out_incomplete_count) -
+                                        (fault_base[dir].iso_in_incomplete_count +
+                                         fault_base[dir].iso_out_incomplete_count);
+  }
+}
+
+/**
+  * @brief  AUDIO_FaultTick
+  *         posts the session watch once the faults were set, called each SysTick ms
+  * @param  None
+  * @retval None
+  */
+void AUDIO_FaultTick(void)
+{
+  if(fault_active)
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_FAULT);
+  }
+}
+
+/**
+  * @brief  AUDIO_FaultDropOut
+  *         tells the audio class to drop an OUT data packet, the endpoint is
+  *         armed again as if it was received
+  * @param  None
+  * @retval 1 to drop the packet
+  */
+uint8_t AUDIO_FaultDropOut(void)
+{
+  if((fault_config.drop_out_every == 0U) || (++fault_out_count < fault_config.drop_out_every))
+  {
+    return 0;
+  }
+  fault_out_count = 0;
+  fault_injected[AUDIO_FAULT_PLAYBACK]++;
+  return 1;
+}
+
+/**
+  * @brief  AUDIO_FaultDelayIn
+  *         spins before an IN data packet is armed, the packet then starts
+  *         later in its frame or misses it
+  * @param  None
+  * @retval None
+  */
+void AUDIO_FaultDelayIn(void)
+{
+  uint32_t start;
+  uint32_t cycles;
+
+  if((fault_config.delay_in_every == 0U) || (++fault_delay_count < fault_config.delay_in_every))
+  {
+    return;
+  }
+  fault_delay_count = 0;
+  fault_injected[AUDIO_FAULT_RECORD]++;
+  cycles = fault_config.delay_in_us * (SystemCoreClock / 1000000U);
+  start = DWT->CYCCNT;
+  while((DWT->CYCCNT - start) < cycles)
+  {
+  }
+}
+
+/**
+  * @brief  AUDIO_FaultHoldIn
+  *         tells the audio class to keep an IN data packet until the next SOF,
+  *         which hands it to the ISO IN incomplete handling
+  * @param  None
+  * @retval 1 to hold the packet
+  */
+uint8_t AUDIO_FaultHoldIn(void)
+{
+  if((fault_config.incomplete_in_every == 0U) || (++fault_hold_count < fault_config.incomplete_in_every))
+  {
+    return 0;
+  }
+  fault_hold_count = 0;
+  fault_injected[AUDIO_FAULT_RECORD]++;
+  return 1;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FaultHandler
+  *         pump handler, each ms : a fault or a session glitch starts a
+  *         disturbance or extends it, AUDIO_FAULT_SETTLE_MS without any ends it
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_FaultHandler(void)
+{
+  AUDIO_USB_SessionStatsTypeDef stats;
+  AUDIO_FaultRecoveryTypeDef* recovery;
+  uint32_t now = HAL_GetTick();
+  uint32_t events;
+  uint32_t duration;
+  uint32_t lock;
+  uint8_t  dir;
+
+  for(dir = 0; dir < AUDIO_FAULT_DIR_COUNT; dir++)
+  {
+    /* the session counters are also written by audio work */
+    lock = AUDIO_PumpLockAudio();
+    AUDIO_FaultGetSession(dir, &stats);
+    AUDIO_PumpUnlockAudio(lock);
+    events = fault_injected[dir] + AUDIO_FaultGlitches(&stats);
+    recovery = &fault_recovery[dir];
+    if(events != fault_events[dir])
+    {
+      fault_events[dir] = events;
+      if(!recovery->recovering)
+      {
+        recovery->recovering = 1;
+        fault_begin_tick[dir] = now;
+      }
+      fault_last_tick[dir] = now;
+    }
+    else if(recovery->recovering && ((now - fault_last_tick[dir]) >= AUDIO_FAULT_SETTLE_MS))
+    {
+      duration = fault_last_tick[dir] - fault_begin_tick[dir];
+      recovery->recovering = 0;
+      recovery->recoveries++;
+      recovery->recovery_last_ms = duration;
+      recovery->recovery_total_ms += duration;
+      if(duration > recovery->recovery_max_ms)
+      {
+        recovery->recovery_max_ms = duration;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_FaultDirToFunction
+  *         audio function of a fault direction
+  * @param  dir: AUDIO_FAULT_PLAYBACK or AUDIO_FAULT_RECORD
+  * @retval USBD_AUDIO_PLAYBACK or USBD_AUDIO_RECORD
+  */
+static uint8_t AUDIO_FaultDirToFunction(uint8_t dir)
+{
+  return (dir == (uint8_t)AUDIO_FAULT_PLAYBACK) ? USBD_AUDIO_PLAYBACK : USBD_AUDIO_RECORD;
+}
+
+/**
+  * @brief  AUDIO_FaultGetSession
+  *         reads the counters of a session, zeros when it is not built
+  * @param  dir: AUDIO_FAULT_PLAYBACK or AUDIO_FAULT_RECORD
+  * @param  stats: session counters
+  * @retval None
+  */
+static void AUDIO_FaultGetSession(uint8_t dir, AUDIO_USB_SessionStatsTypeDef* stats)
+{
+  if(USBD_AUDIO_GetSessionStats(AUDIO_FaultDirToFunction(dir), stats) != 0)
+  {
+    memset(stats, 0, sizeof(AUDIO_USB_SessionStatsTypeDef));
+  }
+}
+
+/**
+  * @brief  AUDIO_FaultGlitches
+  *         sum of the glitch counters of a session, free running
+  * @param  stats: session counters
+  * @retval glitches
+  */
+static uint32_t AUDIO_FaultGlitches(const AUDIO_USB_SessionStatsTypeDef* stats)
+{
+  return stats->underrun_count + stats->overrun_count + stats->fill.resync_count +
+         stats->iso_in_incomplete_count + stats->iso_out_incomplete_count;
+}
+#endif /* USE_AUDIO_FAULT_INJECTION */
@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file    audio_fault.h
+  * @brief   header file for the audio_fault.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_FAULT_H
+#define __AUDIO_FAULT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_FAULT_INJECTION
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_FAULT_MAX_DELAY_US          500U  /* IN re-arm delay, the USB interrupt spins meanwhile */
+#define AUDIO_FAULT_MAX_SKEW_PPM          2000  /* dummy node rate skew, both ways */
+/* a disturbance is over once its session had no glitch for this long */
+#ifndef AUDIO_FAULT_SETTLE_MS
+#define AUDIO_FAULT_SETTLE_MS             50U
+#endif /* AUDIO_FAULT_SETTLE_MS */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_FAULT_PLAYBACK = 0,       /* OUT data endpoint and dummy speaker */
+  AUDIO_FAULT_RECORD,             /* IN data endpoint and dummy mic */
+  AUDIO_FAULT_DIR_COUNT
+}
+AUDIO_FaultDirTypeDef;
+
+/* faults to inject, a period of 0 disables its fault */
+typedef struct
+{
+  uint16_t drop_out_every;        /* the Nth OUT data packet is dropped before DataReceived */
+  uint16_t delay_in_every;        /* the Nth IN data re-arm waits delay_in_us */
+  uint16_t delay_in_us;
+  uint16_t incomplete_in_every;   /* the Nth IN data packet misses its frame, the next SOF runs the ISO IN incomplete handling */
+  int16_t  skew_ppm[AUDIO_FAULT_DIR_COUNT]; /* dummy speaker and mic rate on top of the dummy clock, USE_AUDIO_DUMMY_CLOCK */
+}
+AUDIO_FaultConfigTypeDef;
+
+/* recovery of one session since the faults were set. A disturbance starts
+   with a fault or a glitch and lasts until the last glitch before
+   AUDIO_FAULT_SETTLE_MS of quiet */
+typedef struct
+{
+  uint32_t injected;              /* faults injected on the session endpoint */
+  uint32_t underrun_count;        /* session counters increase */
+  uint32_t overrun_count;
+  uint32_t resync_count;
+  uint32_t incomplete_count;      /* ISO IN and OUT incompletes */
+  uint32_t recoveries;            /* disturbances which settled */
+  uint32_t recovery_last_ms;
+  uint32_t recovery_max_ms;
+  uint32_t recovery_total_ms;
+  uint8_t  recovering;            /* a disturbance is going on */
+}
+AUDIO_FaultRecoveryTypeDef;
+
+typedef struct
+{
+  AUDIO_FaultConfigTypeDef   config;
+  uint32_t                   elapsed_ms;          /* since the faults were set */
+  AUDIO_FaultRecoveryTypeDef dir[AUDIO_FAULT_DIR_COUNT];
+}
+AUDIO_FaultReportTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_FaultInit(void);
+/* from the pump : sets the faults and clears the report */
+int8_t  AUDIO_FaultSet(const AUDIO_FaultConfigTypeDef* config);
+void    AUDIO_FaultGetReport(AUDIO_FaultReportTypeDef* report);
+/* from SysTick, each ms */
+void    AUDIO_FaultTick(void);
+/* from the audio class, USB interrupt */
+uint8_t AUDIO_FaultDropOut(void);
+void    AUDIO_FaultDelayIn(void);
+uint8_t AUDIO_FaultHoldIn(void);
+#endif /* USE_AUDIO_FAULT_INJECTION */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_FAULT_H */
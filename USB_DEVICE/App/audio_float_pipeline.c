@@ -0,0 +1,164 @@
+/**
+  ******************************************************************************
+  * @file    audio_float_pipeline.c
+  * @brief   Float pipeline : the processing nodes with a float variant run on
+  *          one float plane per channel, full scale is 1, so a node may go
+  *          above full scale and the next one bring it back. The packet is
+  *          converted once before the first of them and written back after
+  *          the last, saturated and, for 16 bits samples, dithered. A node
+  *          without a float variant gets the packet back in between.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_float_pipeline.h"
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+#include "audio_pcm.h"
+#include "audio_dither.h"
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_FLOAT_PIPELINE_SCALE_24     8388608.0f
+
+/* Private variables ---------------------------------------------------------*/
+/* planes of the packet being processed, chains never preempt each other */
+static float float_planes[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT * AUDIO_FLOAT_PIPELINE_MAX_FRAMES] USBD_DTCM_BSS;
+static AUDIO_DitherTypeDef float_dither;
+static uint8_t float_dither_ready = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t  AUDIO_FloatPipelineAccepts(AUDIO_NodeTypeDef* node, uint32_t frames) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FloatPipelineProcessChain
+  *         runs the started processing nodes from node to the end of the list
+  *         in place on one packet, the consecutive nodes with a float
+  *         variant on the planes
+  * @param  node: first node of the chain
+  * @param  data: packet , contiguous
+  * @param  length: packet length in bytes
+  * @retval None
+  */
+void  AUDIO_FloatPipelineProcessChain(AUDIO_NodeTypeDef* node, uint8_t* data, uint32_t length)
+{
+  AUDIO_ProcessingNodeTypeDef* processing;
+  AUDIO_DescriptionTypeDef* planar_desc = 0; /* format of the planes, 0 while the packet holds the samples */
+  uint32_t frames = 0;
+#ifdef USE_AUDIO_CPU_LOAD
+  uint32_t start;
+#endif /* USE_AUDIO_CPU_LOAD */
+
+  for(; node != 0; node = node->next)
+  {
+    if((node->type != AUDIO_PROCESSING) || (node->state != AUDIO_NODE_STARTED))
+    {
+      continue;
+    }
+    processing = (AUDIO_ProcessingNodeTypeDef*)node;
+    frames = length / AUDIO_SAMPLE_LENGTH(node->audio_description);
+#ifdef USE_AUDIO_CPU_LOAD
+    start = DWT->CYCCNT;
+#endif /* USE_AUDIO_CPU_LOAD */
+    if(AUDIO_FloatPipelineAccepts(node, frames))
+    {
+      if(planar_desc == 0)
+      {
+        planar_desc = node->audio_description;
+        AUDIO_PcmDeinterleave(data, float_planes, AUDIO_FLOAT_PIPELINE_MAX_FRAMES, frames,
+                              planar_desc->channels_count, planar_desc->audio_res);
+      }
+      processing->ProcessFloat(float_planes, AUDIO_FLOAT_PIPELINE_MAX_FRAMES, frames, (uint32_t)node);
+    }
+    else
+    {
+      if(planar_desc != 0)
+      {
+        AUDIO_FloatPipelineOutput(float_planes, AUDIO_FLOAT_PIPELINE_MAX_FRAMES, data,
+                                  length / AUDIO_SAMPLE_LENGTH(planar_desc),
+                                  planar_desc->channels_count, planar_desc->audio_res);
+        planar_desc = 0;
+      }
+      processing->Process(data, data, frames, (uint32_t)node);
+    }
+#ifdef USE_AUDIO_CPU_LOAD
+    AUDIO_CpuLoadNode(node, DWT->CYCCNT - start);
+#endif /* USE_AUDIO_CPU_LOAD */
+  }
+  if(planar_desc != 0)
+  {
+    AUDIO_FloatPipelineOutput(float_planes, AUDIO_FLOAT_PIPELINE_MAX_FRAMES, data,
+                              length / AUDIO_SAMPLE_LENGTH(planar_desc),
+                              planar_desc->channels_count, planar_desc->audio_res);
+  }
+}
+
+/**
+  * @brief  AUDIO_FloatPipelineOutput
+  *         writes the planes back as interleaved frames. 16 bits samples are
+  *         rounded to 24 bits then dithered to 16 bits, 24 and 32 bits ones
+  *         are saturated, a float holds 24 bits
+  * @param  planes: planes, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  out: interleaved frames
+  * @param  frames: frames count
+  * @param  channels: channels count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+void  AUDIO_FloatPipelineOutput(const float* planes, uint32_t stride, uint8_t* out, uint32_t frames,
+                                uint8_t channels, uint8_t res)
+{
+  int16_t* dst = (int16_t*)out;
+  int32_t sample;
+  float y;
+  uint32_t i;
+  uint8_t ch;
+
+  if(res != 2U)
+  {
+    AUDIO_PcmInterleave(planes, stride, out, frames, channels, res);
+    return;
+  }
+  if(!float_dither_ready)
+  {
+    AUDIO_DitherInit(&float_dither, AUDIO_DITHER_MAX_CHANNELS);
+    float_dither_ready = 1;
+  }
+  for(i = 0; i < frames; i++)
+  {
+    for(ch = 0; ch < channels; ch++)
+    {
+      y = planes[ch * stride + i];
+      sample = (y >= 1.0f) ? 0x7FFFFF : ((y < -1.0f) ? -0x800000 : (int32_t)(y * AUDIO_FLOAT_PIPELINE_SCALE_24));
+      *dst++ = AUDIO_DitherSample16(&float_dither.channel[ch & (AUDIO_DITHER_MAX_CHANNELS - 1U)], sample);
+    }
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_FloatPipelineAccepts
+  *         tells if a node runs on the planes
+  * @param  node: started processing node
+  * @param  frames: frames of the packet
+  * @retval 1 if the node has a float variant and the packet fits the planes
+  */
+static uint8_t  AUDIO_FloatPipelineAccepts(AUDIO_NodeTypeDef* node, uint32_t frames)
+{
+  return ((((AUDIO_ProcessingNodeTypeDef*)node)->ProcessFloat != 0) &&
+          (frames <= AUDIO_FLOAT_PIPELINE_MAX_FRAMES) &&
+          (node->audio_description->channels_count <= AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) &&
+          (node->audio_description->audio_res >= 2U) && (node->audio_description->audio_res <= 4U)) ? 1U : 0U;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file    audio_float_pipeline.h
+  * @brief   header file for the audio_float_pipeline.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_FLOAT_PIPELINE_H
+#define __AUDIO_FLOAT_PIPELINE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/* Exported constants --------------------------------------------------------*/
+/* frames of the planes : one ms at 192 kHz and the frame added by the feedback.
+   A longer packet runs the fixed point nodes */
+#ifndef AUDIO_FLOAT_PIPELINE_MAX_FRAMES
+#define AUDIO_FLOAT_PIPELINE_MAX_FRAMES   193U
+#endif /* AUDIO_FLOAT_PIPELINE_MAX_FRAMES */
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_FloatPipelineOutput(const float* planes, uint32_t stride, uint8_t* out, uint32_t frames,
+                                uint8_t channels, uint8_t res) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_FLOAT_PIPELINE_H */
@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    audio_gain.c
+  * @brief   dB to linear gain conversion : a table holds the gains of the
+  *          speaker volume steps and values between two steps are
+  *          interpolated, so a volume request costs the same time whatever
+  *          its value.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_gain.h"
+#include "audio_speaker_node.h"
+
+/* Private defines -----------------------------------------------------------*/
+/* range the table was generated for */
+#define AUDIO_GAIN_TABLE_MIN_DB_256       (-6400)
+#define AUDIO_GAIN_TABLE_MAX_DB_256       1536
+#define AUDIO_GAIN_TABLE_RES_DB_256       128
+#define AUDIO_GAIN_TABLE_SIZE             (((AUDIO_GAIN_TABLE_MAX_DB_256 - AUDIO_GAIN_TABLE_MIN_DB_256) / \
+                                            AUDIO_GAIN_TABLE_RES_DB_256) + 1)
+
+#if (VOLUME_SPEAKER_MIN_DB_256 != AUDIO_GAIN_TABLE_MIN_DB_256) || \
+    (VOLUME_SPEAKER_MAX_DB_256 != AUDIO_GAIN_TABLE_MAX_DB_256) || \
+    (VOLUME_SPEAKER_RES_DB_256 != AUDIO_GAIN_TABLE_RES_DB_256)
+#error "the speaker volume range changed, regenerate audio_gain_table"
+#endif /* VOLUME_SPEAKER_MIN_DB_256 */
+
+/* Private variables ---------------------------------------------------------*/
+/* round(10 ^ (db / 20) * 2 ^ 30) from -25 dB to +6 dB by 0.5 dB */
+static const int32_t audio_gain_table[AUDIO_GAIN_TABLE_SIZE] =
+{
+    60380940,   63958736,   67748529,   71762882,   76015100,   80519278,
+    85290345,   90344115,   95697341,  101367765,  107374182,  113736503,
+   120475814,  127614455,  135176087,  143185773,  151670064,  160657080,
+   170176611,  180260209,  190941298,  202255281,  214239660,  226934158,
+   240380852,  254624313,  269711752,  285693178,  302621563,  320553018,
+   339546978,  359666402,  380977976,  403552340,  427464319,  452793173,
+   479622855,  508042296,  538145694,  570032831,  603809400,  639587356,
+   677485290,  717628817,  760150998,  805192776,  852903448,  903441154,
+   956973408, 1013677647, 1073741824, 1137365027, 1204758142, 1276144550,
+  1351760868, 1431857735, 1516700640, 1606570803, 1701766107, 1802602089,
+  1909412977, 2022552809, 2142396597
+};
+
+/* Exported functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_GainFromDb256
+  *         converts a volume to a linear gain. Below the table the gain is
+  *         the product of the lowest table gain and of the gain of the rest
+  * @param  volume_db_256: volume in db 8.8 format
+  * @retval gain, Q1.30 format
+  */
+int32_t  AUDIO_GainFromDb256(int volume_db_256)
+{
+  int64_t gain = AUDIO_GAIN_UNITY;
+  int64_t step_gain;
+  uint32_t index;
+  uint32_t frac;
+
+  if(volume_db_256 > AUDIO_GAIN_TABLE_MAX_DB_256)
+  {
+    volume_db_256 = AUDIO_GAIN_TABLE_MAX_DB_256;
+  }
+  while(volume_db_256 < AUDIO_GAIN_TABLE_MIN_DB_256)
+  {
+    gain = (gain * audio_gain_table[0]) >> AUDIO_GAIN_FRAC_BITS;
+    volume_db_256 -= AUDIO_GAIN_TABLE_MIN_DB_256;
+  }
+  index = (uint32_t)(volume_db_256 - AUDIO_GAIN_TABLE_MIN_DB_256) / AUDIO_GAIN_TABLE_RES_DB_256;
+  frac = (uint32_t)(volume_db_256 - AUDIO_GAIN_TABLE_MIN_DB_256) % AUDIO_GAIN_TABLE_RES_DB_256;
+  step_gain = audio_gain_table[index];
+  if(frac != 0U)
+  {
+    /* linear between two steps, less than 0.004 dB error for 0.5 dB steps */
+    step_gain += ((audio_gain_table[index + 1U] - step_gain) * (int64_t)frac) / AUDIO_GAIN_TABLE_RES_DB_256;
+  }
+  return (int32_t)((gain * step_gain) >> AUDIO_GAIN_FRAC_BITS);
+}
@@ -0,0 +1,40 @@
+/**
+  ******************************************************************************
+  * @file    audio_gain.h
+  * @brief   header file for the audio_gain.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_GAIN_H
+#define __AUDIO_GAIN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_GAIN_FRAC_BITS              30U  /* gains are Q1.30 , +6 dB max is below 2 */
+#define AUDIO_GAIN_UNITY                  (1L << AUDIO_GAIN_FRAC_BITS)
+
+/* Exported functions ------------------------------------------------------- */
+/* volume in db 8.8 format to a linear gain, without float, limited to VOLUME_SPEAKER_MAX_DB_256 */
+int32_t  AUDIO_GainFromDb256(int volume_db_256);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_GAIN_H */
@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * @file    audio_isr_latency.c
+  * @brief   interrupt latency mode : the vector table is copied to DTCM, so
+  *          the vector fetch of the USB and SAI interrupts doesn't wait for
+  *          the flash, and FPU lazy stacking is enforced, so interrupts which
+  *          don't use the FPU, tail chained ones included, never save its
+  *          registers. With the profiler, the entry latency of an interrupt
+  *          pended from thread mode is measured each ms and the audio
+  *          interrupts which used the FPU are recorded
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_conf.h"
+#include "audio_isr_latency.h"
+
+#ifdef USE_AUDIO_ISR_LATENCY
+#if (defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO) && (!defined USE_AUDIO_RECORDING_USB_RESAMPLER)
+#error "the float recording synchro runs in the USB interrupt, USE_AUDIO_ISR_LATENCY needs USE_AUDIO_RECORDING_USB_RESAMPLER"
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO && !USE_AUDIO_RECORDING_USB_RESAMPLER */
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t isr_vectors[AUDIO_ISR_VECTOR_COUNT] __ALIGNED(AUDIO_ISR_VECTOR_ALIGN) USBD_DTCM_BSS;
+#ifdef USE_AUDIO_PROFILER
+static volatile uint32_t isr_latency_pend_time;
+static uint32_t isr_latency_last_tick;
+#endif /* USE_AUDIO_PROFILER */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_IsrLatencyInit
+  *         relocates the vector table and sets the FPU lazy stacking, to call
+  *         after HAL_Init and before the audio interrupts are enabled
+  * @param  None
+  * @retval None
+  */
+void AUDIO_IsrLatencyInit(void)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  memcpy(isr_vectors, (const void*)SCB->VTOR, sizeof(isr_vectors));
+  __DSB();
+  SCB->VTOR = (uint32_t)isr_vectors;
+  __DSB();
+  __ISB();
+  /* a frame is reserved for the FPU registers, saved only if the interrupt
+     runs a FPU instruction */
+  FPU->FPCCR |= FPU_FPCCR_ASPEN_Msk | FPU_FPCCR_LSPEN_Msk;
+  __set_PRIMASK(primask);
+#ifdef USE_AUDIO_PROFILER
+  isr_latency_last_tick = HAL_GetTick();
+  HAL_NVIC_SetPriority(AUDIO_ISR_LATENCY_IRQn, AUDIO_ISR_LATENCY_PRIORITY, 0);
+  HAL_NVIC_EnableIRQ(AUDIO_ISR_LATENCY_IRQn);
+#endif /* USE_AUDIO_PROFILER */
+}
+
+#ifdef USE_AUDIO_PROFILER
+/**
+  * @brief  AUDIO_IsrLatencyPoll
+  *         pends the probe interrupt once per period, from the main loop. The
+  *         delay to its handler is recorded in AUDIO_PROF_IRQ_ENTRY
+  * @param  None
+  * @retval None
+  */
+void AUDIO_IsrLatencyPoll(void)
+{
+  uint32_t tick = HAL_GetTick();
+
+  if((tick - isr_latency_last_tick) < AUDIO_ISR_LATENCY_PERIOD_MS)
+  {
+    return;
+  }
+  isr_latency_last_tick = tick;
+  isr_latency_pend_time = DWT->CYCCNT;
+  NVIC_SetPendingIRQ(AUDIO_ISR_LATENCY_IRQn);
+  __DSB();
+  __ISB();
+}
+
+/**
+  * @brief  AUDIO_IsrLatencyIRQHandler
+  *         handler of the probe interrupt, the NVIC write of the pend is
+  *         included in the latency
+  * @param  None
+  * @retval None
+  */
+void AUDIO_IsrLatencyIRQHandler(void)
+{
+  AUDIO_ProfilerRecord(AUDIO_PROF_IRQ_ENTRY, DWT->CYCCNT - isr_latency_pend_time);
+}
+#endif /* USE_AUDIO_PROFILER */
+#endif /* USE_AUDIO_ISR_LATENCY */
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    audio_isr_latency.h
+  * @brief   header file for the audio_isr_latency.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_ISR_LATENCY_H
+#define __AUDIO_ISR_LATENCY_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "stm32h7xx.h"
+#include "audio_profiler.h"
+
+#ifdef USE_AUDIO_ISR_LATENCY
+/* Exported constants --------------------------------------------------------*/
+/* 16 system vectors and the 163 interrupts of the STM32H723 startup table */
+#define AUDIO_ISR_VECTOR_COUNT            179U
+/* the table is aligned on the power of two above its size */
+#define AUDIO_ISR_VECTOR_ALIGN            1024U
+
+#ifdef USE_AUDIO_PROFILER
+/* entry latency probe */
+#ifndef AUDIO_ISR_LATENCY_IRQn
+#define AUDIO_ISR_LATENCY_IRQn            DCMI_PSSI_IRQn /* not used by the application, pended by software */
+#define AUDIO_ISR_LATENCY_IRQHandler      DCMI_PSSI_IRQHandler
+#endif /* AUDIO_ISR_LATENCY_IRQn */
+#define AUDIO_ISR_LATENCY_PRIORITY        0U  /* the level of OTG_HS */
+#define AUDIO_ISR_LATENCY_PERIOD_MS       1U
+
+/* Exported macros -----------------------------------------------------------*/
+/* an interrupt which runs a FPU instruction stacks the lazy FPU frame of the
+   code it preempted, LSPACT goes from 1 to 0. Seen when the preempted code had
+   live FPU state, the pump float processing. END records the interrupt in
+   AUDIO_PROF_ISR_FPU, an interrupt preempted by one using the FPU is counted too */
+#define AUDIO_ISR_FPU_BEGIN()             uint32_t audio_isr_fpu_start = DWT->CYCCNT; \
+                                          uint32_t audio_isr_fpu_lazy = FPU->FPCCR & FPU_FPCCR_LSPACT_Msk
+#define AUDIO_ISR_FPU_END()               do { if((audio_isr_fpu_lazy != 0U) && \
+                                                  ((FPU->FPCCR & FPU_FPCCR_LSPACT_Msk) == 0U)) { \
+                                                 AUDIO_ProfilerRecord(AUDIO_PROF_ISR_FPU, DWT->CYCCNT - audio_isr_fpu_start); } \
+                                          } while(0)
+#endif /* USE_AUDIO_PROFILER */
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_IsrLatencyInit(void);
+#ifdef USE_AUDIO_PROFILER
+void    AUDIO_IsrLatencyPoll(void);
+void    AUDIO_IsrLatencyIRQHandler(void);
+#endif /* USE_AUDIO_PROFILER */
+#endif /* USE_AUDIO_ISR_LATENCY */
+
+#if !((defined USE_AUDIO_ISR_LATENCY) && (defined USE_AUDIO_PROFILER))
+#define AUDIO_ISR_FPU_BEGIN()
+#define AUDIO_ISR_FPU_END()
+#endif /* USE_AUDIO_ISR_LATENCY && USE_AUDIO_PROFILER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_ISR_LATENCY_H */
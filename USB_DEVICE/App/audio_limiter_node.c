@@ -0,0 +1,346 @@
+/**
+  ******************************************************************************
+  * @file    audio_limiter_node.c
+  * @brief   Look-ahead limiter : the played frames are delayed by
+  *          AUDIO_LIMITER_LOOKAHEAD_FRAMES while one gain for all channels
+  *          follows the peak of the incoming frames, so it is down to the
+  *          threshold when a peak leaves the delay. Fixed point Q31, the
+  *          gain update has no branch.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_limiter_node.h"
+
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+#if (AUDIO_LIMITER_LOOKAHEAD_FRAMES & (AUDIO_LIMITER_LOOKAHEAD_FRAMES - 1U)) != 0U
+#error "AUDIO_LIMITER_LOOKAHEAD_FRAMES must be a power of two"
+#endif /* AUDIO_LIMITER_LOOKAHEAD_FRAMES */
+#if (AUDIO_LIMITER_ATTACK_FRAMES == 0U) || (AUDIO_LIMITER_RELEASE_FRAMES == 0U)
+#error "AUDIO_LIMITER_ATTACK_FRAMES and AUDIO_LIMITER_RELEASE_FRAMES must not be zero"
+#endif /* AUDIO_LIMITER_ATTACK_FRAMES */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_LIMITER_MUL(x, gain)      ((int32_t)(((int64_t)(x) * (gain)) >> 31))
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_LimiterDeInit(uint32_t node_handle);
+static int8_t  AUDIO_LimiterStart(uint32_t node_handle);
+static int8_t  AUDIO_LimiterStop(uint32_t node_handle);
+static int8_t  AUDIO_LimiterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static int8_t  AUDIO_LimiterProcessFloat(float* planes, uint32_t stride, uint32_t frames,
+                                         uint32_t node_handle) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LimiterInit
+  *         Initializes the limiter node with the build time threshold and
+  *         time constants
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      limiter node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_LimiterInit(AUDIO_DescriptionTypeDef* audio_description,
+                          AUDIO_SessionTypeDef* session_handle,
+                          uint32_t node_handle)
+{
+  AUDIO_Limiter_NodeTypeDef* limiter = (AUDIO_Limiter_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(limiter, 0, sizeof(AUDIO_Limiter_NodeTypeDef));
+  limiter->processing.node.state = AUDIO_NODE_INITIALIZED;
+  limiter->processing.node.type = AUDIO_PROCESSING;
+  limiter->processing.node.session_handle = session_handle;
+  limiter->processing.node.audio_description = audio_description;
+  /* only conversion from dB, done once */
+  limiter->threshold = (int32_t)(powf(10.0f, (float)AUDIO_LIMITER_THRESHOLD_DB_256 / (256.0f * 20.0f)) * 2147483647.0f);
+  limiter->attack = AUDIO_LIMITER_GAIN_UNITY / (int32_t)AUDIO_LIMITER_ATTACK_FRAMES;
+  limiter->release = AUDIO_LIMITER_GAIN_UNITY / (int32_t)AUDIO_LIMITER_RELEASE_FRAMES;
+
+  limiter->LimiterDeInit = AUDIO_LimiterDeInit;
+  limiter->LimiterStart = AUDIO_LimiterStart;
+  limiter->LimiterStop = AUDIO_LimiterStop;
+  limiter->processing.Process = AUDIO_LimiterProcess;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  limiter->processing.ProcessFloat = AUDIO_LimiterProcessFloat;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LimiterDeInit
+  *         De-Initializes the limiter node
+  * @param  node_handle: limiter node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LimiterDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Limiter_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LimiterStart
+  *         Starts limiting from a silent delay at unity gain
+  * @param  node_handle: limiter node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LimiterStart(uint32_t node_handle)
+{
+  AUDIO_Limiter_NodeTypeDef* limiter = (AUDIO_Limiter_NodeTypeDef*)node_handle;
+
+  memset(limiter->delay, 0, sizeof(limiter->delay));
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  memset(limiter->delay_float, 0, sizeof(limiter->delay_float));
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  limiter->position = 0;
+  limiter->gain = AUDIO_LIMITER_GAIN_UNITY;
+  limiter->gain_min = AUDIO_LIMITER_GAIN_UNITY;
+  limiter->hold = 0;
+  limiter->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LimiterStop
+  *         Stops limiting, packets are left untouched
+  * @param  node_handle: limiter node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LimiterStop(uint32_t node_handle)
+{
+  ((AUDIO_Limiter_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LimiterTrack
+  *         moves the gain toward the one bringing the incoming frame peak to
+  *         the threshold : down with the attack constant, held while a peak
+  *         is in the delay, then up with the release constant. Selects
+  *         only, no branch
+  * @param  limiter: limiter node
+  * @param  peak: largest Q31 magnitude of the incoming frame
+  * @retval None
+  */
+__STATIC_FORCEINLINE void AUDIO_LimiterTrack(AUDIO_Limiter_NodeTypeDef* limiter, uint32_t peak)
+{
+  uint32_t over = (peak > (uint32_t)limiter->threshold);
+  /* Q15 division, UDIV is a few cycles */
+  uint32_t ratio = (((uint32_t)limiter->threshold >> 16) << 15) / ((peak >> 16) | 1U);
+  int32_t target = over ? (int32_t)(ratio << 16) : AUDIO_LIMITER_GAIN_UNITY;
+  int32_t coef;
+
+  limiter->hold = over ? AUDIO_LIMITER_LOOKAHEAD_FRAMES : (limiter->hold - (limiter->hold != 0U));
+  coef = (target < limiter->gain) ? limiter->attack : ((limiter->hold != 0U) ? 0 : limiter->release);
+  limiter->gain += AUDIO_LIMITER_MUL(target - limiter->gain, coef);
+  limiter->gain_min = (limiter->gain < limiter->gain_min) ? limiter->gain : limiter->gain_min;
+}
+
+/**
+  * @brief  AUDIO_LimiterMagnitude
+  *         magnitude of a Q31 sample, no branch
+  * @param  x: sample
+  * @retval magnitude , 0x80000000 for the most negative sample
+  */
+__STATIC_FORCEINLINE uint32_t AUDIO_LimiterMagnitude(int32_t x)
+{
+  int32_t sign = x >> 31;
+
+  return (uint32_t)((x ^ sign) - sign);
+}
+
+/**
+  * @brief  AUDIO_LimiterProcess
+  *         delays the frames by the look-ahead and applies the gain tracked
+  *         on the incoming ones. Samples are 2, 3 or 4 bytes little endian
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  node_handle: limiter node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LimiterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Limiter_NodeTypeDef* limiter = (AUDIO_Limiter_NodeTypeDef*)node_handle;
+  uint8_t channels = limiter->processing.node.audio_description->channels_count;
+  uint32_t position = limiter->position;
+  int32_t* delayed;
+  uint32_t peak;
+  uint32_t i;
+  uint8_t ch;
+  int32_t x;
+  int32_t y;
+
+  switch(limiter->processing.node.audio_description->audio_res)
+  {
+    case 2:
+    {
+      int16_t* src = (int16_t*)in;
+      int16_t* dst = (int16_t*)out;
+
+      for(i = 0; i < frames; i++)
+      {
+        peak = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = (int32_t)src[ch] << 16;
+          peak = (AUDIO_LimiterMagnitude(x) > peak) ? AUDIO_LimiterMagnitude(x) : peak;
+        }
+        AUDIO_LimiterTrack(limiter, peak);
+        delayed = limiter->delay[position];
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = (int32_t)src[ch] << 16;
+          dst[ch] = (int16_t)(AUDIO_LIMITER_MUL(delayed[ch], limiter->gain) >> 16);
+          delayed[ch] = x;
+        }
+        position = (position + 1U) & (AUDIO_LIMITER_LOOKAHEAD_FRAMES - 1U);
+        src += channels;
+        dst += channels;
+      }
+      break;
+    }
+    case 3:
+    {
+      uint8_t* src = in;
+      uint8_t* dst = out;
+
+      for(i = 0; i < frames; i++)
+      {
+        peak = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = (int32_t)(((uint32_t)src[3 * ch] << 8) | ((uint32_t)src[3 * ch + 1] << 16) |
+                        ((uint32_t)src[3 * ch + 2] << 24));
+          peak = (AUDIO_LimiterMagnitude(x) > peak) ? AUDIO_LimiterMagnitude(x) : peak;
+        }
+        AUDIO_LimiterTrack(limiter, peak);
+        delayed = limiter->delay[position];
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = (int32_t)(((uint32_t)src[3 * ch] << 8) | ((uint32_t)src[3 * ch + 1] << 16) |
+                        ((uint32_t)src[3 * ch + 2] << 24));
+          y = AUDIO_LIMITER_MUL(delayed[ch], limiter->gain);
+          dst[3 * ch] = (uint8_t)(y >> 8);
+          dst[3 * ch + 1] = (uint8_t)(y >> 16);
+          dst[3 * ch + 2] = (uint8_t)(y >> 24);
+          delayed[ch] = x;
+        }
+        position = (position + 1U) & (AUDIO_LIMITER_LOOKAHEAD_FRAMES - 1U);
+        src += 3 * channels;
+        dst += 3 * channels;
+      }
+      break;
+    }
+    case 4:
+    {
+      int32_t* src = (int32_t*)in;
+      int32_t* dst = (int32_t*)out;
+
+      for(i = 0; i < frames; i++)
+      {
+        peak = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          peak = (AUDIO_LimiterMagnitude(src[ch]) > peak) ? AUDIO_LimiterMagnitude(src[ch]) : peak;
+        }
+        AUDIO_LimiterTrack(limiter, peak);
+        delayed = limiter->delay[position];
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = src[ch];
+          dst[ch] = AUDIO_LIMITER_MUL(delayed[ch], limiter->gain);
+          delayed[ch] = x;
+        }
+        position = (position + 1U) & (AUDIO_LIMITER_LOOKAHEAD_FRAMES - 1U);
+        src += channels;
+        dst += channels;
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+  limiter->position = position;
+  return 0;
+}
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/**
+  * @brief  AUDIO_LimiterProcessFloat
+  *         float variant of the process : the gain follows the frame peak as
+  *         in AUDIO_LimiterTrack, a peak above full scale included, the
+  *         delayed frames are floats
+  * @param  planes: float planes, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  frames: frames count
+  * @param  node_handle: limiter node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LimiterProcessFloat(float* planes, uint32_t stride, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Limiter_NodeTypeDef* limiter = (AUDIO_Limiter_NodeTypeDef*)node_handle;
+  uint8_t channels = limiter->processing.node.audio_description->channels_count;
+  uint32_t position = limiter->position;
+  float threshold = (float)limiter->threshold * (1.0f / 2147483648.0f);
+  float attack = (float)limiter->attack * (1.0f / 2147483648.0f);
+  float release = (float)limiter->release * (1.0f / 2147483648.0f);
+  float gain = (float)limiter->gain * (1.0f / 2147483648.0f);
+  float gain_min = (float)limiter->gain_min * (1.0f / 2147483648.0f);
+  float* delayed;
+  float peak, target, coef, x;
+  uint32_t over;
+  uint32_t i;
+  uint8_t ch;
+
+  for(i = 0; i < frames; i++)
+  {
+    peak = 0.0f;
+    for(ch = 0; ch < channels; ch++)
+    {
+      x = fabsf(planes[ch * stride + i]);
+      peak = (x > peak) ? x : peak;
+    }
+    over = (peak > threshold);
+    target = over ? (threshold / peak) : 1.0f;
+    limiter->hold = over ? AUDIO_LIMITER_LOOKAHEAD_FRAMES : (limiter->hold - (limiter->hold != 0U));
+    coef = (target < gain) ? attack : ((limiter->hold != 0U) ? 0.0f : release);
+    gain += (target - gain) * coef;
+    gain_min = (gain < gain_min) ? gain : gain_min;
+    delayed = limiter->delay_float[position];
+    for(ch = 0; ch < channels; ch++)
+    {
+      x = planes[ch * stride + i];
+      planes[ch * stride + i] = delayed[ch] * gain;
+      delayed[ch] = x;
+    }
+    position = (position + 1U) & (AUDIO_LIMITER_LOOKAHEAD_FRAMES - 1U);
+  }
+  limiter->position = position;
+  limiter->gain = (gain >= 1.0f) ? AUDIO_LIMITER_GAIN_UNITY : (int32_t)(gain * 2147483648.0f);
+  limiter->gain_min = (gain_min >= 1.0f) ? AUDIO_LIMITER_GAIN_UNITY : (int32_t)(gain_min * 2147483648.0f);
+  return 0;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
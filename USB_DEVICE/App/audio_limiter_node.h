@@ -0,0 +1,80 @@
+/**
+  ******************************************************************************
+  * @file    audio_limiter_node.h
+  * @brief   header file for the audio_limiter_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_LIMITER_NODE_H
+#define __AUDIO_LIMITER_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+/* Exported constants --------------------------------------------------------*/
+/* delay of the played frames, the gain is down before a peak leaves it :
+   1.3 ms at 48 kHz, must be a power of two */
+#ifndef AUDIO_LIMITER_LOOKAHEAD_FRAMES
+#define AUDIO_LIMITER_LOOKAHEAD_FRAMES  64U
+#endif /* AUDIO_LIMITER_LOOKAHEAD_FRAMES */
+/* ceiling of the output, -1 dB */
+#ifndef AUDIO_LIMITER_THRESHOLD_DB_256
+#define AUDIO_LIMITER_THRESHOLD_DB_256  (-256)
+#endif /* AUDIO_LIMITER_THRESHOLD_DB_256 */
+/* time constants in frames, the attack one is well below the look-ahead */
+#ifndef AUDIO_LIMITER_ATTACK_FRAMES
+#define AUDIO_LIMITER_ATTACK_FRAMES     (AUDIO_LIMITER_LOOKAHEAD_FRAMES / 4U)
+#endif /* AUDIO_LIMITER_ATTACK_FRAMES */
+#ifndef AUDIO_LIMITER_RELEASE_FRAMES
+#define AUDIO_LIMITER_RELEASE_FRAMES    4800U
+#endif /* AUDIO_LIMITER_RELEASE_FRAMES */
+#define AUDIO_LIMITER_GAIN_UNITY        0x7FFFFFFF /* Q31 */
+
+/* Exported types ------------------------------------------------------------*/
+/* look-ahead limiter node : one gain for all channels follows the frame peak */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  int32_t            delay[AUDIO_LIMITER_LOOKAHEAD_FRAMES][AUDIO_MAX_SUPPORTED_CHANNEL_COUNT]; /* Q31 frames */
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  float              delay_float[AUDIO_LIMITER_LOOKAHEAD_FRAMES][AUDIO_MAX_SUPPORTED_CHANNEL_COUNT]; /* frames above full scale kept */
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  uint32_t           position;       /* oldest frame of delay, replaced by the incoming one */
+  int32_t            gain;           /* Q31 , applied to the oldest frame */
+  uint32_t           hold;           /* frames the gain is held, the peak is still in the delay */
+  int32_t            threshold;      /* Q31 magnitude */
+  int32_t            attack;         /* Q31 one pole coefficients */
+  int32_t            release;
+  int32_t            gain_min;       /* lowest gain since start, for tuning */
+  int8_t            (*LimiterDeInit) (uint32_t /*node_handle*/);
+  int8_t            (*LimiterStart)  (uint32_t /*node_handle*/);
+  int8_t            (*LimiterStop)   (uint32_t /*node_handle*/);
+}
+AUDIO_Limiter_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_LimiterInit(AUDIO_DescriptionTypeDef* audio_description,
+                          AUDIO_SessionTypeDef* session_handle,
+                          uint32_t node_handle);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_LIMITER_NODE_H */
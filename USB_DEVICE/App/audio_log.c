@@ -0,0 +1,253 @@
+/**
+  ******************************************************************************
+  * @file    audio_log.c
+  * @brief   Text log : _write copies the printf output, USBD_UsrLog, ErrLog
+  *          and DbgLog included, in one ring and returns, the pump sends it
+  *          on ITM or on the CDC IN endpoint. A write which doesn't fit is
+  *          dropped and counted, so logs may stay enabled from the USB
+  *          interrupt without blocking on the link.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "audio_log.h"
+
+#ifdef USE_AUDIO_LOG
+#include "stm32h7xx.h"
+#include "usbd_conf.h"
+#include "audio_pump.h"
+#ifndef USE_AUDIO_LOG_ITM
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#include "usbd_cdc_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#endif /* USE_AUDIO_LOG_ITM */
+
+#if (AUDIO_LOG_RING_SIZE & (AUDIO_LOG_RING_SIZE - 1U)) != 0U
+#error "AUDIO_LOG_RING_SIZE must be a power of two"
+#endif /* AUDIO_LOG_RING_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_LOG_NOTICE_SIZE             40U
+
+/* Private variables ---------------------------------------------------------*/
+/* any context may write , the pump is the only reader */
+static char              log_ring[AUDIO_LOG_RING_SIZE] USBD_DEBUG_BSS;
+static volatile uint32_t log_wr = 0;        /* free running , claimed by the writers */
+static volatile uint32_t log_done = 0;      /* free running , bytes copied by the writers */
+static volatile uint32_t log_rd = 0;        /* free running , next byte to send */
+static volatile uint32_t log_lost = 0;      /* bytes dropped on a full ring */
+static uint32_t          log_reported = 0;  /* lost bytes already told in the log */
+static char              log_notice[AUDIO_LOG_NOTICE_SIZE];
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_LogDrain(void);
+static void    AUDIO_LogAdd(volatile uint32_t* counter, uint32_t value);
+static uint8_t AUDIO_LogSend(const char* data, uint32_t length);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LogInit
+  *         clears the ring and sets the pump handler, after AUDIO_PumpInit.
+  *         stdout is made unbuffered, each printf then reaches _write on its
+  *         own stack buffer and printf may be called from interrupts
+  * @param  None
+  * @retval None
+  */
+void AUDIO_LogInit(void)
+{
+  log_wr = 0;
+  log_done = 0;
+  log_rd = 0;
+  log_lost = 0;
+  log_reported = 0;
+  setvbuf(stdout, NULL, _IONBF, 0);
+  AUDIO_PumpSetHandler(AUDIO_PUMP_LOG, AUDIO_LogDrain);
+}
+
+/**
+  * @brief  AUDIO_LogWrite
+  *         copies text in the ring, from any context
+  * @param  text: bytes to log
+  * @param  length: number of bytes
+  * @retval length if queued, 0 if dropped on a full ring
+  */
+uint32_t AUDIO_LogWrite(const char* text, uint32_t length)
+{
+  uint32_t wr;
+  uint32_t start;
+  uint32_t first;
+
+  if((length == 0U) || (length > AUDIO_LOG_RING_SIZE))
+  {
+    AUDIO_LogAdd(&log_lost, length);
+    return 0;
+  }
+  do
+  {
+    wr = __LDREXW(&log_wr);
+    if(((wr + length) - log_rd) > AUDIO_LOG_RING_SIZE)
+    {
+      /* never waits for the link */
+      __CLREX();
+      AUDIO_LogAdd(&log_lost, length);
+      return 0;
+    }
+  }
+  while(__STREXW(wr + length, &log_wr) != 0U);
+
+  start = wr & (AUDIO_LOG_RING_SIZE - 1U);
+  first = AUDIO_LOG_RING_SIZE - start;
+  first = (length < first) ? length : first;
+  memcpy(&log_ring[start], text, first);
+  memcpy(log_ring, &text[first], length - first);
+  __DMB();
+  AUDIO_LogAdd(&log_done, length);
+  AUDIO_PumpPost(AUDIO_PUMP_LOG);
+  return length;
+}
+
+/**
+  * @brief  AUDIO_LogGetLost
+  *         bytes dropped since AUDIO_LogInit
+  * @param  None
+  * @retval dropped bytes
+  */
+uint32_t AUDIO_LogGetLost(void)
+{
+  return log_lost;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LogDrain
+  *         pump handler, run when text is written and when a CDC transfer
+  *         completes. Sends the ring until it is empty or the link is busy,
+  *         then tells the bytes dropped since the last notice
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_LogDrain(void)
+{
+  uint32_t done;
+  uint32_t rd;
+  uint32_t start;
+  uint32_t length;
+  uint32_t lost;
+  int      notice;
+
+  while(1)
+  {
+    done = log_done;
+    __DMB();
+    if(log_wr != done)
+    {
+      /* a writer was interrupted in its copy , the last one to finish posts the pump */
+      return;
+    }
+    rd = log_rd;
+    if(rd == done)
+    {
+      break;
+    }
+    start = rd & (AUDIO_LOG_RING_SIZE - 1U);
+    length = done - rd;
+    length = (length < (AUDIO_LOG_RING_SIZE - start)) ? length : (AUDIO_LOG_RING_SIZE - start);
+    length = (length < AUDIO_LOG_BLOCK_SIZE) ? length : AUDIO_LOG_BLOCK_SIZE;
+    if(AUDIO_LogSend(&log_ring[start], length) != 0U)
+    {
+      /* link busy, sent again on transfer complete */
+      return;
+    }
+    __DMB();
+    log_rd = rd + length;
+  }
+  lost = log_lost;
+  if(lost != log_reported)
+  {
+    notice = snprintf(log_notice, sizeof(log_notice), "\r\n[log] %lu bytes lost\r\n",
+                      (unsigned long)(lost - log_reported));
+    if((notice > 0) && (AUDIO_LogSend(log_notice, (uint32_t)notice) == 0U))
+    {
+      log_reported = lost;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_LogAdd
+  *         adds to a counter shared by the writers
+  * @param  counter: counter
+  * @param  value: value to add
+  * @retval None
+  */
+static void AUDIO_LogAdd(volatile uint32_t* counter, uint32_t value)
+{
+  uint32_t count;
+
+  do
+  {
+    count = __LDREXW(counter);
+  }
+  while(__STREXW(count + value, counter) != 0U);
+}
+
+#ifdef USE_AUDIO_LOG_ITM
+/**
+  * @brief  AUDIO_LogSend
+  *         writes text on the ITM stimulus port, the text is dropped when no
+  *         debugger enabled the port
+  * @param  data: text
+  * @param  length: length in bytes
+  * @retval 0, ITM is never busy
+  */
+static uint8_t AUDIO_LogSend(const char* data, uint32_t length)
+{
+  uint32_t i;
+
+  if(((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0U) || ((ITM->TER & (1UL << AUDIO_LOG_ITM_PORT)) == 0U))
+  {
+    return 0;
+  }
+  for(i = 0; i < length; i++)
+  {
+    while(ITM->PORT[AUDIO_LOG_ITM_PORT].u32 == 0U) {}
+    ITM->PORT[AUDIO_LOG_ITM_PORT].u8 = (uint8_t)data[i];
+  }
+  return 0;
+}
+#else /* USE_AUDIO_LOG_ITM */
+/**
+  * @brief  AUDIO_LogSend
+  *         queues text on the CDC IN endpoint, the telemetry CDC one with
+  *         USE_AUDIO_CDC_TELEMETRY
+  * @param  data: text
+  * @param  length: length in bytes
+  * @retval 0 if queued, 1 if the CDC transmit ring is full
+  */
+static uint8_t AUDIO_LogSend(const char* data, uint32_t length)
+{
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  return (CDC_TLM_Transmit((uint8_t*)data, (uint16_t)length) != USBD_OK) ? 1U : 0U;
+#elif (defined USE_AUDIO_CDC_TX_COALESCE)
+  /* log lines are not awaited , they share packets */
+  return (CDC_TransmitPolicy_FS((uint8_t*)data, (uint16_t)length, CDC_TX_COALESCE) != USBD_OK) ? 1U : 0U;
+#else /* USE_AUDIO_CDC_TELEMETRY */
+  return (CDC_Transmit_FS((uint8_t*)data, (uint16_t)length) != USBD_OK) ? 1U : 0U;
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+}
+#endif /* USE_AUDIO_LOG_ITM */
+#endif /* USE_AUDIO_LOG */
@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file    audio_log.h
+  * @brief   header file for the audio_log.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_LOG_H
+#define __AUDIO_LOG_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_LOG
+/* Exported constants --------------------------------------------------------*/
+#ifndef AUDIO_LOG_RING_SIZE
+#define AUDIO_LOG_RING_SIZE               2048U /* bytes, must be a power of two */
+#endif /* AUDIO_LOG_RING_SIZE */
+#define AUDIO_LOG_BLOCK_SIZE              256U  /* max bytes per CDC transmit */
+/* with USE_AUDIO_LOG_ITM the text goes out on this stimulus port , port 0 is used by
+   the profiler text dump and port 1 by the trace. Otherwise it is sent on the CDC IN
+   endpoint, the telemetry CDC one with USE_AUDIO_CDC_TELEMETRY */
+#define AUDIO_LOG_ITM_PORT                2U
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_LogInit(void);
+uint32_t AUDIO_LogWrite(const char* text, uint32_t length);
+uint32_t AUDIO_LogGetLost(void);
+#endif /* USE_AUDIO_LOG */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_LOG_H */
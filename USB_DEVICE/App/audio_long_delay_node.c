@@ -0,0 +1,485 @@
+/**
+  ******************************************************************************
+  * @file    audio_long_delay_node.c
+  * @brief   Long delay of the played frames, backed by a PSRAM on OCTOSPI in
+  *          memory mapped mode. The packet path writes each packet to a write
+  *          behind window and plays from a read ahead window, both in D2
+  *          SRAM : it never waits on the mapped memory. The MDMA moves the
+  *          write window to the store in blocks of AUDIO_LONG_DELAY_BATCH_PACKETS
+  *          packets and keeps AUDIO_LONG_DELAY_PREFETCH_PACKETS packets
+  *          fetched ahead, one block at a time on its own copy engine.
+  *          The OCTOSPI and the PSRAM are set up by the board code, before the
+  *          playback starts. MPU_Config maps the store full access and not
+  *          cacheable : the short copies the copy engine does itself and its
+  *          fallback on a MDMA error are the only CPU accesses.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_long_delay_node.h"
+
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+#include "stm32h7xx.h"
+#include "usbd_conf.h"
+#include "audio_copy.h"
+#include "audio_fast_copy.h"
+#include "audio_user_devices.h"
+
+#ifndef USE_AUDIO_MDMA_COPY
+#error "USE_AUDIO_PLAYBACK_LONG_DELAY moves the frames to the PSRAM with the copy engine, USE_AUDIO_MDMA_COPY is required"
+#endif /* USE_AUDIO_MDMA_COPY */
+#if (AUDIO_LONG_DELAY_HOT_SIZE & (AUDIO_LONG_DELAY_HOT_SIZE - 1U)) != 0U
+#error "AUDIO_LONG_DELAY_HOT_SIZE must be a power of two"
+#endif /* AUDIO_LONG_DELAY_HOT_SIZE */
+#if (AUDIO_LONG_DELAY_STORE_SIZE & (AUDIO_LONG_DELAY_STORE_SIZE - 1U)) != 0U
+#error "AUDIO_LONG_DELAY_STORE_SIZE must be a power of two"
+#endif /* AUDIO_LONG_DELAY_STORE_SIZE */
+#if AUDIO_LONG_DELAY_STORE_SIZE < (8U * AUDIO_LONG_DELAY_HOT_SIZE)
+#error "AUDIO_LONG_DELAY_STORE_SIZE must be at least eight times AUDIO_LONG_DELAY_HOT_SIZE"
+#endif /* AUDIO_LONG_DELAY_STORE_SIZE */
+#if (AUDIO_LONG_DELAY_STORE_BASE & (AUDIO_LONG_DELAY_STORE_SIZE - 1U)) != 0U
+#error "AUDIO_LONG_DELAY_STORE_BASE must be aligned on AUDIO_LONG_DELAY_STORE_SIZE, it is one MPU region"
+#endif /* AUDIO_LONG_DELAY_STORE_BASE */
+#if (AUDIO_LONG_DELAY_BATCH_PACKETS == 0U) || (AUDIO_LONG_DELAY_PREFETCH_PACKETS == 0U)
+#error "AUDIO_LONG_DELAY_BATCH_PACKETS and AUDIO_LONG_DELAY_PREFETCH_PACKETS must not be zero"
+#endif /* AUDIO_LONG_DELAY_BATCH_PACKETS */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_LONG_DELAY_HOT_MASK         (AUDIO_LONG_DELAY_HOT_SIZE - 1U)
+
+/* Private variables ---------------------------------------------------------*/
+/* read and written by the MDMA, so in D2 SRAM which is not cached */
+static uint8_t long_delay_hot_in[AUDIO_LONG_DELAY_HOT_SIZE] __ALIGNED(32) USBD_D2_BSS;
+static uint8_t long_delay_hot_out[AUDIO_LONG_DELAY_HOT_SIZE] __ALIGNED(32) USBD_D2_BSS;
+/* kept over the sessions */
+static uint16_t long_delay_ms = AUDIO_LONG_DELAY_MS;
+static AUDIO_LongDelay_NodeTypeDef* long_delay_node = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_LongDelayDeInit(uint32_t node_handle);
+static int8_t  AUDIO_LongDelayStart(uint32_t node_handle);
+static int8_t  AUDIO_LongDelayStop(uint32_t node_handle);
+static int8_t  AUDIO_LongDelayProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+static void    AUDIO_LongDelayApply(AUDIO_LongDelay_NodeTypeDef* delay);
+static void    AUDIO_LongDelayKick(AUDIO_LongDelay_NodeTypeDef* delay);
+static uint8_t AUDIO_LongDelayStartJob(AUDIO_LongDelay_NodeTypeDef* delay);
+static void    AUDIO_LongDelayCopied(uint32_t private_data);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LongDelayInit
+  *         Initializes the long delay node
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      long delay node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_LongDelayInit(AUDIO_DescriptionTypeDef* audio_description,
+                            AUDIO_SessionTypeDef* session_handle,
+                            uint32_t node_handle)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = (AUDIO_LongDelay_NodeTypeDef*)node_handle;
+
+  memset(delay, 0, sizeof(AUDIO_LongDelay_NodeTypeDef));
+  delay->processing.node.state = AUDIO_NODE_INITIALIZED;
+  delay->processing.node.type = AUDIO_PROCESSING;
+  delay->processing.node.session_handle = session_handle;
+  delay->processing.node.audio_description = audio_description;
+  delay->store = (uint8_t*)AUDIO_LONG_DELAY_STORE_BASE;
+  delay->store_mask = AUDIO_LONG_DELAY_STORE_SIZE - 1U;
+
+  delay->LongDelayDeInit = AUDIO_LongDelayDeInit;
+  delay->LongDelayStart = AUDIO_LongDelayStart;
+  delay->LongDelayStop = AUDIO_LongDelayStop;
+  /* no float variant, the planes are written back before it */
+  delay->processing.Process = AUDIO_LongDelayProcess;
+  long_delay_node = delay;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelaySetMs
+  *         sets the delay, applied at the next packet. A longer delay plays
+  *         from the bytes already stored when they are enough, else silence
+  *         fills the difference. Clamped to what the store holds
+  * @param  delay_ms: delay, 0 lets the frames through
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_LongDelaySetMs(uint16_t delay_ms)
+{
+  if(delay_ms > AUDIO_LONG_DELAY_MAX_MS)
+  {
+    return -1;
+  }
+  long_delay_ms = delay_ms;
+  if(long_delay_node != 0)
+  {
+    long_delay_node->update = 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayGetStatus
+  *         state and counters of the node
+  * @param  status: status copy
+  * @retval None
+  */
+void  AUDIO_LongDelayGetStatus(AUDIO_LongDelayStatusTypeDef* status)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = long_delay_node;
+  uint32_t frequence;
+  uint32_t max_ms;
+  uint32_t primask;
+
+  memset(status, 0, sizeof(AUDIO_LongDelayStatusTypeDef));
+  status->delay_ms = long_delay_ms;
+  if((delay == 0) || (delay->processing.node.state != AUDIO_NODE_STARTED))
+  {
+    return;
+  }
+  frequence = delay->processing.node.audio_description->frequence;
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->state = (delay->delay_bytes == 0U) ? AUDIO_LONG_DELAY_BYPASS :
+                  ((delay->silence != 0U) ? AUDIO_LONG_DELAY_FILLING : AUDIO_LONG_DELAY_RUNNING);
+  status->delay_frames = delay->delay_bytes / delay->frame_size;
+  status->underruns = delay->underruns;
+  status->overflows = delay->overflows;
+  status->flushes = delay->flushes;
+  status->fetches = delay->fetches;
+  __set_PRIMASK(primask);
+  max_ms = (uint32_t)(((uint64_t)(delay->max_bytes / delay->frame_size) * 1000U) / frequence);
+  status->max_ms = (uint16_t)((max_ms > AUDIO_LONG_DELAY_MAX_MS) ? AUDIO_LONG_DELAY_MAX_MS : max_ms);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LongDelayDeInit
+  *         De-Initializes the long delay node
+  * @param  node_handle: long delay node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LongDelayDeInit(uint32_t node_handle)
+{
+  ((AUDIO_LongDelay_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_OFF;
+  long_delay_node = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayStart
+  *         Starts delaying from silence. The node stays stopped, so frames
+  *         go through, when the store is not memory mapped or a packet of the
+  *         stream format doesn't fit half a window
+  * @param  node_handle: long delay node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LongDelayStart(uint32_t node_handle)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = (AUDIO_LongDelay_NodeTypeDef*)node_handle;
+  AUDIO_DescriptionTypeDef* audio_description = delay->processing.node.audio_description;
+
+  delay->frame_size = AUDIO_SAMPLE_LENGTH(audio_description);
+  delay->packet = AUDIO_MS_MAX_PACKET_SIZE_FROM_AUD_DESC(audio_description);
+  if(((AUDIO_LONG_DELAY_OSPI->CR & OCTOSPI_CR_FMODE) != OCTOSPI_CR_FMODE) ||
+     (delay->frame_size == 0U) || (delay->packet > (AUDIO_LONG_DELAY_HOT_SIZE / 2U)))
+  {
+    delay->processing.node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+  delay->min_bytes = ((2U * AUDIO_LONG_DELAY_HOT_SIZE + delay->frame_size - 1U) / delay->frame_size) * delay->frame_size;
+  delay->max_bytes = ((AUDIO_LONG_DELAY_STORE_SIZE - 2U * AUDIO_LONG_DELAY_HOT_SIZE) / delay->frame_size) * delay->frame_size;
+  delay->job = AUDIO_LONG_DELAY_JOB_NONE;
+  delay->kicking = 0;
+  delay->delay_bytes = 0;
+  delay->underruns = 0;
+  delay->overflows = 0;
+  delay->flushes = 0;
+  delay->fetches = 0;
+  AUDIO_LongDelayApply(delay);
+  delay->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayStop
+  *         Stops delaying, the running block move is dropped
+  * @param  node_handle: long delay node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LongDelayStop(uint32_t node_handle)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = (AUDIO_LongDelay_NodeTypeDef*)node_handle;
+
+  delay->processing.node.state = AUDIO_NODE_STOPPED;
+  AUDIO_CopyAbort(AUDIO_COPY_DELAY);
+  delay->job = AUDIO_LONG_DELAY_JOB_NONE;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayProcess
+  *         stores the packet in the write window and replaces it with the
+  *         delayed one from the read window, then starts the next block move.
+  *         Missing fetched bytes are played as silence and skipped, bytes
+  *         written over before they were stored are lost : both cost a glitch
+  *         but keep the delay
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  node_handle: long delay node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_LongDelayProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = (AUDIO_LongDelay_NodeTypeDef*)node_handle;
+  uint32_t length = frames * delay->frame_size;
+  uint32_t offset;
+  uint32_t first;
+  uint32_t count;
+  int32_t  available;
+  uint32_t primask;
+
+  if(delay->update)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    /* counters are not reset under a running block move, the next packet does it */
+    if(delay->job == AUDIO_LONG_DELAY_JOB_NONE)
+    {
+      AUDIO_LongDelayApply(delay);
+    }
+    __set_PRIMASK(primask);
+  }
+  if(delay->delay_bytes == 0U)
+  {
+    if(out != in)
+    {
+      AUDIO_MEMCPY(out, in, length);
+    }
+    return 0;
+  }
+  if((length > AUDIO_LONG_DELAY_HOT_SIZE) || (length == 0U))
+  {
+    return -1;
+  }
+  delay->packet = (length > delay->packet) ? length : delay->packet;
+
+  /* write behind */
+  offset = delay->in_wr & AUDIO_LONG_DELAY_HOT_MASK;
+  first = AUDIO_LONG_DELAY_HOT_SIZE - offset;
+  first = (length < first) ? length : first;
+  AUDIO_MEMCPY(long_delay_hot_in + offset, in, first);
+  AUDIO_MEMCPY(long_delay_hot_in, in + first, length - first);
+  delay->in_wr += length;
+  delay->written += length;
+  delay->written = (delay->written > AUDIO_LONG_DELAY_STORE_SIZE) ? AUDIO_LONG_DELAY_STORE_SIZE : delay->written;
+  if((delay->in_wr - delay->in_rd) > AUDIO_LONG_DELAY_HOT_SIZE)
+  {
+    delay->overflows++;
+  }
+
+  /* silence until the store holds the delay, then read ahead */
+  count = (delay->silence < length) ? delay->silence : length;
+  memset(out, 0, count);
+  delay->silence -= count;
+  out += count;
+  length -= count;
+  if(length != 0U)
+  {
+    available = (int32_t)(delay->out_wr - delay->out_rd);
+    count = (available <= 0) ? 0U : (((uint32_t)available < length) ? (uint32_t)available : length);
+    offset = delay->out_rd & AUDIO_LONG_DELAY_HOT_MASK;
+    first = AUDIO_LONG_DELAY_HOT_SIZE - offset;
+    first = (count < first) ? count : first;
+    AUDIO_MEMCPY(out, long_delay_hot_out + offset, first);
+    AUDIO_MEMCPY(out + first, long_delay_hot_out, count - first);
+    if(count < length)
+    {
+      memset(out + count, 0, length - count);
+      delay->underruns++;
+    }
+    delay->out_rd += length;
+  }
+  AUDIO_LongDelayKick(delay);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayApply
+  *         applies the requested delay, no block move is running. The output
+  *         goes on from the stored bytes when they cover the delay
+  * @param  delay: long delay node
+  * @retval None
+  */
+static void  AUDIO_LongDelayApply(AUDIO_LongDelay_NodeTypeDef* delay)
+{
+  uint32_t frequence = delay->processing.node.audio_description->frequence;
+  uint32_t bytes;
+
+  delay->update = 0;
+  bytes = (uint32_t)(((uint64_t)long_delay_ms * frequence) / 1000U) * delay->frame_size;
+  if(bytes == 0U)
+  {
+    delay->delay_bytes = 0;
+    return;
+  }
+  bytes = (bytes < delay->min_bytes) ? delay->min_bytes : ((bytes > delay->max_bytes) ? delay->max_bytes : bytes);
+  if(delay->delay_bytes == 0U)
+  {
+    /* from bypass or start, nothing is stored */
+    delay->in_wr = 0;
+    delay->in_rd = 0;
+    delay->written = 0;
+  }
+  delay->silence = (delay->written >= bytes) ? 0U : (bytes - delay->written);
+  delay->out_rd = delay->in_wr - (bytes - delay->silence);
+  delay->out_wr = delay->out_rd;
+  delay->delay_bytes = bytes;
+}
+
+/**
+  * @brief  AUDIO_LongDelayKick
+  *         starts block moves until one runs or none is due. Called from the
+  *         packet path and from the end of a move
+  * @param  delay: long delay node
+  * @retval None
+  */
+static void  AUDIO_LongDelayKick(AUDIO_LongDelay_NodeTypeDef* delay)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  /* a copy done by the CPU ends inside the call, the loop starts the next one */
+  if((delay->job == AUDIO_LONG_DELAY_JOB_NONE) && (delay->kicking == 0U))
+  {
+    delay->kicking = 1;
+    while(AUDIO_LongDelayStartJob(delay) && (delay->job == AUDIO_LONG_DELAY_JOB_NONE))
+    {
+    }
+    delay->kicking = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_LongDelayStartJob
+  *         starts the fetch of the bytes missing ahead of the playout, else
+  *         the store of a batch of the write window. Neither side of a move
+  *         wraps in its window, the store one may wrap in the store
+  * @param  delay: long delay node
+  * @retval 1 if a move was started
+  */
+static uint8_t  AUDIO_LongDelayStartJob(AUDIO_LongDelay_NodeTypeDef* delay)
+{
+  uint32_t target = AUDIO_LONG_DELAY_PREFETCH_PACKETS * delay->packet;
+  uint32_t batch = AUDIO_LONG_DELAY_BATCH_PACKETS * delay->packet;
+  uint32_t level;
+  uint32_t length;
+  uint32_t offset;
+  uint32_t limit;
+  int32_t  fetchable;
+
+  target = (target > (AUDIO_LONG_DELAY_HOT_SIZE / 2U)) ? (AUDIO_LONG_DELAY_HOT_SIZE / 2U) : target;
+  batch = (batch > (AUDIO_LONG_DELAY_HOT_SIZE / 2U)) ? (AUDIO_LONG_DELAY_HOT_SIZE / 2U) : batch;
+  /* late bytes were played as silence, they are not fetched anymore */
+  if((int32_t)(delay->out_wr - delay->out_rd) < 0)
+  {
+    delay->out_wr = delay->out_rd;
+  }
+  /* overwritten bytes are not stored */
+  if((delay->in_wr - delay->in_rd) > AUDIO_LONG_DELAY_HOT_SIZE)
+  {
+    delay->in_rd = delay->in_wr - AUDIO_LONG_DELAY_HOT_SIZE;
+  }
+  level = delay->out_wr - delay->out_rd;
+  fetchable = (int32_t)(delay->in_rd - delay->out_wr);
+  if((level < target) && (fetchable > 0))
+  {
+    length = target - level;
+    length = ((uint32_t)fetchable < length) ? (uint32_t)fetchable : length;
+    offset = delay->out_wr & AUDIO_LONG_DELAY_HOT_MASK;
+    limit = AUDIO_LONG_DELAY_HOT_SIZE - offset;
+    length = (limit < length) ? limit : length;
+    delay->job = AUDIO_LONG_DELAY_JOB_FETCH;
+    offset = delay->out_wr & delay->store_mask;
+    limit = delay->store_mask + 1U - offset;
+    delay->region.data[0] = delay->store + offset;
+    delay->region.length[0] = (limit < length) ? limit : length;
+    delay->region.data[1] = delay->store;
+    delay->region.length[1] = length - delay->region.length[0];
+    delay->job_length = length;
+    if(AUDIO_CopyFromRegion(AUDIO_COPY_DELAY, long_delay_hot_out + (delay->out_wr & AUDIO_LONG_DELAY_HOT_MASK),
+                            &delay->region, AUDIO_LongDelayCopied, (uint32_t)delay) != 0)
+    {
+      delay->job = AUDIO_LONG_DELAY_JOB_NONE;
+      return 0;
+    }
+    return 1;
+  }
+  length = delay->in_wr - delay->in_rd;
+  if(length >= batch)
+  {
+    offset = delay->in_rd & AUDIO_LONG_DELAY_HOT_MASK;
+    limit = AUDIO_LONG_DELAY_HOT_SIZE - offset;
+    length = (limit < length) ? limit : length;
+    delay->job = AUDIO_LONG_DELAY_JOB_FLUSH;
+    offset = delay->in_rd & delay->store_mask;
+    limit = delay->store_mask + 1U - offset;
+    delay->region.data[0] = delay->store + offset;
+    delay->region.length[0] = (limit < length) ? limit : length;
+    delay->region.data[1] = delay->store;
+    delay->region.length[1] = length - delay->region.length[0];
+    delay->job_length = length;
+    if(AUDIO_CopyToRegion(AUDIO_COPY_DELAY, &delay->region, long_delay_hot_in + (delay->in_rd & AUDIO_LONG_DELAY_HOT_MASK),
+                          AUDIO_LongDelayCopied, (uint32_t)delay) != 0)
+    {
+      delay->job = AUDIO_LONG_DELAY_JOB_NONE;
+      return 0;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LongDelayCopied
+  *         end of a block move, from the MDMA interrupt or from the kick
+  *         when the CPU did it
+  * @param  private_data: long delay node
+  * @retval None
+  */
+static void  AUDIO_LongDelayCopied(uint32_t private_data)
+{
+  AUDIO_LongDelay_NodeTypeDef* delay = (AUDIO_LongDelay_NodeTypeDef*)private_data;
+
+  if(delay->job == AUDIO_LONG_DELAY_JOB_FETCH)
+  {
+    delay->out_wr += delay->job_length;
+    delay->fetches++;
+  }
+  else
+  {
+    delay->in_rd += delay->job_length;
+    delay->flushes++;
+  }
+  delay->job = AUDIO_LONG_DELAY_JOB_NONE;
+  if(delay->processing.node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_LongDelayKick(delay);
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
@@ -0,0 +1,129 @@
+/**
+  ******************************************************************************
+  * @file    audio_long_delay_node.h
+  * @brief   header file for the audio_long_delay_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_LONG_DELAY_NODE_H
+#define __AUDIO_LONG_DELAY_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+/* Exported constants --------------------------------------------------------*/
+/* delay applied at start, 0 lets the frames through */
+#ifndef AUDIO_LONG_DELAY_MS
+#define AUDIO_LONG_DELAY_MS               1000U
+#endif /* AUDIO_LONG_DELAY_MS */
+#define AUDIO_LONG_DELAY_MAX_MS           60000U
+/* each of the write behind and read ahead windows in internal SRAM, must be
+   a power of two. The delay is at least twice it, and at most the store size
+   less twice it */
+#ifndef AUDIO_LONG_DELAY_HOT_SIZE
+#define AUDIO_LONG_DELAY_HOT_SIZE         4096U
+#endif /* AUDIO_LONG_DELAY_HOT_SIZE */
+/* packets gathered in the write window before one MDMA block moves them */
+#ifndef AUDIO_LONG_DELAY_BATCH_PACKETS
+#define AUDIO_LONG_DELAY_BATCH_PACKETS    4U
+#endif /* AUDIO_LONG_DELAY_BATCH_PACKETS */
+/* packets fetched ahead of the one being played */
+#ifndef AUDIO_LONG_DELAY_PREFETCH_PACKETS
+#define AUDIO_LONG_DELAY_PREFETCH_PACKETS 1U
+#endif /* AUDIO_LONG_DELAY_PREFETCH_PACKETS */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_LONG_DELAY_OFF = 0,       /* not started, or the store is not memory mapped */
+  AUDIO_LONG_DELAY_BYPASS,        /* delay 0, frames are let through */
+  AUDIO_LONG_DELAY_FILLING,       /* silence is played until the store holds the delay */
+  AUDIO_LONG_DELAY_RUNNING
+}
+AUDIO_LongDelayStateTypeDef;
+
+typedef enum
+{
+  AUDIO_LONG_DELAY_JOB_NONE = 0,
+  AUDIO_LONG_DELAY_JOB_FLUSH,     /* write window to store */
+  AUDIO_LONG_DELAY_JOB_FETCH      /* store to read window */
+}
+AUDIO_LongDelayJobTypeDef;
+
+/* long delay node : frames go through a ring in the memory mapped OCTOSPI
+   PSRAM. The packet path only touches the two windows in internal SRAM, the
+   MDMA moves blocks between them and the store. Stream byte x is kept at
+   store offset x & (size - 1), positions are free running byte counters */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;  /* processing node structure , must be first field */
+  uint8_t*                  store;
+  uint32_t                  store_mask;
+  uint32_t                  frame_size;
+  uint32_t                  packet;        /* largest packet seen, sizes the batches */
+  uint32_t                  delay_bytes;   /* applied, 0 in bypass */
+  uint32_t                  min_bytes;
+  uint32_t                  max_bytes;
+  uint32_t                  written;       /* bytes stored since the delay was applied, saturated at the store size */
+  uint32_t                  silence;       /* bytes of silence left before the first stored one */
+  volatile uint32_t         in_wr;         /* written to the write window by the packet path */
+  volatile uint32_t         in_rd;         /* moved to the store by the MDMA */
+  volatile uint32_t         out_wr;        /* fetched to the read window by the MDMA */
+  volatile uint32_t         out_rd;        /* played by the packet path */
+  AUDIO_BufferRegionTypeDef region;        /* store side of the running job */
+  uint32_t                  job_length;
+  volatile uint8_t          job;           /* AUDIO_LongDelayJobTypeDef */
+  uint8_t                   kicking;
+  volatile uint8_t          update;        /* a new delay is applied at the next packet */
+  uint32_t                  underruns;     /* packets played with fetched bytes missing */
+  uint32_t                  overflows;     /* packets written over bytes not yet stored */
+  uint32_t                  flushes;
+  uint32_t                  fetches;
+  int8_t                   (*LongDelayDeInit) (uint32_t /*node_handle*/);
+  int8_t                   (*LongDelayStart)  (uint32_t /*node_handle*/);
+  int8_t                   (*LongDelayStop)   (uint32_t /*node_handle*/);
+}
+AUDIO_LongDelay_NodeTypeDef;
+
+typedef struct
+{
+  uint8_t  state;                 /* AUDIO_LongDelayStateTypeDef */
+  uint16_t delay_ms;              /* requested */
+  uint16_t max_ms;                /* held by the store at the stream format, 0 when off */
+  uint32_t delay_frames;          /* applied */
+  uint32_t underruns;
+  uint32_t overflows;
+  uint32_t flushes;               /* MDMA blocks written to the store */
+  uint32_t fetches;               /* MDMA blocks read from the store */
+}
+AUDIO_LongDelayStatusTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_LongDelayInit(AUDIO_DescriptionTypeDef* audio_description,
+                            AUDIO_SessionTypeDef* session_handle,
+                            uint32_t node_handle);
+/* from the pump */
+int8_t  AUDIO_LongDelaySetMs(uint16_t delay_ms);
+void    AUDIO_LongDelayGetStatus(AUDIO_LongDelayStatusTypeDef* status);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_LONG_DELAY_NODE_H */
@@ -0,0 +1,296 @@
+/**
+  ******************************************************************************
+  * @file    audio_loopback.c
+  * @brief   Latency benchmark mode : the packets played by the host are given
+  *          back on the record stream after a configurable delay, in place of
+  *          the dummy speaker and mic handlers. Each played packet is stamped
+  *          when it enters the delay line, the time it spent in the device
+  *          is measured when it is sent to the record session. The host
+  *          measures the round trip with an impulse, the device part is read
+  *          with the CDC command channel : Tests/Host/loopback_latency.sh
+  *          runs it for each rate and host buffer size.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_loopback.h"
+
+#ifdef USE_AUDIO_LOOPBACK
+#include "usb_audio_user.h"
+#include "audio_pump.h"
+#include "audio_speaker_node.h"
+#include "audio_mic_node.h"
+
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_LOOPBACK replaces the dummy speaker and mic, USE_AUDIO_SPEAKER_DUMMY and USE_AUDIO_DUMMY_MIC are required"
+#endif /* USE_AUDIO_SPEAKER_DUMMY && USE_AUDIO_DUMMY_MIC */
+#if (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT != USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT) || \
+    (USBD_AUDIO_CONFIG_PLAY_RES_BYTE != USBD_AUDIO_CONFIG_RECORD_RES_BYTE)
+#error "USE_AUDIO_LOOPBACK copies bytes, play and record formats must be the same"
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
+#if (AUDIO_LOOPBACK_RING_SIZE & (AUDIO_LOOPBACK_RING_SIZE - 1U)) != 0U
+#error "AUDIO_LOOPBACK_RING_SIZE must be a power of two"
+#endif /* AUDIO_LOOPBACK_RING_SIZE */
+#if (AUDIO_LOOPBACK_STAMP_COUNT & (AUDIO_LOOPBACK_STAMP_COUNT - 1U)) != 0U
+#error "AUDIO_LOOPBACK_STAMP_COUNT must be a power of two"
+#endif /* AUDIO_LOOPBACK_STAMP_COUNT */
+
+/* Private typedef -----------------------------------------------------------*/
+/* start of a played packet in the delay line */
+typedef struct
+{
+  uint32_t ptr;   /* free running ring position */
+  uint32_t tick;  /* ms tick when the packet was played */
+}
+AUDIO_LoopbackStampTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+/* both handlers and the command channel run in the pump , nothing is shared with interrupts */
+static uint8_t  loop_ring[AUDIO_LOOPBACK_RING_SIZE] USBD_DEBUG_BSS;
+static uint32_t loop_ptr_in;   /* free running */
+static uint32_t loop_ptr_out;  /* free running */
+static AUDIO_LoopbackStampTypeDef loop_stamps[AUDIO_LOOPBACK_STAMP_COUNT] USBD_DEBUG_BSS;
+static uint32_t loop_stamp_in;
+static uint32_t loop_stamp_out;
+static AUDIO_LoopbackStatsTypeDef loop_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_LoopbackSpeakerHandler(void);
+static void AUDIO_LoopbackMicHandler(void);
+static void AUDIO_LoopbackRingWrite(const uint8_t* data, uint32_t length);
+static void AUDIO_LoopbackRingRead(uint8_t* data, uint32_t length);
+static void AUDIO_LoopbackMeasure(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LoopbackInit
+  *         empties the delay line and registers the loopback in the pump in
+  *         place of the dummy speaker and mic handlers, must be called after
+  *         they are registered
+  * @param  None
+  * @retval None
+  */
+void AUDIO_LoopbackInit(void)
+{
+  AUDIO_LoopbackSetDelay(0);
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SPEAKER_DATA, AUDIO_LoopbackSpeakerHandler);
+  AUDIO_PumpSetHandler(AUDIO_PUMP_MIC_SPACE, AUDIO_LoopbackMicHandler);
+}
+
+/**
+  * @brief  AUDIO_LoopbackSetDelay
+  *         sets the delay added in the delay line, empties it and clears the
+  *         measures. Must be called from the pump
+  * @param  delay_ms: delay in ms, up to AUDIO_LOOPBACK_MAX_DELAY_MS
+  * @retval 0 if no error
+  */
+int8_t AUDIO_LoopbackSetDelay(uint32_t delay_ms)
+{
+  if(delay_ms > AUDIO_LOOPBACK_MAX_DELAY_MS)
+  {
+    return -1;
+  }
+  loop_ptr_in = 0;
+  loop_ptr_out = 0;
+  loop_stamp_in = 0;
+  loop_stamp_out = 0;
+  memset(&loop_stats, 0, sizeof(loop_stats));
+  loop_stats.delay_ms = delay_ms;
+  loop_stats.min_ms = UINT32_MAX;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_LoopbackGetStats
+  *         copies the measures
+  * @param  stats: measures copy
+  * @retval None
+  */
+void AUDIO_LoopbackGetStats(AUDIO_LoopbackStatsTypeDef* stats)
+{
+  *stats = loop_stats;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_LoopbackSpeakerHandler
+  *         moves the played packets to the delay line, a packet is dropped
+  *         when the line is full
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_LoopbackSpeakerHandler(void)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t length;
+
+  while((length = AUDIO_AcquireSpeakerData(&region)) > 0U)
+  {
+    if(length > (AUDIO_LOOPBACK_RING_SIZE - (loop_ptr_in - loop_ptr_out)))
+    {
+      loop_stats.dropped += length;
+    }
+    else
+    {
+      if((loop_stamp_in - loop_stamp_out) < AUDIO_LOOPBACK_STAMP_COUNT)
+      {
+        loop_stamps[loop_stamp_in & (AUDIO_LOOPBACK_STAMP_COUNT - 1U)].ptr = loop_ptr_in;
+#ifdef USE_AUDIO_PACKET_QUEUE
+        /* measured from the USB reception, the time in the play ring is included */
+        loop_stamps[loop_stamp_in & (AUDIO_LOOPBACK_STAMP_COUNT - 1U)].tick = HAL_GetTick() - AUDIO_GetSpeakerPacketAge();
+#else /* USE_AUDIO_PACKET_QUEUE */
+        loop_stamps[loop_stamp_in & (AUDIO_LOOPBACK_STAMP_COUNT - 1U)].tick = HAL_GetTick();
+#endif /* USE_AUDIO_PACKET_QUEUE */
+        loop_stamp_in++;
+      }
+      AUDIO_LoopbackRingWrite(region.data[0], region.length[0]);
+      AUDIO_LoopbackRingWrite(region.data[1], length - region.length[0]);
+    }
+    AUDIO_ReleaseSpeakerData();
+  }
+}
+
+/**
+  * @brief  AUDIO_LoopbackMicHandler
+  *         fills the record buffer from the delay line once it holds the
+  *         delay, with silence before
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_LoopbackMicHandler(void)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t packet_length;
+  uint32_t length;
+
+  while((packet_length = AUDIO_GetPacketLength()) > 0U)
+  {
+    length = AUDIO_ReserveINData(&region);
+    if(length > packet_length)
+    {
+      length = packet_length;
+    }
+    if(length == 0U)
+    {
+      break;
+    }
+    /* a mic packet is one ms of audio */
+    if((loop_ptr_in - loop_ptr_out) >= (length * (loop_stats.delay_ms + 1U)))
+    {
+      if(length > region.length[0])
+      {
+        AUDIO_LoopbackRingRead(region.data[0], region.length[0]);
+        AUDIO_LoopbackRingRead(region.data[1], length - region.length[0]);
+      }
+      else
+      {
+        AUDIO_LoopbackRingRead(region.data[0], length);
+      }
+      AUDIO_LoopbackMeasure();
+    }
+    else
+    {
+      if(length > region.length[0])
+      {
+        AUDIO_MEMSET(region.data[0], 0, region.length[0]);
+        AUDIO_MEMSET(region.data[1], 0, length - region.length[0]);
+      }
+      else
+      {
+        AUDIO_MEMSET(region.data[0], 0, length);
+      }
+    }
+    AUDIO_CommitINData(length);
+  }
+}
+
+/**
+  * @brief  AUDIO_LoopbackRingWrite
+  *         copies data to the delay line, room must have been checked
+  * @param  data: data to copy
+  * @param  length: data length
+  * @retval None
+  */
+static void AUDIO_LoopbackRingWrite(const uint8_t* data, uint32_t length)
+{
+  uint32_t offset = loop_ptr_in & (AUDIO_LOOPBACK_RING_SIZE - 1U);
+  uint32_t first = AUDIO_LOOPBACK_RING_SIZE - offset;
+
+  if(first > length)
+  {
+    first = length;
+  }
+  AUDIO_MEMCPY(&loop_ring[offset], data, first);
+  AUDIO_MEMCPY(&loop_ring[0], data + first, length - first);
+  loop_ptr_in += length;
+}
+
+/**
+  * @brief  AUDIO_LoopbackRingRead
+  *         copies data from the delay line, data must have been checked
+  * @param  data: destination
+  * @param  length: data length
+  * @retval None
+  */
+static void AUDIO_LoopbackRingRead(uint8_t* data, uint32_t length)
+{
+  uint32_t offset = loop_ptr_out & (AUDIO_LOOPBACK_RING_SIZE - 1U);
+  uint32_t first = AUDIO_LOOPBACK_RING_SIZE - offset;
+
+  if(first > length)
+  {
+    first = length;
+  }
+  AUDIO_MEMCPY(data, &loop_ring[offset], first);
+  AUDIO_MEMCPY(data + first, &loop_ring[0], length - first);
+  loop_ptr_out += length;
+}
+
+/**
+  * @brief  AUDIO_LoopbackMeasure
+  *         records the time spent in the device by the played packets which
+  *         started in the data just sent to the record session
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_LoopbackMeasure(void)
+{
+  AUDIO_LoopbackStampTypeDef* stamp;
+  uint32_t latency;
+  uint32_t bin;
+
+  while(loop_stamp_out != loop_stamp_in)
+  {
+    stamp = &loop_stamps[loop_stamp_out & (AUDIO_LOOPBACK_STAMP_COUNT - 1U)];
+    if((int32_t)(loop_ptr_out - stamp->ptr) <= 0)
+    {
+      break;
+    }
+    latency = HAL_GetTick() - stamp->tick;
+    /* jitter around the configured delay */
+    bin = (latency > loop_stats.delay_ms) ? (latency - loop_stats.delay_ms) : 0U;
+    loop_stats.hist[(bin < AUDIO_LOOPBACK_HIST_BINS) ? bin : (AUDIO_LOOPBACK_HIST_BINS - 1U)]++;
+    if(latency < loop_stats.min_ms)
+    {
+      loop_stats.min_ms = latency;
+    }
+    if(latency > loop_stats.max_ms)
+    {
+      loop_stats.max_ms = latency;
+    }
+    loop_stats.count++;
+    loop_stamp_out++;
+  }
+}
+#endif /* USE_AUDIO_LOOPBACK */
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file    audio_loopback.h
+  * @brief   header file for the audio_loopback.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_LOOPBACK_H
+#define __AUDIO_LOOPBACK_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+#ifdef USE_AUDIO_LOOPBACK
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_LOOPBACK_RING_SIZE          32768U /* delay line in bytes, must be a power of two */
+#define AUDIO_LOOPBACK_MAX_DELAY_MS       40U    /* must fit the ring at the highest rate */
+#define AUDIO_LOOPBACK_STAMP_COUNT        64U    /* played packets in the delay line, must be a power of two */
+#define AUDIO_LOOPBACK_HIST_BINS          16U    /* 1 ms per bin from the configured delay, last bin has no upper bound */
+
+/* Exported types ------------------------------------------------------------*/
+/* time spent by the played packets in the device until they are given to the record session */
+typedef struct
+{
+  uint32_t delay_ms;                        /* configured delay */
+  uint32_t count;                           /* packets measured */
+  uint32_t min_ms;                          /* UINT32_MAX before the first packet */
+  uint32_t max_ms;
+  uint32_t hist[AUDIO_LOOPBACK_HIST_BINS];
+  uint32_t dropped;                         /* played bytes lost because the delay line was full */
+}
+AUDIO_LoopbackStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void   AUDIO_LoopbackInit(void);
+int8_t AUDIO_LoopbackSetDelay(uint32_t delay_ms);
+void   AUDIO_LoopbackGetStats(AUDIO_LoopbackStatsTypeDef* stats);
+#endif /* USE_AUDIO_LOOPBACK */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_LOOPBACK_H */
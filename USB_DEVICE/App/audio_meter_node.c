@@ -0,0 +1,465 @@
+/**
+  ******************************************************************************
+  * @file    audio_meter_node.c
+  * @brief   Level meter : peak and rms of each channel measured on the packets
+  *          of a session without changing them. The levels of a period are
+  *          published from the USB interrupt, read over the CDC command
+  *          channel, and a peak crossing the threshold is told to the host
+  *          by the audio interrupt endpoint.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_meter_node.h"
+
+#ifdef USE_AUDIO_LEVEL_METER
+#include "usb_audio_user.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_SNAPSHOT
+#include "audio_snapshot.h"
+#endif /* USE_AUDIO_SNAPSHOT */
+
+/* Private variables ---------------------------------------------------------*/
+/* written from the pump, read by the process in the USB interrupt */
+static AUDIO_Meter_NodeTypeDef *meters[AUDIO_METER_COUNT];
+#ifdef USE_AUDIO_USB_INTERRUPT
+/* feature unit of each session, the threshold interrupt comes from it */
+static const uint8_t meter_entity[AUDIO_METER_COUNT] =
+{
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID,
+#else /* USE_USB_AUDIO_PLAYPBACK */
+  0,
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+  USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID
+#else /* USE_USB_AUDIO_RECORDING */
+  0
+#endif /* USE_USB_AUDIO_RECORDING */
+};
+#endif /* USE_AUDIO_USB_INTERRUPT */
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_MeterDeInit(uint32_t node_handle);
+static int8_t  AUDIO_MeterStart(uint32_t node_handle);
+static int8_t  AUDIO_MeterStop(uint32_t node_handle);
+static int8_t  AUDIO_MeterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static int8_t  AUDIO_MeterProcessFloat(float* planes, uint32_t stride, uint32_t frames,
+                                       uint32_t node_handle) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+static void    AUDIO_MeterPublish(AUDIO_Meter_NodeTypeDef* meter) USBD_ITCM_FUNC;
+static void    AUDIO_MeterNotify(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MeterInit
+  *         Initializes a level meter node, levels are published every
+  *         AUDIO_METER_DEFAULT_PERIOD_MS without threshold
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  id:               AUDIO_METER_PLAYBACK or AUDIO_METER_RECORD
+  * @param  node_handle:      meter node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_MeterInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint8_t id, uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+
+  if((id >= AUDIO_METER_COUNT) ||
+     (audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(meter, 0, sizeof(AUDIO_Meter_NodeTypeDef));
+  meter->processing.node.state = AUDIO_NODE_INITIALIZED;
+  meter->processing.node.type = AUDIO_PROCESSING;
+  meter->processing.node.session_handle = session_handle;
+  meter->processing.node.audio_description = audio_description;
+  meter->period_ms = AUDIO_METER_DEFAULT_PERIOD_MS;
+  meter->id = id;
+
+  meter->MeterDeInit = AUDIO_MeterDeInit;
+  meter->MeterStart = AUDIO_MeterStart;
+  meter->MeterStop = AUDIO_MeterStop;
+  meter->processing.Process = AUDIO_MeterProcess;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  meter->processing.ProcessFloat = AUDIO_MeterProcessFloat;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  meters[id] = meter;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_METER, AUDIO_MeterNotify);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MeterConfigure
+  *         sets the period of the published levels and the notified peak,
+  *         the running period restarts. Must be called from the pump
+  * @param  id: AUDIO_METER_PLAYBACK or AUDIO_METER_RECORD
+  * @param  period_ms: period, 1 to AUDIO_METER_MAX_PERIOD_MS
+  * @param  threshold: peak on 24 bits, 0 for no notification
+  * @retval 0 if no error, -1 on bad arguments or when the meter is not initialized
+  */
+int8_t  AUDIO_MeterConfigure(uint8_t id, uint32_t period_ms, uint32_t threshold)
+{
+  AUDIO_Meter_NodeTypeDef* meter;
+  uint32_t primask;
+
+  if((id >= AUDIO_METER_COUNT) || ((meter = meters[id]) == 0) ||
+     (period_ms == 0U) || (period_ms > AUDIO_METER_MAX_PERIOD_MS) || (threshold > AUDIO_METER_FULL_SCALE))
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  meter->period_ms = period_ms;
+  meter->threshold = threshold;
+  meter->frames = 0;
+  memset(meter->peak, 0, sizeof(meter->peak));
+  memset(meter->sum, 0, sizeof(meter->sum));
+  meter->over = 0;
+  meter->over_notified = 0;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MeterGetLevels
+  *         copies the levels of the last period
+  * @param  id: AUDIO_METER_PLAYBACK or AUDIO_METER_RECORD
+  * @param  levels: AUDIO_MAX_SUPPORTED_CHANNEL_COUNT levels
+  * @param  channels_count: returned channels count
+  * @retval 0 if no error, -1 when the meter is not initialized
+  */
+int8_t  AUDIO_MeterGetLevels(uint8_t id, AUDIO_MeterLevelTypeDef* levels, uint8_t* channels_count)
+{
+  AUDIO_Meter_NodeTypeDef* meter;
+  uint32_t primask;
+
+  if((id >= AUDIO_METER_COUNT) || ((meter = meters[id]) == 0))
+  {
+    return -1;
+  }
+  *channels_count = meter->processing.node.audio_description->channels_count;
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(levels, meter->level, sizeof(meter->level));
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MeterDeInit
+  *         De-Initializes the level meter node
+  * @param  node_handle: meter node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MeterDeInit(uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+
+  meter->processing.node.state = AUDIO_NODE_OFF;
+  meters[meter->id] = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MeterStart
+  *         Starts metering from an empty period, the levels read before
+  *         the first period are zero. The kernels of the stream format are
+  *         picked here
+  * @param  node_handle: meter node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MeterStart(uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+
+#ifdef USE_AUDIO_PCM_KERNELS
+  meter->kernels = AUDIO_PcmKernelsSelect(meter->processing.node.audio_description->audio_res,
+                                          meter->processing.node.audio_description->channels_count);
+  if(meter->kernels == 0)
+  {
+    return -1;
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+  meter->frames = 0;
+  memset(meter->peak, 0, sizeof(meter->peak));
+  memset(meter->sum, 0, sizeof(meter->sum));
+  memset(meter->level, 0, sizeof(meter->level));
+  meter->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MeterStop
+  *         Stops metering, the levels fall to zero and a pending crossing
+  *         is told to the host
+  * @param  node_handle: meter node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MeterStop(uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+
+  meter->processing.node.state = AUDIO_NODE_STOPPED;
+  memset(meter->level, 0, sizeof(meter->level));
+  meter->over = 0;
+  if(meter->over_notified != 0U)
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_METER);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MeterProcess
+  *         accumulates the magnitude peak and the squares of each channel,
+  *         the levels are published once the period is reached. Samples
+  *         are 2, 3 or 4 bytes little endian, 4 bytes ones are measured on
+  *         their 24 upper bits
+  * @param  in: input frames
+  * @param  out: output frames , not written
+  * @param  frames: frames count
+  * @param  node_handle: meter node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MeterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+  uint8_t channels = meter->processing.node.audio_description->channels_count;
+#ifndef USE_AUDIO_PCM_KERNELS
+  uint32_t i;
+  uint8_t ch;
+  int32_t value;
+  uint32_t magnitude;
+#endif /* USE_AUDIO_PCM_KERNELS */
+
+  (void)out;
+#ifdef USE_AUDIO_PCM_KERNELS
+  meter->kernels->Measure(in, frames, channels, meter->peak, meter->sum);
+#else /* USE_AUDIO_PCM_KERNELS */
+  switch(meter->processing.node.audio_description->audio_res)
+  {
+    case 2:
+    {
+      int16_t* src = (int16_t*)in;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          value = *src++;
+          /* one SMLAL per sample, a 16 bits square never overflows the sum */
+          meter->sum[ch] += (uint64_t)(value * value);
+          magnitude = (uint32_t)((value < 0) ? -value : value);
+          if(magnitude > meter->peak[ch])
+          {
+            meter->peak[ch] = magnitude;
+          }
+        }
+      }
+      break;
+    }
+    case 3:
+    {
+      uint8_t* src = in;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          value = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+          src += 3;
+          meter->sum[ch] += (uint64_t)((int64_t)value * value);
+          magnitude = (uint32_t)((value < 0) ? -value : value);
+          if(magnitude > meter->peak[ch])
+          {
+            meter->peak[ch] = magnitude;
+          }
+        }
+      }
+      break;
+    }
+    case 4:
+    {
+      int32_t* src = (int32_t*)in;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          value = *src++ >> 8;
+          meter->sum[ch] += (uint64_t)((int64_t)value * value);
+          magnitude = (uint32_t)((value < 0) ? -value : value);
+          if(magnitude > meter->peak[ch])
+          {
+            meter->peak[ch] = magnitude;
+          }
+        }
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+  meter->frames += frames;
+  if((meter->frames != 0U) &&
+     (meter->frames >= ((meter->period_ms * meter->processing.node.audio_description->frequence) / 1000U)))
+  {
+    AUDIO_MeterPublish(meter);
+  }
+  return 0;
+}
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/**
+  * @brief  AUDIO_MeterProcessFloat
+  *         float variant of the process, samples are measured in the units
+  *         of the fixed point one and clipped to full scale as the output
+  *         will be
+  * @param  planes: float planes, full scale is 1, not written
+  * @param  stride: floats from a plane start to the next one
+  * @param  frames: frames count
+  * @param  node_handle: meter node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MeterProcessFloat(float* planes, uint32_t stride, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Meter_NodeTypeDef* meter = (AUDIO_Meter_NodeTypeDef*)node_handle;
+  uint8_t channels = meter->processing.node.audio_description->channels_count;
+  /* 16 bits samples are measured on 16 bits, the others on 24 */
+  float scale = (meter->processing.node.audio_description->audio_res == 2U) ? 32767.0f : 8388607.0f;
+  const float* plane;
+  float x;
+  uint32_t i;
+  uint8_t ch;
+  int32_t value;
+  uint32_t magnitude;
+
+  for(ch = 0; ch < channels; ch++)
+  {
+    plane = planes + ch * stride;
+    for(i = 0; i < frames; i++)
+    {
+      x = fabsf(plane[i]);
+      value = (x >= 1.0f) ? (int32_t)scale : (int32_t)(x * scale);
+      meter->sum[ch] += (uint64_t)((int64_t)value * value);
+      magnitude = (uint32_t)value;
+      if(magnitude > meter->peak[ch])
+      {
+        meter->peak[ch] = magnitude;
+      }
+    }
+  }
+  meter->frames += frames;
+  if((meter->frames != 0U) &&
+     (meter->frames >= ((meter->period_ms * meter->processing.node.audio_description->frequence) / 1000U)))
+  {
+    AUDIO_MeterPublish(meter);
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+/**
+  * @brief  AUDIO_MeterPublish
+  *         makes the running period the last one and starts the next, the
+  *         pump is woken when the channels above the threshold changed
+  * @param  meter: meter node
+  * @retval None
+  */
+static void AUDIO_MeterPublish(AUDIO_Meter_NodeTypeDef* meter)
+{
+  uint8_t channels = meter->processing.node.audio_description->channels_count;
+  uint8_t shift = (meter->processing.node.audio_description->audio_res == 2U) ? 8U : 0U;
+  uint32_t over = 0;
+  uint8_t ch;
+
+  for(ch = 0; ch < channels; ch++)
+  {
+    meter->level[ch].peak = meter->peak[ch] << shift;
+    /* VSQRT, once per channel and period */
+    meter->level[ch].rms = (uint32_t)sqrtf((float)meter->sum[ch] / (float)meter->frames) << shift;
+    if((meter->threshold != 0U) && (meter->level[ch].peak >= meter->threshold))
+    {
+      over |= 1UL << ch;
+    }
+    meter->peak[ch] = 0;
+    meter->sum[ch] = 0;
+  }
+  meter->frames = 0;
+  if(over != meter->over)
+  {
+    meter->over = over;
+    AUDIO_PumpPost(AUDIO_PUMP_METER);
+  }
+}
+
+/**
+  * @brief  AUDIO_MeterNotify
+  *         pump handler , tells the host through the audio interrupt endpoint
+  *         the meters whose channels above the threshold changed. The host
+  *         reads the levels over the CDC command channel
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_MeterNotify(void)
+{
+  AUDIO_Meter_NodeTypeDef* meter;
+  uint32_t over;
+  uint8_t id;
+#ifdef USE_AUDIO_USB_INTERRUPT
+  USBD_AUDIO_InterruptTypeDef interrupt;
+#endif /* USE_AUDIO_USB_INTERRUPT */
+
+  for(id = 0; id < AUDIO_METER_COUNT; id++)
+  {
+    if((meter = meters[id]) == 0)
+    {
+      continue;
+    }
+    over = meter->over;
+    if(over == meter->over_notified)
+    {
+      continue;
+    }
+#ifdef USE_AUDIO_SNAPSHOT
+    if((over & ~meter->over_notified) != 0U)
+    {
+      /* a channel reached the threshold */
+      AUDIO_SnapshotTrigger(AUDIO_SNAPSHOT_TRIGGER_LEVEL);
+    }
+#endif /* USE_AUDIO_SNAPSHOT */
+    meter->over_notified = over;
+#ifdef USE_AUDIO_USB_INTERRUPT
+    /* not a class control, the vendor bit tells the host to read the meter */
+    interrupt.type  = USBD_AUDIO_INTERRUPT_INFO_VENDOR_SPECIFIC;
+    interrupt.attr = USBD_AUDIO_INTERRUPT_ATTR_CUR;
+    interrupt.cs = 0;
+    interrupt.cn_mcn = 0;
+    interrupt.entity_id = meter_entity[id];
+    interrupt.ep_if_id = 0;/* Audio control interface 0*/
+    interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
+    USBD_AUDIO_SendInterrupt  (&interrupt);
+#endif /* USE_AUDIO_USB_INTERRUPT */
+  }
+}
+#endif /* USE_AUDIO_LEVEL_METER */
@@ -0,0 +1,85 @@
+/**
+  ******************************************************************************
+  * @file    audio_meter_node.h
+  * @brief   header file for the audio_meter_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_METER_NODE_H
+#define __AUDIO_METER_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+#include "audio_pcm_kernels.h"
+
+#ifdef USE_AUDIO_LEVEL_METER
+/* Exported constants --------------------------------------------------------*/
+/* meters, one per session */
+#define AUDIO_METER_PLAYBACK            0U
+#define AUDIO_METER_RECORD              1U
+#define AUDIO_METER_COUNT               2U
+
+#define AUDIO_METER_DEFAULT_PERIOD_MS   50U
+/* 64 bits sums of 24 bits squares hold 2^17 frames, 680 ms at 192 kHz */
+#define AUDIO_METER_MAX_PERIOD_MS       500U
+/* levels of all resolutions are given on 24 bits */
+#define AUDIO_METER_FULL_SCALE          0x7FFFFFU
+
+/* Exported types ------------------------------------------------------------*/
+/* levels of one channel over the last period */
+typedef struct
+{
+  uint32_t           peak;           /* largest magnitude */
+  uint32_t           rms;            /* root mean square */
+}
+AUDIO_MeterLevelTypeDef;
+
+/* level meter node : peak and rms per channel of each packet, data is left untouched */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  uint32_t           peak[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];       /* of the running period, in sample scale */
+  uint64_t           sum[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];        /* squares of the running period, in sample scale */
+  uint32_t           frames;                                        /* frames of the running period */
+  AUDIO_MeterLevelTypeDef level[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT]; /* last period, written by the process */
+  uint32_t           period_ms;
+  uint32_t           threshold;      /* peak notified when crossed, 0 for none */
+  uint32_t           over;           /* channels mask whose peak reached the threshold, last period */
+  uint32_t           over_notified;  /* mask the host was told, written by the pump */
+  uint8_t            id;             /* AUDIO_METER_PLAYBACK or AUDIO_METER_RECORD */
+#ifdef USE_AUDIO_PCM_KERNELS
+  const AUDIO_PcmKernelsTypeDef* kernels;  /* of the stream format, picked on start */
+#endif /* USE_AUDIO_PCM_KERNELS */
+  int8_t            (*MeterDeInit)  (uint32_t /*node_handle*/);
+  int8_t            (*MeterStart)   (uint32_t /*node_handle*/);
+  int8_t            (*MeterStop)    (uint32_t /*node_handle*/);
+}
+AUDIO_Meter_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_MeterInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint8_t id, uint32_t node_handle);
+int8_t  AUDIO_MeterConfigure(uint8_t id, uint32_t period_ms, uint32_t threshold);
+int8_t  AUDIO_MeterGetLevels(uint8_t id, AUDIO_MeterLevelTypeDef* levels, uint8_t* channels_count);
+#endif /* USE_AUDIO_LEVEL_METER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_METER_NODE_H */
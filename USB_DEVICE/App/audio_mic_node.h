@@ -99,12 +99,15 @@ AUDIO_Mic_NodeTypeDef;
 /* Exported macros -----------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 #ifdef USE_AUDIO_MEMS_MIC
-
+/* PDM mics on the SAI PDM interface, AUDIO_MicInit is in audio_pdm_mic_node.c
+   and the decimation in audio_pdm_filter.c */
 #endif /* USE_AUDIO_MEMS_MIC */
  int8_t  AUDIO_MicInit(AUDIO_DescriptionTypeDef* audio_description, AUDIO_SessionTypeDef* session_handle,  uint32_t node_handle);
 
  uint32_t AUDIO_GetPacketLength();
 uint32_t AUDIO_SendINData(uint8_t* buffer,uint32_t length);
+uint32_t AUDIO_ReserveINData(AUDIO_BufferRegionTypeDef* region);
+uint32_t AUDIO_CommitINData(uint32_t length);
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,366 @@
+/**
+  ******************************************************************************
+  * @file    audio_mixer_node.c
+  * @brief   Play stream mixer : the ring of the second play stream is added
+  *          to each speaker DMA half, once it has the SAI slot layout, with
+  *          saturating adds (QADD16 on pairs of 16 bits slots). The mixer is
+  *          the consumer of that ring and keeps pace with the speaker: it
+  *          waits for the start threshold, skips the stream while its ring
+  *          runs dry and drops whole frames when the session reports an
+  *          overrun, as the stream has no feedback endpoint of its own.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_mixer_node.h"
+#include "audio_pcm.h"
+#include "audio_gain.h"
+
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+#error "USE_AUDIO_PLAYBACK_MIX mixes in the SAI speaker halves, it needs the SAI speaker node"
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+
+/* Private variables ---------------------------------------------------------*/
+/* written from the pump, read by the speaker DMA interrupt */
+static AUDIO_Mixer_NodeTypeDef *current_mixer = 0;
+/* speaker audio parameters, set by the playback session */
+static AUDIO_DescriptionTypeDef *mixer_output_description = 0;
+/* one chunk of mixed stream samples, gain applied */
+__ALIGN_BEGIN static int16_t mixer_scratch[AUDIO_MIXER_CHUNK_FRAMES * AUDIO_MAX_SUPPORTED_CHANNEL_COUNT] __ALIGN_END;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_MixerDeInit(uint32_t node_handle);
+static int8_t  AUDIO_MixerStart(AUDIO_BufferTypeDef* buffer, uint32_t threshold, uint32_t node_handle);
+static int8_t  AUDIO_MixerStop(uint32_t node_handle);
+static int8_t  AUDIO_MixerMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle);
+static int8_t  AUDIO_MixerSetVolume(uint16_t channel_number, int volume_db_256, uint32_t node_handle);
+static void    AUDIO_MixerLoad(AUDIO_Mixer_NodeTypeDef* mixer, uint32_t frames) USBD_ITCM_FUNC;
+static uint8_t* AUDIO_MixerAdd(uint8_t* half, uint32_t samples) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MixerInit
+  *         Initializes the mixer node of the mixed play stream at unity gain
+  * @param  audio_description: mixed stream audio parameters, 16 bits
+  * @param  session_handle:   mix session handle
+  * @param  node_handle:      mixer node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_MixerInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint32_t node_handle)
+{
+  AUDIO_Mixer_NodeTypeDef* mixer = (AUDIO_Mixer_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res != 2U))
+  {
+    return -1;
+  }
+  memset(mixer, 0, sizeof(AUDIO_Mixer_NodeTypeDef));
+  mixer->node.state = AUDIO_NODE_INITIALIZED;
+  mixer->node.type = AUDIO_OUTPUT;
+  mixer->node.session_handle = session_handle;
+  mixer->node.audio_description = audio_description;
+  mixer->gain = AUDIO_MIXER_GAIN_UNITY;
+
+  mixer->MixerDeInit = AUDIO_MixerDeInit;
+  mixer->MixerStart = AUDIO_MixerStart;
+  mixer->MixerStop = AUDIO_MixerStop;
+  mixer->MixerMute = AUDIO_MixerMute;
+  mixer->MixerSetVolume = AUDIO_MixerSetVolume;
+  current_mixer = mixer;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerSetOutput
+  *         sets the speaker audio parameters, called by the playback session
+  *         before or after the mix one is initialized
+  * @param  audio_description: playback audio parameters
+  * @retval None
+  */
+void  AUDIO_MixerSetOutput(AUDIO_DescriptionTypeDef* audio_description)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  mixer_output_description = audio_description;
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_MixerMix
+  *         adds the mixed stream to a speaker DMA half. Called by the SAI
+  *         speaker node once the half has the slot layout : int16 for 16 bits,
+  *         right aligned 24 bits or int32 in 32 bits slots. Nothing is added
+  *         while the mixed stream is stopped, below its start threshold, or
+  *         at another rate or channels count than the speaker
+  * @param  half: speaker DMA half
+  * @param  frames: frames count of the half
+  * @retval None
+  */
+void  AUDIO_MixerMix(uint8_t* half, uint32_t frames)
+{
+  AUDIO_Mixer_NodeTypeDef* mixer = current_mixer;
+  AUDIO_DescriptionTypeDef* output = mixer_output_description;
+  AUDIO_BufferTypeDef* buf;
+  uint32_t frame_length;
+  uint32_t filled;
+  uint32_t count;
+
+  if((mixer == 0) || (mixer->node.state != AUDIO_NODE_STARTED) || (output == 0) ||
+     (mixer->node.audio_description->frequence != output->frequence) ||
+     (mixer->node.audio_description->channels_count != output->channels_count))
+  {
+    return;
+  }
+  buf = mixer->buf;
+  frame_length = AUDIO_SAMPLE_LENGTH(mixer->node.audio_description);
+  if(mixer->drop_length != 0U)
+  {
+    AUDIO_BufferDrop(buf, mixer->drop_length, frame_length);
+    mixer->drop_length = 0;
+  }
+  filled = AUDIO_BUFFER_FILLED_SIZE(buf);
+  if(mixer->primed == 0U)
+  {
+    if(filled < mixer->threshold)
+    {
+      return;
+    }
+    mixer->primed = 1;
+  }
+  if(filled < frames * frame_length)
+  {
+    /* one gap is counted, adding resumes at the threshold */
+    mixer->underruns++;
+    mixer->primed = 0;
+    return;
+  }
+  if(mixer->node.audio_description->audio_mute)
+  {
+    /* consumed at the speaker pace all the same */
+    AUDIO_BufferCommitRead(buf, frames * frame_length);
+    return;
+  }
+  while(frames != 0U)
+  {
+    count = (frames > AUDIO_MIXER_CHUNK_FRAMES) ? AUDIO_MIXER_CHUNK_FRAMES : frames;
+    AUDIO_MixerLoad(mixer, count);
+    half = AUDIO_MixerAdd(half, count * output->channels_count);
+    frames -= count;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MixerDeInit
+  *         De-Initializes the mixer node
+  * @param  node_handle: mixer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MixerDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Mixer_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerStart
+  *         Starts consuming the mixed stream ring, adding begins once it
+  *         holds threshold
+  * @param  buffer: mixed stream ring, filled by the USB input node
+  * @param  threshold: ring fill to start adding, in whole frames
+  * @param  node_handle: mixer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MixerStart(AUDIO_BufferTypeDef* buffer, uint32_t threshold, uint32_t node_handle)
+{
+  AUDIO_Mixer_NodeTypeDef* mixer = (AUDIO_Mixer_NodeTypeDef*)node_handle;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  mixer->buf = buffer;
+  mixer->threshold = threshold;
+  mixer->drop_length = 0;
+  mixer->primed = 0;
+  mixer->underruns = 0;
+  mixer->node.state = AUDIO_NODE_STARTED;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerStop
+  *         Stops mixing, the speaker output is left untouched
+  * @param  node_handle: mixer node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MixerStop(uint32_t node_handle)
+{
+  ((AUDIO_Mixer_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerMute
+  *         Sets mute of master (channel 0) or of one channel of the mixed stream
+  * @param  channel_number: 0 for master, 1..n for a channel
+  * @param  mute: 1 to mute, 0 to unmute
+  * @param  node_handle: mixer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MixerMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle)
+{
+  AUDIO_Mixer_NodeTypeDef* mixer = (AUDIO_Mixer_NodeTypeDef*)node_handle;
+
+  if(channel_number == 0)
+  {
+    mixer->node.audio_description->audio_mute = mute;
+  }
+  else if(mute)
+  {
+    mixer->channel_mute |= (uint8_t)(1U << (channel_number - 1U));
+  }
+  else
+  {
+    mixer->channel_mute &= (uint8_t)~(1U << (channel_number - 1U));
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerSetVolume
+  *         Sets the master volume of the mixed stream, channels volumes are
+  *         not applied
+  * @param  channel_number: 0 for master
+  * @param  volume_db_256: volume in dB 8.8
+  * @param  node_handle: mixer node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MixerSetVolume(uint16_t channel_number, int volume_db_256, uint32_t node_handle)
+{
+  AUDIO_Mixer_NodeTypeDef* mixer = (AUDIO_Mixer_NodeTypeDef*)node_handle;
+
+  if(channel_number == 0)
+  {
+    mixer->node.audio_description->audio_volume_db_256 = volume_db_256;
+    /* only conversion from dB, done on change */
+    mixer->gain = (int32_t)(((int64_t)AUDIO_GainFromDb256(volume_db_256) * AUDIO_MIXER_GAIN_UNITY) >>
+                            AUDIO_GAIN_FRAC_BITS);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MixerLoad
+  *         reads frames of the mixed stream ring to the scratch, applies the
+  *         gain and the channels mutes then releases them
+  * @param  mixer: mixer node
+  * @param  frames: frames count, the ring holds them
+  * @retval None
+  */
+static void  AUDIO_MixerLoad(AUDIO_Mixer_NodeTypeDef* mixer, uint32_t frames)
+{
+  uint8_t channels = mixer->node.audio_description->channels_count;
+  uint32_t length = frames * AUDIO_SAMPLE_LENGTH(mixer->node.audio_description);
+  int32_t gain = mixer->gain;
+  uint8_t channel_mute = mixer->channel_mute;
+  AUDIO_BufferRegionTypeDef region;
+  int16_t* sample = mixer_scratch;
+  uint32_t i;
+  uint8_t ch;
+
+  AUDIO_BufferAcquireRead(mixer->buf, length, &region);
+  AUDIO_MEMCPY(mixer_scratch, region.data[0], region.length[0]);
+  AUDIO_MEMCPY((uint8_t*)mixer_scratch + region.length[0], region.data[1], region.length[1]);
+  AUDIO_BufferCommitRead(mixer->buf, length);
+  if((gain == AUDIO_MIXER_GAIN_UNITY) && (channel_mute == 0U))
+  {
+    return;
+  }
+  for(i = 0; i < frames; i++)
+  {
+    for(ch = 0; ch < channels; ch++)
+    {
+      sample[ch] = (channel_mute & (1U << ch)) ? 0 : (int16_t)__SSAT(((int32_t)sample[ch] * gain) >> 15, 16);
+    }
+    sample += channels;
+  }
+}
+
+/**
+  * @brief  AUDIO_MixerAdd
+  *         adds the scratch samples to the speaker slots, saturated
+  * @param  half: speaker slots of the first sample
+  * @param  samples: samples count
+  * @retval speaker slots of the next sample
+  */
+static uint8_t*  AUDIO_MixerAdd(uint8_t* half, uint32_t samples)
+{
+  int16_t* src = mixer_scratch;
+  uint32_t i;
+  int32_t x;
+
+  switch(mixer_output_description->audio_res)
+  {
+    case 2:
+    {
+      /* two slots per add, the half and every chunk but the last hold an even count */
+      uint32_t* dst = (uint32_t*)half;
+      const uint32_t* pairs = (const uint32_t*)mixer_scratch;
+      int16_t* last;
+
+      for(i = 0; i < (samples >> 1); i++)
+      {
+        dst[i] = __QADD16(dst[i], pairs[i]);
+      }
+      if(samples & 1U)
+      {
+        last = (int16_t*)&dst[samples >> 1];
+        *last = (int16_t)__SSAT((int32_t)*last + src[samples - 1U], 16);
+      }
+      return half + 2U * samples;
+    }
+    case 3:
+    {
+      uint32_t* dst = (uint32_t*)half;
+
+      for(i = 0; i < samples; i++)
+      {
+        /* right aligned slot, sign extended before the add */
+        x = __SSAT(((int32_t)(dst[i] << 8) >> 8) + ((int32_t)src[i] << 8), 24);
+        dst[i] = (uint32_t)x & AUDIO_PCM_24_MASK;
+      }
+      return half + 4U * samples;
+    }
+    case 4:
+    {
+      int32_t* dst = (int32_t*)half;
+
+      for(i = 0; i < samples; i++)
+      {
+        dst[i] = __QADD(dst[i], (int32_t)src[i] << 16);
+      }
+      return half + 4U * samples;
+    }
+    default:
+      return half;
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_MIX */
@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file    audio_mixer_node.h
+  * @brief   header file for the audio_mixer_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_MIXER_NODE_H
+#define __AUDIO_MIXER_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_MIX
+/* Exported constants --------------------------------------------------------*/
+/* mixed frames copied out of the ring at once */
+#define AUDIO_MIXER_CHUNK_FRAMES        32U
+#define AUDIO_MIXER_GAIN_UNITY          0x8000 /* Q15 */
+
+/* Exported types ------------------------------------------------------------*/
+/* mixer node : output of the mixed play stream, its 16 bits ring is added to the speaker halves */
+typedef struct
+{
+  AUDIO_NodeTypeDef        node;               /* node structure , must be first field , type is AUDIO_OUTPUT */
+  AUDIO_BufferTypeDef*     buf;                /* mixed stream ring, the mixer is its consumer */
+  uint32_t                 threshold;          /* ring fill to start or resume adding */
+  uint32_t                 drop_length;        /* asked by the session on overrun, dropped by the mixer */
+  int32_t                  gain;               /* Q15 , master volume of the mixed stream */
+  uint8_t                  channel_mute;       /* bit n-1 mutes channel n */
+  uint8_t                  primed;             /* 0 until the ring holds threshold */
+  uint32_t                 underruns;          /* halves played without the mixed stream since start */
+  int8_t                  (*MixerDeInit)    (uint32_t /*node_handle*/);
+  int8_t                  (*MixerStart)     (AUDIO_BufferTypeDef* /*buffer*/, uint32_t /*threshold*/,
+                                             uint32_t /*node_handle*/);
+  int8_t                  (*MixerStop)      (uint32_t /*node_handle*/);
+  int8_t                  (*MixerMute)      (uint16_t /*channel_number*/, uint8_t /*mute*/, uint32_t /*node_handle*/);
+  int8_t                  (*MixerSetVolume) (uint16_t /*channel_number*/, int /*volume_db_256*/, uint32_t /*node_handle*/);
+}
+AUDIO_Mixer_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_MixerInit(AUDIO_DescriptionTypeDef* audio_description,
+                        AUDIO_SessionTypeDef* session_handle,
+                        uint32_t node_handle);
+void    AUDIO_MixerSetOutput(AUDIO_DescriptionTypeDef* audio_description);
+void    AUDIO_MixerMix(uint8_t* half, uint32_t frames) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_MIXER_NODE_H */
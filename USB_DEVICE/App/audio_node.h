@@ -55,26 +55,140 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include <stdint.h> 
+#include <string.h>
+#include "cmsis_compiler.h"
+#include "audio_fast_copy.h"
 
 /* Exported Constantes ------------------------------------------------------------------*/
 #define AUDIO_BUFFER_UNDERFLOW_THERSHOLD 0x01
 #define AUDIO_BUFFER_OVERFLOW_THERSHOLD  0x02
 #define AUDIO_BUFFER_OVERFLOW  0x04
 #define AUDIO_BUFFER_UNDERFLOW  0x04
+#define AUDIO_BUFFER_MIRRORED   0x08 /* ring start is copied to the margin , reads never wrap */
 #define AUDIO_BUF_OVERFLOW_THERSHOLD 100
 #define AUDIO_BUF_UNDERFLOW_THERSHOLD 100
+#define AUDIO_BUFFER_FILL_HIST_BINS    16U /* bin n counts fill levels in [n, n + 1[ * size / 16 */
+/* Define USE_AUDIO_DESCRIPTION_SEQLOCK to publish the audio description changes of the
+   control requests under a sequence count : the packet path takes a consistent copy of
+   the fields without masking interrupts, it retries while a write is seen */
+#define AUDIO_DESCRIPTION_READ_RETRIES 4U /* a reader preempting the writer won't see it end */
+#if !defined(UNUSED)
+#define UNUSED(x) ((void)(x)) /* as stm32h7xx_hal_def.h, this header does not need the HAL */
+#endif /* UNUSED */
+#ifdef USE_AUDIO_PACKET_QUEUE
+#define AUDIO_PACKET_QUEUE_SIZE        64U /* packet descriptors of a ring, must be a power of two */
+#ifdef USE_USB_HS_ULPI_PHY
+#define AUDIO_PACKET_SOF_PER_MS        8U  /* SOF numbers count microframes */
+#else /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_PACKET_SOF_PER_MS        1U
+#endif /* USE_USB_HS_ULPI_PHY */
+/* packet time stamps are core cycles, the DWT cycle counter must be running */
+#define AUDIO_PACKET_TIME()            (DWT->CYCCNT)
+#define AUDIO_PACKET_FRAMES_TIME(frames, freq) ((uint32_t)(frames) * (SystemCoreClock / (freq)))
+#define AUDIO_PACKET_TIME_TO_US(cycles) ((uint32_t)((cycles) / (SystemCoreClock / 1000000U)))
+#endif /* USE_AUDIO_PACKET_QUEUE */
 
 /* Exported types ------------------------------------------------------------------*/  
+/* Fill level telemetry of a ring, sampled once per USB packet by the node which talks to the host.
+ * Only that node writes the levels, glitches are counted by the session */
 typedef struct
 {
-  uint8_t                   buffer_flags;
+  uint32_t                   fill_min;        /* bytes , UINT32_MAX before the first packet */
+  uint32_t                   fill_max;        /* bytes */
+  uint32_t                   fill_hist[AUDIO_BUFFER_FILL_HIST_BINS];
+  uint32_t                   underrun_count;
+  uint32_t                   overrun_count;
+  uint32_t                   resync_count;    /* packets the USB node dropped to recover , counted by the node */
+  uint32_t                   glitch_tick;     /* ms tick of the last underrun or overrun , or of the reset */
+}
+AUDIO_BufferTelemetryTypeDef;
+
+#ifdef USE_AUDIO_PACKET_QUEUE
+/* packet as the producer wrote it in the ring */
+typedef struct
+{
+  uint32_t                   ptr;             /* free running position of the first byte */
+  uint16_t                   length;          /* bytes */
+  uint16_t                   sof;             /* USB frame number when it was written */
+  uint32_t                   time;            /* AUDIO_PACKET_TIME of its first frame at the device edge */
+}
+AUDIO_PacketDescTypeDef;
+
+/* Time of the packets through a ring, from their producer time stamp to the consumer output.
+ * lost is written by the producer, the delays by the consumer */
+typedef struct
+{
+  uint32_t                   lost;            /* packets not tracked because the FIFO was full */
+  uint32_t                   count;           /* packets measured */
+  uint32_t                   last;            /* core cycles */
+  uint32_t                   min;             /* core cycles , UINT32_MAX before the first packet */
+  uint32_t                   max;             /* core cycles */
+  uint64_t                   total;           /* core cycles , average is total / count */
+}
+AUDIO_PacketDelayTypeDef;
+
+/* Single producer / single consumer FIFO of the packets of a ring. in is written by the ring
+ * producer only, out by the ring consumer only. A packet is pushed after its bytes are committed,
+ * it is lost when the FIFO is full : its bytes are then read as untracked data */
+typedef struct
+{
+  volatile uint32_t          in;              /* free running */
+  volatile uint32_t          out;             /* free running */
+  AUDIO_PacketDelayTypeDef   delay;           /* kept when the ring is emptied */
+  AUDIO_PacketDescTypeDef    desc[AUDIO_PACKET_QUEUE_SIZE];
+}
+AUDIO_PacketQueueTypeDef;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+/* Single producer / single consumer ring buffer.
+ * rd_ptr and wr_ptr are free running byte counters, only the producer writes wr_ptr and only
+ * the consumer writes rd_ptr. size is a power of two, the offset in data is (ptr & mask).
+ * data must be allocated with size + margin bytes. Nothing is copied when a packet crosses the
+ * ring end :
+ * - by default a write goes on in the margin and the bytes it put there are recorded for the
+ *   ring turn, readers get them from the margin. Reads may be split in two regions.
+ * - with AUDIO_BUFFER_MIRRORED writes wrap to the ring start, which the producer copies to the
+ *   margin, so a read of up to margin bytes is contiguous.
+ * A wrap record is kept for two turns, so the producer never changes the one the consumer reads */
+typedef struct
+{
+  uint8_t                    buffer_flags;
   uint8_t*                   data; 
-  uint16_t                   rd_ptr;  
-  uint16_t                   wr_ptr;
-  uint16_t                   size;
+  volatile uint32_t          rd_ptr;  
+  volatile uint32_t          wr_ptr;
+  uint32_t                   size;
+  uint32_t                   mask;
+  uint32_t                   margin;
+  volatile uint32_t          wrap_ptr[2]; /* turn start crossed by a write, for even and odd turns */
+  volatile uint32_t          wrap_len[2]; /* bytes of that turn start written in the margin */
+  AUDIO_BufferTelemetryTypeDef telemetry; /* kept when the ring is emptied */
+#ifdef USE_AUDIO_PACKET_QUEUE
+  AUDIO_PacketQueueTypeDef*  packets;         /* 0 when packets are not tracked */
+#endif /* USE_AUDIO_PACKET_QUEUE */
 }
 AUDIO_BufferTypeDef;
 
+/* Contiguous view of buffer data, the second part is used only when data wraps around the ring end */
+typedef struct
+{
+  uint8_t*                   data[2];
+  uint32_t                   length[2];
+}
+AUDIO_BufferRegionTypeDef;
+
+/* Packet scheduler : spreads a rate which is not a multiple of the packet rate over
+ * short and long packets (one more frame), Bresenham style, so that packets carry exactly
+ * frequence frames each second for any frequence */
+typedef struct
+{
+  uint16_t                   short_length; /* bytes of a packet of frequence / period frames */
+  uint16_t                   long_length;  /* short_length plus one frame */
+  uint32_t                   remainder;    /* frequence % period */
+  uint32_t                   period;       /* packets per second */
+  uint32_t                   accumulator;  /* fractional frames, in 1/period units */
+}
+AUDIO_PacketSchedulerTypeDef;
+
 /* Node state */
 typedef enum 
 {
@@ -96,6 +210,9 @@ typedef struct
   int                audio_volume_db_256;
   uint8_t            audio_mute;
   uint8_t            audio_res;   
+#ifdef USE_AUDIO_DESCRIPTION_SEQLOCK
+  volatile uint32_t  sequence;        /* odd while a writer updates the fields */
+#endif /* USE_AUDIO_DESCRIPTION_SEQLOCK */
 }AUDIO_DescriptionTypeDef;
 
 /* Node type */
@@ -123,6 +240,18 @@ typedef struct    AUDIO_Node
 }
 AUDIO_NodeTypeDef;
 
+/* Processing node : transforms frames of the stream, called per packet in node list order */
+typedef struct
+{
+  AUDIO_NodeTypeDef         node;  /* generic node structure , must be first field , type is AUDIO_PROCESSING */
+  int8_t  (*Process) (uint8_t* /*in*/, uint8_t* /*out*/, uint32_t /*frames*/, uint32_t /*node handle*/); /* in and out may be the same buffer */
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  /* in place on one float plane per channel, plane ch at planes + ch * stride. 0 when the node has no float variant */
+  int8_t  (*ProcessFloat) (float* /*planes*/, uint32_t /*stride*/, uint32_t /*frames*/, uint32_t /*node handle*/);
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+}
+AUDIO_ProcessingNodeTypeDef;
+
 /* Events raised by nodes to session */
 typedef enum 
 {
@@ -134,7 +263,9 @@ typedef enum
   AUDIO_UNDERRUN,
   AUDIO_OVERRUN_TH_REACHED,
   AUDIO_UNDERRUN_TH_REACHED,
-  AUDIO_FREQUENCY_CHANGED
+  AUDIO_FREQUENCY_CHANGED,
+  AUDIO_SILENCE_BEGIN,      /* play stream silent for the hold time, USE_AUDIO_PLAYBACK_SILENCE_POWER */
+  AUDIO_SILENCE_END
 } AUDIO_SessionEventTypeDef;
 /* Node state */
 typedef enum 
@@ -153,27 +284,35 @@ typedef struct    AUDIO_Session
   int8_t  (*SessionCallback) (AUDIO_SessionEventTypeDef /* event*/ ,
                               AUDIO_NodeTypeDef* /*node_handle*/,
                               struct    AUDIO_Session* /*session handle*/);
+  uint32_t  event_mask; /* AUDIO_SESSION_EVENT_BIT of events handled by SessionCallback, nodes drop the others */
 }
 AUDIO_SessionTypeDef;
 
 /* Exported macros -----------------------------------------------------------*/ 
-#define AUDIO_BUFFER_FREE_SIZE(buff)  (((buff)->wr_ptr>=(buff)->rd_ptr)?(buff)->rd_ptr +(buff)->size -(buff)->wr_ptr : \
-                                                                          (buff)->rd_ptr -(buff)->wr_ptr)
-#define AUDIO_BUFFER_FILLED_SIZE(buff)  (((buff)->wr_ptr>= (buff)->rd_ptr)?(buff)->wr_ptr -(buff)->rd_ptr : \
-(buff)->wr_ptr +(buff)->size -(buff)->rd_ptr)
-
+/* session event subscription */
+#define AUDIO_SESSION_EVENT_BIT(event)  (1UL << (uint32_t)(event))
+#define AUDIO_SESSION_SUBSCRIBED(session, event) \
+        (((session)->event_mask & AUDIO_SESSION_EVENT_BIT(event)) != 0U)
+#define AUDIO_BUFFER_FREE_SIZE(buff)    AUDIO_BufferFreeSize(buff)
+#define AUDIO_BUFFER_FILLED_SIZE(buff)  AUDIO_BufferFilledSize(buff)
+#define AUDIO_BUFFER_RD_OFFSET(buff)    ((buff)->rd_ptr & (buff)->mask)
+#define AUDIO_BUFFER_WR_OFFSET(buff)    ((buff)->wr_ptr & (buff)->mask)
+/* wrap record of the turn starting at free running ptr */
+#define AUDIO_BUFFER_TURN(buff, ptr)    ((((ptr) & (buff)->size) != 0U) ? 1U : 0U)
 
 /* compute one packet size */
 #define AUDIO_MS_PACKET_SIZE(freq,channel_count,res_byte) (((uint32_t)((freq) /1000))* (channel_count) * (res_byte)) 
 #define AUDIO_MS_MAX_PACKET_SIZE(freq,channel_count,res_byte) AUDIO_MS_PACKET_SIZE(freq+999,channel_count,res_byte)
 
-#ifdef USE_USB_HS
-//#define AUDIO_USB_PACKET_SIZE(freq,channel_count,res_byte) (((uint32_t)((freq) /8000))* (channel_count) * (res_byte))
-//#define AUDIO_USB_MAX_PACKET_SIZE(freq,channel_count,res_byte) AUDIO_USB_PACKET_SIZE(freq+7999,channel_count,res_byte)
-#define AUDIO_USB_PACKET_SIZE(freq,channel_count,res_byte) (((uint32_t)((freq) /1000))* (channel_count) * (res_byte)) 
-#define AUDIO_USB_MAX_PACKET_SIZE(freq,channel_count,res_byte) AUDIO_USB_PACKET_SIZE(freq+999,channel_count,res_byte)
-#else /* USE_USB_HS */
-#endif /* USE_USB_HS */
+/* iso packets per second: one packet each 2^(bInterval-1) frames on a full speed bus,
+   each 2^(bInterval-1) 125 us microframes on a high speed bus (external ULPI PHY) */
+#ifdef USE_USB_HS_ULPI_PHY
+#define AUDIO_USB_PACKETS_PER_SECOND   (8000U >> (AUDIO_HS_BINTERVAL - 1U))
+#else /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_USB_PACKETS_PER_SECOND   (1000U >> (AUDIO_FS_BINTERVAL - 1U))
+#endif /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_USB_PACKET_SIZE(freq,channel_count,res_byte) (((uint32_t)((freq) /AUDIO_USB_PACKETS_PER_SECOND))* (channel_count) * (res_byte)) 
+#define AUDIO_USB_MAX_PACKET_SIZE(freq,channel_count,res_byte) AUDIO_USB_PACKET_SIZE((freq)+AUDIO_USB_PACKETS_PER_SECOND-1,channel_count,res_byte)
 #define AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(audio_desc) AUDIO_USB_PACKET_SIZE((audio_desc)->frequence, (audio_desc)->channels_count, (audio_desc)->audio_res)
 #define AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(audio_desc) AUDIO_USB_MAX_PACKET_SIZE((audio_desc)->frequence, (audio_desc)->channels_count, (audio_desc)->audio_res)
 #define AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(audio_desc) AUDIO_MS_PACKET_SIZE((audio_desc)->frequence, (audio_desc)->channels_count, (audio_desc)->audio_res)
@@ -182,6 +321,670 @@ AUDIO_SessionTypeDef;
    /* compute 1 sample length */
 #define AUDIO_SAMPLE_LENGTH(audio_desc) ( (audio_desc)->channels_count*(audio_desc)->audio_res)
 
+/* Exported functions ------------------------------------------------------- */
+/**
+  * @brief  AUDIO_BufferReset
+  *         empty the buffer , must be called while producer or consumer is stopped
+  * @param  buf: audio buffer
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferReset(AUDIO_BufferTypeDef* buf)
+{
+  buf->rd_ptr = 0;
+  buf->wr_ptr = 0;
+  buf->wrap_len[0] = 0;
+  buf->wrap_len[1] = 0;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  if(buf->packets != 0)
+  {
+    buf->packets->in = 0;
+    buf->packets->out = 0;
+  }
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  __DMB();
+}
+
+/**
+  * @brief  AUDIO_BufferTelemetryReset
+  *         clears the fill level telemetry
+  * @param  buf: audio buffer
+  * @param  tick: current ms tick
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferTelemetryReset(AUDIO_BufferTypeDef* buf, uint32_t tick)
+{
+  memset(&buf->telemetry, 0, sizeof(buf->telemetry));
+  buf->telemetry.fill_min = UINT32_MAX;
+  buf->telemetry.glitch_tick = tick;
+}
+
+/**
+  * @brief  AUDIO_BufferTelemetryUpdate
+  *         records one fill level sample, O(1)
+  * @param  buf: audio buffer
+  * @param  filled: filled size in bytes
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferTelemetryUpdate(AUDIO_BufferTypeDef* buf, uint32_t filled)
+{
+  uint32_t bin = (filled * AUDIO_BUFFER_FILL_HIST_BINS) / buf->size;
+
+  if(bin >= AUDIO_BUFFER_FILL_HIST_BINS)
+  {
+    bin = AUDIO_BUFFER_FILL_HIST_BINS - 1U;
+  }
+  buf->telemetry.fill_hist[bin]++;
+  if(filled < buf->telemetry.fill_min)
+  {
+    buf->telemetry.fill_min = filled;
+  }
+  if(filled > buf->telemetry.fill_max)
+  {
+    buf->telemetry.fill_max = filled;
+  }
+}
+
+/**
+  * @brief  AUDIO_BufferTelemetryGlitch
+  *         counts an underrun or an overrun
+  * @param  buf: audio buffer
+  * @param  overrun: 1 for an overrun, 0 for an underrun
+  * @param  tick: current ms tick
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferTelemetryGlitch(AUDIO_BufferTypeDef* buf, uint8_t overrun, uint32_t tick)
+{
+  if(overrun)
+  {
+    buf->telemetry.overrun_count++;
+  }
+  else
+  {
+    buf->telemetry.underrun_count++;
+  }
+  buf->telemetry.glitch_tick = tick;
+}
+
+/**
+  * @brief  AUDIO_BufferTelemetryResync
+  *         counts a packet dropped by the USB node to recover from an
+  *         unexpected transfer, the stream goes on with the next packet
+  * @param  buf: audio buffer
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferTelemetryResync(AUDIO_BufferTypeDef* buf)
+{
+  buf->telemetry.resync_count++;
+}
+
+/**
+  * @brief  AUDIO_BufferFilledSize
+  *         return count of bytes available to read, data may be read safely after this call
+  * @param  buf: audio buffer
+  * @retval filled size in bytes
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferFilledSize(AUDIO_BufferTypeDef* buf)
+{
+  uint32_t filled = buf->wr_ptr - buf->rd_ptr;
+  
+  __DMB();
+  return filled;
+}
+
+/**
+  * @brief  AUDIO_BufferFreeSize
+  *         return count of bytes available to write, data may be written safely after this call
+  * @param  buf: audio buffer
+  * @retval free size in bytes
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferFreeSize(AUDIO_BufferTypeDef* buf)
+{
+  uint32_t free_size = buf->size - (buf->wr_ptr - buf->rd_ptr);
+  
+  __DMB();
+  return free_size;
+}
+
+/**
+  * @brief  AUDIO_BufferTurnWrap
+  *         bytes of a turn start which a write put in the margin
+  * @param  buf: audio buffer
+  * @param  start: free running position of the turn start
+  * @retval byte count , 0 when the turn starts at the ring start
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferTurnWrap(AUDIO_BufferTypeDef* buf, uint32_t start)
+{
+  uint32_t turn = AUDIO_BUFFER_TURN(buf, start);
+
+  return (buf->wrap_ptr[turn] == start) ? buf->wrap_len[turn] : 0U;
+}
+
+/**
+  * @brief  AUDIO_BufferGetRegion
+  *         where a range of written bytes is in memory
+  * @param  buf: audio buffer
+  * @param  ptr: free running position of the range
+  * @param  length: range length, at most the ring size less the margin
+  * @param  region: returned region, split in two parts when the range is not contiguous
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferGetRegion(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint32_t length,
+                                           AUDIO_BufferRegionTypeDef* region)
+{
+  uint32_t offset = ptr & buf->mask;
+  uint32_t start = ptr - offset;
+  uint32_t wrap = 0;
+  uint32_t first;
+
+  if((buf->buffer_flags & AUDIO_BUFFER_MIRRORED) == 0U)
+  {
+    wrap = AUDIO_BufferTurnWrap(buf, start);
+  }
+  if(offset < wrap)
+  {
+    /* the turn start was written in the margin */
+    region->data[0] = buf->data + buf->size + offset;
+    first = wrap - offset;
+  }
+  else
+  {
+    region->data[0] = buf->data + offset;
+    wrap = (buf->buffer_flags & AUDIO_BUFFER_MIRRORED) ? buf->margin : AUDIO_BufferTurnWrap(buf, start + buf->size);
+    first = buf->size - offset + wrap;
+  }
+  region->data[1] = buf->data + wrap;
+  region->length[0] = (length > first) ? first : length;
+  region->length[1] = length - region->length[0];
+}
+
+/**
+  * @brief  AUDIO_BufferGetWritePtr
+  *         return the producer position, up to margin bytes may be written past the end of the ring
+  * @param  buf: audio buffer
+  * @retval write pointer
+  */
+__STATIC_INLINE uint8_t* AUDIO_BufferGetWritePtr(AUDIO_BufferTypeDef* buf)
+{
+  return buf->data + AUDIO_BUFFER_WR_OFFSET(buf);
+}
+
+/**
+  * @brief  AUDIO_BufferCommitWrite
+  *         publish bytes written by the producer at the position AUDIO_BufferGetWritePtr or
+  *         AUDIO_BufferAcquireWrite gave. A write crossing the ring end is recorded, or
+  *         with AUDIO_BUFFER_MIRRORED the ring start it wrote is copied to the margin
+  * @param  buf: audio buffer
+  * @param  length: written bytes
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferCommitWrite(AUDIO_BufferTypeDef* buf, uint32_t length)
+{
+  uint32_t offset = AUDIO_BUFFER_WR_OFFSET(buf);
+  uint32_t start = (buf->wr_ptr - offset) + buf->size;
+  uint32_t from = offset;
+  uint32_t to = offset + length;
+
+  if(offset + length > buf->size)
+  {
+    from = 0;
+    to = offset + length - buf->size;
+    if((buf->buffer_flags & AUDIO_BUFFER_MIRRORED) == 0U)
+    {
+      buf->wrap_len[AUDIO_BUFFER_TURN(buf, start)] = (to > buf->margin) ? buf->margin : to;
+      buf->wrap_ptr[AUDIO_BUFFER_TURN(buf, start)] = start;
+    }
+  }
+  if((buf->buffer_flags & AUDIO_BUFFER_MIRRORED) && (from < buf->margin))
+  {
+    AUDIO_MEMCPY(buf->data + buf->size + from, buf->data + from, ((to > buf->margin) ? buf->margin : to) - from);
+  }
+  __DMB();
+  buf->wr_ptr += length;
+}
+
+/**
+  * @brief  AUDIO_BufferGetReadPtr
+  *         return the consumer position, data is contiguous for an AUDIO_BUFFER_MIRRORED
+  *         buffer
+  * @param  buf: audio buffer
+  * @param  length: bytes to read, must not exceed the margin
+  * @retval read pointer
+  */
+__STATIC_INLINE uint8_t* AUDIO_BufferGetReadPtr(AUDIO_BufferTypeDef* buf, uint32_t length)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  AUDIO_BufferGetRegion(buf, buf->rd_ptr, length, &region);
+  return region.data[0];
+}
+
+/**
+  * @brief  AUDIO_BufferCommitRead
+  *         release bytes read by the consumer
+  * @param  buf: audio buffer
+  * @param  length: read bytes
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferCommitRead(AUDIO_BufferTypeDef* buf, uint32_t length)
+{
+  __DMB();
+  buf->rd_ptr += length;
+}
+
+/**
+  * @brief  AUDIO_BufferDrop
+  *         release up to length unread bytes without reading them, in whole frames
+  * @param  buf: audio buffer
+  * @param  length: bytes to drop
+  * @param  frame_size: bytes per frame
+  * @retval dropped bytes count
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferDrop(AUDIO_BufferTypeDef* buf, uint32_t length, uint32_t frame_size)
+{
+  uint32_t filled = AUDIO_BufferFilledSize(buf);
+
+  if(length > filled)
+  {
+    length = filled;
+  }
+  length -= length % frame_size;
+  AUDIO_BufferCommitRead(buf, length);
+  return length;
+}
+
+/**
+  * @brief  AUDIO_BufferAcquireRead
+  *         borrow up to length bytes in place, data stays owned by the consumer until
+  *         it is released with AUDIO_BufferCommitRead
+  * @param  buf: audio buffer
+  * @param  length: bytes wanted
+  * @param  region: returned region, split in two parts when it is not contiguous
+  * @retval borrowed bytes count
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferAcquireRead(AUDIO_BufferTypeDef* buf, uint32_t length,
+                                                 AUDIO_BufferRegionTypeDef* region)
+{
+  uint32_t filled = AUDIO_BufferFilledSize(buf);
+  
+  if(length > filled)
+  {
+    length = filled;
+  }
+  AUDIO_BufferGetRegion(buf, buf->rd_ptr, length, region);
+  return length;
+}
+
+/**
+  * @brief  AUDIO_BufferAcquireWrite
+  *         reserve up to length free bytes so the producer renders data in place, data
+  *         is published with AUDIO_BufferCommitWrite
+  * @param  buf: audio buffer
+  * @param  length: bytes wanted
+  * @param  region: returned region, split in two parts when it is not contiguous
+  * @retval reserved bytes count
+  */
+__STATIC_INLINE uint32_t AUDIO_BufferAcquireWrite(AUDIO_BufferTypeDef* buf, uint32_t length,
+                                                  AUDIO_BufferRegionTypeDef* region)
+{
+  uint32_t offset = AUDIO_BUFFER_WR_OFFSET(buf);
+  uint32_t free_size = AUDIO_BufferFreeSize(buf);
+  uint32_t first = buf->size - offset;
+  
+  if(length > free_size)
+  {
+    length = free_size;
+  }
+  if((buf->buffer_flags & AUDIO_BUFFER_MIRRORED) == 0U)
+  {
+    /* goes on in the margin first */
+    first += buf->margin;
+  }
+  region->data[0] = buf->data + offset;
+  region->length[0] = (length > first) ? first : length;
+  region->length[1] = length - region->length[0];
+  region->data[1] = buf->data + ((region->length[1] != 0U) ? (offset + region->length[0] - buf->size) : 0U);
+  return length;
+}
+
+/**
+  * @brief  AUDIO_BufferWrite
+  *         copy data to the buffer
+  * @param  buf: audio buffer
+  * @param  src: data to write
+  * @param  length: bytes to write , caller checks the free size
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferWrite(AUDIO_BufferTypeDef* buf, const uint8_t* src, uint32_t length)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  AUDIO_BufferAcquireWrite(buf, length, &region);
+  AUDIO_MEMCPY(region.data[0], src, region.length[0]);
+  AUDIO_MEMCPY(region.data[1], src + region.length[0], region.length[1]);
+  AUDIO_BufferCommitWrite(buf, length);
+}
+
+/**
+  * @brief  AUDIO_BufferPeek
+  *         copy data from the buffer without releasing it
+  * @param  buf: audio buffer
+  * @param  dst: destination
+  * @param  length: bytes to copy , caller checks the filled size
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferPeek(AUDIO_BufferTypeDef* buf, uint8_t* dst, uint32_t length)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  AUDIO_BufferGetRegion(buf, buf->rd_ptr, length, &region);
+  AUDIO_MEMCPY(dst, region.data[0], region.length[0]);
+  AUDIO_MEMCPY(dst + region.length[0], region.data[1], region.length[1]);
+}
+
+/**
+  * @brief  AUDIO_BufferRead
+  *         copy data from the buffer then release it
+  * @param  buf: audio buffer
+  * @param  dst: destination
+  * @param  length: bytes to read , caller checks the filled size
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferRead(AUDIO_BufferTypeDef* buf, uint8_t* dst, uint32_t length)
+{
+  AUDIO_BufferPeek(buf, dst, length);
+  AUDIO_BufferCommitRead(buf, length);
+}
+
+#ifdef USE_AUDIO_PACKET_QUEUE
+/**
+  * @brief  AUDIO_BufferPushPacket
+  *         producer side, track a packet once its bytes are committed
+  * @param  buf: audio buffer
+  * @param  ptr: free running position of the packet
+  * @param  length: packet length in bytes
+  * @param  sof: USB frame number of the packet
+  * @param  time: AUDIO_PACKET_TIME of the packet first frame
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferPushPacket(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint16_t length,
+                                            uint16_t sof, uint32_t time)
+{
+  AUDIO_PacketQueueTypeDef* queue = buf->packets;
+  AUDIO_PacketDescTypeDef* desc;
+
+  if(queue == 0)
+  {
+    return;
+  }
+  if((queue->in - queue->out) >= AUDIO_PACKET_QUEUE_SIZE)
+  {
+    queue->delay.lost++;
+    return;
+  }
+  desc = &queue->desc[queue->in & (AUDIO_PACKET_QUEUE_SIZE - 1U)];
+  desc->ptr = ptr;
+  desc->length = length;
+  desc->sof = sof;
+  desc->time = time;
+  __DMB();
+  queue->in++;
+}
+
+/**
+  * @brief  AUDIO_BufferNextPacket
+  *         consumer side, describe the packet starting at the read position. Packets
+  *         already read are released. When the read position is inside a packet the
+  *         rest of it is returned, untracked bytes before a packet are returned as one
+  *         packet with the frame number of the following one
+  * @param  buf: audio buffer
+  * @param  packet: returned packet, ptr is the read position
+  * @retval 1 if a packet is tracked, 0 otherwise
+  */
+__STATIC_INLINE uint8_t AUDIO_BufferNextPacket(AUDIO_BufferTypeDef* buf, AUDIO_PacketDescTypeDef* packet)
+{
+  AUDIO_PacketQueueTypeDef* queue = buf->packets;
+  AUDIO_PacketDescTypeDef* desc;
+  uint32_t rd_ptr = buf->rd_ptr;
+
+  if(queue == 0)
+  {
+    return 0;
+  }
+  while(queue->out != queue->in)
+  {
+    __DMB();
+    desc = &queue->desc[queue->out & (AUDIO_PACKET_QUEUE_SIZE - 1U)];
+    if((int32_t)(desc->ptr + desc->length - rd_ptr) > 0)
+    {
+      packet->ptr = rd_ptr;
+      packet->sof = desc->sof;
+      packet->time = desc->time;
+      packet->length = (uint16_t)(((int32_t)(desc->ptr - rd_ptr) > 0) ? (desc->ptr - rd_ptr) :
+                                                                      (desc->ptr + desc->length - rd_ptr));
+      return 1;
+    }
+    queue->out++;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_PacketDelayReset
+  *         clears the packet delays of a ring
+  * @param  buf: audio buffer
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_PacketDelayReset(AUDIO_BufferTypeDef* buf)
+{
+  if(buf->packets != 0)
+  {
+    memset(&buf->packets->delay, 0, sizeof(buf->packets->delay));
+    buf->packets->delay.min = UINT32_MAX;
+  }
+}
+
+/**
+  * @brief  AUDIO_BufferMeasureDelay
+  *         consumer side, records the delay of the packet at the read position , called
+  *         before the read is committed
+  * @param  buf: audio buffer
+  * @param  output_time: AUDIO_PACKET_TIME when the consumer outputs the read position
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_BufferMeasureDelay(AUDIO_BufferTypeDef* buf, uint32_t output_time)
+{
+  AUDIO_PacketDelayTypeDef* delay;
+  AUDIO_PacketDescTypeDef packet;
+
+  if(AUDIO_BufferNextPacket(buf, &packet) == 0U)
+  {
+    return;
+  }
+  delay = &buf->packets->delay;
+  delay->last = output_time - packet.time;
+  if(delay->last < delay->min)
+  {
+    delay->min = delay->last;
+  }
+  if(delay->last > delay->max)
+  {
+    delay->max = delay->last;
+  }
+  delay->total += delay->last;
+  delay->count++;
+}
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+/**
+  * @brief  AUDIO_PacketSchedulerInit
+  *         computes packet lengths for the audio description, first packet is a short one
+  * @param  scheduler: packet scheduler
+  * @param  audio_desc: audio description , frequence and frame size
+  * @param  packets_per_second: packet rate
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_PacketSchedulerInit(AUDIO_PacketSchedulerTypeDef* scheduler,
+                                               AUDIO_DescriptionTypeDef* audio_desc,
+                                               uint32_t packets_per_second)
+{
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(audio_desc);
+  
+  scheduler->period = packets_per_second;
+  scheduler->remainder = audio_desc->frequence % packets_per_second;
+  scheduler->short_length = (uint16_t)((audio_desc->frequence / packets_per_second) * frame_size);
+  scheduler->long_length = (uint16_t)(scheduler->short_length + frame_size);
+  scheduler->accumulator = 0;
+}
+
+/**
+  * @brief  AUDIO_PacketSchedulerReset
+  *         restarts the sequence of packet lengths
+  * @param  scheduler: packet scheduler
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_PacketSchedulerReset(AUDIO_PacketSchedulerTypeDef* scheduler)
+{
+  scheduler->accumulator = 0;
+}
+
+/**
+  * @brief  AUDIO_PacketSchedulerPeek
+  *         return the length of next packet without moving to the following one
+  * @param  scheduler: packet scheduler
+  * @retval packet length in bytes
+  */
+__STATIC_INLINE uint16_t AUDIO_PacketSchedulerPeek(AUDIO_PacketSchedulerTypeDef* scheduler)
+{
+  return (scheduler->accumulator + scheduler->remainder >= scheduler->period) ?
+          scheduler->long_length : scheduler->short_length;
+}
+
+/**
+  * @brief  AUDIO_PacketSchedulerNext
+  *         return the length of next packet and move to the following one
+  * @param  scheduler: packet scheduler
+  * @retval packet length in bytes
+  */
+__STATIC_INLINE uint16_t AUDIO_PacketSchedulerNext(AUDIO_PacketSchedulerTypeDef* scheduler)
+{
+  scheduler->accumulator += scheduler->remainder;
+  if(scheduler->accumulator >= scheduler->period)
+  {
+    scheduler->accumulator -= scheduler->period;
+    return scheduler->long_length;
+  }
+  return scheduler->short_length;
+}
+
+/**
+  * @brief  AUDIO_NodeProcessChain
+  *         runs the started processing nodes found from node to the end of the
+  *         list, in place on one packet of whole frames
+  * @param  node: first node of the chain, usually next of the node producing the packet
+  * @param  data: packet , contiguous
+  * @param  length: packet length in bytes
+  * @retval None
+  */
+#ifdef USE_AUDIO_CPU_LOAD
+void AUDIO_CpuLoadNode(AUDIO_NodeTypeDef* node, uint32_t cycles) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_CPU_LOAD */
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+void AUDIO_FloatPipelineProcessChain(AUDIO_NodeTypeDef* node, uint8_t* data, uint32_t length) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+__STATIC_INLINE void AUDIO_NodeProcessChain(AUDIO_NodeTypeDef* node, uint8_t* data, uint32_t length)
+{
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  AUDIO_FloatPipelineProcessChain(node, data, length);
+#else /* USE_AUDIO_FLOAT_PIPELINE */
+  uint32_t frames;
+#ifdef USE_AUDIO_CPU_LOAD
+  uint32_t start;
+#endif /* USE_AUDIO_CPU_LOAD */
+
+  for(; node != 0; node = node->next)
+  {
+    if((node->type == AUDIO_PROCESSING) && (node->state == AUDIO_NODE_STARTED))
+    {
+      frames = length / AUDIO_SAMPLE_LENGTH(node->audio_description);
+#ifdef USE_AUDIO_CPU_LOAD
+      start = DWT->CYCCNT;
+      ((AUDIO_ProcessingNodeTypeDef*)node)->Process(data, data, frames, (uint32_t)node);
+      AUDIO_CpuLoadNode(node, DWT->CYCCNT - start);
+#else /* USE_AUDIO_CPU_LOAD */
+      ((AUDIO_ProcessingNodeTypeDef*)node)->Process(data, data, frames, (uint32_t)node);
+#endif /* USE_AUDIO_CPU_LOAD */
+    }
+  }
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+}
+
+/**
+  * @brief  AUDIO_DescriptionWriteBegin
+  *         starts an update of the description fields. Writers run from the
+  *         control requests or the pump, a writer preempting another one
+  *         ends its update before returning
+  * @param  desc: audio description
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_DescriptionWriteBegin(AUDIO_DescriptionTypeDef* desc)
+{
+#ifdef USE_AUDIO_DESCRIPTION_SEQLOCK
+  desc->sequence++;
+  __DMB();
+#else /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+  UNUSED(desc);
+#endif /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+}
+
+/**
+  * @brief  AUDIO_DescriptionWriteEnd
+  *         publishes the updated fields
+  * @param  desc: audio description
+  * @retval None
+  */
+__STATIC_INLINE void AUDIO_DescriptionWriteEnd(AUDIO_DescriptionTypeDef* desc)
+{
+#ifdef USE_AUDIO_DESCRIPTION_SEQLOCK
+  __DMB();
+  desc->sequence++;
+#else /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+  UNUSED(desc);
+#endif /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+}
+
+/**
+  * @brief  AUDIO_DescriptionRead
+  *         copies the description, never waits for a writer : the copy is
+  *         taken again up to AUDIO_DESCRIPTION_READ_RETRIES times while an
+  *         update is seen
+  * @param  desc: audio description
+  * @param  copy: consistent copy of the fields
+  * @retval 0 if consistent, -1 when the reader preempted a writer , copy mixes old and new fields
+  */
+__STATIC_INLINE int8_t AUDIO_DescriptionRead(const AUDIO_DescriptionTypeDef* desc, AUDIO_DescriptionTypeDef* copy)
+{
+#ifdef USE_AUDIO_DESCRIPTION_SEQLOCK
+  uint32_t sequence;
+  uint32_t retry;
+
+  for(retry = 0; retry < AUDIO_DESCRIPTION_READ_RETRIES; retry++)
+  {
+    sequence = desc->sequence;
+    __DMB();
+    *copy = *desc;
+    __DMB();
+    if(((sequence & 1U) == 0U) && (desc->sequence == sequence))
+    {
+      return 0;
+    }
+  }
+  return -1;
+#else /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+  *copy = *desc;
+  return 0;
+#endif /* USE_AUDIO_DESCRIPTION_SEQLOCK */
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,450 @@
+/**
+  ******************************************************************************
+  * @file    audio_params.c
+  * @brief   runtime parameters kept in flash : volume, mute and rate of each
+  *          direction, playback latency profile and equalizer. The last set
+  *          written is read once at boot, the sessions restore it in their
+  *          audio descriptions. The main loop compares the parameters used
+  *          with the last set written and appends a new record once they are
+  *          stable, so a volume ramp costs one record. The flash is never
+  *          written from an interrupt
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "main.h"
+#include "audio_params.h"
+#include "audio_sessions_usb.h"
+
+#ifdef USE_AUDIO_PARAMS_STORE
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_PARAMS_MAGIC                0x50415241U /* "ARAP" */
+#define AUDIO_PARAMS_FLASH_WORD           (FLASH_NB_32BITWORD_IN_FLASHWORD * 4U)
+/* a record is a whole count of flash words, the ECC unit */
+#define AUDIO_PARAMS_SLOT_SIZE            ((sizeof(AUDIO_ParamsRecordTypeDef) + AUDIO_PARAMS_FLASH_WORD - 1U) & \
+                                           ~(AUDIO_PARAMS_FLASH_WORD - 1U))
+#define AUDIO_PARAMS_SLOT_COUNT           (FLASH_SECTOR_SIZE / AUDIO_PARAMS_SLOT_SIZE)
+#define AUDIO_PARAMS_SLOT(sector, slot)   ((const AUDIO_ParamsRecordTypeDef*)(AUDIO_PARAMS_ADDRESS(sector) + \
+                                                                              ((slot) * AUDIO_PARAMS_SLOT_SIZE)))
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint32_t sequence;   /* incremented by each record, the highest one is the last written */
+  uint32_t length;     /* sizeof(AUDIO_ParamsTypeDef) , another layout is not restored */
+  uint32_t crc;        /* CRC-32 of params */
+  AUDIO_ParamsTypeDef params;
+}
+AUDIO_ParamsRecordTypeDef;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_ParamsCollect(AUDIO_ParamsTypeDef* params);
+static int8_t   AUDIO_ParamsWrite(const AUDIO_ParamsTypeDef* params);
+static int8_t   AUDIO_ParamsErase(uint8_t sector);
+static uint8_t  AUDIO_ParamsIsValid(const AUDIO_ParamsRecordTypeDef* record);
+static uint8_t  AUDIO_ParamsIsBlank(const AUDIO_ParamsRecordTypeDef* record);
+static uint8_t  AUDIO_ParamsStreaming(void);
+static uint32_t AUDIO_ParamsCrc(const uint8_t* data, uint32_t length);
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_ParamsTypeDef params_saved;      /* last set written, or restored at boot */
+static AUDIO_ParamsTypeDef params_pending;    /* last set collected */
+static uint8_t  params_restored = 0;          /* params_saved was read from flash */
+static uint8_t  params_reserved = 0;          /* the linker keeps the sectors out of the code */
+static uint32_t params_changed_tick = 0;      /* HAL tick params_pending changed at */
+static uint32_t params_sequence = 0;
+static uint8_t  params_sector = 0;            /* sector records are appended to */
+static uint32_t params_slot = 0;              /* next free slot of params_sector */
+static AUDIO_DescriptionTypeDef* params_desc[AUDIO_PARAMS_DIRECTION_COUNT];
+static AUDIO_SessionTypeDef* params_session[AUDIO_PARAMS_DIRECTION_COUNT];
+__ALIGN_BEGIN static uint32_t params_record[AUDIO_PARAMS_SLOT_SIZE / 4U] __ALIGN_END;
+/* size kept at the end of bank 1 by the linker script, its value is the address */
+extern uint8_t __flash_reserved_size__[];
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ParamsInit
+  *         finds the last record written and the next free slot. Called once
+  *         at boot, before the USB device starts. The store stays unused when
+  *         the linker does not keep its sectors out of the code
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ParamsInit(void)
+{
+  const AUDIO_ParamsRecordTypeDef* record;
+  const AUDIO_ParamsRecordTypeDef* last = 0;
+  uint32_t used[AUDIO_PARAMS_SECTOR_COUNT];
+  uint32_t slot;
+  uint8_t sector;
+
+  memset(params_desc, 0, sizeof(params_desc));
+  memset(params_session, 0, sizeof(params_session));
+  memset(&params_saved, 0, sizeof(params_saved));
+  params_restored = 0;
+  params_sequence = 0;
+  params_reserved = ((uint32_t)__flash_reserved_size__ >= (AUDIO_PARAMS_SECTOR_COUNT * FLASH_SECTOR_SIZE)) ? 1U : 0U;
+  if(!params_reserved)
+  {
+    return;
+  }
+  for(sector = 0; sector < AUDIO_PARAMS_SECTOR_COUNT; sector++)
+  {
+    used[sector] = 0;
+    for(slot = 0; slot < AUDIO_PARAMS_SLOT_COUNT; slot++)
+    {
+      record = AUDIO_PARAMS_SLOT(sector, slot);
+      if(!AUDIO_ParamsIsBlank(record))
+      {
+        /* a slot after the last used one is never written again before an erase */
+        used[sector] = slot + 1U;
+      }
+      if(AUDIO_ParamsIsValid(record) &&
+         ((last == 0) || ((int32_t)(record->sequence - last->sequence) > 0)))
+      {
+        last = record;
+        params_sector = sector;
+      }
+    }
+  }
+  if(last != 0)
+  {
+    memcpy(&params_saved, &last->params, sizeof(params_saved));
+    params_sequence = last->sequence;
+    params_restored = 1;
+  }
+  else
+  {
+    params_sector = 0;
+  }
+  params_slot = used[params_sector];
+  memcpy(&params_pending, &params_saved, sizeof(params_pending));
+  params_changed_tick = HAL_GetTick();
+}
+
+/**
+  * @brief  AUDIO_ParamsRestore
+  *         applies the parameters read at boot to the description of a
+  *         direction, which is then watched by AUDIO_ParamsPoll. Called by
+  *         the session init, before its nodes are initialized
+  * @param  direction: AUDIO_PARAMS_PLAY or AUDIO_PARAMS_RECORD
+  * @param  audio_description: session description , defaults are kept when
+  *         nothing was saved
+  * @param  session: session, flash sectors are only erased while it is not started
+  * @param  freq_list: rates of the session, a saved rate out of it is not restored
+  * @param  freq_count: rates count
+  * @retval parameters read at boot, 0 when none
+  */
+const AUDIO_ParamsTypeDef* AUDIO_ParamsRestore(uint8_t direction, AUDIO_DescriptionTypeDef* audio_description,
+                                               AUDIO_SessionTypeDef* session,
+                                               const uint32_t* freq_list, uint8_t freq_count)
+{
+  uint8_t i;
+
+  if(direction >= AUDIO_PARAMS_DIRECTION_COUNT)
+  {
+    return 0;
+  }
+  params_desc[direction] = audio_description;
+  params_session[direction] = session;
+  if(!params_restored)
+  {
+    return 0;
+  }
+  audio_description->audio_volume_db_256 = params_saved.volume_db_256[direction];
+  audio_description->audio_mute = params_saved.mute[direction];
+  for(i = 0; i < freq_count; i++)
+  {
+    if(freq_list[i] == params_saved.frequency[direction])
+    {
+      audio_description->frequence = params_saved.frequency[direction];
+      break;
+    }
+  }
+  return &params_saved;
+}
+
+#ifdef USE_AUDIO_PLAYBACK_EQ
+/**
+  * @brief  AUDIO_ParamsRestoreEq
+  *         loads the saved equalizer stages. Called by the play session init
+  *         once the equalizer node is initialized
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ParamsRestoreEq(void)
+{
+  uint16_t ch;
+  uint8_t s;
+
+  if(!params_restored)
+  {
+    return;
+  }
+  for(ch = 0; ch < USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT; ch++)
+  {
+    for(s = 0; s < AUDIO_EQ_MAX_STAGES; s++)
+    {
+      AUDIO_EqSetStage(ch + 1U, s, params_saved.eq[ch][s]);
+    }
+  }
+  AUDIO_EqCommit();
+}
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+/**
+  * @brief  AUDIO_ParamsPoll
+  *         writes the parameters once they are stable and differ from the
+  *         last set written. Called from the main loop, a failed write is
+  *         retried after AUDIO_PARAMS_WRITE_DELAY_MS
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_ParamsPoll(void)
+{
+  AUDIO_ParamsTypeDef params;
+  uint32_t now = HAL_GetTick();
+
+  if(!params_reserved || ((params_desc[AUDIO_PARAMS_PLAY] == 0) && (params_desc[AUDIO_PARAMS_RECORD] == 0)))
+  {
+    return;
+  }
+  AUDIO_ParamsCollect(&params);
+  if(memcmp(&params, &params_pending, sizeof(params)) != 0)
+  {
+    memcpy(&params_pending, &params, sizeof(params));
+    params_changed_tick = now;
+    return;
+  }
+  if((memcmp(&params_pending, &params_saved, sizeof(params)) == 0) ||
+     ((now - params_changed_tick) < AUDIO_PARAMS_WRITE_DELAY_MS))
+  {
+    return;
+  }
+  if(AUDIO_ParamsWrite(&params_pending) == 0)
+  {
+    memcpy(&params_saved, &params_pending, sizeof(params_saved));
+  }
+  else
+  {
+    params_changed_tick = now;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ParamsCollect
+  *         reads the parameters used, those of a direction without session
+  *         keep their saved value
+  * @param  params: filled with the parameters
+  * @retval None
+  */
+static void  AUDIO_ParamsCollect(AUDIO_ParamsTypeDef* params)
+{
+  AUDIO_DescriptionTypeDef* desc;
+  uint8_t d;
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  uint16_t ch;
+  uint8_t s;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+  memcpy(params, &params_saved, sizeof(AUDIO_ParamsTypeDef));
+  for(d = 0; d < AUDIO_PARAMS_DIRECTION_COUNT; d++)
+  {
+    desc = params_desc[d];
+    if(desc != 0)
+    {
+      params->frequency[d] = desc->frequence;
+      params->volume_db_256[d] = desc->audio_volume_db_256;
+      params->mute[d] = desc->audio_mute;
+    }
+  }
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  params->play_latency = (uint8_t)AUDIO_Playback_GetLatency();
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+  for(d = 0; d < AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT; d++)
+  {
+    params->play_drift_ppm[d] = AUDIO_Playback_GetDriftPpm(d);
+  }
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  for(ch = 0; ch < USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT; ch++)
+  {
+    for(s = 0; s < AUDIO_EQ_MAX_STAGES; s++)
+    {
+      /* keeps the saved stage when the equalizer is not built */
+      AUDIO_EqGetStage(ch + 1U, s, params->eq[ch][s]);
+    }
+  }
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+}
+
+/**
+  * @brief  AUDIO_ParamsWrite
+  *         appends a record to the current sector. When it is full the other
+  *         sector is erased first, only while no session streams : the erase
+  *         stalls the code fetch from flash for about a second. Programming
+  *         a record stalls it for some tens of us
+  * @param  params: parameters to write
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ParamsWrite(const AUDIO_ParamsTypeDef* params)
+{
+  AUDIO_ParamsRecordTypeDef* record = (AUDIO_ParamsRecordTypeDef*)params_record;
+  uint32_t address;
+  uint32_t offset;
+  int8_t ret = 0;
+
+  if(params_slot >= AUDIO_PARAMS_SLOT_COUNT)
+  {
+    if(AUDIO_ParamsStreaming() || (AUDIO_ParamsErase(params_sector ^ 1U) != 0))
+    {
+      return -1;
+    }
+    params_sector ^= 1U;
+    params_slot = 0;
+  }
+  memset(params_record, 0xFF, sizeof(params_record));
+  record->magic = AUDIO_PARAMS_MAGIC;
+  record->sequence = params_sequence + 1U;
+  record->length = sizeof(AUDIO_ParamsTypeDef);
+  memcpy(&record->params, params, sizeof(AUDIO_ParamsTypeDef));
+  record->crc = AUDIO_ParamsCrc((const uint8_t*)&record->params, sizeof(AUDIO_ParamsTypeDef));
+  address = (uint32_t)AUDIO_PARAMS_SLOT(params_sector, params_slot);
+  /* the slot is used even when programming fails */
+  params_slot++;
+  HAL_FLASH_Unlock();
+  for(offset = 0; offset < AUDIO_PARAMS_SLOT_SIZE; offset += AUDIO_PARAMS_FLASH_WORD)
+  {
+    if(HAL_FLASH_Program(FLASH_TYPEPROGRAM_FLASHWORD, address + offset,
+                         (uint32_t)&params_record[offset / 4U]) != HAL_OK)
+    {
+      ret = -1;
+      break;
+    }
+  }
+  HAL_FLASH_Lock();
+  SCB_InvalidateDCache_by_Addr((uint32_t*)address, (int32_t)AUDIO_PARAMS_SLOT_SIZE);
+  if((ret != 0) || (memcmp((const void*)address, params_record, AUDIO_PARAMS_SLOT_SIZE) != 0))
+  {
+    return -1;
+  }
+  params_sequence = record->sequence;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ParamsErase
+  *         erases a sector of the store
+  * @param  sector: 0 to AUDIO_PARAMS_SECTOR_COUNT - 1
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_ParamsErase(uint8_t sector)
+{
+  FLASH_EraseInitTypeDef erase;
+  uint32_t error = 0;
+  HAL_StatusTypeDef status;
+
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.Banks = FLASH_BANK_1;
+  erase.Sector = AUDIO_PARAMS_SECTOR + sector;
+  erase.NbSectors = 1;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+  HAL_FLASH_Unlock();
+  status = HAL_FLASHEx_Erase(&erase, &error);
+  HAL_FLASH_Lock();
+  SCB_InvalidateDCache_by_Addr((uint32_t*)AUDIO_PARAMS_ADDRESS(sector), (int32_t)FLASH_SECTOR_SIZE);
+  return (status == HAL_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  AUDIO_ParamsIsValid
+  *         checks a record was fully written by this parameters layout
+  * @param  record: record in flash
+  * @retval 1 if it can be restored
+  */
+static uint8_t  AUDIO_ParamsIsValid(const AUDIO_ParamsRecordTypeDef* record)
+{
+  return ((record->magic == AUDIO_PARAMS_MAGIC) && (record->length == sizeof(AUDIO_ParamsTypeDef)) &&
+          (record->crc == AUDIO_ParamsCrc((const uint8_t*)&record->params, sizeof(AUDIO_ParamsTypeDef)))) ? 1U : 0U;
+}
+
+/**
+  * @brief  AUDIO_ParamsIsBlank
+  *         checks a slot was not written since the sector erase
+  * @param  record: slot in flash
+  * @retval 1 if every byte is erased
+  */
+static uint8_t  AUDIO_ParamsIsBlank(const AUDIO_ParamsRecordTypeDef* record)
+{
+  const uint32_t* word = (const uint32_t*)record;
+  uint32_t i;
+
+  for(i = 0; i < (AUDIO_PARAMS_SLOT_SIZE / 4U); i++)
+  {
+    if(word[i] != 0xFFFFFFFFU)
+    {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+  * @brief  AUDIO_ParamsStreaming
+  *         checks whether a watched session is started
+  * @param  None
+  * @retval 1 if audio streams
+  */
+static uint8_t  AUDIO_ParamsStreaming(void)
+{
+  uint8_t d;
+
+  for(d = 0; d < AUDIO_PARAMS_DIRECTION_COUNT; d++)
+  {
+    if((params_session[d] != 0) && (params_session[d]->state == AUDIO_SESSION_STARTED))
+    {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ParamsCrc
+  *         CRC-32 of zlib / Ethernet, computed bitwise : the CRC unit may be
+  *         used from the pump, which preempts the main loop
+  * @param  data: bytes to check
+  * @param  length: bytes count
+  * @retval CRC
+  */
+static uint32_t  AUDIO_ParamsCrc(const uint8_t* data, uint32_t length)
+{
+  uint32_t crc = 0xFFFFFFFFU;
+  uint32_t i;
+  uint8_t b;
+
+  for(i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for(b = 0; b < 8U; b++)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320U & (0U - (crc & 1U)));
+    }
+  }
+  return ~crc;
+}
+#endif /* USE_AUDIO_PARAMS_STORE */
@@ -0,0 +1,83 @@
+/**
+  ******************************************************************************
+  * @file    audio_params.h
+  * @brief   header file for the audio_params.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PARAMS_H
+#define __AUDIO_PARAMS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_PARAMS_STORE
+#include "audio_node.h"
+#include "usb_audio_user.h"
+#include "audio_sessions_usb.h"
+#ifdef USE_AUDIO_PLAYBACK_EQ
+#include "audio_eq_node.h"
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+
+/* Exported constants --------------------------------------------------------*/
+/* the two last 128 KB sectors of bank 1, kept out of the FLASH region of the linker
+   script by linking with -Wl,--defsym=__flash_reserved_size__=256K. Records are
+   appended in one sector, the other one is erased when it is full */
+#define AUDIO_PARAMS_SECTOR               FLASH_SECTOR_6
+#define AUDIO_PARAMS_SECTOR_COUNT         2U
+#define AUDIO_PARAMS_ADDRESS(sector)      (FLASH_BANK1_BASE + ((AUDIO_PARAMS_SECTOR + (sector)) * FLASH_SECTOR_SIZE))
+/* parameters are written once they did not change for this long */
+#define AUDIO_PARAMS_WRITE_DELAY_MS       2000U
+
+#define AUDIO_PARAMS_PLAY                 0U
+#define AUDIO_PARAMS_RECORD               1U
+#define AUDIO_PARAMS_DIRECTION_COUNT      2U
+
+/* Exported types ------------------------------------------------------------*/
+/* parameters restored at boot, no padding so sets are compared with memcmp */
+typedef struct
+{
+  uint32_t frequency[AUDIO_PARAMS_DIRECTION_COUNT];
+  int32_t  volume_db_256[AUDIO_PARAMS_DIRECTION_COUNT];
+  uint8_t  mute[AUDIO_PARAMS_DIRECTION_COUNT];
+  uint8_t  play_latency;    /* AUDIO_USB_LatencyProfileTypedef */
+  uint8_t  reserved;
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+  int16_t  play_drift_ppm[AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT]; /* clock drift learnt by the feedback */
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  float    eq[USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT][AUDIO_EQ_MAX_STAGES][AUDIO_EQ_COEF_COUNT];
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+}
+AUDIO_ParamsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void  AUDIO_ParamsInit(void);
+const AUDIO_ParamsTypeDef* AUDIO_ParamsRestore(uint8_t direction, AUDIO_DescriptionTypeDef* audio_description,
+                                               AUDIO_SessionTypeDef* session,
+                                               const uint32_t* freq_list, uint8_t freq_count);
+#ifdef USE_AUDIO_PLAYBACK_EQ
+void  AUDIO_ParamsRestoreEq(void);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+void  AUDIO_ParamsPoll(void);
+#endif /* USE_AUDIO_PARAMS_STORE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PARAMS_H */
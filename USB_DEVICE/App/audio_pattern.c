@@ -0,0 +1,388 @@
+/**
+  ******************************************************************************
+  * @file    audio_pattern.c
+  * @brief   test pattern : every recorded frame of the dummy mic is numbered
+  *          and every played frame of the dummy speaker is checked, so the
+  *          stream integrity is verified without analyzer. A recording of the
+  *          dummy mic is checked on the host by Tests/Host/pattern_verify.c
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_pattern.h"
+
+#if (defined USE_AUDIO_MIC_PATTERN) || (defined USE_AUDIO_SPEAKER_PATTERN)
+#include "audio_pcm.h"
+
+#if (defined USE_AUDIO_MIC_PATTERN) && (!defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_MIC_PATTERN replaces the dummy mic data, USE_AUDIO_DUMMY_MIC is required"
+#endif /* USE_AUDIO_MIC_PATTERN && !USE_AUDIO_DUMMY_MIC */
+#if (defined USE_AUDIO_SPEAKER_PATTERN) && (!defined USE_AUDIO_SPEAKER_DUMMY)
+#error "USE_AUDIO_SPEAKER_PATTERN checks the dummy speaker data, USE_AUDIO_SPEAKER_DUMMY is required"
+#endif /* USE_AUDIO_SPEAKER_PATTERN && !USE_AUDIO_SPEAKER_DUMMY */
+#if (defined USE_AUDIO_MIC_PATTERN) && (defined USE_AUDIO_LOOPBACK)
+#error "USE_AUDIO_MIC_PATTERN would overwrite the looped back data, disable USE_AUDIO_LOOPBACK"
+#endif /* USE_AUDIO_MIC_PATTERN && USE_AUDIO_LOOPBACK */
+#if (AUDIO_PATTERN_DEFAULT_MODE >= AUDIO_PATTERN_MODE_COUNT)
+#error "AUDIO_PATTERN_DEFAULT_MODE is not a pattern mode"
+#endif /* AUDIO_PATTERN_DEFAULT_MODE */
+
+/* Private variables ---------------------------------------------------------*/
+#ifdef USE_AUDIO_MIC_PATTERN
+/* written by the pump only */
+static uint8_t  pattern_mode = AUDIO_PATTERN_OFF;
+static uint16_t pattern_word;
+static volatile uint32_t pattern_frames;
+/* written by the USB interrupt , cleared by the pump */
+static volatile uint32_t pattern_sync_packets;
+static volatile uint32_t pattern_sync_skipped;
+static volatile uint32_t pattern_sync_last_frame;
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+/* written by the pump only */
+static AUDIO_PatternCheckTypeDef check;
+static uint16_t check_expected;         /* word of the next frame */
+static uint8_t  check_bad;              /* consecutive corrupted frames */
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t AUDIO_PatternNext(uint8_t mode, uint16_t word);
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+static uint16_t AUDIO_PatternPrevious(uint8_t mode, uint16_t word);
+static int32_t  AUDIO_PatternDistance(uint8_t mode, uint16_t expected, uint16_t word);
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+/* Exported functions --------------------------------------------------------*/
+#ifdef USE_AUDIO_MIC_PATTERN
+/**
+  * @brief  AUDIO_PatternInit
+  *         starts the default pattern
+  * @param  None
+  * @retval None
+  */
+void AUDIO_PatternInit(void)
+{
+  AUDIO_PatternSetMode(AUDIO_PATTERN_DEFAULT_MODE);
+}
+
+/**
+  * @brief  AUDIO_PatternSetMode
+  *         restarts the sequence with a pattern and clears the counts. Must be
+  *         called from the pump
+  * @param  mode: AUDIO_PATTERN_OFF, AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @retval 0 if no error
+  */
+int8_t AUDIO_PatternSetMode(uint8_t mode)
+{
+  if(mode >= AUDIO_PATTERN_MODE_COUNT)
+  {
+    return -1;
+  }
+  pattern_mode            = mode;
+  pattern_word            = (mode == AUDIO_PATTERN_PRBS) ? AUDIO_PATTERN_PRBS_SEED : 0U;
+  pattern_frames          = 0;
+  pattern_sync_packets    = 0;
+  pattern_sync_skipped    = 0;
+  pattern_sync_last_frame = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_PatternGetStats
+  *         reads the counts since the last mode change
+  * @param  stats: returned counts
+  * @retval None
+  */
+void AUDIO_PatternGetStats(AUDIO_PatternStatsTypeDef* stats)
+{
+  stats->mode            = pattern_mode;
+  stats->frames          = pattern_frames;
+  stats->sync_packets    = pattern_sync_packets;
+  stats->sync_skipped    = pattern_sync_skipped;
+  stats->sync_last_frame = pattern_sync_last_frame;
+}
+
+/**
+  * @brief  AUDIO_PatternWriteRegion
+  *         writes the next frames of the pattern over a packet of the mic ring,
+  *         before it is committed. Called from the pump
+  * @param  region: packet area in the mic ring
+  * @param  length: bytes to write , whole frames
+  * @param  audio_description: format of the recording
+  * @retval None
+  */
+void AUDIO_PatternWriteRegion(const AUDIO_BufferRegionTypeDef* region, uint32_t length,
+                              const AUDIO_DescriptionTypeDef* audio_description)
+{
+  uint32_t offset;
+  uint32_t frames = 0;
+  uint8_t  res    = audio_description->audio_res;
+  uint8_t  shift  = (uint8_t)(8U * (res - 2U));
+  uint8_t  channel;
+
+  if(pattern_mode == AUDIO_PATTERN_OFF)
+  {
+    return;
+  }
+  for(offset = 0; offset + AUDIO_SAMPLE_LENGTH(audio_description) <= length;)
+  {
+    for(channel = 0; channel < audio_description->channels_count; channel++)
+    {
+      /* word in the 16 most significant bits, the host may drop the lower ones */
+      AUDIO_PcmRegionWrite(region, offset, (int32_t)((uint32_t)(uint16_t)(pattern_word ^ channel) << shift), res);
+      offset += res;
+    }
+    pattern_word = AUDIO_PatternNext(pattern_mode, pattern_word);
+    frames++;
+  }
+  pattern_frames += frames;
+}
+
+/**
+  * @brief  AUDIO_PatternSyncAdjust
+  *         counts a packet length change of the recording implicit synchro.
+  *         Called from the USB interrupt
+  * @param  bytes: length added to the packet , or removed when negative
+  * @param  skipped: 1 when the bytes were dropped from the ring instead
+  * @param  audio_description: format of the recording
+  * @retval None
+  */
+void AUDIO_PatternSyncAdjust(int32_t bytes, uint8_t skipped,
+                             const AUDIO_DescriptionTypeDef* audio_description)
+{
+  if((pattern_mode == AUDIO_PATTERN_OFF) || (bytes == 0))
+  {
+    return;
+  }
+  pattern_sync_packets++;
+  if(skipped)
+  {
+    pattern_sync_skipped   += (uint32_t)bytes / AUDIO_SAMPLE_LENGTH(audio_description);
+    pattern_sync_last_frame = pattern_frames;
+  }
+}
+#endif /* USE_AUDIO_MIC_PATTERN */
+
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+/**
+  * @brief  AUDIO_PatternCheckInit
+  *         starts checking the default pattern
+  * @param  None
+  * @retval None
+  */
+void AUDIO_PatternCheckInit(void)
+{
+  AUDIO_PatternCheckSetMode(AUDIO_PATTERN_DEFAULT_MODE);
+}
+
+/**
+  * @brief  AUDIO_PatternCheckSetMode
+  *         selects the pattern the host plays and clears the counts, the check
+  *         locks on the next played word. Must be called from the pump
+  * @param  mode: AUDIO_PATTERN_OFF, AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @retval 0 if no error
+  */
+int8_t AUDIO_PatternCheckSetMode(uint8_t mode)
+{
+  if(mode >= AUDIO_PATTERN_MODE_COUNT)
+  {
+    return -1;
+  }
+  memset(&check, 0, sizeof(check));
+  check.mode = mode;
+  check_bad  = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_PatternCheckGetStats
+  *         reads the check counts since the last mode change
+  * @param  stats: returned counts
+  * @retval None
+  */
+void AUDIO_PatternCheckGetStats(AUDIO_PatternCheckTypeDef* stats)
+{
+  *stats = check;
+}
+
+/**
+  * @brief  AUDIO_PatternCheckRegion
+  *         checks the frames of a played packet against the pattern. Frames
+  *         out of sequence by up to AUDIO_PATTERN_MAX_JUMP are counted lost
+  *         or repeated and the check follows the stream, other words are
+  *         counted corrupted. Called from the pump
+  * @param  region: packet area in the play ring
+  * @param  length: packet bytes
+  * @param  audio_description: format of the playback
+  * @param  sof: SOF number , kept with the last error
+  * @retval None
+  */
+void AUDIO_PatternCheckRegion(const AUDIO_BufferRegionTypeDef* region, uint32_t length,
+                              const AUDIO_DescriptionTypeDef* audio_description, uint16_t sof)
+{
+  uint32_t offset;
+  uint32_t errors = 0;
+  int32_t  distance;
+  uint8_t  res   = audio_description->audio_res;
+  uint8_t  shift = (uint8_t)(8U * (res - 2U));
+  uint8_t  channel;
+  uint16_t word;
+  uint16_t other;
+
+  if(check.mode == AUDIO_PATTERN_OFF)
+  {
+    return;
+  }
+  for(offset = 0; offset + AUDIO_SAMPLE_LENGTH(audio_description) <= length;
+      offset += AUDIO_SAMPLE_LENGTH(audio_description))
+  {
+    word = (uint16_t)((uint32_t)AUDIO_PcmRegionRead(region, offset, res) >> shift);
+    if(!check.locked)
+    {
+      if(word == 0U)
+      {
+        /* silence before the host starts the pattern */
+        continue;
+      }
+      check.locked   = 1;
+      check_expected = word;
+    }
+    check.frames++;
+    for(channel = 1; channel < audio_description->channels_count; channel++)
+    {
+      other = (uint16_t)((uint32_t)AUDIO_PcmRegionRead(region, offset + (uint32_t)channel * res, res) >> shift);
+      if((uint16_t)(other ^ channel) != word)
+      {
+        check.bit_errors += (uint32_t)__builtin_popcount((uint16_t)(other ^ channel ^ word));
+        errors++;
+      }
+    }
+    if(word != check_expected)
+    {
+      errors++;
+      distance = AUDIO_PatternDistance(check.mode, check_expected, word);
+      if(distance > 0)
+      {
+        check.lost += (uint32_t)distance;
+      }
+      else if(distance < 0)
+      {
+        check.repeated += (uint32_t)(-distance);
+      }
+      else
+      {
+        check.corrupted++;
+        check.bit_errors += (uint32_t)__builtin_popcount((uint16_t)(word ^ check_expected));
+        if(++check_bad < AUDIO_PATTERN_RESYNC_FRAMES)
+        {
+          /* the frame stays at its place in the sequence */
+          check_expected = AUDIO_PatternNext(check.mode, check_expected);
+          continue;
+        }
+        check.resyncs++;
+      }
+      check_expected = word;
+    }
+    check_bad      = 0;
+    check_expected = AUDIO_PatternNext(check.mode, check_expected);
+  }
+  if(check.locked)
+  {
+    check.packets++;
+    if(errors != 0U)
+    {
+      check.error_packets++;
+      check.error_sof = sof;
+    }
+  }
+}
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PatternNext
+  *         word of the frame after a frame
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @param  word: word of the frame
+  * @retval next word
+  */
+static uint16_t AUDIO_PatternNext(uint8_t mode, uint16_t word)
+{
+  if(mode == AUDIO_PATTERN_COUNTER)
+  {
+    return (uint16_t)(word + 1U);
+  }
+  return (uint16_t)((word >> 1) ^ ((word & 1U) ? AUDIO_PATTERN_PRBS_TAPS : 0U));
+}
+
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+/**
+  * @brief  AUDIO_PatternPrevious
+  *         word of the frame before a frame , the LFSR taps include bit 15 so
+  *         it tells whether the taps were applied
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @param  word: word of the frame
+  * @retval previous word
+  */
+static uint16_t AUDIO_PatternPrevious(uint8_t mode, uint16_t word)
+{
+  if(mode == AUDIO_PATTERN_COUNTER)
+  {
+    return (uint16_t)(word - 1U);
+  }
+  if(word & 0x8000U)
+  {
+    return (uint16_t)(((word ^ AUDIO_PATTERN_PRBS_TAPS) << 1) | 1U);
+  }
+  return (uint16_t)(word << 1);
+}
+
+/**
+  * @brief  AUDIO_PatternDistance
+  *         position of a word from the expected one in the sequence
+  * @param  mode: AUDIO_PATTERN_COUNTER or AUDIO_PATTERN_PRBS
+  * @param  expected: word expected
+  * @param  word: word found
+  * @retval frames skipped when positive, played again when negative , 0 when
+  *         the word is further than AUDIO_PATTERN_MAX_JUMP
+  */
+static int32_t AUDIO_PatternDistance(uint8_t mode, uint16_t expected, uint16_t word)
+{
+  uint16_t ahead  = expected;
+  uint16_t behind = expected;
+  int32_t  i;
+
+  if(mode == AUDIO_PATTERN_COUNTER)
+  {
+    i = (int16_t)(uint16_t)(word - expected);
+    return ((i >= -(int32_t)AUDIO_PATTERN_MAX_JUMP) && (i <= (int32_t)AUDIO_PATTERN_MAX_JUMP)) ? i : 0;
+  }
+  /* the LFSR has no cheaper way than stepping both directions */
+  for(i = 1; i <= (int32_t)AUDIO_PATTERN_MAX_JUMP; i++)
+  {
+    ahead  = AUDIO_PatternNext(mode, ahead);
+    behind = AUDIO_PatternPrevious(mode, behind);
+    if(ahead == word)
+    {
+      return i;
+    }
+    if(behind == word)
+    {
+      return -i;
+    }
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+#endif /* USE_AUDIO_MIC_PATTERN || USE_AUDIO_SPEAKER_PATTERN */
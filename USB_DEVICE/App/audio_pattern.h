@@ -0,0 +1,112 @@
+/**
+  ******************************************************************************
+  * @file    audio_pattern.h
+  * @brief   header file for the audio_pattern.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PATTERN_H
+#define __AUDIO_PATTERN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "usbd_conf.h"
+
+#if (defined USE_AUDIO_MIC_PATTERN) || (defined USE_AUDIO_SPEAKER_PATTERN)
+/* Exported constants --------------------------------------------------------*/
+/* each frame carries a 16 bits word in the most significant bits of its
+   samples, channel c carries word ^ c. The position of a frame is found from
+   its word alone : a dropped, repeated or inserted frame breaks the sequence */
+#define AUDIO_PATTERN_OFF                 0U /* data is not generated or checked */
+#define AUDIO_PATTERN_COUNTER             1U /* word of frame n is n modulo 65536 */
+#define AUDIO_PATTERN_PRBS                2U /* word is a 16 bits Galois LFSR state, stepped once per frame */
+#define AUDIO_PATTERN_MODE_COUNT          3U
+#ifndef AUDIO_PATTERN_DEFAULT_MODE
+#define AUDIO_PATTERN_DEFAULT_MODE        AUDIO_PATTERN_COUNTER
+#endif /* AUDIO_PATTERN_DEFAULT_MODE */
+#define AUDIO_PATTERN_PRBS_TAPS           0xB400U /* x^16 + x^14 + x^13 + x^11 + 1 , period 65535 */
+#define AUDIO_PATTERN_PRBS_SEED           0x0001U /* word of the first frame */
+#endif /* USE_AUDIO_MIC_PATTERN || USE_AUDIO_SPEAKER_PATTERN */
+
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+/* a word out of sequence by up to this many frames is a jump of the stream,
+   further it is a corrupted frame. A counter word with a flipped bit looks
+   like a jump , the PRBS tells corrupted words from jumps */
+#ifndef AUDIO_PATTERN_MAX_JUMP
+#define AUDIO_PATTERN_MAX_JUMP            4096U
+#endif /* AUDIO_PATTERN_MAX_JUMP */
+#define AUDIO_PATTERN_RESYNC_FRAMES       4U /* consecutive corrupted frames before the check locks again */
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+/* Exported types ------------------------------------------------------------*/
+#ifdef USE_AUDIO_MIC_PATTERN
+/* counts since the last mode change, the host compares the discontinuities it
+   finds with the frames the implicit synchro skipped */
+typedef struct
+{
+  uint8_t  mode;
+  uint32_t frames;             /* frames generated */
+  uint32_t sync_packets;       /* packets whose length the implicit synchro changed */
+  uint32_t sync_skipped;       /* frames dropped from the stream by the implicit synchro */
+  uint32_t sync_last_frame;    /* frames generated when the last frames were skipped */
+}
+AUDIO_PatternStatsTypeDef;
+#endif /* USE_AUDIO_MIC_PATTERN */
+
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+/* check of the played packets since the last mode change */
+typedef struct
+{
+  uint8_t  mode;
+  uint8_t  locked;             /* a first pattern word was found */
+  uint32_t packets;            /* packets checked since the lock */
+  uint32_t error_packets;      /* packets with at least one error */
+  uint16_t error_sof;          /* SOF number when the last error was found */
+  uint32_t frames;
+  uint32_t lost;               /* frames missing from the stream */
+  uint32_t repeated;           /* frames played again */
+  uint32_t corrupted;          /* frames with a word out of sequence */
+  uint32_t bit_errors;         /* bits in error in the corrupted words and between channels */
+  uint32_t resyncs;            /* locks after AUDIO_PATTERN_RESYNC_FRAMES corrupted frames */
+}
+AUDIO_PatternCheckTypeDef;
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+/* Exported functions ------------------------------------------------------- */
+#ifdef USE_AUDIO_MIC_PATTERN
+void    AUDIO_PatternInit(void);
+int8_t  AUDIO_PatternSetMode(uint8_t mode);
+void    AUDIO_PatternGetStats(AUDIO_PatternStatsTypeDef* stats);
+void    AUDIO_PatternWriteRegion(const AUDIO_BufferRegionTypeDef* region, uint32_t length,
+                                 const AUDIO_DescriptionTypeDef* audio_description);
+void    AUDIO_PatternSyncAdjust(int32_t bytes, uint8_t skipped,
+                                const AUDIO_DescriptionTypeDef* audio_description) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_SPEAKER_PATTERN
+void    AUDIO_PatternCheckInit(void);
+int8_t  AUDIO_PatternCheckSetMode(uint8_t mode);
+void    AUDIO_PatternCheckGetStats(AUDIO_PatternCheckTypeDef* stats);
+void    AUDIO_PatternCheckRegion(const AUDIO_BufferRegionTypeDef* region, uint32_t length,
+                                 const AUDIO_DescriptionTypeDef* audio_description, uint16_t sof);
+#endif /* USE_AUDIO_SPEAKER_PATTERN */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PATTERN_H */
@@ -0,0 +1,438 @@
+/**
+  ******************************************************************************
+  * @file    audio_pcm.c
+  * @brief   PCM sample containers conversion : packed 24 bits samples
+  *          (S24_3LE, as carried on USB) to and from 32 bits words, the
+  *          layout SAI and DSP code expect. Four samples are converted per
+  *          loop with three unaligned word accesses instead of twelve byte
+  *          accesses.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_pcm.h"
+#include "audio_pcm_kernels.h"
+
+#if defined(USE_AUDIO_PLANAR_DSP) && !defined(USE_AUDIO_PCM_KERNELS)
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_PCM_SCALE_16                32768.0f
+#define AUDIO_PCM_SCALE_24                8388608.0f
+#define AUDIO_PCM_SCALE_32                2147483648.0f
+#endif /* USE_AUDIO_PLANAR_DSP && !USE_AUDIO_PCM_KERNELS */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t AUDIO_PcmRead24(const uint8_t* in);
+static void     AUDIO_PcmWrite24(uint8_t* out, uint32_t sample);
+#if defined(USE_AUDIO_PLANAR_DSP) && !defined(USE_AUDIO_PCM_KERNELS)
+static int32_t  AUDIO_PcmSaturate(float y, float scale, int32_t max);
+#endif /* USE_AUDIO_PLANAR_DSP && !USE_AUDIO_PCM_KERNELS */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PcmUnpack24
+  *         unpacks 3 bytes samples to 32 bits words, 24 bits right aligned
+  * @param  in: packed samples, no alignment needed
+  * @param  out: unpacked samples
+  * @param  samples: samples count
+  * @retval None
+  */
+void  AUDIO_PcmUnpack24(const uint8_t* in, uint32_t* out, uint32_t samples)
+{
+  uint32_t w0, w1, w2;
+
+  while(samples >= 4U)
+  {
+    w0 = __UNALIGNED_UINT32_READ(in);
+    w1 = __UNALIGNED_UINT32_READ(in + 4U);
+    w2 = __UNALIGNED_UINT32_READ(in + 8U);
+    out[0] = w0 & AUDIO_PCM_24_MASK;
+    out[1] = (w0 >> 24) | ((w1 << 8) & AUDIO_PCM_24_MASK);
+    out[2] = (w1 >> 16) | ((w2 << 16) & AUDIO_PCM_24_MASK);
+    out[3] = w2 >> 8;
+    in += 12U;
+    out += 4U;
+    samples -= 4U;
+  }
+  while(samples--)
+  {
+    *out++ = AUDIO_PcmRead24(in);
+    in += AUDIO_PCM_PACKED_24_BYTES;
+  }
+}
+
+/**
+  * @brief  AUDIO_PcmPack24
+  *         packs the 24 low bits of 32 bits words to 3 bytes samples
+  * @param  in: 32 bits samples, upper byte is ignored
+  * @param  out: packed samples, no alignment needed
+  * @param  samples: samples count
+  * @retval None
+  */
+void  AUDIO_PcmPack24(const uint32_t* in, uint8_t* out, uint32_t samples)
+{
+  while(samples >= 4U)
+  {
+    __UNALIGNED_UINT32_WRITE(out, (in[0] & AUDIO_PCM_24_MASK) | (in[1] << 24));
+    __UNALIGNED_UINT32_WRITE(out + 4U, ((in[1] >> 8) & 0xFFFFU) | (in[2] << 16));
+    __UNALIGNED_UINT32_WRITE(out + 8U, ((in[2] >> 16) & 0xFFU) | (in[3] << 8));
+    in += 4U;
+    out += 12U;
+    samples -= 4U;
+  }
+  while(samples--)
+  {
+    AUDIO_PcmWrite24(out, *in++);
+    out += AUDIO_PCM_PACKED_24_BYTES;
+  }
+}
+
+/**
+  * @brief  AUDIO_PcmUnpack24Region
+  *         unpacks packed samples of a buffer region, a sample may be split by
+  *         the ring end
+  * @param  region: packed samples, total length is a multiple of 3 bytes
+  * @param  out: unpacked samples
+  * @retval unpacked samples count
+  */
+uint32_t  AUDIO_PcmUnpack24Region(const AUDIO_BufferRegionTypeDef* region, uint32_t* out)
+{
+  uint32_t samples = region->length[0] / AUDIO_PCM_PACKED_24_BYTES;
+  uint32_t split = region->length[0] - (samples * AUDIO_PCM_PACKED_24_BYTES);
+  uint8_t  sample[AUDIO_PCM_PACKED_24_BYTES];
+  uint32_t i;
+
+  AUDIO_PcmUnpack24(region->data[0], out, samples);
+  out += samples;
+  if(split != 0U)
+  {
+    for(i = 0; i < AUDIO_PCM_PACKED_24_BYTES; i++)
+    {
+      sample[i] = (i < split) ? region->data[0][samples * AUDIO_PCM_PACKED_24_BYTES + i] :
+                                region->data[1][i - split];
+    }
+    *out++ = AUDIO_PcmRead24(sample);
+    samples++;
+    split = AUDIO_PCM_PACKED_24_BYTES - split;
+  }
+  AUDIO_PcmUnpack24(region->data[1] + split, out,
+                    (region->length[1] - split) / AUDIO_PCM_PACKED_24_BYTES);
+  return samples + (region->length[1] - split) / AUDIO_PCM_PACKED_24_BYTES;
+}
+
+/**
+  * @brief  AUDIO_PcmPack24Region
+  *         packs samples into a buffer region, a sample may be split by the
+  *         ring end
+  * @param  in: 32 bits samples
+  * @param  region: destination, total length is a multiple of 3 bytes
+  * @retval packed samples count
+  */
+uint32_t  AUDIO_PcmPack24Region(const uint32_t* in, const AUDIO_BufferRegionTypeDef* region)
+{
+  uint32_t samples = region->length[0] / AUDIO_PCM_PACKED_24_BYTES;
+  uint32_t split = region->length[0] - (samples * AUDIO_PCM_PACKED_24_BYTES);
+  uint8_t  sample[AUDIO_PCM_PACKED_24_BYTES];
+  uint32_t i;
+
+  AUDIO_PcmPack24(in, region->data[0], samples);
+  in += samples;
+  if(split != 0U)
+  {
+    AUDIO_PcmWrite24(sample, *in++);
+    for(i = 0; i < AUDIO_PCM_PACKED_24_BYTES; i++)
+    {
+      if(i < split)
+      {
+        region->data[0][samples * AUDIO_PCM_PACKED_24_BYTES + i] = sample[i];
+      }
+      else
+      {
+        region->data[1][i - split] = sample[i];
+      }
+    }
+    samples++;
+    split = AUDIO_PCM_PACKED_24_BYTES - split;
+  }
+  AUDIO_PcmPack24(in, region->data[1] + split, (region->length[1] - split) / AUDIO_PCM_PACKED_24_BYTES);
+  return samples + (region->length[1] - split) / AUDIO_PCM_PACKED_24_BYTES;
+}
+
+/**
+  * @brief  AUDIO_PcmRegionRead
+  *         reads a little endian sample of a buffer region, a sample may be
+  *         split by the ring end
+  * @param  region: region of the ring
+  * @param  offset: byte offset of the sample in the region
+  * @param  res: bytes per sample
+  * @retval sample value
+  */
+int32_t  AUDIO_PcmRegionRead(const AUDIO_BufferRegionTypeDef* region, uint32_t offset, uint8_t res)
+{
+  uint32_t value = 0;
+  uint32_t o;
+  uint8_t i;
+
+  for(i = 0; i < res; i++)
+  {
+    o = offset + i;
+    value |= (uint32_t)((o < region->length[0]) ? region->data[0][o] : region->data[1][o - region->length[0]]) << (8U * i);
+  }
+  if(res == 2U)
+  {
+    return (int16_t)value;
+  }
+  if(res == AUDIO_PCM_PACKED_24_BYTES)
+  {
+    return ((int32_t)(value << 8)) >> 8;
+  }
+  return (int32_t)value;
+}
+
+/**
+  * @brief  AUDIO_PcmRegionWrite
+  *         writes a little endian sample in a buffer region
+  * @param  region: region of the ring
+  * @param  offset: byte offset of the sample in the region
+  * @param  value: sample value
+  * @param  res: bytes per sample
+  * @retval None
+  */
+void  AUDIO_PcmRegionWrite(const AUDIO_BufferRegionTypeDef* region, uint32_t offset, int32_t value, uint8_t res)
+{
+  uint32_t o;
+  uint8_t i;
+
+  for(i = 0; i < res; i++)
+  {
+    o = offset + i;
+    if(o < region->length[0])
+    {
+      region->data[0][o] = (uint8_t)((uint32_t)value >> (8U * i));
+    }
+    else
+    {
+      region->data[1][o - region->length[0]] = (uint8_t)((uint32_t)value >> (8U * i));
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_PcmFade
+  *         applies a linear gain ramp in place, the gain steps once per frame
+  * @param  data: contiguous frames
+  * @param  frames: frames count
+  * @param  channels: samples per frame
+  * @param  res: bytes per sample, 2, 3 or 4
+  * @param  fade_in: 1 to ramp from 0 to unity, 0 from unity to 0
+  * @retval None
+  */
+void  AUDIO_PcmFade(uint8_t* data, uint32_t frames, uint8_t channels, uint8_t res, uint8_t fade_in)
+{
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t frame_len = (uint32_t)channels * res;
+  uint32_t offset = 0;
+  uint32_t frame;
+  int32_t  gain;
+  uint8_t  ch;
+
+  region.data[0] = data;
+  region.length[0] = frames * frame_len;
+  region.data[1] = 0;
+  region.length[1] = 0;
+  for(frame = 0; frame < frames; frame++)
+  {
+    gain = (int32_t)(fade_in ? frame : (frames - frame));
+    for(ch = 0; ch < channels; ch++)
+    {
+      AUDIO_PcmRegionWrite(&region, offset,
+                           (int32_t)(((int64_t)AUDIO_PcmRegionRead(&region, offset, res) * gain) / (int32_t)frames), res);
+      offset += res;
+    }
+  }
+}
+
+#ifdef USE_AUDIO_PLANAR_DSP
+/**
+  * @brief  AUDIO_PcmDeinterleave
+  *         splits interleaved frames into one float plane per channel, so
+  *         per channel kernels run on contiguous samples with their state in
+  *         registers. 16 bits stereo frames are read as one word
+  * @param  in: interleaved frames, 2, 3 or 4 bytes little endian samples
+  * @param  planes: planes, at least channels * stride floats
+  * @param  stride: floats from a plane start to the next one, at least frames
+  * @param  frames: frames count
+  * @param  channels: channels count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+void  AUDIO_PcmDeinterleave(const uint8_t* in, float* planes, uint32_t stride, uint32_t frames,
+                            uint8_t channels, uint8_t res)
+{
+#ifdef USE_AUDIO_PCM_KERNELS
+  const AUDIO_PcmKernelsTypeDef* kernels = AUDIO_PcmKernelsSelect(res, channels);
+
+  if(kernels != 0)
+  {
+    kernels->Deinterleave(in, planes, stride, frames, channels);
+  }
+#else /* USE_AUDIO_PCM_KERNELS */
+  uint32_t i;
+  uint8_t ch;
+
+  if((res == 2U) && (channels == 2U))
+  {
+    const uint32_t* src = (const uint32_t*)in;
+    float* left = planes;
+    float* right = planes + stride;
+    uint32_t w;
+
+    for(i = 0; i < frames; i++)
+    {
+      w = src[i];
+      left[i] = (float)(int16_t)w * (1.0f / AUDIO_PCM_SCALE_16);
+      right[i] = (float)((int32_t)w >> 16) * (1.0f / AUDIO_PCM_SCALE_16);
+    }
+    return;
+  }
+  for(i = 0; i < frames; i++)
+  {
+    for(ch = 0; ch < channels; ch++)
+    {
+      switch(res)
+      {
+        case 2:
+          planes[ch * stride + i] = (float)*(const int16_t*)in * (1.0f / AUDIO_PCM_SCALE_16);
+          break;
+        case 3:
+          planes[ch * stride + i] = (float)((int32_t)(AUDIO_PcmRead24(in) << 8) >> 8) * (1.0f / AUDIO_PCM_SCALE_24);
+          break;
+        default:
+          planes[ch * stride + i] = (float)*(const int32_t*)in * (1.0f / AUDIO_PCM_SCALE_32);
+          break;
+      }
+      in += res;
+    }
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+}
+
+/**
+  * @brief  AUDIO_PcmInterleave
+  *         writes float planes back as interleaved frames, samples are
+  *         saturated
+  * @param  planes: planes, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  out: interleaved frames, may be the frames the planes were read from
+  * @param  frames: frames count
+  * @param  channels: channels count
+  * @param  res: bytes per sample
+  * @retval None
+  */
+void  AUDIO_PcmInterleave(const float* planes, uint32_t stride, uint8_t* out, uint32_t frames,
+                          uint8_t channels, uint8_t res)
+{
+#ifdef USE_AUDIO_PCM_KERNELS
+  const AUDIO_PcmKernelsTypeDef* kernels = AUDIO_PcmKernelsSelect(res, channels);
+
+  if(kernels != 0)
+  {
+    kernels->Interleave(planes, stride, out, frames, channels);
+  }
+#else /* USE_AUDIO_PCM_KERNELS */
+  uint32_t i;
+  uint8_t ch;
+
+  if((res == 2U) && (channels == 2U))
+  {
+    uint32_t* dst = (uint32_t*)out;
+    const float* left = planes;
+    const float* right = planes + stride;
+
+    for(i = 0; i < frames; i++)
+    {
+      dst[i] = ((uint32_t)AUDIO_PcmSaturate(left[i], AUDIO_PCM_SCALE_16, INT16_MAX) & 0xFFFFU) |
+               ((uint32_t)AUDIO_PcmSaturate(right[i], AUDIO_PCM_SCALE_16, INT16_MAX) << 16);
+    }
+    return;
+  }
+  for(i = 0; i < frames; i++)
+  {
+    for(ch = 0; ch < channels; ch++)
+    {
+      switch(res)
+      {
+        case 2:
+          *(int16_t*)out = (int16_t)AUDIO_PcmSaturate(planes[ch * stride + i], AUDIO_PCM_SCALE_16, INT16_MAX);
+          break;
+        case 3:
+          AUDIO_PcmWrite24(out, (uint32_t)AUDIO_PcmSaturate(planes[ch * stride + i], AUDIO_PCM_SCALE_24, 0x7FFFFF));
+          break;
+        default:
+          *(int32_t*)out = AUDIO_PcmSaturate(planes[ch * stride + i], AUDIO_PCM_SCALE_32, INT32_MAX);
+          break;
+      }
+      out += res;
+    }
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+}
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PcmRead24
+  *         reads one packed sample
+  * @param  in: packed sample
+  * @retval sample, 24 bits right aligned
+  */
+static uint32_t  AUDIO_PcmRead24(const uint8_t* in)
+{
+  return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16);
+}
+
+/**
+  * @brief  AUDIO_PcmWrite24
+  *         writes one packed sample
+  * @param  out: packed sample
+  * @param  sample: sample, 24 low bits are written
+  * @retval None
+  */
+static void  AUDIO_PcmWrite24(uint8_t* out, uint32_t sample)
+{
+  out[0] = (uint8_t)sample;
+  out[1] = (uint8_t)(sample >> 8);
+  out[2] = (uint8_t)(sample >> 16);
+}
+#if defined(USE_AUDIO_PLANAR_DSP) && !defined(USE_AUDIO_PCM_KERNELS)
+
+/**
+  * @brief  AUDIO_PcmSaturate
+  *         converts a float sample back to a fixed point sample
+  * @param  y: sample, full scale is 1
+  * @param  scale: fixed point full scale
+  * @param  max: largest fixed point sample
+  * @retval saturated sample
+  */
+static int32_t  AUDIO_PcmSaturate(float y, float scale, int32_t max)
+{
+  if(y >= 1.0f)
+  {
+    return max;
+  }
+  if(y < -1.0f)
+  {
+    return -max - 1;
+  }
+  return (int32_t)(y * scale);
+}
+#endif /* USE_AUDIO_PLANAR_DSP && !USE_AUDIO_PCM_KERNELS */
@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file    audio_pcm.h
+  * @brief   header file for the audio_pcm.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PCM_H
+#define __AUDIO_PCM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "usbd_conf.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_PCM_PACKED_24_BYTES         3U          /* S24_3LE sample size */
+#define AUDIO_PCM_24_MASK                 0x00FFFFFFU /* valid bits of an unpacked 24 bits sample */
+
+/* Exported functions ------------------------------------------------------- */
+/* S24_3LE <-> 24 bits right aligned in 32 bits words , the layout the SAI uses for 24 bits data */
+void      AUDIO_PcmUnpack24(const uint8_t* in, uint32_t* out, uint32_t samples) USBD_ITCM_FUNC;
+void      AUDIO_PcmPack24(const uint32_t* in, uint8_t* out, uint32_t samples) USBD_ITCM_FUNC;
+uint32_t  AUDIO_PcmUnpack24Region(const AUDIO_BufferRegionTypeDef* region, uint32_t* out);
+uint32_t  AUDIO_PcmPack24Region(const uint32_t* in, const AUDIO_BufferRegionTypeDef* region);
+/* one little endian sample of 2, 3 or 4 bytes at a byte offset of a region, sign extended */
+int32_t   AUDIO_PcmRegionRead(const AUDIO_BufferRegionTypeDef* region, uint32_t offset, uint8_t res) USBD_ITCM_FUNC;
+void      AUDIO_PcmRegionWrite(const AUDIO_BufferRegionTypeDef* region, uint32_t offset, int32_t value,
+                               uint8_t res) USBD_ITCM_FUNC;
+/* linear gain ramp over contiguous frames, from 0 to unity or from unity to 0 */
+void      AUDIO_PcmFade(uint8_t* data, uint32_t frames, uint8_t channels, uint8_t res, uint8_t fade_in);
+#ifdef USE_AUDIO_PLANAR_DSP
+/* interleaved frames <-> one float plane per channel, full scale is 1. Plane ch starts at planes + ch * stride */
+void      AUDIO_PcmDeinterleave(const uint8_t* in, float* planes, uint32_t stride, uint32_t frames,
+                                uint8_t channels, uint8_t res) USBD_ITCM_FUNC;
+void      AUDIO_PcmInterleave(const float* planes, uint32_t stride, uint8_t* out, uint32_t frames,
+                              uint8_t channels, uint8_t res) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PCM_H */
@@ -0,0 +1,352 @@
+/**
+  ******************************************************************************
+  * @file    audio_pcm_kernels.c
+  * @brief   PCM kernels specialized per stream format : the gain, measure and
+  *          float conversion loops are expanded from one template per sample
+  *          resolution and for mono, stereo and any other channels count.
+  *          The resolution and, for mono and stereo, the channels count are
+  *          constants of each variant, so the inner loops hold no format
+  *          branch and the per channel state stays in registers. Nodes pick
+  *          the variants of their format once, when the stream starts.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_pcm_kernels.h"
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PCM_KERNELS
+
+/* Private defines -----------------------------------------------------------*/
+/* channels count variants of each resolution : mono, stereo, any */
+#define AUDIO_PCM_KERNELS_VARIANTS        3U
+#ifdef USE_AUDIO_PLANAR_DSP
+#define AUDIO_PCM_KERNELS_SCALE_2         32768.0f
+#define AUDIO_PCM_KERNELS_SCALE_3         8388608.0f
+#define AUDIO_PCM_KERNELS_SCALE_4         2147483648.0f
+#define AUDIO_PCM_KERNELS_MAX_2           INT16_MAX
+#define AUDIO_PCM_KERNELS_MAX_3           0x7FFFFF
+#define AUDIO_PCM_KERNELS_MAX_4           INT32_MAX
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Private functions ---------------------------------------------------------*/
+/* sample access of each resolution, 3 bytes samples are sign extended */
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLoad2(const uint8_t* in)
+{
+  return *(const int16_t*)in;
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLoad3(const uint8_t* in)
+{
+  return (int32_t)(((uint32_t)in[0] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 24)) >> 8;
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLoad4(const uint8_t* in)
+{
+  return *(const int32_t*)in;
+}
+
+__STATIC_FORCEINLINE void AUDIO_PcmKernelStore2(uint8_t* out, int32_t value)
+{
+  *(int16_t*)out = (int16_t)value;
+}
+
+__STATIC_FORCEINLINE void AUDIO_PcmKernelStore3(uint8_t* out, int32_t value)
+{
+  out[0] = (uint8_t)value;
+  out[1] = (uint8_t)(value >> 8);
+  out[2] = (uint8_t)(value >> 16);
+}
+
+__STATIC_FORCEINLINE void AUDIO_PcmKernelStore4(uint8_t* out, int32_t value)
+{
+  *(int32_t*)out = value;
+}
+
+/* Q1.30 gain applied to a sample, saturated to the resolution */
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelGain2(int32_t value, int32_t gain)
+{
+  /* Q1.14 gain : 16 x 16 bits product fits 32 bits, single cycle multiply then SSAT */
+  return __SSAT((value * (gain >> 16)) >> 14, 16);
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelGain3(int32_t value, int32_t gain)
+{
+  return __SSAT((int32_t)(((int64_t)value * gain) >> 30), 24);
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelGain4(int32_t value, int32_t gain)
+{
+  int64_t y = ((int64_t)value * gain) >> 30;
+
+  return (y > INT32_MAX) ? INT32_MAX : ((y < INT32_MIN) ? INT32_MIN : (int32_t)y);
+}
+
+/* sample as measured by the level meter, on 24 bits at most */
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLevel2(int32_t value)
+{
+  return value;
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLevel3(int32_t value)
+{
+  return value;
+}
+
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelLevel4(int32_t value)
+{
+  return value >> 8;
+}
+
+#ifdef USE_AUDIO_PLANAR_DSP
+/* float sample back to the resolution, saturated */
+__STATIC_FORCEINLINE int32_t AUDIO_PcmKernelSaturate(float y, float scale, int32_t max)
+{
+  if(y >= 1.0f)
+  {
+    return max;
+  }
+  if(y < -1.0f)
+  {
+    return -max - 1;
+  }
+  return (int32_t)(y * scale);
+}
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Templates -----------------------------------------------------------------*/
+/* RES : bytes per sample , CH : channels count, a constant or the channels
+   argument , SUFFIX : variant name. The gains and the levels are copied to
+   locals so the output stores can't alias them */
+#define AUDIO_PCM_KERNELS_FIXED(RES, CH, SUFFIX)                                                         \
+static void  AUDIO_PcmGain##SUFFIX(const uint8_t* in, uint8_t* out, uint32_t frames, uint8_t channels,   \
+                                   const int32_t* gain, const int32_t* step) USBD_ITCM_FUNC;             \
+static void  AUDIO_PcmGain##SUFFIX(const uint8_t* in, uint8_t* out, uint32_t frames, uint8_t channels,   \
+                                   const int32_t* gain, const int32_t* step)                             \
+{                                                                                                        \
+  int32_t g[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];                                                          \
+  int32_t s[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];                                                          \
+  uint32_t i;                                                                                            \
+  uint8_t ch;                                                                                            \
+                                                                                                         \
+  (void)channels;                                                                                        \
+  for(ch = 0; ch < (CH); ch++)                                                                           \
+  {                                                                                                      \
+    g[ch] = gain[ch];                                                                                    \
+    s[ch] = step[ch];                                                                                    \
+  }                                                                                                      \
+  for(i = 0; i < frames; i++)                                                                            \
+  {                                                                                                      \
+    for(ch = 0; ch < (CH); ch++)                                                                         \
+    {                                                                                                    \
+      g[ch] += s[ch];                                                                                    \
+      AUDIO_PcmKernelStore##RES(out, AUDIO_PcmKernelGain##RES(AUDIO_PcmKernelLoad##RES(in), g[ch]));     \
+      in += (RES);                                                                                       \
+      out += (RES);                                                                                      \
+    }                                                                                                    \
+  }                                                                                                      \
+}                                                                                                        \
+                                                                                                         \
+static void  AUDIO_PcmMeasure##SUFFIX(const uint8_t* in, uint32_t frames, uint8_t channels,              \
+                                      uint32_t* peak, uint64_t* sum) USBD_ITCM_FUNC;                     \
+static void  AUDIO_PcmMeasure##SUFFIX(const uint8_t* in, uint32_t frames, uint8_t channels,              \
+                                      uint32_t* peak, uint64_t* sum)                                     \
+{                                                                                                        \
+  uint32_t p[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];                                                         \
+  uint64_t q[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];                                                         \
+  uint32_t magnitude;                                                                                    \
+  int32_t value;                                                                                         \
+  uint32_t i;                                                                                            \
+  uint8_t ch;                                                                                            \
+                                                                                                         \
+  (void)channels;                                                                                        \
+  for(ch = 0; ch < (CH); ch++)                                                                           \
+  {                                                                                                      \
+    p[ch] = peak[ch];                                                                                    \
+    q[ch] = sum[ch];                                                                                     \
+  }                                                                                                      \
+  for(i = 0; i < frames; i++)                                                                            \
+  {                                                                                                      \
+    for(ch = 0; ch < (CH); ch++)                                                                         \
+    {                                                                                                    \
+      value = AUDIO_PcmKernelLevel##RES(AUDIO_PcmKernelLoad##RES(in));                                   \
+      in += (RES);                                                                                       \
+      q[ch] += (uint64_t)((int64_t)value * value);                                                       \
+      magnitude = (uint32_t)((value < 0) ? -value : value);                                              \
+      if(magnitude > p[ch])                                                                              \
+      {                                                                                                  \
+        p[ch] = magnitude;                                                                               \
+      }                                                                                                  \
+    }                                                                                                    \
+  }                                                                                                      \
+  for(ch = 0; ch < (CH); ch++)                                                                           \
+  {                                                                                                      \
+    peak[ch] = p[ch];                                                                                    \
+    sum[ch] = q[ch];                                                                                     \
+  }                                                                                                      \
+}
+
+#define AUDIO_PCM_KERNELS_PLANAR(RES, CH, SUFFIX)                                                        \
+static void  AUDIO_PcmDeinterleave##SUFFIX(const uint8_t* in, float* planes, uint32_t stride,            \
+                                           uint32_t frames, uint8_t channels) USBD_ITCM_FUNC;            \
+static void  AUDIO_PcmDeinterleave##SUFFIX(const uint8_t* in, float* planes, uint32_t stride,            \
+                                           uint32_t frames, uint8_t channels)                            \
+{                                                                                                        \
+  uint32_t i;                                                                                            \
+  uint8_t ch;                                                                                            \
+                                                                                                         \
+  (void)channels;                                                                                        \
+  for(i = 0; i < frames; i++)                                                                            \
+  {                                                                                                      \
+    for(ch = 0; ch < (CH); ch++)                                                                         \
+    {                                                                                                    \
+      planes[ch * stride + i] = (float)AUDIO_PcmKernelLoad##RES(in) * (1.0f / AUDIO_PCM_KERNELS_SCALE_##RES); \
+      in += (RES);                                                                                       \
+    }                                                                                                    \
+  }                                                                                                      \
+}                                                                                                        \
+                                                                                                         \
+static void  AUDIO_PcmInterleave##SUFFIX(const float* planes, uint32_t stride, uint8_t* out,             \
+                                         uint32_t frames, uint8_t channels) USBD_ITCM_FUNC;              \
+static void  AUDIO_PcmInterleave##SUFFIX(const float* planes, uint32_t stride, uint8_t* out,             \
+                                         uint32_t frames, uint8_t channels)                              \
+{                                                                                                        \
+  uint32_t i;                                                                                            \
+  uint8_t ch;                                                                                            \
+                                                                                                         \
+  (void)channels;                                                                                        \
+  for(i = 0; i < frames; i++)                                                                            \
+  {                                                                                                      \
+    for(ch = 0; ch < (CH); ch++)                                                                         \
+    {                                                                                                    \
+      AUDIO_PcmKernelStore##RES(out, AUDIO_PcmKernelSaturate(planes[ch * stride + i],                    \
+                                                             AUDIO_PCM_KERNELS_SCALE_##RES,              \
+                                                             AUDIO_PCM_KERNELS_MAX_##RES));              \
+      out += (RES);                                                                                      \
+    }                                                                                                    \
+  }                                                                                                      \
+}
+
+/* Variants ------------------------------------------------------------------*/
+AUDIO_PCM_KERNELS_FIXED(2, 1U, 2x1)
+AUDIO_PCM_KERNELS_FIXED(2, 2U, 2x2)
+AUDIO_PCM_KERNELS_FIXED(2, channels, 2xN)
+AUDIO_PCM_KERNELS_FIXED(3, 1U, 3x1)
+AUDIO_PCM_KERNELS_FIXED(3, 2U, 3x2)
+AUDIO_PCM_KERNELS_FIXED(3, channels, 3xN)
+AUDIO_PCM_KERNELS_FIXED(4, 1U, 4x1)
+AUDIO_PCM_KERNELS_FIXED(4, 2U, 4x2)
+AUDIO_PCM_KERNELS_FIXED(4, channels, 4xN)
+
+#ifdef USE_AUDIO_PLANAR_DSP
+AUDIO_PCM_KERNELS_PLANAR(2, 1U, 2x1)
+AUDIO_PCM_KERNELS_PLANAR(2, channels, 2xN)
+AUDIO_PCM_KERNELS_PLANAR(3, 1U, 3x1)
+AUDIO_PCM_KERNELS_PLANAR(3, 2U, 3x2)
+AUDIO_PCM_KERNELS_PLANAR(3, channels, 3xN)
+AUDIO_PCM_KERNELS_PLANAR(4, 1U, 4x1)
+AUDIO_PCM_KERNELS_PLANAR(4, 2U, 4x2)
+AUDIO_PCM_KERNELS_PLANAR(4, channels, 4xN)
+
+static void  AUDIO_PcmDeinterleave2x2(const uint8_t* in, float* planes, uint32_t stride,
+                                      uint32_t frames, uint8_t channels) USBD_ITCM_FUNC;
+static void  AUDIO_PcmInterleave2x2(const float* planes, uint32_t stride, uint8_t* out,
+                                    uint32_t frames, uint8_t channels) USBD_ITCM_FUNC;
+
+/**
+  * @brief  AUDIO_PcmDeinterleave2x2
+  *         16 bits stereo variant, each frame is read as one word
+  * @param  in: interleaved frames, word aligned
+  * @param  planes: left then right plane
+  * @param  stride: floats from a plane start to the next one
+  * @param  frames: frames count
+  * @param  channels: not read
+  * @retval None
+  */
+static void  AUDIO_PcmDeinterleave2x2(const uint8_t* in, float* planes, uint32_t stride,
+                                      uint32_t frames, uint8_t channels)
+{
+  const uint32_t* src = (const uint32_t*)in;
+  float* left = planes;
+  float* right = planes + stride;
+  uint32_t w;
+  uint32_t i;
+
+  (void)channels;
+  for(i = 0; i < frames; i++)
+  {
+    w = src[i];
+    left[i] = (float)(int16_t)w * (1.0f / AUDIO_PCM_KERNELS_SCALE_2);
+    right[i] = (float)((int32_t)w >> 16) * (1.0f / AUDIO_PCM_KERNELS_SCALE_2);
+  }
+}
+
+/**
+  * @brief  AUDIO_PcmInterleave2x2
+  *         16 bits stereo variant, each frame is written as one word
+  * @param  planes: left then right plane, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  out: interleaved frames, word aligned
+  * @param  frames: frames count
+  * @param  channels: not read
+  * @retval None
+  */
+static void  AUDIO_PcmInterleave2x2(const float* planes, uint32_t stride, uint8_t* out,
+                                    uint32_t frames, uint8_t channels)
+{
+  uint32_t* dst = (uint32_t*)out;
+  const float* left = planes;
+  const float* right = planes + stride;
+  uint32_t i;
+
+  (void)channels;
+  for(i = 0; i < frames; i++)
+  {
+    dst[i] = ((uint32_t)AUDIO_PcmKernelSaturate(left[i], AUDIO_PCM_KERNELS_SCALE_2, INT16_MAX) & 0xFFFFU) |
+             ((uint32_t)AUDIO_PcmKernelSaturate(right[i], AUDIO_PCM_KERNELS_SCALE_2, INT16_MAX) << 16);
+  }
+}
+
+#define AUDIO_PCM_KERNELS_ENTRY(SUFFIX)   { AUDIO_PcmGain##SUFFIX, AUDIO_PcmMeasure##SUFFIX, \
+                                            AUDIO_PcmDeinterleave##SUFFIX, AUDIO_PcmInterleave##SUFFIX }
+#else /* USE_AUDIO_PLANAR_DSP */
+#define AUDIO_PCM_KERNELS_ENTRY(SUFFIX)   { AUDIO_PcmGain##SUFFIX, AUDIO_PcmMeasure##SUFFIX }
+#endif /* USE_AUDIO_PLANAR_DSP */
+
+/* Private variables ---------------------------------------------------------*/
+/* by resolution from 2 bytes, then mono, stereo and any channels count */
+static const AUDIO_PcmKernelsTypeDef pcm_kernels[3][AUDIO_PCM_KERNELS_VARIANTS] =
+{
+  { AUDIO_PCM_KERNELS_ENTRY(2x1), AUDIO_PCM_KERNELS_ENTRY(2x2), AUDIO_PCM_KERNELS_ENTRY(2xN) },
+  { AUDIO_PCM_KERNELS_ENTRY(3x1), AUDIO_PCM_KERNELS_ENTRY(3x2), AUDIO_PCM_KERNELS_ENTRY(3xN) },
+  { AUDIO_PCM_KERNELS_ENTRY(4x1), AUDIO_PCM_KERNELS_ENTRY(4x2), AUDIO_PCM_KERNELS_ENTRY(4xN) }
+};
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PcmKernelsSelect
+  *         returns the kernels of a stream format, the mono and stereo ones
+  *         have the channels count built in
+  * @param  res: bytes per sample , 2, 3 or 4
+  * @param  channels: channels count , 1 to AUDIO_MAX_SUPPORTED_CHANNEL_COUNT
+  * @retval kernels, 0 if the format has none
+  */
+const AUDIO_PcmKernelsTypeDef*  AUDIO_PcmKernelsSelect(uint8_t res, uint8_t channels)
+{
+  if((res < 2U) || (res > 4U) || (channels == 0U) || (channels > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT))
+  {
+    return 0;
+  }
+  return &pcm_kernels[res - 2U][(channels <= 2U) ? (channels - 1U) : 2U];
+}
+#endif /* USE_AUDIO_PCM_KERNELS */
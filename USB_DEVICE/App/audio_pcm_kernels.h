@@ -0,0 +1,61 @@
+/**
+  ******************************************************************************
+  * @file    audio_pcm_kernels.h
+  * @brief   header file for the audio_pcm_kernels.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PCM_KERNELS_H
+#define __AUDIO_PCM_KERNELS_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_PCM_KERNELS
+/* Exported types ------------------------------------------------------------*/
+/* kernels of one (resolution, channels) pair. Samples are 2, 3 or 4 bytes
+   little endian interleaved frames. The channels argument is only read by the
+   variants of the channel counts without their own kernels */
+typedef struct
+{
+  /* Q1.30 gains, each one adds its step before each frame, samples are saturated. out may be in */
+  void (*Gain)        (const uint8_t* /*in*/, uint8_t* /*out*/, uint32_t /*frames*/, uint8_t /*channels*/,
+                       const int32_t* /*gain*/, const int32_t* /*step*/);
+  /* accumulates the largest magnitude and the squares of each channel, 4 bytes samples on their 24 upper bits */
+  void (*Measure)     (const uint8_t* /*in*/, uint32_t /*frames*/, uint8_t /*channels*/,
+                       uint32_t* /*peak*/, uint64_t* /*sum*/);
+#ifdef USE_AUDIO_PLANAR_DSP
+  /* interleaved frames <-> one float plane per channel, full scale is 1 */
+  void (*Deinterleave)(const uint8_t* /*in*/, float* /*planes*/, uint32_t /*stride*/, uint32_t /*frames*/,
+                       uint8_t /*channels*/);
+  void (*Interleave)  (const float* /*planes*/, uint32_t /*stride*/, uint8_t* /*out*/, uint32_t /*frames*/,
+                       uint8_t /*channels*/);
+#endif /* USE_AUDIO_PLANAR_DSP */
+}
+AUDIO_PcmKernelsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+/* kernels of a stream format, picked once when the stream starts. 0 if res isn't 2, 3 or 4 */
+const AUDIO_PcmKernelsTypeDef*  AUDIO_PcmKernelsSelect(uint8_t res, uint8_t channels);
+#endif /* USE_AUDIO_PCM_KERNELS */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PCM_KERNELS_H */
@@ -0,0 +1,283 @@
+/**
+  ******************************************************************************
+  * @file    audio_pdm_filter.c
+  * @brief   PDM to PCM decimation for the MEMS mics : a sinc4 CIC decimates
+  *          the 64 fs bitstream by 16, then a 96 taps FIR by 4.
+  *          The CIC is not run as integrators and combs on each bit : its
+  *          61 taps are split in 8 bytes and one table per byte gives the
+  *          weighted sum of the 8 bits of any PDM byte, so a CIC output costs
+  *          8 table reads. The FIR is only evaluated at the output rate, two
+  *          taps per SMLAD. It cuts at 0.46 fs and a 3 taps pre-emphasis,
+  *          convolved in it, flattens the CIC droop in the passband. A one
+  *          pole high pass removes the mic DC offset.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "usbd_def.h"
+#include "audio_pdm_filter.h"
+
+#ifdef USE_AUDIO_MEMS_MIC
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_PDM_CIC_TAPS            (AUDIO_PDM_CIC_ORDER * (AUDIO_PDM_CIC_DECIMATION - 1U) + 1U)
+#define AUDIO_PDM_FIR_LP_TAPS         (AUDIO_PDM_FIR_TAPS - 2U)
+#define AUDIO_PDM_FIR_CUTOFF          0.115f   /* of the CIC output rate, 0.46 fs */
+#define AUDIO_PDM_FIR_COMPENSATION    0.1775f  /* [-c, 1 + 2c, -c] cancels the CIC droop at 0.4 fs */
+#define AUDIO_PDM_DC_SHIFT            10U      /* DC blocker pole 1 - 2^-10 , 7.5 Hz at 48 kHz */
+#define AUDIO_PDM_IDLE_PATTERN        0x5555555555555555ULL /* zero mean PDM history */
+
+#if (AUDIO_PDM_FIR_TAPS % AUDIO_PDM_FIR_DECIMATION) != 0
+#error "AUDIO_PDM_FIR_TAPS must be a multiple of AUDIO_PDM_FIR_DECIMATION"
+#endif /* AUDIO_PDM_FIR_TAPS */
+
+/* Private variables ---------------------------------------------------------*/
+/* weighted sum of the 8 bits of a byte for each byte of the CIC window, from
+   the oldest one. Read for every CIC output so kept in DTCM */
+static int16_t pdm_cic_lut[AUDIO_PDM_CIC_BYTES][256] USBD_DTCM_BSS;
+__ALIGN_BEGIN static int16_t pdm_fir_coeffs[AUDIO_PDM_FIR_TAPS] __ALIGN_END USBD_DTCM_BSS; /* Q15 */
+static uint8_t pdm_tables_ready = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_PdmFilterBuildTables(void);
+__STATIC_FORCEINLINE int32_t AUDIO_PdmFilterOutput(AUDIO_PDM_FilterTypeDef* filter,
+                                                   AUDIO_PDM_ChannelTypeDef* ch, const int16_t* window);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PdmFilterInit
+  *         Initializes the decimation of a PDM stream, the tables are built
+  *         on first call
+  * @param  filter: filter to initialize
+  * @param  channels: mics to decimate, the first ones of the stream
+  * @param  stride: bytes of a PDM frame
+  * @retval None
+  */
+void  AUDIO_PdmFilterInit(AUDIO_PDM_FilterTypeDef* filter, uint8_t channels, uint8_t stride)
+{
+  uint8_t m;
+
+  if(!pdm_tables_ready)
+  {
+    AUDIO_PdmFilterBuildTables();
+    pdm_tables_ready = 1;
+  }
+  memset(filter, 0, sizeof(AUDIO_PDM_FilterTypeDef));
+  filter->channels = (channels > AUDIO_PDM_MAX_MICS) ? AUDIO_PDM_MAX_MICS : channels;
+  filter->stride = stride;
+  filter->gain = AUDIO_PDM_GAIN_UNITY;
+  for(m = 0; m < AUDIO_PDM_MAX_MICS; m++)
+  {
+    filter->channel[m].offset = m;
+  }
+  AUDIO_PdmFilterReset(filter);
+}
+
+/**
+  * @brief  AUDIO_PdmFilterReset
+  *         clears the filters history, before a new capture
+  * @param  filter: filter to reset
+  * @retval None
+  */
+void  AUDIO_PdmFilterReset(AUDIO_PDM_FilterTypeDef* filter)
+{
+  AUDIO_PDM_ChannelTypeDef* ch;
+  uint8_t m;
+
+  for(m = 0; m < AUDIO_PDM_MAX_MICS; m++)
+  {
+    ch = &filter->channel[m];
+    memset(ch->cic, 0, sizeof(ch->cic));
+    ch->pdm = AUDIO_PDM_IDLE_PATTERN;
+    ch->dc_x = 0;
+    ch->dc_y = 0;
+    ch->pos = 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_PdmFilterRun
+  *         decimates PDM frames to PCM frames, one mic after the other so its
+  *         state stays in registers
+  * @param  filter: filter
+  * @param  pdm: PDM frames, one byte per mic and per 8 PDM clocks, first bit in the MSB
+  * @param  pdm_frames: PDM frames count, multiple of 8
+  * @param  pcm: interleaved output, 24 bits right aligned
+  * @retval PCM frames written
+  */
+uint32_t  AUDIO_PdmFilterRun(AUDIO_PDM_FilterTypeDef* filter, const uint8_t* pdm, uint32_t pdm_frames,
+                             int32_t* pcm)
+{
+  uint32_t stride = filter->stride;
+  uint32_t channels = filter->channels;
+  AUDIO_PDM_ChannelTypeDef* ch;
+  const uint8_t* src;
+  int32_t* out;
+  uint64_t hist;
+  uint32_t pos;
+  int32_t acc;
+  int16_t sample;
+  uint32_t i, m;
+
+  for(m = 0; m < channels; m++)
+  {
+    ch = &filter->channel[m];
+    src = pdm + ch->offset;
+    out = pcm + m;
+    hist = ch->pdm;
+    pos = ch->pos;
+    /* a CIC output every 2 PDM bytes */
+    for(i = 0; i < pdm_frames; i += 2U)
+    {
+      hist = (hist << 16) | ((uint32_t)src[0] << 8) | src[stride];
+      src += 2U * stride;
+      acc = pdm_cic_lut[0][(uint8_t)(hist >> 56)] + pdm_cic_lut[1][(uint8_t)(hist >> 48)] +
+            pdm_cic_lut[2][(uint8_t)(hist >> 40)] + pdm_cic_lut[3][(uint8_t)(hist >> 32)] +
+            pdm_cic_lut[4][(uint8_t)(hist >> 24)] + pdm_cic_lut[5][(uint8_t)(hist >> 16)] +
+            pdm_cic_lut[6][(uint8_t)(hist >> 8)] + pdm_cic_lut[7][(uint8_t)hist];
+      /* CIC gain is 16^4 , the full scale bitstream gives 16 bits */
+      sample = (int16_t)__SSAT(acc >> 1, 16);
+      ch->cic[pos] = sample;
+      ch->cic[pos + AUDIO_PDM_FIR_TAPS] = sample;
+      /* the window then starts on an even index, its pairs are aligned */
+      if((pos % AUDIO_PDM_FIR_DECIMATION) == (AUDIO_PDM_FIR_DECIMATION - 1U))
+      {
+        *out = AUDIO_PdmFilterOutput(filter, ch, &ch->cic[pos + 1U]);
+        out += channels;
+      }
+      pos = (pos + 1U == AUDIO_PDM_FIR_TAPS) ? 0U : pos + 1U;
+    }
+    ch->pdm = hist;
+    ch->pos = (uint8_t)pos;
+  }
+  return pdm_frames / (2U * AUDIO_PDM_FIR_DECIMATION);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PdmFilterOutput
+  *         one FIR output from the last AUDIO_PDM_FIR_TAPS CIC outputs, then
+  *         the DC blocker and the gain
+  * @param  filter: filter
+  * @param  ch: mic state
+  * @param  window: oldest CIC output of the window, 32 bits aligned
+  * @retval 24 bits sample
+  */
+__STATIC_FORCEINLINE int32_t AUDIO_PdmFilterOutput(AUDIO_PDM_FilterTypeDef* filter,
+                                                   AUDIO_PDM_ChannelTypeDef* ch, const int16_t* window)
+{
+  const uint32_t* w = (const uint32_t*)window;
+  const uint32_t* c = (const uint32_t*)pdm_fir_coeffs;
+  int32_t acc = 0;
+  int32_t x, y;
+  uint32_t k;
+
+  for(k = 0; k < AUDIO_PDM_FIR_TAPS / 2U; k += 4U)
+  {
+    acc = (int32_t)__SMLAD(w[k], c[k], (uint32_t)acc);
+    acc = (int32_t)__SMLAD(w[k + 1U], c[k + 1U], (uint32_t)acc);
+    acc = (int32_t)__SMLAD(w[k + 2U], c[k + 2U], (uint32_t)acc);
+    acc = (int32_t)__SMLAD(w[k + 3U], c[k + 3U], (uint32_t)acc);
+  }
+  /* Q15 coefficients on 16 bits samples, keep 24 bits */
+  x = acc >> 7;
+  y = x - ch->dc_x + ch->dc_y - (ch->dc_y >> AUDIO_PDM_DC_SHIFT);
+  ch->dc_x = x;
+  ch->dc_y = y;
+  return __SSAT((int32_t)(((int64_t)y * filter->gain) >> 16), 24);
+}
+
+/**
+  * @brief  AUDIO_PdmFilterBuildTables
+  *         computes the CIC byte tables and the FIR coefficients
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_PdmFilterBuildTables(void)
+{
+  int32_t kernel[AUDIO_PDM_CIC_BYTES * 8U];
+  int32_t stage[AUDIO_PDM_CIC_BYTES * 8U];
+  float lowpass[AUDIO_PDM_FIR_LP_TAPS];
+  float fir[AUDIO_PDM_FIR_TAPS];
+  float sum = 0.0f;
+  float t, w;
+  uint32_t i, j, n, v;
+  int32_t acc;
+
+  /* sinc4 kernel : 4 boxcars of 16 taps convolved, zero padded to 64 taps */
+  memset(kernel, 0, sizeof(kernel));
+  for(i = 0; i < AUDIO_PDM_CIC_DECIMATION; i++)
+  {
+    kernel[i] = 1;
+  }
+  for(n = 1; n < AUDIO_PDM_CIC_ORDER; n++)
+  {
+    memset(stage, 0, sizeof(stage));
+    for(i = 0; i < AUDIO_PDM_CIC_TAPS; i++)
+    {
+      for(j = 0; (j < AUDIO_PDM_CIC_DECIMATION) && (j <= i); j++)
+      {
+        stage[i] += kernel[i - j];
+      }
+    }
+    memcpy(kernel, stage, sizeof(kernel));
+  }
+  /* a bit at 1 weights +tap , at 0 -tap */
+  for(j = 0; j < AUDIO_PDM_CIC_BYTES; j++)
+  {
+    for(v = 0; v < 256U; v++)
+    {
+      acc = 0;
+      for(i = 0; i < 8U; i++)
+      {
+        acc += (v & (0x80U >> i)) ? kernel[8U * j + i] : -kernel[8U * j + i];
+      }
+      pdm_cic_lut[j][v] = (int16_t)acc;
+    }
+  }
+
+  /* Blackman windowed sinc low pass */
+  for(n = 0; n < AUDIO_PDM_FIR_LP_TAPS; n++)
+  {
+    t = (float)n - (float)(AUDIO_PDM_FIR_LP_TAPS - 1U) / 2.0f;
+    w = 0.42f - 0.5f * cosf(2.0f * (float)M_PI * (float)n / (float)(AUDIO_PDM_FIR_LP_TAPS - 1U)) +
+        0.08f * cosf(4.0f * (float)M_PI * (float)n / (float)(AUDIO_PDM_FIR_LP_TAPS - 1U));
+    lowpass[n] = w * sinf(2.0f * (float)M_PI * AUDIO_PDM_FIR_CUTOFF * t) / ((float)M_PI * t);
+  }
+  /* convolved with the droop compensation */
+  for(n = 0; n < AUDIO_PDM_FIR_TAPS; n++)
+  {
+    fir[n] = 0.0f;
+    if(n < AUDIO_PDM_FIR_LP_TAPS)
+    {
+      fir[n] -= AUDIO_PDM_FIR_COMPENSATION * lowpass[n];
+    }
+    if((n >= 1U) && (n - 1U < AUDIO_PDM_FIR_LP_TAPS))
+    {
+      fir[n] += (1.0f + 2.0f * AUDIO_PDM_FIR_COMPENSATION) * lowpass[n - 1U];
+    }
+    if((n >= 2U) && (n - 2U < AUDIO_PDM_FIR_LP_TAPS))
+    {
+      fir[n] -= AUDIO_PDM_FIR_COMPENSATION * lowpass[n - 2U];
+    }
+    sum += fir[n];
+  }
+  /* unity DC gain */
+  for(n = 0; n < AUDIO_PDM_FIR_TAPS; n++)
+  {
+    pdm_fir_coeffs[n] = (int16_t)lrintf(fir[n] * 32768.0f / sum);
+  }
+}
+#endif /* USE_AUDIO_MEMS_MIC */
@@ -0,0 +1,75 @@
+/**
+  ******************************************************************************
+  * @file    audio_pdm_filter.h
+  * @brief   header file for the audio_pdm_filter.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PDM_FILTER_H
+#define __AUDIO_PDM_FILTER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_MEMS_MIC
+/* Exported constants --------------------------------------------------------*/
+/* PDM clock is 64 fs : a sinc4 CIC decimates by 16 then a FIR by 4 */
+#define AUDIO_PDM_DECIMATION              64U
+#define AUDIO_PDM_CIC_DECIMATION          16U
+#define AUDIO_PDM_CIC_ORDER               4U
+#define AUDIO_PDM_CIC_BYTES               8U   /* the 61 taps of the CIC span 8 PDM bytes */
+#define AUDIO_PDM_FIR_DECIMATION          4U
+#define AUDIO_PDM_FIR_TAPS                96U  /* multiple of AUDIO_PDM_FIR_DECIMATION */
+#define AUDIO_PDM_MAX_MICS                4U
+#define AUDIO_PDM_GAIN_UNITY              0x10000 /* Q16 */
+
+/* Exported types ------------------------------------------------------------*/
+/* decimation state of one mic */
+typedef struct
+{
+  uint64_t  pdm;                                /* last 8 PDM bytes, newest in the low byte */
+  int16_t   cic[2U * AUDIO_PDM_FIR_TAPS];       /* CIC outputs written twice, the FIR window is contiguous */
+  int32_t   dc_x;                               /* DC blocker last input */
+  int32_t   dc_y;                               /* DC blocker last output */
+  uint8_t   pos;                                /* next write index in cic */
+  uint8_t   offset;                             /* byte of this mic in a PDM frame */
+}
+AUDIO_PDM_ChannelTypeDef;
+
+typedef struct
+{
+  AUDIO_PDM_ChannelTypeDef  channel[AUDIO_PDM_MAX_MICS];
+  int32_t                   gain;               /* Q16 applied to the PCM output */
+  uint8_t                   channels;           /* mics decimated */
+  uint8_t                   stride;             /* bytes of a PDM frame : one per mic of the stream */
+}
+AUDIO_PDM_FilterTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void      AUDIO_PdmFilterInit(AUDIO_PDM_FilterTypeDef* filter, uint8_t channels, uint8_t stride);
+void      AUDIO_PdmFilterReset(AUDIO_PDM_FilterTypeDef* filter);
+/* pdm_frames must be a multiple of 8, pcm receives pdm_frames / 8 frames of 24 bits right aligned samples */
+uint32_t  AUDIO_PdmFilterRun(AUDIO_PDM_FilterTypeDef* filter, const uint8_t* pdm, uint32_t pdm_frames,
+                             int32_t* pcm) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_MEMS_MIC */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PDM_FILTER_H */
@@ -0,0 +1,712 @@
+/**
+  ******************************************************************************
+  * @file    audio_pdm_mic_node.c
+  * @brief   MEMS mic node : the SAI PDM interface captures the bitstream of
+  *          up to four mics in a circular DMA of two halves of one ms each.
+  *          Every completed half is decimated by audio_pdm_filter.c and the
+  *          PCM is written to the session ring while the DMA fills the other
+  *          half. As for the SAI mic, the ring is filled at the mic clock.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "usbd_audio.h"
+#include "audio_mic_node.h"
+#include "usb_audio_user.h"
+#include "audio_pump.h"
+#include "audio_sof_timestamp.h"
+#include "audio_tap.h"
+#include "audio_snapshot.h"
+#include "audio_pcm.h"
+#include "audio_profiler.h"
+#ifdef USE_AUDIO_AEC
+#include "audio_aec_node.h"
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "audio_bulk_capture.h"
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_MIC_AGC
+#include "audio_agc_node.h"
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "audio_sof_align.h"
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_RECORDING_VOICE
+#include "audio_sessions_usb.h"
+#endif /* USE_AUDIO_RECORDING_VOICE */
+
+#if (!defined USE_AUDIO_DUMMY_MIC) && (defined USE_AUDIO_MEMS_MIC)
+
+/* Private defines -----------------------------------------------------------*/
+/* the gain is applied to the decimated samples */
+#define PDM_MIC_VOLUME_RES_DB_256     256   /* 1 db 1 * 256 = 256*/
+#define PDM_MIC_VOLUME_MAX_DB_256     8192  /* 32db == 32*256 = 8192*/
+#define PDM_MIC_VOLUME_MIN_DB_256     -8192 /* -32db == -32*256 = -8192*/
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_MicDeInit(uint32_t node_handle);
+static int8_t   AUDIO_MicStart(AUDIO_BufferTypeDef* buffer, uint32_t node_handle);
+static int8_t   AUDIO_MicStop( uint32_t node_handle);
+static int8_t   AUDIO_MicChangeFrequence( uint32_t node_handle);
+static int8_t   AUDIO_MicMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle);
+static int8_t   AUDIO_MicSetVolume( uint16_t channel_number, int volume_db_256, uint32_t node_handle);
+static int8_t   AUDIO_MicGetVolumeDefaultsValues( int* vol_max, int* vol_min, int* vol_res, uint32_t node_handle);
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+static int8_t   AUDIO_MicStartReadCount( uint32_t node_handle);
+static uint16_t AUDIO_MicGetLastReadCount( uint32_t node_handle);
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+static void     AUDIO_MicInitCaptureParams( AUDIO_Mic_NodeTypeDef* mic);
+static int8_t   AUDIO_MicSAIInit( AUDIO_Mic_NodeTypeDef* mic);
+static void     AUDIO_MicDrainHalf( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half);
+static void     AUDIO_MicWriteRegion( AUDIO_Mic_NodeTypeDef* mic, AUDIO_BufferRegionTypeDef* region);
+static void     AUDIO_MicMuteChannels( AUDIO_Mic_NodeTypeDef* mic, uint32_t samples);
+static uint16_t AUDIO_MicGetDMAPosition( AUDIO_Mic_NodeTypeDef* mic);
+#ifdef USE_AUDIO_SOF_ALIGN
+static void     AUDIO_MicStartDMA( uint32_t node_handle);
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+/* Private variables ---------------------------------------------------------*/
+/* the PDM interface is on block A, see AUDIO_MIC_SAI_BLOCK */
+SAI_HandleTypeDef hsai_BlockB1;
+DMA_HandleTypeDef hdma_sai1_b;
+/* written by the DMA1, so in D2 SRAM which is not cached */
+__ALIGN_BEGIN static uint8_t mic_dma_buffer[AUDIO_MIC_DMA_BUFFER_SIZE] __ALIGN_END USBD_D2_BSS;
+/* one decimated half, before it is converted to the ring format */
+__ALIGN_BEGIN static int32_t mic_pcm_buffer[AUDIO_MIC_DMA_HALF_MAX_FRAMES * AUDIO_MIC_COUNT]
+  __ALIGN_END USBD_DTCM_BSS;
+static AUDIO_Mic_NodeTypeDef *current_mic = 0;
+
+/* Exported functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MicInit
+  *         Initializes the audio mic node
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      mic node handle must be allocated
+  * @retval 0 if no error
+  */
+ int8_t  AUDIO_MicInit(AUDIO_DescriptionTypeDef* audio_description,  AUDIO_SessionTypeDef* session_handle,
+                       uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+  uint8_t m;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  memset(mic, 0, sizeof(AUDIO_Mic_NodeTypeDef));
+  mic->node.type = AUDIO_INPUT;
+  mic->node.state = AUDIO_NODE_INITIALIZED;
+  mic->node.session_handle = session_handle;
+  mic->node.audio_description = audio_description;
+  mic->specific.hsai = &hsai_BlockB1;
+  mic->specific.dma_buffer = mic_dma_buffer;
+  mic->specific.pcm = mic_pcm_buffer;
+  AUDIO_PdmFilterInit(&mic->specific.filter, (uint8_t)AUDIO_MIC_COUNT, (uint8_t)AUDIO_MIC_PDM_FRAME_BYTES);
+  for(m = 0; m < AUDIO_MIC_COUNT; m++)
+  {
+    mic->specific.filter.channel[m].offset = (uint8_t)AUDIO_MIC_PDM_BYTE_OFFSET(m);
+  }
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+  AUDIO_BeamformerInit(&mic->specific.beamformer, (uint8_t)AUDIO_MIC_COUNT, audio_description->channels_count);
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+  AUDIO_MicSetVolume(0, audio_description->audio_volume_db_256, node_handle);
+  AUDIO_MicInitCaptureParams(mic);
+
+  /* set callbacks */
+  mic->MicDeInit = AUDIO_MicDeInit;
+  mic->MicStart = AUDIO_MicStart;
+  mic->MicStop = AUDIO_MicStop;
+  mic->MicChangeFrequence = AUDIO_MicChangeFrequence;
+  mic->MicMute = AUDIO_MicMute;
+  mic->MicSetVolume = AUDIO_MicSetVolume;
+  mic->MicGetVolumeDefaultsValues = AUDIO_MicGetVolumeDefaultsValues;
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+  mic->MicStartReadCount = AUDIO_MicStartReadCount;
+  mic->MicGetReadCount = AUDIO_MicGetLastReadCount;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+  current_mic = mic;
+  return 0;
+}
+
+/**
+  * @brief  HAL_SAI_RxHalfCpltCallback
+  *         first half is captured, the DMA writes the second one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_RxHalfCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_MicDrainHalf(current_mic, current_mic->specific.dma_buffer);
+  }
+}
+
+/**
+  * @brief  HAL_SAI_RxCpltCallback
+  *         second half is captured, the DMA writes the first one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_RxCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_MicDrainHalf(current_mic, current_mic->specific.dma_buffer +
+                       current_mic->specific.half_pdm_frames * AUDIO_MIC_PDM_FRAME_BYTES);
+  }
+}
+
+/**
+  * @brief  AUDIO_USER_MicErrorCallback
+  *         SAI or DMA error, reported as an overrun so the session restarts
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void AUDIO_USER_MicErrorCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai) &&
+     (current_mic->node.state == AUDIO_NODE_STARTED))
+  {
+    AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)current_mic,
+                        current_mic->node.session_handle);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MicDeInit
+  *         De-Initializes the audio mic node
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicDeInit(uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_MicStop(node_handle);
+  }
+  mic->node.state = AUDIO_NODE_OFF;
+  current_mic = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicStart
+  *         Start the audio mic node, the buffer is filled from the first
+  *         completed DMA half
+  * @param  buffer:     buffer to fill while node is being started
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStart(AUDIO_BufferTypeDef* buffer,  uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    return 0;
+  }
+  mic->buf = buffer;
+  if(AUDIO_MicSAIInit(mic) != 0)
+  {
+    return -1;
+  }
+  /* the filters settle on the first half, the mics need some ms to wake up anyway */
+  AUDIO_PdmFilterReset(&mic->specific.filter);
+#ifdef USE_AUDIO_DITHER
+  AUDIO_DitherInit(&mic->specific.dither, mic->node.audio_description->channels_count);
+#endif /* USE_AUDIO_DITHER */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+  AUDIO_BeamformerReset(&mic->specific.beamformer, mic->node.audio_description->frequence);
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+  mic->specific.dma_pos = 0;
+  mic->node.state = AUDIO_NODE_STARTED;
+  /* the DMA moves 16 bits slots, one per mic pair of a PDM frame */
+#ifdef USE_AUDIO_SOF_ALIGN
+  /* the DMA starts from the pump at its time after SOF */
+  if(AUDIO_SofAlignStart(AUDIO_SOF_ALIGN_MIC, AUDIO_MicStartDMA, node_handle) != 0)
+  {
+    mic->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#else /* USE_AUDIO_SOF_ALIGN */
+  if(HAL_SAI_Receive_DMA(mic->specific.hsai, mic->specific.dma_buffer,
+                         2U * mic->specific.half_pdm_frames * AUDIO_MIC_PDM_PAIRS) != HAL_OK)
+  {
+    mic->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+  /* without SAI speaker, FS_A is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(mic->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+#endif /* USE_AUDIO_SOF_ALIGN */
+  return 0;
+}
+
+#ifdef USE_AUDIO_SOF_ALIGN
+/**
+  * @brief  AUDIO_MicStartDMA
+  *         starts the capture DMA, called by the SOF align at the mic time.
+  *         A failure is reported as a SAI error
+  * @param  node_handle: mic node handle
+  * @retval None
+  */
+static void  AUDIO_MicStartDMA( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return;
+  }
+  mic->specific.dma_pos = 0;
+  if(HAL_SAI_Receive_DMA(mic->specific.hsai, mic->specific.dma_buffer,
+                         2U * mic->specific.half_pdm_frames * AUDIO_MIC_PDM_PAIRS) != HAL_OK)
+  {
+    AUDIO_USER_MicErrorCallback(mic->specific.hsai);
+    return;
+  }
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+  /* without SAI speaker, FS_A is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(mic->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+}
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+/**
+  * @brief  AUDIO_MicStop
+  *         Stop mic node, SAI is released so the next start applies the
+  *         current frequency
+  * @param  node_handle: mic node handle must be Started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStop( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    /* state first, so a pending DMA callback drops its half */
+    mic->node.state = AUDIO_NODE_STOPPED;
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignStop(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+    AUDIO_SofTimestampStop();
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+    HAL_SAI_DMAStop(mic->specific.hsai);
+    HAL_SAI_DeInit(mic->specific.hsai);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicChangeFrequence
+  *         change mic frequency, capture is restarted when it was running
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicChangeFrequence( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_MicStop(node_handle);
+    AUDIO_MicInitCaptureParams(mic);
+    return AUDIO_MicStart(mic->buf, node_handle);
+  }
+  AUDIO_MicInitCaptureParams(mic);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicInitCaptureParams
+  *         computes the DMA halves size for the current frequency
+  * @param  mic: mic node handle
+  * @retval None
+  */
+static void  AUDIO_MicInitCaptureParams( AUDIO_Mic_NodeTypeDef* mic)
+{
+  AUDIO_DescriptionTypeDef* desc = mic->node.audio_description;
+  uint32_t frames = (desc->frequence * AUDIO_MIC_DMA_HALF_MS) / 1000U;
+
+  mic->specific.half_pdm_frames = (uint16_t)(frames * 8U);
+  mic->specific.half_ring_bytes = (uint16_t)(frames * AUDIO_SAMPLE_LENGTH(desc));
+  mic->packet_length = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(desc);
+}
+
+/**
+  * @brief  AUDIO_MicSAIInit
+  *         Sets the audio clock then initializes the SAI PDM interface, the
+  *         mics are clocked at 64 times the frequency
+  * @param  mic: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicSAIInit( AUDIO_Mic_NodeTypeDef* mic)
+{
+  SAI_HandleTypeDef* hsai = mic->specific.hsai;
+  AUDIO_DescriptionTypeDef* desc = mic->node.audio_description;
+
+  if(AUDIO_USER_ClockConfig(desc->frequence) != 0)
+  {
+    return -1;
+  }
+  hsai->Instance = AUDIO_MIC_SAI_BLOCK;
+  hsai->Init.Protocol = SAI_FREE_PROTOCOL;
+  hsai->Init.AudioMode = SAI_MODEMASTER_RX;
+  hsai->Init.DataSize = SAI_DATASIZE_16;
+  hsai->Init.FirstBit = SAI_FIRSTBIT_MSB;
+  hsai->Init.ClockStrobing = SAI_CLOCKSTROBING_FALLINGEDGE;
+  hsai->Init.Synchro = SAI_ASYNCHRONOUS;
+  hsai->Init.OutputDrive = SAI_OUTPUT_DRIVE_DISABLE;
+  hsai->Init.NoDivider = SAI_MASTERDIVIDER_DISABLE;
+  hsai->Init.FIFOThreshold = SAI_FIFOTHRESHOLD_1QF;
+  /* a PDM frame holds 8 bits of each mic */
+  hsai->Init.AudioFrequency = desc->frequence * (AUDIO_PDM_DECIMATION / 8U);
+  hsai->Init.SynchroExt = SAI_SYNCEXT_DISABLE;
+  hsai->Init.MonoStereoMode = SAI_STEREOMODE;
+  hsai->Init.CompandingMode = SAI_NOCOMPANDING;
+  hsai->Init.TriState = SAI_OUTPUT_NOTRELEASED;
+  hsai->Init.MckOutput = SAI_MCK_OUTPUT_DISABLE;
+  hsai->Init.MckOverSampling = SAI_MCK_OVERSAMPLING_DISABLE;
+  hsai->Init.PdmInit.Activation = ENABLE;
+  hsai->Init.PdmInit.MicPairsNbr = AUDIO_MIC_PDM_PAIRS;
+  hsai->Init.PdmInit.ClockEnable = AUDIO_MIC_PDM_CLOCK;
+  hsai->FrameInit.FrameLength = 16U * AUDIO_MIC_PDM_PAIRS;
+  hsai->FrameInit.ActiveFrameLength = 1;
+  hsai->FrameInit.FSDefinition = SAI_FS_STARTFRAME;
+  hsai->FrameInit.FSPolarity = SAI_FS_ACTIVE_HIGH;
+  hsai->FrameInit.FSOffset = SAI_FS_FIRSTBIT;
+  hsai->SlotInit.FirstBitOffset = 0;
+  hsai->SlotInit.SlotSize = SAI_SLOTSIZE_DATASIZE;
+  hsai->SlotInit.SlotNumber = AUDIO_MIC_PDM_PAIRS;
+  hsai->SlotInit.SlotActive = (1U << AUDIO_MIC_PDM_PAIRS) - 1U;
+  if(HAL_SAI_Init(hsai) != HAL_OK)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicDrainHalf
+  *         decimates a captured DMA half to the buffer, silence is written
+  *         when muted. The half is dropped when stopped or on overrun
+  * @param  mic: mic node handle
+  * @param  half: captured DMA half
+  * @retval None
+  */
+static void  AUDIO_MicDrainHalf( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half)
+{
+  AUDIO_BufferTypeDef* buf = mic->buf;
+  uint32_t ring_bytes = mic->specific.half_ring_bytes;
+  uint32_t frames;
+  AUDIO_BufferRegionTypeDef region;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  uint32_t wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return;
+  }
+  /* the filters run even when the half is dropped, so they stay in step
+     with the bitstream */
+  AUDIO_PROF_BEGIN(AUDIO_PROF_PDM_DECIMATE);
+  frames = AUDIO_PdmFilterRun(&mic->specific.filter, half, mic->specific.half_pdm_frames,
+                              mic->specific.pcm);
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+  AUDIO_BeamformerRun(&mic->specific.beamformer, mic->specific.pcm, frames);
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+  AUDIO_PROF_END(AUDIO_PROF_PDM_DECIMATE);
+  if(AUDIO_BUFFER_FREE_SIZE(buf) < ring_bytes)
+  {
+    AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)mic, mic->node.session_handle);
+    return;
+  }
+
+  if(mic->specific.channel_mute)
+  {
+    AUDIO_MicMuteChannels(mic, frames * mic->node.audio_description->channels_count);
+  }
+  AUDIO_BufferAcquireWrite(buf, ring_bytes, &region);
+  AUDIO_MicWriteRegion(mic, &region);
+#ifdef USE_AUDIO_TAP
+  AUDIO_TapWriteRegion(AUDIO_TAP_POINT_MIC_RAW, &region);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+  AUDIO_SnapshotWriteRegion(AUDIO_TAP_POINT_MIC_RAW, &region);
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SPECTRUM
+  AUDIO_SpectrumWriteRegion(AUDIO_SPECTRUM_SOURCE_MIC, &region, mic->node.audio_description);
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_BULK_CAPTURE
+  AUDIO_BulkCaptureWriteRegion(&region, mic->node.audio_description);
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_AEC
+  /* the tap keeps the echo, the host gets the cancelled half */
+  AUDIO_AecCancel(&region);
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+  AUDIO_AgcProcess(&region);
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_RECORDING_VOICE
+  /* decimated to the voice ring before the host may read the half */
+  AUDIO_VoiceWriteRegion(&region, mic->node.audio_description);
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_PACKET_QUEUE
+  wr_ptr = buf->wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_BufferCommitWrite(buf, ring_bytes);
+#ifdef USE_AUDIO_PACKET_QUEUE
+  /* the first frame of the half was captured one half ago */
+  AUDIO_BufferPushPacket(buf, wr_ptr, (uint16_t)ring_bytes, (uint16_t)USB_SOF_NUMBER(),
+                         AUDIO_PACKET_TIME() -
+                         AUDIO_PACKET_FRAMES_TIME(frames, mic->node.audio_description->frequence));
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_PumpPostEvent(AUDIO_PACKET_RECEIVED, (AUDIO_NodeTypeDef*)mic, mic->node.session_handle);
+}
+
+/**
+  * @brief  AUDIO_MicWriteRegion
+  *         converts the decimated half to the buffer format
+  * @param  mic: mic node handle
+  * @param  region: region of the buffer to write
+  * @retval None
+  */
+static void  AUDIO_MicWriteRegion( AUDIO_Mic_NodeTypeDef* mic, AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_DescriptionTypeDef* desc = mic->node.audio_description;
+  int32_t* pcm = mic->specific.pcm;
+  uint32_t samples = mic->specific.half_ring_bytes / desc->audio_res;
+  uint32_t i;
+
+  if(desc->audio_mute)
+  {
+    AUDIO_MEMSET(region->data[0], 0, region->length[0]);
+    AUDIO_MEMSET(region->data[1], 0, region->length[1]);
+    return;
+  }
+  if(desc->audio_res == AUDIO_PCM_PACKED_24_BYTES)
+  {
+    AUDIO_PcmPack24Region((uint32_t*)pcm, region);
+    return;
+  }
+  /* the conversion is done in place, the samples don't grow */
+  if(desc->audio_res == 2U)
+  {
+#ifdef USE_AUDIO_DITHER
+    AUDIO_DitherReduce16(&mic->specific.dither, pcm, (int16_t*)pcm, samples);
+#else /* USE_AUDIO_DITHER */
+    for(i = 0; i < samples; i++)
+    {
+      ((int16_t*)pcm)[i] = (int16_t)(pcm[i] >> 8);
+    }
+#endif /* USE_AUDIO_DITHER */
+  }
+  else
+  {
+    for(i = 0; i < samples; i++)
+    {
+      pcm[i] = (int32_t)((uint32_t)pcm[i] << 8);
+    }
+  }
+  AUDIO_MEMCPY(region->data[0], pcm, region->length[0]);
+  AUDIO_MEMCPY(region->data[1], (uint8_t*)pcm + region->length[0], region->length[1]);
+}
+
+/**
+  * @brief  AUDIO_MicMuteChannels
+  *         writes silence in the samples of the muted channels
+  * @param  mic: mic node handle
+  * @param  samples: samples of the decimated half
+  * @retval None
+  */
+static void  AUDIO_MicMuteChannels( AUDIO_Mic_NodeTypeDef* mic, uint32_t samples)
+{
+  uint8_t channels = mic->node.audio_description->channels_count;
+  uint8_t channel = 0;
+  uint32_t i;
+
+  for(i = 0; i < samples; i++)
+  {
+    if(mic->specific.channel_mute & (1U << channel))
+    {
+      mic->specific.pcm[i] = 0;
+    }
+    channel = (channel + 1U == channels) ? 0U : channel + 1U;
+  }
+}
+
+/**
+  * @brief  AUDIO_MicGetDMAPosition
+  *         position of the DMA in the whole buffer, from the remaining count
+  * @param  mic: mic node handle
+  * @retval position in PCM frames
+  */
+static uint16_t  AUDIO_MicGetDMAPosition( AUDIO_Mic_NodeTypeDef* mic)
+{
+  uint32_t total = 2U * mic->specific.half_pdm_frames * AUDIO_MIC_PDM_PAIRS;
+  uint32_t remaining = __HAL_DMA_GET_COUNTER(mic->specific.hsai->hdmarx);
+
+  /* a PCM frame is 8 PDM frames of one slot per pair */
+  return (uint16_t)(((total - remaining) % total) / (8U * AUDIO_MIC_PDM_PAIRS));
+}
+
+/**
+  * @brief  AUDIO_MicMute
+  *         mute mic, muted halves are written as silence so the stream
+  *         timing is kept
+  * @param  channel_number: Channel number to mute, 0 for master
+  * @param  mute: 1 to mute , 0 to unmute
+  * @param  node_handle: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(channel_number == 0)
+  {
+    mic->node.audio_description->audio_mute = mute;
+  }
+  else if(mute)
+  {
+    mic->specific.channel_mute |= (uint8_t)(1U << (channel_number - 1U));
+  }
+  else
+  {
+    mic->specific.channel_mute &= (uint8_t)~(1U << (channel_number - 1U));
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicSetVolume
+  *         set mic volume, the gain is applied by the decimation filters
+  * @param  channel_number: channel number to set volume, 0 for master
+  * @param  volume_db_256:  volume value
+  * @param  node_handle:  mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicSetVolume( uint16_t channel_number,  int volume_db_256 ,  uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(channel_number == 0)
+  {
+    if(volume_db_256 > PDM_MIC_VOLUME_MAX_DB_256)
+    {
+      volume_db_256 = PDM_MIC_VOLUME_MAX_DB_256;
+    }
+    if(volume_db_256 < PDM_MIC_VOLUME_MIN_DB_256)
+    {
+      volume_db_256 = PDM_MIC_VOLUME_MIN_DB_256;
+    }
+    mic->volume = volume_db_256;
+    mic->specific.filter.gain = (int32_t)lrintf(powf(10.0f, (float)volume_db_256 / (20.0f * 256.0f)) *
+                                                (float)AUDIO_PDM_GAIN_UNITY);
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicGetVolumeDefaultsValues
+  *         get mic volume max, min & resolution value in db
+  * @param  vol_max: returned maximal volume
+  * @param  vol_min: returned minimal volume
+  * @param  vol_res: returned volume resolution
+  * @param  node_handle: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicGetVolumeDefaultsValues( int* vol_max, int* vol_min, int* vol_res, uint32_t node_handle)
+{
+  *vol_max = PDM_MIC_VOLUME_MAX_DB_256;
+  *vol_min = PDM_MIC_VOLUME_MIN_DB_256;
+  *vol_res = PDM_MIC_VOLUME_RES_DB_256;
+  return 0;
+}
+
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+/**
+  * @brief  AUDIO_MicStartReadCount
+  *         Start a count of bytes captured by the mics
+  * @param  node_handle: mic node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStartReadCount( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return -1;
+  }
+  mic->specific.dma_pos = AUDIO_MicGetDMAPosition(mic);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicGetLastReadCount
+  *         read the count of bytes captured since last call, in the buffer
+  *         format. Must be called more often than the DMA buffer duration
+  * @param  node_handle: mic node handle must be started
+  * @retval captured bytes , 0 if an error
+  */
+static uint16_t  AUDIO_MicGetLastReadCount( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+  uint32_t total;
+  uint16_t position;
+  uint16_t read_frames;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return 0;
+  }
+  total = 2U * (mic->specific.half_pdm_frames / 8U);
+  position = AUDIO_MicGetDMAPosition(mic);
+  read_frames = (uint16_t)((position + total - mic->specific.dma_pos) % total);
+  mic->specific.dma_pos = position;
+
+  return (uint16_t)(read_frames * AUDIO_SAMPLE_LENGTH(mic->node.audio_description));
+}
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+
+#endif /* !USE_AUDIO_DUMMY_MIC && USE_AUDIO_MEMS_MIC */
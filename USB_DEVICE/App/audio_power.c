@@ -0,0 +1,244 @@
+/**
+  ******************************************************************************
+  * @file    audio_power.c
+  * @brief   Idle power manager : the main loop lowers the system clock and the
+  *          regulator scale while no AS interface streams and CDC is quiet,
+  *          and enters STOP mode while the bus is suspended. A session start
+  *          ramps the clock back up from its SET_INTERFACE, before its nodes
+  *          and the SAI are started.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "usb_audio_user.h"
+#include "audio_power.h"
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC)
+#include "audio_user_devices.h"
+#endif /* (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC) */
+#ifdef USE_AUDIO_CPU_LOAD
+#include "audio_cpu_load.h"
+#endif /* USE_AUDIO_CPU_LOAD */
+
+#ifdef USE_AUDIO_IDLE_POWER
+/* Private variables ---------------------------------------------------------*/
+static volatile uint32_t audio_power_streams = 0;   /* one bit per AS interface started */
+static volatile uint8_t  audio_power_suspended = 0;
+static volatile uint8_t  audio_power_link_sleep = 0; /* link in LPM L1 */
+static volatile uint32_t audio_power_cdc_tick = 0;  /* HAL tick of the last CDC transfer */
+static volatile uint8_t  audio_power_state = AUDIO_POWER_RUN;
+
+/* Private function prototypes -----------------------------------------------*/
+static void  AUDIO_PowerRun(void);
+static void  AUDIO_PowerScaleDown(void);
+static void  AUDIO_PowerStop(void);
+static void  AUDIO_PowerClockChanged(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PowerInit
+  *         starts at full clock, the clock is only lowered after
+  *         AUDIO_POWER_CDC_IDLE_MS without streaming
+  * @retval None
+  */
+void AUDIO_PowerInit(void)
+{
+  audio_power_streams = 0;
+  audio_power_suspended = 0;
+  audio_power_link_sleep = 0;
+  audio_power_cdc_tick = HAL_GetTick();
+  audio_power_state = AUDIO_POWER_RUN;
+}
+
+/**
+  * @brief  AUDIO_PowerSetStreaming
+  *         called by the sessions when they start and stop. The first stream
+  *         started ramps the clock up before returning
+  * @param  interface_num: AS interface of the session
+  * @param  streaming: 1 when started, 0 when stopped
+  * @retval None
+  */
+void AUDIO_PowerSetStreaming(uint8_t interface_num, uint8_t streaming)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(streaming)
+  {
+    audio_power_streams |= (1UL << interface_num);
+    AUDIO_PowerRun();
+  }
+  else
+  {
+    audio_power_streams &= ~(1UL << interface_num);
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_PowerCdcActivity
+  *         called on each CDC transfer, keeps the full clock for AUDIO_POWER_CDC_IDLE_MS
+  * @retval None
+  */
+void AUDIO_PowerCdcActivity(void)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  audio_power_cdc_tick = HAL_GetTick();
+  AUDIO_PowerRun();
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_PowerSuspend
+  *         called from the USB suspend interrupt, STOP is entered by the main loop
+  * @retval None
+  */
+void AUDIO_PowerSuspend(void)
+{
+  audio_power_suspended = 1;
+}
+
+/**
+  * @brief  AUDIO_PowerResume
+  *         called from the USB resume and reset interrupts. The clocks were
+  *         restored by the main loop before the interrupt was taken
+  * @retval None
+  */
+void AUDIO_PowerResume(void)
+{
+  audio_power_suspended = 0;
+  audio_power_link_sleep = 0;
+}
+
+/**
+  * @brief  AUDIO_PowerLinkSleep
+  *         called from the LPM interrupt. In L1 no CDC transfer can come, the
+  *         clock is lowered without waiting for AUDIO_POWER_CDC_IDLE_MS
+  * @param  sleep: 1 when entering L1 , 0 when back to L0
+  * @retval None
+  */
+void AUDIO_PowerLinkSleep(uint8_t sleep)
+{
+  audio_power_link_sleep = sleep;
+}
+
+/**
+  * @brief  AUDIO_PowerIdle
+  *         main loop body : waits for the next interrupt at the lowest power
+  *         the device state allows. Interrupts are masked while deciding so a
+  *         wake up event is never missed, the pending interrupt is taken on return
+  * @retval None
+  */
+void AUDIO_PowerIdle(void)
+{
+  __disable_irq();
+  if((audio_power_streams == 0U) && audio_power_suspended)
+  {
+    AUDIO_PowerStop();
+  }
+  else
+  {
+    if((audio_power_streams == 0U) && (audio_power_state == AUDIO_POWER_RUN) &&
+       (audio_power_link_sleep || ((HAL_GetTick() - audio_power_cdc_tick) >= AUDIO_POWER_CDC_IDLE_MS)))
+    {
+      AUDIO_PowerScaleDown();
+    }
+#ifdef USE_AUDIO_CPU_LOAD
+    AUDIO_CpuLoadWfi();
+#else /* USE_AUDIO_CPU_LOAD */
+    __WFI();
+#endif /* USE_AUDIO_CPU_LOAD */
+  }
+  __enable_irq();
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PowerRun
+  *         back to VOS0 and PLL1 system clock, interrupts must be masked.
+  *         Takes the regulator and PLL lock times, well under a frame
+  * @retval None
+  */
+static void AUDIO_PowerRun(void)
+{
+  if(audio_power_state == AUDIO_POWER_IDLE)
+  {
+    __HAL_PWR_VOLTAGESCALING_CONFIG(AUDIO_POWER_RUN_VOLTAGE_SCALE);
+    while(!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
+    __HAL_RCC_PLL_ENABLE();
+    while(!__HAL_RCC_GET_FLAG(RCC_FLAG_PLLRDY)) {}
+    __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_PLLCLK);
+    while(__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_PLLCLK) {}
+    AUDIO_PowerClockChanged();
+    audio_power_state = AUDIO_POWER_RUN;
+  }
+}
+
+/**
+  * @brief  AUDIO_PowerScaleDown
+  *         system clock on HSI, PLL1 off then VOS3, interrupts must be masked.
+  *         The flash latency set for full clock is kept, it is valid at any lower clock
+  * @retval None
+  */
+static void AUDIO_PowerScaleDown(void)
+{
+  __HAL_RCC_SYSCLK_CONFIG(RCC_SYSCLKSOURCE_HSI);
+  while(__HAL_RCC_GET_SYSCLK_SOURCE() != RCC_SYSCLKSOURCE_STATUS_HSI) {}
+  __HAL_RCC_PLL_DISABLE();
+  AUDIO_PowerClockChanged();
+  __HAL_PWR_VOLTAGESCALING_CONFIG(AUDIO_POWER_IDLE_VOLTAGE_SCALE);
+  while(!__HAL_PWR_GET_FLAG(PWR_FLAG_VOSRDY)) {}
+  audio_power_state = AUDIO_POWER_IDLE;
+}
+
+/**
+  * @brief  AUDIO_PowerStop
+  *         STOP mode until the USB wake up line, interrupts must be masked.
+  *         The wake up interrupt is only enabled to end the WFI, it is never
+  *         taken : clocks are set again before interrupts are unmasked
+  * @retval None
+  */
+static void AUDIO_PowerStop(void)
+{
+  audio_power_state = AUDIO_POWER_STOP;
+  __HAL_USB_OTG_HS_WAKEUP_EXTI_ENABLE_IT();
+  NVIC_ClearPendingIRQ(OTG_HS_WKUP_IRQn);
+  NVIC_EnableIRQ(OTG_HS_WKUP_IRQn);
+  HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+  NVIC_DisableIRQ(OTG_HS_WKUP_IRQn);
+  NVIC_ClearPendingIRQ(OTG_HS_WKUP_IRQn);
+  __HAL_USB_OTG_HS_WAKEUP_EXTI_DISABLE_IT();
+  /* woken up on HSI with all PLLs off */
+  SystemClock_Config();
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC)
+  AUDIO_USER_ClockLost();
+#endif /* (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC) */
+  audio_power_cdc_tick = HAL_GetTick();
+  audio_power_state = AUDIO_POWER_RUN;
+}
+
+/**
+  * @brief  AUDIO_PowerClockChanged
+  *         SystemCoreClock and the 1 ms HAL tick follow the new system clock
+  * @retval None
+  */
+static void AUDIO_PowerClockChanged(void)
+{
+  SystemCoreClockUpdate();
+  HAL_InitTick(uwTickPrio);
+}
+#endif /* USE_AUDIO_IDLE_POWER */
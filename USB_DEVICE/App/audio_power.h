@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    audio_power.h
+  * @brief   header file for the audio_power.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_POWER_H
+#define __AUDIO_POWER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_IDLE_POWER
+/* Exported constants --------------------------------------------------------*/
+/* while no AS interface streams the system clock is the 64 MHz HSI with PLL1
+   off, the regulator then runs in VOS3. The audio PLL2 and the USB HSI48 are
+   not touched */
+#define AUDIO_POWER_IDLE_VOLTAGE_SCALE    PWR_REGULATOR_VOLTAGE_SCALE3
+#define AUDIO_POWER_RUN_VOLTAGE_SCALE     PWR_REGULATOR_VOLTAGE_SCALE0
+/* CDC traffic keeps the full clock for this long after the last transfer */
+#define AUDIO_POWER_CDC_IDLE_MS           1000U
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_POWER_RUN,     /* full clock, VOS0 */
+  AUDIO_POWER_IDLE,    /* HSI system clock, VOS3 , WFI between interrupts , also in LPM L1 */
+  AUDIO_POWER_STOP     /* USB suspended : STOP mode until resume */
+}AUDIO_PowerStateTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_PowerInit(void);
+void     AUDIO_PowerSetStreaming(uint8_t interface_num, uint8_t streaming);
+void     AUDIO_PowerCdcActivity(void);
+void     AUDIO_PowerSuspend(void);
+void     AUDIO_PowerResume(void);
+void     AUDIO_PowerLinkSleep(uint8_t sleep);
+void     AUDIO_PowerIdle(void);
+#endif /* USE_AUDIO_IDLE_POWER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_POWER_H */
@@ -0,0 +1,222 @@
+/**
+  ******************************************************************************
+  * @file    audio_profiler.c
+  * @brief   Cycle count profiler of the USB interrupt : each probe records the
+  *          DWT cycle counter delta of one handler or callback, min, max,
+  *          average and a log2 histogram are kept per probe in RAM. They are
+  *          read with the CDC command channel or dumped on SWO. When
+  *          USE_AUDIO_PROFILER is not defined the probes are empty macros.
+  *          USE_AUDIO_BOOT_PROFILE time stamps the boot stages up to the USB
+  *          configuration with the same counter.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "audio_profiler.h"
+
+#ifdef USE_AUDIO_PROFILER
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_PROF_DWT_UNLOCK_KEY         0xC5ACCE55U
+#define AUDIO_PROF_SWO_LINE_SIZE          128U
+
+/* Exported variables --------------------------------------------------------*/
+/* written by the USB interrupt only */
+AUDIO_ProfilerProbeTypeDef audio_profiler_probes[AUDIO_PROF_PROBE_COUNT];
+
+/* Private variables ---------------------------------------------------------*/
+static const char* const profiler_probe_names[AUDIO_PROF_PROBE_COUNT] =
+{
+  "pcd_irq",
+  "audio_data_out",
+  "audio_data_in",
+  "audio_sof",
+  "node_get_buffer",
+  "node_data_received",
+  "cdc_xfer",
+  "eq_process",
+  "pdm_decimate",
+  "irq_entry",
+  "isr_fpu"
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_ProfilerSwoWrite(const char* str);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ProfilerInit
+  *         starts the DWT cycle counter and clears the probes, must be called
+  *         before the USB interrupt is enabled
+  * @param  None
+  * @retval None
+  */
+void AUDIO_ProfilerInit(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  /* the cortex-M7 DWT is locked after reset */
+  DWT->LAR = AUDIO_PROF_DWT_UNLOCK_KEY;
+#ifndef USE_AUDIO_BOOT_PROFILE
+  /* the boot profile already runs the counter */
+  DWT->CYCCNT = 0;
+#endif /* USE_AUDIO_BOOT_PROFILE */
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  AUDIO_ProfilerReset();
+}
+
+/**
+  * @brief  AUDIO_ProfilerReset
+  *         clears the probes
+  * @param  None
+  * @retval None
+  */
+void AUDIO_ProfilerReset(void)
+{
+  uint32_t primask = __get_PRIMASK();
+  uint8_t probe;
+
+  __disable_irq();
+  memset(audio_profiler_probes, 0, sizeof(audio_profiler_probes));
+  for(probe = 0; probe < AUDIO_PROF_PROBE_COUNT; probe++)
+  {
+    audio_profiler_probes[probe].min = UINT32_MAX;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_ProfilerGet
+  *         copies a probe, the copy is consistent as the USB interrupt is masked
+  * @param  probe: probe index
+  * @param  stats: probe copy
+  * @retval 0 if no error
+  */
+int8_t AUDIO_ProfilerGet(uint8_t probe, AUDIO_ProfilerProbeTypeDef* stats)
+{
+  uint32_t primask;
+
+  if(probe >= AUDIO_PROF_PROBE_COUNT)
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *stats = audio_profiler_probes[probe];
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_ProfilerSwoDump
+  *         prints one line per probe on ITM stimulus port 0 , nothing is sent
+  *         when no debugger enabled the ITM. Must be called from thread mode
+  * @param  None
+  * @retval None
+  */
+void AUDIO_ProfilerSwoDump(void)
+{
+  AUDIO_ProfilerProbeTypeDef stats;
+  char line[AUDIO_PROF_SWO_LINE_SIZE];
+  uint8_t probe;
+  uint8_t bin;
+  int len;
+
+  for(probe = 0; probe < AUDIO_PROF_PROBE_COUNT; probe++)
+  {
+    AUDIO_ProfilerGet(probe, &stats);
+    if(stats.count == 0U)
+    {
+      stats.min = 0;
+    }
+    len = snprintf(line, sizeof(line), "%s n=%lu min=%lu avg=%lu max=%lu hist=",
+                   profiler_probe_names[probe], (unsigned long)stats.count, (unsigned long)stats.min,
+                   (unsigned long)(stats.count ? (stats.total / stats.count) : 0U), (unsigned long)stats.max);
+    for(bin = 0; (bin < AUDIO_PROF_HIST_BINS) && (len > 0) && (len < (int)sizeof(line)); bin++)
+    {
+      len += snprintf(&line[len], sizeof(line) - (uint32_t)len, (bin == 0U) ? "%lu" : ",%lu",
+                      (unsigned long)stats.hist[bin]);
+    }
+    AUDIO_ProfilerSwoWrite(line);
+    AUDIO_ProfilerSwoWrite("\r\n");
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ProfilerSwoWrite
+  *         sends a string on ITM stimulus port 0
+  * @param  str: null terminated string
+  * @retval None
+  */
+static void AUDIO_ProfilerSwoWrite(const char* str)
+{
+  while(*str != '\0')
+  {
+    ITM_SendChar((uint32_t)*str++);
+  }
+}
+#endif /* USE_AUDIO_PROFILER */
+
+#ifdef USE_AUDIO_BOOT_PROFILE
+/* Exported variables --------------------------------------------------------*/
+AUDIO_BootProfileTypeDef audio_boot_profile;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_BootProfileInit
+  *         starts the DWT cycle counter and marks AUDIO_BOOT_MAIN, first call
+  *         of main
+  * @param  None
+  * @retval None
+  */
+void AUDIO_BootProfileInit(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  /* the cortex-M7 DWT is locked after reset */
+  DWT->LAR = 0xC5ACCE55U;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  memset(&audio_boot_profile, 0, sizeof(audio_boot_profile));
+  audio_boot_profile.last_clock = SystemCoreClock;
+  audio_boot_profile.reached = 1UL << AUDIO_BOOT_MAIN;
+}
+
+/**
+  * @brief  AUDIO_BootMark
+  *         records the time of a stage the first time it is reached, later
+  *         marks are ignored (every bus reset, every SET_CONFIGURATION)
+  * @param  stage: AUDIO_BOOT_xxx
+  * @retval None
+  */
+void AUDIO_BootMark(uint8_t stage)
+{
+  uint32_t primask;
+  uint32_t now;
+
+  if((stage >= AUDIO_BOOT_STAGE_COUNT) || ((audio_boot_profile.reached & (1UL << stage)) != 0U))
+  {
+    return;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  now = DWT->CYCCNT;
+  audio_boot_profile.elapsed_ns += ((uint64_t)(now - audio_boot_profile.last_cycles) * 1000U) /
+                                   (audio_boot_profile.last_clock / 1000000U);
+  audio_boot_profile.last_cycles = now;
+  audio_boot_profile.last_clock = SystemCoreClock;
+  audio_boot_profile.time_us[stage] = (uint32_t)(audio_boot_profile.elapsed_ns / 1000U);
+  audio_boot_profile.reached |= 1UL << stage;
+  __set_PRIMASK(primask);
+}
+#endif /* USE_AUDIO_BOOT_PROFILE */
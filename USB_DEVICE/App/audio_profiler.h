@@ -0,0 +1,153 @@
+/**
+  ******************************************************************************
+  * @file    audio_profiler.h
+  * @brief   header file for the audio_profiler.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PROFILER_H
+#define __AUDIO_PROFILER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "stm32h7xx.h"
+
+#ifdef USE_AUDIO_PROFILER
+/* Exported constants --------------------------------------------------------*/
+/* probes , a probe includes the time spent in the probes it calls */
+#define AUDIO_PROF_PCD_IRQ                0U /* HAL_PCD_IRQHandler */
+#define AUDIO_PROF_AUDIO_DATA_OUT         1U /* USBD_AUDIO_DataOut */
+#define AUDIO_PROF_AUDIO_DATA_IN          2U /* USBD_AUDIO_DataIn */
+#define AUDIO_PROF_AUDIO_SOF              3U /* USBD_AUDIO_SOF */
+#define AUDIO_PROF_NODE_GET_BUFFER        4U /* GetBuffer callbacks of the data endpoints */
+#define AUDIO_PROF_NODE_DATA_RECEIVED     5U /* DataReceived callback of the playback endpoint */
+#define AUDIO_PROF_CDC_XFER               6U /* CDC receive and transmit complete callbacks */
+#define AUDIO_PROF_EQ_PROCESS             7U /* equalizer node on one played packet */
+#define AUDIO_PROF_PDM_DECIMATE           8U /* PDM decimation of one captured DMA half */
+#define AUDIO_PROF_IRQ_ENTRY              9U /* pend to handler of an interrupt, USE_AUDIO_ISR_LATENCY */
+#define AUDIO_PROF_ISR_FPU                10U /* audio interrupts which ran FPU instructions, USE_AUDIO_ISR_LATENCY */
+#define AUDIO_PROF_PROBE_COUNT            11U
+
+/* histogram bin n counts the durations in [2^(n + SHIFT - 1), 2^(n + SHIFT)[ cycles,
+   first bin is below 2^SHIFT and last one has no upper bound */
+#define AUDIO_PROF_HIST_BINS              8U
+#define AUDIO_PROF_HIST_SHIFT             7U  /* 128 cycles , 0.23 us at 550 MHz */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t count;                        /* durations recorded */
+  uint32_t min;                          /* cycles */
+  uint32_t max;                          /* cycles */
+  uint64_t total;                        /* cycles , average is total / count */
+  uint32_t hist[AUDIO_PROF_HIST_BINS];
+}
+AUDIO_ProfilerProbeTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern AUDIO_ProfilerProbeTypeDef audio_profiler_probes[AUDIO_PROF_PROBE_COUNT];
+
+/* Exported macros -----------------------------------------------------------*/
+/* BEGIN declares the start time of the probe in the current block , END of the same
+  probe must be in that block */
+#define AUDIO_PROF_BEGIN(probe)           uint32_t audio_prof_start_##probe = DWT->CYCCNT
+#define AUDIO_PROF_END(probe)             AUDIO_ProfilerRecord((probe), DWT->CYCCNT - audio_prof_start_##probe)
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_ProfilerInit(void);
+void     AUDIO_ProfilerReset(void);
+int8_t   AUDIO_ProfilerGet(uint8_t probe, AUDIO_ProfilerProbeTypeDef* stats);
+void     AUDIO_ProfilerSwoDump(void);
+
+/**
+  * @brief  AUDIO_ProfilerRecord
+  *         adds one duration to a probe, inlined in the interrupt which owns
+  *         the probe
+  * @param  probe: probe index
+  * @param  cycles: duration in core cycles
+  * @retval None
+  */
+__STATIC_FORCEINLINE void AUDIO_ProfilerRecord(uint8_t probe, uint32_t cycles)
+{
+  AUDIO_ProfilerProbeTypeDef* p = &audio_profiler_probes[probe];
+  uint32_t bin = 32U - __CLZ(cycles >> AUDIO_PROF_HIST_SHIFT);
+
+  if(bin >= AUDIO_PROF_HIST_BINS)
+  {
+    bin = AUDIO_PROF_HIST_BINS - 1U;
+  }
+  p->hist[bin]++;
+  if(cycles < p->min)
+  {
+    p->min = cycles;
+  }
+  if(cycles > p->max)
+  {
+    p->max = cycles;
+  }
+  p->total += cycles;
+  p->count++;
+}
+#else /* USE_AUDIO_PROFILER */
+#define AUDIO_PROF_BEGIN(probe)
+#define AUDIO_PROF_END(probe)
+#endif /* USE_AUDIO_PROFILER */
+
+#ifdef USE_AUDIO_BOOT_PROFILE
+/* boot stages, each one is marked once when it is done */
+#define AUDIO_BOOT_MAIN                   0U /* main entered, the cycle counter starts */
+#define AUDIO_BOOT_CORE                   1U /* MPU, caches and HAL_Init */
+#define AUDIO_BOOT_CLOCK                  2U /* SystemClock_Config, voltage scaling and PLL lock */
+#define AUDIO_BOOT_SYSINIT                3U /* pump and audio services */
+#define AUDIO_BOOT_USB_CORE               4U /* USBD_Init : OTG core reset and forced device mode */
+#define AUDIO_BOOT_USB_CLASSES            5U /* CDC and AUDIO registered, composite descriptors built */
+#define AUDIO_BOOT_USB_CONNECT            6U /* USBD_Start : pull-up on, the host sees the device */
+#define AUDIO_BOOT_USB_RESET              7U /* first bus reset from the host */
+#define AUDIO_BOOT_USB_CONFIGURED         8U /* SET_CONFIGURATION, audio class initialized */
+#define AUDIO_BOOT_STAGE_COUNT            9U
+#ifndef AUDIO_BOOT_BUDGET_US
+#define AUDIO_BOOT_BUDGET_US              50000U /* main entry to AUDIO_BOOT_USB_CONNECT */
+#endif /* AUDIO_BOOT_BUDGET_US */
+
+/* time of each stage from main entry, the interval before a mark is counted at the
+   core clock of the previous mark : SystemClock_Config waits at the reset clock */
+typedef struct
+{
+  uint32_t time_us[AUDIO_BOOT_STAGE_COUNT]; /* 0 until reached */
+  uint32_t reached;                         /* bit per stage */
+  uint64_t elapsed_ns;
+  uint32_t last_cycles;
+  uint32_t last_clock;                      /* SystemCoreClock at the last mark */
+}
+AUDIO_BootProfileTypeDef;
+
+/* read by the debugger or the CDC command channel */
+extern AUDIO_BootProfileTypeDef audio_boot_profile;
+
+#define AUDIO_BOOT_MARK(stage)            AUDIO_BootMark(stage)
+
+void     AUDIO_BootProfileInit(void);
+void     AUDIO_BootMark(uint8_t stage);
+#else /* USE_AUDIO_BOOT_PROFILE */
+#define AUDIO_BOOT_MARK(stage)
+#endif /* USE_AUDIO_BOOT_PROFILE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PROFILER_H */
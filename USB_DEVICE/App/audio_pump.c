@@ -0,0 +1,307 @@
+/**
+  ******************************************************************************
+  * @file    audio_pump.c
+  * @brief   Deferred audio work : USB ISR and SOF callbacks post work items,
+  *          handlers run later from the PendSV exception at the lowest priority
+  *          so the core can sleep in the main loop. With USE_AUDIO_PUMP_AUDIO_LEVEL
+  *          audio work runs from a higher priority level, see audio_pump.h.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32h7xx.h"
+#ifdef USE_AUDIO_PUMP_FREERTOS
+/* configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY of AUDIO_PUMP_AUDIO_PRIORITY */
+#include "FreeRTOS.h"
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+#include "audio_pump.h"
+#include "audio_trace.h"
+
+/* Private define ------------------------------------------------------------*/
+#define AUDIO_PUMP_PENDSV_PRIORITY        ((1U << __NVIC_PRIO_BITS) - 1U)
+
+#if (defined USE_AUDIO_PUMP_AUDIO_LEVEL) && (!defined AUDIO_PUMP_AUDIO_PRIORITY)
+#error "AUDIO_PUMP_AUDIO_PRIORITY must be defined with AUDIO_PUMP_KICK_AUDIO"
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL && !AUDIO_PUMP_AUDIO_PRIORITY */
+
+/* Private variables ---------------------------------------------------------*/
+static volatile uint32_t pump_pending_work = 0;
+static AUDIO_PumpHandlerTypeDef pump_handlers[AUDIO_PUMP_MAX_WORK];
+/* session event queue : several producers (ISRs of any priority) , the pump is the only consumer */
+static AUDIO_PumpEventTypeDef pump_events[AUDIO_PUMP_EVENT_QUEUE_SIZE];
+static volatile uint32_t pump_event_wr = 0;
+static volatile uint32_t pump_event_rd = 0;
+static volatile uint32_t pump_event_lost = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_PumpDispatchEvents(void);
+static void AUDIO_PumpRunLevel(uint32_t level_work);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PumpInit
+  *         Initializes the pump, PendSV is set to the lowest priority so
+  *         handlers are preempted by USB and audio peripheral interrupts
+  * @param  None
+  * @retval None
+  */
+void AUDIO_PumpInit(void)
+{
+  uint32_t i;
+
+  for(i = 0; i < AUDIO_PUMP_MAX_WORK; i++)
+  {
+    pump_handlers[i] = 0;
+  }
+  for(i = 0; i < AUDIO_PUMP_EVENT_QUEUE_SIZE; i++)
+  {
+    pump_events[i].ready = 0;
+  }
+  pump_pending_work = 0;
+  pump_event_wr = 0;
+  pump_event_rd = 0;
+  pump_event_lost = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SESSION_EVENT, AUDIO_PumpDispatchEvents);
+  NVIC_SetPriority(PendSV_IRQn, AUDIO_PUMP_PENDSV_PRIORITY);
+#if (defined USE_AUDIO_PUMP_AUDIO_LEVEL) && (defined AUDIO_PUMP_AUDIO_IRQn)
+  NVIC_SetPriority(AUDIO_PUMP_AUDIO_IRQn, AUDIO_PUMP_AUDIO_PRIORITY);
+  NVIC_EnableIRQ(AUDIO_PUMP_AUDIO_IRQn);
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL && AUDIO_PUMP_AUDIO_IRQn */
+}
+
+/**
+  * @brief  AUDIO_PumpSetHandler
+  *         Sets the handler run when work is posted
+  * @param  work: one AUDIO_PUMP_xxx bit
+  * @param  handler: function to run , 0 to ignore the work
+  * @retval None
+  */
+void AUDIO_PumpSetHandler(uint32_t work, AUDIO_PumpHandlerTypeDef handler)
+{
+  uint32_t i;
+
+  for(i = 0; i < AUDIO_PUMP_MAX_WORK; i++)
+  {
+    if(work & (1U << i))
+    {
+      pump_handlers[i] = handler;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_PumpPost
+  *         Posts work from any context, posting the same work several times
+  *         before it runs only runs its handler once
+  * @param  work: AUDIO_PUMP_xxx bits
+  * @retval None
+  */
+void AUDIO_PumpPost(uint32_t work)
+{
+  uint32_t pending;
+
+  do
+  {
+    pending = __LDREXW(&pump_pending_work);
+  }
+  while(__STREXW(pending | work, &pump_pending_work) != 0U);
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+  if(work & AUDIO_PUMP_AUDIO_WORK)
+  {
+    AUDIO_PUMP_KICK_AUDIO();
+  }
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+  if(work & ~AUDIO_PUMP_AUDIO_WORK)
+  {
+    AUDIO_PUMP_KICK_CONTROL();
+  }
+}
+
+/**
+  * @brief  AUDIO_PumpRun
+  *         Runs the handlers of posted control work, all posted work without
+  *         USE_AUDIO_PUMP_AUDIO_LEVEL, called from PendSV_Handler
+  * @param  None
+  * @retval None
+  */
+void AUDIO_PumpRun(void)
+{
+  AUDIO_PumpRunLevel(~AUDIO_PUMP_AUDIO_WORK);
+}
+
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+/**
+  * @brief  AUDIO_PumpRunAudio
+  *         Runs the handlers of posted audio work, called from
+  *         AUDIO_PUMP_AUDIO_IRQHandler or from the audio task
+  * @param  None
+  * @retval None
+  */
+void AUDIO_PumpRunAudio(void)
+{
+  AUDIO_PumpRunLevel(AUDIO_PUMP_AUDIO_WORK);
+}
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+
+/**
+  * @brief  AUDIO_PumpLockAudio
+  *         Keeps audio work from running, for control work changing session
+  *         state. Must be short
+  * @param  None
+  * @retval lock to give back to AUDIO_PumpUnlockAudio
+  */
+uint32_t AUDIO_PumpLockAudio(void)
+{
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+  uint32_t basepri = __get_BASEPRI();
+
+  __set_BASEPRI_MAX(AUDIO_PUMP_AUDIO_PRIORITY << (8U - __NVIC_PRIO_BITS));
+  return basepri;
+#else /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+  /* single level, control work is never preempted by audio work */
+  return 0;
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+}
+
+/**
+  * @brief  AUDIO_PumpUnlockAudio
+  *         Lets audio work run again, work posted meanwhile runs now
+  * @param  lock: value returned by AUDIO_PumpLockAudio
+  * @retval None
+  */
+void AUDIO_PumpUnlockAudio(uint32_t lock)
+{
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+  __set_BASEPRI(lock);
+#else /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+  UNUSED(lock);
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+}
+
+/**
+  * @brief  AUDIO_PumpPostEvent
+  *         Queues a session event, SessionCallback is called later from the pump
+  *         instead of the ISR context of the node raising it. Events the
+  *         session did not subscribe to are dropped here
+  * @param  event: event type
+  * @param  node: source of event
+  * @param  session: session to notify
+  * @retval 0 if queued or not subscribed, -1 if the queue is full and the event is lost
+  */
+int8_t AUDIO_PumpPostEvent(AUDIO_SessionEventTypeDef event, AUDIO_NodeTypeDef* node, AUDIO_SessionTypeDef* session)
+{
+  AUDIO_PumpEventTypeDef* record;
+  uint32_t wr;
+
+  AUDIO_TRACE(AUDIO_TRACE_SESSION_EVENT, event, node);
+  if((session == 0) || (!AUDIO_SESSION_SUBSCRIBED(session, event)))
+  {
+    return 0;
+  }
+  /* claim a slot, producers may preempt each other */
+  do
+  {
+    wr = __LDREXW(&pump_event_wr);
+    if((wr - pump_event_rd) >= AUDIO_PUMP_EVENT_QUEUE_SIZE)
+    {
+      __CLREX();
+      pump_event_lost++;
+      return -1;
+    }
+  }
+  while(__STREXW(wr + 1U, &pump_event_wr) != 0U);
+
+  record = &pump_events[wr & (AUDIO_PUMP_EVENT_QUEUE_SIZE - 1U)];
+  record->event = event;
+  record->node = node;
+  record->session = session;
+  __DMB();
+  record->ready = 1;
+  AUDIO_PumpPost(AUDIO_PUMP_SESSION_EVENT);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_PumpGetLostEvents
+  *         Returns count of events dropped because the queue was full
+  * @param  None
+  * @retval lost events count
+  */
+uint32_t AUDIO_PumpGetLostEvents(void)
+{
+  return pump_event_lost;
+}
+
+/**
+  * @brief  AUDIO_PumpDispatchEvents
+  *         Delivers queued events in order, stops on a slot still being
+  *         written, its producer posts the pump again once done
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_PumpDispatchEvents(void)
+{
+  AUDIO_PumpEventTypeDef* record;
+  AUDIO_PumpEventTypeDef  current;
+
+  while(pump_event_rd != pump_event_wr)
+  {
+    record = &pump_events[pump_event_rd & (AUDIO_PUMP_EVENT_QUEUE_SIZE - 1U)];
+    if(record->ready == 0)
+    {
+      break;
+    }
+    __DMB();
+    current = *record;
+    record->ready = 0;
+    __DMB();
+    pump_event_rd++;
+    if((current.session) && (current.session->SessionCallback))
+    {
+      current.session->SessionCallback(current.event, current.node, current.session);
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_PumpRunLevel
+  *         Takes the posted work of one level and runs its handlers, work of
+  *         the other level stays pending
+  * @param  level_work: AUDIO_PUMP_xxx bits of the level
+  * @retval None
+  */
+static void AUDIO_PumpRunLevel(uint32_t level_work)
+{
+  uint32_t pending;
+  uint32_t work;
+  uint32_t i;
+
+  do
+  {
+    pending = __LDREXW(&pump_pending_work);
+    work = pending & level_work;
+  }
+  while(__STREXW(pending & ~level_work, &pump_pending_work) != 0U);
+
+  for(i = 0; (i < AUDIO_PUMP_MAX_WORK) && (work != 0U); i++)
+  {
+    if(work & (1U << i))
+    {
+      work &= ~(1U << i);
+      if(pump_handlers[i])
+      {
+        pump_handlers[i]();
+      }
+    }
+  }
+}
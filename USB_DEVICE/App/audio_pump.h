@@ -0,0 +1,135 @@
+/**
+  ******************************************************************************
+  * @file    audio_pump.h
+  * @brief   header file for the audio_pump.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_PUMP_H
+#define __AUDIO_PUMP_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* work items posted by USB ISR / SOF callbacks, one bit each */
+#define AUDIO_PUMP_SPEAKER_DATA           0x01U /* a packet was received, speaker data may be consumed */
+#define AUDIO_PUMP_MIC_SPACE              0x02U /* a packet was played, room is available in mic buffer */
+#define AUDIO_PUMP_CDC_COMMAND            0x04U /* bytes were received on the CDC command channel */
+#define AUDIO_PUMP_TAP                    0x08U /* tap data was captured or the CDC IN endpoint is free */
+#define AUDIO_PUMP_STRESS                 0x10U /* the CDC IN endpoint is free during a stress run */
+#define AUDIO_PUMP_METER                  0x20U /* a level meter crossed its threshold */
+#define AUDIO_PUMP_TRACE                  0x40U /* trace records are ready or the CDC IN endpoint is free */
+#define AUDIO_PUMP_SESSION_EVENT          0x80U /* session events are queued, reserved for the pump */
+#define AUDIO_PUMP_CDC_BRIDGE             0x100U /* UART data, CDC data or a line coding for the UART bridge */
+#define AUDIO_PUMP_CLIP                   0x200U /* a clip request or payload was received, or a clip ended */
+#define AUDIO_PUMP_CONTROLS               0x400U /* the mute button or the volume encoder changed */
+#define AUDIO_PUMP_MIC_STAGE              0x800U /* an IN packet was armed, the next one may be staged */
+#define AUDIO_PUMP_CF_MAILBOX             0x1000U /* feature unit volume or mute requests wait to be applied */
+#define AUDIO_PUMP_CODEC                  0x2000U /* codec register writes were queued or a sequence ended */
+#define AUDIO_PUMP_SPECTRUM               0x4000U /* a spectrum window was captured or the CDC IN endpoint is free */
+#define AUDIO_PUMP_SOF_ALIGN              0x8000U /* a SAI stream waits for its start time after SOF */
+#define AUDIO_PUMP_LOG                    0x10000U /* log text was written or the CDC IN endpoint is free */
+#define AUDIO_PUMP_BULK_CAPTURE           0x20000U /* a mic block was queued or the bulk IN transfer ended */
+#define AUDIO_PUMP_VENDOR_REQUEST         0x40000U /* a parameter set was received on EP0 */
+#define AUDIO_PUMP_PLAY_START             0x80000U /* the host selected a playback alternate, USE_AUDIO_DEFERRED_ALTERNATE */
+#define AUDIO_PUMP_RECORD_START           0x100000U /* the host selected a recording alternate, USE_AUDIO_DEFERRED_ALTERNATE */
+#define AUDIO_PUMP_FAULT                  0x200000U /* a ms elapsed while faults are injected, USE_AUDIO_FAULT_INJECTION */
+#define AUDIO_PUMP_SNAPSHOT               0x400000U /* a ms elapsed while the snapshot is armed or the CDC IN endpoint is free, USE_AUDIO_SNAPSHOT */
+#define AUDIO_PUMP_MAX_WORK               23U
+#define AUDIO_PUMP_EVENT_QUEUE_SIZE       16U /* must be a power of two */
+
+/* Work runs at two levels : audio work from AUDIO_PumpRunAudio, the rest (CDC, tap, meter) from
+   AUDIO_PumpRun. Bare metal, the audio level is a spare interrupt below the USB and SAI DMA interrupts
+   and above PendSV so CDC parsing and transmits never delay audio work. Without
+   USE_AUDIO_PUMP_AUDIO_LEVEL everything runs from PendSV.
+   RTOS port : define AUDIO_PUMP_KICK_AUDIO() and AUDIO_PUMP_KICK_CONTROL() to notify two tasks
+   (e.g. vTaskNotifyGiveFromISR), the audio task loops on AUDIO_PumpRunAudio at a priority above
+   the control task looping on AUDIO_PumpRun, and define AUDIO_PUMP_AUDIO_PRIORITY to the
+   configMAX_SYSCALL_INTERRUPT_PRIORITY level for AUDIO_PumpLockAudio. The audio task needs stack
+   for the deepest session callback plus the speaker / mic copy, about 1 KB, the control task for
+   the CDC command frame buffers, about 1 KB too.
+   Define USE_AUDIO_PUMP_FREERTOS with USE_AUDIO_PUMP_AUDIO_LEVEL for the FreeRTOS port of
+   audio_pump_freertos.c , the FreeRTOS middleware must be added to the project. Its
+   FreeRTOSConfig.h maps vPortSVCHandler and xPortPendSVHandler to SVC_Handler and PendSV_Handler
+   but not xPortSysTickHandler, the HAL SysTick handler calls it. The interrupts posting work
+   (OTG_HS, SAI and MDMA) must be moved at or below configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY,
+   and the main loop polls need a task of their own */
+#ifdef USE_AUDIO_PUMP_FREERTOS
+#ifndef USE_AUDIO_PUMP_AUDIO_LEVEL
+#error "USE_AUDIO_PUMP_FREERTOS needs USE_AUDIO_PUMP_AUDIO_LEVEL"
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+#define AUDIO_PUMP_TASK_AUDIO             0U
+#define AUDIO_PUMP_TASK_CONTROL           1U
+#define AUDIO_PUMP_TASK_COUNT             2U
+#define AUDIO_PUMP_KICK_AUDIO()           AUDIO_PumpKickTask(AUDIO_PUMP_TASK_AUDIO)
+#define AUDIO_PUMP_KICK_CONTROL()         AUDIO_PumpKickTask(AUDIO_PUMP_TASK_CONTROL)
+#define AUDIO_PUMP_AUDIO_PRIORITY         configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+#define AUDIO_PUMP_AUDIO_WORK             (AUDIO_PUMP_SPEAKER_DATA | AUDIO_PUMP_MIC_SPACE | AUDIO_PUMP_SESSION_EVENT | \
+                                           AUDIO_PUMP_MIC_STAGE | AUDIO_PUMP_CF_MAILBOX | AUDIO_PUMP_PLAY_START | \
+                                           AUDIO_PUMP_RECORD_START)
+#ifndef AUDIO_PUMP_KICK_AUDIO
+#define AUDIO_PUMP_AUDIO_IRQn             CORDIC_IRQn /* not used by the application, pended by software */
+#define AUDIO_PUMP_AUDIO_IRQHandler       CORDIC_IRQHandler
+#define AUDIO_PUMP_AUDIO_PRIORITY         2U /* below OTG_HS (0) and the SAI / MDMA interrupts (1) */
+#define AUDIO_PUMP_KICK_AUDIO()           NVIC_SetPendingIRQ(AUDIO_PUMP_AUDIO_IRQn)
+#endif /* AUDIO_PUMP_KICK_AUDIO */
+#else /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+#define AUDIO_PUMP_AUDIO_WORK             0U
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+#ifndef AUDIO_PUMP_KICK_CONTROL
+#define AUDIO_PUMP_KICK_CONTROL()         (SCB->ICSR = SCB_ICSR_PENDSVSET_Msk)
+#endif /* AUDIO_PUMP_KICK_CONTROL */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*AUDIO_PumpHandlerTypeDef)(void);
+
+/* session event waiting to be delivered to SessionCallback */
+typedef struct
+{
+  AUDIO_SessionEventTypeDef event;
+  AUDIO_NodeTypeDef*        node;
+  AUDIO_SessionTypeDef*     session;
+  volatile uint8_t          ready; /* set by producer once the record is written */
+}
+AUDIO_PumpEventTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void AUDIO_PumpInit(void);
+void AUDIO_PumpSetHandler(uint32_t work, AUDIO_PumpHandlerTypeDef handler);
+void AUDIO_PumpPost(uint32_t work);
+void AUDIO_PumpRun(void);
+#ifdef USE_AUDIO_PUMP_AUDIO_LEVEL
+void AUDIO_PumpRunAudio(void);
+#endif /* USE_AUDIO_PUMP_AUDIO_LEVEL */
+uint32_t AUDIO_PumpLockAudio(void);
+void AUDIO_PumpUnlockAudio(uint32_t lock);
+int8_t AUDIO_PumpPostEvent(AUDIO_SessionEventTypeDef event, AUDIO_NodeTypeDef* node, AUDIO_SessionTypeDef* session);
+uint32_t AUDIO_PumpGetLostEvents(void);
+#ifdef USE_AUDIO_PUMP_FREERTOS
+int8_t AUDIO_PumpStartTasks(void);
+void AUDIO_PumpKickTask(uint32_t task);
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_PUMP_H */
@@ -0,0 +1,127 @@
+/**
+  ******************************************************************************
+  * @file    audio_pump_freertos.c
+  * @brief   FreeRTOS port of the pump : each level is a task, the audio task
+  *          above the control task, woken by a task notification each time
+  *          work of its level is posted. AUDIO_PumpLockAudio masks up to
+  *          configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, which holds the
+  *          scheduler, see audio_pump.h.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32h7xx.h"
+#include "audio_pump.h"
+
+#ifdef USE_AUDIO_PUMP_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+
+/* Private define ------------------------------------------------------------*/
+#define AUDIO_PUMP_AUDIO_STACK_WORDS      256U /* 1 KB : deepest session callback plus the speaker / mic copy */
+#define AUDIO_PUMP_CONTROL_STACK_WORDS    256U /* 1 KB : CDC command frame buffers */
+#define AUDIO_PUMP_AUDIO_TASK_PRIORITY    (configMAX_PRIORITIES - 1U)
+#define AUDIO_PUMP_CONTROL_TASK_PRIORITY  (tskIDLE_PRIORITY + 1U)
+
+/* Private variables ---------------------------------------------------------*/
+static TaskHandle_t pump_tasks[AUDIO_PUMP_TASK_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_PumpAudioTask(void* argument);
+static void AUDIO_PumpControlTask(void* argument);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PumpStartTasks
+  *         Creates the tasks of the two levels, called after AUDIO_PumpInit and
+  *         before vTaskStartScheduler. Work posted before is run once they start
+  * @param  None
+  * @retval 0 if no error, -1 if a task could not be created
+  */
+int8_t AUDIO_PumpStartTasks(void)
+{
+  if(xTaskCreate(AUDIO_PumpAudioTask, "pump_audio", AUDIO_PUMP_AUDIO_STACK_WORDS, 0,
+                 AUDIO_PUMP_AUDIO_TASK_PRIORITY, &pump_tasks[AUDIO_PUMP_TASK_AUDIO]) != pdPASS)
+  {
+    return -1;
+  }
+  if(xTaskCreate(AUDIO_PumpControlTask, "pump_control", AUDIO_PUMP_CONTROL_STACK_WORDS, 0,
+                 AUDIO_PUMP_CONTROL_TASK_PRIORITY, &pump_tasks[AUDIO_PUMP_TASK_CONTROL]) != pdPASS)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_PumpKickTask
+  *         Wakes the task of a level, AUDIO_PUMP_KICK_AUDIO and
+  *         AUDIO_PUMP_KICK_CONTROL. Work is mostly posted from interrupts, the
+  *         control task also posts it when it changes session state
+  * @param  task: AUDIO_PUMP_TASK_AUDIO or AUDIO_PUMP_TASK_CONTROL
+  * @retval None
+  */
+void AUDIO_PumpKickTask(uint32_t task)
+{
+  BaseType_t woken = pdFALSE;
+
+  if(pump_tasks[task] == 0)
+  {
+    /* not created yet : the work stays posted */
+    return;
+  }
+  if(__get_IPSR() != 0U)
+  {
+    vTaskNotifyGiveFromISR(pump_tasks[task], &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+  else
+  {
+    xTaskNotifyGive(pump_tasks[task]);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_PumpAudioTask
+  *         Runs the audio work each time it is notified
+  * @param  argument: not used
+  * @retval None
+  */
+static void AUDIO_PumpAudioTask(void* argument)
+{
+  UNUSED(argument);
+  for(;;)
+  {
+    AUDIO_PumpRunAudio();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+
+/**
+  * @brief  AUDIO_PumpControlTask
+  *         Runs the control work each time it is notified
+  * @param  argument: not used
+  * @retval None
+  */
+static void AUDIO_PumpControlTask(void* argument)
+{
+  UNUSED(argument);
+  for(;;)
+  {
+    AUDIO_PumpRun();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
+#endif /* USE_AUDIO_PUMP_FREERTOS */
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,191 @@
+/**
+  ******************************************************************************
+  * @file    audio_resampler.c
+  * @brief   Asynchronous sample rate converter : output frames are interpolated
+  *          from the input ring buffer at a fractional step with a cubic
+  *          (Catmull-Rom) Farrow structure, integer arithmetic only.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_resampler.h"
+#include "usb_audio_user.h"
+
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+
+/* Private define ------------------------------------------------------------*/
+#define AUDIO_RESAMPLER_MU_FRAC_BITS      15U /* interpolation position precision */
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t AUDIO_ResamplerLoadSample(AUDIO_BufferTypeDef* input, uint32_t ptr, uint8_t res);
+static void    AUDIO_ResamplerStoreSample(uint8_t* output, int32_t sample, uint8_t res);
+static int32_t AUDIO_ResamplerInterpolate(int32_t* x, int32_t mu);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ResamplerInit
+  *         Initializes the resampler with a unity step, history is silence
+  * @param  resampler: resampler to initialize
+  * @param  channels: channels count , at most AUDIO_RESAMPLER_MAX_CHANNELS
+  * @param  res: bytes per sample , 2 or 3
+  * @retval None
+  */
+void AUDIO_ResamplerInit(AUDIO_ResamplerTypeDef* resampler, uint8_t channels, uint8_t res)
+{
+  memset(resampler, 0, sizeof(AUDIO_ResamplerTypeDef));
+  resampler->channels = (channels > AUDIO_RESAMPLER_MAX_CHANNELS) ? AUDIO_RESAMPLER_MAX_CHANNELS : channels;
+  resampler->res = res;
+  resampler->step = AUDIO_RESAMPLER_STEP_ONE;
+}
+
+/**
+  * @brief  AUDIO_ResamplerSetStep
+  *         Sets ratio input rate / output rate , takes effect from next frame
+  * @param  resampler: resampler
+  * @param  step: input frames per output frame, 2.30 format
+  * @retval None
+  */
+void AUDIO_ResamplerSetStep(AUDIO_ResamplerTypeDef* resampler, uint32_t step)
+{
+  resampler->step = step;
+}
+
+/**
+  * @brief  AUDIO_ResamplerProcess
+  *         Produces output_frames frames from the input buffer, input is read
+  *         from its read pointer but not committed. When input runs short the
+  *         last frame is held
+  * @param  resampler: resampler
+  * @param  input: input buffer, same format as output
+  * @param  output: output frames
+  * @param  output_frames: count of frames to produce
+  * @retval consumed input bytes, to commit by caller
+  */
+uint32_t AUDIO_ResamplerProcess(AUDIO_ResamplerTypeDef* resampler, AUDIO_BufferTypeDef* input,
+                                uint8_t* output, uint32_t output_frames)
+{
+  uint32_t frame_size = resampler->channels * resampler->res;
+  uint32_t available = AUDIO_BUFFER_FILLED_SIZE(input);
+  uint32_t consumed = 0;
+  uint32_t ch;
+  int32_t  mu;
+  int32_t* x;
+
+  while(output_frames--)
+  {
+    /* shift in the input frames passed over by the output position */
+    while(resampler->phase >= AUDIO_RESAMPLER_STEP_ONE)
+    {
+      for(ch = 0; ch < resampler->channels; ch++)
+      {
+        x = resampler->history[ch];
+        x[0] = x[1];
+        x[1] = x[2];
+        x[2] = x[3];
+        if(consumed + frame_size <= available)
+        {
+          x[3] = AUDIO_ResamplerLoadSample(input, input->rd_ptr + consumed + ch * resampler->res, resampler->res);
+        }
+      }
+      if(consumed + frame_size <= available)
+      {
+        consumed += frame_size;
+      }
+      resampler->phase -= AUDIO_RESAMPLER_STEP_ONE;
+    }
+
+    mu = (int32_t)(resampler->phase >> (AUDIO_RESAMPLER_STEP_FRAC_BITS - AUDIO_RESAMPLER_MU_FRAC_BITS));
+    for(ch = 0; ch < resampler->channels; ch++)
+    {
+      AUDIO_ResamplerStoreSample(output, AUDIO_ResamplerInterpolate(resampler->history[ch], mu), resampler->res);
+      output += resampler->res;
+    }
+    resampler->phase += resampler->step;
+  }
+  return consumed;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_ResamplerLoadSample
+  *         reads a little endian signed sample from the ring
+  * @param  input: input buffer
+  * @param  ptr: free running byte pointer of sample
+  * @param  res: bytes per sample
+  * @retval sample value
+  */
+static int32_t AUDIO_ResamplerLoadSample(AUDIO_BufferTypeDef* input, uint32_t ptr, uint8_t res)
+{
+  uint32_t value;
+
+  value = (uint32_t)input->data[ptr & input->mask] | ((uint32_t)input->data[(ptr + 1U) & input->mask] << 8);
+  if(res == 3)
+  {
+    value |= (uint32_t)input->data[(ptr + 2U) & input->mask] << 16;
+    return ((int32_t)(value << 8)) >> 8;
+  }
+  return (int16_t)value;
+}
+
+/**
+  * @brief  AUDIO_ResamplerStoreSample
+  *         writes a sample, saturated to the sample resolution
+  * @param  output: destination
+  * @param  sample: value
+  * @param  res: bytes per sample
+  * @retval None
+  */
+static void AUDIO_ResamplerStoreSample(uint8_t* output, int32_t sample, uint8_t res)
+{
+  int32_t max = (1L << (8 * res - 1)) - 1;
+
+  if(sample > max)
+  {
+    sample = max;
+  }
+  if(sample < -max - 1)
+  {
+    sample = -max - 1;
+  }
+  output[0] = (uint8_t)sample;
+  output[1] = (uint8_t)(sample >> 8);
+  if(res == 3)
+  {
+    output[2] = (uint8_t)(sample >> 16);
+  }
+}
+
+/**
+  * @brief  AUDIO_ResamplerInterpolate
+  *         Catmull-Rom cubic between x[1] and x[2] evaluated with the Farrow
+  *         structure (Horner on mu), coefficients are kept doubled so no
+  *         precision is lost before the last shift
+  * @param  x: 4 input frames of one channel
+  * @param  mu: position after x[1], AUDIO_RESAMPLER_MU_FRAC_BITS format
+  * @retval interpolated sample
+  */
+static int32_t AUDIO_ResamplerInterpolate(int32_t* x, int32_t mu)
+{
+  int32_t c1 = x[2] - x[0];
+  int32_t c2 = 2 * x[0] - 5 * x[1] + 4 * x[2] - x[3];
+  int32_t c3 = x[3] - x[0] + 3 * (x[1] - x[2]);
+  int64_t acc;
+
+  acc = (((int64_t)c3 * mu) >> AUDIO_RESAMPLER_MU_FRAC_BITS) + c2;
+  acc = ((acc * mu) >> AUDIO_RESAMPLER_MU_FRAC_BITS) + c1;
+  acc = (acc * mu) >> AUDIO_RESAMPLER_MU_FRAC_BITS;
+  return x[1] + (int32_t)(acc >> 1);
+}
+
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file    audio_resampler.h
+  * @brief   header file for the audio_resampler.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_RESAMPLER_H
+#define __AUDIO_RESAMPLER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_RESAMPLER_STEP_FRAC_BITS    30U
+#define AUDIO_RESAMPLER_STEP_ONE          (1UL << AUDIO_RESAMPLER_STEP_FRAC_BITS) /* step for same input and output rates */
+#define AUDIO_RESAMPLER_MAX_CHANNELS      8U
+#define AUDIO_RESAMPLER_TAPS              4U /* cubic interpolation uses 4 input frames */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t step;     /* input frames consumed per output frame, 2.30 format */
+  uint32_t phase;    /* position of next output frame after history[1], 2.30 format */
+  uint8_t  channels;
+  uint8_t  res;      /* bytes per sample , 2 or 3 */
+  int32_t  history[AUDIO_RESAMPLER_MAX_CHANNELS][AUDIO_RESAMPLER_TAPS]; /* last input frames, oldest first */
+}
+AUDIO_ResamplerTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_ResamplerInit(AUDIO_ResamplerTypeDef* resampler, uint8_t channels, uint8_t res);
+void     AUDIO_ResamplerSetStep(AUDIO_ResamplerTypeDef* resampler, uint32_t step);
+uint32_t AUDIO_ResamplerProcess(AUDIO_ResamplerTypeDef* resampler, AUDIO_BufferTypeDef* input,
+                                uint8_t* output, uint32_t output_frames);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_RESAMPLER_H */
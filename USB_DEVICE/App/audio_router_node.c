@@ -0,0 +1,418 @@
+/**
+  ******************************************************************************
+  * @file    audio_router_node.c
+  * @brief   Channel router : a gain matrix maps the USB channels to the
+  *          speaker channels in place on the packets received from USB. The
+  *          routing is loaded from the CDC command channel in a second bank,
+  *          swapped with the active one between two packets. An identity
+  *          routing returns at once, 16 bits stereo is routed two samples at
+  *          a time with SMUAD and PKHBT.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_router_node.h"
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+
+/* Private variables ---------------------------------------------------------*/
+/* written from the pump, read by the process in the USB interrupt */
+static AUDIO_Router_NodeTypeDef *current_router = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_RouterDeInit(uint32_t node_handle);
+static int8_t  AUDIO_RouterStart(uint32_t node_handle);
+static int8_t  AUDIO_RouterStop(uint32_t node_handle);
+static int8_t  AUDIO_RouterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+static void    AUDIO_RouterStereo16(const AUDIO_RouterBankTypeDef* bank, uint8_t* in, uint8_t* out,
+                                    uint32_t frames) USBD_ITCM_FUNC;
+static void    AUDIO_RouterMatrix(const AUDIO_RouterBankTypeDef* bank, uint8_t* in, uint8_t* out,
+                                  uint32_t frames, uint8_t channels, uint8_t res) USBD_ITCM_FUNC;
+static void    AUDIO_RouterSetIdentity(AUDIO_RouterBankTypeDef* bank);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_RouterInit
+  *         Initializes the router node, each channel goes to itself
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      router node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_RouterInit(AUDIO_DescriptionTypeDef* audio_description,
+                         AUDIO_SessionTypeDef* session_handle,
+                         uint32_t node_handle)
+{
+  AUDIO_Router_NodeTypeDef* router = (AUDIO_Router_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(router, 0, sizeof(AUDIO_Router_NodeTypeDef));
+  router->processing.node.state = AUDIO_NODE_INITIALIZED;
+  router->processing.node.type = AUDIO_PROCESSING;
+  router->processing.node.session_handle = session_handle;
+  router->processing.node.audio_description = audio_description;
+  AUDIO_RouterSetIdentity(&router->bank[0]);
+  AUDIO_RouterSetIdentity(&router->bank[1]);
+
+  router->RouterDeInit = AUDIO_RouterDeInit;
+  router->RouterStart = AUDIO_RouterStart;
+  router->RouterStop = AUDIO_RouterStop;
+  router->processing.Process = AUDIO_RouterProcess;
+  current_router = router;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterSetGain
+  *         loads the gain of an input channel in an output channel in the
+  *         loaded bank, it is used once AUDIO_RouterCommit is called. Must be
+  *         called from the pump
+  * @param  output_channel: 1..n
+  * @param  input_channel: 1..n
+  * @param  gain: Q1.14 , -AUDIO_ROUTER_GAIN_MAX to AUDIO_ROUTER_GAIN_MAX
+  * @retval 0 if no error, -1 on bad arguments or while a swap is pending
+  */
+int8_t  AUDIO_RouterSetGain(uint8_t output_channel, uint8_t input_channel, int16_t gain)
+{
+  AUDIO_Router_NodeTypeDef* router = current_router;
+  uint8_t channels;
+
+  if((router == 0) || router->swap || (gain < -AUDIO_ROUTER_GAIN_MAX))
+  {
+    return -1;
+  }
+  channels = router->processing.node.audio_description->channels_count;
+  if((output_channel == 0U) || (output_channel > channels) || (input_channel == 0U) || (input_channel > channels))
+  {
+    return -1;
+  }
+  if(!router->loading)
+  {
+    /* gains not loaded keep their active value */
+    memcpy(&router->bank[router->active ^ 1U], &router->bank[router->active], sizeof(AUDIO_RouterBankTypeDef));
+    router->loading = 1;
+  }
+  router->bank[router->active ^ 1U].gain[output_channel - 1U][input_channel - 1U] = gain;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterCommit
+  *         uses the loaded bank from the next packet, at once when the node
+  *         is not started. Must be called from the pump
+  * @param  None
+  * @retval 0 if no error, -1 while the previous swap is pending
+  */
+int8_t  AUDIO_RouterCommit(void)
+{
+  AUDIO_Router_NodeTypeDef* router = current_router;
+  AUDIO_RouterBankTypeDef* bank;
+  uint8_t channels;
+  uint8_t o, i;
+
+  if((router == 0) || router->swap)
+  {
+    return -1;
+  }
+  if(!router->loading)
+  {
+    return 0;
+  }
+  bank = &router->bank[router->active ^ 1U];
+  channels = router->processing.node.audio_description->channels_count;
+  bank->identity = 1;
+  for(o = 0; o < channels; o++)
+  {
+    for(i = 0; i < channels; i++)
+    {
+      if(bank->gain[o][i] != ((o == i) ? AUDIO_ROUTER_GAIN_UNITY : 0))
+      {
+        bank->identity = 0;
+      }
+    }
+  }
+  /* left input in the low half word, as the samples of a 16 bits stereo frame */
+  bank->pair[0] = __PKHBT((uint32_t)(uint16_t)bank->gain[0][0], (uint32_t)(uint16_t)bank->gain[0][1], 16);
+  bank->pair[1] = __PKHBT((uint32_t)(uint16_t)bank->gain[1][0], (uint32_t)(uint16_t)bank->gain[1][1], 16);
+  router->loading = 0;
+  if(router->processing.node.state != AUDIO_NODE_STARTED)
+  {
+    router->active ^= 1U;
+    return 0;
+  }
+  __DMB();
+  router->swap = 1;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterIsIdentity
+  *         tells whether the active routing leaves the packets untouched
+  * @param  None
+  * @retval 1 for identity, 0 otherwise, -1 when the router is not built
+  */
+int8_t  AUDIO_RouterIsIdentity(void)
+{
+  if(current_router == 0)
+  {
+    return -1;
+  }
+  return (int8_t)current_router->bank[current_router->active].identity;
+}
+
+#ifdef USE_AUDIO_BENCH
+/**
+  * @brief  AUDIO_RouterBenchInit
+  *         Initializes a router out of the sessions for the benchmark, every
+  *         output is the half sum of all inputs. The node loaded by the CDC
+  *         commands is left unchanged. Must be called from the pump
+  * @param  audio_description: audio parameters
+  * @param  node_handle:      router node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_RouterBenchInit(AUDIO_DescriptionTypeDef* audio_description, uint32_t node_handle)
+{
+  AUDIO_Router_NodeTypeDef* saved = current_router;
+  uint8_t channels = audio_description->channels_count;
+  uint8_t o, i;
+
+  if(AUDIO_RouterInit(audio_description, 0, node_handle) != 0)
+  {
+    current_router = saved;
+    return -1;
+  }
+  for(o = 1; o <= channels; o++)
+  {
+    for(i = 1; i <= channels; i++)
+    {
+      AUDIO_RouterSetGain(o, i, AUDIO_ROUTER_GAIN_UNITY / 2);
+    }
+  }
+  AUDIO_RouterCommit();
+  AUDIO_RouterStart(node_handle);
+  current_router = saved;
+  return 0;
+}
+#endif /* USE_AUDIO_BENCH */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_RouterDeInit
+  *         De-Initializes the router node
+  * @param  node_handle: router node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_RouterDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Router_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_OFF;
+  current_router = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterStart
+  *         Starts processing
+  * @param  node_handle: router node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_RouterStart(uint32_t node_handle)
+{
+  ((AUDIO_Router_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterStop
+  *         Stops processing, packets are left untouched. A pending swap is
+  *         done so the next load isn't refused
+  * @param  node_handle: router node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_RouterStop(uint32_t node_handle)
+{
+  AUDIO_Router_NodeTypeDef* router = (AUDIO_Router_NodeTypeDef*)node_handle;
+
+  router->processing.node.state = AUDIO_NODE_STOPPED;
+  if(router->swap)
+  {
+    router->active ^= 1U;
+    router->swap = 0;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterProcess
+  *         Routes the channels of the frames, the loaded bank is taken first
+  *         when a swap is pending
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  node_handle: router node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_RouterProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Router_NodeTypeDef* router = (AUDIO_Router_NodeTypeDef*)node_handle;
+  AUDIO_RouterBankTypeDef* bank;
+  uint8_t channels = router->processing.node.audio_description->channels_count;
+  uint8_t res = router->processing.node.audio_description->audio_res;
+
+  if(router->swap)
+  {
+    router->active ^= 1U;
+    router->swap = 0;
+  }
+  bank = &router->bank[router->active];
+  if(bank->identity)
+  {
+    if(out != in)
+    {
+      memcpy(out, in, frames * channels * res);
+    }
+    return 0;
+  }
+  if((res == 2U) && (channels == 2U))
+  {
+    AUDIO_RouterStereo16(bank, in, out, frames);
+  }
+  else
+  {
+    AUDIO_RouterMatrix(bank, in, out, frames, channels, res);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_RouterStereo16
+  *         routes 16 bits stereo frames : a frame is loaded as one word, each
+  *         output is a dual multiply accumulate of both samples, the two
+  *         saturated outputs are packed back in one word. Gains are below 2
+  *         in magnitude so the sum of the two products never overflows
+  * @param  bank: active routing
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @retval None
+  */
+static void  AUDIO_RouterStereo16(const AUDIO_RouterBankTypeDef* bank, uint8_t* in, uint8_t* out, uint32_t frames)
+{
+  uint32_t left_gains = bank->pair[0];
+  uint32_t right_gains = bank->pair[1];
+  uint32_t frame;
+  int32_t  left, right;
+  uint32_t i;
+
+  for(i = 0; i < frames; i++)
+  {
+    frame = __UNALIGNED_UINT32_READ(in + 4U * i);
+    left = __SSAT((int32_t)__SMUAD(frame, left_gains) >> AUDIO_ROUTER_GAIN_FRAC_BITS, 16);
+    right = __SSAT((int32_t)__SMUAD(frame, right_gains) >> AUDIO_ROUTER_GAIN_FRAC_BITS, 16);
+    __UNALIGNED_UINT32_WRITE(out + 4U * i, __PKHBT((uint32_t)left, (uint32_t)right, 16));
+  }
+}
+
+/**
+  * @brief  AUDIO_RouterMatrix
+  *         routes frames of any channels count and resolution, the input
+  *         frame is loaded first so processing in place is possible
+  * @param  bank: active routing
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  channels: channels count
+  * @param  res: bytes per sample , 2, 3 or 4
+  * @retval None
+  */
+static void  AUDIO_RouterMatrix(const AUDIO_RouterBankTypeDef* bank, uint8_t* in, uint8_t* out,
+                                uint32_t frames, uint8_t channels, uint8_t res)
+{
+  int32_t  x[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  int64_t  acc;
+  int32_t  value;
+  uint32_t i;
+  uint8_t  o, ch;
+
+  for(i = 0; i < frames; i++)
+  {
+    for(ch = 0; ch < channels; ch++)
+    {
+      if(res == 2U)
+      {
+        x[ch] = (int16_t)__UNALIGNED_UINT16_READ(in);
+      }
+      else if(res == 3U)
+      {
+        x[ch] = (int32_t)(((uint32_t)in[0] << 8) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 24)) >> 8;
+      }
+      else
+      {
+        x[ch] = (int32_t)__UNALIGNED_UINT32_READ(in);
+      }
+      in += res;
+    }
+    for(o = 0; o < channels; o++)
+    {
+      acc = 0;
+      for(ch = 0; ch < channels; ch++)
+      {
+        acc += (int64_t)x[ch] * bank->gain[o][ch];
+      }
+      acc >>= AUDIO_ROUTER_GAIN_FRAC_BITS;
+      if(res == 2U)
+      {
+        value = (acc > INT16_MAX) ? INT16_MAX : ((acc < INT16_MIN) ? INT16_MIN : (int32_t)acc);
+        __UNALIGNED_UINT16_WRITE(out, (uint16_t)value);
+      }
+      else if(res == 3U)
+      {
+        value = (acc > 0x7FFFFF) ? 0x7FFFFF : ((acc < -0x800000) ? -0x800000 : (int32_t)acc);
+        out[0] = (uint8_t)value;
+        out[1] = (uint8_t)(value >> 8);
+        out[2] = (uint8_t)(value >> 16);
+      }
+      else
+      {
+        value = (acc > INT32_MAX) ? INT32_MAX : ((acc < INT32_MIN) ? INT32_MIN : (int32_t)acc);
+        __UNALIGNED_UINT32_WRITE(out, (uint32_t)value);
+      }
+      out += res;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_RouterSetIdentity
+  *         routes each channel to itself
+  * @param  bank: bank to set
+  * @retval None
+  */
+static void  AUDIO_RouterSetIdentity(AUDIO_RouterBankTypeDef* bank)
+{
+  uint8_t ch;
+
+  memset(bank, 0, sizeof(AUDIO_RouterBankTypeDef));
+  for(ch = 0; ch < AUDIO_MAX_SUPPORTED_CHANNEL_COUNT; ch++)
+  {
+    bank->gain[ch][ch] = AUDIO_ROUTER_GAIN_UNITY;
+  }
+  bank->pair[0] = AUDIO_ROUTER_GAIN_UNITY;
+  bank->pair[1] = (uint32_t)AUDIO_ROUTER_GAIN_UNITY << 16;
+  bank->identity = 1;
+}
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
@@ -0,0 +1,76 @@
+/**
+  ******************************************************************************
+  * @file    audio_router_node.h
+  * @brief   header file for the audio_router_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_ROUTER_NODE_H
+#define __AUDIO_ROUTER_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_ROUTER_GAIN_FRAC_BITS     14U  /* gains are Q1.14 , -2 to +2 */
+#define AUDIO_ROUTER_GAIN_UNITY         (1 << AUDIO_ROUTER_GAIN_FRAC_BITS)
+#define AUDIO_ROUTER_GAIN_MAX           32767 /* -32768 is refused, two products then fit SMUAD */
+
+/* Exported types ------------------------------------------------------------*/
+/* routing of all channels, the active one is never written */
+typedef struct
+{
+  int16_t            gain[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT][AUDIO_MAX_SUPPORTED_CHANNEL_COUNT]; /* output channel then input channel */
+  uint32_t           pair[2];        /* the two input gains of a stereo output, packed for SMUAD */
+  uint8_t            identity;       /* each channel goes to itself, packets are untouched */
+}
+AUDIO_RouterBankTypeDef;
+
+/* router node : every output channel is a weighted sum of the USB channels,
+   so channels can be swapped, duplicated or downmixed in place on each packet.
+   The speaker has the USB channels count, channels_map is not changed */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  AUDIO_RouterBankTypeDef bank[2];                                 /* active one and the one being loaded */
+  volatile uint8_t   active;         /* bank used by the process */
+  volatile uint8_t   swap;           /* the loaded bank is used from next packet */
+  uint8_t            loading;        /* the loaded bank was copied from the active one */
+  int8_t            (*RouterDeInit)  (uint32_t /*node_handle*/);
+  int8_t            (*RouterStart)   (uint32_t /*node_handle*/);
+  int8_t            (*RouterStop)    (uint32_t /*node_handle*/);
+}
+AUDIO_Router_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_RouterInit(AUDIO_DescriptionTypeDef* audio_description,
+                         AUDIO_SessionTypeDef* session_handle,
+                         uint32_t node_handle);
+int8_t  AUDIO_RouterSetGain(uint8_t output_channel, uint8_t input_channel, int16_t gain);
+int8_t  AUDIO_RouterCommit(void);
+int8_t  AUDIO_RouterIsIdentity(void);
+#ifdef USE_AUDIO_BENCH
+int8_t  AUDIO_RouterBenchInit(AUDIO_DescriptionTypeDef* audio_description, uint32_t node_handle);
+#endif /* USE_AUDIO_BENCH */
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_ROUTER_NODE_H */
@@ -0,0 +1,685 @@
+/**
+  ******************************************************************************
+  * @file    audio_sai_mic_node.c
+  * @brief   SAI mic node : a circular DMA fills two halves of one ms each,
+  *          every completed half is moved to the session ring while the DMA
+  *          writes the other one. The ring is therefore filled at the ADC
+  *          clock, and the count of captured bytes is read from the DMA.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_audio.h"
+#include "audio_mic_node.h"
+#include "usb_audio_user.h"
+#include "audio_pump.h"
+#include "audio_sof_timestamp.h"
+#include "audio_tap.h"
+#include "audio_snapshot.h"
+#include "audio_pcm.h"
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_copy.h"
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_AEC
+#include "audio_aec_node.h"
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "audio_bulk_capture.h"
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_MIC_AGC
+#include "audio_agc_node.h"
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "audio_sof_align.h"
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_RECORDING_VOICE
+#include "audio_sessions_usb.h"
+#endif /* USE_AUDIO_RECORDING_VOICE */
+
+#if (!defined USE_AUDIO_DUMMY_MIC) && (!defined USE_AUDIO_MEMS_MIC)
+
+/* Private defines -----------------------------------------------------------*/
+/* the mic gain is set in the codec, these are the limits reported to the host */
+#define SAI_MIC_VOLUME_RES_DB_256     256   /* 1 db 1 * 256 = 256*/
+#define SAI_MIC_VOLUME_MAX_DB_256     8192  /* 32db == 32*256 = 8192*/
+#define SAI_MIC_VOLUME_MIN_DB_256     -8192 /* -32db == -32*256 = -8192*/
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_MicDeInit(uint32_t node_handle);
+static int8_t   AUDIO_MicStart(AUDIO_BufferTypeDef* buffer, uint32_t node_handle);
+static int8_t   AUDIO_MicStop( uint32_t node_handle);
+static int8_t   AUDIO_MicChangeFrequence( uint32_t node_handle);
+static int8_t   AUDIO_MicMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle);
+static int8_t   AUDIO_MicSetVolume( uint16_t channel_number, int volume_db_256, uint32_t node_handle);
+static int8_t   AUDIO_MicGetVolumeDefaultsValues( int* vol_max, int* vol_min, int* vol_res, uint32_t node_handle);
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+static int8_t   AUDIO_MicStartReadCount( uint32_t node_handle);
+static uint16_t AUDIO_MicGetLastReadCount( uint32_t node_handle);
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+static void     AUDIO_MicInitCaptureParams( AUDIO_Mic_NodeTypeDef* mic);
+static int8_t   AUDIO_MicSAIInit( AUDIO_Mic_NodeTypeDef* mic);
+static void     AUDIO_MicDrainHalf( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half);
+static void     AUDIO_MicHalfDrained( AUDIO_Mic_NodeTypeDef* mic, AUDIO_BufferRegionTypeDef* region);
+#ifdef USE_AUDIO_MDMA_COPY
+static void     AUDIO_MicCopyDone( uint32_t private_data);
+#endif /* USE_AUDIO_MDMA_COPY */
+static void     AUDIO_MicMuteChannels( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half);
+static uint16_t AUDIO_MicGetDMAPosition( AUDIO_Mic_NodeTypeDef* mic);
+#ifdef USE_AUDIO_SOF_ALIGN
+static void     AUDIO_MicStartDMA( uint32_t node_handle);
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+/* Private variables ---------------------------------------------------------*/
+SAI_HandleTypeDef hsai_BlockB1;
+DMA_HandleTypeDef hdma_sai1_b;
+/* written by the DMA1, so in D2 SRAM which is not cached */
+__ALIGN_BEGIN static uint8_t mic_dma_buffer[AUDIO_MIC_DMA_BUFFER_SIZE] __ALIGN_END USBD_D2_BSS;
+static AUDIO_Mic_NodeTypeDef *current_mic = 0;
+
+/* Exported functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MicInit
+  *         Initializes the audio mic node
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      mic node handle must be allocated
+  * @retval 0 if no error
+  */
+ int8_t  AUDIO_MicInit(AUDIO_DescriptionTypeDef* audio_description,  AUDIO_SessionTypeDef* session_handle,
+                       uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  memset(mic, 0, sizeof(AUDIO_Mic_NodeTypeDef));
+  mic->node.type = AUDIO_INPUT;
+  mic->node.state = AUDIO_NODE_INITIALIZED;
+  mic->node.session_handle = session_handle;
+  mic->node.audio_description = audio_description;
+  mic->volume = audio_description->audio_volume_db_256;
+  mic->specific.hsai = &hsai_BlockB1;
+  mic->specific.dma_buffer = mic_dma_buffer;
+  AUDIO_MicInitCaptureParams(mic);
+
+  /* set callbacks */
+  mic->MicDeInit = AUDIO_MicDeInit;
+  mic->MicStart = AUDIO_MicStart;
+  mic->MicStop = AUDIO_MicStop;
+  mic->MicChangeFrequence = AUDIO_MicChangeFrequence;
+  mic->MicMute = AUDIO_MicMute;
+  mic->MicSetVolume = AUDIO_MicSetVolume;
+  mic->MicGetVolumeDefaultsValues = AUDIO_MicGetVolumeDefaultsValues;
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+  mic->MicStartReadCount = AUDIO_MicStartReadCount;
+  mic->MicGetReadCount = AUDIO_MicGetLastReadCount;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+  current_mic = mic;
+  return 0;
+}
+
+/**
+  * @brief  HAL_SAI_RxHalfCpltCallback
+  *         first half is captured, the DMA writes the second one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_RxHalfCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_MicDrainHalf(current_mic, current_mic->specific.dma_buffer);
+  }
+}
+
+/**
+  * @brief  HAL_SAI_RxCpltCallback
+  *         second half is captured, the DMA writes the first one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_RxCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_MicDrainHalf(current_mic, current_mic->specific.dma_buffer +
+                       current_mic->specific.half_samples * current_mic->specific.sample_size);
+  }
+}
+
+/**
+  * @brief  AUDIO_USER_MicErrorCallback
+  *         SAI or DMA error, reported as an overrun so the session restarts
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void AUDIO_USER_MicErrorCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_mic) && (hsai == current_mic->specific.hsai) &&
+     (current_mic->node.state == AUDIO_NODE_STARTED))
+  {
+    AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)current_mic,
+                        current_mic->node.session_handle);
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_MicDeInit
+  *         De-Initializes the audio mic node
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicDeInit(uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_MicStop(node_handle);
+  }
+  mic->node.state = AUDIO_NODE_OFF;
+  current_mic = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicStart
+  *         Start the audio mic node, the buffer is filled from the first
+  *         completed DMA half
+  * @param  buffer:     buffer to fill while node is being started
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStart(AUDIO_BufferTypeDef* buffer,  uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    return 0;
+  }
+  mic->buf = buffer;
+  if(AUDIO_MicSAIInit(mic) != 0)
+  {
+    return -1;
+  }
+  mic->specific.dma_pos = 0;
+  mic->node.state = AUDIO_NODE_STARTED;
+#ifdef USE_AUDIO_SOF_ALIGN
+  /* the DMA starts from the pump at its time after SOF */
+  if(AUDIO_SofAlignStart(AUDIO_SOF_ALIGN_MIC, AUDIO_MicStartDMA, node_handle) != 0)
+  {
+    mic->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#else /* USE_AUDIO_SOF_ALIGN */
+  if(HAL_SAI_Receive_DMA(mic->specific.hsai, mic->specific.dma_buffer,
+                         2U * mic->specific.half_samples) != HAL_OK)
+  {
+    mic->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+  /* without SAI speaker, FS_B is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(mic->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+#endif /* USE_AUDIO_SOF_ALIGN */
+  return 0;
+}
+
+#ifdef USE_AUDIO_SOF_ALIGN
+/**
+  * @brief  AUDIO_MicStartDMA
+  *         starts the capture DMA, called by the SOF align at the mic time.
+  *         A failure is reported as a SAI error
+  * @param  node_handle: mic node handle
+  * @retval None
+  */
+static void  AUDIO_MicStartDMA( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return;
+  }
+  mic->specific.dma_pos = 0;
+  if(HAL_SAI_Receive_DMA(mic->specific.hsai, mic->specific.dma_buffer,
+                         2U * mic->specific.half_samples) != HAL_OK)
+  {
+    AUDIO_USER_MicErrorCallback(mic->specific.hsai);
+    return;
+  }
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+  /* without SAI speaker, FS_B is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(mic->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+}
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+/**
+  * @brief  AUDIO_MicStop
+  *         Stop mic node, SAI is released so the next start applies the
+  *         current frequency
+  * @param  node_handle: mic node handle must be Started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStop( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    /* state first, so a pending DMA callback drops its half */
+    mic->node.state = AUDIO_NODE_STOPPED;
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignStop(AUDIO_SOF_ALIGN_MIC);
+#endif /* USE_AUDIO_SOF_ALIGN */
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY)
+    AUDIO_SofTimestampStop();
+#endif /* USE_AUDIO_SOF_TIMESTAMP && USE_AUDIO_SPEAKER_DUMMY */
+    HAL_SAI_DMAStop(mic->specific.hsai);
+#ifdef USE_AUDIO_MDMA_COPY
+    AUDIO_CopyAbort(AUDIO_COPY_MIC);
+#endif /* USE_AUDIO_MDMA_COPY */
+    HAL_SAI_DeInit(mic->specific.hsai);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicChangeFrequence
+  *         change mic frequency, capture is restarted when it was running
+  * @param  node_handle: mic node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicChangeFrequence( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_MicStop(node_handle);
+    AUDIO_MicInitCaptureParams(mic);
+    return AUDIO_MicStart(mic->buf, node_handle);
+  }
+  AUDIO_MicInitCaptureParams(mic);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicInitCaptureParams
+  *         computes the DMA halves size for the current frequency
+  * @param  mic: mic node handle
+  * @retval None
+  */
+static void  AUDIO_MicInitCaptureParams( AUDIO_Mic_NodeTypeDef* mic)
+{
+  AUDIO_DescriptionTypeDef* desc = mic->node.audio_description;
+  uint32_t frames = (desc->frequence * AUDIO_MIC_DMA_HALF_MS) / 1000U;
+
+  mic->specific.sample_size = (desc->audio_res == 2U) ? 2U : 4U;
+  mic->specific.half_samples = (uint16_t)(frames * desc->channels_count);
+  mic->specific.half_ring_bytes = (uint16_t)(frames * AUDIO_SAMPLE_LENGTH(desc));
+  mic->packet_length = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(desc);
+}
+
+/**
+  * @brief  AUDIO_MicSAIInit
+  *         Sets the audio clock then initializes the SAI for the current
+  *         frequency and resolution
+  * @param  mic: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicSAIInit( AUDIO_Mic_NodeTypeDef* mic)
+{
+  SAI_HandleTypeDef* hsai = mic->specific.hsai;
+  AUDIO_DescriptionTypeDef* desc = mic->node.audio_description;
+
+  if(AUDIO_USER_ClockConfig(desc->frequence) != 0)
+  {
+    return -1;
+  }
+  hsai->Instance = AUDIO_MIC_SAI_BLOCK;
+  hsai->Init.AudioMode = SAI_MODEMASTER_RX;
+  hsai->Init.Synchro = SAI_ASYNCHRONOUS;
+  hsai->Init.OutputDrive = SAI_OUTPUT_DRIVE_DISABLE;
+  hsai->Init.NoDivider = SAI_MASTERDIVIDER_ENABLE;
+  hsai->Init.FIFOThreshold = SAI_FIFOTHRESHOLD_1QF;
+  hsai->Init.AudioFrequency = desc->frequence;
+  hsai->Init.SynchroExt = SAI_SYNCEXT_DISABLE;
+  hsai->Init.MonoStereoMode = (desc->channels_count == 1U) ? SAI_MONOMODE : SAI_STEREOMODE;
+  hsai->Init.CompandingMode = SAI_NOCOMPANDING;
+  hsai->Init.TriState = SAI_OUTPUT_NOTRELEASED;
+  hsai->Init.MckOutput = SAI_MCK_OUTPUT_ENABLE;
+  /* one slot per channel, mono still uses the two I2S slots */
+  if(HAL_SAI_InitProtocol(hsai, SAI_I2S_STANDARD,
+                          AUDIO_SAI_PROTOCOL_DATASIZE(desc->audio_res),
+                          (desc->channels_count + 1U) & ~1U) != HAL_OK)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicDrainHalf
+  *         moves a captured DMA half to the buffer, silence is written when
+  *         muted. The half is dropped when stopped or on overrun
+  * @param  mic: mic node handle
+  * @param  half: captured DMA half
+  * @retval None
+  */
+static void  AUDIO_MicDrainHalf( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half)
+{
+  AUDIO_BufferTypeDef* buf = mic->buf;
+  uint32_t ring_bytes = mic->specific.half_ring_bytes;
+  AUDIO_BufferRegionTypeDef region;
+
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return;
+  }
+  if(AUDIO_BUFFER_FREE_SIZE(buf) < ring_bytes)
+  {
+    AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)mic, mic->node.session_handle);
+    return;
+  }
+
+  if(mic->specific.channel_mute)
+  {
+    /* the DMA is writing the other half, this one can be cleared in place */
+    AUDIO_MicMuteChannels(mic, half);
+  }
+  /* the control requests preempt the SAI interrupt : mute and resolution are read once */
+  AUDIO_DescriptionTypeDef desc;
+  (void)AUDIO_DescriptionRead(mic->node.audio_description, &desc);
+  AUDIO_BufferAcquireWrite(buf, ring_bytes, &region);
+  if(desc.audio_mute)
+  {
+    AUDIO_MEMSET(region.data[0], 0, region.length[0]);
+    AUDIO_MEMSET(region.data[1], 0, region.length[1]);
+  }
+  else if(desc.audio_res == AUDIO_PCM_PACKED_24_BYTES)
+  {
+    /* 24 bits right aligned SAI slots, packed to S24_3LE for USB */
+    AUDIO_PcmPack24Region((uint32_t*)half, &region);
+  }
+  else
+  {
+    /* 16 bits and 32 bits containers have the SAI slot layout */
+#ifdef USE_AUDIO_MDMA_COPY
+    /* the region is committed once the MDMA moved the half, the DMA writes
+       the other one meanwhile */
+    if(AUDIO_CopyToRegion(AUDIO_COPY_MIC, &region, half, AUDIO_MicCopyDone, (uint32_t)mic) != 0)
+    {
+      /* previous copy still running, the region can't be written */
+      AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)mic, mic->node.session_handle);
+    }
+    return;
+#else /* USE_AUDIO_MDMA_COPY */
+    AUDIO_MEMCPY(region.data[0], half, region.length[0]);
+    AUDIO_MEMCPY(region.data[1], half + region.length[0], region.length[1]);
+#endif /* USE_AUDIO_MDMA_COPY */
+  }
+  AUDIO_MicHalfDrained(mic, &region);
+}
+
+/**
+  * @brief  AUDIO_MicHalfDrained
+  *         ends the move of a captured half : the region written is published
+  * @param  mic: mic node handle
+  * @param  region: region of the buffer holding the half
+  * @retval None
+  */
+static void  AUDIO_MicHalfDrained( AUDIO_Mic_NodeTypeDef* mic, AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_BufferTypeDef* buf = mic->buf;
+  uint32_t ring_bytes = mic->specific.half_ring_bytes;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  uint32_t wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+
+#ifdef USE_AUDIO_TAP
+  AUDIO_TapWriteRegion(AUDIO_TAP_POINT_MIC_RAW, region);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+  AUDIO_SnapshotWriteRegion(AUDIO_TAP_POINT_MIC_RAW, region);
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SPECTRUM
+  AUDIO_SpectrumWriteRegion(AUDIO_SPECTRUM_SOURCE_MIC, region, mic->node.audio_description);
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_BULK_CAPTURE
+  AUDIO_BulkCaptureWriteRegion(region, mic->node.audio_description);
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_AEC
+  /* the tap keeps the echo, the host gets the cancelled half */
+  AUDIO_AecCancel(region);
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+  AUDIO_AgcProcess(region);
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_RECORDING_VOICE
+  /* decimated to the voice ring before the host may read the half */
+  AUDIO_VoiceWriteRegion(region, mic->node.audio_description);
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_PACKET_QUEUE
+  wr_ptr = buf->wr_ptr;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_BufferCommitWrite(buf, ring_bytes);
+#ifdef USE_AUDIO_PACKET_QUEUE
+  /* the first frame of the half was captured one half ago */
+  AUDIO_BufferPushPacket(buf, wr_ptr, (uint16_t)ring_bytes, (uint16_t)USB_SOF_NUMBER(),
+                         AUDIO_PACKET_TIME() -
+                         AUDIO_PACKET_FRAMES_TIME(ring_bytes / AUDIO_SAMPLE_LENGTH(mic->node.audio_description),
+                                                  mic->node.audio_description->frequence));
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_PumpPostEvent(AUDIO_PACKET_RECEIVED, (AUDIO_NodeTypeDef*)mic, mic->node.session_handle);
+}
+
+#ifdef USE_AUDIO_MDMA_COPY
+/**
+  * @brief  AUDIO_MicCopyDone
+  *         the MDMA moved the captured half to the buffer
+  * @param  private_data: mic node handle
+  * @retval None
+  */
+static void  AUDIO_MicCopyDone( uint32_t private_data)
+{
+  AUDIO_Mic_NodeTypeDef* mic = (AUDIO_Mic_NodeTypeDef*)private_data;
+  AUDIO_BufferRegionTypeDef region;
+
+  if(mic->node.state == AUDIO_NODE_STARTED)
+  {
+    /* the write position didn't move, same region as the copy */
+    AUDIO_BufferAcquireWrite(mic->buf, mic->specific.half_ring_bytes, &region);
+    AUDIO_MicHalfDrained(mic, &region);
+  }
+}
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/**
+  * @brief  AUDIO_MicMuteChannels
+  *         writes silence in the slots of the muted channels
+  * @param  mic: mic node handle
+  * @param  half: captured DMA half
+  * @retval None
+  */
+static void  AUDIO_MicMuteChannels( AUDIO_Mic_NodeTypeDef* mic, uint8_t* half)
+{
+  uint8_t channels = mic->node.audio_description->channels_count;
+  uint8_t channel = 0;
+  uint32_t i;
+
+  for(i = 0; i < mic->specific.half_samples; i++)
+  {
+    if(mic->specific.channel_mute & (1U << channel))
+    {
+      if(mic->specific.sample_size == 2U)
+      {
+        ((uint16_t*)half)[i] = 0;
+      }
+      else
+      {
+        ((uint32_t*)half)[i] = 0;
+      }
+    }
+    channel = (channel + 1U == channels) ? 0U : channel + 1U;
+  }
+}
+
+/**
+  * @brief  AUDIO_MicGetDMAPosition
+  *         position of the DMA in the whole buffer, from the remaining count
+  * @param  mic: mic node handle
+  * @retval position in samples
+  */
+static uint16_t  AUDIO_MicGetDMAPosition( AUDIO_Mic_NodeTypeDef* mic)
+{
+  uint32_t total = 2U * mic->specific.half_samples;
+  uint32_t remaining = __HAL_DMA_GET_COUNTER(mic->specific.hsai->hdmarx);
+
+  return (uint16_t)((total - remaining) % total);
+}
+
+/**
+  * @brief  AUDIO_MicMute
+  *         mute mic, muted halves are written as silence so the stream
+  *         timing is kept
+  * @param  channel_number: Channel number to mute, 0 for master
+  * @param  mute: 1 to mute , 0 to unmute
+  * @param  node_handle: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(channel_number == 0)
+  {
+    AUDIO_DescriptionWriteBegin(mic->node.audio_description);
+    mic->node.audio_description->audio_mute = mute;
+    AUDIO_DescriptionWriteEnd(mic->node.audio_description);
+  }
+  else if(mute)
+  {
+    mic->specific.channel_mute |= (uint8_t)(1U << (channel_number - 1U));
+  }
+  else
+  {
+    mic->specific.channel_mute &= (uint8_t)~(1U << (channel_number - 1U));
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicSetVolume
+  *         set mic volume, the gain is applied by the codec
+  * @param  channel_number: channel number to set volume, 0 for master
+  * @param  volume_db_256:  volume value
+  * @param  node_handle:  mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicSetVolume( uint16_t channel_number,  int volume_db_256 ,  uint32_t node_handle)
+{
+  if(channel_number == 0)
+  {
+    ((AUDIO_Mic_NodeTypeDef*)node_handle)->volume = volume_db_256;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicGetVolumeDefaultsValues
+  *         get mic volume max, min & resolution value in db
+  * @param  vol_max: returned maximal volume
+  * @param  vol_min: returned minimal volume
+  * @param  vol_res: returned volume resolution
+  * @param  node_handle: mic node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicGetVolumeDefaultsValues( int* vol_max, int* vol_min, int* vol_res, uint32_t node_handle)
+{
+  *vol_max = SAI_MIC_VOLUME_MAX_DB_256;
+  *vol_min = SAI_MIC_VOLUME_MIN_DB_256;
+  *vol_res = SAI_MIC_VOLUME_RES_DB_256;
+  return 0;
+}
+
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+/**
+  * @brief  AUDIO_MicStartReadCount
+  *         Start a count of bytes captured by the ADC
+  * @param  node_handle: mic node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_MicStartReadCount( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return -1;
+  }
+  mic->specific.dma_pos = AUDIO_MicGetDMAPosition(mic);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_MicGetLastReadCount
+  *         read the count of bytes captured since last call, in the buffer
+  *         format. Must be called more often than the DMA buffer duration
+  * @param  node_handle: mic node handle must be started
+  * @retval captured bytes , 0 if an error
+  */
+static uint16_t  AUDIO_MicGetLastReadCount( uint32_t node_handle)
+{
+  AUDIO_Mic_NodeTypeDef* mic;
+  uint32_t total;
+  uint16_t position;
+  uint16_t read_samples;
+
+  mic = (AUDIO_Mic_NodeTypeDef*)node_handle;
+  if(mic->node.state != AUDIO_NODE_STARTED)
+  {
+    return 0;
+  }
+  total = 2U * mic->specific.half_samples;
+  position = AUDIO_MicGetDMAPosition(mic);
+  read_samples = (uint16_t)((position + total - mic->specific.dma_pos) % total);
+  mic->specific.dma_pos = position;
+
+  return (uint16_t)(read_samples * mic->node.audio_description->audio_res);
+}
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+
+#endif /* !USE_AUDIO_DUMMY_MIC && !USE_AUDIO_MEMS_MIC */
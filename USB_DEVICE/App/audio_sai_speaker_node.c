@@ -0,0 +1,954 @@
+/**
+  ******************************************************************************
+  * @file    audio_sai_speaker_node.c
+  * @brief   SAI speaker node : a circular DMA plays two halves of one ms each,
+  *          every half is refilled from the session ring as soon as the DMA
+  *          moves to the other one. The ring is therefore drained at the DAC
+  *          clock, and the count of played samples is read from the DMA.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_audio.h"
+#include "audio_speaker_node.h"
+#include "usb_audio_user.h"
+#include "audio_pump.h"
+#include "audio_pcm.h"
+#include "audio_sof_timestamp.h"
+#include "audio_sidetone_node.h"
+#include "audio_mixer_node.h"
+#ifdef USE_AUDIO_MDMA_COPY
+#include "audio_copy.h"
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#include "audio_clip.h"
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_AEC
+#include "audio_aec_node.h"
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "audio_sof_align.h"
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+
+/* Private defines -----------------------------------------------------------*/
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+#define AUDIO_SPEAKER_SAI_FREQUENCY(desc)     AUDIO_SPEAKER_FIXED_RATE
+#else /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#define AUDIO_SPEAKER_SAI_FREQUENCY(desc)     ((desc)->frequence)
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+/* highest rate with a 256 fs MCLK */
+#define AUDIO_SPEAKER_MCLK_FREQ_MAX           USB_AUDIO_CONFIG_FREQ_192_K
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   AUDIO_SpeakerDeInit(uint32_t node_handle);
+static int8_t   AUDIO_SpeakerStart(AUDIO_BufferTypeDef* buffer, uint32_t node_handle);
+static int8_t   AUDIO_SpeakerStop( uint32_t node_handle);
+static int8_t   AUDIO_SpeakerChangeFrequence( uint32_t node_handle);
+static int8_t   AUDIO_SpeakerMute( uint16_t channel_number,  uint8_t mute , uint32_t node_handle);
+static int8_t   AUDIO_SpeakerSetVolume( uint16_t channel_number,  int volume ,  uint32_t node_handle);
+static int8_t   AUDIO_SpeakerStartReadCount( uint32_t node_handle);
+static uint16_t AUDIO_SpeakerGetLastReadCount( uint32_t node_handle);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+static int8_t   AUDIO_SpeakerPower( uint8_t on, uint32_t node_handle);
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+static void     AUDIO_SpeakerInitInjectionsParams( AUDIO_Speaker_NodeTypeDef* speaker);
+static int8_t   AUDIO_SpeakerSAIInit( AUDIO_Speaker_NodeTypeDef* speaker);
+static void     AUDIO_SpeakerFillHalf( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half);
+static void     AUDIO_SpeakerHalfFilled( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half, uint32_t ring_bytes);
+#ifdef USE_AUDIO_MDMA_COPY
+static void     AUDIO_SpeakerCopyDone( uint32_t private_data);
+#endif /* USE_AUDIO_MDMA_COPY */
+static void     AUDIO_SpeakerMuteChannels( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half);
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+static void     AUDIO_SpeakerConceal( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half);
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+static uint16_t AUDIO_SpeakerGetDMAPosition( AUDIO_Speaker_NodeTypeDef* speaker);
+#ifdef USE_AUDIO_SOF_ALIGN
+static void     AUDIO_SpeakerStartDMA( uint32_t node_handle);
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+static void     AUDIO_SpeakerLocalRelease( AUDIO_Speaker_NodeTypeDef* speaker);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+
+/* Private variables ---------------------------------------------------------*/
+SAI_HandleTypeDef hsai_BlockA1;
+DMA_HandleTypeDef hdma_sai1_a;
+/* read by the DMA1, so in D2 SRAM which is not cached */
+__ALIGN_BEGIN static uint8_t speaker_dma_buffer[AUDIO_SPEAKER_DMA_BUFFER_SIZE] __ALIGN_END USBD_D2_BSS;
+static AUDIO_Speaker_NodeTypeDef *current_speaker = 0;
+
+/* Exported functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SpeakerInit
+  *         Initializes the audio speaker node
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      speaker node handle must be allocated
+  * @retval 0 if no error
+  */
+ int8_t  AUDIO_SpeakerInit(AUDIO_DescriptionTypeDef* audio_description,  AUDIO_SessionTypeDef* session_handle,
+                           uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  memset(speaker, 0, sizeof(AUDIO_Speaker_NodeTypeDef));
+  speaker->node.type = AUDIO_OUTPUT;
+  speaker->node.state = AUDIO_NODE_INITIALIZED;
+  speaker->node.session_handle = session_handle;
+  speaker->node.audio_description = audio_description;
+  speaker->specific.hsai = &hsai_BlockA1;
+  speaker->specific.dma_buffer = speaker_dma_buffer;
+  AUDIO_SpeakerInitInjectionsParams( speaker);
+
+  /* set callbacks */
+  speaker->SpeakerDeInit = AUDIO_SpeakerDeInit;
+  speaker->SpeakerStart = AUDIO_SpeakerStart;
+  speaker->SpeakerStop = AUDIO_SpeakerStop;
+  speaker->SpeakerChangeFrequence = AUDIO_SpeakerChangeFrequence;
+  speaker->SpeakerMute = AUDIO_SpeakerMute;
+  speaker->SpeakerSetVolume = AUDIO_SpeakerSetVolume;
+  speaker->SpeakerStartReadCount = AUDIO_SpeakerStartReadCount;
+  speaker->SpeakerGetReadCount = AUDIO_SpeakerGetLastReadCount;
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  speaker->SpeakerPower = AUDIO_SpeakerPower;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+  current_speaker = speaker;
+  return 0;
+}
+
+/**
+  * @brief  HAL_SAI_TxHalfCpltCallback
+  *         first half is played, the DMA reads the second one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_TxHalfCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_speaker) && (hsai == current_speaker->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_SPEAKER);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_SpeakerFillHalf(current_speaker, current_speaker->specific.dma_buffer);
+#ifdef USE_AUDIO_AEC
+    /* echo reference, as played */
+    AUDIO_AecReference(current_speaker->specific.dma_buffer,
+                       current_speaker->specific.half_samples / current_speaker->node.audio_description->channels_count,
+                       current_speaker->node.audio_description,
+                       AUDIO_SPEAKER_SAI_FREQUENCY(current_speaker->node.audio_description));
+#endif /* USE_AUDIO_AEC */
+  }
+}
+
+/**
+  * @brief  HAL_SAI_TxCpltCallback
+  *         second half is played, the DMA reads the first one
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_TxCpltCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_speaker) && (hsai == current_speaker->specific.hsai))
+  {
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignHalf(AUDIO_SOF_ALIGN_SPEAKER);
+#endif /* USE_AUDIO_SOF_ALIGN */
+    AUDIO_SpeakerFillHalf(current_speaker, current_speaker->specific.dma_buffer +
+                          current_speaker->specific.half_samples * current_speaker->specific.sample_size);
+#ifdef USE_AUDIO_AEC
+    AUDIO_AecReference(current_speaker->specific.dma_buffer +
+                       current_speaker->specific.half_samples * current_speaker->specific.sample_size,
+                       current_speaker->specific.half_samples / current_speaker->node.audio_description->channels_count,
+                       current_speaker->node.audio_description,
+                       AUDIO_SPEAKER_SAI_FREQUENCY(current_speaker->node.audio_description));
+#endif /* USE_AUDIO_AEC */
+  }
+}
+
+/**
+  * @brief  AUDIO_SPEAKER_USER_ErrorCallback
+  *         SAI or DMA error, reported as an underrun so the session restarts
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void AUDIO_SPEAKER_USER_ErrorCallback(SAI_HandleTypeDef *hsai)
+{
+  if((current_speaker) && (hsai == current_speaker->specific.hsai) &&
+     (current_speaker->node.state == AUDIO_NODE_STARTED))
+  {
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+    /* not an underrun the speaker can conceal */
+    current_speaker->failed = 1;
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+    AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)current_speaker,
+                        current_speaker->node.session_handle);
+  }
+}
+
+#ifdef USE_AUDIO_CLIP_UPLOAD
+/**
+  * @brief  AUDIO_SpeakerLocalStart
+  *         starts the SAI without host stream, the halves get silence and
+  *         the clip. Nothing is done while the host streams, the clip is then
+  *         mixed in the stream. Called from the pump with audio work locked
+  * @param  None
+  * @retval 0 if the output runs
+  */
+int8_t  AUDIO_SpeakerLocalStart(void)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker = current_speaker;
+
+  if(speaker == 0)
+  {
+    return -1;
+  }
+  if((speaker->node.state == AUDIO_NODE_STARTED) || (speaker->specific.local))
+  {
+    return 0;
+  }
+  if(AUDIO_SpeakerSAIInit(speaker) != 0)
+  {
+    return -1;
+  }
+  speaker->specific.local = 1;
+  AUDIO_SpeakerFillHalf(speaker, speaker->specific.dma_buffer);
+  AUDIO_SpeakerFillHalf(speaker, speaker->specific.dma_buffer +
+                        speaker->specific.half_samples * speaker->specific.sample_size);
+  speaker->specific.dma_pos = 0;
+  if(HAL_SAI_Transmit_DMA(speaker->specific.hsai, speaker->specific.dma_buffer,
+                          2U * speaker->specific.half_samples) != HAL_OK)
+  {
+    speaker->specific.local = 0;
+    HAL_SAI_DeInit(speaker->specific.hsai);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SpeakerLocalStop
+  *         stops the SAI started by AUDIO_SpeakerLocalStart, the host stream
+  *         is left untouched. Called from the pump with audio work locked
+  * @param  None
+  * @retval None
+  */
+void  AUDIO_SpeakerLocalStop(void)
+{
+  if(current_speaker)
+  {
+    AUDIO_SpeakerLocalRelease(current_speaker);
+  }
+}
+
+/**
+  * @brief  AUDIO_SpeakerGetDescription
+  *         format the speaker plays, host stream or local clip
+  * @param  None
+  * @retval audio description , 0 before the playback session is initialized
+  */
+AUDIO_DescriptionTypeDef*  AUDIO_SpeakerGetDescription(void)
+{
+  return (current_speaker) ? current_speaker->node.audio_description : 0;
+}
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SpeakerDeInit
+  *         De-Initializes the audio speaker node
+  * @param  node_handle: speaker node handle must be initialized
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_SpeakerDeInit(uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(speaker->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_SpeakerStop(node_handle);
+  }
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  AUDIO_SpeakerLocalRelease(speaker);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+  speaker->node.state = AUDIO_NODE_OFF;
+  current_speaker = 0;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SpeakerStart
+  *         Start the audio speaker node, both halves are filled from the
+  *         buffer before the DMA starts
+  * @param  buffer:     buffer to use while node is being started
+  * @param  node_handle: speaker node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerStart(AUDIO_BufferTypeDef* buffer,  uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  speaker->buf = buffer;
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  AUDIO_USER_SpeakerAmpPower(1);
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+  speaker->drop_length = 0;
+  speaker->failed = 0;
+  speaker->specific.concealed = 0;
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  /* the host stream takes the SAI over, the clip goes on mixed in it */
+  AUDIO_SpeakerLocalRelease(speaker);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  AUDIO_UpsamplerInit(&speaker->specific.upsampler, speaker->node.audio_description->frequence,
+                      AUDIO_SPEAKER_FIXED_RATE, speaker->node.audio_description->channels_count,
+                      speaker->node.audio_description->audio_res);
+  speaker->specific.count_residue = 0;
+  if(speaker->specific.running)
+  {
+    /* the SAI kept playing silence across the rate change, the next half is read from the buffer */
+    speaker->specific.running = 0;
+    AUDIO_SpeakerMute( 0,  speaker->node.audio_description->audio_mute , node_handle);
+    AUDIO_SpeakerSetVolume( 0,  speaker->node.audio_description->audio_volume_db_256 , node_handle);
+    speaker->node.state = AUDIO_NODE_STARTED;
+    return 0;
+  }
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  if(AUDIO_SpeakerSAIInit(speaker) != 0)
+  {
+    return -1;
+  }
+  AUDIO_SpeakerMute( 0,  speaker->node.audio_description->audio_mute , node_handle);
+  AUDIO_SpeakerSetVolume( 0,  speaker->node.audio_description->audio_volume_db_256 , node_handle);
+  speaker->node.state = AUDIO_NODE_STARTED;
+  AUDIO_SpeakerFillHalf(speaker, speaker->specific.dma_buffer);
+#ifdef USE_AUDIO_MDMA_COPY
+  /* the second half is read after the first one is committed */
+  AUDIO_CopyWait(AUDIO_COPY_SPEAKER);
+#endif /* USE_AUDIO_MDMA_COPY */
+  AUDIO_SpeakerFillHalf(speaker, speaker->specific.dma_buffer +
+                        speaker->specific.half_samples * speaker->specific.sample_size);
+#ifdef USE_AUDIO_MDMA_COPY
+  AUDIO_CopyWait(AUDIO_COPY_SPEAKER);
+#endif /* USE_AUDIO_MDMA_COPY */
+  speaker->specific.dma_pos = 0;
+#ifdef USE_AUDIO_SOF_ALIGN
+  /* the DMA starts from the pump at its time after SOF, nothing is played before */
+  if(AUDIO_SofAlignStart(AUDIO_SOF_ALIGN_SPEAKER, AUDIO_SpeakerStartDMA, node_handle) != 0)
+  {
+    speaker->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#else /* USE_AUDIO_SOF_ALIGN */
+  if(HAL_SAI_Transmit_DMA(speaker->specific.hsai, speaker->specific.dma_buffer,
+                          2U * speaker->specific.half_samples) != HAL_OK)
+  {
+    speaker->node.state = AUDIO_NODE_STOPPED;
+    return -1;
+  }
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  /* FS_A is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(speaker->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+#endif /* USE_AUDIO_SOF_ALIGN */
+  return 0;
+}
+
+#ifdef USE_AUDIO_SOF_ALIGN
+/**
+  * @brief  AUDIO_SpeakerStartDMA
+  *         starts the DMA of the primed halves, called by the SOF align at
+  *         the speaker time. A failure is reported as a SAI error
+  * @param  node_handle: speaker node handle
+  * @retval None
+  */
+static void  AUDIO_SpeakerStartDMA( uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(speaker->node.state != AUDIO_NODE_STARTED)
+  {
+    return;
+  }
+  speaker->specific.dma_pos = 0;
+  if(HAL_SAI_Transmit_DMA(speaker->specific.hsai, speaker->specific.dma_buffer,
+                          2U * speaker->specific.half_samples) != HAL_OK)
+  {
+    AUDIO_SPEAKER_USER_ErrorCallback(speaker->specific.hsai);
+    return;
+  }
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  /* FS_A is the clock counted by the SOF timestamp */
+  AUDIO_SofTimestampStart(speaker->node.audio_description->frequence);
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+}
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+ /**
+  * @brief  AUDIO_SpeakerStop
+  *         Stop speaker node, SAI is released so the next start applies the
+  *         current frequency
+  * @param  node_handle: speaker node handle must be Started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerStop( uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  if((speaker->node.state == AUDIO_NODE_STARTED) || (speaker->specific.running))
+#else /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  if(speaker->node.state == AUDIO_NODE_STARTED)
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  {
+    /* state first, so a pending DMA callback plays silence */
+    speaker->node.state = AUDIO_NODE_STOPPED;
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+    speaker->specific.running = 0;
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#ifdef USE_AUDIO_SOF_ALIGN
+    AUDIO_SofAlignStop(AUDIO_SOF_ALIGN_SPEAKER);
+#endif /* USE_AUDIO_SOF_ALIGN */
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+    AUDIO_SofTimestampStop();
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+    HAL_SAI_DMAStop(speaker->specific.hsai);
+#ifdef USE_AUDIO_MDMA_COPY
+    AUDIO_CopyAbort(AUDIO_COPY_SPEAKER);
+#endif /* USE_AUDIO_MDMA_COPY */
+    HAL_SAI_DeInit(speaker->specific.hsai);
+  }
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  else
+  {
+    /* a frequency change while a clip plays locally */
+    AUDIO_SpeakerLocalRelease(speaker);
+  }
+  /* a clip being played goes on with the local output */
+  AUDIO_PumpPost(AUDIO_PUMP_CLIP);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+  return 0;
+}
+
+ /**
+  * @brief  AUDIO_SpeakerChangeFrequence
+  *         change frequency then stop speaker node. With
+  *         USE_AUDIO_PLAYBACK_FIXED_RATE the SAI goes on with silence at
+  *         its rate until the node restarts
+  * @param  node_handle: speaker node handle must be Started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerChangeFrequence( uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  if(speaker->node.state == AUDIO_NODE_STARTED)
+  {
+    /* running first, so the node is never seen stopped with the SAI on and not running */
+    speaker->specific.running = 1;
+    speaker->node.state = AUDIO_NODE_STOPPED;
+  }
+#else /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  AUDIO_SpeakerStop(node_handle);
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  AUDIO_SpeakerInitInjectionsParams(speaker);
+  return 0;
+}
+
+ /**
+  * @brief  AUDIO_SpeakerInitInjectionsParams
+  *         computes the DMA halves size for the current frequency. With
+  *         USE_AUDIO_PLAYBACK_FIXED_RATE the halves keep the SAI rate and a
+  *         half reads at most half_ring_bytes from the ring
+  * @param  speaker: speaker node handle
+  * @retval None
+  */
+static void  AUDIO_SpeakerInitInjectionsParams( AUDIO_Speaker_NodeTypeDef* speaker)
+{
+  AUDIO_DescriptionTypeDef* desc = speaker->node.audio_description;
+  uint32_t frames = (AUDIO_SPEAKER_SAI_FREQUENCY(desc) * AUDIO_SPEAKER_DMA_HALF_MS) / 1000U;
+
+  speaker->specific.sample_size = (desc->audio_res == 2U) ? 2U : 4U;
+  speaker->specific.half_samples = (uint16_t)(frames * desc->channels_count);
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  frames = (desc->frequence * AUDIO_SPEAKER_DMA_HALF_MS + 999U) / 1000U;
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  speaker->specific.half_ring_bytes = (uint16_t)(frames * AUDIO_SAMPLE_LENGTH(desc));
+  speaker->packet_length = speaker->specific.half_ring_bytes;
+}
+
+/**
+  * @brief  AUDIO_SpeakerSAIInit
+  *         Sets the audio clock then initializes the SAI for the current
+  *         frequency and resolution
+  * @param  speaker: speaker node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerSAIInit( AUDIO_Speaker_NodeTypeDef* speaker)
+{
+  SAI_HandleTypeDef* hsai = speaker->specific.hsai;
+  AUDIO_DescriptionTypeDef* desc = speaker->node.audio_description;
+
+  if(AUDIO_USER_ClockConfig(AUDIO_SPEAKER_SAI_FREQUENCY(desc)) != 0)
+  {
+    return -1;
+  }
+  hsai->Instance = AUDIO_SPEAKER_SAI_BLOCK;
+  hsai->Init.AudioMode = SAI_MODEMASTER_TX;
+  hsai->Init.Synchro = SAI_ASYNCHRONOUS;
+  hsai->Init.OutputDrive = SAI_OUTPUT_DRIVE_DISABLE;
+  hsai->Init.NoDivider = SAI_MASTERDIVIDER_ENABLE;
+  hsai->Init.FIFOThreshold = SAI_FIFOTHRESHOLD_1QF;
+  hsai->Init.AudioFrequency = AUDIO_SPEAKER_SAI_FREQUENCY(desc);
+  hsai->Init.SynchroExt = SAI_SYNCEXT_DISABLE;
+  hsai->Init.MonoStereoMode = (desc->channels_count == 1U) ? SAI_MONOMODE : SAI_STEREOMODE;
+  hsai->Init.CompandingMode = SAI_NOCOMPANDING;
+  hsai->Init.TriState = SAI_OUTPUT_NOTRELEASED;
+  hsai->Init.MckOutput = SAI_MCK_OUTPUT_ENABLE;
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+  /* a 256 fs MCLK above 192 kHz is faster than the PLL2P kernel clock : the bit
+     clock is divided from the kernel clock, 64 bits frames at 768 kHz take the
+     49.152 MHz as is. The codec then runs from the bit clock, no MCLK is output */
+  if(AUDIO_SPEAKER_SAI_FREQUENCY(desc) > AUDIO_SPEAKER_MCLK_FREQ_MAX)
+  {
+    hsai->Init.NoDivider = SAI_MASTERDIVIDER_DISABLE;
+    hsai->Init.MckOutput = SAI_MCK_OUTPUT_DISABLE;
+  }
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
+  /* one slot per channel, mono still uses the two I2S slots */
+  if(HAL_SAI_InitProtocol(hsai, SAI_I2S_STANDARD,
+                          AUDIO_SAI_PROTOCOL_DATASIZE(desc->audio_res),
+                          (desc->channels_count + 1U) & ~1U) != HAL_OK)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SpeakerFillHalf
+  *         refills a DMA half from the buffer, silence is played when muted,
+  *         stopped or on underrun. With USE_AUDIO_PLAYBACK_CONCEALMENT the
+  *         underrun is concealed and playing resumes with the next half
+  * @param  speaker: speaker node handle
+  * @param  half: DMA half to fill
+  * @retval None
+  */
+static void  AUDIO_SpeakerFillHalf( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half)
+{
+  AUDIO_BufferTypeDef* buf = speaker->buf;
+  uint32_t half_size = speaker->specific.half_samples * speaker->specific.sample_size;
+  uint32_t ring_bytes = speaker->specific.half_ring_bytes;
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  uint32_t half_frames = speaker->specific.half_samples / speaker->node.audio_description->channels_count;
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  AUDIO_BufferRegionTypeDef region;
+
+  if(speaker->node.state != AUDIO_NODE_STARTED)
+  {
+    AUDIO_MEMSET(half, 0, half_size);
+#ifdef USE_AUDIO_CLIP_UPLOAD
+    if(speaker->specific.local)
+    {
+      AUDIO_ClipMix(half, speaker->specific.half_samples / speaker->node.audio_description->channels_count,
+                    speaker->node.audio_description);
+    }
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+    return;
+  }
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  /* the input frames of a half vary when the rates are not multiples, 44 or 45 frames at 44.1 kHz */
+  ring_bytes = AUDIO_UpsamplerInputFrames(&speaker->specific.upsampler, half_frames) *
+               AUDIO_SAMPLE_LENGTH(speaker->node.audio_description);
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+  if(speaker->drop_length != 0U)
+  {
+    AUDIO_BufferDrop(buf, speaker->drop_length, AUDIO_SAMPLE_LENGTH(speaker->node.audio_description));
+    speaker->drop_length = 0;
+  }
+  if(AUDIO_BUFFER_FILLED_SIZE(buf) < ring_bytes)
+  {
+    /* one underrun is reported per gap */
+    if(speaker->specific.concealed == 0U)
+    {
+      AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)speaker, speaker->node.session_handle);
+    }
+    AUDIO_SpeakerConceal(speaker, half);
+    return;
+  }
+  speaker->specific.concealed = 0;
+#else /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+  if(AUDIO_BUFFER_FILLED_SIZE(buf) < ring_bytes)
+  {
+    AUDIO_MEMSET(half, 0, half_size);
+    AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)speaker, speaker->node.session_handle);
+    return;
+  }
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+
+  /* the control requests preempt the SAI interrupt : mute and resolution are read once */
+  AUDIO_DescriptionTypeDef desc;
+  (void)AUDIO_DescriptionRead(speaker->node.audio_description, &desc);
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  /* upsampled to the SAI rate, the filter history goes on while muted */
+  AUDIO_BufferAcquireRead(buf, ring_bytes, &region);
+  ring_bytes = AUDIO_UpsamplerProcess(&speaker->specific.upsampler, &region, half, half_frames);
+#ifndef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  if(desc.audio_mute)
+  {
+    AUDIO_MEMSET(half, 0, half_size);
+  }
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#else /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#ifndef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  if(desc.audio_mute)
+  {
+    AUDIO_MEMSET(half, 0, half_size);
+  }
+  else
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+  if(desc.audio_res == AUDIO_PCM_PACKED_24_BYTES)
+  {
+    /* S24_3LE from USB, unpacked to the 24 bits right aligned SAI slots */
+    AUDIO_BufferAcquireRead(buf, ring_bytes, &region);
+    AUDIO_PcmUnpack24Region(&region, (uint32_t*)half);
+  }
+  else
+  {
+    /* 16 bits and 32 bits containers have the SAI slot layout */
+    AUDIO_BufferAcquireRead(buf, ring_bytes, &region);
+#ifdef USE_AUDIO_MDMA_COPY
+    /* the half is completed once the MDMA moved it */
+    speaker->specific.fill_half = half;
+    if(AUDIO_CopyFromRegion(AUDIO_COPY_SPEAKER, half, &region, AUDIO_SpeakerCopyDone, (uint32_t)speaker) != 0)
+    {
+      /* previous copy still running, the ring can't be read */
+      AUDIO_MEMSET(half, 0, half_size);
+      AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)speaker, speaker->node.session_handle);
+    }
+    return;
+#else /* USE_AUDIO_MDMA_COPY */
+    AUDIO_MEMCPY(half, region.data[0], region.length[0]);
+    AUDIO_MEMCPY(half + region.length[0], region.data[1], region.length[1]);
+#endif /* USE_AUDIO_MDMA_COPY */
+  }
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+  AUDIO_SpeakerHalfFilled(speaker, half, ring_bytes);
+}
+
+/**
+  * @brief  AUDIO_SpeakerHalfFilled
+  *         ends the refill of a DMA half from the buffer : the muted channels
+  *         are cleared, the mixed stream and the sidetone are added and the
+  *         data is released
+  * @param  speaker: speaker node handle
+  * @param  half: DMA half filled
+  * @param  ring_bytes: bytes read from the buffer
+  * @retval None
+  */
+static void  AUDIO_SpeakerHalfFilled( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half, uint32_t ring_bytes)
+{
+  AUDIO_BufferTypeDef* buf = speaker->buf;
+
+  if(speaker->specific.channel_mute)
+  {
+    AUDIO_SpeakerMuteChannels(speaker, half);
+  }
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  /* after the mutes, each stream has its own feature unit */
+  AUDIO_MixerMix(half, ring_bytes / AUDIO_SAMPLE_LENGTH(speaker->node.audio_description));
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_SIDETONE
+  /* after the mutes, the host mutes the stream but not the sidetone */
+  AUDIO_SidetoneMix(half, ring_bytes / AUDIO_SAMPLE_LENGTH(speaker->node.audio_description));
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  /* after the mutes too, alerts are heard while the host mutes */
+  AUDIO_ClipMix(half, ring_bytes / AUDIO_SAMPLE_LENGTH(speaker->node.audio_description),
+                speaker->node.audio_description);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_PACKET_QUEUE
+  /* the half is output once the DMA played the other one */
+  AUDIO_BufferMeasureDelay(buf, AUDIO_PACKET_TIME() +
+                           AUDIO_PACKET_FRAMES_TIME(ring_bytes / AUDIO_SAMPLE_LENGTH(speaker->node.audio_description),
+                                                    speaker->node.audio_description->frequence));
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_BufferCommitRead(buf, ring_bytes);
+  AUDIO_PumpPostEvent(AUDIO_PACKET_PLAYED, (AUDIO_NodeTypeDef*)speaker, speaker->node.session_handle);
+}
+
+#ifdef USE_AUDIO_MDMA_COPY
+/**
+  * @brief  AUDIO_SpeakerCopyDone
+  *         the MDMA moved the ring data to the half being filled
+  * @param  private_data: speaker node handle
+  * @retval None
+  */
+static void  AUDIO_SpeakerCopyDone( uint32_t private_data)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker = (AUDIO_Speaker_NodeTypeDef*)private_data;
+
+  if(speaker->node.state == AUDIO_NODE_STARTED)
+  {
+    AUDIO_SpeakerHalfFilled(speaker, speaker->specific.fill_half, speaker->specific.half_ring_bytes);
+  }
+}
+#endif /* USE_AUDIO_MDMA_COPY */
+
+/**
+  * @brief  AUDIO_SpeakerMuteChannels
+  *         writes silence in the slots of the muted channels
+  * @param  speaker: speaker node handle
+  * @param  half: DMA half just filled
+  * @retval None
+  */
+static void  AUDIO_SpeakerMuteChannels( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half)
+{
+  uint8_t channels = speaker->node.audio_description->channels_count;
+  uint8_t channel = 0;
+  uint32_t i;
+
+  for(i = 0; i < speaker->specific.half_samples; i++)
+  {
+    if(speaker->specific.channel_mute & (1U << channel))
+    {
+      if(speaker->specific.sample_size == 2U)
+      {
+        ((uint16_t*)half)[i] = 0;
+      }
+      else
+      {
+        ((uint32_t*)half)[i] = 0;
+      }
+    }
+    channel = (channel + 1U == channels) ? 0U : channel + 1U;
+  }
+}
+
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+/**
+  * @brief  AUDIO_SpeakerConceal
+  *         fills a DMA half without data : the first half of a gap repeats the
+  *         half just played with a fade out, the next ones are silence
+  * @param  speaker: speaker node handle
+  * @param  half: DMA half to fill
+  * @retval None
+  */
+static void  AUDIO_SpeakerConceal( AUDIO_Speaker_NodeTypeDef* speaker, uint8_t* half)
+{
+  uint32_t half_size = speaker->specific.half_samples * speaker->specific.sample_size;
+  uint8_t* last = (half == speaker->specific.dma_buffer) ? (half + half_size) : speaker->specific.dma_buffer;
+  uint8_t channels = speaker->node.audio_description->channels_count;
+  uint32_t frames = speaker->specific.half_samples / channels;
+  int32_t  gain;
+  int32_t  sample;
+  uint32_t i;
+
+  if(speaker->specific.concealed != 0U)
+  {
+    AUDIO_MEMSET(half, 0, half_size);
+    return;
+  }
+  speaker->specific.concealed = 1;
+  for(i = 0; i < speaker->specific.half_samples; i++)
+  {
+    /* Q15 gain, linear from 1 down to 1/frames */
+    gain = (int32_t)(((frames - (i / channels)) << 15) / frames);
+    if(speaker->specific.sample_size == 2U)
+    {
+      ((int16_t*)half)[i] = (int16_t)(((int32_t)((int16_t*)last)[i] * gain) >> 15);
+    }
+    else
+    {
+      sample = ((int32_t*)last)[i];
+      if(speaker->node.audio_description->audio_res == AUDIO_PCM_PACKED_24_BYTES)
+      {
+        /* 24 bits right aligned slot */
+        sample = (int32_t)((uint32_t)sample << 8) >> 8;
+      }
+      ((int32_t*)half)[i] = (int32_t)(((int64_t)sample * gain) >> 15);
+    }
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+
+/**
+  * @brief  AUDIO_SpeakerGetDMAPosition
+  *         position of the DMA in the whole buffer, from the remaining count
+  * @param  speaker: speaker node handle
+  * @retval position in samples
+  */
+static uint16_t  AUDIO_SpeakerGetDMAPosition( AUDIO_Speaker_NodeTypeDef* speaker)
+{
+  uint32_t total = 2U * speaker->specific.half_samples;
+  uint32_t remaining = __HAL_DMA_GET_COUNTER(speaker->specific.hsai->hdmatx);
+
+  return (uint16_t)((total - remaining) % total);
+}
+
+#ifdef USE_AUDIO_CLIP_UPLOAD
+/**
+  * @brief  AUDIO_SpeakerLocalRelease
+  *         stops the SAI played without host stream
+  * @param  speaker: speaker node handle
+  * @retval None
+  */
+static void  AUDIO_SpeakerLocalRelease( AUDIO_Speaker_NodeTypeDef* speaker)
+{
+  if(speaker->specific.local)
+  {
+    /* flag first, so a pending DMA callback plays silence only */
+    speaker->specific.local = 0;
+    HAL_SAI_DMAStop(speaker->specific.hsai);
+    HAL_SAI_DeInit(speaker->specific.hsai);
+  }
+}
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+
+ /**
+  * @brief  AUDIO_SpeakerMute
+  *         set Mute value to speaker
+  * @param  channel_number: channel number, 0 for master
+  * @param  mute: mute value (0 : mute , 1 unmute)
+  * @param  node_handle: speaker node handle must be Started
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_SpeakerMute( uint16_t channel_number,  uint8_t mute , uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(channel_number == 0)
+  {
+    AUDIO_DescriptionWriteBegin(speaker->node.audio_description);
+    speaker->node.audio_description->audio_mute = mute;
+    AUDIO_DescriptionWriteEnd(speaker->node.audio_description);
+  }
+  else if(mute)
+  {
+    speaker->specific.channel_mute |= (uint8_t)(1U << (channel_number - 1U));
+  }
+  else
+  {
+    speaker->specific.channel_mute &= (uint8_t)~(1U << (channel_number - 1U));
+  }
+
+  return 0;
+}
+
+ /**
+  * @brief  AUDIO_SpeakerSetVolume
+  *         set Volume value to speaker, the volume is applied by the codec
+  * @param  channel_number: channel number, 0 for master
+  * @param  volume_db_256:  volume value in db
+  * @param  node_handle:    speaker node handle must be Started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerSetVolume( uint16_t channel_number,  int volume_db_256 ,  uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(channel_number == 0)
+  {
+    AUDIO_DescriptionWriteBegin(speaker->node.audio_description);
+    speaker->node.audio_description->audio_volume_db_256 = volume_db_256;
+    AUDIO_DescriptionWriteEnd(speaker->node.audio_description);
+  }
+
+  return 0;
+}
+
+ /**
+  * @brief  AUDIO_SpeakerStartReadCount
+  *         Start a count of samples played by the DAC
+  * @param  node_handle: speaker node handle must be started
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_SpeakerStartReadCount( uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(speaker->node.state != AUDIO_NODE_STARTED)
+  {
+    return -1;
+  }
+  speaker->specific.dma_pos = AUDIO_SpeakerGetDMAPosition(speaker);
+  return 0;
+}
+
+ /**
+  * @brief  AUDIO_SpeakerGetLastReadCount
+  *         read the count of samples played since last call, must be called
+  *         more often than the DMA buffer duration
+  * @param  node_handle: speaker node handle must be started
+  * @retval  :  number of played samples , 0 if  an error
+  */
+static uint16_t  AUDIO_SpeakerGetLastReadCount( uint32_t node_handle)
+{
+  AUDIO_Speaker_NodeTypeDef* speaker;
+  uint32_t total;
+  uint16_t position;
+  uint16_t read_samples;
+
+  speaker = (AUDIO_Speaker_NodeTypeDef*)node_handle;
+  if(speaker->node.state != AUDIO_NODE_STARTED)
+  {
+    return 0;
+  }
+  total = 2U * speaker->specific.half_samples;
+  position = AUDIO_SpeakerGetDMAPosition(speaker);
+  read_samples = (uint16_t)((position + total - speaker->specific.dma_pos) % total);
+  speaker->specific.dma_pos = position;
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  /* the SAI plays the stream faster, the count is scaled back to the stream rate */
+  total = read_samples * speaker->node.audio_description->frequence + speaker->specific.count_residue;
+  read_samples = (uint16_t)(total / AUDIO_SPEAKER_FIXED_RATE);
+  speaker->specific.count_residue = total - (read_samples * AUDIO_SPEAKER_FIXED_RATE);
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+
+  return read_samples;
+}
+
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+ /**
+  * @brief  AUDIO_SpeakerPower
+  *         powers the amplifier down during a long silence, the SAI goes on
+  *         with zeros so the clocks stay locked
+  * @param  on: 1 to power the amplifier, 0 to shut it down
+  * @param  node_handle: speaker node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SpeakerPower( uint8_t on, uint32_t node_handle)
+{
+  AUDIO_USER_SpeakerAmpPower(on);
+  return 0;
+}
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
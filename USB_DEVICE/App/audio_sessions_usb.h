@@ -65,6 +65,59 @@ typedef enum
   USBD_AUDIO_VOLUME
 }AUDIO_ControlCommandTypedef;
 #endif /* USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+/* session state reported over the CDC command channel or the vendor requests */
+typedef struct
+{
+  AUDIO_DescriptionTypeDef audio_description; /* current stream format & master controls */
+  uint8_t                  state;             /* AUDIO_SessionStateTypeDef */
+  uint32_t                 buffer_size;       /* ring size in bytes */
+  uint32_t                 buffer_filled;     /* ring filled size in bytes */
+  uint32_t                 feedback;          /* play : feedback sent to host, record : resampler step, 0 when not used */
+  uint32_t                 underrun_count;
+  uint32_t                 overrun_count;
+  uint32_t                 iso_in_incomplete_count; /* record : data EP , play : feedback EP , transfers which missed their frame */
+  uint32_t                 iso_out_incomplete_count; /* play : data EP packets missed and concealed , record : 0 */
+  AUDIO_BufferTelemetryTypeDef fill;         /* ring fill levels seen by the USB node, and glitches */
+#ifdef USE_AUDIO_PACKET_QUEUE
+  AUDIO_PacketDelayTypeDef delay;             /* play : USB reception to speaker output (presentation delay) ,
+                                                 record : mic input to USB send */
+#endif /* USE_AUDIO_PACKET_QUEUE */
+}
+AUDIO_USB_SessionStatsTypeDef;
+
+/* session parameters set over the CDC command channel or the vendor requests */
+typedef enum
+{
+  AUDIO_USB_PARAM_MUTE,      /* value 0 or 1 */
+  AUDIO_USB_PARAM_VOLUME,    /* value in db 8.8 format */
+  AUDIO_USB_PARAM_LATENCY,   /* playback only , value AUDIO_USB_LatencyProfileTypedef */
+  AUDIO_USB_PARAM_CHAIN      /* playback only , value AUDIO_USB_CHAIN_xxx mask , USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+}AUDIO_USB_SessionParamTypedef;
+/* stages of the playback chain, run in this order */
+#define AUDIO_USB_CHAIN_ROUTER            0x01U
+#define AUDIO_USB_CHAIN_EQ                0x02U
+#define AUDIO_USB_CHAIN_LIMITER           0x04U
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
+/* playback latency profiles , ring fill kept before the speaker */
+typedef enum
+{
+  AUDIO_USB_LATENCY_LOW,     /* 2 ms , live monitoring */
+  AUDIO_USB_LATENCY_MEDIUM,  /* 8 ms , default */
+  AUDIO_USB_LATENCY_HIGH,    /* 20 ms , hosts with a lot of jitter */
+  AUDIO_USB_LATENCY_COUNT
+}AUDIO_USB_LatencyProfileTypedef;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+/* SET_INTERFACE only records the alternate, the session starts from the pump so the
+   status stage doesn't wait for the devices. The pump can't allocate the node buffers :
+   the USB memory pool is only used from the USB interrupt */
+#ifdef USE_AUDIO_USB_ALTERNATE_ALLOC
+#error "USE_AUDIO_DEFERRED_ALTERNATE can't allocate the node buffers with the alternate, remove USE_AUDIO_USB_ALTERNATE_ALLOC"
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
+#define AUDIO_USB_START_IDLE              0x00U
+#define AUDIO_USB_START_PENDING           0x01U /* alternate selected, the start is posted to the pump */
+#define AUDIO_USB_START_RUNNING           0x02U /* the pump starts or stops the session, the alternate may change meanwhile */
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
 typedef struct    AUDIO_USB_StreamingSession
 {
   AUDIO_SessionTypeDef session; /* the session structure */
@@ -72,8 +125,19 @@ typedef struct    AUDIO_USB_StreamingSession
 #ifdef USE_AUDIO_USB_INTERRUPT
   int8_t               (*ExternalControl)(AUDIO_ControlCommandTypedef /*control*/ , uint32_t /*val*/, uint32_t/*  session_handle*/);
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+  int8_t               (*GetStats)     (AUDIO_USB_SessionStatsTypeDef* /*stats*/, uint32_t /*session_handle*/);
+  int8_t               (*SetParameter) (AUDIO_USB_SessionParamTypedef /*param*/, uint16_t /*channel*/,
+                                        int32_t /*value*/, uint32_t /*session_handle*/);
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  int8_t               (*SessionSuspend)(uint8_t /*suspend*/, uint32_t /*session_handle*/); /* NULL when the session restarts from its threshold */
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
   uint8_t              interface_num; /* interface number for streaming interface */
   uint8_t              alternate; /* alternate number for streaming interface */
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  volatile uint8_t     start_state; /* AUDIO_USB_START_xxx, the pump brings the session to the alternate */
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
   AUDIO_BufferTypeDef  buffer; /* Audio data buffer */
 }
 AUDIO_USB_SessionTypedef;
@@ -82,6 +146,25 @@ AUDIO_USB_SessionTypedef;
  int8_t  AUDIO_Playback_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
                                     USBD_AUDIO_ControlTypeDef* controls_desc,
                                     uint8_t* control_count, uint32_t session_handle);
+ int8_t  AUDIO_Playback_SetLatency(AUDIO_USB_LatencyProfileTypedef profile, uint32_t session_handle);
+ AUDIO_USB_LatencyProfileTypedef  AUDIO_Playback_GetLatency(void);
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+/* rate families of the clock drift learnt by the feedback : multiples of 11.025 KHz, others */
+#define AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT 2U
+ int16_t AUDIO_Playback_GetDriftPpm(uint8_t family);
+ void    AUDIO_Playback_SetDriftPpm(uint8_t family, int16_t ppm);
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#if (defined USE_AUDIO_BENCH) && (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) && !(defined USE_AUDIO_CLOCK_SOF_OUTPUT)
+ uint32_t AUDIO_Playback_FeedbackBench(uint32_t freq, uint8_t channels, uint8_t res);
+#endif /* USE_AUDIO_BENCH && USE_AUDIO_PLAYBACK_USB_FEEDBACK && !USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+ int8_t  AUDIO_Mix_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
+                               USBD_AUDIO_ControlTypeDef* controls_desc,
+                               uint8_t* control_count, uint32_t session_handle);
+#ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
+ int8_t  AUDIO_Mix_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle);
+#endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
 #ifdef USE_USB_AUDIO_RECORDING
  int8_t  AUDIO_Recording_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
@@ -89,12 +172,28 @@ AUDIO_USB_SessionTypedef;
                                      uint8_t* control_count, uint32_t session_handle);
 #ifdef  USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
  int8_t  AUDIO_Recording_get_Sample_to_add(struct AUDIO_Session* session_handle);
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+ uint32_t  AUDIO_Recording_get_Resampler_Step(struct AUDIO_Session* session_handle);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_RECORD_MULTI_FREQUENCES
  int8_t  AUDIO_Recording_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle);
 #endif /*USE_AUDIO_USB_RECORD_MULTI_FREQUENCES*/
 #endif /* USE_USB_AUDIO_CLASS_20 */
+#ifdef USE_AUDIO_RECORDING_USERS
+/* readers of the mic */
+#define AUDIO_RECORDING_USER_HOST               0x01U /* record streaming interface */
+#define AUDIO_RECORDING_USER_VOICE              0x02U /* voice streaming interface */
+#define AUDIO_RECORDING_USER_BULK               0x04U /* vendor bulk capture interface */
+ int8_t  AUDIO_Recording_SetUser(uint8_t user, uint8_t active, uint32_t session_handle);
+#endif /* USE_AUDIO_RECORDING_USERS */
+#ifdef USE_AUDIO_RECORDING_VOICE
+ int8_t  AUDIO_Voice_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
+                                 USBD_AUDIO_ControlTypeDef* controls_desc,
+                                 uint8_t* control_count, uint32_t session_handle);
+ void    AUDIO_VoiceWriteRegion(const AUDIO_BufferRegionTypeDef* region, const AUDIO_DescriptionTypeDef* desc);
+#endif /* USE_AUDIO_RECORDING_VOICE */
 #endif /* USE_USB_AUDIO_RECORDING*/
 #ifdef __cplusplus
 }
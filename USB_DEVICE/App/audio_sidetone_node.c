@@ -0,0 +1,370 @@
+/**
+  ******************************************************************************
+  * @file    audio_sidetone_node.c
+  * @brief   Sidetone mixer : the newest frames of the record ring are added
+  *          at a small gain to each speaker DMA half, once it has the SAI slot
+  *          layout, so the user hears the microphone with two halves of
+  *          latency. The record ring is only read, its consumer is still the
+  *          USB IN endpoint. When both sessions run from one clock
+  *          (USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC) the read position
+  *          keeps pace with the microphone; any drift or ring reset moves it
+  *          back to the newest frames, which is counted as a slip.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_sidetone_node.h"
+#include "audio_pcm.h"
+#include "audio_gain.h"
+
+#ifdef USE_AUDIO_SIDETONE
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+#error "USE_AUDIO_SIDETONE mixes in the SAI speaker halves, it needs the SAI speaker node"
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_SIDETONE_MUL(x, gain)     ((int32_t)(((int64_t)(x) * (gain)) >> 15))
+
+/* Private variables ---------------------------------------------------------*/
+/* written from the pump, read by the speaker DMA interrupt */
+static AUDIO_Sidetone_NodeTypeDef *current_sidetone = 0;
+/* record ring, 0 while the record session is stopped */
+static AUDIO_BufferTypeDef *sidetone_source = 0;
+static AUDIO_DescriptionTypeDef *sidetone_source_description = 0;
+/* one chunk of microphone frames in Q31 */
+static int32_t sidetone_scratch[AUDIO_SIDETONE_CHUNK_FRAMES * AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_SidetoneDeInit(uint32_t node_handle);
+static int8_t  AUDIO_SidetoneStart(uint32_t node_handle);
+static int8_t  AUDIO_SidetoneStop(uint32_t node_handle);
+static void    AUDIO_SidetoneLoad(AUDIO_BufferRegionTypeDef* region, uint8_t res, uint32_t samples) USBD_ITCM_FUNC;
+static uint8_t* AUDIO_SidetoneAdd(AUDIO_Sidetone_NodeTypeDef* sidetone, uint8_t* half, uint32_t frames) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SidetoneInit
+  *         Initializes the sidetone mixer of the playback session at
+  *         AUDIO_SIDETONE_DEFAULT_GAIN_DB_256
+  * @param  audio_description: playback audio parameters
+  * @param  session_handle:   playback session handle
+  * @param  node_handle:      sidetone node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_SidetoneInit(AUDIO_DescriptionTypeDef* audio_description,
+                           AUDIO_SessionTypeDef* session_handle,
+                           uint32_t node_handle)
+{
+  AUDIO_Sidetone_NodeTypeDef* sidetone = (AUDIO_Sidetone_NodeTypeDef*)node_handle;
+
+  if((audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT) ||
+     (audio_description->audio_res < 2U) || (audio_description->audio_res > 4U))
+  {
+    return -1;
+  }
+  memset(sidetone, 0, sizeof(AUDIO_Sidetone_NodeTypeDef));
+  sidetone->node.state = AUDIO_NODE_INITIALIZED;
+  sidetone->node.type = AUDIO_PROCESSING;
+  sidetone->node.session_handle = session_handle;
+  sidetone->node.audio_description = audio_description;
+
+  sidetone->SidetoneDeInit = AUDIO_SidetoneDeInit;
+  sidetone->SidetoneStart = AUDIO_SidetoneStart;
+  sidetone->SidetoneStop = AUDIO_SidetoneStop;
+  current_sidetone = sidetone;
+  AUDIO_SidetoneSetGain(AUDIO_SIDETONE_DEFAULT_GAIN_DB_256);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneSetSource
+  *         sets the record ring mixed in the speaker output, called by the
+  *         record session from the pump, before or after the playback one
+  *         is initialized
+  * @param  buffer: record ring, 0 when recording stops
+  * @param  audio_description: record audio parameters
+  * @retval None
+  */
+void  AUDIO_SidetoneSetSource(AUDIO_BufferTypeDef* buffer, AUDIO_DescriptionTypeDef* audio_description)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  sidetone_source = buffer;
+  sidetone_source_description = audio_description;
+  /* the first half syncs on the newest frames */
+  if(current_sidetone != 0)
+  {
+    current_sidetone->synced = 0;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_SidetoneSetGain
+  *         sets the sidetone gain, must be called from the pump
+  * @param  gain_db_256: gain in dB 8.8 , AUDIO_SIDETONE_OFF_GAIN_DB_256 or
+  *         below turns the sidetone off
+  * @retval 0 if no error, -1 above AUDIO_SIDETONE_MAX_GAIN_DB_256 or when not initialized
+  */
+int8_t  AUDIO_SidetoneSetGain(int gain_db_256)
+{
+  AUDIO_Sidetone_NodeTypeDef* sidetone = current_sidetone;
+
+  if((sidetone == 0) || (gain_db_256 > AUDIO_SIDETONE_MAX_GAIN_DB_256))
+  {
+    return -1;
+  }
+  if(gain_db_256 <= AUDIO_SIDETONE_OFF_GAIN_DB_256)
+  {
+    gain_db_256 = AUDIO_SIDETONE_OFF_GAIN_DB_256;
+    sidetone->gain = 0;
+  }
+  else
+  {
+    /* only conversion from dB, done on change */
+    sidetone->gain = AUDIO_GainFromDb256(gain_db_256) >> (AUDIO_GAIN_FRAC_BITS - 15U);
+  }
+  sidetone->gain_db_256 = gain_db_256;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneGetStatus
+  *         returns the gain and the count of read position moves
+  * @param  gain_db_256: returned gain in dB 8.8
+  * @param  slips: returned slips count since start
+  * @retval 0 if no error, -1 when not initialized
+  */
+int8_t  AUDIO_SidetoneGetStatus(int* gain_db_256, uint32_t* slips)
+{
+  if(current_sidetone == 0)
+  {
+    return -1;
+  }
+  *gain_db_256 = current_sidetone->gain_db_256;
+  *slips = current_sidetone->slips;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneMix
+  *         adds the newest microphone frames to a speaker DMA half. Called
+  *         by the SAI speaker node once the half has the slot layout :
+  *         int16 for 16 bits, right aligned 24 bits or int32 in 32 bits slots.
+  *         The microphone channels are repeated over the speaker ones
+  * @param  half: speaker DMA half
+  * @param  frames: frames count of the half
+  * @retval None
+  */
+void  AUDIO_SidetoneMix(uint8_t* half, uint32_t frames)
+{
+  AUDIO_Sidetone_NodeTypeDef* sidetone = current_sidetone;
+  AUDIO_BufferTypeDef* source;
+  AUDIO_BufferRegionTypeDef region;
+  uint32_t frame_length;
+  uint32_t length;
+  uint32_t count;
+
+  if((sidetone == 0) || (sidetone->node.state != AUDIO_NODE_STARTED) ||
+     ((source = sidetone_source) == 0) || (sidetone->gain == 0) ||
+     (sidetone_source_description->frequence != sidetone->node.audio_description->frequence))
+  {
+    return;
+  }
+  frame_length = AUDIO_SAMPLE_LENGTH(sidetone_source_description);
+  length = frames * frame_length;
+  if(3U * length > source->size - source->margin)
+  {
+    return;
+  }
+  /* between one and three halves behind the microphone, else back to two */
+  if((sidetone->synced == 0U) || ((source->wr_ptr - sidetone->rd_ptr) - length > 2U * length))
+  {
+    sidetone->slips += sidetone->synced;
+    sidetone->rd_ptr = source->wr_ptr - 2U * length;
+    sidetone->synced = 1;
+  }
+  while(frames != 0U)
+  {
+    count = (frames > AUDIO_SIDETONE_CHUNK_FRAMES) ? AUDIO_SIDETONE_CHUNK_FRAMES : frames;
+    AUDIO_BufferGetRegion(source, sidetone->rd_ptr, count * frame_length, &region);
+    AUDIO_SidetoneLoad(&region, sidetone_source_description->audio_res,
+                       count * sidetone_source_description->channels_count);
+    half = AUDIO_SidetoneAdd(sidetone, half, count);
+    sidetone->rd_ptr += count * frame_length;
+    frames -= count;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SidetoneDeInit
+  *         De-Initializes the sidetone node
+  * @param  node_handle: sidetone node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SidetoneDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Sidetone_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneStart
+  *         Starts mixing, the first half syncs on the newest frames
+  * @param  node_handle: sidetone node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SidetoneStart(uint32_t node_handle)
+{
+  AUDIO_Sidetone_NodeTypeDef* sidetone = (AUDIO_Sidetone_NodeTypeDef*)node_handle;
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  sidetone->synced = 0;
+  sidetone->slips = 0;
+  sidetone->node.state = AUDIO_NODE_STARTED;
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneStop
+  *         Stops mixing, the speaker output is left untouched
+  * @param  node_handle: sidetone node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_SidetoneStop(uint32_t node_handle)
+{
+  ((AUDIO_Sidetone_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SidetoneLoad
+  *         converts microphone samples of the record ring to Q31 in the scratch
+  * @param  region: ring samples
+  * @param  res: microphone sample size in bytes
+  * @param  samples: samples count
+  * @retval None
+  */
+static void  AUDIO_SidetoneLoad(AUDIO_BufferRegionTypeDef* region, uint8_t res, uint32_t samples)
+{
+  uint32_t i;
+
+  if(res == AUDIO_PCM_PACKED_24_BYTES)
+  {
+    AUDIO_PcmUnpack24Region(region, (uint32_t*)sidetone_scratch);
+    for(i = 0; i < samples; i++)
+    {
+      sidetone_scratch[i] = (int32_t)((uint32_t)sidetone_scratch[i] << 8);
+    }
+    return;
+  }
+  memcpy(sidetone_scratch, region->data[0], region->length[0]);
+  memcpy((uint8_t*)sidetone_scratch + region->length[0], region->data[1], region->length[1]);
+  if(res == 2U)
+  {
+    /* widened from the end, each sample lands past the unread ones */
+    for(i = samples; i != 0U; i--)
+    {
+      sidetone_scratch[i - 1U] = (int32_t)((int16_t*)sidetone_scratch)[i - 1U] << 16;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SidetoneAdd
+  *         adds the scratch frames at the gain to the speaker slots, saturated
+  * @param  sidetone: sidetone node
+  * @param  half: speaker slots of the first frame
+  * @param  frames: frames count
+  * @retval speaker slots of the next frame
+  */
+static uint8_t*  AUDIO_SidetoneAdd(AUDIO_Sidetone_NodeTypeDef* sidetone, uint8_t* half, uint32_t frames)
+{
+  uint8_t channels = sidetone->node.audio_description->channels_count;
+  uint8_t mic_channels = sidetone_source_description->channels_count;
+  int32_t gain = sidetone->gain;
+  int32_t* mic = sidetone_scratch;
+  uint8_t mic_channel;
+  uint32_t i;
+  uint8_t ch;
+  int32_t x;
+
+  switch(sidetone->node.audio_description->audio_res)
+  {
+    case 2:
+    {
+      int16_t* dst = (int16_t*)half;
+
+      for(i = 0; i < frames; i++)
+      {
+        mic_channel = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = AUDIO_SIDETONE_MUL(mic[mic_channel], gain) >> 16;
+          dst[ch] = (int16_t)__SSAT((int32_t)dst[ch] + x, 16);
+          mic_channel = (mic_channel + 1U == mic_channels) ? 0U : mic_channel + 1U;
+        }
+        mic += mic_channels;
+        dst += channels;
+      }
+      return (uint8_t*)dst;
+    }
+    case 3:
+    {
+      uint32_t* dst = (uint32_t*)half;
+
+      for(i = 0; i < frames; i++)
+      {
+        mic_channel = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          x = AUDIO_SIDETONE_MUL(mic[mic_channel], gain) >> 8;
+          /* right aligned slot, sign extended before the add */
+          x = __SSAT(((int32_t)(dst[ch] << 8) >> 8) + x, 24);
+          dst[ch] = (uint32_t)x & AUDIO_PCM_24_MASK;
+          mic_channel = (mic_channel + 1U == mic_channels) ? 0U : mic_channel + 1U;
+        }
+        mic += mic_channels;
+        dst += channels;
+      }
+      return (uint8_t*)dst;
+    }
+    case 4:
+    {
+      int32_t* dst = (int32_t*)half;
+
+      for(i = 0; i < frames; i++)
+      {
+        mic_channel = 0;
+        for(ch = 0; ch < channels; ch++)
+        {
+          dst[ch] = __QADD(dst[ch], AUDIO_SIDETONE_MUL(mic[mic_channel], gain));
+          mic_channel = (mic_channel + 1U == mic_channels) ? 0U : mic_channel + 1U;
+        }
+        mic += mic_channels;
+        dst += channels;
+      }
+      return (uint8_t*)dst;
+    }
+    default:
+      return half;
+  }
+}
+#endif /* USE_AUDIO_SIDETONE */
@@ -0,0 +1,66 @@
+/**
+  ******************************************************************************
+  * @file    audio_sidetone_node.h
+  * @brief   header file for the audio_sidetone_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SIDETONE_NODE_H
+#define __AUDIO_SIDETONE_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+
+#ifdef USE_AUDIO_SIDETONE
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_SIDETONE_DEFAULT_GAIN_DB_256  (-3072)  /* -12 dB */
+#define AUDIO_SIDETONE_MAX_GAIN_DB_256      0
+#define AUDIO_SIDETONE_OFF_GAIN_DB_256      (-24576) /* -96 dB and below turn the sidetone off */
+/* mic frames converted at once */
+#define AUDIO_SIDETONE_CHUNK_FRAMES         32U
+
+/* Exported types ------------------------------------------------------------*/
+/* sidetone mixer : the newest record ring frames are added to the speaker output */
+typedef struct
+{
+  AUDIO_NodeTypeDef        node;               /* node structure , must be first field */
+  uint32_t                 rd_ptr;             /* free running position in the record ring */
+  int32_t                  gain;               /* Q15 , 0 when off */
+  int                      gain_db_256;
+  uint32_t                 slips;              /* read position moved back to the newest frames */
+  uint8_t                  synced;             /* 0 until the first half sets rd_ptr */
+  int8_t                  (*SidetoneDeInit) (uint32_t /*node_handle*/);
+  int8_t                  (*SidetoneStart)  (uint32_t /*node_handle*/);
+  int8_t                  (*SidetoneStop)   (uint32_t /*node_handle*/);
+}
+AUDIO_Sidetone_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_SidetoneInit(AUDIO_DescriptionTypeDef* audio_description,
+                           AUDIO_SessionTypeDef* session_handle,
+                           uint32_t node_handle);
+void    AUDIO_SidetoneSetSource(AUDIO_BufferTypeDef* buffer, AUDIO_DescriptionTypeDef* audio_description);
+int8_t  AUDIO_SidetoneSetGain(int gain_db_256);
+int8_t  AUDIO_SidetoneGetStatus(int* gain_db_256, uint32_t* slips);
+void    AUDIO_SidetoneMix(uint8_t* half, uint32_t frames) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_SIDETONE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SIDETONE_NODE_H */
@@ -0,0 +1,533 @@
+/**
+  ******************************************************************************
+  * @file    audio_snapshot.c
+  * @brief   Glitch triggered PCM capture : while armed the selected pipeline
+  *          points are copied to one overwriting ring each, so the rings
+  *          always hold the last bytes of each point. A session underrun,
+  *          overrun or ISO incomplete, a level meter crossing or a CDC
+  *          command triggers it, the capture goes on for the post trigger
+  *          window then freezes. The host reads the frozen capture over CDC
+  *          in frames. Memory is fixed, the cost is one copy per packet and
+  *          a session counters read each ms, only while armed.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_snapshot.h"
+
+#ifdef USE_AUDIO_SNAPSHOT
+#include "usbd_conf.h"
+#include "usbd_audio_if.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#include "usbd_cdc_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+
+#ifndef USE_AUDIO_CDC_COMMAND
+#error "USE_AUDIO_SNAPSHOT is driven by the CDC command channel, USE_AUDIO_CDC_COMMAND is required"
+#endif /* USE_AUDIO_CDC_COMMAND */
+#if (AUDIO_SNAPSHOT_RING_SIZE & (AUDIO_SNAPSHOT_RING_SIZE - 1U)) != 0U
+#error "AUDIO_SNAPSHOT_RING_SIZE must be a power of two"
+#endif /* AUDIO_SNAPSHOT_RING_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_SNAPSHOT_SESSION_COUNT      2U /* playback then record */
+
+/* Private typedef -----------------------------------------------------------*/
+/* one producer (the interrupt owning the point), read by the pump once frozen */
+typedef struct
+{
+  uint8_t           data[AUDIO_SNAPSHOT_RING_SIZE];
+  volatile uint32_t ptr_in;       /* free running since arming, older bytes are overwritten */
+  uint32_t          trigger_ptr;  /* ptr_in when the trigger was taken */
+}
+AUDIO_SnapshotRingTypeDef;
+
+/* session counters the triggers watch */
+typedef struct
+{
+  uint32_t underrun;
+  uint32_t overrun;
+  uint32_t incomplete;
+}
+AUDIO_SnapshotGlitchesTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_SnapshotRingTypeDef snap_rings[AUDIO_TAP_POINT_COUNT] USBD_DEBUG_BSS;
+static uint8_t snap_frame[AUDIO_SNAPSHOT_HEADER_SIZE + AUDIO_SNAPSHOT_BLOCK_SIZE] USBD_DEBUG_BSS;
+static volatile uint32_t snap_capturing = 0;       /* points written to the rings */
+static volatile uint8_t  snap_state = AUDIO_SNAPSHOT_IDLE;
+/* written by the pump only */
+static uint8_t  snap_points;
+static uint8_t  snap_triggers;
+static uint8_t  snap_cause;
+static uint16_t snap_post_ms;
+static uint32_t snap_arm_tick;
+static volatile uint32_t snap_trigger_tick;
+static AUDIO_SnapshotGlitchesTypeDef snap_base[AUDIO_SNAPSHOT_SESSION_COUNT];
+static uint8_t  snap_read_point;
+static uint32_t snap_read_offset;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_SnapshotHandler(void);
+static void     AUDIO_SnapshotWatch(void);
+static void     AUDIO_SnapshotGetGlitches(uint8_t session, AUDIO_SnapshotGlitchesTypeDef* glitches);
+static void     AUDIO_SnapshotFreeze(void);
+static uint32_t AUDIO_SnapshotStart(uint8_t point);
+static void     AUDIO_SnapshotDrain(void);
+static uint8_t  AUDIO_SnapshotSendBlock(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SnapshotInit
+  *         registers the snapshot handler in the pump, nothing is captured
+  *         until AUDIO_SnapshotArm. Must be called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SnapshotInit(void)
+{
+  snap_capturing = 0;
+  snap_state = AUDIO_SNAPSHOT_IDLE;
+  snap_points = 0;
+  snap_triggers = 0;
+  snap_cause = 0;
+  snap_post_ms = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SNAPSHOT, AUDIO_SnapshotHandler);
+}
+
+/**
+  * @brief  AUDIO_SnapshotArm
+  *         drops the previous capture and starts capturing the points until a
+  *         trigger. Must be called from the pump
+  * @param  points: mask of AUDIO_TAP_POINT_MASK(point)
+  * @param  triggers: AUDIO_SNAPSHOT_TRIGGER_xxx mask
+  * @param  post_ms: capture kept after the trigger
+  * @retval 0 if no error, -1 if an argument is out of range
+  */
+int8_t AUDIO_SnapshotArm(uint8_t points, uint8_t triggers, uint16_t post_ms)
+{
+  uint8_t i;
+
+  if((points == 0U) || ((points & ~((1U << AUDIO_TAP_POINT_COUNT) - 1U)) != 0U) ||
+     ((triggers & ~AUDIO_SNAPSHOT_TRIGGER_ALL) != 0U) || (post_ms > AUDIO_SNAPSHOT_MAX_POST_MS))
+  {
+    return -1;
+  }
+#ifndef USE_AUDIO_LEVEL_METER
+  if((triggers & AUDIO_SNAPSHOT_TRIGGER_LEVEL) != 0U)
+  {
+    return -1;
+  }
+#endif /* USE_AUDIO_LEVEL_METER */
+  /* the writers preempt the pump : none is running once they see no point */
+  snap_capturing = 0;
+  __DMB();
+  for(i = 0; i < AUDIO_TAP_POINT_COUNT; i++)
+  {
+    snap_rings[i].ptr_in = 0;
+    snap_rings[i].trigger_ptr = 0;
+  }
+  for(i = 0; i < AUDIO_SNAPSHOT_SESSION_COUNT; i++)
+  {
+    AUDIO_SnapshotGetGlitches(i, &snap_base[i]);
+  }
+  snap_points = points;
+  snap_triggers = triggers;
+  snap_post_ms = post_ms;
+  snap_cause = 0;
+  snap_arm_tick = HAL_GetTick();
+  snap_state = AUDIO_SNAPSHOT_ARMED;
+  __DMB();
+  snap_capturing = points;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SnapshotTrigger
+  *         takes a trigger when armed and the trigger is selected. Must be
+  *         called from the pump
+  * @param  cause: AUDIO_SNAPSHOT_TRIGGER_xxx
+  * @retval None
+  */
+void AUDIO_SnapshotTrigger(uint8_t cause)
+{
+  uint8_t i;
+
+  if((snap_state != AUDIO_SNAPSHOT_ARMED) ||
+     (((snap_triggers & cause) == 0U) && (cause != AUDIO_SNAPSHOT_TRIGGER_COMMAND)))
+  {
+    return;
+  }
+  for(i = 0; i < AUDIO_TAP_POINT_COUNT; i++)
+  {
+    snap_rings[i].trigger_ptr = snap_rings[i].ptr_in;
+  }
+  snap_cause = cause;
+  snap_trigger_tick = HAL_GetTick();
+  __DMB();
+  snap_state = AUDIO_SNAPSHOT_TRIGGERED;
+  if(snap_post_ms == 0U)
+  {
+    AUDIO_SnapshotFreeze();
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotRead
+  *         sends the frozen capture over CDC, point after point from its
+  *         oldest byte. Must be called from the pump
+  * @param  None
+  * @retval 0 if sending starts, -1 if nothing is frozen
+  */
+int8_t AUDIO_SnapshotRead(void)
+{
+  if((snap_state != AUDIO_SNAPSHOT_FROZEN) && (snap_state != AUDIO_SNAPSHOT_READING))
+  {
+    return -1;
+  }
+  snap_read_point = 0;
+  snap_read_offset = 0;
+  snap_state = AUDIO_SNAPSHOT_READING;
+  AUDIO_PumpPost(AUDIO_PUMP_SNAPSHOT);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SnapshotStop
+  *         stops capturing and drops the capture. Must be called from the pump
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SnapshotStop(void)
+{
+  snap_capturing = 0;
+  snap_state = AUDIO_SNAPSHOT_IDLE;
+}
+
+/**
+  * @brief  AUDIO_SnapshotGetStatus
+  *         reports the state and the bytes each point holds. Must be called
+  *         from the pump
+  * @param  status: status copy
+  * @retval None
+  */
+void AUDIO_SnapshotGetStatus(AUDIO_SnapshotStatusTypeDef* status)
+{
+  uint32_t start;
+  uint8_t  i;
+
+  memset(status, 0, sizeof(AUDIO_SnapshotStatusTypeDef));
+  status->state = snap_state;
+  if(snap_state == AUDIO_SNAPSHOT_IDLE)
+  {
+    return;
+  }
+  status->points = snap_points;
+  status->triggers = snap_triggers;
+  status->cause = snap_cause;
+  status->post_ms = snap_post_ms;
+  status->trigger_ms = (snap_cause != 0U) ? (snap_trigger_tick - snap_arm_tick) : 0U;
+  for(i = 0; i < AUDIO_TAP_POINT_COUNT; i++)
+  {
+    if((snap_points & AUDIO_TAP_POINT_MASK(i)) == 0U)
+    {
+      continue;
+    }
+    start = AUDIO_SnapshotStart(i);
+    status->length[i] = snap_rings[i].ptr_in - start;
+    if(snap_cause == 0U)
+    {
+      status->pre[i] = status->length[i];
+    }
+    else if(snap_rings[i].trigger_ptr > start)
+    {
+      status->pre[i] = snap_rings[i].trigger_ptr - start;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotTick
+  *         posts the trigger watch while capturing, called each SysTick ms
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SnapshotTick(void)
+{
+  if((snap_state == AUDIO_SNAPSHOT_ARMED) || (snap_state == AUDIO_SNAPSHOT_TRIGGERED))
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_SNAPSHOT);
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotWrite
+  *         copies data of one point while it is captured, over the oldest
+  *         bytes. Freezes the capture once the post trigger window elapsed.
+  *         Each point must be written from a single context
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @param  data: data to capture
+  * @param  length: data length
+  * @retval None
+  */
+void AUDIO_SnapshotWrite(uint8_t point, const uint8_t* data, uint32_t length)
+{
+  AUDIO_SnapshotRingTypeDef* ring;
+  uint32_t ptr_in;
+  uint32_t offset;
+  uint32_t first;
+
+  if(((snap_capturing & AUDIO_TAP_POINT_MASK(point)) == 0U) || (length == 0U))
+  {
+    return;
+  }
+  ring = &snap_rings[point];
+  ptr_in = ring->ptr_in;
+  if(length > AUDIO_SNAPSHOT_RING_SIZE)
+  {
+    /* only its end is kept */
+    ptr_in += length - AUDIO_SNAPSHOT_RING_SIZE;
+    data += length - AUDIO_SNAPSHOT_RING_SIZE;
+    length = AUDIO_SNAPSHOT_RING_SIZE;
+  }
+  offset = ptr_in & (AUDIO_SNAPSHOT_RING_SIZE - 1U);
+  first = AUDIO_SNAPSHOT_RING_SIZE - offset;
+  if(first > length)
+  {
+    first = length;
+  }
+  memcpy(&ring->data[offset], data, first);
+  memcpy(&ring->data[0], data + first, length - first);
+  ring->ptr_in = ptr_in + length;
+  if((snap_state == AUDIO_SNAPSHOT_TRIGGERED) && ((HAL_GetTick() - snap_trigger_tick) >= snap_post_ms))
+  {
+    AUDIO_SnapshotFreeze();
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotWriteRegion
+  *         captures a buffer region, both parts in order
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @param  region: region of an audio buffer
+  * @retval None
+  */
+void AUDIO_SnapshotWriteRegion(uint8_t point, AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_SnapshotWrite(point, region->data[0], region->length[0]);
+  AUDIO_SnapshotWrite(point, region->data[1], region->length[1]);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SnapshotHandler
+  *         pump handler : watches the sessions while armed, freezes when the
+  *         points stopped before the end of the post trigger window, and
+  *         sends the capture when read
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SnapshotHandler(void)
+{
+  switch(snap_state)
+  {
+    case AUDIO_SNAPSHOT_ARMED:
+      AUDIO_SnapshotWatch();
+      break;
+    case AUDIO_SNAPSHOT_TRIGGERED:
+      if((HAL_GetTick() - snap_trigger_tick) >= snap_post_ms)
+      {
+        AUDIO_SnapshotFreeze();
+      }
+      break;
+    case AUDIO_SNAPSHOT_READING:
+      AUDIO_SnapshotDrain();
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotWatch
+  *         takes the trigger of the session counters which increased
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SnapshotWatch(void)
+{
+  AUDIO_SnapshotGlitchesTypeDef glitches;
+  AUDIO_SnapshotGlitchesTypeDef* base;
+  uint8_t cause = 0;
+  uint8_t i;
+
+  for(i = 0; i < AUDIO_SNAPSHOT_SESSION_COUNT; i++)
+  {
+    AUDIO_SnapshotGetGlitches(i, &glitches);
+    base = &snap_base[i];
+    if(glitches.underrun != base->underrun)
+    {
+      cause |= AUDIO_SNAPSHOT_TRIGGER_UNDERRUN;
+    }
+    if(glitches.overrun != base->overrun)
+    {
+      cause |= AUDIO_SNAPSHOT_TRIGGER_OVERRUN;
+    }
+    if(glitches.incomplete != base->incomplete)
+    {
+      cause |= AUDIO_SNAPSHOT_TRIGGER_INCOMPLETE;
+    }
+    *base = glitches;
+  }
+  cause &= snap_triggers;
+  if(cause != 0U)
+  {
+    AUDIO_SnapshotTrigger(cause);
+  }
+}
+
+/**
+  * @brief  AUDIO_SnapshotGetGlitches
+  *         reads the glitch counters of a session, zeros when it is not built
+  * @param  session: 0 for playback, 1 for record
+  * @param  glitches: counters
+  * @retval None
+  */
+static void AUDIO_SnapshotGetGlitches(uint8_t session, AUDIO_SnapshotGlitchesTypeDef* glitches)
+{
+  AUDIO_USB_SessionStatsTypeDef stats;
+  uint32_t lock;
+  int8_t   error;
+
+  /* the session counters are also written by audio work */
+  lock = AUDIO_PumpLockAudio();
+  error = USBD_AUDIO_GetSessionStats((session == 0U) ? USBD_AUDIO_PLAYBACK : USBD_AUDIO_RECORD, &stats);
+  AUDIO_PumpUnlockAudio(lock);
+  if(error != 0)
+  {
+    memset(glitches, 0, sizeof(AUDIO_SnapshotGlitchesTypeDef));
+    return;
+  }
+  glitches->underrun = stats.underrun_count;
+  glitches->overrun = stats.overrun_count;
+  glitches->incomplete = stats.iso_in_incomplete_count + stats.iso_out_incomplete_count;
+}
+
+/**
+  * @brief  AUDIO_SnapshotFreeze
+  *         stops capturing, from a writer or the pump
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SnapshotFreeze(void)
+{
+  snap_capturing = 0;
+  snap_state = AUDIO_SNAPSHOT_FROZEN;
+}
+
+/**
+  * @brief  AUDIO_SnapshotStart
+  *         free running position of the oldest byte a point ring holds
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @retval position
+  */
+static uint32_t AUDIO_SnapshotStart(uint8_t point)
+{
+  uint32_t ptr_in = snap_rings[point].ptr_in;
+
+  return (ptr_in > AUDIO_SNAPSHOT_RING_SIZE) ? (ptr_in - AUDIO_SNAPSHOT_RING_SIZE) : 0U;
+}
+
+/**
+  * @brief  AUDIO_SnapshotDrain
+  *         sends blocks of the read point until the CDC transmit ring is
+  *         full, retried on transfer complete. The capture stays frozen once
+  *         all points are sent
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SnapshotDrain(void)
+{
+  while(snap_read_point < AUDIO_TAP_POINT_COUNT)
+  {
+    if((snap_points & AUDIO_TAP_POINT_MASK(snap_read_point)) != 0U)
+    {
+      switch(AUDIO_SnapshotSendBlock())
+      {
+        case 1:
+          continue;
+        case 2:
+          return;
+        default:
+          break;
+      }
+    }
+    snap_read_point++;
+    snap_read_offset = 0;
+  }
+  snap_state = AUDIO_SNAPSHOT_FROZEN;
+}
+
+/**
+  * @brief  AUDIO_SnapshotSendBlock
+  *         sends up to AUDIO_SNAPSHOT_BLOCK_SIZE bytes of the read point in one frame
+  * @param  None
+  * @retval 0 if the point is sent, 1 if a block was sent, 2 if the CDC transmit ring is full
+  */
+static uint8_t AUDIO_SnapshotSendBlock(void)
+{
+  AUDIO_SnapshotRingTypeDef* ring = &snap_rings[snap_read_point];
+  uint32_t start = AUDIO_SnapshotStart(snap_read_point);
+  uint32_t length = (ring->ptr_in - start) - snap_read_offset;
+  uint32_t offset = (start + snap_read_offset) & (AUDIO_SNAPSHOT_RING_SIZE - 1U);
+  uint32_t first;
+
+  if(length == 0U)
+  {
+    return 0;
+  }
+  if(length > AUDIO_SNAPSHOT_BLOCK_SIZE)
+  {
+    length = AUDIO_SNAPSHOT_BLOCK_SIZE;
+  }
+  snap_frame[0] = AUDIO_SNAPSHOT_SYNC;
+  snap_frame[1] = snap_read_point;
+  snap_frame[2] = (uint8_t)length;
+  snap_frame[3] = (uint8_t)(length >> 8);
+  snap_frame[4] = (uint8_t)snap_read_offset;
+  snap_frame[5] = (uint8_t)(snap_read_offset >> 8);
+  snap_frame[6] = (uint8_t)(snap_read_offset >> 16);
+  snap_frame[7] = (uint8_t)(snap_read_offset >> 24);
+  first = AUDIO_SNAPSHOT_RING_SIZE - offset;
+  if(first > length)
+  {
+    first = length;
+  }
+  memcpy(&snap_frame[AUDIO_SNAPSHOT_HEADER_SIZE], &ring->data[offset], first);
+  memcpy(&snap_frame[AUDIO_SNAPSHOT_HEADER_SIZE + first], &ring->data[0], length - first);
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  if(CDC_TLM_Transmit(snap_frame, (uint16_t)(AUDIO_SNAPSHOT_HEADER_SIZE + length)) != USBD_OK)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+  if(CDC_Transmit_FS(snap_frame, (uint16_t)(AUDIO_SNAPSHOT_HEADER_SIZE + length)) != USBD_OK)
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+  {
+    return 2;
+  }
+  snap_read_offset += length;
+  return 1;
+}
+#endif /* USE_AUDIO_SNAPSHOT */
@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file    audio_snapshot.h
+  * @brief   header file for the audio_snapshot.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SNAPSHOT_H
+#define __AUDIO_SNAPSHOT_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "audio_tap.h"
+
+#ifdef USE_AUDIO_SNAPSHOT
+/* Exported constants --------------------------------------------------------*/
+/* points are the tap ones, AUDIO_TAP_POINT_xxx */
+#ifndef AUDIO_SNAPSHOT_RING_SIZE
+#define AUDIO_SNAPSHOT_RING_SIZE          16384U /* per point, must be a power of two : 42 ms of 96 kHz stereo 16 bits */
+#endif /* AUDIO_SNAPSHOT_RING_SIZE */
+#define AUDIO_SNAPSHOT_MAX_POST_MS        1000U
+#define AUDIO_SNAPSHOT_BLOCK_SIZE         512U  /* max data bytes per read out frame */
+
+/* triggers, a CDC command trigger is always taken */
+#define AUDIO_SNAPSHOT_TRIGGER_UNDERRUN   0x01U /* a session underrun */
+#define AUDIO_SNAPSHOT_TRIGGER_OVERRUN    0x02U /* a session overrun */
+#define AUDIO_SNAPSHOT_TRIGGER_INCOMPLETE 0x04U /* an ISO IN or OUT incomplete */
+#define AUDIO_SNAPSHOT_TRIGGER_LEVEL      0x08U /* a level meter peak reached its threshold, USE_AUDIO_LEVEL_METER */
+#define AUDIO_SNAPSHOT_TRIGGER_COMMAND    0x10U
+#define AUDIO_SNAPSHOT_TRIGGER_ALL        0x1FU
+
+/* CDC command operations */
+#define AUDIO_SNAPSHOT_OP_STATUS          0x00U
+#define AUDIO_SNAPSHOT_OP_ARM             0x01U /* points, triggers, post trigger ms 16 bits */
+#define AUDIO_SNAPSHOT_OP_TRIGGER         0x02U
+#define AUDIO_SNAPSHOT_OP_READ            0x03U /* sends the frozen capture */
+#define AUDIO_SNAPSHOT_OP_STOP            0x04U
+
+/* read out frame : AUDIO_SNAPSHOT_SYNC, point, length (16 bits), offset of the data
+   in the point capture (32 bits), data[length] little endian */
+#define AUDIO_SNAPSHOT_SYNC               0xC7U
+#define AUDIO_SNAPSHOT_HEADER_SIZE        8U
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_SNAPSHOT_IDLE = 0,
+  AUDIO_SNAPSHOT_ARMED,           /* the rings keep the last bytes of each point */
+  AUDIO_SNAPSHOT_TRIGGERED,       /* capture goes on for the post trigger window */
+  AUDIO_SNAPSHOT_FROZEN,
+  AUDIO_SNAPSHOT_READING          /* the frozen capture is sent over CDC */
+}
+AUDIO_SnapshotStateTypeDef;
+
+typedef struct
+{
+  uint8_t  state;                 /* AUDIO_SnapshotStateTypeDef */
+  uint8_t  points;                /* mask of AUDIO_TAP_POINT_MASK(point) */
+  uint8_t  triggers;              /* AUDIO_SNAPSHOT_TRIGGER_xxx mask */
+  uint8_t  cause;                 /* trigger taken, 0 before */
+  uint16_t post_ms;
+  uint32_t trigger_ms;            /* since arming */
+  uint32_t length[AUDIO_TAP_POINT_COUNT]; /* bytes of each point capture */
+  uint32_t pre[AUDIO_TAP_POINT_COUNT];    /* of them before the trigger */
+}
+AUDIO_SnapshotStatusTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_SnapshotInit(void);
+/* from the pump */
+int8_t  AUDIO_SnapshotArm(uint8_t points, uint8_t triggers, uint16_t post_ms);
+void    AUDIO_SnapshotTrigger(uint8_t cause);
+int8_t  AUDIO_SnapshotRead(void);
+void    AUDIO_SnapshotStop(void);
+void    AUDIO_SnapshotGetStatus(AUDIO_SnapshotStatusTypeDef* status);
+/* from SysTick, each ms */
+void    AUDIO_SnapshotTick(void);
+/* from the interrupt owning the point */
+void    AUDIO_SnapshotWrite(uint8_t point, const uint8_t* data, uint32_t length);
+void    AUDIO_SnapshotWriteRegion(uint8_t point, AUDIO_BufferRegionTypeDef* region);
+#endif /* USE_AUDIO_SNAPSHOT */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SNAPSHOT_H */
@@ -0,0 +1,256 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_align.c
+  * @brief   starts the SAI DMA at a fixed time after SOF, so the half
+  *          callbacks keep their phase to the USB frames and one packet of
+  *          buffering is enough on each side
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_sof_align.h"
+
+#ifdef USE_AUDIO_SOF_ALIGN
+#include "stm32h7xx.h"
+#include "audio_pump.h"
+#include "audio_sof_tick.h"
+
+#if (defined USE_AUDIO_SPEAKER_DUMMY) && (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_SOF_ALIGN starts the SAI DMA, a SAI speaker or mic is required"
+#endif /* USE_AUDIO_SPEAKER_DUMMY && USE_AUDIO_DUMMY_MIC */
+#if (AUDIO_SOF_ALIGN_SPEAKER_US >= 1000U) || (AUDIO_SOF_ALIGN_MIC_US >= 1000U)
+#error "the SOF align offsets are times in a ms frame"
+#endif /* AUDIO_SOF_ALIGN_SPEAKER_US || AUDIO_SOF_ALIGN_MIC_US */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_SofAlignStartTypeDef start;       /* set while the stream waits for its time */
+  uint32_t                   private_data;
+  uint8_t                    running;     /* the half callbacks are measured */
+  AUDIO_SofAlignStatsTypeDef stats;
+}
+AUDIO_SofAlignStreamTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static const uint16_t AUDIO_SofAlignOffsetUs[AUDIO_SOF_ALIGN_STREAM_COUNT] =
+{
+  AUDIO_SOF_ALIGN_SPEAKER_US, AUDIO_SOF_ALIGN_MIC_US
+};
+static AUDIO_SofAlignStreamTypeDef align_streams[AUDIO_SOF_ALIGN_STREAM_COUNT];
+/* written by the SOF interrupt only */
+static volatile uint32_t align_sof_time;  /* cycle counter at the last ms SOF */
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_SofAlignTick(uint32_t private_data);
+static void AUDIO_SofAlignHandler(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofAlignInit
+  *         installs the pump handler which starts the streams
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SofAlignInit(void)
+{
+  memset(align_streams, 0, sizeof(align_streams));
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SOF_ALIGN, AUDIO_SofAlignHandler);
+}
+
+/**
+  * @brief  AUDIO_SofAlignStart
+  *         arms the start of a stream, start is called from the pump at the
+  *         stream offset after the next SOF. The node buffers must be ready
+  * @param  stream: AUDIO_SOF_ALIGN_SPEAKER or AUDIO_SOF_ALIGN_MIC
+  * @param  start: starts the DMA of the stream
+  * @param  private_data: start argument
+  * @retval 0 if no error
+  */
+int8_t AUDIO_SofAlignStart(uint8_t stream, AUDIO_SofAlignStartTypeDef start, uint32_t private_data)
+{
+  AUDIO_SofAlignStreamTypeDef* s;
+
+  if((stream >= AUDIO_SOF_ALIGN_STREAM_COUNT) || (start == 0))
+  {
+    return -1;
+  }
+  s = &align_streams[stream];
+  s->start = 0;
+  s->running = 0;
+  memset(&s->stats, 0, sizeof(s->stats));
+  s->stats.offset_us    = AUDIO_SofAlignOffsetUs[stream];
+  s->stats.error_min_us = INT16_MAX;
+  s->stats.error_max_us = INT16_MIN;
+  s->private_data = private_data;
+  if(AUDIO_SofTickSubscribe(AUDIO_SofAlignTick, AUDIO_SOF_TICK_PER_MS, 0) != 0)
+  {
+    return -1;
+  }
+  /* armed last, the SOF may post the pump at once */
+  s->start = start;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SofAlignStop
+  *         cancels a start not yet done and stops measuring the stream. To
+  *         call before the DMA is stopped
+  * @param  stream: AUDIO_SOF_ALIGN_SPEAKER or AUDIO_SOF_ALIGN_MIC
+  * @retval None
+  */
+void AUDIO_SofAlignStop(uint8_t stream)
+{
+  uint8_t i;
+
+  if(stream >= AUDIO_SOF_ALIGN_STREAM_COUNT)
+  {
+    return;
+  }
+  align_streams[stream].start = 0;
+  align_streams[stream].running = 0;
+  for(i = 0; i < AUDIO_SOF_ALIGN_STREAM_COUNT; i++)
+  {
+    if((align_streams[i].start != 0) || (align_streams[i].running))
+    {
+      return;
+    }
+  }
+  AUDIO_SofTickUnsubscribe(AUDIO_SofAlignTick, 0);
+}
+
+/**
+  * @brief  AUDIO_SofAlignHalf
+  *         measures the time of a half callback after SOF , called from the
+  *         DMA half callbacks of the stream
+  * @param  stream: AUDIO_SOF_ALIGN_SPEAKER or AUDIO_SOF_ALIGN_MIC
+  * @retval None
+  */
+void AUDIO_SofAlignHalf(uint8_t stream)
+{
+  AUDIO_SofAlignStreamTypeDef* s = &align_streams[stream];
+  int32_t error;
+
+  if(!s->running)
+  {
+    return;
+  }
+  error = (int32_t)((DWT->CYCCNT - align_sof_time) / (SystemCoreClock / 1000000U)) - (int32_t)s->stats.offset_us;
+  /* the closest SOF , a late callback may follow the next one */
+  error = ((error + 1500) % 1000) - 500;
+  s->stats.error_us = (int16_t)error;
+  if(error < s->stats.error_min_us)
+  {
+    s->stats.error_min_us = (int16_t)error;
+  }
+  if(error > s->stats.error_max_us)
+  {
+    s->stats.error_max_us = (int16_t)error;
+  }
+  s->stats.halves++;
+  if((error > (int32_t)AUDIO_SOF_ALIGN_TOLERANCE_US) || (error < -(int32_t)AUDIO_SOF_ALIGN_TOLERANCE_US))
+  {
+    s->stats.drifts++;
+  }
+}
+
+/**
+  * @brief  AUDIO_SofAlignGetStats
+  *         reads the phase of a stream since its start
+  * @param  stream: AUDIO_SOF_ALIGN_SPEAKER or AUDIO_SOF_ALIGN_MIC
+  * @param  stats: returned phase
+  * @retval None
+  */
+void AUDIO_SofAlignGetStats(uint8_t stream, AUDIO_SofAlignStatsTypeDef* stats)
+{
+  *stats = align_streams[stream].stats;
+  if(stats->halves == 0U)
+  {
+    stats->error_min_us = 0;
+    stats->error_max_us = 0;
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofAlignTick
+  *         time stamps the ms SOF, wakes the pump while a stream waits
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_SofAlignTick(uint32_t private_data)
+{
+  uint8_t i;
+
+  align_sof_time = DWT->CYCCNT;
+  for(i = 0; i < AUDIO_SOF_ALIGN_STREAM_COUNT; i++)
+  {
+    if(align_streams[i].start != 0)
+    {
+      AUDIO_PumpPost(AUDIO_PUMP_SOF_ALIGN);
+      return;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SofAlignHandler
+  *         starts the waiting streams at their offset after the SOF, earliest
+  *         first. The pump waits up to the last offset, once per start. A
+  *         stream whose time is already past waits for the next SOF
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SofAlignHandler(void)
+{
+  AUDIO_SofAlignStreamTypeDef* s;
+  AUDIO_SofAlignStartTypeDef start;
+  uint32_t cycles_per_us = SystemCoreClock / 1000000U;
+  uint32_t sof_time = align_sof_time;
+  uint32_t target;
+  uint8_t  next;
+  uint8_t  i;
+
+  do
+  {
+    next = AUDIO_SOF_ALIGN_STREAM_COUNT;
+    for(i = 0; i < AUDIO_SOF_ALIGN_STREAM_COUNT; i++)
+    {
+      if((align_streams[i].start != 0) &&
+         ((DWT->CYCCNT - sof_time) <= (AUDIO_SofAlignOffsetUs[i] + AUDIO_SOF_ALIGN_LATE_US) * cycles_per_us) &&
+         ((next == AUDIO_SOF_ALIGN_STREAM_COUNT) || (AUDIO_SofAlignOffsetUs[i] < AUDIO_SofAlignOffsetUs[next])))
+      {
+        next = i;
+      }
+    }
+    if(next < AUDIO_SOF_ALIGN_STREAM_COUNT)
+    {
+      s = &align_streams[next];
+      target = AUDIO_SofAlignOffsetUs[next] * cycles_per_us;
+      while((DWT->CYCCNT - sof_time) < target)
+      {
+      }
+      start = s->start;
+      s->start = 0;
+      if(start != 0)
+      {
+        s->stats.aligned = 1;
+        s->running = 1;
+        start(s->private_data);
+      }
+    }
+  }
+  while(next < AUDIO_SOF_ALIGN_STREAM_COUNT);
+}
+#endif /* USE_AUDIO_SOF_ALIGN */
@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_align.h
+  * @brief   header file for the audio_sof_align.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SOF_ALIGN_H
+#define __AUDIO_SOF_ALIGN_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_SOF_ALIGN
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_SOF_ALIGN_SPEAKER           0U
+#define AUDIO_SOF_ALIGN_MIC               1U
+#define AUDIO_SOF_ALIGN_STREAM_COUNT      2U
+
+/* time of the DMA half callbacks after the ms SOF. The speaker refills after
+   the OUT packet of the frame was received, the mic commits its half before
+   the next IN packet is prepared */
+#ifndef AUDIO_SOF_ALIGN_SPEAKER_US
+#define AUDIO_SOF_ALIGN_SPEAKER_US        500U
+#endif /* AUDIO_SOF_ALIGN_SPEAKER_US */
+#ifndef AUDIO_SOF_ALIGN_MIC_US
+#define AUDIO_SOF_ALIGN_MIC_US            750U
+#endif /* AUDIO_SOF_ALIGN_MIC_US */
+/* a start later than this after its time waits for the next SOF */
+#define AUDIO_SOF_ALIGN_LATE_US           50U
+/* a half callback further from its time is counted as a drift */
+#ifndef AUDIO_SOF_ALIGN_TOLERANCE_US
+#define AUDIO_SOF_ALIGN_TOLERANCE_US      100U
+#endif /* AUDIO_SOF_ALIGN_TOLERANCE_US */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*AUDIO_SofAlignStartTypeDef)(uint32_t /*private_data*/);
+
+/* phase of the half callbacks of a stream since its start */
+typedef struct
+{
+  uint8_t  aligned;            /* the DMA was started at its time */
+  uint16_t offset_us;          /* time of the half callbacks after SOF */
+  int16_t  error_us;           /* last half callback minus its time */
+  int16_t  error_min_us;
+  int16_t  error_max_us;
+  uint32_t halves;             /* half callbacks measured */
+  uint32_t drifts;             /* half callbacks further than AUDIO_SOF_ALIGN_TOLERANCE_US */
+}
+AUDIO_SofAlignStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_SofAlignInit(void);
+int8_t  AUDIO_SofAlignStart(uint8_t stream, AUDIO_SofAlignStartTypeDef start, uint32_t private_data);
+void    AUDIO_SofAlignStop(uint8_t stream);
+void    AUDIO_SofAlignHalf(uint8_t stream);
+void    AUDIO_SofAlignGetStats(uint8_t stream, AUDIO_SofAlignStatsTypeDef* stats);
+#endif /* USE_AUDIO_SOF_ALIGN */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SOF_ALIGN_H */
@@ -0,0 +1,255 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_jitter.c
+  * @brief   SOF jitter monitor : a free running timer latches its count in
+  *          hardware on each USB SOF, so the interrupt latency is not part of
+  *          the measure. Over windows of AUDIO_SOF_JITTER_WINDOW periods the
+  *          mean SOF period, its jitter and the frames the host sent no SOF
+  *          for are published in the trace and read by the playback session,
+  *          which sizes its latency and its feedback filter from them
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_sof_jitter.h"
+
+#ifdef USE_AUDIO_SOF_JITTER
+#include "stm32h7xx_hal.h"
+#include "audio_user_devices.h"
+#include "audio_trace.h"
+
+/* Private defines -----------------------------------------------------------*/
+/* a longer gap is a suspend or a restart of the host, not missed frames */
+#define AUDIO_SOF_JITTER_MAX_GAP          32U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t last;                          /* capture of the previous SOF */
+  uint8_t  started;                       /* last is valid */
+  uint32_t nominal;                       /* timer ticks per SOF period */
+  uint32_t mean;                          /* mean period of the previous window, ticks */
+  /* window */
+  uint64_t sum;
+  uint64_t dev_sum;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t missed;
+}
+AUDIO_SofJitterTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static TIM_HandleTypeDef htim_sof_jitter;
+static AUDIO_SofJitterTypeDef sof_jitter;
+static uint32_t sof_jitter_clock;
+static AUDIO_SofJitterStatsTypeDef sof_jitter_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_SofJitterUpdate(uint32_t private_data);
+static void     AUDIO_SofJitterPeriod(uint32_t period);
+static void     AUDIO_SofJitterEndWindow(void);
+static void     AUDIO_SofJitterClearWindow(void);
+static uint32_t AUDIO_SofJitterTicksToNs(uint32_t ticks);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofJitterInit
+  *         starts the timer and follows the SOF, after the clocks are set
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SofJitterInit(void)
+{
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_SlaveConfigTypeDef sSlaveConfig = {0};
+  TIM_IC_InitTypeDef sConfigIC = {0};
+
+  /* APB1 timers run at twice the bus clock when it is divided, TIMPRE cleared */
+  sof_jitter_clock = HAL_RCC_GetPCLK1Freq();
+  if((RCC->D2CFGR & RCC_D2CFGR_D2PPRE1) != RCC_APB1_DIV1)
+  {
+    sof_jitter_clock *= 2U;
+  }
+
+  htim_sof_jitter.Instance = AUDIO_SOF_JITTER_TIM;
+  htim_sof_jitter.Init.Prescaler = 0;
+  htim_sof_jitter.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim_sof_jitter.Init.Period = 0xFFFFFFFFU;
+  htim_sof_jitter.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim_sof_jitter.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if(HAL_TIM_IC_Init(&htim_sof_jitter) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if(HAL_TIM_ConfigClockSource(&htim_sof_jitter, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* the trigger only feeds TRC, the counter keeps running */
+  sSlaveConfig.SlaveMode = TIM_SLAVEMODE_DISABLE;
+  sSlaveConfig.InputTrigger = AUDIO_SOF_JITTER_TRIGGER;
+  if(HAL_TIM_SlaveConfigSynchro(&htim_sof_jitter, &sSlaveConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigIC.ICPolarity = TIM_ICPOLARITY_RISING;
+  sConfigIC.ICSelection = TIM_ICSELECTION_TRC;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 0;
+  if(HAL_TIM_IC_ConfigChannel(&htim_sof_jitter, &sConfigIC, TIM_CHANNEL_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  memset(&sof_jitter, 0, sizeof(sof_jitter));
+  memset(&sof_jitter_stats, 0, sizeof(sof_jitter_stats));
+  sof_jitter.nominal = sof_jitter_clock / (1000U * AUDIO_SOF_TICK_PER_MS);
+  sof_jitter.mean = sof_jitter.nominal;
+  AUDIO_SofJitterClearWindow();
+  HAL_TIM_IC_Start(&htim_sof_jitter, TIM_CHANNEL_1);
+  AUDIO_SofTickSubscribe(AUDIO_SofJitterUpdate, 1, 0);
+}
+
+/**
+  * @brief  AUDIO_SofJitterGetStats
+  *         copies the last complete window and the counters
+  * @param  stats: returned statistics
+  * @retval None
+  */
+void AUDIO_SofJitterGetStats(AUDIO_SofJitterStatsTypeDef* stats)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  *stats = sof_jitter_stats;
+  __set_PRIMASK(primask);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofJitterUpdate
+  *         reads the count latched at the last SOF, called by the SOF tick
+  *         each SOF. A capture overwritten before it was read spans two
+  *         periods, the pairing restarts from the new one
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_SofJitterUpdate(uint32_t private_data)
+{
+  uint32_t capture;
+
+  if(__HAL_TIM_GET_FLAG(&htim_sof_jitter, TIM_FLAG_CC1) == RESET)
+  {
+    return;
+  }
+  /* reading the capture clears the flag */
+  capture = HAL_TIM_ReadCapturedValue(&htim_sof_jitter, TIM_CHANNEL_1);
+  if(__HAL_TIM_GET_FLAG(&htim_sof_jitter, TIM_FLAG_CC1OF) != RESET)
+  {
+    __HAL_TIM_CLEAR_FLAG(&htim_sof_jitter, TIM_FLAG_CC1OF);
+    sof_jitter_stats.overruns++;
+    sof_jitter.started = 0;
+  }
+  if(sof_jitter.started)
+  {
+    AUDIO_SofJitterPeriod(capture - sof_jitter.last);
+  }
+  sof_jitter.last = capture;
+  sof_jitter.started = 1;
+}
+
+/**
+  * @brief  AUDIO_SofJitterPeriod
+  *         accounts one capture interval. An interval of n nominal periods is
+  *         n - 1 frames without SOF, it is not counted in the jitter
+  * @param  period: timer ticks since the previous SOF
+  * @retval None
+  */
+static void AUDIO_SofJitterPeriod(uint32_t period)
+{
+  uint32_t frames = (period + (sof_jitter.nominal >> 1)) / sof_jitter.nominal;
+  uint32_t dev;
+
+  if(frames > 1U)
+  {
+    if(frames <= AUDIO_SOF_JITTER_MAX_GAP)
+    {
+      sof_jitter.missed += frames - 1U;
+      sof_jitter_stats.missed += frames - 1U;
+    }
+    return;
+  }
+  dev = (period > sof_jitter.mean) ? (period - sof_jitter.mean) : (sof_jitter.mean - period);
+  sof_jitter.dev_sum += dev;
+  sof_jitter.sum += period;
+  sof_jitter.min = (period < sof_jitter.min) ? period : sof_jitter.min;
+  sof_jitter.max = (period > sof_jitter.max) ? period : sof_jitter.max;
+  if(++sof_jitter.count >= AUDIO_SOF_JITTER_WINDOW)
+  {
+    AUDIO_SofJitterEndWindow();
+  }
+}
+
+/**
+  * @brief  AUDIO_SofJitterEndWindow
+  *         publishes the window and starts the next one. The mean distance is
+  *         taken to the mean of the previous window, the peak to this one
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SofJitterEndWindow(void)
+{
+  uint32_t mean = (uint32_t)(sof_jitter.sum / sof_jitter.count);
+  uint32_t peak = (sof_jitter.max - mean > mean - sof_jitter.min) ? (sof_jitter.max - mean) : (mean - sof_jitter.min);
+
+  sof_jitter_stats.period_ps = (uint32_t)((((sof_jitter.sum * 1000000U) / sof_jitter.count) * 1000000U) / sof_jitter_clock);
+  sof_jitter_stats.jitter_avg_ns = AUDIO_SofJitterTicksToNs((uint32_t)(sof_jitter.dev_sum / sof_jitter.count));
+  sof_jitter_stats.jitter_peak_ns = AUDIO_SofJitterTicksToNs(peak);
+  sof_jitter_stats.window_missed = sof_jitter.missed;
+  sof_jitter_stats.windows++;
+  AUDIO_TRACE(AUDIO_TRACE_SOF_JITTER, (sof_jitter.missed > 0xFFU) ? 0xFFU : sof_jitter.missed,
+              sof_jitter_stats.jitter_peak_ns);
+  sof_jitter.mean = mean;
+  AUDIO_SofJitterClearWindow();
+}
+
+/**
+  * @brief  AUDIO_SofJitterClearWindow
+  *         clears the window accumulators
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SofJitterClearWindow(void)
+{
+  sof_jitter.sum = 0;
+  sof_jitter.dev_sum = 0;
+  sof_jitter.count = 0;
+  sof_jitter.min = UINT32_MAX;
+  sof_jitter.max = 0;
+  sof_jitter.missed = 0;
+}
+
+/**
+  * @brief  AUDIO_SofJitterTicksToNs
+  *         converts a timer duration
+  * @param  ticks: timer ticks
+  * @retval duration in ns
+  */
+static uint32_t AUDIO_SofJitterTicksToNs(uint32_t ticks)
+{
+  return (uint32_t)(((uint64_t)ticks * 1000000000U) / sof_jitter_clock);
+}
+#endif /* USE_AUDIO_SOF_JITTER */
@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_jitter.h
+  * @brief   header file for the audio_sof_jitter.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SOF_JITTER_H
+#define __AUDIO_SOF_JITTER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_sof_tick.h"
+
+#ifdef USE_AUDIO_SOF_JITTER
+/* Exported constants --------------------------------------------------------*/
+/* SOF periods per published window, one second */
+#define AUDIO_SOF_JITTER_WINDOW           (1000U * AUDIO_SOF_TICK_PER_MS)
+
+/* Exported types ------------------------------------------------------------*/
+/* last complete window, missed and overrun counters since the init */
+typedef struct
+{
+  uint32_t windows;                       /* windows completed */
+  uint32_t period_ps;                     /* mean SOF period */
+  uint32_t jitter_avg_ns;                 /* mean distance of a period to the mean */
+  uint32_t jitter_peak_ns;                /* farthest period from the mean */
+  uint32_t window_missed;                 /* frames without SOF in the window */
+  uint32_t missed;                        /* frames without SOF */
+  uint32_t overruns;                      /* captures overwritten before they were read */
+}
+AUDIO_SofJitterStatsTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_SofJitterInit(void);
+void     AUDIO_SofJitterGetStats(AUDIO_SofJitterStatsTypeDef* stats);
+#endif /* USE_AUDIO_SOF_JITTER */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SOF_JITTER_H */
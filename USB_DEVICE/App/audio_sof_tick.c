@@ -0,0 +1,153 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_tick.c
+  * @brief   SOF tick service : the audio class calls the dispatch once per
+  *          SOF. One frame (or microframe) counter is kept for all users, a
+  *          subscriber is called only when its period in SOF elapsed.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32h7xx.h"
+#include "audio_sof_tick.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_SofTickHandlerTypeDef handler; /* 0 when the slot is free */
+  uint32_t private_data;               /* handler argument */
+  uint32_t period;                     /* SOF between two calls */
+  uint32_t next;                       /* SOF count of the next call */
+}
+AUDIO_SofTickSubscriberTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+/* the count is written by the SOF interrupt only */
+static volatile uint32_t sof_tick_count = 0;
+static AUDIO_SofTickSubscriberTypeDef sof_tick_subscribers[AUDIO_SOF_TICK_MAX_SUBSCRIBERS];
+static volatile uint32_t sof_tick_used = 0; /* slots ever used */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofTickSubscribe
+  *         calls handler every period SOF, from the SOF interrupt. A handler
+  *         subscribed again with the same private data only gets the new period
+  * @param  handler: called with private_data
+  * @param  period: SOF between two calls , AUDIO_SOF_TICK_PER_MS for each ms
+  * @param  private_data: handler argument
+  * @retval 0 if no error, -1 when no slot is free
+  */
+int8_t AUDIO_SofTickSubscribe(AUDIO_SofTickHandlerTypeDef handler, uint32_t period, uint32_t private_data)
+{
+  AUDIO_SofTickSubscriberTypeDef* subscriber;
+  AUDIO_SofTickSubscriberTypeDef* free_slot = 0;
+  uint32_t primask;
+  uint32_t i;
+
+  if((handler == 0) || (period == 0U))
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  for(i = 0; i < AUDIO_SOF_TICK_MAX_SUBSCRIBERS; i++)
+  {
+    subscriber = &sof_tick_subscribers[i];
+    if((subscriber->handler == handler) && (subscriber->private_data == private_data))
+    {
+      break;
+    }
+    if((subscriber->handler == 0) && (free_slot == 0))
+    {
+      free_slot = subscriber;
+    }
+  }
+  if(i == AUDIO_SOF_TICK_MAX_SUBSCRIBERS)
+  {
+    if(free_slot == 0)
+    {
+      __set_PRIMASK(primask);
+      return -1;
+    }
+    subscriber = free_slot;
+    i = (uint32_t)(subscriber - sof_tick_subscribers);
+  }
+  subscriber->handler = handler;
+  subscriber->private_data = private_data;
+  subscriber->period = period;
+  subscriber->next = sof_tick_count + period;
+  if(i >= sof_tick_used)
+  {
+    sof_tick_used = i + 1U;
+  }
+  __set_PRIMASK(primask);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SofTickUnsubscribe
+  *         stops the calls of a handler
+  * @param  handler: subscribed handler
+  * @param  private_data: argument it was subscribed with
+  * @retval None
+  */
+void AUDIO_SofTickUnsubscribe(AUDIO_SofTickHandlerTypeDef handler, uint32_t private_data)
+{
+  uint32_t i;
+
+  for(i = 0; i < sof_tick_used; i++)
+  {
+    if((sof_tick_subscribers[i].handler == handler) && (sof_tick_subscribers[i].private_data == private_data))
+    {
+      sof_tick_subscribers[i].handler = 0;
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SofTickDispatch
+  *         counts a SOF and calls the subscribers which are due, to call once
+  *         per SOF
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SofTickDispatch(void)
+{
+  AUDIO_SofTickSubscriberTypeDef* subscriber;
+  AUDIO_SofTickHandlerTypeDef handler;
+  uint32_t count = sof_tick_count + 1U;
+  uint32_t i;
+
+  sof_tick_count = count;
+  for(i = 0; i < sof_tick_used; i++)
+  {
+    subscriber = &sof_tick_subscribers[i];
+    handler = subscriber->handler;
+    if((handler != 0) && (subscriber->next == count))
+    {
+      subscriber->next = count + subscriber->period;
+      handler(subscriber->private_data);
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SofTickGetCount
+  *         SOF counted since power up
+  * @param  None
+  * @retval free running SOF count
+  */
+uint32_t AUDIO_SofTickGetCount(void)
+{
+  return sof_tick_count;
+}
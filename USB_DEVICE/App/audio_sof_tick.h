@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_tick.h
+  * @brief   header file for the audio_sof_tick.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SOF_TICK_H
+#define __AUDIO_SOF_TICK_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* one more for the CDC coalesce deadline, one more for the synchronous start */
+#if (defined USE_AUDIO_CDC_TX_COALESCE) && (defined USE_AUDIO_SYNC_START)
+#define AUDIO_SOF_TICK_MAX_SUBSCRIBERS    9U
+#elif (defined USE_AUDIO_CDC_TX_COALESCE) || (defined USE_AUDIO_SYNC_START)
+#define AUDIO_SOF_TICK_MAX_SUBSCRIBERS    8U
+#else /* USE_AUDIO_CDC_TX_COALESCE || USE_AUDIO_SYNC_START */
+#define AUDIO_SOF_TICK_MAX_SUBSCRIBERS    7U
+#endif /* USE_AUDIO_CDC_TX_COALESCE || USE_AUDIO_SYNC_START */
+#ifdef USE_USB_HS_ULPI_PHY
+#define AUDIO_SOF_TICK_PER_MS             8U /* a SOF each microframe */
+#else /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_SOF_TICK_PER_MS             1U
+#endif /* USE_USB_HS_ULPI_PHY */
+
+/* Exported types ------------------------------------------------------------*/
+typedef void (*AUDIO_SofTickHandlerTypeDef)(uint32_t /*private_data*/);
+
+/* Exported functions ------------------------------------------------------- */
+int8_t   AUDIO_SofTickSubscribe(AUDIO_SofTickHandlerTypeDef handler, uint32_t period, uint32_t private_data);
+void     AUDIO_SofTickUnsubscribe(AUDIO_SofTickHandlerTypeDef handler, uint32_t private_data);
+void     AUDIO_SofTickDispatch(void);
+uint32_t AUDIO_SofTickGetCount(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SOF_TICK_H */
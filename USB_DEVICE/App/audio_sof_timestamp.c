@@ -0,0 +1,237 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_timestamp.c
+  * @brief   SOF timestamp : a timer counts the audio clock and latches its
+  *          count in hardware on each USB SOF. The count difference over a
+  *          sliding window of SOF gives the audio rate measured in USB time,
+  *          renewed every frame instead of once per second. Optionally the
+  *          audio PLL is trimmed from this rate so the audio clock follows
+  *          the host.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_audio.h"
+#include "audio_sof_timestamp.h"
+
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+#include "audio_user_devices.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t capture[AUDIO_SOF_TS_WINDOW]; /* counter latched at last SOF */
+  uint32_t count;                        /* captures since start */
+  uint32_t frequency;                    /* nominal frequency of counted clock, 0 when stopped */
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+  uint32_t lock_capture;                 /* capture at previous PLL correction */
+  int32_t  lock_phase;                   /* ticks counted minus ticks expected, 24.8 format */
+  uint8_t  lock_started;                 /* lock_capture is valid */
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+}
+AUDIO_SofTimestampTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+TIM_HandleTypeDef htim_sof_ts;
+static AUDIO_SofTimestampTypeDef sof_ts;
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_SofTimestampUpdate(uint32_t private_data);
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+static void AUDIO_SofTimestampLock(uint32_t capture);
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofTimestampStart
+  *         starts latching the audio clock on SOF, called by the node owning
+  *         the counted clock once its SAI is running
+  * @param  frequency: nominal sampling frequency of the counted clock
+  * @retval None
+  */
+void AUDIO_SofTimestampStart(uint32_t frequency)
+{
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_SlaveConfigTypeDef sSlaveConfig = {0};
+  TIM_IC_InitTypeDef sConfigIC = {0};
+
+  AUDIO_SofTimestampStop();
+
+  htim_sof_ts.Instance = AUDIO_SOF_TS_TIM;
+  htim_sof_ts.Init.Prescaler = 0;
+  htim_sof_ts.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim_sof_ts.Init.Period = 0xFFFFFFFFU;
+  htim_sof_ts.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim_sof_ts.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if(HAL_TIM_IC_Init(&htim_sof_ts) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_ETRMODE2;
+  sClockSourceConfig.ClockPolarity = TIM_CLOCKPOLARITY_NONINVERTED;
+  sClockSourceConfig.ClockPrescaler = TIM_CLOCKPRESCALER_DIV1;
+  sClockSourceConfig.ClockFilter = 0;
+  if(HAL_TIM_ConfigClockSource(&htim_sof_ts, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if(HAL_TIMEx_RemapConfig(&htim_sof_ts, AUDIO_SOF_TS_ETR_REMAP) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* the trigger only feeds TRC, the counter keeps running on ETR */
+  sSlaveConfig.SlaveMode = TIM_SLAVEMODE_DISABLE;
+  sSlaveConfig.InputTrigger = AUDIO_SOF_TS_TRIGGER;
+  if(HAL_TIM_SlaveConfigSynchro(&htim_sof_ts, &sSlaveConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigIC.ICPolarity = TIM_ICPOLARITY_RISING;
+  sConfigIC.ICSelection = TIM_ICSELECTION_TRC;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 0;
+  if(HAL_TIM_IC_ConfigChannel(&htim_sof_ts, &sConfigIC, TIM_CHANNEL_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  memset(&sof_ts, 0, sizeof(sof_ts));
+  sof_ts.frequency = frequency;
+  HAL_TIM_IC_Start(&htim_sof_ts, TIM_CHANNEL_1);
+  AUDIO_SofTickSubscribe(AUDIO_SofTimestampUpdate, 1, 0);
+}
+
+/**
+  * @brief  AUDIO_SofTimestampStop
+  *         stops latching, rate is no more available
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SofTimestampStop(void)
+{
+  if(sof_ts.frequency)
+  {
+    AUDIO_SofTickUnsubscribe(AUDIO_SofTimestampUpdate, 0);
+    sof_ts.frequency = 0;
+    HAL_TIM_IC_Stop(&htim_sof_ts, TIM_CHANNEL_1);
+    HAL_TIM_IC_DeInit(&htim_sof_ts);
+  }
+}
+
+/**
+  * @brief  AUDIO_SofTimestampGetRate
+  *         rate of a stream clocked by the audio PLL, measured over the last
+  *         AUDIO_SOF_TS_WINDOW captures
+  * @param  frequency: nominal frequency of the stream
+  * @retval rate in Hz with AUDIO_SOF_TS_RATE_FRAC_BITS fractional bits, 0 while
+  *         the window is not filled
+  */
+uint32_t AUDIO_SofTimestampGetRate(uint32_t frequency)
+{
+  uint32_t last;
+  uint32_t ticks;
+
+  if((sof_ts.frequency == 0U) || (sof_ts.count < AUDIO_SOF_TS_WINDOW))
+  {
+    return 0;
+  }
+  /* oldest slot is the one written next, counter wrap is absorbed by the subtraction */
+  last = sof_ts.count - 1U;
+  ticks = sof_ts.capture[last & (AUDIO_SOF_TS_WINDOW - 1U)] - sof_ts.capture[(last + 1U) & (AUDIO_SOF_TS_WINDOW - 1U)];
+
+  /* ticks were expected at sof_ts.frequency * TICKS_PER_FRAME per second over
+     WINDOW - 1 periods, the stream rate is scaled by the same ratio */
+  return (uint32_t)((((uint64_t)frequency * ticks * AUDIO_SOF_TS_SOF_PER_SECOND) << AUDIO_SOF_TS_RATE_FRAC_BITS) /
+                    ((uint64_t)sof_ts.frequency * AUDIO_SOF_TS_TICKS_PER_FRAME * (AUDIO_SOF_TS_WINDOW - 1U)));
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SofTimestampUpdate
+  *         stores the count latched at last SOF, called by the SOF tick each
+  *         SOF while latching. When a SOF was missed the window is restarted
+  * @param  private_data: not used
+  * @retval None
+  */
+static void AUDIO_SofTimestampUpdate(uint32_t private_data)
+{
+  uint32_t capture;
+
+  if((sof_ts.frequency == 0U) || (__HAL_TIM_GET_FLAG(&htim_sof_ts, TIM_FLAG_CC1) == RESET))
+  {
+    return;
+  }
+  /* reading the capture clears the flag */
+  capture = HAL_TIM_ReadCapturedValue(&htim_sof_ts, TIM_CHANNEL_1);
+  if(__HAL_TIM_GET_FLAG(&htim_sof_ts, TIM_FLAG_CC1OF) != RESET)
+  {
+    __HAL_TIM_CLEAR_FLAG(&htim_sof_ts, TIM_FLAG_CC1OF);
+    sof_ts.count = 0;
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+    sof_ts.lock_started = 0;
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+  }
+  sof_ts.capture[sof_ts.count & (AUDIO_SOF_TS_WINDOW - 1U)] = capture;
+  sof_ts.count++;
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+  if((sof_ts.count & (AUDIO_SOF_TS_WINDOW - 1U)) == 0U)
+  {
+    AUDIO_SofTimestampLock(capture);
+  }
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+}
+
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+/**
+  * @brief  AUDIO_SofTimestampLock
+  *         trims the audio PLL so the audio clock follows the host, run once
+  *         per window so a measurement only covers time after the previous
+  *         correction. The phase term brings back the frames gained or lost,
+  *         thus buffers keep their fill level and the error stays bounded by
+  *         the FRACN step
+  * @param  capture: count latched at this SOF
+  * @retval None
+  */
+static void AUDIO_SofTimestampLock(uint32_t capture)
+{
+  uint32_t nominal = sof_ts.frequency << AUDIO_SOF_TS_RATE_FRAC_BITS;
+  int32_t expected = (int32_t)((((uint64_t)sof_ts.frequency * AUDIO_SOF_TS_TICKS_PER_FRAME * AUDIO_SOF_TS_WINDOW)
+                                << AUDIO_SOF_TS_RATE_FRAC_BITS) / AUDIO_SOF_TS_SOF_PER_SECOND);
+  int32_t delta;
+  int32_t error;
+
+  if(sof_ts.lock_started)
+  {
+    delta = (int32_t)((capture - sof_ts.lock_capture) << AUDIO_SOF_TS_RATE_FRAC_BITS) - expected;
+    sof_ts.lock_phase += delta;
+    /* rate error of last window, and the rate which cancels the phase in AUDIO_SOF_TS_LOCK_PHASE_WINDOWS */
+    error = (int32_t)(((int64_t)delta * AUDIO_SOF_TS_SOF_PER_SECOND) /
+                      (AUDIO_SOF_TS_TICKS_PER_FRAME * AUDIO_SOF_TS_WINDOW)) >> AUDIO_SOF_TS_LOCK_GAIN_SHIFT;
+    error += (int32_t)(((int64_t)sof_ts.lock_phase * AUDIO_SOF_TS_SOF_PER_SECOND) /
+                       (AUDIO_SOF_TS_TICKS_PER_FRAME * AUDIO_SOF_TS_WINDOW * AUDIO_SOF_TS_LOCK_PHASE_WINDOWS));
+    if(AUDIO_USER_ClockTrim(error, nominal) != 0)
+    {
+      /* FRACN at its limit : don't let the phase wind up */
+      sof_ts.lock_phase -= delta;
+    }
+  }
+  else
+  {
+    sof_ts.lock_phase = 0;
+    sof_ts.lock_started = 1;
+  }
+  sof_ts.lock_capture = capture;
+}
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    audio_sof_timestamp.h
+  * @brief   header file for the audio_sof_timestamp.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SOF_TIMESTAMP_H
+#define __AUDIO_SOF_TIMESTAMP_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usb_audio_user.h"
+
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+/* Exported constants --------------------------------------------------------*/
+#ifdef USE_USB_HS_ULPI_PHY
+#define AUDIO_SOF_TS_SOF_PER_SECOND       8000U
+#else /* USE_USB_HS_ULPI_PHY */
+#define AUDIO_SOF_TS_SOF_PER_SECOND       1000U
+#endif /* USE_USB_HS_ULPI_PHY */
+/* captures kept, rate is measured between oldest and newest, sliding by one each SOF */
+#define AUDIO_SOF_TS_WINDOW               128U /* must be a power of two */
+#define AUDIO_SOF_TS_RATE_FRAC_BITS       8U   /* rates in Hz, 24.8 format as the feedback rate */
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+#define AUDIO_SOF_TS_LOCK_GAIN_SHIFT      1U   /* half of the rate error is corrected each window */
+#define AUDIO_SOF_TS_LOCK_PHASE_WINDOWS   8U   /* phase error is cancelled over this count of windows */
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_SofTimestampStart(uint32_t frequency);
+void     AUDIO_SofTimestampStop(void);
+uint32_t AUDIO_SofTimestampGetRate(uint32_t frequency);
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SOF_TIMESTAMP_H */
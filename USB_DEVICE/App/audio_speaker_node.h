@@ -92,11 +92,11 @@ typedef struct
   AUDIO_NodeTypeDef      node;            /* the structure of generic node*/
   AUDIO_BufferTypeDef*   buf;             /* the audio data buffer*/
   uint16_t               packet_length;   /* packet maximal length */
-#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K
-  uint16_t               packet_length_max_44_1; /* packet maximal length for frequence 44_1 */
-  uint8_t                injection_44_count;     /* used as count to inject 9 packets (44 samples) then 1 packet(45 samples)*/
-  uint8_t                injection_45_pos;     /* used as position of  45 samples packet*/
-#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K*/
+  AUDIO_PacketSchedulerTypeDef scheduler; /* length of each 1 ms packet to read */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+  volatile uint32_t      drop_length;     /* oldest bytes dropped by the speaker at its next read, set on overrun */
+  volatile uint8_t       failed;          /* device error, the session must restart the speaker */
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
   int8_t                (*SpeakerDeInit)  (uint32_t /*node_handle*/);
   int8_t                (*SpeakerStart)   (AUDIO_BufferTypeDef* /*buffer*/, uint32_t /*node handle*/);
   int8_t                (*SpeakerStop)    ( uint32_t /*node handle*/);
@@ -105,6 +105,9 @@ typedef struct
   int8_t                (*SpeakerSetVolume)    ( uint16_t /*channel_number*/, int /*volume_db_256 */, uint32_t /*node handle*/);
   int8_t                (*SpeakerStartReadCount)     (uint32_t /*node handle*/);
   uint16_t              (*SpeakerGetReadCount)    (  uint32_t /*node handle*/);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  int8_t                (*SpeakerPower)   (uint8_t /*on*/, uint32_t /*node handle*/); /* output stage, on at start */
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
   AUDIO_Speaker_SpecificTypeDef specific; /*should be defined by user for user speaker */
 }
 AUDIO_Speaker_NodeTypeDef;
@@ -114,6 +117,19 @@ AUDIO_Speaker_NodeTypeDef;
  int8_t  AUDIO_SpeakerInit(AUDIO_DescriptionTypeDef* audio_description,
                            AUDIO_SessionTypeDef* session_handle,
                            uint32_t node_handle);
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+uint32_t AUDIO_GetSpeakerData(uint16_t* data);
+uint32_t AUDIO_AcquireSpeakerData(AUDIO_BufferRegionTypeDef* region);
+uint16_t AUDIO_ReleaseSpeakerData(void);
+#ifdef USE_AUDIO_PACKET_QUEUE
+uint32_t AUDIO_GetSpeakerPacketAge(void);
+#endif /* USE_AUDIO_PACKET_QUEUE */
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#if (defined USE_AUDIO_CLIP_UPLOAD) && !(defined USE_AUDIO_SPEAKER_DUMMY)
+int8_t   AUDIO_SpeakerLocalStart(void);
+void     AUDIO_SpeakerLocalStop(void);
+AUDIO_DescriptionTypeDef* AUDIO_SpeakerGetDescription(void);
+#endif /* USE_AUDIO_CLIP_UPLOAD */
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,389 @@
+/**
+  ******************************************************************************
+  * @file    audio_spectrum.c
+  * @brief   Spectrum over CDC : windows of the first channel of the selected
+  *          streams are captured from their interrupt, one per period. The
+  *          pump applies a Hann window, runs a radix-2 float FFT and sends the
+  *          magnitudes in one byte per bin on the CDC IN endpoint, a 512
+  *          samples window every 100 ms is 2.7 KB/s against 192 KB/s for the
+  *          stereo 48 kHz PCM tap. Windows the pump couldn't take are dropped
+  *          and counted, audio is never delayed.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_spectrum.h"
+
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_pump.h"
+#include "audio_pcm.h"
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#include "usbd_cdc_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+
+#if ((AUDIO_SPECTRUM_SIZE & (AUDIO_SPECTRUM_SIZE - 1U)) != 0U) || (AUDIO_SPECTRUM_SIZE < 16U) || \
+    (AUDIO_SPECTRUM_SIZE > 1024U)
+#error "AUDIO_SPECTRUM_SIZE must be a power of two from 16 to 1024"
+#endif /* AUDIO_SPECTRUM_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_SPECTRUM_STEPS_PER_DB       2.0f
+#define AUDIO_SPECTRUM_FLOOR_CODE         255U
+/* power of a full scale 16 bits sine in its bin : Hann coherent gain 1/2 and
+   half of the amplitude in the positive frequencies */
+#define AUDIO_SPECTRUM_FULL_SCALE_DB      (20.0f * log10f(32768.0f * (float)AUDIO_SPECTRUM_SIZE / 4.0f))
+
+/* Private typedef -----------------------------------------------------------*/
+/* one producer (the interrupt of the stream) , the pump is the only consumer */
+typedef struct
+{
+  int16_t           samples[AUDIO_SPECTRUM_SIZE];
+  uint32_t          count;      /* samples of the window being captured */
+  uint32_t          skip;       /* frames left before the next window */
+  volatile uint8_t  ready;      /* window complete, set by the producer, cleared by the pump */
+  volatile uint32_t frequency;  /* of the window ready */
+  volatile uint32_t dropped;    /* windows the pump didn't take in time */
+  uint32_t          sent;       /* frames accepted by the CDC */
+}
+AUDIO_SpectrumSourceTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_SpectrumSourceTypeDef spectrum_sources[AUDIO_SPECTRUM_SOURCE_COUNT];
+static volatile uint32_t spectrum_selected = 0;
+static volatile uint32_t spectrum_period_ms = AUDIO_SPECTRUM_DEFAULT_PERIOD_MS;
+/* pump working set */
+static float spectrum_re[AUDIO_SPECTRUM_SIZE] USBD_DEBUG_BSS;
+static float spectrum_im[AUDIO_SPECTRUM_SIZE] USBD_DEBUG_BSS;
+static float spectrum_window[AUDIO_SPECTRUM_SIZE] USBD_DEBUG_BSS;
+static float spectrum_cos[AUDIO_SPECTRUM_SIZE / 2U] USBD_DEBUG_BSS;
+static float spectrum_sin[AUDIO_SPECTRUM_SIZE / 2U] USBD_DEBUG_BSS;
+static uint8_t spectrum_frame[AUDIO_SPECTRUM_HEADER_SIZE + AUDIO_SPECTRUM_BINS] USBD_DEBUG_BSS;
+static uint8_t spectrum_pending = 0;   /* source + 1 of the frame the CDC refused */
+static uint8_t spectrum_next_source = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_SpectrumHandler(void);
+static void     AUDIO_SpectrumAnalyse(uint8_t source);
+static void     AUDIO_SpectrumFft(float* re, float* im);
+static uint8_t  AUDIO_SpectrumTransmit(void);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SpectrumInit
+  *         computes the window and the twiddles and registers the analysis in
+  *         the pump, must be called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SpectrumInit(void)
+{
+  uint32_t n;
+
+  memset(spectrum_sources, 0, sizeof(spectrum_sources));
+  for(n = 0; n < AUDIO_SPECTRUM_SIZE; n++)
+  {
+    spectrum_window[n] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * (float)n / (float)AUDIO_SPECTRUM_SIZE);
+  }
+  for(n = 0; n < AUDIO_SPECTRUM_SIZE / 2U; n++)
+  {
+    spectrum_cos[n] = cosf(2.0f * (float)M_PI * (float)n / (float)AUDIO_SPECTRUM_SIZE);
+    spectrum_sin[n] = -sinf(2.0f * (float)M_PI * (float)n / (float)AUDIO_SPECTRUM_SIZE);
+  }
+  spectrum_pending = 0;
+  spectrum_next_source = 0;
+  spectrum_selected = 0;
+  spectrum_period_ms = AUDIO_SPECTRUM_DEFAULT_PERIOD_MS;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_SPECTRUM, AUDIO_SpectrumHandler);
+}
+
+/**
+  * @brief  AUDIO_SpectrumSelect
+  *         sets the analysed streams and the frame period, windows already
+  *         captured are still sent
+  * @param  sources: mask of AUDIO_SPECTRUM_SOURCE_MASK(source)
+  * @param  period_ms: frame period of each source, AUDIO_SPECTRUM_MIN_PERIOD_MS
+  *         to AUDIO_SPECTRUM_MAX_PERIOD_MS. A window is the shortest
+  * @retval 0 if no error
+  */
+int8_t AUDIO_SpectrumSelect(uint32_t sources, uint32_t period_ms)
+{
+  if((period_ms < AUDIO_SPECTRUM_MIN_PERIOD_MS) || (period_ms > AUDIO_SPECTRUM_MAX_PERIOD_MS))
+  {
+    return -1;
+  }
+  spectrum_period_ms = period_ms;
+  spectrum_selected = sources & ((1U << AUDIO_SPECTRUM_SOURCE_COUNT) - 1U);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SpectrumGetSelected
+  *         returns the analysed streams
+  * @param  period_ms: returned frame period
+  * @retval mask of AUDIO_SPECTRUM_SOURCE_MASK(source)
+  */
+uint32_t AUDIO_SpectrumGetSelected(uint32_t* period_ms)
+{
+  *period_ms = spectrum_period_ms;
+  return spectrum_selected;
+}
+
+/**
+  * @brief  AUDIO_SpectrumGetSent
+  *         returns the frames of one source sent since start
+  * @param  source: AUDIO_SPECTRUM_SOURCE_xxx
+  * @retval frames count
+  */
+uint32_t AUDIO_SpectrumGetSent(uint8_t source)
+{
+  return (source < AUDIO_SPECTRUM_SOURCE_COUNT) ? spectrum_sources[source].sent : 0U;
+}
+
+/**
+  * @brief  AUDIO_SpectrumWrite
+  *         captures contiguous frames of one source
+  * @param  source: AUDIO_SPECTRUM_SOURCE_xxx
+  * @param  data: frames
+  * @param  length: data length, whole frames
+  * @param  audio_description: format of the frames
+  * @retval None
+  */
+void AUDIO_SpectrumWrite(uint8_t source, uint8_t* data, uint32_t length,
+                         const AUDIO_DescriptionTypeDef* audio_description)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  region.data[0] = data;
+  region.length[0] = length;
+  region.data[1] = data + length;
+  region.length[1] = 0;
+  AUDIO_SpectrumWriteRegion(source, &region, audio_description);
+}
+
+/**
+  * @brief  AUDIO_SpectrumWriteRegion
+  *         captures the first channel of a buffer region when the source is
+  *         selected and its period elapsed. Each source must be written from
+  *         a single context
+  * @param  source: AUDIO_SPECTRUM_SOURCE_xxx
+  * @param  region: region of an audio buffer, whole frames
+  * @param  audio_description: format of the frames
+  * @retval None
+  */
+void AUDIO_SpectrumWriteRegion(uint8_t source, const AUDIO_BufferRegionTypeDef* region,
+                               const AUDIO_DescriptionTypeDef* audio_description)
+{
+  AUDIO_SpectrumSourceTypeDef* src;
+  uint32_t frame_length = AUDIO_SAMPLE_LENGTH(audio_description);
+  uint32_t frames;
+  uint32_t period_frames;
+  uint8_t  res = audio_description->audio_res;
+  uint32_t i;
+
+  if(((spectrum_selected & AUDIO_SPECTRUM_SOURCE_MASK(source)) == 0U) || (frame_length == 0U))
+  {
+    return;
+  }
+  src = &spectrum_sources[source];
+  frames = (region->length[0] + region->length[1]) / frame_length;
+  period_frames = (audio_description->frequence * spectrum_period_ms) / 1000U;
+  for(i = 0; i < frames; i++)
+  {
+    if(src->skip != 0U)
+    {
+      src->skip--;
+      continue;
+    }
+    if(src->ready)
+    {
+      /* the previous window is still waiting, this one is not captured */
+      src->dropped++;
+      src->skip = period_frames;
+      continue;
+    }
+    src->samples[src->count++] = (int16_t)(AUDIO_PcmRegionRead(region, i * frame_length, res) >> (8U * (res - 2U)));
+    if(src->count == AUDIO_SPECTRUM_SIZE)
+    {
+      src->count = 0;
+      src->skip = (period_frames > AUDIO_SPECTRUM_SIZE) ? (period_frames - AUDIO_SPECTRUM_SIZE) : 0U;
+      src->frequency = audio_description->frequence;
+      /* the samples are in memory before the pump sees the window */
+      __DMB();
+      src->ready = 1;
+      AUDIO_PumpPost(AUDIO_PUMP_SPECTRUM);
+    }
+  }
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SpectrumHandler
+  *         pump handler, run when a window is captured and when a CDC
+  *         transfer completes. A frame the CDC refused is sent first, then
+  *         the sources are served in turn
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_SpectrumHandler(void)
+{
+  uint8_t s;
+
+  if(spectrum_pending != 0U)
+  {
+    if(AUDIO_SpectrumTransmit() != 0U)
+    {
+      /* CDC is busy, retried on transfer complete */
+      return;
+    }
+  }
+  for(s = 0; s < AUDIO_SPECTRUM_SOURCE_COUNT; s++)
+  {
+    if(spectrum_sources[spectrum_next_source].ready)
+    {
+      AUDIO_SpectrumAnalyse(spectrum_next_source);
+      if(AUDIO_SpectrumTransmit() != 0U)
+      {
+        spectrum_next_source = (uint8_t)((spectrum_next_source + 1U) % AUDIO_SPECTRUM_SOURCE_COUNT);
+        return;
+      }
+    }
+    spectrum_next_source = (uint8_t)((spectrum_next_source + 1U) % AUDIO_SPECTRUM_SOURCE_COUNT);
+  }
+}
+
+/**
+  * @brief  AUDIO_SpectrumAnalyse
+  *         builds the frame of a ready window, the window is released once
+  *         copied so the next one may be captured
+  * @param  source: AUDIO_SPECTRUM_SOURCE_xxx
+  * @retval None
+  */
+static void AUDIO_SpectrumAnalyse(uint8_t source)
+{
+  AUDIO_SpectrumSourceTypeDef* src = &spectrum_sources[source];
+  uint32_t frequency;
+  uint32_t dropped;
+  float    power;
+  float    level;
+  uint32_t n;
+
+  /* samples are read after the ready flag */
+  __DMB();
+  for(n = 0; n < AUDIO_SPECTRUM_SIZE; n++)
+  {
+    spectrum_re[n] = (float)src->samples[n] * spectrum_window[n];
+    spectrum_im[n] = 0.0f;
+  }
+  frequency = src->frequency;
+  dropped = src->dropped;
+  __DMB();
+  src->ready = 0;
+
+  AUDIO_SpectrumFft(spectrum_re, spectrum_im);
+  spectrum_frame[0] = AUDIO_SPECTRUM_SYNC;
+  spectrum_frame[1] = source;
+  spectrum_frame[2] = (uint8_t)AUDIO_SPECTRUM_BINS;
+  spectrum_frame[3] = (uint8_t)(AUDIO_SPECTRUM_BINS >> 8);
+  spectrum_frame[4] = (uint8_t)frequency;
+  spectrum_frame[5] = (uint8_t)(frequency >> 8);
+  spectrum_frame[6] = (uint8_t)(frequency >> 16);
+  spectrum_frame[7] = (uint8_t)(frequency >> 24);
+  spectrum_frame[8] = (uint8_t)dropped;
+  spectrum_frame[9] = (uint8_t)(dropped >> 8);
+  for(n = 0; n < AUDIO_SPECTRUM_BINS; n++)
+  {
+    power = spectrum_re[n] * spectrum_re[n] + spectrum_im[n] * spectrum_im[n];
+    level = (power > 0.0f) ? (AUDIO_SPECTRUM_FULL_SCALE_DB - 10.0f * log10f(power)) * AUDIO_SPECTRUM_STEPS_PER_DB :
+            (float)AUDIO_SPECTRUM_FLOOR_CODE;
+    level = (level < 0.0f) ? 0.0f : level;
+    spectrum_frame[AUDIO_SPECTRUM_HEADER_SIZE + n] = (level >= (float)AUDIO_SPECTRUM_FLOOR_CODE) ?
+                                                     (uint8_t)AUDIO_SPECTRUM_FLOOR_CODE : (uint8_t)(level + 0.5f);
+  }
+  spectrum_pending = source + 1U;
+}
+
+/**
+  * @brief  AUDIO_SpectrumFft
+  *         in place radix-2 decimation in time FFT of AUDIO_SPECTRUM_SIZE
+  *         points
+  * @param  re: real parts
+  * @param  im: imaginary parts
+  * @retval None
+  */
+static void AUDIO_SpectrumFft(float* re, float* im)
+{
+  uint32_t i, j, k, bit;
+  uint32_t half, step;
+  float    tr, ti;
+
+  /* bit reversed order */
+  for(i = 1U, j = 0U; i < AUDIO_SPECTRUM_SIZE; i++)
+  {
+    for(bit = AUDIO_SPECTRUM_SIZE >> 1; (j & bit) != 0U; bit >>= 1)
+    {
+      j ^= bit;
+    }
+    j |= bit;
+    if(i < j)
+    {
+      tr = re[i];
+      re[i] = re[j];
+      re[j] = tr;
+      tr = im[i];
+      im[i] = im[j];
+      im[j] = tr;
+    }
+  }
+  for(half = 1U, step = AUDIO_SPECTRUM_SIZE / 2U; half < AUDIO_SPECTRUM_SIZE; half <<= 1, step >>= 1)
+  {
+    for(i = 0; i < AUDIO_SPECTRUM_SIZE; i += 2U * half)
+    {
+      for(k = 0; k < half; k++)
+      {
+        j = i + k + half;
+        tr = re[j] * spectrum_cos[k * step] - im[j] * spectrum_sin[k * step];
+        ti = re[j] * spectrum_sin[k * step] + im[j] * spectrum_cos[k * step];
+        re[j] = re[i + k] - tr;
+        im[j] = im[i + k] - ti;
+        re[i + k] += tr;
+        im[i + k] += ti;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_SpectrumTransmit
+  *         sends the pending frame
+  * @param  None
+  * @retval 0 if sent, 1 if the CDC transmit ring is full
+  */
+static uint8_t AUDIO_SpectrumTransmit(void)
+{
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  if(CDC_TLM_Transmit(spectrum_frame, (uint16_t)sizeof(spectrum_frame)) != USBD_OK)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+  if(CDC_Transmit_FS(spectrum_frame, (uint16_t)sizeof(spectrum_frame)) != USBD_OK)
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+  {
+    return 1;
+  }
+  spectrum_sources[spectrum_pending - 1U].sent++;
+  spectrum_pending = 0;
+  return 0;
+}
+#endif /* USE_AUDIO_SPECTRUM */
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file    audio_spectrum.h
+  * @brief   header file for the audio_spectrum.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SPECTRUM_H
+#define __AUDIO_SPECTRUM_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+#include "usbd_conf.h"
+
+#ifdef USE_AUDIO_SPECTRUM
+/* Exported constants --------------------------------------------------------*/
+/* streams which may be analysed */
+#define AUDIO_SPECTRUM_SOURCE_MIC         0U /* recording data as produced by the mic */
+#define AUDIO_SPECTRUM_SOURCE_SPEAKER     1U /* playback packet after the processing nodes */
+#define AUDIO_SPECTRUM_SOURCE_COUNT       2U
+#define AUDIO_SPECTRUM_SOURCE_MASK(source) (1U << (source))
+
+/* window of the first channel, power of two. A frame carries half as many bins */
+#ifndef AUDIO_SPECTRUM_SIZE
+#define AUDIO_SPECTRUM_SIZE               512U
+#endif /* AUDIO_SPECTRUM_SIZE */
+#define AUDIO_SPECTRUM_BINS               (AUDIO_SPECTRUM_SIZE / 2U)
+#ifndef AUDIO_SPECTRUM_DEFAULT_PERIOD_MS
+#define AUDIO_SPECTRUM_DEFAULT_PERIOD_MS  100U /* one frame per source every period */
+#endif /* AUDIO_SPECTRUM_DEFAULT_PERIOD_MS */
+#define AUDIO_SPECTRUM_MIN_PERIOD_MS      10U
+#define AUDIO_SPECTRUM_MAX_PERIOD_MS      10000U
+
+/* frame : AUDIO_SPECTRUM_SYNC, source, bins (16 bits), frequency (32 bits),
+   dropped windows (16 bits), bin[bins]. Little endian, bin k is centered on
+   k * frequency / AUDIO_SPECTRUM_SIZE, its magnitude in 0.5 dB steps below
+   full scale : 0 for a full scale sine, 255 at -127.5 dBFS or below */
+#define AUDIO_SPECTRUM_SYNC               0xC5U
+#define AUDIO_SPECTRUM_HEADER_SIZE        10U
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_SpectrumInit(void);
+int8_t   AUDIO_SpectrumSelect(uint32_t sources, uint32_t period_ms);
+uint32_t AUDIO_SpectrumGetSelected(uint32_t* period_ms);
+uint32_t AUDIO_SpectrumGetSent(uint8_t source);
+void     AUDIO_SpectrumWrite(uint8_t source, uint8_t* data, uint32_t length,
+                             const AUDIO_DescriptionTypeDef* audio_description) USBD_ITCM_FUNC;
+void     AUDIO_SpectrumWriteRegion(uint8_t source, const AUDIO_BufferRegionTypeDef* region,
+                                   const AUDIO_DescriptionTypeDef* audio_description) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_SPECTRUM */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SPECTRUM_H */
@@ -0,0 +1,88 @@
+/**
+  ******************************************************************************
+  * @file    audio_sync_control.c
+  * @brief   Regulation steps of the stream synchronisation : the playback
+  *          feedback PI controller and the recording resampler correction.
+  *          Both keep a ring at its target fill level and only depend on
+  *          their arguments, so they run the same on the target and on the
+  *          host against a simulated SOF and clock drift.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_sync_control.h"
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SyncFeedbackStep
+  *         one step of the feedback PI controller
+  * @param  feedback: controller state, fill_avg and integral are updated
+  * @param  fill: buffer filled size, AUDIO_FEEDBACK_FILL_FRAC_BITS fractional bits
+  * @param  target: fill level to keep, same format
+  * @param  sample_size: bytes per frame
+  * @param  max_deviation: correction limit, AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits
+  * @param  avg_shift: fill level low-pass, 1/2^avg_shift of each new measure
+  * @retval correction to add to the nominal rate, AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits
+  */
+int32_t AUDIO_SyncFeedbackStep(AUDIO_SyncFeedbackTypeDef* feedback, int32_t fill, int32_t target,
+                               int32_t sample_size, int32_t max_deviation, uint8_t avg_shift)
+{
+  int32_t error;
+  int32_t correction;
+
+  /* packets arrive as bursts, so the fill level is smoothed before use */
+  feedback->fill_avg += (fill - feedback->fill_avg) >> avg_shift;
+  /* positive error : buffer is below target, ask host for more samples */
+  error = (target - feedback->fill_avg) / sample_size;
+  feedback->integral += error;
+  /* the terms are signed, they are scaled by products and not shifts */
+  correction = ((error * (1 << AUDIO_FEEDBACK_KP_SHIFT)) + (feedback->integral * (1 << AUDIO_FEEDBACK_KI_SHIFT)))
+                >> AUDIO_FEEDBACK_FILL_FRAC_BITS;
+  if((correction > max_deviation) || (correction < -max_deviation))
+  {
+    /* saturated : don't let the integral term wind up */
+    feedback->integral -= error;
+    correction = (correction > 0) ? max_deviation : -max_deviation;
+  }
+  return correction;
+}
+
+/**
+  * @brief  AUDIO_SyncResamplerCorrection
+  *         proportional correction of the recording resampler step, which
+  *         keeps the ring at its center : a ring too filled consumes more
+  *         mic frames for each USB frame
+  * @param  fill: buffer filled size in bytes
+  * @param  center: fill level to keep in bytes
+  * @param  sample_size: bytes per frame
+  * @param  step_one: step for same input and output rates
+  * @retval correction to add to the nominal step, limited to step_one >> AUDIO_SYNC_RESAMPLER_MAX_SHIFT
+  */
+int32_t AUDIO_SyncResamplerCorrection(int32_t fill, int32_t center, int32_t sample_size, int32_t step_one)
+{
+  int32_t max_correction = step_one >> AUDIO_SYNC_RESAMPLER_MAX_SHIFT;
+  int32_t correction;
+
+  /* the error is negative below the center, it is scaled by a product and not a shift */
+  correction = ((fill - center) / sample_size) * (1 << AUDIO_SYNC_RESAMPLER_GAIN_SHIFT);
+  if(correction > max_correction)
+  {
+    correction = max_correction;
+  }
+  if(correction < -max_correction)
+  {
+    correction = -max_correction;
+  }
+  return correction;
+}
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    audio_sync_control.h
+  * @brief   header file for the audio_sync_control.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SYNC_CONTROL_H
+#define __AUDIO_SYNC_CONTROL_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* feedback PI controller, run once per ms frame. rates are in Hz with
+   AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits, errors in samples with
+   AUDIO_FEEDBACK_FILL_FRAC_BITS fractional bits */
+#define AUDIO_FEEDBACK_FILL_FRAC_BITS      4  /* fill level and error precision */
+#define AUDIO_FEEDBACK_FILL_AVG_SHIFT      3  /* fill level low-pass, 1/8 of each new measure */
+#define AUDIO_FEEDBACK_KP_SHIFT            12 /* proportional gain : 16 Hz per sample of error */
+#define AUDIO_FEEDBACK_KI_SHIFT            4  /* integral gain : 1/16 Hz per sample of error per ms */
+#define AUDIO_FEEDBACK_MAX_DEVIATION_SHIFT 6  /* correction is limited to nominal rate/64 */
+
+/* recording resampler step correction, the step is in 2.30 format */
+#define AUDIO_SYNC_RESAMPLER_GAIN_SHIFT    15 /* step correction per frame of fill error */
+#define AUDIO_SYNC_RESAMPLER_MAX_SHIFT     7  /* step correction is limited to 1/128 */
+
+/* Exported types ------------------------------------------------------------*/
+/* feedback PI controller state */
+typedef struct
+{
+  int32_t  fill_avg;  /* smoothed buffer filled size in bytes, AUDIO_FEEDBACK_FILL_FRAC_BITS fractional bits */
+  int32_t  integral;  /* accumulated error */
+}
+AUDIO_SyncFeedbackTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+/* work on their arguments only, no session, node or HAL state : they are
+   linked as they are by the host test of Tests/Host */
+int32_t AUDIO_SyncFeedbackStep(AUDIO_SyncFeedbackTypeDef* feedback, int32_t fill, int32_t target,
+                               int32_t sample_size, int32_t max_deviation, uint8_t avg_shift);
+int32_t AUDIO_SyncResamplerCorrection(int32_t fill, int32_t center, int32_t sample_size, int32_t step_one);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SYNC_CONTROL_H */
@@ -0,0 +1,280 @@
+/**
+  ******************************************************************************
+  * @file    audio_sync_start.c
+  * @brief   Sample synchronous start of playback and recording : while armed
+  *          the playback session holds the speaker at its start threshold and
+  *          the recording session holds the mic. Once both are held they
+  *          start back to back from the same SOF interrupt, AUDIO_SYNC_START_LEAD_MS
+  *          later, and the stream frame each device starts with is reported
+  *          so the host aligns both streams without cross-correlation.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_sync_start.h"
+
+#ifdef USE_AUDIO_SYNC_START
+#include "stm32h7xx.h"
+#include "usbd_conf.h"
+#include "audio_sof_tick.h"
+
+#if !(defined USE_USB_AUDIO_PLAYPBACK) || !(defined USE_USB_AUDIO_RECORDING)
+#error "USE_AUDIO_SYNC_START starts playback and recording together, both are required"
+#endif /* !USE_USB_AUDIO_PLAYPBACK || !USE_USB_AUDIO_RECORDING */
+#ifndef USE_AUDIO_CDC_COMMAND
+#error "USE_AUDIO_SYNC_START is armed over the CDC command channel, USE_AUDIO_CDC_COMMAND is required"
+#endif /* USE_AUDIO_CDC_COMMAND */
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+#error "USE_AUDIO_SYNC_START counts the stream frames from SET_INTERFACE, it can't be used with USE_AUDIO_DEFERRED_ALTERNATE"
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+#ifdef USE_AUDIO_RECORDING_USERS
+#error "USE_AUDIO_SYNC_START holds the mic start, it can't be used with USE_AUDIO_RECORDING_USERS"
+#endif /* USE_AUDIO_RECORDING_USERS */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  AUDIO_SyncStartHandlerTypeDef handler;  /* set while the stream is held */
+  uint32_t                      private_data;
+}
+AUDIO_SyncStartStreamTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+/* written with the interrupts masked, read by the SOF interrupt */
+static AUDIO_SyncStartStreamTypeDef sync_streams[AUDIO_SYNC_START_STREAM_COUNT];
+static volatile uint8_t  sync_state = AUDIO_SYNC_START_IDLE;
+static volatile uint8_t  sync_held = 0;
+static volatile uint8_t  sync_valid = 0;
+static uint8_t           sync_lead_ms = AUDIO_SYNC_START_LEAD_MS;
+static uint8_t           sync_countdown;     /* SOF left before the start, both streams held */
+static uint16_t          sync_start_frame;
+static uint32_t          sync_position[AUDIO_SYNC_START_STREAM_COUNT];
+
+/* Private function prototypes -----------------------------------------------*/
+static void AUDIO_SyncStartSof(uint32_t private_data);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SyncStartArm
+  *         the next sessions to start are held until both are, then start on
+  *         the same SOF. Sessions already running are not affected
+  * @param  lead_ms: SOF between both held and the start, 0 for AUDIO_SYNC_START_LEAD_MS
+  * @retval 0 if no error, -1 if lead_ms is out of range or no SOF subscriber is free
+  */
+int8_t AUDIO_SyncStartArm(uint8_t lead_ms)
+{
+  uint32_t primask;
+
+  if(lead_ms == 0U)
+  {
+    lead_ms = AUDIO_SYNC_START_LEAD_MS;
+  }
+  if(lead_ms > AUDIO_SYNC_START_MAX_LEAD_MS)
+  {
+    return -1;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  sync_lead_ms = lead_ms;
+  sync_countdown = lead_ms;
+  sync_valid = 0;
+  if(sync_state != AUDIO_SYNC_START_ARMED)
+  {
+    sync_held = 0;
+    sync_streams[AUDIO_SYNC_START_PLAYBACK].handler = 0;
+    sync_streams[AUDIO_SYNC_START_RECORD].handler = 0;
+  }
+  sync_state = AUDIO_SYNC_START_ARMED;
+  __set_PRIMASK(primask);
+  if(AUDIO_SofTickSubscribe(AUDIO_SyncStartSof, AUDIO_SOF_TICK_PER_MS, 0) != 0)
+  {
+    sync_state = AUDIO_SYNC_START_IDLE;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_SyncStartDisarm
+  *         back to independent starts, a held stream starts at once
+  * @param  None
+  * @retval None
+  */
+void AUDIO_SyncStartDisarm(void)
+{
+  AUDIO_SyncStartStreamTypeDef held[AUDIO_SYNC_START_STREAM_COUNT];
+  uint32_t primask;
+  uint8_t  i;
+
+  AUDIO_SofTickUnsubscribe(AUDIO_SyncStartSof, 0);
+  primask = __get_PRIMASK();
+  __disable_irq();
+  memcpy(held, sync_streams, sizeof(held));
+  memset(sync_streams, 0, sizeof(sync_streams));
+  sync_held = 0;
+  sync_state = AUDIO_SYNC_START_IDLE;
+  /* started with the USB interrupt masked, like from the SOF interrupt */
+  for(i = 0; i < AUDIO_SYNC_START_STREAM_COUNT; i++)
+  {
+    if(held[i].handler != 0)
+    {
+      held[i].handler(1, held[i].private_data);
+    }
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_SyncStartGetStatus
+  *         state and positions of the last synchronous start
+  * @param  status: status copy
+  * @retval None
+  */
+void AUDIO_SyncStartGetStatus(AUDIO_SyncStartStatusTypeDef* status)
+{
+  uint32_t primask;
+
+  memset(status, 0, sizeof(AUDIO_SyncStartStatusTypeDef));
+  primask = __get_PRIMASK();
+  __disable_irq();
+  status->state = sync_state;
+  status->held = sync_held;
+  status->valid = sync_valid;
+  status->lead_ms = sync_lead_ms;
+  status->start_frame = sync_start_frame;
+  status->position[AUDIO_SYNC_START_PLAYBACK] = sync_position[AUDIO_SYNC_START_PLAYBACK];
+  status->position[AUDIO_SYNC_START_RECORD] = sync_position[AUDIO_SYNC_START_RECORD];
+  __set_PRIMASK(primask);
+  status->delay[AUDIO_SYNC_START_PLAYBACK] = AUDIO_SYNC_START_SPEAKER_DELAY_FRAMES;
+  status->delay[AUDIO_SYNC_START_RECORD] = AUDIO_SYNC_START_MIC_DELAY_FRAMES;
+}
+
+/**
+  * @brief  AUDIO_SyncStartHold
+  *         holds the start of a stream while armed, called by the session
+  *         instead of starting its device
+  * @param  stream: AUDIO_SYNC_START_PLAYBACK or AUDIO_SYNC_START_RECORD
+  * @param  handler: called from the SOF interrupt while held, then to start
+  * @param  private_data: handler argument
+  * @retval 0 if the stream is held, -1 when not armed : the session starts the device itself
+  */
+int8_t AUDIO_SyncStartHold(uint8_t stream, AUDIO_SyncStartHandlerTypeDef handler, uint32_t private_data)
+{
+  uint32_t primask;
+  int8_t   ret = -1;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(sync_state == AUDIO_SYNC_START_ARMED)
+  {
+    sync_streams[stream].handler = handler;
+    sync_streams[stream].private_data = private_data;
+    sync_held |= (uint8_t)(1U << stream);
+    sync_countdown = sync_lead_ms;
+    ret = 0;
+  }
+  __set_PRIMASK(primask);
+  return ret;
+}
+
+/**
+  * @brief  AUDIO_SyncStartRelease
+  *         the session stopped, its stream is no more held
+  * @param  stream: AUDIO_SYNC_START_PLAYBACK or AUDIO_SYNC_START_RECORD
+  * @retval None
+  */
+void AUDIO_SyncStartRelease(uint8_t stream)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  sync_streams[stream].handler = 0;
+  sync_held &= (uint8_t)~(1U << stream);
+  sync_valid &= (uint8_t)~(1U << stream);
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  AUDIO_SyncStartSetPosition
+  *         position known after the start, the record one once the silence
+  *         sent before the first mic frame is counted. Only the first one
+  *         after the start is kept
+  * @param  stream: AUDIO_SYNC_START_PLAYBACK or AUDIO_SYNC_START_RECORD
+  * @param  position: stream frame of the first device frame
+  * @retval None
+  */
+void AUDIO_SyncStartSetPosition(uint8_t stream, uint32_t position)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if((sync_state == AUDIO_SYNC_START_STARTED) && ((sync_valid & (1U << stream)) == 0U))
+  {
+    sync_position[stream] = position;
+    sync_valid |= (uint8_t)(1U << stream);
+  }
+  __set_PRIMASK(primask);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_SyncStartSof
+  *         SOF subscriber while armed : keeps the held streams waiting and
+  *         starts both once they were held for the lead time
+  * @param  private_data: unused
+  * @retval None
+  */
+static void AUDIO_SyncStartSof(uint32_t private_data)
+{
+  AUDIO_SyncStartStreamTypeDef* stream;
+  uint8_t i;
+
+  UNUSED(private_data);
+  if(sync_state != AUDIO_SYNC_START_ARMED)
+  {
+    return;
+  }
+  if((sync_held != AUDIO_SYNC_START_ALL) || (--sync_countdown != 0U))
+  {
+    for(i = 0; i < AUDIO_SYNC_START_STREAM_COUNT; i++)
+    {
+      stream = &sync_streams[i];
+      if(stream->handler != 0)
+      {
+        stream->handler(0, stream->private_data);
+      }
+    }
+    if(sync_held != AUDIO_SYNC_START_ALL)
+    {
+      sync_countdown = sync_lead_ms;
+    }
+    return;
+  }
+  sync_start_frame = (uint16_t)USB_SOF_NUMBER();
+  sync_valid = 0;
+  /* the speaker first, its ring is cut to the threshold before it starts */
+  for(i = 0; i < AUDIO_SYNC_START_STREAM_COUNT; i++)
+  {
+    stream = &sync_streams[i];
+    sync_position[i] = stream->handler(1, stream->private_data);
+    stream->handler = 0;
+  }
+  sync_held = 0;
+  sync_valid = (uint8_t)(1U << AUDIO_SYNC_START_PLAYBACK);
+  sync_state = AUDIO_SYNC_START_STARTED;
+  AUDIO_SofTickUnsubscribe(AUDIO_SyncStartSof, 0);
+}
+#endif /* USE_AUDIO_SYNC_START */
@@ -0,0 +1,101 @@
+/**
+  ******************************************************************************
+  * @file    audio_sync_start.h
+  * @brief   header file for the audio_sync_start.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_SYNC_START_H
+#define __AUDIO_SYNC_START_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_SYNC_START
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_SYNC_START_PLAYBACK         0U
+#define AUDIO_SYNC_START_RECORD           1U
+#define AUDIO_SYNC_START_STREAM_COUNT     2U
+#define AUDIO_SYNC_START_ALL              0x03U /* mask of both streams */
+
+/* SOF between both streams being held and their start */
+#ifndef AUDIO_SYNC_START_LEAD_MS
+#define AUDIO_SYNC_START_LEAD_MS          2U
+#endif /* AUDIO_SYNC_START_LEAD_MS */
+#define AUDIO_SYNC_START_MAX_LEAD_MS      100U
+/* frames from the DMA to the DAC output and from the ADC input to the DMA
+   (SAI FIFO, codec filters), 0 for the dummy nodes */
+#ifndef AUDIO_SYNC_START_SPEAKER_DELAY_FRAMES
+#define AUDIO_SYNC_START_SPEAKER_DELAY_FRAMES 0U
+#endif /* AUDIO_SYNC_START_SPEAKER_DELAY_FRAMES */
+#ifndef AUDIO_SYNC_START_MIC_DELAY_FRAMES
+#define AUDIO_SYNC_START_MIC_DELAY_FRAMES 0U
+#endif /* AUDIO_SYNC_START_MIC_DELAY_FRAMES */
+
+/* CDC command operations */
+#define AUDIO_SYNC_START_OP_STATUS        0x00U
+#define AUDIO_SYNC_START_OP_ARM           0x01U /* [lead ms] */
+#define AUDIO_SYNC_START_OP_DISARM        0x02U
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  AUDIO_SYNC_START_IDLE = 0,      /* sessions start on their own thresholds */
+  AUDIO_SYNC_START_ARMED,         /* sessions are held at their start until both are */
+  AUDIO_SYNC_START_STARTED        /* both started on start_frame */
+}
+AUDIO_SyncStartStateTypeDef;
+
+/* called from the SOF interrupt while the stream is held with start 0, then
+   once with start 1 to start it. Returns, with start 1, the stream frame the
+   device starts with */
+typedef uint32_t (*AUDIO_SyncStartHandlerTypeDef)(uint8_t /*start*/, uint32_t /*private_data*/);
+
+/* position of both streams at the start SOF, in frames since the alternate
+   was selected : the speaker plays playback frame position[PLAYBACK] and the
+   mic captures record frame position[RECORD] at the start. Playback frame p
+   and record frame r are at the same time when
+   r - position[RECORD] - delay[RECORD] == p - position[PLAYBACK] + delay[PLAYBACK].
+   It stays exact until a glitch of either session */
+typedef struct
+{
+  uint8_t  state;                 /* AUDIO_SyncStartStateTypeDef */
+  uint8_t  held;                  /* streams waiting for the start */
+  uint8_t  valid;                 /* streams whose position is known, the record one once its first frame is sent */
+  uint8_t  lead_ms;
+  uint16_t start_frame;           /* USB frame number of the start SOF */
+  uint32_t position[AUDIO_SYNC_START_STREAM_COUNT];
+  uint16_t delay[AUDIO_SYNC_START_STREAM_COUNT]; /* AUDIO_SYNC_START_xxx_DELAY_FRAMES */
+}
+AUDIO_SyncStartStatusTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+/* from the pump */
+int8_t  AUDIO_SyncStartArm(uint8_t lead_ms);
+void    AUDIO_SyncStartDisarm(void);
+void    AUDIO_SyncStartGetStatus(AUDIO_SyncStartStatusTypeDef* status);
+/* from the sessions */
+int8_t  AUDIO_SyncStartHold(uint8_t stream, AUDIO_SyncStartHandlerTypeDef handler, uint32_t private_data);
+void    AUDIO_SyncStartRelease(uint8_t stream);
+void    AUDIO_SyncStartSetPosition(uint8_t stream, uint32_t position);
+#endif /* USE_AUDIO_SYNC_START */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_SYNC_START_H */
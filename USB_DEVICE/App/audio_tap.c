@@ -0,0 +1,255 @@
+/**
+  ******************************************************************************
+  * @file    audio_tap.c
+  * @brief   Raw PCM capture over CDC : selected pipeline points are copied to
+  *          one lossy ring each, the pump sends them in frames on the CDC IN
+  *          endpoint. When the host doesn't read fast enough data is dropped
+  *          and counted, audio is never delayed.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_tap.h"
+
+#ifdef USE_AUDIO_TAP
+#include "audio_pump.h"
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#include "usbd_cdc_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+
+#if (AUDIO_TAP_RING_SIZE & (AUDIO_TAP_RING_SIZE - 1U)) != 0U
+#error "AUDIO_TAP_RING_SIZE must be a power of two"
+#endif /* AUDIO_TAP_RING_SIZE */
+
+/* Private typedef -----------------------------------------------------------*/
+/* one producer (the interrupt owning the point) , the pump is the only consumer */
+typedef struct
+{
+  uint8_t           data[AUDIO_TAP_RING_SIZE];
+  volatile uint32_t ptr_in;   /* free running */
+  volatile uint32_t ptr_out;  /* free running */
+  volatile uint32_t dropped;  /* bytes not captured because the ring was full */
+}
+AUDIO_TapRingTypeDef;
+
+/* Private variables ---------------------------------------------------------*/
+static AUDIO_TapRingTypeDef tap_rings[AUDIO_TAP_POINT_COUNT] USBD_DEBUG_BSS;
+static volatile uint32_t tap_selected = 0;
+static uint8_t tap_frame[AUDIO_TAP_HEADER_SIZE + AUDIO_TAP_BLOCK_SIZE] USBD_DEBUG_BSS;
+static uint8_t tap_next_point = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_TapDrain(void);
+static uint8_t  AUDIO_TapSendBlock(uint8_t point);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_TapInit
+  *         Initializes the rings and registers the drain in the pump, must be
+  *         called after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_TapInit(void)
+{
+  uint32_t i;
+
+  for(i = 0; i < AUDIO_TAP_POINT_COUNT; i++)
+  {
+    tap_rings[i].ptr_in = 0;
+    tap_rings[i].ptr_out = 0;
+    tap_rings[i].dropped = 0;
+  }
+  tap_next_point = 0;
+  tap_selected = AUDIO_TAP_DEFAULT_POINTS;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_TAP, AUDIO_TapDrain);
+}
+
+/**
+  * @brief  AUDIO_TapSelect
+  *         sets the captured points, data already in the rings is still sent
+  * @param  points: mask of AUDIO_TAP_POINT_MASK(point)
+  * @retval None
+  */
+void AUDIO_TapSelect(uint32_t points)
+{
+  tap_selected = points & ((1U << AUDIO_TAP_POINT_COUNT) - 1U);
+}
+
+/**
+  * @brief  AUDIO_TapGetSelected
+  *         returns the captured points
+  * @param  None
+  * @retval mask of AUDIO_TAP_POINT_MASK(point)
+  */
+uint32_t AUDIO_TapGetSelected(void)
+{
+  return tap_selected;
+}
+
+/**
+  * @brief  AUDIO_TapGetDropped
+  *         returns the bytes lost on one point since start
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @retval dropped bytes
+  */
+uint32_t AUDIO_TapGetDropped(uint8_t point)
+{
+  return (point < AUDIO_TAP_POINT_COUNT) ? tap_rings[point].dropped : 0U;
+}
+
+/**
+  * @brief  AUDIO_TapWrite
+  *         copies data of one point when it is selected, whole chunk is
+  *         dropped when it doesn't fit. Each point must be written from a
+  *         single context
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @param  data: data to capture
+  * @param  length: data length
+  * @retval None
+  */
+void AUDIO_TapWrite(uint8_t point, const uint8_t* data, uint32_t length)
+{
+  AUDIO_TapRingTypeDef* ring;
+  uint32_t ptr_in;
+  uint32_t offset;
+  uint32_t first;
+
+  if(((tap_selected & AUDIO_TAP_POINT_MASK(point)) == 0U) || (length == 0U))
+  {
+    return;
+  }
+  ring = &tap_rings[point];
+  ptr_in = ring->ptr_in;
+  if((AUDIO_TAP_RING_SIZE - (ptr_in - ring->ptr_out)) < length)
+  {
+    ring->dropped += length;
+  }
+  else
+  {
+    offset = ptr_in & (AUDIO_TAP_RING_SIZE - 1U);
+    first = AUDIO_TAP_RING_SIZE - offset;
+    if(first > length)
+    {
+      first = length;
+    }
+    memcpy(&ring->data[offset], data, first);
+    memcpy(&ring->data[0], data + first, length - first);
+    __DMB();
+    ring->ptr_in = ptr_in + length;
+  }
+  AUDIO_PumpPost(AUDIO_PUMP_TAP);
+}
+
+/**
+  * @brief  AUDIO_TapWriteRegion
+  *         captures a buffer region, both parts in order
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @param  region: region of an audio buffer
+  * @retval None
+  */
+void AUDIO_TapWriteRegion(uint8_t point, AUDIO_BufferRegionTypeDef* region)
+{
+  AUDIO_TapWrite(point, region->data[0], region->length[0]);
+  AUDIO_TapWrite(point, region->data[1], region->length[1]);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_TapDrain
+  *         pump handler, run when data is captured and when a CDC transfer
+  *         completes. Points are served one block each in turn until the CDC
+  *         transmit ring is full
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_TapDrain(void)
+{
+  uint8_t idle = 0;
+
+  while(idle < AUDIO_TAP_POINT_COUNT)
+  {
+    switch(AUDIO_TapSendBlock(tap_next_point))
+    {
+      case 0:
+        idle++;
+        break;
+      case 1:
+        idle = 0;
+        break;
+      default:
+        /* CDC is busy, retried on transfer complete */
+        return;
+    }
+    tap_next_point = (uint8_t)((tap_next_point + 1U) % AUDIO_TAP_POINT_COUNT);
+  }
+}
+
+/**
+  * @brief  AUDIO_TapSendBlock
+  *         sends up to AUDIO_TAP_BLOCK_SIZE bytes of one point in one frame,
+  *         data stays in the ring until the frame is accepted
+  * @param  point: AUDIO_TAP_POINT_xxx
+  * @retval 0 if nothing to send, 1 if sent, 2 if the CDC transmit ring is full
+  */
+static uint8_t AUDIO_TapSendBlock(uint8_t point)
+{
+  AUDIO_TapRingTypeDef* ring = &tap_rings[point];
+  uint32_t ptr_out = ring->ptr_out;
+  uint32_t length = ring->ptr_in - ptr_out;
+  uint32_t offset = ptr_out & (AUDIO_TAP_RING_SIZE - 1U);
+  uint32_t dropped = ring->dropped;
+  uint32_t first;
+
+  if(length == 0U)
+  {
+    return 0;
+  }
+  /* data is read after the write position */
+  __DMB();
+  if(length > AUDIO_TAP_BLOCK_SIZE)
+  {
+    length = AUDIO_TAP_BLOCK_SIZE;
+  }
+  tap_frame[0] = AUDIO_TAP_SYNC;
+  tap_frame[1] = point;
+  tap_frame[2] = (uint8_t)length;
+  tap_frame[3] = (uint8_t)(length >> 8);
+  tap_frame[4] = (uint8_t)dropped;
+  tap_frame[5] = (uint8_t)(dropped >> 8);
+  tap_frame[6] = (uint8_t)(dropped >> 16);
+  tap_frame[7] = (uint8_t)(dropped >> 24);
+  first = AUDIO_TAP_RING_SIZE - offset;
+  if(first > length)
+  {
+    first = length;
+  }
+  memcpy(&tap_frame[AUDIO_TAP_HEADER_SIZE], &ring->data[offset], first);
+  memcpy(&tap_frame[AUDIO_TAP_HEADER_SIZE + first], &ring->data[0], length - first);
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  if(CDC_TLM_Transmit(tap_frame, (uint16_t)(AUDIO_TAP_HEADER_SIZE + length)) != USBD_OK)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+  if(CDC_Transmit_FS(tap_frame, (uint16_t)(AUDIO_TAP_HEADER_SIZE + length)) != USBD_OK)
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+  {
+    return 2;
+  }
+  /* data is copied before the producer may reuse its place */
+  __DMB();
+  ring->ptr_out = ptr_out + length;
+  return 1;
+}
+#endif /* USE_AUDIO_TAP */
@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file    audio_tap.h
+  * @brief   header file for the audio_tap.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_TAP_H
+#define __AUDIO_TAP_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "audio_node.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* pipeline points which may be captured, by the taps and the snapshot (USE_AUDIO_SNAPSHOT) */
+#define AUDIO_TAP_POINT_USB_OUT           0U /* playback packet as received from USB */
+#define AUDIO_TAP_POINT_DSP_OUT           1U /* playback packet after the processing nodes */
+#define AUDIO_TAP_POINT_MIC_RAW           2U /* recording data as produced by the mic */
+#define AUDIO_TAP_POINT_COUNT             3U
+#define AUDIO_TAP_POINT_MASK(point)       (1U << (point))
+
+#ifdef USE_AUDIO_TAP
+#ifndef AUDIO_TAP_DEFAULT_POINTS
+#define AUDIO_TAP_DEFAULT_POINTS          0U /* nothing captured until selected */
+#endif /* AUDIO_TAP_DEFAULT_POINTS */
+#ifndef AUDIO_TAP_RING_SIZE
+#define AUDIO_TAP_RING_SIZE               4096U /* per point, must be a power of two */
+#endif /* AUDIO_TAP_RING_SIZE */
+#define AUDIO_TAP_BLOCK_SIZE              512U  /* max data bytes per frame */
+
+/* frame : AUDIO_TAP_SYNC, point, length (16 bits), dropped bytes (32 bits), data[length]
+   little endian, dropped is the count of bytes of this point lost since start */
+#define AUDIO_TAP_SYNC                    0xC3U
+#define AUDIO_TAP_HEADER_SIZE             8U
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_TapInit(void);
+void     AUDIO_TapSelect(uint32_t points);
+uint32_t AUDIO_TapGetSelected(void);
+uint32_t AUDIO_TapGetDropped(uint8_t point);
+void     AUDIO_TapWrite(uint8_t point, const uint8_t* data, uint32_t length);
+void     AUDIO_TapWriteRegion(uint8_t point, AUDIO_BufferRegionTypeDef* region);
+#endif /* USE_AUDIO_TAP */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_TAP_H */
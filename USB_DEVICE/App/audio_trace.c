@@ -0,0 +1,471 @@
+/**
+  ******************************************************************************
+  * @file    audio_trace.c
+  * @brief   Event trace : interrupts and the pump write time stamped records
+  *          in one lossy ring, the pump sends them in frames on ITM or on the
+  *          CDC IN endpoint. In freeze mode the ring is a flight recorder, the
+  *          first underrun or overrun stops it and the last records before
+  *          the glitch are sent once.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <stdarg.h>
+#include "audio_trace.h"
+
+#ifdef USE_AUDIO_TRACE
+#include "stm32h7xx.h"
+#include "audio_node.h"
+#include "audio_pump.h"
+#include "hal_usb_ex.h"
+#ifndef USE_AUDIO_TRACE_ITM
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#include "usbd_cdc_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#endif /* USE_AUDIO_TRACE_ITM */
+
+#if (AUDIO_TRACE_RING_SIZE & (AUDIO_TRACE_RING_SIZE - 1U)) != 0U
+#error "AUDIO_TRACE_RING_SIZE must be a power of two"
+#endif /* AUDIO_TRACE_RING_SIZE */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_TRACE_SEQ_BUSY              0xFFFFFFFFU /* record being written */
+#define AUDIO_TRACE_FRAME_SIZE            (AUDIO_TRACE_HEADER_SIZE + \
+                                           (AUDIO_TRACE_BLOCK_RECORDS * sizeof(AUDIO_TraceRecordTypeDef)))
+
+/* Private variables ---------------------------------------------------------*/
+/* any context may write , the pump is the only reader */
+static AUDIO_TraceRecordTypeDef trace_ring[AUDIO_TRACE_RING_SIZE] USBD_DEBUG_BSS;
+static volatile uint32_t trace_wr = 0;       /* free running , claimed by the writers */
+static uint32_t          trace_rd = 0;       /* free running , next record to send */
+static volatile uint32_t trace_lost = 0;     /* records overwritten before being sent */
+static volatile uint8_t  trace_mode = AUDIO_TRACE_DEFAULT_MODE;
+static volatile uint8_t  trace_frozen = 0;
+static uint32_t          trace_freeze_time = 0;
+static uint32_t          trace_frame[AUDIO_TRACE_FRAME_SIZE / 4U] USBD_DEBUG_BSS;
+#ifndef USE_AUDIO_TRACE_ITM
+static volatile uint8_t  trace_sending = 0;  /* the CDC transmit is a trace frame */
+#endif /* USE_AUDIO_TRACE_ITM */
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_TraceDrain(void);
+static uint8_t  AUDIO_TraceSendFrame(uint32_t length);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_TraceInit
+  *         empties the ring and registers the drain in the pump, must be
+  *         called after AUDIO_PumpInit. Time stamps need the DWT cycle counter
+  * @param  None
+  * @retval None
+  */
+void AUDIO_TraceInit(void)
+{
+  uint32_t i;
+
+  for(i = 0; i < AUDIO_TRACE_RING_SIZE; i++)
+  {
+    trace_ring[i].seq = AUDIO_TRACE_SEQ_BUSY;
+  }
+  trace_wr = 0;
+  trace_rd = 0;
+  trace_lost = 0;
+  trace_frozen = 0;
+  trace_mode = AUDIO_TRACE_DEFAULT_MODE;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_TRACE, AUDIO_TraceDrain);
+}
+
+/**
+  * @brief  AUDIO_TraceSetMode
+  *         sets the mode and re-arms a frozen trace, records not sent yet are
+  *         discarded. Must be called from the pump
+  * @param  mode: AUDIO_TRACE_MODE_xxx
+  * @retval None
+  */
+void AUDIO_TraceSetMode(uint8_t mode)
+{
+  trace_mode = mode;
+  trace_rd = trace_wr;
+  trace_lost = 0;
+  __DMB();
+  trace_frozen = 0;
+}
+
+/**
+  * @brief  AUDIO_TraceGetMode
+  *         returns the mode
+  * @param  None
+  * @retval AUDIO_TRACE_MODE_xxx
+  */
+uint8_t AUDIO_TraceGetMode(void)
+{
+  return trace_mode;
+}
+
+/**
+  * @brief  AUDIO_TraceIsFrozen
+  *         returns 1 once a glitch froze the trace, until the next AUDIO_TraceSetMode
+  * @param  None
+  * @retval 1 if frozen
+  */
+uint8_t AUDIO_TraceIsFrozen(void)
+{
+  return trace_frozen;
+}
+
+/**
+  * @brief  AUDIO_TraceGetLost
+  *         returns the records overwritten before being sent, since the mode was set
+  * @param  None
+  * @retval lost records
+  */
+uint32_t AUDIO_TraceGetLost(void)
+{
+  return trace_lost;
+}
+
+/**
+  * @brief  AUDIO_TraceFreeze
+  *         in freeze mode, records the reason and stops recording : the
+  *         records of the last AUDIO_TRACE_FREEZE_MS are then sent. Nothing
+  *         happens in stream mode or when already frozen
+  * @param  reason: recorded as the arg of the AUDIO_TRACE_FREEZE record
+  * @retval None
+  */
+void AUDIO_TraceFreeze(uint8_t reason)
+{
+  uint32_t primask;
+  uint32_t wr;
+
+  if((trace_mode != AUDIO_TRACE_MODE_FREEZE) || trace_frozen)
+  {
+    return;
+  }
+  AUDIO_TraceWrite(AUDIO_TRACE_FREEZE, reason, 0);
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(trace_frozen == 0U)
+  {
+    wr = trace_wr;
+    trace_freeze_time = DWT->CYCCNT;
+    /* the whole ring is a candidate , AUDIO_TraceDrain skips the older records */
+    trace_rd = (wr > AUDIO_TRACE_RING_SIZE) ? (wr - AUDIO_TRACE_RING_SIZE) : 0U;
+    __DMB();
+    trace_frozen = 1;
+  }
+  __set_PRIMASK(primask);
+  AUDIO_PumpPost(AUDIO_PUMP_TRACE);
+}
+
+/**
+  * @brief  AUDIO_TraceWrite
+  *         records one event, lock free : writers of any priority claim their
+  *         record then fill it. Dropped while frozen. An underrun or an overrun
+  *         event freezes the trace in freeze mode
+  * @param  type: AUDIO_TRACE_xxx
+  * @param  arg: type specific argument
+  * @param  value: type specific value
+  * @retval None
+  */
+void AUDIO_TraceWrite(uint8_t type, uint8_t arg, uint32_t value)
+{
+  AUDIO_TraceRecordTypeDef* record;
+  uint32_t wr;
+
+  if(trace_frozen)
+  {
+    return;
+  }
+#ifndef USE_AUDIO_TRACE_ITM
+  if((type == AUDIO_TRACE_CDC_TX) && trace_sending)
+  {
+    /* a trace frame must not be traced again */
+    return;
+  }
+#endif /* USE_AUDIO_TRACE_ITM */
+  do
+  {
+    wr = __LDREXW(&trace_wr);
+  }
+  while(__STREXW(wr + 1U, &trace_wr) != 0U);
+
+  record = &trace_ring[wr & (AUDIO_TRACE_RING_SIZE - 1U)];
+  record->seq = AUDIO_TRACE_SEQ_BUSY;
+  __DMB();
+  record->time = DWT->CYCCNT;
+  record->type = type;
+  record->arg = arg;
+  record->sof = (uint16_t)USB_SOF_NUMBER();
+  record->value = value;
+  __DMB();
+  record->seq = wr;
+
+  if((type == AUDIO_TRACE_SESSION_EVENT) &&
+     ((arg == (uint8_t)AUDIO_UNDERRUN) || (arg == (uint8_t)AUDIO_OVERRUN)))
+  {
+    AUDIO_TraceFreeze(arg);
+  }
+  else if(trace_mode == AUDIO_TRACE_MODE_STREAM)
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_TRACE);
+  }
+}
+
+/**
+  * @brief  AUDIO_TraceSnapshot
+  *         copies recent records without consuming them, oldest first. Any
+  *         context, the records being written or overwritten during the
+  *         copy are left out, their seq gap shows it
+  * @param  records: copies
+  * @param  skip: newest records not to copy
+  * @param  max: records to copy at most
+  * @retval records copied
+  */
+uint32_t AUDIO_TraceSnapshot(AUDIO_TraceRecordTypeDef* records, uint32_t skip, uint32_t max)
+{
+  AUDIO_TraceRecordTypeDef* record;
+  uint32_t wr = trace_wr;
+  uint32_t count = 0;
+  uint32_t seq, end;
+
+  if((skip >= wr) || (skip >= AUDIO_TRACE_RING_SIZE))
+  {
+    return 0;
+  }
+  end = wr - skip;
+  if(max > end)
+  {
+    max = end;
+  }
+  if(max > (AUDIO_TRACE_RING_SIZE - skip))
+  {
+    max = AUDIO_TRACE_RING_SIZE - skip;
+  }
+  for(seq = end - max; seq != end; seq++)
+  {
+    record = &trace_ring[seq & (AUDIO_TRACE_RING_SIZE - 1U)];
+    if(record->seq != seq)
+    {
+      continue;
+    }
+    records[count] = *record;
+    __DMB();
+    if(record->seq == seq)
+    {
+      count++;
+    }
+  }
+  return count;
+}
+
+#ifdef USE_AUDIO_TRACE_LOG
+/**
+  * @brief  AUDIO_TraceLog
+  *         records a tokenized log, use AUDIO_TRACE_LOG_FORMAT. The head and
+  *         argument records are claimed at once so other writers don't come
+  *         in between, they share the time stamp. Dropped while frozen
+  * @param  format: format string in the .audio_log_fmt section, never read
+  * @param  count: number of 32 bits arguments which follow
+  * @retval None
+  */
+void AUDIO_TraceLog(const char* format, uint8_t count, ...)
+{
+  AUDIO_TraceRecordTypeDef* record;
+  va_list  args;
+  uint32_t time;
+  uint16_t sof;
+  uint32_t wr;
+  uint8_t  i;
+
+  if(trace_frozen)
+  {
+    return;
+  }
+  count = (count > AUDIO_TRACE_LOG_MAX_ARGS) ? (uint8_t)AUDIO_TRACE_LOG_MAX_ARGS : count;
+  do
+  {
+    wr = __LDREXW(&trace_wr);
+  }
+  while(__STREXW(wr + 1U + count, &trace_wr) != 0U);
+
+  time = DWT->CYCCNT;
+  sof = (uint16_t)USB_SOF_NUMBER();
+  va_start(args, count);
+  for(i = 0; i <= count; i++)
+  {
+    record = &trace_ring[(wr + i) & (AUDIO_TRACE_RING_SIZE - 1U)];
+    record->seq = AUDIO_TRACE_SEQ_BUSY;
+    __DMB();
+    record->time = time;
+    record->sof = sof;
+    if(i == 0U)
+    {
+      record->type = AUDIO_TRACE_LOG;
+      record->arg = count;
+      record->value = (uint32_t)format;
+    }
+    else
+    {
+      record->type = AUDIO_TRACE_LOG_ARG;
+      record->arg = i - 1U;
+      record->value = va_arg(args, uint32_t);
+    }
+    __DMB();
+    record->seq = wr + i;
+  }
+  va_end(args);
+
+  if(trace_mode == AUDIO_TRACE_MODE_STREAM)
+  {
+    AUDIO_PumpPost(AUDIO_PUMP_TRACE);
+  }
+}
+#endif /* USE_AUDIO_TRACE_LOG */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_TraceDrain
+  *         pump handler, run when records are written, when the trace freezes
+  *         and when a CDC transfer completes. Sends frames until the ring is
+  *         empty or the link is busy
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_TraceDrain(void)
+{
+  AUDIO_TraceRecordTypeDef* record;
+  uint8_t* frame = (uint8_t*)trace_frame;
+  uint32_t window = AUDIO_TRACE_FREEZE_MS * (SystemCoreClock / 1000U);
+  uint32_t rd;
+  uint32_t wr;
+  uint32_t seq;
+  uint32_t lost;
+  uint16_t count;
+
+  if((trace_mode == AUDIO_TRACE_MODE_FREEZE) && (trace_frozen == 0U))
+  {
+    /* flight recorder : nothing is sent before a glitch */
+    return;
+  }
+  while(1)
+  {
+    rd = trace_rd;
+    wr = trace_wr;
+    if((wr - rd) > AUDIO_TRACE_RING_SIZE)
+    {
+      /* overwritten by the writers */
+      trace_lost += (wr - rd) - AUDIO_TRACE_RING_SIZE;
+      rd = wr - AUDIO_TRACE_RING_SIZE;
+    }
+    count = 0;
+    while((rd != wr) && (count < AUDIO_TRACE_BLOCK_RECORDS))
+    {
+      record = &trace_ring[rd & (AUDIO_TRACE_RING_SIZE - 1U)];
+      seq = record->seq;
+      if((seq == AUDIO_TRACE_SEQ_BUSY) || ((int32_t)(seq - rd) < 0))
+      {
+        /* claimed and not written yet */
+        break;
+      }
+      __DMB();
+      memcpy(&frame[AUDIO_TRACE_HEADER_SIZE + (count * sizeof(AUDIO_TraceRecordTypeDef))],
+             record, sizeof(AUDIO_TraceRecordTypeDef));
+      __DMB();
+      if((seq != rd) || (record->seq != rd))
+      {
+        /* overwritten while it was copied */
+        trace_lost++;
+      }
+      else if((!trace_frozen) || ((trace_freeze_time - record->time) <= window))
+      {
+        count++;
+      }
+      rd++;
+    }
+    if(count == 0U)
+    {
+      trace_rd = rd;
+      return;
+    }
+    lost = trace_lost;
+    frame[0] = AUDIO_TRACE_SYNC;
+    frame[1] = trace_frozen ? AUDIO_TRACE_FRAME_FROZEN : 0U;
+    frame[2] = (uint8_t)count;
+    frame[3] = (uint8_t)(count >> 8);
+    frame[4] = (uint8_t)lost;
+    frame[5] = (uint8_t)(lost >> 8);
+    frame[6] = (uint8_t)(lost >> 16);
+    frame[7] = (uint8_t)(lost >> 24);
+    if(AUDIO_TraceSendFrame(AUDIO_TRACE_HEADER_SIZE + (count * sizeof(AUDIO_TraceRecordTypeDef))) != 0U)
+    {
+      /* link busy, the same records are read again on transfer complete */
+      return;
+    }
+    trace_rd = rd;
+  }
+}
+
+#ifdef USE_AUDIO_TRACE_ITM
+/**
+  * @brief  AUDIO_TraceSendFrame
+  *         writes one frame on the ITM stimulus port, the frame is dropped
+  *         when no debugger enabled the port
+  * @param  length: frame length in bytes, multiple of 4
+  * @retval 0, ITM is never busy
+  */
+static uint8_t AUDIO_TraceSendFrame(uint32_t length)
+{
+  uint32_t i;
+
+  if(((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0U) || ((ITM->TER & (1UL << AUDIO_TRACE_ITM_PORT)) == 0U))
+  {
+    return 0;
+  }
+  for(i = 0; i < (length / 4U); i++)
+  {
+    while(ITM->PORT[AUDIO_TRACE_ITM_PORT].u32 == 0U) {}
+    ITM->PORT[AUDIO_TRACE_ITM_PORT].u32 = trace_frame[i];
+  }
+  return 0;
+}
+#else /* USE_AUDIO_TRACE_ITM */
+/**
+  * @brief  AUDIO_TraceSendFrame
+  *         queues one frame on the CDC IN endpoint, the telemetry CDC one
+  *         with USE_AUDIO_CDC_TELEMETRY
+  * @param  length: frame length in bytes
+  * @retval 0 if queued, 1 if the CDC transmit ring is full
+  */
+static uint8_t AUDIO_TraceSendFrame(uint32_t length)
+{
+  uint8_t ret;
+
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  ret = (CDC_TLM_Transmit((uint8_t*)trace_frame, (uint16_t)length) != USBD_OK) ? 1U : 0U;
+#else /* USE_AUDIO_CDC_TELEMETRY */
+  trace_sending = 1;
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+  /* trace records are small and not awaited , they share packets */
+  ret = (CDC_TransmitPolicy_FS((uint8_t*)trace_frame, (uint16_t)length, CDC_TX_COALESCE) != USBD_OK) ? 1U : 0U;
+#else /* USE_AUDIO_CDC_TX_COALESCE */
+  ret = (CDC_Transmit_FS((uint8_t*)trace_frame, (uint16_t)length) != USBD_OK) ? 1U : 0U;
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
+  trace_sending = 0;
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+  return ret;
+}
+#endif /* USE_AUDIO_TRACE_ITM */
+#endif /* USE_AUDIO_TRACE */
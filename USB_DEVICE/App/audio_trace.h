@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file    audio_trace.h
+  * @brief   header file for the audio_trace.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_TRACE_H
+#define __AUDIO_TRACE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_TRACE
+/* Exported constants --------------------------------------------------------*/
+/* record types , arg and value meaning */
+#define AUDIO_TRACE_SESSION_EVENT         0x01U /* AUDIO_SessionEventTypeDef , node address */
+#define AUDIO_TRACE_ALTERNATE             0x02U /* AS interface index , new alternate */
+#define AUDIO_TRACE_RATE                  0x03U /* 0 , sampling frequency set by the host */
+#define AUDIO_TRACE_FEEDBACK              0x04U /* feedback endpoint number , rate returned by GetFeedback */
+#define AUDIO_TRACE_ISO_IN_INCOMPLETE     0x05U /* endpoint number , incomplete count */
+#define AUDIO_TRACE_ISO_OUT_INCOMPLETE    0x06U /* endpoint number , incomplete count */
+#define AUDIO_TRACE_CDC_RX                0x07U /* 0 , length */
+#define AUDIO_TRACE_CDC_TX                0x08U /* 0 , length , the trace frames are not recorded */
+#define AUDIO_TRACE_FREEZE                0x09U /* event which froze the trace , 0 */
+#define AUDIO_TRACE_SOF_JITTER            0x0AU /* frames without SOF in the window , SOF jitter peak in ns */
+#define AUDIO_TRACE_LOG                   0x0BU /* argument count , format id , USE_AUDIO_TRACE_LOG */
+#define AUDIO_TRACE_LOG_ARG               0x0CU /* argument index , argument , follows its AUDIO_TRACE_LOG record */
+#define AUDIO_TRACE_ADMISSION             0x0DU /* endpoint address , periodic bytes per (micro)frame asked , USE_AUDIO_USB_ADMISSION */
+
+/* modes */
+#define AUDIO_TRACE_MODE_STREAM           0x00U /* records are sent as they come, lost when the link is slow */
+#define AUDIO_TRACE_MODE_FREEZE           0x01U /* records are kept until a glitch, then the last
+                                                   AUDIO_TRACE_FREEZE_MS before it are sent once */
+#ifndef AUDIO_TRACE_DEFAULT_MODE
+#define AUDIO_TRACE_DEFAULT_MODE          AUDIO_TRACE_MODE_FREEZE
+#endif /* AUDIO_TRACE_DEFAULT_MODE */
+#ifndef AUDIO_TRACE_RING_SIZE
+#define AUDIO_TRACE_RING_SIZE             512U  /* records, must be a power of two */
+#endif /* AUDIO_TRACE_RING_SIZE */
+#define AUDIO_TRACE_FREEZE_MS             50U
+#define AUDIO_TRACE_BLOCK_RECORDS         16U   /* max records per frame */
+/* with USE_AUDIO_TRACE_ITM the frames go out on this stimulus port , port 0 is used by
+   the profiler text dump. Otherwise they are sent on the CDC IN endpoint, the
+   telemetry CDC one with USE_AUDIO_CDC_TELEMETRY */
+#define AUDIO_TRACE_ITM_PORT              1U
+
+/* frame : AUDIO_TRACE_SYNC, flags, count (16 bits), lost records (32 bits), then count
+   records of AUDIO_TraceRecordTypeDef , little endian */
+#define AUDIO_TRACE_SYNC                  0xE1U
+#define AUDIO_TRACE_FRAME_FROZEN          0x01U /* frame flag : records of a frozen trace */
+#define AUDIO_TRACE_HEADER_SIZE           8U
+
+/* tokenized log : the format strings are kept in the .audio_log_fmt section of the ELF
+   file, not loaded in the target. A log writes one AUDIO_TRACE_LOG record whose value
+   is the address of its format in that section, then one AUDIO_TRACE_LOG_ARG record
+   per argument with consecutive seq. The host formats the text from the ELF file */
+#define AUDIO_TRACE_LOG_MAX_ARGS          4U
+
+/* Exported types ------------------------------------------------------------*/
+/* 16 bytes , seq is written last by the producer */
+typedef struct
+{
+  uint32_t          time;   /* DWT cycle counter */
+  volatile uint32_t seq;    /* free running index of the record */
+  uint8_t           type;   /* AUDIO_TRACE_xxx */
+  uint8_t           arg;
+  uint16_t          sof;    /* USB frame number */
+  uint32_t          value;
+}
+AUDIO_TraceRecordTypeDef;
+
+/* Exported macro ------------------------------------------------------------*/
+#define AUDIO_TRACE(type, arg, value)     AUDIO_TraceWrite((type), (uint8_t)(arg), (uint32_t)(value))
+#ifdef USE_AUDIO_TRACE_LOG
+/* ISR safe printf : only the format id and the arguments are stored, up to
+   AUDIO_TRACE_LOG_MAX_ARGS 32 bits integers. %s prints the address of the string */
+#define AUDIO_TRACE_LOG_FORMAT(fmt, ...)  do { \
+                                            static const char audio_trace_log_fmt[] \
+                                              __attribute__((section(".audio_log_fmt"), used)) = fmt; \
+                                            AUDIO_TraceLog(audio_trace_log_fmt, \
+                                                           AUDIO_TRACE_LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+                                          } while(0)
+#define AUDIO_TRACE_LOG_NARGS(...)        AUDIO_TRACE_LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define AUDIO_TRACE_LOG_NARGS_(_0, _1, _2, _3, _4, n, ...) (n)
+#endif /* USE_AUDIO_TRACE_LOG */
+
+/* Exported functions ------------------------------------------------------- */
+void     AUDIO_TraceInit(void);
+void     AUDIO_TraceSetMode(uint8_t mode);
+uint8_t  AUDIO_TraceGetMode(void);
+uint8_t  AUDIO_TraceIsFrozen(void);
+uint32_t AUDIO_TraceGetLost(void);
+void     AUDIO_TraceFreeze(uint8_t reason);
+void     AUDIO_TraceWrite(uint8_t type, uint8_t arg, uint32_t value);
+uint32_t AUDIO_TraceSnapshot(AUDIO_TraceRecordTypeDef* records, uint32_t skip, uint32_t max);
+#ifdef USE_AUDIO_TRACE_LOG
+void     AUDIO_TraceLog(const char* format, uint8_t count, ...);
+#endif /* USE_AUDIO_TRACE_LOG */
+#else /* USE_AUDIO_TRACE */
+#define AUDIO_TRACE(type, arg, value)
+#ifdef USE_AUDIO_TRACE_LOG
+#error "USE_AUDIO_TRACE_LOG stores the logs in the trace ring, USE_AUDIO_TRACE is required"
+#endif /* USE_AUDIO_TRACE_LOG */
+#endif /* USE_AUDIO_TRACE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_TRACE_H */
@@ -0,0 +1,270 @@
+/**
+  ******************************************************************************
+  * @file    audio_upsampler.c
+  * @brief   Polyphase FIR upsampler : the host stream is converted to the
+  *          fixed rate of the DAC. A Blackman windowed sinc of 32 taps at the
+  *          input rate is tabulated on 64 sub-sample positions; the taps of an
+  *          output frame are interpolated between the two nearest positions,
+  *          so any ratio is played exactly, 44.1 kHz as well as 48 kHz. The
+  *          position is kept as a fraction of the output rate, it never drifts.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <math.h>
+#include "audio_upsampler.h"
+
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_UPSAMPLER_CUTOFF            0.9f /* of the input Nyquist rate */
+#define AUDIO_UPSAMPLER_COEF_FRAC_BITS    15U  /* Q15 taps */
+#define AUDIO_UPSAMPLER_SAMPLE_MAX        0x7FFFFF /* samples are filtered on 24 bits */
+
+#if (AUDIO_UPSAMPLER_TAPS % 2U) != 0
+#error "AUDIO_UPSAMPLER_TAPS must be even"
+#endif /* AUDIO_UPSAMPLER_TAPS */
+
+/* Private variables ---------------------------------------------------------*/
+/* taps of each sub-sample position, from the oldest input frame. The last row
+   is the next input frame position, the interpolation never wraps. Read for
+   every output frame so kept in DTCM */
+__ALIGN_BEGIN static int16_t upsampler_coeffs[AUDIO_UPSAMPLER_PHASES + 1U][AUDIO_UPSAMPLER_TAPS] __ALIGN_END USBD_DTCM_BSS;
+static uint8_t upsampler_coeffs_ready = 0;
+
+/* Private function prototypes -----------------------------------------------*/
+static void    AUDIO_UpsamplerBuildCoeffs(void);
+static int32_t AUDIO_UpsamplerLoadSample(const AUDIO_BufferRegionTypeDef* input, uint32_t offset,
+                                         uint8_t res) USBD_ITCM_FUNC;
+static void    AUDIO_UpsamplerStoreSample(uint8_t* output, int32_t sample, uint8_t res) USBD_ITCM_FUNC;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_UpsamplerInit
+  *         Initializes the conversion of a stream, history is silence. The
+  *         taps are computed on first call
+  * @param  upsampler: upsampler to initialize
+  * @param  in_rate: stream rate, at most out_rate
+  * @param  out_rate: DAC rate
+  * @param  channels: channels count , at most AUDIO_UPSAMPLER_MAX_CHANNELS
+  * @param  res: bytes per sample , 2, 3 or 4
+  * @retval None
+  */
+void  AUDIO_UpsamplerInit(AUDIO_UpsamplerTypeDef* upsampler, uint32_t in_rate, uint32_t out_rate,
+                          uint8_t channels, uint8_t res)
+{
+  if(!upsampler_coeffs_ready)
+  {
+    AUDIO_UpsamplerBuildCoeffs();
+    upsampler_coeffs_ready = 1;
+  }
+  memset(upsampler, 0, sizeof(AUDIO_UpsamplerTypeDef));
+  upsampler->in_rate = in_rate;
+  upsampler->out_rate = out_rate;
+  upsampler->channels = (channels > AUDIO_UPSAMPLER_MAX_CHANNELS) ? AUDIO_UPSAMPLER_MAX_CHANNELS : channels;
+  upsampler->res = res;
+#ifdef USE_AUDIO_DITHER
+  AUDIO_DitherInit(&upsampler->dither, upsampler->channels);
+#endif /* USE_AUDIO_DITHER */
+}
+
+/**
+  * @brief  AUDIO_UpsamplerInputFrames
+  *         input frames the next AUDIO_UpsamplerProcess call consumes
+  * @param  upsampler: upsampler
+  * @param  output_frames: count of frames to produce
+  * @retval input frames count
+  */
+uint32_t  AUDIO_UpsamplerInputFrames(const AUDIO_UpsamplerTypeDef* upsampler, uint32_t output_frames)
+{
+  return (uint32_t)(((uint64_t)output_frames * upsampler->in_rate + upsampler->phase) / upsampler->out_rate);
+}
+
+/**
+  * @brief  AUDIO_UpsamplerProcess
+  *         Produces output_frames frames in the SAI slot layout : 16 bits
+  *         samples in 16 bits slots, 24 bits right aligned and 32 bits in 32
+  *         bits slots
+  * @param  upsampler: upsampler
+  * @param  input: input frames, holds at least AUDIO_UpsamplerInputFrames frames
+  * @param  output: output frames
+  * @param  output_frames: count of frames to produce
+  * @retval consumed input bytes, to commit by caller
+  */
+uint32_t  AUDIO_UpsamplerProcess(AUDIO_UpsamplerTypeDef* upsampler, const AUDIO_BufferRegionTypeDef* input,
+                                 uint8_t* output, uint32_t output_frames)
+{
+  uint32_t frame_size = upsampler->channels * upsampler->res;
+  uint32_t slot_size = (upsampler->res == 2U) ? 2U : 4U;
+  uint32_t consumed = 0;
+  int32_t  coeffs[AUDIO_UPSAMPLER_TAPS];
+  const int16_t* c0;
+  const int16_t* c1;
+  const int32_t* window;
+  uint64_t position;
+  int32_t  frac;
+  int32_t  sample;
+  int64_t  acc;
+  uint32_t ch, j;
+
+  while(output_frames--)
+  {
+    /* taps of the output position, between two tabulated positions */
+    position = (uint64_t)upsampler->phase * AUDIO_UPSAMPLER_PHASES;
+    c0 = upsampler_coeffs[position / upsampler->out_rate];
+    c1 = c0 + AUDIO_UPSAMPLER_TAPS;
+    frac = (int32_t)(((position % upsampler->out_rate) << AUDIO_UPSAMPLER_COEF_FRAC_BITS) / upsampler->out_rate);
+    for(j = 0; j < AUDIO_UPSAMPLER_TAPS; j++)
+    {
+      coeffs[j] = c0[j] + (((c1[j] - c0[j]) * frac) >> AUDIO_UPSAMPLER_COEF_FRAC_BITS);
+    }
+
+    for(ch = 0; ch < upsampler->channels; ch++)
+    {
+      window = &upsampler->history[ch][upsampler->pos];
+      acc = 0;
+      for(j = 0; j < AUDIO_UPSAMPLER_TAPS; j++)
+      {
+        acc += (int64_t)window[j] * coeffs[j];
+      }
+      sample = (int32_t)((acc + (1 << (AUDIO_UPSAMPLER_COEF_FRAC_BITS - 1U))) >> AUDIO_UPSAMPLER_COEF_FRAC_BITS);
+#ifdef USE_AUDIO_DITHER
+      if(upsampler->res == 2U)
+      {
+        *(int16_t*)output = AUDIO_DitherSample16(&upsampler->dither.channel[ch], sample);
+      }
+      else
+#endif /* USE_AUDIO_DITHER */
+      {
+        AUDIO_UpsamplerStoreSample(output, sample, upsampler->res);
+      }
+      output += slot_size;
+    }
+
+    /* shift in the input frames passed over by the output position */
+    upsampler->phase += upsampler->in_rate;
+    while(upsampler->phase >= upsampler->out_rate)
+    {
+      upsampler->phase -= upsampler->out_rate;
+      for(ch = 0; ch < upsampler->channels; ch++)
+      {
+        sample = AUDIO_UpsamplerLoadSample(input, consumed + ch * upsampler->res, upsampler->res);
+        upsampler->history[ch][upsampler->pos] = sample;
+        upsampler->history[ch][upsampler->pos + AUDIO_UPSAMPLER_TAPS] = sample;
+      }
+      upsampler->pos = (upsampler->pos + 1U == AUDIO_UPSAMPLER_TAPS) ? 0U : upsampler->pos + 1U;
+      consumed += frame_size;
+    }
+  }
+  return consumed;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_UpsamplerBuildCoeffs
+  *         computes the taps of each sub-sample position. Every row is
+  *         normalized to a unity DC gain, so no position modulates the level
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_UpsamplerBuildCoeffs(void)
+{
+  float taps[AUDIO_UPSAMPLER_TAPS];
+  float sum;
+  float t, w, x;
+  uint32_t p, j;
+
+  for(p = 0; p <= AUDIO_UPSAMPLER_PHASES; p++)
+  {
+    sum = 0.0f;
+    for(j = 0; j < AUDIO_UPSAMPLER_TAPS; j++)
+    {
+      /* distance of the input frame to the output position, in input frames */
+      t = (float)j - (float)(AUDIO_UPSAMPLER_TAPS / 2U - 1U) - (float)p / (float)AUDIO_UPSAMPLER_PHASES;
+      w = 0.42f + 0.5f * cosf(2.0f * (float)M_PI * t / (float)AUDIO_UPSAMPLER_TAPS) +
+          0.08f * cosf(4.0f * (float)M_PI * t / (float)AUDIO_UPSAMPLER_TAPS);
+      x = (float)M_PI * AUDIO_UPSAMPLER_CUTOFF * t;
+      taps[j] = (x == 0.0f) ? w : (w * sinf(x) / x);
+      sum += taps[j];
+    }
+    for(j = 0; j < AUDIO_UPSAMPLER_TAPS; j++)
+    {
+      upsampler_coeffs[p][j] = (int16_t)lroundf(taps[j] * (float)(1U << AUDIO_UPSAMPLER_COEF_FRAC_BITS) / sum);
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_UpsamplerLoadSample
+  *         reads a little endian sample of the input, a sample may be split
+  *         by the ring end. Samples are scaled to 24 bits
+  * @param  input: input frames
+  * @param  offset: byte offset of the sample in the input
+  * @param  res: bytes per sample
+  * @retval sample value
+  */
+static int32_t  AUDIO_UpsamplerLoadSample(const AUDIO_BufferRegionTypeDef* input, uint32_t offset, uint8_t res)
+{
+  uint32_t value = 0;
+  uint32_t o;
+  uint8_t i;
+
+  for(i = 0; i < res; i++)
+  {
+    o = offset + i;
+    value |= (uint32_t)((o < input->length[0]) ? input->data[0][o] : input->data[1][o - input->length[0]]) << (8U * i);
+  }
+  if(res == 2U)
+  {
+    return (int32_t)(int16_t)value * 256;
+  }
+  if(res == 3U)
+  {
+    return ((int32_t)(value << 8)) >> 8;
+  }
+  return ((int32_t)value) >> 8;
+}
+
+/**
+  * @brief  AUDIO_UpsamplerStoreSample
+  *         writes a sample, saturated to 24 bits, in its SAI slot
+  * @param  output: slot
+  * @param  sample: value on 24 bits
+  * @param  res: bytes per input sample
+  * @retval None
+  */
+static void  AUDIO_UpsamplerStoreSample(uint8_t* output, int32_t sample, uint8_t res)
+{
+  if(sample > AUDIO_UPSAMPLER_SAMPLE_MAX)
+  {
+    sample = AUDIO_UPSAMPLER_SAMPLE_MAX;
+  }
+  if(sample < -AUDIO_UPSAMPLER_SAMPLE_MAX - 1)
+  {
+    sample = -AUDIO_UPSAMPLER_SAMPLE_MAX - 1;
+  }
+  if(res == 2U)
+  {
+    *(int16_t*)output = (int16_t)(sample >> 8);
+  }
+  else if(res == 3U)
+  {
+    *(int32_t*)output = sample;
+  }
+  else
+  {
+    *(uint32_t*)output = (uint32_t)sample << 8;
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    audio_upsampler.h
+  * @brief   header file for the audio_upsampler.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_UPSAMPLER_H
+#define __AUDIO_UPSAMPLER_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_conf.h"
+#include "audio_node.h"
+#include "audio_dither.h"
+
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_UPSAMPLER_PHASES            64U  /* sub-sample positions of the prototype filter */
+#define AUDIO_UPSAMPLER_TAPS              32U  /* input frames per output frame */
+#define AUDIO_UPSAMPLER_MAX_CHANNELS      8U
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t  in_rate;
+  uint32_t  out_rate;
+  uint32_t  phase;      /* next output position after the filter center, in 1 / out_rate input frames */
+  uint8_t   channels;
+  uint8_t   res;        /* bytes per input sample , 2, 3 or 4 */
+  uint8_t   pos;        /* next write index in history */
+  int32_t   history[AUDIO_UPSAMPLER_MAX_CHANNELS][2U * AUDIO_UPSAMPLER_TAPS]; /* written twice, the window is contiguous */
+#ifdef USE_AUDIO_DITHER
+  AUDIO_DitherTypeDef dither; /* 24 bits filtered samples to 16 bits slots */
+#endif /* USE_AUDIO_DITHER */
+}
+AUDIO_UpsamplerTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+void      AUDIO_UpsamplerInit(AUDIO_UpsamplerTypeDef* upsampler, uint32_t in_rate, uint32_t out_rate,
+                              uint8_t channels, uint8_t res);
+uint32_t  AUDIO_UpsamplerInputFrames(const AUDIO_UpsamplerTypeDef* upsampler, uint32_t output_frames);
+uint32_t  AUDIO_UpsamplerProcess(AUDIO_UpsamplerTypeDef* upsampler, const AUDIO_BufferRegionTypeDef* input,
+                                 uint8_t* output, uint32_t output_frames) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_UPSAMPLER_H */
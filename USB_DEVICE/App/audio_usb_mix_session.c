@@ -0,0 +1,320 @@
+/**
+  ******************************************************************************
+  * @file    audio_usb_mix_session.c
+  * @brief   usb audio mix session : a second play streaming interface, 16 bits
+  *          with the play channels, received in its own ring and added to the
+  *          speaker output by the mixer node. It has its own feature unit and
+  *          shares the play clock source, so it always runs at the play rate.
+  *          The speaker clock paces its ring; there is no feedback endpoint
+  *          for it, the mixer drops or waits for whole frames instead.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_audio.h"
+#include "usb_audio_user.h"
+#include "audio_speaker_node.h"
+#include "audio_sessions_usb.h"
+#include "audio_mixer_node.h"
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+
+#ifdef USE_AUDIO_PLAYBACK_MIX
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_Mix_SessionStart(AUDIO_USB_SessionTypedef* session);
+static int8_t  AUDIO_Mix_SessionStop(AUDIO_USB_SessionTypedef* session);
+static int8_t  AUDIO_Mix_SessionDeInit(uint32_t session_handle);
+static int8_t  AUDIO_Mix_SessionCallback(AUDIO_SessionEventTypeDef  event,
+                                          AUDIO_NodeTypeDef* node,
+                                          struct    AUDIO_Session* session_handle);
+static int8_t  AUDIO_Mix_SetAS_Alternate(uint8_t alternate, uint32_t session_handle);
+static int8_t  AUDIO_Mix_GetState(uint32_t session_handle);
+static void    AUDIO_Mix_InitializesBuffer(AUDIO_USB_SessionTypedef* mix_session);
+
+/* Private variables ---------------------------------------------------------*/
+/* list of used nodes */
+static AUDIO_USB_IO_NodeTypeDef usb_mix_input;
+static AUDIO_DescriptionTypeDef mix_audio_description;
+static AUDIO_USB_CF_NodeTypeDef mix_feature_control;
+static AUDIO_Mixer_NodeTypeDef mix_mixer;
+/* nodes of the mix path, as described to the host */
+#define AUDIO_MIX_ENTITY(subtype, id, source, type, node) { (id), (source), (AUDIO_NodeTypeDef*)&(node) },
+static const AUDIO_USB_EntityTypeDef mix_entities[] = { AUDIO_TOPOLOGY_MIX(AUDIO_MIX_ENTITY) };
+/* mix ring, USB packets are received in place */
+__ALIGN_BEGIN static uint8_t mix_buffer_data[USBD_AUDIO_CONFIG_MIX_BUFFER_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+static uint32_t mix_start_threshold;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_Mix_SessionInit
+  *         Initializes the mix (streaming) session
+  * @param  as_desc:  audio streaming callbacks
+  * @param  controls_desc: list of control
+  * @param  control_count: list of control count
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+int8_t  AUDIO_Mix_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
+                              USBD_AUDIO_ControlTypeDef* controls_desc,
+                              uint8_t* control_count, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *mix_session;
+  AUDIO_ControlDeviceDefaultsTypedef controller_defaults;
+
+  mix_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  memset(mix_session, 0, sizeof(AUDIO_USB_SessionTypedef));
+
+  mix_session->interface_num = USBD_AUDIO_CONFIG_MIX_SA_INTERFACE;
+  mix_session->alternate = 0;
+  mix_session->SessionDeInit = AUDIO_Mix_SessionDeInit;
+  mix_session->session.SessionCallback = AUDIO_Mix_SessionCallback;
+  mix_session->session.event_mask = AUDIO_SESSION_EVENT_BIT(AUDIO_OVERRUN);
+  mix_session->buffer.data = mix_buffer_data;
+  /*set audio used option*/
+  mix_audio_description.audio_res = USBD_AUDIO_CONFIG_MIX_RES_BYTE;
+  mix_audio_description.audio_type = USBD_AUDIO_FORMAT_TYPE_PCM; /* PCM*/
+  mix_audio_description.channels_count = USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT;
+  mix_audio_description.channels_map = USBD_AUDIO_CONFIG_PLAY_CHANNEL_MAP;
+  mix_audio_description.frequence = USB_AUDIO_CONFIG_PLAY_DEF_FREQ;
+  mix_audio_description.audio_volume_db_256 = VOLUME_SPEAKER_DEFAULT_DB_256;
+  mix_audio_description.audio_mute = 0;
+  *control_count = 0;
+
+  /* create usb input node, on the mix endpoint */
+  USB_AUDIO_Streaming_Input_Init(&as_desc->data_ep, &mix_audio_description, &mix_session->session, (uint32_t)&usb_mix_input);
+  as_desc->data_ep.ep_num = USBD_AUDIO_CONFIG_MIX_EP_OUT;
+  mix_session->session.node_list = (AUDIO_NodeTypeDef*)&usb_mix_input;
+  /* initialize usb feature node, the clock source is the play one */
+  controller_defaults.audio_description = &mix_audio_description;
+  controller_defaults.max_volume = VOLUME_SPEAKER_MAX_DB_256;
+  controller_defaults.min_volume = VOLUME_SPEAKER_MIN_DB_256;
+  controller_defaults.res_volume = VOLUME_SPEAKER_RES_DB_256;
+  USB_AUDIO_Streaming_CF_Init(controls_desc, &controller_defaults, USB_AUDIO_CONFIG_MIX_UNIT_FEATURE_ID, (uint32_t)&mix_feature_control);
+  (*control_count)++;
+  /* the mixer is the ring consumer, the speaker calls it on each DMA half */
+  AUDIO_MixerInit(&mix_audio_description, &mix_session->session, (uint32_t)&mix_mixer);
+  AUDIO_USB_LinkTopology(mix_entities, (uint8_t)(sizeof(mix_entities) / sizeof(mix_entities[0])));
+
+  /* set USB AUDIO class callbacks */
+  as_desc->interface_num = mix_session->interface_num;
+  as_desc->alternate = 0;
+  as_desc->max_alternate = 1;
+  as_desc->private_data = session_handle;
+  as_desc->SetAS_Alternate = AUDIO_Mix_SetAS_Alternate;
+  as_desc->GetState = AUDIO_Mix_GetState;
+
+  AUDIO_Mix_InitializesBuffer(mix_session);
+  mix_session->session.state = AUDIO_SESSION_INITIALIZED;
+
+  return 0;
+}
+
+#ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
+/**
+  * @brief  AUDIO_Mix_SessionSetFrequency
+  *         follows a frequency change of the shared play clock source
+  * @param  freq: new frequency
+  * @param  as_cnt_to_restart: count of streaming interfaces to restart, incremented
+  * @param  as_list_to_restart: list of streaming interfaces to restart
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_Mix_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef * mix_session = (AUDIO_USB_SessionTypedef *)session_handle;
+
+  AUDIO_DescriptionWriteBegin(&mix_audio_description);
+  mix_audio_description.frequence = freq;
+  AUDIO_DescriptionWriteEnd(&mix_audio_description);
+  usb_mix_input.IOChangeFrequency((uint32_t)&usb_mix_input);
+  AUDIO_Mix_InitializesBuffer(mix_session);
+  if(mix_session->session.state == AUDIO_SESSION_STARTED)
+  {
+    as_list_to_restart[*as_cnt_to_restart] = mix_session->interface_num;
+    (*as_cnt_to_restart)++;
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_Mix_SessionStart
+  *         Starts the mix (streaming) session
+  * @param  mix_session: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Mix_SessionStart(AUDIO_USB_SessionTypedef* mix_session)
+{
+  if((mix_session->session.state == AUDIO_SESSION_INITIALIZED)
+     ||(mix_session->session.state == AUDIO_SESSION_STOPPED))
+  {
+    AUDIO_DevicesCommandsTypedef commands;
+
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(mix_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
+    usb_mix_input.IOStart(&mix_session->buffer, mix_start_threshold, (uint32_t)&usb_mix_input);
+    mix_mixer.MixerStart(&mix_session->buffer, mix_start_threshold, (uint32_t)&mix_mixer);
+    commands.private_data = (uint32_t)&mix_mixer;
+    commands.SetMute = mix_mixer.MixerMute;
+    commands.SetCurrentVolume = mix_mixer.MixerSetVolume;
+    mix_feature_control.CFStart(&commands, (uint32_t)&mix_feature_control);
+    mix_session->session.state = AUDIO_SESSION_STARTED;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_SessionStop
+  *         Stop the mix (streaming) session
+  * @param  mix_session: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Mix_SessionStop(AUDIO_USB_SessionTypedef* mix_session)
+{
+  if(mix_session->session.state == AUDIO_SESSION_STARTED)
+  {
+    mix_mixer.MixerStop((uint32_t)&mix_mixer);
+    usb_mix_input.IOStop((uint32_t)&usb_mix_input);
+    mix_feature_control.CFStop((uint32_t)&mix_feature_control);
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(mix_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
+    mix_session->session.state = AUDIO_SESSION_STOPPED;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_SessionDeInit
+  *         De-Initializes the mix (streaming) session
+  * @param  session_handle: session handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Mix_SessionDeInit(uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef* mix_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(mix_session->session.state != AUDIO_SESSION_OFF)
+  {
+    if(mix_session->session.state == AUDIO_SESSION_STARTED)
+    {
+      AUDIO_Mix_SessionStop(mix_session);
+    }
+    mix_mixer.MixerDeInit((uint32_t)&mix_mixer);
+    mix_feature_control.CFDeInit((uint32_t)&mix_feature_control);
+    usb_mix_input.IODeInit((uint32_t)&usb_mix_input);
+    mix_session->session.state = AUDIO_SESSION_OFF;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_SessionCallback
+  *         session callback, the mixer consumes the ring from the speaker
+  *         interrupt so only overruns are handled here : the oldest whole
+  *         frames are dropped down to the start threshold
+  * @param  event:
+  * @param  node:
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Mix_SessionCallback(AUDIO_SessionEventTypeDef  event,
+                                          AUDIO_NodeTypeDef* node,
+                                          struct    AUDIO_Session* session_handle)
+{
+  AUDIO_USB_SessionTypedef * mix_session = (AUDIO_USB_SessionTypedef *)session_handle;
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&mix_audio_description);
+  uint32_t filled;
+
+  switch(event)
+  {
+  case AUDIO_OVERRUN:
+    AUDIO_BufferTelemetryGlitch(&mix_session->buffer, 1U, HAL_GetTick());
+    filled = AUDIO_BUFFER_FILLED_SIZE(&mix_session->buffer);
+    if(filled > mix_start_threshold)
+    {
+      mix_mixer.drop_length = ((filled - mix_start_threshold) / frame_size) * frame_size;
+    }
+    break;
+  default :
+    break;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_SetAS_Alternate
+  *         set AS interface alternate callback
+  * @param  alternate:
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Mix_SetAS_Alternate(uint8_t alternate, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef * mix_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(alternate == 0)
+  {
+    if(mix_session->alternate != 0)
+    {
+      AUDIO_Mix_SessionStop(mix_session);
+      mix_session->alternate = 0;
+    }
+  }
+  else
+  {
+    if(mix_session->alternate == 0)
+    {
+      AUDIO_Mix_SessionStart(mix_session);
+      mix_session->alternate = alternate;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_GetState
+  *         return AS interface state
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Mix_GetState(uint32_t session_handle)
+{
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Mix_InitializesBuffer
+  *         sizes the ring and the start threshold for the current rate, a
+  *         packet may always cross the ring end so margin is the max packet
+  * @param  mix_session: session, must be stopped
+  * @retval None
+  */
+static void  AUDIO_Mix_InitializesBuffer(AUDIO_USB_SessionTypedef* mix_session)
+{
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&mix_audio_description);
+  uint32_t threshold = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&mix_audio_description) * USBD_AUDIO_CONFIG_MIX_START_MS;
+
+  AUDIO_USB_InitializesDataBuffer(&mix_session->buffer, USBD_AUDIO_CONFIG_MIX_BUFFER_SIZE,
+                                  AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&mix_audio_description), usb_mix_input.max_packet_length);
+  if(threshold > (mix_session->buffer.size >> 1))
+  {
+    threshold = mix_session->buffer.size >> 1;
+  }
+  mix_start_threshold = (threshold / frame_size) * frame_size;
+}
+#endif /* USE_AUDIO_PLAYBACK_MIX */
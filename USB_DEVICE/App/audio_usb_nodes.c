@@ -48,9 +48,48 @@
 /* Includes ------------------------------------------------------------------*/
 #include "usb_audio_user.h"
 #include "audio_usb_nodes.h"
+#include "audio_pump.h"
+#include "audio_tap.h"
+#include "audio_snapshot.h"
+#ifdef USE_AUDIO_SPECTRUM
+#include "audio_spectrum.h"
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_MIC_PATTERN
+#include "audio_pattern.h"
+#endif /* USE_AUDIO_MIC_PATTERN */
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+#include "audio_sof_tick.h"
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+#include "audio_pcm.h"
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
 
 /* External variables --------------------------------------------------------*/
 /* Private macros ------------------------------------------------------------*/
+/* data EP callbacks are called directly by the class with USE_AUDIO_USB_DIRECT_DISPATCH, see usbd_audio.h */
+#ifdef USE_AUDIO_USB_DIRECT_DISPATCH
+#define USB_AUDIO_DATA_EP_CBK
+#else /* USE_AUDIO_USB_DIRECT_DISPATCH */
+#define USB_AUDIO_DATA_EP_CBK  static
+#endif /* USE_AUDIO_USB_DIRECT_DISPATCH */
+/* Define USE_AUDIO_USB_ALTERNATE_ALLOC to allocate the node packet buffers when the host
+   selects a streaming alternate and release them on alternate 0 : an enumerated but idle
+   device keeps only the class handles in the USBD_malloc arena */
+/* Define USE_AUDIO_USB_OUT_PINGPONG to receive the playback packets in two buffers out of
+   the ring : the OUT endpoint is armed with one before the other is processed and copied
+   to the ring, so it is never left unarmed while the chain runs */
+/* Define USE_AUDIO_CONTROL_MAILBOX to apply the feature unit SET_CUR requests from the
+   audio level of the pump, once per ms frame : a burst of volume requests from a host
+   slider keeps only the latest value of each channel and reaches the device once, the
+   gain ramp of the volume node smooths the step */
+/* Define USE_AUDIO_MUTE_BYPASS to skip the processing chains of a muted stream : the play
+   packets run the chain once more so the nodes fade out, then they are zeroed and the
+   chain is skipped. The mic frames are dropped from the ring unread and the zero packet
+   is sent. The nodes keep their state, unmute needs no init */
+/* Define USE_AUDIO_PLAYBACK_SILENCE_POWER to detect digital silence on the play stream :
+   after AUDIO_PLAYBACK_SILENCE_HOLD_MS of zero packets the chain is skipped and the
+   session powers the speaker output stage down. The first non zero packet powers it up
+   and is faded in */
 /* Private variables ---------------------------------------------------------*/
 /* Private defines -----------------------------------------------------------*/
 #ifdef USE_USB_AUDIO_CLASS_10
@@ -62,23 +101,53 @@
 #endif /* USBD_SUPPORT_AUDIO_MULTI_FREQUENCES */
 #endif /*(defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES) */
 #endif /* USE_USB_AUDIO_CLASS_10 */
-
-//#define DEBUG_USB_NODES 1  /* uncomment to debug USB input for playback */
-#ifdef DEBUG_USB_NODES
-#define USB_INPUT_NODE_DEBUG_BUFFER_SIZE 1000
-/* Private typedef -----------------------------------------------------------*/
-typedef struct
-{
-  uint32_t time;
-  uint16_t write;
-  uint16_t read;
-  uint16_t error;
-} AUDIO_USB_Input_Buffer_StatsTypeDef;
-#endif /* DEBUG_USB_NODES */
+#ifdef USE_USB_AUDIO_PLAYPBACK
+#if (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT < 1) || (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT)
+#error "USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT must be between 1 and AUDIO_MAX_SUPPORTED_CHANNEL_COUNT"
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+/* the jitter peak loses 1/4096 of itself per packet, about 4 s at 1000 packets per second */
+#define USB_AUDIO_INPUT_JITTER_DECAY_SHIFT 12U
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+/* the next packet is received while the previous one is processed : the input
+   receive buffer has two halves, sized for the highest frequency */
+#define USB_AUDIO_INPUT_RX_STRIDE         ((USBD_AUDIO_CONFIG_PLAY_MAX_PACKET_SIZE + USBD_DMA_BUFFER_ALIGN - 1U) & \
+                                           ~(USBD_DMA_BUFFER_ALIGN - 1U))
+#define USB_AUDIO_INPUT_RX_HALF(input_node, half) ((input_node)->specific.input.rx_buff + \
+                                                   ((half) * USB_AUDIO_INPUT_RX_STRIDE))
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+#if (USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT < 1) || (USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT)
+#error "USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT must be between 1 and AUDIO_MAX_SUPPORTED_CHANNEL_COUNT"
+#endif /* USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+/* the next packet is prepared while the previous one is sent : the output bounce
+   buffers have two halves, sized for the highest frequency */
+#define USB_AUDIO_OUTPUT_SCRATCH_STRIDE   ((USBD_AUDIO_CONFIG_RECORD_MAX_PACKET_SIZE + USBD_DMA_BUFFER_ALIGN - 1U) & \
+                                           ~(USBD_DMA_BUFFER_ALIGN - 1U))
+#define USB_AUDIO_OUTPUT_SCRATCH(output_node, base) ((base) + ((output_node)->specific.output.scratch * \
+                                                              USB_AUDIO_OUTPUT_SCRATCH_STRIDE))
+#else /* USE_AUDIO_USB_IN_PIPELINE */
+#define USB_AUDIO_OUTPUT_SCRATCH(output_node, base) (base)
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+#endif /* USE_USB_AUDIO_RECORDING */
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+#define USB_AUDIO_CF_MAILBOX_NODES        3U /* playback, recording and mix feature units */
+#if (AUDIO_MAX_SUPPORTED_CHANNEL_COUNT > 15)
+#error "the control mailbox keeps a bit for each channel and the master in 16 bits"
+#endif /* AUDIO_MAX_SUPPORTED_CHANNEL_COUNT */
+/* feature units with requests to apply, read by the pump */
+static AUDIO_USB_CF_NodeTypeDef* cf_mailbox_nodes[USB_AUDIO_CF_MAILBOX_NODES];
+static volatile uint8_t cf_mailbox_posted = 0; /* a request came since the last frame */
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
 
 /* Private function prototypes -----------------------------------------------*/
 static int8_t     USB_AUDIO_Streaming_IO_DeInit(uint32_t node_handle);
-static int8_t     USB_AUDIO_Streaming_IO_Start( AUDIO_BufferTypeDef* buffer, uint16_t thershold ,uint32_t node_handle);
+static void       USB_AUDIO_Streaming_IO_AllocBuffers(AUDIO_USB_IO_NodeTypeDef* io_node);
+static void       USB_AUDIO_Streaming_IO_FreeBuffers(AUDIO_USB_IO_NodeTypeDef* io_node);
+static int8_t     USB_AUDIO_Streaming_IO_Start( AUDIO_BufferTypeDef* buffer, uint32_t thershold ,uint32_t node_handle);
 static int8_t     USB_AUDIO_Streaming_IO_Stop( uint32_t node_handle);
 static uint16_t   USB_AUDIO_Streaming_IO_GetMaxPacketLength(uint32_t node_handle);
 #ifdef USE_USB_AUDIO_CLASS_10
@@ -86,12 +155,29 @@ static int8_t     USB_AUDIO_Streaming_IO_GetState(uint32_t node_handle);
 #endif /*USE_USB_AUDIO_CLASS_10*/
 static int8_t     USB_AUDIO_Streaming_IO_Restart( uint32_t node_handle);
 #ifdef USE_USB_AUDIO_PLAYPBACK
-static int8_t     USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len,uint32_t node_handle);
-static uint8_t*   USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length);
+USB_AUDIO_DATA_EP_CBK int8_t     USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len,uint32_t node_handle) USBD_ITCM_FUNC;
+USB_AUDIO_DATA_EP_CBK uint8_t*   USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length) USBD_ITCM_FUNC;
+static int8_t     USB_AUDIO_Streaming_Input_DataMissed(uint32_t node_handle) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+static void       USB_AUDIO_Streaming_Input_Jitter(AUDIO_USB_IO_NodeTypeDef* input_node) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#if (defined USE_AUDIO_MUTE_BYPASS) || (defined USE_AUDIO_PLAYBACK_SILENCE_POWER)
+static void       USB_AUDIO_Streaming_Input_Process(AUDIO_USB_IO_NodeTypeDef* input_node, uint8_t* packet,
+                                                    uint16_t data_len) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+static uint8_t    USB_AUDIO_Streaming_Input_Silence(AUDIO_USB_IO_NodeTypeDef* input_node, const uint8_t* packet,
+                                                    uint16_t data_len) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
 #ifdef USE_USB_AUDIO_RECORDING
-static uint8_t*   USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length);
+USB_AUDIO_DATA_EP_CBK uint8_t*   USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+static void       USB_AUDIO_Streaming_Output_StageRequest(uint32_t node_handle) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
 #endif /* USE_USB_AUDIO_RECORDING*/
+static void       USB_AUDIO_Streaming_CacheClean(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint32_t size);
+static void       USB_AUDIO_Streaming_CacheInvalidate(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint32_t size);
 
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
@@ -110,6 +196,12 @@ static int8_t USB_AUDIO_Streaming_CF_GetMute(uint16_t channel,uint8_t* mute, uin
 static int8_t USB_AUDIO_Streaming_CF_SetMute(uint16_t channel,uint8_t mute, uint32_t node_handle);
 static int8_t USB_AUDIO_Streaming_CF_SetCurVolume(uint16_t channel, uint16_t volume, uint32_t node_handle);
 static int8_t USB_AUDIO_Streaming_CF_GetCurVolume(uint16_t channel, uint16_t* volume, uint32_t node_handle);
+static int8_t USB_AUDIO_Streaming_CF_SetVolume(uint16_t channel, int volume_db_256, uint32_t node_handle);
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+static void   USB_AUDIO_Streaming_CF_MailboxPost(AUDIO_USB_CF_NodeTypeDef* cf, volatile uint16_t* pending, uint16_t channel);
+static void   USB_AUDIO_Streaming_CF_MailboxTick(uint32_t private_data);
+static void   USB_AUDIO_Streaming_CF_MailboxHandler(void);
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
 #ifdef USE_USB_AUDIO_CLASS_10
 static int8_t USB_AUDIO_Streaming_CF_GetStatus(uint32_t node_handle);
 #endif /*USE_USB_AUDIO_CLASS_10*/
@@ -122,6 +214,11 @@ static int8_t USB_AUDIO_Streaming_CLK_SRC_SetCurFrequency(uint32_t frequency, ui
 static int8_t USB_AUDIO_Streaming_CLK_SRC_GetCurFrequency(uint32_t* frequency, uint32_t node_handle);
 static int8_t USB_AUDIO_Streaming_CLK_SRC_GetFrequenciesList(uint32_t** frequencies,uint8_t* freq_count, uint32_t node_handle);
 static int8_t USB_AUDIO_Streaming_CLK_SRC_GetIsValid(uint8_t *is_valid, uint32_t node_handle);
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+static int8_t USB_AUDIO_Streaming_CLK_SEL_GetCurSelector(uint8_t* pin, uint32_t node_handle);
+static int8_t USB_AUDIO_Streaming_CLK_SEL_SetCurSelector(uint8_t pin, uint8_t* as_cnt_to_restart,
+                                                         uint8_t* as_list_to_restart, uint32_t node_handle);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #if (defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES)
 static uint32_t  USB_AUDIO_Streaming_GetBestFrequence(uint32_t freq,  uint32_t* freq_table, int freq_count);
 #endif /* (defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES) */
@@ -176,12 +273,6 @@ USB_AUDIO_CONFIG_FREQ_8_K,
 #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES*/
 #endif /* USE_USB_AUDIO_CLASS_10 */
 
-#ifdef DEBUG_USB_NODES
-static AUDIO_USB_Input_Buffer_StatsTypeDef stats_buffer [USB_INPUT_NODE_DEBUG_BUFFER_SIZE];
-static int stats_count=0;
-extern __IO uint32_t uwTick;
-#endif /* DEBUG_USB_NODES */
-
 /* Private functions ---------------------------------------------------------*/
 #ifdef USE_USB_AUDIO_PLAYPBACK
 /**
@@ -212,17 +303,21 @@ extern __IO uint32_t uwTick;
   input_node->IOStop = USB_AUDIO_Streaming_IO_Stop;
   input_node->packet_length = AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(audio_desc);
   /* compute the packet_max_length */
-  #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  #if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
   input_node->max_packet_length = AUDIO_MAX_PACKET_WITH_FEEDBACK_LENGTH(audio_desc);
   #else
     input_node->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(audio_desc);
-  #endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+  #endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#ifndef USE_AUDIO_USB_ALTERNATE_ALLOC
+  USB_AUDIO_Streaming_IO_AllocBuffers(input_node);
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
   /* set data end point callbacks to be called by USB class */
   data_ep->ep_num = USBD_AUDIO_CONFIG_PLAY_EP_OUT;
   data_ep->control_name_map = 0;
   data_ep->control_selector_map = 0;
   data_ep->private_data = node_handle;
   data_ep->DataReceived = USB_AUDIO_Streaming_Input_DataReceived;
+  data_ep->DataMissed = USB_AUDIO_Streaming_Input_DataMissed;
   data_ep->GetBuffer = USB_AUDIO_Streaming_Input_GetBuffer;
   data_ep->GetMaxPacketLength = USB_AUDIO_Streaming_IO_GetMaxPacketLength;
 #ifdef USE_USB_AUDIO_CLASS_10
@@ -272,15 +367,13 @@ extern __IO uint32_t uwTick;
   output_node->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(audio_desc);
 #endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
   output_node->packet_length = AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(audio_desc);
-  output_node->specific.output.alt_buff = (uint8_t *) malloc(output_node->max_packet_length);
-  if(output_node->specific.output.alt_buff)
-  {
-    memset(output_node->specific.output.alt_buff, 0, output_node->max_packet_length);
-  }
-  else
-  {
-    Error_Handler();
-  }
+  AUDIO_PacketSchedulerInit(&output_node->specific.output.scheduler, audio_desc, AUDIO_USB_PACKETS_PER_SECOND);
+#ifndef USE_AUDIO_USB_ALTERNATE_ALLOC
+  USB_AUDIO_Streaming_IO_AllocBuffers(output_node);
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  AUDIO_ResamplerInit(&output_node->specific.output.resampler, audio_desc->channels_count, audio_desc->audio_res);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
   output_node->IODeInit = USB_AUDIO_Streaming_IO_DeInit;
   output_node->IOStart = USB_AUDIO_Streaming_IO_Start;
   output_node->IOStop = USB_AUDIO_Streaming_IO_Stop;
@@ -291,8 +384,17 @@ extern __IO uint32_t uwTick;
   data_ep->control_selector_map = 0;
   data_ep->private_data = node_handle;
   data_ep->DataReceived = 0;
+  data_ep->DataMissed = 0;
   data_ep->GetBuffer = USB_AUDIO_Streaming_Output_GetBuffer;
   data_ep->GetMaxPacketLength = USB_AUDIO_Streaming_IO_GetMaxPacketLength;
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+  data_ep->StageRequest = USB_AUDIO_Streaming_Output_StageRequest;
+  data_ep->staged = 0;
+  data_ep->staging = 0;
+  data_ep->stage_miss_count = 0;
+  output_node->specific.output.data_ep = data_ep;
+  output_node->specific.output.scratch = 0;
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
 #ifdef USE_USB_AUDIO_CLASS_10
   data_ep->GetState = USB_AUDIO_Streaming_IO_GetState;
 
@@ -323,20 +425,112 @@ extern __IO uint32_t uwTick;
  static int8_t  USB_AUDIO_Streaming_IO_DeInit(uint32_t node_handle)
 {
   ((AUDIO_USB_IO_NodeTypeDef *)node_handle)->node.state = AUDIO_NODE_OFF;
+  USB_AUDIO_Streaming_IO_FreeBuffers((AUDIO_USB_IO_NodeTypeDef *)node_handle);
   
   return 0;
 }
 
+/**
+  * @brief  USB_AUDIO_Streaming_IO_AllocBuffers
+  *         allocates the packet buffers of the node for its current max packet length
+  * @param  io_node: the usb io node
+  * @retval None
+  */
+static void  USB_AUDIO_Streaming_IO_AllocBuffers(AUDIO_USB_IO_NodeTypeDef* io_node)
+{
+#ifdef USE_USB_HS_DMA
+#if defined(USE_USB_AUDIO_RECORDING) && defined(USE_AUDIO_USB_IN_PIPELINE)
+  io_node->dma_buff = (uint8_t *) USBD_malloc((io_node->node.type == AUDIO_OUTPUT) ?
+                                              (2U * USB_AUDIO_OUTPUT_SCRATCH_STRIDE) : io_node->max_packet_length);
+#else /* USE_USB_AUDIO_RECORDING && USE_AUDIO_USB_IN_PIPELINE */
+  io_node->dma_buff = (uint8_t *) USBD_malloc(io_node->max_packet_length);
+#endif /* USE_USB_AUDIO_RECORDING && USE_AUDIO_USB_IN_PIPELINE */
+  if(io_node->dma_buff == 0)
+  {
+    Error_Handler();
+  }
+#endif /* USE_USB_HS_DMA */
+#if defined(USE_USB_AUDIO_PLAYPBACK) && defined(USE_AUDIO_USB_OUT_PINGPONG)
+  if(io_node->node.type == AUDIO_INPUT)
+  {
+    io_node->specific.input.rx_buff = (uint8_t *) USBD_malloc(2U * USB_AUDIO_INPUT_RX_STRIDE);
+    if(io_node->specific.input.rx_buff == 0)
+    {
+      Error_Handler();
+    }
+    io_node->specific.input.rx_half = 0;
+  }
+#endif /* USE_USB_AUDIO_PLAYPBACK && USE_AUDIO_USB_OUT_PINGPONG */
+#ifdef USE_USB_AUDIO_RECORDING
+  if(io_node->node.type == AUDIO_OUTPUT)
+  {
+    io_node->specific.output.alt_buff = (uint8_t *) USBD_malloc(io_node->max_packet_length);
+    if(io_node->specific.output.alt_buff)
+    {
+      AUDIO_MEMSET(io_node->specific.output.alt_buff, 0, io_node->max_packet_length);
+    }
+    else
+    {
+      Error_Handler();
+    }
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+    /* sized for the highest frequency so it is kept when frequency changes */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+    io_node->specific.output.resampled_buff = (uint8_t *) USBD_malloc(2U * USB_AUDIO_OUTPUT_SCRATCH_STRIDE);
+#else /* USE_AUDIO_USB_IN_PIPELINE */
+    io_node->specific.output.resampled_buff = (uint8_t *) USBD_malloc(USBD_AUDIO_CONFIG_RECORD_MAX_PACKET_SIZE);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+    if(io_node->specific.output.resampled_buff == 0)
+    {
+      Error_Handler();
+    }
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  }
+#endif /* USE_USB_AUDIO_RECORDING */
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_IO_FreeBuffers
+  *         releases the packet buffers of the node, buffers already released are skipped
+  * @param  io_node: the usb io node
+  * @retval None
+  */
+static void  USB_AUDIO_Streaming_IO_FreeBuffers(AUDIO_USB_IO_NodeTypeDef* io_node)
+{
+#ifdef USE_USB_HS_DMA
+  USBD_free(io_node->dma_buff);
+  io_node->dma_buff = 0;
+#endif /* USE_USB_HS_DMA */
+#if defined(USE_USB_AUDIO_PLAYPBACK) && defined(USE_AUDIO_USB_OUT_PINGPONG)
+  if(io_node->node.type == AUDIO_INPUT)
+  {
+    USBD_free(io_node->specific.input.rx_buff);
+    io_node->specific.input.rx_buff = 0;
+  }
+#endif /* USE_USB_AUDIO_PLAYPBACK && USE_AUDIO_USB_OUT_PINGPONG */
+#ifdef USE_USB_AUDIO_RECORDING
+  if(io_node->node.type == AUDIO_OUTPUT)
+  {
+    USBD_free(io_node->specific.output.alt_buff);
+    io_node->specific.output.alt_buff = 0;
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+    USBD_free(io_node->specific.output.resampled_buff);
+    io_node->specific.output.resampled_buff = 0;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  }
+#endif /* USE_USB_AUDIO_RECORDING */
+}
+
 
 /**
   * @brief  USB_AUDIO_Streaming_IO_Start
   *         Start Usb input  or ouput node
   * @param  buffer:             buffer which is used while node is being started
-  * @param  thershold:          buffer thershold for input node
+  * @param  thershold:          buffer fill to start playing for input node , to start sending for output node
   * @param  node_handle:        the node handle, node must be initialized
   * @retval 0 for no error
   */
-static int8_t  USB_AUDIO_Streaming_IO_Start( AUDIO_BufferTypeDef* buffer, uint16_t thershold ,uint32_t node_handle)
+static int8_t  USB_AUDIO_Streaming_IO_Start( AUDIO_BufferTypeDef* buffer, uint32_t thershold ,uint32_t node_handle)
 {
   AUDIO_USB_IO_NodeTypeDef * io_node;
    
@@ -344,23 +538,38 @@ static int8_t  USB_AUDIO_Streaming_IO_Start( AUDIO_BufferTypeDef* buffer, uint16
    
    if((io_node->node.state == AUDIO_NODE_INITIALIZED ) ||(io_node->node.state == AUDIO_NODE_STOPPED))
    {
+#ifdef USE_AUDIO_USB_ALTERNATE_ALLOC
+       /* sized for the frequency selected before the alternate */
+       USB_AUDIO_Streaming_IO_AllocBuffers(io_node);
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
        io_node->node.state = AUDIO_NODE_STARTED;
        io_node->buf = buffer;
-       io_node->buf->rd_ptr = io_node->buf->wr_ptr=0;
+       AUDIO_BufferReset(io_node->buf);
        
        io_node->flags = 0;
        if(io_node->node.type == AUDIO_INPUT)
        {
          io_node->specific.input.thershold = thershold;
+         io_node->specific.input.last_packet_length = 0;
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+         io_node->specific.input.jitter_peak = 0;
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+         io_node->specific.input.silence_bytes = 0;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
        }
        else
        {
-#if USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K
-          if(io_node->node.audio_description->frequence == USB_AUDIO_CONFIG_FREQ_44_1_K)
-          {
-            io_node->specific.output.packet_44_counter = 0;
-          }
-#endif /* USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K */
+          io_node->specific.output.thershold = thershold;
+          AUDIO_PacketSchedulerReset(&io_node->specific.output.scheduler);
+#ifdef USE_AUDIO_SYNC_START
+          io_node->specific.output.lead_bytes = 0;
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+          AUDIO_ResamplerInit(&io_node->specific.output.resampler,
+                              io_node->node.audio_description->channels_count,
+                              io_node->node.audio_description->audio_res);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
        }
    }
    return 0;
@@ -377,6 +586,14 @@ static int8_t  USB_AUDIO_Streaming_IO_Stop( uint32_t node_handle)
   AUDIO_USB_IO_NodeTypeDef * io_node;
    
    io_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
+#ifdef USE_AUDIO_USB_ALTERNATE_ALLOC
+   if(io_node->node.state == AUDIO_NODE_STARTED)
+   {
+     /* stopped first : the endpoint callbacks no longer return the buffers */
+     io_node->node.state = AUDIO_NODE_STOPPED;
+     USB_AUDIO_Streaming_IO_FreeBuffers(io_node);
+   }
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
    io_node->node.state = AUDIO_NODE_STOPPED;
   return 0;
 }
@@ -407,11 +624,13 @@ static int8_t  USB_AUDIO_Streaming_IO_Restart( uint32_t node_handle)
   * @param  node_handle:        the input node handle, node must be initialized  and stardted
   * @retval  0 for no error
   */
-static int8_t  USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len, uint32_t node_handle)
+USB_AUDIO_DATA_EP_CBK int8_t  USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len, uint32_t node_handle)
  {
    AUDIO_USB_IO_NodeTypeDef * input_node;
    AUDIO_BufferTypeDef *buf;
-   uint16_t wr_distance;
+   uint32_t wr_distance;
+   uint32_t wr_ptr;
+   uint8_t* packet = 0; /* set when the packet was not received in the ring */
    
    input_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
    if(input_node->node.state == AUDIO_NODE_STARTED)
@@ -420,63 +639,111 @@ static int8_t  USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len, uint32
      if(input_node->flags&AUDIO_IO_RESTART_REQUIRED)
      {
        input_node->flags = 0;
-       input_node->buf->rd_ptr=input_node->buf->wr_ptr = 0;
+       AUDIO_BufferReset(input_node->buf);
+       input_node->specific.input.last_packet_length = 0;
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+       /* the speaker restarts powered */
+       input_node->specific.input.silence_bytes = 0;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
        return 0;
      }
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+     USB_AUDIO_Streaming_Input_Jitter(input_node);
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
      buf=input_node->buf;
+     wr_ptr = buf->wr_ptr;
 
-     buf->wr_ptr += data_len;/* increment buffer */
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+     /* the endpoint is already armed with the other half */
+     packet = USB_AUDIO_INPUT_RX_HALF(input_node, input_node->specific.input.rx_half ^ 1U);
+#elif defined(USE_USB_HS_DMA)
+     if(input_node->flags&AUDIO_IO_DMA_BOUNCE)
+     {
+       input_node->flags &= ~AUDIO_IO_DMA_BOUNCE;
+       packet = input_node->dma_buff;
+     }
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
+     if(packet)
+     {
+       /* packet was received out of the ring, copy it once processed */
+#ifdef USE_AUDIO_TAP
+       AUDIO_TapWrite(AUDIO_TAP_POINT_USB_OUT, packet, data_len);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+       AUDIO_SnapshotWrite(AUDIO_TAP_POINT_USB_OUT, packet, data_len);
+#endif /* USE_AUDIO_SNAPSHOT */
+#if (defined USE_AUDIO_MUTE_BYPASS) || (defined USE_AUDIO_PLAYBACK_SILENCE_POWER)
+       USB_AUDIO_Streaming_Input_Process(input_node, packet, data_len);
+#else /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+       AUDIO_NodeProcessChain(input_node->node.next, packet, data_len);
+#endif /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_TAP
+       AUDIO_TapWrite(AUDIO_TAP_POINT_DSP_OUT, packet, data_len);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+       AUDIO_SnapshotWrite(AUDIO_TAP_POINT_DSP_OUT, packet, data_len);
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SPECTRUM
+       AUDIO_SpectrumWrite(AUDIO_SPECTRUM_SOURCE_SPEAKER, packet, data_len, input_node->node.audio_description);
+#endif /* USE_AUDIO_SPECTRUM */
+       AUDIO_BufferWrite(buf, packet, data_len);
+     }
+     else
+     {
+       /* process the packet while it is contiguous, the consumer never sees it unprocessed */
+#ifdef USE_AUDIO_TAP
+       AUDIO_TapWrite(AUDIO_TAP_POINT_USB_OUT, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+       AUDIO_SnapshotWrite(AUDIO_TAP_POINT_USB_OUT, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#endif /* USE_AUDIO_SNAPSHOT */
+#if (defined USE_AUDIO_MUTE_BYPASS) || (defined USE_AUDIO_PLAYBACK_SILENCE_POWER)
+       USB_AUDIO_Streaming_Input_Process(input_node, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#else /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+       AUDIO_NodeProcessChain(input_node->node.next, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#endif /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_TAP
+       AUDIO_TapWrite(AUDIO_TAP_POINT_DSP_OUT, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#endif /* USE_AUDIO_TAP */
+#ifdef USE_AUDIO_SNAPSHOT
+       AUDIO_SnapshotWrite(AUDIO_TAP_POINT_DSP_OUT, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len);
+#endif /* USE_AUDIO_SNAPSHOT */
+#ifdef USE_AUDIO_SPECTRUM
+       AUDIO_SpectrumWrite(AUDIO_SPECTRUM_SOURCE_SPEAKER, buf->data + AUDIO_BUFFER_WR_OFFSET(buf), data_len,
+                           input_node->node.audio_description);
+#endif /* USE_AUDIO_SPECTRUM */
+       /* publish received packet, readers find data written in the margin there */
+       AUDIO_BufferCommitWrite(buf, data_len);
+     }
+     /* the packet is in memory for the audio DMA which consumes the buffer */
+     USB_AUDIO_Streaming_CacheClean(buf, wr_ptr, data_len);
+#ifdef USE_AUDIO_PACKET_QUEUE
+     AUDIO_BufferPushPacket(buf, wr_ptr, data_len, (uint16_t)USB_SOF_NUMBER(), AUDIO_PACKET_TIME());
+#endif /* USE_AUDIO_PACKET_QUEUE */
+     input_node->specific.input.last_packet_length = data_len;
+     wr_distance = AUDIO_BUFFER_FILLED_SIZE(buf);
+     AUDIO_BufferTelemetryUpdate(buf, wr_distance);
 
      if((input_node->flags&AUDIO_IO_BEGIN_OF_STREAM) == 0)
      {
        
-       input_node->node.session_handle->SessionCallback(AUDIO_BEGIN_OF_STREAM,(AUDIO_NodeTypeDef*)input_node,
+       AUDIO_PumpPostEvent(AUDIO_BEGIN_OF_STREAM, (AUDIO_NodeTypeDef*)input_node,
                                                         input_node->node.session_handle);
        input_node->flags |= AUDIO_IO_BEGIN_OF_STREAM;
        
      }
      else
      {
-#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
-       /* check if data is in margin, then copy it */
-        if(buf->wr_ptr > buf->size)
-        {
-          buf->wr_ptr -= buf->size;
-          memcpy(buf->data, buf->data+buf->size, buf->wr_ptr);
-        }
-#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
-#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K
-        if(input_node->node.audio_description->frequence ==   USB_AUDIO_CONFIG_FREQ_44_1_K)
-        {
-          if(buf->wr_ptr > buf->size)
-          {
-            buf->wr_ptr -= buf->size;
-            memcpy(buf->data, buf->data+buf->size, buf->wr_ptr);
-          }
-        }
-#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K*/
-        if(buf->wr_ptr > buf->size)
-        {
-          Error_Handler();
-        }
-#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
-        
-       
-      wr_distance = AUDIO_BUFFER_FILLED_SIZE(buf); 
-      if(buf->wr_ptr == buf->size)
-      {
-        buf->wr_ptr = 0;
-      }
       if(((input_node->flags&AUDIO_IO_THERSHOLD_REACHED) == 0)&&
           (wr_distance >= input_node->specific.input.thershold))
       {
-         input_node->node.session_handle->SessionCallback(AUDIO_THERSHOLD_REACHED, (AUDIO_NodeTypeDef*)input_node,
+         AUDIO_PumpPostEvent(AUDIO_THERSHOLD_REACHED, (AUDIO_NodeTypeDef*)input_node,
                                                          input_node->node.session_handle); 
           input_node->flags |= AUDIO_IO_THERSHOLD_REACHED ;
        }
        else
        {
-        input_node->node.session_handle->SessionCallback(AUDIO_PACKET_RECEIVED, (AUDIO_NodeTypeDef*)input_node,
+        AUDIO_PumpPostEvent(AUDIO_PACKET_RECEIVED, (AUDIO_NodeTypeDef*)input_node,
                                                          input_node->node.session_handle); 
        }
      }
@@ -495,23 +762,12 @@ static int8_t  USB_AUDIO_Streaming_Input_DataReceived( uint16_t data_len, uint32
   * @param  max_packet_length:  max data length to be received
   * @retval  0 for no error                          
   */
-static uint8_t* USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length)
+USB_AUDIO_DATA_EP_CBK uint8_t* USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16_t* max_packet_length)
 {
   AUDIO_USB_IO_NodeTypeDef* input_node;
-  uint16_t wr_distance;
+  uint32_t wr_distance;
   
   input_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
-#ifdef DEBUG_USB_NODES
-  stats_buffer[stats_count].read = input_node->buf->rd_ptr;
-  stats_buffer[stats_count].write = input_node->buf->wr_ptr;
-  stats_buffer[stats_count].time = uwTick;
-  
-  stats_count++;
-  if(stats_count == USB_INPUT_NODE_DEBUG_BUFFER_SIZE)
-  {
-    stats_count=0;
-  }
-#endif /*DEBUG_USB_NODES*/
   *max_packet_length = input_node->max_packet_length;
   if( input_node->node.state == AUDIO_NODE_STARTED)
   {
@@ -520,24 +776,235 @@ static uint8_t* USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16
     
     if(wr_distance < input_node->max_packet_length)
     {
-      input_node->node.session_handle->SessionCallback(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)input_node,
+      AUDIO_PumpPostEvent(AUDIO_OVERRUN, (AUDIO_NodeTypeDef*)input_node,
                                                        input_node->node.session_handle);
     }
     
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+    /* called before the previous packet is passed to DataReceived, which handles
+       the restart and then drops that packet */
+    input_node->specific.input.rx_half ^= 1U;
+    return USB_AUDIO_INPUT_RX_HALF(input_node, input_node->specific.input.rx_half);
+#else /* USE_AUDIO_USB_OUT_PINGPONG */
     if(input_node->flags&AUDIO_IO_RESTART_REQUIRED)
     {
      input_node->flags = 0;
-     input_node->buf->rd_ptr = input_node->buf->wr_ptr = 0;
+     AUDIO_BufferReset(input_node->buf);
+     input_node->specific.input.last_packet_length = 0;
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+     input_node->specific.input.silence_bytes = 0;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
     }
-    return input_node->buf->data+input_node->buf->wr_ptr;
+#ifdef USE_USB_HS_DMA
+    if(!USBD_DMA_IS_ALIGNED(AUDIO_BufferGetWritePtr(input_node->buf)))
+    {
+      input_node->flags |= AUDIO_IO_DMA_BOUNCE;
+      return input_node->dma_buff;
+    }
+#endif /* USE_USB_HS_DMA */
+    return AUDIO_BufferGetWritePtr(input_node->buf);
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
   }
   else
   {
-    //Error_Handler();
-    return 0; /* return statement non reachable */
+    /* stopped while the endpoint is still armed : the packet is received in
+       the unused ring and dropped by USB_AUDIO_Streaming_Input_DataReceived */
+    AUDIO_BufferTelemetryResync(input_node->buf);
+    return input_node->buf->data;
+  }
+}
+
+
+#if (defined USE_AUDIO_MUTE_BYPASS) || (defined USE_AUDIO_PLAYBACK_SILENCE_POWER)
+/**
+  * @brief  USB_AUDIO_Streaming_Input_Process
+  *         runs the play chain on a received packet. Once muted, the first
+  *         packet still goes through the chain so the volume ramps down, the
+  *         next ones are zeroed without it. Silence held long enough skips
+  *         the chain as well
+  * @param  input_node: the input node, started
+  * @param  packet: received packet, contiguous
+  * @param  data_len: packet length in bytes
+  * @retval None
+  */
+static void  USB_AUDIO_Streaming_Input_Process(AUDIO_USB_IO_NodeTypeDef* input_node, uint8_t* packet, uint16_t data_len)
+{
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  uint8_t resumed = (input_node->flags&AUDIO_IO_SILENCE) ? 1U : 0U;
+
+  if(USB_AUDIO_Streaming_Input_Silence(input_node, packet, data_len))
+  {
+    /* the packet is zero already */
+    return;
+  }
+  resumed = (resumed && !(input_node->flags&AUDIO_IO_SILENCE)) ? 1U : 0U;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_MUTE_BYPASS
+  if(!input_node->node.audio_description->audio_mute)
+  {
+    input_node->flags &= ~AUDIO_IO_MUTE_BYPASS;
+  }
+  else if(input_node->flags&AUDIO_IO_MUTE_BYPASS)
+  {
+    AUDIO_MEMSET(packet, 0, data_len);
+    return;
+  }
+  else
+  {
+    input_node->flags |= AUDIO_IO_MUTE_BYPASS;
+  }
+#endif /* USE_AUDIO_MUTE_BYPASS */
+  AUDIO_NodeProcessChain(input_node->node.next, packet, data_len);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  if(resumed)
+  {
+    /* the output stage is powering up meanwhile */
+    AUDIO_PcmFade(packet, data_len / AUDIO_SAMPLE_LENGTH(input_node->node.audio_description),
+                  input_node->node.audio_description->channels_count,
+                  input_node->node.audio_description->audio_res, 1);
+  }
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+}
+#endif /* USE_AUDIO_MUTE_BYPASS || USE_AUDIO_PLAYBACK_SILENCE_POWER */
+
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+/**
+  * @brief  USB_AUDIO_Streaming_Input_Silence
+  *         ORs the packet words to find digital silence and follows how long
+  *         it lasts. The session is told when the hold time is reached and
+  *         when sound comes back
+  * @param  input_node: the input node, started
+  * @param  packet: received packet, contiguous
+  * @param  data_len: packet length in bytes
+  * @retval 1 if the packet is silent past the hold time, the chain is skipped
+  */
+static uint8_t  USB_AUDIO_Streaming_Input_Silence(AUDIO_USB_IO_NodeTypeDef* input_node, const uint8_t* packet,
+                                                  uint16_t data_len)
+{
+  const uint32_t* words;
+  uint32_t acc = 0;
+  uint32_t hold;
+  uint16_t n = data_len;
+  uint16_t i;
+
+  /* ring offsets of 3 bytes samples are not word aligned */
+  while((((uint32_t)packet & 3U) != 0U) && (n != 0U))
+  {
+    acc |= *packet++;
+    n--;
+  }
+  words = (const uint32_t*)packet;
+  for(i = 0; i < (n >> 2); i++)
+  {
+    acc |= words[i];
+  }
+  for(i = n & ~3U; i < n; i++)
+  {
+    acc |= packet[i];
   }
+
+  if(acc == 0U)
+  {
+    if(input_node->flags&AUDIO_IO_SILENCE)
+    {
+      return 1;
+    }
+    input_node->specific.input.silence_bytes += data_len;
+    hold = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(input_node->node.audio_description) * AUDIO_PLAYBACK_SILENCE_HOLD_MS;
+    if((input_node->specific.input.silence_bytes >= hold) &&
+       (AUDIO_PumpPostEvent(AUDIO_SILENCE_BEGIN, (AUDIO_NodeTypeDef*)input_node,
+                            input_node->node.session_handle) == 0))
+    {
+      input_node->flags |= AUDIO_IO_SILENCE;
+      return 1;
+    }
+    return 0;
+  }
+  input_node->specific.input.silence_bytes = 0;
+  /* a lost event is posted again with the next packet */
+  if((input_node->flags&AUDIO_IO_SILENCE) &&
+     (AUDIO_PumpPostEvent(AUDIO_SILENCE_END, (AUDIO_NodeTypeDef*)input_node,
+                          input_node->node.session_handle) == 0))
+  {
+    input_node->flags &= ~AUDIO_IO_SILENCE;
+  }
+  return 0;
 }
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
 
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+/**
+  * @brief  USB_AUDIO_Streaming_Input_Jitter
+  *         measures how late the packet is over the packet period. The peak is
+  *         held and decays slowly, so the session target covers the longest
+  *         gap the host made recently, bursts included
+  * @param  input_node: the input node, started
+  * @retval None
+  */
+static void  USB_AUDIO_Streaming_Input_Jitter(AUDIO_USB_IO_NodeTypeDef* input_node)
+{
+  AUDIO_USB_Input_SpecifcTypeDef* input = &input_node->specific.input;
+  uint32_t now = DWT->CYCCNT;
+  uint32_t period = SystemCoreClock / AUDIO_USB_PACKETS_PER_SECOND;
+  uint32_t late;
+
+  /* no period to measure before the first packet since the start or a restart */
+  if(input->last_packet_length != 0U)
+  {
+    late = now - input->arrival_time;
+    late = (late > period) ? (late - period) : 0U;
+    input->jitter_peak -= input->jitter_peak >> USB_AUDIO_INPUT_JITTER_DECAY_SHIFT;
+    if(late > input->jitter_peak)
+    {
+      input->jitter_peak = late;
+    }
+  }
+  input->arrival_time = now;
+}
+
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+/**
+  * @brief  USB_AUDIO_Streaming_Input_DataMissed
+  *         callback called by USB class when a packet was not received in its
+  *         frame. The last packet, already processed, is written again so the
+  *         speaker plays a repeated millisecond instead of a gap           
+  * @param  node_handle:        the input node handle, node must be initialized and started
+  * @retval  0 for no error , -1 when nothing could be concealed
+  */
+static int8_t  USB_AUDIO_Streaming_Input_DataMissed(uint32_t node_handle)
+{
+  AUDIO_USB_IO_NodeTypeDef* input_node;
+  AUDIO_BufferTypeDef *buf;
+  AUDIO_BufferRegionTypeDef src;
+  uint32_t length;
+  uint32_t wr_ptr;
+  uint8_t* dst;
+
+  input_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
+  buf = input_node->buf;
+  length = input_node->specific.input.last_packet_length;
+  /* the packet was not received in the bounce buffer either */
+  input_node->flags &= ~AUDIO_IO_DMA_BOUNCE;
+  if((input_node->node.state != AUDIO_NODE_STARTED) || (length == 0U) ||
+     (input_node->flags&AUDIO_IO_RESTART_REQUIRED) || (AUDIO_BUFFER_FREE_SIZE(buf) < length))
+  {
+    return -1;
+  }
+  wr_ptr = buf->wr_ptr;
+  AUDIO_BufferGetRegion(buf, wr_ptr - length, length, &src);
+  dst = AUDIO_BufferGetWritePtr(buf);
+  AUDIO_MEMCPY(dst, src.data[0], src.length[0]);
+  AUDIO_MEMCPY(dst + src.length[0], src.data[1], src.length[1]);
+  AUDIO_BufferCommitWrite(buf, length);
+  USB_AUDIO_Streaming_CacheClean(buf, wr_ptr, length);
+#ifdef USE_AUDIO_PACKET_QUEUE
+  /* the copy stands for the missed packet of this frame */
+  AUDIO_BufferPushPacket(buf, wr_ptr, (uint16_t)length, (uint16_t)USB_SOF_NUMBER(), AUDIO_PACKET_TIME());
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_PumpPostEvent(AUDIO_PACKET_RECEIVED, (AUDIO_NodeTypeDef*)input_node,
+                                                   input_node->node.session_handle);
+  return 0;
+}
 
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
 #ifdef USE_USB_AUDIO_RECORDING
@@ -548,16 +1015,18 @@ static uint8_t* USB_AUDIO_Streaming_Input_GetBuffer(uint32_t node_handle, uint16
   * @param  packet_length:      max data length to send         
   * @retval  0 if no error     
   */
-static uint8_t* USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle,uint16_t* packet_length)
+USB_AUDIO_DATA_EP_CBK uint8_t* USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle,uint16_t* packet_length)
 {
 
    AUDIO_USB_IO_NodeTypeDef *output_node;
-   uint16_t wr_distance;
+   uint32_t wr_distance;
    AUDIO_BufferTypeDef *buf;
    uint8_t* packet_data;
-#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+   uint32_t read_length;
+#elif defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
    int8_t sample_add_remove;
-#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 
    output_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
 
@@ -566,70 +1035,81 @@ static uint8_t* USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle,uint16
      if(output_node->flags&AUDIO_IO_RESTART_REQUIRED)
      {
        output_node->flags = 0;
-       output_node->buf->rd_ptr = 0;
-#if USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K
-      if(output_node->node.audio_description->frequence == USB_AUDIO_CONFIG_FREQ_44_1_K)
-      {
-        output_node->specific.output.packet_44_counter = 0;
-      }
-#endif /* USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K */
+       AUDIO_BufferCommitRead(output_node->buf, AUDIO_BUFFER_FILLED_SIZE(output_node->buf));
+      AUDIO_PacketSchedulerReset(&output_node->specific.output.scheduler);
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+      AUDIO_ResamplerInit(&output_node->specific.output.resampler,
+                          output_node->node.audio_description->channels_count,
+                          output_node->node.audio_description->audio_res);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
        return output_node->specific.output.alt_buff;
      }
-#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
-      output_node->node.session_handle->SessionCallback(AUDIO_PACKET_PLAYED, (AUDIO_NodeTypeDef*)output_node,
+      AUDIO_PumpPostEvent(AUDIO_PACKET_PLAYED, (AUDIO_NodeTypeDef*)output_node,
                                                         output_node->node.session_handle);
-#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
-#if USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K
-    if(output_node->node.audio_description->frequence == USB_AUDIO_CONFIG_FREQ_44_1_K)
-    {
-#ifdef USE_USB_HS
-        if(output_node->specific.output.packet_44_counter == 79)
-#else /* USE_USB_HS */
-      if(output_node->specific.output.packet_44_counter == 9)
-#endif /* USE_USB_HS */
-      {
-        *packet_length = output_node->max_packet_length;
-        output_node->specific.output.packet_44_counter = 0;
-      }
-      else
-      {
-        output_node->specific.output.packet_44_counter ++;
-        *packet_length = output_node->packet_length;
-      }
-    }
-    else
-    {
-      *packet_length = output_node->packet_length;
-    }
-#else /* USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K */
-    *packet_length = output_node->packet_length;
-#endif /* USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K */
+    *packet_length = AUDIO_PacketSchedulerNext(&output_node->specific.output.scheduler);
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+    output_node->specific.output.scratch ^= 1U;
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
     
      buf = output_node->buf;
       /* @TODO add underrun detection */
      if(!(output_node->flags&AUDIO_IO_BEGIN_OF_STREAM))
      { 
-     if(buf->wr_ptr < (buf->size>>1)) /* first thershold is a half of buffer */
+     if(AUDIO_BUFFER_FILLED_SIZE(buf) < output_node->specific.output.thershold)
       {
         /* buffer is not ready  */
+#ifdef USE_AUDIO_SYNC_START
+        output_node->specific.output.lead_bytes += *packet_length;
+#endif /* USE_AUDIO_SYNC_START */
         return output_node->specific.output.alt_buff;
       }
-       output_node->node.session_handle->SessionCallback(AUDIO_BEGIN_OF_STREAM, (AUDIO_NodeTypeDef*)output_node,
+       AUDIO_PumpPostEvent(AUDIO_BEGIN_OF_STREAM, (AUDIO_NodeTypeDef*)output_node,
                                                         output_node->node.session_handle);
        output_node->flags |= AUDIO_IO_BEGIN_OF_STREAM;
      }
        /* Check for underrun */
       wr_distance = AUDIO_BUFFER_FILLED_SIZE(buf);       
+      AUDIO_BufferTelemetryUpdate(buf, wr_distance);
       if(wr_distance < *packet_length)
       {
-       output_node->node.session_handle->SessionCallback(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)output_node,
+       AUDIO_PumpPostEvent(AUDIO_UNDERRUN, (AUDIO_NodeTypeDef*)output_node,
                                                         output_node->node.session_handle);
         return output_node->specific.output.alt_buff;
       }
       else
       {
+#ifdef USE_AUDIO_PACKET_QUEUE
+        /* from the mic input to the USB send */
+        AUDIO_BufferMeasureDelay(buf, AUDIO_PACKET_TIME());
+#endif /* USE_AUDIO_PACKET_QUEUE */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+        /* the packet keeps its nominal length, mic frames are interpolated at the mic/USB ratio */
+        AUDIO_ResamplerSetStep(&output_node->specific.output.resampler,
+                               AUDIO_Recording_get_Resampler_Step(output_node->node.session_handle));
+        USB_AUDIO_Streaming_CacheInvalidate(buf, buf->rd_ptr, (wr_distance < output_node->max_packet_length) ?
+                                            wr_distance : output_node->max_packet_length);
+        packet_data = USB_AUDIO_OUTPUT_SCRATCH(output_node, output_node->specific.output.resampled_buff);
+        read_length = AUDIO_ResamplerProcess(&output_node->specific.output.resampler, buf, packet_data,
+                                             *packet_length / AUDIO_SAMPLE_LENGTH(output_node->node.audio_description));
+        AUDIO_Recording_Set_Sample_Written(output_node->node.session_handle, read_length);
+        AUDIO_BufferCommitRead(buf, read_length);
+#ifdef USE_AUDIO_MUTE_BYPASS
+        if(output_node->node.audio_description->audio_mute)
+        {
+          /* the resampler keeps the ring in sync, its frames are not sent */
+          return output_node->specific.output.alt_buff;
+        }
+#endif /* USE_AUDIO_MUTE_BYPASS */
+#else /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
       sample_add_remove = AUDIO_Recording_get_Sample_to_add(output_node->node.session_handle);
+#ifdef USE_AUDIO_MIC_PATTERN
+#ifdef  USE_AUDIO_RECORDING_USB_NO_REMOVE
+      AUDIO_PatternSyncAdjust(sample_add_remove, 0, output_node->node.audio_description);
+#else /*USE_AUDIO_RECORDING_USB_NO_REMOVE */
+      AUDIO_PatternSyncAdjust(sample_add_remove, (uint8_t)(sample_add_remove > 0), output_node->node.audio_description);
+#endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
+#endif /* USE_AUDIO_MIC_PATTERN */
 #ifdef  USE_AUDIO_RECORDING_USB_NO_REMOVE
       *packet_length += sample_add_remove;
       if(*packet_length > output_node->max_packet_length)
@@ -647,48 +1127,145 @@ static uint8_t* USB_AUDIO_Streaming_Output_GetBuffer(uint32_t node_handle,uint16
         {
           if(sample_add_remove>0)
           {
-            buf->rd_ptr += sample_add_remove;
-            if(buf->rd_ptr == buf->size)
-            {
-              buf->rd_ptr = 0;
-            }
+            AUDIO_BufferCommitRead(buf, sample_add_remove);
           }
         }
         AUDIO_Recording_Set_Sample_Written(output_node->node.session_handle, *packet_length+sample_add_remove);
 #endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
-         /* increment read pointer */
-        packet_data = buf->data + buf->rd_ptr;
-        buf->rd_ptr += *packet_length;
-        
-        /* manage the packet not aligned */
-        if(buf->rd_ptr > buf->size)
+#ifdef USE_AUDIO_MUTE_BYPASS
+        if(output_node->node.audio_description->audio_mute)
         {
-          buf->rd_ptr -= buf->size;
-          memcpy(buf->data+buf->size, buf->data, buf->rd_ptr);
-          if(buf->rd_ptr+buf->size >=USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE)
-          {
-            Error_Handler();
-          }
-         }
-          
-        if(buf->rd_ptr == buf->size)
+          /* muted : the frames are dropped unread, the zero packet is sent */
+          AUDIO_BufferCommitRead(buf, *packet_length);
+          return output_node->specific.output.alt_buff;
+        }
+#endif /* USE_AUDIO_MUTE_BYPASS */
+        /* the audio DMA may have written the packet behind the cache */
+        USB_AUDIO_Streaming_CacheInvalidate(buf, buf->rd_ptr, *packet_length);
+#ifdef USE_USB_HS_DMA
+        if(!USBD_DMA_IS_ALIGNED(buf->data + AUDIO_BUFFER_RD_OFFSET(buf)))
+        {
+          /* DMA can not start from this offset, send a copy of the packet */
+          packet_data = USB_AUDIO_OUTPUT_SCRATCH(output_node, output_node->dma_buff);
+          AUDIO_BufferPeek(buf, packet_data, *packet_length);
+        }
+        else
+#endif /* USE_USB_HS_DMA */
         {
-          buf->rd_ptr = 0;
+          /* get packet, the producer completed the ring start in the margin */
+          packet_data = AUDIO_BufferGetReadPtr(buf, *packet_length);
         }
+         /* increment read pointer */
+        AUDIO_BufferCommitRead(buf, *packet_length);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+        /* nodes after the output see each sent packet, they must not write it:
+           it was not cleaned from the cache for the USB DMA */
+        AUDIO_NodeProcessChain(output_node->node.next, packet_data, *packet_length);
       }
      return (packet_data);
    }
    else
    {
-     /*Should not happen */
-     Error_Handler();
-     return 0; /* return statement not reachable */
+     /* stopped while the endpoint is still armed : a zero length packet
+        goes out, streaming restarts with the next start */
+     AUDIO_BufferTelemetryResync(output_node->buf);
+     *packet_length = 0;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+     if(output_node->flags & AUDIO_IO_START_PENDING)
+     {
+       /* the host already reads the alternate : nominal silence until the session runs */
+       *packet_length = output_node->packet_length;
+     }
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+     return output_node->specific.output.alt_buff;
    }
  
 }
+
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+/**
+  * @brief  USB_AUDIO_Streaming_Output_StageRequest
+  *         called by the IN complete interrupt once it armed the staged packet,
+  *         the next one is prepared from the pump
+  * @param  node_handle:        the output node handle
+  * @retval None
+  */
+static void  USB_AUDIO_Streaming_Output_StageRequest(uint32_t node_handle)
+{
+  UNUSED(node_handle);
+  AUDIO_PumpPost(AUDIO_PUMP_MIC_STAGE);
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_Output_Stage
+  *         prepares the next packet of the output node one frame ahead of the
+  *         IN complete interrupt, to call from the AUDIO_PUMP_MIC_STAGE work
+  * @param  node_handle:        the output node handle, node must be initialized
+  * @retval None
+  */
+void  USB_AUDIO_Streaming_Output_Stage(uint32_t node_handle)
+{
+  AUDIO_USB_IO_NodeTypeDef *output_node = (AUDIO_USB_IO_NodeTypeDef *)node_handle;
+
+  USBD_AUDIO_StageInPacket(output_node->specific.output.data_ep);
+}
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
 #endif /* USE_USB_AUDIO_RECORDING*/
 
+/**
+  * @brief  USB_AUDIO_Streaming_CacheClean
+  *         writes back the D-Cache lines of a ring range, so an audio DMA
+  *         reading the buffer gets the data written by the CPU
+  * @param  buf:   audio buffer
+  * @param  ptr:   free running pointer of range start
+  * @param  size:  range size in bytes
+  * @retval None
+  */
+static void USB_AUDIO_Streaming_CacheClean(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint32_t size)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  if(((SCB->CCR & SCB_CCR_DC_Msk) == 0U) || (size == 0U))
+  {
+    return;
+  }
+  /* the range may be in the margin */
+  AUDIO_BufferGetRegion(buf, ptr, size, &region);
+  SCB_CleanDCache_by_Addr((uint32_t *)region.data[0], (int32_t)region.length[0]);
+  if(region.length[1] != 0U)
+  {
+    SCB_CleanDCache_by_Addr((uint32_t *)region.data[1], (int32_t)region.length[1]);
+  }
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_CacheInvalidate
+  *         drops the D-Cache lines of a ring range before the CPU reads data
+  *         written by an audio DMA. Lines are cleaned first, data written by
+  *         the CPU in the same lines is kept
+  * @param  buf:   audio buffer
+  * @param  ptr:   free running pointer of range start
+  * @param  size:  range size in bytes
+  * @retval None
+  */
+static void USB_AUDIO_Streaming_CacheInvalidate(AUDIO_BufferTypeDef* buf, uint32_t ptr, uint32_t size)
+{
+  AUDIO_BufferRegionTypeDef region;
+
+  if(((SCB->CCR & SCB_CCR_DC_Msk) == 0U) || (size == 0U))
+  {
+    return;
+  }
+  /* the range may be in the margin */
+  AUDIO_BufferGetRegion(buf, ptr, size, &region);
+  SCB_CleanInvalidateDCache_by_Addr((uint32_t *)region.data[0], (int32_t)region.length[0]);
+  if(region.length[1] != 0U)
+  {
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)region.data[1], (int32_t)region.length[1]);
+  }
+}
+
 /**
   * @brief  USB_AUDIO_Streaming_IO_GetMaxPacketLength
   *         return max packet length 
@@ -745,13 +1322,15 @@ static int8_t  USB_AUDIO_Streaming_IO_SetCurFrequence(uint32_t freq, uint8_t* re
   }
   else
   {
+    AUDIO_DescriptionWriteBegin(aud);
     aud->frequence = best_freq;
+    AUDIO_DescriptionWriteEnd(aud);
   }
-#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
   usb_io_node->max_packet_length = AUDIO_MAX_PACKET_WITH_FEEDBACK_LENGTH(aud);
 #else
     usb_io_node->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(aud);
-#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
  }
  #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES*/
  
@@ -768,7 +1347,9 @@ static int8_t  USB_AUDIO_Streaming_IO_SetCurFrequence(uint32_t freq, uint8_t* re
   }
   else
   {
+    AUDIO_DescriptionWriteBegin(aud);
     aud->frequence = best_freq;
+    AUDIO_DescriptionWriteEnd(aud);
   }
 #ifdef  USE_AUDIO_RECORDING_USB_NO_REMOVE
   usb_io_node->max_packet_length = AUDIO_MAX_PACKET_WITH_FEEDBACK_LENGTH(aud);
@@ -776,21 +1357,31 @@ static int8_t  USB_AUDIO_Streaming_IO_SetCurFrequence(uint32_t freq, uint8_t* re
    usb_io_node->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(aud);
 #endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
    /* reallocat alternate buffer */
-  free(usb_io_node->specific.output.alt_buff);
-  usb_io_node->specific.output.alt_buff = (uint8_t *) malloc(usb_io_node->max_packet_length);
-   if(usb_io_node->specific.output.alt_buff)
+#ifdef USE_AUDIO_USB_ALTERNATE_ALLOC
+   /* not allocated while stopped, the start allocates it at the new size */
+   if(usb_io_node->specific.output.alt_buff != 0)
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
    {
-     memset(usb_io_node->specific.output.alt_buff, 0, usb_io_node->max_packet_length);
-   }
-   else
-   {
-     Error_Handler();
+     USBD_free(usb_io_node->specific.output.alt_buff);
+     usb_io_node->specific.output.alt_buff = (uint8_t *) USBD_malloc(usb_io_node->max_packet_length);
+     if(usb_io_node->specific.output.alt_buff)
+     {
+       AUDIO_MEMSET(usb_io_node->specific.output.alt_buff, 0, usb_io_node->max_packet_length);
+     }
+     else
+     {
+       Error_Handler();
+     }
    }
+   AUDIO_PacketSchedulerInit(&usb_io_node->specific.output.scheduler, aud, AUDIO_USB_PACKETS_PER_SECOND);
  }
 #endif /* USE_AUDIO_USB_RECORD_MULTI_FREQUENCES*/
   usb_io_node->packet_length = AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(aud);
-  usb_io_node->node.session_handle->SessionCallback(AUDIO_FREQUENCY_CHANGED,(AUDIO_NodeTypeDef*)usb_io_node,
-                                                        usb_io_node->node.session_handle);
+  if(AUDIO_SESSION_SUBSCRIBED(usb_io_node->node.session_handle, AUDIO_FREQUENCY_CHANGED))
+  {
+    usb_io_node->node.session_handle->SessionCallback(AUDIO_FREQUENCY_CHANGED,(AUDIO_NodeTypeDef*)usb_io_node,
+                                                      usb_io_node->node.session_handle);
+  }
  *restart_req = 1;
  }
  else
@@ -823,11 +1414,11 @@ static int8_t  USB_AUDIO_Streaming_Input_SetCurFrequence(uint32_t node_handle)
 {
   AUDIO_USB_IO_NodeTypeDef *input=(AUDIO_USB_IO_NodeTypeDef *)node_handle;
  
-#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
   input->max_packet_length = AUDIO_MAX_PACKET_WITH_FEEDBACK_LENGTH(input->node.audio_description);
 #else
     input->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(input->node.audio_description);
-#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
   input->packet_length = AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(input->node.audio_description);
   return 0;
 }
@@ -852,17 +1443,24 @@ static int8_t  USB_AUDIO_Streaming_Output_SetCurFrequence(uint32_t node_handle)
    output->max_packet_length = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(output->node.audio_description);
 #endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
    /* reallocat alternate buffer */
-  free(output->specific.output.alt_buff);
-  output->specific.output.alt_buff = (uint8_t *) malloc(output->max_packet_length);
-  if(output->specific.output.alt_buff)
+#ifdef USE_AUDIO_USB_ALTERNATE_ALLOC
+  /* not allocated while stopped, the start allocates it at the new size */
+  if(output->specific.output.alt_buff != 0)
+#endif /* USE_AUDIO_USB_ALTERNATE_ALLOC */
   {
-    memset(output->specific.output.alt_buff, 0, output->max_packet_length);
-  }
-  else
-  {
-    Error_Handler();
+    USBD_free(output->specific.output.alt_buff);
+    output->specific.output.alt_buff = (uint8_t *) USBD_malloc(output->max_packet_length);
+    if(output->specific.output.alt_buff)
+    {
+      AUDIO_MEMSET(output->specific.output.alt_buff, 0, output->max_packet_length);
+    }
+    else
+    {
+      Error_Handler();
+    }
   }
   output->packet_length = AUDIO_USB_PACKET_SIZE_FROM_AUD_DESC(output->node.audio_description);
+  AUDIO_PacketSchedulerInit(&output->specific.output.scheduler, output->node.audio_description, AUDIO_USB_PACKETS_PER_SECOND);
 
  return 0;
 }
@@ -872,39 +1470,45 @@ static int8_t  USB_AUDIO_Streaming_Output_SetCurFrequence(uint32_t node_handle)
 #if (defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES)
 /**
   * @brief  USB_AUDIO_Streaming_GetBestFrequence
-  *        get nearst supprted frequence
-  * @param  freq               
-  * @param  freq_table          
-  * @param  freq_count          
-  * @retval  0 if no error 
+  *         get nearest supported frequency, by halving the table down to the
+  *         two entries around freq
+  * @param  freq:       requested frequency
+  * @param  freq_table: supported frequencies, sorted from the highest
+  * @param  freq_count: size of freq_table
+  * @retval nearest supported frequency, the highest one on a tie
 */
 static uint32_t  USB_AUDIO_Streaming_GetBestFrequence(uint32_t freq,  uint32_t* freq_table,  int freq_count)
 {
-  
+  int low = 0;
+  int high = freq_count - 1;
+  int mid;
+
   if(freq >= freq_table[0])
- {
-   return freq_table[0];
- }
- else
- {
-    if(freq <= freq_table[freq_count-1])
-   {
-     return freq_table[freq_count-1];
-   }
-   else
-   {
-     for(int i = 1; i<freq_count; i++)
-     {
-       if(freq >= freq_table[i])
-       {
-         return ((freq_table[i-1] - freq )<= ( freq - freq_table[i]))?
-           freq_table[i-1] : freq_table[i];
-       }
-     }
-   }
- }
- 
-return 0; 
+  {
+    return freq_table[0];
+  }
+  if(freq <= freq_table[high])
+  {
+    return freq_table[high];
+  }
+  /* freq_table[low] > freq > freq_table[high] */
+  while(high - low > 1)
+  {
+    mid = (low + high) >> 1;
+    if(freq_table[mid] == freq)
+    {
+      return freq;
+    }
+    if(freq_table[mid] > freq)
+    {
+      low = mid;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+  return ((freq_table[low] - freq) <= (freq - freq_table[high])) ? freq_table[low] : freq_table[high];
 }
 #endif /* (defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES) */
 
@@ -947,6 +1551,7 @@ static int8_t  USB_AUDIO_Streaming_IO_GetState(uint32_t node_handle)
   cf->CFStart = USB_AUDIO_Streaming_CF_Start;
   cf->CFStop = USB_AUDIO_Streaming_CF_Stop;
   cf->CFSetMute = USB_AUDIO_Streaming_CF_SetMute;
+  cf->CFSetVolume = USB_AUDIO_Streaming_CF_SetVolume;
 #ifdef USE_USB_AUDIO_CLASS_10
   cf->usb_control_callbacks.GetStatus = USB_AUDIO_Streaming_CF_GetStatus;
 #endif /*USE_USB_AUDIO_CLASS_10*/
@@ -957,6 +1562,12 @@ static int8_t  USB_AUDIO_Streaming_IO_GetState(uint32_t node_handle)
   VOLUME_DB_256_TO_USB(cf->usb_control_callbacks.MaxVolume, audio_defaults->max_volume);
   VOLUME_DB_256_TO_USB(cf->usb_control_callbacks.MinVolume, audio_defaults->min_volume);
   cf->usb_control_callbacks.ResVolume = audio_defaults->res_volume;
+  /* the range does not change, its GET_RANGE payload is built once */
+  cf->volume_range[0] = 1; /* one subrange */
+  cf->volume_range[1] = 0;
+  AUDIO_2_L2_RNG_VAL_TO_DATA(cf->usb_control_callbacks.MinVolume, cf->usb_control_callbacks.MaxVolume,
+                             cf->usb_control_callbacks.ResVolume, cf->volume_range + 2);
+  cf->usb_control_callbacks.VolumeRange = cf->volume_range;
   cf->node.audio_description=audio_defaults->audio_description;
   
   /* @TODO fill next request map and selector */
@@ -966,6 +1577,18 @@ static int8_t  USB_AUDIO_Streaming_IO_GetState(uint32_t node_handle)
   usb_control_feature->type = USBD_AUDIO_CS_AC_SUBTYPE_FEATURE_UNIT;
   usb_control_feature->Callbacks.feature_control = &cf->usb_control_callbacks;
   usb_control_feature->private_data = node_handle;
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+  for(uint32_t i = 0; i < USB_AUDIO_CF_MAILBOX_NODES; i++)
+  {
+    if((cf_mailbox_nodes[i] == 0) || (cf_mailbox_nodes[i] == cf))
+    {
+      cf_mailbox_nodes[i] = cf;
+      break;
+    }
+  }
+  AUDIO_PumpSetHandler(AUDIO_PUMP_CF_MAILBOX, USB_AUDIO_Streaming_CF_MailboxHandler);
+  AUDIO_SofTickSubscribe(USB_AUDIO_Streaming_CF_MailboxTick, AUDIO_SOF_TICK_PER_MS, 0);
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
   return 0;
 }
 
@@ -979,6 +1602,16 @@ static int8_t  USB_AUDIO_Streaming_IO_GetState(uint32_t node_handle)
 static int8_t USB_AUDIO_Streaming_CF_DInit(uint32_t node_handle)
 {
   ((AUDIO_USB_CF_NodeTypeDef*)node_handle)->node.state = AUDIO_NODE_OFF;
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+  /* also the clock nodes DeInit, which are never in the mailbox */
+  for(uint32_t i = 0; i < USB_AUDIO_CF_MAILBOX_NODES; i++)
+  {
+    if(cf_mailbox_nodes[i] == (AUDIO_USB_CF_NodeTypeDef*)node_handle)
+    {
+      cf_mailbox_nodes[i] = 0;
+    }
+  }
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
   return 0;
 }
 
@@ -1002,6 +1635,19 @@ static int8_t USB_AUDIO_Streaming_CF_Start(AUDIO_DevicesCommandsTypedef* command
                                       cf->node.audio_description->audio_volume_db_256,
                                       cf->control_cbks.private_data);
   }
+  /* restore the channels settings received while stopped */
+  for(uint16_t channel = 1; channel <= cf->node.audio_description->channels_count; channel++)
+  {
+    if(cf->control_cbks.SetCurrentVolume)
+    {
+      cf->control_cbks.SetCurrentVolume(channel, cf->channel_volume_db_256[channel - 1],
+                                        cf->control_cbks.private_data);
+    }
+    if(cf->control_cbks.SetMute)
+    {
+      cf->control_cbks.SetMute(channel, cf->channel_mute[channel - 1], cf->control_cbks.private_data);
+    }
+  }
   return 0;
 }
 
@@ -1027,12 +1673,25 @@ static int8_t USB_AUDIO_Streaming_CF_Stop( uint32_t node_handle)
   * @param  channel: channel number , 0 for master channel
   * @param  mute: returned mute value
   * @param  node_handle: the Feature node handle, node must be initialized
-  * @retval  0 for no error
+  * @retval  0 for no error, -1 when the channel does not exist
   */
 static int8_t USB_AUDIO_Streaming_CF_GetMute(uint16_t channel, uint8_t* mute, uint32_t node_handle)
 {
-  /**@TODO add channel management  */
-  *mute = ((AUDIO_USB_CF_NodeTypeDef*)node_handle)->node.audio_description->audio_mute; 
+  AUDIO_USB_CF_NodeTypeDef * cf;
+  
+  cf = (AUDIO_USB_CF_NodeTypeDef*)node_handle;
+  if(channel == 0)
+  {
+    *mute = cf->node.audio_description->audio_mute; 
+  }
+  else if(channel <= cf->node.audio_description->channels_count)
+  {
+    *mute = cf->channel_mute[channel - 1];
+  }
+  else
+  {
+    return -1;
+  }
   return 0; 
 }
 
@@ -1042,20 +1701,38 @@ static int8_t USB_AUDIO_Streaming_CF_GetMute(uint16_t channel, uint8_t* mute, ui
   * @param  channel: channel number , 0 for master channel
   * @param  mute:  mute value
   * @param  node_handle: the Feature node handle, node must be initialized
-  * @retval  0 for no error
+  * @retval  0 for no error, -1 when the channel does not exist
   */
 static int8_t USB_AUDIO_Streaming_CF_SetMute(uint16_t channel, uint8_t mute, uint32_t node_handle)
 {
   AUDIO_USB_CF_NodeTypeDef * cf;
   
   cf = (AUDIO_USB_CF_NodeTypeDef*)node_handle;
-  /**@TODO add channel management  */
-  
-  cf->node.audio_description->audio_mute = mute;
+  if(channel == 0)
+  {
+    AUDIO_DescriptionWriteBegin(cf->node.audio_description);
+    cf->node.audio_description->audio_mute = mute;
+    AUDIO_DescriptionWriteEnd(cf->node.audio_description);
+  }
+  else if(channel <= cf->node.audio_description->channels_count)
+  {
+    cf->channel_mute[channel - 1] = mute;
+  }
+  else
+  {
+    return -1;
+  }
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+  if(cf->node.state == AUDIO_NODE_STARTED)
+  {
+    USB_AUDIO_Streaming_CF_MailboxPost(cf, &cf->pending_mute, channel);
+  }
+#else /* USE_AUDIO_CONTROL_MAILBOX */
   if((cf->node.state == AUDIO_NODE_STARTED)&&(cf->control_cbks.SetMute))
   {
       cf->control_cbks.SetMute(channel, mute, cf->control_cbks.private_data);
   }
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
   return 0;
 }
 
@@ -1065,12 +1742,25 @@ static int8_t USB_AUDIO_Streaming_CF_SetMute(uint16_t channel, uint8_t mute, uin
   * @param  channel:            channel number , 0 for master channel
   * @param  volume:             returned volume value
   * @param  node_handle:        the Feature node handle, node must be initialized
-  * @retval  0 for no error
+  * @retval  0 for no error, -1 when the channel does not exist
   */
 static int8_t USB_AUDIO_Streaming_CF_GetCurVolume(uint16_t channel, uint16_t* volume, uint32_t node_handle)
 {
-  /**@TODO add channel management  */
-  VOLUME_DB_256_TO_USB(*volume, ((AUDIO_NodeTypeDef*)node_handle)->audio_description->audio_volume_db_256);
+  AUDIO_USB_CF_NodeTypeDef* cf;
+  
+  cf = (AUDIO_USB_CF_NodeTypeDef*)node_handle;
+  if(channel == 0)
+  {
+    VOLUME_DB_256_TO_USB(*volume, cf->node.audio_description->audio_volume_db_256);
+  }
+  else if(channel <= cf->node.audio_description->channels_count)
+  {
+    VOLUME_DB_256_TO_USB(*volume, cf->channel_volume_db_256[channel - 1]);
+  }
+  else
+  {
+    return -1;
+  }
   return 0; 
 }
 
@@ -1080,25 +1770,164 @@ static int8_t USB_AUDIO_Streaming_CF_GetCurVolume(uint16_t channel, uint16_t* vo
   * @param  channel:            channel number , 0 for master channel
   * @param  volume:             volume value
   * @param  node_handle:        the Feature node handle, node must be initialized
-  * @retval  0 for no error
+  * @retval  0 for no error, -1 when the channel does not exist
   */
 static int8_t USB_AUDIO_Streaming_CF_SetCurVolume(uint16_t channel, uint16_t volume, uint32_t node_handle)
 {
   AUDIO_USB_CF_NodeTypeDef* cf;
+  int* volume_db_256;
   
   cf = (AUDIO_USB_CF_NodeTypeDef*)node_handle;
-  /**@TODO add channel management  */
+  if(channel == 0)
+  {
+    volume_db_256 = &cf->node.audio_description->audio_volume_db_256;
+  }
+  else if(channel <= cf->node.audio_description->channels_count)
+  {
+    volume_db_256 = &cf->channel_volume_db_256[channel - 1];
+  }
+  else
+  {
+    return -1;
+  }
   
-  VOLUME_USB_TO_DB_256(cf->node.audio_description->audio_volume_db_256, volume);
+  AUDIO_DescriptionWriteBegin(cf->node.audio_description);
+  VOLUME_USB_TO_DB_256(*volume_db_256, volume);
+  AUDIO_DescriptionWriteEnd(cf->node.audio_description);
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+  if(cf->node.state == AUDIO_NODE_STARTED)
+  {
+    /* only the latest value is applied, from the pump */
+    USB_AUDIO_Streaming_CF_MailboxPost(cf, &cf->pending_volume, channel);
+  }
+#else /* USE_AUDIO_CONTROL_MAILBOX */
   if((cf->node.state == AUDIO_NODE_STARTED)&&(cf->control_cbks.SetCurrentVolume))
   {
     cf->control_cbks.SetCurrentVolume(channel, 
-                                      cf->node.audio_description->audio_volume_db_256,
+                                      *volume_db_256,
                                       cf->control_cbks.private_data);
   }
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
   return 0;
 }
 
+/**
+  * @brief  USB_AUDIO_Streaming_CF_SetVolume
+  *         set current volume from the device side, checked against the
+  *         range announced to the host
+  * @param  channel:            channel number , 0 for master channel
+  * @param  volume_db_256:      volume in db 8.8 format
+  * @param  node_handle:        the Feature node handle, node must be initialized
+  * @retval  0 for no error, -1 when the channel does not exist or volume is out of range
+  */
+static int8_t USB_AUDIO_Streaming_CF_SetVolume(uint16_t channel, int volume_db_256, uint32_t node_handle)
+{
+  AUDIO_USB_CF_NodeTypeDef* cf;
+  int max_db_256;
+  int min_db_256;
+  uint16_t volume;
+
+  cf = (AUDIO_USB_CF_NodeTypeDef*)node_handle;
+  VOLUME_USB_TO_DB_256(max_db_256, cf->usb_control_callbacks.MaxVolume);
+  VOLUME_USB_TO_DB_256(min_db_256, cf->usb_control_callbacks.MinVolume);
+  if((volume_db_256 > max_db_256) || (volume_db_256 < min_db_256))
+  {
+    return -1;
+  }
+  VOLUME_DB_256_TO_USB(volume, volume_db_256);
+  return USB_AUDIO_Streaming_CF_SetCurVolume(channel, volume, node_handle);
+}
+
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+/**
+  * @brief  USB_AUDIO_Streaming_CF_MailboxPost
+  *         marks a channel setting to apply at the next frame, the value is
+  *         the one stored in the node when the pump applies it
+  * @param  cf:                 the Feature node, must be started
+  * @param  pending:            pending volume or mute channels of the node
+  * @param  channel:            channel number , 0 for master channel
+  * @retval None
+  */
+static void USB_AUDIO_Streaming_CF_MailboxPost(AUDIO_USB_CF_NodeTypeDef* cf, volatile uint16_t* pending, uint16_t channel)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  *pending |= (uint16_t)(1U << channel);
+  __set_PRIMASK(primask);
+  cf_mailbox_posted = 1;
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_CF_MailboxTick
+  *         SOF tick each ms, posts the requests of the frame to the pump
+  * @param  private_data:       unused
+  * @retval None
+  */
+static void USB_AUDIO_Streaming_CF_MailboxTick(uint32_t private_data)
+{
+  if(cf_mailbox_posted)
+  {
+    cf_mailbox_posted = 0;
+    AUDIO_PumpPost(AUDIO_PUMP_CF_MAILBOX);
+  }
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_CF_MailboxHandler
+  *         applies the latest volume and mute of the pending channels, at the
+  *         pump audio level
+  * @param  None
+  * @retval None
+  */
+static void USB_AUDIO_Streaming_CF_MailboxHandler(void)
+{
+  AUDIO_USB_CF_NodeTypeDef* cf;
+  uint32_t primask;
+  uint16_t volume;
+  uint16_t mute;
+
+  for(uint32_t i = 0; i < USB_AUDIO_CF_MAILBOX_NODES; i++)
+  {
+    cf = cf_mailbox_nodes[i];
+    if(cf == 0)
+    {
+      continue;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();
+    volume = cf->pending_volume;
+    mute = cf->pending_mute;
+    cf->pending_volume = 0;
+    cf->pending_mute = 0;
+    __set_PRIMASK(primask);
+    if(cf->node.state != AUDIO_NODE_STARTED)
+    {
+      /* CFStart applies all the settings */
+      continue;
+    }
+    for(uint16_t channel = 0; (volume | mute) != 0U; channel++, volume >>= 1, mute >>= 1)
+    {
+      if((volume & 1U) && (cf->control_cbks.SetCurrentVolume))
+      {
+        cf->control_cbks.SetCurrentVolume(channel,
+                                          (channel == 0) ? cf->node.audio_description->audio_volume_db_256 :
+                                                           cf->channel_volume_db_256[channel - 1],
+                                          cf->control_cbks.private_data);
+      }
+      if((mute & 1U) && (cf->control_cbks.SetMute))
+      {
+        cf->control_cbks.SetMute(channel,
+                                 (channel == 0) ? cf->node.audio_description->audio_mute :
+                                                  cf->channel_mute[channel - 1],
+                                 cf->control_cbks.private_data);
+      }
+    }
+  }
+}
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
+
 #ifdef USE_USB_AUDIO_CLASS_10
 /**
   * @brief  USB_AUDIO_Streaming_CF_GetStatus          
@@ -1152,6 +1981,11 @@ static int8_t  USB_AUDIO_Streaming_CF_GetStatus( uint32_t node_handle )
 #endif /*(defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES)*/
   clk->control_cbks = *clk_cmds;
   clk->node.audio_description = audio_description;
+  if(clk->control_cbks.clock_freq_count > USB_AUDIO_CLK_SRC_MAX_FREQ_COUNT)
+  {
+    return -1;
+  }
+  USB_AUDIO_Streaming_CLK_SRC_UpdateRange(node_handle);
   
   /* @TODO fill next request map and selector */
   usb_control_feature->id = clock_src_id;
@@ -1220,9 +2054,13 @@ static int8_t USB_AUDIO_Streaming_CLK_SRC_SetCurFrequency(uint32_t frequency, ui
   }
   else
   {
-    clk->control_cbks.SetFrequency(frequency, as_cnt_to_restart, as_list_to_restart,  clk->control_cbks.private_data);
+    int8_t ret;
+
+    ret = clk->control_cbks.SetFrequency(best_freq, as_cnt_to_restart, as_list_to_restart,  clk->control_cbks.private_data);
+    /* a single frequency list is the current frequency itself */
+    USB_AUDIO_Streaming_CLK_SRC_UpdateRange(node_handle);
+    return ret;
   }
-  return 0;
 }
 #endif /*(defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)||(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES)*/
 /**
@@ -1258,6 +2096,33 @@ static int8_t USB_AUDIO_Streaming_CLK_SRC_GetFrequenciesList(uint32_t** frequenc
   *freq_count = clk->control_cbks.clock_freq_count;
   return 0;
 }
+/**
+  * @brief  USB_AUDIO_Streaming_CLK_SRC_UpdateRange
+  *         builds the GET_RANGE payload of the frequency list, served from EP0
+  *         without rebuilding it at each host poll. To call when the list or a
+  *         frequency it points to changes, out of the EP0 request handling
+  * @param  node_handle:        the Clock source node handle, node must be initialized
+  * @retval  None
+  */
+void USB_AUDIO_Streaming_CLK_SRC_UpdateRange(uint32_t node_handle)
+{
+  AUDIO_USB_ClockSrc_NodeTypeDef *clk;
+  uint8_t* range;
+
+  clk = (AUDIO_USB_ClockSrc_NodeTypeDef*)node_handle;
+  range = clk->freq_range;
+  *(range++) = (uint8_t)clk->control_cbks.clock_freq_count;
+  *(range++) = 0;
+  /* a discrete frequency is a subrange with MIN = MAX and RES = 0 */
+  for(int i = 0; i < clk->control_cbks.clock_freq_count; i++)
+  {
+    AUDIO_2_L3_RNG_VAL_TO_DATA(clk->control_cbks.clock_freq_list[i], clk->control_cbks.clock_freq_list[i], 0, range);
+    range += AUDIO_2_L3_RNG_SIZE;
+  }
+  clk->usb_control_callbacks.FrequencyRangeLength = (uint16_t)(range - clk->freq_range);
+  clk->usb_control_callbacks.FrequencyRange = (clk->control_cbks.clock_freq_count > 0U) ? clk->freq_range : 0;
+}
+
 /**
   * @brief  USB_AUDIO_Streaming_CLK_SRC_GetIsValid
   *         check if clock is valid  
@@ -1267,27 +2132,165 @@ static int8_t USB_AUDIO_Streaming_CLK_SRC_GetFrequenciesList(uint32_t** frequenc
   */
 static int8_t USB_AUDIO_Streaming_CLK_SRC_GetIsValid(uint8_t *is_valid, uint32_t node_handle)
 {
+  AUDIO_USB_ClockSrc_NodeTypeDef *clk;
+
+  clk = (AUDIO_USB_ClockSrc_NodeTypeDef*)node_handle;
+  if(clk->control_cbks.IsValid)
+  {
+    /* an external clock is valid while its receiver is locked */
+    return clk->control_cbks.IsValid(is_valid, clk->control_cbks.private_data);
+  }
   *is_valid = 1;
   return 0;
 }
+
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/**
+  * @brief  USB_AUDIO_Streaming_CLK_SEL_Init
+  *         Initializes clock selector node
+  * @param  usb_control_selector:       supported controls
+  * @param  sel_cmds:                   Specific clock selector commands
+  * @param  clock_selector_id:          usb unit id
+  * @param  default_pin:                clock source input selected at start
+  * @param  node_handle:                the node handle, node must be allocated
+  * @retval  0 for no error
+  */
+int8_t USB_AUDIO_Streaming_CLK_SEL_Init(USBD_AUDIO_ControlTypeDef* usb_control_selector,
+                                        AUDIO_DevicesClockSelectCommandsTypedef* sel_cmds,
+                                        uint8_t clock_selector_id, uint8_t default_pin,
+                                        uint32_t node_handle)
+{
+  AUDIO_USB_ClockSel_NodeTypeDef *sel;
+
+  sel = (AUDIO_USB_ClockSel_NodeTypeDef*)node_handle;
+  memset(sel, 0, sizeof(AUDIO_USB_ClockSel_NodeTypeDef));
+  sel->node.state = AUDIO_NODE_INITIALIZED;
+  sel->node.type = AUDIO_CLOCK;
+  sel->clock_selector_id = clock_selector_id;
+  sel->selected_pin = default_pin;
+  sel->control_cbks = *sel_cmds;
+  sel->usb_control_callbacks.GetCurSelector = USB_AUDIO_Streaming_CLK_SEL_GetCurSelector;
+  sel->usb_control_callbacks.SetCurSelector = USB_AUDIO_Streaming_CLK_SEL_SetCurSelector;
+
+  usb_control_selector->id = clock_selector_id;
+  usb_control_selector->control_req_map = 0;
+  usb_control_selector->control_selector_map = USBD_AUDIO_CX_CLOCK_SELECTOR_CONTROL;
+  usb_control_selector->type = USBD_AUDIO_CS_AC_SUBTYPE_CLOCK_SELECTOR;
+  usb_control_selector->Callbacks.clk_sel_control = &sel->usb_control_callbacks;
+  usb_control_selector->private_data = node_handle;
+  return 0;
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_CLK_SEL_GetCurSelector
+  *         get the clock source input in use
+  * @param  pin:                returned input, from 1
+  * @param  node_handle:        the Clock selector node handle, node must be initialized
+  * @retval  0 for no error
+  */
+static int8_t USB_AUDIO_Streaming_CLK_SEL_GetCurSelector(uint8_t* pin, uint32_t node_handle)
+{
+  AUDIO_USB_ClockSel_NodeTypeDef *sel;
+
+  sel = (AUDIO_USB_ClockSel_NodeTypeDef*)node_handle;
+  *pin = sel->selected_pin;
+  return 0;
+}
+
+/**
+  * @brief  USB_AUDIO_Streaming_CLK_SEL_SetCurSelector
+  *         switch to an other clock source input
+  * @param  pin:                new input, from 1
+  * @param  as_cnt_to_restart:  returned count of AS interfaces to restart
+  * @param  as_list_to_restart: returned AS interfaces to restart
+  * @param  node_handle:        the Clock selector node handle, node must be initialized
+  * @retval  0 for no error, -1 when the input doesn't exist or can't be used
+  */
+static int8_t USB_AUDIO_Streaming_CLK_SEL_SetCurSelector(uint8_t pin, uint8_t* as_cnt_to_restart,
+                                                         uint8_t* as_list_to_restart, uint32_t node_handle)
+{
+  AUDIO_USB_ClockSel_NodeTypeDef *sel;
+
+  sel = (AUDIO_USB_ClockSel_NodeTypeDef*)node_handle;
+  *as_cnt_to_restart = 0;
+  if((pin == 0U) || (pin > sel->control_cbks.pin_count))
+  {
+    return -1;
+  }
+  if(pin == sel->selected_pin)
+  {
+    return 0;
+  }
+  if(sel->control_cbks.SelectSource(pin, as_cnt_to_restart, as_list_to_restart, sel->control_cbks.private_data) != 0)
+  {
+    return -1;
+  }
+  sel->selected_pin = pin;
+  return 0;
+}
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
 
 
 /**
   * @brief  AUDIO_USB_InitializesDataBuffer
   *         compute the  buffer size and add margin if needed
+  *         the ring size is the greatest power of two which fits in buffer_size - margin
   * @param  buf: session               
-  * @param  buffer_size:                
-  * @param  packet_size:                
-  * @param  margin:                    
+  * @param  buffer_size: allocated size of buf->data
+  * @param  packet_size: nominal packet size, the ring must hold at least two packets
+  * @param  margin: bytes reserved after the ring, must be at least the max packet size
   * @retval 0 if no error
   */
   void AUDIO_USB_InitializesDataBuffer(AUDIO_BufferTypeDef* buf, 
                                        uint32_t buffer_size, 
                                        uint16_t packet_size, uint16_t margin)
  {
-    buf->size = ((int)((buffer_size - margin )
-                       / packet_size)) * packet_size; 
-    buf->rd_ptr = buf->wr_ptr = 0;
+    uint32_t size = 1;
+    
+    while((size << 1) <= (buffer_size - margin))
+    {
+      size <<= 1;
+    }
+    if(size < 2 * (uint32_t)packet_size)
+    {
+      Error_Handler();
+    }
+    buf->size = size;
+    buf->mask = size - 1;
+    buf->margin = margin;
+    AUDIO_BufferReset(buf);
+    /* levels are relative to the ring size */
+    AUDIO_BufferTelemetryReset(buf, HAL_GetTick());
+#ifdef USE_AUDIO_PACKET_QUEUE
+    AUDIO_PacketDelayReset(buf);
+#endif /* USE_AUDIO_PACKET_QUEUE */
  }
+
+/**
+  * @brief  AUDIO_USB_LinkTopology
+  *         links the nodes of a topology table : each node feeds the node of
+  *         the entity whose source is its id, the last one feeds none. Called
+  *         once the nodes are initialized, their Init clears next
+  * @param  entities: entities of the path, in any order
+  * @param  count: entities count
+  * @retval None
+  */
+void AUDIO_USB_LinkTopology(const AUDIO_USB_EntityTypeDef* entities, uint8_t count)
+{
+  uint8_t i, j;
+
+  for(i = 0; i < count; i++)
+  {
+    entities[i].node->next = 0;
+    for(j = 0; j < count; j++)
+    {
+      if(entities[j].source == entities[i].id)
+      {
+        entities[i].node->next = entities[j].node;
+        break;
+      }
+    }
+  }
+}
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
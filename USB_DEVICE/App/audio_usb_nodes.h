@@ -56,25 +56,60 @@
 /* Includes ------------------------------------------------------------------*/
 #include  "usbd_audio.h"
 #include  "audio_node.h"
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+#include  "audio_resampler.h"
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 /* Exported constants --------------------------------------------------------*/
-#define AUDIO_MAX_SUPPORTED_CHANNEL_COUNT 2    /* we support sterio audio channels */
+#define AUDIO_MAX_SUPPORTED_CHANNEL_COUNT 8    /* up to 8 audio channels, each with its own mute & volume */
 #define AUDIO_IO_BEGIN_OF_STREAM          0x01 /* Begin of stream flag */
 #define AUDIO_IO_BEGIN_OF_READ            0x02
+#define AUDIO_IO_START_PENDING            0x04 /* output node : the session starts from the pump, silence is sent meanwhile, USE_AUDIO_DEFERRED_ALTERNATE */
 #define AUDIO_IO_RESTART_REQUIRED         0x40 /* Restart of node is required , after frequency changes for exampels */
 #define AUDIO_IO_THERSHOLD_REACHED        0x08 /* flag that buffer fill thershold is reached */ 
+#define AUDIO_IO_DMA_BOUNCE               0x10 /* current packet goes through dma_buff because the ring offset is not DMA aligned */
+#define AUDIO_IO_MUTE_BYPASS              0x20 /* muted stream, the chain ran its fade out and is skipped, USE_AUDIO_MUTE_BYPASS */
+#define AUDIO_IO_SILENCE                  0x80 /* silence held past the hold time, the output stage is off, USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+#ifndef AUDIO_PLAYBACK_SILENCE_HOLD_MS
+#define AUDIO_PLAYBACK_SILENCE_HOLD_MS    2000U /* zero packets before the output stage is powered down */
+#endif /* AUDIO_PLAYBACK_SILENCE_HOLD_MS */
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#define USB_AUDIO_CLK_SRC_MAX_FREQ_COUNT  4    /* 44.1, 48, 96 and 192 KHz */
 
 /* Exported types ------------------------------------------------------------*/
 typedef struct
 {
-    uint16_t thershold; /* after star when received size reach thershold and event is raised to play audio*/
+    uint32_t thershold; /* after star when received size reach thershold and event is raised to play audio*/
+    uint16_t last_packet_length; /* length of last received packet, repeated when a packet is missed */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+    uint32_t silence_bytes; /* zero bytes received in a row, up to the hold time */
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+    uint32_t arrival_time; /* DWT cycles when the last packet was received */
+    uint32_t jitter_peak;  /* decaying peak of the packet lateness over its period, DWT cycles */
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_USB_OUT_PINGPONG
+    uint8_t* rx_buff; /* two halves, one is being received while the other one is processed */
+    uint8_t rx_half;  /* half of rx_buff the endpoint is armed with */
+#endif /* USE_AUDIO_USB_OUT_PINGPONG */
 }AUDIO_USB_Input_SpecifcTypeDef;
 
 typedef struct
 {
     uint8_t* alt_buff;/* buffer_tosend_when_no_data_prepared*/
-#if USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K
-    uint8_t packet_44_counter;
-#endif /* USB_AUDIO_CONFIG_RECORD_FREQ_44_1_K */
+    uint32_t thershold; /* after start, real data is sent once filled size reaches thershold */
+    AUDIO_PacketSchedulerTypeDef scheduler; /* length of each packet to send */
+#ifdef USE_AUDIO_SYNC_START
+    uint32_t lead_bytes; /* silence sent since the start, before the first ring data */
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+    AUDIO_ResamplerTypeDef resampler; /* converts mic rate to USB rate */
+    uint8_t* resampled_buff; /* packet produced by resampler */
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+    USBD_AUDIO_EP_DataTypeDef* data_ep; /* staged by USB_AUDIO_Streaming_Output_Stage */
+    uint8_t scratch; /* half of the bounce buffers used by the next packet, the other one may be in flight */
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
 }AUDIO_USB_Output_SpecifcTypeDef;
 
 typedef struct
@@ -84,8 +119,11 @@ typedef struct
   AUDIO_BufferTypeDef* buf; /* buffer to use */
   uint16_t             max_packet_length; /* the packet to read each time from buffer */
   uint16_t             packet_length; /* the packet normallength */
+#ifdef USE_USB_HS_DMA
+  uint8_t*             dma_buff; /* aligned bounce buffer of max_packet_length bytes */
+#endif /* USE_USB_HS_DMA */
   int8_t  (*IODeInit) (uint32_t /*node_handle*/);
-  int8_t  (*IOStart) (AUDIO_BufferTypeDef* buffer, uint16_t thershold, uint32_t /*node handle*/);
+  int8_t  (*IOStart) (AUDIO_BufferTypeDef* buffer, uint32_t thershold, uint32_t /*node handle*/);
   int8_t  (*IORestart) ( uint32_t /*node handle*/);
   int8_t  (*IOStop) ( uint32_t /*node handle*/);
 #ifdef USE_USB_AUDIO_CLASS_20
@@ -126,6 +164,13 @@ typedef struct
   uint8_t unit_id;                              /* UNIT ID for usb audio function description and control*/
   USBD_AUDIO_FeatureControlCallbacksTypeDef usb_control_callbacks;      /* list of callbacks */
   AUDIO_DevicesCommandsTypedef control_cbks;                            /* */
+  uint8_t channel_mute[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];              /* mute of channels 1..n, master (0) is in audio description */
+  int     channel_volume_db_256[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];     /* volume of channels 1..n, master (0) is in audio description */
+  uint8_t volume_range[AUDIO_2_RNG_PAYLOAD_SIZE(AUDIO_2_L2_RNG_SIZE, 1U)]; /* GET_RANGE payload, built at init */
+#ifdef USE_AUDIO_CONTROL_MAILBOX
+  volatile uint16_t pending_volume;             /* channels (bit 0 for master) whose volume waits for the pump */
+  volatile uint16_t pending_mute;               /* channels (bit 0 for master) whose mute waits for the pump */
+#endif /* USE_AUDIO_CONTROL_MAILBOX */
   int8_t  (*CFInit)    (USBD_AUDIO_ControlTypeDef* /*control*/  ,
                         AUDIO_ControlDeviceDefaultsTypedef* /*audio_defaults*/,
                         uint8_t /*unit_id*/,  
@@ -134,6 +179,7 @@ typedef struct
   int8_t  (*CFStart)   (  AUDIO_DevicesCommandsTypedef* /* commands */, uint32_t /*node handle*/);
   int8_t  (*CFStop)    (uint32_t /*node handle*/);
   int8_t  (*CFSetMute)    (uint16_t /*channel*/,uint8_t /*mute*/, uint32_t /* node handle*/);
+  int8_t  (*CFSetVolume)  (uint16_t /*channel*/,int /*volume_db_256*/, uint32_t /* node handle*/);
 }
 AUDIO_USB_CF_NodeTypeDef;
 #ifdef USE_USB_AUDIO_CLASS_20
@@ -142,6 +188,7 @@ AUDIO_USB_CF_NodeTypeDef;
 typedef struct 
 {
   int8_t  (*SetFrequency)    (uint32_t /*freq*/, uint8_t* /*as_cnt_to_restart*/ ,uint8_t* /*as_list_to_restart*/ ,uint32_t /*private_data*/);
+  int8_t  (*IsValid)         (uint8_t* /*is_valid*/, uint32_t /*private_data*/); /* 0 for a clock always valid */
   uint32_t* clock_freq_list;
   uint16_t clock_freq_count;
   uint32_t private_data;
@@ -154,6 +201,7 @@ typedef struct
 
   USBD_AUDIO_ClockSourceCallbacksTypeDef usb_control_callbacks;      /* list of callbacks */
   AUDIO_DevicesClockCommandsTypedef control_cbks;                            /* */
+  uint8_t freq_range[AUDIO_2_RNG_PAYLOAD_SIZE(AUDIO_2_L3_RNG_SIZE, USB_AUDIO_CLK_SRC_MAX_FREQ_COUNT)]; /* GET_RANGE payload */
   int8_t  (*CSInit)    (USBD_AUDIO_ControlTypeDef* /*control*/  ,
                         AUDIO_DevicesClockCommandsTypedef* /*clk_cmds*/,
                         uint8_t /*unit_id*/,
@@ -164,7 +212,35 @@ typedef struct
   int8_t  (*CSStop)    (uint32_t /*node handle*/);
 }
 AUDIO_USB_ClockSrc_NodeTypeDef;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* Clock Selector Entity */
+/* Clock selector callbacks */
+typedef struct
+{
+  int8_t  (*SelectSource)    (uint8_t /*pin*/, uint8_t* /*as_cnt_to_restart*/ ,uint8_t* /*as_list_to_restart*/ ,uint32_t /*private_data*/);
+  uint8_t  pin_count;
+  uint32_t private_data;
+} AUDIO_DevicesClockSelectCommandsTypedef;
+
+typedef struct
+{
+  AUDIO_NodeTypeDef node;        /* generic node structure , must be first field */
+  uint8_t clock_selector_id;     /* Clock_Selector ID for usb audio function description and control */
+  uint8_t selected_pin;          /* clock source input in use, 1 to pin_count */
+  USBD_AUDIO_ClockSelectorCallbacksTypeDef usb_control_callbacks;    /* list of callbacks */
+  AUDIO_DevicesClockSelectCommandsTypedef control_cbks;
+}
+AUDIO_USB_ClockSel_NodeTypeDef;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
+/* entity of an AUDIO_TOPOLOGY_xxx table, see usb_audio_user.h */
+typedef struct
+{
+  uint8_t            id;         /* terminal or unit id */
+  uint8_t            source;     /* id of the entity feeding it, 0 for the first one */
+  AUDIO_NodeTypeDef* node;       /* node implementing it */
+}
+AUDIO_USB_EntityTypeDef;
 /* Exported macros -----------------------------------------------------------*/ 
 #define VOLUME_USB_TO_DB_256(v_db, v_usb) (v_db) = (v_usb <= 0x7FFF)? v_usb:  - (((int)0xFFFF - v_usb)+1)
 #define VOLUME_DB_256_TO_USB(v_usb, v_db) (v_usb) = (v_db >= 0)? v_db : ((int)0xFFFF+v_db) +1   
@@ -180,14 +256,21 @@ int8_t  USB_AUDIO_Streaming_Input_Init(USBD_AUDIO_EP_DataTypeDef* data_ep,
 int8_t  USB_AUDIO_Streaming_Output_Init(USBD_AUDIO_EP_DataTypeDef* data_ep,
                                                AUDIO_DescriptionTypeDef* audio_desc,
                                                AUDIO_SessionTypeDef* session_handle,  uint32_t node_handle);
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+void    USB_AUDIO_Streaming_Output_Stage(uint32_t node_handle);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
  int8_t  AUDIO_Recording_get_Sample_to_add(struct AUDIO_Session* session_handle);
  int8_t  AUDIO_Recording_Set_Sample_Written(struct AUDIO_Session* session_handle, uint16_t bytes);
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+ uint32_t  AUDIO_Recording_get_Resampler_Step(struct AUDIO_Session* session_handle);
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 #endif /* USE_USB_AUDIO_RECORDING*/
 int8_t USB_AUDIO_Streaming_CF_Init(USBD_AUDIO_ControlTypeDef* usb_control_feature,
                                    AUDIO_ControlDeviceDefaultsTypedef* audio_defaults, uint8_t unit_id,
                                    uint32_t node_handle);
 void AUDIO_USB_InitializesDataBuffer(AUDIO_BufferTypeDef* buf, uint32_t buffer_size, 
                                      uint16_t packet_size, uint16_t margin);
+void AUDIO_USB_LinkTopology(const AUDIO_USB_EntityTypeDef* entities, uint8_t count);
 /* UAC 2.0 specific functions */
 #ifdef USE_USB_AUDIO_CLASS_20
 int8_t USB_AUDIO_Streaming_CLK_SRC_Init(USBD_AUDIO_ControlTypeDef* usb_control_feature  ,
@@ -195,6 +278,13 @@ int8_t USB_AUDIO_Streaming_CLK_SRC_Init(USBD_AUDIO_ControlTypeDef* usb_control_f
                                          uint8_t        clock_src_id,
                                          AUDIO_DescriptionTypeDef* audio_description,
                                          uint32_t node_handle);
+void USB_AUDIO_Streaming_CLK_SRC_UpdateRange(uint32_t node_handle);
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+int8_t USB_AUDIO_Streaming_CLK_SEL_Init(USBD_AUDIO_ControlTypeDef* usb_control_selector,
+                                        AUDIO_DevicesClockSelectCommandsTypedef* sel_cmds,
+                                        uint8_t clock_selector_id, uint8_t default_pin,
+                                        uint32_t node_handle);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
 
 #ifdef __cplusplus
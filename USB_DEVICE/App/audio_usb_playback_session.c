@@ -50,20 +50,110 @@
 #include "usb_audio_user.h"
 #include "audio_speaker_node.h"
 #include "audio_sessions_usb.h"
+#include "audio_sync_control.h"
+#include "audio_pump.h"
+#include "audio_sof_timestamp.h"
+#include "audio_sof_jitter.h"
+#include "audio_clock_domain.h"
+#include "audio_volume_node.h"
+#include "audio_router_node.h"
+#include "audio_eq_node.h"
+#include "audio_meter_node.h"
+#include "audio_limiter_node.h"
+#include "audio_long_delay_node.h"
+#include "audio_sidetone_node.h"
+#include "audio_mixer_node.h"
+#include "audio_chain_node.h"
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+#include "audio_user_devices.h"
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_PARAMS_STORE
+#include "audio_params.h"
+#endif /* USE_AUDIO_PARAMS_STORE */
+#ifdef USE_AUDIO_SYNC_START
+#include "audio_sync_start.h"
+#endif /* USE_AUDIO_SYNC_START */
 #ifdef USE_USB_AUDIO_PLAYPBACK
 
 
 
 /* Private defines -----------------------------------------------------------*/
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+#define AUDIO_USB_PLAYBACK_ALTERNATE USB_AUDIO_CONFIG_PLAY_ALT_COUNT
+#else /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 #define AUDIO_USB_PLAYBACK_ALTERNATE 0x01
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+#define AUDIO_PLAYBACK_LATENCY_DEFAULT   AUDIO_USB_LATENCY_MEDIUM
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+/* the feedback PI controller constants are in audio_sync_control.h */
+#ifdef USE_AUDIO_SOF_JITTER
+/* the fill level low-pass narrows by one octave each time the SOF jitter peak
+   doubles above AUDIO_FEEDBACK_JITTER_QUIET_NS */
+#define AUDIO_FEEDBACK_JITTER_QUIET_NS     1000U
+#define AUDIO_FEEDBACK_FILL_AVG_MAX_SHIFT  6
+#endif /* USE_AUDIO_SOF_JITTER */
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+#if !defined(USE_AUDIO_PLAYBACK_USB_FEEDBACK) || defined(USE_AUDIO_CLOCK_SOF_OUTPUT)
+#error "the adaptive latency moves the fill level through the feedback, it needs USE_AUDIO_PLAYBACK_USB_FEEDBACK without USE_AUDIO_CLOCK_SOF_OUTPUT"
+#endif /* !USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_CLOCK_SOF_OUTPUT */
+/* the target latency follows the jitter peak of the host, between the low latency
+   profile and the selected one : it is raised at once and lowered by 1 ms each
+   AUDIO_PLAYBACK_ADAPT_PERIOD_MS while the jitter stays below it */
+#define AUDIO_PLAYBACK_ADAPT_PERIOD_MS   500U
+#define AUDIO_PLAYBACK_ADAPT_MIN_MS      (AUDIO_Playback_LatencyMs[AUDIO_USB_LATENCY_LOW])
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+#if !defined(USE_AUDIO_PLAYBACK_USB_FEEDBACK) || defined(USE_AUDIO_CLOCK_SOF_OUTPUT)
+#error "the warm start seeds the feedback PI controller, it needs USE_AUDIO_PLAYBACK_USB_FEEDBACK without USE_AUDIO_CLOCK_SOF_OUTPUT"
+#endif /* !USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_CLOCK_SOF_OUTPUT */
+/* the integral term of a converged controller is the clock drift between host and
+   speaker. It is kept in ppm per rate family and seeds the integral on restart */
+#define AUDIO_FEEDBACK_DRIFT_FRAC_BITS    4     /* drift in ppm with 4 fractional bits */
+#define AUDIO_FEEDBACK_DRIFT_ONE_PPM      (1000000 << AUDIO_FEEDBACK_DRIFT_FRAC_BITS)
+#define AUDIO_FEEDBACK_CONVERGED_MS       2000U /* unsaturated frames before the drift is taken */
+#define AUDIO_FEEDBACK_DRIFT_PUBLISH_PPM  2     /* drift change reported to the parameter store */
+#define AUDIO_PLAYBACK_CLOCK_FAMILY(freq) ((((freq) % 11025U) == 0U) ? 0U : 1U)
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+/* speaker parked over a bus suspend */
+#define AUDIO_PLAYBACK_SUSPEND_NONE       0U
+#define AUDIO_PLAYBACK_SUSPEND_PARKED     1U /* bus suspended, SAI stopped */
+#define AUDIO_PLAYBACK_SUSPEND_RESUMING   2U /* bus resumed, the speaker restarts at the first packet */
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 
 /* Private typedef -----------------------------------------------------------*/
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+typedef struct
+{
+  AUDIO_SyncFeedbackTypeDef pi; /* PI controller state */
+  uint32_t rate;      /* last computed rate, 0 while not computed */
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+  uint16_t steady;    /* frames since the correction was last saturated or the drift taken */
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+}
+AUDIO_Playback_FeedbackTypeDef;
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+typedef struct
+{
+  uint8_t  res_byte;  /* sample size of the alternate format */
+  uint32_t freq_max;  /* highest rate the alternate max packet is sized for */
+}
+AUDIO_Playback_AlternateTypeDef;
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 /* External variables --------------------------------------------------------*/
 #ifdef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
 #ifdef USE_USB_AUDIO_RECORDING
   extern AUDIO_USB_SessionTypedef usb_record_session;
 #endif /* USE_USB_AUDIO_RECORDING*/
 #endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  extern AUDIO_USB_SessionTypedef usb_mix_session;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 /* Private macros ------------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
 /* Play usb session callbacks */
@@ -73,27 +163,85 @@ static int8_t  AUDIO_Playback_SessionDeInit(uint32_t session_handle);
 #ifdef USE_AUDIO_USB_INTERRUPT
 static int8_t  AUDIO_Playback_SessionExternalControl( AUDIO_ControlCommandTypedef control , uint32_t val, uint32_t session_handle);
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+static int8_t  AUDIO_Playback_GetStats(AUDIO_USB_SessionStatsTypeDef* stats, uint32_t session_handle);
+static int8_t  AUDIO_Playback_SetParameter(AUDIO_USB_SessionParamTypedef param, uint16_t channel,
+                                           int32_t value, uint32_t session_handle);
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 static int8_t  AUDIO_Playback_SetAS_Alternate( uint8_t alternate,  uint32_t session_handle);
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+static void    AUDIO_Playback_StartHandler(void);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+static int8_t  AUDIO_Playback_SetAlternateFormat(AUDIO_USB_SessionTypedef* play_session, uint8_t alternate);
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 static int8_t  AUDIO_Playback_GetState(uint32_t session_handle);
+static void    AUDIO_Playback_UpdateLatency(AUDIO_USB_SessionTypedef* play_session);
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+static void    AUDIO_Playback_AdaptLatency(AUDIO_USB_SessionTypedef* play_session);
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+static void    AUDIO_Playback_DropOldest(AUDIO_USB_SessionTypedef* play_session);
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+static void    AUDIO_Playback_StartSpeaker(AUDIO_USB_SessionTypedef* play_session);
+#ifdef USE_AUDIO_SYNC_START
+static uint32_t AUDIO_Playback_SyncStart(uint8_t start, uint32_t session_handle);
+#endif /* USE_AUDIO_SYNC_START */
+#if defined(USE_AUDIO_PLAYBACK_ROUTER) || defined(USE_AUDIO_PLAYBACK_EQ) || defined(USE_AUDIO_PLAYBACK_LIMITER) || \
+    defined(USE_AUDIO_LEVEL_METER) || defined(USE_AUDIO_PLAYBACK_CHAIN_SWAP) || defined(USE_AUDIO_PLAYBACK_LONG_DELAY)
+static void    AUDIO_Playback_InsertProcessing(AUDIO_NodeTypeDef* node);
+#endif /* USE_AUDIO_PLAYBACK_ROUTER || USE_AUDIO_PLAYBACK_EQ || USE_AUDIO_PLAYBACK_LIMITER || USE_AUDIO_LEVEL_METER || USE_AUDIO_PLAYBACK_CHAIN_SWAP || USE_AUDIO_PLAYBACK_LONG_DELAY */
+#if (defined USE_AUDIO_PLAYBACK_CHAIN_SWAP) && ((defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS))
+static int8_t  AUDIO_Playback_SetChain(uint32_t stages, AUDIO_USB_SessionTypedef* play_session);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP && (USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS) */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+static int8_t  AUDIO_Playback_SessionSuspend(uint8_t suspend, uint32_t session_handle);
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 static int8_t  AUDIO_Playback_SessionCallback(AUDIO_SessionEventTypeDef  event, 
                                                AUDIO_NodeTypeDef* node_handle, 
                                                struct    AUDIO_Session* session_handle);
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
 static uint32_t   AUDIO_Playback_GetFeedback( uint32_t session_handle );
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
 static void  AUDIO_USB_Session_Sof_Received(uint32_t session_handle );
+static void  AUDIO_Playback_FeedbackUpdate(AUDIO_USB_SessionTypedef* session);
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+static void    AUDIO_Playback_FeedbackLearn(int32_t correction, int32_t nominal, int32_t max_deviation);
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+static int8_t   AUDIO_Playback_ClockStart(uint32_t session_handle);
+static uint32_t AUDIO_Playback_ClockCount(uint32_t session_handle);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
 static int8_t  AUDIO_Playback_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle);
 #endif /*USE_AUDIO_USB_PLAY_MULTI_FREQUENCES*/
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+static int8_t  AUDIO_Playback_SessionSelectClock(uint8_t pin, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle);
+static int8_t  AUDIO_Playback_ExtClockIsValid(uint8_t* is_valid, uint32_t session_handle);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
 
 /* Private variables ---------------------------------------------------------*/
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
-/* declare table of supprted frequencies */
+/* declare table of supprted frequencies, from the highest : the clock source search relies on it */
  uint32_t USB_AUDIO_CONFIG_PLAY_FREQENCIES[USB_AUDIO_CONFIG_PLAY_FREQ_COUNT]=
 {
+#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K
+USB_AUDIO_CONFIG_FREQ_768_K,
+#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K */
+#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K
+USB_AUDIO_CONFIG_FREQ_705_6_K,
+#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K */
+#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K
+USB_AUDIO_CONFIG_FREQ_384_K,
+#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K */
+#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K
+USB_AUDIO_CONFIG_FREQ_352_8_K,
+#endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K */
 #if USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K
 USB_AUDIO_CONFIG_FREQ_192_K,
 #endif /* USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K */
@@ -115,18 +263,96 @@ USB_AUDIO_CONFIG_FREQ_8_K,
 };
 #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES*/
 #endif /* USE_USB_AUDIO_CLASS_20 */
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+/* format of each streaming alternate, alternate n is at index n-1 */
+static const AUDIO_Playback_AlternateTypeDef AUDIO_Playback_Alternates[USB_AUDIO_CONFIG_PLAY_ALT_COUNT] =
+{
+  { USB_AUDIO_CONFIG_PLAY_ALT1_RES_BYTE, USB_AUDIO_CONFIG_PLAY_ALT_FREQ(USB_AUDIO_CONFIG_PLAY_ALT1_FREQ_MAX) },
+#if USB_AUDIO_CONFIG_PLAY_ALT_COUNT > 1
+  { USB_AUDIO_CONFIG_PLAY_ALT2_RES_BYTE, USB_AUDIO_CONFIG_PLAY_ALT_FREQ(USB_AUDIO_CONFIG_PLAY_ALT2_FREQ_MAX) },
+#endif /* USB_AUDIO_CONFIG_PLAY_ALT_COUNT > 1 */
+#if USB_AUDIO_CONFIG_PLAY_ALT_COUNT > 2
+  { USB_AUDIO_CONFIG_PLAY_ALT3_RES_BYTE, USB_AUDIO_CONFIG_PLAY_ALT_FREQ(USB_AUDIO_CONFIG_PLAY_ALT3_FREQ_MAX) },
+#endif /* USB_AUDIO_CONFIG_PLAY_ALT_COUNT > 2 */
+};
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 /* list of used nodes */
 #ifdef USE_USB_AUDIO_CLASS_20
 static AUDIO_USB_ClockSrc_NodeTypeDef streaming_play_clk_source;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* external word clock source and the selector between it and the internal clock */
+static AUDIO_USB_ClockSrc_NodeTypeDef streaming_ext_clk_source;
+static AUDIO_DescriptionTypeDef ext_clk_description;
+static AUDIO_USB_ClockSel_NodeTypeDef streaming_clk_selector;
+static uint8_t play_ext_clk_selected = 0;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
 static AUDIO_USB_IO_NodeTypeDef usb_play_input;
 static AUDIO_DescriptionTypeDef play_audio_description;
 static AUDIO_USB_CF_NodeTypeDef streaming_feature_control;
 static AUDIO_Speaker_NodeTypeDef speaker_output;
+/* nodes of the play path, as described to the host */
+#define AUDIO_PLAY_ENTITY(subtype, id, source, type, node) { (id), (source), (AUDIO_NodeTypeDef*)&(node) },
+static const AUDIO_USB_EntityTypeDef play_entities[] = { AUDIO_TOPOLOGY_PLAY(AUDIO_PLAY_ENTITY) };
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+static AUDIO_Volume_NodeTypeDef soft_volume;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+static AUDIO_Router_NodeTypeDef play_router;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+static AUDIO_Eq_NodeTypeDef play_eq;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+static AUDIO_Limiter_NodeTypeDef play_limiter;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+static AUDIO_LongDelay_NodeTypeDef play_long_delay;
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+/* runs the router, the equalizer and the limiter, rebuilt as the stream goes on */
+static AUDIO_Chain_NodeTypeDef play_chain;
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_LEVEL_METER
+static AUDIO_Meter_NodeTypeDef play_meter;
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+static AUDIO_Sidetone_NodeTypeDef play_sidetone;
+#endif /* USE_AUDIO_SIDETONE */
+/* play ring, USB packets are received in place */
+__ALIGN_BEGIN static uint8_t play_buffer_data[USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+#ifdef USE_AUDIO_PACKET_QUEUE
+/* packets of the play ring as the host sent them */
+static AUDIO_PacketQueueTypeDef play_packets;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+/* ring fill of each latency profile, in ms at the current rate : the speaker starts
+   from it and the feedback keeps the fill there */
+static const uint8_t AUDIO_Playback_LatencyMs[AUDIO_USB_LATENCY_COUNT] = {2, 8, 20};
+static AUDIO_USB_LatencyProfileTypedef play_latency = AUDIO_PLAYBACK_LATENCY_DEFAULT;
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+static uint8_t  play_parked = AUDIO_PLAYBACK_SUSPEND_NONE;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+static uint8_t  play_adaptive_ms;   /* current target, at most the latency of the profile */
+static uint16_t play_adapt_count;   /* ms since the target last changed */
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+/* levels of the latency profile in bytes , set when the session starts */
+static uint32_t play_start_threshold;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+static AUDIO_USB_SessionTypedef* play_start_session = 0; /* session of the start handler */
+static uint8_t  play_started_alternate = 0;  /* alternate the session was started for, 0 if stopped */
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+static uint32_t play_guard_band;  /* below it the host is asked for the highest rate */
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
-/* Playback synchronization : frequency estimation */
+/* Playback synchronization : buffer fill level regulation */
 static uint8_t sync_first_time_sof = 0;
-static uint32_t sync_estimated_freq = 0;
+static AUDIO_Playback_FeedbackTypeDef sync_feedback;
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+static int32_t sync_drift[AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT];          /* AUDIO_FEEDBACK_DRIFT_FRAC_BITS, 0 when unknown */
+static int16_t sync_drift_published[AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT]; /* ppm read by the parameter store */
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
 
 /* Private functions ---------------------------------------------------------*/
@@ -146,8 +372,14 @@ static uint32_t sync_estimated_freq = 0;
 {
   AUDIO_USB_SessionTypedef *play_session;
   AUDIO_ControlDeviceDefaultsTypedef controller_defaults;
+#ifdef USE_AUDIO_PARAMS_STORE
+  const AUDIO_ParamsTypeDef* params;
+#endif /* USE_AUDIO_PARAMS_STORE */
 #ifdef USE_USB_AUDIO_CLASS_20
   AUDIO_DevicesClockCommandsTypedef clk_src_cmds;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  AUDIO_DevicesClockSelectCommandsTypedef clk_sel_cmds;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
   
    play_session = (AUDIO_USB_SessionTypedef*)session_handle;
@@ -159,13 +391,28 @@ static uint32_t sync_estimated_freq = 0;
 #ifdef USE_AUDIO_USB_INTERRUPT
    play_session->ExternalControl = AUDIO_Playback_SessionExternalControl;
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+   play_session->GetStats = AUDIO_Playback_GetStats;
+   play_session->SetParameter = AUDIO_Playback_SetParameter;
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+   play_session->SessionSuspend = AUDIO_Playback_SessionSuspend;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
    play_session->session.SessionCallback = AUDIO_Playback_SessionCallback;
-   play_session->buffer.size = USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE;
-   play_session->buffer.data = malloc( USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE); 
-   if(! play_session->buffer.data)
-   {
-    Error_Handler();
-   }
+   /* the speaker AUDIO_PACKET_PLAYED is not used */
+   play_session->session.event_mask = AUDIO_SESSION_EVENT_BIT(AUDIO_THERSHOLD_REACHED)|
+                                      AUDIO_SESSION_EVENT_BIT(AUDIO_PACKET_RECEIVED)|
+                                      AUDIO_SESSION_EVENT_BIT(AUDIO_FREQUENCY_CHANGED)|
+                                      AUDIO_SESSION_EVENT_BIT(AUDIO_OVERRUN)|
+                                      AUDIO_SESSION_EVENT_BIT(AUDIO_UNDERRUN);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+   play_session->session.event_mask |= AUDIO_SESSION_EVENT_BIT(AUDIO_SILENCE_BEGIN)|
+                                       AUDIO_SESSION_EVENT_BIT(AUDIO_SILENCE_END);
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+   play_session->buffer.data = play_buffer_data;
+#ifdef USE_AUDIO_PACKET_QUEUE
+   play_session->buffer.packets = &play_packets;
+#endif /* USE_AUDIO_PACKET_QUEUE */
     /*set audio used option*/
   play_audio_description.audio_res = USBD_AUDIO_CONFIG_PLAY_RES_BYTE;
   play_audio_description.audio_type = USBD_AUDIO_FORMAT_TYPE_PCM; /* PCM*/
@@ -174,6 +421,29 @@ static uint32_t sync_estimated_freq = 0;
   play_audio_description.frequence = USB_AUDIO_CONFIG_PLAY_DEF_FREQ;
   play_audio_description.audio_volume_db_256 = VOLUME_SPEAKER_DEFAULT_DB_256;
   play_audio_description.audio_mute = 0;
+#ifdef USE_AUDIO_PARAMS_STORE
+  /* settings of the last run, the nodes below start from them */
+#if (defined USE_USB_AUDIO_CLASS_20) && (defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)
+  params = AUDIO_ParamsRestore(AUDIO_PARAMS_PLAY, &play_audio_description, &play_session->session,
+                               USB_AUDIO_CONFIG_PLAY_FREQENCIES, USB_AUDIO_CONFIG_PLAY_FREQ_COUNT);
+#else /* USE_USB_AUDIO_CLASS_20 && USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+  params = AUDIO_ParamsRestore(AUDIO_PARAMS_PLAY, &play_audio_description, &play_session->session,
+                               &play_audio_description.frequence, 1);
+#endif /* USE_USB_AUDIO_CLASS_20 && USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+  if((params != 0) && (params->play_latency < AUDIO_USB_LATENCY_COUNT))
+  {
+    play_latency = (AUDIO_USB_LatencyProfileTypedef)params->play_latency;
+  }
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+  if(params != 0)
+  {
+    for(uint8_t family = 0; family < AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT; family++)
+    {
+      AUDIO_Playback_SetDriftPpm(family, params->play_drift_ppm[family]);
+    }
+  }
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+#endif /* USE_AUDIO_PARAMS_STORE */
   *control_count = 0;
  
    /* create usb input node */
@@ -199,15 +469,99 @@ static uint32_t sync_estimated_freq = 0;
   clk_src_cmds.clock_freq_list = &play_audio_description.frequence;
     clk_src_cmds.SetFrequency = 0;
 #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+  clk_src_cmds.IsValid = 0;
 
   USB_AUDIO_Streaming_CLK_SRC_Init(&(controls_desc[1]), &clk_src_cmds,
                                    USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID,&play_audio_description,
                                    (uint32_t)&streaming_play_clk_source);
 (*control_count)++;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  /* the external clock runs at a fixed rate, it is valid while its PLL is locked */
+  play_ext_clk_selected = 0;
+  ext_clk_description.frequence = USB_AUDIO_CONFIG_EXT_CLOCK_FREQ;
+  clk_src_cmds.clock_freq_count = 1;
+  clk_src_cmds.clock_freq_list = &ext_clk_description.frequence;
+  clk_src_cmds.SetFrequency = 0;
+  clk_src_cmds.IsValid = AUDIO_Playback_ExtClockIsValid;
+  USB_AUDIO_Streaming_CLK_SRC_Init(&(controls_desc[*control_count]), &clk_src_cmds,
+                                   USB_AUDIO_CONFIG_EXT_CLOCK_SOURCE_ID, &ext_clk_description,
+                                   (uint32_t)&streaming_ext_clk_source);
+  (*control_count)++;
+  clk_sel_cmds.SelectSource = AUDIO_Playback_SessionSelectClock;
+  clk_sel_cmds.pin_count = 2;
+  clk_sel_cmds.private_data = session_handle;
+  USB_AUDIO_Streaming_CLK_SEL_Init(&(controls_desc[*control_count]), &clk_sel_cmds,
+                                   USB_AUDIO_CONFIG_CLOCK_SELECTOR_ID, USB_AUDIO_CONFIG_CLOCK_SELECTOR_INTERNAL,
+                                   (uint32_t)&streaming_clk_selector);
+  (*control_count)++;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
-  usb_play_input.node.next = (AUDIO_NodeTypeDef*)&streaming_feature_control;
   AUDIO_SpeakerInit(&play_audio_description, &play_session->session, (uint32_t)&speaker_output);
-  streaming_feature_control.node.next = (AUDIO_NodeTypeDef*)&speaker_output;
+  AUDIO_USB_LinkTopology(play_entities, (uint8_t)(sizeof(play_entities) / sizeof(play_entities[0])));
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+  /* volume is applied on each received packet, before the speaker reads it */
+  AUDIO_VolumeInit(&play_audio_description, &play_session->session, (uint32_t)&soft_volume);
+  streaming_feature_control.node.next = (AUDIO_NodeTypeDef*)&soft_volume;
+  soft_volume.processing.node.next = (AUDIO_NodeTypeDef*)&speaker_output;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+  /* the chain takes the place of the router, the equalizer and the limiter, all of them run at first */
+  AUDIO_ChainInit(&play_audio_description, &play_session->session, (uint32_t)&play_chain);
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_chain);
+  AUDIO_ChainClear();
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+  /* routing before the equalizer, which then works on the speaker channels */
+  AUDIO_RouterInit(&play_audio_description, &play_session->session, (uint32_t)&play_router);
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+  AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_router);
+#else /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_router);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  /* equalizer after the volume, which gives it headroom on boosts */
+  AUDIO_EqInit(&play_audio_description, &play_session->session, (uint32_t)&play_eq);
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+  AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_eq);
+#else /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_eq);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PARAMS_STORE
+  AUDIO_ParamsRestoreEq();
+#endif /* USE_AUDIO_PARAMS_STORE */
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  /* limiter after every gain stage, nothing above the threshold reaches the speaker */
+  AUDIO_LimiterInit(&play_audio_description, &play_session->session, (uint32_t)&play_limiter);
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+  AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_limiter);
+#else /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_limiter);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+  /* not started, the bank is active at once */
+  AUDIO_ChainCommit();
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+  /* out of the chain, a swap doesn't drop what the store holds */
+  AUDIO_LongDelayInit(&play_audio_description, &play_session->session, (uint32_t)&play_long_delay);
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_long_delay);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifdef USE_AUDIO_LEVEL_METER
+  /* meters what the speaker plays */
+  AUDIO_MeterInit(&play_audio_description, &play_session->session, AUDIO_METER_PLAYBACK, (uint32_t)&play_meter);
+  AUDIO_Playback_InsertProcessing((AUDIO_NodeTypeDef*)&play_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+  /* not in the chain : the speaker mixes it in its DMA halves, after the meter */
+  AUDIO_SidetoneInit(&play_audio_description, &play_session->session, (uint32_t)&play_sidetone);
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  /* the mix session stream is added to this output at its rate */
+  AUDIO_MixerSetOutput(&play_audio_description);
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 
 /* initializes synchronization setting */
   
@@ -216,8 +570,25 @@ static uint32_t sync_estimated_freq = 0;
      as_desc->synch_ep.ep_num = USB_AUDIO_CONFIG_PLAY_EP_SYNC;
      as_desc->synch_ep.GetFeedback = AUDIO_Playback_GetFeedback;
      as_desc->synch_ep.private_data = (uint32_t) play_session;
-     as_desc->SofReceived = AUDIO_USB_Session_Sof_Received;
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
+     /* the feedback is computed each ms */
+     AUDIO_SofTickSubscribe(AUDIO_USB_Session_Sof_Received, AUDIO_SOF_TICK_PER_MS, session_handle);
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
 #endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+  {
+    /* the speaker may count the frames of the clock shared with the mic */
+    AUDIO_ClockDomainSubscriberTypeDef clock_subscriber;
+
+    clock_subscriber.StartCount = AUDIO_Playback_ClockStart;
+    clock_subscriber.GetCount = AUDIO_Playback_ClockCount;
+    clock_subscriber.Frame = 0;
+    clock_subscriber.audio_description = &play_audio_description;
+    clock_subscriber.period = 1;
+    clock_subscriber.private_data = session_handle;
+    AUDIO_ClockDomainSubscribe(&clock_subscriber);
+  }
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
   /* set USB AUDIO class callbacks */
   as_desc->interface_num =  play_session->interface_num;
   as_desc->alternate = 0;
@@ -225,9 +596,15 @@ static uint32_t sync_estimated_freq = 0;
   as_desc->private_data = session_handle;
   as_desc->SetAS_Alternate = AUDIO_Playback_SetAS_Alternate;
   as_desc->GetState = AUDIO_Playback_GetState;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  play_session->start_state = AUDIO_USB_START_IDLE;
+  play_started_alternate = 0;
+  play_start_session = play_session;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_PLAY_START, AUDIO_Playback_StartHandler);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
 
-  /* initialize working buffer */
-  uint16_t buffer_margin = (usb_play_input.max_packet_length > usb_play_input.packet_length)?usb_play_input.max_packet_length:0;
+  /* initialize working buffer, a packet may always cross the ring end so margin is the max packet */
+  uint16_t buffer_margin = usb_play_input.max_packet_length;
   AUDIO_USB_InitializesDataBuffer(&play_session->buffer, USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE,
                                   AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) , buffer_margin);
   play_session->session.state = AUDIO_SESSION_INITIALIZED;
@@ -249,11 +626,49 @@ static int8_t  AUDIO_Playback_SessionStart(AUDIO_USB_SessionTypedef*  play_sessi
      ||(play_session->session.state == AUDIO_SESSION_STOPPED))
   {
         AUDIO_DevicesCommandsTypedef commands;
+#ifdef USE_AUDIO_IDLE_POWER
+    /* full clock before the nodes and the SAI start */
+    AUDIO_PowerSetStreaming(play_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
     /* start input node */
-    usb_play_input.IOStart(& play_session->buffer,   play_session->buffer.size/2,  (uint32_t)&usb_play_input);
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+    /* the host jitter is not known yet : start safe and converge down */
+    play_adaptive_ms = AUDIO_Playback_LatencyMs[play_latency];
+    play_adapt_count = 0;
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+    AUDIO_Playback_UpdateLatency(play_session);
+    usb_play_input.IOStart(& play_session->buffer,   play_start_threshold,  (uint32_t)&usb_play_input);
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    soft_volume.VolumeStart((uint32_t)&soft_volume);
+    commands.private_data = (uint32_t)&soft_volume;
+    commands.SetMute = soft_volume.VolumeMute;
+    commands.SetCurrentVolume = soft_volume.VolumeSetVolume;
+#else /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
     commands.private_data = (uint32_t)&speaker_output;
     commands.SetMute = speaker_output.SpeakerMute;
     commands.SetCurrentVolume = speaker_output.SpeakerSetVolume;
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    play_router.RouterStart((uint32_t)&play_router);
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    play_eq.EqStart((uint32_t)&play_eq);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    play_limiter.LimiterStart((uint32_t)&play_limiter);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+    play_chain.ChainStart((uint32_t)&play_chain);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+    play_long_delay.LongDelayStart((uint32_t)&play_long_delay);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifdef USE_AUDIO_LEVEL_METER
+    play_meter.MeterStart((uint32_t)&play_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+    play_sidetone.SidetoneStart((uint32_t)&play_sidetone);
+#endif /* USE_AUDIO_SIDETONE */
 #ifdef USE_USB_AUDIO_CLASS_20
     streaming_play_clk_source.CSStart((uint32_t)&streaming_play_clk_source);
 #endif /* USE_USB_AUDIO_CLASS_20 */
@@ -275,12 +690,45 @@ static int8_t  AUDIO_Playback_SessionStop(AUDIO_USB_SessionTypedef*  play_sessio
   
   if( play_session->session.state == AUDIO_SESSION_STARTED)
   {
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+    play_parked = AUDIO_PLAYBACK_SUSPEND_NONE;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+#ifdef USE_AUDIO_SYNC_START
+    AUDIO_SyncStartRelease(AUDIO_SYNC_START_PLAYBACK);
+#endif /* USE_AUDIO_SYNC_START */
     usb_play_input.IOStop((uint32_t)&usb_play_input);
     streaming_feature_control.CFStop((uint32_t)&streaming_feature_control);
 #ifdef USE_USB_AUDIO_CLASS_20
     streaming_play_clk_source.CSStop((uint32_t)&streaming_play_clk_source);
 #endif /* USE_USB_AUDIO_CLASS_20 */
     speaker_output.SpeakerStop((uint32_t)&speaker_output);
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    soft_volume.VolumeStop((uint32_t)&soft_volume);
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    play_router.RouterStop((uint32_t)&play_router);
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    play_eq.EqStop((uint32_t)&play_eq);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    play_limiter.LimiterStop((uint32_t)&play_limiter);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+    play_chain.ChainStop((uint32_t)&play_chain);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+    play_long_delay.LongDelayStop((uint32_t)&play_long_delay);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifdef USE_AUDIO_LEVEL_METER
+    play_meter.MeterStop((uint32_t)&play_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+    play_sidetone.SidetoneStop((uint32_t)&play_sidetone);
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(play_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
     play_session->session.state = AUDIO_SESSION_STOPPED;
   }
   
@@ -300,20 +748,51 @@ static int8_t  AUDIO_Playback_SessionDeInit(uint32_t session_handle)
    play_session = (AUDIO_USB_SessionTypedef*)session_handle;
   if( play_session->session.state != AUDIO_SESSION_OFF)
   {
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+    /* a start still posted is dropped, the handler skips an OFF session */
+    play_session->start_state = AUDIO_USB_START_IDLE;
+    play_started_alternate = 0;
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
     if( play_session->session.state == AUDIO_SESSION_STARTED)
     {
       AUDIO_Playback_SessionStop( play_session);
     }
     speaker_output.SpeakerDeInit((uint32_t)&speaker_output);
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+    soft_volume.VolumeDeInit((uint32_t)&soft_volume);
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+    play_router.RouterDeInit((uint32_t)&play_router);
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+    play_eq.EqDeInit((uint32_t)&play_eq);
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+    play_limiter.LimiterDeInit((uint32_t)&play_limiter);
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+    play_chain.ChainDeInit((uint32_t)&play_chain);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+    play_long_delay.LongDelayDeInit((uint32_t)&play_long_delay);
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#ifdef USE_AUDIO_LEVEL_METER
+    play_meter.MeterDeInit((uint32_t)&play_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_SIDETONE
+    play_sidetone.SidetoneDeInit((uint32_t)&play_sidetone);
+#endif /* USE_AUDIO_SIDETONE */
     streaming_feature_control.CFDeInit((uint32_t)&streaming_feature_control);
 #ifdef USE_USB_AUDIO_CLASS_20
     streaming_play_clk_source.CSDeInit((uint32_t)&streaming_play_clk_source);
 #endif /* USE_USB_AUDIO_CLASS_20 */
     usb_play_input.IODeInit((uint32_t)&usb_play_input);
-    if( play_session->buffer.data)
-    {
-      free( play_session->buffer.data);
-    }
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) && !(defined USE_AUDIO_CLOCK_SOF_OUTPUT)
+    AUDIO_SofTickUnsubscribe(AUDIO_USB_Session_Sof_Received, session_handle);
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK && !USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+    AUDIO_ClockDomainUnsubscribe(session_handle);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
      play_session->session.state = AUDIO_SESSION_OFF;
   }
   return 0;
@@ -322,7 +801,7 @@ static int8_t  AUDIO_Playback_SessionDeInit(uint32_t session_handle)
 #ifdef USE_AUDIO_USB_INTERRUPT
 /**
   * @brief  AUDIO_Playback_SessionExternalControl
-  *         Mute or Unmute 
+  *         Mute or Unmute , or change the volume by val (signed db 8.8)
   * @param  session_handle: session
   * @retval  : 0 if no error
   */
@@ -351,8 +830,38 @@ static int8_t  AUDIO_Playback_SessionExternalControl( AUDIO_ControlCommandTypede
       interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
       }
        break;
+      case USBD_AUDIO_VOLUME:
+      {
+        /* val is a signed change in db 8.8, the result is held in the announced range */
+        int volume_db_256;
+        int max_db_256;
+        int min_db_256;
+
+        VOLUME_USB_TO_DB_256(max_db_256, streaming_feature_control.usb_control_callbacks.MaxVolume);
+        VOLUME_USB_TO_DB_256(min_db_256, streaming_feature_control.usb_control_callbacks.MinVolume);
+        volume_db_256 = play_audio_description.audio_volume_db_256 + (int32_t)val;
+        volume_db_256 = (volume_db_256 > max_db_256) ? max_db_256 : volume_db_256;
+        volume_db_256 = (volume_db_256 < min_db_256) ? min_db_256 : volume_db_256;
+        if(volume_db_256 == play_audio_description.audio_volume_db_256)
+        {
+          /* already at a bound, nothing to report */
+          return 0;
+        }
+        if(streaming_feature_control.CFSetVolume(0, volume_db_256, (uint32_t) &streaming_feature_control) != 0)
+        {
+          return -1;
+        }
+        interrupt.type  = USBD_AUDIO_INTERRUPT_INFO_FROM_INTERFACE;
+        interrupt.attr = USBD_AUDIO_INTERRUPT_ATTR_CUR;
+        interrupt.cs = USBD_AUDIO_FU_VOLUME_CONTROL;
+        interrupt.cn_mcn = 0;
+        interrupt.entity_id = USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID;
+        interrupt.ep_if_id = 0;/* Audio control interface 0*/
+        interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
+      }
+       break;
     default :
-      break;
+      return -1;
     }
     USBD_AUDIO_SendInterrupt  (&interrupt);
    }
@@ -363,6 +872,95 @@ static int8_t  AUDIO_Playback_SessionExternalControl( AUDIO_ControlCommandTypede
   return 0;
 }
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+/**
+  * @brief  AUDIO_Playback_GetStats
+  *         reports stream format, buffer level, feedback and error counters
+  * @param  stats: filled with session state
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Playback_GetStats(AUDIO_USB_SessionStatsTypeDef* stats, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  stats->audio_description = play_audio_description;
+  stats->state = (uint8_t)play_session->session.state;
+  stats->buffer_size = play_session->buffer.size;
+  stats->buffer_filled = AUDIO_BUFFER_FILLED_SIZE(&play_session->buffer);
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  stats->feedback = AUDIO_Playback_GetFeedback(session_handle);
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+  stats->feedback = 0;
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+  stats->underrun_count = play_session->buffer.telemetry.underrun_count;
+  stats->overrun_count = play_session->buffer.telemetry.overrun_count;
+  stats->fill = play_session->buffer.telemetry;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  stats->delay = play_packets.delay;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Playback_SetParameter
+  *         sets a control from the device side, through the feature unit so
+  *         the host reads back the same value
+  * @param  param: parameter to set
+  * @param  channel: 0 for master, 1..n for a channel
+  * @param  value: new value
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Playback_SetParameter(AUDIO_USB_SessionParamTypedef param, uint16_t channel,
+                                           int32_t value, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  int8_t ret;
+#ifdef USE_AUDIO_USB_INTERRUPT
+  USBD_AUDIO_InterruptTypeDef interrupt;
+#endif /*USE_AUDIO_USB_INTERRUPT*/
+
+  if((play_session->session.state == AUDIO_SESSION_OFF)||(play_session->session.state == AUDIO_SESSION_ERROR))
+  {
+    return -1;
+  }
+  switch(param)
+  {
+    case AUDIO_USB_PARAM_MUTE:
+      ret = streaming_feature_control.CFSetMute(channel, (value != 0), (uint32_t)&streaming_feature_control);
+      break;
+    case AUDIO_USB_PARAM_VOLUME:
+      ret = streaming_feature_control.CFSetVolume(channel, (int)value, (uint32_t)&streaming_feature_control);
+      break;
+    case AUDIO_USB_PARAM_LATENCY:
+      /* not a feature unit control, the host is not told */
+      return AUDIO_Playback_SetLatency((AUDIO_USB_LatencyProfileTypedef)value, session_handle);
+#ifdef USE_AUDIO_PLAYBACK_CHAIN_SWAP
+    case AUDIO_USB_PARAM_CHAIN:
+      return AUDIO_Playback_SetChain((uint32_t)value, play_session);
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP */
+    default :
+      ret = -1;
+      break;
+  }
+#ifdef USE_AUDIO_USB_INTERRUPT
+  if(ret == 0)
+  {
+    /* tell the host the control changed */
+    interrupt.type  = USBD_AUDIO_INTERRUPT_INFO_FROM_INTERFACE;
+    interrupt.attr = USBD_AUDIO_INTERRUPT_ATTR_CUR;
+    interrupt.cs = (param == AUDIO_USB_PARAM_MUTE) ? USBD_AUDIO_FU_MUTE_CONTROL : USBD_AUDIO_FU_VOLUME_CONTROL;
+    interrupt.cn_mcn = (uint8_t)channel;
+    interrupt.entity_id = USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID;
+    interrupt.ep_if_id = 0;/* Audio control interface 0*/
+    interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
+    USBD_AUDIO_SendInterrupt  (&interrupt);
+  }
+#endif /*USE_AUDIO_USB_INTERRUPT*/
+  return ret;
+}
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 /**
   * @brief  AUDIO_Playback_SessionCallback
   *         session callback for the audio playback
@@ -383,36 +981,87 @@ static int8_t  AUDIO_Playback_SessionCallback(AUDIO_SessionEventTypeDef  event,
     
     if(node->type  ==  AUDIO_INPUT)
     {
+#ifdef USE_AUDIO_SYNC_START
+      if(AUDIO_SyncStartHold(AUDIO_SYNC_START_PLAYBACK, AUDIO_Playback_SyncStart, (uint32_t)play_session) == 0)
+      {
+        /* the speaker starts with the mic */
+        break;
+      }
+#endif /* USE_AUDIO_SYNC_START */
+      AUDIO_Playback_StartSpeaker(play_session);
+    }
+    break;
+  case AUDIO_PACKET_RECEIVED:
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+    if((play_parked == AUDIO_PLAYBACK_SUSPEND_RESUMING) && (speaker_output.node.state != AUDIO_NODE_STARTED))
+    {
+      /* the host streams again : the speaker restarts from the fill kept over
+         the suspend, the feedback goes on from its estimate */
+      play_parked = AUDIO_PLAYBACK_SUSPEND_NONE;
       speaker_output.SpeakerStart(& play_session->buffer, (uint32_t)&speaker_output);
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
-	  sync_first_time_sof =0;
+      sync_first_time_sof = (sync_feedback.rate != 0U) ? 1U : 0U;
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
     }
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+    /* speaker data is consumed outside the USB ISR */
+    AUDIO_PumpPost(AUDIO_PUMP_SPEAKER_DATA);
     break;
-  case AUDIO_PACKET_RECEIVED:
-    
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+  case AUDIO_SILENCE_BEGIN:
+    /* the speaker may have restarted powered since the event was raised */
+    if((usb_play_input.flags&AUDIO_IO_SILENCE) && (speaker_output.node.state == AUDIO_NODE_STARTED))
+    {
+      speaker_output.SpeakerPower(0, (uint32_t)&speaker_output);
+    }
+    break;
+  case AUDIO_SILENCE_END:
+    speaker_output.SpeakerPower(1, (uint32_t)&speaker_output);
     break;
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
   case AUDIO_FREQUENCY_CHANGED: 
     {
       /* recompute the buffer size */
      speaker_output.SpeakerChangeFrequence((uint32_t)&speaker_output);
-     uint16_t buffer_margin = (usb_play_input.max_packet_length > usb_play_input.packet_length)? usb_play_input.max_packet_length:0;
+     uint16_t buffer_margin = usb_play_input.max_packet_length;
   AUDIO_USB_InitializesDataBuffer(&play_session->buffer, USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE,
                                   AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) , buffer_margin);
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
      sync_first_time_sof =0;
-     sync_estimated_freq = 0;
+     sync_feedback.rate = 0;
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */   
     break;
     }
   case AUDIO_OVERRUN:
   case AUDIO_UNDERRUN:
     {
+     AUDIO_BufferTelemetryGlitch(&play_session->buffer, (event == AUDIO_OVERRUN), HAL_GetTick());
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+     if((event == AUDIO_UNDERRUN) && (play_adaptive_ms < AUDIO_Playback_LatencyMs[play_latency]))
+     {
+       /* the host made a gap longer than the target : one step up at once */
+       play_adaptive_ms++;
+       play_adapt_count = 0;
+       AUDIO_Playback_UpdateLatency(play_session);
+     }
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+     if((play_session->session.state == AUDIO_SESSION_STARTED) &&
+        (speaker_output.node.state == AUDIO_NODE_STARTED) && (speaker_output.failed == 0U))
+     {
+       /* the speaker conceals an underrun and plays again from the next packet */
+       if(event == AUDIO_OVERRUN)
+       {
+         AUDIO_Playback_DropOldest(play_session);
+       }
+       break;
+     }
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
      /* restart input and stop output */
      speaker_output.SpeakerStop((uint32_t)&speaker_output);
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
      sync_first_time_sof =0;
-     sync_estimated_freq = 0;
+     sync_feedback.rate = 0;
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */ 
      if( play_session->session.state == AUDIO_SESSION_STARTED)
      {
@@ -427,6 +1076,49 @@ static int8_t  AUDIO_Playback_SessionCallback(AUDIO_SessionEventTypeDef  event,
 }
 
 
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+/**
+  * @brief  AUDIO_Playback_SessionSuspend
+  *         bus suspend and resume, called from the USB interrupt. The speaker
+  *         stops before it underruns, the ring, the processing nodes and the
+  *         feedback keep their state so streaming resumes without a new start
+  *         threshold nor feedback convergence
+  * @param  suspend: 1 on suspend, 0 on resume
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Playback_SessionSuspend(uint8_t suspend, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef * play_session;
+
+  play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  if(suspend)
+  {
+    if((play_session->session.state == AUDIO_SESSION_STARTED) &&
+       (speaker_output.node.state == AUDIO_NODE_STARTED) && (play_parked == AUDIO_PLAYBACK_SUSPEND_NONE))
+    {
+      speaker_output.SpeakerStop((uint32_t)&speaker_output);
+      play_parked = AUDIO_PLAYBACK_SUSPEND_PARKED;
+#ifdef USE_AUDIO_IDLE_POWER
+      /* let the main loop enter STOP mode */
+      AUDIO_PowerSetStreaming(play_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
+    }
+  }
+  else
+  {
+    if(play_parked == AUDIO_PLAYBACK_SUSPEND_PARKED)
+    {
+#ifdef USE_AUDIO_IDLE_POWER
+      AUDIO_PowerSetStreaming(play_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
+      play_parked = AUDIO_PLAYBACK_SUSPEND_RESUMING;
+    }
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+
 /**
   * @brief  AUDIO_Playback_SetAS_Alternate
   *         set AS interface alternate callback
@@ -439,6 +1131,42 @@ static int8_t  AUDIO_Playback_SetAS_Alternate( uint8_t alternate , uint32_t sess
   AUDIO_USB_SessionTypedef * play_session;
   
    play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  if(alternate  ==  0)
+  {
+    if(play_session->start_state == AUDIO_USB_START_IDLE)
+    {
+      /* stopping is short, the endpoint closes right after */
+      if(play_session->alternate != 0)
+      {
+        AUDIO_Playback_SessionStop(play_session);
+        play_started_alternate = 0;
+      }
+    }
+    play_session->alternate = 0;
+  }
+  else
+  {
+    if( play_session->alternate  ==  0)
+    {
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+      /* checked now to stall the request, applied by the handler with the session stopped */
+      if((alternate > USB_AUDIO_CONFIG_PLAY_ALT_COUNT) ||
+         (play_audio_description.frequence > AUDIO_Playback_Alternates[alternate - 1U].freq_max))
+      {
+        return -1;
+      }
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+      /* packets received until the speaker starts are dropped by the stopped input node */
+      play_session->alternate = alternate;
+      if(play_session->start_state == AUDIO_USB_START_IDLE)
+      {
+        play_session->start_state = AUDIO_USB_START_PENDING;
+        AUDIO_PumpPost(AUDIO_PUMP_PLAY_START);
+      }
+    }
+  }
+#else /* USE_AUDIO_DEFERRED_ALTERNATE */
   if(alternate  ==  0)
   {
     if( play_session->alternate != 0)
@@ -451,12 +1179,110 @@ static int8_t  AUDIO_Playback_SetAS_Alternate( uint8_t alternate , uint32_t sess
   {
     if( play_session->alternate  ==  0)
     {
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+      if(AUDIO_Playback_SetAlternateFormat(play_session, alternate) != 0)
+      {
+        return -1;
+      }
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
       AUDIO_Playback_SessionStart(play_session);
       play_session->alternate = alternate;
     }
   }
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+  return 0;
+}
+
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+/**
+  * @brief  AUDIO_Playback_StartHandler
+  *         pump work : brings the session to the alternate the host selected.
+  *         The host may leave or change the alternate while the session starts,
+  *         the session is then stopped and started again until both agree
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_Playback_StartHandler(void)
+{
+  AUDIO_USB_SessionTypedef* play_session = play_start_session;
+  uint32_t primask;
+  uint8_t  alternate;
+
+  if(play_session == 0)
+  {
+    return;
+  }
+  for(;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    alternate = play_session->alternate;
+    if((play_session->start_state == AUDIO_USB_START_IDLE) ||
+       (play_session->session.state == AUDIO_SESSION_OFF) || (alternate == play_started_alternate))
+    {
+      play_session->start_state = AUDIO_USB_START_IDLE;
+      __set_PRIMASK(primask);
+      return;
+    }
+    play_session->start_state = AUDIO_USB_START_RUNNING;
+    __set_PRIMASK(primask);
+
+    if(play_started_alternate != 0)
+    {
+      AUDIO_Playback_SessionStop(play_session);
+      play_started_alternate = 0;
+    }
+    else
+    {
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+      (void)AUDIO_Playback_SetAlternateFormat(play_session, alternate);
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+      AUDIO_Playback_SessionStart(play_session);
+      play_started_alternate = alternate;
+    }
+  }
+}
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+/**
+  * @brief  AUDIO_Playback_SetAlternateFormat
+  *         applies the format of a streaming alternate before the session starts,
+  *         nodes and ring are resized as after a frequency change
+  * @param  play_session: session, must be stopped
+  * @param  alternate: streaming alternate, 1 to USB_AUDIO_CONFIG_PLAY_ALT_COUNT
+  * @retval 0 if no error, -1 if the current rate doesn't fit the alternate bandwidth
+  */
+static int8_t  AUDIO_Playback_SetAlternateFormat(AUDIO_USB_SessionTypedef* play_session, uint8_t alternate)
+{
+  const AUDIO_Playback_AlternateTypeDef* alt;
+
+  if((alternate == 0U) || (alternate > USB_AUDIO_CONFIG_PLAY_ALT_COUNT))
+  {
+    return -1;
+  }
+  alt = &AUDIO_Playback_Alternates[alternate - 1U];
+  if(play_audio_description.frequence > alt->freq_max)
+  {
+    return -1;
+  }
+  if(play_audio_description.audio_res == alt->res_byte)
+  {
+    return 0;
+  }
+  play_audio_description.audio_res = alt->res_byte;
+  speaker_output.SpeakerChangeFrequence((uint32_t)&speaker_output);
+  usb_play_input.IOChangeFrequency((uint32_t)&usb_play_input);
+  uint16_t buffer_margin = usb_play_input.max_packet_length;
+  AUDIO_USB_InitializesDataBuffer(&play_session->buffer, USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE,
+                                  AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) , buffer_margin);
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  sync_first_time_sof =0;
+  sync_feedback.rate = 0;
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
   return 0;
 }
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 
 /**
   * @brief  AUDIO_Playback_GetState            
@@ -470,92 +1296,498 @@ static int8_t  AUDIO_Playback_GetState(uint32_t session_handle)
   return 0;
 }
 
+/**
+  * @brief  AUDIO_Playback_UpdateLatency
+  *         computes the levels of the latency profile for the current rate :
+  *         start threshold, which the feedback also targets, and underrun
+  *         guard band. The threshold leaves room for one speaker read and one
+  *         USB packet, and is at most half of the ring
+  * @param  play_session: session, ring must be initialized
+  * @retval None
+  */
+static void AUDIO_Playback_UpdateLatency(AUDIO_USB_SessionTypedef* play_session)
+{
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&play_audio_description);
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+  uint32_t threshold = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) * play_adaptive_ms;
+#else /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+  uint32_t threshold = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) * AUDIO_Playback_LatencyMs[play_latency];
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+  uint32_t min_threshold = (uint32_t)speaker_output.packet_length + usb_play_input.max_packet_length;
+
+  if(threshold < min_threshold)
+  {
+    threshold = min_threshold;
+  }
+  if(threshold > (play_session->buffer.size >> 1))
+  {
+    threshold = play_session->buffer.size >> 1;
+  }
+  play_start_threshold = (threshold / frame_size) * frame_size;
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  /* half way to an underrun of the speaker */
+  play_guard_band = (play_start_threshold + speaker_output.packet_length) >> 1;
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+}
 
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
 /**
-  * @brief  AUDIO_Playback_GetFeedback
-  *         get played sample counter
+  * @brief  AUDIO_Playback_AdaptLatency
+  *         moves the target latency to the jitter peak measured by the input
+  *         node plus the low latency profile, called each ms frame. The levels
+  *         change at once, the feedback moves the fill to the new target
+  * @param  play_session: session, started
+  * @retval None
+  */
+static void AUDIO_Playback_AdaptLatency(AUDIO_USB_SessionTypedef* play_session)
+{
+  uint32_t cycles_per_ms = SystemCoreClock / 1000U;
+  uint32_t jitter = usb_play_input.specific.input.jitter_peak;
+  uint32_t needed;
+#ifdef USE_AUDIO_SOF_JITTER
+  AUDIO_SofJitterStatsTypeDef sof;
+
+  /* the packets follow the SOF of the host : its jitter adds to theirs, and a
+     frame without SOF is a packet sent with the next one */
+  AUDIO_SofJitterGetStats(&sof);
+  jitter += (sof.jitter_peak_ns / 1000U) * (SystemCoreClock / 1000000U);
+  if(sof.window_missed != 0U)
+  {
+    jitter += cycles_per_ms;
+  }
+#endif /* USE_AUDIO_SOF_JITTER */
+
+  needed = AUDIO_PLAYBACK_ADAPT_MIN_MS + ((jitter + cycles_per_ms - 1U) / cycles_per_ms);
+  if(needed > AUDIO_Playback_LatencyMs[play_latency])
+  {
+    needed = AUDIO_Playback_LatencyMs[play_latency];
+  }
+  if(needed > play_adaptive_ms)
+  {
+    play_adaptive_ms = (uint8_t)needed;
+    play_adapt_count = 0;
+    AUDIO_Playback_UpdateLatency(play_session);
+  }
+  else if(++play_adapt_count >= AUDIO_PLAYBACK_ADAPT_PERIOD_MS)
+  {
+    play_adapt_count = 0;
+    if(needed < play_adaptive_ms)
+    {
+      play_adaptive_ms--;
+      AUDIO_Playback_UpdateLatency(play_session);
+    }
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+/**
+  * @brief  AUDIO_Playback_DropOldest
+  *         on overrun, asks the speaker to drop the oldest data in whole
+  *         frames, down to the start threshold. Data the host wrote over the
+  *         unread part of the ring is dropped with it
+  * @param  play_session: session
+  * @retval None
+  */
+static void AUDIO_Playback_DropOldest(AUDIO_USB_SessionTypedef* play_session)
+{
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&play_audio_description);
+  uint32_t filled = AUDIO_BUFFER_FILLED_SIZE(&play_session->buffer);
+
+  if(filled > play_start_threshold)
+  {
+    speaker_output.drop_length = ((filled - play_start_threshold) / frame_size) * frame_size;
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+
+/**
+  * @brief  AUDIO_Playback_StartSpeaker
+  *         starts the speaker once the ring reached the start threshold
+  * @param  play_session: session
+  * @retval None
+  */
+static void AUDIO_Playback_StartSpeaker(AUDIO_USB_SessionTypedef* play_session)
+{
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  play_parked = AUDIO_PLAYBACK_SUSPEND_NONE;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+  speaker_output.SpeakerStart(& play_session->buffer, (uint32_t)&speaker_output);
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  sync_first_time_sof =0;
+#endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+  AUDIO_PumpPost(AUDIO_PUMP_SPEAKER_DATA);
+}
+
+#ifdef USE_AUDIO_SYNC_START
+/**
+  * @brief  AUDIO_Playback_SyncStart
+  *         held speaker start, from the SOF interrupt. The ring is kept at the
+  *         start threshold, the oldest frames are dropped while the host goes
+  *         on sending, so the start always has the same latency
+  * @param  start: 1 to start the speaker
   * @param  session_handle: session
-  * @retval  : 0 if buffer ok , 1 if overrun soon , -1 if underrun soon
+  * @retval playback frame the speaker starts with, since the alternate
   */
-static uint32_t   AUDIO_Playback_GetFeedback( uint32_t session_handle )
+static uint32_t AUDIO_Playback_SyncStart(uint8_t start, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef* play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&play_audio_description);
+  uint32_t filled = AUDIO_BUFFER_FILLED_SIZE(&play_session->buffer);
+
+  /* the speaker doesn't read the ring yet, this is its only consumer */
+  if(filled > play_start_threshold)
+  {
+    AUDIO_BufferCommitRead(&play_session->buffer, ((filled - play_start_threshold) / frame_size) * frame_size);
+  }
+  if(start != 0U)
+  {
+    AUDIO_Playback_StartSpeaker(play_session);
+  }
+  return play_session->buffer.rd_ptr / frame_size;
+}
+#endif /* USE_AUDIO_SYNC_START */
+
+#if defined(USE_AUDIO_PLAYBACK_ROUTER) || defined(USE_AUDIO_PLAYBACK_EQ) || defined(USE_AUDIO_PLAYBACK_LIMITER) || \
+    defined(USE_AUDIO_LEVEL_METER) || defined(USE_AUDIO_PLAYBACK_CHAIN_SWAP) || defined(USE_AUDIO_PLAYBACK_LONG_DELAY)
+/**
+  * @brief  AUDIO_Playback_InsertProcessing
+  *         links a processing node last in the chain, just before the speaker
+  * @param  node: initialized processing node
+  * @retval None
+  */
+static void AUDIO_Playback_InsertProcessing(AUDIO_NodeTypeDef* node)
+{
+  AUDIO_NodeTypeDef* previous = (AUDIO_NodeTypeDef*)&streaming_feature_control;
+
+  while(previous->next != (AUDIO_NodeTypeDef*)&speaker_output)
+  {
+    previous = previous->next;
+  }
+  node->next = (AUDIO_NodeTypeDef*)&speaker_output;
+  previous->next = node;
+}
+#endif /* USE_AUDIO_PLAYBACK_ROUTER || USE_AUDIO_PLAYBACK_EQ || USE_AUDIO_PLAYBACK_LIMITER || USE_AUDIO_LEVEL_METER || USE_AUDIO_PLAYBACK_CHAIN_SWAP || USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+#if (defined USE_AUDIO_PLAYBACK_CHAIN_SWAP) && ((defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS))
+/**
+  * @brief  AUDIO_Playback_SetChain
+  *         rebuilds the chain with the selected stages, in their fixed order.
+  *         A stage joining a started chain is restarted first, so it runs
+  *         from a cleared state. The swap is done at the next packets
+  * @param  stages: AUDIO_USB_CHAIN_xxx mask
+  * @param  play_session: session
+  * @retval 0 if no error, -1 on a stage not built or while a swap is pending
+  */
+static int8_t  AUDIO_Playback_SetChain(uint32_t stages, AUDIO_USB_SessionTypedef* play_session)
 {
- if((speaker_output.node.state == AUDIO_NODE_STARTED))
+  uint32_t built = 0;
+  uint8_t  started = (play_session->session.state == AUDIO_SESSION_STARTED) ? 1U : 0U;
+
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+  built |= AUDIO_USB_CHAIN_ROUTER;
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  built |= AUDIO_USB_CHAIN_EQ;
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  built |= AUDIO_USB_CHAIN_LIMITER;
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+  if(((stages & ~built) != 0U) || (AUDIO_ChainClear() != 0))
+  {
+    return -1;
+  }
+#ifdef USE_AUDIO_PLAYBACK_ROUTER
+  if(stages & AUDIO_USB_CHAIN_ROUTER)
   {
-    if(sync_estimated_freq)
+    if(started && !AUDIO_ChainIsActive((AUDIO_NodeTypeDef*)&play_router))
     {
-      return sync_estimated_freq ;
+      play_router.RouterStart((uint32_t)&play_router);
     }
-    else
+    AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_router);
+  }
+#endif /* USE_AUDIO_PLAYBACK_ROUTER */
+#ifdef USE_AUDIO_PLAYBACK_EQ
+  if(stages & AUDIO_USB_CHAIN_EQ)
+  {
+    if(started && !AUDIO_ChainIsActive((AUDIO_NodeTypeDef*)&play_eq))
     {
-     AUDIO_BufferTypeDef *buffer = &((AUDIO_USB_SessionTypedef*)session_handle)->buffer;
-     uint32_t wr_distance;
-     
-     wr_distance=AUDIO_BUFFER_FREE_SIZE(buffer);
-     if(wr_distance <= (buffer->size>>2))
-     {
-       return play_audio_description.frequence - 1000;
-     }
-     if( wr_distance >= (buffer->size - (buffer->size>>2)))
-     {
-       return play_audio_description.frequence + 1000;
-     }
+      play_eq.EqStart((uint32_t)&play_eq);
+    }
+    AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_eq);
+  }
+#endif /* USE_AUDIO_PLAYBACK_EQ */
+#ifdef USE_AUDIO_PLAYBACK_LIMITER
+  if(stages & AUDIO_USB_CHAIN_LIMITER)
+  {
+    if(started && !AUDIO_ChainIsActive((AUDIO_NodeTypeDef*)&play_limiter))
+    {
+      play_limiter.LimiterStart((uint32_t)&play_limiter);
     }
+    AUDIO_ChainAdd((AUDIO_NodeTypeDef*)&play_limiter);
+  }
+#endif /* USE_AUDIO_PLAYBACK_LIMITER */
+  return AUDIO_ChainCommit();
+}
+#endif /* USE_AUDIO_PLAYBACK_CHAIN_SWAP && (USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS) */
+
+/**
+  * @brief  AUDIO_Playback_SetLatency
+  *         selects the latency profile. When the session is started the levels
+  *         change at once, the feedback moves the fill to the new target
+  * @param  profile: latency profile
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_Playback_SetLatency(AUDIO_USB_LatencyProfileTypedef profile, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *play_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(profile >= AUDIO_USB_LATENCY_COUNT)
+  {
+    return -1;
+  }
+  play_latency = profile;
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+  /* the profile is the new ceiling, the target converges down from it */
+  play_adaptive_ms = AUDIO_Playback_LatencyMs[play_latency];
+  play_adapt_count = 0;
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+  if(play_session->session.state == AUDIO_SESSION_STARTED)
+  {
+    AUDIO_Playback_UpdateLatency(play_session);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Playback_GetLatency
+  *         latency profile selected
+  * @param  None
+  * @retval latency profile
+  */
+AUDIO_USB_LatencyProfileTypedef  AUDIO_Playback_GetLatency(void)
+{
+  return play_latency;
+}
+
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+
+/**
+  * @brief  AUDIO_Playback_GetFeedback
+  *         get rate the host should send at. With USE_AUDIO_CLOCK_SOF_OUTPUT
+  *         the speaker is locked on SOF and the rate is always the nominal one
+  * @param  session_handle: session
+  * @retval  : rate in Hz with AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits
+  */
+static uint32_t   AUDIO_Playback_GetFeedback( uint32_t session_handle )
+{
+  if((speaker_output.node.state == AUDIO_NODE_STARTED) && (sync_feedback.rate))
+  {
+    return sync_feedback.rate;
   }
- return play_audio_description.frequence;
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  if((play_parked != AUDIO_PLAYBACK_SUSPEND_NONE) && (sync_feedback.rate))
+  {
+    /* estimate kept over the suspend, until the speaker restarts */
+    return sync_feedback.rate;
+  }
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+  return play_audio_description.frequence << AUDIO_FEEDBACK_RATE_FRAC_BITS;
+}
+
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
+/**
+  * @brief  AUDIO_Playback_FeedbackUpdate
+  *         PI controller which keeps the buffer half filled, the proportional
+  *         term absorbs packet jitter and the integral term converges to the
+  *         clock drift between host and speaker
+  * @param  session: playback session
+  * @retval  : 
+  */
+static void  AUDIO_Playback_FeedbackUpdate(AUDIO_USB_SessionTypedef* session)
+{
+  AUDIO_BufferTypeDef *buffer = &session->buffer;
+  int32_t sample_size = AUDIO_SAMPLE_LENGTH(&play_audio_description);
+  int32_t nominal = play_audio_description.frequence << AUDIO_FEEDBACK_RATE_FRAC_BITS;
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+  uint32_t measured = AUDIO_ClockDomainGetRate();
+#elif defined(USE_AUDIO_SOF_TIMESTAMP)
+  uint32_t measured = AUDIO_SofTimestampGetRate(play_audio_description.frequence);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+  int32_t max_deviation = nominal >> AUDIO_FEEDBACK_MAX_DEVIATION_SHIFT;
+  int32_t fill = AUDIO_BUFFER_FILLED_SIZE(buffer) << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+  int32_t target = (int32_t)play_start_threshold << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+  int32_t correction;
+  uint8_t avg_shift = AUDIO_FEEDBACK_FILL_AVG_SHIFT;
+#ifdef USE_AUDIO_SOF_JITTER
+  AUDIO_SofJitterStatsTypeDef sof;
+  uint32_t quiet_ns = AUDIO_FEEDBACK_JITTER_QUIET_NS;
+
+  /* a host with irregular frames makes the fill level noisier : filter more */
+  AUDIO_SofJitterGetStats(&sof);
+  while((sof.jitter_peak_ns > quiet_ns) && (avg_shift < AUDIO_FEEDBACK_FILL_AVG_MAX_SHIFT))
+  {
+    quiet_ns <<= 1;
+    avg_shift++;
+  }
+#endif /* USE_AUDIO_SOF_JITTER */
+
+#if defined(USE_AUDIO_SHARED_CLOCK_DOMAIN) || defined(USE_AUDIO_SOF_TIMESTAMP)
+  if(measured)
+  {
+    /* speaker rate measured in USB time : the controller only trims the fill level.
+       The recording synchro of a shared clock domain uses the same rate */
+    nominal = (int32_t)measured;
+  }
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN || USE_AUDIO_SOF_TIMESTAMP */
+  correction = AUDIO_SyncFeedbackStep(&sync_feedback.pi, fill, target, sample_size, max_deviation, avg_shift);
+  if(AUDIO_BUFFER_FILLED_SIZE(buffer) < play_guard_band)
+  {
+    /* close to an underrun : don't wait for the averaged fill level */
+    correction = max_deviation;
+  }
+  sync_feedback.rate = (uint32_t)(nominal + correction);
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+  AUDIO_Playback_FeedbackLearn(correction, nominal, max_deviation);
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+}
+
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+/**
+  * @brief  AUDIO_Playback_FeedbackLearn
+  *         takes the integral term as the drift of the current rate family
+  *         once the correction stayed unsaturated for AUDIO_FEEDBACK_CONVERGED_MS
+  * @param  correction: correction sent this frame
+  * @param  nominal: rate the correction applies to, AUDIO_FEEDBACK_RATE_FRAC_BITS fractional bits
+  * @param  max_deviation: correction limit, same format
+  * @retval None
+  */
+static void AUDIO_Playback_FeedbackLearn(int32_t correction, int32_t nominal, int32_t max_deviation)
+{
+  uint8_t family = AUDIO_PLAYBACK_CLOCK_FAMILY(play_audio_description.frequence);
+  int32_t integral_rate;
+  int32_t ppm;
+
+  if((correction >= max_deviation) || (correction <= -max_deviation))
+  {
+    sync_feedback.steady = 0;
+    return;
+  }
+  if(++sync_feedback.steady < AUDIO_FEEDBACK_CONVERGED_MS)
+  {
+    return;
+  }
+  sync_feedback.steady = 0;
+  integral_rate = (sync_feedback.pi.integral * (1 << AUDIO_FEEDBACK_KI_SHIFT)) / (1 << AUDIO_FEEDBACK_FILL_FRAC_BITS);
+  sync_drift[family] = (int32_t)(((int64_t)integral_rate * AUDIO_FEEDBACK_DRIFT_ONE_PPM) / nominal);
+  ppm = sync_drift[family] / (1 << AUDIO_FEEDBACK_DRIFT_FRAC_BITS);
+  /* the estimate wanders by some tenths of ppm, which is not worth a flash record */
+  if((ppm - sync_drift_published[family] >= AUDIO_FEEDBACK_DRIFT_PUBLISH_PPM) ||
+     (sync_drift_published[family] - ppm >= AUDIO_FEEDBACK_DRIFT_PUBLISH_PPM))
+  {
+    sync_drift_published[family] = (int16_t)ppm;
+  }
+}
+
+/**
+  * @brief  AUDIO_Playback_GetDriftPpm
+  *         clock drift learnt for a rate family, updated by steps of
+  *         AUDIO_FEEDBACK_DRIFT_PUBLISH_PPM
+  * @param  family: 0 for multiples of 11.025 KHz, 1 for the others
+  * @retval drift in ppm, positive when the host asks for more samples than nominal
+  */
+int16_t  AUDIO_Playback_GetDriftPpm(uint8_t family)
+{
+  return (family < AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT) ? sync_drift_published[family] : 0;
+}
+
+/**
+  * @brief  AUDIO_Playback_SetDriftPpm
+  *         sets the clock drift of a rate family, used by the next start
+  * @param  family: 0 for multiples of 11.025 KHz, 1 for the others
+  * @param  ppm: drift in ppm
+  * @retval None
+  */
+void  AUDIO_Playback_SetDriftPpm(uint8_t family, int16_t ppm)
+{
+  if(family < AUDIO_PLAYBACK_CLOCK_FAMILY_COUNT)
+  {
+    sync_drift[family] = (int32_t)ppm * (1 << AUDIO_FEEDBACK_DRIFT_FRAC_BITS);
+    sync_drift_published[family] = ppm;
+  }
+}
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+
+#ifdef USE_AUDIO_BENCH
+/**
+  * @brief  AUDIO_Playback_FeedbackBench
+  *         times one step of the PI controller on a private state, for the
+  *         on-target benchmark. The fill is a frame below target so both
+  *         terms are computed, the session controller is not touched
+  * @param  freq: sampling frequency
+  * @param  channels: channels count
+  * @param  res: bytes per sample
+  * @retval cycles of the step
+  */
+uint32_t AUDIO_Playback_FeedbackBench(uint32_t freq, uint8_t channels, uint8_t res)
+{
+  AUDIO_SyncFeedbackTypeDef feedback;
+  int32_t sample_size = (int32_t)channels * res;
+  int32_t max_deviation = (int32_t)(freq << AUDIO_FEEDBACK_RATE_FRAC_BITS) >> AUDIO_FEEDBACK_MAX_DEVIATION_SHIFT;
+  int32_t target = (int32_t)AUDIO_MS_PACKET_SIZE(freq, channels, res) << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+  int32_t fill = target - (sample_size << AUDIO_FEEDBACK_FILL_FRAC_BITS);
+  volatile int32_t correction;
+  uint32_t start;
+
+  memset(&feedback, 0, sizeof(feedback));
+  feedback.fill_avg = target;
+  start = DWT->CYCCNT;
+  correction = AUDIO_SyncFeedbackStep(&feedback, fill, target, sample_size, max_deviation,
+                                      AUDIO_FEEDBACK_FILL_AVG_SHIFT);
+  start = DWT->CYCCNT - start;
+  (void)correction;
+  return start;
 }
+#endif /* USE_AUDIO_BENCH */
 
 /**
   * @brief  AUDIO_USB_Session_Sof_Received
-  *         update the rate of audio
+  *         update the rate of audio, called by the SOF tick each ms
   * @param  session_handle: session
   * @retval  : 
   */
 
 static void  AUDIO_USB_Session_Sof_Received(uint32_t session_handle )
  {
-   static uint16_t sof_counter = 0;
-#ifdef USE_USB_HS
-   static uint8_t micro_sof_counter = 0;
-#endif /* USE_USB_HS */
-   static uint32_t total_received_sub_samples = 0;
     AUDIO_USB_SessionTypedef *session;
-    uint16_t read_samples_per_channel ;
     
   session = (AUDIO_USB_SessionTypedef*)session_handle;
-  if( session->session.state == AUDIO_SESSION_STARTED) 
+  if((session->session.state == AUDIO_SESSION_STARTED) &&
+     (speaker_output.node.state == AUDIO_NODE_STARTED))
   {
    if(sync_first_time_sof)
    {
-#ifdef USE_USB_HS
-     if(micro_sof_counter !=7)
-     {
-       micro_sof_counter++;
-     }
-     else
-     {
-#endif /* USE_USB_HS */
-        read_samples_per_channel = speaker_output.SpeakerGetReadCount((uint32_t)&speaker_output);
-        total_received_sub_samples += read_samples_per_channel;
-        if(++sof_counter == 1000)
-        {
-          sync_estimated_freq =((total_received_sub_samples)>>1); 
-          sof_counter =0;
-          total_received_sub_samples = 0;
-        }
-#ifdef USE_USB_HS
-        micro_sof_counter = 0;
-     }
-#endif /* USE_USB_HS */
+#ifdef USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY
+        AUDIO_Playback_AdaptLatency(session);
+#endif /* USE_AUDIO_PLAYBACK_ADAPTIVE_LATENCY */
+        AUDIO_Playback_FeedbackUpdate(session);
    }
    else
    {
-       speaker_output.SpeakerStartReadCount((uint32_t)&speaker_output);
-       sof_counter = 0;
-#ifdef USE_USB_HS
-       micro_sof_counter = 0;
-#endif /* USE_USB_HS */
-       total_received_sub_samples = 0;
+       /* speaker has just started from the start threshold */
+       sync_feedback.pi.fill_avg = (int32_t)play_start_threshold << AUDIO_FEEDBACK_FILL_FRAC_BITS;
+#ifdef USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START
+       /* start from the drift of the last run at a rate of the same family */
+       sync_feedback.pi.integral = (int32_t)(((int64_t)sync_drift[AUDIO_PLAYBACK_CLOCK_FAMILY(play_audio_description.frequence)] *
+                                           (int32_t)(play_audio_description.frequence << AUDIO_FEEDBACK_RATE_FRAC_BITS)) /
+                                          AUDIO_FEEDBACK_DRIFT_ONE_PPM);
+       sync_feedback.pi.integral = (sync_feedback.pi.integral * (1 << AUDIO_FEEDBACK_FILL_FRAC_BITS)) / (1 << AUDIO_FEEDBACK_KI_SHIFT);
+       sync_feedback.steady = 0;
+#else /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+       sync_feedback.pi.integral = 0;
+#endif /* USE_AUDIO_PLAYBACK_FEEDBACK_WARM_START */
+       sync_feedback.rate = 0;
        sync_first_time_sof = 1;
     }
   }
@@ -564,8 +1796,33 @@ static void  AUDIO_USB_Session_Sof_Received(uint32_t session_handle )
     sync_first_time_sof = 0;
   }
  }
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
 #endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
 
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+/**
+  * @brief  AUDIO_Playback_ClockStart
+  *         starts the count of the speaker frames for the clock domain
+  * @param  session_handle: session
+  * @retval 0 if the speaker runs
+  */
+static int8_t  AUDIO_Playback_ClockStart(uint32_t session_handle)
+{
+  return speaker_output.SpeakerStartReadCount((uint32_t)&speaker_output);
+}
+
+/**
+  * @brief  AUDIO_Playback_ClockCount
+  *         samples played by the speaker since the last call
+  * @param  session_handle: session
+  * @retval samples of all channels , 0 if the speaker is stopped
+  */
+static uint32_t  AUDIO_Playback_ClockCount(uint32_t session_handle)
+{
+  return speaker_output.SpeakerGetReadCount((uint32_t)&speaker_output);
+}
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
 /**
@@ -578,15 +1835,34 @@ static int8_t  AUDIO_Playback_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt
 {
        AUDIO_USB_SessionTypedef * play_session = (AUDIO_USB_SessionTypedef *)session_handle;
        
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+      /* the external clock rate can't be changed by the host */
+      if(play_ext_clk_selected && (freq != USB_AUDIO_CONFIG_EXT_CLOCK_FREQ))
+      {
+        *as_cnt_to_restart = 0;
+        return -1;
+      }
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+      /* the streaming alternate bandwidth is sized for its own highest rate */
+      if((play_session->alternate != 0) &&
+         (freq > AUDIO_Playback_Alternates[play_session->alternate - 1U].freq_max))
+      {
+        *as_cnt_to_restart = 0;
+        return -1;
+      }
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+      AUDIO_DescriptionWriteBegin(&play_audio_description);
       play_audio_description.frequence = freq;
+      AUDIO_DescriptionWriteEnd(&play_audio_description);
        /* recompute the buffer size */
       speaker_output.SpeakerChangeFrequence((uint32_t)&speaker_output);
-      uint16_t buffer_margin = (usb_play_input.max_packet_length > usb_play_input.packet_length)? usb_play_input.max_packet_length:0;
+      uint16_t buffer_margin = usb_play_input.max_packet_length;
       AUDIO_USB_InitializesDataBuffer(&play_session->buffer, USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE,
                                   AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&play_audio_description) , buffer_margin);
 #ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
      sync_first_time_sof =0;
-     sync_estimated_freq = 0;
+     sync_feedback.rate = 0;
 #endif  /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */  
       usb_play_input.IOChangeFrequency((uint32_t)&usb_play_input);
       *as_cnt_to_restart = 0;
@@ -595,6 +1871,9 @@ static int8_t  AUDIO_Playback_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt
  AUDIO_Recording_SessionSetFrequency( freq, as_cnt_to_restart, as_list_to_restart,  (uint32_t) &usb_record_session);
 #endif /* USE_USB_AUDIO_RECORDING*/
 #endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+ AUDIO_Mix_SessionSetFrequency( freq, as_cnt_to_restart, as_list_to_restart,  (uint32_t) &usb_mix_session);
+#endif /* USE_AUDIO_PLAYBACK_MIX */
       if(play_session->session.state == AUDIO_SESSION_STARTED)
       {
         as_list_to_restart[*as_cnt_to_restart] = play_session->interface_num;
@@ -604,6 +1883,48 @@ static int8_t  AUDIO_Playback_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt
   return 0;
 }
 #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/**
+  * @brief  AUDIO_Playback_SessionSelectClock
+  *         Switches the audio clock between the internal PLL and the external
+  *         word clock. The sessions sharing the clock are set to the rate of
+  *         the new source and restarted, so the SAI is clocked again from it
+  * @param  pin: selector input, USB_AUDIO_CONFIG_CLOCK_SELECTOR_INTERNAL or _EXTERNAL
+  * @param  as_cnt_to_restart: returned count of AS interfaces to restart
+  * @param  as_list_to_restart: returned list of AS interfaces to restart
+  * @param  session_handle: session handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Playback_SessionSelectClock(uint8_t pin, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle)
+{
+  uint8_t external = (pin == USB_AUDIO_CONFIG_CLOCK_SELECTOR_EXTERNAL) ? 1U : 0U;
+  uint32_t freq = (external) ? USB_AUDIO_CONFIG_EXT_CLOCK_FREQ : play_audio_description.frequence;
+
+  AUDIO_USER_ClockSelect(external);
+  play_ext_clk_selected = external;
+  if(AUDIO_Playback_SessionSetFrequency(freq, as_cnt_to_restart, as_list_to_restart, session_handle) != 0)
+  {
+    AUDIO_USER_ClockSelect(!external);
+    play_ext_clk_selected = !external;
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Playback_ExtClockIsValid
+  *         The external clock is valid while its PLL is locked on the word clock
+  * @param  is_valid: returned validity
+  * @param  session_handle: session handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Playback_ExtClockIsValid(uint8_t* is_valid, uint32_t session_handle)
+{
+  *is_valid = AUDIO_USER_ClockIsLocked();
+  return 0;
+}
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 #endif /* USE_USB_AUDIO_CLASS_20 */
   
 #endif /*USE_USB_AUDIO_PLAYPBACK*/
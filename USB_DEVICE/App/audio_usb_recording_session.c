@@ -50,6 +50,27 @@
 #include "usb_audio_user.h"
 #include "audio_mic_node.h"
 #include "audio_sessions_usb.h"
+#include "audio_sync_control.h"
+#include "audio_pump.h"
+#include "audio_sof_timestamp.h"
+#include "audio_clock_domain.h"
+#include "audio_meter_node.h"
+#include "audio_sidetone_node.h"
+#ifdef USE_AUDIO_AEC
+#include "audio_aec_node.h"
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+#include "audio_agc_node.h"
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_PARAMS_STORE
+#include "audio_params.h"
+#endif /* USE_AUDIO_PARAMS_STORE */
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_SYNC_START
+#include "audio_sync_start.h"
+#endif /* USE_AUDIO_SYNC_START */
 #ifdef USE_USB_AUDIO_RECORDING
 
 
@@ -57,13 +78,18 @@
 /* Private defines -----------------------------------------------------------*/
 #define AUDIO_USB_RECORDING_ALTERNATE           0x01
 #define DEFAULT_VOLUME_DB_256                   0
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+/* mic parked over a bus suspend */
+#define AUDIO_RECORDING_SUSPEND_NONE            0U
+#define AUDIO_RECORDING_SUSPEND_PARKED          1U /* bus suspended, SAI stopped */
+#define AUDIO_RECORDING_SUSPEND_RESUMING        2U /* bus resumed, the mic restarts at the first packet sent */
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
-#ifdef USE_USB_FS
-#define USB_SOF_COUNT_PER_SECOND 1000
-#endif /* USE_USB_FS */
-#ifdef USE_USB_HS
+#ifdef USE_USB_HS_ULPI_PHY
 #define USB_SOF_COUNT_PER_SECOND 8000
-#endif /* USE_USB_HS */
+#else /* USE_USB_HS_ULPI_PHY */
+#define USB_SOF_COUNT_PER_SECOND 1000
+#endif /* USE_USB_HS_ULPI_PHY */
 #define AUDIO_SYNC_STARTED                      0x01 /* set to 1 when synchro parameters are ready to use */
 #define AUDIO_SYNC_NEEDED                       0x02 /* We need to add or remove some samples */
 #define AUDIO_SYNC_STABLE                       0x04 /* computed frequency has a good precision */
@@ -89,9 +115,16 @@ typedef struct
   uint16_t packet_size;         /* packet size */
   int8_t   sample_size;         /* size of 1 sample */
   int      sample_per_s_th;     /* thershold to detect that a small drift is observed */
-  uint16_t buffer_fill_max_th;  /* if filled bytes count is more than this thershold an overrun is soon */
-  uint16_t buffer_fill_min_th;  /* if filled bytes count is less than this thershold an underrun is soon */
-  uint16_t buffer_fill_moy;     /* the center value of filled bytes */
+  uint32_t buffer_fill_max_th;  /* if filled bytes count is more than this thershold an overrun is soon */
+  uint32_t buffer_fill_min_th;  /* if filled bytes count is less than this thershold an underrun is soon */
+  uint32_t buffer_fill_moy;     /* the center value of filled bytes */
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  uint32_t nominal_step;        /* mic frequency / USB frequency, 2.30 format */
+  uint32_t resampler_step;      /* nominal_step corrected by buffer fill level */
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  uint32_t mic_rate;            /* mic rate latched against SOF, AUDIO_SOF_TS_RATE_FRAC_BITS format, 0 if unknown */
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
 }AUDIO_SynchroParams;
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO*/
 
@@ -106,22 +139,58 @@ static int8_t  AUDIO_Recording_SessionStop(AUDIO_USB_SessionTypedef *rec_session
 static int8_t  AUDIO_Recording_SessionDeInit(uint32_t session_handle);
 static int8_t  AUDIO_Recording_SetAS_Alternate( uint8_t alternate,  uint32_t session_handle);
 static int8_t  AUDIO_Recording_GetState(uint32_t session_handle);
+static void    AUDIO_Recording_InitBuffer(AUDIO_USB_SessionTypedef* rec_session);
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+static int8_t  AUDIO_Recording_GetStats(AUDIO_USB_SessionStatsTypeDef* stats, uint32_t session_handle);
+static int8_t  AUDIO_Recording_SetParameter(AUDIO_USB_SessionParamTypedef param, uint16_t channel,
+                                            int32_t value, uint32_t session_handle);
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 static int8_t  AUDIO_Recording_SessionCallback(AUDIO_SessionEventTypeDef  event, 
                                                AUDIO_NodeTypeDef* node_handle, 
                                                struct    AUDIO_Session* session_handle);
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+static int8_t  AUDIO_Recording_SessionSuspend(uint8_t suspend, uint32_t session_handle);
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 #ifdef USE_AUDIO_USB_INTERRUPT
 static int8_t  AUDIO_Recording_SessionExternalControl( AUDIO_ControlCommandTypedef control , uint32_t val, uint32_t session_handle);
 #endif /*USE_AUDIO_USB_INTERRUPT*/
 
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+static void  AUDIO_Recording_StageHandler(void);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+#ifdef USE_AUDIO_RECORDING_USERS
+static int8_t  AUDIO_Recording_SetUsers(AUDIO_USB_SessionTypedef* rec_session, uint8_t users);
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+static int8_t  AUDIO_Recording_RequestUsers(AUDIO_USB_SessionTypedef* rec_session, uint8_t users);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+#endif /* USE_AUDIO_RECORDING_USERS */
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+static void    AUDIO_Recording_StartHandler(void);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+#ifdef USE_AUDIO_SYNC_START
+static uint32_t AUDIO_Recording_SyncStart(uint8_t start, uint32_t session_handle);
+#endif /* USE_AUDIO_SYNC_START */
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+static int8_t   AUDIO_Recording_ClockStart(uint32_t session_handle);
+static uint32_t AUDIO_Recording_ClockCount(uint32_t session_handle);
+static void     AUDIO_Recording_ClockFrame(uint32_t frames, uint32_t session_handle);
+#else /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
 static void  AUDIO_Recording_Sof_Received(uint32_t session_handle );
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+static void  AUDIO_Recording_FrameUpdate(AUDIO_USB_SessionTypedef* rec_session, uint32_t read_bytes);
 static void AUDIO_Recording_synchro_init(AUDIO_BufferTypeDef *buf, uint32_t packet_length);
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+static void  AUDIO_Recording_resampler_update(int wr_distance);
+#else /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 static void  AUDIO_Recording_synchro_update(int wr_distance );
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO*/
 
 /* Private variables ---------------------------------------------------------*/
 #ifdef USE_USB_AUDIO_CLASS_20
 #ifdef USE_AUDIO_USB_RECORD_MULTI_FREQUENCES
+/* supported frequencies, from the highest : the clock source search relies on it */
  uint32_t USB_AUDIO_CONFIG_RECORD_FREQENCIES[USB_AUDIO_CONFIG_RECORD_FREQ_COUNT]=
 {
 #if USB_AUDIO_CONFIG_RECORD_USE_FREQ_192_K
@@ -153,9 +222,43 @@ static AUDIO_USB_IO_NodeTypeDef usb_rec_output;
 static AUDIO_DescriptionTypeDef record_audio_description;
 static AUDIO_USB_CF_NodeTypeDef recording_feature_control;
 static AUDIO_Mic_NodeTypeDef mic_input;
+/* nodes of the record path, as described to the host */
+#define AUDIO_RECORD_ENTITY(subtype, id, source, type, node) { (id), (source), (AUDIO_NodeTypeDef*)&(node) },
+static const AUDIO_USB_EntityTypeDef record_entities[] = { AUDIO_TOPOLOGY_RECORD(AUDIO_RECORD_ENTITY) };
+#ifdef USE_AUDIO_LEVEL_METER
+static AUDIO_Meter_NodeTypeDef rec_meter;
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_AEC
+static AUDIO_Aec_NodeTypeDef rec_aec;
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+static AUDIO_Agc_NodeTypeDef rec_agc;
+#endif /* USE_AUDIO_MIC_AGC */
+/* record ring, USB packets are sent in place */
+__ALIGN_BEGIN static uint8_t rec_buffer_data[USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+#ifdef USE_AUDIO_PACKET_QUEUE
+/* packets of the record ring as the mic wrote them */
+static AUDIO_PacketQueueTypeDef rec_packets;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+/* fill level to start sending at, set with the ring size */
+static uint32_t rec_start_threshold;
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO 
 static  AUDIO_SynchroParams syncp; /* synchro parameters*/
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO*/
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+static uint8_t rec_parked = AUDIO_RECORDING_SUSPEND_NONE;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+#ifdef USE_AUDIO_RECORDING_USERS
+static uint8_t rec_users = 0;
+#endif /* USE_AUDIO_RECORDING_USERS */
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+static AUDIO_USB_SessionTypedef* rec_start_session = 0; /* session of the start handler */
+#ifdef USE_AUDIO_RECORDING_USERS
+static uint8_t rec_users_request = 0; /* users the interfaces selected, rec_users follows from the pump */
+#else /* USE_AUDIO_RECORDING_USERS */
+static uint8_t rec_started_alternate = 0; /* alternate the session was started for, 0 if stopped */
+#endif /* USE_AUDIO_RECORDING_USERS */
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
 
 /* exported functions ---------------------------------------------------------*/
 
@@ -188,7 +291,32 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
   #ifdef USE_AUDIO_USB_INTERRUPT
    rec_session->ExternalControl = AUDIO_Recording_SessionExternalControl;
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+  rec_session->GetStats = AUDIO_Recording_GetStats;
+  rec_session->SetParameter = AUDIO_Recording_SetParameter;
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  rec_session->SessionSuspend = AUDIO_Recording_SessionSuspend;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
   rec_session->session.SessionCallback = AUDIO_Recording_SessionCallback;
+  rec_session->session.event_mask = AUDIO_SESSION_EVENT_BIT(AUDIO_PACKET_PLAYED)|
+                                    AUDIO_SESSION_EVENT_BIT(AUDIO_FREQUENCY_CHANGED)|
+                                    AUDIO_SESSION_EVENT_BIT(AUDIO_OVERRUN)|
+                                    AUDIO_SESSION_EVENT_BIT(AUDIO_UNDERRUN);
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+  /* the mic AUDIO_PACKET_RECEIVED is only needed to track the host reads */
+  rec_session->session.event_mask |= AUDIO_SESSION_EVENT_BIT(AUDIO_PACKET_RECEIVED)|
+                                     AUDIO_SESSION_EVENT_BIT(AUDIO_BEGIN_OF_STREAM);
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#ifdef USE_AUDIO_SYNC_START
+  /* the first mic frame sent gives the record position of a synchronous start */
+  rec_session->session.event_mask |= AUDIO_SESSION_EVENT_BIT(AUDIO_BEGIN_OF_STREAM);
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_RECORDING_USERS
+  /* the ring is emptied when the host doesn't read the mic */
+  rec_session->session.event_mask |= AUDIO_SESSION_EVENT_BIT(AUDIO_PACKET_RECEIVED);
+  rec_users = 0;
+#endif /* USE_AUDIO_RECORDING_USERS */
   
   /*set audio used option*/
   record_audio_description.audio_res = USBD_AUDIO_CONFIG_RECORD_RES_BYTE;
@@ -198,6 +326,16 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
   record_audio_description.frequence = USB_AUDIO_CONFIG_RECORD_DEF_FREQ;
   record_audio_description.audio_mute = 0;
   record_audio_description.audio_volume_db_256 = DEFAULT_VOLUME_DB_256;
+#ifdef USE_AUDIO_PARAMS_STORE
+  /* settings of the last run, the nodes below start from them */
+#if (defined USE_USB_AUDIO_CLASS_20) && (defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES)
+  AUDIO_ParamsRestore(AUDIO_PARAMS_RECORD, &record_audio_description, &rec_session->session,
+                      USB_AUDIO_CONFIG_RECORD_FREQENCIES, USB_AUDIO_CONFIG_RECORD_FREQ_COUNT);
+#else /* USE_USB_AUDIO_CLASS_20 && USE_AUDIO_USB_RECORD_MULTI_FREQUENCES */
+  AUDIO_ParamsRestore(AUDIO_PARAMS_RECORD, &record_audio_description, &rec_session->session,
+                      &record_audio_description.frequence, 1);
+#endif /* USE_USB_AUDIO_CLASS_20 && USE_AUDIO_USB_RECORD_MULTI_FREQUENCES */
+#endif /* USE_AUDIO_PARAMS_STORE */
   *control_count = 0;
   
   /* create list of node */
@@ -211,6 +349,19 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
                                   &record_audio_description,
                                   &rec_session->session,
                                   (uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+  AUDIO_PumpSetHandler(AUDIO_PUMP_MIC_STAGE, AUDIO_Recording_StageHandler);
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  rec_session->start_state = AUDIO_USB_START_IDLE;
+#ifdef USE_AUDIO_RECORDING_USERS
+  rec_users_request = 0;
+#else /* USE_AUDIO_RECORDING_USERS */
+  rec_started_alternate = 0;
+#endif /* USE_AUDIO_RECORDING_USERS */
+  rec_start_session = rec_session;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_RECORD_START, AUDIO_Recording_StartHandler);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
   
    /* create Feature UNIT */
   controller_defaults.audio_description = &record_audio_description;
@@ -223,8 +374,26 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
                               USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID,
                               (uint32_t)&recording_feature_control);
  (*control_count)++;
-  mic_input.node.next = (AUDIO_NodeTypeDef*)&recording_feature_control;
-  recording_feature_control.node.next = (AUDIO_NodeTypeDef*)&usb_rec_output;
+  AUDIO_USB_LinkTopology(record_entities, (uint8_t)(sizeof(record_entities) / sizeof(record_entities[0])));
+#ifdef USE_AUDIO_LEVEL_METER
+  /* meters the packets the host receives */
+  AUDIO_MeterInit(&record_audio_description, &rec_session->session, AUDIO_METER_RECORD, (uint32_t)&rec_meter);
+  usb_rec_output.node.next = (AUDIO_NodeTypeDef*)&rec_meter;
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_AEC
+  /* not in the chain : the mic cancels the echo of each half before it is published */
+  if(AUDIO_AecInit(&record_audio_description, &rec_session->session, (uint32_t)&rec_aec) != 0)
+  {
+    return -1;
+  }
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+  /* not in the chain either, the mic levels each half after the echo is removed */
+  if(AUDIO_AgcInit(&record_audio_description, &rec_session->session, (uint32_t)&rec_agc) != 0)
+  {
+    return -1;
+  }
+#endif /* USE_AUDIO_MIC_AGC */
 #ifndef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
 #ifdef USE_USB_AUDIO_CLASS_20
   /* clock node init */
@@ -238,6 +407,7 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
   clk_src_cmds.clock_freq_list = &record_audio_description.frequence;
   clk_src_cmds.SetFrequency = 0;
 #endif /*  USE_AUDIO_USB_RECORD_MULTI_FREQUENCES */
+  clk_src_cmds.IsValid = 0;
 
   USB_AUDIO_Streaming_CLK_SRC_Init(&(controls_desc[*control_count]), &clk_src_cmds,
                                    USB_AUDIO_CONFIG_RECORD_CLOCK_SOURCE_ID,&record_audio_description,
@@ -247,14 +417,11 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
 #endif /* USE_USB_AUDIO_CLASS_20 */
   
     /* prepare buffer */
-  rec_session->buffer.data = malloc(USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE);
-  if(!rec_session->buffer.data)
-  {
-    Error_Handler();
-  }
-  /* @TODO optimize the margin value */
-  AUDIO_USB_InitializesDataBuffer(&rec_session->buffer, USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE,
-                                   AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description) , AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description));
+  rec_session->buffer.data = rec_buffer_data;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  rec_session->buffer.packets = &rec_packets;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  AUDIO_Recording_InitBuffer(rec_session);
   /* set USB AUDIO class callbacks */
   as_desc->interface_num = rec_session->interface_num;
   as_desc->alternate = 0;
@@ -266,9 +433,22 @@ static  AUDIO_SynchroParams syncp; /* synchro parameters*/
   as_desc->SetAS_Alternate = AUDIO_Recording_SetAS_Alternate;
   as_desc->GetState = AUDIO_Recording_GetState;
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
-  as_desc->SofReceived = AUDIO_Recording_Sof_Received;
-#else /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
-  as_desc->SofReceived =  0;
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+  {
+    /* the mic frames are counted once for both sessions of the shared clock */
+    AUDIO_ClockDomainSubscriberTypeDef clock_subscriber;
+
+    clock_subscriber.StartCount = AUDIO_Recording_ClockStart;
+    clock_subscriber.GetCount = AUDIO_Recording_ClockCount;
+    clock_subscriber.Frame = AUDIO_Recording_ClockFrame;
+    clock_subscriber.audio_description = &record_audio_description;
+    clock_subscriber.period = 1;
+    clock_subscriber.private_data = session_handle;
+    AUDIO_ClockDomainSubscribe(&clock_subscriber);
+  }
+#else /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+  AUDIO_SofTickSubscribe(AUDIO_Recording_Sof_Received, 1, session_handle);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
   rec_session->session.state = AUDIO_SESSION_INITIALIZED;
   return 0;
@@ -287,16 +467,24 @@ static  int8_t  AUDIO_Recording_SessionStart( AUDIO_USB_SessionTypedef* rec_sess
        ||(rec_session->session.state == AUDIO_SESSION_STOPPED))
   {
     AUDIO_DevicesCommandsTypedef commands;
+#ifdef USE_AUDIO_IDLE_POWER
+    /* full clock before the nodes and the SAI start */
+    AUDIO_PowerSetStreaming(rec_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
     /* start feature control node */
     commands.private_data = (uint32_t)&mic_input;
     commands.SetCurrentVolume = mic_input.MicSetVolume;
     commands.SetMute = mic_input.MicMute;
-    rec_session->buffer.rd_ptr = rec_session->buffer.wr_ptr = 0;
+    AUDIO_BufferReset(&rec_session->buffer);
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
     syncp.status = 0;
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
 
     /* start the mic */
+#ifdef USE_AUDIO_SYNC_START
+    /* or hold it, the host reads silence until it starts with the speaker */
+    if(AUDIO_SyncStartHold(AUDIO_SYNC_START_RECORD, AUDIO_Recording_SyncStart, (uint32_t)rec_session) != 0)
+#endif /* USE_AUDIO_SYNC_START */
     mic_input.MicStart(&rec_session->buffer, (uint32_t)&mic_input);
     /* start the feature */
     recording_feature_control.CFStart(&commands, (uint32_t)&recording_feature_control);
@@ -305,8 +493,26 @@ static  int8_t  AUDIO_Recording_SessionStart( AUDIO_USB_SessionTypedef* rec_sess
     recording_clk_source.CSStart((uint32_t)&recording_clk_source);
 #endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC*/
 #endif /* USE_USB_AUDIO_CLASS_20 */
-    /* start output node */
-    usb_rec_output.IOStart(&rec_session->buffer, 0, (uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_RECORDING_USERS
+    if(rec_users & AUDIO_RECORDING_USER_HOST)
+#endif /* USE_AUDIO_RECORDING_USERS */
+    {
+      /* start output node */
+      usb_rec_output.IOStart(&rec_session->buffer, rec_start_threshold, (uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_LEVEL_METER
+      rec_meter.MeterStart((uint32_t)&rec_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+    }
+#ifdef USE_AUDIO_AEC
+    rec_aec.AecStart((uint32_t)&rec_aec);
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+    rec_agc.AgcStart((uint32_t)&rec_agc);
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_SIDETONE
+    /* the playback sidetone reads the newest mic frames */
+    AUDIO_SidetoneSetSource(&rec_session->buffer, &record_audio_description);
+#endif /* USE_AUDIO_SIDETONE */
     rec_session->session.state = AUDIO_SESSION_STARTED; 
   }
   return 0;
@@ -323,15 +529,63 @@ static int8_t  AUDIO_Recording_SessionStop(AUDIO_USB_SessionTypedef *rec_session
   
   if( rec_session->session.state == AUDIO_SESSION_STARTED)
   {
-    usb_rec_output.IOStop((uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+    rec_parked = AUDIO_RECORDING_SUSPEND_NONE;
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+#ifdef USE_AUDIO_SYNC_START
+    AUDIO_SyncStartRelease(AUDIO_SYNC_START_RECORD);
+#endif /* USE_AUDIO_SYNC_START */
+#ifdef USE_AUDIO_SIDETONE
+    AUDIO_SidetoneSetSource(0, 0);
+#endif /* USE_AUDIO_SIDETONE */
+#ifdef USE_AUDIO_RECORDING_USERS
+    if(usb_rec_output.node.state == AUDIO_NODE_STARTED)
+#endif /* USE_AUDIO_RECORDING_USERS */
+    {
+      usb_rec_output.IOStop((uint32_t)&usb_rec_output);
+    }
     recording_feature_control.CFStop((uint32_t)&recording_feature_control);
     mic_input.MicStop((uint32_t)&mic_input);
+#ifdef USE_AUDIO_LEVEL_METER
+    rec_meter.MeterStop((uint32_t)&rec_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_AEC
+    rec_aec.AecStop((uint32_t)&rec_aec);
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+    rec_agc.AgcStop((uint32_t)&rec_agc);
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(rec_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
     rec_session->session.state = AUDIO_SESSION_STOPPED;
   }
 
   return 0;
 }
 
+#ifdef USE_AUDIO_SYNC_START
+/**
+  * @brief  AUDIO_Recording_SyncStart
+  *         held mic start, from the SOF interrupt. The ring is empty until
+  *         then, so the first mic frame is the first one sent after the
+  *         silence
+  * @param  start: 1 to start the mic
+  * @param  session_handle: session
+  * @retval 0, the record position is known once the first mic frame is sent
+  */
+static uint32_t AUDIO_Recording_SyncStart(uint8_t start, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef* rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(start != 0U)
+  {
+    mic_input.MicStart(&rec_session->buffer, (uint32_t)&mic_input);
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_SYNC_START */
+
 /**
   * @brief  AUDIO_Recording_SessionDeInit
   *         De-Initialize the recording session
@@ -346,6 +600,13 @@ static int8_t  AUDIO_Recording_SessionDeInit(uint32_t session_handle)
   
   if( rec_session->session.state != AUDIO_SESSION_OFF)
   {
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+    /* a start still posted is dropped, the handler skips an OFF session */
+    rec_session->start_state = AUDIO_USB_START_IDLE;
+#ifndef USE_AUDIO_RECORDING_USERS
+    rec_started_alternate = 0;
+#endif /* USE_AUDIO_RECORDING_USERS */
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
     if( rec_session->session.state == AUDIO_SESSION_STARTED)
     {
       AUDIO_Recording_SessionStop( rec_session);
@@ -358,11 +619,22 @@ static int8_t  AUDIO_Recording_SessionDeInit(uint32_t session_handle)
 #endif /* USE_USB_AUDIO_CLASS_20 */
     usb_rec_output.IODeInit((uint32_t)&usb_rec_output);
     recording_feature_control.CFDeInit((uint32_t)&recording_feature_control);
-    
-    if( rec_session->buffer.data)
-    {
-      free( rec_session->buffer.data);
-    }
+#ifdef USE_AUDIO_LEVEL_METER
+    rec_meter.MeterDeInit((uint32_t)&rec_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+#ifdef USE_AUDIO_AEC
+    rec_aec.AecDeInit((uint32_t)&rec_aec);
+#endif /* USE_AUDIO_AEC */
+#ifdef USE_AUDIO_MIC_AGC
+    rec_agc.AgcDeInit((uint32_t)&rec_agc);
+#endif /* USE_AUDIO_MIC_AGC */
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+    AUDIO_ClockDomainUnsubscribe(session_handle);
+#else /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+    AUDIO_SofTickUnsubscribe(AUDIO_Recording_Sof_Received, session_handle);
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
     rec_session->session.state = AUDIO_SESSION_OFF;
   }
 
@@ -376,8 +648,6 @@ static int8_t  AUDIO_Recording_SessionDeInit(uint32_t session_handle)
   * @param  session_handle: session
   * @retval  : 0 if no error
   */
-static int underrun_count = 0;
-static int overrun_count = 0;
 static int8_t  AUDIO_Recording_SessionCallback(AUDIO_SessionEventTypeDef  event, 
                                                AUDIO_NodeTypeDef* node, 
                                                struct    AUDIO_Session* session_handle)
@@ -392,57 +662,98 @@ static int8_t  AUDIO_Recording_SessionCallback(AUDIO_SessionEventTypeDef  event,
     {
       /* recompute the buffer size */
       mic_input.MicChangeFrequence((uint32_t)&mic_input);
+      AUDIO_Recording_InitBuffer(rec_session);
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
        AUDIO_Recording_synchro_init(&rec_session->buffer, usb_rec_output.packet_length);
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
-AUDIO_USB_InitializesDataBuffer(&rec_session->buffer, USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE,
-                                AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description) ,
-                                AUDIO_MS_MAX_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description));
        break;
     }
     case AUDIO_UNDERRUN :
     case AUDIO_OVERRUN :
     {
-      if(event == AUDIO_OVERRUN)
-      {
-        overrun_count++;
-      }
-      else
-      {
-        underrun_count++;
-      }
-          rec_session->buffer.rd_ptr = rec_session->buffer.wr_ptr = 0;
+      AUDIO_BufferTelemetryGlitch(&rec_session->buffer, (event == AUDIO_OVERRUN), HAL_GetTick());
+          AUDIO_BufferReset(&rec_session->buffer);
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
       AUDIO_Recording_synchro_init(&rec_session->buffer, usb_rec_output.packet_length);
       usb_rec_output.IORestart((uint32_t)&usb_rec_output);
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
     }
     break;
-#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+#if (defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO) || (defined USE_AUDIO_RECORDING_USERS)
   case AUDIO_PACKET_RECEIVED :
+#ifdef USE_AUDIO_RECORDING_USERS
+    if((rec_users & AUDIO_RECORDING_USER_HOST) == 0U)
+    {
+      /* the mic runs for the other users only, nobody reads the ring */
+      AUDIO_BufferCommitRead(&rec_session->buffer, AUDIO_BUFFER_FILLED_SIZE(&rec_session->buffer));
+      break;
+    }
+#endif /* USE_AUDIO_RECORDING_USERS */
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
     if(++syncp.last_write_interval == 4)
     {
         /* empty the buffer */
-        rec_session->buffer.rd_ptr = rec_session->buffer.wr_ptr = 0;
+        AUDIO_BufferReset(&rec_session->buffer);
         syncp.status = 0;
         usb_rec_output.IORestart((uint32_t)&usb_rec_output);
         syncp.last_write_interval = 0;
     }
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
     break;
-  case AUDIO_PACKET_PLAYED:
-    syncp.last_write_interval = 0;
-    break;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO || USE_AUDIO_RECORDING_USERS */
+#if (defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO) || (defined USE_AUDIO_SYNC_START)
   case AUDIO_BEGIN_OF_STREAM:
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
     AUDIO_Recording_synchro_init(&rec_session->buffer, usb_rec_output.packet_length);
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#ifdef USE_AUDIO_SYNC_START
+    /* the first mic frame follows the silence sent since the alternate */
+    AUDIO_SyncStartSetPosition(AUDIO_SYNC_START_RECORD, usb_rec_output.specific.output.lead_bytes /
+                               AUDIO_SAMPLE_LENGTH(usb_rec_output.node.audio_description));
+#endif /* USE_AUDIO_SYNC_START */
 
     break;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO || USE_AUDIO_SYNC_START */
+  case AUDIO_PACKET_PLAYED:
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+    syncp.last_write_interval = 0;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+    if(rec_parked == AUDIO_RECORDING_SUSPEND_RESUMING)
+    {
+      /* the host reads again : the mic restarts behind the fill kept over the
+         suspend, the synchro goes on from its estimate */
+      rec_parked = AUDIO_RECORDING_SUSPEND_NONE;
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+      syncp.status &= ~AUDIO_SYNCHRO_FIRST_VALUE_READ;
+      syncp.sof_counter = 0;
+      syncp.read_data_by_second = 0;
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+      mic_input.MicStart(&rec_session->buffer, (uint32_t)&mic_input);
+    }
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
+    /* room for a new packet, let the mic fill the buffer outside the USB ISR */
+    AUDIO_PumpPost(AUDIO_PUMP_MIC_SPACE);
+    break;
   default : 
     break;
   }
   return 0;
 }
 
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+/**
+  * @brief  AUDIO_Recording_StageHandler
+  *         pump work : prepares the next IN packet while the last one is sent
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_Recording_StageHandler(void)
+{
+  USB_AUDIO_Streaming_Output_Stage((uint32_t)&usb_rec_output);
+}
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+
 /**
   * @brief  AUDIO_Recording_SetAS_Alternate
   *        SA interface set alternate callback
@@ -455,11 +766,56 @@ static int8_t  AUDIO_Recording_SetAS_Alternate( uint8_t alternate, uint32_t sess
   AUDIO_USB_SessionTypedef *rec_session;
   
   rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  if(alternate  ==  0)
+  {
+    if(rec_session->alternate != 0)
+    {
+      /* stopping is short, it stays here when the pump isn't busy with the session */
+      rec_session->alternate = 0;
+#ifdef USE_AUDIO_RECORDING_USERS
+      AUDIO_Recording_RequestUsers(rec_session, rec_users_request & ~AUDIO_RECORDING_USER_HOST);
+#else /* USE_AUDIO_RECORDING_USERS */
+      if(rec_session->start_state == AUDIO_USB_START_IDLE)
+      {
+        AUDIO_Recording_SessionStop(rec_session);
+        rec_started_alternate = 0;
+      }
+#endif /* USE_AUDIO_RECORDING_USERS */
+      usb_rec_output.flags &= ~AUDIO_IO_START_PENDING;
+    }
+  }
+  else
+  {
+    if(rec_session->alternate  ==  0)
+    {
+      rec_session->alternate = alternate;
+#ifdef USE_AUDIO_RECORDING_USERS
+      AUDIO_Recording_RequestUsers(rec_session, rec_users_request | AUDIO_RECORDING_USER_HOST);
+#else /* USE_AUDIO_RECORDING_USERS */
+      if(rec_session->start_state == AUDIO_USB_START_IDLE)
+      {
+        rec_session->start_state = AUDIO_USB_START_PENDING;
+        AUDIO_PumpPost(AUDIO_PUMP_RECORD_START);
+      }
+#endif /* USE_AUDIO_RECORDING_USERS */
+      if(usb_rec_output.node.state != AUDIO_NODE_STARTED)
+      {
+        /* the host reads silence until the output node starts */
+        usb_rec_output.flags |= AUDIO_IO_START_PENDING;
+      }
+    }
+  }
+#else /* USE_AUDIO_DEFERRED_ALTERNATE */
   if(alternate  ==  0)
   {
     if(rec_session->alternate != 0)
     {
+#ifdef USE_AUDIO_RECORDING_USERS
+      AUDIO_Recording_SetUsers(rec_session, rec_users & ~AUDIO_RECORDING_USER_HOST);
+#else /* USE_AUDIO_RECORDING_USERS */
       AUDIO_Recording_SessionStop(rec_session);
+#endif /* USE_AUDIO_RECORDING_USERS */
       rec_session->alternate = 0;
     }
   }
@@ -469,12 +825,231 @@ static int8_t  AUDIO_Recording_SetAS_Alternate( uint8_t alternate, uint32_t sess
     {
       /* @ADD how to define thershold */
       
+#ifdef USE_AUDIO_RECORDING_USERS
+      AUDIO_Recording_SetUsers(rec_session, rec_users | AUDIO_RECORDING_USER_HOST);
+#else /* USE_AUDIO_RECORDING_USERS */
       AUDIO_Recording_SessionStart(rec_session);
+#endif /* USE_AUDIO_RECORDING_USERS */
       rec_session->alternate = alternate;
     }
   }
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+  return 0;
+}
+
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+/**
+  * @brief  AUDIO_Recording_StartHandler
+  *         pump work : brings the session to what the interfaces selected. An
+  *         interface may change while the session starts, the handler then
+  *         applies the change before it returns
+  * @param  None
+  * @retval None
+  */
+static void  AUDIO_Recording_StartHandler(void)
+{
+  AUDIO_USB_SessionTypedef* rec_session = rec_start_session;
+  uint32_t primask;
+  uint8_t  target;
+  uint8_t  done;
+
+  if(rec_session == 0)
+  {
+    return;
+  }
+  for(;;)
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+#ifdef USE_AUDIO_RECORDING_USERS
+    target = rec_users_request;
+    done = (target == rec_users);
+#else /* USE_AUDIO_RECORDING_USERS */
+    target = rec_session->alternate;
+    done = ((target != 0U) == (rec_started_alternate != 0U));
+#endif /* USE_AUDIO_RECORDING_USERS */
+    if((rec_session->start_state == AUDIO_USB_START_IDLE) ||
+       (rec_session->session.state == AUDIO_SESSION_OFF) || done)
+    {
+      rec_session->start_state = AUDIO_USB_START_IDLE;
+      __set_PRIMASK(primask);
+      return;
+    }
+    rec_session->start_state = AUDIO_USB_START_RUNNING;
+    __set_PRIMASK(primask);
+
+#ifdef USE_AUDIO_RECORDING_USERS
+    AUDIO_Recording_SetUsers(rec_session, target);
+#else /* USE_AUDIO_RECORDING_USERS */
+    if(rec_started_alternate != 0U)
+    {
+      AUDIO_Recording_SessionStop(rec_session);
+      rec_started_alternate = 0;
+    }
+    else
+    {
+      AUDIO_Recording_SessionStart(rec_session);
+      rec_started_alternate = target;
+    }
+#endif /* USE_AUDIO_RECORDING_USERS */
+  }
+}
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+
+#ifdef USE_AUDIO_RECORDING_USERS
+/**
+  * @brief  AUDIO_Recording_SetUser
+  *         a reader other than the record interface starts or stops reading
+  *         the mic, from the USB interrupt
+  * @param  user: AUDIO_RECORDING_USER_VOICE or AUDIO_RECORDING_USER_BULK
+  * @param  active: 1 when the user streams
+  * @param  session_handle: recording session
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_Recording_SetUser(uint8_t user, uint8_t active, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *rec_session;
+
+  rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+  if(active)
+  {
+    return AUDIO_Recording_RequestUsers(rec_session, rec_users_request | user);
+  }
+  return AUDIO_Recording_RequestUsers(rec_session, rec_users_request & ~user);
+#else /* USE_AUDIO_DEFERRED_ALTERNATE */
+  if(active)
+  {
+    return AUDIO_Recording_SetUsers(rec_session, rec_users | user);
+  }
+  return AUDIO_Recording_SetUsers(rec_session, rec_users & ~user);
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+}
+
+#ifdef USE_AUDIO_DEFERRED_ALTERNATE
+/**
+  * @brief  AUDIO_Recording_RequestUsers
+  *         records the interfaces reading the mic, from the USB interrupt. The
+  *         session start goes to the pump, the other changes are short and
+  *         applied here unless the pump is busy with the session
+  * @param  rec_session: recording session
+  * @param  users: AUDIO_RECORDING_USER_xxx bits
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Recording_RequestUsers(AUDIO_USB_SessionTypedef* rec_session, uint8_t users)
+{
+  rec_users_request = users;
+  if(rec_session->start_state != AUDIO_USB_START_IDLE)
+  {
+    return 0;
+  }
+  if((rec_users == 0U) && (users != 0U))
+  {
+    rec_session->start_state = AUDIO_USB_START_PENDING;
+    AUDIO_PumpPost(AUDIO_PUMP_RECORD_START);
+    return 0;
+  }
+  return AUDIO_Recording_SetUsers(rec_session, users);
+}
+#endif /* USE_AUDIO_DEFERRED_ALTERNATE */
+
+/**
+  * @brief  AUDIO_Recording_SetUsers
+  *         sets the interfaces reading the mic. The mic starts with the first
+  *         one and stops with the last one, the record output node follows
+  *         the host interface alone so the other streams have no gap
+  * @param  rec_session: recording session
+  * @param  users: AUDIO_RECORDING_USER_xxx bits
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Recording_SetUsers(AUDIO_USB_SessionTypedef* rec_session, uint8_t users)
+{
+  uint8_t previous = rec_users;
+
+  rec_users = users;
+  if((previous == 0U) && (users != 0U))
+  {
+    AUDIO_Recording_SessionStart(rec_session);
+  }
+  else if((previous != 0U) && (users == 0U))
+  {
+    AUDIO_Recording_SessionStop(rec_session);
+  }
+  else if((rec_session->session.state == AUDIO_SESSION_STARTED) &&
+          ((previous ^ users) & AUDIO_RECORDING_USER_HOST))
+  {
+    if(users & AUDIO_RECORDING_USER_HOST)
+    {
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+      syncp.status = 0;
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+      /* the ring restarts empty, the mic keeps running */
+      usb_rec_output.IOStart(&rec_session->buffer, rec_start_threshold, (uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_LEVEL_METER
+      rec_meter.MeterStart((uint32_t)&rec_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+    }
+    else
+    {
+      usb_rec_output.IOStop((uint32_t)&usb_rec_output);
+#ifdef USE_AUDIO_LEVEL_METER
+      rec_meter.MeterStop((uint32_t)&rec_meter);
+#endif /* USE_AUDIO_LEVEL_METER */
+    }
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_RECORDING_USERS */
+
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+/**
+  * @brief  AUDIO_Recording_SessionSuspend
+  *         bus suspend and resume, called from the USB interrupt. The mic
+  *         stops before it overruns, the ring, the processing nodes and the
+  *         synchro keep their state
+  * @param  suspend: 1 on suspend, 0 on resume
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Recording_SessionSuspend(uint8_t suspend, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *rec_session;
+
+  rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  if(suspend)
+  {
+    if((rec_session->session.state == AUDIO_SESSION_STARTED) &&
+       (mic_input.node.state == AUDIO_NODE_STARTED) && (rec_parked == AUDIO_RECORDING_SUSPEND_NONE))
+    {
+      mic_input.MicStop((uint32_t)&mic_input);
+      rec_parked = AUDIO_RECORDING_SUSPEND_PARKED;
+#ifdef USE_AUDIO_IDLE_POWER
+      /* let the main loop enter STOP mode */
+      AUDIO_PowerSetStreaming(rec_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
+    }
+  }
+  else
+  {
+    if(rec_parked == AUDIO_RECORDING_SUSPEND_PARKED)
+    {
+#ifdef USE_AUDIO_IDLE_POWER
+      AUDIO_PowerSetStreaming(rec_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
+      rec_parked = AUDIO_RECORDING_SUSPEND_RESUMING;
+#ifdef USE_AUDIO_RECORDING_USERS
+      if((rec_users & AUDIO_RECORDING_USER_HOST) == 0U)
+      {
+        /* no record packet will be sent, the other users read at once */
+        rec_parked = AUDIO_RECORDING_SUSPEND_NONE;
+        mic_input.MicStart(&rec_session->buffer, (uint32_t)&mic_input);
+      }
+#endif /* USE_AUDIO_RECORDING_USERS */
+    }
+  }
   return 0;
 }
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 
 /**
   * @brief  AUDIO_Recording_GetState          
@@ -486,7 +1061,108 @@ static int8_t  AUDIO_Recording_GetState(uint32_t session_handle)
 {
   return 0;
 }
+
+/**
+  * @brief  AUDIO_Recording_InitBuffer
+  *         sizes the ring and the start threshold for the current format : ring
+  *         of USBD_AUDIO_CONFIG_RECORD_RING_MS rounded up to a power of two,
+  *         sending starts after USBD_AUDIO_CONFIG_RECORD_START_MS, with at
+  *         least two packets and at most half of the ring. The margin holds
+  *         the largest ms and the largest USB packet, as a mirror of the ring start
+  * @param  rec_session: session, buffer data must be set
+  * @retval None
+  */
+static void AUDIO_Recording_InitBuffer(AUDIO_USB_SessionTypedef* rec_session)
+{
+  uint32_t packet_size = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description);
+  uint32_t ms_max = AUDIO_MS_MAX_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description);
+  uint32_t margin = AUDIO_USB_MAX_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description);
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&record_audio_description);
+  uint32_t ring = 1;
+  uint32_t threshold;
+
+  /* the clock adjustment sends a frame more than the max packet */
+  margin += frame_size;
+  if(margin < ms_max)
+  {
+    margin = ms_max;
+  }
+  while(ring < (ms_max * USBD_AUDIO_CONFIG_RECORD_RING_MS))
+  {
+    ring <<= 1;
+  }
+  if((ring + margin) > USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE)
+  {
+    /* rounded down to the power of two which fits */
+    ring = USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE - margin;
+  }
+  AUDIO_USB_InitializesDataBuffer(&rec_session->buffer, ring + margin, packet_size, margin);
+  /* mic nodes copy the ring start to the margin, the USB packet is always contiguous */
+  rec_session->buffer.buffer_flags |= AUDIO_BUFFER_MIRRORED;
+  threshold = packet_size * USBD_AUDIO_CONFIG_RECORD_START_MS;
+  if(threshold < 2U * margin)
+  {
+    threshold = 2U * margin;
+  }
+  if(threshold > (rec_session->buffer.size >> 1))
+  {
+    threshold = rec_session->buffer.size >> 1;
+  }
+  rec_start_threshold = (threshold / frame_size) * frame_size;
+}
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+#ifdef USE_AUDIO_SHARED_CLOCK_DOMAIN
+/**
+  * @brief  AUDIO_Recording_ClockStart
+  *         starts the count of the mic frames for the clock domain
+  * @param  session_handle: session handle
+  * @retval 0 if the mic runs
+  */
+static int8_t  AUDIO_Recording_ClockStart(uint32_t session_handle)
+{
+  return mic_input.MicStartReadCount((uint32_t)&mic_input);
+}
+
+/**
+  * @brief  AUDIO_Recording_ClockCount
+  *         samples captured by the mic since the last call
+  * @param  session_handle: session handle
+  * @retval samples of all channels , 0 if the mic is stopped
+  */
+static uint32_t  AUDIO_Recording_ClockCount(uint32_t session_handle)
+{
+  return mic_input.MicGetReadCount((uint32_t)&mic_input) / record_audio_description.audio_res;
+}
+
+/**
+  * @brief  AUDIO_Recording_ClockFrame
+  *         frames of the shared clock counted at this SOF, the estimated mic
+  *         frequency is the rate of the domain, the one the feedback uses
+  * @param  frames: frames counted since the last call
+  * @param  session_handle: session handle
+  * @retval None
+  */
+static void  AUDIO_Recording_ClockFrame(uint32_t frames, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *rec_session;
+  uint32_t rate;
+
+  rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  if(( rec_session->session.state == AUDIO_SESSION_STARTED)&&(  syncp.status & AUDIO_SYNC_STARTED))
+  {
+    rate = AUDIO_ClockDomainGetRate();
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+    syncp.mic_rate = rate;
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+    if(rate)
+    {
+      syncp.mic_estimated_freq = (rate + (1U << (AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS - 1U)))
+                                  >> AUDIO_CLOCK_DOMAIN_RATE_FRAC_BITS;
+    }
+    AUDIO_Recording_FrameUpdate(rec_session, frames * (uint32_t)syncp.sample_size);
+  }
+}
+#else /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
 /**
   * @brief  AUDIO_Recording_Sof_Received
   *         Updates the estimated  microphone frequency by computing read samples each second
@@ -497,9 +1173,16 @@ static int8_t  AUDIO_Recording_GetState(uint32_t session_handle)
  static void  AUDIO_Recording_Sof_Received(uint32_t session_handle )
  {
     AUDIO_USB_SessionTypedef *rec_session;
-    uint16_t read_bytes, wr_distance;
+    uint32_t read_bytes;
     
   rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  if(rec_parked != AUDIO_RECORDING_SUSPEND_NONE)
+  {
+    /* mic stopped , the frame count restarts with it */
+    return;
+  }
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
   if(( rec_session->session.state == AUDIO_SESSION_STARTED)&&(  syncp.status & AUDIO_SYNC_STARTED))
   {
    if(syncp.status&AUDIO_SYNCHRO_FIRST_VALUE_READ)
@@ -513,33 +1196,16 @@ static int8_t  AUDIO_Recording_GetState(uint32_t session_handle)
         syncp.sof_counter = 0;
         syncp.read_data_by_second = 0;
       }
-      
-      syncp.mic_usb_diff += read_bytes;
-      if(syncp.mic_estimated_freq)
-      {
-        wr_distance = AUDIO_BUFFER_FILLED_SIZE(&rec_session->buffer);
-        AUDIO_Recording_synchro_update(wr_distance);
-      }
-      else
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+      /* every frame when latched against SOF, the count by second is only a fallback */
+      syncp.mic_rate = AUDIO_SofTimestampGetRate(record_audio_description.frequence);
+      if(syncp.mic_rate)
       {
-        if(syncp.mic_usb_diff >= syncp.packet_size*4)
-        {
-          syncp.samples = syncp.sample_size;
-        }
-        else
-        {
-          if(syncp.mic_usb_diff + 4*syncp.packet_size <= 0)
-          {
-            syncp.samples = -syncp.sample_size;
-          }
-          else
-          if((syncp.mic_usb_diff <= syncp.packet_size)&&
-             (syncp.mic_usb_diff + syncp.packet_size >= 0))
-          {
-            syncp.samples = 0;
-          }
-        }
+        syncp.mic_estimated_freq = (syncp.mic_rate + (1U << (AUDIO_SOF_TS_RATE_FRAC_BITS - 1U)))
+                                    >> AUDIO_SOF_TS_RATE_FRAC_BITS;
       }
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+      AUDIO_Recording_FrameUpdate(rec_session, read_bytes);
    }
     else
     {
@@ -548,7 +1214,52 @@ static int8_t  AUDIO_Recording_GetState(uint32_t session_handle)
     }
   }
  }
+#endif /* USE_AUDIO_SHARED_CLOCK_DOMAIN */
+
+/**
+  * @brief  AUDIO_Recording_FrameUpdate
+  *         computes the difference between read sample from microphone count and
+  *         written sample to USB count, and the correction of the next packets
+  * @param  rec_session: recording session
+  * @param  read_bytes: bytes captured by the mic since the last SOF
+  * @retval None
+  */
+static void  AUDIO_Recording_FrameUpdate(AUDIO_USB_SessionTypedef* rec_session, uint32_t read_bytes)
+{
+  uint32_t wr_distance;
 
+  syncp.mic_usb_diff += read_bytes;
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  wr_distance = AUDIO_BUFFER_FILLED_SIZE(&rec_session->buffer);
+  AUDIO_Recording_resampler_update(wr_distance);
+#else /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  if(syncp.mic_estimated_freq)
+  {
+    wr_distance = AUDIO_BUFFER_FILLED_SIZE(&rec_session->buffer);
+    AUDIO_Recording_synchro_update(wr_distance);
+  }
+  else
+  {
+    if(syncp.mic_usb_diff >= syncp.packet_size*4)
+    {
+      syncp.samples = syncp.sample_size;
+    }
+    else
+    {
+      if(syncp.mic_usb_diff + 4*syncp.packet_size <= 0)
+      {
+        syncp.samples = -syncp.sample_size;
+      }
+      else
+      if((syncp.mic_usb_diff <= syncp.packet_size)&&
+         (syncp.mic_usb_diff + syncp.packet_size >= 0))
+      {
+        syncp.samples = 0;
+      }
+    }
+  }
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+}
 
 /**
   * @brief  AUDIO_Recording_synchro_init
@@ -561,14 +1272,15 @@ static void AUDIO_Recording_synchro_init(AUDIO_BufferTypeDef *buf, uint32_t pack
 {
   syncp.packet_size = packet_length;
   syncp.sample_size = AUDIO_SAMPLE_LENGTH(&record_audio_description);
-  syncp.buffer_fill_max_th = buf->size*3/4;
-  syncp.buffer_fill_min_th = buf->size/4;
-  syncp.buffer_fill_moy = buf->size>>1;
-#ifdef USE_USB_HS
+  /* the fill is kept at the start threshold */
+  syncp.buffer_fill_moy = rec_start_threshold;
+  syncp.buffer_fill_max_th = rec_start_threshold + ((buf->size - rec_start_threshold) >> 1);
+  syncp.buffer_fill_min_th = rec_start_threshold >> 1;
+#ifdef USE_USB_HS_ULPI_PHY
   syncp.sample_per_s_th = packet_length<<2;
 #else 
   syncp.sample_per_s_th = packet_length>>1;
-#endif /* USE_USB_HS */
+#endif /* USE_USB_HS_ULPI_PHY */
   syncp.current_frequency = record_audio_description.frequence;
   syncp.mic_estimated_freq = 0;
   syncp.last_write_interval = 0;
@@ -576,10 +1288,68 @@ static void AUDIO_Recording_synchro_init(AUDIO_BufferTypeDef *buf, uint32_t pack
   syncp.samples = 0;
   syncp.sof_counter = 0;
   syncp.read_data_by_second = 0;
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+  syncp.nominal_step = AUDIO_RESAMPLER_STEP_ONE;
+  syncp.resampler_step = AUDIO_RESAMPLER_STEP_ONE;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  syncp.mic_rate = 0;
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
   syncp.status|= AUDIO_SYNC_NEEDED;
   syncp.status = AUDIO_SYNC_STARTED;
 }
 
+#ifdef USE_AUDIO_RECORDING_USB_RESAMPLER
+/**
+  * @brief  AUDIO_Recording_resampler_update
+  *         computes the resampler step : ratio of estimated mic frequency to
+  *         USB frequency, plus a proportional correction which keeps the buffer
+  *         half filled
+  * @param  wr_distance: buffer filled size
+  * @retval None
+  */
+static void  AUDIO_Recording_resampler_update(int wr_distance)
+{
+  int32_t correction;
+
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+  if(syncp.mic_rate)
+  {
+    /* sub-sample estimation, renewed each frame */
+    syncp.current_frequency = syncp.mic_estimated_freq;
+    syncp.nominal_step = (uint32_t)(((uint64_t)syncp.mic_rate << (AUDIO_RESAMPLER_STEP_FRAC_BITS - AUDIO_SOF_TS_RATE_FRAC_BITS))
+                                    / record_audio_description.frequence);
+  }
+  else
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+  if((syncp.mic_estimated_freq) && (syncp.mic_estimated_freq != syncp.current_frequency))
+  {
+    /* new estimation, done once per second */
+    syncp.current_frequency = syncp.mic_estimated_freq;
+    syncp.nominal_step = (uint32_t)(((uint64_t)syncp.current_frequency << AUDIO_RESAMPLER_STEP_FRAC_BITS)
+                                    / record_audio_description.frequence);
+  }
+  /* buffer too filled : consume more mic frames for each USB frame */
+  correction = AUDIO_SyncResamplerCorrection(wr_distance, (int32_t)syncp.buffer_fill_moy, syncp.sample_size,
+                                             (int32_t)AUDIO_RESAMPLER_STEP_ONE);
+  syncp.resampler_step = (uint32_t)((int32_t)syncp.nominal_step + correction);
+}
+
+/**
+  * @brief  AUDIO_Recording_get_Resampler_Step
+  *         get resampler step for next packet
+  * @param  session_handle: session handle
+  * @retval input frames per output frame, 2.30 format
+  */
+uint32_t  AUDIO_Recording_get_Resampler_Step(struct  AUDIO_Session* session_handle)
+{
+   if(syncp.status&AUDIO_SYNC_STARTED)
+   {
+     return syncp.resampler_step;
+   }
+   return AUDIO_RESAMPLER_STEP_ONE;
+}
+#else /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 /**
   * @brief  AUDIO_Recording_synchro_update
   *         update synchronization parameters
@@ -593,7 +1363,7 @@ static void  AUDIO_Recording_synchro_update(int wr_distance)
    if((syncp.status&AUDIO_SYNCHRO_OVERRUN_UNDERR_SOON)== 0)
    {
      /* NO SOON OVERRUN OR UNDEURRUN DETECETED*/
-     if((wr_distance<syncp.buffer_fill_max_th) && (wr_distance>syncp.buffer_fill_min_th))
+     if((wr_distance<(int)syncp.buffer_fill_max_th) && (wr_distance>(int)syncp.buffer_fill_min_th))
      {
        /* In this block no risk of buffer overflow or underflow*/
        if((syncp.mic_usb_diff < syncp.sample_per_s_th)
@@ -645,14 +1415,14 @@ static void  AUDIO_Recording_synchro_update(int wr_distance)
      }
      else
      {
-       syncp.samples = (wr_distance>=syncp.buffer_fill_max_th)? syncp.sample_size:-syncp.sample_size;
+       syncp.samples = (wr_distance>=(int)syncp.buffer_fill_max_th)? syncp.sample_size:-syncp.sample_size;
        syncp.status|= AUDIO_SYNCHRO_OVERRUN_UNDERR_SOON;
      }
    }
    else
    {
-     if(((syncp.samples>0)&&(wr_distance>=syncp.buffer_fill_moy))||
-        ((syncp.samples<0)&&(wr_distance<=syncp.buffer_fill_moy)))
+     if(((syncp.samples>0)&&(wr_distance>=(int)syncp.buffer_fill_moy))||
+        ((syncp.samples<0)&&(wr_distance<=(int)syncp.buffer_fill_moy)))
      {
        update_synchro = 1;
        syncp.status &= ~AUDIO_SYNCHRO_OVERRUN_UNDERR_SOON;
@@ -693,6 +1463,7 @@ static void  AUDIO_Recording_synchro_update(int wr_distance)
      }
    }
 }
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
 
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
 
@@ -737,15 +1508,15 @@ int8_t  AUDIO_Recording_get_Sample_to_add(struct  AUDIO_Session* session_handle)
  int8_t  AUDIO_Recording_SessionSetFrequency(uint32_t freq, uint8_t* as_cnt_to_restart, uint8_t* as_list_to_restart,  uint32_t session_handle)
 {
   AUDIO_USB_SessionTypedef * rec_session = (AUDIO_USB_SessionTypedef *)session_handle;
+  AUDIO_DescriptionWriteBegin(&record_audio_description);
   record_audio_description.frequence = freq;
+  AUDIO_DescriptionWriteEnd(&record_audio_description);
   /* recompute the buffer size */
   mic_input.MicChangeFrequence((uint32_t)&mic_input);
+  AUDIO_Recording_InitBuffer(rec_session);
 #ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
   AUDIO_Recording_synchro_init(&rec_session->buffer, usb_rec_output.packet_length);
 #endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
-AUDIO_USB_InitializesDataBuffer(&rec_session->buffer, USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE,
-                                AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description) ,
-                                AUDIO_MS_MAX_PACKET_SIZE_FROM_AUD_DESC(&record_audio_description));
   usb_rec_output.IOChangeFrequency((uint32_t)&usb_rec_output);
   *as_cnt_to_restart = 1;
   as_list_to_restart[0] = rec_session->interface_num;
@@ -756,7 +1527,7 @@ AUDIO_USB_InitializesDataBuffer(&rec_session->buffer, USBD_AUDIO_CONFIG_RECORD_B
 #ifdef USE_AUDIO_USB_INTERRUPT
 /**
   * @brief  AUDIO_Recording_SessionExternalControl
-  *         Mute or Unmute 
+  *         Mute or Unmute , or change the volume by val (signed db 8.8)
   * @param  session_handle: session
   * @retval  : 0 if no error
   */
@@ -785,8 +1556,38 @@ static int8_t  AUDIO_Recording_SessionExternalControl( AUDIO_ControlCommandTyped
       interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
       }
        break;
+      case USBD_AUDIO_VOLUME:
+      {
+        /* val is a signed change in db 8.8, the result is held in the announced range */
+        int volume_db_256;
+        int max_db_256;
+        int min_db_256;
+
+        VOLUME_USB_TO_DB_256(max_db_256, recording_feature_control.usb_control_callbacks.MaxVolume);
+        VOLUME_USB_TO_DB_256(min_db_256, recording_feature_control.usb_control_callbacks.MinVolume);
+        volume_db_256 = record_audio_description.audio_volume_db_256 + (int32_t)val;
+        volume_db_256 = (volume_db_256 > max_db_256) ? max_db_256 : volume_db_256;
+        volume_db_256 = (volume_db_256 < min_db_256) ? min_db_256 : volume_db_256;
+        if(volume_db_256 == record_audio_description.audio_volume_db_256)
+        {
+          /* already at a bound, nothing to report */
+          return 0;
+        }
+        if(recording_feature_control.CFSetVolume(0, volume_db_256, (uint32_t) &recording_feature_control) != 0)
+        {
+          return -1;
+        }
+        interrupt.type  = USBD_AUDIO_INTERRUPT_INFO_FROM_INTERFACE;
+        interrupt.attr = USBD_AUDIO_INTERRUPT_ATTR_CUR;
+        interrupt.cs = USBD_AUDIO_FU_VOLUME_CONTROL;
+        interrupt.cn_mcn = 0;
+        interrupt.entity_id = USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID;
+        interrupt.ep_if_id = 0;/* Audio control interface 0*/
+        interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
+      }
+       break;
     default :
-      break;
+      return -1;
     }
     USBD_AUDIO_SendInterrupt  (&interrupt);
    }
@@ -797,5 +1598,87 @@ static int8_t  AUDIO_Recording_SessionExternalControl( AUDIO_ControlCommandTyped
   return 0;
 }
 #endif /*USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+/**
+  * @brief  AUDIO_Recording_GetStats
+  *         reports stream format, buffer level, resampler step and error counters
+  * @param  stats: filled with session state
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Recording_GetStats(AUDIO_USB_SessionStatsTypeDef* stats, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  stats->audio_description = record_audio_description;
+  stats->state = (uint8_t)rec_session->session.state;
+  stats->buffer_size = rec_session->buffer.size;
+  stats->buffer_filled = AUDIO_BUFFER_FILLED_SIZE(&rec_session->buffer);
+#if defined(USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO) && defined(USE_AUDIO_RECORDING_USB_RESAMPLER)
+  stats->feedback = syncp.resampler_step;
+#else /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  stats->feedback = 0;
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+  stats->underrun_count = rec_session->buffer.telemetry.underrun_count;
+  stats->overrun_count = rec_session->buffer.telemetry.overrun_count;
+  stats->fill = rec_session->buffer.telemetry;
+#ifdef USE_AUDIO_PACKET_QUEUE
+  stats->delay = rec_packets.delay;
+#endif /* USE_AUDIO_PACKET_QUEUE */
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Recording_SetParameter
+  *         sets a control from the device side, through the feature unit so
+  *         the host reads back the same value
+  * @param  param: parameter to set
+  * @param  channel: 0 for master, 1..n for a channel
+  * @param  value: new value
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Recording_SetParameter(AUDIO_USB_SessionParamTypedef param, uint16_t channel,
+                                            int32_t value, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *rec_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  int8_t ret;
+#ifdef USE_AUDIO_USB_INTERRUPT
+  USBD_AUDIO_InterruptTypeDef interrupt;
+#endif /*USE_AUDIO_USB_INTERRUPT*/
+
+  if((rec_session->session.state == AUDIO_SESSION_OFF)||(rec_session->session.state == AUDIO_SESSION_ERROR))
+  {
+    return -1;
+  }
+  switch(param)
+  {
+    case AUDIO_USB_PARAM_MUTE:
+      ret = recording_feature_control.CFSetMute(channel, (value != 0), (uint32_t)&recording_feature_control);
+      break;
+    case AUDIO_USB_PARAM_VOLUME:
+      ret = recording_feature_control.CFSetVolume(channel, (int)value, (uint32_t)&recording_feature_control);
+      break;
+    default :
+      ret = -1;
+      break;
+  }
+#ifdef USE_AUDIO_USB_INTERRUPT
+  if(ret == 0)
+  {
+    /* tell the host the control changed */
+    interrupt.type  = USBD_AUDIO_INTERRUPT_INFO_FROM_INTERFACE;
+    interrupt.attr = USBD_AUDIO_INTERRUPT_ATTR_CUR;
+    interrupt.cs = (param == AUDIO_USB_PARAM_MUTE) ? USBD_AUDIO_FU_MUTE_CONTROL : USBD_AUDIO_FU_VOLUME_CONTROL;
+    interrupt.cn_mcn = (uint8_t)channel;
+    interrupt.entity_id = USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID;
+    interrupt.ep_if_id = 0;/* Audio control interface 0*/
+    interrupt.priority = USBD_AUDIO_NORMAL_PRIORITY;
+    USBD_AUDIO_SendInterrupt  (&interrupt);
+  }
+#endif /*USE_AUDIO_USB_INTERRUPT*/
+  return ret;
+}
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 #endif /* USE_USB_AUDIO_RECORDING*/
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,399 @@
+/**
+  ******************************************************************************
+  * @file    audio_usb_voice_session.c
+  * @brief   usb audio voice session : a second record streaming interface at
+  *          16 kHz, 16 bits with the record channels. The mic of the record
+  *          session hands each captured half to AUDIO_VoiceWriteRegion, which
+  *          decimates it in its own ring, so the host gets both rates with
+  *          no resampling. The record feature unit controls both streams.
+  *          The mic clock paces the ring; the packets keep their nominal
+  *          length and take one frame more or less when the fill leaves its
+  *          band.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_audio.h"
+#include "usb_audio_user.h"
+#include "audio_sessions_usb.h"
+#include "audio_decimator.h"
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+
+#ifdef USE_AUDIO_RECORDING_VOICE
+
+/* Private defines -----------------------------------------------------------*/
+/* the mic writes a whole captured half, at most this long, after the ring end */
+#define AUDIO_VOICE_MARGIN_MS             4U
+#define AUDIO_VOICE_PACKET_BUFFER_SIZE    ((USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE + 3U) & ~3U)
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t    AUDIO_Voice_SessionStart(AUDIO_USB_SessionTypedef* voice_session);
+static int8_t    AUDIO_Voice_SessionStop(AUDIO_USB_SessionTypedef* voice_session);
+static int8_t    AUDIO_Voice_SessionDeInit(uint32_t session_handle);
+static int8_t    AUDIO_Voice_SetAS_Alternate(uint8_t alternate, uint32_t session_handle);
+static int8_t    AUDIO_Voice_GetState(uint32_t session_handle);
+static uint8_t*  AUDIO_Voice_GetBuffer(uint32_t session_handle, uint16_t* packet_length);
+static uint16_t  AUDIO_Voice_GetMaxPacketLength(uint32_t session_handle);
+static void      AUDIO_Voice_InitializesBuffer(AUDIO_USB_SessionTypedef* voice_session);
+
+/* Private variables ---------------------------------------------------------*/
+extern AUDIO_USB_SessionTypedef usb_record_session;
+/* list of used nodes */
+static AUDIO_USB_ClockSrc_NodeTypeDef voice_clk_source;
+static AUDIO_DescriptionTypeDef voice_audio_description;
+/* filtered in the mic interrupt */
+static AUDIO_DecimatorTypeDef voice_decimator USBD_DTCM_BSS;
+static uint32_t voice_decimator_rate;
+/* voice ring , filled by the mic and read by the IN endpoint */
+__ALIGN_BEGIN static uint8_t voice_buffer_data[USBD_AUDIO_CONFIG_VOICE_BUFFER_SIZE] __ALIGN_END;
+/* packets sent by the IN endpoint, one is sent while the next is prepared */
+__ALIGN_BEGIN static uint8_t voice_packets[2][AUDIO_VOICE_PACKET_BUFFER_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+static uint8_t voice_packet_index;
+static AUDIO_PacketSchedulerTypeDef voice_scheduler;
+static uint32_t voice_start_threshold;
+static uint8_t  voice_streaming;        /* the start threshold was reached */
+static AUDIO_USB_SessionTypedef* volatile voice_active = 0; /* started session, written by the mic */
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_Voice_SessionInit
+  *         Initializes the voice (streaming) session
+  * @param  as_desc:  audio streaming callbacks
+  * @param  controls_desc: list of control
+  * @param  control_count: list of control count
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+int8_t  AUDIO_Voice_SessionInit(USBD_AUDIO_AS_InterfaceTypeDef* as_desc,
+                                USBD_AUDIO_ControlTypeDef* controls_desc,
+                                uint8_t* control_count, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef *voice_session;
+  AUDIO_DevicesClockCommandsTypedef clk_src_cmds;
+
+  voice_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  memset(voice_session, 0, sizeof(AUDIO_USB_SessionTypedef));
+
+  voice_session->interface_num = USBD_AUDIO_CONFIG_VOICE_SA_INTERFACE;
+  voice_session->alternate = 0;
+  voice_session->SessionDeInit = AUDIO_Voice_SessionDeInit;
+  /* no node posts events, the ring is handled in the mic and USB interrupts */
+  voice_session->session.SessionCallback = 0;
+  voice_session->session.event_mask = 0;
+  voice_session->buffer.data = voice_buffer_data;
+  /*set audio used option*/
+  voice_audio_description.audio_res = USBD_AUDIO_CONFIG_VOICE_RES_BYTE;
+  voice_audio_description.audio_type = USBD_AUDIO_FORMAT_TYPE_PCM; /* PCM*/
+  voice_audio_description.channels_count = USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT;
+  voice_audio_description.channels_map = USBD_AUDIO_CONFIG_RECORD_CHANNEL_MAP;
+  voice_audio_description.frequence = USB_AUDIO_CONFIG_VOICE_FREQ;
+  voice_audio_description.audio_volume_db_256 = 0;
+  voice_audio_description.audio_mute = 0;
+  *control_count = 0;
+
+  /* fixed rate clock source of the voice terminal */
+  clk_src_cmds.private_data = session_handle;
+  clk_src_cmds.clock_freq_count = 1;
+  clk_src_cmds.clock_freq_list = &voice_audio_description.frequence;
+  clk_src_cmds.SetFrequency = 0;
+  clk_src_cmds.IsValid = 0;
+  USB_AUDIO_Streaming_CLK_SRC_Init(controls_desc, &clk_src_cmds, USB_AUDIO_CONFIG_VOICE_CLOCK_SOURCE_ID,
+                                   &voice_audio_description, (uint32_t)&voice_clk_source);
+  (*control_count)++;
+
+  /* set data end point callbacks, the session is the endpoint private data */
+  as_desc->data_ep.ep_num = USB_AUDIO_CONFIG_VOICE_EP_IN;
+  as_desc->data_ep.control_name_map = 0;
+  as_desc->data_ep.control_selector_map = 0;
+  as_desc->data_ep.private_data = session_handle;
+  as_desc->data_ep.DataReceived = 0;
+  as_desc->data_ep.DataMissed = 0;
+  as_desc->data_ep.GetBuffer = AUDIO_Voice_GetBuffer;
+  as_desc->data_ep.GetMaxPacketLength = AUDIO_Voice_GetMaxPacketLength;
+#ifdef USE_AUDIO_USB_IN_PIPELINE
+  /* the packet is copied in the IN complete interrupt, nothing to stage */
+  as_desc->data_ep.StageRequest = 0;
+  as_desc->data_ep.staged = 0;
+  as_desc->data_ep.staging = 0;
+  as_desc->data_ep.stage_miss_count = 0;
+#endif /* USE_AUDIO_USB_IN_PIPELINE */
+  AUDIO_PacketSchedulerInit(&voice_scheduler, &voice_audio_description, AUDIO_USB_PACKETS_PER_SECOND);
+
+  /* set USB AUDIO class callbacks */
+  as_desc->interface_num = voice_session->interface_num;
+  as_desc->alternate = 0;
+  as_desc->max_alternate = 1;
+#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+  as_desc->synch_enabled = 0;
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+  as_desc->private_data = session_handle;
+  as_desc->SetAS_Alternate = AUDIO_Voice_SetAS_Alternate;
+  as_desc->GetState = AUDIO_Voice_GetState;
+
+  AUDIO_Voice_InitializesBuffer(voice_session);
+  voice_session->session.state = AUDIO_SESSION_INITIALIZED;
+
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VoiceWriteRegion
+  *         called by the mic for each captured half before it is published,
+  *         the half is decimated to the voice ring. The filter follows the mic
+  *         rate, a rate which isn't a multiple of the voice rate gives no
+  *         frame and the host gets silence
+  * @param  region: captured half, in the record format
+  * @param  desc: record format
+  * @retval None
+  */
+void  AUDIO_VoiceWriteRegion(const AUDIO_BufferRegionTypeDef* region, const AUDIO_DescriptionTypeDef* desc)
+{
+  AUDIO_USB_SessionTypedef* voice_session = voice_active;
+  AUDIO_BufferRegionTypeDef output;
+  uint32_t frames;
+  uint32_t length;
+
+  if(voice_session == 0)
+  {
+    return;
+  }
+  if(desc->frequence != voice_decimator_rate)
+  {
+    AUDIO_DecimatorInit(&voice_decimator, desc->frequence, USB_AUDIO_CONFIG_VOICE_FREQ, desc->channels_count);
+    voice_decimator_rate = desc->frequence;
+  }
+  frames = (region->length[0] + region->length[1]) / AUDIO_SAMPLE_LENGTH(desc);
+  length = AUDIO_DecimatorOutputFrames(&voice_decimator, frames) * AUDIO_SAMPLE_LENGTH(&voice_audio_description);
+  if((AUDIO_BUFFER_FREE_SIZE(&voice_session->buffer) < length) || (length > voice_session->buffer.margin))
+  {
+    /* the host doesn't read, the new frames are dropped */
+    AUDIO_BufferTelemetryGlitch(&voice_session->buffer, 1U, HAL_GetTick());
+    return;
+  }
+  AUDIO_BufferAcquireWrite(&voice_session->buffer, length, &output);
+  AUDIO_DecimatorProcess(&voice_decimator, region, frames, desc->audio_res, &output);
+  AUDIO_BufferCommitWrite(&voice_session->buffer, length);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_Voice_SessionStart
+  *         Starts the voice (streaming) session, the record session starts
+  *         the mic if the host doesn't record
+  * @param  voice_session: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Voice_SessionStart(AUDIO_USB_SessionTypedef* voice_session)
+{
+  if((voice_session->session.state == AUDIO_SESSION_INITIALIZED)
+     ||(voice_session->session.state == AUDIO_SESSION_STOPPED))
+  {
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(voice_session->interface_num, 1);
+#endif /* USE_AUDIO_IDLE_POWER */
+    AUDIO_BufferReset(&voice_session->buffer);
+    AUDIO_PacketSchedulerReset(&voice_scheduler);
+    voice_streaming = 0;
+    /* the filter history is cleared on the first half */
+    voice_decimator_rate = 0;
+    voice_clk_source.CSStart((uint32_t)&voice_clk_source);
+    voice_session->session.state = AUDIO_SESSION_STARTED;
+    __DMB();
+    voice_active = voice_session;
+    AUDIO_Recording_SetUser(AUDIO_RECORDING_USER_VOICE, 1, (uint32_t)&usb_record_session);
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Voice_SessionStop
+  *         Stop the voice (streaming) session
+  * @param  voice_session: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Voice_SessionStop(AUDIO_USB_SessionTypedef* voice_session)
+{
+  if(voice_session->session.state == AUDIO_SESSION_STARTED)
+  {
+    voice_active = 0;
+    AUDIO_Recording_SetUser(AUDIO_RECORDING_USER_VOICE, 0, (uint32_t)&usb_record_session);
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerSetStreaming(voice_session->interface_num, 0);
+#endif /* USE_AUDIO_IDLE_POWER */
+    voice_session->session.state = AUDIO_SESSION_STOPPED;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Voice_SessionDeInit
+  *         De-Initializes the voice (streaming) session
+  * @param  session_handle: session handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Voice_SessionDeInit(uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef* voice_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(voice_session->session.state != AUDIO_SESSION_OFF)
+  {
+    if(voice_session->session.state == AUDIO_SESSION_STARTED)
+    {
+      AUDIO_Voice_SessionStop(voice_session);
+    }
+    voice_clk_source.CSDeInit((uint32_t)&voice_clk_source);
+    voice_session->session.state = AUDIO_SESSION_OFF;
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Voice_SetAS_Alternate
+  *         set AS interface alternate callback
+  * @param  alternate:
+  * @param  session_handle: session
+  * @retval  : 0 if no error
+  */
+static int8_t  AUDIO_Voice_SetAS_Alternate(uint8_t alternate, uint32_t session_handle)
+{
+  AUDIO_USB_SessionTypedef * voice_session = (AUDIO_USB_SessionTypedef*)session_handle;
+
+  if(alternate == 0)
+  {
+    if(voice_session->alternate != 0)
+    {
+      AUDIO_Voice_SessionStop(voice_session);
+      voice_session->alternate = 0;
+    }
+  }
+  else
+  {
+    if(voice_session->alternate == 0)
+    {
+      AUDIO_Voice_SessionStart(voice_session);
+      voice_session->alternate = alternate;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Voice_GetState
+  *         return AS interface state
+  * @param  session_handle: session
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_Voice_GetState(uint32_t session_handle)
+{
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_Voice_GetBuffer
+  *         callback called by USB class to get the next packet to send. Zeros
+  *         are sent until the start threshold is decimated and after an
+  *         underrun, a frame is added or removed when the fill is out of
+  *         [threshold / 2 , 2 * threshold]
+  * @param  session_handle: session
+  * @param  packet_length: length of the packet to send
+  * @retval packet data
+  */
+static uint8_t*  AUDIO_Voice_GetBuffer(uint32_t session_handle, uint16_t* packet_length)
+{
+  AUDIO_USB_SessionTypedef* voice_session = (AUDIO_USB_SessionTypedef*)session_handle;
+  AUDIO_BufferTypeDef* buf = &voice_session->buffer;
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&voice_audio_description);
+  uint8_t* packet;
+  uint32_t filled;
+  uint32_t length;
+
+  packet = voice_packets[voice_packet_index];
+  voice_packet_index ^= 1U;
+  if(voice_session->session.state != AUDIO_SESSION_STARTED)
+  {
+    /* stopped while the endpoint is still armed */
+    AUDIO_BufferTelemetryResync(buf);
+    *packet_length = 0;
+    return packet;
+  }
+  length = AUDIO_PacketSchedulerNext(&voice_scheduler);
+  filled = AUDIO_BUFFER_FILLED_SIZE(buf);
+  if(!voice_streaming)
+  {
+    if(filled < voice_start_threshold)
+    {
+      memset(packet, 0, length);
+      *packet_length = (uint16_t)length;
+      return packet;
+    }
+    voice_streaming = 1;
+  }
+  AUDIO_BufferTelemetryUpdate(buf, filled);
+  if((filled > 2U * voice_start_threshold) && (length + frame_size <= USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE))
+  {
+    length += frame_size;
+  }
+  else if((filled < voice_start_threshold / 2U) && (length > frame_size))
+  {
+    length -= frame_size;
+  }
+  if(filled < length)
+  {
+    /* the mic stopped or lags : silence up to the start threshold again */
+    AUDIO_BufferTelemetryGlitch(buf, 0U, HAL_GetTick());
+    voice_streaming = 0;
+    memset(packet, 0, length);
+  }
+  else
+  {
+    AUDIO_BufferRead(buf, packet, length);
+  }
+  *packet_length = (uint16_t)length;
+  return packet;
+}
+
+/**
+  * @brief  AUDIO_Voice_GetMaxPacketLength
+  *         max packet length of the voice endpoint
+  * @param  session_handle: session
+  * @retval max packet length in bytes
+  */
+static uint16_t  AUDIO_Voice_GetMaxPacketLength(uint32_t session_handle)
+{
+  return USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE;
+}
+
+/**
+  * @brief  AUDIO_Voice_InitializesBuffer
+  *         sizes the ring and the start threshold, the margin holds the
+  *         largest half the mic writes
+  * @param  voice_session: session, must be stopped
+  * @retval None
+  */
+static void  AUDIO_Voice_InitializesBuffer(AUDIO_USB_SessionTypedef* voice_session)
+{
+  uint32_t frame_size = AUDIO_SAMPLE_LENGTH(&voice_audio_description);
+  uint32_t threshold = AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&voice_audio_description) * USBD_AUDIO_CONFIG_VOICE_START_MS;
+
+  AUDIO_USB_InitializesDataBuffer(&voice_session->buffer, USBD_AUDIO_CONFIG_VOICE_BUFFER_SIZE,
+                                  AUDIO_MS_PACKET_SIZE_FROM_AUD_DESC(&voice_audio_description),
+                                  AUDIO_MS_MAX_PACKET_SIZE_FROM_AUD_DESC(&voice_audio_description) * AUDIO_VOICE_MARGIN_MS);
+  if(threshold > (voice_session->buffer.size >> 2))
+  {
+    threshold = voice_session->buffer.size >> 2;
+  }
+  voice_start_threshold = (threshold / frame_size) * frame_size;
+}
+#endif /* USE_AUDIO_RECORDING_VOICE */
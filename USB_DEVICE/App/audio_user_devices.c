@@ -0,0 +1,575 @@
+/**
+  ******************************************************************************
+  * @file    audio_user_devices.c
+  * @brief   Board audio devices low level : audio PLL and SAI/DMA MSP of the
+  *          user speaker and mic nodes.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+#include "usb_audio_user.h"
+#if (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC)
+#include "audio_user_devices.h"
+
+/* Private define ------------------------------------------------------------*/
+/* PLL2 from the PLL source brought to 8..16 MHz , P output = 256 * fs , the
+   SAI master clock divider then gives 12.288 MHz or 11.2896 MHz */
+#define AUDIO_PLL2_M                  CLOCK_PLL_M
+#define AUDIO_PLL2_P                  8U
+#define AUDIO_PLL2_VCO_48K            (49152000UL * AUDIO_PLL2_P)
+#define AUDIO_PLL2_N_48K              CLOCK_PLL_N(AUDIO_PLL2_VCO_48K)      /* 24 , 4719 from HSI */
+#define AUDIO_PLL2_FRACN_48K          CLOCK_PLL_FRACN(AUDIO_PLL2_VCO_48K)
+#define AUDIO_PLL2_VCO_44_1K          (45158400UL * AUDIO_PLL2_P)
+#define AUDIO_PLL2_N_44_1K            CLOCK_PLL_N(AUDIO_PLL2_VCO_44_1K)    /* 22 , 4745 from HSI */
+#define AUDIO_PLL2_FRACN_44_1K        CLOCK_PLL_FRACN(AUDIO_PLL2_VCO_44_1K)
+#define AUDIO_PLL2_FRACN_RANGE        8192U
+
+/* Private variables ---------------------------------------------------------*/
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+/* set once SAI1 is clocked by the external PLL */
+static uint8_t audio_ext_clk_set = 0;
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+/* PLL2 N currently set, 0 before first configuration */
+static uint32_t audio_pll2_n = 0;
+/* PLL2 FRACN currently set, moved by AUDIO_USER_ClockTrim */
+static uint32_t audio_pll2_fracn = 0;
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* SAI1 kernel clock to use at next configuration : 1 for the external PLL */
+static uint8_t audio_ext_clk_selected = 0;
+/* set once SAI1 is clocked by the external PLL */
+static uint8_t audio_ext_clk_set = 0;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+
+/* Private function prototypes -----------------------------------------------*/
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+static int8_t AUDIO_USER_ExtClockConfig(uint32_t frequency);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+
+/* Exported functions --------------------------------------------------------*/
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+/**
+  * @brief  AUDIO_USER_ClockConfig
+  *         Selects the external audio PLL, locked on SOF, as SAI1 kernel clock.
+  *         Its rate is fixed, so only the sampling frequencies it divides down
+  *         to are accepted
+  * @param  frequency: sampling frequency
+  * @retval 0 if no error
+  */
+int8_t AUDIO_USER_ClockConfig(uint32_t frequency)
+{
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if((frequency == 0U) || ((EXTERNAL_CLOCK_VALUE % (frequency * AUDIO_EXT_CLK_MCLK_RATIO)) != 0U))
+  {
+    return -1;
+  }
+  if(audio_ext_clk_set)
+  {
+    return 0;
+  }
+  AUDIO_EXT_CLK_GPIO_CLK_ENABLE();
+  GPIO_InitStruct.Pin = AUDIO_EXT_CLK_GPIO_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  GPIO_InitStruct.Alternate = AUDIO_EXT_CLK_GPIO_AF;
+  HAL_GPIO_Init(AUDIO_EXT_CLK_GPIO_PORT, &GPIO_InitStruct);
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+  PeriphClkInitStruct.PeriphClockSelection |= AUDIO_SPEAKER_SAI_PERIPHCLK;
+  PeriphClkInitStruct.Sai1ClockSelection = AUDIO_SPEAKER_SAI_CLKSOURCE;
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+  PeriphClkInitStruct.PeriphClockSelection |= AUDIO_MIC_SAI_PERIPHCLK;
+  PeriphClkInitStruct.Sai1ClockSelection = AUDIO_MIC_SAI_CLKSOURCE;
+#endif /* USE_AUDIO_DUMMY_MIC */
+  if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
+  {
+    return -1;
+  }
+  audio_ext_clk_set = 1;
+  return 0;
+}
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+/**
+  * @brief  AUDIO_USER_ClockConfig
+  *         Sets the audio PLL for the family of a sampling frequency, 48 kHz
+  *         multiples or 44.1 kHz multiples. SAI dividers are then exact. The
+  *         PLL is left running when already set for this family, so the other
+  *         SAI block is not disturbed
+  * @param  frequency: sampling frequency
+  * @retval 0 if no error
+  */
+int8_t AUDIO_USER_ClockConfig(uint32_t frequency)
+{
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  if(audio_ext_clk_selected)
+  {
+    return AUDIO_USER_ExtClockConfig(frequency);
+  }
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+  PeriphClkInitStruct.PLL2.PLL2M = AUDIO_PLL2_M;
+  PeriphClkInitStruct.PLL2.PLL2P = AUDIO_PLL2_P;
+  PeriphClkInitStruct.PLL2.PLL2Q = 2;
+  PeriphClkInitStruct.PLL2.PLL2R = 2;
+  PeriphClkInitStruct.PLL2.PLL2RGE = RCC_PLL2VCIRANGE_3;
+  PeriphClkInitStruct.PLL2.PLL2VCOSEL = RCC_PLL2VCOWIDE;
+  if((frequency % 11025U) == 0U)
+  {
+    PeriphClkInitStruct.PLL2.PLL2N = AUDIO_PLL2_N_44_1K;
+    PeriphClkInitStruct.PLL2.PLL2FRACN = AUDIO_PLL2_FRACN_44_1K;
+  }
+  else
+  {
+    PeriphClkInitStruct.PLL2.PLL2N = AUDIO_PLL2_N_48K;
+    PeriphClkInitStruct.PLL2.PLL2FRACN = AUDIO_PLL2_FRACN_48K;
+  }
+  if(PeriphClkInitStruct.PLL2.PLL2N == audio_pll2_n)
+  {
+    return 0;
+  }
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+  PeriphClkInitStruct.PeriphClockSelection |= AUDIO_SPEAKER_SAI_PERIPHCLK;
+  PeriphClkInitStruct.Sai1ClockSelection = AUDIO_SPEAKER_SAI_CLKSOURCE;
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+  PeriphClkInitStruct.PeriphClockSelection |= AUDIO_MIC_SAI_PERIPHCLK;
+  PeriphClkInitStruct.Sai1ClockSelection = AUDIO_MIC_SAI_CLKSOURCE;
+#endif /* USE_AUDIO_DUMMY_MIC */
+  if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
+  {
+    return -1;
+  }
+  audio_pll2_n = PeriphClkInitStruct.PLL2.PLL2N;
+  audio_pll2_fracn = PeriphClkInitStruct.PLL2.PLL2FRACN;
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  audio_ext_clk_set = 0;
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+  return 0;
+}
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/**
+  * @brief  AUDIO_USER_ClockSelect
+  *         Chooses the SAI1 kernel clock of the next AUDIO_USER_ClockConfig :
+  *         PLL2 or the external PLL locked on the word clock. The nodes are
+  *         restarted by the caller, which configures the clock again
+  * @param  external: 1 for the external PLL, 0 for PLL2
+  * @retval None
+  */
+void AUDIO_USER_ClockSelect(uint8_t external)
+{
+  audio_ext_clk_selected = external;
+}
+
+/**
+  * @brief  AUDIO_USER_ClockIsLocked
+  *         Reads the lock output of the external PLL, its input pin is set
+  *         at first call
+  * @retval 1 while the external PLL follows the word clock
+  */
+uint8_t AUDIO_USER_ClockIsLocked(void)
+{
+  static uint8_t lock_pin_set = 0;
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if(!lock_pin_set)
+  {
+    AUDIO_EXT_CLK_GPIO_CLK_ENABLE();
+    GPIO_InitStruct.Pin = AUDIO_EXT_CLK_LOCK_GPIO_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_PULLDOWN;
+    HAL_GPIO_Init(AUDIO_EXT_CLK_LOCK_GPIO_PORT, &GPIO_InitStruct);
+    lock_pin_set = 1;
+  }
+  return (HAL_GPIO_ReadPin(AUDIO_EXT_CLK_LOCK_GPIO_PORT, AUDIO_EXT_CLK_LOCK_GPIO_PIN) == AUDIO_EXT_CLK_LOCK_ACTIVE) ? 1U : 0U;
+}
+
+/**
+  * @brief  AUDIO_USER_ExtClockConfig
+  *         Selects the external PLL as SAI1 kernel clock, PLL2 is left as is
+  *         and set again when the internal clock is selected back. Its rate
+  *         is fixed, so only the sampling frequencies it divides down to are accepted
+  * @param  frequency: sampling frequency
+  * @retval 0 if no error
+  */
+static int8_t AUDIO_USER_ExtClockConfig(uint32_t frequency)
+{
+  RCC_PeriphCLKInitTypeDef PeriphClkInitStruct = {0};
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if((frequency == 0U) || ((EXTERNAL_CLOCK_VALUE % (frequency * AUDIO_EXT_CLK_MCLK_RATIO)) != 0U))
+  {
+    return -1;
+  }
+  if(audio_ext_clk_set)
+  {
+    return 0;
+  }
+  AUDIO_EXT_CLK_GPIO_CLK_ENABLE();
+  GPIO_InitStruct.Pin = AUDIO_EXT_CLK_GPIO_PIN;
+  GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+  GPIO_InitStruct.Alternate = AUDIO_EXT_CLK_GPIO_AF;
+  HAL_GPIO_Init(AUDIO_EXT_CLK_GPIO_PORT, &GPIO_InitStruct);
+  PeriphClkInitStruct.PeriphClockSelection = RCC_PERIPHCLK_SAI1;
+  PeriphClkInitStruct.Sai1ClockSelection = RCC_SAI1CLKSOURCE_PIN;
+  if(HAL_RCCEx_PeriphCLKConfig(&PeriphClkInitStruct) != HAL_OK)
+  {
+    return -1;
+  }
+  audio_ext_clk_set = 1;
+  /* the SAI1 selection of PLL2 is given back with its next configuration */
+  audio_pll2_n = 0;
+  return 0;
+}
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+
+#if (defined USE_AUDIO_PLAYBACK_SILENCE_POWER) && !(defined USE_AUDIO_SPEAKER_DUMMY)
+/**
+  * @brief  AUDIO_USER_SpeakerAmpPower
+  *         Drives the enable input of the speaker amplifier, its output pin
+  *         is set at first call
+  * @param  on: 1 to power the amplifier
+  * @retval None
+  */
+void AUDIO_USER_SpeakerAmpPower(uint8_t on)
+{
+  static uint8_t amp_pin_set = 0;
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  if(!amp_pin_set)
+  {
+    AUDIO_SPEAKER_AMP_GPIO_CLK_ENABLE();
+    GPIO_InitStruct.Pin = AUDIO_SPEAKER_AMP_GPIO_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+    HAL_GPIO_Init(AUDIO_SPEAKER_AMP_GPIO_PORT, &GPIO_InitStruct);
+    amp_pin_set = 1;
+  }
+  HAL_GPIO_WritePin(AUDIO_SPEAKER_AMP_GPIO_PORT, AUDIO_SPEAKER_AMP_GPIO_PIN,
+                    on ? AUDIO_SPEAKER_AMP_ON : AUDIO_SPEAKER_AMP_OFF);
+}
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER && !USE_AUDIO_SPEAKER_DUMMY */
+
+#ifdef USE_AUDIO_IDLE_POWER
+/**
+  * @brief  AUDIO_USER_ClockLost
+  *         Called after STOP mode, which turned the audio PLL off : the next
+  *         AUDIO_USER_ClockConfig sets it again. The external PLL and the SAI
+  *         kernel clock selection are kept through STOP
+  * @retval None
+  */
+void AUDIO_USER_ClockLost(void)
+{
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
+  audio_pll2_n = 0;
+  audio_pll2_fracn = 0;
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+}
+#endif /* USE_AUDIO_IDLE_POWER */
+
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
+/**
+  * @brief  AUDIO_USER_ClockTrim
+  *         Moves the audio PLL fractional part, while it runs, to cancel a
+  *         relative rate error. One FRACN step is about 5 ppm of the audio clock.
+  *         Used by the SOF lock, a ppm trim passes nominal_rate = 1000000
+  * @param  rate_error: measured rate minus nominal rate
+  * @param  nominal_rate: nominal rate, same unit as rate_error
+  * @retval 0 if no error, -1 when the correction reaches the FRACN range
+  */
+int8_t AUDIO_USER_ClockTrim(int32_t rate_error, uint32_t nominal_rate)
+{
+  int32_t multiplier = (int32_t)(audio_pll2_n * AUDIO_PLL2_FRACN_RANGE + audio_pll2_fracn);
+  int32_t fracn;
+  int8_t ret = 0;
+
+  if((audio_pll2_n == 0U) || (nominal_rate == 0U))
+  {
+    return -1;
+  }
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+  if(audio_ext_clk_selected)
+  {
+    /* the external clock can't follow the host, the feedback takes over */
+    return -1;
+  }
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+  /* VCO is proportional to N + FRACN / 8192 , so is the audio rate */
+  fracn = (int32_t)audio_pll2_fracn - (int32_t)(((int64_t)rate_error * multiplier) / (int64_t)nominal_rate);
+  if(fracn < 0)
+  {
+    fracn = 0;
+    ret = -1;
+  }
+  if(fracn >= (int32_t)AUDIO_PLL2_FRACN_RANGE)
+  {
+    fracn = AUDIO_PLL2_FRACN_RANGE - 1;
+    ret = -1;
+  }
+  if((uint32_t)fracn != audio_pll2_fracn)
+  {
+    /* FRACN is latched when FRACEN goes from 0 to 1, the PLL stays locked */
+    __HAL_RCC_PLL2FRACN_DISABLE();
+    __HAL_RCC_PLL2FRACN_CONFIG(fracn);
+    __HAL_RCC_PLL2FRACN_ENABLE();
+    audio_pll2_fracn = (uint32_t)fracn;
+  }
+  return ret;
+}
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+
+/**
+  * @brief  HAL_SAI_MspInit
+  *         SAI clocks, pins and DMA of the audio nodes
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_MspInit(SAI_HandleTypeDef* hsai)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+  if(hsai->Instance == AUDIO_SPEAKER_SAI_BLOCK)
+  {
+    AUDIO_SPEAKER_SAI_CLK_ENABLE();
+    AUDIO_SPEAKER_SAI_GPIO_CLK_ENABLE();
+    AUDIO_SPEAKER_DMA_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = AUDIO_SPEAKER_SAI_GPIO_PINS;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = AUDIO_SPEAKER_SAI_GPIO_AF;
+    HAL_GPIO_Init(AUDIO_SPEAKER_SAI_GPIO_PORT, &GPIO_InitStruct);
+#ifdef USE_AUDIO_MEMS_MIC
+    GPIO_InitStruct.Pin = AUDIO_SPEAKER_SAI_SD_GPIO_PINS;
+    HAL_GPIO_Init(AUDIO_SPEAKER_SAI_SD_GPIO_PORT, &GPIO_InitStruct);
+#endif /* USE_AUDIO_MEMS_MIC */
+
+    hdma_sai1_a.Instance = AUDIO_SPEAKER_DMA_STREAM;
+    hdma_sai1_a.Init.Request = AUDIO_SPEAKER_DMA_REQUEST;
+    hdma_sai1_a.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    hdma_sai1_a.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_sai1_a.Init.MemInc = DMA_MINC_ENABLE;
+    if(hsai->Init.DataSize <= SAI_DATASIZE_16)
+    {
+      hdma_sai1_a.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+      hdma_sai1_a.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    }
+    else
+    {
+      hdma_sai1_a.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+      hdma_sai1_a.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    }
+    hdma_sai1_a.Init.Mode = DMA_CIRCULAR;
+    hdma_sai1_a.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_sai1_a.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(&hdma_sai1_a) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(hsai, hdmatx, hdma_sai1_a);
+
+    HAL_NVIC_SetPriority(AUDIO_SPEAKER_DMA_IRQn, AUDIO_SPEAKER_DMA_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_SPEAKER_DMA_IRQn);
+  }
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+  if(hsai->Instance == AUDIO_MIC_SAI_BLOCK)
+  {
+    AUDIO_MIC_SAI_CLK_ENABLE();
+    AUDIO_MIC_SAI_GPIO_CLK_ENABLE();
+    AUDIO_MIC_DMA_CLK_ENABLE();
+
+    GPIO_InitStruct.Pin = AUDIO_MIC_SAI_CLK_GPIO_PINS;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = AUDIO_MIC_SAI_GPIO_AF;
+    HAL_GPIO_Init(AUDIO_MIC_SAI_CLK_GPIO_PORT, &GPIO_InitStruct);
+    GPIO_InitStruct.Pin = AUDIO_MIC_SAI_SD_GPIO_PINS;
+    HAL_GPIO_Init(AUDIO_MIC_SAI_SD_GPIO_PORT, &GPIO_InitStruct);
+
+    hdma_sai1_b.Instance = AUDIO_MIC_DMA_STREAM;
+    hdma_sai1_b.Init.Request = AUDIO_MIC_DMA_REQUEST;
+    hdma_sai1_b.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_sai1_b.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_sai1_b.Init.MemInc = DMA_MINC_ENABLE;
+    if(hsai->Init.DataSize <= SAI_DATASIZE_16)
+    {
+      hdma_sai1_b.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+      hdma_sai1_b.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    }
+    else
+    {
+      hdma_sai1_b.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+      hdma_sai1_b.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    }
+    hdma_sai1_b.Init.Mode = DMA_CIRCULAR;
+    hdma_sai1_b.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_sai1_b.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if(HAL_DMA_Init(&hdma_sai1_b) != HAL_OK)
+    {
+      Error_Handler();
+    }
+    __HAL_LINKDMA(hsai, hdmarx, hdma_sai1_b);
+
+    HAL_NVIC_SetPriority(AUDIO_MIC_DMA_IRQn, AUDIO_MIC_DMA_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(AUDIO_MIC_DMA_IRQn);
+  }
+#endif /* USE_AUDIO_DUMMY_MIC */
+}
+
+/**
+  * @brief  HAL_SAI_MspDeInit
+  *         Releases SAI clocks, pins and DMA of the audio nodes
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_MspDeInit(SAI_HandleTypeDef* hsai)
+{
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+  if(hsai->Instance == AUDIO_SPEAKER_SAI_BLOCK)
+  {
+    HAL_NVIC_DisableIRQ(AUDIO_SPEAKER_DMA_IRQn);
+    HAL_DMA_DeInit(hsai->hdmatx);
+    HAL_GPIO_DeInit(AUDIO_SPEAKER_SAI_GPIO_PORT, AUDIO_SPEAKER_SAI_GPIO_PINS);
+#ifdef USE_AUDIO_MEMS_MIC
+    HAL_GPIO_DeInit(AUDIO_SPEAKER_SAI_SD_GPIO_PORT, AUDIO_SPEAKER_SAI_SD_GPIO_PINS);
+#endif /* USE_AUDIO_MEMS_MIC */
+#ifdef USE_AUDIO_DUMMY_MIC
+    /* SAI1 clock is shared with the mic block otherwise */
+    AUDIO_SPEAKER_SAI_CLK_DISABLE();
+#endif /* USE_AUDIO_DUMMY_MIC */
+  }
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+  if(hsai->Instance == AUDIO_MIC_SAI_BLOCK)
+  {
+    HAL_NVIC_DisableIRQ(AUDIO_MIC_DMA_IRQn);
+    HAL_DMA_DeInit(hsai->hdmarx);
+    HAL_GPIO_DeInit(AUDIO_MIC_SAI_CLK_GPIO_PORT, AUDIO_MIC_SAI_CLK_GPIO_PINS);
+    HAL_GPIO_DeInit(AUDIO_MIC_SAI_SD_GPIO_PORT, AUDIO_MIC_SAI_SD_GPIO_PINS);
+#ifdef USE_AUDIO_SPEAKER_DUMMY
+    AUDIO_MIC_SAI_CLK_DISABLE();
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+  }
+#endif /* USE_AUDIO_DUMMY_MIC */
+}
+
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+/**
+  * @brief  HAL_TIM_IC_MspInit
+  *         clock and audio clock input of the SOF timestamp timer
+  * @param  htim: TIM handle
+  * @retval None
+  */
+void HAL_TIM_IC_MspInit(TIM_HandleTypeDef* htim)
+{
+#ifdef USE_AUDIO_SOF_TIMESTAMP_MCLK
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+#endif /* USE_AUDIO_SOF_TIMESTAMP_MCLK */
+
+  if(htim->Instance == AUDIO_SOF_TS_TIM)
+  {
+    AUDIO_SOF_TS_TIM_CLK_ENABLE();
+#ifdef USE_AUDIO_SOF_TIMESTAMP_MCLK
+    AUDIO_SOF_TS_GPIO_CLK_ENABLE();
+    GPIO_InitStruct.Pin = AUDIO_SOF_TS_GPIO_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    GPIO_InitStruct.Alternate = AUDIO_SOF_TS_GPIO_AF;
+    HAL_GPIO_Init(AUDIO_SOF_TS_GPIO_PORT, &GPIO_InitStruct);
+#endif /* USE_AUDIO_SOF_TIMESTAMP_MCLK */
+  }
+}
+
+/**
+  * @brief  HAL_TIM_IC_MspDeInit
+  *         releases the SOF timestamp timer
+  * @param  htim: TIM handle
+  * @retval None
+  */
+void HAL_TIM_IC_MspDeInit(TIM_HandleTypeDef* htim)
+{
+  if(htim->Instance == AUDIO_SOF_TS_TIM)
+  {
+#ifdef USE_AUDIO_SOF_TIMESTAMP_MCLK
+    HAL_GPIO_DeInit(AUDIO_SOF_TS_GPIO_PORT, AUDIO_SOF_TS_GPIO_PIN);
+#endif /* USE_AUDIO_SOF_TIMESTAMP_MCLK */
+    AUDIO_SOF_TS_TIM_CLK_DISABLE();
+  }
+}
+#elif defined(USE_AUDIO_SOF_JITTER)
+/**
+  * @brief  HAL_TIM_IC_MspInit
+  *         clocks the SOF jitter timer, it has no pin
+  * @param  htim: TIM handle
+  * @retval None
+  */
+void HAL_TIM_IC_MspInit(TIM_HandleTypeDef* htim)
+{
+  if(htim->Instance == AUDIO_SOF_JITTER_TIM)
+  {
+    AUDIO_SOF_JITTER_TIM_CLK_ENABLE();
+  }
+}
+
+/**
+  * @brief  HAL_TIM_IC_MspDeInit
+  *         releases the SOF jitter timer
+  * @param  htim: TIM handle
+  * @retval None
+  */
+void HAL_TIM_IC_MspDeInit(TIM_HandleTypeDef* htim)
+{
+  if(htim->Instance == AUDIO_SOF_JITTER_TIM)
+  {
+    AUDIO_SOF_JITTER_TIM_CLK_DISABLE();
+  }
+}
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+
+/**
+  * @brief  HAL_SAI_ErrorCallback
+  *         SAI or DMA error, forwarded to the node owning the block
+  * @param  hsai: SAI handle
+  * @retval None
+  */
+void HAL_SAI_ErrorCallback(SAI_HandleTypeDef *hsai)
+{
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+  if(hsai->Instance == AUDIO_SPEAKER_SAI_BLOCK)
+  {
+    AUDIO_SPEAKER_USER_ErrorCallback(hsai);
+  }
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+  if(hsai->Instance == AUDIO_MIC_SAI_BLOCK)
+  {
+    AUDIO_USER_MicErrorCallback(hsai);
+  }
+#endif /* USE_AUDIO_DUMMY_MIC */
+}
+
+#endif /* (!defined USE_AUDIO_SPEAKER_DUMMY) || (!defined USE_AUDIO_DUMMY_MIC) */
@@ -0,0 +1,447 @@
+/**
+  ******************************************************************************
+  * @file    audio_user_devices.h
+  * @brief   Board audio devices used when the dummy speaker or mic is not
+  *          selected : peripheral instances, DMA streams and node specific
+  *          data.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_USER_DEVICES_H
+#define __AUDIO_USER_DEVICES_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32h7xx_hal.h"
+#include "audio_node.h"
+#include "usb_audio_user.h"
+#ifdef USE_AUDIO_MEMS_MIC
+#include "audio_pdm_filter.h"
+#endif /* USE_AUDIO_MEMS_MIC */
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+#include "audio_upsampler.h"
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#ifdef USE_AUDIO_DITHER
+#include "audio_dither.h"
+#endif /* USE_AUDIO_DITHER */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+#include "audio_beamformer.h"
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+#ifndef HAL_SAI_MODULE_ENABLED
+#error "the SAI speaker needs HAL_SAI_MODULE_ENABLED and the HAL SAI driver"
+#endif /* HAL_SAI_MODULE_ENABLED */
+/* speaker : SAI1 block A master transmitter, I2S standard, MCLK = 256 fs.
+   Beyond 2 channels the frame carries one slot per channel (TDM with I2S framing),
+   8 slots of 32 bits fit the 256 bit clocks of a frame */
+#if (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT > 2) && ((USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT & 1) != 0)
+#error "the SAI speaker needs 1, 2 or an even count of channels"
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
+#ifdef USE_AUDIO_MEMS_MIC
+/* the PDM interface is on block A only, the speaker moves to block B on the
+   pins the I2S mic would use */
+#define AUDIO_SPEAKER_SAI_BLOCK               SAI1_Block_B
+#else /* USE_AUDIO_MEMS_MIC */
+#define AUDIO_SPEAKER_SAI_BLOCK               SAI1_Block_A
+#endif /* USE_AUDIO_MEMS_MIC */
+#define AUDIO_SPEAKER_SAI_CLK_ENABLE()        __HAL_RCC_SAI1_CLK_ENABLE()
+#define AUDIO_SPEAKER_SAI_CLK_DISABLE()       __HAL_RCC_SAI1_CLK_DISABLE()
+#define AUDIO_SPEAKER_SAI_PERIPHCLK           RCC_PERIPHCLK_SAI1
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+#define AUDIO_SPEAKER_SAI_CLKSOURCE           RCC_SAI1CLKSOURCE_PIN
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#define AUDIO_SPEAKER_SAI_CLKSOURCE           RCC_SAI1CLKSOURCE_PLL2
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_MEMS_MIC
+/* PF7 MCLK, PF8 SCK, PF9 FS, PE3 SD */
+#define AUDIO_SPEAKER_SAI_GPIO_PORT           GPIOF
+#define AUDIO_SPEAKER_SAI_GPIO_PINS           (GPIO_PIN_7 | GPIO_PIN_8 | GPIO_PIN_9)
+#define AUDIO_SPEAKER_SAI_SD_GPIO_PORT        GPIOE
+#define AUDIO_SPEAKER_SAI_SD_GPIO_PINS        GPIO_PIN_3
+#define AUDIO_SPEAKER_SAI_GPIO_CLK_ENABLE()   do { __HAL_RCC_GPIOE_CLK_ENABLE(); \
+                                                   __HAL_RCC_GPIOF_CLK_ENABLE(); } while(0)
+#define AUDIO_SPEAKER_DMA_REQUEST             DMA_REQUEST_SAI1_B
+#else /* USE_AUDIO_MEMS_MIC */
+/* PE2 MCLK, PE4 FS, PE5 SCK, PE6 SD */
+#define AUDIO_SPEAKER_SAI_GPIO_PORT           GPIOE
+#define AUDIO_SPEAKER_SAI_GPIO_PINS           (GPIO_PIN_2 | GPIO_PIN_4 | GPIO_PIN_5 | GPIO_PIN_6)
+#define AUDIO_SPEAKER_SAI_GPIO_CLK_ENABLE()   __HAL_RCC_GPIOE_CLK_ENABLE()
+#define AUDIO_SPEAKER_DMA_REQUEST             DMA_REQUEST_SAI1_A
+#endif /* USE_AUDIO_MEMS_MIC */
+#define AUDIO_SPEAKER_SAI_GPIO_AF             GPIO_AF6_SAI1
+#define AUDIO_SPEAKER_DMA_STREAM              DMA1_Stream0
+#define AUDIO_SPEAKER_DMA_CLK_ENABLE()        __HAL_RCC_DMA1_CLK_ENABLE()
+#define AUDIO_SPEAKER_DMA_IRQn                DMA1_Stream0_IRQn
+#define AUDIO_SPEAKER_DMA_IRQHandler          DMA1_Stream0_IRQHandler
+/* below USB so a packet reception is never delayed by a refill */
+#define AUDIO_SPEAKER_DMA_IRQ_PRIORITY        1U
+
+/* each DMA half holds one ms of audio, it is refilled from the session ring
+   when the other half starts playing */
+#define AUDIO_SPEAKER_DMA_HALF_MS             1U
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+/* the SAI always plays at this rate, the host stream is upsampled to it so a
+   rate change neither reclocks the SAI nor stops it */
+#define AUDIO_SPEAKER_FIXED_RATE              96000U
+#if (USB_AUDIO_CONFIG_PLAY_FREQ_MAX > AUDIO_SPEAKER_FIXED_RATE)
+#error "the fixed rate playback only upsamples, the play frequencies must not exceed AUDIO_SPEAKER_FIXED_RATE"
+#endif /* USB_AUDIO_CONFIG_PLAY_FREQ_MAX */
+#if (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT > AUDIO_UPSAMPLER_MAX_CHANNELS)
+#error "the fixed rate playback upsamples up to AUDIO_UPSAMPLER_MAX_CHANNELS channels"
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
+#if defined(USE_AUDIO_PLAYBACK_MIX) || defined(USE_AUDIO_SIDETONE) || defined(USE_AUDIO_CLIP_UPLOAD)
+#error "the fixed rate playback halves are not at the stream rate, nothing can be mixed in them"
+#endif /* USE_AUDIO_PLAYBACK_MIX || USE_AUDIO_SIDETONE || USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+#error "the SOF timestamp measures the SAI clock as the stream rate, it can't be used with the fixed rate playback"
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+#define AUDIO_SPEAKER_DMA_HALF_MAX_SAMPLES    (((AUDIO_SPEAKER_FIXED_RATE + 999U) / 1000U) * \
+                                               AUDIO_SPEAKER_DMA_HALF_MS * USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT)
+#else /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+#define AUDIO_SPEAKER_DMA_HALF_MAX_SAMPLES    (((USB_AUDIO_CONFIG_PLAY_FREQ_MAX + 999U) / 1000U) * \
+                                               AUDIO_SPEAKER_DMA_HALF_MS * USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT)
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+/* 24 and 32 bits samples are sent in 32 bits words */
+#define AUDIO_SPEAKER_DMA_BUFFER_SIZE         (2U * AUDIO_SPEAKER_DMA_HALF_MAX_SAMPLES * 4U)
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+
+#ifdef USE_AUDIO_MEMS_MIC
+#ifdef USE_AUDIO_DUMMY_MIC
+#error "USE_AUDIO_MEMS_MIC replaces the dummy mic, undefine USE_AUDIO_DUMMY_MIC"
+#endif /* USE_AUDIO_DUMMY_MIC */
+#ifndef HAL_SAI_MODULE_ENABLED
+#error "the MEMS mic needs HAL_SAI_MODULE_ENABLED and the HAL SAI driver"
+#endif /* HAL_SAI_MODULE_ENABLED */
+/* MEMS mic : SAI1 block A master receiver with its PDM interface. One data
+   line per pair of mics, the left mic of a pair on the rising edge. The PDM
+   clock is 64 fs, 3.072 MHz at 48 kHz, the mics don't run much faster */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+/* the mics are steered to the recorded channels, one or two beams */
+#ifndef AUDIO_MIC_COUNT
+#define AUDIO_MIC_COUNT                       4U
+#endif /* AUDIO_MIC_COUNT */
+#if (USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT > 2)
+#error "the beamformer records one or two beams"
+#endif /* USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT */
+#if (AUDIO_MIC_COUNT < 2) || (AUDIO_MIC_COUNT > AUDIO_BEAM_MAX_MICS)
+#error "the beamformer steers 2 to AUDIO_BEAM_MAX_MICS mics"
+#endif /* AUDIO_MIC_COUNT */
+#else /* USE_AUDIO_MIC_BEAMFORMER */
+/* each mic is a recorded channel */
+#define AUDIO_MIC_COUNT                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+#if (AUDIO_MIC_COUNT > 4)
+#error "the MEMS mic takes 1 to 4 mics, on 2 data lines"
+#endif /* AUDIO_MIC_COUNT */
+#if (USB_AUDIO_CONFIG_RECORD_FREQ_MAX > 48000)
+#error "the MEMS mic needs a PDM clock of 64 fs, record up to 48 kHz"
+#endif /* USB_AUDIO_CONFIG_RECORD_FREQ_MAX */
+#define AUDIO_MIC_PDM_PAIRS                   ((AUDIO_MIC_COUNT + 1U) / 2U)
+#define AUDIO_MIC_PDM_CLOCK                   SAI_PDM_CLOCK1_ENABLE
+/* a pair is a 16 bits slot , in memory the first mic is its high byte */
+#define AUDIO_MIC_PDM_BYTE_OFFSET(mic)        ((mic) ^ 1U)
+#define AUDIO_MIC_SAI_BLOCK                   SAI1_Block_A
+#define AUDIO_MIC_SAI_CLK_ENABLE()            __HAL_RCC_SAI1_CLK_ENABLE()
+#define AUDIO_MIC_SAI_CLK_DISABLE()           __HAL_RCC_SAI1_CLK_DISABLE()
+#define AUDIO_MIC_SAI_PERIPHCLK               RCC_PERIPHCLK_SAI1
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+#define AUDIO_MIC_SAI_CLKSOURCE               RCC_SAI1CLKSOURCE_PIN
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#define AUDIO_MIC_SAI_CLKSOURCE               RCC_SAI1CLKSOURCE_PLL2
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+/* PE2 CK1, PE6 D1, PE4 D2 */
+#define AUDIO_MIC_SAI_CLK_GPIO_PORT           GPIOE
+#define AUDIO_MIC_SAI_CLK_GPIO_PINS           GPIO_PIN_2
+#define AUDIO_MIC_SAI_SD_GPIO_PORT            GPIOE
+#if (AUDIO_MIC_PDM_PAIRS > 1)
+#define AUDIO_MIC_SAI_SD_GPIO_PINS            (GPIO_PIN_6 | GPIO_PIN_4)
+#else /* AUDIO_MIC_PDM_PAIRS */
+#define AUDIO_MIC_SAI_SD_GPIO_PINS            GPIO_PIN_6
+#endif /* AUDIO_MIC_PDM_PAIRS */
+#define AUDIO_MIC_SAI_GPIO_AF                 GPIO_AF2_SAI1
+#define AUDIO_MIC_SAI_GPIO_CLK_ENABLE()       __HAL_RCC_GPIOE_CLK_ENABLE()
+#define AUDIO_MIC_DMA_STREAM                  DMA1_Stream1
+#define AUDIO_MIC_DMA_REQUEST                 DMA_REQUEST_SAI1_A
+#define AUDIO_MIC_DMA_CLK_ENABLE()            __HAL_RCC_DMA1_CLK_ENABLE()
+#define AUDIO_MIC_DMA_IRQn                    DMA1_Stream1_IRQn
+#define AUDIO_MIC_DMA_IRQHandler              DMA1_Stream1_IRQHandler
+#define AUDIO_MIC_DMA_IRQ_PRIORITY            1U
+
+/* each DMA half holds one ms of PDM frames, it is decimated to the session
+   ring as soon as the DMA starts writing the other half. A PDM frame is one
+   byte per mic of the pairs, 8 PDM frames make a PCM frame */
+#define AUDIO_MIC_DMA_HALF_MS                 1U
+#define AUDIO_MIC_PDM_FRAME_BYTES             (2U * AUDIO_MIC_PDM_PAIRS)
+#define AUDIO_MIC_DMA_HALF_MAX_FRAMES         (((USB_AUDIO_CONFIG_RECORD_FREQ_MAX + 999U) / 1000U) * \
+                                               AUDIO_MIC_DMA_HALF_MS)
+#define AUDIO_MIC_DMA_BUFFER_SIZE             (2U * AUDIO_MIC_DMA_HALF_MAX_FRAMES * 8U * AUDIO_MIC_PDM_FRAME_BYTES)
+#elif !defined(USE_AUDIO_DUMMY_MIC)
+#ifndef HAL_SAI_MODULE_ENABLED
+#error "the SAI mic needs HAL_SAI_MODULE_ENABLED and the HAL SAI driver"
+#endif /* HAL_SAI_MODULE_ENABLED */
+/* mic : SAI1 block B master receiver, I2S standard, MCLK = 256 fs. It owns its
+   clocks so recording runs whether the speaker is streaming or not. Both blocks
+   share the SAI1 kernel clock, so play and record must be of the same family.
+   Channels are slots of a TDM frame as for the speaker */
+#if (USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT > 2) && ((USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT & 1) != 0)
+#error "the SAI mic needs 1, 2 or an even count of channels"
+#endif /* USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT */
+#define AUDIO_MIC_SAI_BLOCK                   SAI1_Block_B
+#define AUDIO_MIC_SAI_CLK_ENABLE()            __HAL_RCC_SAI1_CLK_ENABLE()
+#define AUDIO_MIC_SAI_CLK_DISABLE()           __HAL_RCC_SAI1_CLK_DISABLE()
+#define AUDIO_MIC_SAI_PERIPHCLK               RCC_PERIPHCLK_SAI1
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+#define AUDIO_MIC_SAI_CLKSOURCE               RCC_SAI1CLKSOURCE_PIN
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#define AUDIO_MIC_SAI_CLKSOURCE               RCC_SAI1CLKSOURCE_PLL2
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+/* PF7 MCLK, PF8 SCK, PF9 FS, PE3 SD */
+#define AUDIO_MIC_SAI_CLK_GPIO_PORT           GPIOF
+#define AUDIO_MIC_SAI_CLK_GPIO_PINS           (GPIO_PIN_7 | GPIO_PIN_8 | GPIO_PIN_9)
+#define AUDIO_MIC_SAI_SD_GPIO_PORT            GPIOE
+#define AUDIO_MIC_SAI_SD_GPIO_PINS            GPIO_PIN_3
+#define AUDIO_MIC_SAI_GPIO_AF                 GPIO_AF6_SAI1
+#define AUDIO_MIC_SAI_GPIO_CLK_ENABLE()       do { __HAL_RCC_GPIOE_CLK_ENABLE(); \
+                                                   __HAL_RCC_GPIOF_CLK_ENABLE(); } while(0)
+#define AUDIO_MIC_DMA_STREAM                  DMA1_Stream1
+#define AUDIO_MIC_DMA_REQUEST                 DMA_REQUEST_SAI1_B
+#define AUDIO_MIC_DMA_CLK_ENABLE()            __HAL_RCC_DMA1_CLK_ENABLE()
+#define AUDIO_MIC_DMA_IRQn                    DMA1_Stream1_IRQn
+#define AUDIO_MIC_DMA_IRQHandler              DMA1_Stream1_IRQHandler
+#define AUDIO_MIC_DMA_IRQ_PRIORITY            1U
+
+/* each DMA half holds one ms of audio, it is moved to the session ring as soon
+   as the DMA starts writing the other half */
+#define AUDIO_MIC_DMA_HALF_MS                 1U
+#define AUDIO_MIC_DMA_HALF_MAX_SAMPLES        (((USB_AUDIO_CONFIG_RECORD_FREQ_MAX + 999U) / 1000U) * \
+                                               AUDIO_MIC_DMA_HALF_MS * USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT)
+/* 24 and 32 bits samples are received in 32 bits words */
+#define AUDIO_MIC_DMA_BUFFER_SIZE             (2U * AUDIO_MIC_DMA_HALF_MAX_SAMPLES * 4U)
+#endif /* USE_AUDIO_MEMS_MIC */
+
+#if !defined(USE_AUDIO_SPEAKER_DUMMY) || !defined(USE_AUDIO_DUMMY_MIC)
+/* SAI slot data size from the USB container : 16 bits, packed 24 bits (S24_3LE,
+   handled right aligned in 32 bits words) or 32 bits */
+#define AUDIO_SAI_PROTOCOL_DATASIZE(res)      (((res) == 2U) ? SAI_PROTOCOL_DATASIZE_16BIT : \
+                                               (((res) == 3U) ? SAI_PROTOCOL_DATASIZE_24BIT : \
+                                                SAI_PROTOCOL_DATASIZE_32BIT))
+#endif /* !USE_AUDIO_SPEAKER_DUMMY || !USE_AUDIO_DUMMY_MIC */
+
+#ifdef USE_AUDIO_SOF_TIMESTAMP
+/* SOF timestamp : TIM2 is clocked through its ETR by the audio clock and its
+   channel 1 latches the counter on the OTG_HS SOF (ITR5) */
+#define AUDIO_SOF_TS_TIM                      TIM2
+#define AUDIO_SOF_TS_TIM_CLK_ENABLE()         __HAL_RCC_TIM2_CLK_ENABLE()
+#define AUDIO_SOF_TS_TIM_CLK_DISABLE()        __HAL_RCC_TIM2_CLK_DISABLE()
+#define AUDIO_SOF_TS_TRIGGER                  TIM_TS_ITR5
+#ifdef USE_AUDIO_SOF_TIMESTAMP_MCLK
+/* MCLK is wired to TIM2_ETR (PA0), 256 ticks per frame give sub-sample precision */
+#define AUDIO_SOF_TS_ETR_REMAP                TIM_TIM2_ETR_GPIO
+#define AUDIO_SOF_TS_TICKS_PER_FRAME          256U
+#define AUDIO_SOF_TS_GPIO_PORT                GPIOA
+#define AUDIO_SOF_TS_GPIO_PIN                 GPIO_PIN_0
+#define AUDIO_SOF_TS_GPIO_AF                  GPIO_AF1_TIM2
+#define AUDIO_SOF_TS_GPIO_CLK_ENABLE()        __HAL_RCC_GPIOA_CLK_ENABLE()
+#else /* USE_AUDIO_SOF_TIMESTAMP_MCLK */
+/* the frame sync of the clock owner is counted internally, no wiring needed */
+#ifdef USE_AUDIO_MEMS_MIC
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+#define AUDIO_SOF_TS_ETR_REMAP                TIM_TIM2_ETR_SAI1_FSB
+#define AUDIO_SOF_TS_TICKS_PER_FRAME          1U
+#else /* USE_AUDIO_SPEAKER_DUMMY */
+/* a PDM frame lasts 8 PDM clocks, 8 per PCM frame */
+#define AUDIO_SOF_TS_ETR_REMAP                TIM_TIM2_ETR_SAI1_FSA
+#define AUDIO_SOF_TS_TICKS_PER_FRAME          8U
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#else /* USE_AUDIO_MEMS_MIC */
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+#define AUDIO_SOF_TS_ETR_REMAP                TIM_TIM2_ETR_SAI1_FSA
+#else /* USE_AUDIO_SPEAKER_DUMMY */
+#define AUDIO_SOF_TS_ETR_REMAP                TIM_TIM2_ETR_SAI1_FSB
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#define AUDIO_SOF_TS_TICKS_PER_FRAME          1U
+#endif /* USE_AUDIO_MEMS_MIC */
+#endif /* USE_AUDIO_SOF_TIMESTAMP_MCLK */
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+
+#ifdef USE_AUDIO_SOF_JITTER
+/* SOF jitter monitor : TIM2 runs free on its kernel clock and its channel 1
+   latches the counter on the OTG_HS SOF (ITR5) */
+#define AUDIO_SOF_JITTER_TIM                  TIM2
+#define AUDIO_SOF_JITTER_TIM_CLK_ENABLE()     __HAL_RCC_TIM2_CLK_ENABLE()
+#define AUDIO_SOF_JITTER_TIM_CLK_DISABLE()    __HAL_RCC_TIM2_CLK_DISABLE()
+#define AUDIO_SOF_JITTER_TRIGGER              TIM_TS_ITR5
+#endif /* USE_AUDIO_SOF_JITTER */
+
+#ifdef USE_AUDIO_MDMA_COPY
+/* MDMA copies between the SAI DMA halves and the session rings, one channel
+   per node */
+#define AUDIO_COPY_SPEAKER_MDMA_CHANNEL       MDMA_Channel0
+#define AUDIO_COPY_MIC_MDMA_CHANNEL           MDMA_Channel1
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+#define AUDIO_COPY_DELAY_MDMA_CHANNEL         MDMA_Channel2
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+#define AUDIO_COPY_MDMA_CLK_ENABLE()          __HAL_RCC_MDMA_CLK_ENABLE()
+#define AUDIO_COPY_MDMA_IRQn                  MDMA_IRQn
+#define AUDIO_COPY_MDMA_IRQHandler            MDMA_IRQHandler
+/* as the SAI DMA, the end of a copy started by a refill runs after it */
+#define AUDIO_COPY_MDMA_IRQ_PRIORITY          1U
+#endif /* USE_AUDIO_MDMA_COPY */
+
+#ifdef USE_AUDIO_PLAYBACK_LONG_DELAY
+/* long delay store : PSRAM on OCTOSPI1, set up and switched to memory mapped
+   mode by the board code before the playback starts. MPU_Config maps it with
+   full access and not cacheable, base aligned on the size. The node is left
+   out while the OCTOSPI is in another mode */
+#define AUDIO_LONG_DELAY_OSPI                 OCTOSPI1
+#ifndef AUDIO_LONG_DELAY_STORE_BASE
+#define AUDIO_LONG_DELAY_STORE_BASE           OCTOSPI1_BASE
+#endif /* AUDIO_LONG_DELAY_STORE_BASE */
+/* bytes, must be a power of two : 64 Mbits, 29 s of 48 kHz stereo 24 bits */
+#ifndef AUDIO_LONG_DELAY_STORE_SIZE
+#define AUDIO_LONG_DELAY_STORE_SIZE           0x800000U
+#endif /* AUDIO_LONG_DELAY_STORE_SIZE */
+#endif /* USE_AUDIO_PLAYBACK_LONG_DELAY */
+
+#if (defined USE_AUDIO_CLOCK_SOF_OUTPUT) || (defined USE_AUDIO_CLOCK_SELECTOR)
+/* external audio PLL, locked on the OTG_HS SOF output (PA8) or with
+   USE_AUDIO_CLOCK_SELECTOR on the studio word clock or S/PDIF receiver : it
+   runs at EXTERNAL_CLOCK_VALUE and clocks SAI1 through I2S_CKIN (PC9) in place of PLL2 */
+#define AUDIO_EXT_CLK_GPIO_PORT               GPIOC
+#define AUDIO_EXT_CLK_GPIO_PIN                GPIO_PIN_9
+#define AUDIO_EXT_CLK_GPIO_AF                 GPIO_AF5_SPI1 /* I2S_CKIN */
+#define AUDIO_EXT_CLK_GPIO_CLK_ENABLE()       __HAL_RCC_GPIOC_CLK_ENABLE()
+#define AUDIO_EXT_CLK_MCLK_RATIO              256U /* SAI masters divide it down to 256 * fs */
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT || USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* lock output of the external PLL, high while it follows the word clock (PC8) */
+#define AUDIO_EXT_CLK_LOCK_GPIO_PORT          GPIOC
+#define AUDIO_EXT_CLK_LOCK_GPIO_PIN           GPIO_PIN_8
+#define AUDIO_EXT_CLK_LOCK_ACTIVE             GPIO_PIN_SET
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+/* enable input of the speaker amplifier (PG3), high to power its output stage */
+#define AUDIO_SPEAKER_AMP_GPIO_PORT           GPIOG
+#define AUDIO_SPEAKER_AMP_GPIO_PIN            GPIO_PIN_3
+#define AUDIO_SPEAKER_AMP_ON                  GPIO_PIN_SET
+#define AUDIO_SPEAKER_AMP_OFF                 GPIO_PIN_RESET
+#define AUDIO_SPEAKER_AMP_GPIO_CLK_ENABLE()   __HAL_RCC_GPIOG_CLK_ENABLE()
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+
+/* Exported types ------------------------------------------------------------*/
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+/* SAI speaker node data */
+typedef struct
+{
+  SAI_HandleTypeDef*    hsai;
+  uint8_t*              dma_buffer;       /* two halves played in circular mode */
+  uint16_t              half_samples;     /* samples of all channels in one half */
+  uint16_t              half_ring_bytes;  /* ring bytes consumed to refill one half */
+  uint16_t              dma_pos;          /* DMA position in samples at last read count */
+  uint8_t               sample_size;      /* bytes per sample in DMA buffer , 2 or 4 */
+  uint8_t               channel_mute;     /* bit n set when channel n + 1 is muted */
+#ifdef USE_AUDIO_PLAYBACK_CONCEALMENT
+  uint8_t               concealed;        /* halves played without data since the last underrun */
+#endif /* USE_AUDIO_PLAYBACK_CONCEALMENT */
+#ifdef USE_AUDIO_MDMA_COPY
+  uint8_t*              fill_half;        /* half being filled by the MDMA */
+#endif /* USE_AUDIO_MDMA_COPY */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  volatile uint8_t      local;            /* the SAI plays a clip while the host doesn't stream */
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_PLAYBACK_FIXED_RATE
+  volatile uint8_t      running;          /* the SAI plays silence across a rate change */
+  uint32_t              count_residue;    /* played samples not counted yet at the stream rate, in 1 / AUDIO_SPEAKER_FIXED_RATE */
+  AUDIO_UpsamplerTypeDef upsampler;       /* stream rate to AUDIO_SPEAKER_FIXED_RATE */
+#endif /* USE_AUDIO_PLAYBACK_FIXED_RATE */
+}
+AUDIO_Speaker_SpecificTypeDef;
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+
+#ifdef USE_AUDIO_MEMS_MIC
+/* MEMS mic node data */
+typedef struct
+{
+  SAI_HandleTypeDef*      hsai;
+  uint8_t*                dma_buffer;       /* two halves of PDM frames written in circular mode */
+  int32_t*                pcm;              /* decimated half, 24 bits right aligned */
+  uint16_t                half_pdm_frames;  /* PDM frames in one half */
+  uint16_t                half_ring_bytes;  /* ring bytes produced by one half */
+  uint16_t                dma_pos;          /* DMA position in PCM frames at last read count */
+  uint8_t                 channel_mute;     /* bit n set when channel n + 1 is muted */
+  AUDIO_PDM_FilterTypeDef filter;
+#ifdef USE_AUDIO_DITHER
+  AUDIO_DitherTypeDef     dither;           /* 24 bits decimated samples to 16 bits recording */
+#endif /* USE_AUDIO_DITHER */
+#ifdef USE_AUDIO_MIC_BEAMFORMER
+  AUDIO_BeamformerTypeDef beamformer;       /* decimated mics to the recorded beams */
+#endif /* USE_AUDIO_MIC_BEAMFORMER */
+}
+AUDIO_Mic_SpecificTypeDef;
+#elif !defined(USE_AUDIO_DUMMY_MIC)
+/* SAI mic node data */
+typedef struct
+{
+  SAI_HandleTypeDef*    hsai;
+  uint8_t*              dma_buffer;       /* two halves written in circular mode */
+  uint16_t              half_samples;     /* samples of all channels in one half */
+  uint16_t              half_ring_bytes;  /* ring bytes produced by one half */
+  uint16_t              dma_pos;          /* DMA position in samples at last read count */
+  uint8_t               sample_size;      /* bytes per sample in DMA buffer , 2 or 4 */
+  uint8_t               channel_mute;     /* bit n set when channel n + 1 is muted */
+}
+AUDIO_Mic_SpecificTypeDef;
+#endif /* USE_AUDIO_MEMS_MIC */
+
+/* Exported variables --------------------------------------------------------*/
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+extern SAI_HandleTypeDef hsai_BlockA1;
+extern DMA_HandleTypeDef hdma_sai1_a;
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+extern SAI_HandleTypeDef hsai_BlockB1;
+extern DMA_HandleTypeDef hdma_sai1_b;
+#endif /* USE_AUDIO_DUMMY_MIC */
+
+/* Exported functions ------------------------------------------------------- */
+int8_t AUDIO_USER_ClockConfig(uint32_t frequency);
+#ifdef USE_AUDIO_IDLE_POWER
+void   AUDIO_USER_ClockLost(void);
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifndef USE_AUDIO_CLOCK_SOF_OUTPUT
+int8_t AUDIO_USER_ClockTrim(int32_t rate_error, uint32_t nominal_rate);
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+void    AUDIO_USER_ClockSelect(uint8_t external);
+uint8_t AUDIO_USER_ClockIsLocked(void);
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifndef USE_AUDIO_SPEAKER_DUMMY
+void   AUDIO_SPEAKER_USER_ErrorCallback(SAI_HandleTypeDef *hsai);
+#ifdef USE_AUDIO_PLAYBACK_SILENCE_POWER
+void   AUDIO_USER_SpeakerAmpPower(uint8_t on);
+#endif /* USE_AUDIO_PLAYBACK_SILENCE_POWER */
+#endif /* USE_AUDIO_SPEAKER_DUMMY */
+#ifndef USE_AUDIO_DUMMY_MIC
+void   AUDIO_USER_MicErrorCallback(SAI_HandleTypeDef *hsai);
+#endif /* USE_AUDIO_DUMMY_MIC */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_USER_DEVICES_H */
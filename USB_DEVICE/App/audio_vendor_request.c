@@ -0,0 +1,257 @@
+/**
+  ******************************************************************************
+  * @file    audio_vendor_request.c
+  * @brief   Vendor control requests of the audio function : session stats,
+  *          trace snapshots and parameter sets over EP0, for hosts which
+  *          can't open the CDC port. Requests are answered from the USB
+  *          interrupt out of one DMA reachable block the stats are written
+  *          to, with no staging copy. Parameter sets are acknowledged at once
+  *          and applied from the pump, so the status stage and the class
+  *          requests after it never wait for a session.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_vendor_request.h"
+
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+#include "usbd_conf.h"
+#include "usbd_audio_if.h"
+#include "audio_pump.h"
+#ifdef USE_AUDIO_TRACE
+#include "audio_trace.h"
+#endif /* USE_AUDIO_TRACE */
+
+#if (AUDIO_VENDOR_REQ_MAX_LENGTH & 3U) != 0U
+#error "AUDIO_VENDOR_REQ_MAX_LENGTH must be a multiple of 4"
+#endif /* AUDIO_VENDOR_REQ_MAX_LENGTH */
+
+/* Private defines -----------------------------------------------------------*/
+#define AUDIO_VENDOR_REQ_INFO_SIZE        4U
+#define AUDIO_VENDOR_REQ_TRACE_HEADER     8U /* mode, frozen, count, lost */
+#define AUDIO_VENDOR_REQ_PARAMS_SIZE      8U /* pending, count, reserved, failed */
+
+/* Private variables ---------------------------------------------------------*/
+/* IN responses, sent by the USB DMA when it is used. Rewritten by each request,
+   a request only comes after the data stage of the previous one */
+__ALIGN_BEGIN static uint32_t vendor_block[AUDIO_VENDOR_REQ_MAX_LENGTH / 4U] __ALIGN_END USBD_BUFFER_BSS;
+/* last parameter set, received in place and read by the pump */
+__ALIGN_BEGIN static uint8_t  vendor_params[AUDIO_VENDOR_REQ_MAX_PARAMS * AUDIO_VENDOR_REQ_PARAM_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+static volatile uint8_t  vendor_params_pending = 0; /* received, not applied yet */
+static uint8_t           vendor_params_count = 0;
+static uint32_t          vendor_params_failed = 0;  /* entries the session refused */
+
+/* Private function prototypes -----------------------------------------------*/
+static void     AUDIO_VendorRequestApply(void);
+static uint8_t  AUDIO_VendorRequestSessionToFunction(uint16_t session);
+static uint8_t* AUDIO_VendorRequestPut32(uint8_t* dst, uint32_t value);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_VendorRequestInit
+  *         registers the parameter sets handler in the pump, must be called
+  *         after AUDIO_PumpInit
+  * @param  None
+  * @retval None
+  */
+void AUDIO_VendorRequestInit(void)
+{
+  vendor_params_pending = 0;
+  vendor_params_count = 0;
+  vendor_params_failed = 0;
+  AUDIO_PumpSetHandler(AUDIO_PUMP_VENDOR_REQUEST, AUDIO_VendorRequestApply);
+}
+
+/**
+  * @brief  AUDIO_VendorRequestSetup
+  *         checks a request and prepares its data stage. IN responses are
+  *         built in the block, the class sends at most the host length
+  * @param  request: AUDIO_VENDOR_REQ_xxx
+  * @param  value: wValue
+  * @param  length: wLength
+  * @param  is_in: 1 for a device to host request
+  * @param  data: data stage buffer
+  * @param  response_length: IN response length
+  * @retval 0 if the request is accepted, -1 to stall it
+  */
+int8_t AUDIO_VendorRequestSetup(uint8_t request, uint16_t value, uint16_t length, uint8_t is_in,
+                                uint8_t** data, uint16_t* response_length)
+{
+  uint8_t* ptr = (uint8_t*)vendor_block;
+  uint8_t  func;
+#ifdef USE_AUDIO_TRACE
+  uint32_t max;
+  uint32_t count;
+#endif /* USE_AUDIO_TRACE */
+
+  *data = ptr;
+  *response_length = 0;
+  if(is_in == 0U)
+  {
+    if((request != AUDIO_VENDOR_REQ_SET_PARAMS) || (length == 0U) || (length > sizeof(vendor_params)) ||
+       ((length % AUDIO_VENDOR_REQ_PARAM_SIZE) != 0U) || vendor_params_pending)
+    {
+      return -1;
+    }
+    *data = vendor_params;
+    return 0;
+  }
+
+  switch(request)
+  {
+    case AUDIO_VENDOR_REQ_GET_INFO:
+      *ptr++ = AUDIO_VENDOR_REQ_VERSION;
+#ifdef USE_AUDIO_TRACE
+      *ptr++ = AUDIO_VENDOR_REQ_FEATURE_TRACE;
+#else /* USE_AUDIO_TRACE */
+      *ptr++ = 0;
+#endif /* USE_AUDIO_TRACE */
+      *ptr++ = (uint8_t)AUDIO_VENDOR_REQ_MAX_LENGTH;
+      *ptr++ = (uint8_t)(AUDIO_VENDOR_REQ_MAX_LENGTH >> 8);
+      *response_length = AUDIO_VENDOR_REQ_INFO_SIZE;
+      return 0;
+
+    case AUDIO_VENDOR_REQ_GET_STATS:
+      /* written in place, the data stage reads the session counters from here */
+      if((sizeof(AUDIO_USB_SessionStatsTypeDef) > sizeof(vendor_block)) ||
+         ((func = AUDIO_VendorRequestSessionToFunction(value)) == 0U) ||
+         (USBD_AUDIO_GetSessionStats(func, (AUDIO_USB_SessionStatsTypeDef*)vendor_block) != 0))
+      {
+        return -1;
+      }
+      *response_length = sizeof(AUDIO_USB_SessionStatsTypeDef);
+      return 0;
+
+#ifdef USE_AUDIO_TRACE
+    case AUDIO_VENDOR_REQ_GET_TRACE:
+      if(length < AUDIO_VENDOR_REQ_TRACE_HEADER)
+      {
+        return -1;
+      }
+      max = (((length < AUDIO_VENDOR_REQ_MAX_LENGTH) ? length : AUDIO_VENDOR_REQ_MAX_LENGTH) -
+             AUDIO_VENDOR_REQ_TRACE_HEADER) / sizeof(AUDIO_TraceRecordTypeDef);
+      count = AUDIO_TraceSnapshot((AUDIO_TraceRecordTypeDef*)(ptr + AUDIO_VENDOR_REQ_TRACE_HEADER), value, max);
+      *ptr++ = AUDIO_TraceGetMode();
+      *ptr++ = AUDIO_TraceIsFrozen();
+      *ptr++ = (uint8_t)count;
+      *ptr++ = (uint8_t)(count >> 8);
+      (void)AUDIO_VendorRequestPut32(ptr, AUDIO_TraceGetLost());
+      *response_length = (uint16_t)(AUDIO_VENDOR_REQ_TRACE_HEADER + count * sizeof(AUDIO_TraceRecordTypeDef));
+      return 0;
+#endif /* USE_AUDIO_TRACE */
+
+    case AUDIO_VENDOR_REQ_GET_PARAMS:
+      *ptr++ = vendor_params_pending;
+      *ptr++ = vendor_params_count;
+      *ptr++ = 0;
+      *ptr++ = 0;
+      (void)AUDIO_VendorRequestPut32(ptr, vendor_params_failed);
+      *response_length = AUDIO_VENDOR_REQ_PARAMS_SIZE;
+      return 0;
+
+    default:
+      return -1;
+  }
+}
+
+/**
+  * @brief  AUDIO_VendorRequestReceived
+  *         hands a received parameter set to the pump
+  * @param  request: AUDIO_VENDOR_REQ_xxx
+  * @param  length: received length, checked by AUDIO_VendorRequestSetup
+  * @retval None
+  */
+void AUDIO_VendorRequestReceived(uint8_t request, uint16_t length)
+{
+  if(request != AUDIO_VENDOR_REQ_SET_PARAMS)
+  {
+    return;
+  }
+  vendor_params_count = (uint8_t)(length / AUDIO_VENDOR_REQ_PARAM_SIZE);
+  vendor_params_failed = 0;
+  vendor_params_pending = 1;
+  AUDIO_PumpPost(AUDIO_PUMP_VENDOR_REQUEST);
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_VendorRequestApply
+  *         pump handler, sets the parameters of the last set in order. An
+  *         entry the session refuses doesn't stop the next ones
+  * @param  None
+  * @retval None
+  */
+static void AUDIO_VendorRequestApply(void)
+{
+  const uint8_t* entry = vendor_params;
+  uint32_t failed = 0;
+  int32_t  value;
+  uint8_t  func;
+  uint8_t  i;
+
+  if(vendor_params_pending == 0U)
+  {
+    return;
+  }
+  for(i = 0; i < vendor_params_count; i++, entry += AUDIO_VENDOR_REQ_PARAM_SIZE)
+  {
+    value = (int32_t)((uint32_t)entry[4] | ((uint32_t)entry[5] << 8) |
+                      ((uint32_t)entry[6] << 16) | ((uint32_t)entry[7] << 24));
+    if(((func = AUDIO_VendorRequestSessionToFunction(entry[0])) == 0U) ||
+       (entry[1] > (uint8_t)AUDIO_USB_PARAM_CHAIN) ||
+       (USBD_AUDIO_SetSessionParameter(func, (AUDIO_USB_SessionParamTypedef)entry[1],
+                                       (uint16_t)(entry[2] | (entry[3] << 8)), value) != 0))
+    {
+      failed |= 1UL << i;
+    }
+  }
+  vendor_params_failed = failed;
+  __DMB();
+  vendor_params_pending = 0;
+}
+
+/**
+  * @brief  AUDIO_VendorRequestSessionToFunction
+  *         maps a request session number to an audio function
+  * @param  session: AUDIO_VENDOR_REQ_SESSION_xxx
+  * @retval USBD_AUDIO_PLAYBACK, USBD_AUDIO_RECORD or 0 if unknown
+  */
+static uint8_t AUDIO_VendorRequestSessionToFunction(uint16_t session)
+{
+  switch(session)
+  {
+    case AUDIO_VENDOR_REQ_SESSION_PLAYBACK:
+      return USBD_AUDIO_PLAYBACK;
+    case AUDIO_VENDOR_REQ_SESSION_RECORD:
+      return USBD_AUDIO_RECORD;
+    default:
+      return 0;
+  }
+}
+
+/**
+  * @brief  AUDIO_VendorRequestPut32
+  *         writes a 32 bits value little endian
+  * @param  dst: destination
+  * @param  value: value
+  * @retval next destination byte
+  */
+static uint8_t* AUDIO_VendorRequestPut32(uint8_t* dst, uint32_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+  dst[2] = (uint8_t)(value >> 16);
+  dst[3] = (uint8_t)(value >> 24);
+  return dst + 4;
+}
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
@@ -0,0 +1,68 @@
+/**
+  ******************************************************************************
+  * @file    audio_vendor_request.h
+  * @brief   header file for the audio_vendor_request.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_VENDOR_REQUEST_H
+#define __AUDIO_VENDOR_REQUEST_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+#ifdef USE_AUDIO_VENDOR_REQUESTS
+/* Exported constants --------------------------------------------------------*/
+/* vendor requests to an interface of the audio function, bmRequestType 0xC1 for IN, 0x41 for OUT */
+#define AUDIO_VENDOR_REQ_GET_INFO         0x01U /* IN : version, features mask, max length 16 bits */
+#define AUDIO_VENDOR_REQ_GET_STATS        0x02U /* IN , wValue session : AUDIO_USB_SessionStatsTypeDef as laid out in memory */
+#define AUDIO_VENDOR_REQ_GET_TRACE        0x03U /* IN , wValue newest records to skip : mode, frozen, count 16 bits, lost,
+                                                   then count AUDIO_TraceRecordTypeDef oldest first , USE_AUDIO_TRACE */
+#define AUDIO_VENDOR_REQ_SET_PARAMS       0x04U /* OUT : entries of session, param, channel 16 bits, int32 value,
+                                                   applied in order from the pump. Stalled while a set is pending */
+#define AUDIO_VENDOR_REQ_GET_PARAMS       0x05U /* IN : pending, entries of the last set, 2 reserved, failed entries mask 32 bits */
+
+#define AUDIO_VENDOR_REQ_VERSION          0x01U
+/* GET_INFO features mask */
+#define AUDIO_VENDOR_REQ_FEATURE_TRACE    0x01U
+
+/* wValue and entry session */
+#define AUDIO_VENDOR_REQ_SESSION_PLAYBACK 0x00U
+#define AUDIO_VENDOR_REQ_SESSION_RECORD   0x01U
+
+#define AUDIO_VENDOR_REQ_PARAM_SIZE       8U
+#define AUDIO_VENDOR_REQ_MAX_PARAMS       8U
+/* data stage limit : a response takes EP0 for at most 8 max size packets, so a
+   class request waits no longer behind it. Must be a multiple of 4 */
+#ifndef AUDIO_VENDOR_REQ_MAX_LENGTH
+#define AUDIO_VENDOR_REQ_MAX_LENGTH       512U
+#endif /* AUDIO_VENDOR_REQ_MAX_LENGTH */
+
+/* Exported functions ------------------------------------------------------- */
+void    AUDIO_VendorRequestInit(void);
+/* from the audio class setup, USB interrupt : data is the buffer of the data stage, length the IN response length */
+int8_t  AUDIO_VendorRequestSetup(uint8_t request, uint16_t value, uint16_t length, uint8_t is_in,
+                                 uint8_t** data, uint16_t* response_length);
+/* from the audio class EP0 rx ready, USB interrupt : the OUT data stage of request was received */
+void    AUDIO_VendorRequestReceived(uint8_t request, uint16_t length);
+#endif /* USE_AUDIO_VENDOR_REQUESTS */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_VENDOR_REQUEST_H */
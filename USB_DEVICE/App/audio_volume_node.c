@@ -0,0 +1,375 @@
+/**
+  ******************************************************************************
+  * @file    audio_volume_node.c
+  * @brief   Software volume : per channel gain & mute applied in place on the
+  *          packets received from USB, before they are published to the
+  *          speaker. Gain changes are ramped linearly over one packet so
+  *          volume steps and mute don't click. Fixed point, the dB to gain
+  *          conversion only runs on control requests.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "audio_volume_node.h"
+#include "audio_gain.h"
+
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t  AUDIO_VolumeDeInit(uint32_t node_handle);
+static int8_t  AUDIO_VolumeStart(uint32_t node_handle);
+static int8_t  AUDIO_VolumeStop(uint32_t node_handle);
+static int8_t  AUDIO_VolumeMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle);
+static int8_t  AUDIO_VolumeSetVolume(uint16_t channel_number, int volume_db_256, uint32_t node_handle);
+static int8_t  AUDIO_VolumeProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle) USBD_ITCM_FUNC;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+static int8_t  AUDIO_VolumeProcessFloat(float* planes, uint32_t stride, uint32_t frames,
+                                        uint32_t node_handle) USBD_ITCM_FUNC;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+static void    AUDIO_VolumeUpdateTargets(AUDIO_Volume_NodeTypeDef* volume);
+static int32_t AUDIO_VolumeDbToGain(int volume_db_256);
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  AUDIO_VolumeInit
+  *         Initializes the software volume node, all channels at unity gain
+  * @param  audio_description: audio parameters
+  * @param  session_handle:   session handle
+  * @param  node_handle:      volume node handle must be allocated
+  * @retval 0 if no error
+  */
+int8_t  AUDIO_VolumeInit(AUDIO_DescriptionTypeDef* audio_description,
+                         AUDIO_SessionTypeDef* session_handle,
+                         uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+
+  if(audio_description->channels_count > AUDIO_MAX_SUPPORTED_CHANNEL_COUNT)
+  {
+    return -1;
+  }
+  memset(volume, 0, sizeof(AUDIO_Volume_NodeTypeDef));
+  volume->processing.node.state = AUDIO_NODE_INITIALIZED;
+  volume->processing.node.type = AUDIO_PROCESSING;
+  volume->processing.node.session_handle = session_handle;
+  volume->processing.node.audio_description = audio_description;
+
+  volume->VolumeDeInit = AUDIO_VolumeDeInit;
+  volume->VolumeStart = AUDIO_VolumeStart;
+  volume->VolumeStop = AUDIO_VolumeStop;
+  volume->VolumeMute = AUDIO_VolumeMute;
+  volume->VolumeSetVolume = AUDIO_VolumeSetVolume;
+  volume->processing.Process = AUDIO_VolumeProcess;
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+  volume->processing.ProcessFloat = AUDIO_VolumeProcessFloat;
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+  AUDIO_VolumeUpdateTargets(volume);
+  return 0;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  AUDIO_VolumeDeInit
+  *         De-Initializes the software volume node
+  * @param  node_handle: volume node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeDeInit(uint32_t node_handle)
+{
+  ((AUDIO_Volume_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_OFF;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VolumeStart
+  *         Starts processing, first packet fades in from silence. The
+  *         kernels of the stream format are picked here
+  * @param  node_handle: volume node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeStart(uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+
+#ifdef USE_AUDIO_PCM_KERNELS
+  volume->kernels = AUDIO_PcmKernelsSelect(volume->processing.node.audio_description->audio_res,
+                                           volume->processing.node.audio_description->channels_count);
+  if(volume->kernels == 0)
+  {
+    return -1;
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+  memset(volume->gain, 0, sizeof(volume->gain));
+  AUDIO_VolumeUpdateTargets(volume);
+  volume->processing.node.state = AUDIO_NODE_STARTED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VolumeStop
+  *         Stops processing, packets are left untouched
+  * @param  node_handle: volume node handle must be started
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeStop(uint32_t node_handle)
+{
+  ((AUDIO_Volume_NodeTypeDef*)node_handle)->processing.node.state = AUDIO_NODE_STOPPED;
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VolumeMute
+  *         Sets mute of master (channel 0) or of one channel
+  * @param  channel_number: 0 for master, 1..n for a channel
+  * @param  mute: 1 to mute, 0 to unmute
+  * @param  node_handle: volume node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeMute(uint16_t channel_number, uint8_t mute, uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+
+  if(channel_number > volume->processing.node.audio_description->channels_count)
+  {
+    return -1;
+  }
+  volume->mute[channel_number] = mute;
+  AUDIO_VolumeUpdateTargets(volume);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VolumeSetVolume
+  *         Sets volume of master (channel 0) or of one channel
+  * @param  channel_number: 0 for master, 1..n for a channel
+  * @param  volume_db_256: volume in db 8.8 format
+  * @param  node_handle: volume node handle must be initialized
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeSetVolume(uint16_t channel_number, int volume_db_256, uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+
+  if(channel_number > volume->processing.node.audio_description->channels_count)
+  {
+    return -1;
+  }
+  volume->volume_db_256[channel_number] = volume_db_256;
+  AUDIO_VolumeUpdateTargets(volume);
+  return 0;
+}
+
+/**
+  * @brief  AUDIO_VolumeProcess
+  *         Applies the gains on frames, each gain moves from its value at the
+  *         end of last call to its target by equal steps, so it reaches the
+  *         target exactly on the last frame. Samples are saturated, 2, 3 or
+  *         4 bytes little endian
+  * @param  in: input frames
+  * @param  out: output frames , may be in
+  * @param  frames: frames count
+  * @param  node_handle: volume node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeProcess(uint8_t* in, uint8_t* out, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+  int32_t gain[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  int32_t step[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];
+  uint8_t channels = volume->processing.node.audio_description->channels_count;
+  uint8_t res = volume->processing.node.audio_description->audio_res;
+  uint8_t unity = 1;
+#ifndef USE_AUDIO_PCM_KERNELS
+  uint32_t i;
+#endif /* USE_AUDIO_PCM_KERNELS */
+  uint8_t ch;
+
+  if(frames == 0U)
+  {
+    return 0;
+  }
+  for(ch = 0; ch < channels; ch++)
+  {
+    gain[ch] = volume->gain[ch];
+    step[ch] = (volume->target[ch] - gain[ch]) / (int32_t)frames;
+    if((gain[ch] != AUDIO_VOLUME_GAIN_UNITY) || (volume->target[ch] != AUDIO_VOLUME_GAIN_UNITY))
+    {
+      unity = 0;
+    }
+  }
+  if(unity)
+  {
+    /* bit exact path */
+    if(out != in)
+    {
+      memcpy(out, in, frames * channels * res);
+    }
+    return 0;
+  }
+
+#ifdef USE_AUDIO_PCM_KERNELS
+  volume->kernels->Gain(in, out, frames, channels, gain, step);
+#else /* USE_AUDIO_PCM_KERNELS */
+  switch(res)
+  {
+    case 2:
+    {
+      int16_t* src = (int16_t*)in;
+      int16_t* dst = (int16_t*)out;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          gain[ch] += step[ch];
+          /* Q1.14 gain : 16 x 16 bits product fits 32 bits, single cycle multiply then SSAT */
+          *dst++ = (int16_t)__SSAT(((int32_t)*src++ * (gain[ch] >> 16)) >> 14, 16);
+        }
+      }
+      break;
+    }
+    case 3:
+    {
+      uint8_t* src = in;
+      uint8_t* dst = out;
+      int32_t value;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          gain[ch] += step[ch];
+          value = (int32_t)(((uint32_t)src[0] << 8) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 24)) >> 8;
+          value = (int32_t)(((int64_t)value * gain[ch]) >> AUDIO_VOLUME_GAIN_FRAC_BITS);
+          value = __SSAT(value, 24);
+          dst[0] = (uint8_t)value;
+          dst[1] = (uint8_t)(value >> 8);
+          dst[2] = (uint8_t)(value >> 16);
+          src += 3;
+          dst += 3;
+        }
+      }
+      break;
+    }
+    case 4:
+    {
+      int32_t* src = (int32_t*)in;
+      int32_t* dst = (int32_t*)out;
+      int64_t value;
+
+      for(i = 0; i < frames; i++)
+      {
+        for(ch = 0; ch < channels; ch++)
+        {
+          gain[ch] += step[ch];
+          value = ((int64_t)*src++ * gain[ch]) >> AUDIO_VOLUME_GAIN_FRAC_BITS;
+          *dst++ = (value > INT32_MAX) ? INT32_MAX : ((value < INT32_MIN) ? INT32_MIN : (int32_t)value);
+        }
+      }
+      break;
+    }
+    default:
+      return -1;
+  }
+#endif /* USE_AUDIO_PCM_KERNELS */
+  for(ch = 0; ch < channels; ch++)
+  {
+    volume->gain[ch] = volume->target[ch];
+  }
+  return 0;
+}
+
+#ifdef USE_AUDIO_FLOAT_PIPELINE
+/**
+  * @brief  AUDIO_VolumeProcessFloat
+  *         ramps the gain of each channel plane from the current gain to the
+  *         target, samples are not saturated
+  * @param  planes: float planes, full scale is 1
+  * @param  stride: floats from a plane start to the next one
+  * @param  frames: frames count
+  * @param  node_handle: volume node handle
+  * @retval 0 if no error
+  */
+static int8_t  AUDIO_VolumeProcessFloat(float* planes, uint32_t stride, uint32_t frames, uint32_t node_handle)
+{
+  AUDIO_Volume_NodeTypeDef* volume = (AUDIO_Volume_NodeTypeDef*)node_handle;
+  uint8_t channels = volume->processing.node.audio_description->channels_count;
+  float* plane;
+  float gain, step;
+  uint32_t i;
+  uint8_t ch;
+
+  if(frames == 0U)
+  {
+    return 0;
+  }
+  for(ch = 0; ch < channels; ch++)
+  {
+    if((volume->gain[ch] != AUDIO_VOLUME_GAIN_UNITY) || (volume->target[ch] != AUDIO_VOLUME_GAIN_UNITY))
+    {
+      plane = planes + ch * stride;
+      gain = (float)volume->gain[ch] * (1.0f / (float)AUDIO_VOLUME_GAIN_UNITY);
+      step = ((float)volume->target[ch] * (1.0f / (float)AUDIO_VOLUME_GAIN_UNITY) - gain) / (float)frames;
+      for(i = 0; i < frames; i++)
+      {
+        gain += step;
+        plane[i] *= gain;
+      }
+    }
+    volume->gain[ch] = volume->target[ch];
+  }
+  return 0;
+}
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+
+/**
+  * @brief  AUDIO_VolumeUpdateTargets
+  *         computes the gain of each channel from master and channel controls,
+  *         next packet ramps to it
+  * @param  volume: volume node
+  * @retval None
+  */
+static void AUDIO_VolumeUpdateTargets(AUDIO_Volume_NodeTypeDef* volume)
+{
+  uint8_t channels = volume->processing.node.audio_description->channels_count;
+  uint8_t ch;
+
+  for(ch = 0; ch < channels; ch++)
+  {
+    if(volume->mute[0] || volume->mute[ch + 1])
+    {
+      volume->target[ch] = 0;
+    }
+    else
+    {
+      volume->target[ch] = AUDIO_VolumeDbToGain(volume->volume_db_256[0] + volume->volume_db_256[ch + 1]);
+    }
+  }
+}
+
+/**
+  * @brief  AUDIO_VolumeDbToGain
+  *         converts a volume to a linear gain
+  * @param  volume_db_256: volume in db 8.8 format, limited to AUDIO_VOLUME_MAX_DB_256
+  * @retval gain, Q1.30 format
+  */
+static int32_t AUDIO_VolumeDbToGain(int volume_db_256)
+{
+  if(volume_db_256 > AUDIO_VOLUME_MAX_DB_256)
+  {
+    volume_db_256 = AUDIO_VOLUME_MAX_DB_256;
+  }
+  return AUDIO_GainFromDb256(volume_db_256) >> (AUDIO_GAIN_FRAC_BITS - AUDIO_VOLUME_GAIN_FRAC_BITS);
+}
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    audio_volume_node.h
+  * @brief   header file for the audio_volume_node.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __AUDIO_VOLUME_NODE_H
+#define __AUDIO_VOLUME_NODE_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "audio_usb_nodes.h"
+#include "audio_pcm_kernels.h"
+
+#ifdef USE_AUDIO_PLAYBACK_SOFT_VOLUME
+/* Exported constants --------------------------------------------------------*/
+#define AUDIO_VOLUME_GAIN_FRAC_BITS     30U  /* gains are Q1.30 , +6 dB max is below 2 */
+#define AUDIO_VOLUME_GAIN_UNITY         (1L << AUDIO_VOLUME_GAIN_FRAC_BITS)
+#define AUDIO_VOLUME_MAX_DB_256         1536 /* master plus channel volume is limited to +6 dB */
+
+/* Exported types ------------------------------------------------------------*/
+/* software volume node : applies per channel gain & mute in place on each packet */
+typedef struct
+{
+  AUDIO_ProcessingNodeTypeDef processing;                          /* processing node structure , must be first field */
+  int32_t            gain[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];       /* gain reached at the end of last packet */
+  int32_t            target[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT];     /* gain to reach at the end of next packet */
+  int                volume_db_256[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT + 1]; /* master then channels 1..n */
+  uint8_t            mute[AUDIO_MAX_SUPPORTED_CHANNEL_COUNT + 1];   /* master then channels 1..n */
+#ifdef USE_AUDIO_PCM_KERNELS
+  const AUDIO_PcmKernelsTypeDef* kernels;                           /* of the stream format, picked on start */
+#endif /* USE_AUDIO_PCM_KERNELS */
+  int8_t            (*VolumeDeInit)    (uint32_t /*node_handle*/);
+  int8_t            (*VolumeStart)     (uint32_t /*node_handle*/);
+  int8_t            (*VolumeStop)      (uint32_t /*node_handle*/);
+  int8_t            (*VolumeMute)      (uint16_t /*channel_number*/, uint8_t /*mute */, uint32_t /*node handle*/);
+  int8_t            (*VolumeSetVolume) (uint16_t /*channel_number*/, int /*volume_db_256 */, uint32_t /*node handle*/);
+}
+AUDIO_Volume_NodeTypeDef;
+
+/* Exported functions ------------------------------------------------------- */
+int8_t  AUDIO_VolumeInit(AUDIO_DescriptionTypeDef* audio_description,
+                         AUDIO_SessionTypeDef* session_handle,
+                         uint32_t node_handle);
+#endif /* USE_AUDIO_PLAYBACK_SOFT_VOLUME */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __AUDIO_VOLUME_NODE_H */
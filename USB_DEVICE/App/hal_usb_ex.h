@@ -70,6 +70,10 @@
         + (ep_addr&0x7FU)*USB_OTG_EP_REG_SIZE))->DIEPCTL
 #define USB_DOEPCTL(ep_addr) ((USB_OTG_OUTEndpointTypeDef *)((uint32_t)USB_OTG_BASE_ADDRESS +  \
       USB_OTG_OUT_ENDPOINT_BASE + (ep_addr)*USB_OTG_EP_REG_SIZE))->DOEPCTL
+#define USB_DIEPINT(ep_addr) ((USB_OTG_INEndpointTypeDef *)((uint32_t)USB_OTG_BASE_ADDRESS + USB_OTG_IN_ENDPOINT_BASE   \
+        + (ep_addr&0x7FU)*USB_OTG_EP_REG_SIZE))->DIEPINT
+/* transfer completed , its completion not yet serviced by the PCD driver */
+#define IS_IN_EP_XFER_PENDING(ep_addr) ((USB_DIEPINT(ep_addr) & USB_OTG_DIEPINT_XFRC) != 0U)
 
 #define USB_CLEAR_INCOMPLETE_IN_EP(ep_addr)     if((((ep_addr) & 0x80U) == 0x80U)){  \
             USB_DIEPCTL(ep_addr) |= (USB_OTG_DIEPCTL_EPDIS | USB_OTG_DIEPCTL_SNAK);  \
@@ -89,13 +93,19 @@ if((((ep_addr) & 0x80U) == 0x80U))\
                     USB_OTG_DOEPCTL_MPSIZ); \
   } ;
                                          
+/* FNSOF counts frames on a full speed bus (11 bits) and microframes on a high speed bus (14 bits) */
+#ifdef USE_USB_HS_ULPI_PHY
+#define USB_SOF_NUMBER_MASK 0x3FFF
+#else /* USE_USB_HS_ULPI_PHY */
+#define USB_SOF_NUMBER_MASK 0x7FF
+#endif /* USE_USB_HS_ULPI_PHY */
 #define USB_SOF_NUMBER() ((((USB_OTG_DeviceTypeDef *)((uint32_t )USB_OTG_BASE_ADDRESS + USB_OTG_DEVICE_BASE))->DSTS&USB_OTG_DSTS_FNSOF)>>USB_OTG_DSTS_FNSOF_Pos)
 
 
 
 #define IS_ISO_IN_INCOMPLETE_EP(ep_addr,current_sof, transmit_soffn) ((USB_DIEPCTL(ep_addr)&USB_OTG_DIEPCTL_EPENA_Msk)&&\
                                                           (((current_sof&0x01) == ((USB_DIEPCTL(ep_addr)&USB_OTG_DIEPCTL_EONUM_DPID_Msk)>>USB_OTG_DIEPCTL_EONUM_DPID_Pos))\
-                                                            ||(current_sof== ((transmit_soffn+2)&0x7FF))))
+                                                            ||(current_sof== ((transmit_soffn+2)&USB_SOF_NUMBER_MASK))))
 
 #ifdef __cplusplus
 }
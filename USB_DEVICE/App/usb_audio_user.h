@@ -57,6 +57,10 @@
 #include "audio_node.h"
 /* Exported constants --------------------------------------------------------*/
 /* list of frequencies*/
+#define USB_AUDIO_CONFIG_FREQ_768_K  768000
+#define USB_AUDIO_CONFIG_FREQ_705_6_K 705600
+#define USB_AUDIO_CONFIG_FREQ_384_K  384000
+#define USB_AUDIO_CONFIG_FREQ_352_8_K 352800
 #define USB_AUDIO_CONFIG_FREQ_192_K  192000
 #define USB_AUDIO_CONFIG_FREQ_96_K   96000
 #define USB_AUDIO_CONFIG_FREQ_48_K   48000 
@@ -65,28 +69,115 @@
 #define USB_AUDIO_CONFIG_FREQ_8_K    8000 
 
 #define USB_IRQ_PREPRIO 3
+/* ring and start durations hold at least 4 and 2 packets of AUDIO_USB_PACKET_MS (usbd_audio.h),
+   the allocations add one packet of margin */
+#define AUDIO_USB_RING_MS(ms)      (((ms) > (4U * AUDIO_USB_PACKET_MS)) ? (ms) : (4U * AUDIO_USB_PACKET_MS))
+#define AUDIO_USB_START_MS(ms)     (((ms) > (2U * AUDIO_USB_PACKET_MS)) ? (ms) : (2U * AUDIO_USB_PACKET_MS))
 #ifdef USE_USB_FS_INTO_HS
 #define USB_FIFO_WORD_SIZE  320
 #else /* USE_USB_FS_INTO_HS */
 #ifdef USE_USB_FS
 #define USB_FIFO_WORD_SIZE  320
 #else  /*  USE_USB_FS */
-#define USB_FIFO_WORD_SIZE  1000
+#define USB_FIFO_WORD_SIZE  1024 /* 4 KB OTG_HS FIFO RAM, the partition of usbd_conf.c is checked against it */
 #endif  /*  USE_USB_FS */
 #endif  /* USE_USB_FS_INTO_HS */
 
-#ifdef USE_USB_AUDIO_PLAYPBACK
+/* audio function topology : terminal and unit ids, which must be greater than the
+   highest interface number (to avoid request destination confusion), and the path
+   of each stream as X(subtype, id, source id, terminal type, node) in descriptor
+   order, the first entity is fed by the streaming interface. The descriptor
+   holds the play and the record paths in any configuration :
+   - the descriptor builder appends one terminal or unit descriptor per entity
+     and counts them in the class specific header size
+   - the session links each node to the node of the entity it feeds, with
+     AUDIO_USB_LinkTopology, so the node graph follows the descriptor */
+#define AUDIO_TOPOLOGY_INPUT_TERMINAL                 0x02U
+#define AUDIO_TOPOLOGY_OUTPUT_TERMINAL                0x03U
+#define AUDIO_TOPOLOGY_FEATURE_UNIT                   0x06U
+
 /*play session : list of terminal and unit id for audio function */
-/* must be greater than the highest interface number(to avoid request destination confusion */
 #define USB_AUDIO_CONFIG_PLAY_TERMINAL_INPUT_ID       0x12
 #define USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID         0x16
 #define USB_AUDIO_CONFIG_PLAY_TERMINAL_OUTPUT_ID      0x14
 #define USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID         0x18
+/* USB streaming to speaker */
+#define AUDIO_TOPOLOGY_PLAY(X) \
+  X(AUDIO_TOPOLOGY_INPUT_TERMINAL,  USB_AUDIO_CONFIG_PLAY_TERMINAL_INPUT_ID,  0x00U,                                   0x0101U, usb_play_input) \
+  X(AUDIO_TOPOLOGY_FEATURE_UNIT,    USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID,    USB_AUDIO_CONFIG_PLAY_TERMINAL_INPUT_ID, 0x0000U, streaming_feature_control) \
+  X(AUDIO_TOPOLOGY_OUTPUT_TERMINAL, USB_AUDIO_CONFIG_PLAY_TERMINAL_OUTPUT_ID, USB_AUDIO_CONFIG_PLAY_UNIT_FEATURE_ID,   0x0301U, speaker_output)
+
+/*record session : list of terminal and unit id for audio function */
+#define USB_AUDIO_CONFIG_RECORD_TERMINAL_INPUT_ID     0x011
+#define USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID       0x015
+#define USB_AUDIO_CONFIG_RECORD_TERMINAL_OUTPUT_ID    0x013
+/* microphone to USB streaming */
+#define AUDIO_TOPOLOGY_RECORD(X) \
+  X(AUDIO_TOPOLOGY_INPUT_TERMINAL,  USB_AUDIO_CONFIG_RECORD_TERMINAL_INPUT_ID,  0x00U,                                     0x0201U, mic_input) \
+  X(AUDIO_TOPOLOGY_FEATURE_UNIT,    USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID,    USB_AUDIO_CONFIG_RECORD_TERMINAL_INPUT_ID, 0x0000U, recording_feature_control) \
+  X(AUDIO_TOPOLOGY_OUTPUT_TERMINAL, USB_AUDIO_CONFIG_RECORD_TERMINAL_OUTPUT_ID, USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID,   0x0101U, usb_rec_output)
+
+#ifdef USE_USB_AUDIO_PLAYPBACK
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* the terminals are clocked by the selector, its pin 1 is the internal clock
+   source above, pin 2 the external word clock source */
+#define USB_AUDIO_CONFIG_CLOCK_SELECTOR_ID            0x1D
+#define USB_AUDIO_CONFIG_EXT_CLOCK_SOURCE_ID          0x1E
+#define USB_AUDIO_CONFIG_CLOCK_SELECTOR_INTERNAL      1U
+#define USB_AUDIO_CONFIG_CLOCK_SELECTOR_EXTERNAL      2U
+/* rate of the external word clock, the external PLL gives 256 times it */
+#ifndef USB_AUDIO_CONFIG_EXT_CLOCK_FREQ
+#define USB_AUDIO_CONFIG_EXT_CLOCK_FREQ               USB_AUDIO_CONFIG_FREQ_48_K
+#endif /* USB_AUDIO_CONFIG_EXT_CLOCK_FREQ */
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
 
+/* 1 to AUDIO_MAX_SUPPORTED_CHANNEL_COUNT channels, the map is the USB spatial location bitmap :
+   0x01 FL, 0x02 FR, 0x04 FC, 0x08 LFE, 0x10 BL, 0x20 BR, 0x40 FLC, 0x80 FRC, 0x100 BC, 0x200 SL, 0x400 SR
+   e.g. 0x3F for 5.1 on 6 channels, 0x63F for 7.1 on 8 channels, 0 for not located channels (arrays).
+   The max packet must fit an iso packet : 1023 bytes on full speed, 1024 on high speed, with
+   USE_AUDIO_USB_LOW_RATE it carries AUDIO_USB_PACKET_MS of audio */
+#ifndef USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT
 #define USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT          0x02 /* channels Left dn right */
 #define USBD_AUDIO_CONFIG_PLAY_CHANNEL_MAP            0x03 /* channels Left dn right */
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
 
-#ifdef USE_AUDIO_PLAYPBACK_24_BIT
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+/* one streaming alternate per format, in increasing bandwidth order. Each alternate declares
+   the iso max packet of its own highest rate, so the host reserves only what the chosen format
+   needs. Rates above USB_AUDIO_CONFIG_PLAY_ALTn_FREQ_MAX are refused while alternate n streams */
+#ifndef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
+#error "USE_AUDIO_USB_PLAY_MULTI_ALTERNATES needs USE_AUDIO_USB_PLAY_MULTI_FREQUENCES"
+#endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+#define USB_AUDIO_CONFIG_PLAY_ALT_COUNT               3    /* 1 to 3 streaming alternates */
+/* RES_BYTE 0x03 is packed S24_3LE, unpacked to 32 bits words on the SAI side. RES_BYTE 0x04
+   with RES_BIT 0x18 declares 24 bits left aligned in 32 bits containers, sent to the SAI as is */
+#define USB_AUDIO_CONFIG_PLAY_ALT1_RES_BIT            0x10 /* 16 bit per sample */
+#define USB_AUDIO_CONFIG_PLAY_ALT1_RES_BYTE           0x02 /* 2 bytes */
+#define USB_AUDIO_CONFIG_PLAY_ALT1_FREQ_MAX           USB_AUDIO_CONFIG_FREQ_48_K
+#define USB_AUDIO_CONFIG_PLAY_ALT2_RES_BIT            0x18 /* 24 bit per sample */
+#define USB_AUDIO_CONFIG_PLAY_ALT2_RES_BYTE           0x03 /* 3 bytes */
+#define USB_AUDIO_CONFIG_PLAY_ALT2_FREQ_MAX           USB_AUDIO_CONFIG_FREQ_96_K
+#define USB_AUDIO_CONFIG_PLAY_ALT3_RES_BIT            0x20 /* 32 bit per sample */
+#define USB_AUDIO_CONFIG_PLAY_ALT3_RES_BYTE           0x04 /* 4 bytes */
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+#define USB_AUDIO_CONFIG_PLAY_ALT3_FREQ_MAX           USB_AUDIO_CONFIG_FREQ_768_K
+#else /* USE_AUDIO_PLAYBACK_HIRES */
+#define USB_AUDIO_CONFIG_PLAY_ALT3_FREQ_MAX           USB_AUDIO_CONFIG_FREQ_192_K
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
+/* the session is initialized with the widest alternate so buffers fit all of them */
+#if USB_AUDIO_CONFIG_PLAY_ALT_COUNT == 3
+#define USBD_AUDIO_CONFIG_PLAY_RES_BIT                USB_AUDIO_CONFIG_PLAY_ALT3_RES_BIT
+#define USBD_AUDIO_CONFIG_PLAY_RES_BYTE               USB_AUDIO_CONFIG_PLAY_ALT3_RES_BYTE
+#elif USB_AUDIO_CONFIG_PLAY_ALT_COUNT == 2
+#define USBD_AUDIO_CONFIG_PLAY_RES_BIT                USB_AUDIO_CONFIG_PLAY_ALT2_RES_BIT
+#define USBD_AUDIO_CONFIG_PLAY_RES_BYTE               USB_AUDIO_CONFIG_PLAY_ALT2_RES_BYTE
+#elif USB_AUDIO_CONFIG_PLAY_ALT_COUNT == 1
+#define USBD_AUDIO_CONFIG_PLAY_RES_BIT                USB_AUDIO_CONFIG_PLAY_ALT1_RES_BIT
+#define USBD_AUDIO_CONFIG_PLAY_RES_BYTE               USB_AUDIO_CONFIG_PLAY_ALT1_RES_BYTE
+#else
+#error "USB_AUDIO_CONFIG_PLAY_ALT_COUNT must be 1 to 3"
+#endif /* USB_AUDIO_CONFIG_PLAY_ALT_COUNT */
+#elif defined USE_AUDIO_PLAYPBACK_24_BIT
 #define USBD_AUDIO_CONFIG_PLAY_RES_BIT                0x18 /* 24 bit per sample */
 #define USBD_AUDIO_CONFIG_PLAY_RES_BYTE               0x03 /* 3 bytes */
 #else /*  USE_AUDIO_PLAYPBACK_24_BIT  */
@@ -95,11 +186,33 @@
 #endif /*  USE_AUDIO_PLAYPBACK_24_BIT  */
    
 #ifdef USE_AUDIO_USB_PLAY_MULTI_FREQUENCES
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+/* high resolution family, stereo 32 bits on the third alternate only : 776 bytes
+   per microframe at 768 kHz with the feedback extra frame */
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K          1 /* to set by user  1 : to use , 0 to not support*/
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K        1 /* to set by user  1 : to use , 0 to not support*/
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K          1 /* to set by user  1 : to use , 0 to not support*/
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K        1 /* to set by user  1 : to use , 0 to not support*/
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K          1 /* to set by user  1 : to use , 0 to not support*/
+#else /* USE_AUDIO_PLAYBACK_HIRES */
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K          0
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K        0
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K          0
+#define USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K        0
 #define USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K           0 /* to set by user  1 : to use , 0 to not support*/
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
 #define USB_AUDIO_CONFIG_PLAY_USE_FREQ_96_K           1 /* to set by user  1 : to use , 0 to not support*/
 #define USB_AUDIO_CONFIG_PLAY_USE_FREQ_48_K           1 /* to set by user  1 : to use , 0 to not support*/
 #define USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K         1 /* to set by user  1 : to use , 0 to not support*/
-#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K
+#if USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_768_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_705_6_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_384_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_352_8_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K
 #define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_192_K
 #elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_96_K
 #define USB_AUDIO_CONFIG_PLAY_FREQ_MAX   USB_AUDIO_CONFIG_FREQ_96_K
@@ -118,9 +231,19 @@
 #define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_96_K
 #elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K
 #define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_192_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_352_8_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_384_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_705_6_K
+#elif USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K
+#define USB_AUDIO_CONFIG_PLAY_FREQ_MIN   USB_AUDIO_CONFIG_FREQ_768_K
 #endif 
 
-#define USB_AUDIO_CONFIG_PLAY_FREQ_COUNT              (USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K + USB_AUDIO_CONFIG_PLAY_USE_FREQ_96_K +\
+#define USB_AUDIO_CONFIG_PLAY_FREQ_COUNT              (USB_AUDIO_CONFIG_PLAY_USE_FREQ_768_K + USB_AUDIO_CONFIG_PLAY_USE_FREQ_705_6_K +\
+                                                       USB_AUDIO_CONFIG_PLAY_USE_FREQ_384_K + USB_AUDIO_CONFIG_PLAY_USE_FREQ_352_8_K +\
+                                                       USB_AUDIO_CONFIG_PLAY_USE_FREQ_192_K + USB_AUDIO_CONFIG_PLAY_USE_FREQ_96_K +\
                                                        USB_AUDIO_CONFIG_PLAY_USE_FREQ_48_K + USB_AUDIO_CONFIG_PLAY_USE_FREQ_44_1_K)
 #define USB_AUDIO_CONFIG_PLAY_DEF_FREQ                USB_AUDIO_CONFIG_PLAY_FREQ_MAX
 
@@ -134,20 +257,56 @@
 #endif /* (USB_AUDIO_CONFIG_PLAY_DEF_FREQ == USB_AUDIO_CONFIG_FREQ_44_1_K)*/
 #endif /* USE_AUDIO_USB_PLAY_MULTI_FREQUENCES*/
    
-#define  USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE (1024 * 10)  
+#if defined USE_AUDIO_PLAYBACK_HIRES
+/* a ms is 6 KB at 768 kHz, the ring is the power of two which holds
+   USBD_AUDIO_CONFIG_PLAY_HIRES_RING_MS at the highest rate, with the max packet margin */
+#define  USBD_AUDIO_CONFIG_PLAY_HIRES_RING_MS         AUDIO_USB_RING_MS(4U)
+#define  USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE           (AUDIO_MS_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_PLAY_FREQ_MAX,\
+                                                       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT,\
+                                                       USBD_AUDIO_CONFIG_PLAY_RES_BYTE) *\
+                                                       (2U * USBD_AUDIO_CONFIG_PLAY_HIRES_RING_MS + AUDIO_USB_PACKET_MS))
+#elif (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
+/* fill level is regulated by the feedback endpoint, a smaller buffer is enough.
+   Sizes are given for stereo and 1 ms packets, scaled by the channel count and the packet
+   duration to keep the same number of packets */
+#define  USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE (1024 * 5 * USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT / 2 * AUDIO_USB_PACKET_MS)
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#define  USBD_AUDIO_CONFIG_PLAY_BUFFER_SIZE (1024 * 10 * USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT / 2 * AUDIO_USB_PACKET_MS)
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
 #else /* USE_AUDIO_PLAYPBACK */
 #ifndef  USE_USB_AUDIO_RECORDING
 #error "USE_USB_AUDIO_RECORDING or(and) USE_AUDIO_PLAYPBACK must be defined"
 #endif /* USE_USB_AUDIO_RECORDING*/
 #endif /*USE_AUDIO_PLAYPBACK*/
 
+#ifdef USE_AUDIO_PLAYBACK_MIX
+/* mix session : a second play stream ("chat"), 16 bits with the play channels, added to the
+   speaker output. It has its own terminals and feature unit and shares the play clock source */
+#if !(defined USE_USB_AUDIO_PLAYPBACK) || !(defined USE_USB_AUDIO_CLASS_20) || (defined USE_AUDIO_SPEAKER_DUMMY)
+#error "USE_AUDIO_PLAYBACK_MIX needs the playback session, the audio class 2.0 and the SAI speaker"
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#define USB_AUDIO_CONFIG_MIX_TERMINAL_INPUT_ID        0x1A
+#define USB_AUDIO_CONFIG_MIX_UNIT_FEATURE_ID          0x1B
+#define USB_AUDIO_CONFIG_MIX_TERMINAL_OUTPUT_ID       0x1C
+/* USB streaming to the mixer of the speaker */
+#define AUDIO_TOPOLOGY_MIX(X) \
+  X(AUDIO_TOPOLOGY_INPUT_TERMINAL,  USB_AUDIO_CONFIG_MIX_TERMINAL_INPUT_ID,  0x00U,                                  0x0101U, usb_mix_input) \
+  X(AUDIO_TOPOLOGY_FEATURE_UNIT,    USB_AUDIO_CONFIG_MIX_UNIT_FEATURE_ID,    USB_AUDIO_CONFIG_MIX_TERMINAL_INPUT_ID, 0x0000U, mix_feature_control) \
+  X(AUDIO_TOPOLOGY_OUTPUT_TERMINAL, USB_AUDIO_CONFIG_MIX_TERMINAL_OUTPUT_ID, USB_AUDIO_CONFIG_MIX_UNIT_FEATURE_ID,   0x0301U, mix_mixer)
+#define USBD_AUDIO_CONFIG_MIX_RES_BIT                 0x10 /* 16 bit per sample */
+#define USBD_AUDIO_CONFIG_MIX_RES_BYTE                0x02 /* 2 bytes */
+/* mix ring : the power of two which holds USBD_AUDIO_CONFIG_MIX_RING_MS at the highest rate,
+   the speaker adds it once USBD_AUDIO_CONFIG_MIX_START_MS are received */
+#define  USBD_AUDIO_CONFIG_MIX_RING_MS                AUDIO_USB_RING_MS(8U)
+#define  USBD_AUDIO_CONFIG_MIX_START_MS               AUDIO_USB_START_MS(4U)
+#define  USBD_AUDIO_CONFIG_MIX_BUFFER_SIZE            (AUDIO_MS_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_PLAY_FREQ_MAX,\
+                                                       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT,\
+                                                       USBD_AUDIO_CONFIG_MIX_RES_BYTE) *\
+                                                       (2U * USBD_AUDIO_CONFIG_MIX_RING_MS + AUDIO_USB_PACKET_MS))
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+
 
 #ifdef  USE_USB_AUDIO_RECORDING   
-/*record session : list of terminal and unit id for audio function */
-/* must be greater than the highest interface number(to avoid request destination confusion */
-#define USB_AUDIO_CONFIG_RECORD_TERMINAL_INPUT_ID     0x011
-#define USB_AUDIO_CONFIG_RECORD_UNIT_FEATURE_ID       0x015
-#define USB_AUDIO_CONFIG_RECORD_TERMINAL_OUTPUT_ID    0x013
 #ifdef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
 #ifdef USE_USB_AUDIO_PLAYPBACK 
 #define USB_AUDIO_CONFIG_RECORD_CLOCK_SOURCE_ID       USB_AUDIO_CONFIG_PLAY_CLOCK_SOURCE_ID
@@ -159,11 +318,22 @@
 #define USB_AUDIO_CONFIG_RECORD_CLOCK_SOURCE_ID       0x019
 #endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
 
-#define  USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE         (1024 * 2) 
+/* record ring : the power of two which holds USBD_AUDIO_CONFIG_RECORD_RING_MS at the current
+   format, sending real data starts once USBD_AUDIO_CONFIG_RECORD_START_MS are recorded.
+   The allocation covers the largest format , ring rounded up and max packet margin */
+#define  USBD_AUDIO_CONFIG_RECORD_RING_MS             AUDIO_USB_RING_MS(8U)
+#define  USBD_AUDIO_CONFIG_RECORD_START_MS            AUDIO_USB_START_MS(2U)
+#define  USBD_AUDIO_CONFIG_RECORD_BUFFER_SIZE         (AUDIO_MS_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_RECORD_FREQ_MAX,\
+                                                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT,\
+                                                       USBD_AUDIO_CONFIG_RECORD_RES_BYTE) *\
+                                                       (2U * USBD_AUDIO_CONFIG_RECORD_RING_MS + AUDIO_USB_PACKET_MS))
   
 /*record session : audio description */
+/* same channel rules as the play session, a mic array usually sets no location */
+#ifndef USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT
 #define USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT        0x02 /* channels Left dn right */
 #define USBD_AUDIO_CONFIG_RECORD_CHANNEL_MAP          0x03 /* channels Left dn right */
+#endif /* USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT */
 
 #ifdef USE_AUDIO_RECORDING_24_BIT
 #define USBD_AUDIO_CONFIG_RECORD_RES_BIT              0x18 /* 24 bit per sample */
@@ -208,7 +378,12 @@
 #else /*USE_AUDIO_USB_RECORD_MULTI_FREQUENCES*/
 #define USB_AUDIO_CONFIG_RECORD_FREQ_COUNT           1 /* 1 frequence */
 #define USB_AUDIO_CONFIG_RECORD_FREQ_MAX             USB_AUDIO_CONFIG_RECORD_DEF_FREQ
+#ifdef USE_AUDIO_MEMS_MIC
+/* the PDM clock of the MEMS mics is 64 fs */
+#define USB_AUDIO_CONFIG_RECORD_DEF_FREQ             USB_AUDIO_CONFIG_FREQ_48_K /* to set by user */
+#else /* USE_AUDIO_MEMS_MIC */
 #define USB_AUDIO_CONFIG_RECORD_DEF_FREQ             USB_AUDIO_CONFIG_FREQ_96_K /* to set by user */
+#endif /* USE_AUDIO_MEMS_MIC */
 #if (USB_AUDIO_CONFIG_RECORD_DEF_FREQ == USB_AUDIO_CONFIG_FREQ_44_1_K)
 #define  USB_AUDIO_CONFIG_RECORD_USE_FREQ_44_1_K     1
 #endif /* (USB_AUDIO_CONFIG_RECORD_DEF_FREQ == USB_AUDIO_CONFIG_FREQ_44_1_K)*/
@@ -217,17 +392,128 @@
    
 /* defining the max packet length*/
 #ifdef USE_USB_AUDIO_PLAYPBACK
-#ifdef  USE_AUDIO_PLAYBACK_USB_FEEDBACK
+/* with a feedback, explicit or implicit, the host may send one more sample per packet */
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
 #define USBD_AUDIO_CONFIG_PLAY_MAX_PACKET_SIZE ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE((USB_AUDIO_CONFIG_PLAY_FREQ_MAX+ 1),\
       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT,\
       USBD_AUDIO_CONFIG_PLAY_RES_BYTE)))
-#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
 #define USBD_AUDIO_CONFIG_PLAY_MAX_PACKET_SIZE ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE((USB_AUDIO_CONFIG_PLAY_FREQ_MAX),\
       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT,\
       USBD_AUDIO_CONFIG_PLAY_RES_BYTE)))
-#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#ifdef USE_AUDIO_USB_PLAY_MULTI_ALTERNATES
+/* max packet of one alternate : its highest rate, limited to the supported ones */
+#define USB_AUDIO_CONFIG_PLAY_ALT_FREQ(freq_max)      (((freq_max) < USB_AUDIO_CONFIG_PLAY_FREQ_MAX) ?\
+                                                       (freq_max) : USB_AUDIO_CONFIG_PLAY_FREQ_MAX)
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
+#define USBD_AUDIO_CONFIG_PLAY_ALT_MAX_PACKET_SIZE(freq_max, res_byte) \
+      ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE((USB_AUDIO_CONFIG_PLAY_ALT_FREQ(freq_max) + 1),\
+      USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT, (res_byte))))
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#define USBD_AUDIO_CONFIG_PLAY_ALT_MAX_PACKET_SIZE(freq_max, res_byte) \
+      ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_PLAY_ALT_FREQ(freq_max),\
+      USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT, (res_byte))))
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
 #endif /* USE_USB_AUDIO_PLAYPBACK */
 
+#ifdef USE_USB_AUDIO_RECORDING
+#if (defined USE_AUDIO_RECORDING_USB_RESAMPLER) && !(defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO)
+#error "USE_AUDIO_RECORDING_USB_RESAMPLER needs USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO"
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER */
+#endif /*USE_USB_AUDIO_RECORDING*/
+#if (defined USE_AUDIO_SOF_TIMESTAMP) && (defined USE_AUDIO_SPEAKER_DUMMY) && (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_SOF_TIMESTAMP needs the SAI speaker or the SAI mic as audio clock"
+#endif /* USE_AUDIO_SOF_TIMESTAMP */
+#if (defined USE_AUDIO_CLOCK_SOF_LOCK) && !(defined USE_AUDIO_SOF_TIMESTAMP)
+#error "USE_AUDIO_CLOCK_SOF_LOCK needs USE_AUDIO_SOF_TIMESTAMP"
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+#ifdef USE_AUDIO_PLAYBACK_HIRES
+#if !(defined USE_USB_AUDIO_PLAYPBACK) || !(defined USE_USB_AUDIO_CLASS_20) || !(defined USE_USB_HS_ULPI_PHY)
+#error "USE_AUDIO_PLAYBACK_HIRES needs the playback session on a high speed audio class 2.0 device"
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#if !(defined USE_AUDIO_USB_PLAY_MULTI_ALTERNATES) || (USB_AUDIO_CONFIG_PLAY_ALT_COUNT != 3)
+#error "USE_AUDIO_PLAYBACK_HIRES streams on the 32 bits alternate, USE_AUDIO_USB_PLAY_MULTI_ALTERNATES with 3 alternates is required"
+#endif /* USE_AUDIO_USB_PLAY_MULTI_ALTERNATES */
+#if (USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT != 2)
+#error "USE_AUDIO_PLAYBACK_HIRES is stereo, the 768 kHz packets of more channels don't fit a microframe"
+#endif /* USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT */
+#ifdef USE_USB_HS_DMA
+#error "the USE_AUDIO_PLAYBACK_HIRES ring doesn't fit the D2 SRAM with the speaker DMA buffer, disable USE_USB_HS_DMA"
+#endif /* USE_USB_HS_DMA */
+#if (defined USE_AUDIO_PLAYBACK_MIX) || (defined USE_AUDIO_CLOCK_SOF_OUTPUT) || (defined USE_AUDIO_CLOCK_SELECTOR)
+#error "USE_AUDIO_PLAYBACK_HIRES clocks the SAI from the audio PLL, without a mix stream"
+#endif /* USE_AUDIO_PLAYBACK_MIX || USE_AUDIO_CLOCK_SOF_OUTPUT || USE_AUDIO_CLOCK_SELECTOR */
+#if (defined USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC) && (defined USE_USB_AUDIO_RECORDING)
+#error "the recording doesn't run at the USE_AUDIO_PLAYBACK_HIRES rates, its clock source can't be shared"
+#endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC && USE_USB_AUDIO_RECORDING */
+#endif /* USE_AUDIO_PLAYBACK_HIRES */
+#if (defined USE_AUDIO_SOF_JITTER) && (defined USE_AUDIO_SOF_TIMESTAMP)
+#error "USE_AUDIO_SOF_JITTER and USE_AUDIO_SOF_TIMESTAMP both latch the SOF with TIM2"
+#endif /* USE_AUDIO_SOF_JITTER && USE_AUDIO_SOF_TIMESTAMP */
+/* the debug captures (USBD_DEBUG_BSS) are kept out of the release RAM budget,
+   define USE_AUDIO_DEBUG_IN_RELEASE to keep one */
+#if !(defined DEBUG) && !(defined USE_AUDIO_DEBUG_IN_RELEASE) && \
+    ((defined USE_AUDIO_TRACE) || (defined USE_AUDIO_TAP) || (defined USE_AUDIO_SPECTRUM) || (defined USE_AUDIO_LOOPBACK) || \
+     (defined USE_AUDIO_SNAPSHOT))
+#error "USE_AUDIO_TRACE, USE_AUDIO_TAP, USE_AUDIO_SPECTRUM, USE_AUDIO_LOOPBACK and USE_AUDIO_SNAPSHOT are debug captures, off in release"
+#endif /* !DEBUG && !USE_AUDIO_DEBUG_IN_RELEASE && (USE_AUDIO_TRACE || USE_AUDIO_TAP || USE_AUDIO_SPECTRUM || USE_AUDIO_LOOPBACK || USE_AUDIO_SNAPSHOT) */
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+/* the SAI nodes are clocked by an external PLL locked on the SOF output : no drift to follow */
+#if (defined USE_AUDIO_SPEAKER_DUMMY) && (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_CLOCK_SOF_OUTPUT clocks the SAI speaker or the SAI mic"
+#endif /* USE_AUDIO_SPEAKER_DUMMY && USE_AUDIO_DUMMY_MIC */
+#ifdef USE_AUDIO_CLOCK_SOF_LOCK
+#error "USE_AUDIO_CLOCK_SOF_OUTPUT and USE_AUDIO_CLOCK_SOF_LOCK both lock the audio clock"
+#endif /* USE_AUDIO_CLOCK_SOF_LOCK */
+#ifdef USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO
+#error "USE_AUDIO_CLOCK_SOF_OUTPUT locks the mic on SOF, USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO is not needed"
+#endif /* USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_AUDIO_CLOCK_SELECTOR
+/* the external clock doesn't follow the host : the play stream needs a
+   feedback and the mic packets must follow the audio clock */
+#if !(defined USE_USB_AUDIO_PLAYPBACK) || !(defined USE_USB_AUDIO_CLASS_20) || \
+    !(defined USE_AUDIO_USB_PLAY_MULTI_FREQUENCES)
+#error "USE_AUDIO_CLOCK_SELECTOR needs UAC2 playback with USE_AUDIO_USB_PLAY_MULTI_FREQUENCES"
+#endif /* USE_USB_AUDIO_PLAYPBACK && USE_USB_AUDIO_CLASS_20 && USE_AUDIO_USB_PLAY_MULTI_FREQUENCES */
+#if !(defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) && !(defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
+#error "USE_AUDIO_CLOCK_SELECTOR needs USE_AUDIO_PLAYBACK_USB_FEEDBACK or USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK"
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+#if !(defined USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC) || !(defined USE_AUDIO_USB_RECORD_MULTI_FREQUENCES) || \
+    !(defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO)
+#error "USE_AUDIO_CLOCK_SELECTOR needs USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC, USE_AUDIO_USB_RECORD_MULTI_FREQUENCES and USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO"
+#endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+#endif /* USE_USB_AUDIO_RECORDING */
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+#error "USE_AUDIO_CLOCK_SOF_OUTPUT already clocks SAI1 from the external PLL, USE_AUDIO_CLOCK_SELECTOR can't be used"
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
+#if (defined USE_AUDIO_SPEAKER_DUMMY) && (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_CLOCK_SELECTOR selects the clock of the SAI speaker or the SAI mic"
+#endif /* USE_AUDIO_SPEAKER_DUMMY && USE_AUDIO_DUMMY_MIC */
+#endif /* USE_AUDIO_CLOCK_SELECTOR */
+#ifdef USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK
+/* the host sends as many samples as the record IN packets carry : the mic
+   packets must follow the audio clock, which the speaker shares */
+#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
+#error "USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK replaces the USE_AUDIO_PLAYBACK_USB_FEEDBACK endpoint"
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+#if !(defined USE_USB_AUDIO_PLAYPBACK) || !(defined USE_USB_AUDIO_RECORDING) || !(defined USE_USB_AUDIO_CLASS_20)
+#error "USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK needs UAC2 playback and recording"
+#endif /* USE_USB_AUDIO_PLAYPBACK && USE_USB_AUDIO_RECORDING && USE_USB_AUDIO_CLASS_20 */
+#ifndef USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC
+#error "USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK needs both streams at the same rate : USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC"
+#endif /* USE_AUDIO_PLAYBACK_RECORDING_SHARED_CLOCK_SRC */
+#if (defined USE_AUDIO_RECORDING_USB_RESAMPLER) || \
+    (!(defined USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO) && !(defined USE_AUDIO_CLOCK_SOF_OUTPUT))
+#error "USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK needs record packets sized on the audio clock : USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO without resampler"
+#endif /* USE_AUDIO_RECORDING_USB_RESAMPLER || !USE_AUDIO_RECORDING_USB_IMPLECIT_SYNCHRO */
+#if (defined USE_AUDIO_SPEAKER_DUMMY) || (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK needs the SAI speaker and mic on the same audio clock"
+#endif /* USE_AUDIO_SPEAKER_DUMMY || USE_AUDIO_DUMMY_MIC */
+#endif /* USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
 #ifdef USE_USB_AUDIO_RECORDING
 #ifdef  USE_AUDIO_RECORDING_USB_NO_REMOVE
 #define USBD_AUDIO_CONFIG_RECORD_MAX_PACKET_SIZE ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE((USB_AUDIO_CONFIG_RECORD_FREQ_MAX+1),\
@@ -239,10 +525,60 @@
       USBD_AUDIO_CONFIG_RECORD_RES_BYTE)))
 #endif /*USE_AUDIO_RECORDING_USB_NO_REMOVE*/
 #endif /*USE_USB_AUDIO_RECORDING*/
+#ifdef USE_AUDIO_RECORDING_VOICE
+/* voice session : a second record streaming interface at 16 kHz, 16 bits with the record
+   channels, decimated from the mic by an integer factor. It has its own clock source,
+   sampling rate converter and terminal, the record feature unit controls both streams */
+#if !(defined USE_USB_AUDIO_RECORDING) || !(defined USE_USB_AUDIO_CLASS_20) || !(defined USE_USBD_COMPOSITE) || \
+    (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_RECORDING_VOICE needs the recording session, the audio class 2.0, the composite builder and the SAI or PDM mic"
+#endif /* USE_USB_AUDIO_RECORDING */
+#ifdef USE_AUDIO_USB_INTERRUPT
+#error "the USE_AUDIO_RECORDING_VOICE endpoint is the USE_AUDIO_USB_INTERRUPT one"
+#endif /* USE_AUDIO_USB_INTERRUPT */
+#define USB_AUDIO_CONFIG_VOICE_UNIT_SRC_ID            0x10
+#define USB_AUDIO_CONFIG_VOICE_CLOCK_SOURCE_ID        0x17
+#define USB_AUDIO_CONFIG_VOICE_TERMINAL_OUTPUT_ID     0x1F
+#define USB_AUDIO_CONFIG_VOICE_FREQ                   USB_AUDIO_CONFIG_FREQ_16_K
+#define USBD_AUDIO_CONFIG_VOICE_RES_BIT               0x10 /* 16 bit per sample */
+#define USBD_AUDIO_CONFIG_VOICE_RES_BYTE              0x02 /* 2 bytes */
+/* voice ring : the power of two which holds USBD_AUDIO_CONFIG_VOICE_RING_MS, sending real
+   data starts once USBD_AUDIO_CONFIG_VOICE_START_MS are decimated */
+#define  USBD_AUDIO_CONFIG_VOICE_RING_MS              AUDIO_USB_RING_MS(8U)
+#define  USBD_AUDIO_CONFIG_VOICE_START_MS             AUDIO_USB_START_MS(2U)
+#define  USBD_AUDIO_CONFIG_VOICE_BUFFER_SIZE          (AUDIO_MS_MAX_PACKET_SIZE(USB_AUDIO_CONFIG_VOICE_FREQ,\
+                                                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT,\
+                                                       USBD_AUDIO_CONFIG_VOICE_RES_BYTE) *\
+                                                       (2U * USBD_AUDIO_CONFIG_VOICE_RING_MS + AUDIO_USB_PACKET_MS))
+/* one more frame when the ring runs ahead of the host */
+#define USBD_AUDIO_CONFIG_VOICE_MAX_PACKET_SIZE ((uint16_t)(AUDIO_USB_MAX_PACKET_SIZE((USB_AUDIO_CONFIG_VOICE_FREQ+1),\
+      USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT,\
+      USBD_AUDIO_CONFIG_VOICE_RES_BYTE)))
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_BULK_CAPTURE
+/* bulk capture : the mic halves are sent in blocks on a vendor bulk interface */
+#if !(defined USE_USB_AUDIO_RECORDING) || !(defined USE_USBD_COMPOSITE) || (defined USE_AUDIO_DUMMY_MIC)
+#error "USE_AUDIO_BULK_CAPTURE needs the recording session, the composite builder and the SAI or PDM mic"
+#endif /* USE_USB_AUDIO_RECORDING */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#error "USE_AUDIO_BULK_CAPTURE and USE_AUDIO_CLIP_UPLOAD share the endpoint 8"
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#if (defined USE_AUDIO_FLOAT_PIPELINE) && (!(defined USE_AUDIO_PLANAR_DSP) || !(defined USE_AUDIO_DITHER))
+#error "USE_AUDIO_FLOAT_PIPELINE needs USE_AUDIO_PLANAR_DSP for the conversions and USE_AUDIO_DITHER for 16 bits samples"
+#endif /* USE_AUDIO_FLOAT_PIPELINE */
+#if (defined USE_AUDIO_RECORDING_VOICE) || (defined USE_AUDIO_BULK_CAPTURE)
+/* the mic may run while the host doesn't record, the recording session keeps its readers */
+#define USE_AUDIO_RECORDING_USERS
+#endif /* USE_AUDIO_RECORDING_VOICE || USE_AUDIO_BULK_CAPTURE */
 /* endpoint& streaming interface numbers definitions*/
 #ifdef USE_USB_AUDIO_PLAYPBACK
 #define USBD_AUDIO_CONFIG_PLAY_SA_INTERFACE              0x03 /* AUDIO STREAMING INTERFACE NUMBER FOR PLAY SESSION */
+#ifdef USE_USB_DEDICATED_EP1
+#define USBD_AUDIO_CONFIG_PLAY_EP_OUT                    0x01 /* dedicated EP1 OUT interrupt */
+#else /* USE_USB_DEDICATED_EP1 */
 #define USBD_AUDIO_CONFIG_PLAY_EP_OUT                    0x03
+#endif /* USE_USB_DEDICATED_EP1 */
 #ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK   
 #define USB_AUDIO_CONFIG_PLAY_EP_SYNC                    0x85
 #ifdef USE_USB_AUDIO_CLASS_10
@@ -252,9 +588,17 @@
 #define USB_AUDIO_CONFIG_PLAY_FEEDBACK_REFRESH           1 /* refresh every 32(2^5) microframe/ms */
 #endif /* USE_USB_AUDIO_CLASS_20 */
 #endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK  */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#define USBD_AUDIO_CONFIG_MIX_SA_INTERFACE               0x05 /* AUDIO STREAMING INTERFACE NUMBER FOR MIX SESSION */
+#define USBD_AUDIO_CONFIG_MIX_EP_OUT                     0x04
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #ifdef USE_USB_AUDIO_RECORDING
 #define USBD_AUDIO_CONFIG_RECORD_SA_INTERFACE            0x04 /* AUDIO STREAMING INTERFACE NUMBER FOR RECORD SESSION */
+#ifdef USE_USB_DEDICATED_EP1
+#define USB_AUDIO_CONFIG_RECORD_EP_IN                    0x81 /* dedicated EP1 IN interrupt */
+#else /* USE_USB_DEDICATED_EP1 */
 #define USB_AUDIO_CONFIG_RECORD_EP_IN                    0x83
+#endif /* USE_USB_DEDICATED_EP1 */
 #if USE_AUDIO_USB_INTERRUPT
 #define USB_AUDIO_CONFIG_INTERRUPT_EP_IN                 0x84
 #endif /* USE_AUDIO_USB_INTERRUPT */
@@ -265,12 +609,25 @@
 #endif /* USE_USB_AUDIO_RECORDING */
 #else /* USE_USB_AUDIO_PLAYPBACK */ 
 #define USBD_AUDIO_CONFIG_RECORD_SA_INTERFACE            0x04 /* AUDIO STREAMING INTERFACE NUMBER FOR RECORD SESSION */
+#ifdef USE_USB_DEDICATED_EP1
+#define USB_AUDIO_CONFIG_RECORD_EP_IN                    0x81 /* dedicated EP1 IN interrupt */
+#else /* USE_USB_DEDICATED_EP1 */
 #define USB_AUDIO_CONFIG_RECORD_EP_IN                    0x83
+#endif /* USE_USB_DEDICATED_EP1 */
 #if USE_AUDIO_USB_INTERRUPT
 #define USB_AUDIO_CONFIG_INTERRUPT_EP_IN                 0x82
 #endif /* USE_AUDIO_USB_INTERRUPT */
 #endif /* USE_USB_AUDIO_PLAYPBACK */
 
+#ifdef USE_AUDIO_RECORDING_VOICE
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#define USBD_AUDIO_CONFIG_VOICE_SA_INTERFACE             0x06 /* AUDIO STREAMING INTERFACE NUMBER FOR VOICE SESSION */
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#define USBD_AUDIO_CONFIG_VOICE_SA_INTERFACE             0x05 /* AUDIO STREAMING INTERFACE NUMBER FOR VOICE SESSION */
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#define USB_AUDIO_CONFIG_VOICE_EP_IN                     0x84
+#endif /* USE_AUDIO_RECORDING_VOICE */
+
 #if USE_AUDIO_USB_INTERRUPT
 #define USB_AUDIO_CONFIG_INTERRUPT_EP_REFRESH        100 /*  */
 #endif /* USE_AUDIO_USB_INTERRUPT */
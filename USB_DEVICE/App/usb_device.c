@@ -29,6 +29,15 @@
 /* USER CODE BEGIN Includes */
 #include "usbd_cdc.h"
 #include "usbd_cdc_if.h"
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "usbd_cdc_tlm_if.h"
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+#include "audio_clip.h"
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_BULK_CAPTURE
+#include "audio_bulk_capture.h"
+#endif /* USE_AUDIO_BULK_CAPTURE */
 /* USER CODE END Includes */
 
 /* USER CODE BEGIN PV */
@@ -48,8 +57,42 @@ USBD_HandleTypeDef hUsbDeviceHS;
  * -- Insert your variables declaration here --
  */
 /* USER CODE BEGIN 0 */
+#ifdef USE_USB_DEDICATED_EP1
+/* the play OUT and record IN take EP1 for its dedicated interrupts, the CDC data moves to EP3 */
+uint8_t cdc_ep[3]={0x83,0x3,0x82};
+#define USB_DEVICE_AUDIO_DATA_EP_OUT  0x01
+#define USB_DEVICE_AUDIO_DATA_EP_IN   0x81
+#else /* USE_USB_DEDICATED_EP1 */
 uint8_t cdc_ep[3]={0x81,0x1,0x82};
-uint8_t audio_ep[]={0x03,0x83};
+#define USB_DEVICE_AUDIO_DATA_EP_OUT  0x03
+#define USB_DEVICE_AUDIO_DATA_EP_IN   0x83
+#endif /* USE_USB_DEDICATED_EP1 */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+/* play OUT, record IN then mix OUT and voice IN, as assigned by the composite builder */
+#ifdef USE_AUDIO_RECORDING_VOICE
+uint8_t audio_ep[]={USB_DEVICE_AUDIO_DATA_EP_OUT,USB_DEVICE_AUDIO_DATA_EP_IN,0x04,0x84};
+#else /* USE_AUDIO_RECORDING_VOICE */
+uint8_t audio_ep[]={USB_DEVICE_AUDIO_DATA_EP_OUT,USB_DEVICE_AUDIO_DATA_EP_IN,0x04};
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_RECORDING_VOICE
+uint8_t audio_ep[]={USB_DEVICE_AUDIO_DATA_EP_OUT,USB_DEVICE_AUDIO_DATA_EP_IN,0x84};
+#else /* USE_AUDIO_RECORDING_VOICE */
+uint8_t audio_ep[]={USB_DEVICE_AUDIO_DATA_EP_OUT,USB_DEVICE_AUDIO_DATA_EP_IN};
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+/* second CDC, tap and trace frames */
+uint8_t cdc_tlm_ep[3]={CDC_TLM_IN_EP,CDC_TLM_OUT_EP,CDC_TLM_CMD_EP};
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+/* vendor bulk interface, clip upload */
+uint8_t clip_ep[2]={AUDIO_CLIP_IN_EP,AUDIO_CLIP_OUT_EP};
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_BULK_CAPTURE
+/* vendor bulk interface, mic capture */
+uint8_t bulk_capture_ep[2]={AUDIO_BULK_CAPTURE_IN_EP,AUDIO_BULK_CAPTURE_OUT_EP};
+#endif /* USE_AUDIO_BULK_CAPTURE */
 /* USER CODE END 0 */
 
 /*
@@ -66,6 +109,7 @@ uint8_t audio_ep[]={0x03,0x83};
 void MX_USB_DEVICE_Init(void)
 {
   /* USER CODE BEGIN USB_DEVICE_Init_PreTreatment */
+  USBD_HS_SerialNumInit();
 
   /* USER CODE END USB_DEVICE_Init_PreTreatment */
 
@@ -74,6 +118,7 @@ void MX_USB_DEVICE_Init(void)
   {
     Error_Handler();
   }
+  AUDIO_BOOT_MARK(AUDIO_BOOT_USB_CORE);
 
   if (USBD_CDC_RegisterInterface(&hUsbDeviceHS, &USBD_Interface_fops_FS) != USBD_OK)
   {
@@ -92,6 +137,40 @@ void MX_USB_DEVICE_Init(void)
   {
     Error_Handler();
   }
+#ifdef USE_AUDIO_CDC_TELEMETRY
+  /* registered last so its class id is CDC_TLM_CLASS_ID */
+  if (USBD_CDC_RegisterInterface(&hUsbDeviceHS, &USBD_TLM_Interface_fops) != USBD_OK)
+  {
+    Error_Handler();
+  }
+  if (USBD_RegisterClassComposite(&hUsbDeviceHS, &USBD_CDC,CLASS_TYPE_CDC,cdc_tlm_ep) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_CLIP_UPLOAD
+  /* registered last so its class id is AUDIO_CLIP_CLASS_ID */
+  if (USBD_VENDOR_RegisterInterface(&hUsbDeviceHS, &AUDIO_CLIP_Interface_fops) != USBD_OK)
+  {
+    Error_Handler();
+  }
+  if (USBD_RegisterClassComposite(&hUsbDeviceHS, &USBD_VENDOR,CLASS_TYPE_VENDOR,clip_ep) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#endif /* USE_AUDIO_CLIP_UPLOAD */
+#ifdef USE_AUDIO_BULK_CAPTURE
+  /* registered last so its class id is AUDIO_BULK_CAPTURE_CLASS_ID */
+  if (USBD_VENDOR_RegisterInterface(&hUsbDeviceHS, &AUDIO_BULK_CAPTURE_Interface_fops) != USBD_OK)
+  {
+    Error_Handler();
+  }
+  if (USBD_RegisterClassComposite(&hUsbDeviceHS, &USBD_VENDOR,CLASS_TYPE_VENDOR,bulk_capture_ep) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#endif /* USE_AUDIO_BULK_CAPTURE */
+  AUDIO_BOOT_MARK(AUDIO_BOOT_USB_CLASSES);
 
 
 
@@ -109,6 +188,7 @@ void MX_USB_DEVICE_Init(void)
   }
 
   /* USER CODE BEGIN USB_DEVICE_Init_PostTreatment */
+  AUDIO_BOOT_MARK(AUDIO_BOOT_USB_CONNECT);
   HAL_PWREx_EnableUSBVoltageDetector();
 
   /* USER CODE END USB_DEVICE_Init_PostTreatment */
@@ -60,6 +60,9 @@ static int8_t  AUDIO_USB_DeInit(USBD_AUDIO_FunctionDescriptionfTypeDef* audio_fu
 static int8_t  AUDIO_USB_GetState(uint32_t private_data);
 static int8_t  AUDIO_USB_GetConfigDesc (uint8_t ** pdata, uint16_t * psize, uint32_t private_data);
 /* exported  variable ---------------------------------------------------------*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+extern USBD_HandleTypeDef hUsbDeviceHS;
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 
  USBD_AUDIO_InterfaceCallbacksfTypeDef audio_class_interface =
  {
@@ -75,10 +78,16 @@ static int8_t  AUDIO_USB_GetConfigDesc (uint8_t ** pdata, uint16_t * psize, uint
  
 #ifdef USE_USB_AUDIO_PLAYPBACK
   AUDIO_USB_SessionTypedef usb_play_session;
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  AUDIO_USB_SessionTypedef usb_mix_session;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
  
 #ifdef USE_USB_AUDIO_RECORDING
   AUDIO_USB_SessionTypedef usb_record_session;
+#ifdef USE_AUDIO_RECORDING_VOICE
+  AUDIO_USB_SessionTypedef usb_voice_session;
+#endif /* USE_AUDIO_RECORDING_VOICE */
 #endif /* USE_USB_AUDIO_RECORDING*/
  /* private  functions ---------------------------------------------------------*/
  
@@ -99,12 +108,24 @@ static int8_t  AUDIO_USB_Init(USBD_AUDIO_FunctionDescriptionfTypeDef* audio_func
   AUDIO_Playback_SessionInit(&audio_function->as_interfaces[i], &(audio_function->controls[i]), &control_count, (uint32_t) &usb_play_session);
   i++;
   j += control_count;
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  /* Initializes the USB mix session, its interface follows the record one */
+  AUDIO_Mix_SessionInit(&audio_function->as_interfaces[i], &(audio_function->controls[j]), &control_count, (uint32_t) &usb_mix_session);
+  i++;
+  j += control_count;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
 #ifdef USE_USB_AUDIO_RECORDING 
   /* Initializes the USB record session */
   AUDIO_Recording_SessionInit(&audio_function->as_interfaces[i], &(audio_function->controls[j]), &control_count, (uint32_t) &usb_record_session);
   i++;
   j += control_count;
+#ifdef USE_AUDIO_RECORDING_VOICE
+  /* Initializes the USB voice session, fed by the record session mic */
+  AUDIO_Voice_SessionInit(&audio_function->as_interfaces[i], &(audio_function->controls[j]), &control_count, (uint32_t) &usb_voice_session);
+  i++;
+  j += control_count;
+#endif /* USE_AUDIO_RECORDING_VOICE */
 #endif /* USE_USB_AUDIO_RECORDING*/
   audio_function->as_interfaces_count = i;
   audio_function->control_count = j;
@@ -130,8 +151,18 @@ static int8_t  AUDIO_USB_DeInit(USBD_AUDIO_FunctionDescriptionfTypeDef* audio_fu
   usb_play_session.SessionDeInit( (uint32_t) &usb_play_session);
   audio_function->as_interfaces[0].alternate = 0;
   i++;
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  usb_mix_session.SessionDeInit((uint32_t) &usb_mix_session);
+  audio_function->as_interfaces[i].alternate = 0;
+  i++;
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 #endif /* USE_USB_AUDIO_PLAYPBACK*/
 #ifdef USE_USB_AUDIO_RECORDING
+#ifdef USE_AUDIO_RECORDING_VOICE
+  /* stopped first, it takes its frames from the record mic */
+  usb_voice_session.SessionDeInit((uint32_t) &usb_voice_session);
+  audio_function->as_interfaces[i + 1].alternate = 0;
+#endif /* USE_AUDIO_RECORDING_VOICE */
   usb_record_session.SessionDeInit((uint32_t) &usb_record_session);
   audio_function->as_interfaces[i].alternate = 0;
 #endif /* USE_USB_AUDIO_RECORDING*/
@@ -164,6 +195,36 @@ static int8_t  AUDIO_USB_GetConfigDesc (uint8_t ** pdata, uint16_t * psize, uint
    while(1);
     return 0;
 }
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+/**
+  * @brief  USBD_AUDIO_Suspend
+  *         parks the started sessions on a bus suspend and resumes them,
+  *         called from the USB suspend and resume interrupts
+  * @param  suspend: 1 on suspend, 0 on resume
+  * @retval None
+  */
+void USBD_AUDIO_Suspend(uint8_t suspend)
+{
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  if(usb_play_session.SessionSuspend != NULL)
+  {
+    usb_play_session.SessionSuspend(suspend, (uint32_t) &usb_play_session);
+  }
+#ifdef USE_AUDIO_PLAYBACK_MIX
+  if(usb_mix_session.SessionSuspend != NULL)
+  {
+    usb_mix_session.SessionSuspend(suspend, (uint32_t) &usb_mix_session);
+  }
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#endif /* USE_USB_AUDIO_PLAYPBACK*/
+#ifdef USE_USB_AUDIO_RECORDING
+  if(usb_record_session.SessionSuspend != NULL)
+  {
+    usb_record_session.SessionSuspend(suspend, (uint32_t) &usb_record_session);
+  }
+#endif /* USE_USB_AUDIO_RECORDING*/
+}
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 #ifdef USE_AUDIO_USB_INTERRUPT
 /**
   * @brief  USBD_AUDIO_ExecuteControl
@@ -193,4 +254,98 @@ int8_t USBD_AUDIO_ExecuteControl( uint8_t func, AUDIO_ControlCommandTypedef cont
   return 0;
 }
 #endif /* USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+/**
+  * @brief  USBD_AUDIO_GetSessionStats
+  *         reads the state of one streaming session
+  * @param  func: USBD_AUDIO_PLAYBACK or USBD_AUDIO_RECORD
+  * @param  stats: filled with session state
+  * @retval status 0 if no error, -1 if the function is not built
+  */
+int8_t USBD_AUDIO_GetSessionStats(uint8_t func, AUDIO_USB_SessionStatsTypeDef* stats)
+{
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  if(func == USBD_AUDIO_PLAYBACK)
+  {
+#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
+    stats->iso_in_incomplete_count = USBD_AUDIO_GetIsoINIncompleteCount(&hUsbDeviceHS, USB_AUDIO_CONFIG_PLAY_EP_SYNC);
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+    stats->iso_in_incomplete_count = 0;
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+    stats->iso_out_incomplete_count = USBD_AUDIO_GetIsoOUTIncompleteCount(&hUsbDeviceHS, USBD_AUDIO_CONFIG_PLAY_EP_OUT);
+    return usb_play_session.GetStats(stats, (uint32_t) &usb_play_session);
+  }
+#endif /*  USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+  if(func == USBD_AUDIO_RECORD)
+  {
+    stats->iso_in_incomplete_count = USBD_AUDIO_GetIsoINIncompleteCount(&hUsbDeviceHS, USB_AUDIO_CONFIG_RECORD_EP_IN);
+    stats->iso_out_incomplete_count = 0;
+    return usb_record_session.GetStats(stats, (uint32_t) &usb_record_session);
+  }
+#endif /*  USE_USB_AUDIO_RECORDING */
+  return -1;
+}
+
+/**
+  * @brief  USBD_AUDIO_SetSessionParameter
+  *         sets a control of one streaming session from the device side
+  * @param  func: USBD_AUDIO_PLAYBACK or USBD_AUDIO_RECORD
+  * @param  param: parameter to set
+  * @param  channel: 0 for master, 1..n for a channel
+  * @param  value: new value
+  * @retval status 0 if no error
+  */
+int8_t USBD_AUDIO_SetSessionParameter(uint8_t func, AUDIO_USB_SessionParamTypedef param,
+                                      uint16_t channel, int32_t value)
+{
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  if(func == USBD_AUDIO_PLAYBACK)
+  {
+    return usb_play_session.SetParameter(param, channel, value, (uint32_t) &usb_play_session);
+  }
+#endif /*  USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+  if(func == USBD_AUDIO_RECORD)
+  {
+    return usb_record_session.SetParameter(param, channel, value, (uint32_t) &usb_record_session);
+  }
+#endif /*  USE_USB_AUDIO_RECORDING */
+  return -1;
+}
+
+#ifdef USE_AUDIO_ISO_SLACK
+/**
+  * @brief  USBD_AUDIO_GetSessionSlack
+  *         reads the deadline slack of the endpoints of one streaming session
+  * @param  func: USBD_AUDIO_PLAYBACK or USBD_AUDIO_RECORD
+  * @param  data: filled with the data endpoint slack
+  * @param  sync: filled with the feedback endpoint slack, cleared when none
+  * @retval status 0 if no error, -1 if the function is not built
+  */
+int8_t USBD_AUDIO_GetSessionSlack(uint8_t func, USBD_AUDIO_IsoSlackTypeDef* data, USBD_AUDIO_IsoSlackTypeDef* sync)
+{
+  memset(sync, 0, sizeof(USBD_AUDIO_IsoSlackTypeDef));
+#ifdef USE_USB_AUDIO_PLAYPBACK
+  if(func == USBD_AUDIO_PLAYBACK)
+  {
+#ifdef USE_AUDIO_PLAYBACK_USB_FEEDBACK
+    if(USBD_AUDIO_GetIsoSlack(&hUsbDeviceHS, USB_AUDIO_CONFIG_PLAY_EP_SYNC, sync) != USBD_OK)
+    {
+      return -1;
+    }
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK */
+    return (USBD_AUDIO_GetIsoSlack(&hUsbDeviceHS, USBD_AUDIO_CONFIG_PLAY_EP_OUT, data) == USBD_OK) ? 0 : -1;
+  }
+#endif /*  USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_USB_AUDIO_RECORDING
+  if(func == USBD_AUDIO_RECORD)
+  {
+    return (USBD_AUDIO_GetIsoSlack(&hUsbDeviceHS, USB_AUDIO_CONFIG_RECORD_EP_IN, data) == USBD_OK) ? 0 : -1;
+  }
+#endif /*  USE_USB_AUDIO_RECORDING */
+  return -1;
+}
+#endif /* USE_AUDIO_ISO_SLACK */
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
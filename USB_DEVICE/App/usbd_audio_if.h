@@ -56,18 +56,29 @@
 /* Exported constants --------------------------------------------------------*/
  extern USBD_AUDIO_InterfaceCallbacksfTypeDef audio_class_interface;
 /* Exported types ------------------------------------------------------------*/
-#ifdef USE_AUDIO_USB_INTERRUPT
+#if defined(USE_AUDIO_USB_INTERRUPT) || defined(USE_AUDIO_CDC_COMMAND) || defined(USE_AUDIO_VENDOR_REQUESTS)
 typedef enum 
 {
   USBD_AUDIO_PLAYBACK  = 0x01,
   USBD_AUDIO_RECORD    = 0x02
 }USBD_AUDIO_FunctionTypedef;
-#endif /* USE_AUDIO_USB_INTERRUPT*/
+#endif /* USE_AUDIO_USB_INTERRUPT || USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 /* Exported macro ------------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+void   USBD_AUDIO_Suspend(uint8_t suspend);
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 #ifdef USE_AUDIO_USB_INTERRUPT
 int8_t USBD_AUDIO_ExecuteControl( uint8_t func, AUDIO_ControlCommandTypedef control , uint32_t val , uint32_t private_data);
 #endif /* USE_AUDIO_USB_INTERRUPT*/
+#if (defined USE_AUDIO_CDC_COMMAND) || (defined USE_AUDIO_VENDOR_REQUESTS)
+int8_t USBD_AUDIO_GetSessionStats(uint8_t func, AUDIO_USB_SessionStatsTypeDef* stats);
+int8_t USBD_AUDIO_SetSessionParameter(uint8_t func, AUDIO_USB_SessionParamTypedef param,
+                                      uint16_t channel, int32_t value);
+#ifdef USE_AUDIO_ISO_SLACK
+int8_t USBD_AUDIO_GetSessionSlack(uint8_t func, USBD_AUDIO_IsoSlackTypeDef* data, USBD_AUDIO_IsoSlackTypeDef* sync);
+#endif /* USE_AUDIO_ISO_SLACK */
+#endif /* USE_AUDIO_CDC_COMMAND || USE_AUDIO_VENDOR_REQUESTS */
 #endif /* __USBD_AUDIO_IF_H */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -45,6 +45,17 @@
 #include "usbd_cdc_if.h"
 //#include "cat_driver.h"
 #include "usb_device.h"
+/* the CDC callbacks post the work of every CDC client to the pump */
+#include "audio_pump.h"
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+#include "audio_cdc_bridge.h"
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+#include "audio_sof_tick.h"
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 //#include "usbd_composite.h"
 //#include "usbd_composite_desc.h"
 
@@ -75,8 +86,22 @@
 /* USER CODE BEGIN PRIVATE_DEFINES */
 /* Define size for the receive and transmit buffer over CDC */
 /* It's up to user to redefine and/or remove those define */
-#define APP_RX_DATA_SIZE  64
+#define APP_RX_DATA_SIZE  2048 /* receive ring , power of two */
 #define APP_TX_DATA_SIZE  2048
+#if (APP_RX_DATA_SIZE & (APP_RX_DATA_SIZE - 1U)) != 0U
+#error "APP_RX_DATA_SIZE must be a power of two"
+#endif /* APP_RX_DATA_SIZE */
+#ifdef USE_USB_HS_ULPI_PHY
+#define CDC_RX_PACKET_SIZE  CDC_DATA_HS_OUT_PACKET_SIZE
+#else /* USE_USB_HS_ULPI_PHY */
+#define CDC_RX_PACKET_SIZE  CDC_DATA_FS_OUT_PACKET_SIZE
+#endif /* USE_USB_HS_ULPI_PHY */
+#define CDC_CLASS_ID        0U /* CDC is the first class registered in the composite */
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/* coalesce time in SOF ticks, at least one */
+#define CDC_TX_COALESCE_TICKS(us) (((((uint32_t)(us) * AUDIO_SOF_TICK_PER_MS) + 999U) / 1000U) + \
+                                   ((((uint32_t)(us) * AUDIO_SOF_TICK_PER_MS) == 0U) ? 1U : 0U))
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 /* USER CODE END PRIVATE_DEFINES */
 /**
   * @}
@@ -99,17 +124,43 @@ extern USBD_HandleTypeDef hUsbDeviceHS;
 
 /* Create buffer for reception and transmission           */
 /* It's up to user to redefine and/or remove those define */
-/* Received Data over USB are stored in this buffer       */
-uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
+/* Received Data over USB are stored in these buffers, used in turn : the
+   next packet is received in one while the other is copied to the ring */
+__ALIGN_BEGIN uint8_t UserRxBufferFS[2][CDC_RX_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+/* Received data waiting for the application, free running pointers */
+static uint8_t UserRxRingFS[APP_RX_DATA_SIZE];
 
 /* Send Data over USB CDC are stored in this buffer       */
-uint8_t UserTxBufferFS   [APP_TX_DATA_SIZE];
-
-uint32_t CDC_Tx_PtrIn  = 0;
-uint32_t CDC_Tx_PtrOut = 0;
+__ALIGN_BEGIN uint8_t UserTxBufferFS   [APP_TX_DATA_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+
+#ifdef USE_USB_HS_DMA
+/* Aligned copy of the packet in flight when its ring offset is not DMA aligned */
+__ALIGN_BEGIN static uint8_t UserTxPacketFS[CDC_DATA_FS_IN_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+#endif /* USE_USB_HS_DMA */
+
+/* UserTxBufferFS is a ring : written by CDC_Transmit_FS / CDC_Write_FS at PtrIn,
+   sent from PtrOut, reusable up to PtrFree which is the start of the packet in flight.
+   State is 1 while a packet is in flight, each transfer complete sends the next one */
+__IO uint32_t CDC_Tx_PtrIn  = 0;
+__IO uint32_t CDC_Tx_PtrOut = 0;
+__IO uint32_t CDC_Tx_PtrFree = 0;
 uint32_t CDC_Tx_Length  = 0;
 
-uint8_t  CDC_Tx_State = 0;
+__IO uint8_t  CDC_Tx_State = 0;
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/* policy of the data waiting in the ring, and the coalesce deadline armed by
+   the first CDC_TX_COALESCE write, in SOF ticks */
+static __IO uint8_t  CDC_Tx_Policy = CDC_TX_POLICY_NONE;
+static __IO uint8_t  CDC_Tx_DeadlineArmed = 0;
+static uint32_t      CDC_Tx_DeadlineStart = 0;
+static uint32_t      CDC_Tx_CoalesceBytes = CDC_TX_COALESCE_BYTES;
+static uint32_t      CDC_Tx_CoalesceTicks = CDC_TX_COALESCE_TICKS(CDC_TX_COALESCE_US);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
+
+__IO uint32_t CDC_Rx_PtrIn  = 0;
+__IO uint32_t CDC_Rx_PtrOut = 0;
+__IO uint8_t  CDC_Rx_Paused = 0; /* OUT endpoint not armed because the ring is full, host is NAKed */
+static uint8_t CDC_Rx_Buffer = 0; /* buffer of UserRxBufferFS armed for reception */
 
 typedef struct
 {
@@ -153,8 +204,16 @@ static int8_t CDC_Init_FS     (void);
 static int8_t CDC_DeInit_FS   (void);
 static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length);
 static int8_t CDC_Receive_FS  (uint8_t* pbuf, uint32_t *Len);
-static int8_t  CDC_SOF (USBD_HandleTypeDef *pdev);
-static int8_t  CDC_DataIn (USBD_HandleTypeDef *pdev);
+static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum);
+static void    CDC_Handle_USBAsynchXfer (USBD_HandleTypeDef *pdev);
+static uint32_t CDC_TxFreeSize(void);
+static void    CDC_TxRingWrite(const uint8_t* Buf, uint32_t Len);
+static uint8_t CDC_RxArm(void);
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+static void    CDC_TxSetPolicy(CDC_TxPolicyTypeDef Policy);
+static uint32_t CDC_TxPolicyLength(uint32_t Len);
+static void    CDC_TxCoalesceTick(uint32_t private_data);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
@@ -169,8 +228,7 @@ USBD_CDC_ItfTypeDef USBD_Interface_fops_FS =
   CDC_DeInit_FS,
   CDC_Control_FS,  
   CDC_Receive_FS,
-  CDC_SOF,
-  CDC_DataIn
+  CDC_TransmitCplt_FS
 };
 
 
@@ -187,8 +245,21 @@ static int8_t CDC_Init_FS(void)
 { 
   /* USER CODE BEGIN 3 */ 
   /* Set Application Buffers */
+  CDC_Tx_State = 0;
+  CDC_Tx_Length = 0;
+  CDC_Tx_PtrOut = CDC_Tx_PtrIn;
+  CDC_Tx_PtrFree = CDC_Tx_PtrIn;
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+  /* data left by the last configuration goes out at once */
+  CDC_Tx_Policy = CDC_TX_IMMEDIATE;
+  CDC_Tx_DeadlineArmed = 0;
+  AUDIO_SofTickSubscribe(CDC_TxCoalesceTick, 1, 0);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
   USBD_CDC_SetTxBuffer(&hUsbDeviceHS, UserTxBufferFS, 0,0);//IF 0 for CDC
-  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, UserRxBufferFS);
+  CDC_Rx_PtrOut = CDC_Rx_PtrIn;
+  CDC_Rx_Paused = 0;
+  CDC_Rx_Buffer = 0;
+  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, UserRxBufferFS[0]);
   return (USBD_OK);
   /* USER CODE END 3 */ 
 }
@@ -262,6 +333,11 @@ static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length)
       // satisfy the host when it asks for the current
       // line coding
 	memcpy(&CDC_Linecoding,pbuf,sizeof(CDC_Linecoding));
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+    /* the bridge applies it to its USART */
+    AUDIO_CdcBridgeSetLineCoding(CDC_Linecoding.speed, CDC_Linecoding.stop,
+                                 CDC_Linecoding.parity, CDC_Linecoding.bits);
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
     break;
   case CDC_GET_LINE_CODING:     
     memcpy(pbuf,&CDC_Linecoding,length);
@@ -295,10 +371,10 @@ static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length)
   *         through this function.
   *           
   *         @note
-  *         This function will block any OUT packet reception on USB endpoint 
-  *         untill exiting this function. If you exit this function before transfer
-  *         is complete on CDC interface (ie. using DMA controller) it will result 
-  *         in receiving more data while previous ones are still not sent.
+  *         The other reception buffer is armed first so the next packet is
+  *         received while this one is copied to the ring. When the ring
+  *         can't take one more packet the endpoint is left NAKed until
+  *         CDC_Read_FS makes room.
   *                 
   * @param  Buf: Buffer of data to be received
   * @param  Len: Number of data received (in bytes)
@@ -307,23 +383,144 @@ static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS (uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-    for (uint32_t i = 0; i < *Len; i++)
-    {
-//        CatDriver_InterfaceBufferAddData(Buf[i]);
-    }
+  uint32_t ptr_in = CDC_Rx_PtrIn;
+  uint32_t offset = ptr_in & (APP_RX_DATA_SIZE - 1U);
+  uint32_t length = *Len;
+  uint32_t first;
 
-  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, &Buf[0]);
-  USBD_CDC_ReceivePacket(&hUsbDeviceHS);
+  /* the ring had room for this packet when it was armed */
+  if (CDC_RxArm() != 0U)
+  {
+      CDC_Rx_Paused = 1;
+  }
+  first = APP_RX_DATA_SIZE - offset;
+  if (first > length)
+  {
+      first = length;
+  }
+  memcpy(&UserRxRingFS[offset], Buf, first);
+  memcpy(&UserRxRingFS[0], Buf + first, length - first);
+  __DMB();
+  CDC_Rx_PtrIn = ptr_in + length;
+  AUDIO_TRACE(AUDIO_TRACE_CDC_RX, 0, length);
+#ifdef USE_AUDIO_IDLE_POWER
+  AUDIO_PowerCdcActivity();
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_CDC_COMMAND
+  /* commands are parsed out of interrupt context */
+  AUDIO_PumpPost(AUDIO_PUMP_CDC_COMMAND);
+#endif /* USE_AUDIO_CDC_COMMAND */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+  AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
   return (USBD_OK);
   /* USER CODE END 6 */ 
 }
 
+/**
+  * @brief  CDC_Peek_FS
+  *         Copies received data without releasing it
+  * @param  Buf: Buffer to fill
+  * @param  Len: Maximal number of data to copy (in bytes)
+  * @retval Number of bytes copied
+  */
+uint16_t CDC_Peek_FS(uint8_t* Buf, uint16_t Len)
+{
+  uint32_t ptr_out = CDC_Rx_PtrOut;
+  uint32_t offset = ptr_out & (APP_RX_DATA_SIZE - 1U);
+  uint32_t length = CDC_Rx_PtrIn - ptr_out;
+  uint32_t first;
+
+  /* data is read after the write position */
+  __DMB();
+  if (length > Len)
+  {
+      length = Len;
+  }
+  first = APP_RX_DATA_SIZE - offset;
+  if (first > length)
+  {
+      first = length;
+  }
+  memcpy(Buf, &UserRxRingFS[offset], first);
+  memcpy(Buf + first, &UserRxRingFS[0], length - first);
+  return (uint16_t)length;
+}
+
+/**
+  * @brief  CDC_Read_FS
+  *         Copies received data and releases it, reception restarts once
+  *         a packet fits in the ring again
+  * @param  Buf: Buffer to fill
+  * @param  Len: Maximal number of data to read (in bytes)
+  * @retval Number of bytes read
+  */
+uint16_t CDC_Read_FS(uint8_t* Buf, uint16_t Len)
+{
+  uint16_t length = CDC_Peek_FS(Buf, Len);
+
+  /* data is copied before the writer may reuse its place */
+  __DMB();
+  CDC_Rx_PtrOut += length;
+  if (CDC_Rx_Paused)
+  {
+      uint32_t primask = __get_PRIMASK();
+
+      __disable_irq();
+      if (CDC_Rx_Paused && (CDC_RxArm() == 0U))
+      {
+          CDC_Rx_Paused = 0;
+      }
+      __set_PRIMASK(primask);
+  }
+  return length;
+}
+
+/**
+  * @brief  CDC_GetRxCount_FS
+  *         Number of received bytes waiting to be read
+  * @param  None
+  * @retval Number of bytes
+  */
+uint32_t CDC_GetRxCount_FS(void)
+{
+  return CDC_Rx_PtrIn - CDC_Rx_PtrOut;
+}
+
+/**
+  * @brief  CDC_RxArm
+  *         Arms the OUT endpoint with the other reception buffer when the
+  *         ring has room for the packet in flight and a new one, else the
+  *         endpoint stays NAKed
+  * @param  None
+  * @retval 0 if armed, 1 if the ring is full
+  */
+static uint8_t CDC_RxArm(void)
+{
+  uint32_t free_size = APP_RX_DATA_SIZE - (CDC_Rx_PtrIn - CDC_Rx_PtrOut);
+  uint8_t  class_id = (uint8_t)hUsbDeviceHS.classId;
+
+  /* when paused no packet is in flight, the buffer received last is already in the ring */
+  if (free_size < ((CDC_Rx_Paused ? 1U : 2U) * CDC_RX_PACKET_SIZE))
+  {
+      return 1;
+  }
+  CDC_Rx_Buffer ^= 1U;
+  /* called from the application as well, the class works on the current class id */
+  hUsbDeviceHS.classId = CDC_CLASS_ID;
+  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, UserRxBufferFS[CDC_Rx_Buffer]);
+  USBD_CDC_ReceivePacket(&hUsbDeviceHS);
+  hUsbDeviceHS.classId = class_id;
+  return 0;
+}
+
 /**
   * @brief  CDC_Transmit_FS
   *         Data send over USB IN endpoint are sent over CDC interface 
   *         through this function.           
   *         @note
-  *         
+  *         Data is copied to the transmit ring and sent at once when the
+  *         pipe is idle, the whole buffer is accepted or nothing
   *                 
   * @param  Buf: Buffer of data to be send
   * @param  Len: Number of data to be send (in bytes)
@@ -333,26 +530,244 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 {
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */ 
-  uint32_t tx_counter = 0;
+  if (Len > (APP_TX_DATA_SIZE - 1U))
+  {
+      return USBD_FAIL;
+  }
+  if (CDC_TxFreeSize() < Len)
+  {
+      return USBD_BUSY;
+  }
+#ifdef USE_AUDIO_IDLE_POWER
+  AUDIO_PowerCdcActivity();
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+  CDC_TxSetPolicy(CDC_TX_IMMEDIATE);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
+  CDC_TxRingWrite(Buf, Len);
+  AUDIO_TRACE(AUDIO_TRACE_CDC_TX, 0, Len);
+  /* USER CODE END 7 */ 
+  return result;
+}
 
-  while (tx_counter < Len)
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/**
+  * @brief  CDC_TransmitPolicy_FS
+  *         as CDC_Transmit_FS, the data is sent following the policy. Many
+  *         small records then share the USB transactions
+  * @param  Buf: Buffer of data to be send
+  * @param  Len: Number of data to be send (in bytes)
+  * @param  Policy: CDC_TX_IMMEDIATE, CDC_TX_COALESCE or CDC_TX_FULL_PACKET
+  * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
+  */
+uint8_t CDC_TransmitPolicy_FS(uint8_t* Buf, uint16_t Len, CDC_TxPolicyTypeDef Policy)
+{
+  if ((Len > (APP_TX_DATA_SIZE - 1U)) || (Policy >= CDC_TX_POLICY_NONE))
   {
-      UserTxBufferFS[CDC_Tx_PtrIn] = *(Buf+tx_counter);
+      return USBD_FAIL;
+  }
+  if (CDC_TxFreeSize() < Len)
+  {
+      return USBD_BUSY;
+  }
+#ifdef USE_AUDIO_IDLE_POWER
+  AUDIO_PowerCdcActivity();
+#endif /* USE_AUDIO_IDLE_POWER */
+  CDC_TxSetPolicy(Policy);
+  CDC_TxRingWrite(Buf, Len);
+  AUDIO_TRACE(AUDIO_TRACE_CDC_TX, 0, Len);
+  return USBD_OK;
+}
 
-      CDC_Tx_PtrIn++;
+/**
+  * @brief  CDC_SetTxCoalesce_FS
+  *         limits of CDC_TX_COALESCE : the data goes out once the ring holds
+  *         Bytes or TimeUs after the first coalesced write, rounded up to SOF
+  * @param  Bytes: 1 to the ring size
+  * @param  TimeUs: wait from the first coalesced write in us , at least one SOF
+  * @retval None
+  */
+void CDC_SetTxCoalesce_FS(uint16_t Bytes, uint16_t TimeUs)
+{
+  CDC_Tx_CoalesceBytes = ((Bytes == 0U) || (Bytes > (APP_TX_DATA_SIZE - 1U))) ? (APP_TX_DATA_SIZE - 1U) : Bytes;
+  CDC_Tx_CoalesceTicks = CDC_TX_COALESCE_TICKS(TimeUs);
+}
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 
-      /* To avoid buffer overflow */
-      if (CDC_Tx_PtrIn >= APP_TX_DATA_SIZE)
+/**
+  * @brief  CDC_Write_FS
+  *         Copies data to the transmit ring, as much as fits. With a timeout
+  *         waits for free space until all data is accepted, the timeout
+  *         expires or the device is no more configured. Must not be called
+  *         with a timeout from an interrupt with priority higher or equal to
+  *         the USB one
+  * @param  Buf: Buffer of data to be send
+  * @param  Len: Number of data to be send (in bytes)
+  * @param  Timeout: 0 for non blocking call, else maximal wait in ms
+  * @retval Number of bytes accepted, 0 when the ring is full
+  */
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len, uint32_t Timeout)
+{
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t accepted = 0;
+  uint32_t length;
+
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+  CDC_TxSetPolicy(CDC_TX_IMMEDIATE);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
+  while (1)
+  {
+      length = CDC_TxFreeSize();
+      if (length > (Len - accepted))
       {
-          CDC_Tx_PtrIn = 0;
+          length = Len - accepted;
       }
+      if (length != 0U)
+      {
+          CDC_TxRingWrite(Buf + accepted, length);
+          accepted += length;
+      }
+      if ((accepted == Len) || (Timeout == 0U) ||
+          (hUsbDeviceHS.dev_state != USBD_STATE_CONFIGURED) ||
+          ((HAL_GetTick() - tickstart) >= Timeout))
+      {
+          break;
+      }
+  }
+  return (uint16_t)accepted;
+}
 
-      tx_counter++;
+/**
+  * @brief  CDC_TxFreeSize
+  *         Bytes which may be written in the transmit ring, the packet in
+  *         flight is not overwritten and one byte is kept to tell full from empty
+  * @param  None
+  * @retval Free size in bytes
+  */
+static uint32_t CDC_TxFreeSize(void)
+{
+  uint32_t ptr_free = CDC_Tx_PtrFree;
+
+  if (ptr_free >= APP_TX_DATA_SIZE)
+  {
+      ptr_free -= APP_TX_DATA_SIZE;
   }
-  /* USER CODE END 7 */ 
-  return result;
+  return (ptr_free + APP_TX_DATA_SIZE - CDC_Tx_PtrIn - 1U) % APP_TX_DATA_SIZE;
 }
 
+/**
+  * @brief  CDC_TxRingWrite
+  *         Copies data at the ring write position in at most two blocks, then
+  *         publishes it and starts the transfer if the pipe is idle
+  * @param  Buf: Buffer of data to be send
+  * @param  Len: Number of data to be send, caller checks the free size
+  * @retval None
+  */
+static void CDC_TxRingWrite(const uint8_t* Buf, uint32_t Len)
+{
+  uint32_t ptr_in = CDC_Tx_PtrIn;
+  uint32_t first = APP_TX_DATA_SIZE - ptr_in;
+
+  if (first > Len)
+  {
+      first = Len;
+  }
+  memcpy(&UserTxBufferFS[ptr_in], Buf, first);
+  memcpy(&UserTxBufferFS[0], Buf + first, Len - first);
+  ptr_in += Len;
+  if (ptr_in >= APP_TX_DATA_SIZE)
+  {
+      ptr_in -= APP_TX_DATA_SIZE;
+  }
+  /* data is in memory before the sender sees the new write position */
+  __DMB();
+  CDC_Tx_PtrIn = ptr_in;
+
+  /* idle pipe : send now, else the transfer complete chains to this data */
+  if ((CDC_Tx_State == 0U) && (hUsbDeviceHS.dev_state == USBD_STATE_CONFIGURED))
+  {
+      uint32_t primask = __get_PRIMASK();
+
+      __disable_irq();
+      CDC_Handle_USBAsynchXfer(&hUsbDeviceHS);
+      __set_PRIMASK(primask);
+  }
+}
+
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/**
+  * @brief  CDC_TxSetPolicy
+  *         merges the policy of a write with the one of the data waiting, the
+  *         most urgent is kept. The first coalesced write arms the deadline
+  * @param  Policy: policy of the write
+  * @retval None
+  */
+static void CDC_TxSetPolicy(CDC_TxPolicyTypeDef Policy)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  if (Policy < CDC_Tx_Policy)
+  {
+      CDC_Tx_Policy = Policy;
+  }
+  if ((Policy == CDC_TX_COALESCE) && (CDC_Tx_DeadlineArmed == 0U))
+  {
+      CDC_Tx_DeadlineStart = AUDIO_SofTickGetCount();
+      CDC_Tx_DeadlineArmed = 1;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  CDC_TxPolicyLength
+  *         part of the contiguous data from PtrOut which the policy lets go now
+  * @param  Len: contiguous bytes from PtrOut
+  * @retval bytes to send, 0 to wait
+  */
+static uint32_t CDC_TxPolicyLength(uint32_t Len)
+{
+  uint32_t pending = (CDC_Tx_PtrIn + APP_TX_DATA_SIZE - CDC_Tx_PtrOut) % APP_TX_DATA_SIZE;
+
+  switch (CDC_Tx_Policy)
+  {
+  case CDC_TX_COALESCE:
+      return (pending >= CDC_Tx_CoalesceBytes) ? Len : 0U;
+  case CDC_TX_FULL_PACKET:
+      if (Len < pending)
+      {
+          /* the ring end : its tail goes in a short packet */
+          return Len;
+      }
+      return Len - (Len % CDC_DATA_FS_IN_PACKET_SIZE);
+  default:
+      return Len;
+  }
+}
+
+/**
+  * @brief  CDC_TxCoalesceTick
+  *         SOF tick : past the deadline the coalesced data goes out
+  * @param  private_data: not used
+  * @retval None
+  */
+static void CDC_TxCoalesceTick(uint32_t private_data)
+{
+  UNUSED(private_data);
+
+  if ((CDC_Tx_DeadlineArmed != 0U) &&
+      ((AUDIO_SofTickGetCount() - CDC_Tx_DeadlineStart) >= CDC_Tx_CoalesceTicks))
+  {
+      CDC_Tx_DeadlineArmed = 0;
+      if (CDC_Tx_Policy > CDC_TX_IMMEDIATE)
+      {
+          CDC_Tx_Policy = CDC_TX_IMMEDIATE;
+      }
+      CDC_Handle_USBAsynchXfer(&hUsbDeviceHS);
+  }
+}
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
+
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
@@ -367,30 +782,48 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
 
 
+/**
+  * @brief  CDC_InitiateTransmit
+  *         Sends the contiguous data from PtrOut in one transfer of many
+  *         packets, the class adds a ZLP when its length is a multiple of
+  *         the max packet size
+  * @param  pdev: instance
+  * @retval None
+  */
 static void CDC_InitiateTransmit(USBD_HandleTypeDef *pdev)
 {
-    uint16_t USB_Tx_ptr;
-    uint16_t USB_Tx_length;
-
-    if (CDC_Tx_Length > CDC_DATA_FS_IN_PACKET_SIZE)
-    {
-        USB_Tx_ptr = CDC_Tx_PtrOut;
-        USB_Tx_length = CDC_DATA_FS_IN_PACKET_SIZE;
+    uint32_t USB_Tx_ptr;
+    uint32_t USB_Tx_length;
 
-        CDC_Tx_PtrOut += CDC_DATA_FS_IN_PACKET_SIZE;
-        CDC_Tx_Length -= CDC_DATA_FS_IN_PACKET_SIZE;
-    }
-    else
+    USB_Tx_ptr = CDC_Tx_PtrOut;
+    USB_Tx_length = CDC_Tx_Length;
+#ifdef USE_USB_HS_DMA
+    if(!USBD_DMA_IS_ALIGNED(&UserTxBufferFS[USB_Tx_ptr]))
     {
-        USB_Tx_ptr = CDC_Tx_PtrOut;
-        USB_Tx_length = CDC_Tx_Length;
+      /* one short packet through the aligned copy, next transfer starts aligned */
+      uint32_t bounce_length = CDC_DATA_FS_IN_PACKET_SIZE -
+                               ((uint32_t)&UserTxBufferFS[USB_Tx_ptr] & (USBD_DMA_BUFFER_ALIGN - 1U));
 
-        CDC_Tx_PtrOut += CDC_Tx_Length;
-        CDC_Tx_Length = 0;
+      if (USB_Tx_length > bounce_length)
+      {
+          USB_Tx_length = bounce_length;
+      }
     }
+#endif /* USE_USB_HS_DMA */
+    CDC_Tx_PtrOut += USB_Tx_length;
+    CDC_Tx_Length -= USB_Tx_length;
 
     CDC_Tx_State = 1;
+    CDC_Tx_PtrFree = USB_Tx_ptr;
 
+#ifdef USE_USB_HS_DMA
+    if(!USBD_DMA_IS_ALIGNED(&UserTxBufferFS[USB_Tx_ptr]))
+    {
+      memcpy(UserTxPacketFS, &UserTxBufferFS[USB_Tx_ptr], USB_Tx_length);
+      USBD_CDC_SetTxBuffer(pdev, UserTxPacketFS, USB_Tx_length, 0);//IF 0 for CDC
+    }
+    else
+#endif /* USE_USB_HS_DMA */
     USBD_CDC_SetTxBuffer(pdev,
             &UserTxBufferFS[USB_Tx_ptr],
             USB_Tx_length,0);//IF 0 for CDC
@@ -420,6 +853,11 @@ static void CDC_Handle_USBAsynchXfer (USBD_HandleTypeDef *pdev)
         {
             CDC_Tx_Length = 0;
             CDC_Tx_State = 0;
+            CDC_Tx_PtrFree = CDC_Tx_PtrOut;
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+            CDC_Tx_Policy = CDC_TX_POLICY_NONE;
+            CDC_Tx_DeadlineArmed = 0;
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
         }
         else
         {
@@ -433,40 +871,74 @@ static void CDC_Handle_USBAsynchXfer (USBD_HandleTypeDef *pdev)
                 CDC_Tx_Length = CDC_Tx_PtrIn - CDC_Tx_PtrOut;
 
             }
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+            CDC_Tx_Length = CDC_TxPolicyLength(CDC_Tx_Length);
+            if (CDC_Tx_Length == 0U)
+            {
+                /* held by the policy : a write or the deadline sends it */
+                return;
+            }
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
             CDC_InitiateTransmit(pdev);
         }
     }
 }
 
-static int8_t  CDC_DataIn (USBD_HandleTypeDef *pdev)
+/**
+  * @brief  CDC_TransmitCplt_FS
+  *         Data transmitted callback, next packet is sent at once so
+  *         transfers are back to back while the ring holds data
+  * @param  Buf: Buffer of data sent
+  * @param  Len: Number of data sent (in bytes)
+  * @param  epnum: endpoint number
+  * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
 {
+    UNUSED(Buf);
+    UNUSED(Len);
+    UNUSED(epnum);
+
     if (CDC_Tx_State == 1)
     {
         if (CDC_Tx_Length == 0)
         {
+            /* last packet is sent, its place in the ring is free */
+            CDC_Tx_PtrFree = CDC_Tx_PtrOut;
             CDC_Tx_State = 0;
+            /* data written while it was in flight */
+            CDC_Handle_USBAsynchXfer(&hUsbDeviceHS);
+#ifndef USE_AUDIO_CDC_TELEMETRY
+#ifdef USE_AUDIO_TAP
+            /* room is available for tap frames waiting */
+            AUDIO_PumpPost(AUDIO_PUMP_TAP);
+#endif /* USE_AUDIO_TAP */
+#if (defined USE_AUDIO_TRACE) && (!defined USE_AUDIO_TRACE_ITM)
+            AUDIO_PumpPost(AUDIO_PUMP_TRACE);
+#endif /* USE_AUDIO_TRACE && !USE_AUDIO_TRACE_ITM */
+#if (defined USE_AUDIO_LOG) && (!defined USE_AUDIO_LOG_ITM)
+            AUDIO_PumpPost(AUDIO_PUMP_LOG);
+#endif /* USE_AUDIO_LOG && !USE_AUDIO_LOG_ITM */
+#ifdef USE_AUDIO_SPECTRUM
+            AUDIO_PumpPost(AUDIO_PUMP_SPECTRUM);
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_SNAPSHOT
+            AUDIO_PumpPost(AUDIO_PUMP_SNAPSHOT);
+#endif /* USE_AUDIO_SNAPSHOT */
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_CDC_STRESS
+            AUDIO_PumpPost(AUDIO_PUMP_STRESS);
+#endif /* USE_AUDIO_CDC_STRESS */
+#ifdef USE_AUDIO_CDC_UART_BRIDGE
+            /* room is available for UART data waiting in the DMA ring */
+            AUDIO_PumpPost(AUDIO_PUMP_CDC_BRIDGE);
+#endif /* USE_AUDIO_CDC_UART_BRIDGE */
         }
         else
         {
-            CDC_InitiateTransmit(pdev);
+            CDC_InitiateTransmit(&hUsbDeviceHS);
         }
     }
 
-    return CDC_Tx_State;
-}
-
-static int8_t  CDC_SOF (USBD_HandleTypeDef *pdev)
-{
-    static uint32_t FrameCount = 0;
-
-    if (FrameCount++ == 2) // every second frame
-    {
-        /* Reset the frame counter */
-        FrameCount = 0;
-
-        /* Check the data to be sent through IN pipe */
-        CDC_Handle_USBAsynchXfer(pdev);
-    }
-
     return USBD_OK;
 }
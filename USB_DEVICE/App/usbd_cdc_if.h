@@ -66,6 +66,15 @@
   * @{
   */ 
 /* USER CODE BEGIN EXPORTED_DEFINES */
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/* default limits of CDC_TX_COALESCE, see CDC_SetTxCoalesce_FS */
+#ifndef CDC_TX_COALESCE_BYTES
+#define CDC_TX_COALESCE_BYTES     CDC_DATA_FS_IN_PACKET_SIZE
+#endif /* CDC_TX_COALESCE_BYTES */
+#ifndef CDC_TX_COALESCE_US
+#define CDC_TX_COALESCE_US        1000U
+#endif /* CDC_TX_COALESCE_US */
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 /* USER CODE END EXPORTED_DEFINES */
 
 /**
@@ -83,6 +92,18 @@
  } CdcVcp_CtrlLines_t;
 
 extern __IO CdcVcp_CtrlLines_t  cdcvcp_ctrllines;
+
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+/* when the data of a write is sent, from the most urgent. Data waiting in the
+   ring goes with the most urgent write among it */
+typedef enum
+{
+  CDC_TX_IMMEDIATE,     /* at once when the pipe is idle, replies */
+  CDC_TX_COALESCE,      /* once the ring holds the coalesce bytes or after the coalesce time */
+  CDC_TX_FULL_PACKET,   /* whole packets only, the tail waits for more data */
+  CDC_TX_POLICY_NONE    /* ring empty */
+} CDC_TxPolicyTypeDef;
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 /* USER CODE END EXPORTED_TYPES */
 
 /**
@@ -115,6 +136,14 @@ extern USBD_CDC_ItfTypeDef  USBD_Interface_fops_FS;
   * @{
   */ 
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
+uint16_t CDC_Write_FS(const uint8_t* Buf, uint16_t Len, uint32_t Timeout);
+uint16_t CDC_Read_FS(uint8_t* Buf, uint16_t Len);
+uint16_t CDC_Peek_FS(uint8_t* Buf, uint16_t Len);
+uint32_t CDC_GetRxCount_FS(void);
+#ifdef USE_AUDIO_CDC_TX_COALESCE
+uint8_t CDC_TransmitPolicy_FS(uint8_t* Buf, uint16_t Len, CDC_TxPolicyTypeDef Policy);
+void    CDC_SetTxCoalesce_FS(uint16_t Bytes, uint16_t TimeUs);
+#endif /* USE_AUDIO_CDC_TX_COALESCE */
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
 /* USER CODE END EXPORTED_FUNCTIONS */
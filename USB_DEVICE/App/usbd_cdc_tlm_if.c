@@ -0,0 +1,325 @@
+/**
+  ******************************************************************************
+  * @file    usbd_cdc_tlm_if.c
+  * @brief   Telemetry CDC : a second CDC ACM function carrying the tap and
+  *          trace frames, so bulk telemetry never delays the command and
+  *          response traffic of the first CDC. Frames are queued whole in a
+  *          transmit ring sent back to back, data received from the host is
+  *          dropped and counted.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "usbd_cdc_tlm_if.h"
+
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#include "audio_pump.h"
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+
+/* Private defines -----------------------------------------------------------*/
+#ifdef USE_USB_HS_ULPI_PHY
+#define CDC_TLM_RX_PACKET_SIZE  CDC_DATA_HS_OUT_PACKET_SIZE
+#else /* USE_USB_HS_ULPI_PHY */
+#define CDC_TLM_RX_PACKET_SIZE  CDC_DATA_FS_OUT_PACKET_SIZE
+#endif /* USE_USB_HS_ULPI_PHY */
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceHS;
+
+__ALIGN_BEGIN static uint8_t TlmRxBuffer[CDC_TLM_RX_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+__ALIGN_BEGIN static uint8_t TlmTxBuffer[CDC_TLM_TX_DATA_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+#ifdef USE_USB_HS_DMA
+/* Aligned copy of the packet in flight when its ring offset is not DMA aligned */
+__ALIGN_BEGIN static uint8_t TlmTxPacket[CDC_DATA_FS_IN_PACKET_SIZE] __ALIGN_END USBD_BUFFER_BSS;
+#endif /* USE_USB_HS_DMA */
+
+/* TlmTxBuffer is a ring : written at PtrIn, sent from PtrOut which only moves
+   when the transfer in flight completes, so its data is never overwritten.
+   State is 1 while a transfer of Length bytes is in flight */
+static __IO uint32_t CDC_TLM_Tx_PtrIn  = 0;
+static __IO uint32_t CDC_TLM_Tx_PtrOut = 0;
+static uint32_t      CDC_TLM_Tx_Length = 0;
+static __IO uint8_t  CDC_TLM_Tx_State  = 0;
+static uint32_t      CDC_TLM_Rx_Dropped = 0;
+
+/* line coding is only kept to answer the host */
+static USBD_CDC_LineCodingTypeDef CDC_TLM_Linecoding =
+{
+  921600, /* baud rate */
+  0,      /* 1 stop bit */
+  0,      /* no parity */
+  8       /* 8 data bits */
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t   CDC_TLM_Init(void);
+static int8_t   CDC_TLM_DeInit(void);
+static int8_t   CDC_TLM_Control(uint8_t cmd, uint8_t* pbuf, uint16_t length);
+static int8_t   CDC_TLM_Receive(uint8_t* pbuf, uint32_t *Len);
+static int8_t   CDC_TLM_TransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum);
+static uint32_t CDC_TLM_TxFreeSize(void);
+static void     CDC_TLM_StartTransmit(void);
+
+USBD_CDC_ItfTypeDef USBD_TLM_Interface_fops =
+{
+  CDC_TLM_Init,
+  CDC_TLM_DeInit,
+  CDC_TLM_Control,
+  CDC_TLM_Receive,
+  CDC_TLM_TransmitCplt
+};
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  CDC_TLM_Transmit
+  *         Copies a frame to the transmit ring, the whole frame is accepted or
+  *         nothing. It is sent at once when the pipe is idle
+  * @param  Buf: frame
+  * @param  Len: frame length in bytes
+  * @retval USBD_OK if queued, USBD_BUSY when the ring is full, USBD_FAIL when it can't hold the frame
+  */
+uint8_t CDC_TLM_Transmit(uint8_t* Buf, uint16_t Len)
+{
+  uint32_t ptr_in = CDC_TLM_Tx_PtrIn;
+  uint32_t first = CDC_TLM_TX_DATA_SIZE - ptr_in;
+  uint32_t primask;
+
+  if (Len > (CDC_TLM_TX_DATA_SIZE - 1U))
+  {
+    return USBD_FAIL;
+  }
+  if (CDC_TLM_TxFreeSize() < Len)
+  {
+    return USBD_BUSY;
+  }
+#ifdef USE_AUDIO_IDLE_POWER
+  AUDIO_PowerCdcActivity();
+#endif /* USE_AUDIO_IDLE_POWER */
+  if (first > Len)
+  {
+    first = Len;
+  }
+  memcpy(&TlmTxBuffer[ptr_in], Buf, first);
+  memcpy(&TlmTxBuffer[0], Buf + first, Len - first);
+  ptr_in += Len;
+  if (ptr_in >= CDC_TLM_TX_DATA_SIZE)
+  {
+    ptr_in -= CDC_TLM_TX_DATA_SIZE;
+  }
+  /* data is in memory before the sender sees the new write position */
+  __DMB();
+  CDC_TLM_Tx_PtrIn = ptr_in;
+
+  if ((CDC_TLM_Tx_State == 0U) && (hUsbDeviceHS.dev_state == USBD_STATE_CONFIGURED))
+  {
+    primask = __get_PRIMASK();
+    __disable_irq();
+    CDC_TLM_StartTransmit();
+    __set_PRIMASK(primask);
+  }
+  return USBD_OK;
+}
+
+/**
+  * @brief  CDC_TLM_GetRxDropped
+  *         Bytes sent by the host on the telemetry pipe, they are dropped
+  * @retval Number of bytes
+  */
+uint32_t CDC_TLM_GetRxDropped(void)
+{
+  return CDC_TLM_Rx_Dropped;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  CDC_TLM_Init
+  *         Restarts the transmit ring empty, frames queued before the host
+  *         configured the device are dropped
+  * @retval USBD_OK
+  */
+static int8_t CDC_TLM_Init(void)
+{
+  CDC_TLM_Tx_State = 0;
+  CDC_TLM_Tx_Length = 0;
+  CDC_TLM_Tx_PtrOut = CDC_TLM_Tx_PtrIn;
+  USBD_CDC_SetTxBuffer(&hUsbDeviceHS, TlmTxBuffer, 0, CDC_TLM_CLASS_ID);
+  USBD_CDC_SetRxBuffer(&hUsbDeviceHS, TlmRxBuffer);
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TLM_DeInit
+  * @retval USBD_OK
+  */
+static int8_t CDC_TLM_DeInit(void)
+{
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TLM_Control
+  *         Class requests : the line coding is kept for GET_LINE_CODING,
+  *         the others are ignored
+  * @param  cmd: Command code
+  * @param  pbuf: Buffer containing command data (request parameters)
+  * @param  length: Number of data to be sent (in bytes)
+  * @retval USBD_OK
+  */
+static int8_t CDC_TLM_Control(uint8_t cmd, uint8_t* pbuf, uint16_t length)
+{
+  switch (cmd)
+  {
+  case CDC_SET_LINE_CODING:
+    CDC_TLM_Linecoding.bitrate = (uint32_t)pbuf[0] | ((uint32_t)pbuf[1] << 8) |
+                                 ((uint32_t)pbuf[2] << 16) | ((uint32_t)pbuf[3] << 24);
+    CDC_TLM_Linecoding.format = pbuf[4];
+    CDC_TLM_Linecoding.paritytype = pbuf[5];
+    CDC_TLM_Linecoding.datatype = pbuf[6];
+    break;
+
+  case CDC_GET_LINE_CODING:
+    if (length >= 7U)
+    {
+      pbuf[0] = (uint8_t)CDC_TLM_Linecoding.bitrate;
+      pbuf[1] = (uint8_t)(CDC_TLM_Linecoding.bitrate >> 8);
+      pbuf[2] = (uint8_t)(CDC_TLM_Linecoding.bitrate >> 16);
+      pbuf[3] = (uint8_t)(CDC_TLM_Linecoding.bitrate >> 24);
+      pbuf[4] = CDC_TLM_Linecoding.format;
+      pbuf[5] = CDC_TLM_Linecoding.paritytype;
+      pbuf[6] = CDC_TLM_Linecoding.datatype;
+    }
+    break;
+
+  default:
+    break;
+  }
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TLM_Receive
+  *         The telemetry pipe takes no command, received data is dropped
+  *         and the endpoint armed again at once
+  * @param  Buf: Buffer of data received
+  * @param  Len: Number of data received (in bytes)
+  * @retval USBD_OK
+  */
+static int8_t CDC_TLM_Receive(uint8_t* Buf, uint32_t *Len)
+{
+  UNUSED(Buf);
+
+  CDC_TLM_Rx_Dropped += *Len;
+  /* called by the class with the telemetry class id selected */
+  USBD_CDC_ReceivePacket(&hUsbDeviceHS);
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TLM_TransmitCplt
+  *         Releases the data sent and sends the next block, then asks the
+  *         producers for more frames
+  * @param  Buf: Buffer of data sent
+  * @param  Len: Number of data sent (in bytes)
+  * @param  epnum: endpoint number
+  * @retval USBD_OK
+  */
+static int8_t CDC_TLM_TransmitCplt(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
+{
+  uint32_t ptr_out;
+
+  UNUSED(Buf);
+  UNUSED(Len);
+  UNUSED(epnum);
+
+  if (CDC_TLM_Tx_State == 1U)
+  {
+    ptr_out = CDC_TLM_Tx_PtrOut + CDC_TLM_Tx_Length;
+    if (ptr_out >= CDC_TLM_TX_DATA_SIZE)
+    {
+      ptr_out -= CDC_TLM_TX_DATA_SIZE;
+    }
+    CDC_TLM_Tx_PtrOut = ptr_out;
+    CDC_TLM_Tx_Length = 0;
+    CDC_TLM_Tx_State = 0;
+    CDC_TLM_StartTransmit();
+#ifdef USE_AUDIO_TAP
+    AUDIO_PumpPost(AUDIO_PUMP_TAP);
+#endif /* USE_AUDIO_TAP */
+#if (defined USE_AUDIO_TRACE) && (!defined USE_AUDIO_TRACE_ITM)
+    AUDIO_PumpPost(AUDIO_PUMP_TRACE);
+#endif /* USE_AUDIO_TRACE && !USE_AUDIO_TRACE_ITM */
+#if (defined USE_AUDIO_LOG) && (!defined USE_AUDIO_LOG_ITM)
+    AUDIO_PumpPost(AUDIO_PUMP_LOG);
+#endif /* USE_AUDIO_LOG && !USE_AUDIO_LOG_ITM */
+#ifdef USE_AUDIO_SPECTRUM
+    AUDIO_PumpPost(AUDIO_PUMP_SPECTRUM);
+#endif /* USE_AUDIO_SPECTRUM */
+#ifdef USE_AUDIO_SNAPSHOT
+    AUDIO_PumpPost(AUDIO_PUMP_SNAPSHOT);
+#endif /* USE_AUDIO_SNAPSHOT */
+  }
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC_TLM_TxFreeSize
+  *         Bytes which may be written in the transmit ring, one byte is kept to
+  *         tell full from empty
+  * @retval Free size in bytes
+  */
+static uint32_t CDC_TLM_TxFreeSize(void)
+{
+  return (CDC_TLM_Tx_PtrOut + CDC_TLM_TX_DATA_SIZE - CDC_TLM_Tx_PtrIn - 1U) % CDC_TLM_TX_DATA_SIZE;
+}
+
+/**
+  * @brief  CDC_TLM_StartTransmit
+  *         Sends the contiguous data from PtrOut in one transfer when the pipe
+  *         is idle, interrupts must be masked or the caller be the USB interrupt
+  * @retval None
+  */
+static void CDC_TLM_StartTransmit(void)
+{
+  uint32_t ptr_out = CDC_TLM_Tx_PtrOut;
+  uint32_t ptr_in = CDC_TLM_Tx_PtrIn;
+  uint32_t length;
+  uint8_t *pbuf = &TlmTxBuffer[ptr_out];
+
+  if ((CDC_TLM_Tx_State != 0U) || (ptr_out == ptr_in))
+  {
+    return;
+  }
+  length = (ptr_in > ptr_out) ? (ptr_in - ptr_out) : (CDC_TLM_TX_DATA_SIZE - ptr_out);
+#ifdef USE_USB_HS_DMA
+  if (!USBD_DMA_IS_ALIGNED(pbuf))
+  {
+    /* one short packet through the aligned copy, next transfer starts aligned */
+    uint32_t bounce_length = CDC_DATA_FS_IN_PACKET_SIZE - ((uint32_t)pbuf & (USBD_DMA_BUFFER_ALIGN - 1U));
+
+    if (length > bounce_length)
+    {
+      length = bounce_length;
+    }
+    memcpy(TlmTxPacket, pbuf, length);
+    pbuf = TlmTxPacket;
+  }
+#endif /* USE_USB_HS_DMA */
+  CDC_TLM_Tx_Length = length;
+  CDC_TLM_Tx_State = 1;
+  USBD_CDC_SetTxBuffer(&hUsbDeviceHS, pbuf, length, CDC_TLM_CLASS_ID);
+  USBD_CDC_TransmitPacket(&hUsbDeviceHS, CDC_TLM_CLASS_ID);
+}
+#endif /* USE_AUDIO_CDC_TELEMETRY */
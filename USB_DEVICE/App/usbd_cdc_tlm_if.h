@@ -0,0 +1,52 @@
+/**
+  ******************************************************************************
+  * @file    usbd_cdc_tlm_if.h
+  * @brief   header file for the usbd_cdc_tlm_if.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_CDC_TLM_IF_H
+#define __USBD_CDC_TLM_IF_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_cdc.h"
+
+#ifdef USE_AUDIO_CDC_TELEMETRY
+/* Exported constants --------------------------------------------------------*/
+/* the telemetry CDC is registered after the command CDC and the audio function */
+#define CDC_TLM_CLASS_ID                  2U
+/* data IN, data OUT and command IN endpoints, after the audio ones */
+#define CDC_TLM_IN_EP                     0x86U
+#define CDC_TLM_OUT_EP                    0x06U
+#define CDC_TLM_CMD_EP                    0x87U
+#ifndef CDC_TLM_TX_DATA_SIZE
+#define CDC_TLM_TX_DATA_SIZE              4096U /* transmit ring */
+#endif /* CDC_TLM_TX_DATA_SIZE */
+
+/* Exported variables --------------------------------------------------------*/
+extern USBD_CDC_ItfTypeDef  USBD_TLM_Interface_fops;
+
+/* Exported functions ------------------------------------------------------- */
+uint8_t  CDC_TLM_Transmit(uint8_t* Buf, uint16_t Len);
+uint32_t CDC_TLM_GetRxDropped(void);
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __USBD_CDC_TLM_IF_H */
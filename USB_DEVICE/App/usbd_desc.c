@@ -90,7 +90,16 @@
   */
 
 /* USER CODE BEGIN PRIVATE_MACRO */
-
+/* string descriptor built by the compiler in flash : the UTF-16 literal of str
+   is as long as the descriptor, its 2 bytes null taking the place of the
+   header. The core is little endian as USB */
+#define USBD_STRING_DESC(name, str)                                            \
+  static const struct                                                         \
+  {                                                                           \
+    uint8_t  bLength;                                                         \
+    uint8_t  bDescriptorType;                                                 \
+    uint16_t bString[(sizeof(u"" str) / 2U) - 1U];                            \
+  } name __ALIGN_END = { (uint8_t)sizeof(u"" str), USB_DESC_TYPE_STRING, u"" str }
 /* USER CODE END PRIVATE_MACRO */
 
 /**
@@ -150,8 +159,11 @@ __ALIGN_BEGIN uint8_t USBD_HS_DeviceDesc[USB_LEN_DEV_DESC] __ALIGN_END =
 {
   0x12,                       /*bLength */
   USB_DESC_TYPE_DEVICE,       /*bDescriptorType*/
+#if (USBD_LPM_ENABLED == 1)
+  0x01,                       /*bcdUSB 2.01 : the host reads the BOS descriptor for LPM */
+#else /* (USBD_LPM_ENABLED == 1) */
   0x00,                       /*bcdUSB */
-
+#endif /* (USBD_LPM_ENABLED == 1) */
   0x02,
   0x00,                       /*bDeviceClass*/
   0x00,                       /*bDeviceSubClass*/
@@ -185,7 +197,7 @@ __ALIGN_BEGIN uint8_t USBD_HS_BOSDesc[USB_SIZ_BOS_DESC] __ALIGN_END =
   0x7,
   USB_DEVICE_CAPABITY_TYPE,
   0x2,
-  0x2,  /*LPM capability bit set */
+  0x6,  /*LPM capability bit set , BESL values as the core decodes them */
   0x0,
   0x0,
   0x0
@@ -217,8 +229,11 @@ __ALIGN_BEGIN uint8_t USBD_LangIDDesc[USB_LEN_LANGID_STR_DESC] __ALIGN_END =
 #if defined ( __ICCARM__ ) /* IAR Compiler */
   #pragma data_alignment=4
 #endif /* defined ( __ICCARM__ ) */
-/* Internal string descriptor. */
-__ALIGN_BEGIN uint8_t USBD_StrDesc[USBD_MAX_STR_DESC_SIZ] __ALIGN_END;
+/* String descriptors, sent from flash without conversion. */
+USBD_STRING_DESC(USBD_ManufacturerStrDesc, USBD_MANUFACTURER_STRING);
+USBD_STRING_DESC(USBD_ProductStrDesc, USBD_PRODUCT_STRING_HS);
+USBD_STRING_DESC(USBD_ConfigStrDesc, USBD_CONFIGURATION_STRING_HS);
+USBD_STRING_DESC(USBD_InterfaceStrDesc, USBD_INTERFACE_STRING_HS);
 
 #if defined ( __ICCARM__ ) /*!< IAR Compiler */
   #pragma data_alignment=4
@@ -271,15 +286,9 @@ uint8_t * USBD_HS_LangIDStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
   */
 uint8_t * USBD_HS_ProductStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
-  if(speed == 0)
-  {
-    USBD_GetString((uint8_t *)USBD_PRODUCT_STRING_HS, USBD_StrDesc, length);
-  }
-  else
-  {
-    USBD_GetString((uint8_t *)USBD_PRODUCT_STRING_HS, USBD_StrDesc, length);
-  }
-  return USBD_StrDesc;
+  UNUSED(speed);
+  *length = sizeof(USBD_ProductStrDesc);
+  return (uint8_t *)&USBD_ProductStrDesc;
 }
 
 /**
@@ -291,8 +300,8 @@ uint8_t * USBD_HS_ProductStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length
 uint8_t * USBD_HS_ManufacturerStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
   UNUSED(speed);
-  USBD_GetString((uint8_t *)USBD_MANUFACTURER_STRING, USBD_StrDesc, length);
-  return USBD_StrDesc;
+  *length = sizeof(USBD_ManufacturerStrDesc);
+  return (uint8_t *)&USBD_ManufacturerStrDesc;
 }
 
 /**
@@ -306,9 +315,8 @@ uint8_t * USBD_HS_SerialStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
   UNUSED(speed);
   *length = USB_SIZ_STRING_SERIAL;
 
-  /* Update the serial number string descriptor with the data from the unique
-   * ID */
-  Get_SerialNum();
+  /* the serial number string descriptor was built from the unique ID by
+   * USBD_HS_SerialNumInit */
   /* USER CODE BEGIN USBD_HS_SerialStrDescriptor */
 
   /* USER CODE END USBD_HS_SerialStrDescriptor */
@@ -324,15 +332,9 @@ uint8_t * USBD_HS_SerialStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
   */
 uint8_t * USBD_HS_ConfigStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
-  if(speed == USBD_SPEED_HIGH)
-  {
-    USBD_GetString((uint8_t *)USBD_CONFIGURATION_STRING_HS, USBD_StrDesc, length);
-  }
-  else
-  {
-    USBD_GetString((uint8_t *)USBD_CONFIGURATION_STRING_HS, USBD_StrDesc, length);
-  }
-  return USBD_StrDesc;
+  UNUSED(speed);
+  *length = sizeof(USBD_ConfigStrDesc);
+  return (uint8_t *)&USBD_ConfigStrDesc;
 }
 
 /**
@@ -343,15 +345,9 @@ uint8_t * USBD_HS_ConfigStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
   */
 uint8_t * USBD_HS_InterfaceStrDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 {
-  if(speed == 0)
-  {
-    USBD_GetString((uint8_t *)USBD_INTERFACE_STRING_HS, USBD_StrDesc, length);
-  }
-  else
-  {
-    USBD_GetString((uint8_t *)USBD_INTERFACE_STRING_HS, USBD_StrDesc, length);
-  }
-  return USBD_StrDesc;
+  UNUSED(speed);
+  *length = sizeof(USBD_InterfaceStrDesc);
+  return (uint8_t *)&USBD_InterfaceStrDesc;
 }
 
 #if (USBD_LPM_ENABLED == 1)
@@ -369,6 +365,17 @@ uint8_t * USBD_HS_USR_BOSDescriptor(USBD_SpeedTypeDef speed, uint16_t *length)
 }
 #endif /* (USBD_LPM_ENABLED == 1) */
 
+/**
+  * @brief  Builds the serial number string descriptor once, before the
+  *         device is connected
+  * @param  None
+  * @retval None
+  */
+void USBD_HS_SerialNumInit(void)
+{
+  Get_SerialNum();
+}
+
 /**
   * @brief  Create the serial number string descriptor
   * @param  None
@@ -120,6 +120,7 @@ extern USBD_DescriptorsTypeDef HS_Desc;
   */
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+void USBD_HS_SerialNumInit(void);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 
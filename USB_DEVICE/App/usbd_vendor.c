@@ -0,0 +1,326 @@
+/**
+  ******************************************************************************
+  * @file    usbd_vendor.c
+  * @brief   vendor specific class : one interface with a bulk IN and a bulk
+  *          OUT endpoint, added by the composite builder. The class moves
+  *          whole transfers : an OUT transfer is received straight into the
+  *          buffer given by the application, up to its length or the first
+  *          short packet, so large payloads go without a per packet copy
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_vendor.h"
+#include "usbd_ctlreq.h"
+
+#if (defined USBD_CMPSIT_ACTIVATE_VENDOR) && (USBD_CMPSIT_ACTIVATE_VENDOR == 1U)
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t USBD_VENDOR_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_VENDOR_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
+static uint8_t USBD_VENDOR_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t USBD_VENDOR_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_VENDOR_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
+
+/* Private variables ---------------------------------------------------------*/
+USBD_ClassTypeDef  USBD_VENDOR =
+{
+  USBD_VENDOR_Init,
+  USBD_VENDOR_DeInit,
+  USBD_VENDOR_Setup,
+  NULL,                 /* EP0_TxSent */
+  NULL,                 /* EP0_RxReady */
+  USBD_VENDOR_DataIn,
+  USBD_VENDOR_DataOut,
+  NULL,
+  NULL,
+  NULL,
+  NULL,                 /* descriptors are built by the composite builder */
+  NULL,
+  NULL,
+  NULL,
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+  NULL,
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+};
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  USBD_VENDOR_RegisterInterface
+  *         sets the application callbacks of the next registered class
+  * @param  pdev: device instance
+  * @param  fops: application callbacks
+  * @retval status
+  */
+uint8_t USBD_VENDOR_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_VENDOR_ItfTypeDef *fops)
+{
+  if (fops == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  pdev->pUserData[pdev->classId] = fops;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_VENDOR_Transmit
+  *         starts an IN transfer, a zero length packet ends it when its
+  *         length is a multiple of the max packet size
+  * @param  pdev: device instance
+  * @param  pbuff: data to send, must stay valid until TransmitCplt
+  * @param  length: data length
+  * @param  ClassId: class id of the vendor interface
+  * @retval USBD_OK, USBD_BUSY while the previous transfer is in progress
+  */
+uint8_t USBD_VENDOR_Transmit(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length, uint8_t ClassId)
+{
+  USBD_VENDOR_HandleTypeDef *hvnd = (USBD_VENDOR_HandleTypeDef *)pdev->pClassDataCmsit[ClassId];
+  uint8_t in_ep;
+
+  if (hvnd == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+  if (hvnd->TxState != 0U)
+  {
+    return (uint8_t)USBD_BUSY;
+  }
+  in_ep = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_BULK, ClassId);
+  hvnd->TxState = 1U;
+  hvnd->TxBuffer = pbuff;
+  hvnd->TxLength = length;
+  pdev->ep_in[in_ep & 0xFU].total_length = length;
+  (void)USBD_LL_Transmit(pdev, in_ep, pbuff, length);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_VENDOR_Receive
+  *         arms the OUT endpoint for one transfer, Receive is called once
+  *         length bytes or a short packet are received
+  * @param  pdev: device instance
+  * @param  pbuff: reception buffer, word aligned when the USB DMA is used
+  * @param  length: buffer length
+  * @param  ClassId: class id of the vendor interface
+  * @retval status
+  */
+uint8_t USBD_VENDOR_Receive(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length, uint8_t ClassId)
+{
+  USBD_VENDOR_HandleTypeDef *hvnd = (USBD_VENDOR_HandleTypeDef *)pdev->pClassDataCmsit[ClassId];
+
+  if (hvnd == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+  hvnd->RxBuffer = pbuff;
+  (void)USBD_LL_PrepareReceive(pdev, USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_BULK, ClassId),
+                               pbuff, length);
+
+  return (uint8_t)USBD_OK;
+}
+
+/* Private functions ---------------------------------------------------------*/
+/**
+  * @brief  USBD_VENDOR_Init
+  *         opens the endpoints, the application arms the first reception
+  *         from its Init callback
+  * @param  pdev: device instance
+  * @param  cfgidx: Configuration index
+  * @retval status
+  */
+static uint8_t USBD_VENDOR_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+  UNUSED(cfgidx);
+  USBD_VENDOR_HandleTypeDef *hvnd;
+  uint16_t packet_size;
+  uint8_t in_ep;
+  uint8_t out_ep;
+
+  hvnd = (USBD_VENDOR_HandleTypeDef *)USBD_malloc(sizeof(USBD_VENDOR_HandleTypeDef));
+  if (hvnd == NULL)
+  {
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+    return (uint8_t)USBD_EMEM;
+  }
+  (void)USBD_memset(hvnd, 0, sizeof(USBD_VENDOR_HandleTypeDef));
+  pdev->pClassDataCmsit[pdev->classId] = (void *)hvnd;
+  pdev->pClassData = pdev->pClassDataCmsit[pdev->classId];
+
+  in_ep  = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_BULK, (uint8_t)pdev->classId);
+  out_ep = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_BULK, (uint8_t)pdev->classId);
+  packet_size = (pdev->dev_speed == USBD_SPEED_HIGH) ? USBD_VENDOR_HS_MAX_PACKET_SIZE :
+                                                       USBD_VENDOR_FS_MAX_PACKET_SIZE;
+  (void)USBD_LL_OpenEP(pdev, in_ep, USBD_EP_TYPE_BULK, packet_size);
+  pdev->ep_in[in_ep & 0xFU].is_used = 1U;
+  (void)USBD_LL_OpenEP(pdev, out_ep, USBD_EP_TYPE_BULK, packet_size);
+  pdev->ep_out[out_ep & 0xFU].is_used = 1U;
+
+  if (((USBD_VENDOR_ItfTypeDef *)pdev->pUserData[pdev->classId])->Init() != 0)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_VENDOR_DeInit
+  *         closes the endpoints and releases the class handle
+  * @param  pdev: device instance
+  * @param  cfgidx: Configuration index
+  * @retval status
+  */
+static uint8_t USBD_VENDOR_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+  UNUSED(cfgidx);
+  uint8_t in_ep  = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_BULK, (uint8_t)pdev->classId);
+  uint8_t out_ep = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_BULK, (uint8_t)pdev->classId);
+
+  (void)USBD_LL_CloseEP(pdev, in_ep);
+  pdev->ep_in[in_ep & 0xFU].is_used = 0U;
+  (void)USBD_LL_CloseEP(pdev, out_ep);
+  pdev->ep_out[out_ep & 0xFU].is_used = 0U;
+
+  if (pdev->pClassDataCmsit[pdev->classId] != NULL)
+  {
+    ((USBD_VENDOR_ItfTypeDef *)pdev->pUserData[pdev->classId])->DeInit();
+    (void)USBD_free(pdev->pClassDataCmsit[pdev->classId]);
+    pdev->pClassDataCmsit[pdev->classId] = NULL;
+    pdev->pClassData = NULL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_VENDOR_Setup
+  *         standard interface requests, the interface has no class requests
+  * @param  pdev: device instance
+  * @param  req: usb request
+  * @retval status
+  */
+static uint8_t USBD_VENDOR_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+  uint16_t status_info = 0U;
+  uint8_t ifalt = 0U;
+  USBD_StatusTypeDef ret = USBD_OK;
+
+  if ((req->bmRequest & USB_REQ_TYPE_MASK) != USB_REQ_TYPE_STANDARD)
+  {
+    USBD_CtlError(pdev, req);
+    return (uint8_t)USBD_FAIL;
+  }
+  switch (req->bRequest)
+  {
+    case USB_REQ_GET_STATUS:
+      if (pdev->dev_state == USBD_STATE_CONFIGURED)
+      {
+        (void)USBD_CtlSendData(pdev, (uint8_t *)&status_info, 2U);
+      }
+      else
+      {
+        USBD_CtlError(pdev, req);
+        ret = USBD_FAIL;
+      }
+      break;
+
+    case USB_REQ_GET_INTERFACE:
+      if (pdev->dev_state == USBD_STATE_CONFIGURED)
+      {
+        (void)USBD_CtlSendData(pdev, &ifalt, 1U);
+      }
+      else
+      {
+        USBD_CtlError(pdev, req);
+        ret = USBD_FAIL;
+      }
+      break;
+
+    case USB_REQ_SET_INTERFACE:
+      if ((pdev->dev_state != USBD_STATE_CONFIGURED) || (req->wValue != 0U))
+      {
+        USBD_CtlError(pdev, req);
+        ret = USBD_FAIL;
+      }
+      break;
+
+    case USB_REQ_CLEAR_FEATURE:
+      break;
+
+    default:
+      USBD_CtlError(pdev, req);
+      ret = USBD_FAIL;
+      break;
+  }
+
+  return (uint8_t)ret;
+}
+
+/**
+  * @brief  USBD_VENDOR_DataIn
+  *         an IN transfer was sent, or its zero length packet
+  * @param  pdev: device instance
+  * @param  epnum: endpoint number
+  * @retval status
+  */
+static uint8_t USBD_VENDOR_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+  USBD_VENDOR_HandleTypeDef *hvnd = (USBD_VENDOR_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+
+  if (hvnd == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+  if ((pdev->ep_in[epnum & 0xFU].total_length > 0U) &&
+      ((pdev->ep_in[epnum & 0xFU].total_length % hpcd->IN_ep[epnum & 0xFU].maxpacket) == 0U))
+  {
+    pdev->ep_in[epnum & 0xFU].total_length = 0U;
+    (void)USBD_LL_Transmit(pdev, epnum, NULL, 0U);
+  }
+  else
+  {
+    hvnd->TxState = 0U;
+    if (((USBD_VENDOR_ItfTypeDef *)pdev->pUserData[pdev->classId])->TransmitCplt != NULL)
+    {
+      ((USBD_VENDOR_ItfTypeDef *)pdev->pUserData[pdev->classId])->TransmitCplt(hvnd->TxBuffer, hvnd->TxLength);
+    }
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_VENDOR_DataOut
+  *         an OUT transfer ended, the endpoint NAKs until the application
+  *         arms the next one
+  * @param  pdev: device instance
+  * @param  epnum: endpoint number
+  * @retval status
+  */
+static uint8_t USBD_VENDOR_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+  USBD_VENDOR_HandleTypeDef *hvnd = (USBD_VENDOR_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+
+  if (hvnd == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+  ((USBD_VENDOR_ItfTypeDef *)pdev->pUserData[pdev->classId])->Receive(hvnd->RxBuffer,
+                                                                      USBD_LL_GetRxDataSize(pdev, epnum));
+
+  return (uint8_t)USBD_OK;
+}
+#endif /* USBD_CMPSIT_ACTIVATE_VENDOR */
@@ -0,0 +1,68 @@
+/**
+  ******************************************************************************
+  * @file    usbd_vendor.h
+  * @brief   header file for the usbd_vendor.c file.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2023 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_VENDOR_H
+#define __USBD_VENDOR_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include  "usbd_ioreq.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* one vendor specific interface (class 0xFF) with a bulk IN and a bulk OUT endpoint */
+#define USBD_VENDOR_FS_MAX_PACKET_SIZE        64U
+#define USBD_VENDOR_HS_MAX_PACKET_SIZE        512U
+#define USBD_VENDOR_INTERFACE_CLASS           0xFFU
+#define USBD_VENDOR_INTERFACE_SUBCLASS        0x00U
+#define USBD_VENDOR_INTERFACE_PROTOCOL        0x00U
+
+/* Exported types ------------------------------------------------------------*/
+/* application callbacks, called from the USB interrupt */
+typedef struct
+{
+  int8_t (* Init)(void);
+  int8_t (* DeInit)(void);
+  int8_t (* Receive)(uint8_t *Buf, uint32_t Len);        /* an OUT transfer ended, full or short */
+  int8_t (* TransmitCplt)(uint8_t *Buf, uint32_t Len);   /* the IN transfer was sent */
+}
+USBD_VENDOR_ItfTypeDef;
+
+typedef struct
+{
+  uint8_t*          RxBuffer;
+  uint8_t*          TxBuffer;
+  uint32_t          TxLength;
+  volatile uint32_t TxState;   /* an IN transfer is in progress */
+}
+USBD_VENDOR_HandleTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern USBD_ClassTypeDef USBD_VENDOR;
+
+/* Exported functions ------------------------------------------------------- */
+uint8_t USBD_VENDOR_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_VENDOR_ItfTypeDef *fops);
+uint8_t USBD_VENDOR_Transmit(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length, uint8_t ClassId);
+uint8_t USBD_VENDOR_Receive(USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length, uint8_t ClassId);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  /* __USBD_VENDOR_H */
@@ -26,15 +26,278 @@
 #include "usbd_audio.h"
 
 /* USER CODE BEGIN Includes */
-
+#include "usbd_cdc.h"
+#include "usb_audio_user.h"
+#ifdef USE_AUDIO_IDLE_POWER
+#include "audio_power.h"
+#endif /* USE_AUDIO_IDLE_POWER */
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+#include "usbd_audio_if.h"
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 /* USER CODE END Includes */
 
+#if (defined USE_USB_DEDICATED_EP1) && !(defined USE_USB_HS_DMA)
+#error "USE_USB_DEDICATED_EP1 needs USE_USB_HS_DMA, without it the EP1 IN FIFO is written from the TX FIFO empty interrupt"
+#endif /* USE_USB_DEDICATED_EP1 */
+
 /* Private typedef -----------------------------------------------------------*/
+/* header of each block of the memory pool, blocks are contiguous */
+typedef struct
+{
+  uint32_t size;  /* block size including header */
+  uint32_t used;
+}
+USBD_MemBlockTypeDef;
+#ifdef USE_USBD_DEFERRED_CONTROL
+/* OTG event handed to the control interrupt */
+typedef enum
+{
+  USBD_CTRL_EVENT_SETUP,
+  USBD_CTRL_EVENT_DATA_OUT,
+  USBD_CTRL_EVENT_DATA_IN,
+  USBD_CTRL_EVENT_RESET,
+  USBD_CTRL_EVENT_DISCONNECT
+}
+USBD_CtrlEventTypeDef;
+typedef struct
+{
+  uint8_t   event;    /* USBD_CtrlEventTypeDef */
+  uint8_t   epnum;
+  uint8_t   speed;    /* reset : USBD_SpeedTypeDef */
+  uint8_t   setup[8]; /* setup : copy of the request, the HAL buffer is rewritten by the next one */
+  uint8_t*  buff;     /* data stages : transfer buffer */
+}
+USBD_CtrlRecordTypeDef;
+#endif /* USE_USBD_DEFERRED_CONTROL */
+
+#ifdef USE_AUDIO_USB_LOW_RATE
+/* iso endpoint polled each period (micro)frames : its transfers are armed for
+   the parity the polls fall on, the incompletes before target are not misses */
+typedef struct
+{
+  uint16_t period;                /* (micro)frames between polls, 0 when polled each one */
+  uint16_t target;                /* last (micro)frame the armed transfer may wait for */
+  uint8_t  parity;                /* 1 when the polls fall on odd (micro)frames */
+  uint8_t  misses;                /* consecutive ones, the parity changes on the second */
+}
+USBD_IsoSparseTypeDef;
+#endif /* USE_AUDIO_USB_LOW_RATE */
+
 /* Private define ------------------------------------------------------------*/
+#define USBD_MEM_BLOCK_HEADER_SIZE   ((sizeof(USBD_MemBlockTypeDef) + USBD_MEM_POOL_ALIGN - 1U) & ~(USBD_MEM_POOL_ALIGN - 1U))
+
+/* OTG FIFO partition in 32-bit words, from the endpoints of the composite :
+   EP0, CDC data (1) and command (2), audio play OUT (3) and record IN (3),
+   audio mix OUT (4), interrupt or voice IN (4), play feedback IN (5), the telemetry
+   CDC data (6) and command (7) and the clip upload bulk (8), whose 12 bytes
+   responses fit the smallest TX FIFO. With USE_USB_DEDICATED_EP1 the CDC data
+   and the audio play OUT and record IN swap numbers. Isochronous FIFOs hold two
+   packets, the next one is loaded while the current one waits for its frame.
+   With USE_AUDIO_USB_LOW_RATE they hold one : the next packet has a whole poll
+   period to be loaded, and the multi ms packets would not fit twice.
+   Sizes avoid casts so the total is checked by the preprocessor */
+#define USBD_FIFO_WORDS(size)        (((size) + 3U) / 4U)
+#define USBD_FIFO_TX_MIN_WORDS       16U /* smallest TX FIFO the core accepts */
+#define USBD_FIFO_TX_WORDS(size)     ((USBD_FIFO_WORDS(size) > USBD_FIFO_TX_MIN_WORDS) ? \
+                                      USBD_FIFO_WORDS(size) : USBD_FIFO_TX_MIN_WORDS)
+#define USBD_FIFO_ISO_PACKET(freq, channels, res_byte) \
+      ((((freq) + AUDIO_USB_PACKETS_PER_SECOND - 1U) / AUDIO_USB_PACKETS_PER_SECOND) * (channels) * (res_byte))
+#ifdef USE_AUDIO_USB_LOW_RATE
+#define USBD_FIFO_ISO_PACKETS        1U
+#else /* USE_AUDIO_USB_LOW_RATE */
+#define USBD_FIFO_ISO_PACKETS        2U
+#endif /* USE_AUDIO_USB_LOW_RATE */
+#ifdef USE_USB_HS_ULPI_PHY
+#define USBD_FIFO_CDC_PACKET         CDC_DATA_HS_MAX_PACKET_SIZE
+#else /* USE_USB_HS_ULPI_PHY */
+#define USBD_FIFO_CDC_PACKET         CDC_DATA_FS_MAX_PACKET_SIZE
+#endif /* USE_USB_HS_ULPI_PHY */
+#ifdef USE_USB_AUDIO_PLAYPBACK
+#if (defined USE_AUDIO_PLAYBACK_USB_FEEDBACK) || (defined USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK)
+#define USBD_FIFO_PLAY_PACKET        USBD_FIFO_ISO_PACKET(USB_AUDIO_CONFIG_PLAY_FREQ_MAX + 1U, \
+                                       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT, USBD_AUDIO_CONFIG_PLAY_RES_BYTE)
+#else /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#define USBD_FIFO_PLAY_PACKET        USBD_FIFO_ISO_PACKET(USB_AUDIO_CONFIG_PLAY_FREQ_MAX, \
+                                       USBD_AUDIO_CONFIG_PLAY_CHANNEL_COUNT, USBD_AUDIO_CONFIG_PLAY_RES_BYTE)
+#endif /* USE_AUDIO_PLAYBACK_USB_FEEDBACK || USE_AUDIO_PLAYBACK_USB_IMPLICIT_FEEDBACK */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+/* the mix OUT packets are 16 bits, never larger than the play ones */
+#define USBD_FIFO_OUT_EP_COUNT       4U
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#define USBD_FIFO_OUT_EP_COUNT       3U
+#endif /* USE_AUDIO_PLAYBACK_MIX */
+#else /* USE_USB_AUDIO_PLAYPBACK */
+#define USBD_FIFO_PLAY_PACKET        0U
+#define USBD_FIFO_OUT_EP_COUNT       2U
+#endif /* USE_USB_AUDIO_PLAYPBACK */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define USBD_FIFO_TLM_OUT_EP_COUNT   1U
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_FIFO_TLM_OUT_EP_COUNT   0U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#if (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+/* the vendor packets have the CDC size */
+#define USBD_FIFO_CLIP_OUT_EP_COUNT  1U
+#else /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#define USBD_FIFO_CLIP_OUT_EP_COUNT  0U
+#endif /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_USB_AUDIO_RECORDING
+#ifdef USE_AUDIO_RECORDING_USB_NO_REMOVE
+#define USBD_FIFO_RECORD_PACKET      USBD_FIFO_ISO_PACKET(USB_AUDIO_CONFIG_RECORD_FREQ_MAX + 1U, \
+                                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT, USBD_AUDIO_CONFIG_RECORD_RES_BYTE)
+#else /* USE_AUDIO_RECORDING_USB_NO_REMOVE */
+#define USBD_FIFO_RECORD_PACKET      USBD_FIFO_ISO_PACKET(USB_AUDIO_CONFIG_RECORD_FREQ_MAX, \
+                                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT, USBD_AUDIO_CONFIG_RECORD_RES_BYTE)
+#endif /* USE_AUDIO_RECORDING_USB_NO_REMOVE */
+#define USBD_FIFO_RECORD_WORDS       (USBD_FIFO_ISO_PACKETS * USBD_FIFO_TX_WORDS(USBD_FIFO_RECORD_PACKET))
+#else /* USE_USB_AUDIO_RECORDING */
+#define USBD_FIFO_RECORD_PACKET      0U
+#define USBD_FIFO_RECORD_WORDS       USBD_FIFO_TX_MIN_WORDS /* record IN unused, FIFOs are allocated in order */
+#endif /* USE_USB_AUDIO_RECORDING */
+#ifdef USE_AUDIO_RECORDING_VOICE
+/* the voice packets may carry one more frame */
+#define USBD_FIFO_EP4_WORDS          (USBD_FIFO_ISO_PACKETS * USBD_FIFO_TX_WORDS(USBD_FIFO_ISO_PACKET(USB_AUDIO_CONFIG_VOICE_FREQ + 1U, \
+                                       USBD_AUDIO_CONFIG_RECORD_CHANNEL_COUNT, USBD_AUDIO_CONFIG_VOICE_RES_BYTE)))
+#else /* USE_AUDIO_RECORDING_VOICE */
+#define USBD_FIFO_EP4_WORDS          USBD_FIFO_TX_MIN_WORDS
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#ifdef USE_AUDIO_BULK_CAPTURE
+/* the capture blocks stream back to back on the bulk IN, two packets keep it busy */
+#define USBD_FIFO_EP8_WORDS          (2U * USBD_FIFO_TX_WORDS(USBD_FIFO_CDC_PACKET))
+#else /* USE_AUDIO_BULK_CAPTURE */
+#define USBD_FIFO_EP8_WORDS          USBD_FIFO_TX_MIN_WORDS
+#endif /* USE_AUDIO_BULK_CAPTURE */
+#define USBD_FIFO_OUT_PACKET         ((USBD_FIFO_PLAY_PACKET > USBD_FIFO_CDC_PACKET) ? \
+                                      USBD_FIFO_PLAY_PACKET : USBD_FIFO_CDC_PACKET)
+/* room for the OUT packets with their status word : two of the largest, or with
+   one iso packet only, one play packet and a CDC one */
+#define USBD_FIFO_OUT_WORDS          ((USBD_FIFO_ISO_PACKETS == 2U) ? \
+                                      (2U * (USBD_FIFO_WORDS(USBD_FIFO_OUT_PACKET) + 1U)) : \
+                                      (USBD_FIFO_WORDS(USBD_FIFO_OUT_PACKET) + 1U + \
+                                       USBD_FIFO_WORDS(USBD_FIFO_CDC_PACKET) + 1U))
+/* setup packets, the OUT packets, one transfer complete word per OUT endpoint
+   and the global NAK word */
+#define USBD_FIFO_RX_WORDS           (13U + USBD_FIFO_OUT_WORDS + \
+                                      2U * (USBD_FIFO_OUT_EP_COUNT + USBD_FIFO_TLM_OUT_EP_COUNT + \
+                                            USBD_FIFO_CLIP_OUT_EP_COUNT) + 1U)
+#define USBD_FIFO_EP0_WORDS          USBD_FIFO_TX_WORDS(USB_MAX_EP0_SIZE)
+#define USBD_FIFO_CDC_DATA_WORDS     (2U * USBD_FIFO_TX_WORDS(USBD_FIFO_CDC_PACKET))
+#define USBD_FIFO_CDC_CMD_WORDS      USBD_FIFO_TX_WORDS(CDC_CMD_PACKET_SIZE)
+#if (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+#define USBD_FIFO_TX_COUNT           9U /* EP4 to EP7 get at least the smallest FIFO even when unused */
+#elif defined USE_AUDIO_CDC_TELEMETRY
+#define USBD_FIFO_TX_COUNT           8U /* EP4 and EP5 get the smallest FIFO even when unused */
+#elif defined USB_AUDIO_CONFIG_PLAY_EP_SYNC
+#define USBD_FIFO_TX_COUNT           6U /* interrupt and feedback IN, both fit the smallest FIFO */
+#elif (defined USB_AUDIO_CONFIG_INTERRUPT_EP_IN) && (USB_AUDIO_CONFIG_INTERRUPT_EP_IN == 0x84)
+#define USBD_FIFO_TX_COUNT           5U
+#elif defined USE_AUDIO_RECORDING_VOICE
+#define USBD_FIFO_TX_COUNT           5U
+#else
+#define USBD_FIFO_TX_COUNT           4U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define USBD_FIFO_TX_MIN_COUNT       (USBD_FIFO_TX_COUNT - 6U)
+#define USBD_FIFO_TLM_WORDS          (USBD_FIFO_CDC_DATA_WORDS + USBD_FIFO_CDC_CMD_WORDS)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_FIFO_TX_MIN_COUNT       (USBD_FIFO_TX_COUNT - 4U)
+#define USBD_FIFO_TLM_WORDS          0U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_FIFO_TOTAL_WORDS        (USBD_FIFO_RX_WORDS + USBD_FIFO_EP0_WORDS + USBD_FIFO_CDC_DATA_WORDS + \
+                                      USBD_FIFO_CDC_CMD_WORDS + USBD_FIFO_RECORD_WORDS + \
+                                      USBD_FIFO_TX_MIN_COUNT * USBD_FIFO_TX_MIN_WORDS + USBD_FIFO_TLM_WORDS + \
+                                      (USBD_FIFO_EP4_WORDS - USBD_FIFO_TX_MIN_WORDS) + \
+                                      (USBD_FIFO_EP8_WORDS - USBD_FIFO_TX_MIN_WORDS))
+/* RX FIFO words left to the OUT packets, one of them with its status word fits */
+#define USBD_FIFO_RX_PACKET_WORDS    (USBD_FIFO_RX_WORDS - 14U - 2U * (USBD_FIFO_OUT_EP_COUNT + \
+                                      USBD_FIFO_TLM_OUT_EP_COUNT + USBD_FIFO_CLIP_OUT_EP_COUNT))
+#if USBD_FIFO_TOTAL_WORDS > USB_FIFO_WORD_SIZE
+#error "the endpoints of the composite don't fit the OTG FIFO RAM, lower the audio max packet sizes"
+#endif /* USBD_FIFO_TOTAL_WORDS */
+
+#ifdef USE_AUDIO_USB_LOW_RATE
+/* an iso packet carries 1023 bytes at most on full speed, 1024 on high speed (one
+   transaction per microframe), whatever its poll period */
+#ifdef USE_USB_HS_ULPI_PHY
+#define USBD_FIFO_ISO_MAX_PACKET     1024U
+#else /* USE_USB_HS_ULPI_PHY */
+#define USBD_FIFO_ISO_MAX_PACKET     1023U
+#endif /* USE_USB_HS_ULPI_PHY */
+#if (USBD_FIFO_PLAY_PACKET > USBD_FIFO_ISO_MAX_PACKET) || (USBD_FIFO_RECORD_PACKET > USBD_FIFO_ISO_MAX_PACKET)
+#error "the AUDIO_USB_PACKET_MS packets exceed the max iso packet, lower AUDIO_USB_PACKET_MS or the audio max rates and resolutions"
+#endif /* USBD_FIFO_PLAY_PACKET || USBD_FIFO_RECORD_PACKET */
+#endif /* USE_AUDIO_USB_LOW_RATE */
+
+#ifdef USE_AUDIO_USB_LOW_RATE
+#define USBD_ISO_SPARSE_EPS          16U
+#define USBD_ISO_SPARSE_MISSES       2U
+#define USBD_ISO_SPARSE_MAX_INTERVAL 8U  /* 128 (micro)frames, under half the frame number range */
+#endif /* USE_AUDIO_USB_LOW_RATE */
+
 /* Private macro -------------------------------------------------------------*/
+#ifdef USE_USBD_DEFERRED_CONTROL
+/* iso and SOF callbacks may preempt the core running a control request : the class selection is restored */
+#define USBD_LL_ISO_ENTER(pdev)  uint32_t iso_class_id = (pdev)->classId; \
+                                 void* iso_class_data = (pdev)->pClassData
+#define USBD_LL_ISO_EXIT(pdev)   do { (pdev)->classId = iso_class_id; \
+                                      (pdev)->pClassData = iso_class_data; } while(0)
+#endif /* USE_USBD_DEFERRED_CONTROL */
 
 /* USER CODE BEGIN PV */
 /* Private variables ---------------------------------------------------------*/
+/* TX FIFO of each IN endpoint, in words */
+static const uint16_t usbd_fifo_tx_words[USBD_FIFO_TX_COUNT] =
+{
+  USBD_FIFO_EP0_WORDS,
+#ifdef USE_USB_DEDICATED_EP1
+  USBD_FIFO_RECORD_WORDS,
+  USBD_FIFO_CDC_CMD_WORDS,
+  USBD_FIFO_CDC_DATA_WORDS,
+#else /* USE_USB_DEDICATED_EP1 */
+  USBD_FIFO_CDC_DATA_WORDS,
+  USBD_FIFO_CDC_CMD_WORDS,
+  USBD_FIFO_RECORD_WORDS,
+#endif /* USE_USB_DEDICATED_EP1 */
+#if USBD_FIFO_TX_COUNT > 4U
+  USBD_FIFO_EP4_WORDS,
+#endif /* USBD_FIFO_TX_COUNT */
+#if USBD_FIFO_TX_COUNT > 5U
+  USBD_FIFO_TX_MIN_WORDS,
+#endif /* USBD_FIFO_TX_COUNT */
+#if defined USE_AUDIO_CDC_TELEMETRY
+  USBD_FIFO_CDC_DATA_WORDS,
+  USBD_FIFO_CDC_CMD_WORDS,
+#elif (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+  USBD_FIFO_TX_MIN_WORDS,
+  USBD_FIFO_TX_MIN_WORDS,
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#if (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+  USBD_FIFO_EP8_WORDS,
+#endif /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+};
+/* USBD_malloc arena, in DMA reachable memory as it holds endpoint buffers */
+__ALIGN_BEGIN static uint64_t usbd_mem_pool[USBD_MEM_POOL_SIZE / sizeof(uint64_t)] __ALIGN_END USBD_BUFFER_BSS;
+static uint8_t  usbd_mem_pool_ready = 0;
+static uint32_t usbd_mem_pool_used = 0;
+static uint32_t usbd_mem_pool_high_water = 0;
+#ifdef USE_USBD_DEFERRED_CONTROL
+/* control events, the OTG interrupt is the only producer, the control interrupt the only consumer */
+static USBD_CtrlRecordTypeDef usbd_ctrl_queue[USBD_CTRL_QUEUE_SIZE] USBD_DTCM_BSS;
+static volatile uint32_t usbd_ctrl_wr = 0;
+static volatile uint32_t usbd_ctrl_rd = 0;
+static uint32_t usbd_ctrl_lost = 0;
+static uint8_t  usbd_ctrl_shared = 0; /* the current control transfer runs with the OTG interrupt enabled */
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#if (USBD_LPM_ENABLED == 1U)
+/* iso endpoints open, bit n for OUT n and bit 16 + n for IN n : L1 is refused while one is open */
+static uint32_t usbd_lpm_iso_open = 0;
+#endif /* USBD_LPM_ENABLED */
+#ifdef USE_AUDIO_USB_LOW_RATE
+/* indexed by direction, 1 for IN, and endpoint number */
+static USBD_IsoSparseTypeDef usbd_iso_sparse[2][USBD_ISO_SPARSE_EPS];
+static uint32_t usbd_iso_sparse_open = 0;  /* bit n for OUT n and bit 16 + n for IN n */
+static uint32_t usbd_iso_frame_mask = 0x7FFU; /* FNSOF wraps at 11 bits on a full speed bus, 14 on high speed */
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
 /* USER CODE END PV */
 
@@ -50,12 +313,124 @@ void Error_Handler(void);
 /* USER CODE BEGIN PFP */
 /* Private function prototypes -----------------------------------------------*/
 USBD_StatusTypeDef USBD_Get_USB_Status(HAL_StatusTypeDef hal_status);
+#ifdef USE_USB_HS_DMA
+static void USBD_LL_DMACacheClean(uint8_t *pbuf, uint32_t size);
+static void USBD_LL_DMACacheInvalidate(uint8_t *pbuf, uint32_t size);
+#endif /* USE_USB_HS_DMA */
+#ifdef USE_USBD_DEFERRED_CONTROL
+static USBD_CtrlRecordTypeDef* USBD_LL_CtrlAlloc(uint8_t event, uint8_t epnum);
+static void USBD_LL_CtrlPost(void);
+static uint8_t USBD_LL_CtrlIsShared(const USBD_CtrlRecordTypeDef* record);
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#if (USBD_LPM_ENABLED == 1U)
+static void USBD_LL_LPMUpdate(PCD_HandleTypeDef *hpcd);
+#endif /* USBD_LPM_ENABLED */
+#ifdef USE_USB_DEDICATED_EP1
+static void USBD_LL_EP1Route(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+#endif /* USE_USB_DEDICATED_EP1 */
+#ifdef USE_AUDIO_USB_LOW_RATE
+static void USBD_LL_IsoSparseArm(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+static void USBD_LL_IsoSparseCompleted(PCD_HandleTypeDef *hpcd, uint8_t ep_addr);
+static uint8_t USBD_LL_IsoSparseMissed(uint8_t ep_addr, uint32_t frame);
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
 /* USER CODE END PFP */
 
 /* Private functions ---------------------------------------------------------*/
 
 /* USER CODE BEGIN 1 */
+#ifdef USE_USB_HS_DMA
+/**
+  * @brief  Writes back the D-Cache lines covering a buffer before the USB DMA reads it.
+  * @param  pbuf: buffer address
+  * @param  size: buffer size in bytes
+  * @retval None
+  */
+static void USBD_LL_DMACacheClean(uint8_t *pbuf, uint32_t size)
+{
+  /* CMSIS extends the range to the enclosing cache lines */
+  if(((SCB->CCR & SCB_CCR_DC_Msk) != 0U) && (size > 0U))
+  {
+    SCB_CleanDCache_by_Addr((uint32_t *)pbuf, (int32_t)size);
+  }
+}
+
+/**
+  * @brief  Drops the D-Cache lines covering a buffer written by the USB DMA.
+  *         lines are cleaned first so that dirty data sharing a line with the
+  *         buffer is not lost, buffers in cacheable memory should therefore be
+  *         aligned on cache lines or placed in a non cacheable MPU region.
+  * @param  pbuf: buffer address
+  * @param  size: buffer size in bytes
+  * @retval None
+  */
+static void USBD_LL_DMACacheInvalidate(uint8_t *pbuf, uint32_t size)
+{
+  /* CMSIS extends the range to the enclosing cache lines */
+  if(((SCB->CCR & SCB_CCR_DC_Msk) != 0U) && (size > 0U))
+  {
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)pbuf, (int32_t)size);
+  }
+}
+#endif /* USE_USB_HS_DMA */
+#ifdef USE_USBD_DEFERRED_CONTROL
+/**
+  * @brief  Takes a record of the control queue, called from the OTG interrupt.
+  * @param  event: USBD_CtrlEventTypeDef
+  * @param  epnum: endpoint number
+  * @retval record to fill before USBD_LL_CtrlPost, NULL if the queue is full
+  */
+static USBD_CtrlRecordTypeDef* USBD_LL_CtrlAlloc(uint8_t event, uint8_t epnum)
+{
+  USBD_CtrlRecordTypeDef* record;
+
+  if((usbd_ctrl_wr - usbd_ctrl_rd) >= USBD_CTRL_QUEUE_SIZE)
+  {
+    usbd_ctrl_lost++;
+    return NULL;
+  }
+  record = &usbd_ctrl_queue[usbd_ctrl_wr & (USBD_CTRL_QUEUE_SIZE - 1U)];
+  record->event = event;
+  record->epnum = epnum;
+  return record;
+}
+
+/**
+  * @brief  Publishes the record taken by USBD_LL_CtrlAlloc and pends the control interrupt.
+  * @retval None
+  */
+static void USBD_LL_CtrlPost(void)
+{
+  __DMB();
+  usbd_ctrl_wr++;
+  NVIC_SetPendingIRQ(USBD_CTRL_IRQn);
+}
+
+/**
+  * @brief  Tells if a control event may run while iso endpoints are serviced.
+  *         Requests reading the device (GET_DESCRIPTOR, GET_CUR, ...) and bulk
+  *         or interrupt endpoints don't change the endpoints or the sessions
+  *         used by the iso callbacks. SET requests (alternate, frequency ...),
+  *         their data stages, reset and disconnect keep them out as before.
+  * @param  record: event
+  * @retval 1 if the OTG interrupt may stay enabled
+  */
+static uint8_t USBD_LL_CtrlIsShared(const USBD_CtrlRecordTypeDef* record)
+{
+  switch(record->event)
+  {
+  case USBD_CTRL_EVENT_SETUP:
+    usbd_ctrl_shared = ((record->setup[0] & 0x80U) != 0U) ? 1U : 0U;
+    return usbd_ctrl_shared;
+  case USBD_CTRL_EVENT_DATA_OUT:
+  case USBD_CTRL_EVENT_DATA_IN:
+    return (record->epnum == 0U) ? usbd_ctrl_shared : 1U;
+  default:
+    usbd_ctrl_shared = 0U;
+    return 0U;
+  }
+}
+#endif /* USE_USBD_DEFERRED_CONTROL */
 /* USER CODE END 1 */
 
 /*******************************************************************************
@@ -69,7 +444,58 @@ void HAL_PCD_MspInit(PCD_HandleTypeDef* pcdHandle)
   if(pcdHandle->Instance==USB_OTG_HS)
   {
   /* USER CODE BEGIN USB_OTG_HS_MspInit 0 */
-
+#if (defined USE_USB_HS_ULPI_PHY) || (defined USE_AUDIO_CLOCK_SOF_OUTPUT)
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+#endif /* USE_USB_HS_ULPI_PHY || USE_AUDIO_CLOCK_SOF_OUTPUT */
+#ifdef USE_USB_HS_ULPI_PHY
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+    __HAL_RCC_GPIOC_CLK_ENABLE();
+    __HAL_RCC_SYSCFG_CLK_ENABLE();
+    /* DIR and NXT are on the PC2_C/PC3_C pads, close the analog switches */
+    HAL_SYSCFG_AnalogSwitchConfig(SYSCFG_SWITCH_PC2 | SYSCFG_SWITCH_PC3,
+                                  SYSCFG_SWITCH_PC2_CLOSE | SYSCFG_SWITCH_PC3_CLOSE);
+    /**USB_OTG_HS ULPI GPIO Configuration
+    PA3     ------> USB_OTG_HS_ULPI_D0
+    PA5     ------> USB_OTG_HS_ULPI_CK
+    PB0     ------> USB_OTG_HS_ULPI_D1
+    PB1     ------> USB_OTG_HS_ULPI_D2
+    PB10    ------> USB_OTG_HS_ULPI_D3
+    PB11    ------> USB_OTG_HS_ULPI_D4
+    PB12    ------> USB_OTG_HS_ULPI_D5
+    PB13    ------> USB_OTG_HS_ULPI_D6
+    PB5     ------> USB_OTG_HS_ULPI_D7
+    PC0     ------> USB_OTG_HS_ULPI_STP
+    PC2_C   ------> USB_OTG_HS_ULPI_DIR
+    PC3_C   ------> USB_OTG_HS_ULPI_NXT
+    */
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF10_OTG1_HS;
+    GPIO_InitStruct.Pin = GPIO_PIN_3|GPIO_PIN_5;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_10|GPIO_PIN_11
+                          |GPIO_PIN_12|GPIO_PIN_13|GPIO_PIN_5;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_2|GPIO_PIN_3;
+    HAL_GPIO_Init(GPIOC, &GPIO_InitStruct);
+#endif /* USE_USB_HS_ULPI_PHY */
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    /**USB_OTG_HS SOF output, the external audio PLL locks on it
+    PA8     ------> USB_OTG_HS_SOF
+    */
+    GPIO_InitStruct.Pin = GPIO_PIN_8;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = GPIO_AF10_OTG1_FS;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
   /* USER CODE END USB_OTG_HS_MspInit 0 */
 
   /** Initializes the peripherals clock
@@ -87,11 +513,25 @@ void HAL_PCD_MspInit(PCD_HandleTypeDef* pcdHandle)
 
     /* Peripheral clock enable */
     __HAL_RCC_USB_OTG_HS_CLK_ENABLE();
+#ifdef USE_USB_HS_ULPI_PHY
+    __HAL_RCC_USB_OTG_HS_ULPI_CLK_ENABLE();
+#endif /* USE_USB_HS_ULPI_PHY */
 
     /* Peripheral interrupt init */
     HAL_NVIC_SetPriority(OTG_HS_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(OTG_HS_IRQn);
   /* USER CODE BEGIN USB_OTG_HS_MspInit 1 */
+#ifdef USE_USBD_DEFERRED_CONTROL
+    HAL_NVIC_SetPriority(USBD_CTRL_IRQn, USBD_CTRL_IRQ_PRIORITY, 0);
+    HAL_NVIC_EnableIRQ(USBD_CTRL_IRQn);
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_USB_DEDICATED_EP1
+    /* at the OTG level : EP1 completions and the global handler never preempt each other */
+    HAL_NVIC_SetPriority(OTG_HS_EP1_OUT_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(OTG_HS_EP1_OUT_IRQn);
+    HAL_NVIC_SetPriority(OTG_HS_EP1_IN_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(OTG_HS_EP1_IN_IRQn);
+#endif /* USE_USB_DEDICATED_EP1 */
 
   /* USER CODE END USB_OTG_HS_MspInit 1 */
   }
@@ -106,12 +546,21 @@ void HAL_PCD_MspDeInit(PCD_HandleTypeDef* pcdHandle)
   /* USER CODE END USB_OTG_HS_MspDeInit 0 */
     /* Peripheral clock disable */
     __HAL_RCC_USB_OTG_HS_CLK_DISABLE();
+#ifdef USE_USB_HS_ULPI_PHY
+    __HAL_RCC_USB_OTG_HS_ULPI_CLK_DISABLE();
+#endif /* USE_USB_HS_ULPI_PHY */
 
     /* Peripheral interrupt Deinit*/
     HAL_NVIC_DisableIRQ(OTG_HS_IRQn);
+#ifdef USE_USBD_DEFERRED_CONTROL
+    HAL_NVIC_DisableIRQ(USBD_CTRL_IRQn);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 
   /* USER CODE BEGIN USB_OTG_HS_MspDeInit 1 */
-
+#ifdef USE_USB_DEDICATED_EP1
+    HAL_NVIC_DisableIRQ(OTG_HS_EP1_OUT_IRQn);
+    HAL_NVIC_DisableIRQ(OTG_HS_EP1_IN_IRQn);
+#endif /* USE_USB_DEDICATED_EP1 */
   /* USER CODE END USB_OTG_HS_MspDeInit 1 */
   }
 }
@@ -127,7 +576,21 @@ static void PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_CtrlRecordTypeDef* record;
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_USB_HS_DMA
+  USBD_LL_DMACacheInvalidate((uint8_t *)hpcd->Setup, sizeof(hpcd->Setup));
+#endif /* USE_USB_HS_DMA */
+#ifdef USE_USBD_DEFERRED_CONTROL
+  if((record = USBD_LL_CtrlAlloc(USBD_CTRL_EVENT_SETUP, 0U)) != NULL)
+  {
+    memcpy(record->setup, hpcd->Setup, sizeof(record->setup));
+    USBD_LL_CtrlPost();
+  }
+#else /* USE_USBD_DEFERRED_CONTROL */
   USBD_LL_SetupStage((USBD_HandleTypeDef*)hpcd->pData, (uint8_t *)hpcd->Setup);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -142,7 +605,32 @@ static void PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_CtrlRecordTypeDef* record;
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_USB_HS_DMA
+  USBD_LL_DMACacheInvalidate((uint8_t *)hpcd->OUT_ep[epnum].dma_addr, hpcd->OUT_ep[epnum].xfer_count);
+#endif /* USE_USB_HS_DMA */
+#ifdef USE_USBD_DEFERRED_CONTROL
+  if(hpcd->OUT_ep[epnum].type != EP_TYPE_ISOC)
+  {
+    if((record = USBD_LL_CtrlAlloc(USBD_CTRL_EVENT_DATA_OUT, epnum)) != NULL)
+    {
+      record->buff = hpcd->OUT_ep[epnum].xfer_buff;
+      USBD_LL_CtrlPost();
+    }
+    return;
+  }
+  USBD_LL_ISO_ENTER((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_AUDIO_USB_LOW_RATE
+  /* before the class re-arms the endpoint */
+  USBD_LL_IsoSparseCompleted(hpcd, epnum);
+#endif /* USE_AUDIO_USB_LOW_RATE */
   USBD_LL_DataOutStage((USBD_HandleTypeDef*)hpcd->pData, epnum, hpcd->OUT_ep[epnum].xfer_buff);
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_EXIT((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -157,7 +645,27 @@ static void PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_CtrlRecordTypeDef* record;
+
+  if(hpcd->IN_ep[epnum].type != EP_TYPE_ISOC)
+  {
+    if((record = USBD_LL_CtrlAlloc(USBD_CTRL_EVENT_DATA_IN, epnum)) != NULL)
+    {
+      record->buff = hpcd->IN_ep[epnum].xfer_buff;
+      USBD_LL_CtrlPost();
+    }
+    return;
+  }
+  USBD_LL_ISO_ENTER((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_AUDIO_USB_LOW_RATE
+  USBD_LL_IsoSparseCompleted(hpcd, epnum | 0x80U);
+#endif /* USE_AUDIO_USB_LOW_RATE */
   USBD_LL_DataInStage((USBD_HandleTypeDef*)hpcd->pData, epnum, hpcd->IN_ep[epnum].xfer_buff);
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_EXIT((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -171,7 +679,13 @@ static void PCD_SOFCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_SOFCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_ENTER((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
   USBD_LL_SOF((USBD_HandleTypeDef*)hpcd->pData);
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_EXIT((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -187,6 +701,11 @@ void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
 {
   USBD_SpeedTypeDef speed = USBD_SPEED_FULL;
 
+  AUDIO_BOOT_MARK(AUDIO_BOOT_USB_RESET);
+#ifdef USE_AUDIO_IDLE_POWER
+  /* a reset also ends the suspend */
+  AUDIO_PowerResume();
+#endif /* USE_AUDIO_IDLE_POWER */
   if ( hpcd->Init.speed == PCD_SPEED_HIGH)
   {
     speed = USBD_SPEED_HIGH;
@@ -199,11 +718,22 @@ void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
   {
     Error_Handler();
   }
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_CtrlRecordTypeDef* record;
+
+  /* the reset closes the classes, done by the control interrupt in order with the requests */
+  if((record = USBD_LL_CtrlAlloc(USBD_CTRL_EVENT_RESET, 0U)) != NULL)
+  {
+    record->speed = (uint8_t)speed;
+    USBD_LL_CtrlPost();
+  }
+#else /* USE_USBD_DEFERRED_CONTROL */
     /* Set Speed. */
   USBD_LL_SetSpeed((USBD_HandleTypeDef*)hpcd->pData, speed);
 
   /* Reset Device. */
   USBD_LL_Reset((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -218,6 +748,10 @@ static void PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  /* no more packets : the sessions stop their SAI and keep their state */
+  USBD_AUDIO_Suspend(1);
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
   /* Inform USB library that core enters in suspend Mode. */
   USBD_LL_Suspend((USBD_HandleTypeDef*)hpcd->pData);
   __HAL_PCD_GATE_PHYCLOCK(hpcd);
@@ -228,6 +762,10 @@ void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
     /* Set SLEEPDEEP bit and SleepOnExit of Cortex System Control Register. */
     SCB->SCR |= (uint32_t)((uint32_t)(SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SLEEPONEXIT_Msk));
   }
+#ifdef USE_AUDIO_IDLE_POWER
+  /* the main loop enters STOP mode once no stream is started */
+  AUDIO_PowerSuspend();
+#endif /* USE_AUDIO_IDLE_POWER */
   /* USER CODE END 2 */
 }
 
@@ -244,9 +782,16 @@ void HAL_PCD_ResumeCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
   /* USER CODE BEGIN 3 */
-
+#ifdef USE_AUDIO_IDLE_POWER
+  __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+  AUDIO_PowerResume();
+#endif /* USE_AUDIO_IDLE_POWER */
   /* USER CODE END 3 */
   USBD_LL_Resume((USBD_HandleTypeDef*)hpcd->pData);
+#ifdef USE_AUDIO_SUSPEND_RETAIN
+  /* the sessions restart their SAI with the first packet */
+  USBD_AUDIO_Suspend(0);
+#endif /* USE_AUDIO_SUSPEND_RETAIN */
 }
 
 /**
@@ -261,7 +806,13 @@ static void PCD_ISOOUTIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_ISOOUTIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_ENTER((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
   USBD_LL_IsoOUTIncomplete((USBD_HandleTypeDef*)hpcd->pData, epnum);
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_EXIT((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -276,7 +827,13 @@ static void PCD_ISOINIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_ISOINIncompleteCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_ENTER((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
   USBD_LL_IsoINIncomplete((USBD_HandleTypeDef*)hpcd->pData, epnum);
+#ifdef USE_USBD_DEFERRED_CONTROL
+  USBD_LL_ISO_EXIT((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
 /**
@@ -304,9 +861,79 @@ static void PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+#ifdef USE_USBD_DEFERRED_CONTROL
+  if(USBD_LL_CtrlAlloc(USBD_CTRL_EVENT_DISCONNECT, 0U) != NULL)
+  {
+    USBD_LL_CtrlPost();
+  }
+#else /* USE_USBD_DEFERRED_CONTROL */
   USBD_LL_DevDisconnected((USBD_HandleTypeDef*)hpcd->pData);
+#endif /* USE_USBD_DEFERRED_CONTROL */
 }
 
+#if (USBD_LPM_ENABLED == 1U)
+/**
+  * @brief  LPM callback.
+  *         L1 is only acknowledged while no iso endpoint is open, see USBD_LL_LPMUpdate.
+  *         Leaving L1 only ungates the PHY clock : the USB runs from HSI48 whatever
+  *         the system clock, so the device is ready well within the BESL
+  * @param  hpcd: PCD handle
+  * @param  msg: LPM message
+  * @retval None
+  */
+#if (USE_HAL_PCD_REGISTER_CALLBACKS == 1U)
+static void PCDEx_LPM_Callback(PCD_HandleTypeDef *hpcd, PCD_LPM_MsgTypeDef msg)
+#else
+void HAL_PCDEx_LPM_Callback(PCD_HandleTypeDef *hpcd, PCD_LPM_MsgTypeDef msg)
+#endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
+{
+  switch (msg)
+  {
+  case PCD_LPM_L0_ACTIVE:
+    __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+#ifdef USE_AUDIO_IDLE_POWER
+    AUDIO_PowerLinkSleep(0);
+#endif /* USE_AUDIO_IDLE_POWER */
+    USBD_LL_Resume((USBD_HandleTypeDef*)hpcd->pData);
+    break;
+
+  case PCD_LPM_L1_ACTIVE:
+    USBD_LL_Suspend((USBD_HandleTypeDef*)hpcd->pData);
+    __HAL_PCD_GATE_PHYCLOCK(hpcd);
+#ifdef USE_AUDIO_IDLE_POWER
+    /* not STOP mode : its clock restart would not fit the BESL */
+    AUDIO_PowerLinkSleep(1);
+#endif /* USE_AUDIO_IDLE_POWER */
+    break;
+
+  default:
+    break;
+  }
+}
+
+/**
+  * @brief  Acknowledges LPM L1 requests only while no iso endpoint is open,
+  *         otherwise the core answers NYET and the link stays in L0
+  * @param  hpcd: PCD handle
+  * @retval None
+  */
+static void USBD_LL_LPMUpdate(PCD_HandleTypeDef *hpcd)
+{
+  if(hpcd->lpm_active == 0U)
+  {
+    return;
+  }
+  if(usbd_lpm_iso_open == 0U)
+  {
+    hpcd->Instance->GLPMCFG |= USB_OTG_GLPMCFG_LPMACK;
+  }
+  else
+  {
+    hpcd->Instance->GLPMCFG &= ~USB_OTG_GLPMCFG_LPMACK;
+  }
+}
+#endif /* USBD_LPM_ENABLED */
+
 /*******************************************************************************
                        LL Driver Interface (USB Device Library --> PCD)
 *******************************************************************************/
@@ -318,6 +945,8 @@ void HAL_PCD_DisconnectCallback(PCD_HandleTypeDef *hpcd)
   */
 USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
 {
+  uint8_t fifo;
+
   /* Init USB Ip. */
   if (pdev->id == DEVICE_HS) {
   /* Link the driver to the stack. */
@@ -326,13 +955,32 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
 
   hpcd_USB_OTG_HS.Instance = USB_OTG_HS;
   hpcd_USB_OTG_HS.Init.dev_endpoints = 9;
+#ifdef USE_USB_HS_ULPI_PHY
+  hpcd_USB_OTG_HS.Init.speed = PCD_SPEED_HIGH;
+  hpcd_USB_OTG_HS.Init.phy_itface = USB_OTG_ULPI_PHY;
+#else /* USE_USB_HS_ULPI_PHY */
   hpcd_USB_OTG_HS.Init.speed = PCD_SPEED_FULL;
-  hpcd_USB_OTG_HS.Init.dma_enable = DISABLE;
   hpcd_USB_OTG_HS.Init.phy_itface = USB_OTG_EMBEDDED_PHY;
+#endif /* USE_USB_HS_ULPI_PHY */
+#ifdef USE_USB_HS_DMA
+  hpcd_USB_OTG_HS.Init.dma_enable = ENABLE;
+#else /* USE_USB_HS_DMA */
+  hpcd_USB_OTG_HS.Init.dma_enable = DISABLE;
+#endif /* USE_USB_HS_DMA */
+#ifdef USE_AUDIO_CLOCK_SOF_OUTPUT
+  hpcd_USB_OTG_HS.Init.Sof_enable = ENABLE;
+#else /* USE_AUDIO_CLOCK_SOF_OUTPUT */
   hpcd_USB_OTG_HS.Init.Sof_enable = DISABLE;
+#endif /* USE_AUDIO_CLOCK_SOF_OUTPUT */
   hpcd_USB_OTG_HS.Init.low_power_enable = DISABLE;
+#if (USBD_LPM_ENABLED == 1U)
+  hpcd_USB_OTG_HS.Init.lpm_enable = ENABLE;
+#else /* USBD_LPM_ENABLED */
   hpcd_USB_OTG_HS.Init.lpm_enable = DISABLE;
+#endif /* USBD_LPM_ENABLED */
   hpcd_USB_OTG_HS.Init.vbus_sensing_enable = DISABLE;
+  /* with USE_USB_DEDICATED_EP1 too : the HAL would then leave the masks of the
+     other endpoints cleared at reset. USBD_LL_OpenEP routes EP1 itself */
   hpcd_USB_OTG_HS.Init.use_dedicated_ep1 = DISABLE;
   hpcd_USB_OTG_HS.Init.use_external_vbus = DISABLE;
   if (HAL_PCD_Init(&hpcd_USB_OTG_HS) != HAL_OK)
@@ -354,13 +1002,17 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
   HAL_PCD_RegisterDataInStageCallback(&hpcd_USB_OTG_HS, PCD_DataInStageCallback);
   HAL_PCD_RegisterIsoOutIncpltCallback(&hpcd_USB_OTG_HS, PCD_ISOOUTIncompleteCallback);
   HAL_PCD_RegisterIsoInIncpltCallback(&hpcd_USB_OTG_HS, PCD_ISOINIncompleteCallback);
+#if (USBD_LPM_ENABLED == 1U)
+  HAL_PCD_RegisterLpmCallback(&hpcd_USB_OTG_HS, PCDEx_LPM_Callback);
+#endif /* USBD_LPM_ENABLED */
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
   /* USER CODE BEGIN TxRx_HS_Configuration */
-  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, 0x100);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 0, 0x40);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 1, 0x40);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 2, 0x40);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, 3, 0x100);
+  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_HS, USBD_FIFO_RX_WORDS);
+  /* each TX FIFO starts after the previous ones, they are set in order */
+  for(fifo = 0; fifo < USBD_FIFO_TX_COUNT; fifo++)
+  {
+    HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_HS, fifo, usbd_fifo_tx_words[fifo]);
+  }
   /* USER CODE END TxRx_HS_Configuration */
   }
   return USBD_OK;
@@ -431,6 +1083,19 @@ USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uin
   USBD_StatusTypeDef usb_status = USBD_OK;
 
   hal_status = HAL_PCD_EP_Open(pdev->pData, ep_addr, ep_mps, ep_type);
+#ifdef USE_USB_DEDICATED_EP1
+  if((ep_addr & 0x7FU) == 1U)
+  {
+    USBD_LL_EP1Route(pdev->pData, ep_addr);
+  }
+#endif /* USE_USB_DEDICATED_EP1 */
+#if (USBD_LPM_ENABLED == 1U)
+  if(ep_type == USBD_EP_TYPE_ISOC)
+  {
+    usbd_lpm_iso_open |= 1UL << ((ep_addr & 0x0FU) + (((ep_addr & 0x80U) != 0U) ? 16U : 0U));
+    USBD_LL_LPMUpdate(pdev->pData);
+  }
+#endif /* USBD_LPM_ENABLED */
 
   usb_status =  USBD_Get_USB_Status(hal_status);
 
@@ -449,6 +1114,14 @@ USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
   USBD_StatusTypeDef usb_status = USBD_OK;
 
   hal_status = HAL_PCD_EP_Close(pdev->pData, ep_addr);
+#if (USBD_LPM_ENABLED == 1U)
+  usbd_lpm_iso_open &= ~(1UL << ((ep_addr & 0x0FU) + (((ep_addr & 0x80U) != 0U) ? 16U : 0U)));
+  USBD_LL_LPMUpdate(pdev->pData);
+#endif /* USBD_LPM_ENABLED */
+#ifdef USE_AUDIO_USB_LOW_RATE
+  usbd_iso_sparse_open &= ~(1UL << ((ep_addr & 0x0FU) + (((ep_addr & 0x80U) != 0U) ? 16U : 0U)));
+  usbd_iso_sparse[(ep_addr & 0x80U) >> 7][ep_addr & 0x0FU].period = 0;
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
   usb_status =  USBD_Get_USB_Status(hal_status);
 
@@ -560,7 +1233,13 @@ USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, u
   HAL_StatusTypeDef hal_status = HAL_OK;
   USBD_StatusTypeDef usb_status = USBD_OK;
 
+#ifdef USE_USB_HS_DMA
+  USBD_LL_DMACacheClean(pbuf, size);
+#endif /* USE_USB_HS_DMA */
   hal_status = HAL_PCD_EP_Transmit(pdev->pData, ep_addr, pbuf, size);
+#ifdef USE_AUDIO_USB_LOW_RATE
+  USBD_LL_IsoSparseArm(pdev->pData, ep_addr);
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
   usb_status =  USBD_Get_USB_Status(hal_status);
 
@@ -580,7 +1259,14 @@ USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_a
   HAL_StatusTypeDef hal_status = HAL_OK;
   USBD_StatusTypeDef usb_status = USBD_OK;
 
+#ifdef USE_USB_HS_DMA
+  /* no dirty line must be evicted over the buffer while the DMA fills it */
+  USBD_LL_DMACacheInvalidate(pbuf, size);
+#endif /* USE_USB_HS_DMA */
   hal_status = HAL_PCD_EP_Receive(pdev->pData, ep_addr, pbuf, size);
+#ifdef USE_AUDIO_USB_LOW_RATE
+  USBD_LL_IsoSparseArm(pdev->pData, ep_addr);
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
   usb_status =  USBD_Get_USB_Status(hal_status);
 
@@ -613,27 +1299,513 @@ USBD_StatusTypeDef USBD_LL_SetTestMode(USBD_HandleTypeDef *pdev, uint8_t testmod
   return USBD_OK;
 }
 #endif /* USBD_HS_TESTMODE_ENABLE */
+#ifdef USE_USBD_DEFERRED_CONTROL
 /**
-  * @brief  Static single allocation.
-  * @param  size: Size of allocated memory
+  * @brief  Runs the control events queued by the OTG interrupt : setup and
+  *         data stages of EP0, bulk and interrupt endpoints, reset and
+  *         disconnect. Called from USBD_CTRL_IRQHandler, below the OTG
+  *         interrupt which keeps servicing iso endpoints and SOF meanwhile
+  *         unless the event changes their state.
+  * @retval None
+  */
+void USBD_LL_ControlIRQHandler(void)
+{
+  USBD_HandleTypeDef* pdev = (USBD_HandleTypeDef*)hpcd_USB_OTG_HS.pData;
+  USBD_CtrlRecordTypeDef* record;
+  uint8_t shared;
+
+  while(usbd_ctrl_rd != usbd_ctrl_wr)
+  {
+    __DMB();
+    record = &usbd_ctrl_queue[usbd_ctrl_rd & (USBD_CTRL_QUEUE_SIZE - 1U)];
+    shared = USBD_LL_CtrlIsShared(record);
+    if(shared == 0U)
+    {
+      NVIC_DisableIRQ(OTG_HS_IRQn);
+#ifdef USE_USB_DEDICATED_EP1
+      NVIC_DisableIRQ(OTG_HS_EP1_OUT_IRQn);
+      NVIC_DisableIRQ(OTG_HS_EP1_IN_IRQn);
+#endif /* USE_USB_DEDICATED_EP1 */
+    }
+    switch(record->event)
+    {
+    case USBD_CTRL_EVENT_SETUP:
+      USBD_LL_SetupStage(pdev, record->setup);
+      break;
+    case USBD_CTRL_EVENT_DATA_OUT:
+      USBD_LL_DataOutStage(pdev, record->epnum, record->buff);
+      break;
+    case USBD_CTRL_EVENT_DATA_IN:
+      USBD_LL_DataInStage(pdev, record->epnum, record->buff);
+      break;
+    case USBD_CTRL_EVENT_RESET:
+      USBD_LL_SetSpeed(pdev, (USBD_SpeedTypeDef)record->speed);
+      USBD_LL_Reset(pdev);
+      break;
+    default:
+      USBD_LL_DevDisconnected(pdev);
+      break;
+    }
+    if(shared == 0U)
+    {
+#ifdef USE_USB_DEDICATED_EP1
+      NVIC_EnableIRQ(OTG_HS_EP1_IN_IRQn);
+      NVIC_EnableIRQ(OTG_HS_EP1_OUT_IRQn);
+#endif /* USE_USB_DEDICATED_EP1 */
+      NVIC_EnableIRQ(OTG_HS_IRQn);
+    }
+    __DMB();
+    usbd_ctrl_rd++;
+  }
+}
+
+/**
+  * @brief  Returns the count of control events dropped because the queue was full.
+  * @retval lost events count
+  */
+uint32_t USBD_LL_GetControlLost(void)
+{
+  return usbd_ctrl_lost;
+}
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_AUDIO_USB_ADMISSION
+/**
+  * @brief  Returns the largest iso packet the FIFO of an endpoint holds : its
+  *         TX FIFO for an IN endpoint, the shared RX FIFO for an OUT one.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval bytes, 0 for an IN endpoint without TX FIFO
+  */
+uint32_t USBD_LL_GetIsoFifoSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  if((ep_addr & 0x80U) == 0U)
+  {
+    return (USBD_FIFO_RX_PACKET_WORDS - 1U) * 4U;
+  }
+  if((ep_addr & 0x7FU) >= USBD_FIFO_TX_COUNT)
+  {
+    return 0;
+  }
+  return usbd_fifo_tx_words[ep_addr & 0x7FU] * 4U;
+}
+#endif /* USE_AUDIO_USB_ADMISSION */
+#ifdef USE_USB_DEDICATED_EP1
+/**
+  * @brief  Lean handler of the dedicated EP1 OUT interrupt : the play data
+  *         completes with a few register accesses, no walk over the endpoints
+  *         nor the global interrupt status. The DMA already moved the packet.
+  *         Called from OTG_HS_EP1_OUT_IRQHandler
+  * @retval None
+  */
+void USBD_LL_EP1OutIRQHandler(void)
+{
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_HS;
+  USB_OTG_GlobalTypeDef *USBx = hpcd->Instance;
+  uint32_t USBx_BASE = (uint32_t)USBx;
+  PCD_EPTypeDef *ep = &hpcd->OUT_ep[1];
+  uint32_t epint;
+
+  epint = USBx_OUTEP(1U)->DOEPINT & USBx_DEVICE->DOUTEP1MSK;
+  if((epint & USB_OTG_DOEPINT_XFRC) != 0U)
+  {
+    USBx_OUTEP(1U)->DOEPINT = USB_OTG_DOEPINT_XFRC;
+    ep->xfer_count = ep->xfer_size - (USBx_OUTEP(1U)->DOEPTSIZ & USB_OTG_DOEPTSIZ_XFRSIZ);
+#if (USE_HAL_PCD_REGISTER_CALLBACKS == 1U)
+    hpcd->DataOutStageCallback(hpcd, 1U);
+#else
+    HAL_PCD_DataOutStageCallback(hpcd, 1U);
+#endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
+  }
+  /* disabled by the ISO OUT incomplete handling of the global handler */
+  if((epint & USB_OTG_DOEPINT_EPDISD) != 0U)
+  {
+    if((USBx->GINTSTS & USB_OTG_GINTSTS_BOUTNAKEFF) == USB_OTG_GINTSTS_BOUTNAKEFF)
+    {
+      USBx_DEVICE->DCTL |= USB_OTG_DCTL_CGONAK;
+    }
+    if(ep->is_iso_incomplete == 1U)
+    {
+      ep->is_iso_incomplete = 0U;
+#if (USE_HAL_PCD_REGISTER_CALLBACKS == 1U)
+      hpcd->ISOOUTIncompleteCallback(hpcd, 1U);
+#else
+      HAL_PCD_ISOOUTIncompleteCallback(hpcd, 1U);
+#endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
+    }
+    USBx_OUTEP(1U)->DOEPINT = USB_OTG_DOEPINT_EPDISD;
+  }
+}
+
+/**
+  * @brief  Lean handler of the dedicated EP1 IN interrupt, for the record data.
+  *         Called from OTG_HS_EP1_IN_IRQHandler
   * @retval None
   */
+void USBD_LL_EP1InIRQHandler(void)
+{
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_HS;
+  USB_OTG_GlobalTypeDef *USBx = hpcd->Instance;
+  uint32_t USBx_BASE = (uint32_t)USBx;
+  PCD_EPTypeDef *ep = &hpcd->IN_ep[1];
+  uint32_t epint;
+
+  epint = USBx_INEP(1U)->DIEPINT & USBx_DEVICE->DINEP1MSK;
+  if((epint & USB_OTG_DIEPINT_XFRC) != 0U)
+  {
+    USBx_INEP(1U)->DIEPINT = USB_OTG_DIEPINT_XFRC;
+    ep->xfer_buff += ep->maxpacket;
+#if (USE_HAL_PCD_REGISTER_CALLBACKS == 1U)
+    hpcd->DataInStageCallback(hpcd, 1U);
+#else
+    HAL_PCD_DataInStageCallback(hpcd, 1U);
+#endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
+  }
+  /* disabled by the ISO IN incomplete handling of the global handler */
+  if((epint & USB_OTG_DIEPINT_EPDISD) != 0U)
+  {
+    (void)USB_FlushTxFifo(USBx, 1U);
+    if(ep->is_iso_incomplete == 1U)
+    {
+      ep->is_iso_incomplete = 0U;
+#if (USE_HAL_PCD_REGISTER_CALLBACKS == 1U)
+      hpcd->ISOINIncompleteCallback(hpcd, 1U);
+#else
+      HAL_PCD_ISOINIncompleteCallback(hpcd, 1U);
+#endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
+    }
+    USBx_INEP(1U)->DIEPINT = USB_OTG_DIEPINT_EPDISD;
+  }
+}
+
+/**
+  * @brief  Moves an opened EP1 direction from the global OTG interrupt to its
+  *         dedicated one : it leaves the shared endpoints mask and gets the
+  *         completion and disable interrupts of its own mask. Closing the
+  *         endpoint clears both masks
+  * @param  hpcd: PCD handle
+  * @param  ep_addr: 0x01 or 0x81
+  * @retval None
+  */
+static void USBD_LL_EP1Route(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+  uint32_t USBx_BASE = (uint32_t)hpcd->Instance;
+
+  if((ep_addr & 0x80U) != 0U)
+  {
+    USBx_DEVICE->DINEP1MSK = USB_OTG_DIEPMSK_XFRCM | USB_OTG_DIEPMSK_EPDM;
+    USBx_DEVICE->DAINTMSK &= ~(USB_OTG_DAINTMSK_IEPM & (1UL << 1U));
+    USBx_DEVICE->DEACHMSK |= USB_OTG_DEACHINTMSK_IEP1INTM;
+  }
+  else
+  {
+    USBx_DEVICE->DOUTEP1MSK = USB_OTG_DOEPMSK_XFRCM | USB_OTG_DOEPMSK_EPDM;
+    USBx_DEVICE->DAINTMSK &= ~(USB_OTG_DAINTMSK_OEPM & (1UL << 17U));
+    USBx_DEVICE->DEACHMSK |= USB_OTG_DEACHINTMSK_OEP1INTM;
+  }
+}
+#endif /* USE_USB_DEDICATED_EP1 */
+#ifdef USE_AUDIO_USB_LOW_RATE
+/**
+  * @brief  Sets the polling interval of an opened iso endpoint. Past one
+  *         (micro)frame the endpoint is sparse : its transfers are armed for
+  *         the parity of the host polls, learned from the completions, and
+  *         the incompletes before the poll is due are dropped. Must be called
+  *         after USBD_LL_OpenEP, before the first transfer
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @param  interval: bInterval of the endpoint descriptor
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_SetIsoInterval(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t interval)
+{
+  PCD_HandleTypeDef *hpcd = pdev->pData;
+  uint32_t USBx_BASE = (uint32_t)hpcd->Instance;
+  USBD_IsoSparseTypeDef *sparse = &usbd_iso_sparse[(ep_addr & 0x80U) >> 7][ep_addr & 0x0FU];
+  uint32_t bit = 1UL << ((ep_addr & 0x0FU) + (((ep_addr & 0x80U) != 0U) ? 16U : 0U));
+  uint32_t frame;
+
+  if((interval == 0U) || (interval > USBD_ISO_SPARSE_MAX_INTERVAL))
+  {
+    return USBD_FAIL;
+  }
+  usbd_iso_frame_mask = (pdev->dev_speed == USBD_SPEED_HIGH) ? 0x3FFFU : 0x7FFU;
+  frame = (USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF_Msk) >> USB_OTG_DSTS_FNSOF_Pos;
+  sparse->period = (interval > 1U) ? (uint16_t)(1UL << (interval - 1U)) : 0U;
+  /* until a completion tells, the next (micro)frame one as the HAL arms it */
+  sparse->parity = (uint8_t)((frame + 1U) & 1U);
+  sparse->misses = 0;
+  if(sparse->period != 0U)
+  {
+    usbd_iso_sparse_open |= bit;
+  }
+  else
+  {
+    usbd_iso_sparse_open &= ~bit;
+  }
+  return USBD_OK;
+}
+
+/**
+  * @brief  Handles the iso incompletes while a sparse endpoint is open, ahead
+  *         of HAL_PCD_IRQHandler which would disable every enabled iso
+  *         endpoint at the end of each frame of its parity. Does the HAL
+  *         handling for the endpoints polled each (micro)frame and for the
+  *         sparse ones past their target, then clears the flags.
+  *         Called from OTG_HS_IRQHandler
+  * @retval None
+  */
+void USBD_LL_IsoIncompleteIRQHandler(void)
+{
+  PCD_HandleTypeDef *hpcd = &hpcd_USB_OTG_HS;
+  USB_OTG_GlobalTypeDef *USBx = hpcd->Instance;
+  uint32_t USBx_BASE = (uint32_t)USBx;
+  uint32_t gintsts;
+  uint32_t frame;
+  uint32_t ctl;
+  uint32_t epnum;
+
+  gintsts = USBx->GINTSTS & USBx->GINTMSK &
+            (USB_OTG_GINTSTS_IISOIXFR | USB_OTG_GINTSTS_PXFR_INCOMPISOOUT);
+  if((usbd_iso_sparse_open == 0U) || (gintsts == 0U))
+  {
+    return;
+  }
+  /* the (micro)frame which just ended */
+  frame = (USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF_Msk) >> USB_OTG_DSTS_FNSOF_Pos;
+  if((gintsts & USB_OTG_GINTSTS_IISOIXFR) != 0U)
+  {
+    for(epnum = 1U; (epnum < hpcd->Init.dev_endpoints) && (epnum < USBD_ISO_SPARSE_EPS); epnum++)
+    {
+      ctl = USBx_INEP(epnum)->DIEPCTL;
+      if((hpcd->IN_ep[epnum].type == EP_TYPE_ISOC) && ((ctl & USB_OTG_DIEPCTL_EPENA) != 0U) &&
+         USBD_LL_IsoSparseMissed((uint8_t)(epnum | 0x80U), frame))
+      {
+        hpcd->IN_ep[epnum].is_iso_incomplete = 1U;
+        (void)HAL_PCD_EP_Abort(hpcd, (uint8_t)(epnum | 0x80U));
+      }
+    }
+    __HAL_PCD_CLEAR_FLAG(hpcd, USB_OTG_GINTSTS_IISOIXFR);
+  }
+  if((gintsts & USB_OTG_GINTSTS_PXFR_INCOMPISOOUT) != 0U)
+  {
+    for(epnum = 1U; (epnum < hpcd->Init.dev_endpoints) && (epnum < USBD_ISO_SPARSE_EPS); epnum++)
+    {
+      ctl = USBx_OUTEP(epnum)->DOEPCTL;
+      /* armed for the parity of the frame which ended, EONUM is bit 16 in both directions */
+      if((hpcd->OUT_ep[epnum].type == EP_TYPE_ISOC) && ((ctl & USB_OTG_DOEPCTL_EPENA) != 0U) &&
+         (((ctl & USB_OTG_DIEPCTL_EONUM_DPID) != 0U) == ((frame & 1U) != 0U)) &&
+         USBD_LL_IsoSparseMissed((uint8_t)epnum, frame))
+      {
+        hpcd->OUT_ep[epnum].is_iso_incomplete = 1U;
+        USBx->GINTMSK |= USB_OTG_GINTMSK_GONAKEFFM;
+        if((USBx->GINTSTS & USB_OTG_GINTSTS_BOUTNAKEFF) == 0U)
+        {
+          USBx_DEVICE->DCTL |= USB_OTG_DCTL_SGONAK;
+          break;
+        }
+      }
+    }
+    __HAL_PCD_CLEAR_FLAG(hpcd, USB_OTG_GINTSTS_PXFR_INCOMPISOOUT);
+  }
+}
+
+/**
+  * @brief  Sets the parity of a sparse endpoint transfer the HAL just armed
+  *         for the next (micro)frame, its target is the last (micro)frame of
+  *         one period with that parity. Other endpoints are left as armed
+  * @param  hpcd: PCD handle
+  * @param  ep_addr: Endpoint number
+  * @retval None
+  */
+static void USBD_LL_IsoSparseArm(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+  uint32_t USBx_BASE = (uint32_t)hpcd->Instance;
+  USBD_IsoSparseTypeDef *sparse = &usbd_iso_sparse[(ep_addr & 0x80U) >> 7][ep_addr & 0x0FU];
+  uint32_t set = (sparse->parity != 0U) ? USB_OTG_DIEPCTL_SODDFRM : USB_OTG_DIEPCTL_SD0PID_SEVNFRM;
+  uint32_t target;
+
+  if(sparse->period == 0U)
+  {
+    return;
+  }
+  target = ((USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF_Msk) >> USB_OTG_DSTS_FNSOF_Pos) + sparse->period;
+  if((target & 1U) != sparse->parity)
+  {
+    target--;
+  }
+  sparse->target = (uint16_t)(target & usbd_iso_frame_mask);
+  /* DOEPCTL has the same bits */
+  if((ep_addr & 0x80U) != 0U)
+  {
+    USBx_INEP(ep_addr & 0x0FU)->DIEPCTL |= set;
+  }
+  else
+  {
+    USBx_OUTEP(ep_addr & 0x0FU)->DOEPCTL |= set;
+  }
+}
+
+/**
+  * @brief  Learns the polls parity of a sparse endpoint from a completion,
+  *         called before the class re-arms it
+  * @param  hpcd: PCD handle
+  * @param  ep_addr: Endpoint number
+  * @retval None
+  */
+static void USBD_LL_IsoSparseCompleted(PCD_HandleTypeDef *hpcd, uint8_t ep_addr)
+{
+  uint32_t USBx_BASE = (uint32_t)hpcd->Instance;
+  USBD_IsoSparseTypeDef *sparse = &usbd_iso_sparse[(ep_addr & 0x80U) >> 7][ep_addr & 0x0FU];
+
+  if(sparse->period == 0U)
+  {
+    return;
+  }
+  sparse->parity = (uint8_t)(((USBx_DEVICE->DSTS & USB_OTG_DSTS_FNSOF_Msk) >> USB_OTG_DSTS_FNSOF_Pos) & 1U);
+  sparse->misses = 0;
+}
+
+/**
+  * @brief  Tells if an incomplete is a miss : always for an endpoint polled
+  *         each (micro)frame, once its target ended for a sparse one. The
+  *         second consecutive miss of a sparse endpoint changes its parity
+  * @param  ep_addr: Endpoint number
+  * @param  frame: (micro)frame which just ended
+  * @retval 1 for a miss
+  */
+static uint8_t USBD_LL_IsoSparseMissed(uint8_t ep_addr, uint32_t frame)
+{
+  USBD_IsoSparseTypeDef *sparse = &usbd_iso_sparse[(ep_addr & 0x80U) >> 7][ep_addr & 0x0FU];
+
+  if(sparse->period == 0U)
+  {
+    return 1U;
+  }
+  /* before the target , modulo the frame number range */
+  if(((frame - sparse->target) & usbd_iso_frame_mask) > (usbd_iso_frame_mask >> 1))
+  {
+    return 0U;
+  }
+  if(++sparse->misses >= USBD_ISO_SPARSE_MISSES)
+  {
+    sparse->parity ^= 1U;
+    sparse->misses = 0;
+  }
+  return 1U;
+}
+#endif /* USE_AUDIO_USB_LOW_RATE */
+/**
+  * @brief  Allocation from the static memory pool, first fit. Blocks are
+  *         allocated on enumeration and released on class DeInit so the same
+  *         sequence of requests always gets the same addresses.
+  * @param  size: Size of allocated memory
+  * @retval pointer to USBD_MEM_POOL_ALIGN aligned memory, NULL if pool is full
+  */
 void *USBD_static_malloc(uint32_t size)
 {
-  UNUSED(size);
-//  static uint32_t mem[(sizeof(USBD_AUDIO_HandleTypeDef)/4)+1];/* On 32-bit boundary */
-//  return mem;
-  return 0;
+  USBD_MemBlockTypeDef *block;
+  USBD_MemBlockTypeDef *next;
+  uint8_t *pool = (uint8_t *)usbd_mem_pool;
+  uint32_t offset = 0;
+  uint32_t need;
+  uint32_t primask;
+  void *mem = NULL;
+
+  need = ((size + USBD_MEM_POOL_ALIGN - 1U) & ~(USBD_MEM_POOL_ALIGN - 1U)) + USBD_MEM_BLOCK_HEADER_SIZE;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  if(usbd_mem_pool_ready == 0U)
+  {
+    block = (USBD_MemBlockTypeDef *)pool;
+    block->size = USBD_MEM_POOL_SIZE;
+    block->used = 0U;
+    usbd_mem_pool_ready = 1U;
+  }
+  while((size != 0U) && (offset < USBD_MEM_POOL_SIZE))
+  {
+    block = (USBD_MemBlockTypeDef *)&pool[offset];
+    if((block->used == 0U) && (block->size >= need))
+    {
+      /* split when the remainder can hold a header and some data */
+      if(block->size - need > USBD_MEM_BLOCK_HEADER_SIZE)
+      {
+        next = (USBD_MemBlockTypeDef *)&pool[offset + need];
+        next->size = block->size - need;
+        next->used = 0U;
+        block->size = need;
+      }
+      block->used = 1U;
+      usbd_mem_pool_used += block->size;
+      if(usbd_mem_pool_used > usbd_mem_pool_high_water)
+      {
+        usbd_mem_pool_high_water = usbd_mem_pool_used;
+      }
+      mem = &pool[offset + USBD_MEM_BLOCK_HEADER_SIZE];
+      break;
+    }
+    offset += block->size;
+  }
+  __set_PRIMASK(primask);
+  return mem;
 }
 
 /**
-  * @brief  Dummy memory free
-  * @param  p: Pointer to allocated  memory address
+  * @brief  Releases a block of the static memory pool, merges free neighbours
+  * @param  p: Pointer to allocated  memory address, may be NULL
   * @retval None
   */
 void USBD_static_free(void *p)
 {
-  UNUSED(p);
+  USBD_MemBlockTypeDef *block;
+  USBD_MemBlockTypeDef *next;
+  uint8_t *pool = (uint8_t *)usbd_mem_pool;
+  uint32_t offset = 0;
+  uint32_t primask;
+
+  if((p == NULL) || ((uint8_t *)p < &pool[USBD_MEM_BLOCK_HEADER_SIZE]) || ((uint8_t *)p >= &pool[USBD_MEM_POOL_SIZE]))
+  {
+    return;
+  }
+  primask = __get_PRIMASK();
+  __disable_irq();
+  block = (USBD_MemBlockTypeDef *)((uint8_t *)p - USBD_MEM_BLOCK_HEADER_SIZE);
+  if(block->used != 0U)
+  {
+    block->used = 0U;
+    usbd_mem_pool_used -= block->size;
+    /* coalesce adjacent free blocks */
+    while(offset < USBD_MEM_POOL_SIZE)
+    {
+      block = (USBD_MemBlockTypeDef *)&pool[offset];
+      if(block->used == 0U)
+      {
+        while(offset + block->size < USBD_MEM_POOL_SIZE)
+        {
+          next = (USBD_MemBlockTypeDef *)&pool[offset + block->size];
+          if(next->used != 0U)
+          {
+            break;
+          }
+          block->size += next->size;
+        }
+      }
+      offset += block->size;
+    }
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Returns the highest count of bytes allocated from the pool at once,
+  *         headers included, to be compared with USBD_MEM_POOL_SIZE
+  * @param  None
+  * @retval high-water mark in bytes
+  */
+uint32_t USBD_static_get_high_water(void)
+{
+  return usbd_mem_pool_high_water;
 }
 
 /**
@@ -36,6 +36,9 @@
 
 /* USER CODE BEGIN INCLUDE */
 #include "hal_usb_ex.h"
+#include "audio_profiler.h"
+#include "audio_trace.h"
+#include "audio_sof_tick.h"
 /* USER CODE END INCLUDE */
 
 /** @addtogroup USBD_OTG_DRIVER
@@ -63,19 +66,148 @@
   */
 
 /*---------- -----------*/
-#define USBD_MAX_NUM_INTERFACES     4U
+/* the mixed play stream is interface 5, its descriptors add about 100 bytes.
+   The telemetry CDC takes the next two interfaces, its descriptors add 66 bytes.
+   The clip upload or bulk capture vendor interface comes last, its descriptors add 23 bytes.
+   The voice record stream is the last audio interface, its descriptors add 83 bytes */
+#ifdef USE_AUDIO_RECORDING_VOICE
+#define USBD_VOICE_NUM_INTERFACES   1U
+#define USBD_VOICE_CONFDESC_SZ      96U
+#else /* USE_AUDIO_RECORDING_VOICE */
+#define USBD_VOICE_NUM_INTERFACES   0U
+#define USBD_VOICE_CONFDESC_SZ      0U
+#endif /* USE_AUDIO_RECORDING_VOICE */
+#if (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+#define USBD_CMPSIT_ACTIVATE_VENDOR 1U
+#define USBD_CLIP_NUM_INTERFACES    1U
+#define USBD_CLIP_CONFDESC_SZ       64U
+#else /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#define USBD_CLIP_NUM_INTERFACES    0U
+#define USBD_CLIP_CONFDESC_SZ       0U
+#endif /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_PLAYBACK_MIX
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define USBD_MAX_NUM_INTERFACES     (7U + USBD_CLIP_NUM_INTERFACES + USBD_VOICE_NUM_INTERFACES)
+#define USBD_CMPST_MAX_CONFDESC_SZ  (768U + USBD_CLIP_CONFDESC_SZ + USBD_VOICE_CONFDESC_SZ)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_MAX_NUM_INTERFACES     (5U + USBD_CLIP_NUM_INTERFACES + USBD_VOICE_NUM_INTERFACES)
+#define USBD_CMPST_MAX_CONFDESC_SZ  (640U + USBD_CLIP_CONFDESC_SZ + USBD_VOICE_CONFDESC_SZ)
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#else /* USE_AUDIO_PLAYBACK_MIX */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define USBD_MAX_NUM_INTERFACES     (6U + USBD_CLIP_NUM_INTERFACES + USBD_VOICE_NUM_INTERFACES)
+#define USBD_CMPST_MAX_CONFDESC_SZ  (640U + USBD_CLIP_CONFDESC_SZ + USBD_VOICE_CONFDESC_SZ)
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_MAX_NUM_INTERFACES     (4U + USBD_CLIP_NUM_INTERFACES + USBD_VOICE_NUM_INTERFACES)
+#define USBD_CMPST_MAX_CONFDESC_SZ  (512U + USBD_CLIP_CONFDESC_SZ + USBD_VOICE_CONFDESC_SZ)
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#endif /* USE_AUDIO_PLAYBACK_MIX */
 /*---------- -----------*/
 #define USBD_MAX_NUM_CONFIGURATION     1U
 /*---------- -----------*/
 #define USBD_MAX_STR_DESC_SIZ     512U
 /*---------- -----------*/
+/* with USE_AUDIO_LOG printf only copies to the log ring, with USE_AUDIO_TRACE_LOG
+   the logs are tokenized in the trace ring : the level may be raised without
+   stalling the USB interrupt */
+#ifndef USBD_DEBUG_LEVEL
 #define USBD_DEBUG_LEVEL     0U
+#endif /* USBD_DEBUG_LEVEL */
 /*---------- -----------*/
 #define USBD_LPM_ENABLED     1U
 /*---------- -----------*/
 #define USBD_SELF_POWERED     1U
 /*---------- -----------*/
 #define USBD_AUDIO_FREQ     22100U
+/*---------- -----------*/
+/* Define USE_USB_HS_DMA to let the OTG_HS internal DMA move endpoint data.
+   Every buffer given to USBD_LL_Transmit/USBD_LL_PrepareReceive must then be
+   32-bit aligned and located in AXI SRAM or SRAM1..SRAM4 (DTCM and ITCM are
+   not reachable by the USB DMA master). */
+#ifdef USE_USB_HS_DMA
+#define USBD_DMA_ENABLED     1U
+#else /* USE_USB_HS_DMA */
+#define USBD_DMA_ENABLED     0U
+#endif /* USE_USB_HS_DMA */
+#define USBD_DMA_BUFFER_ALIGN     4U
+/*---------- -----------*/
+/* Memory placement, sections are defined in STM32H723ZGTX_FLASH.ld :
+   - USBD_ITCM_FUNC : code run from the USB interrupt, copied to ITCM at startup
+   - USBD_DTCM_BSS  : data only accessed by the CPU
+   - USBD_D2_BSS    : data accessed by the USB DMA, D2 SRAM1
+   - USBD_DEBUG_BSS : debug captures (trace, taps, spectrum, loopback delay
+     line, snapshot rings), grouped at the end of .bss so the map file gives their total.
+     Define it as USBD_DTCM_BSS or USBD_D2_BSS to move them
+   USBD_BUFFER_BSS places endpoint and audio buffers in DTCM, or in D2 SRAM
+   when the USB DMA moves them. */
+#define USBD_ITCM_FUNC     __attribute__((section(".itcm_text")))
+#define USBD_DTCM_BSS      __attribute__((section(".dtcm_bss")))
+#define USBD_D2_BSS        __attribute__((section(".d2_bss")))
+#ifdef USE_USB_HS_DMA
+#define USBD_BUFFER_BSS    USBD_D2_BSS
+#else /* USE_USB_HS_DMA */
+#define USBD_BUFFER_BSS    USBD_DTCM_BSS
+#endif /* USE_USB_HS_DMA */
+#ifndef USBD_DEBUG_BSS
+#define USBD_DEBUG_BSS     __attribute__((section(".debug_bss")))
+#endif /* USBD_DEBUG_BSS */
+/*---------- -----------*/
+/* Static arena serving USBD_malloc : class handles (AUDIO, CDC) and audio
+   node packet buffers, its high-water mark is returned by
+   USBD_static_get_high_water() to tune this size. The base size holds the
+   first audio function and the CDC one, each more audio function adds its
+   class handle and node buffers */
+/* audio functions registered with USBD_RegisterClassComposite, usb_device.c
+   registers one. A second one needs its interface callbacks and sessions */
+#ifndef USBD_AUDIO_MAX_INSTANCES
+#define USBD_AUDIO_MAX_INSTANCES  1U
+#endif /* USBD_AUDIO_MAX_INSTANCES */
+#define USBD_MEM_POOL_AUDIO_SIZE  2048U /* class handle and node packet buffers of one more audio function */
+#if (defined USE_AUDIO_CLIP_UPLOAD) || (defined USE_AUDIO_BULK_CAPTURE)
+#define USBD_MEM_POOL_CLIP_SIZE   64U /* vendor class handle */
+#else /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#define USBD_MEM_POOL_CLIP_SIZE   0U
+#endif /* USE_AUDIO_CLIP_UPLOAD || USE_AUDIO_BULK_CAPTURE */
+#ifdef USE_AUDIO_CDC_TELEMETRY
+#define USBD_MEM_POOL_CDC_SIZE    640U /* one more CDC class handle */
+#else /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_MEM_POOL_CDC_SIZE    0U
+#endif /* USE_AUDIO_CDC_TELEMETRY */
+#define USBD_MEM_POOL_SIZE        (4096U + ((USBD_AUDIO_MAX_INSTANCES - 1U) * USBD_MEM_POOL_AUDIO_SIZE) + \
+                                   USBD_MEM_POOL_CDC_SIZE + USBD_MEM_POOL_CLIP_SIZE)
+#define USBD_MEM_POOL_ALIGN       8U
+/*---------- -----------*/
+/* Define USE_USBD_DEFERRED_CONTROL to run EP0, bulk and interrupt endpoint
+   events from a software pended interrupt below OTG_HS : the OTG interrupt
+   then only services iso endpoints and SOF, a long control request or a CDC
+   burst does not delay the iso re-arm. The control level is the pump audio
+   level so control requests and audio work never interleave. */
+#ifdef USE_USBD_DEFERRED_CONTROL
+#define USBD_CTRL_IRQn            FMAC_IRQn /* not used by the application */
+#define USBD_CTRL_IRQHandler      FMAC_IRQHandler
+#define USBD_CTRL_IRQ_PRIORITY    2U
+#define USBD_CTRL_QUEUE_SIZE      8U /* must be a power of two */
+#endif /* USE_USBD_DEFERRED_CONTROL */
+/* Define USE_USBD_FAST_RESET to keep the audio sessions, rings and devices over
+   a bus reset : USBD_LL_Reset only stops the streaming alternates and closes
+   their endpoints, the next SET_CONFIGURATION takes the class handle back
+   without allocation nor descriptor parsing. A detach still tears all down. */
+/* Define USE_AUDIO_USB_ADMISSION to check each streaming alternate the host
+   selects against the periodic bandwidth of a (micro)frame and the FIFO of its
+   endpoint : an alternate the bus or the FIFOs can't carry is refused instead
+   of running with incompletes. USBD_LL_GetIsoFifoSize gives the FIFO side. */
+/* Define USE_USB_DEDICATED_EP1 to give the play OUT and record IN endpoints
+   EP1 and its dedicated OTG_HS_EP1_OUT and OTG_HS_EP1_IN interrupts, the CDC
+   data taking EP3 : their completions skip the HAL_PCD_IRQHandler decoding,
+   which keeps control, CDC, SOF and the iso incompletes. Needs
+   USE_USB_HS_DMA. */
+/* Define USE_AUDIO_USB_LOW_RATE to carry AUDIO_USB_PACKET_MS (2, 4 or 8) of
+   audio in each iso data packet (usbd_audio.h). The core arms an iso transfer
+   for a frame parity and reports an incomplete at the end of each frame with
+   that parity : USBD_LL_SetIsoInterval makes an endpoint sparse, its
+   transfers are armed for the parity the host polls on and
+   USBD_LL_IsoIncompleteIRQHandler , called ahead of HAL_PCD_IRQHandler,
+   ignores the incompletes before the poll is due. */
 
 /****************************************/
 /* #define for FS and HS identification */
@@ -93,10 +225,10 @@
 /* Memory management macros make sure to use static memory allocation */
 /** Alias for memory allocation. */
 
-#define USBD_malloc         (void *)malloc
+#define USBD_malloc         (void *)USBD_static_malloc
 
 /** Alias for memory release. */
-#define USBD_free           free
+#define USBD_free           USBD_static_free
 
 /** Alias for memory set. */
 #define USBD_memset         memset
@@ -107,8 +239,33 @@
 /** Alias for delay. */
 #define USBD_Delay          HAL_Delay
 
+/** Check that a buffer can be used as USB DMA target. */
+#define USBD_DMA_IS_ALIGNED(p)  ((((uint32_t)(p)) & (USBD_DMA_BUFFER_ALIGN - 1U)) == 0U)
+
 /* DEBUG macros */
 
+#ifdef USE_AUDIO_TRACE_LOG
+/* tokenized : the format must be a string literal, the arguments 32 bits integers */
+#include "audio_trace.h"
+
+#if (USBD_DEBUG_LEVEL > 0)
+#define USBD_UsrLog(fmt, ...) AUDIO_TRACE_LOG_FORMAT(fmt "\n", ##__VA_ARGS__)
+#else
+#define USBD_UsrLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 0U) */
+
+#if (USBD_DEBUG_LEVEL > 1)
+#define USBD_ErrLog(fmt, ...) AUDIO_TRACE_LOG_FORMAT("ERROR: " fmt "\n", ##__VA_ARGS__)
+#else
+#define USBD_ErrLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 1U) */
+
+#if (USBD_DEBUG_LEVEL > 2)
+#define USBD_DbgLog(fmt, ...) AUDIO_TRACE_LOG_FORMAT("DEBUG : " fmt "\n", ##__VA_ARGS__)
+#else
+#define USBD_DbgLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 2U) */
+#else /* USE_AUDIO_TRACE_LOG */
 #if (USBD_DEBUG_LEVEL > 0)
 #define USBD_UsrLog(...)    printf(__VA_ARGS__);\
                             printf("\n");
@@ -132,6 +289,7 @@
 #else
 #define USBD_DbgLog(...)
 #endif /* (USBD_DEBUG_LEVEL > 2U) */
+#endif /* USE_AUDIO_TRACE_LOG */
 
 /**
   * @}
@@ -154,6 +312,18 @@
 /* Exported functions -------------------------------------------------------*/
 void *USBD_static_malloc(uint32_t size);
 void USBD_static_free(void *p);
+uint32_t USBD_static_get_high_water(void);
+#ifdef USE_USBD_DEFERRED_CONTROL
+void USBD_LL_ControlIRQHandler(void);
+uint32_t USBD_LL_GetControlLost(void);
+#endif /* USE_USBD_DEFERRED_CONTROL */
+#ifdef USE_USB_DEDICATED_EP1
+void USBD_LL_EP1OutIRQHandler(void);
+void USBD_LL_EP1InIRQHandler(void);
+#endif /* USE_USB_DEDICATED_EP1 */
+#ifdef USE_AUDIO_USB_LOW_RATE
+void USBD_LL_IsoIncompleteIRQHandler(void);
+#endif /* USE_AUDIO_USB_LOW_RATE */
 
 
 void USBD_error_handler(void);